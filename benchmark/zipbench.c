@@ -0,0 +1,1086 @@
+/*
+  zipbench.c -- measure speed of common operations on synthetic archives
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#ifndef HAVE_GETOPT
+#include "getopt.h"
+#endif
+
+#include "opcount.h"
+#include "zip.h"
+
+#define COPY_BUFFER_SIZE (64 * 1024)
+#define READ_BUFFER_SIZE (64 * 1024)
+#define RANDOM_READ_LENGTH 4096
+#define RANDOM_READ_COUNT 10000
+#define MODIFY_EVERY 10 /* every n-th file is replaced or deleted */
+#define SEED 0x6c69627a6970ULL
+#define HUGE_LENGTH ((zip_uint64_t)100 * 1024 * 1024 * 1024)
+
+/* Description of synthetic corpus, all data and names are derived from fixed seeds. */
+typedef struct {
+    const char *name;
+    zip_uint64_t count;      /* number of files */
+    zip_uint64_t min_length; /* lengths are evenly distributed in [min_length, max_length] */
+    zip_uint64_t max_length;
+    bool scale_length; /* scale applies to lengths instead of count */
+    bool incompressible;
+    zip_int32_t method;
+    zip_uint64_t per_directory; /* number of files per directory, 0 for no directories */
+    const char *suffix;
+    bool sparse; /* data is all NULs, archive is kept in compact form by source_hole.c; only run when selected */
+} corpus_spec_t;
+
+static const corpus_spec_t corpus_specs[] = {
+    {"many-small", 20000, 256, 4096, false, false, ZIP_CM_DEFAULT, 100, ".txt", false},
+    /* stored, so random reads can seek */
+    {"few-huge", 4, 32 * 1024 * 1024, 32 * 1024 * 1024, true, false, ZIP_CM_STORE, 0, ".bin", false},
+    {"incompressible", 256, 256 * 1024, 256 * 1024, true, true, ZIP_CM_DEFAULT, 16, ".bin", false},
+    {"million-entry", 1000000, 0, 32, false, false, ZIP_CM_DEFAULT, 1000, "", false},
+    /* Zip64 archives too large for disk: the central directory takes about 1.2 GB of memory, the data of the files takes none */
+    {"zip64-many", 10000000, 0, 0, false, false, ZIP_CM_STORE, 10000, "", true},
+    {"zip64-huge", 2, HUGE_LENGTH, HUGE_LENGTH, true, false, ZIP_CM_STORE, 0, ".bin", true},
+};
+
+typedef struct {
+    const corpus_spec_t *spec;
+    zip_uint64_t count;
+    char *names;               /* all names, NUL terminated */
+    zip_uint64_t *name_offset; /* offset of name of each file in names */
+    zip_uint8_t *data;         /* data of all files, NULL for sparse corpora */
+    zip_uint64_t *data_offset; /* offset of data of each file in data, with one extra element for the end */
+    char *archive;             /* file name of corpus archive */
+    char *work;                /* file name of copy modified by benchmarks */
+} corpus_t;
+
+/* Result of one run of a benchmark. */
+typedef struct {
+    double seconds;
+    zip_uint64_t operations; /* number of files or lookups processed */
+    zip_uint64_t bytes;      /* uncompressed data processed */
+    opcount_t counts;        /* allocations and I/O calls, if counted */
+    double start;
+} run_t;
+
+typedef int (*benchmark_fn)(const corpus_t *corpus, run_t *run);
+
+/* source of NULs, for data of sparse corpora */
+typedef struct {
+    zip_error_t error;
+    zip_uint64_t length;
+    zip_uint64_t offset;
+} zeros_t;
+
+zip_source_t *source_hole_create(const char *, int flags, zip_error_t *);
+
+static int bench_add(const corpus_t *corpus, run_t *run);
+static int bench_delete(const corpus_t *corpus, run_t *run);
+static int bench_locate(const corpus_t *corpus, run_t *run);
+static int bench_open(const corpus_t *corpus, run_t *run);
+static int bench_open_threadsafe(const corpus_t *corpus, run_t *run);
+static int bench_read_random(const corpus_t *corpus, run_t *run);
+static int bench_read_sequential(const corpus_t *corpus, run_t *run);
+static int bench_read_sequential_nocrc(const corpus_t *corpus, run_t *run);
+static int bench_replace(const corpus_t *corpus, run_t *run);
+static int bench_torrentzip(const corpus_t *corpus, run_t *run);
+
+static const struct {
+    const char *name;
+    benchmark_fn run;
+    bool all_data; /* processes all data, only run on sparse corpora when selected */
+} benchmarks[] = {
+    {"open", bench_open, false},
+    {"open-threadsafe", bench_open_threadsafe, false},
+    {"locate", bench_locate, false},
+    {"read-sequential", bench_read_sequential, true},
+    {"read-sequential-nocrc", bench_read_sequential_nocrc, true},
+    {"read-random", bench_read_random, false},
+    {"add", bench_add, true},
+    {"replace", bench_replace, false},
+    {"delete", bench_delete, false},
+    {"torrentzip", bench_torrentzip, true},
+};
+
+#define NUM_CORPORA (sizeof(corpus_specs) / sizeof(corpus_specs[0]))
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static const char *prg;
+static double scale = 1.0;
+static opcount_get_fn get_counts = NULL; /* set if libopcount is preloaded */
+
+static const char *usage = "usage: %s [-hjk] [-d dir] [-n repetitions] [-s scale] [corpus | benchmark ...]\n";
+static const char *help_head = "zipbench (" PACKAGE ") " VERSION ", measure speed of libzip on synthetic archives\n\n";
+static const char *help = "\n"
+                          "  -d dir          create archives in dir (default: current directory)\n"
+                          "  -h              display this help message\n"
+                          "  -j              write results as JSON\n"
+                          "  -k              keep created archives\n"
+                          "  -n repetitions  run each benchmark this many times (default: 3)\n"
+                          "  -s scale        scale number or size of files by this factor (default: 1)\n"
+                          "\n"
+                          "Arguments restrict which corpora and benchmarks are run.\n"
+                          "The sparse corpora zip64-many and zip64-huge are only run when named,\n"
+                          "read-sequential, read-sequential-nocrc, add, and torrentzip only when also named.\n"
+                          "\n"
+                          "When libopcount from the regression tests is preloaded, allocations and\n"
+                          "read, write, and seek calls per operation are reported too.\n";
+
+static zip_source_t *archive_source(const corpus_t *corpus, const char *fname, int flags, zip_error_t *error);
+static int compare_double(const void *a, const void *b);
+static int copy_file(const char *from, const char *to);
+static void corpus_free(corpus_t *corpus);
+static int corpus_init(corpus_t *corpus, const corpus_spec_t *spec, const char *dir);
+static size_t corpus_name(const corpus_spec_t *spec, zip_uint64_t index, char *name, size_t size);
+static zip_source_t *corpus_source(zip_t *za, const corpus_t *corpus, zip_uint64_t index);
+static int corpus_write(const corpus_t *corpus, const char *fname, run_t *run);
+static char *make_path(const char *dir, const char *name, const char *suffix);
+static bool named(const char *name, char **args, int nargs);
+static double now(void);
+static double per_operation(unsigned long long count, const run_t *run);
+static zip_t *open_archive(const corpus_t *corpus, const char *fname, int flags);
+static zip_uint64_t random_next(zip_uint64_t *state);
+static int read_file(zip_file_t *zf, zip_uint8_t *buffer, zip_uint64_t *bytesp);
+static void run_start(run_t *run);
+static void run_stop(run_t *run);
+static zip_uint64_t scaled(zip_uint64_t value);
+static bool selected(const char *name, char **args, int nargs, bool *matched, bool is_corpus);
+static zip_source_t *zeros_create(zip_t *za, zip_uint64_t length);
+static zip_int64_t zeros_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t command);
+
+
+int
+main(int argc, char *argv[]) {
+    const char *dir = ".";
+    bool json = false, keep = false, first = true;
+    int repetitions = 3;
+    bool *matched;
+    int c, ret = 0;
+    size_t i, j;
+    double *seconds;
+
+    prg = argv[0];
+
+    while ((c = getopt(argc, argv, "d:hjkn:s:")) != -1) {
+        switch (c) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 'h':
+            fputs(help_head, stdout);
+            printf(usage, prg);
+            fputs(help, stdout);
+            exit(0);
+        case 'j':
+            json = true;
+            break;
+        case 'k':
+            keep = true;
+            break;
+        case 'n':
+            repetitions = atoi(optarg);
+            if (repetitions < 1) {
+                fprintf(stderr, "%s: invalid number of repetitions '%s'\n", prg, optarg);
+                exit(1);
+            }
+            break;
+        case 's':
+            scale = strtod(optarg, NULL);
+            if (scale <= 0) {
+                fprintf(stderr, "%s: invalid scale '%s'\n", prg, optarg);
+                exit(1);
+            }
+            break;
+        default:
+            fprintf(stderr, usage, prg);
+            exit(2);
+        }
+    }
+
+    if ((matched = (bool *)calloc((size_t)(argc - optind) + 1, sizeof(*matched))) == NULL || (seconds = (double *)malloc((size_t)repetitions * sizeof(*seconds))) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        exit(1);
+    }
+
+    /* check for unknown names before spending time on creating corpora */
+    for (i = 0; i < NUM_CORPORA; i++) {
+        selected(corpus_specs[i].name, argv + optind, argc - optind, matched, true);
+    }
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        selected(benchmarks[i].name, argv + optind, argc - optind, matched, false);
+    }
+    for (c = 0; c < argc - optind; c++) {
+        if (!matched[c]) {
+            fprintf(stderr, "%s: unknown corpus or benchmark '%s'\n", prg, argv[optind + c]);
+            exit(1);
+        }
+    }
+
+#ifndef _WIN32
+    {
+        void *self;
+
+        if ((self = dlopen(NULL, RTLD_LAZY)) != NULL) {
+            get_counts = (opcount_get_fn)dlsym(self, "opcount_get");
+        }
+    }
+#endif
+
+    if (json) {
+        printf("{\n  \"libzip_version\": \"%s\",\n  \"scale\": %g,\n  \"repetitions\": %d,\n  \"results\": [", zip_libzip_version(), scale, repetitions);
+    }
+    else {
+        printf("libzip %s, scale %g, %d repetitions\n", zip_libzip_version(), scale, repetitions);
+        printf("%-15s %-21s %10s %12s %12s %10s", "corpus", "benchmark", "operations", "min s", "median s", "MB/s");
+        if (get_counts != NULL) {
+            printf(" %10s %10s %10s %10s %10s %10s", "allocs/op", "frees/op", "KB/op", "reads/op", "writes/op", "seeks/op");
+        }
+        printf("\n");
+    }
+
+    for (i = 0; i < NUM_CORPORA && ret == 0; i++) {
+        corpus_t corpus;
+        run_t run;
+
+        if (!selected(corpus_specs[i].name, argv + optind, argc - optind, matched, true) || (corpus_specs[i].sparse && !named(corpus_specs[i].name, argv + optind, argc - optind))) {
+            continue;
+        }
+
+        if (corpus_init(&corpus, corpus_specs + i, dir) < 0 || corpus_write(&corpus, corpus.archive, &run) < 0) {
+            corpus_free(&corpus);
+            ret = 1;
+            break;
+        }
+
+        for (j = 0; j < NUM_BENCHMARKS; j++) {
+            double median;
+            int k;
+
+            if (!selected(benchmarks[j].name, argv + optind, argc - optind, matched, false) || (corpus.spec->sparse && benchmarks[j].all_data && !named(benchmarks[j].name, argv + optind, argc - optind))) {
+                continue;
+            }
+
+            for (k = 0; k < repetitions; k++) {
+                if (benchmarks[j].run(&corpus, &run) < 0) {
+                    ret = 1;
+                    break;
+                }
+                seconds[k] = run.seconds;
+            }
+            if (ret != 0) {
+                break;
+            }
+
+            qsort(seconds, (size_t)repetitions, sizeof(seconds[0]), compare_double);
+            median = repetitions % 2 ? seconds[repetitions / 2] : (seconds[repetitions / 2 - 1] + seconds[repetitions / 2]) / 2;
+
+            /* counts are those of the last run, they don't vary like times */
+            if (json) {
+                printf("%s\n    {\"corpus\": \"%s\", \"benchmark\": \"%s\", \"files\": %llu, \"operations\": %llu, \"bytes\": %llu, \"min_seconds\": %.6f, \"median_seconds\": %.6f", first ? "" : ",", corpus.spec->name, benchmarks[j].name, (unsigned long long)corpus.count, (unsigned long long)run.operations, (unsigned long long)run.bytes, seconds[0], median);
+                if (get_counts != NULL) {
+                    printf(", \"allocations\": %llu, \"frees\": %llu, \"bytes_allocated\": %llu, \"reads\": %llu, \"writes\": %llu, \"seeks\": %llu", run.counts.allocations, run.counts.frees, run.counts.bytes_allocated, run.counts.reads, run.counts.writes, run.counts.seeks);
+                }
+                printf("}");
+                first = false;
+            }
+            else {
+                printf("%-15s %-21s %10llu %12.6f %12.6f ", corpus.spec->name, benchmarks[j].name, (unsigned long long)run.operations, seconds[0], median);
+                if (run.bytes > 0) {
+                    printf("%10.1f", (double)run.bytes / (1024 * 1024) / median);
+                }
+                else {
+                    printf("%10s", "-");
+                }
+                if (get_counts != NULL) {
+                    printf(" %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f", per_operation(run.counts.allocations, &run), per_operation(run.counts.frees, &run), per_operation(run.counts.bytes_allocated, &run) / 1024, per_operation(run.counts.reads, &run), per_operation(run.counts.writes, &run), per_operation(run.counts.seeks, &run));
+                }
+                printf("\n");
+            }
+            fflush(stdout);
+        }
+
+        if (!keep) {
+            remove(corpus.archive);
+        }
+        remove(corpus.work);
+        corpus_free(&corpus);
+    }
+
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+
+    free(matched);
+    free(seconds);
+    return ret;
+}
+
+
+/* Create new archive containing all files of corpus. */
+static int
+bench_add(const corpus_t *corpus, run_t *run) {
+    return corpus_write(corpus, corpus->work, run);
+}
+
+
+/* Delete every tenth file from copy of corpus archive. */
+static int
+bench_delete(const corpus_t *corpus, run_t *run) {
+    zip_t *za;
+    zip_uint64_t i;
+
+    if (copy_file(corpus->archive, corpus->work) < 0) {
+        return -1;
+    }
+
+    run->operations = 0;
+    run->bytes = 0;
+    run_start(run);
+    if ((za = open_archive(corpus, corpus->work, 0)) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < corpus->count; i += MODIFY_EVERY) {
+        if (zip_delete(za, i) < 0) {
+            fprintf(stderr, "%s: can't delete file %llu: %s\n", prg, (unsigned long long)i, zip_strerror(za));
+            zip_discard(za);
+            return -1;
+        }
+        run->operations++;
+    }
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write '%s': %s\n", prg, corpus->work, zip_strerror(za));
+        zip_discard(za);
+        return -1;
+    }
+    run_stop(run);
+
+    return 0;
+}
+
+
+/* Look up all files by name, in random order. */
+static int
+bench_locate(const corpus_t *corpus, run_t *run) {
+    zip_uint64_t *order;
+    zip_uint64_t i, state = SEED;
+    zip_t *za;
+
+    if ((order = (zip_uint64_t *)malloc((size_t)corpus->count * sizeof(*order))) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+    for (i = 0; i < corpus->count; i++) {
+        order[i] = i;
+    }
+    for (i = corpus->count; i > 1; i--) {
+        zip_uint64_t j = random_next(&state) % i;
+        zip_uint64_t tmp = order[i - 1];
+
+        order[i - 1] = order[j];
+        order[j] = tmp;
+    }
+
+    if ((za = open_archive(corpus, corpus->archive, ZIP_RDONLY)) == NULL) {
+        free(order);
+        return -1;
+    }
+
+    run_start(run);
+    for (i = 0; i < corpus->count; i++) {
+        if (zip_name_locate(za, corpus->names + corpus->name_offset[order[i]], 0) != (zip_int64_t)order[i]) {
+            fprintf(stderr, "%s: can't find '%s'\n", prg, corpus->names + corpus->name_offset[order[i]]);
+            zip_discard(za);
+            free(order);
+            return -1;
+        }
+    }
+    run_stop(run);
+    run->operations = corpus->count;
+    run->bytes = 0;
+
+    zip_discard(za);
+    free(order);
+    return 0;
+}
+
+
+/* Open archive with flags, excluding creating its source, which reads sparse archives into memory. */
+static int
+bench_open_flags(const corpus_t *corpus, run_t *run, int flags) {
+    zip_source_t *src;
+    zip_error_t error;
+    zip_t *za;
+
+    zip_error_init(&error);
+    if ((src = archive_source(corpus, corpus->archive, ZIP_RDONLY, &error)) == NULL) {
+        fprintf(stderr, "%s: can't open '%s': %s\n", prg, corpus->archive, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return -1;
+    }
+
+    run_start(run);
+    if ((za = zip_open_from_source(src, flags, &error)) == NULL) {
+        fprintf(stderr, "%s: can't open '%s': %s\n", prg, corpus->archive, zip_error_strerror(&error));
+        zip_source_free(src);
+        zip_error_fini(&error);
+        return -1;
+    }
+    zip_discard(za);
+    run_stop(run);
+    zip_error_fini(&error);
+    run->operations = 1;
+    run->bytes = 0;
+
+    return 0;
+}
+
+
+static int
+bench_open(const corpus_t *corpus, run_t *run) {
+    return bench_open_flags(corpus, run, ZIP_RDONLY);
+}
+
+
+/* Large central directories are parsed in several threads. */
+static int
+bench_open_threadsafe(const corpus_t *corpus, run_t *run) {
+    return bench_open_flags(corpus, run, ZIP_RDONLY | ZIP_THREADSAFE);
+}
+
+
+/* Read short pieces of randomly chosen files, from random offsets if they are seekable. */
+static int
+bench_read_random(const corpus_t *corpus, run_t *run) {
+    zip_uint8_t buffer[RANDOM_READ_LENGTH];
+    zip_uint64_t i, count, state = SEED;
+    zip_t *za;
+
+    if ((za = open_archive(corpus, corpus->archive, ZIP_RDONLY)) == NULL) {
+        return -1;
+    }
+
+    count = scaled(RANDOM_READ_COUNT);
+    run->operations = count;
+    run->bytes = 0;
+    run_start(run);
+    for (i = 0; i < count; i++) {
+        zip_uint64_t index = random_next(&state) % corpus->count;
+        zip_uint64_t length = corpus->data_offset[index + 1] - corpus->data_offset[index];
+        zip_file_t *zf;
+        zip_int64_t n;
+
+        if ((zf = zip_fopen_index(za, index, 0)) == NULL) {
+            fprintf(stderr, "%s: can't open file %llu: %s\n", prg, (unsigned long long)index, zip_strerror(za));
+            zip_discard(za);
+            return -1;
+        }
+        if (length > RANDOM_READ_LENGTH && zip_file_is_seekable(zf) == 1) {
+            if (zip_fseek(zf, (zip_int64_t)(random_next(&state) % (length - RANDOM_READ_LENGTH)), SEEK_SET) < 0) {
+                fprintf(stderr, "%s: can't seek in file %llu: %s\n", prg, (unsigned long long)index, zip_file_strerror(zf));
+                zip_fclose(zf);
+                zip_discard(za);
+                return -1;
+            }
+        }
+        if ((n = zip_fread(zf, buffer, sizeof(buffer))) < 0) {
+            fprintf(stderr, "%s: can't read file %llu: %s\n", prg, (unsigned long long)index, zip_file_strerror(zf));
+            zip_fclose(zf);
+            zip_discard(za);
+            return -1;
+        }
+        run->bytes += (zip_uint64_t)n;
+        zip_fclose(zf);
+    }
+    run_stop(run);
+
+    zip_discard(za);
+    return 0;
+}
+
+
+/* Read all files completely, in archive order, opening the archive with flags. */
+static int
+bench_read_sequential_flags(const corpus_t *corpus, run_t *run, int flags) {
+    zip_uint8_t *buffer;
+    zip_uint64_t i;
+    zip_t *za;
+
+    if ((buffer = (zip_uint8_t *)malloc(READ_BUFFER_SIZE)) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+
+    run->operations = corpus->count;
+    run->bytes = 0;
+    run_start(run);
+    if ((za = open_archive(corpus, corpus->archive, flags)) == NULL) {
+        free(buffer);
+        return -1;
+    }
+    for (i = 0; i < corpus->count; i++) {
+        zip_file_t *zf;
+
+        if ((zf = zip_fopen_index(za, i, 0)) == NULL) {
+            fprintf(stderr, "%s: can't open file %llu: %s\n", prg, (unsigned long long)i, zip_strerror(za));
+            zip_discard(za);
+            free(buffer);
+            return -1;
+        }
+        if (read_file(zf, buffer, &run->bytes) < 0) {
+            fprintf(stderr, "%s: can't read file %llu: %s\n", prg, (unsigned long long)i, zip_file_strerror(zf));
+            zip_fclose(zf);
+            zip_discard(za);
+            free(buffer);
+            return -1;
+        }
+        zip_fclose(zf);
+    }
+    zip_discard(za);
+    run_stop(run);
+
+    free(buffer);
+    return 0;
+}
+
+
+static int
+bench_read_sequential(const corpus_t *corpus, run_t *run) {
+    return bench_read_sequential_flags(corpus, run, ZIP_RDONLY);
+}
+
+
+/* Trusted archives are read without checking the CRC of their data. */
+static int
+bench_read_sequential_nocrc(const corpus_t *corpus, run_t *run) {
+    return bench_read_sequential_flags(corpus, run, ZIP_RDONLY | ZIP_SKIP_CRC_CHECK);
+}
+
+
+/* Replace every tenth file in copy of corpus archive with the same data. */
+static int
+bench_replace(const corpus_t *corpus, run_t *run) {
+    zip_t *za;
+    zip_uint64_t i;
+
+    if (copy_file(corpus->archive, corpus->work) < 0) {
+        return -1;
+    }
+
+    run->operations = 0;
+    run->bytes = 0;
+    run_start(run);
+    if ((za = open_archive(corpus, corpus->work, 0)) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < corpus->count; i += MODIFY_EVERY) {
+        zip_source_t *src;
+
+        if ((src = corpus_source(za, corpus, i)) == NULL || zip_file_replace(za, i, src, 0) < 0 || zip_set_file_compression(za, i, corpus->spec->method, 0) < 0) {
+            fprintf(stderr, "%s: can't replace file %llu: %s\n", prg, (unsigned long long)i, zip_strerror(za));
+            zip_source_free(src);
+            zip_discard(za);
+            return -1;
+        }
+        run->operations++;
+        run->bytes += corpus->data_offset[i + 1] - corpus->data_offset[i];
+    }
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write '%s': %s\n", prg, corpus->work, zip_strerror(za));
+        zip_discard(za);
+        return -1;
+    }
+    run_stop(run);
+
+    return 0;
+}
+
+
+/* Convert copy of corpus archive to torrentzip. */
+static int
+bench_torrentzip(const corpus_t *corpus, run_t *run) {
+    zip_t *za;
+
+    if (copy_file(corpus->archive, corpus->work) < 0) {
+        return -1;
+    }
+
+    run_start(run);
+    if ((za = open_archive(corpus, corpus->work, 0)) == NULL) {
+        return -1;
+    }
+    if (zip_set_archive_flag(za, ZIP_AFL_WANT_TORRENTZIP, 1) < 0 || zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write '%s' as torrentzip: %s\n", prg, corpus->work, zip_strerror(za));
+        zip_discard(za);
+        return -1;
+    }
+    run_stop(run);
+    run->operations = corpus->count;
+    run->bytes = corpus->data_offset[corpus->count];
+
+    return 0;
+}
+
+
+static zip_source_t *
+archive_source(const corpus_t *corpus, const char *fname, int flags, zip_error_t *error) {
+    if (corpus->spec->sparse) {
+        return source_hole_create(fname, flags, error);
+    }
+    return zip_source_file_create(fname, 0, ZIP_LENGTH_TO_END, error);
+}
+
+
+static int
+compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static int
+copy_file(const char *from, const char *to) {
+    FILE *fin, *fout;
+    char *buffer;
+    size_t n;
+    int ret = 0;
+
+    if ((buffer = (char *)malloc(COPY_BUFFER_SIZE)) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+    if ((fin = fopen(from, "rb")) == NULL) {
+        fprintf(stderr, "%s: can't open '%s'\n", prg, from);
+        free(buffer);
+        return -1;
+    }
+    if ((fout = fopen(to, "wb")) == NULL) {
+        fprintf(stderr, "%s: can't create '%s'\n", prg, to);
+        fclose(fin);
+        free(buffer);
+        return -1;
+    }
+
+    while ((n = fread(buffer, 1, COPY_BUFFER_SIZE, fin)) > 0) {
+        if (fwrite(buffer, 1, n, fout) != n) {
+            ret = -1;
+            break;
+        }
+    }
+    if (ferror(fin)) {
+        ret = -1;
+    }
+    if (fclose(fout) != 0) {
+        ret = -1;
+    }
+    fclose(fin);
+    free(buffer);
+
+    if (ret < 0) {
+        fprintf(stderr, "%s: can't copy '%s' to '%s'\n", prg, from, to);
+    }
+    return ret;
+}
+
+
+static void
+corpus_free(corpus_t *corpus) {
+    free(corpus->names);
+    free(corpus->name_offset);
+    free(corpus->data);
+    free(corpus->data_offset);
+    free(corpus->archive);
+    free(corpus->work);
+}
+
+
+/* Create names and data of all files of corpus in memory. */
+static int
+corpus_init(corpus_t *corpus, const corpus_spec_t *spec, const char *dir) {
+    static const char *words[] = {"archive", "central", "compress", "data", "directory", "entry", "file", "header", "libzip", "local", "stream", "zip"};
+    zip_uint64_t i, names_size, data_size, state = SEED;
+    char name[64];
+
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->spec = spec;
+    corpus->count = spec->scale_length ? spec->count : scaled(spec->count);
+
+    if ((corpus->archive = make_path(dir, spec->name, spec->sparse ? ".zh" : ".zip")) == NULL || (corpus->work = make_path(dir, spec->name, spec->sparse ? "-work.zh" : "-work.zip")) == NULL || (corpus->name_offset = (zip_uint64_t *)malloc((size_t)corpus->count * sizeof(*corpus->name_offset))) == NULL || (corpus->data_offset = (zip_uint64_t *)malloc((size_t)(corpus->count + 1) * sizeof(*corpus->data_offset))) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+
+    names_size = data_size = 0;
+    for (i = 0; i < corpus->count; i++) {
+        zip_uint64_t min_length = spec->scale_length ? scaled(spec->min_length) : spec->min_length;
+        zip_uint64_t max_length = spec->scale_length ? scaled(spec->max_length) : spec->max_length;
+
+        corpus->name_offset[i] = names_size;
+        names_size += (zip_uint64_t)corpus_name(spec, i, name, sizeof(name)) + 1;
+
+        corpus->data_offset[i] = data_size;
+        data_size += min_length + random_next(&state) % (max_length - min_length + 1);
+    }
+    corpus->data_offset[corpus->count] = data_size;
+
+    if ((corpus->names = (char *)malloc((size_t)names_size)) == NULL || (!spec->sparse && (corpus->data = (zip_uint8_t *)malloc(data_size > 0 ? (size_t)data_size : 1)) == NULL)) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+
+    for (i = 0; i < corpus->count; i++) {
+        corpus_name(spec, i, corpus->names + corpus->name_offset[i], sizeof(name));
+    }
+
+    if (spec->sparse) {
+        return 0;
+    }
+
+    if (spec->incompressible) {
+        for (i = 0; i < data_size; i++) {
+            corpus->data[i] = (zip_uint8_t)(random_next(&state) >> 56);
+        }
+    }
+    else {
+        /* text made of random words, compresses about as well as prose */
+        i = 0;
+        while (i < data_size) {
+            const char *word = words[random_next(&state) % (sizeof(words) / sizeof(words[0]))];
+            size_t length = strlen(word);
+
+            if (length > data_size - i) {
+                length = (size_t)(data_size - i);
+            }
+            memcpy(corpus->data + i, word, length);
+            i += length;
+            if (i < data_size) {
+                corpus->data[i++] = random_next(&state) % 8 == 0 ? '\n' : ' ';
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* Write name of file index to name, return its length. */
+static size_t
+corpus_name(const corpus_spec_t *spec, zip_uint64_t index, char *name, size_t size) {
+    if (spec->per_directory > 0) {
+        snprintf(name, size, "dir%llu/file%llu%s", (unsigned long long)(index / spec->per_directory), (unsigned long long)index, spec->suffix);
+    }
+    else {
+        snprintf(name, size, "file%llu%s", (unsigned long long)index, spec->suffix);
+    }
+    return strlen(name);
+}
+
+
+static zip_source_t *
+corpus_source(zip_t *za, const corpus_t *corpus, zip_uint64_t index) {
+    if (corpus->data == NULL) {
+        return zeros_create(za, corpus->data_offset[index + 1] - corpus->data_offset[index]);
+    }
+    return zip_source_buffer(za, corpus->data + corpus->data_offset[index], corpus->data_offset[index + 1] - corpus->data_offset[index], 0);
+}
+
+
+/* Write all files of corpus to new archive fname. */
+static int
+corpus_write(const corpus_t *corpus, const char *fname, run_t *run) {
+    zip_t *za;
+    zip_uint64_t i;
+
+    run_start(run);
+    if ((za = open_archive(corpus, fname, ZIP_CREATE | ZIP_TRUNCATE)) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < corpus->count; i++) {
+        zip_source_t *src;
+        zip_int64_t idx;
+
+        if ((src = corpus_source(za, corpus, i)) == NULL || (idx = zip_file_add(za, corpus->names + corpus->name_offset[i], src, 0)) < 0 || zip_set_file_compression(za, (zip_uint64_t)idx, corpus->spec->method, 0) < 0) {
+            fprintf(stderr, "%s: can't add file %llu: %s\n", prg, (unsigned long long)i, zip_strerror(za));
+            zip_source_free(src);
+            zip_discard(za);
+            return -1;
+        }
+    }
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write '%s': %s\n", prg, fname, zip_strerror(za));
+        zip_discard(za);
+        return -1;
+    }
+    run_stop(run);
+    run->operations = corpus->count;
+    run->bytes = corpus->data_offset[corpus->count];
+
+    return 0;
+}
+
+
+static char *
+make_path(const char *dir, const char *name, const char *suffix) {
+    size_t length = strlen(dir) + strlen(name) + strlen(suffix) + 2;
+    char *path;
+
+    if ((path = (char *)malloc(length)) == NULL) {
+        return NULL;
+    }
+    snprintf(path, length, "%s/%s%s", dir, name, suffix);
+    return path;
+}
+
+
+/* Return whether name is given in args. */
+static bool
+named(const char *name, char **args, int nargs) {
+    int i;
+
+    for (i = 0; i < nargs; i++) {
+        if (strcmp(args[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Start measuring run. */
+static void
+run_start(run_t *run) {
+    if (get_counts != NULL) {
+        get_counts(&run->counts);
+    }
+    run->start = now();
+}
+
+
+/* Stop measuring run, leaving the counts of what happened in between. */
+static void
+run_stop(run_t *run) {
+    opcount_t end;
+
+    run->seconds = now() - run->start;
+    if (get_counts != NULL) {
+        get_counts(&end);
+        run->counts.allocations = end.allocations - run->counts.allocations;
+        run->counts.frees = end.frees - run->counts.frees;
+        run->counts.bytes_allocated = end.bytes_allocated - run->counts.bytes_allocated;
+        run->counts.reads = end.reads - run->counts.reads;
+        run->counts.writes = end.writes - run->counts.writes;
+        run->counts.seeks = end.seeks - run->counts.seeks;
+    }
+}
+
+
+static double
+per_operation(unsigned long long count, const run_t *run) {
+    return (double)count / (double)(run->operations > 0 ? run->operations : 1);
+}
+
+
+/* Wall clock time in seconds, since work may be done in threads. */
+static double
+now(void) {
+#ifdef TIME_UTC
+    struct timespec ts;
+
+    if (timespec_get(&ts, TIME_UTC) != 0) {
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    }
+#endif
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+
+static zip_t *
+open_archive(const corpus_t *corpus, const char *fname, int flags) {
+    zip_source_t *src;
+    zip_error_t error;
+    zip_t *za;
+
+    zip_error_init(&error);
+    if ((src = archive_source(corpus, fname, flags, &error)) == NULL || (za = zip_open_from_source(src, flags, &error)) == NULL) {
+        fprintf(stderr, "%s: can't open '%s': %s\n", prg, fname, zip_error_strerror(&error));
+        zip_source_free(src);
+        zip_error_fini(&error);
+        return NULL;
+    }
+    zip_error_fini(&error);
+
+    return za;
+}
+
+
+/* xorshift64*, so corpora are the same on all platforms */
+static zip_uint64_t
+random_next(zip_uint64_t *state) {
+    zip_uint64_t x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+
+static int
+read_file(zip_file_t *zf, zip_uint8_t *buffer, zip_uint64_t *bytesp) {
+    zip_int64_t n;
+
+    while ((n = zip_fread(zf, buffer, READ_BUFFER_SIZE)) > 0) {
+        *bytesp += (zip_uint64_t)n;
+    }
+    return n < 0 ? -1 : 0;
+}
+
+
+static zip_uint64_t
+scaled(zip_uint64_t value) {
+    double v = (double)value * scale;
+
+    return v < 1 ? 1 : (zip_uint64_t)v;
+}
+
+
+/* Return whether name is selected by args; args only restrict the kind of names they match. */
+static bool
+selected(const char *name, char **args, int nargs, bool *matched, bool is_corpus) {
+    bool any = false, found = false;
+    int i;
+    size_t j;
+
+    for (i = 0; i < nargs; i++) {
+        bool arg_is_corpus = false;
+
+        for (j = 0; j < NUM_CORPORA; j++) {
+            if (strcmp(args[i], corpus_specs[j].name) == 0) {
+                arg_is_corpus = true;
+            }
+        }
+        if (arg_is_corpus != is_corpus) {
+            continue;
+        }
+        any = true;
+        if (strcmp(args[i], name) == 0) {
+            matched[i] = true;
+            found = true;
+        }
+    }
+
+    return !any || found;
+}
+
+
+static zip_source_t *
+zeros_create(zip_t *za, zip_uint64_t length) {
+    zip_source_t *src;
+    zeros_t *ctx;
+
+    if ((ctx = (zeros_t *)malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(zip_get_error(za), ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    zip_error_init(&ctx->error);
+    ctx->length = length;
+    ctx->offset = 0;
+
+    if ((src = zip_source_function(za, zeros_cb, ctx)) == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    return src;
+}
+
+
+static zip_int64_t
+zeros_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t command) {
+    zeros_t *ctx = (zeros_t *)ud;
+
+    switch (command) {
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        zip_error_fini(&ctx->error);
+        free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_OPEN:
+        ctx->offset = 0;
+        return 0;
+
+    case ZIP_SOURCE_READ:
+        if (length > ctx->length - ctx->offset) {
+            length = ctx->length - ctx->offset;
+        }
+        memset(data, 0, (size_t)length);
+        ctx->offset += length;
+        return (zip_int64_t)length;
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, length, &ctx->error);
+
+        if (st == NULL) {
+            return -1;
+        }
+        st->valid |= ZIP_STAT_SIZE;
+        st->size = ctx->length;
+        return 0;
+    }
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_CLOSE, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_STAT, -1);
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
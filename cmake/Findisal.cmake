@@ -0,0 +1,135 @@
+# Copyright (C) 2026 Dieter Baron and Thomas Klausner
+#
+# The authors can be contacted at <info@libzip.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# 1. Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in
+#   the documentation and/or other materials provided with the
+#   distribution.
+#
+# 3. The names of the authors may not be used to endorse or promote
+#   products derived from this software without specific prior
+#   written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+# OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#[=======================================================================[.rst:
+Findisal
+--------
+
+Finds the ISA-L (Intel Intelligent Storage Acceleration) library.
+
+Imported Targets
+^^^^^^^^^^^^^^^^
+
+This module provides the following imported targets, if found:
+
+``isal::isal``
+  The ISA-L library
+
+Result Variables
+^^^^^^^^^^^^^^^^
+
+This will define the following variables:
+
+``isal_FOUND``
+  True if the system has the ISA-L library.
+``isal_VERSION``
+  The version of the ISA-L library which was found.
+``isal_INCLUDE_DIRS``
+  Include directories needed to use ISA-L.
+``isal_LIBRARIES``
+  Libraries needed to link to ISA-L.
+
+Cache Variables
+^^^^^^^^^^^^^^^
+
+The following cache variables may also be set:
+
+``isal_INCLUDE_DIR``
+  The directory containing ``isa-l.h``.
+``isal_LIBRARY``
+  The path to the ISA-L library.
+
+#]=======================================================================]
+
+find_package(PkgConfig)
+pkg_check_modules(PC_isal QUIET libisal)
+
+find_path(isal_INCLUDE_DIR
+  NAMES isa-l.h
+  PATHS ${PC_isal_INCLUDE_DIRS}
+)
+find_library(isal_LIBRARY
+  NAMES isal libisal
+  PATHS ${PC_isal_LIBRARY_DIRS}
+)
+
+# Extract version information from the header file
+if(isal_INCLUDE_DIR)
+  file(STRINGS ${isal_INCLUDE_DIR}/isa-l.h _ver_major_line
+       REGEX "^#define ISAL_MAJOR_VERSION  *[0-9]+"
+       LIMIT_COUNT 1)
+  string(REGEX MATCH "[0-9]+"
+         isal_MAJOR_VERSION "${_ver_major_line}")
+  file(STRINGS ${isal_INCLUDE_DIR}/isa-l.h _ver_minor_line
+       REGEX "^#define ISAL_MINOR_VERSION  *[0-9]+"
+       LIMIT_COUNT 1)
+  string(REGEX MATCH "[0-9]+"
+         isal_MINOR_VERSION "${_ver_minor_line}")
+  if(isal_MAJOR_VERSION)
+    set(isal_VERSION "${isal_MAJOR_VERSION}.${isal_MINOR_VERSION}")
+  elseif(PC_isal_VERSION)
+    set(isal_VERSION ${PC_isal_VERSION})
+  else()
+    set(isal_VERSION "2.0")
+  endif()
+  unset(_ver_major_line)
+  unset(_ver_minor_line)
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(isal
+  FOUND_VAR isal_FOUND
+  REQUIRED_VARS
+    isal_LIBRARY
+    isal_INCLUDE_DIR
+  VERSION_VAR isal_VERSION
+)
+
+if(isal_FOUND)
+  set(isal_LIBRARIES ${isal_LIBRARY})
+  set(isal_INCLUDE_DIRS ${isal_INCLUDE_DIR})
+  set(isal_DEFINITIONS ${PC_isal_CFLAGS_OTHER})
+endif()
+
+if(isal_FOUND AND NOT TARGET isal::isal)
+  add_library(isal::isal UNKNOWN IMPORTED)
+  set_target_properties(isal::isal PROPERTIES
+    IMPORTED_LOCATION "${isal_LIBRARY}"
+    INTERFACE_COMPILE_OPTIONS "${PC_isal_CFLAGS_OTHER}"
+    INTERFACE_INCLUDE_DIRECTORIES "${isal_INCLUDE_DIR}"
+  )
+endif()
+
+mark_as_advanced(
+  isal_INCLUDE_DIR
+  isal_LIBRARY
+)
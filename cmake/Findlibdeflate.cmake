@@ -0,0 +1,135 @@
+# Copyright (C) 2026 Dieter Baron and Thomas Klausner
+#
+# The authors can be contacted at <info@libzip.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# 1. Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in
+#   the documentation and/or other materials provided with the
+#   distribution.
+#
+# 3. The names of the authors may not be used to endorse or promote
+#   products derived from this software without specific prior
+#   written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+# OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#[=======================================================================[.rst:
+Findlibdeflate
+--------------
+
+Finds the libdeflate library.
+
+Imported Targets
+^^^^^^^^^^^^^^^^
+
+This module provides the following imported targets, if found:
+
+``libdeflate::libdeflate``
+  The libdeflate library
+
+Result Variables
+^^^^^^^^^^^^^^^^
+
+This will define the following variables:
+
+``libdeflate_FOUND``
+  True if the system has the libdeflate library.
+``libdeflate_VERSION``
+  The version of the libdeflate library which was found.
+``libdeflate_INCLUDE_DIRS``
+  Include directories needed to use libdeflate.
+``libdeflate_LIBRARIES``
+  Libraries needed to link to libdeflate.
+
+Cache Variables
+^^^^^^^^^^^^^^^
+
+The following cache variables may also be set:
+
+``libdeflate_INCLUDE_DIR``
+  The directory containing ``libdeflate.h``.
+``libdeflate_LIBRARY``
+  The path to the libdeflate library.
+
+#]=======================================================================]
+
+find_package(PkgConfig)
+pkg_check_modules(PC_libdeflate QUIET libdeflate)
+
+find_path(libdeflate_INCLUDE_DIR
+  NAMES libdeflate.h
+  PATHS ${PC_libdeflate_INCLUDE_DIRS}
+)
+find_library(libdeflate_LIBRARY
+  NAMES deflate libdeflate
+  PATHS ${PC_libdeflate_LIBRARY_DIRS}
+)
+
+# Extract version information from the header file
+if(libdeflate_INCLUDE_DIR)
+  file(STRINGS ${libdeflate_INCLUDE_DIR}/libdeflate.h _ver_major_line
+       REGEX "^#define LIBDEFLATE_VERSION_MAJOR  *[0-9]+"
+       LIMIT_COUNT 1)
+  string(REGEX MATCH "[0-9]+"
+         libdeflate_MAJOR_VERSION "${_ver_major_line}")
+  file(STRINGS ${libdeflate_INCLUDE_DIR}/libdeflate.h _ver_minor_line
+       REGEX "^#define LIBDEFLATE_VERSION_MINOR  *[0-9]+"
+       LIMIT_COUNT 1)
+  string(REGEX MATCH "[0-9]+"
+         libdeflate_MINOR_VERSION "${_ver_minor_line}")
+  if(libdeflate_MAJOR_VERSION)
+    set(libdeflate_VERSION "${libdeflate_MAJOR_VERSION}.${libdeflate_MINOR_VERSION}")
+  elseif(PC_libdeflate_VERSION)
+    set(libdeflate_VERSION ${PC_libdeflate_VERSION})
+  else()
+    set(libdeflate_VERSION "1.0")
+  endif()
+  unset(_ver_major_line)
+  unset(_ver_minor_line)
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(libdeflate
+  FOUND_VAR libdeflate_FOUND
+  REQUIRED_VARS
+    libdeflate_LIBRARY
+    libdeflate_INCLUDE_DIR
+  VERSION_VAR libdeflate_VERSION
+)
+
+if(libdeflate_FOUND)
+  set(libdeflate_LIBRARIES ${libdeflate_LIBRARY})
+  set(libdeflate_INCLUDE_DIRS ${libdeflate_INCLUDE_DIR})
+  set(libdeflate_DEFINITIONS ${PC_libdeflate_CFLAGS_OTHER})
+endif()
+
+if(libdeflate_FOUND AND NOT TARGET libdeflate::libdeflate)
+  add_library(libdeflate::libdeflate UNKNOWN IMPORTED)
+  set_target_properties(libdeflate::libdeflate PROPERTIES
+    IMPORTED_LOCATION "${libdeflate_LIBRARY}"
+    INTERFACE_COMPILE_OPTIONS "${PC_libdeflate_CFLAGS_OTHER}"
+    INTERFACE_INCLUDE_DIRECTORIES "${libdeflate_INCLUDE_DIR}"
+  )
+endif()
+
+mark_as_advanced(
+  libdeflate_INCLUDE_DIR
+  libdeflate_LIBRARY
+)
@@ -0,0 +1,132 @@
+# Copyright (C) 2026 Dieter Baron and Thomas Klausner
+#
+# The authors can be contacted at <info@libzip.org>
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# 1. Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in
+#   the documentation and/or other materials provided with the
+#   distribution.
+#
+# 3. The names of the authors may not be used to endorse or promote
+#   products derived from this software without specific prior
+#   written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+# OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+# GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+# IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+# IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#[=======================================================================[.rst:
+Findlz4
+--------------
+
+Finds the lz4 library.
+
+Imported Targets
+^^^^^^^^^^^^^^^^
+
+This module provides the following imported targets, if found:
+
+``lz4::lz4``
+  The lz4 library
+
+Result Variables
+^^^^^^^^^^^^^^^^
+
+This will define the following variables:
+
+``lz4_FOUND``
+  True if the system has the lz4 library.
+``lz4_VERSION``
+  The version of the lz4 library which was found.
+``lz4_INCLUDE_DIRS``
+  Include directories needed to use lz4.
+``lz4_LIBRARIES``
+  Libraries needed to link to lz4.
+
+Cache Variables
+^^^^^^^^^^^^^^^
+
+The following cache variables may also be set:
+
+``lz4_INCLUDE_DIR``
+  The directory containing ``lz4.h``.
+``lz4_LIBRARY``
+  The path to the lz4 library.
+
+#]=======================================================================]
+
+find_package(PkgConfig)
+pkg_check_modules(PC_lz4 QUIET lz4)
+
+find_path(lz4_INCLUDE_DIR
+  NAMES lz4.h
+  PATHS ${PC_lz4_INCLUDE_DIRS}
+)
+find_library(lz4_LIBRARY
+  NAMES lz4 liblz4
+  PATHS ${PC_lz4_LIBRARY_DIRS}
+)
+
+# Extract version information from the header file
+if(lz4_INCLUDE_DIR)
+  foreach(_part MAJOR MINOR RELEASE)
+    file(STRINGS ${lz4_INCLUDE_DIR}/lz4.h _ver_line
+         REGEX "^#define LZ4_VERSION_${_part}  *[0-9]+"
+         LIMIT_COUNT 1)
+    string(REGEX REPLACE "^#define LZ4_VERSION_${_part}  *([0-9]+).*$" "\\1"
+           lz4_${_part}_VERSION "${_ver_line}")
+  endforeach()
+  if(lz4_MAJOR_VERSION)
+    set(lz4_VERSION "${lz4_MAJOR_VERSION}.${lz4_MINOR_VERSION}.${lz4_RELEASE_VERSION}")
+  elseif(PC_lz4_VERSION)
+    set(lz4_VERSION ${PC_lz4_VERSION})
+  else()
+    set(lz4_VERSION "1.0")
+  endif()
+  unset(_part)
+  unset(_ver_line)
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(lz4
+  FOUND_VAR lz4_FOUND
+  REQUIRED_VARS
+    lz4_LIBRARY
+    lz4_INCLUDE_DIR
+  VERSION_VAR lz4_VERSION
+)
+
+if(lz4_FOUND)
+  set(lz4_LIBRARIES ${lz4_LIBRARY})
+  set(lz4_INCLUDE_DIRS ${lz4_INCLUDE_DIR})
+  set(lz4_DEFINITIONS ${PC_lz4_CFLAGS_OTHER})
+endif()
+
+if(lz4_FOUND AND NOT TARGET lz4::lz4)
+  add_library(lz4::lz4 UNKNOWN IMPORTED)
+  set_target_properties(lz4::lz4 PROPERTIES
+    IMPORTED_LOCATION "${lz4_LIBRARY}"
+    INTERFACE_COMPILE_OPTIONS "${PC_lz4_CFLAGS_OTHER}"
+    INTERFACE_INCLUDE_DIRECTORIES "${lz4_INCLUDE_DIR}"
+  )
+endif()
+
+mark_as_advanced(
+  lz4_INCLUDE_DIR
+  lz4_LIBRARY
+)
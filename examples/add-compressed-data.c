@@ -32,79 +32,16 @@
 */
 
 /*
- This layered source can be used to add pre-compressed data to a zip archive.
+ This example adds pre-compressed data to a zip archive using zip_source_precompressed().
  The data is taken from the lower layer source.
  Metadata (uncompressed size, crc, compression method) must be provided by the caller.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 
 #include <zip.h>
 
-struct ctx {
-    zip_uint64_t uncompressed_size;
-    zip_uint32_t crc;
-    zip_uint32_t compression_method;
-};
-
-zip_int64_t callback(zip_source_t* src, void *ud, void* data, zip_uint64_t length, zip_source_cmd_t command) {
-    struct ctx* ctx = (struct ctx*)ud;
-
-    switch (command) {
-    case ZIP_SOURCE_FREE:
-        /* Free our context. */
-        free(ctx);
-        return 0;
-
-    case ZIP_SOURCE_STAT: {
-        zip_stat_t *st = (zip_stat_t *)data;
-        /* Fix metadata with provided values. */
-        if (st->valid & ZIP_STAT_SIZE) {
-            st->comp_size = st->size;
-            st->valid |= ZIP_STAT_COMP_SIZE;
-        }
-        st->size = ctx->uncompressed_size;
-        st->crc = ctx->crc;
-        st->comp_method = ctx->compression_method;
-        st->valid |= ZIP_STAT_COMP_METHOD | ZIP_STAT_SIZE | ZIP_STAT_CRC;
-
-        return 0;
-    }
-
-    default:
-        /* For all other commands, use default implementation */
-        return zip_source_pass_to_lower_layer(src, data, length, command);
-    }
-}
-
-zip_source_t* create_layered_compressed_source(zip_source_t* source, zip_uint64_t uncompressed_size, zip_uint32_t crc, zip_uint32_t compression_method, zip_error_t *error) {
-    struct ctx* ctx = (struct ctx*)malloc(sizeof(*ctx));
-    zip_source_t *compressed_source;
-
-    /* Allocate context. */
-    if (ctx == NULL) {
-        zip_error_set(error, ZIP_ER_MEMORY, 0);
-        return NULL;
-    }
-
-    /* Initialize context */
-    ctx->compression_method = compression_method;
-    ctx->uncompressed_size = uncompressed_size;
-    ctx->crc = crc;
-
-    /* Create layered source using our callback and context. */
-    compressed_source = zip_source_layered_create(source, callback, ctx, error);
-
-    /* In case of error, free context. */
-    if (compressed_source == NULL) {
-        free(ctx);
-    }
-
-    return compressed_source;
-}
-
 
 /* This is the information needed to add pre-compressed data to a zip archive. data must be compressed in a format compatible with Zip (e.g. no gzip header for deflate). */
 
@@ -146,9 +83,8 @@ main(int argc, char *argv[]) {
         exit(1);
     }
 
-    zip_error_t error;
-    if ((src_comp = create_layered_compressed_source(src, uncompressed_size, crc, compression_method, &error)) == NULL) {
-        fprintf(stderr, "%s: cannot create layered source: %s\n", argv[0], zip_error_strerror(&error));
+    if ((src_comp = zip_source_precompressed(za, src, compression_method, uncompressed_size, crc)) == NULL) {
+        fprintf(stderr, "%s: cannot create precompressed source: %s\n", argv[0], zip_strerror(za));
         zip_source_free(src);
         zip_discard(za);
         exit(1);
@@ -90,11 +90,12 @@ modify_archive(zip_t *za) {
 
 
 static int
-use_data(void *data, size_t size, const char *archive) {
+use_data(const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, const char *archive) {
     /* example implementation that writes data to file */
     FILE *fp;
+    zip_uint64_t i;
 
-    if (data == NULL) {
+    if (fragments == NULL) {
         if (remove(archive) < 0 && errno != ENOENT) {
             fprintf(stderr, "can't remove %s: %s\n", archive, strerror(errno));
             return -1;
@@ -106,10 +107,12 @@ use_data(void *data, size_t size, const char *archive) {
         fprintf(stderr, "can't open %s: %s\n", archive, strerror(errno));
         return -1;
     }
-    if (fwrite(data, 1, size, fp) < size) {
-        fprintf(stderr, "can't write %s: %s\n", archive, strerror(errno));
-        fclose(fp);
-        return -1;
+    for (i = 0; i < nfragments; i++) {
+        if (fwrite(fragments[i].data, 1, fragments[i].length, fp) < fragments[i].length) {
+            fprintf(stderr, "can't write %s: %s\n", archive, strerror(errno));
+            fclose(fp);
+            return -1;
+        }
     }
     if (fclose(fp) < 0) {
         fprintf(stderr, "can't write %s: %s\n", archive, strerror(errno));
@@ -128,6 +131,8 @@ main(int argc, char *argv[]) {
     zip_error_t error;
     void *data;
     size_t size;
+    zip_buffer_fragment_t *fragments;
+    zip_uint64_t i, nfragments;
 
     if (argc < 2) {
         fprintf(stderr, "usage: %s archive\n", argv[0]);
@@ -171,47 +176,28 @@ main(int argc, char *argv[]) {
     }
 
 
-    /* copy new archive to buffer */
+    /* take over data of new archive without copying */
 
     if (zip_source_is_deleted(src)) {
         /* new archive is empty, thus no data */
-        data = NULL;
+        fragments = NULL;
+        nfragments = 0;
     }
-    else {
-        zip_stat_t zst;
-
-        if (zip_source_stat(src, &zst) < 0) {
-            fprintf(stderr, "can't stat source: %s\n", zip_error_strerror(zip_source_error(src)));
-            return 1;
-        }
-
-        size = zst.size;
-
-        if (zip_source_open(src) < 0) {
-            fprintf(stderr, "can't open source: %s\n", zip_error_strerror(zip_source_error(src)));
-            return 1;
-        }
-        if ((data = malloc(size)) == NULL) {
-            fprintf(stderr, "malloc failed: %s\n", strerror(errno));
-            zip_source_close(src);
-            return 1;
-        }
-        if ((zip_uint64_t)zip_source_read(src, data, size) < size) {
-            fprintf(stderr, "can't read data from source: %s\n", zip_error_strerror(zip_source_error(src)));
-            zip_source_close(src);
-            free(data);
-            return 1;
-        }
-        zip_source_close(src);
+    else if (zip_source_buffer_detach(src, &fragments, &nfragments) < 0) {
+        fprintf(stderr, "can't detach data from source: %s\n", zip_error_strerror(zip_source_error(src)));
+        return 1;
     }
 
     /* we're done with src */
     zip_source_free(src);
 
     /* use new data */
-    use_data(data, size, archive);
+    use_data(fragments, nfragments, archive);
 
-    free(data);
+    for (i = 0; i < nfragments; i++) {
+        free(fragments[i].data);
+    }
+    free(fragments);
 
     return 0;
 }
@@ -79,6 +79,13 @@ extern "C" {
 #define ZIP_CHECKCONS 4
 #define ZIP_TRUNCATE 8
 #define ZIP_RDONLY 16
+#define ZIP_LAZY_CDIR 32
+#define ZIP_THREADSAFE 64
+#define ZIP_COLLECT_STATS 128
+#define ZIP_RECOVER 256
+#define ZIP_SKIP_CRC_CHECK 512
+#define ZIP_FORKSAFE 1024
+#define ZIP_LAZY_NAMES 2048
 
 
 /* flags for zip_name_locate, zip_fopen, zip_stat, ... */
@@ -98,6 +105,11 @@ extern "C" {
 #define ZIP_FL_ENC_UTF_8 2048u /* string is UTF-8 encoded */
 #define ZIP_FL_ENC_CP437 4096u /* string is CP437 encoded */
 #define ZIP_FL_OVERWRITE 8192u /* zip_file_add: if file with name exists, overwrite (replace) it */
+#define ZIP_FL_CHILDREN 16384u /* zip_name_list: only list entries directly in directory */
+/*                           32768u    reserved for internal use */
+/*                           65536u    reserved for internal use */
+#define ZIP_FL_NORMALIZE 131072u /* compare Unicode names by canonical equivalence on name lookup */
+#define ZIP_FL_DIGEST 262144u  /* zip_fopen: compute SHA-256 digest of data read */
 
 /* archive global flags flags */
 
@@ -105,6 +117,16 @@ extern "C" {
 #define ZIP_AFL_IS_TORRENTZIP	4u /* current archive is torrentzipped */
 #define ZIP_AFL_WANT_TORRENTZIP	8u /* write archive in torrentzip format */
 #define ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE 16u /* don't remove file if archive is empty */
+#define ZIP_AFL_DEDUPLICATE 32u /* write identical data of new files only once */
+#define ZIP_AFL_RESUMABLE 64u /* keep partially written archive to continue writing it after interruption */
+#define ZIP_AFL_LOG_STRUCTURED 128u /* append central directory of added files instead of rewriting it */
+#define ZIP_AFL_EMBED_INDEX 256u /* store index of entry names in archive for faster lazy opening */
+#define ZIP_AFL_DIGEST 512u /* store SHA-256 digest of data of entries written */
+#define ZIP_AFL_CHECK_SOURCE_CRC 1024u /* compute CRC of data whose source reports it and fail on mismatch */
+
+/* length of digests returned by zip_fdigest and zip_file_get_digest */
+
+#define ZIP_DIGEST_LENGTH 32
 
 
 /* create a new extra field */
@@ -154,6 +176,8 @@ extern "C" {
 #define ZIP_ER_CANCELLED 32       /* N Operation cancelled */
 #define ZIP_ER_DATA_LENGTH 33     /* N Unexpected length of data */
 #define ZIP_ER_NOT_ALLOWED 34     /* N Not allowed in torrentzip */
+#define ZIP_ER_MEMLIMIT 35        /* N Memory limit exceeded */
+#define ZIP_ER_AGAIN 36           /* N Resource temporarily unavailable */
 
 /* type of system error value */
 
@@ -190,6 +214,37 @@ extern "C" {
 #define ZIP_CM_JPEG 96    /* Compressed Jpeg data */
 #define ZIP_CM_WAVPACK 97 /* WavPack compressed data */
 #define ZIP_CM_PPMD 98    /* PPMd version I, Rev 1 */
+#define ZIP_CM_LZ4 0x4c34 /* LZ4 compressed data, libzip specific, not readable by other implementations */
+
+/* compression flags, or'ed into compression level */
+
+#define ZIP_CM_FL_PARALLEL 0x100u /* compress in independent blocks using multiple threads */
+#define ZIP_CM_FL_SEEKABLE 0x200u /* record seek index in central directory for fast zip_fseek */
+#define ZIP_CM_FL_LZ4_BLOCK 0x400u /* ZIP_CM_LZ4: compress as single LZ4 block instead of LZ4 frame */
+#define ZIP_CM_FL_AUTO 0x800u      /* estimate compressibility from first data: store, compress fast or with requested level */
+#define ZIP_CM_FL_EARLY_STORE 0x1000u /* give up compressing and store if the first megabytes don't compress well */
+#define ZIP_CM_FL_RSYNCABLE 0x2000u /* restart compression at boundaries chosen by content, so local changes don't change all following output */
+
+/* compression parameters, see zip_set_file_compression_parameter() */
+
+#define ZIP_CP_ZSTD_WINDOW_LOG 1             /* zstd: log2 of window size when compressing, 10 to 31 */
+#define ZIP_CP_ZSTD_STRATEGY 2               /* zstd: match finding strategy, 1 (fastest) to 9 (strongest) */
+#define ZIP_CP_ZSTD_LONG_DISTANCE_MATCHING 3 /* zstd: 1 to find long matches across the whole window */
+#define ZIP_CP_ZSTD_WINDOW_LOG_MAX 4         /* zstd: log2 of largest window accepted when decompressing, 10 to 31 */
+
+/* flags for zip_source_buffer_set_write_options() */
+
+#define ZIP_BUFFER_FL_COALESCE 1u /* store written data in a single block */
+
+/* policies for compression level 0, see zip_set_compression_level_policy() */
+
+#define ZIP_COMPRESSION_LEVEL_DEFAULT 0  /* default level of each compression method */
+#define ZIP_COMPRESSION_LEVEL_SPEED 1    /* fastest compression */
+#define ZIP_COMPRESSION_LEVEL_BALANCED 2 /* good compression at moderate speed */
+#define ZIP_COMPRESSION_LEVEL_MAX 3      /* best compression */
+
+/* name of entry holding dictionary set with zip_set_compression_dictionary() */
+#define ZIP_ZSTD_DICTIONARY_NAME ".zstd-dictionary"
 
 /* encryption methods */
 
@@ -256,7 +311,12 @@ enum zip_source_cmd {
     ZIP_SOURCE_BEGIN_WRITE_CLONING, /* like ZIP_SOURCE_BEGIN_WRITE, but keep part of original file */
     ZIP_SOURCE_ACCEPT_EMPTY,        /* whether empty files are valid archives */
     ZIP_SOURCE_GET_FILE_ATTRIBUTES, /* get additional file attributes */
-    ZIP_SOURCE_SUPPORTS_REOPEN      /* allow reading from changed entry */
+    ZIP_SOURCE_SUPPORTS_REOPEN,     /* allow reading from changed entry */
+    ZIP_SOURCE_GET_DATA,            /* get pointer to data without copying */
+    ZIP_SOURCE_READ_AT,             /* read data at offset, without changing read position */
+    ZIP_SOURCE_BEGIN_WRITE_IN_PLACE, /* like ZIP_SOURCE_BEGIN_WRITE_CLONING, but overwrite original file after offset */
+    ZIP_SOURCE_COPY_DATA,           /* copy data from read position to write position */
+    ZIP_SOURCE_WRITEV               /* write data from several buffers */
 };
 typedef enum zip_source_cmd zip_source_cmd_t;
 
@@ -296,6 +356,29 @@ struct zip_source_args_seek {
 };
 
 typedef struct zip_source_args_seek zip_source_args_seek_t;
+
+struct zip_source_args_get_data {
+    zip_uint64_t offset;        /* start of requested data */
+    zip_uint64_t length;        /* length of requested data */
+    const void *_Nullable data; /* set by source: pointer to data */
+};
+
+typedef struct zip_source_args_get_data zip_source_args_get_data_t;
+
+struct zip_source_args_read_at {
+    zip_uint64_t offset; /* start of requested data */
+    void *_Nonnull data; /* buffer to read into */
+    zip_uint64_t length; /* length of buffer */
+};
+
+typedef struct zip_source_args_read_at zip_source_args_read_at_t;
+
+struct zip_source_args_writev {
+    const struct zip_buffer_fragment *_Nonnull fragments; /* buffers to write, in order */
+    zip_uint64_t nfragments;                              /* number of buffers */
+};
+
+typedef struct zip_source_args_writev zip_source_args_writev_t;
 #define ZIP_SOURCE_GET_ARGS(type, data, len, error) ((len) < sizeof(type) ? zip_error_set((error), ZIP_ER_INVAL, 0), (type *)NULL : (type *)(data))
 
 
@@ -330,11 +413,53 @@ struct zip_stat {
     zip_uint32_t flags;             /* reserved for future use */
 };
 
+/* filled in by zip_stat_entries() */
+struct zip_entry_info {
+    const char *_Nullable name;     /* name of the file, NULL for deleted files */
+    zip_uint64_t size;              /* size of file (uncompressed) */
+    zip_uint64_t comp_size;         /* size of file (compressed) */
+    zip_uint64_t offset;            /* offset of local header in archive, ZIP_UINT64_MAX if data is not in archive */
+    time_t mtime;                   /* modification time */
+    zip_uint32_t crc;               /* crc of file data */
+    zip_uint32_t valid;             /* which fields have valid values (ZIP_STAT_*) */
+    zip_uint16_t comp_method;       /* compression method used */
+    zip_uint16_t encryption_method; /* encryption method used */
+};
+
+/* phases for zip_get_stats */
+
+#define ZIP_PHASE_OPEN 0       /* zip_open */
+#define ZIP_PHASE_READ 1       /* zip_fread, zip_read_entry */
+#define ZIP_PHASE_CLOSE 2      /* zip_close */
+#define ZIP_PHASE_SOURCE 3     /* reading data of added or changed files in zip_close */
+#define ZIP_PHASE_DECOMPRESS 4 /* decrypting and decompressing data that is recompressed in zip_close */
+#define ZIP_PHASE_CRC 5        /* computing CRC in zip_close */
+#define ZIP_PHASE_COMPRESS 6   /* compressing in zip_close */
+#define ZIP_PHASE_ENCRYPT 7    /* encrypting in zip_close */
+#define ZIP_PHASE_WRITE 8      /* writing archive in zip_close */
+#define ZIP_PHASE_COPY 9       /* copying unchanged data in zip_close */
+
+struct zip_phase_stats {
+    zip_uint64_t wall_time; /* wall clock time in nanoseconds */
+    zip_uint64_t cpu_time;  /* processor time of process in nanoseconds, only for ZIP_PHASE_OPEN and ZIP_PHASE_CLOSE */
+    zip_uint64_t bytes_in;  /* bytes processed */
+    zip_uint64_t bytes_out; /* bytes produced */
+    zip_uint64_t count;     /* number of calls or files */
+};
+
 struct zip_buffer_fragment {
     zip_uint8_t *_Nonnull data;
     zip_uint64_t length;
 };
 
+/* entry to read with zip_read_entries() */
+struct zip_read_request {
+    zip_uint64_t index;   /* index of entry in archive */
+    void *_Nullable data; /* buffer for uncompressed data */
+    zip_uint64_t length;  /* size of buffer */
+    zip_int64_t result;   /* set to number of bytes read, -1 on error */
+};
+
 struct zip_file_attributes {
     zip_uint64_t valid;                     /* which fields have valid values */
     zip_uint8_t version;                    /* version of this struct, currently 1 */
@@ -346,6 +471,82 @@ struct zip_file_attributes {
     zip_uint16_t general_purpose_bit_mask;  /* which bits in general_purpose_bit_flags are valid */
 };
 
+/* cryptographic primitives used for WinZip AES encryption instead of the ones libzip was built with */
+struct zip_crypto_provider {
+    zip_uint8_t version; /* version of this struct, currently 1 */
+    void *_Nullable ud;  /* passed to all functions */
+
+    /* AES in ECB mode for KEY_SIZE bits key; length is a multiple of the block size */
+    void *_Nullable (*_Nonnull aes_new)(void *_Nullable ud, const zip_uint8_t *_Nonnull key, zip_uint16_t key_size);
+    int (*_Nonnull aes_encrypt_blocks)(void *_Nullable ud, void *_Nonnull aes, const zip_uint8_t *_Nonnull in, zip_uint8_t *_Nonnull out, zip_uint64_t length);
+    void (*_Nonnull aes_free)(void *_Nullable ud, void *_Nonnull aes);
+
+    /* HMAC-SHA1, output is 20 bytes */
+    void *_Nullable (*_Nonnull hmac_new)(void *_Nullable ud, const zip_uint8_t *_Nonnull secret, zip_uint64_t secret_length);
+    int (*_Nonnull hmac_update)(void *_Nullable ud, void *_Nonnull hmac, const zip_uint8_t *_Nonnull data, zip_uint64_t length);
+    int (*_Nonnull hmac_output)(void *_Nullable ud, void *_Nonnull hmac, zip_uint8_t *_Nonnull digest);
+    void (*_Nonnull hmac_free)(void *_Nullable ud, void *_Nonnull hmac);
+
+    /* PBKDF2 with HMAC-SHA1 */
+    int (*_Nonnull pbkdf2)(void *_Nullable ud, const zip_uint8_t *_Nonnull password, zip_uint64_t password_length, const zip_uint8_t *_Nonnull salt, zip_uint16_t salt_length, zip_uint16_t iterations, zip_uint8_t *_Nonnull output, zip_uint16_t output_length);
+};
+
+/* memory allocator used for all allocations of libzip instead of malloc(), see zip_set_allocator() */
+struct zip_allocator {
+    zip_uint8_t version; /* version of this struct, currently 1 */
+    void *_Nullable ud;  /* passed to all functions */
+
+    void *_Nullable (*_Nonnull allocate)(void *_Nullable ud, size_t size);
+    void *_Nullable (*_Nonnull reallocate)(void *_Nullable ud, void *_Nullable ptr, size_t size);
+    void (*_Nonnull deallocate)(void *_Nullable ud, void *_Nonnull ptr);
+};
+
+/* runs parallel work of libzip instead of its own worker threads, see zip_set_executor() */
+struct zip_executor {
+    zip_uint8_t version; /* version of this struct, currently 1 */
+    void *_Nullable ud;  /* passed to submit */
+
+    /* arrange for task(task_ud) to be called exactly once in some thread; return 0 on success, -1 if it can't */
+    int (*_Nonnull submit)(void *_Nullable ud, void (*_Nonnull task)(void *_Nullable task_ud), void *_Nullable task_ud);
+};
+
+/* clang-format off */
+enum zip_compression_status {
+    ZIP_COMPRESSION_OK,
+    ZIP_COMPRESSION_END,
+    ZIP_COMPRESSION_ERROR,
+    ZIP_COMPRESSION_NEED_DATA
+};
+/* clang-format on */
+
+/* compression or decompression for one method, registered with zip_register_compression_implementation or returned by zip_get_compression_implementation */
+struct zip_compression_implementation {
+    zip_uint8_t version;        /* version of this struct, currently 1 */
+    zip_uint8_t version_needed; /* minimum version needed to extract files compressed with it */
+    void *_Nullable ud;         /* passed to maximum_compressed_size and allocate */
+
+    zip_uint64_t (*_Nonnull maximum_compressed_size)(void *_Nullable ud, zip_uint64_t uncompressed_size);
+
+    /* create context; error remains valid until deallocate and is used to report errors of the other functions */
+    void *_Nullable (*_Nonnull allocate)(void *_Nullable ud, zip_uint16_t method, int level, struct zip_error *_Nonnull error);
+    void (*_Nonnull deallocate)(void *_Nonnull ctx);
+
+    /* compression specific general purpose bit flags; NULL for none */
+    zip_uint16_t (*_Nullable general_purpose_bit_flags)(void *_Nonnull ctx);
+
+    /* functions returning int return 0 on success, -1 on error */
+    int (*_Nonnull start)(void *_Nonnull ctx, struct zip_stat *_Nonnull st, struct zip_file_attributes *_Nullable attributes);
+    int (*_Nonnull end)(void *_Nonnull ctx);
+    /* data remains valid until next call to input or end */
+    int (*_Nonnull input)(void *_Nonnull ctx, zip_uint8_t *_Nonnull data, zip_uint64_t length);
+    void (*_Nonnull end_of_input)(void *_Nonnull ctx);
+    /* write up to *length bytes to data, set *length to number of bytes written */
+    enum zip_compression_status (*_Nonnull process)(void *_Nonnull ctx, zip_uint8_t *_Nonnull data, zip_uint64_t *_Nonnull length);
+
+    /* number of bytes of last input not used when process returned ZIP_COMPRESSION_END; NULL if not supported */
+    zip_uint64_t (*_Nullable unconsumed_input)(void *_Nonnull ctx);
+};
+
 #define ZIP_FILE_ATTRIBUTES_HOST_SYSTEM 0x0001u
 #define ZIP_FILE_ATTRIBUTES_ASCII 0x0002u
 #define ZIP_FILE_ATTRIBUTES_VERSION_NEEDED 0x0004u
@@ -357,11 +558,20 @@ struct zip_file;
 struct zip_source;
 
 typedef struct zip zip_t;
+typedef struct zip_allocator zip_allocator_t;
+typedef struct zip_executor zip_executor_t;
+typedef enum zip_compression_status zip_compression_status_t;
+typedef struct zip_compression_implementation zip_compression_implementation_t;
+typedef struct zip_crypto_provider zip_crypto_provider_t;
+typedef struct zip_entry_info zip_entry_info_t;
 typedef struct zip_error zip_error_t;
 typedef struct zip_file zip_file_t;
 typedef struct zip_file_attributes zip_file_attributes_t;
+typedef struct zip_phase_stats zip_phase_stats_t;
+typedef struct zip_read_request zip_read_request_t;
 typedef struct zip_source zip_source_t;
 typedef struct zip_stat zip_stat_t;
+typedef struct zip_stream zip_stream_t;
 typedef struct zip_buffer_fragment zip_buffer_fragment_t;
 
 typedef zip_uint32_t zip_flags_t;
@@ -369,7 +579,13 @@ typedef zip_uint32_t zip_flags_t;
 typedef zip_int64_t (*zip_source_callback)(void *_Nullable, void *_Nullable, zip_uint64_t, zip_source_cmd_t);
 typedef zip_int64_t (*zip_source_layered_callback)(zip_source_t *_Nonnull, void *_Nullable, void *_Nullable, zip_uint64_t, enum zip_source_cmd);
 typedef void (*zip_progress_callback)(zip_t *_Nonnull, double, void *_Nullable);
+typedef void (*zip_progress_bytes_callback)(zip_t *_Nonnull, zip_uint64_t, zip_uint64_t, double, void *_Nullable);
 typedef int (*zip_cancel_callback)(zip_t *_Nonnull, void *_Nullable);
+typedef void (*zip_close_callback)(zip_t *_Nullable, void *_Nullable);
+typedef int (*zip_extract_callback)(zip_t *_Nonnull, zip_uint64_t, const void *_Nullable, zip_uint64_t, void *_Nullable);
+typedef int (*zip_verify_callback)(zip_t *_Nonnull, zip_uint64_t, zip_error_t *_Nonnull, void *_Nullable);
+typedef void (*zip_stats_callback)(zip_t *_Nonnull, zip_int64_t, void *_Nullable);
+typedef void (*zip_source_trace_callback)(zip_source_t *_Nonnull, zip_uint32_t, zip_source_cmd_t, zip_uint64_t, zip_int64_t, zip_uint64_t, void *_Nullable);
 
 #ifndef ZIP_DISABLE_DEPRECATED
 #define ZIP_FL_RECOMPRESS 16u  /* force recompression of data */
@@ -393,8 +609,12 @@ ZIP_DEPRECATED("use 'zip_source_zip_file_create' instead") ZIP_EXTERN zip_source
 #endif
 
 ZIP_EXTERN int zip_close(zip_t *_Nonnull);
+ZIP_EXTERN int zip_close_async(zip_t *_Nonnull, zip_close_callback _Nonnull, void *_Nullable);
+ZIP_EXTERN int zip_close_multiple(zip_t *_Nullable *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_commit(zip_t *_Nonnull);
 ZIP_EXTERN int zip_delete(zip_t *_Nonnull, zip_uint64_t);
 ZIP_EXTERN zip_int64_t zip_dir_add(zip_t *_Nonnull, const char *_Nonnull, zip_flags_t);
+ZIP_EXTERN zip_int64_t zip_dir_add_tree(zip_t *_Nonnull, const char *_Nonnull, const char *_Nullable, zip_flags_t);
 ZIP_EXTERN void zip_discard(zip_t *_Nonnull);
 
 ZIP_EXTERN zip_error_t *_Nonnull zip_get_error(zip_t *_Nonnull);
@@ -410,10 +630,15 @@ ZIP_EXTERN const char *_Nonnull zip_error_strerror(zip_error_t *_Nonnull);
 ZIP_EXTERN int zip_error_system_type(const zip_error_t *_Nonnull);
 ZIP_EXTERN zip_int64_t zip_error_to_data(const zip_error_t *_Nonnull, void *_Nonnull, zip_uint64_t);
 
+ZIP_EXTERN int zip_extract_all(zip_t *_Nonnull, zip_flags_t, zip_extract_callback _Nonnull, void *_Nullable);
 ZIP_EXTERN int zip_fclose(zip_file_t *_Nonnull);
+ZIP_EXTERN int zip_fdigest(zip_file_t *_Nonnull, zip_uint8_t *_Nonnull);
 ZIP_EXTERN zip_t *_Nullable zip_fdopen(int, int, int *_Nullable);
 ZIP_EXTERN zip_int64_t zip_file_add(zip_t *_Nonnull, const char *_Nonnull, zip_source_t *_Nonnull, zip_flags_t);
 ZIP_EXTERN void zip_file_attributes_init(zip_file_attributes_t *_Nonnull);
+ZIP_EXTERN int zip_file_borrow(zip_file_t *_Nonnull, const void *_Nullable *_Nonnull, zip_uint64_t *_Nonnull);
+ZIP_EXTERN int zip_file_borrow_aligned(zip_file_t *_Nonnull, zip_uint32_t, const void *_Nullable *_Nonnull, zip_uint64_t *_Nonnull);
+ZIP_EXTERN zip_int64_t zip_file_copy(zip_t *_Nonnull, zip_t *_Nonnull, zip_uint64_t, zip_flags_t);
 ZIP_EXTERN void zip_file_error_clear(zip_file_t *_Nonnull);
 ZIP_EXTERN int zip_file_extra_field_delete(zip_t *_Nonnull, zip_uint64_t, zip_uint16_t, zip_flags_t);
 ZIP_EXTERN int zip_file_extra_field_delete_by_id(zip_t *_Nonnull, zip_uint64_t, zip_uint16_t, zip_uint16_t, zip_flags_t);
@@ -423,6 +648,7 @@ ZIP_EXTERN zip_int16_t zip_file_extra_fields_count_by_id(zip_t *_Nonnull, zip_ui
 ZIP_EXTERN const zip_uint8_t *_Nullable zip_file_extra_field_get(zip_t *_Nonnull, zip_uint64_t, zip_uint16_t, zip_uint16_t *_Nullable, zip_uint16_t *_Nullable, zip_flags_t);
 ZIP_EXTERN const zip_uint8_t *_Nullable zip_file_extra_field_get_by_id(zip_t *_Nonnull, zip_uint64_t, zip_uint16_t, zip_uint16_t, zip_uint16_t *_Nullable, zip_flags_t);
 ZIP_EXTERN const char *_Nullable zip_file_get_comment(zip_t *_Nonnull, zip_uint64_t, zip_uint32_t *_Nullable, zip_flags_t);
+ZIP_EXTERN int zip_file_get_digest(zip_t *_Nonnull, zip_uint64_t, zip_uint8_t *_Nonnull, zip_flags_t);
 ZIP_EXTERN zip_error_t *_Nonnull zip_file_get_error(zip_file_t *_Nonnull);
 ZIP_EXTERN int zip_file_get_external_attributes(zip_t *_Nonnull, zip_uint64_t, zip_flags_t, zip_uint8_t *_Nullable, zip_uint32_t *_Nullable);
 ZIP_EXTERN int zip_file_is_seekable(zip_file_t *_Nonnull);
@@ -439,33 +665,87 @@ ZIP_EXTERN zip_file_t *_Nullable zip_fopen_encrypted(zip_t *_Nonnull, const char
 ZIP_EXTERN zip_file_t *_Nullable zip_fopen_index(zip_t *_Nonnull, zip_uint64_t, zip_flags_t);
 ZIP_EXTERN zip_file_t *_Nullable zip_fopen_index_encrypted(zip_t *_Nonnull, zip_uint64_t, zip_flags_t, const char *_Nullable);
 ZIP_EXTERN zip_int64_t zip_fread(zip_file_t *_Nonnull, void *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_freopen_index(zip_t *_Nonnull, zip_file_t *_Nonnull, zip_uint64_t, zip_flags_t);
 ZIP_EXTERN zip_int8_t zip_fseek(zip_file_t *_Nonnull, zip_int64_t, int);
 ZIP_EXTERN zip_int64_t zip_ftell(zip_file_t *_Nonnull);
 ZIP_EXTERN const char *_Nullable zip_get_archive_comment(zip_t *_Nonnull, int *_Nullable, zip_flags_t);
 ZIP_EXTERN int zip_get_archive_flag(zip_t *_Nonnull, zip_flags_t, zip_flags_t);
+ZIP_EXTERN const zip_uint8_t *_Nullable zip_get_archive_prefix(zip_t *_Nonnull, zip_uint64_t *_Nullable, zip_flags_t);
+ZIP_EXTERN zip_int64_t zip_get_access_profile(zip_t *_Nonnull, zip_uint64_t *_Nullable, zip_uint64_t);
+ZIP_EXTERN int zip_get_entry_cache_stats(zip_t *_Nonnull, zip_uint64_t *_Nullable, zip_uint64_t *_Nullable);
+ZIP_EXTERN zip_uint64_t zip_get_memory_usage(zip_t *_Nonnull);
 ZIP_EXTERN const char *_Nullable zip_get_name(zip_t *_Nonnull, zip_uint64_t, zip_flags_t);
 ZIP_EXTERN zip_int64_t zip_get_num_entries(zip_t *_Nonnull, zip_flags_t);
+ZIP_EXTERN int zip_get_stats(zip_t *_Nonnull, zip_uint32_t, zip_phase_stats_t *_Nonnull);
 ZIP_EXTERN const char *_Nonnull zip_libzip_version(void);
+ZIP_EXTERN zip_int64_t zip_name_list(zip_t *_Nonnull, const char *_Nonnull, zip_flags_t, zip_uint64_t *_Nullable, zip_uint64_t);
+ZIP_EXTERN zip_uint32_t zip_name_hash(const char *_Nonnull, zip_flags_t);
 ZIP_EXTERN zip_int64_t zip_name_locate(zip_t *_Nonnull, const char *_Nonnull, zip_flags_t);
+ZIP_EXTERN zip_int64_t zip_name_locate_len(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_flags_t);
+ZIP_EXTERN int zip_name_locate_many(zip_t *_Nonnull, const char *_Nonnull const *_Nullable, const zip_uint32_t *_Nullable, zip_uint64_t, zip_flags_t, zip_int64_t *_Nullable);
 ZIP_EXTERN zip_t *_Nullable zip_open(const char *_Nonnull, int, int *_Nullable);
 ZIP_EXTERN zip_t *_Nullable zip_open_from_source(zip_source_t *_Nonnull, int, zip_error_t *_Nullable);
+ZIP_EXTERN zip_t *_Nullable zip_open_with_index(const char *_Nonnull, const char *_Nonnull, int, int *_Nullable);
+ZIP_EXTERN int zip_read_entries(zip_t *_Nonnull, zip_read_request_t *_Nullable, zip_uint64_t);
+ZIP_EXTERN zip_int64_t zip_read_entry(zip_t *_Nonnull, zip_uint64_t, void *_Nullable, zip_uint64_t);
+ZIP_EXTERN int zip_register_progress_bytes_callback_with_state(zip_t *_Nonnull, double, zip_progress_bytes_callback _Nullable, void (*_Nullable)(void *_Nullable), void *_Nullable);
 ZIP_EXTERN int zip_register_progress_callback_with_state(zip_t *_Nonnull, double, zip_progress_callback _Nullable, void (*_Nullable)(void *_Nullable), void *_Nullable);
 ZIP_EXTERN int zip_register_cancel_callback_with_state(zip_t *_Nonnull, zip_cancel_callback _Nullable, void (*_Nullable)(void *_Nullable), void *_Nullable);
+ZIP_EXTERN int zip_get_compression_implementation(zip_uint16_t, int, zip_compression_implementation_t *_Nonnull, zip_error_t *_Nullable);
+ZIP_EXTERN int zip_register_compression_implementation(zip_uint16_t, const zip_compression_implementation_t *_Nullable, const zip_compression_implementation_t *_Nullable, zip_error_t *_Nullable);
+ZIP_EXTERN int zip_register_stats_callback(zip_t *_Nonnull, zip_stats_callback _Nullable, void *_Nullable);
+ZIP_EXTERN int zip_reserve_entries(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_allocator(const zip_allocator_t *_Nullable);
+ZIP_EXTERN int zip_set_access_profiling(zip_t *_Nonnull, int);
+ZIP_EXTERN int zip_set_archive_alignment(zip_t *_Nonnull, zip_uint32_t);
 ZIP_EXTERN int zip_set_archive_comment(zip_t *_Nonnull, const char *_Nullable, zip_uint16_t);
 ZIP_EXTERN int zip_set_archive_flag(zip_t *_Nonnull, zip_flags_t, int);
+ZIP_EXTERN int zip_set_archive_prefix(zip_t *_Nonnull, const zip_uint8_t *_Nullable, zip_uint64_t);
+ZIP_EXTERN int zip_set_buffered_entry_size(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_compression_block_size(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_compression_dictionary(zip_t *_Nonnull, zip_int32_t, const void *_Nullable, zip_uint64_t);
+ZIP_EXTERN int zip_set_compression_level_policy(zip_t *_Nonnull, zip_uint32_t);
+ZIP_EXTERN int zip_set_data_order(zip_t *_Nonnull, const zip_uint64_t *_Nullable, zip_uint64_t);
+ZIP_EXTERN int zip_set_crypto_provider(zip_t *_Nonnull, const zip_crypto_provider_t *_Nullable);
+ZIP_EXTERN void zip_set_default_memory_limit(zip_uint64_t);
+ZIP_EXTERN void zip_set_default_preload_size(zip_uint64_t);
+ZIP_EXTERN int zip_set_decompression_memory_limit(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_decompression_pool_size(zip_uint32_t);
 ZIP_EXTERN int zip_set_default_password(zip_t *_Nonnull, const char *_Nullable);
+ZIP_EXTERN int zip_set_entry_cache_size(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_executor(const zip_executor_t *_Nullable);
 ZIP_EXTERN int zip_set_file_compression(zip_t *_Nonnull, zip_uint64_t, zip_int32_t, zip_uint32_t);
+ZIP_EXTERN int zip_set_file_compression_parameter(zip_t *_Nonnull, zip_uint64_t, zip_uint32_t, zip_int64_t);
+ZIP_EXTERN void zip_set_huge_page_threshold(zip_uint64_t);
+ZIP_EXTERN int zip_set_io_buffer_size(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_memory_limit(zip_t *_Nonnull, zip_uint64_t);
+ZIP_EXTERN int zip_set_num_threads(zip_t *_Nonnull, zip_uint32_t);
+ZIP_EXTERN int zip_set_prefetch_profile(zip_t *_Nonnull, const zip_uint64_t *_Nullable, zip_uint64_t, zip_uint64_t);
+ZIP_EXTERN int zip_set_progress_interval(zip_t *_Nonnull, zip_uint64_t, zip_uint32_t);
+ZIP_EXTERN int zip_set_source_trace_callback(zip_source_trace_callback _Nullable, void *_Nullable);
 ZIP_EXTERN int zip_source_begin_write(zip_source_t *_Nonnull);
 ZIP_EXTERN int zip_source_begin_write_cloning(zip_source_t *_Nonnull, zip_uint64_t);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_buffer(zip_t *_Nonnull, const void *_Nullable, zip_uint64_t, int);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_buffer_create(const void *_Nullable, zip_uint64_t, int, zip_error_t *_Nullable);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_buffer_fragment(zip_t *_Nonnull, const zip_buffer_fragment_t *_Nonnull, zip_uint64_t, int);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_buffer_fragment_create(const zip_buffer_fragment_t *_Nullable, zip_uint64_t, int, zip_error_t *_Nullable);
+ZIP_EXTERN int zip_source_buffer_detach(zip_source_t *_Nonnull, zip_buffer_fragment_t *_Nullable *_Nonnull, zip_uint64_t *_Nonnull);
+ZIP_EXTERN int zip_source_buffer_set_write_options(zip_source_t *_Nonnull, zip_uint64_t, zip_flags_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_cache(zip_t *_Nonnull, zip_source_t *_Nonnull, zip_uint64_t, zip_uint64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_cache_create(zip_source_t *_Nonnull, zip_uint64_t, zip_uint64_t, zip_error_t *_Nullable);
 ZIP_EXTERN int zip_source_close(zip_source_t *_Nonnull);
 ZIP_EXTERN int zip_source_commit_write(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_error_t *_Nonnull zip_source_error(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_file(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_file_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_file_async(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_uint32_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_file_async_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_uint32_t, zip_error_t *_Nullable);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_file_direct(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_file_direct_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_file_mapped(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_file_mapped_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_fd(zip_t *_Nonnull, int, zip_uint64_t, zip_int64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_fd_create(int, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_filep(zip_t *_Nonnull, FILE *_Nonnull, zip_uint64_t, zip_int64_t);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_filep_create(FILE *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
 ZIP_EXTERN void zip_source_free(zip_source_t *_Nullable);
@@ -478,8 +758,12 @@ ZIP_EXTERN void zip_source_keep(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_layered(zip_t *_Nullable, zip_source_t *_Nonnull, zip_source_layered_callback _Nonnull, void *_Nullable);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_layered_create(zip_source_t *_Nonnull, zip_source_layered_callback _Nonnull, void *_Nullable, zip_error_t *_Nullable);
 ZIP_EXTERN zip_int64_t zip_source_make_command_bitmap(zip_source_cmd_t, ...);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_mmap(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_mmap_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
 ZIP_EXTERN int zip_source_open(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_int64_t zip_source_pass_to_lower_layer(zip_source_t *_Nonnull, void *_Nullable, zip_uint64_t, zip_source_cmd_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_precompressed(zip_t *_Nonnull, zip_source_t *_Nonnull, zip_int32_t, zip_uint64_t, zip_uint32_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_precompressed_create(zip_source_t *_Nonnull, zip_int32_t, zip_uint64_t, zip_uint32_t, zip_error_t *_Nullable);
 ZIP_EXTERN zip_int64_t zip_source_read(zip_source_t *_Nonnull, void *_Nonnull, zip_uint64_t);
 ZIP_EXTERN void zip_source_rollback_write(zip_source_t *_Nonnull);
 ZIP_EXTERN int zip_source_seek(zip_source_t *_Nonnull, zip_int64_t, int);
@@ -488,6 +772,8 @@ ZIP_EXTERN int zip_source_seek_write(zip_source_t *_Nonnull, zip_int64_t, int);
 ZIP_EXTERN int zip_source_stat(zip_source_t *_Nonnull, zip_stat_t *_Nonnull);
 ZIP_EXTERN zip_int64_t zip_source_tell(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_int64_t zip_source_tell_write(zip_source_t *_Nonnull);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_volumes(zip_t *_Nonnull, const char *_Nonnull const *_Nonnull, zip_uint64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_volumes_create(const char *_Nonnull const *_Nonnull, zip_uint64_t, zip_error_t *_Nullable);
 #ifdef _WIN32
 ZIP_EXTERN zip_source_t *_Nullable zip_source_win32a(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_win32a_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
@@ -501,13 +787,21 @@ ZIP_EXTERN zip_int64_t zip_source_write(zip_source_t *_Nonnull, const void *_Nul
 ZIP_EXTERN zip_source_t *_Nullable zip_source_zip_file(zip_t *_Nonnull, zip_t *_Nonnull, zip_uint64_t, zip_flags_t, zip_uint64_t, zip_int64_t, const char *_Nullable);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_zip_file_create(zip_t *_Nonnull, zip_uint64_t, zip_flags_t, zip_uint64_t, zip_int64_t, const char *_Nullable, zip_error_t *_Nullable);
 ZIP_EXTERN int zip_stat(zip_t *_Nonnull, const char *_Nonnull, zip_flags_t, zip_stat_t *_Nonnull);
+ZIP_EXTERN zip_int64_t zip_stat_entries(zip_t *_Nonnull, zip_uint64_t, zip_uint64_t, zip_flags_t, zip_entry_info_t *_Nullable);
 ZIP_EXTERN int zip_stat_index(zip_t *_Nonnull, zip_uint64_t, zip_flags_t, zip_stat_t *_Nonnull);
 ZIP_EXTERN void zip_stat_init(zip_stat_t *_Nonnull);
+ZIP_EXTERN void zip_stream_close(zip_stream_t *_Nullable);
+ZIP_EXTERN zip_error_t *_Nonnull zip_stream_get_error(zip_stream_t *_Nonnull);
+ZIP_EXTERN int zip_stream_next(zip_stream_t *_Nonnull, zip_stat_t *_Nonnull);
+ZIP_EXTERN zip_stream_t *_Nullable zip_stream_open(zip_source_t *_Nonnull, zip_error_t *_Nullable);
+ZIP_EXTERN zip_int64_t zip_stream_read(zip_stream_t *_Nonnull, void *_Nonnull, zip_uint64_t);
 ZIP_EXTERN const char *_Nonnull zip_strerror(zip_t *_Nonnull);
 ZIP_EXTERN int zip_unchange(zip_t *_Nonnull, zip_uint64_t);
 ZIP_EXTERN int zip_unchange_all(zip_t *_Nonnull);
 ZIP_EXTERN int zip_unchange_archive(zip_t *_Nonnull);
+ZIP_EXTERN int zip_verify(zip_t *_Nonnull, zip_verify_callback _Nullable, void *_Nullable);
 ZIP_EXTERN int zip_compression_method_supported(zip_int32_t method, int compress);
+ZIP_EXTERN zip_uint32_t zip_crc32(zip_uint32_t, const void *_Nullable, zip_uint64_t);
 ZIP_EXTERN int zip_encryption_method_supported(zip_uint16_t method, int encode);
 
 #ifdef __cplusplus
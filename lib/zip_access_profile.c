@@ -0,0 +1,350 @@
+/*
+  zip_access_profile.c -- record and prefetch order in which entries are used
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <string.h>
+
+#include "zipint.h"
+
+/* entries opened, in the order they were first opened */
+struct zip_access_profile {
+    bool recording;
+    zip_uint64_t *indices;
+    zip_uint64_t nindices;
+    zip_uint64_t nindices_alloc;
+    zip_uint8_t *seen; /* whether entry was recorded, by index */
+    zip_uint64_t nseen;
+};
+
+/* reads entries following an opened one in the profile into the entry cache */
+struct zip_prefetcher {
+    zip_t *za;
+    zip_uint64_t *profile;
+    zip_uint64_t nprofile;
+    zip_uint64_t *position; /* first position of entry in profile, by index, ZIP_UINT64_MAX if not in it */
+    zip_uint64_t nposition;
+    zip_uint64_t window; /* number of entries read ahead */
+#ifdef HAVE_THREADS
+    zip_thread_pool_t *pool;
+    zip_thread_job_t job;
+    zip_mutex_t *mutex; /* protects the fields below */
+#endif
+    zip_uint64_t next;  /* position of next entry to read */
+    zip_uint64_t until; /* end of positions to read */
+    bool running;       /* job is submitted and will read up to until */
+    bool submitted;     /* job was submitted at least once */
+    bool stop;
+};
+
+static void prefetcher_free(zip_prefetcher_t *prefetcher);
+#ifdef HAVE_THREADS
+static void prefetcher_run(void *ud);
+#endif
+
+
+ZIP_EXTERN zip_int64_t
+zip_get_access_profile(zip_t *za, zip_uint64_t *indices, zip_uint64_t nindices) {
+    zip_uint64_t n;
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (indices == NULL && nindices > 0) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    n = za->access_profile != NULL ? za->access_profile->nindices : 0;
+    if (nindices > 0 && n > 0) {
+        (void)memcpy_s(indices, sizeof(indices[0]) * (size_t)nindices, za->access_profile->indices, sizeof(indices[0]) * (size_t)ZIP_MIN(n, nindices));
+    }
+    ZIP_UNLOCK(za);
+
+    return (zip_int64_t)n;
+}
+
+
+ZIP_EXTERN int
+zip_set_access_profiling(zip_t *za, int enable) {
+    zip_access_profile_t *profile;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    if (!enable) {
+        if (za->access_profile != NULL) {
+            za->access_profile->recording = false;
+        }
+        ZIP_UNLOCK(za);
+        return 0;
+    }
+
+    if ((profile = za->access_profile) == NULL) {
+        if ((profile = (zip_access_profile_t *)_zip_malloc(sizeof(*profile))) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            ZIP_UNLOCK(za);
+            return -1;
+        }
+        profile->indices = NULL;
+        profile->nindices_alloc = 0;
+        profile->seen = NULL;
+        profile->nseen = 0;
+        za->access_profile = profile;
+    }
+    /* start new recording */
+    profile->nindices = 0;
+    if (profile->nseen > 0) {
+        memset(profile->seen, 0, (size_t)profile->nseen);
+    }
+    profile->recording = true;
+    ZIP_UNLOCK(za);
+
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_set_prefetch_profile(zip_t *za, const zip_uint64_t *indices, zip_uint64_t nindices, zip_uint64_t window) {
+#ifdef HAVE_THREADS
+    zip_prefetcher_t *prefetcher, *old;
+    zip_uint64_t i;
+#endif
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (nindices > 0 && (indices == NULL || window == 0)) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+#ifdef HAVE_THREADS
+    prefetcher = NULL;
+    if (nindices > 0) {
+        if ((za->open_flags & ZIP_THREADSAFE) == 0) {
+            /* entries are read in a background thread */
+            zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+        }
+        if (za->entry_cache == NULL) {
+            zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+
+        if ((prefetcher = (zip_prefetcher_t *)_zip_malloc(sizeof(*prefetcher))) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        prefetcher->za = za;
+        prefetcher->nprofile = nindices;
+        prefetcher->nposition = za->nentry;
+        prefetcher->window = window;
+        prefetcher->next = prefetcher->until = 0;
+        prefetcher->running = prefetcher->submitted = prefetcher->stop = false;
+        prefetcher->pool = NULL;
+        prefetcher->mutex = NULL;
+        prefetcher->position = NULL;
+        if ((prefetcher->profile = (zip_uint64_t *)_zip_memdup(indices, sizeof(indices[0]) * (size_t)nindices, &za->error)) == NULL) {
+            prefetcher_free(prefetcher);
+            return -1;
+        }
+        if (prefetcher->nposition > 0 && (prefetcher->position = (zip_uint64_t *)_zip_malloc(sizeof(prefetcher->position[0]) * (size_t)prefetcher->nposition)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            prefetcher_free(prefetcher);
+            return -1;
+        }
+        if ((prefetcher->mutex = _zip_mutex_new(&za->error)) == NULL || (prefetcher->pool = _zip_thread_pool_new(1, &za->error)) == NULL) {
+            prefetcher_free(prefetcher);
+            return -1;
+        }
+        prefetcher->job.run = prefetcher_run;
+        prefetcher->job.ud = prefetcher;
+
+        for (i = 0; i < prefetcher->nposition; i++) {
+            prefetcher->position[i] = ZIP_UINT64_MAX;
+        }
+        for (i = nindices; i > 0; i--) {
+            if (indices[i - 1] < prefetcher->nposition) {
+                prefetcher->position[indices[i - 1]] = i - 1;
+            }
+        }
+    }
+
+    ZIP_LOCK(za);
+    old = za->prefetcher;
+    za->prefetcher = prefetcher;
+    ZIP_UNLOCK(za);
+
+    /* old job may be waiting for the archive lock */
+    prefetcher_free(old);
+
+    return 0;
+#else
+    if (nindices > 0) {
+        zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+
+/* Stop prefetching and free recorded profile of archive. Called without holding the archive lock. */
+void
+_zip_access_profile_free(zip_t *za) {
+    prefetcher_free(za->prefetcher);
+    za->prefetcher = NULL;
+
+    if (za->access_profile != NULL) {
+        _zip_free(za->access_profile->indices);
+        _zip_free(za->access_profile->seen);
+        _zip_free(za->access_profile);
+        za->access_profile = NULL;
+    }
+}
+
+
+/* Note that entry index was opened: record it and start reading the entries following it in the prefetch profile.
+   Called with the archive locked. Not being able to record it is not an error. */
+void
+_zip_access_profile_note(zip_t *za, zip_uint64_t index) {
+    zip_access_profile_t *profile = za->access_profile;
+#ifdef HAVE_THREADS
+    zip_prefetcher_t *prefetcher = za->prefetcher;
+    bool submit;
+#endif
+
+    if (profile != NULL && profile->recording) {
+        if (index >= profile->nseen) {
+            zip_uint64_t nseen = ZIP_MAX(za->nentry, index + 1);
+            zip_uint8_t *seen;
+
+            if ((seen = (zip_uint8_t *)_zip_realloc(profile->seen, (size_t)nseen)) == NULL) {
+                return;
+            }
+            memset(seen + profile->nseen, 0, (size_t)(nseen - profile->nseen));
+            profile->seen = seen;
+            profile->nseen = nseen;
+        }
+        if (!profile->seen[index]) {
+            if (profile->nindices == profile->nindices_alloc) {
+                zip_uint64_t nalloc = profile->nindices_alloc > 0 ? profile->nindices_alloc * 2 : 16;
+                zip_uint64_t *indices;
+
+                if ((indices = (zip_uint64_t *)_zip_realloc(profile->indices, sizeof(indices[0]) * (size_t)nalloc)) == NULL) {
+                    return;
+                }
+                profile->indices = indices;
+                profile->nindices_alloc = nalloc;
+            }
+            profile->indices[profile->nindices++] = index;
+            profile->seen[index] = 1;
+        }
+    }
+
+#ifdef HAVE_THREADS
+    if (prefetcher == NULL || index >= prefetcher->nposition || prefetcher->position[index] == ZIP_UINT64_MAX) {
+        return;
+    }
+
+    _zip_mutex_lock(prefetcher->mutex);
+    prefetcher->next = ZIP_MAX(prefetcher->next, prefetcher->position[index] + 1);
+    prefetcher->until = ZIP_MAX(prefetcher->until, prefetcher->position[index] + 1 + ZIP_MIN(prefetcher->window, prefetcher->nprofile - prefetcher->position[index] - 1));
+    submit = !prefetcher->running && prefetcher->next < prefetcher->until;
+    if (submit) {
+        prefetcher->running = true;
+    }
+    _zip_mutex_unlock(prefetcher->mutex);
+
+    if (submit) {
+        if (prefetcher->submitted) {
+            /* previous run has finished its work and doesn't need the archive lock anymore */
+            _zip_thread_pool_wait(prefetcher->pool, &prefetcher->job);
+        }
+        prefetcher->submitted = true;
+        _zip_thread_pool_submit(prefetcher->pool, &prefetcher->job);
+    }
+#endif
+}
+
+
+static void
+prefetcher_free(zip_prefetcher_t *prefetcher) {
+    if (prefetcher == NULL) {
+        return;
+    }
+
+#ifdef HAVE_THREADS
+    if (prefetcher->submitted) {
+        _zip_mutex_lock(prefetcher->mutex);
+        prefetcher->stop = true;
+        _zip_mutex_unlock(prefetcher->mutex);
+        _zip_thread_pool_wait(prefetcher->pool, &prefetcher->job);
+    }
+    if (prefetcher->pool != NULL) {
+        _zip_thread_pool_free(prefetcher->pool);
+    }
+    if (prefetcher->mutex != NULL) {
+        _zip_mutex_free(prefetcher->mutex);
+    }
+#endif
+    _zip_free(prefetcher->profile);
+    _zip_free(prefetcher->position);
+    _zip_free(prefetcher);
+}
+
+
+#ifdef HAVE_THREADS
+static void
+prefetcher_run(void *ud) {
+    zip_prefetcher_t *prefetcher = (zip_prefetcher_t *)ud;
+    zip_uint64_t index;
+
+    for (;;) {
+        _zip_mutex_lock(prefetcher->mutex);
+        if (prefetcher->stop || prefetcher->next >= prefetcher->until) {
+            prefetcher->running = false;
+            _zip_mutex_unlock(prefetcher->mutex);
+            return;
+        }
+        index = prefetcher->profile[prefetcher->next++];
+        _zip_mutex_unlock(prefetcher->mutex);
+
+        _zip_entry_cache_prefetch(prefetcher->za, index);
+    }
+}
+#endif
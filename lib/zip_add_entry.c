@@ -46,15 +46,13 @@ _zip_add_entry(zip_t *za) {
     if (za->nentry + 1 >= za->nentry_alloc) {
         zip_entry_t *rentries;
         zip_uint64_t nalloc = za->nentry_alloc;
-        zip_uint64_t additional_entries = 2 * nalloc;
+        zip_uint64_t additional_entries = nalloc / 2;
         zip_uint64_t realloc_size;
 
+        /* grow geometrically, so adding many entries copies each one only a few times */
         if (additional_entries < 16) {
             additional_entries = 16;
         }
-        else if (additional_entries > 1024) {
-            additional_entries = 1024;
-        }
         /* neither + nor * overflows can happen: nentry_alloc * sizeof(struct zip_entry) < UINT64_MAX */
         nalloc += additional_entries;
         realloc_size = sizeof(struct zip_entry) * (size_t)nalloc;
@@ -63,8 +61,12 @@ _zip_add_entry(zip_t *za) {
             zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
             return -1;
         }
-        rentries = (zip_entry_t *)realloc(za->entry, sizeof(struct zip_entry) * (size_t)nalloc);
+        if (!_zip_memory_budget_charge(za->memory_budget, sizeof(struct zip_entry) * additional_entries, &za->error)) {
+            return -1;
+        }
+        rentries = (zip_entry_t *)_zip_realloc(za->entry, sizeof(struct zip_entry) * (size_t)nalloc);
         if (!rentries) {
+            _zip_memory_budget_release(za->memory_budget, sizeof(struct zip_entry) * additional_entries);
             zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
             return -1;
         }
@@ -36,6 +36,57 @@
 #include <bzlib.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_THREADS
+/* Parallel compression: input is split into blocks small enough that bzip2 compresses each into a single
+   bzip2 block, which are compressed independently. The bits of these blocks are concatenated into one stream,
+   with a common header and a trailer whose CRC is combined from the CRCs of the blocks.
+
+   Parallel decompression: the stream is split where the block magic occurs, and each part is decompressed
+   as a stream of its own. Since the magic can also occur inside compressed data, a part that fails to
+   decompress is joined with the following one and decompressed again. The end of the stream is only looked
+   for at the end of the data. */
+
+#define BLOCK_MAGIC 0x314159265359ull
+#define END_MAGIC 0x177245385090ull
+#define MAGIC_BITS 48
+#define HEADER_SIZE 4      /* "BZh" and level */
+#define TRAILER_BITS 80    /* end magic and stream CRC */
+#define TRAILER_SIZE 11    /* trailer bits with unused bits of preceding byte and padding */
+
+/* libbz2 ends a block when its run length encoded data reaches 19 bytes less than 100000 * level. Blocks are kept
+   below that, so each is compressed into a single bzip2 block, and limited to twice that much input. */
+#define PARALLEL_BLOCK_SYMBOLS(level) ((zip_uint64_t)(level)*100000 - 20)
+#define PARALLEL_BLOCK_SIZE(level) ((zip_uint64_t)(level)*200000)
+#define RUN_SYMBOLS(length) ((length) < 4 ? (length) : 5)
+/* Decompressing smaller files in the calling thread is faster than starting threads. */
+#define PARALLEL_MIN_SIZE (256 * 1024)
+/* Generous limit on the compressed size of a block, so corrupt data isn't buffered indefinitely. */
+#define PARALLEL_MAX_COMPRESSED_BLOCK_SIZE(level) ((zip_uint64_t)(level)*200000)
+
+struct block {
+    zip_thread_job_t job;
+    int level;
+    bool last;      /* last block of stream */
+    bool collected; /* job has been waited for */
+
+    zip_uint8_t *in;         /* uncompressed data when compressing, bits of block when decompressing */
+    zip_uint64_t in_length;  /* bytes when compressing, bits when decompressing */
+    unsigned int first_bit;  /* first bit of block in first byte of in when decompressing */
+
+    zip_uint8_t *out;
+    zip_uint64_t out_length;
+    zip_uint64_t out_size;
+    zip_uint64_t out_offset; /* how much of out has been returned */
+    zip_uint64_t bits_start; /* bits of block in out when compressing */
+    zip_uint64_t bits_end;
+    zip_uint32_t crc;        /* block CRC */
+    int error;               /* zip error code */
+
+    struct block *next;
+};
+#endif
 
 struct ctx {
     zip_error_t *error;
@@ -43,8 +94,64 @@ struct ctx {
     int compression_flags;
     bool end_of_input;
     bz_stream zstr;
+#ifdef HAVE_THREADS
+    zip_uint32_t num_threads;
+    zip_thread_pool_t *pool; /* only set when (de)compressing in parallel */
+    struct block *head;      /* submitted blocks, in order */
+    struct block *tail;
+    struct block *current;    /* block being filled when compressing */
+    zip_uint32_t outstanding; /* submitted blocks not yet waited for */
+    bool last_submitted;
+    zip_uint32_t crc;        /* combined CRC of blocks returned */
+
+    /* compression */
+    zip_uint8_t extra[TRAILER_SIZE]; /* stream header or trailer */
+    size_t extra_length;
+    size_t extra_offset;
+    bool trailer_written;
+    zip_uint8_t pending; /* incomplete last byte of output */
+    unsigned int pending_bits;
+    zip_uint64_t symbols; /* run length encoded size of current block, without current run */
+    zip_uint8_t run_byte;
+    zip_uint64_t run_length;
+
+    /* decompression */
+    int level;           /* from stream header, 0 while not read */
+    zip_uint8_t *scan;   /* input not yet split into blocks */
+    zip_uint64_t scan_length;
+    zip_uint64_t scan_size;
+    zip_uint64_t block_start;  /* bit offset in scan of current block */
+    zip_uint64_t search_start; /* bit offset in scan to continue looking for block magic from */
+    zip_uint32_t stored_crc;
+#endif
 };
 
+#ifdef HAVE_THREADS
+#define PARALLEL(ctx) ((ctx)->pool != NULL)
+
+static void parallel_end(struct ctx *ctx);
+static bool parallel_start(struct ctx *ctx, zip_stat_t *st);
+#endif
+
+
+/* bzip2 allocations use the allocator set with zip_set_allocator() */
+static void *
+bzip2_alloc(void *opaque, int items, int size) {
+    (void)opaque;
+
+    if (items < 0 || size < 0 || (size != 0 && (size_t)items > SIZE_MAX / (size_t)size)) {
+        return NULL;
+    }
+    return _zip_malloc((size_t)items * (size_t)size);
+}
+
+
+static void
+bzip2_free(void *opaque, void *address) {
+    (void)opaque;
+    _zip_free(address);
+}
+
 
 static zip_uint64_t
 maximum_compressed_size(zip_uint64_t uncompressed_size) {
@@ -61,12 +168,20 @@ static void *
 allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     struct ctx *ctx;
 
-    if ((ctx = (struct ctx *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct ctx *)_zip_malloc(sizeof(*ctx))) == NULL) {
         return NULL;
     }
 
     ctx->error = error;
     ctx->compress = compress;
+#ifdef HAVE_THREADS
+    ctx->num_threads = ZIP_COMPRESSION_FLAGS_THREADS(compression_flags);
+    ctx->pool = NULL;
+    ctx->head = ctx->tail = ctx->current = NULL;
+    ctx->scan = NULL;
+    ctx->scan_size = 0;
+#endif
+    compression_flags = ZIP_COMPRESSION_FLAGS_LEVEL(compression_flags);
     if (compression_flags >= 1 && compression_flags <= 9) {
         ctx->compression_flags = (int)compression_flags;
     }
@@ -75,8 +190,8 @@ allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     }
     ctx->end_of_input = false;
 
-    ctx->zstr.bzalloc = NULL;
-    ctx->zstr.bzfree = NULL;
+    ctx->zstr.bzalloc = bzip2_alloc;
+    ctx->zstr.bzfree = bzip2_free;
     ctx->zstr.opaque = NULL;
 
     return ctx;
@@ -101,7 +216,11 @@ static void
 deallocate(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
 
-    free(ctx);
+#ifdef HAVE_THREADS
+    parallel_end(ctx);
+    _zip_free(ctx->scan);
+#endif
+    _zip_free(ctx);
 }
 
 
@@ -142,18 +261,775 @@ map_error(int ret) {
     }
 }
 
+#ifdef HAVE_THREADS
+/* Return n <= 8 bits of data, starting at bit offset. */
+static unsigned int
+get_bits(const zip_uint8_t *data, zip_uint64_t offset, unsigned int n) {
+    const zip_uint8_t *p = data + offset / 8;
+    unsigned int shift = (unsigned int)(offset % 8);
+    unsigned int value = (unsigned int)p[0] << 8;
+
+    /* only access bytes containing requested bits */
+    if (shift + n > 8) {
+        value |= p[1];
+    }
+
+    return (value >> (16 - shift - n)) & ((1u << n) - 1);
+}
+
+
+static zip_uint64_t
+read_bits(const zip_uint8_t *data, zip_uint64_t offset, unsigned int n) {
+    zip_uint64_t value = 0;
+
+    while (n > 0) {
+        unsigned int k = ZIP_MIN(n, 8);
+
+        value = (value << k) | get_bits(data, offset, k);
+        offset += k;
+        n -= k;
+    }
+
+    return value;
+}
+
+
+/* Copy nbits bits from src to dst. Preceding bits in the first byte of dst are kept, following bits in the last byte are cleared.
+   Copies forward, so src may overlap dst if it starts at least a byte later. */
+static void
+copy_bits(zip_uint8_t *dst, zip_uint64_t dst_offset, const zip_uint8_t *src, zip_uint64_t src_offset, zip_uint64_t nbits) {
+    while (nbits > 0) {
+        zip_uint8_t *p = dst + dst_offset / 8;
+        unsigned int used = (unsigned int)(dst_offset % 8);
+        unsigned int n = (unsigned int)ZIP_MIN(8 - used, nbits);
+
+        *p = (zip_uint8_t)((*p & (0xff00 >> used)) | (get_bits(src, src_offset, n) << (8 - used - n)));
+        dst_offset += n;
+        src_offset += n;
+        nbits -= n;
+    }
+}
+
+
+static void
+trailer_fill(zip_uint8_t *trailer, zip_uint32_t crc) {
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        trailer[i] = (zip_uint8_t)(END_MAGIC >> (40 - 8 * i));
+    }
+    for (i = 0; i < 4; i++) {
+        trailer[6 + i] = (zip_uint8_t)(crc >> (24 - 8 * i));
+    }
+}
+
+
+/* Find end of stream in the last bits before end, which are padding to a byte boundary. */
+static bool
+trailer_find(const zip_uint8_t *data, zip_uint64_t start, zip_uint64_t end, zip_uint64_t *offset, zip_uint32_t *crc) {
+    unsigned int padding;
+
+    for (padding = 0; padding < 8 && end >= start + TRAILER_BITS + padding; padding++) {
+        zip_uint64_t trailer = end - padding - TRAILER_BITS;
+
+        if ((padding == 0 || read_bits(data, end - padding, padding) == 0) && read_bits(data, trailer, MAGIC_BITS) == END_MAGIC) {
+            *offset = trailer;
+            *crc = (zip_uint32_t)read_bits(data, trailer + MAGIC_BITS, 32);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* Return bit offset of first block magic in data between start and end, end if there is none. */
+static zip_uint64_t
+magic_find(const zip_uint8_t *data, zip_uint64_t start, zip_uint64_t end) {
+    zip_uint64_t value = 0;
+    zip_uint64_t i;
+
+    if (end < start + MAGIC_BITS) {
+        return end;
+    }
+
+    for (i = start / 8; i < end / 8; i++) {
+        int shift;
+
+        value = (value << 8) | data[i];
+        /* check magics ending in this byte, earliest first */
+        for (shift = 7; shift >= 0; shift--) {
+            zip_uint64_t magic_end = i * 8 + 8 - (zip_uint64_t)shift;
+
+            if (magic_end >= start + MAGIC_BITS && ((value >> shift) & 0xffffffffffffull) == BLOCK_MAGIC) {
+                return magic_end - MAGIC_BITS;
+            }
+        }
+    }
+
+    return end;
+}
+
+
+static void
+crc_combine(struct ctx *ctx, zip_uint32_t crc) {
+    ctx->crc = ((ctx->crc << 1) | (ctx->crc >> 31)) ^ crc;
+}
+
+
+static void
+block_free(struct block *block) {
+    if (block == NULL) {
+        return;
+    }
+
+    _zip_free(block->in);
+    _zip_free(block->out);
+    _zip_free(block);
+}
+
+
+static struct block *
+block_new(struct ctx *ctx, void (*run)(void *)) {
+    struct block *block;
+
+    if ((block = (struct block *)_zip_malloc(sizeof(*block))) == NULL) {
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    block->job.run = run;
+    block->job.ud = block;
+    block->level = ctx->compress ? ctx->compression_flags : ctx->level;
+    block->last = false;
+    block->collected = false;
+    block->in = NULL;
+    block->in_length = 0;
+    block->first_bit = 0;
+    block->out = NULL;
+    block->out_length = block->out_size = block->out_offset = 0;
+    block->bits_start = block->bits_end = 0;
+    block->crc = 0;
+    block->error = ZIP_ER_OK;
+    block->next = NULL;
+
+    return block;
+}
+
+
+static void
+block_submit(struct ctx *ctx, struct block *block) {
+    if (ctx->tail == NULL) {
+        ctx->head = block;
+    }
+    else {
+        ctx->tail->next = block;
+    }
+    ctx->tail = block;
+    ctx->outstanding++;
+    ctx->last_submitted = block->last;
+
+    _zip_thread_pool_submit(ctx->pool, &block->job);
+}
+
+
+/* Runs in worker thread, must only access its block. */
+static void
+block_compress(void *ud) {
+    struct block *block = (struct block *)ud;
+    unsigned int length;
+    zip_uint32_t stream_crc;
+    int ret;
+
+    block->out_size = block->in_length + block->in_length / 100 + 600;
+    if ((block->out = (zip_uint8_t *)_zip_malloc(block->out_size)) == NULL) {
+        block->error = ZIP_ER_MEMORY;
+        return;
+    }
+    length = (unsigned int)block->out_size;
+    ret = BZ2_bzBuffToBuffCompress((char *)block->out, &length, (char *)block->in, (unsigned int)block->in_length, block->level, 0, 30);
+    _zip_free(block->in);
+    block->in = NULL;
+    if (ret != BZ_OK) {
+        block->error = map_error(ret);
+        return;
+    }
+    block->out_length = length;
+    block->bits_start = block->bits_end = HEADER_SIZE * 8;
+
+    if (block->in_length == 0) {
+        /* stream without blocks */
+        return;
+    }
+
+    block->crc = (zip_uint32_t)read_bits(block->out, HEADER_SIZE * 8 + MAGIC_BITS, 32);
+    /* CRC of stream with only one block is the block CRC */
+    if (!trailer_find(block->out, block->bits_start, block->out_length * 8, &block->bits_end, &stream_crc) || stream_crc != block->crc) {
+        block->error = ZIP_ER_INTERNAL;
+    }
+}
+
+
+/* Runs in worker thread, must only access its block. */
+static void
+block_decompress(void *ud) {
+    struct block *block = (struct block *)ud;
+    zip_uint8_t trailer[TRAILER_BITS / 8];
+    zip_uint8_t *stream;
+    zip_uint64_t stream_length;
+    bz_stream zstr;
+    int ret;
+
+    block->error = ZIP_ER_OK;
+    if (block->in_length < MAGIC_BITS + 32) {
+        block->error = ZIP_ER_COMPRESSED_DATA;
+        return;
+    }
+    block->crc = (zip_uint32_t)read_bits(block->in, block->first_bit + MAGIC_BITS, 32);
+
+    /* make block into stream of its own */
+    stream_length = HEADER_SIZE + (block->in_length + TRAILER_BITS + 7) / 8;
+    if (stream_length > UINT_MAX || (stream = (zip_uint8_t *)_zip_malloc(stream_length)) == NULL) {
+        block->error = ZIP_ER_MEMORY;
+        return;
+    }
+    stream[0] = 'B';
+    stream[1] = 'Z';
+    stream[2] = 'h';
+    stream[3] = (zip_uint8_t)('0' + block->level);
+    copy_bits(stream, HEADER_SIZE * 8, block->in, block->first_bit, block->in_length);
+    trailer_fill(trailer, block->crc);
+    copy_bits(stream, HEADER_SIZE * 8 + block->in_length, trailer, 0, TRAILER_BITS);
+
+    /* size of output isn't known, start with block size */
+    _zip_free(block->out);
+    block->out_size = (zip_uint64_t)block->level * 100000;
+    block->out_length = 0;
+    if ((block->out = (zip_uint8_t *)_zip_malloc(block->out_size)) == NULL) {
+        _zip_free(stream);
+        block->error = ZIP_ER_MEMORY;
+        return;
+    }
+
+    zstr.bzalloc = bzip2_alloc;
+    zstr.bzfree = bzip2_free;
+    zstr.opaque = NULL;
+    if ((ret = BZ2_bzDecompressInit(&zstr, 0, 0)) != BZ_OK) {
+        _zip_free(stream);
+        block->error = map_error(ret);
+        return;
+    }
+    zstr.next_in = (char *)stream;
+    zstr.avail_in = (unsigned int)stream_length;
+
+    for (;;) {
+        unsigned int avail_out;
+
+        if (block->out_length == block->out_size) {
+            zip_uint8_t *out;
+
+            if ((out = (zip_uint8_t *)_zip_realloc(block->out, block->out_size * 2)) == NULL) {
+                ret = BZ_MEM_ERROR;
+                break;
+            }
+            block->out = out;
+            block->out_size *= 2;
+        }
+
+        avail_out = (unsigned int)ZIP_MIN(UINT_MAX, block->out_size - block->out_length);
+        zstr.next_out = (char *)block->out + block->out_length;
+        zstr.avail_out = avail_out;
+
+        ret = BZ2_bzDecompress(&zstr);
+        block->out_length += avail_out - zstr.avail_out;
+
+        if (ret != BZ_OK) {
+            break;
+        }
+        if (zstr.avail_in == 0 && zstr.avail_out > 0) {
+            ret = BZ_UNEXPECTED_EOF;
+            break;
+        }
+    }
+
+    BZ2_bzDecompressEnd(&zstr);
+    _zip_free(stream);
+    if (ret != BZ_STREAM_END) {
+        block->error = map_error(ret);
+    }
+}
+
+
+/* Move bits of block to start of its output, after the incomplete last byte of the preceding output, and keep its own incomplete last byte. */
+static void
+block_align(struct ctx *ctx, struct block *block) {
+    zip_uint64_t nbits = block->bits_end - block->bits_start;
+
+    block->out[0] = ctx->pending;
+    copy_bits(block->out, ctx->pending_bits, block->out, block->bits_start, nbits);
+    nbits += ctx->pending_bits;
+    block->out_length = nbits / 8;
+    ctx->pending_bits = (unsigned int)(nbits % 8);
+    ctx->pending = ctx->pending_bits > 0 ? block->out[block->out_length] : 0;
+
+    if (block->bits_end > block->bits_start) {
+        crc_combine(ctx, block->crc);
+    }
+}
+
+
+static bool
+compress_fill(struct ctx *ctx) {
+    struct block *block;
+    zip_uint64_t block_size = PARALLEL_BLOCK_SIZE(ctx->compression_flags);
+    zip_uint64_t block_symbols = PARALLEL_BLOCK_SYMBOLS(ctx->compression_flags);
+    bool full = false;
+
+    if ((block = ctx->current) == NULL) {
+        if ((block = block_new(ctx, block_compress)) == NULL) {
+            return false;
+        }
+        if ((block->in = (zip_uint8_t *)_zip_malloc(block_size)) == NULL) {
+            block_free(block);
+            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        ctx->current = block;
+        ctx->symbols = 0;
+        ctx->run_length = 0;
+    }
+
+    /* follow run length encoding of libbz2 to find out how much fits into one block */
+    while (ctx->zstr.avail_in > 0) {
+        zip_uint8_t c = (zip_uint8_t)*ctx->zstr.next_in;
+
+        if (ctx->run_length > 0 && c == ctx->run_byte && ctx->run_length < 255) {
+            if (ctx->symbols + RUN_SYMBOLS(ctx->run_length + 1) > block_symbols) {
+                full = true;
+                break;
+            }
+            ctx->run_length++;
+        }
+        else {
+            if (ctx->symbols + RUN_SYMBOLS(ctx->run_length) + 1 > block_symbols) {
+                full = true;
+                break;
+            }
+            ctx->symbols += RUN_SYMBOLS(ctx->run_length);
+            ctx->run_byte = c;
+            ctx->run_length = 1;
+        }
+
+        block->in[block->in_length++] = c;
+        ctx->zstr.next_in++;
+        ctx->zstr.avail_in--;
+        if (block->in_length == block_size) {
+            full = true;
+            break;
+        }
+    }
+
+    if (full || (ctx->end_of_input && ctx->zstr.avail_in == 0)) {
+        block->last = ctx->end_of_input && ctx->zstr.avail_in == 0;
+        ctx->current = NULL;
+        block_submit(ctx, block);
+    }
+
+    return true;
+}
+
+
+static void
+trailer_write(struct ctx *ctx) {
+    zip_uint8_t trailer[TRAILER_BITS / 8];
+
+    trailer_fill(trailer, ctx->crc);
+    ctx->extra[0] = ctx->pending;
+    copy_bits(ctx->extra, ctx->pending_bits, trailer, 0, TRAILER_BITS);
+    ctx->extra_length = (ctx->pending_bits + TRAILER_BITS + 7) / 8;
+    ctx->extra_offset = 0;
+    ctx->trailer_written = true;
+}
+
+
+static zip_compression_status_t
+compress_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t out_offset = 0;
+
+    while (out_offset < *length) {
+        struct block *block = ctx->head;
+
+        if (ctx->extra_offset < ctx->extra_length) {
+            zip_uint64_t n = ZIP_MIN(*length - out_offset, ctx->extra_length - ctx->extra_offset);
+
+            (void)memcpy_s(data + out_offset, *length - out_offset, ctx->extra + ctx->extra_offset, n);
+            out_offset += n;
+            ctx->extra_offset += n;
+            continue;
+        }
+
+        if (block != NULL && block->collected) {
+            zip_uint64_t n = ZIP_MIN(*length - out_offset, block->out_length - block->out_offset);
+
+            (void)memcpy_s(data + out_offset, *length - out_offset, block->out + block->out_offset, n);
+            out_offset += n;
+            block->out_offset += n;
+
+            if (block->out_offset == block->out_length) {
+                if ((ctx->head = block->next) == NULL) {
+                    ctx->tail = NULL;
+                }
+                block_free(block);
+            }
+            continue;
+        }
+
+        if (ctx->outstanding < 2 * ctx->num_threads && (ctx->zstr.avail_in > 0 || (ctx->end_of_input && !ctx->last_submitted))) {
+            if (!compress_fill(ctx)) {
+                return ZIP_COMPRESSION_ERROR;
+            }
+            continue;
+        }
+
+        if (block == NULL) {
+            if (ctx->last_submitted && !ctx->trailer_written) {
+                trailer_write(ctx);
+                continue;
+            }
+            *length = out_offset;
+            if (ctx->last_submitted) {
+                return ZIP_COMPRESSION_END;
+            }
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (!ctx->end_of_input && ctx->zstr.avail_in == 0 && ctx->outstanding < 2 * ctx->num_threads) {
+            /* room for more blocks, read more input instead of waiting */
+            *length = out_offset;
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        _zip_thread_pool_wait(ctx->pool, &block->job);
+        block->collected = true;
+        ctx->outstanding--;
+        if (block->error != ZIP_ER_OK) {
+            zip_error_set(ctx->error, block->error, 0);
+            return ZIP_COMPRESSION_ERROR;
+        }
+        block_align(ctx, block);
+    }
+
+    return ZIP_COMPRESSION_OK;
+}
+
+
+/* Submit data from start of current block up to end as block. */
+static bool
+block_add(struct ctx *ctx, zip_uint64_t end, bool last) {
+    struct block *block;
+    zip_uint64_t first = ctx->block_start / 8;
+    zip_uint64_t length = (end + 7) / 8 - first;
+
+    if ((block = block_new(ctx, block_decompress)) == NULL) {
+        return false;
+    }
+    if ((block->in = (zip_uint8_t *)_zip_malloc(length)) == NULL) {
+        block_free(block);
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    (void)memcpy_s(block->in, length, ctx->scan + first, length);
+    block->first_bit = (unsigned int)(ctx->block_start % 8);
+    block->in_length = end - ctx->block_start;
+    block->last = last;
+
+    block_submit(ctx, block);
+    ctx->block_start = end;
+    ctx->search_start = end + MAGIC_BITS;
+
+    return true;
+}
+
+
+/* Join block, which failed to decompress, with the following one and decompress it again. */
+static bool
+block_join(struct ctx *ctx, struct block *block) {
+    struct block *next = block->next;
+    zip_uint64_t nbits = block->first_bit + block->in_length + next->in_length;
+    zip_uint8_t *in;
+
+    if (!next->collected) {
+        _zip_thread_pool_wait(ctx->pool, &next->job);
+        next->collected = true;
+        ctx->outstanding--;
+    }
+
+    if (block->in_length + next->in_length > PARALLEL_MAX_COMPRESSED_BLOCK_SIZE(block->level) * 8) {
+        zip_error_set(ctx->error, block->error, 0);
+        return false;
+    }
+    if ((in = (zip_uint8_t *)_zip_malloc((nbits + 7) / 8)) == NULL) {
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    (void)memcpy_s(in, (nbits + 7) / 8, block->in, (block->first_bit + block->in_length + 7) / 8);
+    copy_bits(in, block->first_bit + block->in_length, next->in, next->first_bit, next->in_length);
+    _zip_free(block->in);
+    block->in = in;
+    block->in_length += next->in_length;
+    block->last = next->last;
+    if ((block->next = next->next) == NULL) {
+        ctx->tail = block;
+    }
+    block_free(next);
+
+    /* rare, so done in calling thread */
+    block_decompress(block);
+
+    return true;
+}
+
+
+static bool
+decompress_fill(struct ctx *ctx) {
+    zip_uint64_t end, offset;
+
+    /* drop data before current block */
+    if (ctx->block_start >= 8) {
+        zip_uint64_t n = ctx->block_start / 8;
+
+        memmove(ctx->scan, ctx->scan + n, (size_t)(ctx->scan_length - n));
+        ctx->scan_length -= n;
+        ctx->block_start -= n * 8;
+        ctx->search_start -= n * 8;
+    }
+
+    if (ctx->zstr.avail_in > 0) {
+        if (ctx->scan_length + ctx->zstr.avail_in > ctx->scan_size) {
+            zip_uint64_t new_size = ZIP_MAX(ctx->scan_size * 2, ctx->scan_length + ctx->zstr.avail_in);
+            zip_uint8_t *scan;
+
+            if (new_size > SIZE_MAX || (scan = (zip_uint8_t *)_zip_realloc(ctx->scan, (size_t)new_size)) == NULL) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+                return false;
+            }
+            ctx->scan = scan;
+            ctx->scan_size = new_size;
+        }
+        (void)memcpy_s(ctx->scan + ctx->scan_length, ctx->scan_size - ctx->scan_length, ctx->zstr.next_in, ctx->zstr.avail_in);
+        ctx->scan_length += ctx->zstr.avail_in;
+        ctx->zstr.next_in += ctx->zstr.avail_in;
+        ctx->zstr.avail_in = 0;
+    }
+
+    if (ctx->level == 0) {
+        if (ctx->scan_length < HEADER_SIZE) {
+            if (ctx->end_of_input) {
+                zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+                return false;
+            }
+            return true;
+        }
+        if (memcmp(ctx->scan, "BZh", 3) != 0 || ctx->scan[3] < '1' || ctx->scan[3] > '9') {
+            zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+            return false;
+        }
+        ctx->level = ctx->scan[3] - '0';
+        ctx->block_start = HEADER_SIZE * 8;
+        ctx->search_start = ctx->block_start + MAGIC_BITS;
+    }
+
+    if (ctx->end_of_input) {
+        if (!trailer_find(ctx->scan, ctx->block_start, ctx->scan_length * 8, &end, &ctx->stored_crc)) {
+            zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+            return false;
+        }
+    }
+    else {
+        /* trailer might start in the last bytes */
+        end = ctx->scan_length > TRAILER_SIZE ? (ctx->scan_length - TRAILER_SIZE) * 8 : 0;
+    }
+
+    while ((offset = magic_find(ctx->scan, ctx->search_start, end)) < end) {
+        if (!block_add(ctx, offset, false)) {
+            return false;
+        }
+    }
+    if (end >= MAGIC_BITS && end - (MAGIC_BITS - 1) > ctx->search_start) {
+        /* earlier starts have been checked */
+        ctx->search_start = end - (MAGIC_BITS - 1);
+    }
+
+    if (ctx->end_of_input) {
+        if (end > ctx->block_start) {
+            return block_add(ctx, end, true);
+        }
+        /* stream without blocks */
+        ctx->last_submitted = true;
+    }
+    else if (ctx->scan_length * 8 - ctx->block_start > PARALLEL_MAX_COMPRESSED_BLOCK_SIZE(ctx->level) * 8) {
+        zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+        return false;
+    }
+
+    return true;
+}
+
+
+static zip_compression_status_t
+decompress_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t out_offset = 0;
+
+    while (out_offset < *length) {
+        struct block *block = ctx->head;
+        bool failed = block != NULL && block->collected && block->error != ZIP_ER_OK;
+
+        if (failed) {
+            if (block->next != NULL) {
+                if (!block_join(ctx, block)) {
+                    return ZIP_COMPRESSION_ERROR;
+                }
+                continue;
+            }
+            if (block->last) {
+                zip_error_set(ctx->error, block->error, 0);
+                return ZIP_COMPRESSION_ERROR;
+            }
+        }
+        else if (block != NULL && block->collected) {
+            zip_uint64_t n = ZIP_MIN(*length - out_offset, block->out_length - block->out_offset);
+
+            (void)memcpy_s(data + out_offset, *length - out_offset, block->out + block->out_offset, n);
+            out_offset += n;
+            block->out_offset += n;
+
+            if (block->out_offset == block->out_length) {
+                crc_combine(ctx, block->crc);
+                if ((ctx->head = block->next) == NULL) {
+                    ctx->tail = NULL;
+                }
+                block_free(block);
+            }
+            continue;
+        }
+
+        /* failed block needs the following one, even if too many are outstanding */
+        if ((ctx->outstanding < 2 * ctx->num_threads || failed) && (ctx->zstr.avail_in > 0 || (ctx->end_of_input && !ctx->last_submitted))) {
+            if (!decompress_fill(ctx)) {
+                return ZIP_COMPRESSION_ERROR;
+            }
+            continue;
+        }
+
+        if (block == NULL) {
+            *length = out_offset;
+            if (ctx->last_submitted) {
+                if (ctx->crc != ctx->stored_crc) {
+                    zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+                    return ZIP_COMPRESSION_ERROR;
+                }
+                return ZIP_COMPRESSION_END;
+            }
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (failed || (!ctx->end_of_input && ctx->zstr.avail_in == 0 && ctx->outstanding < 2 * ctx->num_threads)) {
+            /* read more input instead of waiting */
+            *length = out_offset;
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        _zip_thread_pool_wait(ctx->pool, &block->job);
+        block->collected = true;
+        ctx->outstanding--;
+    }
+
+    return ZIP_COMPRESSION_OK;
+}
+
+
+static bool
+parallel_start(struct ctx *ctx, zip_stat_t *st) {
+    if (!ctx->compress && ((st->valid & ZIP_STAT_SIZE) == 0 || st->size < PARALLEL_MIN_SIZE)) {
+        return true;
+    }
+
+    /* decompress in calling thread if pool can't be created; with one thread, blocks are compressed in calling thread */
+    if ((ctx->pool = _zip_thread_pool_new(ctx->num_threads > 1 ? ctx->num_threads : 0, ctx->compress ? ctx->error : NULL)) == NULL) {
+        return !ctx->compress;
+    }
+
+    ctx->outstanding = 0;
+    ctx->last_submitted = false;
+    ctx->crc = 0;
+    ctx->extra_length = ctx->extra_offset = 0;
+    ctx->trailer_written = false;
+    ctx->pending = 0;
+    ctx->pending_bits = 0;
+    ctx->level = 0;
+    ctx->scan_length = 0;
+    ctx->block_start = ctx->search_start = 0;
+    ctx->stored_crc = 0;
+
+    if (ctx->compress) {
+        ctx->extra[0] = 'B';
+        ctx->extra[1] = 'Z';
+        ctx->extra[2] = 'h';
+        ctx->extra[3] = (zip_uint8_t)('0' + ctx->compression_flags);
+        ctx->extra_length = HEADER_SIZE;
+    }
+
+    return true;
+}
+
+
+static void
+parallel_end(struct ctx *ctx) {
+    if (ctx->pool == NULL) {
+        return;
+    }
+
+    /* waits for running jobs, so all blocks can be freed afterwards */
+    _zip_thread_pool_free(ctx->pool);
+    ctx->pool = NULL;
+
+    while (ctx->head != NULL) {
+        struct block *block = ctx->head;
+        ctx->head = block->next;
+        block_free(block);
+    }
+    ctx->tail = NULL;
+    block_free(ctx->current);
+    ctx->current = NULL;
+}
+#endif
+
+
 static bool
 start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
     struct ctx *ctx = (struct ctx *)ud;
     int ret;
 
-    (void)st;
     (void)attributes;
 
     ctx->zstr.avail_in = 0;
     ctx->zstr.next_in = NULL;
     ctx->zstr.avail_out = 0;
     ctx->zstr.next_out = NULL;
+    ctx->end_of_input = false;
+
+#ifdef HAVE_THREADS
+    if (ctx->num_threads > (ctx->compress ? 0 : 1)) {
+        if (!parallel_start(ctx, st)) {
+            return false;
+        }
+        if (PARALLEL(ctx)) {
+            return true;
+        }
+    }
+#else
+    (void)st;
+#endif
 
     if (ctx->compress) {
         ret = BZ2_bzCompressInit(&ctx->zstr, ctx->compression_flags, 0, 30);
@@ -176,6 +1052,13 @@ end(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
     int err;
 
+#ifdef HAVE_THREADS
+    if (PARALLEL(ctx)) {
+        parallel_end(ctx);
+        return true;
+    }
+#endif
+
     if (ctx->compress) {
         err = BZ2_bzCompressEnd(&ctx->zstr);
     }
@@ -216,6 +1099,35 @@ end_of_input(void *ud) {
 }
 
 
+static zip_uint64_t
+unconsumed_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    return ctx->zstr.avail_in;
+}
+
+
+/* Memory needed by libbzip2, from its manual: 400k + 8 * block size for compression, 100k + 4 * block size for decompression.
+   The block size of compressed data is only known from its header, so assume the largest. */
+static zip_uint64_t
+memory_usage(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t size;
+
+    if (ctx->compress) {
+        size = 400 * 1024 + 8 * (zip_uint64_t)ctx->compression_flags * 100000;
+    }
+    else {
+        size = 100 * 1024 + 4 * (zip_uint64_t)9 * 100000;
+    }
+#ifdef HAVE_THREADS
+    /* each thread runs its own stream */
+    size *= ZIP_MAX(ctx->num_threads, 1);
+#endif
+    return sizeof(*ctx) + size;
+}
+
+
 static zip_compression_status_t
 process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
     struct ctx *ctx = (struct ctx *)ud;
@@ -223,6 +1135,12 @@ process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
 
     int ret;
 
+#ifdef HAVE_THREADS
+    if (PARALLEL(ctx)) {
+        return ctx->compress ? compress_process(ctx, data, length) : decompress_process(ctx, data, length);
+    }
+#endif
+
     if (ctx->zstr.avail_in == 0 && !ctx->end_of_input) {
         *length = 0;
         return ZIP_COMPRESSION_NEED_DATA;
@@ -273,7 +1191,13 @@ zip_compression_algorithm_t zip_algorithm_bzip2_compress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    memory_usage,
+    NULL
 };
 
 
@@ -287,7 +1211,13 @@ zip_compression_algorithm_t zip_algorithm_bzip2_decompress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    NULL,
+    NULL,
+    NULL,
+    unconsumed_input,
+    memory_usage,
+    NULL
 };
 
 /* clang-format on */
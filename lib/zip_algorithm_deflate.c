@@ -35,7 +35,151 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
+#ifdef HAVE_ISAL
+#include <isa-l.h>
+#endif
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+/* Random access when decompressing: after the first seek, the state of the decompressor is recorded
+   at block boundaries every CHECKPOINT_INTERVAL bytes of output, so later seeks can restart from there.
+   Seek points from the seek index of the entry are used as checkpoints without window.
+
+   When compressing with ZIP_CM_FL_SEEKABLE, the stream is fully flushed every CHECKPOINT_INTERVAL bytes
+   of input, and the resulting seek points are recorded for the seek index. */
+
+#if ZLIB_VERNUM >= 0x1271
+#define HAVE_CHECKPOINTS
+#endif
+
+/* When compressing with ZIP_CM_FL_RSYNCABLE, the stream is fully flushed after input bytes where a rolling hash of
+   the preceding bytes hits RSYNC_HIT, on average every 2^RSYNC_BITS bytes. Boundaries depend only on the data around
+   them, and a full flush resets the dictionary, so a change in the input only changes the output up to the next
+   boundary after it, and rsync can reuse the rest. The hash is the one used by pigz, which needs no window. */
+#define RSYNC_BITS 15
+#define RSYNC_MASK ((1u << RSYNC_BITS) - 1)
+#define RSYNC_HIT (RSYNC_MASK >> 1)
+
+#define CHECKPOINT_INTERVAL (4 * 1024 * 1024)
+#define CHECKPOINT_WINDOW_SIZE 32768
+
+#ifdef HAVE_LIBDEFLATE
+/* Files of known size up to LIBDEFLATE_MAX_SIZE are collected in memory and (de)compressed at once with libdeflate,
+   which is considerably faster than zlib. If libdeflate fails, e.g. because the size was wrong, the collected data is
+   passed to zlib instead, so errors are reported as without libdeflate. Output differs from zlib's when compressing,
+   so torrentzip always uses zlib, as do tiny files, where there is nothing to gain. */
+#define LIBDEFLATE_MIN_COMPRESS_SIZE 4096
+#ifndef LIBDEFLATE_MAX_SIZE
+#define LIBDEFLATE_MAX_SIZE (4 * 1024 * 1024)
+#endif
+#if LIBDEFLATE_MAX_SIZE > UINT_MAX
+#undef LIBDEFLATE_MAX_SIZE
+#define LIBDEFLATE_MAX_SIZE UINT_MAX
+#endif
+
+struct whole {
+    bool active;   /* collecting input or returning output */
+    bool finished; /* out is valid */
+    struct libdeflate_compressor *compressor; /* kept across start/end */
+    struct libdeflate_decompressor *decompressor;
+    zip_uint8_t *in;
+    zip_uint64_t in_length;
+    zip_uint64_t in_size;
+    zip_uint64_t last_input_length;
+    zip_uint8_t *out;
+    zip_uint64_t out_length;
+    zip_uint64_t out_size;
+    zip_uint64_t out_offset; /* how much of out has been returned */
+    zip_uint64_t unconsumed; /* input after end of compressed data */
+    zip_uint64_t expected_size;
+    zip_uint8_t *pending; /* input not yet passed to zlib after falling back */
+    zip_uint64_t pending_length;
+};
+#endif
+
+struct checkpoint {
+    zip_uint64_t uncompressed_offset;
+    zip_uint64_t compressed_offset;
+    int bits;          /* unused bits in last byte consumed */
+    zip_uint8_t value; /* last byte consumed, if bits > 0 */
+    uInt window_length;
+    zip_uint8_t *window;
+};
+
+#ifdef HAVE_THREADS
+/* Parallel compression: input is split into blocks which are compressed independently,
+   each primed with the last 32k of the preceding block, and concatenated. */
+
+#define PARALLEL_BLOCK_SIZE (128 * 1024)
+#define PARALLEL_DICTIONARY_SIZE 32768
+
+struct block {
+    zip_thread_job_t job;
+    int level;
+    int mem_level;
+    bool last;      /* finish stream after this block */
+    bool collected; /* job has been waited for */
+    bool seek_point; /* block doesn't use dictionary, decompression can start here */
+    zip_uint64_t uncompressed_offset;
+
+    zip_uint8_t *in;
+    uInt in_length;
+    zip_uint8_t dictionary[PARALLEL_DICTIONARY_SIZE];
+    uInt dictionary_length;
+
+    zip_uint8_t *out;
+    zip_uint64_t out_length;
+    zip_uint64_t out_size;
+    zip_uint64_t out_offset; /* how much of out has been returned */
+    int ret;
+
+    struct block *next;
+};
+
+/* Parallel decompression of large files: the compressed data is split into chunks of PARALLEL_CHUNK_SIZE bytes, which
+   are decompressed in worker threads. Each chunk searches for the first block header in its data and decodes from
+   there, until the first block boundary after its end, reading into the next chunk as needed. Block boundaries aren't
+   marked in deflate, so this is speculation, which is confirmed when the preceding chunk ends where the chunk started.
+
+   The window of the preceding chunk isn't known while decoding, so each chunk is decoded with a made-up dictionary,
+   until its output doesn't refer to the preceding chunk any more; a second pass with another dictionary finds the
+   bytes copied from the window, which are replaced once the real window is known. If speculation fails, the chunk is
+   decoded again in the calling thread; if that isn't possible, e.g. because a block doesn't fit in a chunk, decoding
+   continues with zlib. */
+
+#define PARALLEL_CHUNK_SIZE (1024 * 1024)
+#define PARALLEL_MIN_COMPRESSED_SIZE (8 * PARALLEL_CHUNK_SIZE)
+#define PARALLEL_MAX_CHUNK_OUTPUT (16 * PARALLEL_CHUNK_SIZE)
+#define PARALLEL_COMPARE_SIZE (64 * 1024)
+
+struct chunk {
+    zip_thread_job_t job;
+    bool collected; /* job has been waited for */
+    bool first;     /* starts at beginning of compressed data */
+
+    zip_uint8_t *in; /* this chunk followed by the next one */
+    zip_uint64_t in_length;
+    zip_uint64_t in_offset; /* offset of in in compressed data */
+    zip_uint64_t limit;     /* decoding ends at first block boundary at or after this bit offset in in */
+
+    bool found;         /* start of block found and decoded from */
+    zip_uint64_t start; /* bit offset in in where decoding started */
+    zip_uint64_t end;   /* bit offset in in where decoding ended */
+    bool final;         /* end of compressed data reached */
+
+    zip_uint8_t *out;
+    zip_uint64_t out_length;
+    zip_uint64_t out_size;
+    zip_uint64_t out_offset; /* how much of out has been returned */
+    zip_uint8_t *alternate;  /* out decoded with other dictionary */
+    zip_uint64_t alternate_length; /* out from here on doesn't refer to window */
+
+    struct chunk *next;
+};
+#endif
 
 struct ctx {
     zip_error_t *error;
@@ -44,8 +188,102 @@ struct ctx {
     int mem_level;
     bool end_of_input;
     z_stream zstr;
+    bool zstr_initialized; /* kept across start/end, so the stream can be reset instead of reinitialized */
+#ifdef HAVE_LIBDEFLATE
+    struct whole whole;
+#endif
+#ifdef HAVE_ISAL
+    bool isal_active;
+    struct inflate_state *isal; /* kept across start/end */
+    zip_uint64_t isal_last_input_length;
+#endif
+
+    zip_uint64_t in_position;  /* input bytes consumed */
+    zip_uint64_t out_position; /* output bytes produced */
+    zip_uint8_t last_byte;     /* last compressed byte consumed */
+    bool record_checkpoints;
+    struct checkpoint *checkpoints; /* sorted by offset */
+    zip_uint64_t ncheckpoints;
+    zip_uint64_t checkpoints_alloc;
+
+    bool want_seek_points;
+    bool record_seek_points; /* cleared if recording fails */
+    zip_uint64_t last_seek_point; /* uncompressed offset of latest full flush */
+    zip_seek_point_t *seek_points;
+    zip_uint64_t nseek_points;
+    zip_uint64_t seek_points_alloc;
+
+    bool rsyncable;
+    zip_uint32_t rsync_hash;
+    bool rsync_flush; /* full flush once zlib has consumed input up to boundary */
+    uInt rsync_held;  /* input after boundary, not yet passed to zlib */
+#ifdef HAVE_THREADS
+    zip_uint32_t num_threads;
+    zip_thread_pool_t *pool;
+    struct block *head; /* submitted blocks, in order */
+    struct block *tail;
+    struct block *current; /* block being filled */
+    zip_uint32_t outstanding; /* submitted blocks not yet waited for */
+    bool last_submitted;
+    zip_uint8_t *dictionary; /* end of last submitted block, or window when decompressing */
+    uInt dictionary_length;
+
+    struct chunk *chunk_head; /* submitted chunks, in order */
+    struct chunk *chunk_tail;
+    zip_uint8_t *scan; /* compressed data not yet needed by finished chunks */
+    zip_uint64_t scan_length;
+    zip_uint64_t scan_size;
+    zip_uint64_t scan_offset;  /* offset of scan in compressed data */
+    zip_uint64_t chunk_offset; /* offset of next chunk in compressed data */
+    zip_uint64_t next_start;   /* bit offset in compressed data where the last finished chunk ended */
+    bool inflate_done;         /* final chunk has been returned */
+    zip_uint8_t *fallback;     /* compressed data passed to zlib after falling back */
+#endif
 };
 
+#ifdef HAVE_THREADS
+#define PARALLEL(ctx) ((ctx)->compress && (ctx)->num_threads > 0)
+#define INFLATE_PARALLEL(ctx) (!(ctx)->compress && (ctx)->pool != NULL)
+
+static void inflate_parallel_end(struct ctx *ctx);
+static zip_compression_status_t inflate_parallel_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length);
+static bool inflate_parallel_start(struct ctx *ctx, zip_stat_t *st);
+static void parallel_end(struct ctx *ctx);
+#endif
+
+static void rsync_limit_input(struct ctx *ctx);
+static bool zstr_start(struct ctx *ctx);
+#ifdef HAVE_ISAL
+static zip_compression_status_t isal_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length);
+static bool isal_start(struct ctx *ctx, zip_stat_t *st);
+#endif
+#ifdef HAVE_LIBDEFLATE
+static bool whole_fall_back(struct ctx *ctx, zip_uint8_t *pending, zip_uint64_t pending_length);
+static bool whole_finish(struct ctx *ctx);
+static bool whole_input(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t length);
+static zip_compression_status_t whole_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length);
+static bool whole_start(struct ctx *ctx, zip_stat_t *st);
+#endif
+
+
+/* zlib allocations use the allocator set with zip_set_allocator() */
+static voidpf
+zlib_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+
+    if (size != 0 && items > SIZE_MAX / size) {
+        return Z_NULL;
+    }
+    return _zip_malloc((size_t)items * size);
+}
+
+
+static void
+zlib_free(voidpf opaque, voidpf address) {
+    (void)opaque;
+    _zip_free(address);
+}
+
 
 static zip_uint64_t
 maximum_compressed_size(zip_uint64_t uncompressed_size) {
@@ -64,13 +302,32 @@ static void *
 allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     struct ctx *ctx;
 
-    if ((ctx = (struct ctx *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct ctx *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ET_SYS, errno);
         return NULL;
     }
 
     ctx->error = error;
     ctx->compress = compress;
+    ctx->record_checkpoints = false;
+    ctx->checkpoints = NULL;
+    ctx->ncheckpoints = ctx->checkpoints_alloc = 0;
+    ctx->want_seek_points = compress && (compression_flags & ZIP_COMPRESSION_FLAGS_SEEK_POINTS) != 0;
+    ctx->seek_points = NULL;
+    ctx->nseek_points = ctx->seek_points_alloc = 0;
+    ctx->rsyncable = compress && (compression_flags & ZIP_COMPRESSION_FLAGS_RSYNCABLE) != 0;
+#ifdef HAVE_THREADS
+    /* blocks of parallel compression are primed with the preceding data, so they don't resynchronize */
+    ctx->num_threads = ctx->rsyncable ? 0 : ZIP_COMPRESSION_FLAGS_THREADS(compression_flags);
+    ctx->pool = NULL;
+    ctx->head = ctx->tail = ctx->current = NULL;
+    ctx->dictionary = NULL;
+    ctx->chunk_head = ctx->chunk_tail = NULL;
+    ctx->scan = NULL;
+    ctx->scan_size = 0;
+    ctx->fallback = NULL;
+#endif
+    compression_flags = ZIP_COMPRESSION_FLAGS_LEVEL(compression_flags);
     if (compression_flags >= 1 && compression_flags <= 9) {
         ctx->level = (int)compression_flags;
     }
@@ -80,9 +337,22 @@ allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     ctx->mem_level = compression_flags == TORRENTZIP_COMPRESSION_FLAGS ? TORRENTZIP_MEM_LEVEL : MAX_MEM_LEVEL;
     ctx->end_of_input = false;
 
-    ctx->zstr.zalloc = Z_NULL;
-    ctx->zstr.zfree = Z_NULL;
+    ctx->zstr.zalloc = zlib_alloc;
+    ctx->zstr.zfree = zlib_free;
     ctx->zstr.opaque = NULL;
+    ctx->zstr_initialized = false;
+#ifdef HAVE_LIBDEFLATE
+    ctx->whole.active = false;
+    ctx->whole.compressor = NULL;
+    ctx->whole.decompressor = NULL;
+    ctx->whole.in = ctx->whole.out = NULL;
+    ctx->whole.in_size = ctx->whole.out_size = 0;
+    ctx->whole.pending_length = 0;
+#endif
+#ifdef HAVE_ISAL
+    ctx->isal_active = false;
+    ctx->isal = NULL;
+#endif
 
     return ctx;
 }
@@ -105,74 +375,314 @@ decompress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_err
 static void
 deallocate(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t i;
+
+#ifdef HAVE_THREADS
+    inflate_parallel_end(ctx);
+    parallel_end(ctx);
+    _zip_free(ctx->fallback);
+#endif
+    if (ctx->zstr_initialized) {
+        if (ctx->compress) {
+            deflateEnd(&ctx->zstr);
+        }
+        else {
+            inflateEnd(&ctx->zstr);
+        }
+    }
+    for (i = 0; i < ctx->ncheckpoints; i++) {
+        _zip_free(ctx->checkpoints[i].window);
+    }
+    _zip_free(ctx->checkpoints);
+    _zip_free(ctx->seek_points);
+#ifdef HAVE_LIBDEFLATE
+    if (ctx->whole.compressor != NULL) {
+        libdeflate_free_compressor(ctx->whole.compressor);
+    }
+    if (ctx->whole.decompressor != NULL) {
+        libdeflate_free_decompressor(ctx->whole.decompressor);
+    }
+    _zip_free(ctx->whole.in);
+    _zip_free(ctx->whole.out);
+#endif
+#ifdef HAVE_ISAL
+    _zip_free(ctx->isal);
+#endif
+    _zip_free(ctx);
+}
+
+
+static void
+seek_point_add(struct ctx *ctx, zip_uint64_t uncompressed_offset, zip_uint64_t compressed_offset) {
+    if (ctx->nseek_points == ctx->seek_points_alloc) {
+        zip_uint64_t new_alloc = ctx->seek_points_alloc > 0 ? ctx->seek_points_alloc * 2 : 16;
+        zip_seek_point_t *new_points;
+
+        if (new_alloc > SIZE_MAX / sizeof(*new_points) || (new_points = (zip_seek_point_t *)_zip_realloc(ctx->seek_points, sizeof(*new_points) * (size_t)new_alloc)) == NULL) {
+            /* seek index is optional, continue without it */
+            ctx->record_seek_points = false;
+            ctx->nseek_points = 0;
+            return;
+        }
+        ctx->seek_points = new_points;
+        ctx->seek_points_alloc = new_alloc;
+    }
 
-    free(ctx);
+    ctx->seek_points[ctx->nseek_points].uncompressed_offset = uncompressed_offset;
+    ctx->seek_points[ctx->nseek_points].compressed_offset = compressed_offset;
+    ctx->nseek_points++;
 }
 
 
-static zip_uint16_t
-general_purpose_bit_flags(void *ud) {
-    struct ctx *ctx = (struct ctx *)ud;
+#ifdef HAVE_THREADS
+static void
+block_free(struct block *block) {
+    if (block == NULL) {
+        return;
+    }
 
-    if (!ctx->compress) {
-        return 0;
+    _zip_free(block->in);
+    _zip_free(block->out);
+    _zip_free(block);
+}
+
+
+/* Runs in worker thread, must only access its block. */
+static void
+block_compress(void *ud) {
+    struct block *block = (struct block *)ud;
+    z_stream zstr;
+    int ret;
+
+    zstr.zalloc = zlib_alloc;
+    zstr.zfree = zlib_free;
+    zstr.opaque = NULL;
+
+    if ((ret = deflateInit2(&zstr, block->level, Z_DEFLATED, -MAX_WBITS, block->mem_level, Z_DEFAULT_STRATEGY)) != Z_OK) {
+        block->ret = ret;
+        return;
     }
 
-    if (ctx->level < 3) {
-        return 2 << 1;
+    if (block->dictionary_length > 0 && (ret = deflateSetDictionary(&zstr, block->dictionary, block->dictionary_length)) != Z_OK) {
+        deflateEnd(&zstr);
+        block->ret = ret;
+        return;
     }
-    else if (ctx->level > 7) {
-        return 1 << 1;
+
+    /* room for sync flush marker */
+    block->out_size = deflateBound(&zstr, block->in_length) + 16;
+    block->out_length = 0;
+    if ((block->out = (zip_uint8_t *)_zip_malloc(block->out_size)) == NULL) {
+        deflateEnd(&zstr);
+        block->ret = Z_MEM_ERROR;
+        return;
     }
-    return 0;
-}
 
+    zstr.next_in = (Bytef *)block->in;
+    zstr.avail_in = block->in_length;
 
-static bool
-start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
-    struct ctx *ctx = (struct ctx *)ud;
-    int ret;
+    for (;;) {
+        uInt avail_out;
 
-    (void)st;
-    (void)attributes;
+        if (block->out_length == block->out_size) {
+            zip_uint8_t *out;
 
-    ctx->zstr.avail_in = 0;
-    ctx->zstr.next_in = NULL;
-    ctx->zstr.avail_out = 0;
-    ctx->zstr.next_out = NULL;
+            if ((out = (zip_uint8_t *)_zip_realloc(block->out, block->out_size * 2)) == NULL) {
+                ret = Z_MEM_ERROR;
+                break;
+            }
+            block->out = out;
+            block->out_size *= 2;
+        }
 
-    if (ctx->compress) {
-        /* negative value to tell zlib not to write a header */
-        ret = deflateInit2(&ctx->zstr, ctx->level, Z_DEFLATED, -MAX_WBITS, ctx->mem_level, Z_DEFAULT_STRATEGY);
+        avail_out = (uInt)ZIP_MIN(UINT_MAX, block->out_size - block->out_length);
+        zstr.next_out = (Bytef *)block->out + block->out_length;
+        zstr.avail_out = avail_out;
+
+        /* sync flush ends the output on a byte boundary, so the next block can be appended */
+        ret = deflate(&zstr, block->last ? Z_FINISH : Z_SYNC_FLUSH);
+        block->out_length += avail_out - zstr.avail_out;
+
+        if (ret == Z_STREAM_END || (ret == Z_OK && !block->last && zstr.avail_out > 0)) {
+            ret = Z_OK;
+            break;
+        }
+        if (ret != Z_OK) {
+            break;
+        }
+    }
+
+    deflateEnd(&zstr);
+    block->ret = ret;
+}
+
+
+static void
+parallel_submit(struct ctx *ctx) {
+    struct block *block = ctx->current;
+
+    block->last = ctx->end_of_input && ctx->zstr.avail_in == 0;
+    block->job.run = block_compress;
+    block->job.ud = block;
+    block->next = NULL;
+
+    if (ctx->tail == NULL) {
+        ctx->head = block;
     }
     else {
-        ret = inflateInit2(&ctx->zstr, -MAX_WBITS);
+        ctx->tail->next = block;
     }
+    ctx->tail = block;
+    ctx->current = NULL;
+    ctx->outstanding++;
+
+    ctx->in_position += block->in_length;
+
+    /* all blocks but the last are full, so the dictionary is the end of the preceding block */
+    if (!block->last) {
+        if (ctx->record_seek_points && ctx->in_position - ctx->last_seek_point >= CHECKPOINT_INTERVAL) {
+            /* next block starts without dictionary after sync flush, so it is a seek point */
+            ctx->dictionary_length = 0;
+            ctx->last_seek_point = ctx->in_position;
+        }
+        else {
+            (void)memcpy_s(ctx->dictionary, PARALLEL_DICTIONARY_SIZE, block->in + PARALLEL_BLOCK_SIZE - PARALLEL_DICTIONARY_SIZE, PARALLEL_DICTIONARY_SIZE);
+            ctx->dictionary_length = PARALLEL_DICTIONARY_SIZE;
+        }
+    }
+    ctx->last_submitted = block->last;
 
-    if (ret != Z_OK) {
-        zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
-        return false;
+    _zip_thread_pool_submit(ctx->pool, &block->job);
+}
+
+
+static bool
+parallel_fill(struct ctx *ctx) {
+    struct block *block;
+    uInt n;
+
+    if ((block = ctx->current) == NULL) {
+        if ((block = (struct block *)_zip_malloc(sizeof(*block))) == NULL) {
+            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        if ((block->in = (zip_uint8_t *)_zip_malloc(PARALLEL_BLOCK_SIZE)) == NULL) {
+            _zip_free(block);
+            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        block->level = ctx->level;
+        block->mem_level = ctx->mem_level;
+        block->collected = false;
+        block->seek_point = ctx->in_position > 0 && ctx->dictionary_length == 0;
+        block->uncompressed_offset = ctx->in_position;
+        block->in_length = 0;
+        block->out = NULL;
+        block->out_length = block->out_size = block->out_offset = 0;
+        block->ret = Z_OK;
+
+        block->dictionary_length = ctx->dictionary_length;
+        (void)memcpy_s(block->dictionary, sizeof(block->dictionary), ctx->dictionary, ctx->dictionary_length);
+        ctx->current = block;
     }
 
+    n = ZIP_MIN(ctx->zstr.avail_in, PARALLEL_BLOCK_SIZE - block->in_length);
+    if (n > 0) {
+        (void)memcpy_s(block->in + block->in_length, PARALLEL_BLOCK_SIZE - block->in_length, ctx->zstr.next_in, n);
+        block->in_length += n;
+        ctx->zstr.next_in += n;
+        ctx->zstr.avail_in -= n;
+    }
+
+    if (block->in_length == PARALLEL_BLOCK_SIZE || (ctx->end_of_input && ctx->zstr.avail_in == 0)) {
+        parallel_submit(ctx);
+    }
 
     return true;
 }
 
 
-static bool
-end(void *ud) {
-    struct ctx *ctx = (struct ctx *)ud;
-    int err;
+static zip_compression_status_t
+parallel_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t out_offset = 0;
+
+    while (out_offset < *length) {
+        struct block *block = ctx->head;
+
+        if (block != NULL && block->collected) {
+            zip_uint64_t n = ZIP_MIN(*length - out_offset, block->out_length - block->out_offset);
+
+            if (block->seek_point && block->out_offset == 0 && ctx->record_seek_points) {
+                seek_point_add(ctx, block->uncompressed_offset, ctx->out_position);
+            }
+            (void)memcpy_s(data + out_offset, *length - out_offset, block->out + block->out_offset, n);
+            out_offset += n;
+            block->out_offset += n;
+            ctx->out_position += n;
+
+            if (block->out_offset == block->out_length) {
+                if ((ctx->head = block->next) == NULL) {
+                    ctx->tail = NULL;
+                }
+                block_free(block);
+            }
+            continue;
+        }
 
-    if (ctx->compress) {
-        err = deflateEnd(&ctx->zstr);
-    }
-    else {
-        err = inflateEnd(&ctx->zstr);
+        if (ctx->outstanding < 2 * ctx->num_threads && (ctx->zstr.avail_in > 0 || (ctx->end_of_input && !ctx->last_submitted))) {
+            if (!parallel_fill(ctx)) {
+                return ZIP_COMPRESSION_ERROR;
+            }
+            continue;
+        }
+
+        if (block == NULL) {
+            *length = out_offset;
+            if (ctx->last_submitted) {
+                return ZIP_COMPRESSION_END;
+            }
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (!ctx->end_of_input && ctx->zstr.avail_in == 0 && ctx->outstanding < 2 * ctx->num_threads) {
+            /* room for more blocks, read more input instead of waiting */
+            *length = out_offset;
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        _zip_thread_pool_wait(ctx->pool, &block->job);
+        block->collected = true;
+        ctx->outstanding--;
+        if (block->ret != Z_OK) {
+            if (block->ret == Z_MEM_ERROR) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            }
+            else {
+                zip_error_set(ctx->error, ZIP_ER_ZLIB, block->ret);
+            }
+            return ZIP_COMPRESSION_ERROR;
+        }
     }
 
-    if (err != Z_OK) {
-        zip_error_set(ctx->error, ZIP_ER_ZLIB, err);
+    return ZIP_COMPRESSION_OK;
+}
+
+
+static bool
+parallel_start(struct ctx *ctx) {
+    ctx->end_of_input = false;
+    ctx->outstanding = 0;
+    ctx->last_submitted = false;
+    ctx->dictionary_length = 0;
+
+    if ((ctx->dictionary = (zip_uint8_t *)_zip_malloc(PARALLEL_DICTIONARY_SIZE)) == NULL) {
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    /* with one thread, blocks are compressed in calling thread */
+    if ((ctx->pool = _zip_thread_pool_new(ctx->num_threads > 1 ? ctx->num_threads : 0, ctx->error)) == NULL) {
+        _zip_free(ctx->dictionary);
+        ctx->dictionary = NULL;
         return false;
     }
 
@@ -180,69 +690,1406 @@ end(void *ud) {
 }
 
 
+static void
+parallel_end(struct ctx *ctx) {
+    /* waits for running jobs, so all blocks can be freed afterwards */
+    _zip_thread_pool_free(ctx->pool);
+    ctx->pool = NULL;
+
+    while (ctx->head != NULL) {
+        struct block *block = ctx->head;
+        ctx->head = block->next;
+        block_free(block);
+    }
+    ctx->tail = NULL;
+    block_free(ctx->current);
+    ctx->current = NULL;
+    _zip_free(ctx->dictionary);
+    ctx->dictionary = NULL;
+}
+
+static void
+chunk_free(struct chunk *chunk) {
+    if (chunk == NULL) {
+        return;
+    }
+
+    _zip_free(chunk->in);
+    _zip_free(chunk->out);
+    _zip_free(chunk->alternate);
+    _zip_free(chunk);
+}
+
+
+/* Read n bits starting at bit offset position, least significant bit first. */
+static zip_uint32_t
+bits_get(const zip_uint8_t *in, zip_uint64_t position, int n) {
+    zip_uint32_t value = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        value |= (zip_uint32_t)((in[(position + (zip_uint64_t)i) / 8] >> ((position + (zip_uint64_t)i) % 8)) & 1) << i;
+    }
+    return value;
+}
+
+
+/* Header of stored block: zero padding to next byte, LEN and its one's complement. */
 static bool
-input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
-    struct ctx *ctx = (struct ctx *)ud;
+stored_header(const zip_uint8_t *in, zip_uint64_t in_bits, zip_uint64_t position) {
+    zip_uint64_t aligned = (position + 10) / 8 * 8;
+    zip_uint32_t length;
 
-    if (length > UINT_MAX || ctx->zstr.avail_in > 0) {
-        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+    if (aligned + 32 > in_bits || bits_get(in, position + 1, 2) != 0) {
         return false;
     }
+    if (aligned > position + 3 && bits_get(in, position + 3, (int)(aligned - position - 3)) != 0) {
+        return false;
+    }
+    length = (zip_uint32_t)in[aligned / 8] | (zip_uint32_t)in[aligned / 8 + 1] << 8;
+    return ((length ^ ((zip_uint32_t)in[aligned / 8 + 2] | (zip_uint32_t)in[aligned / 8 + 3] << 8)) == 0xffff);
+}
 
-    ctx->zstr.avail_in = (uInt)length;
-    ctx->zstr.next_in = (Bytef *)data;
 
-    return true;
+/* Header of block with dynamic Huffman codes: valid counts and a complete code length code. */
+static bool
+dynamic_header(const zip_uint8_t *in, zip_uint64_t in_bits, zip_uint64_t position) {
+    zip_uint32_t i, ncodes;
+    zip_uint32_t sum = 0;
+
+    if (position + 17 > in_bits || bits_get(in, position + 1, 2) != 2 || bits_get(in, position + 3, 5) > 29 || bits_get(in, position + 8, 5) > 29) {
+        return false;
+    }
+    ncodes = bits_get(in, position + 13, 4) + 4;
+    if (position + 17 + 3 * ncodes > in_bits) {
+        return false;
+    }
+    for (i = 0; i < ncodes; i++) {
+        zip_uint32_t length = bits_get(in, position + 17 + 3 * i, 3);
+
+        if (length > 0) {
+            sum += 128 >> length;
+        }
+    }
+    return sum == 128;
 }
 
 
-static void
-end_of_input(void *ud) {
-    struct ctx *ctx = (struct ctx *)ud;
+/* Find next possible block start at or after *position and before limit of chunk. */
+static bool
+block_find(const struct chunk *chunk, zip_uint64_t *position) {
+    zip_uint64_t in_bits = chunk->in_length * 8;
+    zip_uint64_t end = ZIP_MIN(chunk->limit, in_bits);
+    zip_uint64_t i;
+
+    /* fixed Huffman blocks are too short to be worth finding, they would be decoded again */
+    for (i = *position; i < end; i++) {
+        if (dynamic_header(chunk->in, in_bits, i) || stored_header(chunk->in, in_bits, i)) {
+            *position = i;
+            return true;
+        }
+    }
+    return false;
+}
 
-    ctx->end_of_input = true;
+
+static int
+chunk_stream_start(const struct chunk *chunk, z_stream *zstr, zip_uint64_t start, const zip_uint8_t *dictionary, uInt dictionary_length) {
+    zip_uint64_t offset = start / 8;
+    int bits = (int)(start % 8);
+    int ret;
+
+    if ((ret = inflateReset(zstr)) != Z_OK) {
+        return ret;
+    }
+    zstr->next_in = (Bytef *)chunk->in + offset;
+    zstr->avail_in = (uInt)(chunk->in_length - offset);
+    if (bits > 0) {
+        /* start in middle of byte: pass its remaining bits */
+        if ((ret = inflatePrime(zstr, 8 - bits, chunk->in[offset] >> bits)) != Z_OK) {
+            return ret;
+        }
+        zstr->next_in++;
+        zstr->avail_in--;
+    }
+    if (dictionary_length > 0 && (ret = inflateSetDictionary(zstr, dictionary, dictionary_length)) != Z_OK) {
+        return ret;
+    }
+    return Z_OK;
 }
 
 
-static zip_compression_status_t
-process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
-    struct ctx *ctx = (struct ctx *)ud;
-    uInt avail_out;
+/* Decode chunk from bit offset start to first block boundary at or after its limit, or end of compressed data.
+   Z_BUF_ERROR if input runs out or output gets too large. */
+static int
+chunk_inflate(struct chunk *chunk, z_stream *zstr, zip_uint64_t start, const zip_uint8_t *dictionary, uInt dictionary_length) {
+    int ret;
+
+    chunk->out_length = 0;
+    chunk->final = false;
+
+    if ((ret = chunk_stream_start(chunk, zstr, start, dictionary, dictionary_length)) != Z_OK) {
+        return ret;
+    }
+
+    for (;;) {
+        zip_uint64_t position;
+        uInt avail_out;
+
+        if (chunk->out_length == chunk->out_size) {
+            zip_uint64_t new_size = chunk->out_size > 0 ? chunk->out_size * 2 : 4 * PARALLEL_CHUNK_SIZE;
+            zip_uint8_t *out;
+
+            if (chunk->out_size >= PARALLEL_MAX_CHUNK_OUTPUT) {
+                return Z_BUF_ERROR;
+            }
+            if ((out = (zip_uint8_t *)_zip_realloc(chunk->out, new_size)) == NULL) {
+                return Z_MEM_ERROR;
+            }
+            chunk->out = out;
+            chunk->out_size = new_size;
+        }
 
+        avail_out = (uInt)ZIP_MIN(UINT_MAX, chunk->out_size - chunk->out_length);
+        zstr->next_out = (Bytef *)chunk->out + chunk->out_length;
+        zstr->avail_out = avail_out;
+
+        ret = inflate(zstr, Z_BLOCK);
+        chunk->out_length += avail_out - zstr->avail_out;
+        /* bits left in last byte consumed are in data_type */
+        position = (zip_uint64_t)((const zip_uint8_t *)zstr->next_in - chunk->in) * 8 - (zip_uint64_t)(zstr->data_type & 7);
+
+        if (ret == Z_STREAM_END) {
+            chunk->final = true;
+            chunk->end = position;
+            return Z_OK;
+        }
+        if (ret != Z_OK) {
+            return ret;
+        }
+        if ((zstr->data_type & 128) && position >= chunk->limit) {
+            chunk->end = position;
+            return Z_OK;
+        }
+    }
+}
+
+
+/* Decode chunk again with second dictionary, until 32k bytes of output agree with the first pass. After that,
+   output can't refer to the window any more. */
+static int
+chunk_compare(struct chunk *chunk, z_stream *zstr, const zip_uint8_t *dictionary) {
+    zip_uint64_t length = 0;
+    zip_uint64_t run = 0;
     int ret;
 
-    avail_out = (uInt)ZIP_MIN(UINT_MAX, *length);
-    ctx->zstr.avail_out = avail_out;
-    ctx->zstr.next_out = (Bytef *)data;
+    chunk->alternate_length = 0;
+    if (chunk->out_length == 0) {
+        return Z_OK;
+    }
+    if ((ret = chunk_stream_start(chunk, zstr, chunk->start, dictionary, PARALLEL_DICTIONARY_SIZE)) != Z_OK) {
+        return ret;
+    }
+    if ((chunk->alternate = (zip_uint8_t *)_zip_malloc(chunk->out_length)) == NULL) {
+        return Z_MEM_ERROR;
+    }
 
-    if (ctx->compress) {
-        ret = deflate(&ctx->zstr, ctx->end_of_input ? Z_FINISH : 0);
+    while (length < chunk->out_length && run < PARALLEL_DICTIONARY_SIZE) {
+        uInt avail_out = (uInt)ZIP_MIN(PARALLEL_COMPARE_SIZE, chunk->out_length - length);
+        zip_uint64_t end;
+
+        zstr->next_out = (Bytef *)chunk->alternate + length;
+        zstr->avail_out = avail_out;
+        ret = inflate(zstr, Z_SYNC_FLUSH);
+        end = length + avail_out - zstr->avail_out;
+
+        while (length < end && run < PARALLEL_DICTIONARY_SIZE) {
+            run = chunk->alternate[length] == chunk->out[length] ? run + 1 : 0;
+            length++;
+        }
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+        if (ret != Z_OK) {
+            return ret;
+        }
     }
-    else {
-        ret = inflate(&ctx->zstr, Z_SYNC_FLUSH);
+
+    chunk->alternate_length = length - run;
+    return Z_OK;
+}
+
+
+/* Runs in worker thread, must only access its chunk. */
+static void
+chunk_decompress(void *ud) {
+    struct chunk *chunk = (struct chunk *)ud;
+    zip_uint8_t *dictionary;
+    zip_uint64_t position;
+    z_stream zstr;
+    zip_uint32_t i;
+    int ret;
+
+    zstr.zalloc = zlib_alloc;
+    zstr.zfree = zlib_free;
+    zstr.opaque = NULL;
+    zstr.next_in = NULL;
+    zstr.avail_in = 0;
+
+    if (inflateInit2(&zstr, -MAX_WBITS) != Z_OK) {
+        return;
     }
 
-    *length = avail_out - ctx->zstr.avail_out;
+    if (chunk->first) {
+        chunk->found = chunk_inflate(chunk, &zstr, 0, NULL, 0) == Z_OK;
+        chunk->start = 0;
+        inflateEnd(&zstr);
+        return;
+    }
 
-    switch (ret) {
-    case Z_OK:
-        return ZIP_COMPRESSION_OK;
+    if ((dictionary = (zip_uint8_t *)_zip_malloc(PARALLEL_DICTIONARY_SIZE)) == NULL) {
+        inflateEnd(&zstr);
+        return;
+    }
 
-    case Z_STREAM_END:
-        return ZIP_COMPRESSION_END;
+    /* Bytes copied from the window are the low byte of their window position in the first pass, and that plus one
+       plus the high byte in the second. */
+    for (i = 0; i < PARALLEL_DICTIONARY_SIZE; i++) {
+        dictionary[i] = (zip_uint8_t)i;
+    }
+    /* compressed data ends in the last chunk, a final block elsewhere is most likely a false find */
+    position = 0;
+    while (block_find(chunk, &position)) {
+        if ((ret = chunk_inflate(chunk, &zstr, position, dictionary, PARALLEL_DICTIONARY_SIZE)) == Z_OK && (!chunk->final || chunk->limit == ZIP_UINT64_MAX)) {
+            chunk->found = true;
+            chunk->start = position;
+            break;
+        }
+        if (ret == Z_MEM_ERROR || chunk->out_size >= PARALLEL_MAX_CHUNK_OUTPUT) {
+            break;
+        }
+        position++;
+    }
 
-    case Z_BUF_ERROR:
-        if (ctx->zstr.avail_in == 0) {
-            return ZIP_COMPRESSION_NEED_DATA;
+    if (chunk->found) {
+        for (i = 0; i < PARALLEL_DICTIONARY_SIZE; i++) {
+            dictionary[i] = (zip_uint8_t)(i + 1 + (i >> 8));
+        }
+        if (chunk_compare(chunk, &zstr, dictionary) != Z_OK) {
+            chunk->found = false;
+        }
+    }
+
+    _zip_free(dictionary);
+    inflateEnd(&zstr);
+}
+
+
+/* Chunk was decoded from where the preceding chunk ended. */
+static bool
+chunk_start_matches(const struct ctx *ctx, const struct chunk *chunk) {
+    zip_uint64_t start = ctx->next_start - chunk->in_offset * 8;
+
+    if (start == chunk->start) {
+        return true;
+    }
+
+    /* padding of stored block header is skipped, so decoding from an earlier bit gives the same result */
+    return start > chunk->start && (start + 10) / 8 == (chunk->start + 10) / 8 && stored_header(chunk->in, chunk->in_length * 8, start) && stored_header(chunk->in, chunk->in_length * 8, chunk->start) && bits_get(chunk->in, start, 1) == bits_get(chunk->in, chunk->start, 1);
+}
+
+
+/* Replace bytes copied from window, false if they can't be. */
+static bool
+chunk_resolve(const struct ctx *ctx, struct chunk *chunk) {
+    zip_uint64_t i;
+
+    for (i = 0; i < chunk->alternate_length; i++) {
+        if (chunk->out[i] != chunk->alternate[i]) {
+            zip_uint32_t high = (zip_uint32_t)(chunk->alternate[i] - chunk->out[i] - 1) & 0xff;
+
+            if (ctx->dictionary_length < PARALLEL_DICTIONARY_SIZE || high >= PARALLEL_DICTIONARY_SIZE / 256) {
+                return false;
+            }
+            chunk->out[i] = ctx->dictionary[high << 8 | chunk->out[i]];
         }
+    }
+    return true;
+}
 
-        /* fallthrough */
 
-    default:
-        zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
-        return ZIP_COMPRESSION_ERROR;
+/* Decode chunk in calling thread from where the preceding chunk ended. */
+static int
+chunk_redo(struct ctx *ctx, struct chunk *chunk) {
+    zip_uint64_t start = ctx->next_start - chunk->in_offset * 8;
+    z_stream zstr;
+    int ret;
+
+    _zip_free(chunk->alternate);
+    chunk->alternate = NULL;
+    chunk->alternate_length = 0;
+
+    if (start >= chunk->limit) {
+        /* preceding chunk ended after this one */
+        chunk->out_length = 0;
+        chunk->final = false;
+        chunk->end = start;
+        return Z_OK;
+    }
+
+    zstr.zalloc = zlib_alloc;
+    zstr.zfree = zlib_free;
+    zstr.opaque = NULL;
+    zstr.next_in = NULL;
+    zstr.avail_in = 0;
+
+    if ((ret = inflateInit2(&zstr, -MAX_WBITS)) != Z_OK) {
+        return ret;
+    }
+    ret = chunk_inflate(chunk, &zstr, start, ctx->dictionary, ctx->dictionary_length);
+    inflateEnd(&zstr);
+    return ret;
+}
+
+
+/* Continue with zlib from where the last finished chunk ended. */
+static bool
+inflate_parallel_fall_back(struct ctx *ctx) {
+    zip_uint64_t offset = ctx->next_start / 8 - ctx->scan_offset;
+    int bits = (int)(ctx->next_start % 8);
+    zip_uint64_t length = ctx->scan_length - offset + ctx->zstr.avail_in;
+    int ret;
+
+    if (length > UINT_MAX) {
+        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+    if ((ctx->fallback = (zip_uint8_t *)_zip_malloc(ZIP_MAX(length, 1))) == NULL) {
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    (void)memcpy_s(ctx->fallback, length, ctx->scan + offset, ctx->scan_length - offset);
+    if (ctx->zstr.avail_in > 0) {
+        (void)memcpy_s(ctx->fallback + ctx->scan_length - offset, ctx->zstr.avail_in, ctx->zstr.next_in, ctx->zstr.avail_in);
+    }
+    ctx->in_position = ctx->next_start / 8;
+
+    if (!zstr_start(ctx)) {
+        return false;
+    }
+    ctx->zstr.next_in = (Bytef *)ctx->fallback;
+    ctx->zstr.avail_in = (uInt)length;
+    if (bits > 0) {
+        if ((ret = inflatePrime(&ctx->zstr, 8 - bits, ctx->fallback[0] >> bits)) != Z_OK) {
+            zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+            return false;
+        }
+        ctx->last_byte = ctx->fallback[0];
+        ctx->zstr.next_in++;
+        ctx->zstr.avail_in--;
+        ctx->in_position++;
+    }
+    if (ctx->dictionary_length > 0 && (ret = inflateSetDictionary(&ctx->zstr, ctx->dictionary, ctx->dictionary_length)) != Z_OK) {
+        zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+        return false;
+    }
+
+    inflate_parallel_end(ctx);
+    return true;
+}
+
+
+/* Make output of chunk final, after the preceding chunk has been finished. */
+static bool
+chunk_finish(struct ctx *ctx, struct chunk *chunk) {
+    zip_uint64_t drop;
+
+    if (!chunk->found || !chunk_start_matches(ctx, chunk) || !chunk_resolve(ctx, chunk)) {
+        int ret = chunk_redo(ctx, chunk);
+
+        if (ret == Z_BUF_ERROR) {
+            return inflate_parallel_fall_back(ctx);
+        }
+        if (ret != Z_OK) {
+            if (ret == Z_MEM_ERROR) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            }
+            else {
+                zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+            }
+            return false;
+        }
+    }
+
+    ctx->next_start = chunk->in_offset * 8 + chunk->end;
+    ctx->in_position = ctx->next_start / 8;
+
+    /* keep last 32k of output as window */
+    if (chunk->out_length >= PARALLEL_DICTIONARY_SIZE) {
+        (void)memcpy_s(ctx->dictionary, PARALLEL_DICTIONARY_SIZE, chunk->out + chunk->out_length - PARALLEL_DICTIONARY_SIZE, PARALLEL_DICTIONARY_SIZE);
+        ctx->dictionary_length = PARALLEL_DICTIONARY_SIZE;
+    }
+    else if (chunk->out_length > 0) {
+        uInt keep = (uInt)ZIP_MIN(ctx->dictionary_length, PARALLEL_DICTIONARY_SIZE - chunk->out_length);
+
+        memmove(ctx->dictionary, ctx->dictionary + ctx->dictionary_length - keep, keep);
+        (void)memcpy_s(ctx->dictionary + keep, PARALLEL_DICTIONARY_SIZE - keep, chunk->out, chunk->out_length);
+        ctx->dictionary_length = keep + (uInt)chunk->out_length;
+    }
+
+    /* compressed data before the end of the chunk is only needed to fall back to zlib */
+    drop = ZIP_MIN(ctx->next_start / 8, ctx->chunk_offset) - ctx->scan_offset;
+    memmove(ctx->scan, ctx->scan + drop, ctx->scan_length - drop);
+    ctx->scan_length -= drop;
+    ctx->scan_offset += drop;
+
+    _zip_free(chunk->in);
+    chunk->in = NULL;
+    _zip_free(chunk->alternate);
+    chunk->alternate = NULL;
+    return true;
+}
+
+
+static bool
+inflate_parallel_fill(struct ctx *ctx) {
+    zip_uint64_t offset = ctx->chunk_offset - ctx->scan_offset;
+    zip_uint64_t needed = offset + 2 * PARALLEL_CHUNK_SIZE;
+    struct chunk *chunk;
+    bool last;
+
+    if (ctx->scan_length < needed && ctx->zstr.avail_in > 0) {
+        zip_uint64_t n = ZIP_MIN(ctx->zstr.avail_in, needed - ctx->scan_length);
+
+        if (ctx->scan_size < needed) {
+            zip_uint8_t *scan;
+
+            if ((scan = (zip_uint8_t *)_zip_realloc(ctx->scan, needed)) == NULL) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+                return false;
+            }
+            ctx->scan = scan;
+            ctx->scan_size = needed;
+        }
+        (void)memcpy_s(ctx->scan + ctx->scan_length, ctx->scan_size - ctx->scan_length, ctx->zstr.next_in, n);
+        ctx->scan_length += n;
+        ctx->zstr.next_in += n;
+        ctx->zstr.avail_in -= (uInt)n;
+    }
+
+    last = ctx->end_of_input && ctx->zstr.avail_in == 0;
+    if (ctx->scan_length < needed && !last) {
+        return true;
+    }
+    last = last && ctx->scan_length <= needed;
+
+    if ((chunk = (struct chunk *)_zip_malloc(sizeof(*chunk))) == NULL) {
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    chunk->in_length = ZIP_MIN(ctx->scan_length - offset, 2 * PARALLEL_CHUNK_SIZE);
+    if ((chunk->in = (zip_uint8_t *)_zip_malloc(ZIP_MAX(chunk->in_length, 1))) == NULL) {
+        _zip_free(chunk);
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    (void)memcpy_s(chunk->in, chunk->in_length, ctx->scan + offset, chunk->in_length);
+    chunk->collected = false;
+    chunk->first = ctx->chunk_offset == 0;
+    chunk->in_offset = ctx->chunk_offset;
+    /* the last chunk ends with the compressed data */
+    chunk->limit = last ? ZIP_UINT64_MAX : PARALLEL_CHUNK_SIZE * 8;
+    chunk->found = false;
+    chunk->start = chunk->end = 0;
+    chunk->final = false;
+    chunk->out = chunk->alternate = NULL;
+    chunk->out_length = chunk->out_size = chunk->out_offset = 0;
+    chunk->alternate_length = 0;
+    chunk->job.run = chunk_decompress;
+    chunk->job.ud = chunk;
+    chunk->next = NULL;
+
+    if (ctx->chunk_tail == NULL) {
+        ctx->chunk_head = chunk;
+    }
+    else {
+        ctx->chunk_tail->next = chunk;
+    }
+    ctx->chunk_tail = chunk;
+    ctx->outstanding++;
+    ctx->chunk_offset += PARALLEL_CHUNK_SIZE;
+    ctx->last_submitted = last;
+
+    _zip_thread_pool_submit(ctx->pool, &chunk->job);
+    return true;
+}
+
+
+static zip_compression_status_t
+inflate_parallel_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t out_offset = 0;
+
+    while (out_offset < *length) {
+        struct chunk *chunk = ctx->chunk_head;
+
+        if (chunk != NULL && chunk->collected) {
+            zip_uint64_t n = ZIP_MIN(*length - out_offset, chunk->out_length - chunk->out_offset);
+
+            (void)memcpy_s(data + out_offset, *length - out_offset, chunk->out + chunk->out_offset, n);
+            out_offset += n;
+            chunk->out_offset += n;
+            ctx->out_position += n;
+
+            if (chunk->out_offset == chunk->out_length) {
+                if ((ctx->chunk_head = chunk->next) == NULL) {
+                    ctx->chunk_tail = NULL;
+                }
+                ctx->inflate_done = chunk->final;
+                chunk_free(chunk);
+            }
+            continue;
+        }
+
+        if (ctx->inflate_done) {
+            *length = out_offset;
+            return ZIP_COMPRESSION_END;
+        }
+
+        if (ctx->outstanding < 2 * ctx->num_threads && !ctx->last_submitted && (ctx->zstr.avail_in > 0 || ctx->end_of_input)) {
+            if (!inflate_parallel_fill(ctx)) {
+                return ZIP_COMPRESSION_ERROR;
+            }
+            continue;
+        }
+
+        if (chunk == NULL) {
+            /* all chunks returned without end of compressed data: data is truncated, which the CRC check reports */
+            *length = out_offset;
+            if (ctx->last_submitted) {
+                return ZIP_COMPRESSION_END;
+            }
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (!ctx->end_of_input && ctx->zstr.avail_in == 0 && ctx->outstanding < 2 * ctx->num_threads && !ctx->last_submitted) {
+            /* room for more chunks, read more input instead of waiting */
+            *length = out_offset;
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        _zip_thread_pool_wait(ctx->pool, &chunk->job);
+        chunk->collected = true;
+        ctx->outstanding--;
+        if (!chunk_finish(ctx, chunk)) {
+            return ZIP_COMPRESSION_ERROR;
+        }
+        if (!INFLATE_PARALLEL(ctx)) {
+            /* fell back to zlib, which continues on next call */
+            *length = out_offset;
+            return ZIP_COMPRESSION_OK;
+        }
+    }
+
+    return ZIP_COMPRESSION_OK;
+}
+
+
+/* Decompress in parallel; false to decompress in calling thread. */
+static bool
+inflate_parallel_start(struct ctx *ctx, zip_stat_t *st) {
+    /* chunks are only cut when the data is large enough to keep the threads busy, checkpoints record zlib's state */
+    if (ctx->compress || ctx->num_threads < 2 || ctx->record_checkpoints || (st->valid & ZIP_STAT_COMP_SIZE) == 0 || st->comp_size < PARALLEL_MIN_COMPRESSED_SIZE) {
+        return false;
+    }
+
+    if ((ctx->dictionary = (zip_uint8_t *)_zip_malloc(PARALLEL_DICTIONARY_SIZE)) == NULL) {
+        return false;
+    }
+    if ((ctx->pool = _zip_thread_pool_new(ctx->num_threads, NULL)) == NULL) {
+        _zip_free(ctx->dictionary);
+        ctx->dictionary = NULL;
+        return false;
+    }
+
+    ctx->dictionary_length = 0;
+    ctx->outstanding = 0;
+    ctx->last_submitted = false;
+    ctx->scan_length = 0;
+    ctx->scan_offset = 0;
+    ctx->chunk_offset = 0;
+    ctx->next_start = 0;
+    ctx->inflate_done = false;
+    return true;
+}
+
+
+static void
+inflate_parallel_end(struct ctx *ctx) {
+    /* waits for running jobs, so all chunks can be freed afterwards */
+    _zip_thread_pool_free(ctx->pool);
+    ctx->pool = NULL;
+
+    while (ctx->chunk_head != NULL) {
+        struct chunk *chunk = ctx->chunk_head;
+        ctx->chunk_head = chunk->next;
+        chunk_free(chunk);
+    }
+    ctx->chunk_tail = NULL;
+    _zip_free(ctx->scan);
+    ctx->scan = NULL;
+    ctx->scan_size = 0;
+    _zip_free(ctx->dictionary);
+    ctx->dictionary = NULL;
+}
+#endif
+
+
+static zip_uint16_t
+general_purpose_bit_flags(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (!ctx->compress) {
+        return 0;
+    }
+
+    if (ctx->level < 3) {
+        return 2 << 1;
+    }
+    else if (ctx->level > 7) {
+        return 1 << 1;
+    }
+    return 0;
+}
+
+
+static bool
+start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    (void)attributes;
+
+    ctx->zstr.avail_in = 0;
+    ctx->zstr.next_in = NULL;
+    ctx->zstr.avail_out = 0;
+    ctx->zstr.next_out = NULL;
+    ctx->end_of_input = false;
+    ctx->in_position = 0;
+    ctx->out_position = 0;
+    ctx->record_seek_points = ctx->want_seek_points;
+    ctx->last_seek_point = 0;
+    ctx->nseek_points = 0;
+    ctx->rsync_hash = 0;
+    ctx->rsync_flush = false;
+    ctx->rsync_held = 0;
+
+#ifdef HAVE_LIBDEFLATE
+    ctx->whole.active = false;
+    ctx->whole.pending_length = 0;
+#endif
+#ifdef HAVE_ISAL
+    ctx->isal_active = false;
+#endif
+#ifdef HAVE_THREADS
+    _zip_free(ctx->fallback);
+    ctx->fallback = NULL;
+    if (PARALLEL(ctx)) {
+        return parallel_start(ctx);
+    }
+    if (inflate_parallel_start(ctx, st)) {
+        return true;
+    }
+#endif
+#ifdef HAVE_LIBDEFLATE
+    if (whole_start(ctx, st)) {
+        return true;
+    }
+#endif
+#ifdef HAVE_ISAL
+    if (isal_start(ctx, st)) {
+        return true;
+    }
+#endif
+#if !defined(HAVE_LIBDEFLATE) && !defined(HAVE_ISAL) && !defined(HAVE_THREADS)
+    (void)st;
+#endif
+
+    return zstr_start(ctx);
+}
+
+
+static bool
+zstr_start(struct ctx *ctx) {
+    int ret;
+
+    if (ctx->zstr_initialized) {
+        /* reused, e.g. for another entry: resetting is much cheaper than reallocating the state */
+        ret = ctx->compress ? deflateReset(&ctx->zstr) : inflateReset(&ctx->zstr);
+    }
+    else if (ctx->compress) {
+        /* negative value to tell zlib not to write a header */
+        ret = deflateInit2(&ctx->zstr, ctx->level, Z_DEFLATED, -MAX_WBITS, ctx->mem_level, Z_DEFAULT_STRATEGY);
+    }
+    else {
+        ret = inflateInit2(&ctx->zstr, -MAX_WBITS);
+    }
+
+    if (ret != Z_OK) {
+        zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+        return false;
+    }
+    ctx->zstr_initialized = true;
+
+    return true;
+}
+
+
+/* The stream is freed in deallocate, so start can reset it. */
+static bool
+end(void *ud) {
+#ifdef HAVE_THREADS
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (PARALLEL(ctx)) {
+        parallel_end(ctx);
+    }
+    else if (INFLATE_PARALLEL(ctx)) {
+        inflate_parallel_end(ctx);
+    }
+#else
+    (void)ud;
+#endif
+
+    return true;
+}
+
+
+static bool
+input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+#ifdef HAVE_LIBDEFLATE
+    if (ctx->whole.active) {
+        return whole_input(ctx, data, length);
+    }
+#endif
+#ifdef HAVE_ISAL
+    if (ctx->isal_active) {
+        if (length > UINT32_MAX || ctx->isal->avail_in > 0) {
+            zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+            return false;
+        }
+        ctx->isal->next_in = data;
+        ctx->isal->avail_in = (uint32_t)length;
+        ctx->isal_last_input_length = length;
+        return true;
+    }
+#endif
+
+    if (length > UINT_MAX || ctx->zstr.avail_in > 0 || ctx->rsync_held > 0) {
+        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    ctx->zstr.avail_in = (uInt)length;
+    ctx->zstr.next_in = (Bytef *)data;
+    if (ctx->rsyncable) {
+        rsync_limit_input(ctx);
+    }
+
+    return true;
+}
+
+
+static void
+end_of_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->end_of_input = true;
+}
+
+
+static zip_uint64_t
+unconsumed_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+#ifdef HAVE_LIBDEFLATE
+    if (ctx->whole.active) {
+        return ZIP_MIN(ctx->whole.unconsumed, ctx->whole.last_input_length);
+    }
+#endif
+#ifdef HAVE_ISAL
+    if (ctx->isal_active) {
+        /* whole bytes in the bit buffer were read ahead */
+        return ZIP_MIN(ctx->isal->avail_in + (zip_uint64_t)(ctx->isal->read_in_length > 0 ? ctx->isal->read_in_length / 8 : 0), ctx->isal_last_input_length);
+    }
+#endif
+    return ctx->zstr.avail_in;
+}
+
+
+/* Memory needed by zlib, from zconf.h: (1 << (windowBits+2)) + (1 << (memLevel+9)) for deflate, 1 << windowBits for inflate, plus a few kilobytes. */
+static zip_uint64_t
+memory_usage(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t size;
+
+    if (!ctx->compress) {
+        size = (1 << MAX_WBITS) + 7 * 1024;
+#ifdef HAVE_THREADS
+        /* large files are decompressed in parallel, each thread runs its own stream */
+        size *= ZIP_MAX(ctx->num_threads, 1);
+#endif
+        size += sizeof(*ctx);
+#ifdef HAVE_ISAL
+        size += sizeof(struct inflate_state);
+#endif
+        return size;
+    }
+
+    size = (1 << (MAX_WBITS + 2)) + ((zip_uint64_t)1 << (ctx->mem_level + 9)) + 6 * 1024;
+#ifdef HAVE_THREADS
+    if (PARALLEL(ctx)) {
+        /* up to 2 * num_threads blocks are in flight, each with its own stream and buffers */
+        size += 2 * (zip_uint64_t)ctx->num_threads * (size + sizeof(struct block) + 2 * PARALLEL_BLOCK_SIZE);
+    }
+#endif
+    return sizeof(*ctx) + size;
+}
+
+
+#ifdef HAVE_CHECKPOINTS
+/* Record state of decompressor, which is at a block boundary. */
+static void
+checkpoint_add(struct ctx *ctx) {
+    struct checkpoint *checkpoint;
+    zip_uint64_t last_offset = ctx->ncheckpoints > 0 ? ctx->checkpoints[ctx->ncheckpoints - 1].uncompressed_offset : 0;
+
+    /* after restarting from an earlier checkpoint, only record the part not covered yet */
+    if (ctx->out_position <= last_offset || ctx->out_position - last_offset < CHECKPOINT_INTERVAL) {
+        return;
+    }
+
+    if (ctx->ncheckpoints == ctx->checkpoints_alloc) {
+        zip_uint64_t new_alloc = ctx->checkpoints_alloc > 0 ? ctx->checkpoints_alloc * 2 : 16;
+        struct checkpoint *new_checkpoints;
+
+        if (new_alloc > SIZE_MAX / sizeof(*new_checkpoints) || (new_checkpoints = (struct checkpoint *)_zip_realloc(ctx->checkpoints, sizeof(*new_checkpoints) * (size_t)new_alloc)) == NULL) {
+            /* checkpoints are an optimization, continue without them */
+            ctx->record_checkpoints = false;
+            return;
+        }
+        ctx->checkpoints = new_checkpoints;
+        ctx->checkpoints_alloc = new_alloc;
+    }
+
+    checkpoint = ctx->checkpoints + ctx->ncheckpoints;
+    if ((checkpoint->window = (zip_uint8_t *)_zip_malloc(CHECKPOINT_WINDOW_SIZE)) == NULL) {
+        ctx->record_checkpoints = false;
+        return;
+    }
+    checkpoint->window_length = CHECKPOINT_WINDOW_SIZE;
+    if (inflateGetDictionary(&ctx->zstr, checkpoint->window, &checkpoint->window_length) != Z_OK) {
+        _zip_free(checkpoint->window);
+        ctx->record_checkpoints = false;
+        return;
+    }
+    checkpoint->uncompressed_offset = ctx->out_position;
+    checkpoint->compressed_offset = ctx->in_position;
+    checkpoint->bits = ctx->zstr.data_type & 7;
+    checkpoint->value = ctx->last_byte;
+    ctx->ncheckpoints++;
+}
+#endif
+
+
+static bool
+seek(void *ud, zip_uint64_t offset, zip_uint64_t *uncompressed_offset, zip_uint64_t *compressed_offset) {
+    struct ctx *ctx = (struct ctx *)ud;
+    struct checkpoint *checkpoint = NULL;
+    int ret;
+
+    zip_uint64_t low, high;
+
+#ifdef HAVE_LIBDEFLATE
+    if (ctx->whole.active) {
+        if (ctx->whole.finished) {
+            /* all input was used, continue returning output from offset */
+            ctx->whole.out_offset = ZIP_MIN(offset, ctx->whole.out_length);
+            *uncompressed_offset = ctx->whole.out_offset;
+            *compressed_offset = ctx->whole.in_length;
+        }
+        else {
+            ctx->end_of_input = false;
+            ctx->whole.in_length = 0;
+            *uncompressed_offset = 0;
+            *compressed_offset = 0;
+        }
+        return true;
+    }
+    ctx->whole.pending_length = 0;
+#endif
+#ifdef HAVE_THREADS
+    if (INFLATE_PARALLEL(ctx)) {
+        /* continue with zlib, from start or checkpoint */
+        inflate_parallel_end(ctx);
+        if (!zstr_start(ctx)) {
+            return false;
+        }
+        ctx->in_position = 0;
+        ctx->out_position = 0;
+    }
+#endif
+#ifdef HAVE_ISAL
+    if (ctx->isal_active) {
+        /* continue with zlib, from start or checkpoint */
+        ctx->isal_active = false;
+        if (!zstr_start(ctx)) {
+            return false;
+        }
+        ctx->in_position = 0;
+        ctx->out_position = 0;
+    }
+#endif
+#ifdef HAVE_CHECKPOINTS
+    ctx->record_checkpoints = true;
+#endif
+
+    /* find last checkpoint at or before offset */
+    low = 0;
+    high = ctx->ncheckpoints;
+    while (low < high) {
+        zip_uint64_t mid = low + (high - low) / 2;
+
+        if (ctx->checkpoints[mid].uncompressed_offset <= offset) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    if (low > 0) {
+        checkpoint = ctx->checkpoints + low - 1;
+    }
+
+    ctx->zstr.avail_in = 0;
+    ctx->zstr.next_in = NULL;
+
+    if (ctx->out_position <= offset && (checkpoint == NULL || checkpoint->uncompressed_offset <= ctx->out_position)) {
+        /* continuing from current position is fastest */
+        *uncompressed_offset = ctx->out_position;
+        *compressed_offset = ctx->in_position;
+        return true;
+    }
+
+    if ((ret = inflateReset(&ctx->zstr)) != Z_OK) {
+        zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+        return false;
+    }
+    ctx->in_position = 0;
+    ctx->out_position = 0;
+
+    if (checkpoint != NULL) {
+        if ((checkpoint->bits > 0 && (ret = inflatePrime(&ctx->zstr, checkpoint->bits, checkpoint->value >> (8 - checkpoint->bits))) != Z_OK) || (checkpoint->window_length > 0 && (ret = inflateSetDictionary(&ctx->zstr, checkpoint->window, checkpoint->window_length)) != Z_OK)) {
+            zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+            return false;
+        }
+        ctx->in_position = checkpoint->compressed_offset;
+        ctx->out_position = checkpoint->uncompressed_offset;
+    }
+
+    *uncompressed_offset = ctx->out_position;
+    *compressed_offset = ctx->in_position;
+    return true;
+}
+
+
+static const zip_seek_point_t *
+seek_points(void *ud, zip_uint64_t *npoints) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t n = ctx->nseek_points;
+
+    /* a flush right before end of input is not inside the data */
+    while (n > 0 && ctx->seek_points[n - 1].uncompressed_offset >= ctx->in_position) {
+        n--;
+    }
+    if (!ctx->record_seek_points || n == 0) {
+        return NULL;
+    }
+
+    *npoints = n;
+    return ctx->seek_points;
+}
+
+
+static bool
+add_seek_points(void *ud, const zip_seek_point_t *points, zip_uint64_t npoints) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t i;
+
+    if (ctx->ncheckpoints > 0 || npoints == 0) {
+        return false;
+    }
+    /* seek points are an optimization, don't set error */
+    if (npoints > SIZE_MAX / sizeof(*ctx->checkpoints) || (ctx->checkpoints = (struct checkpoint *)_zip_malloc(sizeof(*ctx->checkpoints) * (size_t)npoints)) == NULL) {
+        return false;
+    }
+    ctx->checkpoints_alloc = npoints;
+
+    /* state after full flush: byte aligned, empty dictionary */
+    for (i = 0; i < npoints; i++) {
+        ctx->checkpoints[i].uncompressed_offset = points[i].uncompressed_offset;
+        ctx->checkpoints[i].compressed_offset = points[i].compressed_offset;
+        ctx->checkpoints[i].bits = 0;
+        ctx->checkpoints[i].value = 0;
+        ctx->checkpoints[i].window_length = 0;
+        ctx->checkpoints[i].window = NULL;
+    }
+    ctx->ncheckpoints = npoints;
+
+    return true;
+}
+
+
+/* Checkpoints describe the data decompressed before, drop them when context is reused. */
+static void
+reset(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t i;
+
+    for (i = 0; i < ctx->ncheckpoints; i++) {
+        _zip_free(ctx->checkpoints[i].window);
+    }
+    _zip_free(ctx->checkpoints);
+    ctx->checkpoints = NULL;
+    ctx->ncheckpoints = ctx->checkpoints_alloc = 0;
+    ctx->record_checkpoints = false;
+}
+
+
+static zip_compression_status_t
+process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
+    struct ctx *ctx = (struct ctx *)ud;
+    uInt avail_out;
+
+    int ret;
+
+#ifdef HAVE_THREADS
+    if (PARALLEL(ctx)) {
+        return parallel_process(ctx, data, length);
+    }
+    if (INFLATE_PARALLEL(ctx)) {
+        return inflate_parallel_process(ctx, data, length);
+    }
+#endif
+#ifdef HAVE_LIBDEFLATE
+    if (ctx->whole.active) {
+        return whole_process(ctx, data, length);
+    }
+    if (ctx->zstr.avail_in == 0 && ctx->whole.pending_length > 0) {
+        ctx->zstr.next_in = (Bytef *)ctx->whole.pending;
+        ctx->zstr.avail_in = (uInt)ctx->whole.pending_length;
+        ctx->whole.pending_length = 0;
+    }
+#endif
+#ifdef HAVE_ISAL
+    if (ctx->isal_active) {
+        return isal_process(ctx, data, length);
+    }
+#endif
+
+    avail_out = (uInt)ZIP_MIN(UINT_MAX, *length);
+    ctx->zstr.avail_out = avail_out;
+    ctx->zstr.next_out = (Bytef *)data;
+
+    if (ctx->compress) {
+        uInt avail_in = ctx->zstr.avail_in;
+        int flush = ctx->end_of_input ? Z_FINISH : 0;
+
+        /* full flush ends output on a byte boundary and resets the dictionary, so decompression can start there */
+        if (!ctx->end_of_input && avail_in == 0 && (ctx->rsync_flush || (ctx->record_seek_points && ctx->in_position - ctx->last_seek_point >= CHECKPOINT_INTERVAL))) {
+            flush = Z_FULL_FLUSH;
+        }
+
+        ret = deflate(&ctx->zstr, flush);
+
+        ctx->in_position += avail_in - ctx->zstr.avail_in;
+        ctx->out_position += avail_out - ctx->zstr.avail_out;
+        if (flush == Z_FULL_FLUSH && ret == Z_OK && ctx->zstr.avail_out > 0) {
+            if (ctx->record_seek_points && ctx->in_position - ctx->last_seek_point >= CHECKPOINT_INTERVAL) {
+                ctx->last_seek_point = ctx->in_position;
+                seek_point_add(ctx, ctx->in_position, ctx->out_position);
+            }
+            if (ctx->rsync_flush) {
+                /* continue with input after boundary */
+                ctx->rsync_flush = false;
+                ctx->zstr.avail_in = ctx->rsync_held;
+                ctx->rsync_held = 0;
+                rsync_limit_input(ctx);
+            }
+        }
+    }
+    else {
+        uInt avail_in = ctx->zstr.avail_in;
+
+        /* stop at block boundaries to record checkpoints */
+        ret = inflate(&ctx->zstr, ctx->record_checkpoints ? Z_BLOCK : Z_SYNC_FLUSH);
+
+        if (ctx->zstr.avail_in < avail_in) {
+            ctx->in_position += avail_in - ctx->zstr.avail_in;
+            ctx->last_byte = ctx->zstr.next_in[-1];
+        }
+        ctx->out_position += avail_out - ctx->zstr.avail_out;
+#ifdef HAVE_CHECKPOINTS
+        if (ret == Z_OK && ctx->record_checkpoints && (ctx->zstr.data_type & 128) && !(ctx->zstr.data_type & 64)) {
+            checkpoint_add(ctx);
+        }
+#endif
+    }
+
+    *length = avail_out - ctx->zstr.avail_out;
+
+    switch (ret) {
+    case Z_OK:
+        return ZIP_COMPRESSION_OK;
+
+    case Z_STREAM_END:
+        return ZIP_COMPRESSION_END;
+
+    case Z_BUF_ERROR:
+        if (ctx->zstr.avail_in == 0) {
+            return ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        /* fallthrough */
+
+    default:
+        zip_error_set(ctx->error, ZIP_ER_ZLIB, ret);
+        return ZIP_COMPRESSION_ERROR;
+    }
+}
+
+/* Pass input up to next rsync boundary to zlib, hold back the rest until the stream has been flushed there. */
+static void
+rsync_limit_input(struct ctx *ctx) {
+    uInt i;
+
+    for (i = 0; i < ctx->zstr.avail_in; i++) {
+        ctx->rsync_hash = ((ctx->rsync_hash << 1) ^ ctx->zstr.next_in[i]) & RSYNC_MASK;
+        if (ctx->rsync_hash == RSYNC_HIT) {
+            ctx->rsync_held = ctx->zstr.avail_in - (i + 1);
+            ctx->zstr.avail_in = i + 1;
+            ctx->rsync_flush = true;
+            return;
+        }
+    }
+}
+
+
+#ifdef HAVE_LIBDEFLATE
+static bool
+whole_reserve(zip_uint8_t **buffer, zip_uint64_t *size, zip_uint64_t needed) {
+    zip_uint8_t *new_buffer;
+
+    if (*size >= needed) {
+        return true;
+    }
+    if (needed > SIZE_MAX || (new_buffer = (zip_uint8_t *)_zip_realloc(*buffer, (size_t)needed)) == NULL) {
+        return false;
+    }
+    *buffer = new_buffer;
+    *size = needed;
+    return true;
+}
+
+
+/* Collect input in memory if the file is small enough; false to use zlib. */
+static bool
+whole_start(struct ctx *ctx, zip_stat_t *st) {
+    zip_uint64_t in_size;
+
+    if (ctx->compress) {
+        /* torrentzip needs zlib's output, seek points and rsync boundaries need full flushes */
+        if (ctx->mem_level == TORRENTZIP_MEM_LEVEL || ctx->want_seek_points || ctx->rsyncable || (st->valid & ZIP_STAT_SIZE) == 0 || st->size < LIBDEFLATE_MIN_COMPRESS_SIZE || st->size > LIBDEFLATE_MAX_SIZE) {
+            return false;
+        }
+        if (ctx->whole.compressor == NULL && (ctx->whole.compressor = libdeflate_alloc_compressor(ctx->level)) == NULL) {
+            return false;
+        }
+        in_size = st->size;
+    }
+    else {
+        if ((st->valid & (ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE)) != (ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE) || st->size == 0 || st->size > LIBDEFLATE_MAX_SIZE || st->comp_size == 0 || st->comp_size > LIBDEFLATE_MAX_SIZE) {
+            return false;
+        }
+        if (ctx->whole.decompressor == NULL && (ctx->whole.decompressor = libdeflate_alloc_decompressor()) == NULL) {
+            return false;
+        }
+        in_size = st->comp_size;
+        ctx->whole.expected_size = st->size;
+    }
+    if (!whole_reserve(&ctx->whole.in, &ctx->whole.in_size, in_size)) {
+        return false;
+    }
+
+    ctx->whole.active = true;
+    ctx->whole.finished = false;
+    ctx->whole.in_length = 0;
+    ctx->whole.last_input_length = 0;
+    ctx->whole.out_length = 0;
+    ctx->whole.out_offset = 0;
+    ctx->whole.unconsumed = 0;
+    return true;
+}
+
+
+static bool
+whole_input(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    ctx->whole.last_input_length = length;
+
+    if (length > LIBDEFLATE_MAX_SIZE - ctx->whole.in_length || !whole_reserve(&ctx->whole.in, &ctx->whole.in_size, ctx->whole.in_length + length)) {
+        /* more data than stat reported */
+        return whole_fall_back(ctx, data, length);
+    }
+
+    (void)memcpy_s(ctx->whole.in + ctx->whole.in_length, ctx->whole.in_size - ctx->whole.in_length, data, length);
+    ctx->whole.in_length += length;
+    return true;
+}
+
+
+/* (De)compress collected input with libdeflate; false if it fails. */
+static bool
+whole_finish(struct ctx *ctx) {
+    if (ctx->compress) {
+        size_t n;
+
+        if (!whole_reserve(&ctx->whole.out, &ctx->whole.out_size, libdeflate_deflate_compress_bound(ctx->whole.compressor, (size_t)ctx->whole.in_length))) {
+            return false;
+        }
+        if ((n = libdeflate_deflate_compress(ctx->whole.compressor, ctx->whole.in, (size_t)ctx->whole.in_length, ctx->whole.out, (size_t)ctx->whole.out_size)) == 0) {
+            return false;
+        }
+        ctx->whole.out_length = n;
+    }
+    else {
+        size_t in_used, out_length;
+
+        if (!whole_reserve(&ctx->whole.out, &ctx->whole.out_size, ctx->whole.expected_size)) {
+            return false;
+        }
+        if (libdeflate_deflate_decompress_ex(ctx->whole.decompressor, ctx->whole.in, (size_t)ctx->whole.in_length, ctx->whole.out, (size_t)ctx->whole.expected_size, &in_used, &out_length) != LIBDEFLATE_SUCCESS) {
+            return false;
+        }
+        ctx->whole.out_length = out_length;
+        ctx->whole.unconsumed = ctx->whole.in_length - in_used;
+    }
+
+    ctx->whole.finished = true;
+    return true;
+}
+
+
+/* Continue with zlib, passing it the collected input followed by pending. */
+static bool
+whole_fall_back(struct ctx *ctx, zip_uint8_t *pending, zip_uint64_t pending_length) {
+    ctx->whole.active = false;
+
+    if (pending_length > UINT_MAX) {
+        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+    if (!zstr_start(ctx)) {
+        return false;
+    }
+
+    ctx->zstr.next_in = (Bytef *)ctx->whole.in;
+    ctx->zstr.avail_in = (uInt)ctx->whole.in_length;
+    ctx->whole.pending = pending;
+    ctx->whole.pending_length = pending_length;
+    return true;
+}
+
+
+static zip_compression_status_t
+whole_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t n;
+
+    if (!ctx->whole.finished) {
+        if (!ctx->end_of_input) {
+            *length = 0;
+            return ZIP_COMPRESSION_NEED_DATA;
+        }
+        if (!whole_finish(ctx)) {
+            if (!whole_fall_back(ctx, NULL, 0)) {
+                *length = 0;
+                return ZIP_COMPRESSION_ERROR;
+            }
+            return process(ctx, data, length);
+        }
+    }
+
+    n = ZIP_MIN(*length, ctx->whole.out_length - ctx->whole.out_offset);
+    (void)memcpy_s(data, *length, ctx->whole.out + ctx->whole.out_offset, n);
+    ctx->whole.out_offset += n;
+    *length = n;
+
+    return ctx->whole.out_offset == ctx->whole.out_length ? ZIP_COMPRESSION_END : ZIP_COMPRESSION_OK;
+}
+#endif
+
+#ifdef HAVE_ISAL
+/* Files of known compressed size that libdeflate doesn't handle are decompressed with ISA-L's igzip, which is
+   considerably faster than zlib's inflate. Its state can't be recorded at block boundaries, so after a seek, and when
+   reading a file again after seeking in it, zlib is used. ISA-L reads ahead into its bit buffer, so in_position may
+   be a few bytes too large; it is only used for zlib's checkpoints. */
+
+/* Decompress with ISA-L; false to use zlib. */
+static bool
+isal_start(struct ctx *ctx, zip_stat_t *st) {
+    /* zip_stream() needs to know exactly where the compressed data ends, checkpoints record zlib's state */
+    if (ctx->compress || ctx->record_checkpoints || (st->valid & ZIP_STAT_COMP_SIZE) == 0) {
+        return false;
+    }
+    if (ctx->isal == NULL && (ctx->isal = (struct inflate_state *)_zip_malloc(sizeof(*ctx->isal))) == NULL) {
+        return false;
+    }
+
+    isal_inflate_init(ctx->isal);
+    ctx->isal_active = true;
+    ctx->isal_last_input_length = 0;
+    return true;
+}
+
+
+static zip_compression_status_t
+isal_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint32_t avail_in = ctx->isal->avail_in;
+    zip_uint32_t avail_out = (zip_uint32_t)ZIP_MIN(UINT32_MAX, *length);
+    int ret;
+
+    ctx->isal->next_out = data;
+    ctx->isal->avail_out = avail_out;
+
+    ret = isal_inflate(ctx->isal);
+
+    ctx->in_position += avail_in - ctx->isal->avail_in;
+    ctx->out_position += avail_out - ctx->isal->avail_out;
+    *length = avail_out - ctx->isal->avail_out;
+
+    if (ret < 0) {
+        /* invalid data, reported as zlib would */
+        zip_error_set(ctx->error, ZIP_ER_ZLIB, Z_DATA_ERROR);
+        return ZIP_COMPRESSION_ERROR;
+    }
+    if (ctx->isal->block_state == ISAL_BLOCK_FINISH) {
+        return ZIP_COMPRESSION_END;
+    }
+    if (*length == 0 && ctx->isal->avail_in == 0) {
+        return ZIP_COMPRESSION_NEED_DATA;
     }
+    return ZIP_COMPRESSION_OK;
 }
+#endif
 
 /* clang-format off */
 
@@ -256,7 +2103,13 @@ zip_compression_algorithm_t zip_algorithm_deflate_compress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    NULL,
+    seek_points,
+    NULL,
+    NULL,
+    memory_usage,
+    NULL
 };
 
 
@@ -270,7 +2123,13 @@ zip_compression_algorithm_t zip_algorithm_deflate_decompress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    seek,
+    NULL,
+    add_seek_points,
+    unconsumed_input,
+    memory_usage,
+    reset
 };
 
 /* clang-format on */
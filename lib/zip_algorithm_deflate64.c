@@ -0,0 +1,706 @@
+/*
+  zip_algorithm_deflate64.c -- deflate64 decompression routines
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Deflate64 ("Enhanced Deflating") is deflate with a 64k window, distance codes 30 and 31, and length code 285
+   taking 16 extra bits instead of meaning 258. zlib only supports it in an unofficial contrib module, so this is
+   an inflater of its own. Data is decoded into a circular window, from which it is returned to the caller. */
+
+#define WINDOW_SIZE (128 * 1024) /* power of 2, larger than the maximum distance of 64k */
+#define WINDOW_MASK (WINDOW_SIZE - 1)
+
+#define MAX_BITS 15 /* longest Huffman code */
+#define FAST_BITS 10
+#define FAST_SIZE (1 << FAST_BITS)
+#define FAST_MASK (FAST_SIZE - 1)
+
+#define MAX_LITLEN_CODES 288
+#define MAX_DISTANCE_CODES 32
+#define CODE_LENGTH_CODES 19
+
+struct huffman {
+    zip_uint16_t fast[FAST_SIZE]; /* symbol << 4 | length for codes up to FAST_BITS long, 0 otherwise */
+    zip_uint16_t count[MAX_BITS + 1];
+    zip_uint16_t symbol[MAX_LITLEN_CODES]; /* sorted by code */
+};
+
+enum state {
+    STATE_HEADER,
+    STATE_STORED_HEADER,
+    STATE_STORED,
+    STATE_TABLE_HEADER,
+    STATE_CODE_LENGTH_LENGTHS,
+    STATE_CODE_LENGTHS,
+    STATE_LITLEN,
+    STATE_LENGTH_EXTRA,
+    STATE_DISTANCE,
+    STATE_DISTANCE_EXTRA,
+    STATE_COPY,
+    STATE_DONE
+};
+
+enum inflate_status { INFLATE_OK, INFLATE_NEED_DATA, INFLATE_END, INFLATE_ERROR };
+
+struct ctx {
+    zip_error_t *error;
+    bool end_of_input;
+
+    const zip_uint8_t *next_in;
+    zip_uint64_t avail_in;
+    zip_uint64_t last_input_length;
+    zip_uint64_t bits; /* bit buffer, next bit in least significant bit */
+    unsigned int nbits;
+
+    enum state state;
+    bool last_block;
+    bool have_symbol; /* symbol was decoded, its extra bits were not yet available */
+    unsigned int symbol;
+
+    zip_uint8_t *window;
+    zip_uint64_t written;  /* bytes decoded into window */
+    zip_uint64_t returned; /* bytes returned to caller */
+
+    zip_uint64_t stored_length; /* remaining in stored block */
+    zip_uint32_t copy_length;   /* remaining in match */
+    zip_uint32_t copy_distance;
+
+    unsigned int nlitlen;
+    unsigned int ndistance;
+    unsigned int ncode_length_lengths;
+    unsigned int nlengths; /* code lengths read so far */
+    zip_uint8_t code_length_lengths[CODE_LENGTH_CODES];
+    zip_uint8_t lengths[MAX_LITLEN_CODES + MAX_DISTANCE_CODES];
+
+    const struct huffman *litlen;
+    const struct huffman *distance;
+    struct huffman code_length_code;
+    struct huffman dynamic_litlen;
+    struct huffman dynamic_distance;
+    struct huffman fixed_litlen;
+    struct huffman fixed_distance;
+};
+
+static const zip_uint16_t length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 3};
+static const zip_uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 16};
+static const zip_uint16_t distance_base[32] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769, 49153};
+static const zip_uint8_t distance_extra[32] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14};
+static const zip_uint8_t code_length_order[CODE_LENGTH_CODES] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+
+/* Create decoding tables for canonical Huffman code with given code lengths, false if it is over-subscribed. */
+static bool
+huffman_build(struct huffman *h, const zip_uint8_t *lengths, unsigned int n) {
+    zip_uint16_t offset[MAX_BITS + 2];
+    zip_uint32_t next_code[MAX_BITS + 1];
+    zip_uint32_t code, reversed;
+    unsigned int i, j, length;
+    int left;
+
+    memset(h->count, 0, sizeof(h->count));
+    for (i = 0; i < n; i++) {
+        h->count[lengths[i]]++;
+    }
+    h->count[0] = 0;
+
+    left = 1;
+    for (length = 1; length <= MAX_BITS; length++) {
+        left <<= 1;
+        left -= h->count[length];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    offset[1] = 0;
+    for (length = 1; length <= MAX_BITS; length++) {
+        offset[length + 1] = (zip_uint16_t)(offset[length] + h->count[length]);
+    }
+    for (i = 0; i < n; i++) {
+        if (lengths[i] != 0) {
+            h->symbol[offset[lengths[i]]++] = (zip_uint16_t)i;
+        }
+    }
+
+    code = 0;
+    for (length = 1; length <= MAX_BITS; length++) {
+        code = (code + h->count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    memset(h->fast, 0, sizeof(h->fast));
+    for (i = 0; i < n; i++) {
+        if ((length = lengths[i]) == 0) {
+            continue;
+        }
+        code = next_code[length]++;
+        if (length > FAST_BITS) {
+            continue;
+        }
+        /* codes are stored starting with their most significant bit */
+        reversed = 0;
+        for (j = 0; j < length; j++) {
+            reversed = (reversed << 1) | ((code >> j) & 1);
+        }
+        for (j = reversed; j < FAST_SIZE; j += 1u << length) {
+            h->fast[j] = (zip_uint16_t)(i << 4 | length);
+        }
+    }
+
+    return true;
+}
+
+
+static void
+refill(struct ctx *ctx) {
+    while (ctx->nbits <= 56 && ctx->avail_in > 0) {
+        ctx->bits |= (zip_uint64_t)*ctx->next_in++ << ctx->nbits;
+        ctx->nbits += 8;
+        ctx->avail_in--;
+    }
+}
+
+
+static bool
+have_bits(struct ctx *ctx, unsigned int n) {
+    if (ctx->nbits < n) {
+        refill(ctx);
+    }
+    return ctx->nbits >= n;
+}
+
+
+static zip_uint32_t
+get_bits(struct ctx *ctx, unsigned int n) {
+    zip_uint32_t value = (zip_uint32_t)(ctx->bits & (((zip_uint64_t)1 << n) - 1));
+
+    ctx->bits >>= n;
+    ctx->nbits -= n;
+    return value;
+}
+
+
+/* Decode next symbol, INFLATE_NEED_DATA if its code is not complete yet. */
+static enum inflate_status
+decode(struct ctx *ctx, const struct huffman *h, unsigned int *symbol) {
+    zip_uint16_t entry;
+    unsigned int length;
+    int code, first, index, count;
+
+    if (ctx->nbits < MAX_BITS) {
+        refill(ctx);
+    }
+
+    if ((entry = h->fast[ctx->bits & FAST_MASK]) != 0) {
+        if ((entry & 0xf) > ctx->nbits) {
+            return INFLATE_NEED_DATA;
+        }
+        (void)get_bits(ctx, entry & 0xf);
+        *symbol = entry >> 4;
+        return INFLATE_OK;
+    }
+
+    code = first = index = 0;
+    for (length = 1; length <= MAX_BITS; length++) {
+        if (length > ctx->nbits) {
+            return INFLATE_NEED_DATA;
+        }
+        code |= (int)((ctx->bits >> (length - 1)) & 1);
+        count = h->count[length];
+        if (code - count < first) {
+            (void)get_bits(ctx, length);
+            *symbol = h->symbol[index + (code - first)];
+            return INFLATE_OK;
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return INFLATE_ERROR;
+}
+
+
+static enum inflate_status
+data_error(struct ctx *ctx) {
+    zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+    return INFLATE_ERROR;
+}
+
+
+/* Read code lengths of dynamic block, then create its tables. */
+static enum inflate_status
+read_code_lengths(struct ctx *ctx) {
+    unsigned int n = ctx->nlitlen + ctx->ndistance;
+    unsigned int symbol, repeat;
+    zip_uint8_t value;
+    enum inflate_status status;
+
+    while (ctx->nlengths < n) {
+        if (!ctx->have_symbol) {
+            if ((status = decode(ctx, &ctx->code_length_code, &ctx->symbol)) != INFLATE_OK) {
+                return status == INFLATE_ERROR ? data_error(ctx) : status;
+            }
+            ctx->have_symbol = true;
+        }
+        symbol = ctx->symbol;
+
+        if (symbol < 16) {
+            ctx->lengths[ctx->nlengths++] = (zip_uint8_t)symbol;
+            ctx->have_symbol = false;
+            continue;
+        }
+
+        if (symbol == 16) {
+            if (ctx->nlengths == 0) {
+                return data_error(ctx);
+            }
+            if (!have_bits(ctx, 2)) {
+                return INFLATE_NEED_DATA;
+            }
+            value = ctx->lengths[ctx->nlengths - 1];
+            repeat = 3 + get_bits(ctx, 2);
+        }
+        else if (symbol == 17) {
+            if (!have_bits(ctx, 3)) {
+                return INFLATE_NEED_DATA;
+            }
+            value = 0;
+            repeat = 3 + get_bits(ctx, 3);
+        }
+        else {
+            if (!have_bits(ctx, 7)) {
+                return INFLATE_NEED_DATA;
+            }
+            value = 0;
+            repeat = 11 + get_bits(ctx, 7);
+        }
+        ctx->have_symbol = false;
+
+        if (repeat > n - ctx->nlengths) {
+            return data_error(ctx);
+        }
+        memset(ctx->lengths + ctx->nlengths, value, repeat);
+        ctx->nlengths += repeat;
+    }
+
+    if (ctx->lengths[256] == 0 || !huffman_build(&ctx->dynamic_litlen, ctx->lengths, ctx->nlitlen) || !huffman_build(&ctx->dynamic_distance, ctx->lengths + ctx->nlitlen, ctx->ndistance)) {
+        return data_error(ctx);
+    }
+    ctx->litlen = &ctx->dynamic_litlen;
+    ctx->distance = &ctx->dynamic_distance;
+    return INFLATE_OK;
+}
+
+
+/* Decode until wanted bytes are available in window or window is full. */
+static enum inflate_status
+inflate(struct ctx *ctx, zip_uint64_t wanted) {
+    enum inflate_status status;
+    zip_uint64_t n, room, position, source;
+    unsigned int i, symbol;
+
+    while ((room = WINDOW_SIZE - (ctx->written - ctx->returned)) > 0 && WINDOW_SIZE - room < wanted) {
+        switch (ctx->state) {
+        case STATE_HEADER:
+            if (!have_bits(ctx, 3)) {
+                return INFLATE_NEED_DATA;
+            }
+            ctx->last_block = get_bits(ctx, 1) != 0;
+            switch (get_bits(ctx, 2)) {
+            case 0:
+                ctx->state = STATE_STORED_HEADER;
+                /* stored blocks start at byte boundary */
+                (void)get_bits(ctx, ctx->nbits & 7);
+                break;
+            case 1:
+                ctx->litlen = &ctx->fixed_litlen;
+                ctx->distance = &ctx->fixed_distance;
+                ctx->state = STATE_LITLEN;
+                break;
+            case 2:
+                ctx->state = STATE_TABLE_HEADER;
+                break;
+            default:
+                return data_error(ctx);
+            }
+            break;
+
+        case STATE_STORED_HEADER:
+            if (!have_bits(ctx, 32)) {
+                return INFLATE_NEED_DATA;
+            }
+            n = get_bits(ctx, 16);
+            if (n != (get_bits(ctx, 16) ^ 0xffff)) {
+                return data_error(ctx);
+            }
+            ctx->stored_length = n;
+            ctx->state = STATE_STORED;
+            break;
+
+        case STATE_STORED:
+            if (ctx->stored_length == 0) {
+                ctx->state = ctx->last_block ? STATE_DONE : STATE_HEADER;
+                break;
+            }
+            position = ctx->written & WINDOW_MASK;
+            if (ctx->nbits >= 8) {
+                /* left in bit buffer from refill */
+                ctx->window[position] = (zip_uint8_t)get_bits(ctx, 8);
+                n = 1;
+            }
+            else {
+                if (ctx->avail_in == 0) {
+                    return INFLATE_NEED_DATA;
+                }
+                n = ZIP_MIN(ZIP_MIN(ctx->stored_length, room), ZIP_MIN(WINDOW_SIZE - position, ctx->avail_in));
+                (void)memcpy_s(ctx->window + position, WINDOW_SIZE - position, ctx->next_in, n);
+                ctx->next_in += n;
+                ctx->avail_in -= n;
+            }
+            ctx->written += n;
+            ctx->stored_length -= n;
+            break;
+
+        case STATE_TABLE_HEADER:
+            if (!have_bits(ctx, 14)) {
+                return INFLATE_NEED_DATA;
+            }
+            ctx->nlitlen = get_bits(ctx, 5) + 257;
+            ctx->ndistance = get_bits(ctx, 5) + 1;
+            ctx->ncode_length_lengths = get_bits(ctx, 4) + 4;
+            if (ctx->nlitlen > 286) {
+                return data_error(ctx);
+            }
+            ctx->nlengths = 0;
+            ctx->state = STATE_CODE_LENGTH_LENGTHS;
+            break;
+
+        case STATE_CODE_LENGTH_LENGTHS:
+            while (ctx->nlengths < ctx->ncode_length_lengths) {
+                if (!have_bits(ctx, 3)) {
+                    return INFLATE_NEED_DATA;
+                }
+                ctx->code_length_lengths[code_length_order[ctx->nlengths++]] = (zip_uint8_t)get_bits(ctx, 3);
+            }
+            for (i = ctx->nlengths; i < CODE_LENGTH_CODES; i++) {
+                ctx->code_length_lengths[code_length_order[i]] = 0;
+            }
+            if (!huffman_build(&ctx->code_length_code, ctx->code_length_lengths, CODE_LENGTH_CODES)) {
+                return data_error(ctx);
+            }
+            ctx->nlengths = 0;
+            ctx->have_symbol = false;
+            ctx->state = STATE_CODE_LENGTHS;
+            break;
+
+        case STATE_CODE_LENGTHS:
+            if ((status = read_code_lengths(ctx)) != INFLATE_OK) {
+                return status;
+            }
+            ctx->state = STATE_LITLEN;
+            break;
+
+        case STATE_LITLEN:
+            if ((status = decode(ctx, ctx->litlen, &symbol)) != INFLATE_OK) {
+                return status == INFLATE_ERROR ? data_error(ctx) : status;
+            }
+            if (symbol < 256) {
+                ctx->window[ctx->written++ & WINDOW_MASK] = (zip_uint8_t)symbol;
+            }
+            else if (symbol == 256) {
+                ctx->state = ctx->last_block ? STATE_DONE : STATE_HEADER;
+            }
+            else if (symbol - 257 < 29) {
+                ctx->symbol = symbol - 257;
+                ctx->state = STATE_LENGTH_EXTRA;
+            }
+            else {
+                return data_error(ctx);
+            }
+            break;
+
+        case STATE_LENGTH_EXTRA:
+            if (!have_bits(ctx, length_extra[ctx->symbol])) {
+                return INFLATE_NEED_DATA;
+            }
+            ctx->copy_length = length_base[ctx->symbol] + get_bits(ctx, length_extra[ctx->symbol]);
+            ctx->state = STATE_DISTANCE;
+            break;
+
+        case STATE_DISTANCE:
+            if ((status = decode(ctx, ctx->distance, &ctx->symbol)) != INFLATE_OK) {
+                return status == INFLATE_ERROR ? data_error(ctx) : status;
+            }
+            ctx->state = STATE_DISTANCE_EXTRA;
+            break;
+
+        case STATE_DISTANCE_EXTRA:
+            if (!have_bits(ctx, distance_extra[ctx->symbol])) {
+                return INFLATE_NEED_DATA;
+            }
+            ctx->copy_distance = distance_base[ctx->symbol] + get_bits(ctx, distance_extra[ctx->symbol]);
+            if (ctx->copy_distance > ctx->written) {
+                return data_error(ctx);
+            }
+            ctx->state = STATE_COPY;
+            break;
+
+        case STATE_COPY:
+            position = ctx->written & WINDOW_MASK;
+            source = (ctx->written - ctx->copy_distance) & WINDOW_MASK;
+            n = ZIP_MIN(ZIP_MIN(ctx->copy_length, room), ZIP_MIN(WINDOW_SIZE - position, WINDOW_SIZE - source));
+            if (ctx->copy_distance >= n) {
+                (void)memcpy_s(ctx->window + position, WINDOW_SIZE - position, ctx->window + source, n);
+            }
+            else {
+                /* overlapping, repeats the last copy_distance bytes */
+                for (i = 0; i < n; i++) {
+                    ctx->window[position + i] = ctx->window[source + i];
+                }
+            }
+            ctx->written += n;
+            ctx->copy_length -= (zip_uint32_t)n;
+            if (ctx->copy_length == 0) {
+                ctx->state = STATE_LITLEN;
+            }
+            break;
+
+        case STATE_DONE:
+            return INFLATE_END;
+        }
+    }
+
+    return INFLATE_OK;
+}
+
+
+/* Copy up to length decoded bytes from window to data, return number of bytes copied. */
+static zip_uint64_t
+deliver(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t n, done, position;
+
+    done = 0;
+    n = ZIP_MIN(length, ctx->written - ctx->returned);
+    while (done < n) {
+        position = ctx->returned & WINDOW_MASK;
+        length = ZIP_MIN(n - done, WINDOW_SIZE - position);
+        (void)memcpy_s(data + done, n - done, ctx->window + position, length);
+        done += length;
+        ctx->returned += length;
+    }
+
+    return done;
+}
+
+
+static zip_uint64_t
+maximum_compressed_size(zip_uint64_t uncompressed_size) {
+    /* only used for compression, which is not supported */
+    (void)uncompressed_size;
+    return ZIP_UINT64_MAX;
+}
+
+
+static void *
+allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error) {
+    struct ctx *ctx;
+    zip_uint8_t lengths[MAX_LITLEN_CODES];
+    unsigned int i;
+
+    (void)method;
+    (void)compression_flags;
+
+    if ((ctx = (struct ctx *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        return NULL;
+    }
+    if ((ctx->window = (zip_uint8_t *)_zip_malloc(WINDOW_SIZE)) == NULL) {
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    ctx->error = error;
+
+    for (i = 0; i < MAX_LITLEN_CODES; i++) {
+        lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    (void)huffman_build(&ctx->fixed_litlen, lengths, MAX_LITLEN_CODES);
+    memset(lengths, 5, MAX_DISTANCE_CODES);
+    (void)huffman_build(&ctx->fixed_distance, lengths, MAX_DISTANCE_CODES);
+
+    return ctx;
+}
+
+
+static void
+deallocate(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    _zip_free(ctx->window);
+    _zip_free(ctx);
+}
+
+
+static zip_uint16_t
+general_purpose_bit_flags(void *ud) {
+    (void)ud;
+    return 0;
+}
+
+
+static bool
+start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    (void)st;
+    (void)attributes;
+
+    ctx->end_of_input = false;
+    ctx->next_in = NULL;
+    ctx->avail_in = 0;
+    ctx->last_input_length = 0;
+    ctx->bits = 0;
+    ctx->nbits = 0;
+    ctx->state = STATE_HEADER;
+    ctx->last_block = false;
+    ctx->have_symbol = false;
+    ctx->written = 0;
+    ctx->returned = 0;
+
+    return true;
+}
+
+
+static bool
+end(void *ud) {
+    (void)ud;
+    return true;
+}
+
+
+static bool
+input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (ctx->avail_in > 0) {
+        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    ctx->next_in = data;
+    ctx->avail_in = length;
+    ctx->last_input_length = length;
+
+    return true;
+}
+
+
+static void
+end_of_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->end_of_input = true;
+}
+
+
+static zip_uint64_t
+unconsumed_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    /* whole bytes left in bit buffer are also unused */
+    return ZIP_MIN(ctx->avail_in + ctx->nbits / 8, ctx->last_input_length);
+}
+
+
+static zip_compression_status_t
+process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
+    struct ctx *ctx = (struct ctx *)ud;
+    enum inflate_status status = INFLATE_OK;
+    zip_uint64_t done = 0;
+
+    for (;;) {
+        done += deliver(ctx, data + done, *length - done);
+        if (done == *length || status != INFLATE_OK) {
+            break;
+        }
+        status = inflate(ctx, *length - done);
+    }
+    *length = done;
+
+    switch (status) {
+    case INFLATE_OK:
+        return ZIP_COMPRESSION_OK;
+
+    case INFLATE_END:
+        return ctx->written == ctx->returned ? ZIP_COMPRESSION_END : ZIP_COMPRESSION_OK;
+
+    case INFLATE_NEED_DATA:
+        if (ctx->end_of_input) {
+            /* truncated */
+            zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+            return ZIP_COMPRESSION_ERROR;
+        }
+        return ZIP_COMPRESSION_NEED_DATA;
+
+    case INFLATE_ERROR:
+    default:
+        return ZIP_COMPRESSION_ERROR;
+    }
+}
+
+/* clang-format off */
+
+zip_compression_algorithm_t zip_algorithm_deflate64_decompress = {
+    maximum_compressed_size,
+    allocate,
+    deallocate,
+    general_purpose_bit_flags,
+    21,
+    start,
+    end,
+    input,
+    end_of_input,
+    process,
+    NULL,
+    NULL,
+    NULL,
+    unconsumed_input,
+    NULL,
+    NULL
+};
+
+/* clang-format on */
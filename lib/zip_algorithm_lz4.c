@@ -0,0 +1,522 @@
+/*
+  zip_algorithm_lz4.c -- LZ4 (de)compression routines
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+#include <limits.h>
+#include <lz4.h>
+#include <lz4frame.h>
+#include <lz4hc.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* LZ4 is not an official zip compression method; ZIP_CM_LZ4 is only understood by libzip.
+
+   Data is an LZ4 frame, or with ZIP_CM_FL_LZ4_BLOCK a single LZ4 block, which decompresses faster but needs
+   the whole data in memory and the uncompressed size from the directory entry. Blocks can't start with the
+   frame magic (a block starting with a match is invalid), so the decompressor detects which one is used. */
+
+#define FRAME_MAGIC 0x184D2204u
+#define FRAME_CHUNK_SIZE (64 * 1024) /* input passed to LZ4F_compressUpdate at once, matches block size */
+
+enum mode { MODE_UNKNOWN, MODE_FRAME, MODE_BLOCK };
+
+struct ctx {
+    zip_error_t *error;
+    bool compress;
+    int level;
+    bool want_block;
+    bool end_of_input;
+    enum mode mode;
+    bool done; /* all output is in buffer */
+
+    LZ4F_cctx *cctx;
+    LZ4F_dctx *dctx;
+    LZ4F_preferences_t preferences;
+    const zip_uint8_t *next_in;
+    zip_uint64_t avail_in;
+    zip_uint64_t last_input_length;
+
+    zip_uint8_t *block; /* input collected for block mode, or until mode is known when decompressing */
+    zip_uint64_t block_length;
+    zip_uint64_t block_size;
+    zip_uint64_t uncompressed_size; /* ZIP_UINT64_MAX if unknown */
+
+    zip_uint8_t *out; /* output not returned yet, for frame compression and block mode */
+    zip_uint64_t out_size;
+    zip_uint64_t out_length;
+    zip_uint64_t out_offset;
+};
+
+
+static bool
+reserve(zip_uint8_t **buffer, zip_uint64_t *size, zip_uint64_t needed, zip_error_t *error) {
+    zip_uint8_t *new_buffer;
+    zip_uint64_t new_size;
+
+    if (*size >= needed) {
+        return true;
+    }
+    new_size = ZIP_MAX(needed, *size * 2);
+    if (new_size > SIZE_MAX || (new_buffer = (zip_uint8_t *)_zip_realloc(*buffer, (size_t)new_size)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    *buffer = new_buffer;
+    *size = new_size;
+    return true;
+}
+
+
+static zip_uint64_t
+maximum_compressed_size(zip_uint64_t uncompressed_size) {
+    /* block bound, plus block headers, frame header, end mark, and checksum */
+    zip_uint64_t compressed_size = uncompressed_size + uncompressed_size / 255 + 16 + 4 * (uncompressed_size / FRAME_CHUNK_SIZE + 1) + LZ4F_HEADER_SIZE_MAX + 8;
+
+    if (compressed_size < uncompressed_size) {
+        return ZIP_UINT64_MAX;
+    }
+    return compressed_size;
+}
+
+
+static void *
+allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
+    struct ctx *ctx;
+
+    if ((ctx = (struct ctx *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        return NULL;
+    }
+
+    ctx->error = error;
+    ctx->compress = compress;
+    ctx->want_block = compress && (compression_flags & ZIP_CM_FL_LZ4_BLOCK) != 0;
+    ctx->level = (int)(compression_flags & 0xff);
+    if (ctx->level > LZ4HC_CLEVEL_MAX) {
+        ctx->level = 0; /* let lz4 choose */
+    }
+    ctx->end_of_input = false;
+    ctx->cctx = NULL;
+    ctx->dctx = NULL;
+    ctx->block = NULL;
+    ctx->block_size = 0;
+    ctx->out = NULL;
+    ctx->out_size = 0;
+
+    return ctx;
+}
+
+
+static void *
+compress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error) {
+    (void)method;
+    return allocate(true, compression_flags, error);
+}
+
+
+static void *
+decompress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error) {
+    (void)method;
+    return allocate(false, compression_flags, error);
+}
+
+
+static void
+deallocate(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (ctx->cctx != NULL) {
+        LZ4F_freeCompressionContext(ctx->cctx);
+    }
+    if (ctx->dctx != NULL) {
+        LZ4F_freeDecompressionContext(ctx->dctx);
+    }
+    _zip_free(ctx->block);
+    _zip_free(ctx->out);
+    _zip_free(ctx);
+}
+
+
+static zip_uint16_t
+general_purpose_bit_flags(void *ud) {
+    (void)ud;
+    return 0;
+}
+
+
+static bool
+start_frame_compression(struct ctx *ctx) {
+    size_t ret;
+
+    if (ctx->cctx == NULL && LZ4F_isError(LZ4F_createCompressionContext(&ctx->cctx, LZ4F_VERSION))) {
+        ctx->cctx = NULL;
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+
+    memset(&ctx->preferences, 0, sizeof(ctx->preferences));
+    ctx->preferences.frameInfo.blockSizeID = LZ4F_max64KB;
+    ctx->preferences.frameInfo.blockMode = LZ4F_blockLinked;
+    /* zip has its own CRC */
+    ctx->preferences.frameInfo.contentChecksumFlag = LZ4F_noContentChecksum;
+    ctx->preferences.compressionLevel = ctx->level;
+    ctx->preferences.favorDecSpeed = 1;
+
+    if (!reserve(&ctx->out, &ctx->out_size, LZ4F_compressBound(FRAME_CHUNK_SIZE, &ctx->preferences), ctx->error)) {
+        return false;
+    }
+    if (LZ4F_isError(ret = LZ4F_compressBegin(ctx->cctx, ctx->out, (size_t)ctx->out_size, &ctx->preferences))) {
+        zip_error_set(ctx->error, ZIP_ER_INTERNAL, 0);
+        return false;
+    }
+    ctx->out_length = ret;
+    return true;
+}
+
+
+static bool
+start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    (void)attributes;
+
+    ctx->end_of_input = false;
+    ctx->done = false;
+    ctx->next_in = NULL;
+    ctx->avail_in = 0;
+    ctx->last_input_length = 0;
+    ctx->block_length = 0;
+    ctx->out_length = 0;
+    ctx->out_offset = 0;
+    ctx->uncompressed_size = (st->valid & ZIP_STAT_SIZE) ? st->size : ZIP_UINT64_MAX;
+
+    if (ctx->compress) {
+        /* fall back to frame if data may be too large for a block */
+        if (ctx->want_block && ctx->uncompressed_size <= LZ4_MAX_INPUT_SIZE) {
+            ctx->mode = MODE_BLOCK;
+            return reserve(&ctx->block, &ctx->block_size, ctx->uncompressed_size, ctx->error);
+        }
+        ctx->mode = MODE_FRAME;
+        return start_frame_compression(ctx);
+    }
+
+    if (ctx->dctx == NULL) {
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx->dctx, LZ4F_VERSION))) {
+            ctx->dctx = NULL;
+            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+    }
+    else {
+        LZ4F_resetDecompressionContext(ctx->dctx);
+    }
+    ctx->mode = MODE_UNKNOWN;
+
+    return true;
+}
+
+
+static bool
+end(void *ud) {
+    (void)ud;
+    return true;
+}
+
+
+static void
+detect_mode(struct ctx *ctx) {
+    if (ctx->block_length >= 4 && ((zip_uint32_t)ctx->block[0] | (zip_uint32_t)ctx->block[1] << 8 | (zip_uint32_t)ctx->block[2] << 16 | (zip_uint32_t)ctx->block[3] << 24) == FRAME_MAGIC) {
+        /* decompress what was collected so far */
+        ctx->mode = MODE_FRAME;
+        ctx->next_in = ctx->block;
+        ctx->avail_in = ctx->block_length;
+    }
+    else {
+        ctx->mode = MODE_BLOCK;
+    }
+}
+
+
+static bool
+input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (ctx->avail_in > 0) {
+        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+    ctx->last_input_length = length;
+
+    if (ctx->mode == MODE_FRAME) {
+        ctx->next_in = data;
+        ctx->avail_in = length;
+        return true;
+    }
+
+    if (length > LZ4_MAX_INPUT_SIZE - ctx->block_length) {
+        zip_error_set(ctx->error, ctx->compress ? ZIP_ER_INVAL : ZIP_ER_COMPRESSED_DATA, 0);
+        return false;
+    }
+    if (!reserve(&ctx->block, &ctx->block_size, ctx->block_length + length, ctx->error)) {
+        return false;
+    }
+    (void)memcpy_s(ctx->block + ctx->block_length, ctx->block_size - ctx->block_length, data, length);
+    ctx->block_length += length;
+
+    if (ctx->mode == MODE_UNKNOWN && ctx->block_length >= 4) {
+        detect_mode(ctx);
+    }
+    return true;
+}
+
+
+static void
+end_of_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->end_of_input = true;
+}
+
+
+static zip_uint64_t
+unconsumed_input(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    /* blocks need their compressed size, so all input is used */
+    return ctx->mode == MODE_FRAME ? ZIP_MIN(ctx->avail_in, ctx->last_input_length) : 0;
+}
+
+
+/* Copy pending output to data, return number of bytes copied. */
+static zip_uint64_t
+drain(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t n = ZIP_MIN(length, ctx->out_length - ctx->out_offset);
+
+    (void)memcpy_s(data, length, ctx->out + ctx->out_offset, n);
+    ctx->out_offset += n;
+    return n;
+}
+
+
+static bool
+process_block(struct ctx *ctx) {
+    int ret;
+
+    if (ctx->compress) {
+        int bound = LZ4_compressBound((int)ctx->block_length);
+
+        if (!reserve(&ctx->out, &ctx->out_size, (zip_uint64_t)bound, ctx->error)) {
+            return false;
+        }
+        if (ctx->level >= LZ4HC_CLEVEL_MIN) {
+            ret = LZ4_compress_HC((const char *)ctx->block, (char *)ctx->out, (int)ctx->block_length, bound, ctx->level);
+        }
+        else {
+            ret = LZ4_compress_default((const char *)ctx->block, (char *)ctx->out, (int)ctx->block_length, bound);
+        }
+        if (ret <= 0) {
+            zip_error_set(ctx->error, ZIP_ER_INTERNAL, 0);
+            return false;
+        }
+    }
+    else {
+        if (ctx->uncompressed_size > INT_MAX) {
+            /* block size can't be determined from data */
+            zip_error_set(ctx->error, ctx->uncompressed_size == ZIP_UINT64_MAX ? ZIP_ER_OPNOTSUPP : ZIP_ER_COMPRESSED_DATA, 0);
+            return false;
+        }
+        if (!reserve(&ctx->out, &ctx->out_size, ZIP_MAX(ctx->uncompressed_size, 1), ctx->error)) {
+            return false;
+        }
+        if ((ret = LZ4_decompress_safe((const char *)ctx->block, (char *)ctx->out, (int)ctx->block_length, (int)ctx->uncompressed_size)) < 0) {
+            zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+            return false;
+        }
+    }
+
+    ctx->out_length = (zip_uint64_t)ret;
+    ctx->out_offset = 0;
+    ctx->done = true;
+    return true;
+}
+
+
+static zip_compression_status_t
+compress_frame(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t done = 0, n;
+    size_t ret;
+
+    for (;;) {
+        done += drain(ctx, data + done, *length - done);
+        if (done == *length) {
+            return ZIP_COMPRESSION_OK;
+        }
+        if (ctx->done) {
+            *length = done;
+            return ZIP_COMPRESSION_END;
+        }
+
+        if (ctx->avail_in > 0) {
+            n = ZIP_MIN(ctx->avail_in, FRAME_CHUNK_SIZE);
+            ret = LZ4F_compressUpdate(ctx->cctx, ctx->out, (size_t)ctx->out_size, ctx->next_in, (size_t)n, NULL);
+            ctx->next_in += n;
+            ctx->avail_in -= n;
+        }
+        else if (ctx->end_of_input) {
+            ret = LZ4F_compressEnd(ctx->cctx, ctx->out, (size_t)ctx->out_size, NULL);
+            ctx->done = true;
+        }
+        else {
+            *length = done;
+            return ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (LZ4F_isError(ret)) {
+            zip_error_set(ctx->error, ZIP_ER_INTERNAL, 0);
+            return ZIP_COMPRESSION_ERROR;
+        }
+        ctx->out_length = ret;
+        ctx->out_offset = 0;
+    }
+}
+
+
+static zip_compression_status_t
+decompress_frame(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    size_t out_length, in_length, ret;
+
+    if (ctx->done) {
+        *length = 0;
+        return ZIP_COMPRESSION_END;
+    }
+
+    out_length = (size_t)ZIP_MIN(*length, SIZE_MAX);
+    in_length = (size_t)ZIP_MIN(ctx->avail_in, SIZE_MAX);
+    ret = LZ4F_decompress(ctx->dctx, data, &out_length, ctx->next_in, &in_length, NULL);
+    ctx->next_in += in_length;
+    ctx->avail_in -= in_length;
+    *length = out_length;
+
+    if (LZ4F_isError(ret)) {
+        zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+        return ZIP_COMPRESSION_ERROR;
+    }
+    if (ret == 0) {
+        ctx->done = true;
+        return ZIP_COMPRESSION_END;
+    }
+    if (out_length == 0 && ctx->avail_in == 0) {
+        if (ctx->end_of_input) {
+            /* truncated */
+            zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+            return ZIP_COMPRESSION_ERROR;
+        }
+        return ZIP_COMPRESSION_NEED_DATA;
+    }
+    return ZIP_COMPRESSION_OK;
+}
+
+
+static zip_compression_status_t
+process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (ctx->mode == MODE_UNKNOWN) {
+        if (!ctx->end_of_input) {
+            *length = 0;
+            return ZIP_COMPRESSION_NEED_DATA;
+        }
+        detect_mode(ctx);
+    }
+
+    if (ctx->mode == MODE_FRAME) {
+        return ctx->compress ? compress_frame(ctx, data, length) : decompress_frame(ctx, data, length);
+    }
+
+    if (!ctx->done) {
+        if (!ctx->end_of_input) {
+            *length = 0;
+            return ZIP_COMPRESSION_NEED_DATA;
+        }
+        if (!process_block(ctx)) {
+            *length = 0;
+            return ZIP_COMPRESSION_ERROR;
+        }
+    }
+
+    *length = drain(ctx, data, *length);
+    return ctx->out_offset == ctx->out_length ? ZIP_COMPRESSION_END : ZIP_COMPRESSION_OK;
+}
+
+/* clang-format off */
+
+zip_compression_algorithm_t zip_algorithm_lz4_compress = {
+    maximum_compressed_size,
+    compress_allocate,
+    deallocate,
+    general_purpose_bit_flags,
+    63,
+    start,
+    end,
+    input,
+    end_of_input,
+    process,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+
+zip_compression_algorithm_t zip_algorithm_lz4_decompress = {
+    maximum_compressed_size,
+    decompress_allocate,
+    deallocate,
+    general_purpose_bit_flags,
+    63,
+    start,
+    end,
+    input,
+    end_of_input,
+    process,
+    NULL,
+    NULL,
+    NULL,
+    unconsumed_input,
+    NULL,
+    NULL
+};
+
+/* clang-format on */
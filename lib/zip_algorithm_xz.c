@@ -50,10 +50,15 @@ enum header_state { INCOMPLETE, OUTPUT, DONE };
 #define HEADER_PARAMETERS_LENGTH 5
 #define HEADER_LZMA_ALONE_LENGTH (HEADER_PARAMETERS_LENGTH + HEADER_SIZE_LENGTH)
 
+#define MAX_THREADS 16384 /* LZMA_THREADS_MAX, which liblzma doesn't export */
+
 struct ctx {
     zip_error_t *error;
     bool compress;
     zip_uint32_t compression_flags;
+    zip_uint32_t num_threads;  /* use multithreaded coder for xz: when compressing if nonzero, when decompressing if more than 1 */
+    zip_uint64_t block_size;   /* for multithreaded encoder, 0 for liblzma default */
+    zip_uint64_t memory_limit; /* for decoder, 0 for unlimited */
     bool end_of_input;
     lzma_stream zstr;
     zip_uint16_t method;
@@ -82,6 +87,27 @@ struct ctx {
 };
 
 
+/* liblzma allocations use the allocator set with zip_set_allocator() */
+static void *LZMA_API_CALL
+xz_alloc(void *opaque, size_t nmemb, size_t size) {
+    (void)opaque;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    return _zip_malloc(nmemb * size);
+}
+
+
+static void LZMA_API_CALL
+xz_free(void *opaque, void *ptr) {
+    (void)opaque;
+    _zip_free(ptr);
+}
+
+static const lzma_allocator xz_allocator = {xz_alloc, xz_free, NULL};
+
+
 static zip_uint64_t
 maximum_compressed_size(zip_uint64_t uncompressed_size) {
     /*
@@ -107,13 +133,17 @@ static void *
 allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error, zip_uint16_t method) {
     struct ctx *ctx;
 
-    if ((ctx = (struct ctx *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct ctx *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
     ctx->error = error;
     ctx->compress = compress;
+    ctx->num_threads = ZIP_COMPRESSION_FLAGS_THREADS(compression_flags);
+    ctx->block_size = 0;
+    ctx->memory_limit = 0;
+    compression_flags = ZIP_COMPRESSION_FLAGS_LEVEL(compression_flags);
     if (compression_flags <= 9) {
         ctx->compression_flags = compression_flags;
     } else {
@@ -121,20 +151,29 @@ allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error, zip_
     }
     ctx->compression_flags |= LZMA_PRESET_EXTREME;
     ctx->end_of_input = false;
-    memset(ctx->header, 0, sizeof(ctx->header));
-    ctx->header_bytes_offset = 0;
-    if (method == ZIP_CM_LZMA) {
-        ctx->header_state = INCOMPLETE;
-    }
-    else {
-        ctx->header_state = DONE;
-    }
     memset(&ctx->zstr, 0, sizeof(ctx->zstr));
+    ctx->zstr.allocator = &xz_allocator;
     ctx->method = method;
     return ctx;
 }
 
 
+void
+_zip_xz_set_block_size(void *ud, zip_uint64_t block_size) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->block_size = block_size;
+}
+
+
+void
+_zip_xz_set_memory_limit(void *ud, zip_uint64_t limit) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->memory_limit = limit;
+}
+
+
 static void *
 compress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error) {
     return allocate(true, compression_flags, error, method);
@@ -150,7 +189,9 @@ decompress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_err
 static void
 deallocate(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
-    free(ctx);
+
+    lzma_end(&ctx->zstr);
+    _zip_free(ctx);
 }
 
 
@@ -180,6 +221,9 @@ map_error(lzma_ret ret) {
     case LZMA_MEM_ERROR:
         return ZIP_ER_MEMORY;
 
+    case LZMA_MEMLIMIT_ERROR:
+        return ZIP_ER_MEMLIMIT;
+
     case LZMA_OPTIONS_ERROR:
         return ZIP_ER_INVAL;
 
@@ -205,18 +249,52 @@ start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
     ctx->zstr.next_in = NULL;
     ctx->zstr.avail_out = 0;
     ctx->zstr.next_out = NULL;
+    ctx->end_of_input = false;
+    memset(ctx->header, 0, sizeof(ctx->header));
+    ctx->header_bytes_offset = 0;
+    ctx->header_state = ctx->method == ZIP_CM_LZMA ? INCOMPLETE : DONE;
 
+    /* liblzma reuses the memory of a previous coder of the same kind in zstr */
     if (ctx->compress) {
         if (ctx->method == ZIP_CM_LZMA)
             ret = lzma_alone_encoder(&ctx->zstr, filters[0].options);
+#if defined(HAVE_LZMA_STREAM_ENCODER_MT)
+        else if (ctx->num_threads > 0) {
+            /* the data is split into blocks compressed independently, the output depends on block size but not on number of threads */
+            lzma_mt mt;
+
+            memset(&mt, 0, sizeof(mt));
+            mt.threads = ZIP_MIN(ctx->num_threads, MAX_THREADS);
+            mt.block_size = ctx->block_size;
+            mt.filters = filters;
+            mt.check = LZMA_CHECK_CRC64;
+            ret = lzma_stream_encoder_mt(&ctx->zstr, &mt);
+        }
+#endif
         else
             ret = lzma_stream_encoder(&ctx->zstr, filters, LZMA_CHECK_CRC64);
     }
     else {
+        zip_uint64_t memlimit = ctx->memory_limit > 0 ? ctx->memory_limit : UINT64_MAX;
+
         if (ctx->method == ZIP_CM_LZMA)
-            ret = lzma_alone_decoder(&ctx->zstr, UINT64_MAX);
+            ret = lzma_alone_decoder(&ctx->zstr, memlimit);
+#if defined(HAVE_LZMA_STREAM_DECODER_MT)
+        else if (ctx->num_threads > 1) {
+            /* only blocks with sizes in their headers, as written by the multithreaded encoder, are decompressed in parallel */
+            lzma_mt mt;
+
+            memset(&mt, 0, sizeof(mt));
+            mt.threads = ZIP_MIN(ctx->num_threads, MAX_THREADS);
+            mt.flags = LZMA_CONCATENATED;
+            /* decodes in a single thread if more threads would exceed the limit */
+            mt.memlimit_threading = memlimit;
+            mt.memlimit_stop = memlimit;
+            ret = lzma_stream_decoder_mt(&ctx->zstr, &mt);
+        }
+#endif
         else
-            ret = lzma_stream_decoder(&ctx->zstr, UINT64_MAX, LZMA_CONCATENATED);
+            ret = lzma_stream_decoder(&ctx->zstr, memlimit, LZMA_CONCATENATED);
     }
 
     if (ret != LZMA_OK) {
@@ -236,11 +314,10 @@ start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
 }
 
 
+/* The stream is freed in deallocate, so start can reuse it. */
 static bool
 end(void *ud) {
-    struct ctx *ctx = (struct ctx *)ud;
-
-    lzma_end(&ctx->zstr);
+    (void)ud;
     return true;
 }
 
@@ -302,6 +379,23 @@ input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
 }
 
 
+/* For decompression, the dictionary size is only known from the stream, so assume the default preset was used. */
+static zip_uint64_t
+memory_usage(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t size;
+
+    if (ctx->compress) {
+        size = lzma_easy_encoder_memusage(ctx->compression_flags) * ZIP_MAX(ctx->num_threads, 1);
+    }
+    else {
+        size = lzma_easy_decoder_memusage(ctx->compression_flags);
+    }
+    /* UINT64_MAX if preset is not supported */
+    return sizeof(*ctx) + (size == UINT64_MAX ? 0 : size);
+}
+
+
 static void
 end_of_input(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
@@ -388,10 +482,17 @@ zip_compression_algorithm_t zip_algorithm_xz_compress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    memory_usage,
+    NULL
 };
 
 
+/* The decoder accepts concatenated streams, so it can only tell where compressed data ends at the end of input: no unconsumed_input. */
 zip_compression_algorithm_t zip_algorithm_xz_decompress = {
     maximum_compressed_size,
     decompress_allocate,
@@ -402,7 +503,13 @@ zip_compression_algorithm_t zip_algorithm_xz_decompress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    memory_usage,
+    NULL
 };
 
 /* clang-format on */
@@ -34,23 +34,150 @@
 #include "zipint.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <zstd.h>
 #include <zstd_errors.h>
 
+/* files smaller than this are compressed without worker threads */
+#define PARALLEL_MIN_SIZE (1024 * 1024)
+/* Split medium sized files into at least this many jobs, zstd's default job size (8M for fast levels)
+   would leave workers idle. Not based on the number of threads, so output does not depend on it. */
+#define PARALLEL_JOBS 8
+#define PARALLEL_JOB_SIZE_MIN (1024 * 1024)
+#define PARALLEL_JOB_SIZE_MAX (8 * 1024 * 1024)
+
+/* Seekable compression (ZIP_CM_FL_SEEKABLE): data is split into independent frames of FRAME_SIZE bytes,
+   followed by a seek table in a skippable frame as described in zstd's seekable format.
+   The frame starts are also recorded as seek points for the seek index.
+
+   When decompressing, frame boundaries at least CHECKPOINT_DISTANCE apart are recorded as checkpoints,
+   seek points from the seek index of the entry are added to them, and seek restarts at the last checkpoint
+   before the requested offset. With multiple threads and checkpoints known at start, the segments between
+   checkpoints are decompressed in parallel. */
+
+#if ZSTD_VERSION_NUMBER >= 10400
+#define HAVE_SEEKABLE
+#define HAVE_DICTIONARY
+#endif
+
+#define FRAME_SIZE (4 * 1024 * 1024)
+/* maximum frame header, empty last block, seek table entry */
+#define FRAME_OVERHEAD (18 + 3 + 8)
+#define CHECKPOINT_DISTANCE (1024 * 1024)
+
+#define SKIPPABLE_FRAME_MAGIC 0x184D2A5Eu
+#define SEEKABLE_MAGIC 0x8F92EAB1u
+#define SEEK_TABLE_HEADER_SIZE 8
+#define SEEK_TABLE_ENTRY_SIZE 8
+#define SEEK_TABLE_FOOTER_SIZE 9
+
+/* larger segments are not worth keeping in memory for parallel decompression */
+#define PARALLEL_SEGMENT_MAX (64 * 1024 * 1024)
+
+/* ZIP_CM_FL_RSYNCABLE uses zstd's rsyncable mode, which needs worker threads; it is declared only with
+   ZSTD_STATIC_LINKING_ONLY as ZSTD_c_rsyncable. */
+#define ZSTD_C_RSYNCABLE ZSTD_c_experimentalParam1
+
+/* range of window sizes zstd accepts, as log2 */
+#define WINDOW_LOG_MIN 10
+#define WINDOW_LOG_MAX 31
+
+/* Dictionary shared by all entries of an archive (zip_set_compression_dictionary).
+   It is digested once; compression contexts for each compression level are created when first needed.
+   Frames only reference it if their header contains its ID, so entries compressed without it can still be read. */
+
+struct cdict {
+    int level;
+    ZSTD_CDict *cdict;
+    struct cdict *next;
+};
+
+struct zip_zstd_dictionary {
+    zip_uint8_t *data;
+    size_t length;
+    unsigned int id;
+    ZSTD_DDict *ddict;
+    struct cdict *cdicts;
+    unsigned int refcount;
+#ifdef HAVE_THREADS
+    zip_mutex_t *mutex; /* protects cdicts and refcount, entries are compressed in worker threads */
+#endif
+};
+
+#ifdef HAVE_THREADS
+struct segment {
+    zip_thread_job_t job;
+    bool collected; /* job has been waited for */
+    const zip_zstd_dictionary_t *dictionary;
+
+    zip_uint8_t *in;
+    size_t in_length; /* how much of in has been filled */
+    size_t in_size;
+    zip_uint8_t *out;
+    size_t out_size;
+    size_t out_offset; /* how much of out has been returned */
+    int error;         /* zip error code */
+
+    struct segment *next;
+};
+#endif
+
 struct ctx {
     zip_error_t *error;
     bool compress;
     int compression_flags;
+    zip_uint32_t num_threads;
     bool end_of_input;
     ZSTD_DStream *zdstream;
     ZSTD_CStream *zcstream;
     ZSTD_outBuffer out;
     ZSTD_inBuffer in;
+    zip_zstd_dictionary_t *dictionary; /* reference held while set */
+    bool check_dictionary;             /* next input starts frame, check whether it needs dictionary */
+    zip_zstd_parameters_t parameters;  /* of entry, 0 for zstd default */
+    zip_uint64_t memory_limit;         /* for decompression, 0 for unlimited */
+
+    zip_uint64_t in_position;  /* input bytes consumed */
+    zip_uint64_t out_position; /* output bytes produced, not counting seek table */
+
+    bool rsyncable;
+    bool seekable;
+    zip_uint64_t frame_in;       /* input bytes of current frame */
+    zip_seek_point_t *points;    /* frame starts when compressing, checkpoints when decompressing; sorted */
+    zip_uint64_t npoints;
+    zip_uint64_t points_alloc;
+    zip_uint8_t *seek_table;
+    size_t seek_table_length;
+    size_t seek_table_offset; /* how much of seek table has been returned */
+
+#ifdef HAVE_THREADS
+    zip_thread_pool_t *pool; /* only set when decompressing in parallel */
+    zip_uint64_t uncompressed_size;
+    zip_uint64_t compressed_size;
+    zip_uint64_t next_segment; /* index of next segment to fill; segment i starts at points[i - 1] */
+    struct segment *head;      /* submitted segments, in order */
+    struct segment *tail;
+    struct segment *current; /* segment being filled */
+    zip_uint32_t outstanding;       /* submitted segments not yet waited for */
+    zip_uint32_t max_outstanding;   /* read ahead limit, lowered after seek so random access doesn't decompress unneeded segments */
+    zip_uint32_t outstanding_limit; /* upper bound for max_outstanding, from number of threads and memory limit */
+    bool streaming;                 /* after seek, decompress in calling thread up to start of next_segment */
+#endif
 };
 
+#ifdef HAVE_THREADS
+static void parallel_end(struct ctx *ctx);
+#endif
+
+
 static zip_uint64_t
 maximum_compressed_size(zip_uint64_t uncompressed_size) {
-    return ZSTD_compressBound(uncompressed_size);
+    zip_uint64_t compressed_size = ZSTD_compressBound(uncompressed_size);
+
+    /* room for frames and seek table in seekable mode */
+    compressed_size += (uncompressed_size / FRAME_SIZE + 1) * FRAME_OVERHEAD + SEEK_TABLE_HEADER_SIZE + SEEK_TABLE_FOOTER_SIZE;
+
+    return compressed_size;
 }
 
 
@@ -58,11 +185,18 @@ static void *
 allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     struct ctx *ctx;
 
-    if ((ctx = (struct ctx *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct ctx *)_zip_malloc(sizeof(*ctx))) == NULL) {
         return NULL;
     }
 
-    ctx->compression_flags = (zip_int32_t)compression_flags;
+    ctx->num_threads = ZIP_COMPRESSION_FLAGS_THREADS(compression_flags);
+    ctx->rsyncable = compress && (compression_flags & ZIP_COMPRESSION_FLAGS_RSYNCABLE) != 0;
+#ifdef HAVE_SEEKABLE
+    ctx->seekable = compress && (compression_flags & ZIP_COMPRESSION_FLAGS_SEEK_POINTS) != 0;
+#else
+    ctx->seekable = false;
+#endif
+    ctx->compression_flags = (zip_int32_t)ZIP_COMPRESSION_FLAGS_LEVEL(compression_flags);
     if (ctx->compression_flags < ZSTD_minCLevel() || ctx->compression_flags > ZSTD_maxCLevel()) {
         ctx->compression_flags = 0; /* let zstd choose */
     }
@@ -73,6 +207,10 @@ allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
 
     ctx->zdstream = NULL;
     ctx->zcstream = NULL;
+    ctx->dictionary = NULL;
+    ctx->check_dictionary = false;
+    memset(&ctx->parameters, 0, sizeof(ctx->parameters));
+    ctx->memory_limit = 0;
     ctx->in.src = NULL;
     ctx->in.pos = 0;
     ctx->in.size = 0;
@@ -80,6 +218,14 @@ allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     ctx->out.pos = 0;
     ctx->out.size = 0;
 
+    ctx->points = NULL;
+    ctx->npoints = ctx->points_alloc = 0;
+    ctx->seek_table = NULL;
+#ifdef HAVE_THREADS
+    ctx->pool = NULL;
+    ctx->head = ctx->tail = ctx->current = NULL;
+#endif
+
     return ctx;
 }
 
@@ -101,7 +247,16 @@ decompress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_err
 static void
 deallocate(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
-    free(ctx);
+
+#ifdef HAVE_THREADS
+    parallel_end(ctx);
+#endif
+    ZSTD_freeCStream(ctx->zcstream);
+    ZSTD_freeDStream(ctx->zdstream);
+    _zip_zstd_dictionary_free(ctx->dictionary);
+    _zip_free(ctx->points);
+    _zip_free(ctx->seek_table);
+    _zip_free(ctx);
 }
 
 
@@ -111,9 +266,10 @@ general_purpose_bit_flags(void *ud) {
     return 0;
 }
 
+/* Map result of zstd function to zip error code. */
 static int
 map_error(size_t ret) {
-    switch (ret) {
+    switch (ZSTD_getErrorCode(ret)) {
     case ZSTD_error_no_error:
         return ZIP_ER_OK;
 
@@ -126,6 +282,9 @@ map_error(size_t ret) {
     case ZSTD_error_memory_allocation:
         return ZIP_ER_MEMORY;
 
+    case ZSTD_error_frameParameter_windowTooLarge:
+        return ZIP_ER_MEMLIMIT;
+
     case ZSTD_error_parameter_unsupported:
     case ZSTD_error_parameter_outOfBound:
         return ZIP_ER_INVAL;
@@ -136,11 +295,628 @@ map_error(size_t ret) {
 }
 
 
+zip_zstd_dictionary_t *
+_zip_zstd_dictionary_new(const void *data, zip_uint64_t length, zip_error_t *error) {
+#ifdef HAVE_DICTIONARY
+    zip_zstd_dictionary_t *dictionary;
+    unsigned int id;
+
+    if (length > SIZE_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+    /* raw content dictionaries have no ID, frames compressed with them can't be told apart from others */
+    if ((id = ZSTD_getDictID_fromDict(data, (size_t)length)) == 0) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((dictionary = (zip_zstd_dictionary_t *)_zip_malloc(sizeof(*dictionary))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    dictionary->length = (size_t)length;
+    dictionary->id = id;
+    dictionary->cdicts = NULL;
+    dictionary->refcount = 1;
+    dictionary->ddict = NULL;
+#ifdef HAVE_THREADS
+    dictionary->mutex = NULL;
+#endif
+
+    if ((dictionary->data = (zip_uint8_t *)_zip_memdup(data, dictionary->length, error)) == NULL) {
+        _zip_free(dictionary);
+        return NULL;
+    }
+#ifdef HAVE_THREADS
+    if ((dictionary->mutex = _zip_mutex_new(error)) == NULL) {
+        _zip_zstd_dictionary_free(dictionary);
+        return NULL;
+    }
+#endif
+    if ((dictionary->ddict = ZSTD_createDDict(dictionary->data, dictionary->length)) == NULL) {
+        /* also fails for corrupted dictionaries */
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        _zip_zstd_dictionary_free(dictionary);
+        return NULL;
+    }
+
+    return dictionary;
+#else
+    (void)data;
+    (void)length;
+    zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+    return NULL;
+#endif
+}
+
+
+/* Drop reference, freeing dictionary when it was the last one. */
+void
+_zip_zstd_dictionary_free(zip_zstd_dictionary_t *dictionary) {
+    unsigned int refcount;
+
+    if (dictionary == NULL) {
+        return;
+    }
+
+#ifdef HAVE_THREADS
+    if (dictionary->mutex != NULL) {
+        _zip_mutex_lock(dictionary->mutex);
+    }
+#endif
+    refcount = --dictionary->refcount;
+#ifdef HAVE_THREADS
+    if (dictionary->mutex != NULL) {
+        _zip_mutex_unlock(dictionary->mutex);
+    }
+#endif
+    if (refcount > 0) {
+        return;
+    }
+
+    while (dictionary->cdicts != NULL) {
+        struct cdict *cdict = dictionary->cdicts;
+
+        dictionary->cdicts = cdict->next;
+        ZSTD_freeCDict(cdict->cdict);
+        _zip_free(cdict);
+    }
+    ZSTD_freeDDict(dictionary->ddict);
+#ifdef HAVE_THREADS
+    _zip_mutex_free(dictionary->mutex);
+#endif
+    _zip_free(dictionary->data);
+    _zip_free(dictionary);
+}
+
+
+/* Use dictionary for entries started from now on, NULL to stop using one. */
+void
+_zip_zstd_set_dictionary(void *ud, zip_zstd_dictionary_t *dictionary) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (dictionary == ctx->dictionary) {
+        return;
+    }
+
+    if (dictionary != NULL) {
+#ifdef HAVE_THREADS
+        _zip_mutex_lock(dictionary->mutex);
+#endif
+        dictionary->refcount++;
+#ifdef HAVE_THREADS
+        _zip_mutex_unlock(dictionary->mutex);
+#endif
+    }
+    _zip_zstd_dictionary_free(ctx->dictionary);
+    ctx->dictionary = dictionary;
+}
+
+
+/* Use parameters of entry for entries started from now on. */
+void
+_zip_zstd_set_parameters(void *ud, const zip_zstd_parameters_t *parameters) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->parameters = *parameters;
+}
+
+
+/* Limit memory used for decompressing entries started from now on, 0 for unlimited. */
+void
+_zip_zstd_set_memory_limit(void *ud, zip_uint64_t limit) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->memory_limit = limit;
+}
+
+
+#if ZSTD_VERSION_NUMBER >= 10400
+/* Return log2 of largest window accepted for decompression, 0 for zstd default. */
+static int
+window_log_max(const struct ctx *ctx) {
+    int log = ctx->parameters.window_log_max;
+
+    if (ctx->memory_limit > 0) {
+        int limit_log = WINDOW_LOG_MIN;
+
+        while (limit_log < WINDOW_LOG_MAX && ((zip_uint64_t)1 << (limit_log + 1)) <= ctx->memory_limit) {
+            limit_log++;
+        }
+        if (log == 0 || limit_log < log) {
+            log = limit_log;
+        }
+    }
+
+    return log;
+}
+
+
+/* Pass parameter to stream unless it is 0 (zstd default). */
+static bool
+set_parameter(struct ctx *ctx, int parameter, int value) {
+    size_t ret;
+
+    if (value == 0) {
+        return true;
+    }
+
+    if (ctx->compress) {
+        ret = ZSTD_CCtx_setParameter(ctx->zcstream, (ZSTD_cParameter)parameter, value);
+    }
+    else {
+        ret = ZSTD_DCtx_setParameter(ctx->zdstream, (ZSTD_dParameter)parameter, value);
+    }
+    if (ZSTD_isError(ret)) {
+        zip_error_set(ctx->error, map_error(ret), 0);
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+
+#ifdef HAVE_DICTIONARY
+/* Get digested dictionary for compression level, creating it if needed. */
+static ZSTD_CDict *
+dictionary_cdict(zip_zstd_dictionary_t *dictionary, int level) {
+    struct cdict *cdict;
+
+#ifdef HAVE_THREADS
+    _zip_mutex_lock(dictionary->mutex);
+#endif
+    for (cdict = dictionary->cdicts; cdict != NULL; cdict = cdict->next) {
+        if (cdict->level == level) {
+            break;
+        }
+    }
+    if (cdict == NULL && (cdict = (struct cdict *)_zip_malloc(sizeof(*cdict))) != NULL) {
+        if ((cdict->cdict = ZSTD_createCDict(dictionary->data, dictionary->length, level)) == NULL) {
+            _zip_free(cdict);
+            cdict = NULL;
+        }
+        else {
+            cdict->level = level;
+            cdict->next = dictionary->cdicts;
+            dictionary->cdicts = cdict;
+        }
+    }
+#ifdef HAVE_THREADS
+    _zip_mutex_unlock(dictionary->mutex);
+#endif
+
+    return cdict != NULL ? cdict->cdict : NULL;
+}
+#endif
+
+
+/* Get dictionary needed by frame starting at data, NULL if it was compressed without it. */
+static const ZSTD_DDict *
+dictionary_ddict(const zip_zstd_dictionary_t *dictionary, const void *data, size_t length) {
+    if (dictionary == NULL || ZSTD_getDictID_fromFrame(data, length) != dictionary->id) {
+        return NULL;
+    }
+
+    return dictionary->ddict;
+}
+
+
+/* Append point, which must be after all recorded points. Points are an optimization, so failure is not an error. */
+static bool
+point_add(struct ctx *ctx, zip_uint64_t uncompressed_offset, zip_uint64_t compressed_offset) {
+    if (ctx->npoints == ctx->points_alloc) {
+        zip_uint64_t new_alloc = ctx->points_alloc > 0 ? ctx->points_alloc * 2 : 16;
+        zip_seek_point_t *new_points;
+
+        if (new_alloc > SIZE_MAX / sizeof(*new_points) || (new_points = (zip_seek_point_t *)_zip_realloc(ctx->points, sizeof(*new_points) * (size_t)new_alloc)) == NULL) {
+            return false;
+        }
+        ctx->points = new_points;
+        ctx->points_alloc = new_alloc;
+    }
+
+    ctx->points[ctx->npoints].uncompressed_offset = uncompressed_offset;
+    ctx->points[ctx->npoints].compressed_offset = compressed_offset;
+    ctx->npoints++;
+    return true;
+}
+
+
+#ifdef HAVE_SEEKABLE
+/* Create skippable frame with seek table for frames written. */
+static bool
+seek_table_create(struct ctx *ctx) {
+    zip_buffer_t *buffer;
+    zip_uint64_t i, nframes, length;
+    zip_uint64_t uncompressed_offset = 0, compressed_offset = 0;
+
+    nframes = ctx->npoints + 1;
+    length = SEEK_TABLE_HEADER_SIZE + nframes * SEEK_TABLE_ENTRY_SIZE + SEEK_TABLE_FOOTER_SIZE;
+    if (nframes > ZIP_UINT32_MAX || length - SEEK_TABLE_HEADER_SIZE > ZIP_UINT32_MAX || length > SIZE_MAX) {
+        /* can't happen with supported sizes */
+        zip_error_set(ctx->error, ZIP_ER_INTERNAL, 0);
+        return false;
+    }
+
+    if ((ctx->seek_table = (zip_uint8_t *)_zip_malloc((size_t)length)) == NULL) {
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    if ((buffer = _zip_buffer_new(ctx->seek_table, length)) == NULL) {
+        _zip_free(ctx->seek_table);
+        ctx->seek_table = NULL;
+        zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+
+    _zip_buffer_put_32(buffer, SKIPPABLE_FRAME_MAGIC);
+    _zip_buffer_put_32(buffer, (zip_uint32_t)(length - SEEK_TABLE_HEADER_SIZE));
+    for (i = 0; i < nframes; i++) {
+        zip_uint64_t next_uncompressed = i < ctx->npoints ? ctx->points[i].uncompressed_offset : ctx->in_position;
+        zip_uint64_t next_compressed = i < ctx->npoints ? ctx->points[i].compressed_offset : ctx->out_position;
+
+        _zip_buffer_put_32(buffer, (zip_uint32_t)(next_compressed - compressed_offset));
+        _zip_buffer_put_32(buffer, (zip_uint32_t)(next_uncompressed - uncompressed_offset));
+        uncompressed_offset = next_uncompressed;
+        compressed_offset = next_compressed;
+    }
+    _zip_buffer_put_32(buffer, (zip_uint32_t)nframes);
+    _zip_buffer_put_8(buffer, 0); /* no checksums */
+    _zip_buffer_put_32(buffer, SEEKABLE_MAGIC);
+
+    if (!_zip_buffer_ok(buffer)) {
+        _zip_buffer_free(buffer);
+        _zip_free(ctx->seek_table);
+        ctx->seek_table = NULL;
+        zip_error_set(ctx->error, ZIP_ER_INTERNAL, 0);
+        return false;
+    }
+    _zip_buffer_free(buffer);
+
+    ctx->seek_table_length = (size_t)length;
+    ctx->seek_table_offset = 0;
+    return true;
+}
+
+
+/* Compress input up to the end of the current frame, ending the frame there. */
+static size_t
+compress_frame(struct ctx *ctx) {
+    size_t in_size = ctx->in.size;
+    size_t in_pos = ctx->in.pos;
+    ZSTD_EndDirective directive = ZSTD_e_continue;
+    size_t ret;
+
+    if (ctx->in.size - ctx->in.pos >= FRAME_SIZE - ctx->frame_in) {
+        ctx->in.size = ctx->in.pos + (size_t)(FRAME_SIZE - ctx->frame_in);
+        directive = ZSTD_e_end;
+    }
+
+    ret = ZSTD_compressStream2(ctx->zcstream, &ctx->out, &ctx->in, directive);
+    ctx->in.size = in_size;
+    ctx->frame_in += ctx->in.pos - in_pos;
+
+    if (!ZSTD_isError(ret) && directive == ZSTD_e_end && ret == 0) {
+        /* frame done, next one starts here */
+        ctx->in_position += ctx->frame_in;
+        ctx->frame_in = 0;
+        (void)point_add(ctx, ctx->in_position, ctx->out_position + ctx->out.pos);
+    }
+
+    return ret;
+}
+
+
+static zip_compression_status_t
+seek_table_output(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    size_t n = (size_t)ZIP_MIN(*length - ctx->out.pos, ctx->seek_table_length - ctx->seek_table_offset);
+
+    (void)memcpy_s(data + ctx->out.pos, *length - ctx->out.pos, ctx->seek_table + ctx->seek_table_offset, n);
+    ctx->seek_table_offset += n;
+    *length = ctx->out.pos + n;
+
+    return ctx->seek_table_offset == ctx->seek_table_length ? ZIP_COMPRESSION_END : ZIP_COMPRESSION_OK;
+}
+#endif
+
+
+#ifdef HAVE_THREADS
+static void
+segment_free(struct segment *segment) {
+    if (segment == NULL) {
+        return;
+    }
+
+    _zip_free(segment->in);
+    _zip_free(segment->out);
+    _zip_free(segment);
+}
+
+
+/* Runs in worker thread, must only access its segment. */
+static void
+segment_decompress(void *ud) {
+    struct segment *segment = (struct segment *)ud;
+    const ZSTD_DDict *ddict;
+    size_t ret;
+
+    if ((ddict = dictionary_ddict(segment->dictionary, segment->in, segment->in_size)) != NULL) {
+        ZSTD_DCtx *dctx;
+
+        if ((dctx = ZSTD_createDCtx()) == NULL) {
+            segment->error = ZIP_ER_MEMORY;
+            _zip_free(segment->in);
+            segment->in = NULL;
+            return;
+        }
+        ret = ZSTD_decompress_usingDDict(dctx, segment->out, segment->out_size, segment->in, segment->in_size, ddict);
+        ZSTD_freeDCtx(dctx);
+    }
+    else {
+        ret = ZSTD_decompress(segment->out, segment->out_size, segment->in, segment->in_size);
+    }
+    if (ZSTD_isError(ret)) {
+        segment->error = map_error(ret);
+    }
+    else if (ret != segment->out_size) {
+        segment->error = ZIP_ER_COMPRESSED_DATA;
+    }
+    else {
+        segment->error = ZIP_ER_OK;
+    }
+
+    _zip_free(segment->in);
+    segment->in = NULL;
+}
+
+
+static void
+segment_bounds(struct ctx *ctx, zip_uint64_t index, zip_seek_point_t *start, zip_seek_point_t *end) {
+    if (index == 0) {
+        start->uncompressed_offset = start->compressed_offset = 0;
+    }
+    else {
+        *start = ctx->points[index - 1];
+    }
+    if (index < ctx->npoints) {
+        *end = ctx->points[index];
+    }
+    else {
+        end->uncompressed_offset = ctx->uncompressed_size;
+        end->compressed_offset = ctx->compressed_size;
+    }
+}
+
+
+static bool
+parallel_fill(struct ctx *ctx) {
+    struct segment *segment;
+    size_t n;
+
+    if ((segment = ctx->current) == NULL) {
+        zip_seek_point_t start, end;
+
+        segment_bounds(ctx, ctx->next_segment, &start, &end);
+
+        if ((segment = (struct segment *)_zip_malloc(sizeof(*segment))) == NULL) {
+            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        segment->in_size = (size_t)(end.compressed_offset - start.compressed_offset);
+        segment->out_size = (size_t)(end.uncompressed_offset - start.uncompressed_offset);
+        segment->in = (zip_uint8_t *)_zip_malloc(segment->in_size);
+        segment->out = (zip_uint8_t *)_zip_malloc(segment->out_size);
+        if (segment->in == NULL || segment->out == NULL) {
+            segment_free(segment);
+            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        segment->collected = false;
+        segment->dictionary = ctx->dictionary;
+        segment->in_length = 0;
+        segment->out_offset = 0;
+        segment->error = ZIP_ER_OK;
+        ctx->current = segment;
+    }
+
+    n = ZIP_MIN(ctx->in.size - ctx->in.pos, segment->in_size - segment->in_length);
+    (void)memcpy_s(segment->in + segment->in_length, segment->in_size - segment->in_length, (const zip_uint8_t *)ctx->in.src + ctx->in.pos, n);
+    segment->in_length += n;
+    ctx->in.pos += n;
+    ctx->in_position += n;
+
+    if (segment->in_length == segment->in_size) {
+        segment->job.run = segment_decompress;
+        segment->job.ud = segment;
+        segment->next = NULL;
+        if (ctx->tail == NULL) {
+            ctx->head = segment;
+        }
+        else {
+            ctx->tail->next = segment;
+        }
+        ctx->tail = segment;
+        ctx->current = NULL;
+        ctx->outstanding++;
+        ctx->next_segment++;
+
+        _zip_thread_pool_submit(ctx->pool, &segment->job);
+    }
+
+    return true;
+}
+
+
+static zip_compression_status_t
+parallel_process(struct ctx *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    zip_uint64_t out_offset = 0;
+    bool all_filled;
+
+    while (out_offset < *length) {
+        struct segment *segment = ctx->head;
+
+        if (segment != NULL && segment->collected) {
+            zip_uint64_t n = ZIP_MIN(*length - out_offset, segment->out_size - segment->out_offset);
+
+            (void)memcpy_s(data + out_offset, *length - out_offset, segment->out + segment->out_offset, n);
+            out_offset += n;
+            segment->out_offset += n;
+            ctx->out_position += n;
+
+            if (segment->out_offset == segment->out_size) {
+                if ((ctx->head = segment->next) == NULL) {
+                    ctx->tail = NULL;
+                }
+                segment_free(segment);
+                if (ctx->max_outstanding < ctx->outstanding_limit) {
+                    ctx->max_outstanding = ZIP_MIN(2 * ctx->max_outstanding, ctx->outstanding_limit);
+                }
+            }
+            continue;
+        }
+
+        all_filled = ctx->next_segment > ctx->npoints;
+
+        if (!all_filled && ctx->outstanding < ctx->max_outstanding && ctx->in.pos < ctx->in.size) {
+            if (!parallel_fill(ctx)) {
+                return ZIP_COMPRESSION_ERROR;
+            }
+            continue;
+        }
+
+        if (segment == NULL) {
+            *length = out_offset;
+            if (all_filled) {
+                return ZIP_COMPRESSION_END;
+            }
+            if (ctx->end_of_input) {
+                /* data ends before last segment */
+                zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+                return ZIP_COMPRESSION_ERROR;
+            }
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (!all_filled && !ctx->end_of_input && ctx->in.pos == ctx->in.size && ctx->outstanding < ctx->max_outstanding) {
+            /* room for more segments, read more input instead of waiting */
+            *length = out_offset;
+            return out_offset > 0 ? ZIP_COMPRESSION_OK : ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        _zip_thread_pool_wait(ctx->pool, &segment->job);
+        segment->collected = true;
+        ctx->outstanding--;
+        if (segment->error != ZIP_ER_OK) {
+            zip_error_set(ctx->error, segment->error, 0);
+            return ZIP_COMPRESSION_ERROR;
+        }
+    }
+
+    return ZIP_COMPRESSION_OK;
+}
+
+
+/* Drop all segments, waiting for running jobs. */
+static void
+parallel_reset(struct ctx *ctx) {
+    while (ctx->head != NULL) {
+        struct segment *segment = ctx->head;
+
+        ctx->head = segment->next;
+        if (!segment->collected) {
+            _zip_thread_pool_wait(ctx->pool, &segment->job);
+        }
+        segment_free(segment);
+    }
+    ctx->tail = NULL;
+    segment_free(ctx->current);
+    ctx->current = NULL;
+    ctx->outstanding = 0;
+}
+
+
+static void
+parallel_start(struct ctx *ctx, zip_stat_t *st) {
+    zip_uint64_t i, segment_max;
+    zip_seek_point_t start, end;
+
+    if (ctx->num_threads <= 1 || ctx->npoints == 0 || (st->valid & (ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE)) != (ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE)) {
+        return;
+    }
+    if (ctx->points[ctx->npoints - 1].uncompressed_offset >= st->size || ctx->points[ctx->npoints - 1].compressed_offset >= st->comp_size) {
+        return;
+    }
+    ctx->uncompressed_size = st->size;
+    ctx->compressed_size = st->comp_size;
+    segment_max = 0;
+    for (i = 0; i <= ctx->npoints; i++) {
+        segment_bounds(ctx, i, &start, &end);
+        if (end.uncompressed_offset - start.uncompressed_offset > PARALLEL_SEGMENT_MAX || end.compressed_offset - start.compressed_offset > PARALLEL_SEGMENT_MAX) {
+            return;
+        }
+        segment_max = ZIP_MAX(segment_max, (end.uncompressed_offset - start.uncompressed_offset) + (end.compressed_offset - start.compressed_offset));
+    }
+    ctx->outstanding_limit = 2 * ctx->num_threads;
+    if (ctx->memory_limit > 0) {
+        /* segments in flight must fit into memory limit */
+        if (segment_max > 0 && ctx->memory_limit / segment_max < ctx->outstanding_limit) {
+            ctx->outstanding_limit = (zip_uint32_t)(ctx->memory_limit / segment_max);
+        }
+        if (ctx->outstanding_limit < 2) {
+            return;
+        }
+    }
+
+    /* decompress in calling thread if pool can't be created */
+    if ((ctx->pool = _zip_thread_pool_new(ctx->num_threads, NULL)) == NULL) {
+        return;
+    }
+    ctx->next_segment = 0;
+    ctx->outstanding = 0;
+    ctx->max_outstanding = ctx->outstanding_limit;
+    ctx->streaming = false;
+}
+
+
+static void
+parallel_end(struct ctx *ctx) {
+    if (ctx->pool == NULL) {
+        return;
+    }
+
+    parallel_reset(ctx);
+    _zip_thread_pool_free(ctx->pool);
+    ctx->pool = NULL;
+}
+#endif
+
+
 static bool
 start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
     struct ctx *ctx = (struct ctx *)ud;
 
-    (void)st;
     (void)attributes;
 
     ctx->in.src = NULL;
@@ -149,25 +925,98 @@ start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
     ctx->out.dst = NULL;
     ctx->out.pos = 0;
     ctx->out.size = 0;
+    ctx->end_of_input = false;
+    ctx->in_position = 0;
+    ctx->out_position = 0;
     if (ctx->compress) {
         size_t ret;
-        ctx->zcstream = ZSTD_createCStream();
+
+        ctx->frame_in = 0;
+        ctx->npoints = 0;
+        _zip_free(ctx->seek_table);
+        ctx->seek_table = NULL;
+
         if (ctx->zcstream == NULL) {
-            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
-            return false;
+            ctx->zcstream = ZSTD_createCStream();
+            if (ctx->zcstream == NULL) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+                return false;
+            }
+        }
+#if ZSTD_VERSION_NUMBER >= 10400
+        else {
+            /* reused, e.g. for another entry: keeps the allocated state, drops the worker settings below */
+            (void)ZSTD_CCtx_reset(ctx->zcstream, ZSTD_reset_session_and_parameters);
         }
+#endif
         ret = ZSTD_initCStream(ctx->zcstream, ctx->compression_flags);
         if (ZSTD_isError(ret)) {
             zip_error_set(ctx->error, ZIP_ER_ZLIB, map_error(ret));
             return false;
         }
+#ifdef HAVE_DICTIONARY
+        if (ctx->dictionary != NULL) {
+            ZSTD_CDict *cdict;
+
+            if ((cdict = dictionary_cdict(ctx->dictionary, ctx->compression_flags)) == NULL) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+                return false;
+            }
+            if (ZSTD_isError(ret = ZSTD_CCtx_refCDict(ctx->zcstream, cdict))) {
+                zip_error_set(ctx->error, map_error(ret), 0);
+                return false;
+            }
+        }
+#endif
+#if ZSTD_VERSION_NUMBER >= 10400
+        if (!set_parameter(ctx, ZSTD_c_windowLog, ctx->parameters.window_log) || !set_parameter(ctx, ZSTD_c_strategy, ctx->parameters.strategy) || !set_parameter(ctx, ZSTD_c_enableLongDistanceMatching, ctx->parameters.long_distance_matching)) {
+            return false;
+        }
+        if ((ctx->num_threads > 0 && ((st->valid & ZIP_STAT_SIZE) == 0 || st->size >= PARALLEL_MIN_SIZE)) || (ctx->rsyncable && !ctx->seekable)) {
+            /* fails if libzstd was built without thread support, compress in calling thread (and not rsyncable) then */
+            if (!ZSTD_isError(ZSTD_CCtx_setParameter(ctx->zcstream, ZSTD_c_nbWorkers, (int)ZIP_MAX(ctx->num_threads, 1)))) {
+                if (ctx->rsyncable && !ctx->seekable) {
+                    /* boundaries are on average a job apart, keep zstd's job size, which doesn't depend on the file size */
+                    (void)ZSTD_CCtx_setParameter(ctx->zcstream, ZSTD_C_RSYNCABLE, 1);
+                }
+                else if ((st->valid & ZIP_STAT_SIZE) && st->size / PARALLEL_JOBS < PARALLEL_JOB_SIZE_MAX) {
+                    (void)ZSTD_CCtx_setParameter(ctx->zcstream, ZSTD_c_jobSize, (int)ZIP_MAX(st->size / PARALLEL_JOBS, PARALLEL_JOB_SIZE_MIN));
+                }
+            }
+        }
+#endif
     }
     else {
-        ctx->zdstream = ZSTD_createDStream();
         if (ctx->zdstream == NULL) {
-            zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+            ctx->zdstream = ZSTD_createDStream();
+            if (ctx->zdstream == NULL) {
+                zip_error_set(ctx->error, ZIP_ER_MEMORY, 0);
+                return false;
+            }
+        }
+        else {
+            size_t ret;
+
+            /* reused, e.g. for another entry: keeps the allocated window */
+#if ZSTD_VERSION_NUMBER >= 10400
+            ret = ZSTD_DCtx_reset(ctx->zdstream, ZSTD_reset_session_and_parameters);
+#else
+            ret = ZSTD_initDStream(ctx->zdstream);
+#endif
+            if (ZSTD_isError(ret)) {
+                zip_error_set(ctx->error, map_error(ret), 0);
+                return false;
+            }
+        }
+#if ZSTD_VERSION_NUMBER >= 10400
+        if (!set_parameter(ctx, ZSTD_d_windowLogMax, window_log_max(ctx))) {
             return false;
         }
+#endif
+        ctx->check_dictionary = ctx->dictionary != NULL;
+#ifdef HAVE_THREADS
+        parallel_start(ctx, st);
+#endif
     }
 
     return true;
@@ -177,21 +1026,15 @@ start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
 static bool
 end(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
-    size_t ret;
-
-    if (ctx->compress) {
-        ret = ZSTD_freeCStream(ctx->zcstream);
-        ctx->zcstream = NULL;
-    }
-    else {
-        ret = ZSTD_freeDStream(ctx->zdstream);
-        ctx->zdstream = NULL;
-    }
 
-    if (ZSTD_isError(ret)) {
-        zip_error_set(ctx->error, map_error(ret), 0);
-        return false;
+    /* streams are freed in deallocate, so start can reuse them */
+#ifdef HAVE_THREADS
+    if (!ctx->compress) {
+        parallel_end(ctx);
     }
+#else
+    (void)ctx;
+#endif
 
     return true;
 }
@@ -219,12 +1062,129 @@ end_of_input(void *ud) {
 }
 
 
+static const zip_seek_point_t *
+seek_points(void *ud, zip_uint64_t *npoints) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t n = ctx->npoints;
+
+    /* frame ending at end of input is not followed by another one */
+    while (n > 0 && ctx->points[n - 1].uncompressed_offset >= ctx->in_position) {
+        n--;
+    }
+    if (n == 0) {
+        return NULL;
+    }
+
+    *npoints = n;
+    return ctx->points;
+}
+
+
+static bool
+add_seek_points(void *ud, const zip_seek_point_t *points, zip_uint64_t npoints) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_uint64_t i;
+
+    if (ctx->npoints > 0) {
+        return false;
+    }
+
+    for (i = 0; i < npoints; i++) {
+        if (points[i].uncompressed_offset == 0) {
+            continue;
+        }
+        if (!point_add(ctx, points[i].uncompressed_offset, points[i].compressed_offset)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool
+seek(void *ud, zip_uint64_t offset, zip_uint64_t *uncompressed_offset, zip_uint64_t *compressed_offset) {
+    struct ctx *ctx = (struct ctx *)ud;
+    zip_seek_point_t *point = NULL;
+    zip_uint64_t low, high;
+    size_t ret;
+
+    /* find last checkpoint at or before offset */
+    low = 0;
+    high = ctx->npoints;
+    while (low < high) {
+        zip_uint64_t mid = low + (high - low) / 2;
+
+        if (ctx->points[mid].uncompressed_offset <= offset) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    if (low > 0) {
+        point = ctx->points + low - 1;
+    }
+
+    ctx->in.src = NULL;
+    ctx->in.pos = 0;
+    ctx->in.size = 0;
+    ctx->end_of_input = false;
+
+#ifdef HAVE_THREADS
+    if (ctx->pool != NULL) {
+        parallel_reset(ctx);
+        ctx->next_segment = low + 1;
+        ctx->max_outstanding = 1;
+        ctx->streaming = true;
+    }
+    else
+#endif
+    {
+        if (ctx->out_position <= offset && (point == NULL || point->uncompressed_offset <= ctx->out_position)) {
+            /* continuing from current position is fastest */
+            *uncompressed_offset = ctx->out_position;
+            *compressed_offset = ctx->in_position;
+            return true;
+        }
+    }
+
+    if (ZSTD_isError(ret = ZSTD_initDStream(ctx->zdstream))) {
+        zip_error_set(ctx->error, map_error(ret), 0);
+        return false;
+    }
+    /* ZSTD_initDStream also drops the dictionary */
+    ctx->check_dictionary = ctx->dictionary != NULL;
+
+    ctx->in_position = point != NULL ? point->compressed_offset : 0;
+    ctx->out_position = point != NULL ? point->uncompressed_offset : 0;
+    *uncompressed_offset = ctx->out_position;
+    *compressed_offset = ctx->in_position;
+    return true;
+}
+
+
+/* Checkpoints describe the data decompressed before, drop them when context is reused. */
+static void
+reset(void *ud) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->npoints = 0;
+}
+
+
 static zip_compression_status_t
 process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
     struct ctx *ctx = (struct ctx *)ud;
-
+    size_t in_pos;
     size_t ret;
 
+#ifdef HAVE_THREADS
+    if (ctx->pool != NULL && !ctx->streaming) {
+        return parallel_process(ctx, data, length);
+    }
+#endif
+
     if (ctx->in.pos == ctx->in.size && !ctx->end_of_input) {
         *length = 0;
         return ZIP_COMPRESSION_NEED_DATA;
@@ -233,20 +1193,60 @@ process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
     ctx->out.dst = data;
     ctx->out.pos = 0;
     ctx->out.size = ZIP_MIN(SIZE_MAX, *length);
+    in_pos = ctx->in.pos;
 
     if (ctx->compress) {
+#ifdef HAVE_SEEKABLE
+        if (ctx->seek_table != NULL) {
+            return seek_table_output(ctx, data, length);
+        }
+#endif
         if (ctx->in.pos == ctx->in.size && ctx->end_of_input) {
-            ret = ZSTD_endStream(ctx->zcstream, &ctx->out);
+            if (ctx->seekable && ctx->frame_in == 0 && ctx->in_position > 0) {
+                /* last frame already ended */
+                ret = 0;
+            }
+            else {
+                ret = ZSTD_endStream(ctx->zcstream, &ctx->out);
+            }
             if (ret == 0) {
+                ctx->out_position += ctx->out.pos;
+#ifdef HAVE_SEEKABLE
+                if (ctx->seekable) {
+                    ctx->in_position += ctx->frame_in;
+                    ctx->frame_in = 0;
+                    if (!seek_table_create(ctx)) {
+                        return ZIP_COMPRESSION_ERROR;
+                    }
+                    return seek_table_output(ctx, data, length);
+                }
+#endif
                 *length = ctx->out.pos;
                 return ZIP_COMPRESSION_END;
             }
         }
+#ifdef HAVE_SEEKABLE
+        else if (ctx->seekable) {
+            ret = compress_frame(ctx);
+        }
+#endif
         else {
             ret = ZSTD_compressStream(ctx->zcstream, &ctx->out, &ctx->in);
         }
     }
     else {
+#ifdef HAVE_DICTIONARY
+        if (ctx->check_dictionary) {
+            const ZSTD_DDict *ddict;
+
+            /* stays referenced for following frames */
+            ctx->check_dictionary = false;
+            if ((ddict = dictionary_ddict(ctx->dictionary, (const zip_uint8_t *)ctx->in.src + ctx->in.pos, ctx->in.size - ctx->in.pos)) != NULL && ZSTD_isError(ret = ZSTD_DCtx_refDDict(ctx->zdstream, ddict))) {
+                zip_error_set(ctx->error, map_error(ret), 0);
+                return ZIP_COMPRESSION_ERROR;
+            }
+        }
+#endif
         ret = ZSTD_decompressStream(ctx->zdstream, &ctx->out, &ctx->in);
     }
     if (ZSTD_isError(ret)) {
@@ -254,6 +1254,25 @@ process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
         return ZIP_COMPRESSION_ERROR;
     }
 
+    if (!ctx->seekable) {
+        /* compress_frame counts input of current frame in frame_in */
+        ctx->in_position += ctx->in.pos - in_pos;
+    }
+    ctx->out_position += ctx->out.pos;
+#ifdef HAVE_THREADS
+    if (ctx->pool != NULL) {
+        /* segment boundaries are known, switch back to parallel decompression at start of next segment */
+        if (ret == 0 && ctx->next_segment <= ctx->npoints && ctx->out_position == ctx->points[ctx->next_segment - 1].uncompressed_offset) {
+            ctx->streaming = false;
+        }
+    }
+    else
+#endif
+    if (!ctx->compress && ret == 0 && ctx->out_position >= (ctx->npoints > 0 ? ctx->points[ctx->npoints - 1].uncompressed_offset : 0) + CHECKPOINT_DISTANCE) {
+        /* frame done, decompression can restart here */
+        (void)point_add(ctx, ctx->out_position, ctx->in_position);
+    }
+
     *length = ctx->out.pos;
     if (ctx->in.pos == ctx->in.size) {
         return ZIP_COMPRESSION_NEED_DATA;
@@ -278,7 +1297,13 @@ zip_compression_algorithm_t zip_algorithm_zstd_compress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    NULL,
+    seek_points,
+    NULL,
+    NULL,
+    NULL,
+    NULL
 };
 
 
@@ -292,7 +1317,13 @@ zip_compression_algorithm_t zip_algorithm_zstd_decompress = {
     end,
     input,
     end_of_input,
-    process
+    process,
+    seek,
+    NULL,
+    add_seek_points,
+    NULL,
+    NULL,
+    reset
 };
 
 /* clang-format on */
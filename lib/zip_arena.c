@@ -0,0 +1,180 @@
+/*
+  zip_arena.c -- allocator for archive metadata that is freed all at once
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+/* Memory is handed out from chunks, which are only freed together with the arena. Chunks are charged to the budget, if any. */
+
+/* only directory entries, strings, and extra fields are allocated from arena, none of which need more than this */
+#define ARENA_ALIGNMENT 8
+#define ARENA_CHUNK_SIZE_MIN (16 * 1024)
+#define ARENA_CHUNK_SIZE_MAX (4 * 1024 * 1024)
+
+typedef struct zip_arena_chunk zip_arena_chunk_t;
+
+struct zip_arena_chunk {
+    zip_arena_chunk_t *next;
+    size_t size; /* usable size of data */
+    size_t used;
+};
+
+/* data of chunk follows header, at offset rounded up to alignment */
+#define CHUNK_HEADER_SIZE ((sizeof(zip_arena_chunk_t) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define CHUNK_DATA(chunk) ((zip_uint8_t *)(chunk) + CHUNK_HEADER_SIZE)
+
+struct zip_arena {
+    zip_arena_chunk_t *chunks; /* first chunk is the one currently allocated from */
+    size_t next_chunk_size;
+    zip_memory_budget_t *budget; /* charged for chunks, may be NULL */
+};
+
+
+void *
+_zip_arena_alloc(zip_arena_t *arena, size_t size, zip_error_t *error) {
+    zip_arena_chunk_t *chunk;
+    size_t chunk_size;
+    void *ptr;
+
+    if (size > SIZE_MAX - CHUNK_HEADER_SIZE - ARENA_ALIGNMENT) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    chunk = arena->chunks;
+    if (chunk != NULL && chunk->size - chunk->used >= size) {
+        ptr = CHUNK_DATA(chunk) + chunk->used;
+        chunk->used += size;
+        return ptr;
+    }
+
+    chunk_size = ZIP_MAX(size, arena->next_chunk_size);
+    if (!_zip_memory_budget_charge(arena->budget, CHUNK_HEADER_SIZE + chunk_size, error)) {
+        return NULL;
+    }
+    if ((chunk = (zip_arena_chunk_t *)_zip_malloc(CHUNK_HEADER_SIZE + chunk_size)) == NULL) {
+        _zip_memory_budget_release(arena->budget, CHUNK_HEADER_SIZE + chunk_size);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    chunk->size = chunk_size;
+    chunk->used = size;
+
+    if (arena->chunks != NULL && chunk_size == size && arena->chunks->size - arena->chunks->used > ARENA_CHUNK_SIZE_MIN) {
+        /* oversized allocation, keep allocating from current chunk */
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    }
+    else {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        if (arena->next_chunk_size < ARENA_CHUNK_SIZE_MAX) {
+            arena->next_chunk_size *= 2;
+        }
+    }
+
+    return CHUNK_DATA(chunk);
+}
+
+
+void
+_zip_arena_free(zip_arena_t *arena) {
+    zip_arena_chunk_t *chunk;
+
+    if (arena == NULL) {
+        return;
+    }
+
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        _zip_memory_budget_release(arena->budget, CHUNK_HEADER_SIZE + chunk->size);
+        _zip_free(chunk);
+    }
+    _zip_free(arena);
+}
+
+
+/* Move chunks of other, which must not have a budget, to arena and free other. Returns false, leaving other unchanged, if the budget of arena is exceeded. */
+
+bool
+_zip_arena_merge(zip_arena_t *arena, zip_arena_t *other, zip_error_t *error) {
+    zip_arena_chunk_t *chunk, *last;
+    zip_uint64_t size;
+
+    if (other->chunks == NULL) {
+        _zip_arena_free(other);
+        return true;
+    }
+
+    size = 0;
+    last = NULL;
+    for (chunk = other->chunks; chunk != NULL; chunk = chunk->next) {
+        size += CHUNK_HEADER_SIZE + chunk->size;
+        last = chunk;
+    }
+    if (!_zip_memory_budget_charge(arena->budget, size, error)) {
+        return false;
+    }
+
+    /* keep allocating from current chunk of arena */
+    if (arena->chunks != NULL) {
+        last->next = arena->chunks->next;
+        arena->chunks->next = other->chunks;
+    }
+    else {
+        arena->chunks = other->chunks;
+    }
+    other->chunks = NULL;
+    _zip_arena_free(other);
+
+    return true;
+}
+
+
+zip_arena_t *
+_zip_arena_new(zip_memory_budget_t *budget, zip_error_t *error) {
+    zip_arena_t *arena;
+
+    if ((arena = (zip_arena_t *)_zip_malloc(sizeof(*arena))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    arena->chunks = NULL;
+    arena->next_chunk_size = ARENA_CHUNK_SIZE_MIN;
+    arena->budget = budget;
+
+    return arena;
+}
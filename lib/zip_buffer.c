@@ -49,10 +49,10 @@ _zip_buffer_free(zip_buffer_t *buffer) {
     }
 
     if (buffer->free_data) {
-        free(buffer->data);
+        _zip_free(buffer->data);
     }
 
-    free(buffer);
+    _zip_free(buffer);
 }
 
 
@@ -161,25 +161,33 @@ _zip_buffer_new(zip_uint8_t *data, zip_uint64_t size) {
 #endif
 
     if (data == NULL) {
-        if ((data = (zip_uint8_t *)malloc((size_t)size)) == NULL) {
+        if ((data = (zip_uint8_t *)_zip_malloc((size_t)size)) == NULL) {
             return NULL;
         }
     }
 
-    if ((buffer = (zip_buffer_t *)malloc(sizeof(*buffer))) == NULL) {
+    if ((buffer = (zip_buffer_t *)_zip_malloc(sizeof(*buffer))) == NULL) {
         if (free_data) {
-            free(data);
+            _zip_free(data);
         }
         return NULL;
     }
 
+    _zip_buffer_init(buffer, data, size);
+    buffer->free_data = free_data;
+
+    return buffer;
+}
+
+
+/* Initialize caller-owned buffer over existing data; not to be passed to _zip_buffer_free. */
+void
+_zip_buffer_init(zip_buffer_t *buffer, zip_uint8_t *data, zip_uint64_t size) {
     buffer->ok = true;
     buffer->data = data;
     buffer->size = size;
     buffer->offset = 0;
-    buffer->free_data = free_data;
-
-    return buffer;
+    buffer->free_data = false;
 }
 
 
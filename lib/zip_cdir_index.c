@@ -0,0 +1,1041 @@
+/*
+  zip_cdir_index.c -- index of central directory entries parsed on demand
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  When an archive is opened with ZIP_LAZY_CDIR, only the fixed part
+  and the file name of each central directory record are looked at.
+  For each entry, the offset of its record and a hash of its name are
+  kept; the full zip_dirent_t is read when the entry is first used.
+
+  Entries whose name can not be used as lookup key as stored (names
+  in CP437, names replaced by a UTF-8 extra field) are parsed
+  immediately, as if the archive had been opened without the flag.
+
+  The index can be stored in a cache file (see zip_open_with_index()),
+  together with a key identifying the central directory it was built
+  from. All values are stored in little endian byte order:
+
+    magic                 8  CACHE_MAGIC
+    archive size          8
+    archive mtime         8
+    cdir offset           8
+    cdir size             8
+    cdir crc              4
+    hash table size       4
+    number of entries     8
+    entries               16 each: offset (8), hash value (4), next (4)
+    hash table            4 each
+    crc of all the above  4
+
+  With ZIP_AFL_EMBED_INDEX, zip_close() stores the index in the same
+  format as data of a stored entry named ZIP_EMBEDDED_INDEX_NAME, which
+  is the last one in the central directory and whose data directly
+  precedes it. Its magic is EMBEDDED_MAGIC, archive size and mtime are
+  0, and the cdir size and crc cover the records of the other entries.
+  The data ends with a trailer to find its start from the central
+  directory offset:
+
+    length of index       8
+    magic                 8  EMBEDDED_MAGIC
+
+  The entry is hidden from users of libzip.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* parameter for the string hash function */
+#define HASH_MULTIPLIER 33
+#define HASH_START 5381
+
+#define INDEX_END ZIP_UINT32_MAX          /* end of hash chain */
+#define INDEX_PARSED (ZIP_UINT32_MAX - 1) /* in next: entry was parsed when opening archive */
+
+/* maximum size of a central directory record without comment */
+#define INDEX_SCRATCH_SIZE (CDENTRYSIZE + 2 * ZIP_UINT16_MAX)
+
+#define CACHE_MAGIC "ZIPIDX\0\1"
+#define CACHE_HEADER_SIZE 56
+#define CACHE_ENTRY_SIZE 16
+
+#define EMBEDDED_MAGIC "ZIPIDX\0\2"
+#define EMBEDDED_TRAILER_SIZE 16
+/* central directory read at once when checking embedded index */
+#define EMBEDDED_CRC_CHUNK_SIZE (1024 * 1024)
+
+struct zip_cdir_index_entry {
+    zip_uint64_t offset;     /* offset of central directory record */
+    zip_uint32_t hash_value; /* hash of file name */
+    zip_uint32_t next;       /* next entry in hash chain, or INDEX_PARSED */
+};
+typedef struct zip_cdir_index_entry zip_cdir_index_entry_t;
+
+struct zip_cdir_index {
+    zip_uint64_t nentry;            /* number of entries */
+    zip_uint64_t nentry_alloc;      /* number of entries allocated */
+    zip_cdir_index_entry_t *entry;  /* entries */
+    zip_uint32_t table_size;        /* size of hash table, power of 2 */
+    zip_uint32_t *table;            /* first entry of each hash chain */
+    zip_buffer_t *scratch;          /* for reading records from source */
+};
+
+static bool cache_decode(zip_buffer_t *buffer, const char *magic, const zip_cdir_index_key_t *key, zip_cdir_index_t **indexp, zip_error_t *error);
+static zip_buffer_t *cache_encode(const zip_cdir_index_t *index, const char *magic, const zip_cdir_index_key_t *key, zip_uint64_t trailer_size);
+static zip_uint64_t cache_size(const zip_cdir_index_t *index);
+static bool embedded_hide(zip_cdir_t *cd, zip_error_t *error);
+static bool embedded_is_index_entry(const zip_dirent_t *de);
+static bool embedded_trailer(zip_cdir_t *cd, zip_source_t *src, zip_uint64_t *lengthp, zip_error_t *error);
+static bool index_install(zip_cdir_index_t *index, zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error);
+static zip_dirent_t *index_read_entry(zip_cdir_index_t *index, zip_uint64_t idx, zip_source_t *src, zip_arena_t *arena, zip_error_t *error);
+static bool index_reserve(zip_cdir_index_t *index, zip_uint64_t nentry, zip_error_t *error);
+static bool is_index_key(const zip_uint8_t *name, zip_uint16_t name_length, zip_uint16_t bitflags, const zip_uint8_t *ef, zip_uint16_t ef_length);
+static zip_uint32_t hash_name(const zip_uint8_t *name, zip_uint64_t length);
+
+
+zip_cdir_index_t *
+_zip_cdir_index_new(zip_uint64_t nentry, zip_error_t *error) {
+    zip_cdir_index_t *index;
+
+    if ((index = (zip_cdir_index_t *)_zip_malloc(sizeof(*index))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    index->nentry = index->nentry_alloc = 0;
+    index->entry = NULL;
+    index->table_size = 0;
+    index->table = NULL;
+    index->scratch = NULL;
+
+    if (!index_reserve(index, nentry, error)) {
+        _zip_cdir_index_free(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+
+void
+_zip_cdir_index_free(zip_cdir_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    _zip_free(index->entry);
+    _zip_free(index->table);
+    _zip_buffer_free(index->scratch);
+    _zip_free(index);
+}
+
+
+/* _zip_cdir_index_add:
+   Index central directory record at OFFSET as entry IDX. The record
+   is read from BUFFER, or from SRC if BUFFER is NULL.
+
+   Returns the size of the record if it was indexed, 0 if the entry has
+   to be parsed instead (the read position is restored in this case),
+   or -1 on error. */
+
+zip_int64_t
+_zip_cdir_index_add(zip_cdir_index_t *index, zip_uint64_t idx, zip_uint64_t offset, zip_source_t *src, zip_buffer_t *buffer, zip_error_t *error) {
+    zip_uint64_t start;
+    zip_uint16_t bitflags, filename_len, ef_len, comment_len;
+    const zip_uint8_t *record, *filename, *ef;
+    bool from_source;
+
+    if (idx >= index->nentry_alloc && !index_reserve(index, idx < 16 ? 16 : idx * 2, error)) {
+        return -1;
+    }
+    index->entry[idx].offset = offset;
+    index->entry[idx].hash_value = 0;
+    index->entry[idx].next = INDEX_PARSED;
+    if (index->nentry <= idx) {
+        index->nentry = idx + 1;
+    }
+
+    if (idx >= INDEX_PARSED) {
+        return 0;
+    }
+
+    from_source = (buffer == NULL);
+    if (from_source) {
+        if (index->scratch == NULL && (index->scratch = _zip_buffer_new(NULL, INDEX_SCRATCH_SIZE)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        buffer = index->scratch;
+        _zip_buffer_set_offset(buffer, 0);
+        if (_zip_read(src, _zip_buffer_data(buffer), CDENTRYSIZE, error) < 0) {
+            return -1;
+        }
+    }
+
+    start = _zip_buffer_offset(buffer);
+
+    if ((record = _zip_buffer_get(buffer, CDENTRYSIZE)) == NULL || memcmp(record, CENTRAL_MAGIC, 4) != 0) {
+        goto parse;
+    }
+
+    bitflags = _zip_get_16(record + 8);
+    filename_len = _zip_get_16(record + 28);
+    ef_len = _zip_get_16(record + 30);
+    comment_len = _zip_get_16(record + 32);
+
+    if (from_source && _zip_read(src, _zip_buffer_data(buffer) + CDENTRYSIZE, (zip_uint64_t)filename_len + ef_len, error) < 0) {
+        return -1;
+    }
+
+    /* an inconsistent record is reported when parsing it */
+    if ((filename = _zip_buffer_get(buffer, filename_len)) == NULL || (ef = _zip_buffer_get(buffer, ef_len)) == NULL) {
+        goto parse;
+    }
+    if (!from_source && _zip_buffer_skip(buffer, comment_len) < 0) {
+        goto parse;
+    }
+
+    if (!is_index_key(filename, filename_len, bitflags, ef, ef_len)) {
+        goto parse;
+    }
+
+    if (from_source && comment_len > 0 && zip_source_seek(src, comment_len, SEEK_CUR) < 0) {
+        zip_error_set_from_source(error, src);
+        return -1;
+    }
+
+    index->entry[idx].hash_value = hash_name(filename, filename_len);
+    index->entry[idx].next = INDEX_END;
+
+    return (zip_int64_t)CDENTRYSIZE + filename_len + ef_len + comment_len;
+
+parse:
+    if (from_source) {
+        if (zip_source_seek(src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(error, src);
+            return -1;
+        }
+    }
+    else {
+        _zip_buffer_set_offset(buffer, start);
+    }
+    return 0;
+}
+
+
+/* _zip_cdir_index_finalize:
+   Called after all entries have been added, sets up name lookup. */
+
+bool
+_zip_cdir_index_finalize(zip_cdir_index_t *index, zip_error_t *error) {
+    zip_uint64_t i, nindexed;
+    zip_uint32_t size;
+
+    _zip_buffer_free(index->scratch);
+    index->scratch = NULL;
+
+    nindexed = 0;
+    for (i = 0; i < index->nentry; i++) {
+        if (index->entry[i].next != INDEX_PARSED) {
+            nindexed++;
+        }
+    }
+
+    if (nindexed == 0) {
+        return true;
+    }
+
+    size = 16;
+    while (size < nindexed && size < 0x80000000ul) {
+        size *= 2;
+    }
+
+    if ((index->table = (zip_uint32_t *)_zip_malloc(sizeof(index->table[0]) * size)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    index->table_size = size;
+    for (i = 0; i < size; i++) {
+        index->table[i] = INDEX_END;
+    }
+
+    /* build chains back to front, so lookups find the first of several entries with the same name */
+    for (i = index->nentry; i > 0; i--) {
+        zip_cdir_index_entry_t *entry = index->entry + i - 1;
+        zip_uint32_t table_index;
+
+        if (entry->next == INDEX_PARSED) {
+            continue;
+        }
+
+        table_index = entry->hash_value & (index->table_size - 1);
+        entry->next = index->table[table_index];
+        index->table[table_index] = (zip_uint32_t)(i - 1);
+    }
+
+    return true;
+}
+
+
+/* _zip_cdir_index_pending:
+   Returns whether entry IDX of ZA has not been read yet. */
+
+bool
+_zip_cdir_index_pending(const zip_t *za, zip_uint64_t idx) {
+    return za->cdir_index != NULL && idx < za->cdir_index->nentry && za->entry[idx].orig == NULL;
+}
+
+
+/* _zip_cdir_index_load:
+   Make sure the original directory entry of entry IDX of ZA has been read.
+   Returns false on error. */
+
+bool
+_zip_cdir_index_load(zip_t *za, zip_uint64_t idx, zip_error_t *error) {
+    zip_dirent_t *de;
+    const zip_uint8_t *name;
+    zip_error_t hash_error;
+
+    if (!_zip_cdir_index_pending(za, idx)) {
+        return true;
+    }
+
+    if (error == NULL) {
+        error = &za->error;
+    }
+
+    if ((de = index_read_entry(za->cdir_index, idx, za->src, za->arena, error)) == NULL) {
+        return false;
+    }
+
+    if ((name = _zip_string_get(de->filename, NULL, 0, error)) == NULL) {
+        _zip_dirent_free(de);
+        return false;
+    }
+
+    /* duplicate names are allowed, as in _zip_open */
+    zip_error_init(&hash_error);
+    if (!_zip_hash_add(za->names, name, idx, ZIP_FL_UNCHANGED, &hash_error) && zip_error_code_zip(&hash_error) != ZIP_ER_EXISTS) {
+        _zip_error_copy(error, &hash_error);
+        zip_error_fini(&hash_error);
+        _zip_dirent_free(de);
+        return false;
+    }
+    zip_error_fini(&hash_error);
+
+    za->entry[idx].orig = de;
+
+    return true;
+}
+
+
+bool
+_zip_cdir_index_load_all(zip_t *za, zip_error_t *error) {
+    zip_uint64_t i;
+
+    if (za->cdir_index == NULL) {
+        return true;
+    }
+
+    for (i = 0; i < za->cdir_index->nentry; i++) {
+        if (!_zip_cdir_index_load(za, i, error)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* _zip_cdir_index_lookup:
+   Find entry named NAME among the entries that have not been read yet. */
+
+zip_int64_t
+_zip_cdir_index_lookup(zip_t *za, const char *name, zip_error_t *error) {
+    zip_cdir_index_t *index = za->cdir_index;
+    zip_uint32_t hash_value, i;
+
+    if (index == NULL || index->table_size == 0) {
+        zip_error_set(error, ZIP_ER_NOENT, 0);
+        return -1;
+    }
+
+    hash_value = hash_name((const zip_uint8_t *)name, strlen(name));
+
+    for (i = index->table[hash_value & (index->table_size - 1)]; i != INDEX_END; i = index->entry[i].next) {
+        const zip_uint8_t *entry_name;
+
+        if (index->entry[i].hash_value != hash_value || za->entry[i].orig != NULL) {
+            continue;
+        }
+
+        if (!_zip_cdir_index_load(za, i, error)) {
+            return -1;
+        }
+
+        if ((entry_name = _zip_string_get(za->entry[i].orig->filename, NULL, 0, error)) == NULL) {
+            return -1;
+        }
+
+        if (strcmp(name, (const char *)entry_name) == 0) {
+            return (zip_int64_t)i;
+        }
+    }
+
+    zip_error_set(error, ZIP_ER_NOENT, 0);
+    return -1;
+}
+
+
+/* _zip_cdir_index_read_all:
+   Read all entries of CD that have not been read yet, for consistency checks while opening. */
+
+bool
+_zip_cdir_index_read_all(zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error) {
+    zip_uint64_t i;
+
+    if (cd->index == NULL) {
+        return true;
+    }
+
+    for (i = 0; i < cd->index->nentry && i < cd->nentry; i++) {
+        if (cd->entry[i].orig == NULL && (cd->entry[i].orig = index_read_entry(cd->index, i, src, arena, error)) == NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static zip_dirent_t *
+index_read_entry(zip_cdir_index_t *index, zip_uint64_t idx, zip_source_t *src, zip_arena_t *arena, zip_error_t *error) {
+    zip_dirent_t *de;
+
+    if (index->entry[idx].offset > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INTERNAL, 0);
+        return NULL;
+    }
+
+    if (zip_source_seek(src, (zip_int64_t)index->entry[idx].offset, SEEK_SET) < 0) {
+        zip_error_set_from_source(error, src);
+        return NULL;
+    }
+
+    if ((de = _zip_dirent_new_arena(arena, error)) == NULL) {
+        return NULL;
+    }
+
+    if (_zip_dirent_read(de, src, NULL, false, arena, error) < 0) {
+        if (zip_error_code_zip(error) == ZIP_ER_INCONS) {
+            zip_error_set(error, ZIP_ER_INCONS, ADD_INDEX_TO_DETAIL(zip_error_code_system(error), idx));
+        }
+        _zip_dirent_free(de);
+        return NULL;
+    }
+
+    return de;
+}
+
+
+static bool
+index_reserve(zip_cdir_index_t *index, zip_uint64_t nentry, zip_error_t *error) {
+    zip_cdir_index_entry_t *entry;
+
+    if (nentry <= index->nentry_alloc) {
+        return true;
+    }
+
+    if (nentry > SIZE_MAX / sizeof(*entry)) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+
+    if ((entry = (zip_cdir_index_entry_t *)_zip_realloc(index->entry, sizeof(*entry) * (size_t)nentry)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+
+    index->entry = entry;
+    index->nentry_alloc = nentry;
+
+    return true;
+}
+
+
+/* Can NAME be used as hash key without converting it? */
+static bool
+is_index_key(const zip_uint8_t *name, zip_uint16_t name_length, zip_uint16_t bitflags, const zip_uint8_t *ef, zip_uint16_t ef_length) {
+    zip_uint16_t i;
+
+    if (name_length == 0) {
+        return false;
+    }
+
+    for (i = 0; i < name_length; i++) {
+        if (name[i] == 0) {
+            return false;
+        }
+        /* names not marked as UTF-8 are converted from CP437 unless they are ASCII, see _zip_guess_encoding() */
+        if ((bitflags & ZIP_GPBF_ENCODING_UTF_8) == 0 && (name[i] >= 0x80 || (name[i] < 0x20 && name[i] != '\t' && name[i] != '\n' && name[i] != '\r'))) {
+            return false;
+        }
+    }
+
+    /* name might be replaced by UTF-8 extra field */
+    i = 0;
+    while (i + 4 <= ef_length) {
+        zip_uint16_t id = (zip_uint16_t)(ef[i] | (ef[i + 1] << 8));
+        zip_uint16_t length = (zip_uint16_t)(ef[i + 2] | (ef[i + 3] << 8));
+
+        if (id == ZIP_EF_UTF_8_NAME) {
+            return false;
+        }
+        if ((zip_uint32_t)i + 4 + length > ef_length) {
+            break;
+        }
+        i = (zip_uint16_t)(i + 4 + length);
+    }
+
+    return true;
+}
+
+
+static zip_uint32_t
+hash_name(const zip_uint8_t *name, zip_uint64_t length) {
+    zip_uint64_t value = HASH_START;
+    zip_uint64_t i;
+
+    for (i = 0; i < length; i++) {
+        value = (zip_uint64_t)(((value * HASH_MULTIPLIER) + name[i]) % 0x100000000ul);
+    }
+
+    return (zip_uint32_t)value;
+}
+
+
+/* _zip_cdir_index_cache_read:
+   Set up index of CD from the cache file PATH, if it exists and was
+   created for the central directory identified by KEY. Entries that
+   are not indexed are read from SRC.
+
+   Returns false on error; if the cache can't be used, the index of CD
+   is left unset. */
+
+bool
+_zip_cdir_index_cache_read(const char *path, const zip_cdir_index_key_t *key, zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error) {
+    zip_source_t *cache;
+    zip_buffer_t *buffer;
+    zip_cdir_index_t *index;
+    zip_error_t cache_error;
+    zip_stat_t st;
+
+    zip_error_init(&cache_error);
+    if ((cache = zip_source_file_create(path, 0, -1, &cache_error)) == NULL) {
+        zip_error_fini(&cache_error);
+        return true;
+    }
+
+    buffer = NULL;
+    if (zip_source_stat(cache, &st) == 0 && (st.valid & ZIP_STAT_SIZE) && st.size >= CACHE_HEADER_SIZE + 4 && zip_source_open(cache) == 0) {
+        buffer = _zip_buffer_new_from_source(cache, st.size, NULL, &cache_error);
+        zip_source_close(cache);
+    }
+    zip_source_free(cache);
+    zip_error_fini(&cache_error);
+
+    if (buffer == NULL) {
+        return true;
+    }
+
+    if (!cache_decode(buffer, CACHE_MAGIC, key, &index, error)) {
+        _zip_buffer_free(buffer);
+        return false;
+    }
+    _zip_buffer_free(buffer);
+    if (index == NULL) {
+        return true;
+    }
+
+    if (index->nentry < cd->nentry || (index->nentry > cd->nentry && (cd->is_zip64 || (index->nentry - cd->nentry) % 0x10000 != 0))) {
+        /* InfoZIP's entry count modulo 0x10000 is the only allowed difference */
+        _zip_cdir_index_free(index);
+        return true;
+    }
+    if (index->nentry > cd->nentry && !_zip_cdir_grow(cd, index->nentry - cd->nentry, error)) {
+        _zip_cdir_index_free(index);
+        return false;
+    }
+
+    return index_install(index, cd, src, arena, error);
+}
+
+
+/* _zip_cdir_index_cache_write:
+   Store INDEX together with KEY in the cache file PATH. Failure is
+   not an error, the index is built again on the next open. */
+
+void
+_zip_cdir_index_cache_write(const zip_cdir_index_t *index, const char *path, const zip_cdir_index_key_t *key) {
+    zip_source_t *cache;
+    zip_buffer_t *buffer;
+    zip_error_t error;
+    zip_uint64_t size;
+
+    if ((buffer = cache_encode(index, CACHE_MAGIC, key, 0)) == NULL) {
+        return;
+    }
+    size = _zip_buffer_size(buffer);
+
+    zip_error_init(&error);
+    if ((cache = zip_source_file_create(path, 0, -1, &error)) != NULL) {
+        if (zip_source_begin_write(cache) == 0) {
+            if (zip_source_write(cache, _zip_buffer_data(buffer), size) != (zip_int64_t)size || zip_source_commit_write(cache) < 0) {
+                zip_source_rollback_write(cache);
+            }
+        }
+        zip_source_free(cache);
+    }
+    zip_error_fini(&error);
+
+    _zip_buffer_free(buffer);
+}
+
+
+/* _zip_cdir_index_embedded_new:
+   Build index of the NENTRY central directory records of SIZE bytes in
+   RECORDS, to be stored as data of an entry at DATA_OFFSET, which the
+   central directory directly follows. Returns the data, or NULL on
+   error or if the records can't be indexed. */
+
+zip_buffer_t *
+_zip_cdir_index_embedded_new(const zip_uint8_t *records, zip_uint64_t size, zip_uint64_t nentry, zip_uint64_t data_offset, zip_error_t *error) {
+    zip_cdir_index_t *index;
+    zip_cdir_index_key_t key;
+    zip_buffer_t *buffer, *data;
+    zip_uint64_t i, length, offset;
+
+    if (nentry == 0 || nentry >= INDEX_PARSED) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+    if ((buffer = _zip_buffer_new((zip_uint8_t *)records, size)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((index = _zip_cdir_index_new(nentry, error)) == NULL) {
+        _zip_buffer_free(buffer);
+        return NULL;
+    }
+
+    /* offsets are relative to the central directory until its position is known */
+    for (i = 0; i < nentry; i++) {
+        zip_int64_t n;
+
+        offset = _zip_buffer_offset(buffer);
+        if ((n = _zip_cdir_index_add(index, i, offset, NULL, buffer, error)) < 0) {
+            _zip_cdir_index_free(index);
+            _zip_buffer_free(buffer);
+            return NULL;
+        }
+        if (n == 0) {
+            /* name is not a lookup key, skip record */
+            const zip_uint8_t *record = _zip_buffer_peek(buffer, CDENTRYSIZE);
+
+            if (record == NULL || _zip_buffer_skip(buffer, CDENTRYSIZE + (zip_uint64_t)_zip_get_16(record + 28) + _zip_get_16(record + 30) + _zip_get_16(record + 32)) < 0) {
+                zip_error_set(error, ZIP_ER_INTERNAL, 0);
+                _zip_cdir_index_free(index);
+                _zip_buffer_free(buffer);
+                return NULL;
+            }
+        }
+    }
+    _zip_buffer_free(buffer);
+
+    if (!_zip_cdir_index_finalize(index, error)) {
+        _zip_cdir_index_free(index);
+        return NULL;
+    }
+
+    length = cache_size(index) + EMBEDDED_TRAILER_SIZE;
+    key.archive_size = 0;
+    key.archive_mtime = 0;
+    key.cdir_offset = data_offset + length;
+    key.cdir_size = size;
+    key.cdir_crc = _zip_crc32(0, records, size);
+    for (i = 0; i < nentry; i++) {
+        index->entry[i].offset += key.cdir_offset;
+    }
+
+    data = cache_encode(index, EMBEDDED_MAGIC, &key, EMBEDDED_TRAILER_SIZE);
+    _zip_cdir_index_free(index);
+    if (data == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    _zip_buffer_put_64(data, length - EMBEDDED_TRAILER_SIZE);
+    _zip_buffer_put(data, EMBEDDED_MAGIC, 8);
+
+    return data;
+}
+
+
+/* _zip_cdir_index_embedded_read:
+   Set up index of CD from the index stored in the archive, see
+   _zip_cdir_index_embedded_new(), and remove the entry containing it
+   from CD.
+
+   Returns false on error; if the archive has no usable index, CD is
+   left unchanged. */
+
+bool
+_zip_cdir_index_embedded_read(zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error) {
+    zip_buffer_t *buffer;
+    zip_cdir_index_t *index;
+    zip_cdir_index_key_t key;
+    zip_dirent_t *de;
+    zip_error_t probe_error;
+    zip_uint64_t length, left;
+    zip_int64_t n;
+    zip_uint8_t *chunk;
+    zip_uint32_t crc;
+    bool usable;
+
+    if (!embedded_trailer(cd, src, &length, error)) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    if (zip_source_seek(src, (zip_int64_t)(cd->offset - EMBEDDED_TRAILER_SIZE - length), SEEK_SET) < 0) {
+        zip_error_set_from_source(error, src);
+        return false;
+    }
+    if ((buffer = _zip_buffer_new_from_source(src, length, NULL, error)) == NULL) {
+        return false;
+    }
+
+    /* key is taken from index, checked against the central directory below */
+    _zip_buffer_set_offset(buffer, 8);
+    key.archive_size = _zip_buffer_get_64(buffer);
+    key.archive_mtime = (zip_int64_t)_zip_buffer_get_64(buffer);
+    key.cdir_offset = _zip_buffer_get_64(buffer);
+    key.cdir_size = _zip_buffer_get_64(buffer);
+    key.cdir_crc = _zip_buffer_get_32(buffer);
+    if (key.cdir_offset != cd->offset || key.cdir_size >= cd->size) {
+        _zip_buffer_free(buffer);
+        return true;
+    }
+
+    /* index covers all records but the last one, which must be the entry containing it */
+    zip_error_init(&probe_error);
+    usable = false;
+    if (zip_source_seek(src, (zip_int64_t)(cd->offset + key.cdir_size), SEEK_SET) == 0 && (de = _zip_dirent_new_arena(arena, &probe_error)) != NULL) {
+        if ((n = _zip_dirent_read(de, src, NULL, false, arena, &probe_error)) >= 0 && (zip_uint64_t)n == cd->size - key.cdir_size) {
+            usable = embedded_is_index_entry(de);
+        }
+        _zip_dirent_free(de);
+    }
+    zip_error_fini(&probe_error);
+    if (!usable) {
+        _zip_buffer_free(buffer);
+        return true;
+    }
+
+    if (zip_source_seek(src, (zip_int64_t)cd->offset, SEEK_SET) < 0) {
+        zip_error_set_from_source(error, src);
+        _zip_buffer_free(buffer);
+        return false;
+    }
+    if ((chunk = (zip_uint8_t *)_zip_malloc((size_t)ZIP_MIN(key.cdir_size, EMBEDDED_CRC_CHUNK_SIZE))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_buffer_free(buffer);
+        return false;
+    }
+    crc = 0;
+    left = key.cdir_size;
+    while (left > 0) {
+        zip_uint64_t length_chunk = ZIP_MIN(left, EMBEDDED_CRC_CHUNK_SIZE);
+
+        if (_zip_read(src, chunk, length_chunk, error) < 0) {
+            _zip_free(chunk);
+            _zip_buffer_free(buffer);
+            return false;
+        }
+        crc = _zip_crc32(crc, chunk, length_chunk);
+        left -= length_chunk;
+    }
+    _zip_free(chunk);
+    if (crc != key.cdir_crc) {
+        _zip_buffer_free(buffer);
+        return true;
+    }
+
+    if (!cache_decode(buffer, EMBEDDED_MAGIC, &key, &index, error)) {
+        _zip_buffer_free(buffer);
+        return false;
+    }
+    _zip_buffer_free(buffer);
+    if (index == NULL) {
+        return true;
+    }
+    if (index->nentry + 1 != cd->nentry) {
+        _zip_cdir_index_free(index);
+        return true;
+    }
+
+    if (!embedded_hide(cd, error)) {
+        _zip_cdir_index_free(index);
+        return false;
+    }
+    return index_install(index, cd, src, arena, error);
+}
+
+
+/* _zip_cdir_index_embedded_drop:
+   Remove the entry containing an embedded index from fully read CD, if it has one. */
+
+bool
+_zip_cdir_index_embedded_drop(zip_cdir_t *cd, zip_source_t *src, zip_error_t *error) {
+    const zip_dirent_t *de;
+    zip_uint64_t length;
+
+    if (cd->nentry == 0 || (de = cd->entry[cd->nentry - 1].orig) == NULL || !embedded_is_index_entry(de)) {
+        return true;
+    }
+
+    if (!embedded_trailer(cd, src, &length, error)) {
+        return false;
+    }
+    if (length > 0) {
+        return embedded_hide(cd, error);
+    }
+
+    return true;
+}
+
+
+/* Check whether DE could be the entry containing the embedded index. */
+static bool
+embedded_is_index_entry(const zip_dirent_t *de) {
+    return de->filename != NULL && de->filename->length == strlen(ZIP_EMBEDDED_INDEX_NAME) && memcmp(de->filename->raw, ZIP_EMBEDDED_INDEX_NAME, de->filename->length) == 0 && de->comp_method == ZIP_CM_STORE;
+}
+
+
+/* Remove last entry of CD, which contains the embedded index. */
+static bool
+embedded_hide(zip_cdir_t *cd, zip_error_t *error) {
+    /* segment including the hidden entry keeps log-structured updates from appending to it */
+    if ((cd->segments = (zip_cdir_segment_t *)_zip_malloc(sizeof(cd->segments[0]))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    cd->segments[0].offset = cd->offset;
+    cd->segments[0].size = cd->size;
+    cd->segments[0].nentry = cd->nentry;
+    cd->nsegments = 1;
+
+    _zip_entry_finalize(cd->entry + cd->nentry - 1);
+    _zip_entry_init(cd->entry + cd->nentry - 1);
+    cd->nentry--;
+    cd->has_embedded_index = true;
+
+    return true;
+}
+
+
+/* Find trailer of embedded index before central directory CD and
+   return the length of the index in *LENGTHP, 0 if there is none.
+   Returns false on error. */
+static bool
+embedded_trailer(zip_cdir_t *cd, zip_source_t *src, zip_uint64_t *lengthp, zip_error_t *error) {
+    zip_uint8_t data[EMBEDDED_TRAILER_SIZE];
+    zip_buffer_t *buffer;
+    zip_uint64_t length;
+
+    *lengthp = 0;
+
+    if (cd->nentry == 0 || cd->offset < EMBEDDED_TRAILER_SIZE + CACHE_HEADER_SIZE + 4 || cd->offset > ZIP_INT64_MAX) {
+        return true;
+    }
+
+    if (zip_source_seek(src, (zip_int64_t)(cd->offset - EMBEDDED_TRAILER_SIZE), SEEK_SET) < 0) {
+        zip_error_set_from_source(error, src);
+        return false;
+    }
+    if ((buffer = _zip_buffer_new_from_source(src, EMBEDDED_TRAILER_SIZE, data, error)) == NULL) {
+        return false;
+    }
+    length = _zip_buffer_get_64(buffer);
+    if (memcmp(_zip_buffer_get(buffer, 8), EMBEDDED_MAGIC, 8) == 0 && length >= CACHE_HEADER_SIZE + 4 && length <= cd->offset - EMBEDDED_TRAILER_SIZE) {
+        *lengthp = length;
+    }
+    _zip_buffer_free(buffer);
+
+    return true;
+}
+
+
+/* Make INDEX the index of CD and read the entries that are not indexed. */
+static bool
+index_install(zip_cdir_index_t *index, zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error) {
+    zip_uint64_t i;
+
+    cd->index = index;
+
+    for (i = 0; i < index->nentry; i++) {
+        if (index->entry[i].next == INDEX_PARSED && (cd->entry[i].orig = index_read_entry(index, i, src, arena, error)) == NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* Size of INDEX encoded by cache_encode(). */
+static zip_uint64_t
+cache_size(const zip_cdir_index_t *index) {
+    return CACHE_HEADER_SIZE + CACHE_ENTRY_SIZE * index->nentry + 4 * (zip_uint64_t)index->table_size + 4;
+}
+
+
+/* Encode INDEX with KEY, leaving TRAILER_SIZE bytes at the end of the returned buffer. */
+static zip_buffer_t *
+cache_encode(const zip_cdir_index_t *index, const char *magic, const zip_cdir_index_key_t *key, zip_uint64_t trailer_size) {
+    zip_buffer_t *buffer;
+    zip_uint64_t i, size;
+
+    if (index->nentry > (ZIP_UINT64_MAX - CACHE_HEADER_SIZE - 4 - trailer_size - 4 * (zip_uint64_t)index->table_size) / CACHE_ENTRY_SIZE) {
+        return NULL;
+    }
+    size = cache_size(index);
+
+    if ((buffer = _zip_buffer_new(NULL, size + trailer_size)) == NULL) {
+        return NULL;
+    }
+
+    _zip_buffer_put(buffer, magic, 8);
+    _zip_buffer_put_64(buffer, key->archive_size);
+    _zip_buffer_put_64(buffer, (zip_uint64_t)key->archive_mtime);
+    _zip_buffer_put_64(buffer, key->cdir_offset);
+    _zip_buffer_put_64(buffer, key->cdir_size);
+    _zip_buffer_put_32(buffer, key->cdir_crc);
+    _zip_buffer_put_32(buffer, index->table_size);
+    _zip_buffer_put_64(buffer, index->nentry);
+    for (i = 0; i < index->nentry; i++) {
+        _zip_buffer_put_64(buffer, index->entry[i].offset);
+        _zip_buffer_put_32(buffer, index->entry[i].hash_value);
+        _zip_buffer_put_32(buffer, index->entry[i].next);
+    }
+    for (i = 0; i < index->table_size; i++) {
+        _zip_buffer_put_32(buffer, index->table[i]);
+    }
+    _zip_buffer_put_32(buffer, _zip_crc32(0, _zip_buffer_data(buffer), size - 4));
+
+    if (!_zip_buffer_ok(buffer)) {
+        _zip_buffer_free(buffer);
+        return NULL;
+    }
+
+    return buffer;
+}
+
+
+/* Decode cache file in BUFFER into *INDEXP, which is set to NULL if
+   the file is invalid or doesn't match MAGIC and KEY. Returns false on error. */
+static bool
+cache_decode(zip_buffer_t *buffer, const char *magic, const zip_cdir_index_key_t *key, zip_cdir_index_t **indexp, zip_error_t *error) {
+    zip_cdir_index_t *index;
+    zip_uint64_t size, nentry, i;
+    zip_uint32_t table_size;
+
+    *indexp = NULL;
+
+    size = _zip_buffer_size(buffer);
+    _zip_buffer_set_offset(buffer, size - 4);
+    if (_zip_buffer_get_32(buffer) != _zip_crc32(0, _zip_buffer_data(buffer), size - 4)) {
+        return true;
+    }
+    _zip_buffer_set_offset(buffer, 0);
+
+    if (memcmp(_zip_buffer_get(buffer, 8), magic, 8) != 0 || _zip_buffer_get_64(buffer) != key->archive_size || _zip_buffer_get_64(buffer) != (zip_uint64_t)key->archive_mtime || _zip_buffer_get_64(buffer) != key->cdir_offset || _zip_buffer_get_64(buffer) != key->cdir_size || _zip_buffer_get_32(buffer) != key->cdir_crc) {
+        return true;
+    }
+
+    table_size = _zip_buffer_get_32(buffer);
+    nentry = _zip_buffer_get_64(buffer);
+
+    if ((table_size != 0 && (table_size < 16 || (table_size & (table_size - 1)) != 0)) || nentry > INDEX_PARSED || nentry > (size - CACHE_HEADER_SIZE - 4) / CACHE_ENTRY_SIZE || size != CACHE_HEADER_SIZE + CACHE_ENTRY_SIZE * nentry + 4 * (zip_uint64_t)table_size + 4) {
+        return true;
+    }
+
+    if ((index = _zip_cdir_index_new(nentry, error)) == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < nentry; i++) {
+        zip_cdir_index_entry_t *entry = index->entry + i;
+
+        entry->offset = _zip_buffer_get_64(buffer);
+        entry->hash_value = _zip_buffer_get_32(buffer);
+        entry->next = _zip_buffer_get_32(buffer);
+        /* hash chains are built back to front, so they can't loop */
+        if (entry->offset < key->cdir_offset || entry->offset >= key->cdir_offset + key->cdir_size || (entry->next != INDEX_END && entry->next != INDEX_PARSED && (entry->next <= i || entry->next >= nentry))) {
+            _zip_cdir_index_free(index);
+            return true;
+        }
+    }
+    index->nentry = nentry;
+
+    if (table_size > 0) {
+        if ((index->table = (zip_uint32_t *)_zip_malloc(sizeof(index->table[0]) * table_size)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            _zip_cdir_index_free(index);
+            return false;
+        }
+        index->table_size = table_size;
+        for (i = 0; i < table_size; i++) {
+            index->table[i] = _zip_buffer_get_32(buffer);
+            if (index->table[i] >= nentry && index->table[i] != INDEX_END) {
+                _zip_cdir_index_free(index);
+                return true;
+            }
+        }
+    }
+
+    *indexp = index;
+    return true;
+}
@@ -0,0 +1,596 @@
+/*
+  zip_checkpoint.c -- continue writing archive after interruption
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* With ZIP_AFL_RESUMABLE, an archive file is written to a file named like it with PARTIAL_SUFFIX appended instead of
+   a temporary file, which is kept if writing fails. Next to it, a checkpoint file records the entries written
+   completely: their names, a fingerprint of what they were written from, and the fields of their directory entries
+   determined by writing them. When the archive is written again with the same changes, the entries in the checkpoint
+   whose fingerprint still matches are taken from the partial file, and writing continues after them.
+
+   The checkpoint is replaced atomically, after the data it describes has been handed to the operating system, so it
+   always describes data in the partial file. This protects against the writing process being interrupted; neither
+   file is synced, so it doesn't protect against a system crash. */
+
+
+#define PARTIAL_SUFFIX "-partial"
+#define CHECKPOINT_SUFFIX "-checkpoint"
+#define CHECKPOINT_MAGIC "LZCHKP01"
+#define CHECKPOINT_MAGIC_LENGTH 8
+#define CHECKPOINT_HEADER_SIZE (CHECKPOINT_MAGIC_LENGTH + 4 + 8 + 8) /* magic, alignment, offset of first entry, number of entries */
+#define CHECKPOINT_ENTRY_SIZE (4 + 8 + 8 + 8 + 8 + 8 + 4 + 4 + 4 + 2 + 2 + 2 + 2 + 2 + 2 + 1) /* after name length and name */
+#define CHECKPOINT_INTERVAL (64 * 1024 * 1024) /* data written between checkpoints */
+
+#define CHECKPOINT_FL_CRC_VALID 0x01u
+#define CHECKPOINT_FL_LAST_MOD_DOS 0x02u
+
+struct zip_checkpoint {
+    zip_source_t *src;          /* archive source, writing to partial */
+    char *name;                 /* of checkpoint file */
+    char *partial;              /* name of partial file */
+    zip_uint32_t *fingerprints; /* one per filelist entry */
+    zip_uint64_t nresumable;    /* number of entries at the start of filelist that can be resumed */
+    zip_uint64_t start;         /* offset of first entry, after archive prefix */
+    zip_uint64_t completed;     /* number of entries written completely */
+    zip_uint64_t end;           /* offset after them */
+    zip_uint64_t saved_end;     /* end of entries recorded in checkpoint file */
+    bool exists;                /* checkpoint file describes data in partial */
+};
+
+/* entry as recorded in checkpoint file */
+typedef struct {
+    zip_uint64_t end; /* offset after entry */
+    zip_dirent_t de;  /* only the fields determined by writing the entry are used */
+} checkpoint_entry_t;
+
+static bool checkpoint_entry_fingerprint(zip_t *za, zip_uint64_t idx, zip_uint32_t *fingerprint);
+static bool checkpoint_entry_read(zip_buffer_t *buffer, const char *name, checkpoint_entry_t *entry, zip_uint32_t *fingerprint);
+static void checkpoint_entry_write(zip_buffer_t *buffer, const char *name, const zip_dirent_t *de, zip_uint64_t end, zip_uint32_t fingerprint);
+static bool checkpoint_partial_size(zip_checkpoint_t *checkpoint, zip_uint64_t *sizep);
+static zip_uint8_t *checkpoint_read(zip_checkpoint_t *checkpoint, zip_uint64_t *lengthp);
+static void checkpoint_remove(zip_checkpoint_t *checkpoint);
+static bool checkpoint_write(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist);
+static char *name_with_suffix(const char *name, const char *suffix);
+
+
+/* Record entries written after the last checkpoint and free checkpoint. If the archive was committed, the checkpoint
+   file is removed, otherwise the partial file is kept if the checkpoint describes any of it. */
+void
+_zip_checkpoint_finish(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist, bool committed) {
+    if (checkpoint == NULL) {
+        return;
+    }
+
+    (void)_zip_source_file_set_output(checkpoint->src, NULL);
+
+    if (committed) {
+        checkpoint_remove(checkpoint);
+    }
+    else {
+        zip_uint64_t size;
+
+        /* rolling back closed the partial file; if that couldn't write out all data, the previous checkpoint still holds */
+        if (checkpoint->end > checkpoint->saved_end && checkpoint_partial_size(checkpoint, &size) && size >= checkpoint->end) {
+            (void)checkpoint_write(checkpoint, za, filelist);
+        }
+        if (!checkpoint->exists) {
+            zip_source_t *src;
+
+            checkpoint_remove(checkpoint);
+            if ((src = zip_source_file_create(checkpoint->partial, 0, ZIP_LENGTH_TO_END, NULL)) != NULL) {
+                (void)zip_source_remove(src);
+                zip_source_free(src);
+            }
+        }
+    }
+
+    _zip_free(checkpoint->fingerprints);
+    _zip_free(checkpoint->name);
+    _zip_free(checkpoint->partial);
+    _zip_free(checkpoint);
+}
+
+
+/* Set up writing archive resumably, to be called before writing begins. Returns NULL if the archive can't be written
+   resumably, e.g. because it is not a file. */
+zip_checkpoint_t *
+_zip_checkpoint_new(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors) {
+    zip_checkpoint_t *checkpoint;
+    const char *fname;
+    zip_uint8_t *data;
+    zip_uint64_t length;
+
+    if (ZIP_WANT_TORRENTZIP(za) || (fname = _zip_source_file_name(za->src)) == NULL) {
+        return NULL;
+    }
+
+    if ((checkpoint = (zip_checkpoint_t *)_zip_malloc(sizeof(*checkpoint))) == NULL) {
+        return NULL;
+    }
+    checkpoint->src = za->src;
+    checkpoint->name = name_with_suffix(fname, CHECKPOINT_SUFFIX);
+    checkpoint->partial = name_with_suffix(fname, PARTIAL_SUFFIX);
+    checkpoint->fingerprints = (zip_uint32_t *)_zip_malloc(sizeof(checkpoint->fingerprints[0]) * (size_t)ZIP_MAX(survivors, 1));
+    checkpoint->nresumable = 0;
+    checkpoint->start = 0;
+    checkpoint->completed = 0;
+    checkpoint->end = 0;
+    checkpoint->saved_end = 0;
+    checkpoint->exists = false;
+
+    if (checkpoint->name == NULL || checkpoint->partial == NULL || checkpoint->fingerprints == NULL || !_zip_source_file_set_output(za->src, checkpoint->partial)) {
+        _zip_free(checkpoint->fingerprints);
+        _zip_free(checkpoint->name);
+        _zip_free(checkpoint->partial);
+        _zip_free(checkpoint);
+        return NULL;
+    }
+
+    /* until it has been checked, a checkpoint left by an earlier attempt might still describe the partial file */
+    if ((data = checkpoint_read(checkpoint, &length)) != NULL) {
+        checkpoint->exists = true;
+        _zip_free(data);
+    }
+
+    /* writing entries that can't be identified across processes, e.g. because they are encrypted with a password
+       only known in memory, can't be resumed; neither can entries after them */
+    while (checkpoint->nresumable < survivors && filelist[checkpoint->nresumable].name != NULL && checkpoint_entry_fingerprint(za, filelist[checkpoint->nresumable].idx, checkpoint->fingerprints + checkpoint->nresumable)) {
+        checkpoint->nresumable++;
+    }
+
+    return checkpoint;
+}
+
+
+/* Take entries written already from the checkpoint, to be called after the archive prefix has been written.
+   Returns the number of entries taken, after which writing continues, or -1 on error. */
+zip_int64_t
+_zip_checkpoint_resume(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist) {
+    checkpoint_entry_t *entries;
+    zip_uint8_t *data;
+    zip_uint64_t length, count, size, k;
+    zip_int64_t offset;
+    zip_buffer_t *buffer;
+
+    if ((offset = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+    checkpoint->start = checkpoint->end = checkpoint->saved_end = (zip_uint64_t)offset;
+
+    if (!checkpoint->exists || (data = checkpoint_read(checkpoint, &length)) == NULL) {
+        checkpoint->exists = false;
+        return 0;
+    }
+
+    k = 0;
+    count = 0;
+    entries = NULL;
+    if ((buffer = _zip_buffer_new(data, length)) != NULL) {
+        zip_uint8_t *magic = _zip_buffer_get(buffer, CHECKPOINT_MAGIC_LENGTH);
+        zip_uint32_t alignment = _zip_buffer_get_32(buffer);
+        zip_uint64_t start = _zip_buffer_get_64(buffer);
+
+        count = _zip_buffer_get_64(buffer);
+        if (!_zip_buffer_ok(buffer) || memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LENGTH) != 0 || alignment != za->alignment || start != checkpoint->start) {
+            count = 0;
+        }
+
+        if (count > 0 && checkpoint->nresumable > 0 && (entries = (checkpoint_entry_t *)_zip_malloc(sizeof(entries[0]) * (size_t)ZIP_MIN(count, checkpoint->nresumable))) != NULL) {
+            for (; k < count && k < checkpoint->nresumable; k++) {
+                zip_uint32_t fingerprint;
+
+                if (!checkpoint_entry_read(buffer, filelist[k].name, entries + k, &fingerprint) || fingerprint != checkpoint->fingerprints[k]) {
+                    break;
+                }
+            }
+        }
+        _zip_buffer_free(buffer);
+    }
+    _zip_free(data);
+
+    if (k > 0) {
+        if (!checkpoint_partial_size(checkpoint, &size)) {
+            size = 0;
+        }
+        /* only entries whose data is in the partial file */
+        while (k > 0 && entries[k - 1].end > size) {
+            k--;
+        }
+    }
+
+    if (k == 0) {
+        /* entries will be written anew, over the data the checkpoint describes */
+        _zip_free(entries);
+        checkpoint_remove(checkpoint);
+        checkpoint->exists = false;
+        return 0;
+    }
+
+    for (count = 0; count < k; count++) {
+        zip_entry_t *entry = za->entry + filelist[count].idx;
+        zip_dirent_t *de;
+
+        if (entry->changes == NULL && (entry->changes = _zip_dirent_clone(entry->orig)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            _zip_free(entries);
+            return -1;
+        }
+        de = entry->changes;
+        de->offset = entries[count].de.offset;
+        de->comp_size = entries[count].de.comp_size;
+        de->uncomp_size = entries[count].de.uncomp_size;
+        de->last_mod = entries[count].de.last_mod;
+        de->crc = entries[count].de.crc;
+        de->comp_method = entries[count].de.comp_method;
+        de->ext_attrib = entries[count].de.ext_attrib;
+        de->version_madeby = entries[count].de.version_madeby;
+        de->version_needed = entries[count].de.version_needed;
+        de->bitflags = entries[count].de.bitflags;
+        de->int_attrib = entries[count].de.int_attrib;
+        de->dos_time = entries[count].de.dos_time;
+        de->dos_date = entries[count].de.dos_date;
+        de->crc_valid = entries[count].de.crc_valid;
+        de->last_mod_dos = entries[count].de.last_mod_dos;
+
+        if (_zip_seek_index_set(za, filelist[count].idx, NULL, 0) < 0) {
+            _zip_free(entries);
+            return -1;
+        }
+    }
+    checkpoint->completed = k;
+    checkpoint->end = entries[k - 1].end;
+    _zip_free(entries);
+
+    if (zip_source_seek_write(za->src, (zip_int64_t)checkpoint->end, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    /* entries after the ones taken are written anew, over the data the checkpoint describes */
+    if (!checkpoint_write(checkpoint, za, filelist)) {
+        checkpoint_remove(checkpoint);
+        checkpoint->exists = false;
+    }
+
+    return (zip_int64_t)k;
+}
+
+
+/* Note that the first completed entries of filelist have been written, and record them in the checkpoint file if
+   enough data was written since the last checkpoint. To be called between writing entries. */
+void
+_zip_checkpoint_update(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist, zip_uint64_t completed) {
+    zip_int64_t offset;
+
+    if (checkpoint == NULL || completed > checkpoint->nresumable || completed <= checkpoint->completed) {
+        return;
+    }
+
+    if ((offset = zip_source_tell_write(za->src)) < 0) {
+        return;
+    }
+    checkpoint->completed = completed;
+    checkpoint->end = (zip_uint64_t)offset;
+
+    if (checkpoint->end - checkpoint->saved_end < CHECKPOINT_INTERVAL) {
+        return;
+    }
+
+    /* seeking hands buffered data to the operating system */
+    if (zip_source_seek_write(za->src, 0, SEEK_CUR) < 0) {
+        return;
+    }
+    (void)checkpoint_write(checkpoint, za, filelist);
+}
+
+
+/* Compute fingerprint of what entry idx is written from. Returns false if the entry can't be identified. */
+static bool
+checkpoint_entry_fingerprint(zip_t *za, zip_uint64_t idx, zip_uint32_t *fingerprint) {
+    zip_entry_t *entry = za->entry + idx;
+    const zip_dirent_t *de = entry->changes != NULL ? entry->changes : entry->orig;
+    zip_uint8_t data[64];
+    zip_buffer_t buffer;
+    zip_uint32_t crc;
+
+    if (de == NULL || de->encryption_method != ZIP_EM_NONE || (de->changed & ZIP_DIRENT_PASSWORD)) {
+        return false;
+    }
+
+    _zip_buffer_init(&buffer, data, sizeof(data));
+    if (ZIP_ENTRY_DATA_CHANGED(entry)) {
+        zip_stat_t st;
+
+        /* like make, trust that a file with the same size and modification time has the same contents */
+        if (zip_source_stat(entry->source, &st) < 0 || (st.valid & (ZIP_STAT_MTIME | ZIP_STAT_CRC)) == 0) {
+            return false;
+        }
+        st.valid &= ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD;
+        _zip_buffer_put_8(&buffer, 'n');
+        _zip_buffer_put_64(&buffer, st.valid);
+        _zip_buffer_put_64(&buffer, (st.valid & ZIP_STAT_SIZE) ? st.size : 0);
+        _zip_buffer_put_64(&buffer, (st.valid & ZIP_STAT_COMP_SIZE) ? st.comp_size : 0);
+        _zip_buffer_put_64(&buffer, (st.valid & ZIP_STAT_MTIME) ? (zip_uint64_t)(zip_int64_t)st.mtime : 0);
+        _zip_buffer_put_32(&buffer, (st.valid & ZIP_STAT_CRC) ? st.crc : 0);
+        _zip_buffer_put_16(&buffer, (st.valid & ZIP_STAT_COMP_METHOD) ? st.comp_method : 0);
+    }
+    else {
+        /* the original archive is only replaced when the checkpoint is removed */
+        _zip_buffer_put_8(&buffer, 'o');
+        _zip_buffer_put_64(&buffer, entry->orig->offset);
+        _zip_buffer_put_64(&buffer, entry->orig->comp_size);
+        _zip_buffer_put_32(&buffer, entry->orig->crc);
+        _zip_buffer_put_16(&buffer, (zip_uint16_t)entry->orig->comp_method);
+    }
+    _zip_buffer_put_32(&buffer, (zip_uint32_t)de->comp_method);
+    _zip_buffer_put_32(&buffer, de->compression_level);
+    _zip_buffer_put_32(&buffer, de->changed);
+    if (!_zip_buffer_ok(&buffer)) {
+        return false;
+    }
+    crc = _zip_crc32(0, data, _zip_buffer_offset(&buffer));
+
+    /* settings that are otherwise taken from the original entry or the source */
+    _zip_buffer_init(&buffer, data, sizeof(data));
+    if (de->changed & ZIP_DIRENT_LAST_MOD) {
+        _zip_buffer_put_64(&buffer, (zip_uint64_t)(zip_int64_t)de->last_mod);
+        _zip_buffer_put_16(&buffer, de->dos_time);
+        _zip_buffer_put_16(&buffer, de->dos_date);
+        _zip_buffer_put_8(&buffer, de->last_mod_dos);
+    }
+    if (de->changed & ZIP_DIRENT_ATTRIBUTES) {
+        _zip_buffer_put_32(&buffer, de->ext_attrib);
+        _zip_buffer_put_16(&buffer, de->version_madeby);
+    }
+    if (de->changed & ZIP_DIRENT_COMPRESSION_PARAMETERS) {
+        _zip_buffer_put_8(&buffer, de->zstd_parameters.window_log);
+        _zip_buffer_put_8(&buffer, de->zstd_parameters.strategy);
+        _zip_buffer_put_8(&buffer, de->zstd_parameters.long_distance_matching);
+    }
+    if (!_zip_buffer_ok(&buffer)) {
+        return false;
+    }
+    crc = _zip_crc32(crc, data, _zip_buffer_offset(&buffer));
+
+    if (de->changed & ZIP_DIRENT_EXTRA_FIELD) {
+        const zip_extra_field_t *ef;
+
+        for (ef = de->extra_fields; ef != NULL; ef = ef->next) {
+            _zip_buffer_init(&buffer, data, sizeof(data));
+            _zip_buffer_put_16(&buffer, ef->id);
+            _zip_buffer_put_16(&buffer, ef->size);
+            _zip_buffer_put_32(&buffer, ef->flags);
+            crc = _zip_crc32(crc, data, _zip_buffer_offset(&buffer));
+            if (ef->size > 0) {
+                crc = _zip_crc32(crc, ef->data, ef->size);
+            }
+        }
+    }
+
+    *fingerprint = crc;
+    return true;
+}
+
+
+/* Read next entry from checkpoint buffer, returns false if it isn't for name. */
+static bool
+checkpoint_entry_read(zip_buffer_t *buffer, const char *name, checkpoint_entry_t *entry, zip_uint32_t *fingerprint) {
+    zip_uint16_t name_length = _zip_buffer_get_16(buffer);
+    const zip_uint8_t *entry_name = _zip_buffer_get(buffer, name_length);
+    zip_uint8_t flags;
+
+    if (entry_name == NULL || name == NULL || strlen(name) != name_length || memcmp(entry_name, name, name_length) != 0) {
+        return false;
+    }
+
+    *fingerprint = _zip_buffer_get_32(buffer);
+    entry->end = _zip_buffer_get_64(buffer);
+    entry->de.offset = _zip_buffer_get_64(buffer);
+    entry->de.comp_size = _zip_buffer_get_64(buffer);
+    entry->de.uncomp_size = _zip_buffer_get_64(buffer);
+    entry->de.last_mod = (time_t)(zip_int64_t)_zip_buffer_get_64(buffer);
+    entry->de.crc = _zip_buffer_get_32(buffer);
+    entry->de.comp_method = (zip_int32_t)_zip_buffer_get_32(buffer);
+    entry->de.ext_attrib = _zip_buffer_get_32(buffer);
+    entry->de.version_madeby = _zip_buffer_get_16(buffer);
+    entry->de.version_needed = _zip_buffer_get_16(buffer);
+    entry->de.bitflags = _zip_buffer_get_16(buffer);
+    entry->de.int_attrib = _zip_buffer_get_16(buffer);
+    entry->de.dos_time = _zip_buffer_get_16(buffer);
+    entry->de.dos_date = _zip_buffer_get_16(buffer);
+    flags = _zip_buffer_get_8(buffer);
+    entry->de.crc_valid = (flags & CHECKPOINT_FL_CRC_VALID) != 0;
+    entry->de.last_mod_dos = (flags & CHECKPOINT_FL_LAST_MOD_DOS) != 0;
+
+    return _zip_buffer_ok(buffer) && entry->de.offset < entry->end;
+}
+
+
+static void
+checkpoint_entry_write(zip_buffer_t *buffer, const char *name, const zip_dirent_t *de, zip_uint64_t end, zip_uint32_t fingerprint) {
+    zip_uint16_t name_length = (zip_uint16_t)strlen(name);
+
+    _zip_buffer_put_16(buffer, name_length);
+    _zip_buffer_put(buffer, name, name_length);
+    _zip_buffer_put_32(buffer, fingerprint);
+    _zip_buffer_put_64(buffer, end);
+    _zip_buffer_put_64(buffer, de->offset);
+    _zip_buffer_put_64(buffer, de->comp_size);
+    _zip_buffer_put_64(buffer, de->uncomp_size);
+    _zip_buffer_put_64(buffer, (zip_uint64_t)(zip_int64_t)de->last_mod);
+    _zip_buffer_put_32(buffer, de->crc);
+    _zip_buffer_put_32(buffer, (zip_uint32_t)de->comp_method);
+    _zip_buffer_put_32(buffer, de->ext_attrib);
+    _zip_buffer_put_16(buffer, de->version_madeby);
+    _zip_buffer_put_16(buffer, de->version_needed);
+    _zip_buffer_put_16(buffer, de->bitflags);
+    _zip_buffer_put_16(buffer, de->int_attrib);
+    _zip_buffer_put_16(buffer, de->dos_time);
+    _zip_buffer_put_16(buffer, de->dos_date);
+    _zip_buffer_put_8(buffer, (de->crc_valid ? CHECKPOINT_FL_CRC_VALID : 0) | (de->last_mod_dos ? CHECKPOINT_FL_LAST_MOD_DOS : 0));
+}
+
+
+static bool
+checkpoint_partial_size(zip_checkpoint_t *checkpoint, zip_uint64_t *sizep) {
+    zip_source_t *src;
+    zip_stat_t st;
+    bool ok;
+
+    if ((src = zip_source_file_create(checkpoint->partial, 0, ZIP_LENGTH_TO_END, NULL)) == NULL) {
+        return false;
+    }
+    ok = zip_source_stat(src, &st) == 0 && (st.valid & ZIP_STAT_SIZE);
+    if (ok) {
+        *sizep = st.size;
+    }
+    zip_source_free(src);
+
+    return ok;
+}
+
+
+/* Read checkpoint file into memory, returns NULL if it doesn't exist or can't be read. */
+static zip_uint8_t *
+checkpoint_read(zip_checkpoint_t *checkpoint, zip_uint64_t *lengthp) {
+    zip_source_t *src;
+    zip_stat_t st;
+    zip_uint8_t *data;
+
+    if ((src = zip_source_file_create(checkpoint->name, 0, ZIP_LENGTH_TO_END, NULL)) == NULL) {
+        return NULL;
+    }
+
+    data = NULL;
+    if (zip_source_stat(src, &st) == 0 && (st.valid & ZIP_STAT_SIZE) && st.size >= CHECKPOINT_HEADER_SIZE && st.size <= SIZE_MAX && zip_source_open(src) == 0) {
+        if ((data = (zip_uint8_t *)_zip_malloc((size_t)st.size)) != NULL && zip_source_read(src, data, st.size) != (zip_int64_t)st.size) {
+            _zip_free(data);
+            data = NULL;
+        }
+        zip_source_close(src);
+    }
+    zip_source_free(src);
+
+    if (data != NULL) {
+        *lengthp = st.size;
+    }
+    return data;
+}
+
+
+static void
+checkpoint_remove(zip_checkpoint_t *checkpoint) {
+    zip_source_t *src;
+
+    if ((src = zip_source_file_create(checkpoint->name, 0, ZIP_LENGTH_TO_END, NULL)) != NULL) {
+        (void)zip_source_remove(src);
+        zip_source_free(src);
+    }
+}
+
+
+/* Replace checkpoint file with one recording the completed entries. */
+static bool
+checkpoint_write(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist) {
+    zip_uint64_t i, length;
+    zip_uint8_t *data;
+    zip_buffer_t *buffer;
+    zip_source_t *src;
+    bool ok;
+
+    length = CHECKPOINT_HEADER_SIZE;
+    for (i = 0; i < checkpoint->completed; i++) {
+        length += 2 + strlen(filelist[i].name) + CHECKPOINT_ENTRY_SIZE;
+    }
+    if (length > SIZE_MAX || (data = (zip_uint8_t *)_zip_malloc((size_t)length)) == NULL) {
+        return false;
+    }
+    if ((buffer = _zip_buffer_new(data, length)) == NULL) {
+        _zip_free(data);
+        return false;
+    }
+
+    _zip_buffer_put(buffer, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LENGTH);
+    _zip_buffer_put_32(buffer, za->alignment);
+    _zip_buffer_put_64(buffer, checkpoint->start);
+    _zip_buffer_put_64(buffer, checkpoint->completed);
+    for (i = 0; i < checkpoint->completed; i++) {
+        zip_uint64_t end = i + 1 < checkpoint->completed ? za->entry[filelist[i + 1].idx].changes->offset : checkpoint->end;
+
+        checkpoint_entry_write(buffer, filelist[i].name, za->entry[filelist[i].idx].changes, end, checkpoint->fingerprints[i]);
+    }
+    ok = _zip_buffer_ok(buffer);
+    _zip_buffer_free(buffer);
+
+    /* written to a temporary file and renamed, so an interruption leaves the previous checkpoint */
+    if (ok && (src = zip_source_file_create(checkpoint->name, 0, ZIP_LENGTH_TO_END, NULL)) != NULL) {
+        if (zip_source_begin_write(src) < 0) {
+            ok = false;
+        }
+        else if (zip_source_write(src, data, length) != (zip_int64_t)length || zip_source_commit_write(src) < 0) {
+            zip_source_rollback_write(src);
+            ok = false;
+        }
+        zip_source_free(src);
+    }
+    else {
+        ok = false;
+    }
+    _zip_free(data);
+
+    if (ok) {
+        checkpoint->exists = true;
+        checkpoint->saved_end = checkpoint->end;
+    }
+    return ok;
+}
+
+
+static char *
+name_with_suffix(const char *name, const char *suffix) {
+    size_t length = strlen(name) + strlen(suffix) + 1;
+    char *result;
+
+    if ((result = (char *)_zip_malloc(length)) == NULL) {
+        return NULL;
+    }
+    snprintf_s(result, length, "%s%s", name, suffix);
+
+    return result;
+}
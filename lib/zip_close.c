@@ -42,29 +42,209 @@
 #endif
 
 
-static int add_data(zip_t *, zip_source_t *, zip_dirent_t *, zip_uint32_t);
+#define COPY_DATA_CHUNK_SIZE (16 * 1024 * 1024) /* maximum data copied by source between progress updates */
+
+/* Whether the data of entry has to be written anew, instead of being copied from the original archive. */
+#define ENTRY_NEEDS_NEW_DATA(za, entry) (ZIP_ENTRY_DATA_CHANGED(entry) || ZIP_ENTRY_CHANGED((entry), ZIP_DIRENT_COMP_METHOD) || ZIP_ENTRY_CHANGED((entry), ZIP_DIRENT_ENCRYPTION_METHOD) || (ZIP_WANT_TORRENTZIP(za) && !ZIP_IS_TORRENTZIP(za)))
+/* Whether the local header and data of entry can be copied verbatim from the original archive. */
+#define ENTRY_IS_COPYABLE(entry) ((entry)->orig != NULL && !entry_has_local_changes(entry) && ((entry)->orig->bitflags & ZIP_GPBF_DATA_DESCRIPTOR) == 0)
+
+#ifdef HAVE_THREADS
+/* data of entry compressed in worker thread */
+struct compress_job {
+    zip_thread_job_t job;
+    zip_source_t *src;                /* source producing data to write */
+    zip_flags_t flags;                /* flags for writing local header */
+    zip_buffer_fragment_t *fragments; /* data read from src */
+    zip_uint64_t nfragments;
+    zip_uint64_t fragments_alloc;
+    zip_stat_t st;                    /* stat of src after reading */
+    zip_file_attributes_t attributes; /* attributes of src after reading */
+    zip_error_t error;
+    int ret;
+    zip_stats_pipeline_t pipeline; /* statistics of reading src */
+
+    /* if src is NULL, the job only derives the WinZip AES key for the entry, which is then written directly */
+    zip_winzip_aes_key_cache_t *key_cache;
+    const char *password;
+    zip_uint16_t encryption_method;
+    bool have_provider;
+    zip_crypto_provider_t provider;
+};
+typedef struct compress_job compress_job_t;
+
+/* jobs for entries in filelist, submitted ahead of writing them */
+struct compress_queue {
+    zip_thread_pool_t *pool;
+    compress_job_t **jobs;        /* one per filelist entry, NULL if entry is written directly */
+    zip_uint64_t next;            /* next filelist entry to consider */
+    zip_uint64_t outstanding;     /* number of jobs submitted but not written yet */
+    zip_uint64_t max_outstanding; /* limit on outstanding jobs, bounds memory usage */
+    zip_reader_t reader;          /* for reading unchanged data in worker threads */
+    bool have_reader;             /* whether reader can be used */
+};
+typedef struct compress_queue compress_queue_t;
+
+#define COMPRESS_JOB_FRAGMENT_SIZE (1024 * 1024)
+/* data copied from other archives is read ahead into memory up to this size, so several of them are read at the same time */
+#define COPY_AHEAD_MAX_SIZE (8 * 1024 * 1024)
+
+/* entries written in calling thread overlap reading, compressing and writing their data if they are at least this big */
+#define PIPELINE_MIN_SIZE (1024 * 1024)
+#define WANT_PIPELINE(za, data_length) ((za)->num_threads > 1 && ((data_length) < 0 || (data_length) >= PIPELINE_MIN_SIZE))
+
+/* writes data in worker thread while next buffer is filled */
+struct write_behind {
+    zip_thread_job_t job;
+    zip_thread_pool_t *pool;
+    zip_t *za;
+    zip_uint8_t *allocated; /* second buffer, the first one is the I/O buffer of the archive */
+    zip_uint8_t *buffer;    /* buffer not used by job */
+    const zip_uint8_t *data;
+    zip_uint64_t length;
+    bool in_flight;
+    int ret;
+    zip_error_t error;
+};
+typedef struct write_behind write_behind_t;
+
+static int add_data_from_job(zip_t *za, compress_queue_t *queue, zip_uint64_t j, zip_uint64_t idx, zip_dirent_t *de, zip_uint32_t changed);
+static void compress_job_free(compress_job_t *job);
+static compress_job_t *compress_job_new(zip_error_t *error);
+static void compress_job_run(void *ud);
+static int compress_queue_add_key_job(zip_t *za, compress_queue_t *queue, zip_entry_t *entry);
+static int compress_queue_fill(zip_t *za, compress_queue_t *queue, const zip_filelist_t *filelist, zip_uint64_t survivors);
+static void compress_queue_fini(compress_queue_t *queue, zip_uint64_t survivors);
+static int compress_queue_init(zip_t *za, compress_queue_t *queue, zip_uint64_t survivors);
+static bool source_is_independent(zip_source_t *src);
+static bool source_reads_archive(zip_source_t *src);
+static bool source_reads_from(zip_source_t *src, zip_source_t *base);
+static int write_behind_finish(zip_t *za, write_behind_t *writer);
+static write_behind_t *write_behind_new(zip_t *za);
+static void write_behind_run(void *ud);
+static int write_behind_write(write_behind_t *writer, zip_uint8_t **bufp, zip_uint64_t length);
+#endif
+
+static int add_data(zip_t *, zip_uint64_t, zip_source_t *, zip_dirent_t *, zip_uint32_t);
+static int add_data_buffered(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, zip_int64_t data_length, zip_stat_t *st, zip_stats_pipeline_t *pipeline);
+static int add_data_duplicate(zip_t *za, zip_uint64_t idx, zip_dirent_t *de, zip_uint32_t changed, const zip_dirent_t *original, const zip_uint8_t *data, zip_uint64_t length);
+static int add_data_entry(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed, zip_stats_pipeline_t *pipeline);
+static int add_data_finish(zip_t *za, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, int is_zip64, zip_int64_t offstart, zip_int64_t offdata, const zip_stat_t *st, zip_file_attributes_t *attributes);
+static int add_data_from_memory(zip_t *za, zip_uint64_t idx, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, const zip_stat_t *st, zip_file_attributes_t *attributes, zip_source_t *src);
+static bool add_data_is_copy(zip_t *za, const zip_dirent_t *de, const zip_stat_t *st);
+static zip_source_t *add_data_pipeline(zip_t *za, zip_source_t *src, zip_dirent_t *de, const zip_stat_t *st, zip_stats_pipeline_t *pipeline, bool stage_encryption);
+static int add_data_pipeline_meter(zip_t *za, zip_source_t **srcp, zip_stats_pipeline_t *pipeline, zip_uint32_t phase);
+static zip_source_t *add_data_pipeline_read_ahead(zip_t *za, zip_source_t *src, zip_dirent_t *de, const zip_stat_t *st, zip_int64_t data_length, zip_stats_pipeline_t *pipeline);
+static int add_data_prepare(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_stat_t *st, zip_flags_t *flagsp, zip_int64_t *data_lengthp);
+static int add_data_streaming(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, zip_int64_t data_length, const zip_stat_t *st, zip_stats_pipeline_t *pipeline);
+static int add_data_update_dirent(zip_t *za, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, zip_uint64_t comp_size, const zip_stat_t *st, zip_file_attributes_t *attributes);
 static int copy_data(zip_t *, zip_uint64_t);
-static int copy_source(zip_t *, zip_source_t *, zip_int64_t);
+static zip_int64_t copy_unchanged_entries(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t j, zip_uint64_t survivors);
+static int copy_source(zip_t *, zip_source_t *, zip_int64_t, const zip_stats_pipeline_t *);
+static int copy_source_to_buffer(zip_t *za, zip_source_t *src, zip_int64_t data_length, const zip_stats_pipeline_t *pipeline, zip_buffer_fragment_t *fragment);
+static bool entry_has_local_changes(const zip_entry_t *entry);
+static bool entry_keeps_alignment(zip_t *za, zip_uint64_t idx, zip_uint64_t offset);
+static zip_flags_t local_header_flags(const zip_t *za, const zip_dirent_t *de);
+static bool entry_local_header_is_patchable(zip_t *za, zip_uint64_t idx);
+static zip_uint64_t estimate_output_size(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset);
+static int prepare_entry(zip_t *za, zip_uint64_t idx);
+static zip_uint64_t progress_size(zip_t *za, zip_uint64_t idx);
+static int patch_local_header(zip_t *za, const zip_entry_t *entry);
+static int progress_subrange(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t j, zip_uint64_t k);
+static int read_local_header_sizes(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset);
 static int torrentzip_compare_names(const void *a, const void *b);
-static int write_cdir(zip_t *, const zip_filelist_t *, zip_uint64_t);
+static int filelist_apply_data_order(zip_t *za, zip_filelist_t *filelist, zip_uint64_t survivors);
+static int filelist_compare_index(const void *a, const void *b);
+static int update_digest(zip_t *za, zip_uint64_t idx, zip_source_t *src);
+static int update_seek_index(zip_t *za, zip_uint64_t idx, zip_source_t *src);
+static int write_cdir(zip_t *, const zip_filelist_t *, zip_uint64_t, bool, zip_cdir_segment_t **, zip_uint64_t *);
+static int write_cdir_embedded_index(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_int64_t *offsetp, zip_int64_t *sizep);
+static bool cdir_segment_appendable(const zip_t *za, zip_uint64_t survivors);
+static int write_changes(zip_t *za, zip_filelist_t **filelistp, zip_uint64_t *survivorsp);
 static int write_data_descriptor(zip_t *za, const zip_dirent_t *dirent, int is_zip64);
+static int write_prefix(zip_t *za);
 
 ZIP_EXTERN int
 zip_close(zip_t *za) {
-    zip_uint64_t i, j, survivors, unchanged_offset;
-    zip_int64_t off;
-    int error;
     zip_filelist_t *filelist;
-    int changed;
 
     if (za == NULL)
         return -1;
 
+    if (_zip_write_changes(za, &filelist, NULL) < 0) {
+        return -1;
+    }
+    _zip_free(filelist);
+
+    zip_discard(za);
+
+    return 0;
+}
+
+
+/* _zip_write_changes:
+   Writes changes to the archive source, or removes it if no entries are left.
+   On success, *filelistp is set to the list of entries in the order they were written, or to NULL if nothing was written, and 0 is returned. */
+
+int
+_zip_write_changes(zip_t *za, zip_filelist_t **filelistp, zip_uint64_t *survivorsp) {
+    zip_uint64_t start, cpu_start, survivors;
+    int ret;
+
+    if (za->stats == NULL) {
+        return write_changes(za, filelistp, survivorsp);
+    }
+
+    start = _zip_stats_time();
+    cpu_start = _zip_stats_cpu_time();
+    ret = write_changes(za, filelistp, &survivors);
+    if (survivorsp) {
+        *survivorsp = survivors;
+    }
+
+    if (ret == 0 && *filelistp != NULL) {
+        za->stats[ZIP_PHASE_CLOSE].wall_time += _zip_stats_time() - start;
+        za->stats[ZIP_PHASE_CLOSE].cpu_time += _zip_stats_cpu_time() - cpu_start;
+        za->stats[ZIP_PHASE_CLOSE].count += survivors;
+        _zip_stats_notify(za, -1);
+    }
+
+    return ret;
+}
+
+
+static int
+write_changes(zip_t *za, zip_filelist_t **filelistp, zip_uint64_t *survivorsp) {
+    zip_uint64_t i, j, survivors, unchanged_offset;
+    zip_int64_t n, off;
+    int error;
+    zip_filelist_t *filelist, *cdir_filelist;
+    int changed;
+    zip_int64_t supported;
+    bool appending, append_segment;
+    zip_checkpoint_t *checkpoint;
+    zip_uint64_t resumed;
+    zip_cdir_segment_t *segments;
+    zip_uint64_t nsegments;
+#ifdef HAVE_THREADS
+    compress_queue_t queue;
+#endif
+
+    *filelistp = NULL;
     changed = _zip_changed(za, &survivors);
+    if (survivorsp) {
+        *survivorsp = survivors;
+    }
+
+    if (ZIP_IS_STREAMING(za) && ZIP_WANT_TORRENTZIP(za) && (changed || survivors > 0)) {
+        /* torrentzip doesn't allow data descriptors */
+        zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
 
     if (survivors == 0 && !(za->ch_flags & ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE)) {
-        /* don't create zip files with no entries */
-        if ((za->open_flags & ZIP_TRUNCATE) || changed) {
+        /* don't create zip files with no entries; when streaming, nothing has been written yet */
+        if (((za->open_flags & ZIP_TRUNCATE) || changed) && !ZIP_IS_STREAMING(za)) {
             if (zip_source_remove(za->src) < 0) {
                 if (!((zip_error_code_zip(zip_source_error(za->src)) == ZIP_ER_REMOVE) && (zip_error_code_system(zip_source_error(za->src)) == ENOENT))) {
                     zip_error_set_from_source(&za->error, za->src);
@@ -72,13 +252,14 @@ zip_close(zip_t *za) {
                 }
             }
         }
-        zip_discard(za);
+        _zip_free(za->cdir_segments);
+        za->cdir_segments = NULL;
+        za->ncdir_segments = 0;
         return 0;
     }
 
     /* Always write empty archive if we are told to keep it, otherwise it wouldn't be created if the file doesn't already exist. */
     if (!changed && survivors > 0) {
-        zip_discard(za);
         return 0;
     }
 
@@ -87,13 +268,17 @@ zip_close(zip_t *za) {
         return -1;
     }
 
-    if ((filelist = (zip_filelist_t *)malloc(sizeof(filelist[0]) * (size_t)survivors)) == NULL)
+    if (!_zip_cdir_index_load_all(za, &za->error)) {
+        return -1;
+    }
+
+    if ((filelist = (zip_filelist_t *)_zip_malloc(sizeof(filelist[0]) * (size_t)survivors)) == NULL)
         return -1;
 
     unchanged_offset = ZIP_UINT64_MAX;
     /* create list of files with index into original archive  */
     for (i = j = 0; i < za->nentry; i++) {
-        if (za->entry[i].orig != NULL && ZIP_ENTRY_HAS_CHANGES(&za->entry[i])) {
+        if (za->entry[i].orig != NULL && entry_has_local_changes(&za->entry[i]) && !entry_local_header_is_patchable(za, i)) {
             unchanged_offset = ZIP_MIN(unchanged_offset, za->entry[i].orig->offset);
         }
         if (za->entry[i].deleted) {
@@ -101,17 +286,18 @@ zip_close(zip_t *za) {
         }
 
         if (j >= survivors) {
-            free(filelist);
+            _zip_free(filelist);
             zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
             return -1;
         }
 
         filelist[j].idx = i;
         filelist[j].name = zip_get_name(za, i, 0);
+        filelist[j].progress_end = 0;
         j++;
     }
     if (j < survivors) {
-        free(filelist);
+        _zip_free(filelist);
         zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
         return -1;
     }
@@ -119,8 +305,22 @@ zip_close(zip_t *za) {
     if (ZIP_WANT_TORRENTZIP(za)) {
         qsort(filelist, (size_t)survivors, sizeof(filelist[0]), torrentzip_compare_names);
     }
+    else if (za->data_order != NULL && filelist_apply_data_order(za, filelist, survivors) < 0) {
+        _zip_free(filelist);
+        return -1;
+    }
+
+    if (za->progress != NULL) {
+        /* weight progress of entries by the data they process, so big files get their share */
+        for (j = 0; j < survivors; j++) {
+            filelist[j].progress_end = (j > 0 ? filelist[j - 1].progress_end : 0) + progress_size(za, filelist[j].idx);
+        }
+    }
 
-    if (ZIP_WANT_TORRENTZIP(za) || (zip_source_supports(za->src) & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE_CLONING)) == 0) {
+    supported = zip_source_supports(za->src);
+    appending = false;
+    append_segment = false;
+    if (ZIP_WANT_TORRENTZIP(za) || za->data_order != NULL || za->prefix_changed || za->alignment != za->alignment_orig || (supported & (ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE_CLONING) | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE_IN_PLACE))) == 0) {
         unchanged_offset = 0;
     }
     else {
@@ -128,6 +328,8 @@ zip_close(zip_t *za) {
             /* we're keeping all file data, find the end of the last one */
             zip_uint64_t last_index = ZIP_UINT64_MAX;
             unchanged_offset = 0;
+            /* only new entries are written after it, so data after it is not read while writing */
+            appending = true;
 
             for (i = 0; i < za->nentry; i++) {
                 if (za->entry[i].orig != NULL) {
@@ -139,40 +341,117 @@ zip_close(zip_t *za) {
             }
             if (last_index != ZIP_UINT64_MAX) {
                 if ((unchanged_offset = _zip_file_get_end(za, last_index, &za->error)) == 0) {
-                    free(filelist);
+                    _zip_free(filelist);
                     return -1;
                 }
             }
         }
+        if (appending && cdir_segment_appendable(za, survivors)) {
+            /* keep central directory, new entries and a segment listing them follow it */
+            unchanged_offset = za->cdir_segments[za->ncdir_segments - 1].offset + za->cdir_segments[za->ncdir_segments - 1].size;
+            append_segment = true;
+        }
+        else if (za->ncdir_segments > 1) {
+            /* compact log-structured central directory, everything after its first segment is written anew */
+            unchanged_offset = ZIP_MIN(unchanged_offset, za->cdir_segments[0].offset);
+            appending = false;
+        }
         if (unchanged_offset > 0) {
-            if (zip_source_begin_write_cloning(za->src, unchanged_offset) < 0) {
-                /* cloning not supported, need to copy everything */
+            /* cloning leaves the original intact until commit, so prefer it */
+            if (!(ZIP_SOURCE_CHECK_SUPPORTED(supported, ZIP_SOURCE_BEGIN_WRITE_CLONING) && zip_source_begin_write_cloning(za->src, unchanged_offset) == 0) && !(appending && ZIP_SOURCE_CHECK_SUPPORTED(supported, ZIP_SOURCE_BEGIN_WRITE_IN_PLACE) && _zip_source_begin_write_in_place(za->src, unchanged_offset) == 0)) {
+                /* neither cloning nor writing in place possible, need to copy everything */
                 unchanged_offset = 0;
             }
         }
     }
+    checkpoint = NULL;
+    resumed = 0;
     if (unchanged_offset == 0) {
+        append_segment = false;
+        if ((za->ch_flags & ZIP_AFL_RESUMABLE) && !ZIP_IS_STREAMING(za)) {
+            checkpoint = _zip_checkpoint_new(za, filelist, survivors);
+        }
         if (zip_source_begin_write(za->src) < 0) {
             zip_error_set_from_source(&za->error, za->src);
-            free(filelist);
+            _zip_checkpoint_finish(checkpoint, za, filelist, false);
+            _zip_free(filelist);
             return -1;
         }
+        if (write_prefix(za) < 0) {
+            zip_source_rollback_write(za->src);
+            _zip_checkpoint_finish(checkpoint, za, filelist, false);
+            _zip_free(filelist);
+            return -1;
+        }
+        if (checkpoint != NULL) {
+            /* continue after entries written by an earlier attempt */
+            if ((n = _zip_checkpoint_resume(checkpoint, za, filelist)) < 0) {
+                zip_source_rollback_write(za->src);
+                _zip_checkpoint_finish(checkpoint, za, filelist, false);
+                _zip_free(filelist);
+                return -1;
+            }
+            resumed = (zip_uint64_t)n;
+        }
+    }
+
+    if (read_local_header_sizes(za, filelist, survivors, unchanged_offset) < 0) {
+        zip_source_rollback_write(za->src);
+        _zip_checkpoint_finish(checkpoint, za, filelist, false);
+        _zip_free(filelist);
+        return -1;
     }
 
-    if (_zip_progress_start(za->progress) != 0) {
+    /* avoid growing the output in small steps; a partial file kept for resuming is not cut to the data written */
+    if (checkpoint == NULL) {
+        _zip_source_file_preallocate(za->src, unchanged_offset, estimate_output_size(za, filelist, survivors, unchanged_offset));
+    }
+
+    if (_zip_progress_start(za->progress, survivors > 0 ? filelist[survivors - 1].progress_end : 0) != 0) {
         zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
         zip_source_rollback_write(za->src);
-        free(filelist);
+        _zip_checkpoint_finish(checkpoint, za, filelist, false);
+        _zip_free(filelist);
+        return -1;
+    }
+    if ((za->ch_flags & ZIP_AFL_DEDUPLICATE) && !ZIP_IS_STREAMING(za) && _zip_dedup_find(za, filelist, survivors) < 0) {
+        zip_source_rollback_write(za->src);
+        _zip_checkpoint_finish(checkpoint, za, filelist, false);
+        _zip_free(filelist);
+        return -1;
+    }
+#ifdef HAVE_THREADS
+    if (compress_queue_init(za, &queue, survivors) < 0) {
+        _zip_dedup_free(za->dedup);
+        za->dedup = NULL;
+        zip_source_rollback_write(za->src);
+        _zip_checkpoint_finish(checkpoint, za, filelist, false);
+        _zip_free(filelist);
         return -1;
     }
+    queue.next = resumed;
+#endif
+    /* enough for the contexts of outstanding compression jobs; without a cache, every entry allocates its own */
+    za->compression_cache = _zip_compression_cache_new(ZIP_MIN(za->num_threads, ZIP_COMPRESSION_FLAGS_MAX_THREADS) * 2 + 2);
     error = 0;
-    for (j = 0; j < survivors; j++) {
+    if (resumed > 0) {
+        /* entries taken from the checkpoint are done */
+        if (progress_subrange(za, filelist, 0, resumed) < 0) {
+            error = 1;
+        }
+        else if (_zip_progress_update(za->progress, 1.0) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            error = 1;
+        }
+    }
+    for (j = resumed; j < survivors && !error; j++) {
         int new_data;
         zip_entry_t *entry;
         zip_dirent_t *de;
 
-        if (_zip_progress_subrange(za->progress, (double)j / (double)survivors, (double)(j + 1) / (double)survivors) != 0) {
-            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+        _zip_checkpoint_update(checkpoint, za, filelist, j);
+
+        if (progress_subrange(za, filelist, j, j + 1) < 0) {
             error = 1;
             break;
         }
@@ -181,30 +460,37 @@ zip_close(zip_t *za) {
         entry = za->entry + i;
 
         if (entry->orig != NULL && entry->orig->offset < unchanged_offset) {
-            /* already implicitly copied by cloning */
-            continue;
-        }
-
-        new_data = (ZIP_ENTRY_DATA_CHANGED(entry) || ZIP_ENTRY_CHANGED(entry, ZIP_DIRENT_COMP_METHOD) || ZIP_ENTRY_CHANGED(entry, ZIP_DIRENT_ENCRYPTION_METHOD)) || (ZIP_WANT_TORRENTZIP(za) && !ZIP_IS_TORRENTZIP(za));
-
-        /* create new local directory entry */
-        if (entry->changes == NULL) {
-            if ((entry->changes = _zip_dirent_clone(entry->orig)) == NULL) {
-                zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            /* already implicitly copied by cloning, only changes to the local header are left */
+            if (entry_has_local_changes(entry) && patch_local_header(za, entry) < 0) {
                 error = 1;
                 break;
             }
+            continue;
         }
-        de = entry->changes;
 
-        if (_zip_read_local_ef(za, i) < 0) {
+#ifdef HAVE_THREADS
+        if (compress_queue_fill(za, &queue, filelist, survivors) < 0) {
+            error = 1;
+            break;
+        }
+#endif
+
+        if ((n = copy_unchanged_entries(za, filelist, j, survivors)) < 0) {
             error = 1;
             break;
         }
+        if (n > 0) {
+            j += (zip_uint64_t)n - 1;
+            continue;
+        }
 
-        if (ZIP_WANT_TORRENTZIP(za)) {
-            zip_dirent_torrentzip_normalize(entry->changes);
+        new_data = ENTRY_NEEDS_NEW_DATA(za, entry);
+
+        if (prepare_entry(za, i) < 0) {
+            error = 1;
+            break;
         }
+        de = entry->changes;
 
         if ((off = zip_source_tell_write(za->src)) < 0) {
             zip_error_set_from_source(&za->error, za->src);
@@ -215,6 +501,45 @@ zip_close(zip_t *za) {
 
         if (new_data) {
             zip_source_t *zs;
+            zip_uint64_t original;
+
+            if ((original = _zip_dedup_original(za->dedup, i)) != ZIP_UINT64_MAX) {
+                const zip_uint8_t *data;
+                zip_uint64_t length;
+
+                /* same data as an entry written before, write its compressed data again */
+                data = _zip_dedup_data(za->dedup, original, &length);
+                if (data != NULL && length == za->entry[original].changes->comp_size) {
+                    int ret = add_data_duplicate(za, i, de, entry->changes->changed, za->entry[original].changes, data, length);
+
+                    _zip_dedup_release(za->dedup, i);
+                    if (ret < 0) {
+                        error = 1;
+                        break;
+                    }
+                    continue;
+                }
+                _zip_dedup_release(za->dedup, i);
+            }
+
+#ifdef HAVE_THREADS
+            if (queue.jobs != NULL && queue.jobs[j] != NULL) {
+                if (queue.jobs[j]->src == NULL) {
+                    /* key was derived ahead, data is written directly */
+                    _zip_thread_pool_wait(queue.pool, &queue.jobs[j]->job);
+                    compress_job_free(queue.jobs[j]);
+                    queue.jobs[j] = NULL;
+                    queue.outstanding--;
+                }
+                else {
+                    if (add_data_from_job(za, &queue, j, i, de, entry->changes->changed) < 0) {
+                        error = 1;
+                        break;
+                    }
+                    continue;
+                }
+            }
+#endif
 
             zs = NULL;
             if (!ZIP_ENTRY_DATA_CHANGED(entry)) {
@@ -225,7 +550,7 @@ zip_close(zip_t *za) {
             }
 
             /* add_data writes dirent */
-            if (add_data(za, zs ? zs : entry->source, de, entry->changes ? entry->changes->changed : 0) < 0) {
+            if (add_data(za, i, zs ? zs : entry->source, de, entry->changes ? entry->changes->changed : 0) < 0) {
                 error = 1;
                 if (zs)
                     zip_source_free(zs);
@@ -242,7 +567,7 @@ zip_close(zip_t *za) {
                 /* except for PKWare encryption, where removing the data descriptor breaks password validation */
                 de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
             }
-            if (_zip_dirent_write(za, de, ZIP_FL_LOCAL) < 0) {
+            if (_zip_dirent_write(za, de, local_header_flags(za, de)) < 0) {
                 error = 1;
                 break;
             }
@@ -270,11 +595,44 @@ zip_close(zip_t *za) {
     }
 
     if (!error) {
-        if (write_cdir(za, filelist, survivors) < 0)
+        _zip_checkpoint_update(checkpoint, za, filelist, survivors);
+    }
+
+#ifdef HAVE_THREADS
+    compress_queue_fini(&queue, survivors);
+#endif
+    _zip_compression_cache_free(za->compression_cache);
+    za->compression_cache = NULL;
+    _zip_dedup_free(za->dedup);
+    za->dedup = NULL;
+
+    segments = NULL;
+    nsegments = 0;
+    cdir_filelist = filelist;
+    if (!error && za->data_order != NULL && !ZIP_WANT_TORRENTZIP(za)) {
+        /* central directory lists entries in index order, independent of data order */
+        if ((cdir_filelist = (zip_filelist_t *)_zip_memdup(filelist, sizeof(filelist[0]) * (size_t)survivors, &za->error)) == NULL) {
+            cdir_filelist = filelist;
+            error = 1;
+        }
+        else {
+            qsort(cdir_filelist, (size_t)survivors, sizeof(cdir_filelist[0]), filelist_compare_index);
+        }
+    }
+    if (!error) {
+        if (write_cdir(za, cdir_filelist, survivors, append_segment, &segments, &nsegments) < 0)
             error = 1;
     }
 
-    free(filelist);
+    if (!error && za->stats != NULL) {
+        if ((off = zip_source_tell_write(za->src)) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            error = 1;
+        }
+        else {
+            za->stats[ZIP_PHASE_CLOSE].bytes_out += (zip_uint64_t)off;
+        }
+    }
 
     if (!error) {
         if (zip_source_commit_write(za->src) != 0) {
@@ -286,90 +644,131 @@ zip_close(zip_t *za) {
 
     if (error) {
         zip_source_rollback_write(za->src);
+        _zip_checkpoint_finish(checkpoint, za, filelist, false);
+        _zip_free(segments);
+        if (cdir_filelist != filelist) {
+            _zip_free(cdir_filelist);
+        }
+        _zip_free(filelist);
         return -1;
     }
+    _zip_checkpoint_finish(checkpoint, za, filelist, true);
+    if (cdir_filelist != filelist) {
+        _zip_free(filelist);
+        filelist = cdir_filelist;
+    }
 
-    zip_discard(za);
+    _zip_free(za->cdir_segments);
+    za->cdir_segments = segments;
+    za->ncdir_segments = nsegments;
+
+    *filelistp = filelist;
 
     return 0;
 }
 
 
 static int
-add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed) {
-    zip_int64_t offstart, offdata, offend, data_length;
+add_data(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed) {
+    zip_stats_pipeline_t pipeline;
+    int ret;
+
+    if (za->stats == NULL) {
+        return add_data_entry(za, idx, src, de, changed, NULL);
+    }
+
+    _zip_stats_pipeline_init(&pipeline);
+    ret = add_data_entry(za, idx, src, de, changed, &pipeline);
+    _zip_stats_pipeline_merge(za, &pipeline);
+    if (ret == 0) {
+        _zip_stats_notify(za, (zip_int64_t)idx);
+    }
+
+    return ret;
+}
+
+
+/* Write entry with the same data as original, whose compressed data is data. */
+static int
+add_data_duplicate(zip_t *za, zip_uint64_t idx, zip_dirent_t *de, zip_uint32_t changed, const zip_dirent_t *original, const zip_uint8_t *data, zip_uint64_t length) {
     zip_stat_t st;
     zip_file_attributes_t attributes;
-    zip_source_t *src_final, *src_tmp;
+    zip_source_t *src = za->entry[idx].source;
+    zip_uint8_t digest[ZIP_DIGEST_LENGTH];
     int ret;
-    int is_zip64;
-    zip_flags_t flags;
-    bool needs_recompress, needs_decompress, needs_crc, needs_compress, needs_reencrypt, needs_decrypt, needs_encrypt;
 
     if (zip_source_stat(src, &st) < 0) {
         zip_error_set_from_source(&za->error, src);
         return -1;
     }
-
-    if ((st.valid & ZIP_STAT_COMP_METHOD) == 0) {
-        st.valid |= ZIP_STAT_COMP_METHOD;
-        st.comp_method = ZIP_CM_STORE;
+    if (zip_source_get_file_attributes(src, &attributes) != 0) {
+        zip_error_set_from_source(&za->error, src);
+        return -1;
     }
 
-    if (ZIP_CM_IS_DEFAULT(de->comp_method) && st.comp_method != ZIP_CM_STORE)
-        de->comp_method = st.comp_method;
-    else if (de->comp_method == ZIP_CM_STORE && (st.valid & ZIP_STAT_SIZE)) {
-        st.valid |= ZIP_STAT_COMP_SIZE;
-        st.comp_size = st.size;
+    st.valid |= ZIP_STAT_SIZE | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD;
+    st.size = original->uncomp_size;
+    st.crc = original->crc;
+    st.comp_method = original->comp_method;
+    /* as set by the compression layer for original */
+    attributes.valid |= ZIP_FILE_ATTRIBUTES_VERSION_NEEDED | ZIP_FILE_ATTRIBUTES_GENERAL_PURPOSE_BIT_FLAGS;
+    attributes.version_needed = original->version_needed;
+    attributes.general_purpose_bit_mask = ZIP_FILE_ATTRIBUTES_GENERAL_PURPOSE_BIT_FLAGS_ALLOWED_MASK & ~ZIP_GPBF_DATA_DESCRIPTOR;
+    attributes.general_purpose_bit_flags = original->bitflags & attributes.general_purpose_bit_mask;
+
+    de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
+    if (add_data_update_dirent(za, de, changed, ZIP_EF_LOCAL, length, &st, &attributes) < 0) {
+        return -1;
+    }
+    if (_zip_dirent_write(za, de, local_header_flags(za, de)) < 0) {
+        return -1;
+    }
+    if (_zip_write(za, data, length) < 0) {
+        return -1;
+    }
+    if (_zip_progress_update(za->progress, 1.0) != 0) {
+        zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+        return -1;
+    }
+    if (_zip_seek_index_set(za, idx, NULL, 0) < 0) {
+        return -1;
+    }
+    if ((za->ch_flags & ZIP_AFL_DIGEST) && de->encryption_method == ZIP_EM_NONE && _zip_digest_get(original, digest)) {
+        ret = _zip_digest_set(za, idx, digest);
     }
     else {
-        /* we'll recompress */
-        st.valid &= ~ZIP_STAT_COMP_SIZE;
+        ret = _zip_digest_set(za, idx, NULL);
     }
-
-    if ((st.valid & ZIP_STAT_ENCRYPTION_METHOD) == 0) {
-        st.valid |= ZIP_STAT_ENCRYPTION_METHOD;
-        st.encryption_method = ZIP_EM_NONE;
+    if (ret < 0) {
+        return -1;
     }
+    _zip_stats_notify(za, (zip_int64_t)idx);
 
-    flags = ZIP_EF_LOCAL;
+    return 0;
+}
 
-    if ((st.valid & ZIP_STAT_SIZE) == 0) {
-        /* TODO: not valid for torrentzip */
-        flags |= ZIP_FL_FORCE_ZIP64;
-        data_length = -1;
-    }
-    else {
-        de->uncomp_size = st.size;
-        /* this is technically incorrect (copy_source counts compressed data), but it's the best we have */
-        data_length = (zip_int64_t)st.size;
 
-        if ((st.valid & ZIP_STAT_COMP_SIZE) == 0) {
-            zip_uint64_t max_compressed_size;
-            zip_uint16_t compression_method = ZIP_CM_ACTUAL(de->comp_method);
+/* Write entry with new data, pipeline collects statistics if not NULL. */
+static int
+add_data_entry(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed, zip_stats_pipeline_t *pipeline) {
+    zip_int64_t offstart, offdata, data_length;
+    zip_stat_t st;
+    zip_file_attributes_t attributes;
+    zip_source_t *src_final;
+    int ret;
+    int is_zip64;
+    bool early_store;
+    zip_flags_t flags;
 
-            if (compression_method == ZIP_CM_STORE) {
-                max_compressed_size = st.size;
-            }
-            else {
-                zip_compression_algorithm_t *algorithm = _zip_get_compression_algorithm(compression_method, true);
-                if (algorithm == NULL) {
-                    max_compressed_size = ZIP_UINT64_MAX;
-                }
-                else {
-                    max_compressed_size = algorithm->maximum_compressed_size(st.size);
-                }
-            }
+    if (add_data_prepare(za, src, de, &st, &flags, &data_length) < 0) {
+        return -1;
+    }
 
-            if (max_compressed_size > 0xffffffffu) {
-                /* TODO: not valid for torrentzip */
-                flags |= ZIP_FL_FORCE_ZIP64;
-            }
-        }
-        else {
-            de->comp_size = st.comp_size;
-            data_length = (zip_int64_t)st.comp_size;
-        }
+    if (ZIP_IS_STREAMING(za)) {
+        return add_data_streaming(za, idx, src, de, changed, flags, data_length, &st, pipeline);
+    }
+    if (data_length >= 0 && (zip_uint64_t)data_length <= za->buffered_entry_size) {
+        return add_data_buffered(za, idx, src, de, changed, flags, data_length, &st, pipeline);
     }
 
     if ((offstart = zip_source_tell_write(za->src)) < 0) {
@@ -377,319 +776,2083 @@ add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed) {
         return -1;
     }
 
-    /* as long as we don't support non-seekable output, clear data descriptor bit */
-    de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
+    /* sizes and CRC are filled in by rewriting the local header, so no data descriptor is needed,
+       except for copied PKWare encrypted data, where it determines how the password is verified */
+    if (!(st.encryption_method == ZIP_EM_TRAD_PKWARE && de->encryption_method == ZIP_EM_TRAD_PKWARE && (de->changed & ZIP_DIRENT_PASSWORD) == 0)) {
+        de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
+    }
     if ((is_zip64 = _zip_dirent_write(za, de, flags)) < 0) {
         return -1;
     }
 
-    needs_recompress = ZIP_WANT_TORRENTZIP(za) || st.comp_method != ZIP_CM_ACTUAL(de->comp_method);
-    needs_decompress = needs_recompress && (st.comp_method != ZIP_CM_STORE);
-    /* in these cases we can compute the CRC ourselves, so we do */
-    needs_crc = (st.comp_method == ZIP_CM_STORE) || needs_decompress;
-    needs_compress = needs_recompress && (de->comp_method != ZIP_CM_STORE);
-
-    needs_reencrypt = needs_recompress || (de->changed & ZIP_DIRENT_PASSWORD) || (de->encryption_method != st.encryption_method);
-    needs_decrypt = needs_reencrypt && (st.encryption_method != ZIP_EM_NONE);
-    needs_encrypt = needs_reencrypt && (de->encryption_method != ZIP_EM_NONE);
-
-    src_final = src;
-    zip_source_keep(src_final);
+    if ((src_final = add_data_pipeline_read_ahead(za, src, de, &st, data_length, pipeline)) == NULL) {
+        return -1;
+    }
+    if ((src_final = _zip_dedup_capture(za->dedup, idx, src_final, &za->error)) == NULL) {
+        return -1;
+    }
 
-    if (!needs_decrypt && st.encryption_method == ZIP_EM_TRAD_PKWARE && (de->changed & ZIP_DIRENT_LAST_MOD)) {
-        /* PKWare encryption uses the last modification time for password verification, therefore we can't change it without re-encrypting. Ignoring the requested modification time change seems more sensible than failing to close the archive. */
-         de->changed &= ~ZIP_DIRENT_LAST_MOD;
+    if ((offdata = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        zip_source_free(src_final);
+        return -1;
     }
 
-    if (needs_decrypt) {
-        zip_encryption_implementation impl;
+    /* writing the data again stored requires reading it again from the start */
+    early_store = ZIP_WANT_EARLY_STORE(de->compression_level) && ((zip_source_supports(src) & ZIP_SOURCE_SUPPORTS_SEEKABLE) == ZIP_SOURCE_SUPPORTS_SEEKABLE || zip_source_supports_reopen(src)) && _zip_source_compress_enable_early_store(src_final);
 
-        if ((impl = _zip_get_encryption_implementation(st.encryption_method, ZIP_CODEC_DECODE)) == NULL) {
-            zip_error_set(&za->error, ZIP_ER_ENCRNOTSUPP, 0);
-            zip_source_free(src_final);
+    ret = copy_source(za, src_final, data_length, pipeline);
+
+    if (ret < 0 && early_store && _zip_source_compress_stored_early(src_final)) {
+        zip_source_free(src_final);
+        _zip_error_clear(&za->error);
+        if (zip_source_seek_write(za->src, offdata, SEEK_SET) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
             return -1;
         }
-        if ((src_tmp = impl(za, src_final, st.encryption_method, ZIP_CODEC_DECODE, za->default_password)) == NULL) {
-            /* error set by impl */
-            zip_source_free(src_final);
+        de->comp_method = ZIP_CM_STORE;
+        if ((src_final = add_data_pipeline_read_ahead(za, src, de, &st, data_length, pipeline)) == NULL) {
             return -1;
         }
-
-        src_final = src_tmp;
-    }
-
-    if (needs_decompress) {
-        if ((src_tmp = zip_source_decompress(za, src_final, st.comp_method)) == NULL) {
-            zip_source_free(src_final);
+        if ((src_final = _zip_dedup_capture(za->dedup, idx, src_final, &za->error)) == NULL) {
             return -1;
         }
-
-        src_final = src_tmp;
+        ret = copy_source(za, src_final, data_length, pipeline);
     }
 
-    if (needs_crc) {
-        if ((src_tmp = zip_source_crc_create(src_final, 0, &za->error)) == NULL) {
-            zip_source_free(src_final);
-            return -1;
-        }
-
-        src_final = src_tmp;
+    if (zip_source_stat(src_final, &st) < 0) {
+        zip_error_set_from_source(&za->error, src_final);
+        ret = -1;
     }
 
-    if (needs_compress) {
-        if ((src_tmp = zip_source_compress(za, src_final, de->comp_method, de->compression_level)) == NULL) {
-            zip_source_free(src_final);
-            return -1;
-        }
+    if (zip_source_get_file_attributes(src_final, &attributes) != 0) {
+        zip_error_set_from_source(&za->error, src_final);
+        ret = -1;
+    }
 
-        src_final = src_tmp;
+    if (ret == 0) {
+        ret = add_data_finish(za, de, changed, flags, is_zip64, offstart, offdata, &st, &attributes);
+    }
+    if (ret == 0) {
+        ret = update_seek_index(za, idx, src_final);
+    }
+    if (ret == 0) {
+        ret = update_digest(za, idx, src_final);
     }
 
+    zip_source_free(src_final);
+
+    return ret;
+}
+
+
+/* Write small entry by processing its data into memory first, so the final local header can be written
+   right away, followed by the data, instead of seeking back to rewrite the header. */
+static int
+add_data_buffered(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, zip_int64_t data_length, zip_stat_t *st, zip_stats_pipeline_t *pipeline) {
+    zip_source_t *src_final;
+    zip_buffer_fragment_t fragment;
+    zip_file_attributes_t attributes;
+    bool early_store;
+    int ret;
+
+    /* as in add_data_entry */
+    if (!(st->encryption_method == ZIP_EM_TRAD_PKWARE && de->encryption_method == ZIP_EM_TRAD_PKWARE && (de->changed & ZIP_DIRENT_PASSWORD) == 0)) {
+        de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
+    }
+
+    if ((src_final = add_data_pipeline(za, src, de, st, pipeline, false)) == NULL) {
+        return -1;
+    }
+    if ((src_final = _zip_dedup_capture(za->dedup, idx, src_final, &za->error)) == NULL) {
+        return -1;
+    }
+
+    early_store = ZIP_WANT_EARLY_STORE(de->compression_level) && ((zip_source_supports(src) & ZIP_SOURCE_SUPPORTS_SEEKABLE) == ZIP_SOURCE_SUPPORTS_SEEKABLE || zip_source_supports_reopen(src)) && _zip_source_compress_enable_early_store(src_final);
+
+    ret = copy_source_to_buffer(za, src_final, data_length, pipeline, &fragment);
+
+    if (ret < 0 && early_store && _zip_source_compress_stored_early(src_final)) {
+        zip_source_free(src_final);
+        _zip_error_clear(&za->error);
+        de->comp_method = ZIP_CM_STORE;
+        if ((src_final = add_data_pipeline(za, src, de, st, pipeline, false)) == NULL) {
+            return -1;
+        }
+        if ((src_final = _zip_dedup_capture(za->dedup, idx, src_final, &za->error)) == NULL) {
+            return -1;
+        }
+        ret = copy_source_to_buffer(za, src_final, data_length, pipeline, &fragment);
+    }
+
+    if (ret == 0 && zip_source_stat(src_final, st) < 0) {
+        zip_error_set_from_source(&za->error, src_final);
+        ret = -1;
+    }
+    if (ret == 0 && zip_source_get_file_attributes(src_final, &attributes) != 0) {
+        zip_error_set_from_source(&za->error, src_final);
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        ret = add_data_from_memory(za, idx, de, changed, flags, &fragment, 1, st, &attributes, src_final);
+    }
+
+    zip_source_free(src_final);
+
+    return ret;
+}
+
+
+/* Update dirent from data written, rewrite local header, write data descriptor. */
+static int
+add_data_finish(zip_t *za, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, int is_zip64, zip_int64_t offstart, zip_int64_t offdata, const zip_stat_t *st, zip_file_attributes_t *attributes) {
+    zip_int64_t offend;
+    int ret;
+
+    if ((offend = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    if (zip_source_seek_write(za->src, offstart, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    if (add_data_update_dirent(za, de, changed, flags, (zip_uint64_t)(offend - offdata), st, attributes) < 0) {
+        return -1;
+    }
+
+    if ((ret = _zip_dirent_write(za, de, flags)) < 0)
+        return -1;
+
+    if (is_zip64 != ret) {
+        /* Zip64 mismatch between preliminary file header written before data and final file header written afterwards */
+        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+        return -1;
+    }
+
+    if (zip_source_seek_write(za->src, offend, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    if (de->bitflags & ZIP_GPBF_DATA_DESCRIPTOR) {
+        if (write_data_descriptor(za, de, is_zip64) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Write entry whose data is completely in memory: final local header, data, and data descriptor.
+   Small entries are passed on in one write. */
+static int
+add_data_from_memory(zip_t *za, zip_uint64_t idx, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, const zip_stat_t *st, zip_file_attributes_t *attributes, zip_source_t *src) {
+    zip_uint64_t i, j, total, written;
+    int is_zip64, ret;
+    bool buffered;
+
+    total = 0;
+    for (i = 0; i < nfragments; i++) {
+        total += fragments[i].length;
+    }
+
+    if (add_data_update_dirent(za, de, changed, flags, total, st, attributes) < 0) {
+        return -1;
+    }
+
+    /* data that doesn't fit into the write buffer is written together with the buffered local header */
+    buffered = _zip_write_buffer_begin(za);
+    ret = -1;
+
+    if ((is_zip64 = _zip_dirent_write(za, de, flags)) < 0) {
+        goto end;
+    }
+
+    written = 0;
+    for (i = 0; i < nfragments; i = j) {
+        zip_uint64_t length = fragments[i].length;
+
+        for (j = i + 1; j < nfragments && length < COPY_DATA_CHUNK_SIZE && fragments[j].length <= COPY_DATA_CHUNK_SIZE - length; j++) {
+            length += fragments[j].length;
+        }
+        if (_zip_writev(za, fragments + i, j - i) < 0) {
+            goto end;
+        }
+        written += length;
+        if (_zip_progress_update(za->progress, total > 0 ? (double)written / (double)total : 1.0) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            goto end;
+        }
+    }
+
+    if ((de->bitflags & ZIP_GPBF_DATA_DESCRIPTOR) && write_data_descriptor(za, de, is_zip64) < 0) {
+        goto end;
+    }
+    ret = 0;
+
+end:
+    if (buffered && _zip_write_buffer_end(za, ret == 0) < 0) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        ret = update_seek_index(za, idx, src);
+    }
+    if (ret == 0) {
+        ret = update_digest(za, idx, src);
+    }
+    return ret;
+}
+
+
+/* Write entry to archive that can't seek: local header without sizes and CRC, data, data descriptor. */
+static int
+add_data_streaming(zip_t *za, zip_uint64_t idx, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, zip_int64_t data_length, const zip_stat_t *st, zip_stats_pipeline_t *pipeline) {
+    zip_int64_t offdata, offend;
+    zip_stat_t st_final;
+    zip_file_attributes_t attributes;
+    zip_source_t *src_final;
+    int ret;
+    int is_zip64;
+
+    /* the compression method is written before the data, so it can't fall back to storing */
+    if (ZIP_CM_IS_DEFAULT(de->comp_method)) {
+        de->comp_method = ZIP_CM_DEFLATE;
+    }
+    if (ZIP_WANT_AUTO_COMPRESSION(de->compression_level)) {
+        de->compression_level |= ZIP_CM_FL_AUTO_NO_STORE;
+    }
+
+    de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
+    if ((src_final = add_data_pipeline(za, src, de, st, pipeline, false)) == NULL) {
+        return -1;
+    }
+
+    if (zip_source_stat(src_final, &st_final) < 0 || zip_source_get_file_attributes(src_final, &attributes) != 0) {
+        zip_error_set_from_source(&za->error, src_final);
+        zip_source_free(src_final);
+        return -1;
+    }
+
+    if ((de->changed & ZIP_DIRENT_LAST_MOD) == 0) {
+        _zip_dirent_set_last_mod(de, (st_final.valid & ZIP_STAT_MTIME) ? st_final.mtime : time(NULL));
+    }
+    de->comp_method = ZIP_CM_ACTUAL(de->comp_method);
+    _zip_dirent_apply_attributes(de, &attributes, (flags & ZIP_FL_FORCE_ZIP64) != 0, changed);
+    de->bitflags |= ZIP_GPBF_DATA_DESCRIPTOR;
+    de->crc = 0;
+    de->comp_size = 0;
+    de->uncomp_size = 0;
+
+    if ((is_zip64 = _zip_dirent_write(za, de, flags)) < 0) {
+        zip_source_free(src_final);
+        return -1;
+    }
+
+    if ((offdata = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        zip_source_free(src_final);
+        return -1;
+    }
+
+    ret = copy_source(za, src_final, data_length, pipeline);
+
+    if (ret == 0 && zip_source_stat(src_final, &st_final) < 0) {
+        zip_error_set_from_source(&za->error, src_final);
+        ret = -1;
+    }
+
+    if (ret == 0 && (offend = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        if ((st_final.valid & (ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_SIZE)) != (ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_SIZE) || st_final.comp_method != de->comp_method) {
+            zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        de->crc = st_final.crc;
+        de->uncomp_size = st_final.size;
+        de->comp_size = (zip_uint64_t)(offend - offdata);
+
+        if (!is_zip64 && (de->uncomp_size >= ZIP_UINT32_MAX || de->comp_size >= ZIP_UINT32_MAX)) {
+            /* local header was written without Zip64 extra field, data descriptor can't hold the sizes */
+            zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        ret = write_data_descriptor(za, de, is_zip64);
+    }
+    if (ret == 0) {
+        ret = update_seek_index(za, idx, src_final);
+    }
+    if (ret == 0) {
+        ret = update_digest(za, idx, src_final);
+    }
+
+    zip_source_free(src_final);
+
+    return ret;
+}
+
+
+/* Update dirent from data written and what the source reports about it. */
+static int
+add_data_update_dirent(zip_t *za, zip_dirent_t *de, zip_uint32_t changed, zip_flags_t flags, zip_uint64_t comp_size, const zip_stat_t *st, zip_file_attributes_t *attributes) {
+    zip_uint64_t required = ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_SIZE;
+
+    if ((st->valid & ZIP_STAT_ENCRYPTION_METHOD) && (st->encryption_method == ZIP_EM_AES_128 || st->encryption_method == ZIP_EM_AES_192 || st->encryption_method == ZIP_EM_AES_256)) {
+        /* AE-2 data copied still encrypted has no CRC, the authentication code protects it instead */
+        required &= ~(zip_uint64_t)ZIP_STAT_CRC;
+    }
+    if ((st->valid & required) != required) {
+        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+        return -1;
+    }
+
+    if ((de->changed & ZIP_DIRENT_LAST_MOD) == 0) {
+        _zip_dirent_set_last_mod(de, (st->valid & ZIP_STAT_MTIME) ? st->mtime : time(NULL));
+    }
+    de->comp_method = st->comp_method;
+    de->crc_valid = (st->valid & ZIP_STAT_CRC) != 0;
+    de->crc = de->crc_valid ? st->crc : 0;
+    de->uncomp_size = st->size;
+    de->comp_size = comp_size;
+    _zip_dirent_apply_attributes(de, attributes, (flags & ZIP_FL_FORCE_ZIP64) != 0, changed);
+
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        zip_dirent_torrentzip_normalize(de);
+    }
+
+    return 0;
+}
+
+
+#ifdef HAVE_THREADS
+static int
+add_data_from_job(zip_t *za, compress_queue_t *queue, zip_uint64_t j, zip_uint64_t idx, zip_dirent_t *de, zip_uint32_t changed) {
+    compress_job_t *job = queue->jobs[j];
+    int ret;
+
+    _zip_thread_pool_wait(queue->pool, &job->job);
+    queue->jobs[j] = NULL;
+    queue->outstanding--;
+    _zip_stats_pipeline_merge(za, &job->pipeline);
+
+    if (job->ret < 0) {
+        _zip_error_copy(&za->error, &job->error);
+        compress_job_free(job);
+        return -1;
+    }
+
+    ret = add_data_from_memory(za, idx, de, changed, job->flags, job->fragments, job->nfragments, &job->st, &job->attributes, job->src);
+    if (ret == 0) {
+        _zip_stats_notify(za, (zip_int64_t)idx);
+    }
+
+    compress_job_free(job);
+    return ret;
+}
+#endif
+
+
+/* Create source that produces the data to write for de, i.e. with requested compression and encryption applied.
+   If pipeline is not NULL, each layer is metered for it. If stage_encryption is true, data is compressed in a
+   worker thread while the calling thread encrypts it. */
+static zip_source_t *
+add_data_pipeline(zip_t *za, zip_source_t *src, zip_dirent_t *de, const zip_stat_t *st, zip_stats_pipeline_t *pipeline, bool stage_encryption) {
+    zip_source_t *src_final, *src_tmp;
+    bool needs_recompress, needs_decompress, needs_crc, needs_digest, needs_compress, needs_reencrypt, needs_decrypt, needs_encrypt, check_crc;
+
+    needs_recompress = ZIP_WANT_TORRENTZIP(za) || st->comp_method != ZIP_CM_ACTUAL(de->comp_method);
+    needs_decompress = needs_recompress && (st->comp_method != ZIP_CM_STORE);
+    needs_compress = needs_recompress && (de->comp_method != ZIP_CM_STORE);
+
+    needs_reencrypt = needs_recompress || (de->changed & ZIP_DIRENT_PASSWORD) || (de->encryption_method != st->encryption_method);
+    needs_decrypt = needs_reencrypt && (st->encryption_method != ZIP_EM_NONE);
+    needs_encrypt = needs_reencrypt && (de->encryption_method != ZIP_EM_NONE);
+
+    /* in these cases we can compute the CRC ourselves, so we do */
+    needs_crc = (st->comp_method == ZIP_CM_STORE && (st->encryption_method == ZIP_EM_NONE || needs_decrypt)) || needs_decompress;
+    needs_digest = needs_crc && (za->ch_flags & ZIP_AFL_DIGEST) && de->encryption_method == ZIP_EM_NONE;
+
+    /* CRC and size reported by the source are used as is, computing it would be another pass over the data */
+    check_crc = false;
+    if (needs_crc && !needs_digest && (st->valid & (ZIP_STAT_CRC | ZIP_STAT_SIZE)) == (ZIP_STAT_CRC | ZIP_STAT_SIZE)) {
+        check_crc = (za->ch_flags & ZIP_AFL_CHECK_SOURCE_CRC) != 0;
+        needs_crc = check_crc;
+    }
+
+    src_final = src;
+    zip_source_keep(src_final);
+
+    if (pipeline != NULL) {
+        /* data that is not processed is counted by copy_source, meters would keep it from being copied directly */
+        if (!(needs_decrypt || needs_decompress || needs_crc || needs_compress || needs_encrypt)) {
+            pipeline = NULL;
+        }
+        else {
+            /* an earlier attempt at the entry may have left meters */
+            pipeline->top_phase = -1;
+        }
+    }
+    if (add_data_pipeline_meter(za, &src_final, pipeline, ZIP_PHASE_SOURCE) < 0) {
+        return NULL;
+    }
+
+    if (!needs_decrypt && st->encryption_method == ZIP_EM_TRAD_PKWARE && (de->changed & ZIP_DIRENT_LAST_MOD)) {
+        /* PKWare encryption uses the last modification time for password verification, therefore we can't change it without re-encrypting. Ignoring the requested modification time change seems more sensible than failing to close the archive. */
+         de->changed &= ~ZIP_DIRENT_LAST_MOD;
+    }
+
+    if (needs_decrypt) {
+        zip_encryption_implementation impl;
+
+        if ((impl = _zip_get_encryption_implementation(st->encryption_method, ZIP_CODEC_DECODE)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_ENCRNOTSUPP, 0);
+            zip_source_free(src_final);
+            return NULL;
+        }
+        if ((src_tmp = impl(za, src_final, st->encryption_method, ZIP_CODEC_DECODE, za->default_password)) == NULL) {
+            /* error set by impl */
+            zip_source_free(src_final);
+            return NULL;
+        }
+
+        src_final = src_tmp;
+    }
+
+    if (needs_decompress) {
+        if ((src_tmp = zip_source_decompress(za, src_final, st->comp_method)) == NULL) {
+            zip_source_free(src_final);
+            return NULL;
+        }
+        _zip_source_compress_set_zstd_parameters(src_tmp, &de->zstd_parameters);
+
+        src_final = src_tmp;
+    }
+
+    if ((needs_decrypt || needs_decompress) && add_data_pipeline_meter(za, &src_final, pipeline, ZIP_PHASE_DECOMPRESS) < 0) {
+        return NULL;
+    }
+
+    /* data that is compressed gets its CRC computed by the compression layer, unless a digest is computed alongside it or it is checked against the source's */
+    if (needs_crc && (!needs_compress || needs_digest || check_crc)) {
+        if ((src_tmp = zip_source_crc_create(src_final, check_crc, &za->error)) == NULL) {
+            zip_source_free(src_final);
+            return NULL;
+        }
+        if (needs_digest) {
+            _zip_source_crc_compute_digest(src_tmp);
+        }
+
+        src_final = src_tmp;
+
+        if (add_data_pipeline_meter(za, &src_final, pipeline, ZIP_PHASE_CRC) < 0) {
+            return NULL;
+        }
+    }
+
+    if (needs_compress) {
+        if ((src_tmp = zip_source_compress(za, src_final, de->comp_method, de->compression_level)) == NULL) {
+            zip_source_free(src_final);
+            return NULL;
+        }
+        _zip_source_compress_set_zstd_parameters(src_tmp, &de->zstd_parameters);
+        if (needs_crc && !needs_digest && !check_crc) {
+            _zip_source_compress_compute_crc(src_tmp);
+        }
+
+        src_final = src_tmp;
+
+        if (add_data_pipeline_meter(za, &src_final, pipeline, ZIP_PHASE_COMPRESS) < 0) {
+            return NULL;
+        }
+    }
+
+#ifdef HAVE_THREADS
+    /* meters of one pipeline must all run in the same thread */
+    if (needs_encrypt && stage_encryption && (needs_decompress || needs_compress) && pipeline == NULL) {
+        zip_error_t error;
+
+        zip_error_init(&error);
+        src_tmp = _zip_source_read_ahead_new(src_final, za->io_buffer_size, &error);
+        zip_error_fini(&error);
+        /* if no thread can be created, compress in calling thread */
+        if (src_tmp != NULL) {
+            src_final = src_tmp;
+        }
+    }
+#else
+    (void)stage_encryption;
+#endif
+
+    if (needs_encrypt) {
+        zip_encryption_implementation impl;
+        const char *password = NULL;
+
+        if (de->password) {
+            password = de->password;
+        }
+        else if (za->default_password) {
+            password = za->default_password;
+        }
+
+        if ((impl = _zip_get_encryption_implementation(de->encryption_method, ZIP_CODEC_ENCODE)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_ENCRNOTSUPP, 0);
+            zip_source_free(src_final);
+            return NULL;
+        }
+
+        if (de->encryption_method == ZIP_EM_TRAD_PKWARE) {
+            de->bitflags |= ZIP_GPBF_DATA_DESCRIPTOR;
+
+            /* PKWare encryption uses last_mod, make sure it gets the right value. */
+            if (de->changed & ZIP_DIRENT_LAST_MOD) {
+                zip_stat_t st_mtime;
+                zip_stat_init(&st_mtime);
+                st_mtime.valid = ZIP_STAT_MTIME;
+                st_mtime.mtime = _zip_dirent_get_last_mod(de, &za->dos_time_cache);
+                if ((src_tmp = _zip_source_window_new(src_final, 0, -1, &st_mtime, 0, NULL, NULL, 0, true, &za->error)) == NULL) {
+                    zip_source_free(src_final);
+                    return NULL;
+                }
+                src_final = src_tmp;
+            }
+        }
+
+        if ((src_tmp = impl(za, src_final, de->encryption_method, ZIP_CODEC_ENCODE, password)) == NULL) {
+            /* error set by impl */
+            zip_source_free(src_final);
+            return NULL;
+        }
+
+        src_final = src_tmp;
+
+        if (add_data_pipeline_meter(za, &src_final, pipeline, ZIP_PHASE_ENCRYPT) < 0) {
+            return NULL;
+        }
+    }
+
+    return src_final;
+}
+
+
+/* Whether add_data_pipeline() copies the data of source as is, like for already compressed data. */
+static bool
+add_data_is_copy(zip_t *za, const zip_dirent_t *de, const zip_stat_t *st) {
+    bool needs_recompress = ZIP_WANT_TORRENTZIP(za) || st->comp_method != ZIP_CM_ACTUAL(de->comp_method);
+    bool needs_reencrypt = needs_recompress || (de->changed & ZIP_DIRENT_PASSWORD) || (de->encryption_method != st->encryption_method);
+
+    return !needs_reencrypt && !(st->comp_method == ZIP_CM_STORE && st->encryption_method == ZIP_EM_NONE);
+}
+
+
+/* Put meter for phase on top of *srcp if pipeline is not NULL. On failure, *srcp is freed. */
+static int
+add_data_pipeline_meter(zip_t *za, zip_source_t **srcp, zip_stats_pipeline_t *pipeline, zip_uint32_t phase) {
+    zip_source_t *src_tmp;
+
+    if (pipeline == NULL) {
+        return 0;
+    }
+
+    if ((src_tmp = _zip_source_meter_new(*srcp, pipeline, phase, &za->error)) == NULL) {
+        zip_source_free(*srcp);
+        return -1;
+    }
+
+    *srcp = src_tmp;
+    return 0;
+}
+
+
+/* As add_data_pipeline, reading src ahead in a worker thread for big entries. */
+static zip_source_t *
+add_data_pipeline_read_ahead(zip_t *za, zip_source_t *src, zip_dirent_t *de, const zip_stat_t *st, zip_int64_t data_length, zip_stats_pipeline_t *pipeline) {
+#ifdef HAVE_THREADS
+    /* data in memory is not worth copying, sources of archives can't be read from other threads */
+    if (WANT_PIPELINE(za, data_length) && (zip_source_supports(src) & zip_source_make_command_bitmap(ZIP_SOURCE_GET_DATA, -1)) == 0 && source_is_independent(src)) {
+        zip_source_t *src_ahead, *src_final;
+        zip_error_t error;
+
+        /* layer takes over this reference */
+        zip_source_keep(src);
+        zip_error_init(&error);
+        src_ahead = _zip_source_read_ahead_new(src, za->io_buffer_size, &error);
+        zip_error_fini(&error);
+        if (src_ahead == NULL) {
+            zip_source_free(src);
+        }
+        else {
+            src_final = add_data_pipeline(za, src_ahead, de, st, pipeline, true);
+            zip_source_free(src_ahead);
+            return src_final;
+        }
+        /* if no thread can be created, read in calling thread */
+    }
+#else
+    (void)data_length;
+#endif
+
+    return add_data_pipeline(za, src, de, st, pipeline, false);
+}
+
+
+/* Determine what is known about the data of src before writing it and update de accordingly. */
+static int
+add_data_prepare(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_stat_t *st, zip_flags_t *flagsp, zip_int64_t *data_lengthp) {
+    zip_flags_t flags;
+    zip_int64_t data_length;
+
+    if (zip_source_stat(src, st) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        return -1;
+    }
+
+    if ((st->valid & ZIP_STAT_COMP_METHOD) == 0) {
+        st->valid |= ZIP_STAT_COMP_METHOD;
+        st->comp_method = ZIP_CM_STORE;
+    }
+
+    if (ZIP_CM_IS_DEFAULT(de->comp_method) && st->comp_method != ZIP_CM_STORE)
+        de->comp_method = st->comp_method;
+    else if (de->comp_method == ZIP_CM_STORE && (st->valid & ZIP_STAT_SIZE)) {
+        st->valid |= ZIP_STAT_COMP_SIZE;
+        st->comp_size = st->size;
+    }
+    else {
+        /* we'll recompress */
+        st->valid &= ~ZIP_STAT_COMP_SIZE;
+    }
+
+    if ((st->valid & ZIP_STAT_ENCRYPTION_METHOD) == 0) {
+        st->valid |= ZIP_STAT_ENCRYPTION_METHOD;
+        st->encryption_method = ZIP_EM_NONE;
+    }
+
+    flags = local_header_flags(za, de);
+
+    if ((st->valid & ZIP_STAT_SIZE) == 0) {
+        /* TODO: not valid for torrentzip */
+        flags |= ZIP_FL_FORCE_ZIP64;
+        data_length = -1;
+    }
+    else {
+        de->uncomp_size = st->size;
+        /* this is technically incorrect (copy_source counts compressed data), but it's the best we have */
+        data_length = (zip_int64_t)st->size;
+
+        if ((st->valid & ZIP_STAT_COMP_SIZE) == 0) {
+            zip_uint64_t max_compressed_size;
+            zip_uint16_t compression_method = ZIP_CM_ACTUAL(de->comp_method);
+
+            if (compression_method == ZIP_CM_STORE) {
+                max_compressed_size = st->size;
+            }
+            else {
+                max_compressed_size = _zip_compression_maximum_size(compression_method, de->compression_level, st->size);
+            }
+
+            if (max_compressed_size > 0xffffffffu) {
+                /* TODO: not valid for torrentzip */
+                flags |= ZIP_FL_FORCE_ZIP64;
+            }
+        }
+        else {
+            de->comp_size = st->comp_size;
+            data_length = (zip_int64_t)st->comp_size;
+        }
+    }
+
+    *flagsp = flags;
+    *data_lengthp = data_length;
+    return 0;
+}
+
+
+
+#ifdef HAVE_THREADS
+static void
+compress_job_free(compress_job_t *job) {
+    zip_uint64_t i;
+
+    if (job == NULL) {
+        return;
+    }
+
+    zip_source_free(job->src);
+    for (i = 0; i < job->nfragments; i++) {
+        _zip_free(job->fragments[i].data);
+    }
+    _zip_free(job->fragments);
+    zip_error_fini(&job->error);
+    _zip_free(job);
+}
+
+
+static compress_job_t *
+compress_job_new(zip_error_t *error) {
+    compress_job_t *job;
+
+    if ((job = (compress_job_t *)_zip_malloc(sizeof(*job))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    job->job.run = compress_job_run;
+    job->job.ud = job;
+    job->src = NULL;
+    job->fragments = NULL;
+    job->nfragments = job->fragments_alloc = 0;
+    zip_stat_init(&job->st);
+    zip_file_attributes_init(&job->attributes);
+    zip_error_init(&job->error);
+    job->ret = -1;
+    job->key_cache = NULL;
+    job->password = NULL;
+    job->encryption_method = ZIP_EM_NONE;
+    job->have_provider = false;
+    _zip_stats_pipeline_init(&job->pipeline);
+
+    return job;
+}
+
+
+/* Runs in worker thread, must only access its job. */
+static void
+compress_job_run(void *ud) {
+    compress_job_t *job = (compress_job_t *)ud;
+    zip_buffer_fragment_t *fragment;
+    zip_int64_t n;
+
+    job->ret = -1;
+
+    if (job->src == NULL) {
+#ifdef HAVE_CRYPTO
+        /* if this fails, the key is derived when writing the entry */
+        (void)_zip_winzip_aes_key_cache_prepare(job->key_cache, (const zip_uint8_t *)job->password, strlen(job->password), job->encryption_method, job->have_provider ? &job->provider : NULL);
+#endif
+        job->ret = 0;
+        return;
+    }
+
+    if (zip_source_open(job->src) < 0) {
+        zip_error_set_from_source(&job->error, job->src);
+        return;
+    }
+
+    fragment = NULL;
+    for (;;) {
+        if (fragment == NULL || fragment->length == COMPRESS_JOB_FRAGMENT_SIZE) {
+            if (job->nfragments == job->fragments_alloc) {
+                zip_uint64_t new_alloc = job->fragments_alloc > 0 ? job->fragments_alloc * 2 : 16;
+                zip_buffer_fragment_t *fragments;
+
+                if ((fragments = (zip_buffer_fragment_t *)_zip_realloc(job->fragments, sizeof(job->fragments[0]) * new_alloc)) == NULL) {
+                    zip_error_set(&job->error, ZIP_ER_MEMORY, 0);
+                    break;
+                }
+                job->fragments = fragments;
+                job->fragments_alloc = new_alloc;
+            }
+            fragment = job->fragments + job->nfragments;
+            if ((fragment->data = (zip_uint8_t *)_zip_malloc(COMPRESS_JOB_FRAGMENT_SIZE)) == NULL) {
+                zip_error_set(&job->error, ZIP_ER_MEMORY, 0);
+                fragment = NULL;
+                break;
+            }
+            fragment->length = 0;
+            job->nfragments++;
+        }
+
+        if ((n = zip_source_read(job->src, fragment->data + fragment->length, COMPRESS_JOB_FRAGMENT_SIZE - fragment->length)) < 0) {
+            zip_error_set_from_source(&job->error, job->src);
+            break;
+        }
+        if (n == 0) {
+            job->ret = 0;
+            break;
+        }
+        fragment->length += (zip_uint64_t)n;
+    }
+
+    if (fragment != NULL && fragment->length == 0) {
+        _zip_free(fragment->data);
+        job->nfragments--;
+    }
+
+    if (job->ret == 0) {
+        if (zip_source_stat(job->src, &job->st) < 0) {
+            zip_error_set_from_source(&job->error, job->src);
+            job->ret = -1;
+        }
+        else if (zip_source_get_file_attributes(job->src, &job->attributes) != 0) {
+            zip_error_set_from_source(&job->error, job->src);
+            job->ret = -1;
+        }
+    }
+
+    zip_source_close(job->src);
+}
+
+
+/* Submit jobs for upcoming entries that need compressing, up to the limit of outstanding jobs. */
+static int
+compress_queue_fill(zip_t *za, compress_queue_t *queue, const zip_filelist_t *filelist, zip_uint64_t survivors) {
+    if (queue->pool == NULL) {
+        return 0;
+    }
+
+    for (; queue->next < survivors && queue->outstanding < queue->max_outstanding; queue->next++) {
+        zip_uint64_t idx = filelist[queue->next].idx;
+        zip_entry_t *entry = za->entry + idx;
+        zip_dirent_t *de;
+        zip_source_t *src;
+        compress_job_t *job;
+        zip_int64_t data_length;
+        bool is_copy;
+
+        if (_zip_dedup_original(za->dedup, idx) != ZIP_UINT64_MAX) {
+            /* written from data of original */
+            continue;
+        }
+
+        if (ZIP_ENTRY_DATA_CHANGED(entry)) {
+            if (!source_is_independent(entry->source)) {
+                if (compress_queue_add_key_job(za, queue, entry) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            src = entry->source;
+            zip_source_keep(src);
+        }
+        else if (entry->orig != NULL && queue->have_reader && ENTRY_NEEDS_NEW_DATA(za, entry)) {
+            /* recompressed original data, e.g. for torrentzip, read without using the read position of the archive */
+            zip_source_t *data_src;
+
+            if ((data_src = _zip_reader_entry_source_new(&queue->reader, entry->orig->offset, entry->orig->comp_size, &za->error)) == NULL) {
+                return -1;
+            }
+            src = _zip_source_zip_new(za, idx, ZIP_FL_UNCHANGED, 0, -1, NULL, data_src, &za->error);
+            zip_source_free(data_src);
+            if (src == NULL) {
+                return -1;
+            }
+        }
+        else {
+            if (entry->orig != NULL && ENTRY_NEEDS_NEW_DATA(za, entry) && compress_queue_add_key_job(za, queue, entry) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (prepare_entry(za, idx) < 0) {
+            zip_source_free(src);
+            return -1;
+        }
+        de = entry->changes;
+
+        if ((job = compress_job_new(&za->error)) == NULL) {
+            zip_source_free(src);
+            return -1;
+        }
+
+        if (add_data_prepare(za, src, de, &job->st, &job->flags, &data_length) < 0) {
+            zip_source_free(src);
+            compress_job_free(job);
+            return -1;
+        }
+
+        is_copy = (ZIP_CM_ACTUAL(de->comp_method) == ZIP_CM_STORE && de->encryption_method == ZIP_EM_NONE) || add_data_is_copy(za, de, &job->st);
+        if (data_length < 0 || (is_copy && !(source_reads_archive(src) && data_length <= COPY_AHEAD_MAX_SIZE)) || (ZIP_WANT_PARALLEL_COMPRESSION(de->compression_level) && ZIP_CM_SUPPORTS_PARALLEL(de->comp_method))) {
+            /* data of unknown size, e.g. from a pipe, is streamed to the archive instead of being collected in memory;
+               nothing to gain from reading data ahead, except from other archives, or compression uses threads itself */
+            zip_source_free(src);
+            compress_job_free(job);
+            if (compress_queue_add_key_job(za, queue, entry) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        /* as in add_data, clear data descriptor bit before pipeline may set it */
+        de->bitflags &= (zip_uint16_t)~ZIP_GPBF_DATA_DESCRIPTOR;
+        job->src = add_data_pipeline(za, src, de, &job->st, za->stats != NULL ? &job->pipeline : NULL, false);
+        zip_source_free(src);
+        if (job->src != NULL) {
+            job->src = _zip_dedup_capture(za->dedup, idx, job->src, &za->error);
+        }
+        if (job->src == NULL) {
+            compress_job_free(job);
+            return -1;
+        }
+
+        queue->jobs[queue->next] = job;
+        queue->outstanding++;
+        _zip_thread_pool_submit(queue->pool, &job->job);
+    }
+
+    return 0;
+}
+
+
+/* Derive the WinZip AES key of an entry that is written directly in a worker thread ahead of time. */
+static int
+compress_queue_add_key_job(zip_t *za, compress_queue_t *queue, zip_entry_t *entry) {
+#ifdef HAVE_CRYPTO
+    zip_dirent_t *de = entry->changes;
+    compress_job_t *job;
+    const char *password;
+    zip_winzip_aes_key_cache_t *key_cache;
+
+    if (de == NULL || (de->encryption_method != ZIP_EM_AES_128 && de->encryption_method != ZIP_EM_AES_192 && de->encryption_method != ZIP_EM_AES_256)) {
+        return 0;
+    }
+    /* as in add_data_pipeline */
+    if ((password = de->password ? de->password : za->default_password) == NULL) {
+        return 0;
+    }
+
+    if ((key_cache = _zip_winzip_aes_key_cache_get(za)) == NULL) {
+        return -1;
+    }
+    if ((job = compress_job_new(&za->error)) == NULL) {
+        return -1;
+    }
+    job->key_cache = key_cache;
+    job->password = password;
+    job->encryption_method = de->encryption_method;
+    if (za->crypto_provider != NULL) {
+        job->have_provider = true;
+        job->provider = *za->crypto_provider;
+    }
+
+    queue->jobs[queue->next] = job;
+    queue->outstanding++;
+    _zip_thread_pool_submit(queue->pool, &job->job);
+#else
+    (void)za;
+    (void)queue;
+    (void)entry;
+#endif
+
+    return 0;
+}
+
+
+static void
+compress_queue_fini(compress_queue_t *queue, zip_uint64_t survivors) {
+    zip_uint64_t j;
+
+    if (queue->pool == NULL) {
+        return;
+    }
+
+    /* waits for running jobs, so all jobs can be freed afterwards */
+    _zip_thread_pool_free(queue->pool);
+    for (j = 0; j < survivors; j++) {
+        compress_job_free(queue->jobs[j]);
+    }
+    _zip_free(queue->jobs);
+}
+
+
+static int
+compress_queue_init(zip_t *za, compress_queue_t *queue, zip_uint64_t survivors) {
+    zip_uint64_t j;
+
+    queue->pool = NULL;
+    queue->jobs = NULL;
+    queue->next = 0;
+    queue->outstanding = 0;
+    queue->max_outstanding = 2 * (zip_uint64_t)za->num_threads;
+    queue->have_reader = false;
+
+    if (za->num_threads <= 1) {
+        return 0;
+    }
+
+    /* only possible for archives read from files or memory */
+    queue->have_reader = ZIP_SOURCE_IS_OPEN_READING(za->src) && _zip_reader_init(&queue->reader, za->src);
+
+    if ((queue->jobs = (compress_job_t **)_zip_malloc(sizeof(queue->jobs[0]) * (size_t)survivors)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    for (j = 0; j < survivors; j++) {
+        queue->jobs[j] = NULL;
+    }
+
+    if ((queue->pool = _zip_thread_pool_new(za->num_threads, &za->error)) == NULL) {
+        _zip_free(queue->jobs);
+        queue->jobs = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+
+static int
+copy_data(zip_t *za, zip_uint64_t len) {
+    zip_uint8_t *buf;
+    zip_uint64_t length = len;
+    zip_uint64_t start = _zip_stats_start(za);
+
+    /* let the source copy the data itself if it can, e.g. in the kernel */
+    while (len > 0) {
+        zip_int64_t n = _zip_source_copy_data(za->src, ZIP_MIN(len, COPY_DATA_CHUNK_SIZE));
+
+        if (n < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        len -= (zip_uint64_t)n;
+
+        if (_zip_progress_update_bytes(za->progress, length - len) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            return -1;
+        }
+    }
+
+    if (len > 0) {
+        if ((buf = _zip_io_buffer(za)) == NULL) {
+            return -1;
+        }
+    }
+
+    while (len > 0) {
+        zip_uint64_t n = ZIP_MIN(len, za->io_buffer_size);
+
+        if (_zip_read(za->src, buf, n, &za->error) < 0) {
+            return -1;
+        }
+
+        if (_zip_write(za, buf, n) < 0) {
+            return -1;
+        }
+
+        len -= n;
+
+        if (_zip_progress_update_bytes(za->progress, length - len) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            return -1;
+        }
+    }
+
+    _zip_stats_add(za, ZIP_PHASE_COPY, start, length, length);
+
+    return 0;
+}
+
+
+/* Copy unchanged entries starting at filelist[j] that are stored back to back in the original archive with one copy of their
+   local headers and data. Returns the number of entries copied, 0 if filelist[j] can't be copied this way, -1 on error. */
+static zip_int64_t
+copy_unchanged_entries(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t j, zip_uint64_t survivors) {
+    zip_uint64_t k, l, start, end;
+    zip_int64_t off;
+
+    if (ZIP_WANT_TORRENTZIP(za) || !ENTRY_IS_COPYABLE(za->entry + filelist[j].idx)) {
+        return 0;
+    }
+
+    if ((off = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    start = za->entry[filelist[j].idx].orig->offset;
+    if (!entry_keeps_alignment(za, filelist[j].idx, (zip_uint64_t)off)) {
+        return 0;
+    }
+    if ((end = _zip_file_get_end(za, filelist[j].idx, &za->error)) == 0) {
+        return -1;
+    }
+    for (k = j + 1; k < survivors; k++) {
+        zip_entry_t *entry = za->entry + filelist[k].idx;
+
+        if (!ENTRY_IS_COPYABLE(entry) || entry->orig->offset != end || !entry_keeps_alignment(za, filelist[k].idx, (zip_uint64_t)off + (end - start))) {
+            break;
+        }
+        if ((end = _zip_file_get_end(za, filelist[k].idx, &za->error)) == 0) {
+            return -1;
+        }
+    }
+    /* local headers don't contain offsets, only the central directory needs to be adjusted */
+    for (l = j; l < k; l++) {
+        zip_entry_t *entry = za->entry + filelist[l].idx;
+
+        if (entry->changes == NULL) {
+            if ((entry->changes = _zip_dirent_clone(entry->orig)) == NULL) {
+                zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+                return -1;
+            }
+        }
+        entry->changes->offset = (zip_uint64_t)off + (entry->orig->offset - start);
+    }
+
+    if (zip_source_seek(za->src, (zip_int64_t)start, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+    if (progress_subrange(za, filelist, j, k) < 0) {
+        return -1;
+    }
+    if (copy_data(za, end - start) < 0) {
+        return -1;
+    }
+
+    return (zip_int64_t)(k - j);
+}
+
+
+/* Write data of src to archive. Unless it is metered by pipeline, the time spent is counted as copying. */
+static int
+copy_source(zip_t *za, zip_source_t *src, zip_int64_t data_length, const zip_stats_pipeline_t *pipeline) {
+    zip_uint8_t *buf;
+    zip_int64_t n;
+    zip_uint64_t start, copied;
+    bool count_copy;
+    int ret;
+#ifdef HAVE_THREADS
+    write_behind_t *writer = NULL;
+#endif
+
+    if ((buf = _zip_io_buffer(za)) == NULL) {
+        return -1;
+    }
+
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        return -1;
+    }
+
+    ret = 0;
+    copied = 0;
+    count_copy = za->stats != NULL && (pipeline == NULL || pipeline->top_phase < 0);
+    start = count_copy ? _zip_stats_time() : 0;
+    /* copy entry data from another archive file directly if possible, e.g. in the kernel */
+    while (za->write_crc == NULL && (n = _zip_source_copy_data_from(za->src, src, COPY_DATA_CHUNK_SIZE)) != 0) {
+        if (n < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            zip_source_close(src);
+            return -1;
+        }
+        copied += (zip_uint64_t)n;
+        if (_zip_progress_update_bytes(za->progress, copied) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            zip_source_close(src);
+            return -1;
+        }
+    }
+#ifdef HAVE_THREADS
+    /* writing from another thread is only safe if src doesn't read from the archive being written to */
+    if (WANT_PIPELINE(za, data_length) && !source_reads_from(src, za->src)) {
+        writer = write_behind_new(za);
+    }
+#endif
+    while ((n = zip_source_read(src, buf, za->io_buffer_size)) > 0) {
+        copied += (zip_uint64_t)n;
+#ifdef HAVE_THREADS
+        if (writer != NULL) {
+            if (write_behind_write(writer, &buf, (zip_uint64_t)n) < 0) {
+                ret = -1;
+                break;
+            }
+        }
+        else
+#endif
+        if (_zip_write(za, buf, (zip_uint64_t)n) < 0) {
+            ret = -1;
+            break;
+        }
+        if (_zip_progress_update_bytes(za->progress, copied) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            ret = -1;
+            break;
+        }
+    }
+
+#ifdef HAVE_THREADS
+    if (writer != NULL) {
+        if (write_behind_finish(za, writer) < 0 && ret == 0) {
+            /* write error takes precedence over read error */
+            n = 0;
+            ret = -1;
+        }
+    }
+#endif
+    if (n < 0) {
+        zip_error_set_from_source(&za->error, src);
+        ret = -1;
+    }
+    else if (ret == 0) {
+        /* report end of data, which may differ from the size progress was weighted with */
+        if (_zip_progress_update(za->progress, 1.0) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            ret = -1;
+        }
+    }
+
+    zip_source_close(src);
+
+    if (ret == 0 && count_copy) {
+        _zip_stats_add(za, ZIP_PHASE_COPY, start, copied, copied);
+    }
+
+    return ret;
+}
+
+/* Read all data of src into za->entry_buffer, which grows as needed. */
+static int
+copy_source_to_buffer(zip_t *za, zip_source_t *src, zip_int64_t data_length, const zip_stats_pipeline_t *pipeline, zip_buffer_fragment_t *fragment) {
+    zip_int64_t n;
+    zip_uint64_t start, length;
+    bool count_copy;
+
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        return -1;
+    }
+
+    count_copy = za->stats != NULL && (pipeline == NULL || pipeline->top_phase < 0);
+    start = count_copy ? _zip_stats_time() : 0;
+    length = 0;
+    for (;;) {
+        if (length == za->entry_buffer_size) {
+            /* room for headers added by encryption, so the first read usually fits */
+            zip_uint64_t new_size = length > 0 ? length * 2 : (zip_uint64_t)data_length + 1024;
+            zip_uint8_t *buffer;
+
+            if (new_size > SIZE_MAX || (buffer = (zip_uint8_t *)_zip_realloc(za->entry_buffer, (size_t)new_size)) == NULL) {
+                zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+                zip_source_close(src);
+                return -1;
+            }
+            za->entry_buffer = buffer;
+            za->entry_buffer_size = new_size;
+        }
+        if ((n = zip_source_read(src, za->entry_buffer + length, za->entry_buffer_size - length)) < 0) {
+            zip_error_set_from_source(&za->error, src);
+            zip_source_close(src);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        length += (zip_uint64_t)n;
+    }
+
+    zip_source_close(src);
+
+    if (count_copy) {
+        _zip_stats_add(za, ZIP_PHASE_COPY, start, length, length);
+    }
+
+    fragment->data = za->entry_buffer;
+    fragment->length = length;
+    return 0;
+}
+
+
+static int
+dirent_offset_compare(const void *a, const void *b) {
+    const zip_dirent_t *da = *(const zip_dirent_t *const *)a;
+    const zip_dirent_t *db = *(const zip_dirent_t *const *)b;
+
+    return da->offset < db->offset ? -1 : (da->offset > db->offset ? 1 : 0);
+}
+
+
+/* Read the sizes of the local headers of entries that are copied verbatim in file order, so headers close to each other
+   are read together instead of one by one when their data is copied, which matters after deleting many entries. */
+static int
+read_local_header_sizes(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset) {
+    zip_dirent_t **order;
+    zip_uint64_t j, n;
+    zip_uint8_t *window;
+    zip_uint64_t window_offset, window_length;
+
+    if (ZIP_WANT_TORRENTZIP(za) || survivors < 2) {
+        return 0;
+    }
+
+    if ((order = (zip_dirent_t **)_zip_malloc(sizeof(order[0]) * (size_t)survivors)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    n = 0;
+    for (j = 0; j < survivors; j++) {
+        zip_entry_t *entry = za->entry + filelist[j].idx;
+
+        if (ENTRY_IS_COPYABLE(entry) && entry->orig->offset >= unchanged_offset && entry->orig->local_header_size == 0) {
+            order[n++] = entry->orig;
+        }
+    }
+    if (n < 2) {
+        _zip_free(order);
+        return 0;
+    }
+    qsort(order, (size_t)n, sizeof(order[0]), dirent_offset_compare);
+
+    window = NULL;
+    window_offset = window_length = 0;
+    for (j = 0; j < n; j++) {
+        zip_uint64_t length;
+
+        if (!_zip_local_header_window_fill(za->src, NULL, &window, &window_offset, &window_length, order[j]->offset, &za->error)) {
+            _zip_free(window);
+            _zip_free(order);
+            return -1;
+        }
+        /* truncated headers are read again and reported when copying */
+        if ((length = _zip_local_header_length(window, window_offset, window_length, order[j]->offset)) > 0 && order[j]->offset + length <= ZIP_INT64_MAX) {
+            order[j]->local_header_size = (zip_uint32_t)length;
+        }
+    }
+
+    _zip_free(window);
+    _zip_free(order);
+    return 0;
+}
+
+
+/* Whether the local header or data of entry change, as opposed to only its central directory entry. */
+static bool
+entry_has_local_changes(const zip_entry_t *entry) {
+    const zip_dirent_t *de = entry->changes;
+
+    if (ZIP_ENTRY_DATA_CHANGED(entry) || entry->deleted) {
+        return true;
+    }
+    if (de == NULL) {
+        return false;
+    }
+    if (de->changed & ~(zip_uint32_t)(ZIP_DIRENT_COMMENT | ZIP_DIRENT_ATTRIBUTES | ZIP_DIRENT_COMPRESSION_PARAMETERS)) {
+        return true;
+    }
+    /* the comment is only in the central directory, but its encoding affects the general purpose bit flags */
+    return (de->changed & ZIP_DIRENT_COMMENT) && entry->orig != NULL && _zip_dirent_needs_utf8_flag(de) != _zip_dirent_needs_utf8_flag(entry->orig);
+}
+
+
+/* Whether the data of unchanged entry idx is still aligned as requested when its local header is copied to offset. */
+static bool
+entry_keeps_alignment(zip_t *za, zip_uint64_t idx, zip_uint64_t offset) {
+    const zip_dirent_t *de = za->entry[idx].orig;
+    zip_error_t error;
+    bool ok;
+
+    if ((local_header_flags(za, de) & ZIP_FL_ALIGN) == 0) {
+        return true;
+    }
+
+    /* errors reading the local header are reported when copying the entry one by one */
+    zip_error_init(&error);
+    ok = _zip_file_get_offset(za, idx, &error) != 0 && (offset + de->local_header_size) % za->alignment == 0;
+    zip_error_fini(&error);
+
+    return ok;
+}
+
+
+/* Flags for writing the local header of de: data of stored entries is aligned if requested. */
+static zip_flags_t
+local_header_flags(const zip_t *za, const zip_dirent_t *de) {
+    if (za->alignment > 1 && !ZIP_WANT_TORRENTZIP(za) && ZIP_CM_ACTUAL(de->comp_method) == ZIP_CM_STORE && de->encryption_method == ZIP_EM_NONE) {
+        return ZIP_FL_LOCAL | ZIP_FL_ALIGN;
+    }
+    return ZIP_FL_LOCAL;
+}
+
+
+/* Whether the changes to the local header of entry idx can be written over the original one without moving anything:
+   new modification time or a new name of the same length, with both names ASCII and no UTF-8 name extra field. */
+static bool
+entry_local_header_is_patchable(zip_t *za, zip_uint64_t idx) {
+    const zip_entry_t *entry = za->entry + idx;
+    const zip_dirent_t *de = entry->changes;
+    const zip_uint8_t *name, *orig_name;
+    zip_uint32_t name_length, orig_name_length;
+    zip_uint8_t *data;
+    zip_buffer_t *buffer;
+    zip_error_t error;
+    bool ok;
+
+    if (de == NULL || entry->orig == NULL || ZIP_ENTRY_DATA_CHANGED(entry) || entry->deleted || (entry->orig->bitflags & ZIP_GPBF_DATA_DESCRIPTOR)) {
+        return false;
+    }
+    if ((de->changed & ~(zip_uint32_t)(ZIP_DIRENT_FILENAME | ZIP_DIRENT_LAST_MOD | ZIP_DIRENT_COMMENT | ZIP_DIRENT_ATTRIBUTES | ZIP_DIRENT_COMPRESSION_PARAMETERS)) || _zip_dirent_needs_utf8_flag(de) != _zip_dirent_needs_utf8_flag(entry->orig)) {
+        return false;
+    }
+    if ((de->changed & ZIP_DIRENT_FILENAME) == 0) {
+        return true;
+    }
+
+    if (_zip_guess_encoding(de->filename, ZIP_ENCODING_UNKNOWN) != ZIP_ENCODING_ASCII || _zip_guess_encoding(entry->orig->filename, ZIP_ENCODING_UNKNOWN) != ZIP_ENCODING_ASCII) {
+        return false;
+    }
+    name = _zip_string_get(de->filename, &name_length, ZIP_FL_ENC_RAW, NULL);
+    orig_name = _zip_string_get(entry->orig->filename, &orig_name_length, ZIP_FL_ENC_RAW, NULL);
+    if (name == NULL || orig_name == NULL || name_length != orig_name_length) {
+        return false;
+    }
+
+    /* the local header has to contain the same name as the central directory */
+    zip_error_init(&error);
+    if (_zip_file_get_offset(za, idx, &error) == 0 || zip_source_seek(za->src, (zip_int64_t)entry->orig->offset, SEEK_SET) < 0 || (data = _zip_read_data(NULL, za->src, entry->orig->local_header_size, false, &error)) == NULL) {
+        zip_error_fini(&error);
+        return false;
+    }
+    zip_error_fini(&error);
+    if ((buffer = _zip_buffer_new(data, entry->orig->local_header_size)) == NULL) {
+        _zip_free(data);
+        return false;
+    }
+    _zip_buffer_set_offset(buffer, 26);
+    ok = _zip_buffer_get_16(buffer) == orig_name_length;
+    _zip_buffer_get_16(buffer);
+    ok = ok && memcmp(_zip_buffer_get(buffer, orig_name_length), orig_name, orig_name_length) == 0;
+    while (ok && _zip_buffer_left(buffer) >= 4) {
+        zip_uint16_t id = _zip_buffer_get_16(buffer);
+
+        ok = id != ZIP_EF_UTF_8_NAME && _zip_buffer_skip(buffer, _zip_buffer_get_16(buffer)) == 0;
+    }
+    _zip_buffer_free(buffer);
+    _zip_free(data);
+
+    return ok;
+}
+
+
+/* Write new modification time and name of entry over its original local header, see entry_local_header_is_patchable. */
+static int
+patch_local_header(zip_t *za, const zip_entry_t *entry) {
+    const zip_dirent_t *de = entry->changes;
+    zip_int64_t off;
+
+    if ((off = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    if (de->changed & ZIP_DIRENT_LAST_MOD) {
+        zip_uint8_t data[4];
+        zip_buffer_t *buffer;
+        zip_uint16_t dostime, dosdate;
+
+        if ((buffer = _zip_buffer_new(data, sizeof(data))) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        _zip_dirent_get_dos_time(de, &dostime, &dosdate);
+        _zip_buffer_put_16(buffer, dostime);
+        _zip_buffer_put_16(buffer, dosdate);
+        _zip_buffer_free(buffer);
+
+        if (zip_source_seek_write(za->src, (zip_int64_t)(entry->orig->offset + 10), SEEK_SET) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            return -1;
+        }
+        if (_zip_write(za, data, sizeof(data)) < 0) {
+            return -1;
+        }
+    }
+
+    if (de->changed & ZIP_DIRENT_FILENAME) {
+        const zip_uint8_t *name;
+        zip_uint32_t name_length;
+
+        if ((name = _zip_string_get(de->filename, &name_length, ZIP_FL_ENC_RAW, &za->error)) == NULL) {
+            return -1;
+        }
+        if (zip_source_seek_write(za->src, (zip_int64_t)(entry->orig->offset + LENTRYSIZE), SEEK_SET) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            return -1;
+        }
+        if (_zip_write(za, name, name_length) < 0) {
+            return -1;
+        }
+    }
+
+    if (zip_source_seek_write(za->src, off, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* create new local directory entry */
+static int
+prepare_entry(zip_t *za, zip_uint64_t idx) {
+    zip_entry_t *entry = za->entry + idx;
+
+    if (entry->changes == NULL) {
+        if ((entry->changes = _zip_dirent_clone(entry->orig)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+    }
+
+    if (_zip_read_local_ef(za, idx) < 0) {
+        return -1;
+    }
+
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        zip_dirent_torrentzip_normalize(entry->changes);
+    }
+
+    return 0;
+}
+
+
+/* Return number of bytes of data processed when writing entry idx, to weight its share of progress. */
+static zip_uint64_t
+progress_size(zip_t *za, zip_uint64_t idx) {
+    zip_entry_t *entry = za->entry + idx;
+    zip_stat_t st;
+
+    if (ZIP_ENTRY_DATA_CHANGED(entry)) {
+        /* size is unknown for some sources, e.g. streams */
+        if (zip_source_stat(entry->source, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0) {
+            return 0;
+        }
+        return st.size;
+    }
+    if (entry->orig == NULL) {
+        return 0;
+    }
+
+    return ENTRY_NEEDS_NEW_DATA(za, entry) ? entry->orig->uncomp_size : entry->orig->comp_size;
+}
+
+
+/* Return upper bound of bytes written after unchanged_offset, 0 if the size of new data is unknown. */
+static zip_uint64_t
+estimate_output_size(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset) {
+    zip_uint64_t j, size, data_size, prefix_length;
+    zip_entry_t *entry;
+    zip_dirent_t *de;
+    zip_stat_t st;
 
-    if (needs_encrypt) {
-        zip_encryption_implementation impl;
-        const char *password = NULL;
+    size = EOCDLEN + EOCD64LOCLEN + EOCD64LEN + _zip_string_length(za->comment_orig) + _zip_string_length(za->comment_changes);
 
-        if (de->password) {
-            password = de->password;
+    if (unchanged_offset == 0 && !ZIP_WANT_TORRENTZIP(za)) {
+        if (za->prefix_changed) {
+            size += za->prefix_changes_length;
         }
-        else if (za->default_password) {
-            password = za->default_password;
+        else if (_zip_archive_prefix_length(za, &prefix_length, &za->error)) {
+            size += prefix_length;
         }
+    }
 
-        if ((impl = _zip_get_encryption_implementation(de->encryption_method, ZIP_CODEC_ENCODE)) == NULL) {
-            zip_error_set(&za->error, ZIP_ER_ENCRNOTSUPP, 0);
-            zip_source_free(src_final);
-            return -1;
-        }
+    for (j = 0; j < survivors; j++) {
+        entry = za->entry + filelist[j].idx;
+        de = entry->changes ? entry->changes : entry->orig;
 
-        if (de->encryption_method == ZIP_EM_TRAD_PKWARE) {
-            de->bitflags |= ZIP_GPBF_DATA_DESCRIPTOR;
+        /* headers, with room for Zip64, encryption, and UTF-8 name extra fields */
+        size += CDENTRYSIZE + 2 * (zip_uint64_t)_zip_string_length(de->filename) + _zip_ef_size(de->extra_fields, ZIP_EF_CENTRAL) + de->raw_extra_fields_length + _zip_string_length(de->comment) + 64;
+        if (entry->orig != NULL && entry->orig->offset < unchanged_offset) {
+            continue;
+        }
+        size += LENTRYSIZE + 2 * (zip_uint64_t)_zip_string_length(de->filename) + _zip_ef_size(de->extra_fields, ZIP_EF_LOCAL) + de->raw_extra_fields_length + 64 + MAX_DATA_DESCRIPTOR_LENGTH;
 
-            /* PKWare encryption uses last_mod, make sure it gets the right value. */
-            if (de->changed & ZIP_DIRENT_LAST_MOD) {
-                zip_stat_t st_mtime;
-                zip_stat_init(&st_mtime);
-                st_mtime.valid = ZIP_STAT_MTIME;
-                st_mtime.mtime = de->last_mod;
-                if ((src_tmp = _zip_source_window_new(src_final, 0, -1, &st_mtime, 0, NULL, NULL, 0, true, &za->error)) == NULL) {
-                    zip_source_free(src_final);
-                    return -1;
+        if (!ENTRY_NEEDS_NEW_DATA(za, entry)) {
+            data_size = entry->orig->comp_size;
+        }
+        else {
+            if (ZIP_ENTRY_DATA_CHANGED(entry)) {
+                if (zip_source_stat(entry->source, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0) {
+                    return 0;
+                }
+                data_size = st.size;
+            }
+            else {
+                data_size = entry->orig->uncomp_size;
+            }
+            if (ZIP_CM_ACTUAL(de->comp_method) != ZIP_CM_STORE) {
+                if ((data_size = _zip_compression_maximum_size(ZIP_CM_ACTUAL(de->comp_method), de->compression_level, data_size)) == ZIP_UINT64_MAX) {
+                    return 0;
                 }
-                src_final = src_tmp;
             }
         }
-
-        if ((src_tmp = impl(za, src_final, de->encryption_method, ZIP_CODEC_ENCODE, password)) == NULL) {
-            /* error set by impl */
-            zip_source_free(src_final);
-            return -1;
+        if (data_size > ZIP_UINT64_MAX - size) {
+            return 0;
         }
-
-        src_final = src_tmp;
+        size += data_size;
     }
 
+    return size;
+}
 
-    if ((offdata = zip_source_tell_write(za->src)) < 0) {
-        zip_error_set_from_source(&za->error, za->src);
+
+/* Set progress section to entries j to k - 1 of filelist. */
+static int
+progress_subrange(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t j, zip_uint64_t k) {
+    if (_zip_progress_subrange(za->progress, j > 0 ? filelist[j - 1].progress_end : 0, filelist[k - 1].progress_end) != 0) {
+        zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
         return -1;
     }
 
-    ret = copy_source(za, src_final, data_length);
+    return 0;
+}
 
-    if (zip_source_stat(src_final, &st) < 0) {
-        zip_error_set_from_source(&za->error, src_final);
-        ret = -1;
-    }
 
-    if (zip_source_get_file_attributes(src_final, &attributes) != 0) {
-        zip_error_set_from_source(&za->error, src_final);
-        ret = -1;
+#ifdef HAVE_THREADS
+/* Whether src can be read in a worker thread: not shared and not reading from an archive, unless it allows reading from multiple threads. */
+static bool
+source_is_independent(zip_source_t *src) {
+    for (; src != NULL; src = src->src) {
+        if ((src->source_archive != NULL && (src->source_archive->open_flags & ZIP_THREADSAFE) == 0) || ZIP_REFCOUNT_GET(src->refcount) > 1) {
+            return false;
+        }
     }
+    return true;
+}
 
-    zip_source_free(src_final);
 
-    if (ret < 0) {
-        return -1;
+/* Whether src reads data from another archive. */
+static bool
+source_reads_archive(zip_source_t *src) {
+    for (; src != NULL; src = src->src) {
+        if (src->source_archive != NULL) {
+            return true;
+        }
     }
+    return false;
+}
 
-    if ((offend = zip_source_tell_write(za->src)) < 0) {
-        zip_error_set_from_source(&za->error, za->src);
-        return -1;
+
+/* Whether base is src or one of its lower layers. */
+static bool
+source_reads_from(zip_source_t *src, zip_source_t *base) {
+    for (; src != NULL; src = src->src) {
+        if (src == base) {
+            return true;
+        }
     }
+    return false;
+}
 
-    if (zip_source_seek_write(za->src, offstart, SEEK_SET) < 0) {
-        zip_error_set_from_source(&za->error, za->src);
-        return -1;
+
+/* Wait for outstanding write, return -1 and set error of za if any write failed. Frees writer. */
+static int
+write_behind_finish(zip_t *za, write_behind_t *writer) {
+    int ret;
+
+    if (writer->in_flight) {
+        _zip_thread_pool_wait(writer->pool, &writer->job);
+    }
+    if ((ret = writer->ret) < 0) {
+        _zip_error_copy(&za->error, &writer->error);
     }
 
-    if ((st.valid & (ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_SIZE)) != (ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_SIZE)) {
-        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
-        return -1;
+    _zip_thread_pool_free(writer->pool);
+    _zip_free(writer->allocated);
+    zip_error_fini(&writer->error);
+    _zip_free(writer);
+
+    return ret;
+}
+
+
+/* Create writer with second buffer, NULL if none can be created, in which case data is written directly. */
+static write_behind_t *
+write_behind_new(zip_t *za) {
+    write_behind_t *writer;
+    zip_error_t error;
+
+    if ((writer = (write_behind_t *)_zip_malloc(sizeof(*writer))) == NULL) {
+        return NULL;
+    }
+    if ((writer->buffer = (zip_uint8_t *)_zip_malloc((size_t)za->io_buffer_size)) == NULL) {
+        _zip_free(writer);
+        return NULL;
+    }
+    zip_error_init(&error);
+    writer->pool = _zip_thread_pool_new(1, &error);
+    zip_error_fini(&error);
+    if (writer->pool == NULL) {
+        _zip_free(writer->buffer);
+        _zip_free(writer);
+        return NULL;
     }
 
-    if ((de->changed & ZIP_DIRENT_LAST_MOD) == 0) {
-        if (st.valid & ZIP_STAT_MTIME)
-            de->last_mod = st.mtime;
-        else
-            time(&de->last_mod);
+    writer->allocated = writer->buffer;
+    writer->job.run = write_behind_run;
+    writer->job.ud = writer;
+    writer->za = za;
+    writer->in_flight = false;
+    writer->ret = 0;
+    zip_error_init(&writer->error);
+
+    return writer;
+}
+
+
+/* Runs in worker thread, only uses output of archive. */
+static void
+write_behind_run(void *ud) {
+    write_behind_t *writer = (write_behind_t *)ud;
+    zip_t *za = writer->za;
+    zip_int64_t n;
+
+    if ((n = zip_source_write(za->src, writer->data, writer->length)) < 0) {
+        zip_error_set_from_source(&writer->error, za->src);
+        writer->ret = -1;
+        return;
+    }
+    if ((zip_uint64_t)n != writer->length) {
+        zip_error_set(&writer->error, ZIP_ER_WRITE, EINTR);
+        writer->ret = -1;
+        return;
     }
-    de->comp_method = st.comp_method;
-    de->crc = st.crc;
-    de->uncomp_size = st.size;
-    de->comp_size = (zip_uint64_t)(offend - offdata);
-    _zip_dirent_apply_attributes(de, &attributes, (flags & ZIP_FL_FORCE_ZIP64) != 0, changed);
 
-    if (ZIP_WANT_TORRENTZIP(za)) {
-        zip_dirent_torrentzip_normalize(de);
+    if (za->write_crc != NULL) {
+        *za->write_crc = _zip_crc32(*za->write_crc, writer->data, writer->length);
     }
+}
 
-    if ((ret = _zip_dirent_write(za, de, flags)) < 0)
-        return -1;
 
-    if (is_zip64 != ret) {
-        /* Zip64 mismatch between preliminary file header written before data and final file header written afterwards */
-        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+/* Start writing length bytes from *bufp in worker thread, replace *bufp with buffer to fill next. */
+static int
+write_behind_write(write_behind_t *writer, zip_uint8_t **bufp, zip_uint64_t length) {
+    zip_uint8_t *buf = *bufp;
+
+    if (writer->in_flight) {
+        _zip_thread_pool_wait(writer->pool, &writer->job);
+        writer->in_flight = false;
+    }
+    if (writer->ret < 0) {
         return -1;
     }
 
-    if (zip_source_seek_write(za->src, offend, SEEK_SET) < 0) {
-        zip_error_set_from_source(&za->error, za->src);
-        return -1;
+    writer->data = buf;
+    writer->length = length;
+    writer->in_flight = true;
+    _zip_thread_pool_submit(writer->pool, &writer->job);
+
+    *bufp = writer->buffer;
+    writer->buffer = buf;
+
+    return 0;
+}
+#endif
+
+
+/* Replace digest of entry idx by digest computed while writing its data to src, if ZIP_AFL_DIGEST is set. */
+static int
+update_digest(zip_t *za, zip_uint64_t idx, zip_source_t *src) {
+    zip_uint8_t digest[ZIP_DIGEST_LENGTH];
+
+    /* a digest of the plaintext would help guessing encrypted data */
+    if ((za->ch_flags & ZIP_AFL_DIGEST) && za->entry[idx].changes->encryption_method == ZIP_EM_NONE && _zip_source_crc_get_digest(src, digest)) {
+        return _zip_digest_set(za, idx, digest);
     }
 
-    if (de->bitflags & ZIP_GPBF_DATA_DESCRIPTOR) {
-        if (write_data_descriptor(za, de, is_zip64) < 0) {
-            return -1;
-        }
+    return _zip_digest_set(za, idx, NULL);
+}
+
+
+/* Replace seek index of entry idx by seek points recorded while compressing its data to src. */
+static int
+update_seek_index(zip_t *za, zip_uint64_t idx, zip_source_t *src) {
+    const zip_seek_point_t *points = NULL;
+    zip_uint64_t npoints = 0;
+
+    /* offsets would be off in encrypted data */
+    if (za->entry[idx].changes->encryption_method == ZIP_EM_NONE) {
+        points = _zip_source_compress_seek_points(src, &npoints);
     }
 
-    return 0;
+    return _zip_seek_index_set(za, idx, points, points != NULL ? npoints : 0);
 }
 
 
+/* Write central directory and return its segments in SEGMENTSP.
+   If APPEND_SEGMENT, only the new entries are written, as a new segment after the existing ones. */
+
 static int
-copy_data(zip_t *za, zip_uint64_t len) {
-    DEFINE_BYTE_ARRAY(buf, BUFSIZE);
-    double total = (double)len;
+write_cdir(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, bool append_segment, zip_cdir_segment_t **segmentsp, zip_uint64_t *nsegmentsp) {
+    zip_cdir_segment_t *segments;
+    zip_uint64_t first, nsegments;
+    zip_int64_t offset, size;
 
-    if (!byte_array_init(buf, BUFSIZE)) {
+    first = append_segment ? za->nentry_orig : 0;
+    nsegments = append_segment ? za->ncdir_segments : 0;
+
+    if ((segments = (zip_cdir_segment_t *)_zip_malloc(sizeof(segments[0]) * (size_t)(nsegments + 1))) == NULL) {
         zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
         return -1;
     }
 
-    while (len > 0) {
-        zip_uint64_t n = ZIP_MIN(len, BUFSIZE);
-
-        if (_zip_read(za->src, buf, n, &za->error) < 0) {
-            byte_array_fini(buf);
-            return -1;
-        }
+    if ((offset = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        _zip_free(segments);
+        return -1;
+    }
 
-        if (_zip_write(za, buf, n) < 0) {
-            byte_array_fini(buf);
+    if ((za->ch_flags & ZIP_AFL_EMBED_INDEX) && !append_segment && !ZIP_WANT_TORRENTZIP(za) && survivors > 0) {
+        if (write_cdir_embedded_index(za, filelist, survivors, &offset, &size) < 0) {
+            _zip_free(segments);
             return -1;
         }
+        /* entry containing the index is part of the central directory */
+        survivors++;
+    }
+    else if ((size = _zip_cdir_write(za, filelist + first, survivors - first, za->cdir_segments, nsegments)) < 0) {
+        _zip_free(segments);
+        return -1;
+    }
 
-        len -= n;
+    if (zip_source_tell_write(za->src) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        _zip_free(segments);
+        return -1;
+    }
 
-        if (_zip_progress_update(za->progress, (total - (double)len) / total) != 0) {
-            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
-            return -1;
-        }
+    if (nsegments > 0) {
+        (void)memcpy_s(segments, sizeof(segments[0]) * (size_t)nsegments, za->cdir_segments, sizeof(segments[0]) * (size_t)nsegments);
     }
+    segments[nsegments].offset = (zip_uint64_t)offset;
+    segments[nsegments].size = (zip_uint64_t)size;
+    segments[nsegments].nentry = survivors - first;
 
-    byte_array_fini(buf);
+    *segmentsp = segments;
+    *nsegmentsp = nsegments + 1;
     return 0;
 }
 
 
+/* Write central directory of SURVIVORS entries of FILELIST, preceded by an entry containing their index and followed by that entry's own record, see ZIP_AFL_EMBED_INDEX.
+   Sets *OFFSETP and *SIZEP to offset and size of the central directory. */
+
 static int
-copy_source(zip_t *za, zip_source_t *src, zip_int64_t data_length) {
-    DEFINE_BYTE_ARRAY(buf, BUFSIZE);
-    zip_int64_t n, current;
-    int ret;
+write_cdir_embedded_index(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_int64_t *offsetp, zip_int64_t *sizep) {
+    zip_source_t *src, *records_src;
+    zip_phase_stats_t *stats;
+    zip_buffer_t *records, *data;
+    zip_dirent_t *de;
+    zip_stat_t st;
+    zip_int64_t offset, cdir_offset, end;
+    zip_uint64_t data_offset;
+    int is_zip64, ret;
 
-    if (zip_source_open(src) < 0) {
-        zip_error_set_from_source(&za->error, src);
+    /* the index is built from the central directory records, which are written after it */
+    if ((records_src = zip_source_buffer_create(NULL, 0, 0, &za->error)) == NULL) {
+        return -1;
+    }
+    if (zip_source_begin_write(records_src) < 0) {
+        zip_error_set_from_source(&za->error, records_src);
+        zip_source_free(records_src);
+        return -1;
+    }
+    src = za->src;
+    stats = za->stats;
+    za->src = records_src;
+    za->stats = NULL;
+    is_zip64 = _zip_cdir_write_entries(za, filelist, survivors);
+    za->src = src;
+    za->stats = stats;
+    if (is_zip64 < 0) {
+        zip_source_rollback_write(records_src);
+        zip_source_free(records_src);
+        return -1;
+    }
+    if (zip_source_commit_write(records_src) < 0 || zip_source_stat(records_src, &st) < 0 || zip_source_open(records_src) < 0) {
+        zip_error_set_from_source(&za->error, records_src);
+        zip_source_free(records_src);
+        return -1;
+    }
+    records = _zip_buffer_new_from_source(records_src, st.size, NULL, &za->error);
+    zip_source_close(records_src);
+    zip_source_free(records_src);
+    if (records == NULL) {
         return -1;
     }
 
-    if (!byte_array_init(buf, BUFSIZE)) {
-        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+    if ((offset = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        _zip_buffer_free(records);
         return -1;
     }
+    data_offset = (zip_uint64_t)offset + LENTRYSIZE + strlen(ZIP_EMBEDDED_INDEX_NAME);
 
-    ret = 0;
-    current = 0;
-    while ((n = zip_source_read(src, buf, BUFSIZE)) > 0) {
-        if (_zip_write(za, buf, (zip_uint64_t)n) < 0) {
-            ret = -1;
-            break;
+    if ((data = _zip_cdir_index_embedded_new(_zip_buffer_data(records), _zip_buffer_size(records), survivors, data_offset, &za->error)) == NULL) {
+        _zip_buffer_free(records);
+        return -1;
+    }
+
+    if ((de = _zip_dirent_new()) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        _zip_buffer_free(data);
+        _zip_buffer_free(records);
+        return -1;
+    }
+    if ((de->filename = _zip_string_new((const zip_uint8_t *)ZIP_EMBEDDED_INDEX_NAME, (zip_uint16_t)strlen(ZIP_EMBEDDED_INDEX_NAME), ZIP_FL_ENC_GUESS, &za->error)) == NULL) {
+        _zip_dirent_free(de);
+        _zip_buffer_free(data);
+        _zip_buffer_free(records);
+        return -1;
+    }
+    de->comp_method = ZIP_CM_STORE;
+    /* fixed time so unchanged archives are written identically */
+    de->last_mod_dos = true;
+    de->dos_date = 0x21;
+    de->dos_time = 0;
+    de->crc = _zip_crc32(0, _zip_buffer_data(data), _zip_buffer_size(data));
+    de->comp_size = de->uncomp_size = _zip_buffer_size(data);
+    de->offset = (zip_uint64_t)offset;
+
+    ret = -1;
+    if (_zip_dirent_write(za, de, ZIP_FL_LOCAL) >= 0) {
+        if ((cdir_offset = zip_source_tell_write(za->src)) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
         }
-        if (n == BUFSIZE && za->progress && data_length > 0) {
-            current += n;
-            if (_zip_progress_update(za->progress, (double)current / (double)data_length) != 0) {
-                zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
-                ret = -1;
-                break;
+        else if ((zip_uint64_t)cdir_offset != data_offset) {
+            /* index contains offsets computed from expected size of local header */
+            zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+        }
+        else if (_zip_write(za, _zip_buffer_data(data), _zip_buffer_size(data)) == 0 && _zip_write(za, _zip_buffer_data(records), _zip_buffer_size(records)) == 0 && (ret = _zip_dirent_write(za, de, ZIP_FL_CENTRAL)) >= 0) {
+            is_zip64 |= ret;
+            ret = -1;
+            cdir_offset += (zip_int64_t)_zip_buffer_size(data);
+            if ((end = zip_source_tell_write(za->src)) < 0) {
+                zip_error_set_from_source(&za->error, za->src);
+            }
+            else if (_zip_cdir_write_end(za, (zip_uint64_t)cdir_offset, (zip_uint64_t)(end - cdir_offset), survivors + 1, is_zip64 > 0, 0, NULL, 0) == 0) {
+                *offsetp = cdir_offset;
+                *sizep = end - cdir_offset;
+                ret = 0;
             }
         }
     }
 
-    if (n < 0) {
-        zip_error_set_from_source(&za->error, src);
-        ret = -1;
+    _zip_dirent_free(de);
+    _zip_buffer_free(data);
+    _zip_buffer_free(records);
+    return ret;
+}
+
+
+/* Whether only entries are added, so that their central directory can be appended as a new segment, see ZIP_AFL_LOG_STRUCTURED. */
+
+static bool
+cdir_segment_appendable(const zip_t *za, zip_uint64_t survivors) {
+    zip_uint64_t i, nentry;
+
+    if ((za->ch_flags & ZIP_AFL_LOG_STRUCTURED) == 0 || za->cdir_segments == NULL || za->ncdir_segments >= ZIP_CDIR_MAX_SEGMENTS || survivors <= za->nentry_orig) {
+        return false;
     }
 
-    byte_array_fini(buf);
+    nentry = 0;
+    for (i = 0; i < za->ncdir_segments; i++) {
+        nentry += za->cdir_segments[i].nentry;
+    }
+    if (nentry != za->nentry_orig) {
+        return false;
+    }
 
-    zip_source_close(src);
+    /* existing entries must stay as they are in the segments already written */
+    for (i = 0; i < za->nchange_log; i++) {
+        if (ZIP_ENTRY_HAS_CHANGES(za->entry + za->change_log[i])) {
+            return false;
+        }
+    }
 
-    return ret;
+    return true;
 }
 
+
+/* Write archive prefix at start of new archive; an unchanged one is copied from the original archive in one go. */
 static int
-write_cdir(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors) {
-    if (zip_source_tell_write(za->src) < 0) {
-        return -1;
+write_prefix(zip_t *za) {
+    zip_progress_t *progress;
+    zip_uint64_t length;
+    int ret;
+
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        /* torrentzip archives start with their first entry */
+        return 0;
     }
 
-    if (_zip_cdir_write(za, filelist, survivors) < 0) {
-        return -1;
+    if (za->prefix_changed) {
+        return za->prefix_changes_length > 0 ? _zip_write(za, za->prefix_changes, za->prefix_changes_length) : 0;
     }
 
-    if (zip_source_tell_write(za->src) < 0) {
+    if (!_zip_archive_prefix_length(za, &length, &za->error)) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    if (zip_source_seek(za->src, 0, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
         return -1;
     }
 
-    return 0;
+    /* progress is reported for entries only */
+    progress = za->progress;
+    za->progress = NULL;
+    ret = copy_data(za, length);
+    za->progress = progress;
+
+    return ret;
+}
+
+
+static void
+entry_changes(const zip_entry_t *e, int *changed, zip_uint64_t *deleted) {
+    if (ZIP_ENTRY_HAS_CHANGES(e)) {
+        *changed = 1;
+    }
+    if (e->deleted) {
+        *deleted += 1;
+    }
 }
 
 
 int
 _zip_changed(const zip_t *za, zip_uint64_t *survivorsp) {
     int changed;
-    zip_uint64_t i, survivors;
+    zip_uint64_t i, deleted;
 
     changed = 0;
-    survivors = 0;
+    deleted = 0;
 
-    if (za->comment_changed || (ZIP_WANT_TORRENTZIP(za) && !ZIP_IS_TORRENTZIP(za))) {
+    if (za->comment_changed || za->prefix_changed || za->alignment != za->alignment_orig || (ZIP_WANT_TORRENTZIP(za) && !ZIP_IS_TORRENTZIP(za)) || ((za->flags ^ za->ch_flags) & ZIP_AFL_EMBED_INDEX) || za->data_order != NULL) {
         changed = 1;
     }
 
-    for (i = 0; i < za->nentry; i++) {
-        if (ZIP_ENTRY_HAS_CHANGES(&za->entry[i])) {
-            changed = 1;
-        }
-        if (!za->entry[i].deleted) {
-            survivors++;
-        }
+    /* only logged and new entries can have changes */
+    for (i = 0; i < za->nchange_log; i++) {
+        entry_changes(za->entry + za->change_log[i], &changed, &deleted);
+    }
+    for (i = za->nentry_orig; i < za->nentry; i++) {
+        entry_changes(za->entry + i, &changed, &deleted);
     }
 
     if (survivorsp) {
-        *survivorsp = survivors;
+        *survivorsp = za->nentry - deleted;
     }
 
     return changed;
@@ -730,6 +2893,56 @@ write_data_descriptor(zip_t *za, const zip_dirent_t *de, int is_zip64) {
 }
 
 
+/* Move entries of FILELIST, which is in index order, that are listed in za->data_order to its start, in that order, see zip_set_data_order(). */
+static int
+filelist_apply_data_order(zip_t *za, zip_filelist_t *filelist, zip_uint64_t survivors) {
+    zip_filelist_t *ordered;
+    zip_uint64_t *position;
+    zip_uint64_t i, j, n;
+
+    if ((position = (zip_uint64_t *)_zip_malloc(sizeof(position[0]) * (size_t)za->nentry)) == NULL || (ordered = (zip_filelist_t *)_zip_malloc(sizeof(ordered[0]) * (size_t)survivors)) == NULL) {
+        _zip_free(position);
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    for (i = 0; i < za->nentry; i++) {
+        position[i] = ZIP_UINT64_MAX;
+    }
+    for (j = 0; j < survivors; j++) {
+        position[filelist[j].idx] = j;
+    }
+
+    n = 0;
+    for (i = 0; i < za->ndata_order; i++) {
+        /* deleted entries and entries removed by zip_unchange_all() are skipped */
+        if (za->data_order[i] < za->nentry && position[za->data_order[i]] != ZIP_UINT64_MAX) {
+            ordered[n++] = filelist[position[za->data_order[i]]];
+            position[za->data_order[i]] = ZIP_UINT64_MAX;
+        }
+    }
+    for (j = 0; j < survivors; j++) {
+        if (position[filelist[j].idx] != ZIP_UINT64_MAX) {
+            ordered[n++] = filelist[j];
+        }
+    }
+
+    (void)memcpy_s(filelist, sizeof(filelist[0]) * (size_t)survivors, ordered, sizeof(ordered[0]) * (size_t)survivors);
+    _zip_free(ordered);
+    _zip_free(position);
+
+    return 0;
+}
+
+
+static int
+filelist_compare_index(const void *a, const void *b) {
+    zip_uint64_t aidx = ((const zip_filelist_t *)a)->idx;
+    zip_uint64_t bidx = ((const zip_filelist_t *)b)->idx;
+
+    return aidx < bidx ? -1 : aidx > bidx;
+}
+
+
 static int torrentzip_compare_names(const void *a, const void *b) {
     const char *aname = ((const zip_filelist_t *)a)->name;
     const char *bname = ((const zip_filelist_t *)b)->name;
@@ -0,0 +1,136 @@
+/*
+  zip_close_async.c -- close zip archive in background
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_THREADS
+typedef struct {
+    zip_t *za;
+    zip_close_callback callback;
+    void *ud;
+} close_task_t;
+
+static void close_task_run(void *ud);
+static void *close_thread(void *ud);
+#endif
+
+
+ZIP_EXTERN int
+zip_close_async(zip_t *za, zip_close_callback callback, void *ud) {
+#ifndef HAVE_THREADS
+    (void)callback;
+    (void)ud;
+
+    if (za == NULL) {
+        return -1;
+    }
+    zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+    return -1;
+#else
+    close_task_t *task;
+    zip_executor_t executor;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret;
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (callback == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if ((task = (close_task_t *)_zip_malloc(sizeof(*task))) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    task->za = za;
+    task->callback = callback;
+    task->ud = ud;
+
+    /* From here on, the archive belongs to the task until the callback is called. */
+    if (_zip_executor_get(&executor) && executor.submit(executor.ud, close_task_run, task) == 0) {
+        return 0;
+    }
+
+    /* no executor, or it refused the task */
+    if ((ret = pthread_attr_init(&attr)) == 0) {
+        if ((ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) == 0) {
+            ret = pthread_create(&thread, &attr, close_thread, task);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if (ret != 0) {
+        _zip_free(task);
+        zip_error_set(&za->error, ZIP_ER_INTERNAL, ret);
+        return -1;
+    }
+
+    return 0;
+#endif
+}
+
+
+#ifdef HAVE_THREADS
+/* Close archive and report result; the archive is passed to the callback only if closing it failed. */
+static void
+close_task_run(void *ud) {
+    close_task_t *task = (close_task_t *)ud;
+    zip_t *za = task->za;
+    zip_close_callback callback = task->callback;
+    void *callback_ud = task->ud;
+
+    _zip_free(task);
+
+    if (zip_close(za) == 0) {
+        za = NULL;
+    }
+    callback(za, callback_ud);
+}
+
+
+static void *
+close_thread(void *ud) {
+    close_task_run(ud);
+    return NULL;
+}
+#endif
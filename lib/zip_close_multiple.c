@@ -0,0 +1,355 @@
+/*
+  zip_close_multiple.c -- write several archives, compressing shared data once
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+#define SHARE_NONE ZIP_UINT64_MAX
+
+/* A file with new data in one of the archives. Files of different archives with the same source and compression settings share the data
+   written for the first of them: that archive is committed instead of closed, and the others copy the compressed data from it. */
+typedef struct {
+    zip_source_t *source;
+    zip_int32_t comp_method;
+    zip_uint32_t compression_level;
+    zip_uint64_t archive; /* index in archives */
+    zip_uint64_t idx;
+    zip_uint64_t writer;  /* index of share whose data is copied, SHARE_NONE if data is written from source */
+    bool has_readers;     /* other shares copy data of this one */
+    char *name;           /* raw name, to find entry after archive was committed */
+    zip_source_t *replaced; /* source of entry while it copies data from writer */
+} share_t;
+
+static int find_shares(zip_t **archives, zip_uint64_t narchives, share_t **sharesp, zip_uint64_t *nsharesp);
+static void free_shares(share_t *shares, zip_uint64_t nshares);
+static bool is_writer(const share_t *shares, zip_uint64_t nshares, zip_uint64_t archive);
+static int share_compare(const void *a, const void *b);
+static int share_compare_data(const share_t *sa, const share_t *sb);
+static bool share_candidate(zip_t *za, zip_uint64_t idx, share_t *share);
+static void share_finish(zip_t *za, share_t *shares, zip_uint64_t nshares, zip_uint64_t archive);
+static int share_start(zip_t **archives, share_t *shares, zip_uint64_t nshares, zip_uint64_t archive);
+
+
+ZIP_EXTERN int
+zip_close_multiple(zip_t **archives, zip_uint64_t narchives) {
+    share_t *shares;
+    zip_uint64_t nshares, i, j, k;
+    int ret;
+
+    if (archives == NULL) {
+        return -1;
+    }
+    for (i = 0; i < narchives; i++) {
+        if (archives[i] == NULL) {
+            return -1;
+        }
+        for (j = 0; j < i; j++) {
+            if (archives[j] == archives[i]) {
+                zip_error_set(&archives[i]->error, ZIP_ER_INVAL, 0);
+                return -1;
+            }
+        }
+    }
+
+    if (find_shares(archives, narchives, &shares, &nshares) < 0) {
+        return -1;
+    }
+
+    ret = 0;
+    for (k = 0; k < narchives; k++) {
+        bool writer = is_writer(shares, nshares, k);
+
+        if (share_start(archives, shares, nshares, k) < 0) {
+            share_finish(archives[k], shares, nshares, k);
+            ret = -1;
+            break;
+        }
+        /* archives others copy data from are kept open until they are written */
+        if ((writer ? zip_commit(archives[k]) : zip_close(archives[k])) < 0) {
+            share_finish(archives[k], shares, nshares, k);
+            ret = -1;
+            break;
+        }
+        share_finish(NULL, shares, nshares, k);
+        if (!writer) {
+            archives[k] = NULL;
+        }
+    }
+
+    /* committed archives have been written, no changes are left */
+    for (i = 0; i < k; i++) {
+        if (archives[i] != NULL) {
+            zip_discard(archives[i]);
+            archives[i] = NULL;
+        }
+    }
+
+    free_shares(shares, nshares);
+
+    return ret;
+}
+
+
+/* Collect files with new data of all archives and decide which of them copy data written for another. */
+static int
+find_shares(zip_t **archives, zip_uint64_t narchives, share_t **sharesp, zip_uint64_t *nsharesp) {
+    share_t *shares;
+    zip_uint64_t i, j, k, nshares, count;
+
+    *sharesp = NULL;
+    *nsharesp = 0;
+
+    count = 0;
+    for (k = 0; k < narchives; k++) {
+        count += archives[k]->nentry;
+    }
+    if (count < 2) {
+        return 0;
+    }
+    if (count > SIZE_MAX / sizeof(shares[0]) || (shares = (share_t *)_zip_malloc(sizeof(shares[0]) * (size_t)count)) == NULL) {
+        zip_error_set(&archives[0]->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    nshares = 0;
+    for (k = 0; k < narchives; k++) {
+        zip_t *za = archives[k];
+
+        /* data copied as is gets no digest, committing needs to read back the archive */
+        if (ZIP_WANT_TORRENTZIP(za) || (za->ch_flags & ZIP_AFL_DIGEST) || ZIP_IS_STREAMING(za)) {
+            continue;
+        }
+        for (i = 0; i < za->nentry; i++) {
+            if (share_candidate(za, i, shares + nshares)) {
+                shares[nshares].archive = k;
+                nshares++;
+            }
+        }
+    }
+
+    qsort(shares, (size_t)nshares, sizeof(shares[0]), share_compare);
+
+    for (i = 0; i < nshares; i = j) {
+        for (j = i + 1; j < nshares && share_compare_data(shares + i, shares + j) == 0; j++) {
+            /* further files of the same archive are left to ZIP_AFL_DEDUPLICATE */
+            if (shares[j].archive != shares[i].archive) {
+                shares[j].writer = i;
+                shares[i].has_readers = true;
+            }
+        }
+        if (shares[i].has_readers) {
+            zip_t *za = archives[shares[i].archive];
+            const char *name;
+
+            if ((name = _zip_get_name(za, shares[i].idx, ZIP_FL_ENC_RAW, &za->error)) == NULL) {
+                free_shares(shares, nshares);
+                return -1;
+            }
+            if ((shares[i].name = _zip_strdup(name)) == NULL) {
+                zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+                free_shares(shares, nshares);
+                return -1;
+            }
+        }
+    }
+
+    *sharesp = shares;
+    *nsharesp = nshares;
+    return 0;
+}
+
+
+static void
+free_shares(share_t *shares, zip_uint64_t nshares) {
+    zip_uint64_t i;
+
+    if (shares == NULL) {
+        return;
+    }
+
+    for (i = 0; i < nshares; i++) {
+        _zip_free(shares[i].name);
+    }
+    _zip_free(shares);
+}
+
+
+/* Whether other archives copy data written for archive. */
+static bool
+is_writer(const share_t *shares, zip_uint64_t nshares, zip_uint64_t archive) {
+    zip_uint64_t i;
+
+    for (i = 0; i < nshares; i++) {
+        if (shares[i].archive == archive && shares[i].has_readers) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* order by source and compression settings, so shares of the same data are adjacent, in order of archives */
+static int
+share_compare(const void *a, const void *b) {
+    const share_t *sa = (const share_t *)a;
+    const share_t *sb = (const share_t *)b;
+    int ret;
+
+    if ((ret = share_compare_data(sa, sb)) != 0) {
+        return ret;
+    }
+    if (sa->archive != sb->archive) {
+        return sa->archive < sb->archive ? -1 : 1;
+    }
+    if (sa->idx != sb->idx) {
+        return sa->idx < sb->idx ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/* Compare what determines the data written for shares. */
+static int
+share_compare_data(const share_t *sa, const share_t *sb) {
+    if (sa->source != sb->source) {
+        return (uintptr_t)sa->source < (uintptr_t)sb->source ? -1 : 1;
+    }
+    if (sa->comp_method != sb->comp_method) {
+        return sa->comp_method < sb->comp_method ? -1 : 1;
+    }
+    if (sa->compression_level != sb->compression_level) {
+        return sa->compression_level < sb->compression_level ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/* Whether entry idx gets its data compressed from a source, as other archives could copy it. */
+static bool
+share_candidate(zip_t *za, zip_uint64_t idx, share_t *share) {
+    zip_entry_t *entry = za->entry + idx;
+    zip_dirent_t *de = entry->changes ? entry->changes : entry->orig;
+    zip_int32_t comp_method = de ? de->comp_method : ZIP_CM_DEFAULT;
+    zip_uint32_t compression_level = de ? de->compression_level : 0;
+    zip_stat_t st;
+
+    if (entry->deleted || !ZIP_ENTRY_DATA_CHANGED(entry) || ZIP_CM_ACTUAL(comp_method) == ZIP_CM_STORE || ZIP_WANT_SEEKABLE_COMPRESSION(compression_level)) {
+        return false;
+    }
+    if (de != NULL && (de->encryption_method != ZIP_EM_NONE || (de->changed & ZIP_DIRENT_COMPRESSION_PARAMETERS))) {
+        return false;
+    }
+    if (zip_source_stat(entry->source, &st) < 0) {
+        return false;
+    }
+    if ((st.valid & ZIP_STAT_COMP_METHOD) && st.comp_method != ZIP_CM_STORE) {
+        return false;
+    }
+    if ((st.valid & ZIP_STAT_ENCRYPTION_METHOD) && st.encryption_method != ZIP_EM_NONE) {
+        return false;
+    }
+
+    share->source = entry->source;
+    /* default methods may fall back to storing, which explicitly requested ones don't */
+    share->comp_method = ZIP_CM_IS_DEFAULT(comp_method) ? ZIP_CM_DEFAULT : comp_method;
+    share->compression_level = compression_level;
+    share->idx = idx;
+    share->writer = SHARE_NONE;
+    share->has_readers = false;
+    share->name = NULL;
+    share->replaced = NULL;
+    return true;
+}
+
+
+/* Make files of archive whose data was written for another archive copy it from there.
+   Files are skipped if the other archive stored their data uncompressed. */
+static int
+share_start(zip_t **archives, share_t *shares, zip_uint64_t nshares, zip_uint64_t archive) {
+    zip_t *za = archives[archive];
+    zip_uint64_t i;
+
+    for (i = 0; i < nshares; i++) {
+        share_t *share = shares + i;
+        const share_t *writer;
+        zip_t *za_writer;
+        zip_entry_t *entry;
+        zip_source_t *src;
+        zip_int64_t idx;
+
+        if (share->archive != archive || share->writer == SHARE_NONE) {
+            continue;
+        }
+        writer = shares + share->writer;
+        za_writer = archives[writer->archive];
+        entry = za->entry + share->idx;
+
+        if ((idx = _zip_name_locate(za_writer, writer->name, ZIP_FL_ENC_RAW, NULL)) < 0 || za_writer->entry[idx].orig == NULL || za_writer->entry[idx].orig->comp_method != ZIP_CM_ACTUAL(share->comp_method)) {
+            continue;
+        }
+        if ((src = zip_source_zip_file_create(za_writer, (zip_uint64_t)idx, ZIP_FL_COMPRESSED | ZIP_FL_UNCHANGED, 0, -1, NULL, &za->error)) == NULL) {
+            return -1;
+        }
+        share->replaced = entry->source;
+        entry->source = src;
+    }
+
+    return 0;
+}
+
+
+/* Give files of archive za their own sources back after writing it failed, or, if za is NULL, release them once it was written. */
+static void
+share_finish(zip_t *za, share_t *shares, zip_uint64_t nshares, zip_uint64_t archive) {
+    zip_uint64_t i;
+
+    for (i = 0; i < nshares; i++) {
+        share_t *share = shares + i;
+
+        if (share->archive != archive || share->replaced == NULL) {
+            continue;
+        }
+        if (za != NULL) {
+            zip_source_free(za->entry[share->idx].source);
+            za->entry[share->idx].source = share->replaced;
+        }
+        else {
+            zip_source_free(share->replaced);
+        }
+        share->replaced = NULL;
+    }
+}
@@ -0,0 +1,240 @@
+/*
+  zip_commit.c -- write changes to archive and keep it open
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+static void commit_entry(zip_t *za, zip_entry_t *entry);
+
+
+ZIP_EXTERN int
+zip_commit(zip_t *za) {
+    zip_filelist_t *filelist;
+    zip_entry_t *entry;
+    zip_hash_t *names;
+    zip_uint64_t i, j, survivors, prefix_length;
+
+    if (za == NULL)
+        return -1;
+
+    if (_zip_changed(za, &survivors) && ZIP_IS_STREAMING(za)) {
+        /* the archive can't be read back */
+        zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+
+    /* allocate everything needed to update the archive state beforehand, so it can't fail after the changes are written */
+    if (!_zip_archive_prefix_length(za, &prefix_length, &za->error)) {
+        return -1;
+    }
+    entry = NULL;
+    if (survivors > 0) {
+        if (survivors > SIZE_MAX / sizeof(*entry) || (entry = (zip_entry_t *)_zip_malloc(sizeof(*entry) * (size_t)survivors)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+    }
+    if ((names = _zip_hash_new(&za->error)) == NULL) {
+        _zip_free(entry);
+        return -1;
+    }
+    if (!_zip_hash_reserve_capacity(names, survivors, &za->error)) {
+        _zip_hash_free(names);
+        _zip_free(entry);
+        return -1;
+    }
+
+    if (_zip_write_changes(za, &filelist, &survivors) < 0) {
+        _zip_hash_free(names);
+        _zip_free(entry);
+        return -1;
+    }
+
+    if (filelist == NULL && survivors > 0) {
+        /* nothing written */
+        _zip_hash_free(names);
+        _zip_free(entry);
+        return 0;
+    }
+
+    /* Sources reading from the archive use offsets into the old file. */
+    for (i = 0; i < za->nopen_source; i++) {
+        _zip_source_invalidate(za->open_source[i]);
+    }
+    _zip_shared_entry_detach_all(za);
+
+    for (j = 0; j < survivors; j++) {
+        zip_entry_t *e = za->entry + filelist[j].idx;
+
+        commit_entry(za, e);
+        entry[j] = *e;
+        entry[j].logged = false;
+        _zip_entry_init(e);
+
+        /* Names point into file names of entries, which are kept; duplicate names are only found via their first entry, as in zip_open. */
+        _zip_hash_add(names, (const zip_uint8_t *)filelist[j].name, j, ZIP_FL_UNCHANGED, NULL);
+    }
+    _zip_free(filelist);
+
+    for (i = 0; i < za->nentry; i++) {
+        _zip_entry_finalize(za->entry + i);
+    }
+    _zip_free(za->entry);
+    _zip_memory_budget_release(za->memory_budget, sizeof(*entry) * (za->nentry_alloc - survivors));
+    za->entry = entry;
+    za->nentry = za->nentry_alloc = za->nentry_orig = survivors;
+    za->nchange_log = 0;
+
+    _zip_hash_free(za->names);
+    za->names = names;
+    za->names_unhashed = 0;
+    za->names_sorted = false;
+    _zip_name_index_free(za);
+    _zip_cdir_index_free(za->cdir_index);
+    za->cdir_index = NULL;
+
+    if (za->comment_changed) {
+        _zip_string_free(za->comment_orig);
+        za->comment_orig = za->comment_changes;
+        za->comment_changes = NULL;
+        za->comment_changed = 0;
+    }
+    if (za->prefix_changed) {
+        _zip_free(za->prefix_orig);
+        za->prefix_orig = za->prefix_changes;
+        prefix_length = za->prefix_changes_length;
+        za->prefix_changes = NULL;
+        za->prefix_changes_length = 0;
+        za->prefix_changed = false;
+    }
+    if (ZIP_WANT_TORRENTZIP(za) || (survivors == 0 && !(za->ch_flags & ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE))) {
+        /* no prefix written */
+        _zip_free(za->prefix_orig);
+        za->prefix_orig = NULL;
+        prefix_length = 0;
+    }
+    /* entries follow the prefix */
+    za->cdir_offset_orig = prefix_length;
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        /* as in zip_open, the torrentzip comment is not exposed */
+        _zip_string_free(za->comment_orig);
+        za->comment_orig = NULL;
+        za->ch_flags |= ZIP_AFL_IS_TORRENTZIP;
+    }
+    else {
+        za->ch_flags &= ~(unsigned int)ZIP_AFL_IS_TORRENTZIP;
+    }
+    za->flags = za->ch_flags;
+    za->alignment_orig = za->alignment;
+    /* indices have changed, order was applied */
+    _zip_free(za->data_order);
+    za->data_order = NULL;
+    za->ndata_order = 0;
+    /* from now on, it is the archive we just wrote */
+    za->open_flags &= ~(unsigned int)ZIP_TRUNCATE;
+
+    if (survivors > 0 && !ZIP_SOURCE_IS_OPEN_READING(za->src)) {
+        /* committing closed the source for reading */
+        if (zip_source_open(za->src) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Make the directory entry written for ENTRY its original one, as if it had been read from the archive. */
+static void
+commit_entry(zip_t *za, zip_entry_t *entry) {
+    zip_dirent_t *de = entry->changes;
+
+    if (entry->source) {
+        zip_source_free(entry->source);
+        entry->source = NULL;
+    }
+
+    if (de == NULL) {
+        /* kept by cloning, unchanged */
+        return;
+    }
+    entry->changes = NULL;
+
+    if (entry->orig != NULL) {
+        /* take over what is shared with orig before freeing it */
+        if ((de->changed & ZIP_DIRENT_FILENAME) == 0) {
+            entry->orig->filename = NULL;
+        }
+        if ((de->changed & ZIP_DIRENT_EXTRA_FIELD) == 0) {
+            entry->orig->extra_fields = NULL;
+        }
+        if ((de->changed & ZIP_DIRENT_COMMENT) == 0) {
+            entry->orig->comment = NULL;
+        }
+        if ((de->changed & ZIP_DIRENT_PASSWORD) == 0) {
+            entry->orig->password = NULL;
+        }
+        _zip_dirent_free(entry->orig);
+    }
+
+    if (de->changed & ZIP_DIRENT_PASSWORD) {
+        if (de->password) {
+            _zip_crypto_clear(de->password, strlen(de->password));
+        }
+        _zip_free(de->password);
+    }
+    de->password = NULL;
+
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        /* these are normalized when writing */
+        _zip_string_free(de->comment);
+        de->comment = NULL;
+        _zip_ef_free(de->extra_fields);
+        de->extra_fields = NULL;
+        de->raw_extra_fields = NULL;
+        _zip_dirent_set_dos_time(de, 0xbc00, 0x2198);
+    }
+
+    de->changed = 0;
+    de->cloned = 0;
+    de->compression_level = 0;
+    de->zstd_parameters.window_log = 0;
+    de->zstd_parameters.strategy = 0;
+    de->zstd_parameters.long_distance_matching = 0;
+    de->local_header_size = 0;
+    entry->orig = de;
+}
@@ -0,0 +1,320 @@
+/*
+  zip_crc32.c -- CRC-32 with hardware acceleration
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <limits.h>
+#include <zlib.h>
+
+#include "zipint.h"
+
+#if defined(HAVE_CRC32_PCLMUL)
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#elif defined(HAVE_CRC32_ARMV8)
+#include <arm_acle.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/* Shorter data is not worth the setup of the accelerated version. */
+#define CRC32_ACCELERATED_MINIMUM_LENGTH 64
+
+#ifdef HAVE_THREADS
+/* Each thread computes the CRC of at least this much data. */
+#define CRC32_THREAD_MINIMUM_LENGTH (4 * 1024 * 1024)
+#define CRC32_MAX_THREADS 16
+#endif
+
+/* bit-reflected polynomial 0x04c11db7 */
+#define CRC32_POLYNOMIAL 0xedb88320
+
+/* x^(2^n) modulo polynomial, bit-reflected (x^0 is 0x80000000) */
+static const zip_uint32_t x2n_table[32] = {
+    0x40000000, 0x20000000, 0x08000000, 0x00800000,
+    0x00008000, 0xedb88320, 0xb1e6b092, 0xa06a2517,
+    0xed627dae, 0x88d14467, 0xd7bbfe6a, 0xec447f11,
+    0x8e7ea170, 0x6427800e, 0x4d47bae0, 0x09fe548f,
+    0x83852d0f, 0x30362f1a, 0x7b5a9cc3, 0x31fec169,
+    0x9fec022a, 0x6c8dedc4, 0x15d6874d, 0x5fde7a4e,
+    0xbad90e37, 0x2e4e5eef, 0x4eaba214, 0xa8a472c0,
+    0x429a969e, 0x148d302a, 0xc40ba6d0, 0xc4e22c3c
+};
+
+
+static zip_uint32_t
+crc32_zlib(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    while (length > 0) {
+        uInt n = (uInt)ZIP_MIN(UINT_MAX, length);
+        crc = (zip_uint32_t)crc32(crc, data, n);
+        data += n;
+        length -= n;
+    }
+    return crc;
+}
+
+
+#if defined(HAVE_CRC32_PCLMUL)
+/* Folding with carry-less multiplication, as described in Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+   Processes length bytes, which must be a multiple of 16 and at least 64; takes and returns the CRC in its inverted internal form. */
+__attribute__((target("sse2,pclmul"))) static zip_uint32_t
+crc32_pclmul(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    /* constants for the bit-reflected polynomial 0x04c11db7 */
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x1, x2, x3, x4, t1, t2, t3, t4;
+
+    x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), _mm_cvtsi32_si128((int)crc));
+    x2 = _mm_loadu_si128((const __m128i *)(data + 16));
+    x3 = _mm_loadu_si128((const __m128i *)(data + 32));
+    x4 = _mm_loadu_si128((const __m128i *)(data + 48));
+    data += 64;
+    length -= 64;
+
+    /* fold four blocks at a time */
+    while (length >= 64) {
+        t1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        t2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        t3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        t4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), t1), _mm_loadu_si128((const __m128i *)data));
+        x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), t2), _mm_loadu_si128((const __m128i *)(data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), t3), _mm_loadu_si128((const __m128i *)(data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), t4), _mm_loadu_si128((const __m128i *)(data + 48)));
+        data += 64;
+        length -= 64;
+    }
+
+    /* fold into one block */
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x2);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x3);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x4);
+
+    /* fold remaining blocks one at a time */
+    while (length >= 16) {
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), _mm_loadu_si128((const __m128i *)data));
+        data += 16;
+        length -= 16;
+    }
+
+    /* reduce 128 to 64 bits */
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k3k4, 0x10));
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 4), _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00));
+
+    /* Barrett reduction to 32 bits */
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (zip_uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+
+static zip_uint32_t
+crc32_accelerated(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t n;
+
+    if (length < CRC32_ACCELERATED_MINIMUM_LENGTH || !__builtin_cpu_supports("pclmul")) {
+        return crc32_zlib(crc, data, length);
+    }
+
+    n = length & ~(zip_uint64_t)15;
+    crc = ~crc32_pclmul(~crc, data, n);
+    return crc32_zlib(crc, data + n, length - n);
+}
+
+#elif defined(HAVE_CRC32_ARMV8)
+__attribute__((target("arch=armv8-a+crc"))) static zip_uint32_t
+crc32_armv8(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    crc = ~crc;
+
+    while (length > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = __crc32b(crc, *data++);
+        length--;
+    }
+    while (length >= 8) {
+        zip_uint64_t v;
+
+        (void)memcpy_s(&v, sizeof(v), data, 8);
+        crc = __crc32d(crc, v);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = __crc32b(crc, *data++);
+        length--;
+    }
+
+    return ~crc;
+}
+
+
+static zip_uint32_t
+crc32_accelerated(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    if (length < CRC32_ACCELERATED_MINIMUM_LENGTH || (getauxval(AT_HWCAP) & HWCAP_CRC32) == 0) {
+        return crc32_zlib(crc, data, length);
+    }
+
+    return crc32_armv8(crc, data, length);
+}
+
+#else
+#define crc32_accelerated crc32_zlib
+#endif
+
+
+/* Update crc with length bytes of data, like zlib's crc32() (initial value is 0), using CPU instructions if available. */
+zip_uint32_t
+_zip_crc32(zip_uint32_t crc, const void *data, zip_uint64_t length) {
+    if (length == 0) {
+        return crc;
+    }
+
+    return crc32_accelerated(crc, (const zip_uint8_t *)data, length);
+}
+
+
+ZIP_EXTERN zip_uint32_t
+zip_crc32(zip_uint32_t crc, const void *data, zip_uint64_t length) {
+    return _zip_crc32(crc, data, length);
+}
+
+
+/* Multiply a and b modulo polynomial; a must not be 0. */
+static zip_uint32_t
+multiply_modulo(zip_uint32_t a, zip_uint32_t b) {
+    zip_uint32_t m = (zip_uint32_t)1 << 31;
+    zip_uint32_t p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                return p;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLYNOMIAL : b >> 1;
+    }
+}
+
+
+/* Return CRC of concatenation of data with CRC crc1 and data with CRC crc2 and length length2, like zlib's crc32_combine(). */
+zip_uint32_t
+_zip_crc32_combine(zip_uint32_t crc1, zip_uint32_t crc2, zip_uint64_t length2) {
+    zip_uint32_t p = (zip_uint32_t)1 << 31;
+    unsigned int n = 3; /* length2 is in bytes, x2n_table[3] is x^8 */
+
+    /* appending length2 bytes multiplies crc1 by x^(8 * length2) */
+    while (length2 > 0) {
+        if (length2 & 1) {
+            p = multiply_modulo(x2n_table[n & 31], p);
+        }
+        length2 >>= 1;
+        n++;
+    }
+
+    return multiply_modulo(p, crc1) ^ crc2;
+}
+
+
+#ifdef HAVE_THREADS
+struct crc32_part {
+    const zip_uint8_t *data;
+    zip_uint64_t length;
+    zip_uint32_t crc;
+    zip_thread_job_t job;
+};
+
+
+static void
+crc32_part_run(void *ud) {
+    struct crc32_part *part = (struct crc32_part *)ud;
+
+    part->crc = _zip_crc32(0, part->data, part->length);
+}
+#endif
+
+
+/* Like _zip_crc32(), but split large data among up to num_threads threads, combining their CRCs. */
+zip_uint32_t
+_zip_crc32_threads(zip_uint32_t crc, const void *data, zip_uint64_t length, zip_uint32_t num_threads) {
+#ifdef HAVE_THREADS
+    struct crc32_part parts[CRC32_MAX_THREADS];
+    zip_thread_pool_t *pool;
+    zip_uint64_t part_length, offset;
+    zip_uint32_t i, nparts;
+
+    nparts = (zip_uint32_t)ZIP_MIN(ZIP_MIN(num_threads, CRC32_MAX_THREADS), length / CRC32_THREAD_MINIMUM_LENGTH);
+    if (nparts <= 1) {
+        return _zip_crc32(crc, data, length);
+    }
+
+    /* compute CRC in calling thread if pool can't be created */
+    if ((pool = _zip_thread_pool_new(nparts - 1, NULL)) == NULL) {
+        return _zip_crc32(crc, data, length);
+    }
+
+    part_length = length / nparts;
+    offset = 0;
+    for (i = 0; i < nparts; i++) {
+        parts[i].data = (const zip_uint8_t *)data + offset;
+        parts[i].length = i == nparts - 1 ? length - offset : part_length;
+        parts[i].job.run = crc32_part_run;
+        parts[i].job.ud = parts + i;
+        offset += parts[i].length;
+    }
+
+    /* last part is computed in calling thread while workers compute the others */
+    for (i = 0; i < nparts - 1; i++) {
+        _zip_thread_pool_submit(pool, &parts[i].job);
+    }
+    crc32_part_run(parts + nparts - 1);
+
+    for (i = 0; i < nparts; i++) {
+        if (i < nparts - 1) {
+            _zip_thread_pool_wait(pool, &parts[i].job);
+        }
+        crc = _zip_crc32_combine(crc, parts[i].crc, parts[i].length);
+    }
+    _zip_thread_pool_free(pool);
+
+    return crc;
+#else
+    (void)num_threads;
+    return _zip_crc32(crc, data, length);
+#endif
+}
@@ -51,9 +51,13 @@ _zip_crypto_aes_free(_zip_crypto_aes_t *aes) {
 
 
 bool
-_zip_crypto_aes_encrypt_block(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out) {
+_zip_crypto_aes_encrypt_blocks(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length) {
     size_t len;
-    CCCryptorUpdate(aes, in, ZIP_CRYPTO_AES_BLOCK_LENGTH, out, ZIP_CRYPTO_AES_BLOCK_LENGTH, &len);
+
+    if (length > SIZE_MAX) {
+        return false;
+    }
+    CCCryptorUpdate(aes, in, (size_t)length, out, (size_t)length, &len);
     return true;
 }
 
@@ -91,7 +95,7 @@ _zip_crypto_hmac_free(_zip_crypto_hmac_t *hmac) {
     }
 
     _zip_crypto_clear(hmac, sizeof(*hmac));
-    free(hmac);
+    _zip_free(hmac);
 }
 
 
@@ -99,7 +103,7 @@ _zip_crypto_hmac_t *
 _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_error_t *error) {
     _zip_crypto_hmac_t *hmac;
 
-    if ((hmac = (_zip_crypto_hmac_t *)malloc(sizeof(*hmac))) == NULL) {
+    if ((hmac = (_zip_crypto_hmac_t *)_zip_malloc(sizeof(*hmac))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -40,7 +40,7 @@
 #define _zip_crypto_hmac_t CCHmacContext
 
 void _zip_crypto_aes_free(_zip_crypto_aes_t *aes);
-bool _zip_crypto_aes_encrypt_block(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out);
+bool _zip_crypto_aes_encrypt_blocks(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length);
 _zip_crypto_aes_t *_zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *error);
 
 #define _zip_crypto_hmac(hmac, data, length) (CCHmacUpdate((hmac), (data), (length)), true)
@@ -41,7 +41,7 @@ _zip_crypto_aes_t *
 _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *error) {
     _zip_crypto_aes_t *aes;
 
-    if ((aes = (_zip_crypto_aes_t *)malloc(sizeof(*aes))) == NULL) {
+    if ((aes = (_zip_crypto_aes_t *)_zip_malloc(sizeof(*aes))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -60,7 +60,7 @@ _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *
         break;
     default:
         zip_error_set(error, ZIP_ER_INVAL, 0);
-        free(aes);
+        _zip_free(aes);
         return NULL;
     }
 
@@ -68,16 +68,20 @@ _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *
 }
 
 bool
-_zip_crypto_aes_encrypt_block(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out) {
+_zip_crypto_aes_encrypt_blocks(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length) {
+    if (length > SIZE_MAX) {
+        return false;
+    }
+
     switch (aes->key_size) {
     case 128:
-        nettle_aes128_encrypt(&aes->ctx.ctx_128, ZIP_CRYPTO_AES_BLOCK_LENGTH, out, in);
+        nettle_aes128_encrypt(&aes->ctx.ctx_128, (size_t)length, out, in);
         break;
     case 192:
-        nettle_aes192_encrypt(&aes->ctx.ctx_192, ZIP_CRYPTO_AES_BLOCK_LENGTH, out, in);
+        nettle_aes192_encrypt(&aes->ctx.ctx_192, (size_t)length, out, in);
         break;
     case 256:
-        nettle_aes256_encrypt(&aes->ctx.ctx_256, ZIP_CRYPTO_AES_BLOCK_LENGTH, out, in);
+        nettle_aes256_encrypt(&aes->ctx.ctx_256, (size_t)length, out, in);
         break;
     }
 
@@ -91,7 +95,7 @@ _zip_crypto_aes_free(_zip_crypto_aes_t *aes) {
     }
 
     _zip_crypto_clear(aes, sizeof(*aes));
-    free(aes);
+    _zip_free(aes);
 }
 
 
@@ -99,14 +103,14 @@ _zip_crypto_hmac_t *
 _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_error_t *error) {
     _zip_crypto_hmac_t *hmac;
 
-    if ((hmac = (_zip_crypto_hmac_t *)malloc(sizeof(*hmac))) == NULL) {
+    if ((hmac = (_zip_crypto_hmac_t *)_zip_malloc(sizeof(*hmac))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
     if (gnutls_hmac_init(hmac, GNUTLS_MAC_SHA1, secret, secret_length) < 0) {
         zip_error_set(error, ZIP_ER_INTERNAL, 0);
-        free(hmac);
+        _zip_free(hmac);
         return NULL;
     }
 
@@ -124,7 +128,7 @@ _zip_crypto_hmac_free(_zip_crypto_hmac_t *hmac) {
 
     gnutls_hmac_deinit(*hmac, buf);
     _zip_crypto_clear(hmac, sizeof(*hmac));
-    free(hmac);
+    _zip_free(hmac);
 }
 
 
@@ -47,7 +47,7 @@ _zip_crypto_aes_t *
 _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *error) {
     _zip_crypto_aes_t *aes;
 
-    if ((aes = (_zip_crypto_aes_t *)malloc(sizeof(*aes))) == NULL) {
+    if ((aes = (_zip_crypto_aes_t *)_zip_malloc(sizeof(*aes))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -65,7 +65,20 @@ _zip_crypto_aes_free(_zip_crypto_aes_t *aes) {
     }
 
     mbedtls_aes_free(aes);
-    free(aes);
+    _zip_free(aes);
+}
+
+
+bool
+_zip_crypto_aes_encrypt_blocks(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length) {
+    zip_uint64_t i;
+
+    for (i = 0; i < length; i += ZIP_CRYPTO_AES_BLOCK_LENGTH) {
+        if (mbedtls_aes_crypt_ecb(aes, MBEDTLS_AES_ENCRYPT, in + i, out + i) != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 
@@ -78,7 +91,7 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
         return NULL;
     }
 
-    if ((hmac = (_zip_crypto_hmac_t *)malloc(sizeof(*hmac))) == NULL) {
+    if ((hmac = (_zip_crypto_hmac_t *)_zip_malloc(sizeof(*hmac))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -87,13 +100,13 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
 
     if (mbedtls_md_setup(hmac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1) != 0) {
         zip_error_set(error, ZIP_ER_INTERNAL, 0);
-        free(hmac);
+        _zip_free(hmac);
         return NULL;
     }
 
     if (mbedtls_md_hmac_starts(hmac, (const unsigned char *)secret, (size_t)secret_length) != 0) {
         zip_error_set(error, ZIP_ER_INTERNAL, 0);
-        free(hmac);
+        _zip_free(hmac);
         return NULL;
     }
 
@@ -108,7 +121,7 @@ _zip_crypto_hmac_free(_zip_crypto_hmac_t *hmac) {
     }
 
     mbedtls_md_free(hmac);
-    free(hmac);
+    _zip_free(hmac);
 }
 
 
@@ -152,7 +165,7 @@ zip_secure_random(zip_uint8_t *buffer, zip_uint16_t length) {
     const unsigned char *pers = "zip_crypto_mbedtls";
 
     if (!ctx) {
-        ctx = (zip_random_context_t *)malloc(sizeof(zip_random_context_t));
+        ctx = (zip_random_context_t *)_zip_malloc(sizeof(zip_random_context_t));
         if (!ctx) {
             return false;
         }
@@ -161,7 +174,7 @@ zip_secure_random(zip_uint8_t *buffer, zip_uint16_t length) {
         if (mbedtls_ctr_drbg_seed(&ctx->ctr_drbg, mbedtls_entropy_func, &ctx->entropy, pers, strlen(pers)) != 0) {
             mbedtls_ctr_drbg_free(&ctx->ctr_drbg);
             mbedtls_entropy_free(&ctx->entropy);
-            free(ctx);
+            _zip_free(ctx);
             ctx = NULL;
             return false;
         }
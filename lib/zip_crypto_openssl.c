@@ -42,7 +42,7 @@
 
 #ifdef USE_OPENSSL_3_API
 static _zip_crypto_hmac_t* hmac_new() {
-    _zip_crypto_hmac_t *hmac = (_zip_crypto_hmac_t*)malloc(sizeof(*hmac));
+    _zip_crypto_hmac_t *hmac = (_zip_crypto_hmac_t*)_zip_malloc(sizeof(*hmac));
     if (hmac != NULL) {
         hmac->mac = NULL;
         hmac->ctx = NULL;
@@ -57,7 +57,7 @@ static void hmac_free(_zip_crypto_hmac_t* hmac) {
         if (hmac->mac != NULL) {
             EVP_MAC_free(hmac->mac);
         }
-        free(hmac);
+        _zip_free(hmac);
     }
 }
 #endif
@@ -83,7 +83,7 @@ _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *
     }
 
 #ifdef USE_OPENSSL_1_0_API
-    if ((aes = (_zip_crypto_aes_t *)malloc(sizeof(*aes))) == NULL) {
+    if ((aes = (_zip_crypto_aes_t *)_zip_malloc(sizeof(*aes))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -97,7 +97,7 @@ _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *
 
     if (EVP_EncryptInit_ex(aes, cipher_type, NULL, key, NULL) != 1) {
 #ifdef USE_OPENSSL_1_0_API
-        free(aes);
+        _zip_free(aes);
 #else
         EVP_CIPHER_CTX_free(aes);
 #endif
@@ -117,7 +117,7 @@ _zip_crypto_aes_free(_zip_crypto_aes_t *aes) {
 #ifdef USE_OPENSSL_1_0_API
     EVP_CIPHER_CTX_cleanup(aes);
     _zip_crypto_clear(aes, sizeof(*aes));
-    free(aes);
+    _zip_free(aes);
 #else
     EVP_CIPHER_CTX_free(aes);
 #endif
@@ -125,13 +125,17 @@ _zip_crypto_aes_free(_zip_crypto_aes_t *aes) {
 
 
 bool
-_zip_crypto_aes_encrypt_block(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out) {
+_zip_crypto_aes_encrypt_blocks(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length) {
     int len = 0;
+
+    if (length > INT_MAX) {
+        return false;
+    }
     /* TODO: The memset() is just for testing the memory sanitizer,
        _zip_winzip_aes_new() will overwrite the same bytes */
-    memset(out, 0xff, ZIP_CRYPTO_AES_BLOCK_LENGTH);
-    if (EVP_EncryptUpdate(aes, out, &len, in, ZIP_CRYPTO_AES_BLOCK_LENGTH) != 1
-        || len != ZIP_CRYPTO_AES_BLOCK_LENGTH) {
+    memset(out, 0xff, (size_t)length);
+    if (EVP_EncryptUpdate(aes, out, &len, in, (int)length) != 1
+        || (zip_uint64_t)len != length) {
         return false;
     }
     return true;
@@ -169,7 +173,7 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
     }
 #else
 #ifdef USE_OPENSSL_1_0_API
-    if ((hmac = (_zip_crypto_hmac_t *)malloc(sizeof(*hmac))) == NULL) {
+    if ((hmac = (_zip_crypto_hmac_t *)_zip_malloc(sizeof(*hmac))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -185,7 +189,7 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
     if (HMAC_Init_ex(hmac, secret, (int)secret_length, EVP_sha1(), NULL) != 1) {
         zip_error_set(error, ZIP_ER_INTERNAL, 0);
 #ifdef USE_OPENSSL_1_0_API
-        free(hmac);
+        _zip_free(hmac);
 #else
         HMAC_CTX_free(hmac);
 #endif
@@ -208,7 +212,7 @@ _zip_crypto_hmac_free(_zip_crypto_hmac_t *hmac) {
 #elif defined(USE_OPENSSL_1_0_API)
     HMAC_CTX_cleanup(hmac);
     _zip_crypto_clear(hmac, sizeof(*hmac));
-    free(hmac);
+    _zip_free(hmac);
 #else
     HMAC_CTX_free(hmac);
 #endif
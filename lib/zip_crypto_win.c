@@ -122,8 +122,8 @@ hmacFree(PRF_CTX *pContext) {
         BCryptDestroyHash(pContext->hOuterHash);
     if (pContext->hInnerHash)
         BCryptDestroyHash(pContext->hInnerHash);
-    free(pContext->pbOuterHash);
-    free(pContext->pbInnerHash);
+    _zip_free(pContext->pbOuterHash);
+    _zip_free(pContext->pbInnerHash);
     if (pContext->hAlgorithm)
         BCryptCloseAlgorithmProvider(pContext->hAlgorithm, 0);
 }
@@ -152,13 +152,13 @@ hmacInit(PRF_CTX *pContext, PUCHAR pbPassword, DWORD cbPassword) {
     ULONG cbResult;
     BYTE key[DIGEST_SIZE];
 
-    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&pContext->hAlgorithm, BCRYPT_SHA1_ALGORITHM, NULL, 0)) || !BCRYPT_SUCCESS(BCryptGetProperty(pContext->hAlgorithm, BCRYPT_OBJECT_LENGTH, (PUCHAR)&pContext->cbHashObject, sizeof(pContext->cbHashObject), &cbResult, 0)) || ((pContext->pbInnerHash = malloc(pContext->cbHashObject)) == NULL) || ((pContext->pbOuterHash = malloc(pContext->cbHashObject)) == NULL) || !BCRYPT_SUCCESS(BCryptCreateHash(pContext->hAlgorithm, &pContext->hInnerHash, pContext->pbInnerHash, pContext->cbHashObject, NULL, 0, 0)) || !BCRYPT_SUCCESS(BCryptCreateHash(pContext->hAlgorithm, &pContext->hOuterHash, pContext->pbOuterHash, pContext->cbHashObject, NULL, 0, 0))) {
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&pContext->hAlgorithm, BCRYPT_SHA1_ALGORITHM, NULL, 0)) || !BCRYPT_SUCCESS(BCryptGetProperty(pContext->hAlgorithm, BCRYPT_OBJECT_LENGTH, (PUCHAR)&pContext->cbHashObject, sizeof(pContext->cbHashObject), &cbResult, 0)) || ((pContext->pbInnerHash = _zip_malloc(pContext->cbHashObject)) == NULL) || ((pContext->pbOuterHash = _zip_malloc(pContext->cbHashObject)) == NULL) || !BCRYPT_SUCCESS(BCryptCreateHash(pContext->hAlgorithm, &pContext->hInnerHash, pContext->pbInnerHash, pContext->cbHashObject, NULL, 0, 0)) || !BCRYPT_SUCCESS(BCryptCreateHash(pContext->hAlgorithm, &pContext->hOuterHash, pContext->pbOuterHash, pContext->cbHashObject, NULL, 0, 0))) {
         goto hmacInit_end;
     }
 
     if (cbPassword > BLOCK_SIZE) {
         BCRYPT_HASH_HANDLE hHash = NULL;
-        PUCHAR pbHashObject = malloc(pContext->cbHashObject);
+        PUCHAR pbHashObject = _zip_malloc(pContext->cbHashObject);
         if (pbHashObject == NULL) {
             goto hmacInit_end;
         }
@@ -167,7 +167,7 @@ hmacInit(PRF_CTX *pContext, PUCHAR pbPassword, DWORD cbPassword) {
 
         if (hHash)
             BCryptDestroyHash(hHash);
-        free(pbHashObject);
+        _zip_free(pbHashObject);
 
         if (!bStatus) {
             goto hmacInit_end;
@@ -190,7 +190,7 @@ static BOOL
 hmacCalculateInternal(BCRYPT_HASH_HANDLE hHashTemplate, PUCHAR pbData, DWORD cbData, PUCHAR pbOutput, DWORD cbOutput, DWORD cbHashObject) {
     BOOL success = FALSE;
     BCRYPT_HASH_HANDLE hHash = NULL;
-    PUCHAR pbHashObject = malloc(cbHashObject);
+    PUCHAR pbHashObject = _zip_malloc(cbHashObject);
 
     if (pbHashObject == NULL) {
         return FALSE;
@@ -202,7 +202,7 @@ hmacCalculateInternal(BCRYPT_HASH_HANDLE hHashTemplate, PUCHAR pbData, DWORD cbD
         BCryptDestroyHash(hHash);
     }
 
-    free(pbHashObject);
+    _zip_free(pbHashObject);
 
     return success;
 }
@@ -227,7 +227,7 @@ pbkdf2(PUCHAR pbPassword, ULONG cbPassword, PUCHAR pbSalt, ULONG cbSalt, DWORD c
     DWORD l, r, dwULen, i, j;
     BYTE Ti[DIGEST_SIZE];
     BYTE V[DIGEST_SIZE];
-    LPBYTE U = malloc(max((cbSalt + 4), DIGEST_SIZE));
+    LPBYTE U = _zip_malloc(max((cbSalt + 4), DIGEST_SIZE));
     PRF_CTX prfCtx = {0};
 
     if (U == NULL) {
@@ -235,7 +235,7 @@ pbkdf2(PUCHAR pbPassword, ULONG cbPassword, PUCHAR pbSalt, ULONG cbSalt, DWORD c
     }
 
     if (pbPassword == NULL || cbPassword == 0 || pbSalt == NULL || cbSalt == 0 || cIterations == 0 || pbDerivedKey == NULL || cbDerivedKey == 0) {
-        free(U);
+        _zip_free(U);
         return FALSE;
     }
 
@@ -284,7 +284,7 @@ pbkdf2(PUCHAR pbPassword, ULONG cbPassword, PUCHAR pbSalt, ULONG cbSalt, DWORD c
 PBKDF2_end:
 
     hmacFree(&prfCtx);
-    free(U);
+    _zip_free(U);
     return bStatus;
 }
 
@@ -305,7 +305,7 @@ struct _zip_crypto_aes_s {
 
 _zip_crypto_aes_t *
 _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *error) {
-    _zip_crypto_aes_t *aes = (_zip_crypto_aes_t *)calloc(1, sizeof(*aes));
+    _zip_crypto_aes_t *aes = (_zip_crypto_aes_t *)_zip_calloc(1, sizeof(*aes));
 
     ULONG cbResult;
     ULONG key_length = key_size / 8;
@@ -330,7 +330,7 @@ _zip_crypto_aes_new(const zip_uint8_t *key, zip_uint16_t key_size, zip_error_t *
         return NULL;
     }
 
-    aes->pbKeyObject = malloc(aes->cbKeyObject);
+    aes->pbKeyObject = _zip_malloc(aes->cbKeyObject);
     if (aes->pbKeyObject == NULL) {
         _zip_crypto_aes_free(aes);
         zip_error_set(error, ZIP_ER_MEMORY, 0);
@@ -356,20 +356,25 @@ _zip_crypto_aes_free(_zip_crypto_aes_t *aes) {
     }
 
     if (aes->pbKeyObject != NULL) {
-        free(aes->pbKeyObject);
+        _zip_free(aes->pbKeyObject);
     }
 
     if (aes->hAlgorithm != NULL) {
         BCryptCloseAlgorithmProvider(aes->hAlgorithm, 0);
     }
 
-    free(aes);
+    _zip_free(aes);
 }
 
 bool
-_zip_crypto_aes_encrypt_block(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out) {
+_zip_crypto_aes_encrypt_blocks(_zip_crypto_aes_t *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length) {
     ULONG cbResult;
-    NTSTATUS status = BCryptEncrypt(aes->hKey, (PUCHAR)in, ZIP_CRYPTO_AES_BLOCK_LENGTH, NULL, NULL, 0, (PUCHAR)out, ZIP_CRYPTO_AES_BLOCK_LENGTH, &cbResult, 0);
+    NTSTATUS status;
+
+    if (length > ULONG_MAX) {
+        return FALSE;
+    }
+    status = BCryptEncrypt(aes->hKey, (PUCHAR)in, (ULONG)length, NULL, NULL, 0, (PUCHAR)out, (ULONG)length, &cbResult, 0);
     return BCRYPT_SUCCESS(status);
 }
 
@@ -395,7 +400,7 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
         return NULL;
     }
 
-    hmac = (_zip_crypto_hmac_t *)calloc(1, sizeof(*hmac));
+    hmac = (_zip_crypto_hmac_t *)_zip_calloc(1, sizeof(*hmac));
 
     if (hmac == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
@@ -414,7 +419,7 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
         return NULL;
     }
 
-    hmac->pbHashObject = malloc(hmac->cbHashObject);
+    hmac->pbHashObject = _zip_malloc(hmac->cbHashObject);
     if (hmac->pbHashObject == NULL) {
         _zip_crypto_hmac_free(hmac);
         zip_error_set(error, ZIP_ER_MEMORY, 0);
@@ -427,7 +432,7 @@ _zip_crypto_hmac_new(const zip_uint8_t *secret, zip_uint64_t secret_length, zip_
         return NULL;
     }
 
-    hmac->pbHash = malloc(hmac->cbHash);
+    hmac->pbHash = _zip_malloc(hmac->cbHash);
     if (hmac->pbHash == NULL) {
         _zip_crypto_hmac_free(hmac);
         zip_error_set(error, ZIP_ER_MEMORY, 0);
@@ -454,18 +459,18 @@ _zip_crypto_hmac_free(_zip_crypto_hmac_t *hmac) {
     }
 
     if (hmac->pbHash != NULL) {
-        free(hmac->pbHash);
+        _zip_free(hmac->pbHash);
     }
 
     if (hmac->pbHashObject != NULL) {
-        free(hmac->pbHashObject);
+        _zip_free(hmac->pbHashObject);
     }
 
     if (hmac->hAlgorithm) {
         BCryptCloseAlgorithmProvider(hmac->hAlgorithm, 0);
     }
 
-    free(hmac);
+    _zip_free(hmac);
 }
 
 bool
@@ -0,0 +1,509 @@
+/*
+  zip_dedup.c -- write identical data of new entries only once
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* compressed data of an original kept for its duplicates is limited to this size */
+#define DEDUP_CAPTURE_MAX (64 * 1024 * 1024)
+#define DEDUP_READ_SIZE (64 * 1024)
+
+typedef struct {
+    zip_uint64_t original;  /* index of entry with the same data written earlier, ZIP_UINT64_MAX for none */
+    zip_uint64_t remaining; /* for originals: number of duplicates not yet written */
+    zip_uint8_t *data;      /* for originals: compressed data as written */
+    zip_uint64_t length;
+    zip_uint64_t alloc;
+    bool complete; /* data holds all of the compressed data */
+    bool failed;   /* data was too big to keep */
+} dedup_entry_t;
+
+struct zip_dedup {
+    dedup_entry_t *entries; /* one per entry of the archive */
+    zip_uint64_t nentry;
+    zip_memory_budget_t *budget;
+};
+
+typedef struct {
+    zip_dedup_t *dedup;
+    dedup_entry_t *entry;
+} capture_t;
+
+typedef struct {
+    zip_uint64_t idx;
+    zip_uint64_t size;
+    zip_int32_t comp_method;
+    zip_uint32_t compression_level;
+    zip_uint32_t crc;
+    zip_uint64_t position; /* in filelist, i.e. order of writing */
+} dedup_candidate_t;
+
+static void capture_reset(zip_dedup_t *dedup, dedup_entry_t *entry);
+static zip_int64_t capture_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+static int candidate_compare(const void *a, const void *b);
+static int candidate_compare_position(const void *a, const void *b);
+static bool candidate_crc(zip_t *za, dedup_candidate_t *candidate, zip_uint8_t *buffer);
+static bool sources_equal(zip_source_t *a, zip_source_t *b, zip_uint8_t *buffer_a, zip_uint8_t *buffer_b);
+static bool source_is_candidate(zip_t *za, zip_uint64_t idx, dedup_candidate_t *candidate);
+
+
+/* Find new entries whose data is identical to that of a new entry written before them, for ZIP_AFL_DEDUPLICATE.
+   Only entries of equal size are read, to compare CRCs and then their data.
+   Sets za->dedup to NULL if there are no duplicates. */
+int
+_zip_dedup_find(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors) {
+    dedup_candidate_t *candidates;
+    zip_uint8_t *buffer;
+    zip_dedup_t *dedup = NULL;
+    zip_uint64_t i, j, k, ncandidates;
+
+    za->dedup = NULL;
+
+    if ((candidates = (dedup_candidate_t *)_zip_malloc(sizeof(candidates[0]) * (size_t)ZIP_MAX(survivors, 1))) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    ncandidates = 0;
+    for (i = 0; i < survivors; i++) {
+        if (source_is_candidate(za, filelist[i].idx, candidates + ncandidates)) {
+            candidates[ncandidates].position = i;
+            ncandidates++;
+        }
+    }
+    if (ncandidates < 2) {
+        _zip_free(candidates);
+        return 0;
+    }
+
+    if ((buffer = (zip_uint8_t *)_zip_malloc(2 * DEDUP_READ_SIZE)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        _zip_free(candidates);
+        return -1;
+    }
+
+    qsort(candidates, (size_t)ncandidates, sizeof(candidates[0]), candidate_compare);
+
+    for (i = 0; i < ncandidates; i = j) {
+        for (j = i + 1; j < ncandidates && candidate_compare(candidates + i, candidates + j) == 0; j++) {
+        }
+        if (j - i < 2) {
+            continue;
+        }
+
+        /* same size and compression, check the data */
+        for (k = i; k < j; k++) {
+            if (!candidate_crc(za, candidates + k, buffer)) {
+                candidates[k].size = ZIP_UINT64_MAX;
+            }
+        }
+        qsort(candidates + i, (size_t)(j - i), sizeof(candidates[0]), candidate_compare_position);
+
+        for (k = i + 1; k < j; k++) {
+            zip_uint64_t l;
+
+            if (candidates[k].size == ZIP_UINT64_MAX) {
+                continue;
+            }
+            for (l = i; l < k; l++) {
+                zip_source_t *src_k, *src_l;
+
+                if (candidates[l].size == ZIP_UINT64_MAX || candidates[l].crc != candidates[k].crc || (dedup != NULL && dedup->entries[candidates[l].idx].original != ZIP_UINT64_MAX)) {
+                    continue;
+                }
+                src_k = za->entry[candidates[k].idx].source;
+                src_l = za->entry[candidates[l].idx].source;
+                if (src_k != src_l && !sources_equal(src_k, src_l, buffer, buffer + DEDUP_READ_SIZE)) {
+                    continue;
+                }
+
+                if (dedup == NULL) {
+                    if ((dedup = _zip_dedup_new(za->nentry, za->memory_budget, &za->error)) == NULL) {
+                        _zip_free(buffer);
+                        _zip_free(candidates);
+                        return -1;
+                    }
+                }
+                dedup->entries[candidates[k].idx].original = candidates[l].idx;
+                dedup->entries[candidates[l].idx].remaining++;
+                break;
+            }
+        }
+    }
+
+    _zip_free(buffer);
+    _zip_free(candidates);
+
+    za->dedup = dedup;
+    return 0;
+}
+
+
+zip_dedup_t *
+_zip_dedup_new(zip_uint64_t nentry, zip_memory_budget_t *budget, zip_error_t *error) {
+    zip_dedup_t *dedup;
+    zip_uint64_t i;
+
+    if (nentry > SIZE_MAX / sizeof(dedup->entries[0])) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((dedup = (zip_dedup_t *)_zip_malloc(sizeof(*dedup))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((dedup->entries = (dedup_entry_t *)_zip_malloc(sizeof(dedup->entries[0]) * (size_t)ZIP_MAX(nentry, 1))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_free(dedup);
+        return NULL;
+    }
+    for (i = 0; i < nentry; i++) {
+        dedup->entries[i].original = ZIP_UINT64_MAX;
+        dedup->entries[i].remaining = 0;
+        dedup->entries[i].data = NULL;
+        dedup->entries[i].length = dedup->entries[i].alloc = 0;
+        dedup->entries[i].complete = false;
+        dedup->entries[i].failed = false;
+    }
+    dedup->nentry = nentry;
+    dedup->budget = budget;
+
+    return dedup;
+}
+
+
+void
+_zip_dedup_free(zip_dedup_t *dedup) {
+    zip_uint64_t i;
+
+    if (dedup == NULL) {
+        return;
+    }
+
+    for (i = 0; i < dedup->nentry; i++) {
+        capture_reset(dedup, dedup->entries + i);
+    }
+    _zip_free(dedup->entries);
+    _zip_free(dedup);
+}
+
+
+/* Return index of entry written earlier with the same data as entry idx, ZIP_UINT64_MAX if there is none. */
+zip_uint64_t
+_zip_dedup_original(const zip_dedup_t *dedup, zip_uint64_t idx) {
+    if (dedup == NULL || idx >= dedup->nentry) {
+        return ZIP_UINT64_MAX;
+    }
+
+    return dedup->entries[idx].original;
+}
+
+
+/* Wrap src, the compressed data of entry idx, in a layer that keeps it for the duplicates of idx.
+   Takes over src, which is freed on error. */
+zip_source_t *
+_zip_dedup_capture(zip_dedup_t *dedup, zip_uint64_t idx, zip_source_t *src, zip_error_t *error) {
+    capture_t *ctx;
+    zip_source_t *s2;
+
+    if (dedup == NULL || idx >= dedup->nentry || dedup->entries[idx].remaining == 0) {
+        return src;
+    }
+
+    if ((ctx = (capture_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        zip_source_free(src);
+        return NULL;
+    }
+    ctx->dedup = dedup;
+    ctx->entry = dedup->entries + idx;
+
+    if ((s2 = zip_source_layered_create(src, capture_callback, ctx, error)) == NULL) {
+        _zip_free(ctx);
+        zip_source_free(src);
+        return NULL;
+    }
+
+    return s2;
+}
+
+
+/* Return compressed data of entry idx kept for its duplicates, NULL if it was not kept completely. */
+const zip_uint8_t *
+_zip_dedup_data(const zip_dedup_t *dedup, zip_uint64_t idx, zip_uint64_t *lengthp) {
+    const dedup_entry_t *entry;
+
+    if (dedup == NULL || idx >= dedup->nentry) {
+        return NULL;
+    }
+
+    entry = dedup->entries + idx;
+    if (!entry->complete || entry->failed) {
+        return NULL;
+    }
+
+    *lengthp = entry->length;
+    return entry->data;
+}
+
+
+/* Duplicate idx has been written, release data of its original once all duplicates are. */
+void
+_zip_dedup_release(zip_dedup_t *dedup, zip_uint64_t idx) {
+    dedup_entry_t *original;
+
+    if (dedup == NULL || idx >= dedup->nentry || dedup->entries[idx].original == ZIP_UINT64_MAX) {
+        return;
+    }
+
+    original = dedup->entries + dedup->entries[idx].original;
+    if (original->remaining > 0 && --original->remaining == 0) {
+        capture_reset(dedup, original);
+    }
+}
+
+
+static zip_int64_t
+capture_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    capture_t *ctx = (capture_t *)ud;
+    dedup_entry_t *entry = ctx->entry;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN:
+        capture_reset(ctx->dedup, entry);
+        return 0;
+
+    case ZIP_SOURCE_READ: {
+        zip_int64_t n;
+
+        if ((n = zip_source_read(src, data, length)) < 0) {
+            return n;
+        }
+        if (entry->failed) {
+            return n;
+        }
+        if (n == 0) {
+            entry->complete = true;
+            return 0;
+        }
+
+        if (entry->length + (zip_uint64_t)n > entry->alloc) {
+            zip_uint64_t alloc = ZIP_MAX(entry->alloc * 2, entry->length + (zip_uint64_t)n);
+            zip_uint8_t *buffer;
+
+            alloc = ZIP_MIN(alloc, DEDUP_CAPTURE_MAX);
+            if (entry->length + (zip_uint64_t)n > alloc || !_zip_memory_budget_charge(ctx->dedup->budget, alloc - entry->alloc, NULL)) {
+                /* duplicates are compressed again */
+                capture_reset(ctx->dedup, entry);
+                entry->failed = true;
+                return n;
+            }
+            if ((buffer = (zip_uint8_t *)_zip_realloc(entry->data, (size_t)alloc)) == NULL) {
+                _zip_memory_budget_release(ctx->dedup->budget, alloc - entry->alloc);
+                capture_reset(ctx->dedup, entry);
+                entry->failed = true;
+                return n;
+            }
+            entry->data = buffer;
+            entry->alloc = alloc;
+        }
+        memcpy(entry->data + entry->length, data, (size_t)n);
+        entry->length += (zip_uint64_t)n;
+        return n;
+    }
+
+    case ZIP_SOURCE_ERROR:
+        /* all errors come from lower source */
+        return zip_error_to_data(zip_source_error(src), data, length);
+
+    case ZIP_SOURCE_FREE:
+        /* captured data belongs to dedup */
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS: {
+        zip_int64_t mask = zip_source_pass_to_lower_layer(src, data, length, cmd);
+
+        if (mask < 0) {
+            return mask;
+        }
+        return mask | zip_source_make_command_bitmap(ZIP_SOURCE_FREE, -1);
+    }
+
+    default:
+        return zip_source_pass_to_lower_layer(src, data, length, cmd);
+    }
+}
+
+
+static void
+capture_reset(zip_dedup_t *dedup, dedup_entry_t *entry) {
+    if (entry->alloc > 0) {
+        _zip_memory_budget_release(dedup->budget, entry->alloc);
+    }
+    _zip_free(entry->data);
+    entry->data = NULL;
+    entry->length = entry->alloc = 0;
+    entry->complete = false;
+    entry->failed = false;
+}
+
+
+/* order by size and compression, so candidates that can be duplicates are adjacent */
+static int
+candidate_compare(const void *a, const void *b) {
+    const dedup_candidate_t *ca = (const dedup_candidate_t *)a;
+    const dedup_candidate_t *cb = (const dedup_candidate_t *)b;
+
+    if (ca->size != cb->size) {
+        return ca->size < cb->size ? -1 : 1;
+    }
+    if (ca->comp_method != cb->comp_method) {
+        return ca->comp_method < cb->comp_method ? -1 : 1;
+    }
+    if (ca->compression_level != cb->compression_level) {
+        return ca->compression_level < cb->compression_level ? -1 : 1;
+    }
+    return 0;
+}
+
+
+static int
+candidate_compare_position(const void *a, const void *b) {
+    const dedup_candidate_t *ca = (const dedup_candidate_t *)a;
+    const dedup_candidate_t *cb = (const dedup_candidate_t *)b;
+
+    if (ca->position != cb->position) {
+        return ca->position < cb->position ? -1 : 1;
+    }
+    return 0;
+}
+
+
+/* Compute CRC of data of candidate, return false if it can't be read. */
+static bool
+candidate_crc(zip_t *za, dedup_candidate_t *candidate, zip_uint8_t *buffer) {
+    zip_source_t *src = za->entry[candidate->idx].source;
+    zip_uint64_t total = 0;
+    zip_uint32_t crc = 0;
+    zip_int64_t n;
+
+    if (zip_source_open(src) < 0) {
+        return false;
+    }
+    while ((n = zip_source_read(src, buffer, DEDUP_READ_SIZE)) > 0) {
+        crc = _zip_crc32(crc, buffer, (zip_uint64_t)n);
+        total += (zip_uint64_t)n;
+    }
+    zip_source_close(src);
+
+    if (n < 0 || total != candidate->size) {
+        return false;
+    }
+    candidate->crc = crc;
+    return true;
+}
+
+
+/* Compare data of two sources of the same size byte by byte. */
+static bool
+sources_equal(zip_source_t *a, zip_source_t *b, zip_uint8_t *buffer_a, zip_uint8_t *buffer_b) {
+    bool equal = true;
+
+    if (zip_source_open(a) < 0) {
+        return false;
+    }
+    if (zip_source_open(b) < 0) {
+        zip_source_close(a);
+        return false;
+    }
+
+    while (equal) {
+        zip_int64_t n_a, n_b, done;
+
+        if ((n_a = zip_source_read(a, buffer_a, DEDUP_READ_SIZE)) < 0) {
+            equal = false;
+            break;
+        }
+        /* sources may return short reads, read the same amount from b */
+        for (done = 0; done < n_a; done += n_b) {
+            if ((n_b = zip_source_read(b, buffer_b + done, (zip_uint64_t)(n_a - done))) <= 0) {
+                break;
+            }
+        }
+        if (done != n_a || memcmp(buffer_a, buffer_b, (size_t)n_a) != 0) {
+            equal = false;
+        }
+        if (n_a == 0) {
+            break;
+        }
+    }
+
+    zip_source_close(a);
+    zip_source_close(b);
+
+    return equal;
+}
+
+
+static bool
+source_is_candidate(zip_t *za, zip_uint64_t idx, dedup_candidate_t *candidate) {
+    zip_entry_t *entry = za->entry + idx;
+    zip_dirent_t *de = entry->changes ? entry->changes : entry->orig;
+    zip_stat_t st;
+
+    if (!ZIP_ENTRY_DATA_CHANGED(entry) || de == NULL || de->encryption_method != ZIP_EM_NONE || ZIP_WANT_SEEKABLE_COMPRESSION(de->compression_level) || (de->changed & ZIP_DIRENT_COMPRESSION_PARAMETERS)) {
+        return false;
+    }
+    if (zip_source_stat(entry->source, &st) < 0 || !(st.valid & ZIP_STAT_SIZE) || st.size == 0) {
+        return false;
+    }
+    if ((st.valid & ZIP_STAT_COMP_METHOD) && st.comp_method != ZIP_CM_STORE) {
+        return false;
+    }
+    if ((st.valid & ZIP_STAT_ENCRYPTION_METHOD) && st.encryption_method != ZIP_EM_NONE) {
+        return false;
+    }
+    if ((zip_source_supports(entry->source) & ZIP_SOURCE_SUPPORTS_SEEKABLE) != ZIP_SOURCE_SUPPORTS_SEEKABLE && !zip_source_supports_reopen(entry->source)) {
+        return false;
+    }
+
+    candidate->idx = idx;
+    candidate->size = st.size;
+    candidate->comp_method = de->comp_method;
+    candidate->compression_level = de->compression_level;
+    candidate->crc = 0;
+    return true;
+}
@@ -53,10 +53,15 @@ zip_delete(zip_t *za, zip_uint64_t idx) {
         return -1;
     }
 
-    if (!_zip_hash_delete(za->names, (const zip_uint8_t *)name, &za->error)) {
+    if (!_zip_entry_log_change(za, idx)) {
         return -1;
     }
 
+    if (!_zip_names_build_hash(za, &za->error) || !_zip_hash_delete(za->names, (const zip_uint8_t *)name, &za->error)) {
+        return -1;
+    }
+    _zip_name_index_free(za);
+
     /* allow duplicate file names, because the file will
      * be removed directly afterwards */
     if (_zip_unchange(za, idx, 1) != 0)
@@ -0,0 +1,141 @@
+/*
+  zip_digest.c -- digest extra field
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include "zipint.h"
+
+/* The digest extra field records a strong digest of the uncompressed data of an entry, computed while it was written,
+   so it can be compared against without reading the data.
+
+   Layout (all little endian):
+     version (1 byte, currently 1)
+     CRC, uncompressed size of data (4, 8 bytes)
+     algorithm (1 byte, 1 for SHA-256)
+     digest (32 bytes)
+
+   The CRC and size guard against tools that replace the data but keep unknown extra fields. */
+
+#define DIGEST_VERSION 1
+#define DIGEST_ALGORITHM_SHA256 1
+#define DIGEST_SIZE (14 + ZIP_DIGEST_LENGTH)
+/* room left for extra fields added when writing directory entry (Zip64, UTF-8 name and comment) */
+#define DIGEST_RESERVED_SIZE 64
+
+
+/* Get digest of data of de into digest, return whether it has one that matches the data. */
+bool
+_zip_digest_get(const zip_dirent_t *de, zip_uint8_t *digest) {
+    const zip_uint8_t *data;
+    zip_buffer_t *buffer;
+    bool ok;
+    zip_uint16_t length;
+
+    if ((data = _zip_dirent_get_extra_field(de, &length, ZIP_EF_DIGEST, ZIP_EF_CENTRAL)) == NULL || length != DIGEST_SIZE) {
+        return false;
+    }
+    if ((buffer = _zip_buffer_new((zip_uint8_t *)data, length)) == NULL) {
+        return false;
+    }
+
+    ok = _zip_buffer_get_8(buffer) == DIGEST_VERSION && _zip_buffer_get_32(buffer) == de->crc && _zip_buffer_get_64(buffer) == de->uncomp_size && _zip_buffer_get_8(buffer) == DIGEST_ALGORITHM_SHA256;
+    if (ok) {
+        (void)memcpy_s(digest, ZIP_DIGEST_LENGTH, _zip_buffer_get(buffer, ZIP_DIGEST_LENGTH), ZIP_DIGEST_LENGTH);
+    }
+    _zip_buffer_free(buffer);
+
+    return ok;
+}
+
+
+/* Replace digest of entry idx, whose data has been written, by digest; remove it if digest is NULL. */
+int
+_zip_digest_set(zip_t *za, zip_uint64_t idx, const zip_uint8_t *digest) {
+    zip_dirent_t *de = za->entry[idx].changes;
+    zip_extra_field_t *ef;
+    zip_buffer_t *buffer;
+    zip_uint8_t data[DIGEST_SIZE];
+    zip_uint32_t used;
+
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return -1;
+    }
+
+    if (digest != NULL) {
+        used = (zip_uint32_t)_zip_ef_size(de->extra_fields, ZIP_EF_CENTRAL) + _zip_string_length(de->filename) + _zip_string_length(de->comment) + DIGEST_RESERVED_SIZE;
+        if (used + 4 + DIGEST_SIZE > ZIP_UINT16_MAX) {
+            /* no room, digest is optional */
+            digest = NULL;
+        }
+    }
+
+    if (digest == NULL && _zip_ef_get_by_id(de->extra_fields, NULL, ZIP_EF_DIGEST, 0, ZIP_EF_BOTH, NULL) == NULL) {
+        return 0;
+    }
+
+    if (_zip_file_extra_field_prepare_for_change(za, idx) < 0) {
+        return -1;
+    }
+    de = za->entry[idx].changes;
+    de->extra_fields = _zip_ef_delete_by_id(de->extra_fields, ZIP_EF_DIGEST, ZIP_EXTRA_FIELD_ALL, ZIP_EF_BOTH);
+
+    if (digest == NULL) {
+        return 0;
+    }
+
+    if ((buffer = _zip_buffer_new(data, sizeof(data))) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    _zip_buffer_put_8(buffer, DIGEST_VERSION);
+    _zip_buffer_put_32(buffer, de->crc);
+    _zip_buffer_put_64(buffer, de->uncomp_size);
+    _zip_buffer_put_8(buffer, DIGEST_ALGORITHM_SHA256);
+    _zip_buffer_put(buffer, digest, ZIP_DIGEST_LENGTH);
+
+    if (!_zip_buffer_ok(buffer)) {
+        _zip_buffer_free(buffer);
+        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+        return -1;
+    }
+    _zip_buffer_free(buffer);
+
+    if ((ef = _zip_ef_new(ZIP_EF_DIGEST, DIGEST_SIZE, data, ZIP_EF_CENTRAL)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    de->extra_fields = _zip_ef_merge(de->extra_fields, ef);
+
+    return 0;
+}
@@ -61,7 +61,7 @@ zip_dir_add(zip_t *za, const char *name, zip_flags_t flags) {
     len = strlen(name);
 
     if (name[len - 1] != '/') {
-        if (len > SIZE_MAX - 2 || (s = (char *)malloc(len + 2)) == NULL) {
+        if (len > SIZE_MAX - 2 || (s = (char *)_zip_malloc(len + 2)) == NULL) {
             zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
             return -1;
         }
@@ -71,13 +71,13 @@ zip_dir_add(zip_t *za, const char *name, zip_flags_t flags) {
     }
 
     if ((source = zip_source_buffer(za, NULL, 0, 0)) == NULL) {
-        free(s);
+        _zip_free(s);
         return -1;
     }
 
     idx = _zip_file_replace(za, ZIP_UINT64_MAX, s ? s : name, source, flags);
 
-    free(s);
+    _zip_free(s);
 
     if (idx < 0)
         zip_source_free(source);
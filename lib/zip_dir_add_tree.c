@@ -0,0 +1,440 @@
+/*
+  zip_dir_add_tree.c -- add directory tree to zip archive
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+#include "zipint.h"
+
+/* sources are created in jobs of this many files */
+#define TREE_JOB_SIZE 64
+
+typedef struct {
+    char *path; /* in file system */
+    char *name; /* in archive */
+    bool is_dir;
+    zip_uint32_t mode; /* directories only */
+    time_t mtime;      /* directories only */
+    zip_source_t *source;
+    zip_int64_t index; /* in archive once added */
+    zip_error_t error;
+} tree_entry_t;
+
+typedef struct {
+    tree_entry_t *entries;
+    zip_uint64_t nentries;
+    zip_uint64_t alloc;
+} tree_t;
+
+typedef struct {
+#ifdef HAVE_THREADS
+    zip_thread_job_t job;
+#endif
+    tree_entry_t *entries;
+    zip_uint64_t nentries;
+} tree_job_t;
+
+static void tree_create_sources(zip_t *za, tree_t *tree);
+static void tree_free(tree_t *tree);
+static void tree_job_run(void *ud);
+static bool tree_walk(tree_t *tree, const char *path, const char *name, zip_error_t *error);
+#ifndef _WIN32
+static bool tree_add(tree_t *tree, char *path, char *name, const struct stat *st, zip_error_t *error);
+static int tree_name_compare(const void *a, const void *b);
+static char *tree_path(const char *directory, const char *name, char separator, zip_error_t *error);
+#endif
+
+
+ZIP_EXTERN zip_int64_t
+zip_dir_add_tree(zip_t *za, const char *path, const char *prefix, zip_flags_t flags) {
+    tree_t tree;
+    zip_uint64_t i, added;
+    zip_uint64_t nentry_before;
+    char *name_prefix;
+    size_t prefix_length;
+
+    if (ZIP_IS_RDONLY(za)) {
+        zip_error_set(&za->error, ZIP_ER_RDONLY, 0);
+        return -1;
+    }
+
+    if (path == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    /* names are prefix, separated by a slash, followed by the path of the file relative to path */
+    prefix_length = prefix != NULL ? strlen(prefix) : 0;
+    if (prefix_length > 0 && prefix[prefix_length - 1] == '/') {
+        prefix_length--;
+    }
+    if ((name_prefix = (char *)_zip_malloc(prefix_length + 1)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    if (prefix_length > 0) {
+        (void)memcpy_s(name_prefix, prefix_length + 1, prefix, prefix_length);
+    }
+    name_prefix[prefix_length] = '\0';
+
+    tree.entries = NULL;
+    tree.nentries = tree.alloc = 0;
+
+    if (!tree_walk(&tree, path, name_prefix, &za->error)) {
+        _zip_free(name_prefix);
+        tree_free(&tree);
+        return -1;
+    }
+    _zip_free(name_prefix);
+
+    /* creating a file source stats the file, which is done in parallel for many files */
+    tree_create_sources(za, &tree);
+
+    nentry_before = za->nentry;
+    added = 0;
+    for (i = 0; i < tree.nentries; i++) {
+        tree_entry_t *entry = tree.entries + i;
+        zip_int64_t idx;
+
+        if (entry->is_dir) {
+            if ((idx = zip_dir_add(za, entry->name, flags)) < 0) {
+                break;
+            }
+            entry->index = idx;
+            if (zip_file_set_external_attributes(za, (zip_uint64_t)idx, 0, ZIP_OPSYS_UNIX, entry->mode << 16) < 0 || zip_file_set_mtime(za, (zip_uint64_t)idx, entry->mtime, 0) < 0) {
+                added++;
+                break;
+            }
+        }
+        else {
+            if (entry->source == NULL) {
+                _zip_error_copy(&za->error, &entry->error);
+                break;
+            }
+            if ((idx = zip_file_add(za, entry->name, entry->source, flags)) < 0) {
+                break;
+            }
+            entry->index = idx;
+            /* archive owns source now */
+            entry->source = NULL;
+        }
+        added++;
+    }
+
+    if (i < tree.nentries) {
+        zip_error_t error;
+
+        /* don't leave part of the tree behind: remove new entries, restore overwritten ones */
+        zip_error_init(&error);
+        _zip_error_copy(&error, &za->error);
+        for (i = 0; i < added; i++) {
+            zip_uint64_t idx = (zip_uint64_t)tree.entries[i].index;
+
+            if (idx >= nentry_before) {
+                zip_delete(za, idx);
+            }
+            else {
+                zip_unchange(za, idx);
+            }
+        }
+        _zip_error_copy(&za->error, &error);
+        zip_error_fini(&error);
+        tree_free(&tree);
+        return -1;
+    }
+
+    tree_free(&tree);
+    return (zip_int64_t)added;
+}
+
+
+#ifndef _WIN32
+static bool
+tree_add(tree_t *tree, char *path, char *name, const struct stat *st, zip_error_t *error) {
+    tree_entry_t *entry;
+
+    if (tree->nentries == tree->alloc) {
+        zip_uint64_t alloc = tree->alloc > 0 ? tree->alloc * 2 : 256;
+        tree_entry_t *entries;
+
+        if (alloc > SIZE_MAX / sizeof(entries[0]) || (entries = (tree_entry_t *)_zip_realloc(tree->entries, (size_t)alloc * sizeof(entries[0]))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        tree->entries = entries;
+        tree->alloc = alloc;
+    }
+
+    entry = tree->entries + tree->nentries++;
+    entry->path = path;
+    entry->name = name;
+    entry->is_dir = S_ISDIR(st->st_mode);
+    entry->mode = (zip_uint32_t)st->st_mode & 0177777u;
+    entry->mtime = st->st_mtime;
+    entry->source = NULL;
+    entry->index = -1;
+    zip_error_init(&entry->error);
+
+    return true;
+}
+#endif
+
+
+/* Create file sources for files in tree, using the threads of za. Errors are recorded per entry. */
+static void
+tree_create_sources(zip_t *za, tree_t *tree) {
+    tree_job_t *jobs;
+    zip_uint64_t i, njobs;
+#ifdef HAVE_THREADS
+    zip_thread_pool_t *pool = NULL;
+#endif
+
+    njobs = (tree->nentries + TREE_JOB_SIZE - 1) / TREE_JOB_SIZE;
+    if (njobs == 0) {
+        return;
+    }
+
+    if (njobs > SIZE_MAX / sizeof(jobs[0]) || (jobs = (tree_job_t *)_zip_malloc(sizeof(jobs[0]) * (size_t)njobs)) == NULL) {
+        /* each file is stat'ed in calling thread */
+        tree_job_t job;
+
+        job.entries = tree->entries;
+        job.nentries = tree->nentries;
+        tree_job_run(&job);
+        return;
+    }
+
+    for (i = 0; i < njobs; i++) {
+        jobs[i].entries = tree->entries + i * TREE_JOB_SIZE;
+        jobs[i].nentries = ZIP_MIN(TREE_JOB_SIZE, tree->nentries - i * TREE_JOB_SIZE);
+    }
+
+#ifdef HAVE_THREADS
+    /* stat files in calling thread if pool can't be created */
+    if (za->num_threads > 1 && njobs > 1) {
+        pool = _zip_thread_pool_new(za->num_threads, NULL);
+    }
+    if (pool != NULL) {
+        for (i = 0; i < njobs; i++) {
+            jobs[i].job.run = tree_job_run;
+            jobs[i].job.ud = jobs + i;
+            _zip_thread_pool_submit(pool, &jobs[i].job);
+        }
+        for (i = 0; i < njobs; i++) {
+            _zip_thread_pool_wait(pool, &jobs[i].job);
+        }
+        _zip_thread_pool_free(pool);
+        _zip_free(jobs);
+        return;
+    }
+#else
+    (void)za;
+#endif
+
+    for (i = 0; i < njobs; i++) {
+        tree_job_run(jobs + i);
+    }
+    _zip_free(jobs);
+}
+
+
+static void
+tree_free(tree_t *tree) {
+    zip_uint64_t i;
+
+    for (i = 0; i < tree->nentries; i++) {
+        _zip_free(tree->entries[i].path);
+        _zip_free(tree->entries[i].name);
+        zip_source_free(tree->entries[i].source);
+        zip_error_fini(&tree->entries[i].error);
+    }
+    _zip_free(tree->entries);
+}
+
+
+/* Create sources for a range of entries, runs in worker thread. */
+static void
+tree_job_run(void *ud) {
+    tree_job_t *job = (tree_job_t *)ud;
+    zip_uint64_t i;
+
+    for (i = 0; i < job->nentries; i++) {
+        tree_entry_t *entry = job->entries + i;
+
+        if (!entry->is_dir) {
+            entry->source = zip_source_file_create(entry->path, 0, ZIP_LENGTH_TO_END, &entry->error);
+        }
+    }
+}
+
+
+#ifndef _WIN32
+static int
+tree_name_compare(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+
+/* Return newly allocated directory, followed by separator unless it is empty, followed by name. */
+static char *
+tree_path(const char *directory, const char *name, char separator, zip_error_t *error) {
+    size_t directory_length = strlen(directory);
+    size_t name_length = strlen(name);
+    size_t length = directory_length + (directory_length > 0 ? 1 : 0) + name_length;
+    char *path;
+
+    if ((path = (char *)_zip_malloc(length + 1)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    (void)memcpy_s(path, length + 1, directory, directory_length);
+    if (directory_length > 0) {
+        path[directory_length++] = separator;
+    }
+    (void)memcpy_s(path + directory_length, length + 1 - directory_length, name, name_length);
+    path[length] = '\0';
+
+    return path;
+}
+
+
+/* Add contents of directory path to tree, with names in archive starting with name.
+   Entries are sorted by name, so the archive doesn't depend on the order of the directory.
+   Symbolic links to files are added as files, other special files and links are skipped. */
+static bool
+tree_walk(tree_t *tree, const char *path, const char *name, zip_error_t *error) {
+    DIR *dir;
+    struct dirent *de;
+    char **names = NULL;
+    size_t i, nnames = 0, names_alloc = 0;
+    bool ok = true;
+
+    if ((dir = opendir(path)) == NULL) {
+        zip_error_set(error, ZIP_ER_OPEN, errno);
+        return false;
+    }
+
+    for (;;) {
+        errno = 0;
+        if ((de = readdir(dir)) == NULL) {
+            if (errno != 0) {
+                zip_error_set(error, ZIP_ER_READ, errno);
+                ok = false;
+            }
+            break;
+        }
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        if (nnames == names_alloc) {
+            size_t alloc = names_alloc > 0 ? names_alloc * 2 : 16;
+            char **new_names;
+
+            if ((new_names = (char **)_zip_realloc(names, alloc * sizeof(names[0]))) == NULL) {
+                zip_error_set(error, ZIP_ER_MEMORY, 0);
+                ok = false;
+                break;
+            }
+            names = new_names;
+            names_alloc = alloc;
+        }
+        if ((names[nnames] = _zip_strdup(de->d_name)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            ok = false;
+            break;
+        }
+        nnames++;
+    }
+    closedir(dir);
+
+    if (ok && nnames > 1) {
+        qsort(names, nnames, sizeof(names[0]), tree_name_compare);
+    }
+
+    for (i = 0; ok && i < nnames; i++) {
+        char *child_path, *child_name;
+        struct stat st;
+
+        if ((child_path = tree_path(path, names[i], '/', error)) == NULL) {
+            ok = false;
+            break;
+        }
+        if (lstat(child_path, &st) < 0 || (S_ISLNK(st.st_mode) && stat(child_path, &st) == 0 && !S_ISREG(st.st_mode))) {
+            /* vanished, dangling or not a file */
+            _zip_free(child_path);
+            continue;
+        }
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+            _zip_free(child_path);
+            continue;
+        }
+        if ((child_name = tree_path(name, names[i], '/', error)) == NULL) {
+            _zip_free(child_path);
+            ok = false;
+            break;
+        }
+        if (!tree_add(tree, child_path, child_name, &st, error)) {
+            _zip_free(child_path);
+            _zip_free(child_name);
+            ok = false;
+            break;
+        }
+        if (S_ISDIR(st.st_mode) && !tree_walk(tree, child_path, child_name, error)) {
+            ok = false;
+        }
+    }
+
+    for (i = 0; i < nnames; i++) {
+        _zip_free(names[i]);
+    }
+    _zip_free(names);
+
+    return ok;
+}
+#else
+static bool
+tree_walk(tree_t *tree, const char *path, const char *name, zip_error_t *error) {
+    (void)tree;
+    (void)path;
+    (void)name;
+    zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+    return false;
+}
+#endif
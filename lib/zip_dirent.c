@@ -37,14 +37,18 @@
 #include <string.h>
 #include <sys/types.h>
 #include <time.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
-static zip_string_t *_zip_dirent_process_ef_utf_8(const zip_dirent_t *de, zip_uint16_t id, zip_string_t *str);
+static zip_string_t *_zip_dirent_process_ef_utf_8(const zip_dirent_t *de, zip_uint16_t id, zip_string_t *str, zip_arena_t *arena);
 static zip_extra_field_t *_zip_ef_utf8(zip_uint16_t, zip_string_t *, zip_error_t *);
 static bool _zip_dirent_process_winzip_aes(zip_dirent_t *de, zip_error_t *error);
 
+/* extra bytes read beyond the expected length of a local header, see _zip_dirent_read_local_header */
+#define LOCAL_HEADER_SLACK 32
+/* local headers of many entries are read in chunks of this size, see _zip_local_header_window_fill */
+#define LOCAL_HEADER_READ_SIZE (64 * 1024)
+
 
 void
 _zip_cdir_free(zip_cdir_t *cd) {
@@ -55,17 +59,20 @@ _zip_cdir_free(zip_cdir_t *cd) {
 
     for (i = 0; i < cd->nentry; i++)
         _zip_entry_finalize(cd->entry + i);
-    free(cd->entry);
+    _zip_free(cd->entry);
+    _zip_memory_budget_release(cd->budget, sizeof(*(cd->entry)) * cd->nentry_alloc);
     _zip_string_free(cd->comment);
-    free(cd);
+    _zip_cdir_index_free(cd->index);
+    _zip_free(cd->segments);
+    _zip_free(cd);
 }
 
 
 zip_cdir_t *
-_zip_cdir_new(zip_uint64_t nentry, zip_error_t *error) {
+_zip_cdir_new(zip_uint64_t nentry, zip_memory_budget_t *budget, zip_error_t *error) {
     zip_cdir_t *cd;
 
-    if ((cd = (zip_cdir_t *)malloc(sizeof(*cd))) == NULL) {
+    if ((cd = (zip_cdir_t *)_zip_malloc(sizeof(*cd))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -75,6 +82,11 @@ _zip_cdir_new(zip_uint64_t nentry, zip_error_t *error) {
     cd->size = cd->offset = 0;
     cd->comment = NULL;
     cd->is_zip64 = false;
+    cd->index = NULL;
+    cd->budget = budget;
+    cd->segments = NULL;
+    cd->nsegments = 0;
+    cd->has_embedded_index = false;
 
     if (!_zip_cdir_grow(cd, nentry, error)) {
         _zip_cdir_free(cd);
@@ -101,7 +113,13 @@ _zip_cdir_grow(zip_cdir_t *cd, zip_uint64_t additional_entries, zip_error_t *err
         return false;
     }
 
-    if ((new_entry = (zip_entry_t *)realloc(cd->entry, sizeof(*(cd->entry)) * (size_t)new_alloc)) == NULL) {
+    /* number of entries comes from archive, a crafted one must not make us allocate unbounded memory */
+    if (!_zip_memory_budget_charge(cd->budget, sizeof(*(cd->entry)) * additional_entries, error)) {
+        return false;
+    }
+
+    if ((new_entry = (zip_entry_t *)_zip_realloc(cd->entry, sizeof(*(cd->entry)) * (size_t)new_alloc)) == NULL) {
+        _zip_memory_budget_release(cd->budget, sizeof(*(cd->entry)) * additional_entries);
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return false;
     }
@@ -118,15 +136,14 @@ _zip_cdir_grow(zip_cdir_t *cd, zip_uint64_t additional_entries, zip_error_t *err
 }
 
 
+/* Write central directory for SURVIVORS entries of FILELIST.
+   If NSEGMENTS > 0, they are a new segment of a log-structured archive
+   whose earlier SEGMENTS are listed in the Zip64 end of central directory record. */
+
 zip_int64_t
-_zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors) {
+_zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, const zip_cdir_segment_t *segments, zip_uint64_t nsegments) {
     zip_uint64_t offset, size;
-    zip_string_t *comment;
-    zip_uint8_t buf[EOCDLEN + EOCD64LEN + EOCD64LOCLEN];
-    zip_buffer_t *buffer;
     zip_int64_t off;
-    zip_uint64_t i;
-    bool is_zip64;
     int ret;
     zip_uint32_t cdir_crc;
 
@@ -136,50 +153,109 @@ _zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivor
     }
     offset = (zip_uint64_t)off;
 
-    is_zip64 = false;
-
+    cdir_crc = 0;
     if (ZIP_WANT_TORRENTZIP(za)) {
-        cdir_crc = (zip_uint32_t)crc32(0, NULL, 0);
         za->write_crc = &cdir_crc;
     }
+    ret = _zip_cdir_write_entries(za, filelist, survivors);
+    za->write_crc = NULL;
+    if (ret < 0) {
+        return -1;
+    }
 
+    if ((off = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+    size = (zip_uint64_t)off - offset;
+
+    if (_zip_cdir_write_end(za, offset, size, survivors, ret > 0, cdir_crc, segments, nsegments) < 0) {
+        return -1;
+    }
+
+    return (zip_int64_t)size;
+}
+
+
+/* Write central directory records for SURVIVORS entries of FILELIST.
+   Returns 1 if a Zip64 extra field was written, 0 if not, and -1 on error. */
+
+int
+_zip_cdir_write_entries(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors) {
+    zip_uint64_t i;
+    bool is_zip64, buffered;
+    int ret;
+
+    is_zip64 = false;
+
+    /* pass entries to the source in large chunks, not several small writes per entry */
+    buffered = _zip_write_buffer_begin(za);
     for (i = 0; i < survivors; i++) {
         zip_entry_t *entry = za->entry + filelist[i].idx;
 
-        if ((ret = _zip_dirent_write(za, entry->changes ? entry->changes : entry->orig, ZIP_FL_CENTRAL)) < 0)
+        if ((ret = _zip_dirent_write(za, entry->changes ? entry->changes : entry->orig, ZIP_FL_CENTRAL)) < 0) {
+            if (buffered) {
+                (void)_zip_write_buffer_end(za, false);
+            }
             return -1;
+        }
         if (ret)
             is_zip64 = true;
     }
+    if (buffered && _zip_write_buffer_end(za, true) < 0) {
+        return -1;
+    }
 
-    za->write_crc = NULL;
+    return is_zip64 ? 1 : 0;
+}
 
-    if ((off = zip_source_tell_write(za->src)) < 0) {
-        zip_error_set_from_source(&za->error, za->src);
-        return -1;
+
+/* Write end of central directory records and archive comment for central directory of NENTRY entries at OFFSET of SIZE bytes.
+   CDIR_CRC is the CRC of the central directory, used for the torrentzip comment. */
+
+int
+_zip_cdir_write_end(zip_t *za, zip_uint64_t offset, zip_uint64_t size, zip_uint64_t nentry, bool is_zip64, zip_uint32_t cdir_crc, const zip_cdir_segment_t *segments, zip_uint64_t nsegments) {
+    zip_uint64_t ext_length, i;
+    zip_string_t *comment;
+    zip_uint8_t buf[EOCDLEN + EOCD64LEN + EOCD64LOCLEN];
+    zip_buffer_t *buffer;
+
+    if (offset > ZIP_UINT32_MAX || nentry > ZIP_UINT16_MAX) {
+        is_zip64 = true;
     }
-    size = (zip_uint64_t)off - offset;
 
-    if (offset > ZIP_UINT32_MAX || survivors > ZIP_UINT16_MAX) {
+    ext_length = 0;
+    if (nsegments > 0) {
+        /* earlier segments are listed in the extensible data sector */
         is_zip64 = true;
+        ext_length = 6 + nsegments * EOCD64_EXT_CDIR_SEGMENT_SIZE;
     }
 
-    if ((buffer = _zip_buffer_new(buf, sizeof(buf))) == NULL) {
+    if ((buffer = _zip_buffer_new(ext_length > 0 ? NULL : buf, sizeof(buf) + ext_length)) == NULL) {
         zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
         return -1;
     }
 
     if (is_zip64) {
         _zip_buffer_put(buffer, EOCD64_MAGIC, 4);
-        _zip_buffer_put_64(buffer, EOCD64LEN - 12);
+        _zip_buffer_put_64(buffer, EOCD64LEN - 12 + ext_length);
         _zip_buffer_put_16(buffer, 45);
         _zip_buffer_put_16(buffer, 45);
         _zip_buffer_put_32(buffer, 0);
         _zip_buffer_put_32(buffer, 0);
-        _zip_buffer_put_64(buffer, survivors);
-        _zip_buffer_put_64(buffer, survivors);
+        _zip_buffer_put_64(buffer, nentry);
+        _zip_buffer_put_64(buffer, nentry);
         _zip_buffer_put_64(buffer, size);
         _zip_buffer_put_64(buffer, offset);
+        if (nsegments > 0) {
+            _zip_buffer_put_16(buffer, EOCD64_EXT_CDIR_SEGMENTS);
+            _zip_buffer_put_32(buffer, (zip_uint32_t)(nsegments * EOCD64_EXT_CDIR_SEGMENT_SIZE));
+            for (i = 0; i < nsegments; i++) {
+                _zip_buffer_put_64(buffer, segments[i].offset);
+                _zip_buffer_put_64(buffer, segments[i].size);
+                _zip_buffer_put_64(buffer, segments[i].nentry);
+            }
+        }
         _zip_buffer_put(buffer, EOCD64LOC_MAGIC, 4);
         _zip_buffer_put_32(buffer, 0);
         _zip_buffer_put_64(buffer, offset + size);
@@ -188,8 +264,8 @@ _zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivor
 
     _zip_buffer_put(buffer, EOCD_MAGIC, 4);
     _zip_buffer_put_32(buffer, 0);
-    _zip_buffer_put_16(buffer, (zip_uint16_t)(survivors >= ZIP_UINT16_MAX ? ZIP_UINT16_MAX : survivors));
-    _zip_buffer_put_16(buffer, (zip_uint16_t)(survivors >= ZIP_UINT16_MAX ? ZIP_UINT16_MAX : survivors));
+    _zip_buffer_put_16(buffer, (zip_uint16_t)(nentry >= ZIP_UINT16_MAX ? ZIP_UINT16_MAX : nentry));
+    _zip_buffer_put_16(buffer, (zip_uint16_t)(nentry >= ZIP_UINT16_MAX ? ZIP_UINT16_MAX : nentry));
     _zip_buffer_put_32(buffer, size >= ZIP_UINT32_MAX ? ZIP_UINT32_MAX : (zip_uint32_t)size);
     _zip_buffer_put_32(buffer, offset >= ZIP_UINT32_MAX ? ZIP_UINT32_MAX : (zip_uint32_t)offset);
 
@@ -230,7 +306,7 @@ _zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivor
         }
     }
 
-    return (zip_int64_t)size;
+    return 0;
 }
 
 
@@ -238,7 +314,7 @@ zip_dirent_t *
 _zip_dirent_clone(const zip_dirent_t *sde) {
     zip_dirent_t *tde;
 
-    if ((tde = (zip_dirent_t *)malloc(sizeof(*tde))) == NULL)
+    if ((tde = (zip_dirent_t *)_zip_malloc(sizeof(*tde))) == NULL)
         return NULL;
 
     if (sde)
@@ -248,6 +324,7 @@ _zip_dirent_clone(const zip_dirent_t *sde) {
 
     tde->changed = 0;
     tde->cloned = 1;
+    tde->in_arena = false;
 
     return tde;
 }
@@ -262,6 +339,7 @@ _zip_dirent_finalize(zip_dirent_t *zde) {
     if (!zde->cloned || zde->changed & ZIP_DIRENT_EXTRA_FIELD) {
         _zip_ef_free(zde->extra_fields);
         zde->extra_fields = NULL;
+        zde->raw_extra_fields = NULL;
     }
     if (!zde->cloned || zde->changed & ZIP_DIRENT_COMMENT) {
         _zip_string_free(zde->comment);
@@ -271,7 +349,7 @@ _zip_dirent_finalize(zip_dirent_t *zde) {
         if (zde->password) {
             _zip_crypto_clear(zde->password, strlen(zde->password));
         }
-        free(zde->password);
+        _zip_free(zde->password);
         zde->password = NULL;
     }
 }
@@ -283,7 +361,9 @@ _zip_dirent_free(zip_dirent_t *zde) {
         return;
 
     _zip_dirent_finalize(zde);
-    free(zde);
+    if (!zde->in_arena) {
+        _zip_free(zde);
+    }
 }
 
 
@@ -291,6 +371,7 @@ void
 _zip_dirent_init(zip_dirent_t *de) {
     de->changed = 0;
     de->local_extra_fields_read = 0;
+    de->local_header_size = 0;
     de->cloned = 0;
 
     de->crc_valid = true;
@@ -299,17 +380,26 @@ _zip_dirent_init(zip_dirent_t *de) {
     de->bitflags = 0;
     de->comp_method = ZIP_CM_DEFAULT;
     de->last_mod = 0;
+    de->dos_time = 0;
+    de->dos_date = 0;
+    de->last_mod_dos = false;
     de->crc = 0;
     de->comp_size = 0;
     de->uncomp_size = 0;
     de->filename = NULL;
     de->extra_fields = NULL;
+    de->raw_extra_fields = NULL;
+    de->raw_extra_fields_length = 0;
     de->comment = NULL;
     de->disk_number = 0;
     de->int_attrib = 0;
     de->ext_attrib = ZIP_EXT_ATTRIB_DEFAULT;
     de->offset = 0;
     de->compression_level = 0;
+    de->zstd_parameters.window_log = 0;
+    de->zstd_parameters.strategy = 0;
+    de->zstd_parameters.long_distance_matching = 0;
+    de->zstd_parameters.window_log_max = 0;
     de->encryption_method = ZIP_EM_NONE;
     de->password = NULL;
 }
@@ -328,32 +418,54 @@ zip_dirent_t *
 _zip_dirent_new(void) {
     zip_dirent_t *de;
 
-    if ((de = (zip_dirent_t *)malloc(sizeof(*de))) == NULL)
+    if ((de = (zip_dirent_t *)_zip_malloc(sizeof(*de))) == NULL)
+        return NULL;
+
+    _zip_dirent_init(de);
+    de->in_arena = false;
+    return de;
+}
+
+
+/* _zip_dirent_new_arena:
+   Allocate directory entry from ARENA. It is not freed by _zip_dirent_free, only its extra fields and password. */
+
+zip_dirent_t *
+_zip_dirent_new_arena(zip_arena_t *arena, zip_error_t *error) {
+    zip_dirent_t *de;
+
+    if ((de = (zip_dirent_t *)_zip_arena_alloc(arena, sizeof(*de), error)) == NULL)
         return NULL;
 
     _zip_dirent_init(de);
+    de->in_arena = true;
     return de;
 }
 
 
-/* _zip_dirent_read(zde, fp, bufp, left, localp, error):
+/* _zip_dirent_read(zde, fp, bufp, left, localp, arena, error):
    Fills the zip directory entry zde.
 
    If buffer is non-NULL, data is taken from there; otherwise data is read from fp as needed.
 
    If local is true, it reads a local header instead of a central directory entry.
 
+   If arena is non-NULL, file name and comment are allocated from it. Extra fields of central directory entries are
+   then only checked and kept in raw form in the arena, see _zip_dirent_parse_extra_fields.
+
    Returns size of dirent read if successful. On error, error is filled in and -1 is returned.
 */
 
 zip_int64_t
-_zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, bool local, zip_error_t *error) {
+_zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, bool local, zip_arena_t *arena, zip_error_t *error) {
     zip_uint8_t buf[CDENTRYSIZE];
-    zip_uint16_t dostime, dosdate;
+    const zip_uint8_t *record;
     zip_uint32_t size, variable_size;
     zip_uint16_t filename_len, comment_len, ef_len;
+    zip_uint64_t volume_start;
 
     bool from_buffer = (buffer != NULL);
+    bool keep_raw_ef = !local && arena != NULL;
 
     size = local ? LENTRYSIZE : CDENTRYSIZE;
 
@@ -369,7 +481,9 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
         }
     }
 
-    if (memcmp(_zip_buffer_get(buffer, 4), (local ? LOCAL_MAGIC : CENTRAL_MAGIC), 4) != 0) {
+    /* fixed size part, length checked above */
+    record = _zip_buffer_get(buffer, size);
+    if (record == NULL || memcmp(record, (local ? LOCAL_MAGIC : CENTRAL_MAGIC), 4) != 0) {
         zip_error_set(error, ZIP_ER_NOZIP, 0);
         if (!from_buffer) {
             _zip_buffer_free(buffer);
@@ -380,27 +494,18 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
     /* convert buffercontents to zip_dirent */
 
     _zip_dirent_init(zde);
-    if (!local)
-        zde->version_madeby = _zip_buffer_get_16(buffer);
-    else
-        zde->version_madeby = 0;
-    zde->version_needed = _zip_buffer_get_16(buffer);
-    zde->bitflags = _zip_buffer_get_16(buffer);
-    zde->comp_method = _zip_buffer_get_16(buffer);
-
-    /* convert to time_t */
-    dostime = _zip_buffer_get_16(buffer);
-    dosdate = _zip_buffer_get_16(buffer);
-    zde->last_mod = _zip_d2u_time(dostime, dosdate);
-
-    zde->crc = _zip_buffer_get_32(buffer);
-    zde->comp_size = _zip_buffer_get_32(buffer);
-    zde->uncomp_size = _zip_buffer_get_32(buffer);
-
-    filename_len = _zip_buffer_get_16(buffer);
-    ef_len = _zip_buffer_get_16(buffer);
-
     if (local) {
+        zde->version_madeby = 0;
+        zde->version_needed = _zip_get_16(record + 4);
+        zde->bitflags = _zip_get_16(record + 6);
+        zde->comp_method = _zip_get_16(record + 8);
+        zde->dos_time = _zip_get_16(record + 10);
+        zde->dos_date = _zip_get_16(record + 12);
+        zde->crc = _zip_get_32(record + 14);
+        zde->comp_size = _zip_get_32(record + 18);
+        zde->uncomp_size = _zip_get_32(record + 22);
+        filename_len = _zip_get_16(record + 26);
+        ef_len = _zip_get_16(record + 28);
         comment_len = 0;
         zde->disk_number = 0;
         zde->int_attrib = 0;
@@ -408,20 +513,25 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
         zde->offset = 0;
     }
     else {
-        comment_len = _zip_buffer_get_16(buffer);
-        zde->disk_number = _zip_buffer_get_16(buffer);
-        zde->int_attrib = _zip_buffer_get_16(buffer);
-        zde->ext_attrib = _zip_buffer_get_32(buffer);
-        zde->offset = _zip_buffer_get_32(buffer);
-    }
-
-    if (!_zip_buffer_ok(buffer)) {
-        zip_error_set(error, ZIP_ER_INTERNAL, 0);
-        if (!from_buffer) {
-            _zip_buffer_free(buffer);
-        }
-        return -1;
-    }
+        zde->version_madeby = _zip_get_16(record + 4);
+        zde->version_needed = _zip_get_16(record + 6);
+        zde->bitflags = _zip_get_16(record + 8);
+        zde->comp_method = _zip_get_16(record + 10);
+        zde->dos_time = _zip_get_16(record + 12);
+        zde->dos_date = _zip_get_16(record + 14);
+        zde->crc = _zip_get_32(record + 16);
+        zde->comp_size = _zip_get_32(record + 20);
+        zde->uncomp_size = _zip_get_32(record + 24);
+        filename_len = _zip_get_16(record + 28);
+        ef_len = _zip_get_16(record + 30);
+        comment_len = _zip_get_16(record + 32);
+        zde->disk_number = _zip_get_16(record + 34);
+        zde->int_attrib = _zip_get_16(record + 36);
+        zde->ext_attrib = _zip_get_32(record + 38);
+        zde->offset = _zip_get_32(record + 42);
+    }
+    /* converted to time_t when needed, mktime() is slow */
+    zde->last_mod_dos = true;
 
     if (zde->bitflags & ZIP_GPBF_ENCRYPTED) {
         if (zde->bitflags & ZIP_GPBF_STRONG_ENCRYPTION) {
@@ -457,7 +567,7 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
     }
 
     if (filename_len) {
-        zde->filename = _zip_read_string(buffer, src, filename_len, 1, error);
+        zde->filename = _zip_read_string(buffer, src, filename_len, 1, arena, error);
         if (!zde->filename) {
             if (zip_error_code_zip(error) == ZIP_ER_EOF) {
                 zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_VARIABLE_SIZE_OVERFLOW);
@@ -477,31 +587,48 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
                 return -1;
             }
         }
+        else {
+            /* guess now while the name is in the cache; the result is kept in the string */
+            (void)_zip_guess_encoding(zde->filename, ZIP_ENCODING_UNKNOWN);
+        }
     }
 
     if (ef_len) {
-        zip_uint8_t *ef = _zip_read_data(buffer, src, ef_len, 0, error);
+        /* buffer holds all variable size data, parse extra fields in place */
+        zip_uint8_t *ef = _zip_buffer_get(buffer, ef_len);
 
         if (ef == NULL) {
+            zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_VARIABLE_SIZE_OVERFLOW);
             if (!from_buffer) {
                 _zip_buffer_free(buffer);
             }
             return -1;
         }
-        if (!_zip_ef_parse(ef, ef_len, local ? ZIP_EF_LOCAL : ZIP_EF_CENTRAL, &zde->extra_fields, error)) {
-            free(ef);
+        if (!_zip_ef_parse(ef, ef_len, local ? ZIP_EF_LOCAL : ZIP_EF_CENTRAL, keep_raw_ef ? NULL : &zde->extra_fields, arena, error)) {
             if (!from_buffer) {
                 _zip_buffer_free(buffer);
             }
             return -1;
         }
-        free(ef);
+        if (keep_raw_ef) {
+            zip_uint8_t *raw;
+
+            if ((raw = (zip_uint8_t *)_zip_arena_alloc(arena, ef_len, error)) == NULL) {
+                if (!from_buffer) {
+                    _zip_buffer_free(buffer);
+                }
+                return -1;
+            }
+            (void)memcpy_s(raw, ef_len, ef, ef_len);
+            zde->raw_extra_fields = raw;
+            zde->raw_extra_fields_length = ef_len;
+        }
         if (local)
             zde->local_extra_fields_read = 1;
     }
 
     if (comment_len) {
-        zde->comment = _zip_read_string(buffer, src, comment_len, 0, error);
+        zde->comment = _zip_read_string(buffer, src, comment_len, 0, arena, error);
         if (!zde->comment) {
             if (!from_buffer) {
                 _zip_buffer_free(buffer);
@@ -519,14 +646,14 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
         }
     }
 
-    zde->filename = _zip_dirent_process_ef_utf_8(zde, ZIP_EF_UTF_8_NAME, zde->filename);
-    zde->comment = _zip_dirent_process_ef_utf_8(zde, ZIP_EF_UTF_8_COMMENT, zde->comment);
+    zde->filename = _zip_dirent_process_ef_utf_8(zde, ZIP_EF_UTF_8_NAME, zde->filename, arena);
+    zde->comment = _zip_dirent_process_ef_utf_8(zde, ZIP_EF_UTF_8_COMMENT, zde->comment, arena);
 
     /* Zip64 */
 
     if (zde->uncomp_size == ZIP_UINT32_MAX || zde->comp_size == ZIP_UINT32_MAX || zde->offset == ZIP_UINT32_MAX) {
         zip_uint16_t got_len;
-        const zip_uint8_t *ef = _zip_ef_get_by_id(zde->extra_fields, &got_len, ZIP_EF_ZIP64, 0, local ? ZIP_EF_LOCAL : ZIP_EF_CENTRAL, error);
+        const zip_uint8_t *ef = _zip_dirent_get_extra_field(zde, &got_len, ZIP_EF_ZIP64, local ? ZIP_EF_LOCAL : ZIP_EF_CENTRAL);
         if (ef != NULL) {
             if (!zip_dirent_process_ef_zip64(zde, ef, got_len, local, error)) {
                 if (!from_buffer) {
@@ -549,6 +676,16 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
         _zip_buffer_free(buffer);
     }
 
+    if (!local && zde->disk_number != 0 && _zip_source_volumes_start(src, zde->disk_number, &volume_start)) {
+        /* entry of split archive, make offset relative to start of first volume */
+        if (zde->offset > ZIP_UINT64_MAX - volume_start) {
+            zip_error_set(error, ZIP_ER_SEEK, EFBIG);
+            return -1;
+        }
+        zde->offset += volume_start;
+        zde->disk_number = 0;
+    }
+
     /* zip_source_seek / zip_source_tell don't support values > ZIP_INT64_MAX */
     if (zde->offset > ZIP_INT64_MAX) {
         zip_error_set(error, ZIP_ER_SEEK, EFBIG);
@@ -564,47 +701,78 @@ _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, boo
     return (zip_int64_t)size + (zip_int64_t)variable_size;
 }
 
-bool zip_dirent_process_ef_zip64(zip_dirent_t* zde, const zip_uint8_t* ef, zip_uint64_t got_len, bool local, zip_error_t* error) {
-    zip_buffer_t *ef_buffer;
+/* Parse extra fields kept in raw form by _zip_dirent_read, allocating them from arena. Must be called before
+   de->extra_fields is used, except to look up the fields processed by _zip_dirent_read. */
+bool
+_zip_dirent_parse_extra_fields(zip_dirent_t *de, zip_arena_t *arena, zip_error_t *error) {
+    zip_extra_field_t *ef;
 
-    if ((ef_buffer = _zip_buffer_new((zip_uint8_t *)ef, got_len)) == NULL) {
-        zip_error_set(error, ZIP_ER_MEMORY, 0);
+    if (de->raw_extra_fields == NULL) {
+        return true;
+    }
+
+    if (!_zip_ef_parse(de->raw_extra_fields, de->raw_extra_fields_length, ZIP_EF_CENTRAL, &ef, arena, error)) {
         return false;
     }
+    de->extra_fields = _zip_ef_remove_internal(ef);
+    de->raw_extra_fields = NULL;
+
+    return true;
+}
+
+
+/* Find first extra field id of de, whether its extra fields are parsed or not. */
+const zip_uint8_t *
+_zip_dirent_get_extra_field(const zip_dirent_t *de, zip_uint16_t *lenp, zip_uint16_t id, zip_flags_t flags) {
+    if (de->raw_extra_fields != NULL) {
+        if ((flags & ZIP_EF_CENTRAL) == 0) {
+            return NULL;
+        }
+        return _zip_ef_get_by_id_raw(de->raw_extra_fields, de->raw_extra_fields_length, lenp, id);
+    }
+
+    return _zip_ef_get_by_id(de->extra_fields, lenp, id, 0, flags, NULL);
+}
+
+
+bool zip_dirent_process_ef_zip64(zip_dirent_t* zde, const zip_uint8_t* ef, zip_uint64_t got_len, bool local, zip_error_t* error) {
+    zip_buffer_t ef_buffer;
+
+    _zip_buffer_init(&ef_buffer, (zip_uint8_t *)ef, got_len);
 
     if (zde->uncomp_size == ZIP_UINT32_MAX) {
-        zde->uncomp_size = _zip_buffer_get_64(ef_buffer);
+        zde->uncomp_size = _zip_buffer_get_64(&ef_buffer);
     }
     else if (local) {
         /* From appnote.txt: This entry in the Local header MUST
            include BOTH original and compressed file size fields. */
-        (void)_zip_buffer_skip(ef_buffer, 8); /* error is caught by _zip_buffer_eof() call */
+        (void)_zip_buffer_skip(&ef_buffer, 8); /* error is caught by _zip_buffer_eof() call */
     }
     if (zde->comp_size == ZIP_UINT32_MAX) {
-        zde->comp_size = _zip_buffer_get_64(ef_buffer);
+        zde->comp_size = _zip_buffer_get_64(&ef_buffer);
     }
     if (!local) {
         if (zde->offset == ZIP_UINT32_MAX) {
-            zde->offset = _zip_buffer_get_64(ef_buffer);
+            zde->offset = _zip_buffer_get_64(&ef_buffer);
         }
         if (zde->disk_number == ZIP_UINT16_MAX) {
-            zde->disk_number = _zip_buffer_get_32(ef_buffer);
+            zde->disk_number = _zip_buffer_get_32(&ef_buffer);
         }
     }
 
-    if (!_zip_buffer_eof(ef_buffer)) {
+    if (!_zip_buffer_eof(&ef_buffer)) {
         /* accept additional fields if values match */
         bool ok = true;
         switch (got_len) {
         case 28:
-            _zip_buffer_set_offset(ef_buffer, 24);
-            if (zde->disk_number != _zip_buffer_get_32(ef_buffer)) {
+            _zip_buffer_set_offset(&ef_buffer, 24);
+            if (zde->disk_number != _zip_buffer_get_32(&ef_buffer)) {
                 ok = false;
             }
             /* fallthrough */
         case 24:
-            _zip_buffer_set_offset(ef_buffer, 0);
-            if ((zde->uncomp_size != _zip_buffer_get_64(ef_buffer)) || (zde->comp_size != _zip_buffer_get_64(ef_buffer)) || (zde->offset != _zip_buffer_get_64(ef_buffer))) {
+            _zip_buffer_set_offset(&ef_buffer, 0);
+            if ((zde->uncomp_size != _zip_buffer_get_64(&ef_buffer)) || (zde->comp_size != _zip_buffer_get_64(&ef_buffer)) || (zde->offset != _zip_buffer_get_64(&ef_buffer))) {
                 ok = false;
             }
             break;
@@ -614,38 +782,33 @@ bool zip_dirent_process_ef_zip64(zip_dirent_t* zde, const zip_uint8_t* ef, zip_u
         }
         if (!ok) {
             zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_INVALID_ZIP64_EF);
-            _zip_buffer_free(ef_buffer);
             return false;
         }
     }
-    _zip_buffer_free(ef_buffer);
-
     return true;
 }
 
 
 static zip_string_t *
-_zip_dirent_process_ef_utf_8(const zip_dirent_t *de, zip_uint16_t id, zip_string_t *str) {
+_zip_dirent_process_ef_utf_8(const zip_dirent_t *de, zip_uint16_t id, zip_string_t *str, zip_arena_t *arena) {
     zip_uint16_t ef_len;
     zip_uint32_t ef_crc;
-    zip_buffer_t *buffer;
+    zip_buffer_t buffer;
 
-    const zip_uint8_t *ef = _zip_ef_get_by_id(de->extra_fields, &ef_len, id, 0, ZIP_EF_BOTH, NULL);
+    const zip_uint8_t *ef = _zip_dirent_get_extra_field(de, &ef_len, id, ZIP_EF_BOTH);
 
     if (ef == NULL || ef_len < 5 || ef[0] != 1) {
         return str;
     }
 
-    if ((buffer = _zip_buffer_new((zip_uint8_t *)ef, ef_len)) == NULL) {
-        return str;
-    }
+    _zip_buffer_init(&buffer, (zip_uint8_t *)ef, ef_len);
 
-    _zip_buffer_get_8(buffer);
-    ef_crc = _zip_buffer_get_32(buffer);
+    _zip_buffer_get_8(&buffer);
+    ef_crc = _zip_buffer_get_32(&buffer);
 
     if (_zip_string_crc32(str) == ef_crc) {
-        zip_uint16_t len = (zip_uint16_t)_zip_buffer_left(buffer);
-        zip_string_t *ef_str = _zip_string_new(_zip_buffer_get(buffer, len), len, ZIP_FL_ENC_UTF_8, NULL);
+        zip_uint16_t len = (zip_uint16_t)_zip_buffer_left(&buffer);
+        zip_string_t *ef_str = _zip_string_new_arena(arena, _zip_buffer_get(&buffer, len), len, ZIP_FL_ENC_UTF_8, NULL);
 
         if (ef_str != NULL) {
             _zip_string_free(str);
@@ -653,8 +816,6 @@ _zip_dirent_process_ef_utf_8(const zip_dirent_t *de, zip_uint16_t id, zip_string
         }
     }
 
-    _zip_buffer_free(buffer);
-
     return str;
 }
 
@@ -672,7 +833,7 @@ _zip_dirent_process_winzip_aes(zip_dirent_t *de, zip_error_t *error) {
         return true;
     }
 
-    ef = _zip_ef_get_by_id(de->extra_fields, &ef_len, ZIP_EF_WINZIP_AES, 0, ZIP_EF_BOTH, NULL);
+    ef = _zip_dirent_get_extra_field(de, &ef_len, ZIP_EF_WINZIP_AES, ZIP_EF_BOTH);
 
     if (ef == NULL || ef_len < 7) {
         zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_INVALID_WINZIPAES_EF);
@@ -741,37 +902,219 @@ _zip_dirent_process_winzip_aes(zip_dirent_t *de, zip_error_t *error) {
 }
 
 
-zip_int32_t
-_zip_dirent_size(zip_source_t *src, zip_uint16_t flags, zip_error_t *error) {
-    zip_int32_t size;
-    bool local = (flags & ZIP_EF_LOCAL) != 0;
-    int i;
-    zip_uint8_t b[6];
+/* _zip_dirent_read_local_header(de, src, arena, need_extra_fields, error):
+   Reads the local header of the entry described by central directory entry de.  The header is read in one go, its
+   length guessed from the central directory, and its size is recorded in de->local_header_size.
+
+   The local extra fields are merged into the extra fields of de if they were read completely, or, if
+   need_extra_fields is true, read separately if they weren't.  Errors in them are only reported if
+   need_extra_fields is true.
+
+   Returns true if successful. On error, error is filled in and false is returned.
+*/
+
+bool
+_zip_dirent_read_local_header(zip_dirent_t *de, zip_source_t *src, zip_arena_t *arena, bool need_extra_fields, zip_error_t *error) {
+    zip_uint8_t *data;
+    zip_uint64_t length;
+    zip_int64_t n;
     zip_buffer_t *buffer;
+    zip_uint16_t fname_len, ef_len;
+    zip_uint64_t size;
 
-    size = local ? LENTRYSIZE : CDENTRYSIZE;
+    if (need_extra_fields ? de->local_extra_fields_read : de->local_header_size > 0) {
+        return true;
+    }
+
+    if (de->local_header_size > 0) {
+        length = de->local_header_size;
+    }
+    else {
+        /* local extra fields often differ from the central ones, e.g. by a Zip64 extra field, so read a bit more */
+        length = LENTRYSIZE + _zip_string_length(de->filename) + (de->raw_extra_fields != NULL ? de->raw_extra_fields_length : _zip_ef_size(de->extra_fields, ZIP_EF_CENTRAL)) + LOCAL_HEADER_SLACK;
+    }
 
-    if (zip_source_seek(src, local ? 26 : 28, SEEK_CUR) < 0) {
+    if (de->offset > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_SEEK, EFBIG);
+        return false;
+    }
+    if (zip_source_seek(src, (zip_int64_t)de->offset, SEEK_SET) < 0) {
         zip_error_set_from_source(error, src);
-        return -1;
+        return false;
     }
 
-    if ((buffer = _zip_buffer_new_from_source(src, local ? 4 : 6, b, error)) == NULL) {
-        return -1;
+    if ((data = (zip_uint8_t *)_zip_malloc((size_t)length)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    if ((n = zip_source_read(src, data, length)) < 0) {
+        zip_error_set_from_source(error, src);
+        _zip_free(data);
+        return false;
+    }
+    if (n < LENTRYSIZE || ((zip_uint64_t)n < length && _zip_source_would_block(src))) {
+        zip_error_set(error, _zip_source_would_block(src) ? ZIP_ER_AGAIN : ZIP_ER_EOF, 0);
+        _zip_free(data);
+        return false;
     }
 
-    for (i = 0; i < (local ? 2 : 3); i++) {
-        size += _zip_buffer_get_16(buffer);
+    if ((buffer = _zip_buffer_new(data, (zip_uint64_t)n)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_free(data);
+        return false;
     }
+    _zip_buffer_set_offset(buffer, 26);
+    fname_len = _zip_buffer_get_16(buffer);
+    ef_len = _zip_buffer_get_16(buffer);
+    _zip_buffer_free(buffer);
 
-    if (!_zip_buffer_eof(buffer)) {
-        zip_error_set(error, ZIP_ER_INTERNAL, 0);
-        _zip_buffer_free(buffer);
-        return -1;
+    size = LENTRYSIZE + (zip_uint64_t)fname_len + ef_len;
+    if (de->offset + size > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_SEEK, EFBIG);
+        _zip_free(data);
+        return false;
     }
+    de->local_header_size = (zip_uint32_t)size;
 
-    _zip_buffer_free(buffer);
-    return size;
+    if (!de->local_extra_fields_read && (need_extra_fields || (zip_uint64_t)n >= size)) {
+        zip_error_t ef_error;
+        zip_extra_field_t *ef = NULL;
+        bool ok = true;
+
+        zip_error_init(&ef_error);
+
+        if (ef_len > 0) {
+            if ((zip_uint64_t)n >= size) {
+                ok = _zip_ef_parse(data + LENTRYSIZE + fname_len, ef_len, ZIP_EF_LOCAL, &ef, arena, &ef_error);
+            }
+            else {
+                zip_uint8_t *ef_raw;
+
+                if (zip_source_seek(src, (zip_int64_t)(de->offset + LENTRYSIZE + fname_len), SEEK_SET) < 0) {
+                    zip_error_set_from_source(&ef_error, src);
+                    ok = false;
+                }
+                else if ((ef_raw = _zip_read_data(NULL, src, ef_len, 0, &ef_error)) == NULL) {
+                    ok = false;
+                }
+                else {
+                    ok = _zip_ef_parse(ef_raw, ef_len, ZIP_EF_LOCAL, &ef, arena, &ef_error);
+                    _zip_free(ef_raw);
+                }
+            }
+        }
+
+        if (ok && _zip_dirent_parse_extra_fields(de, arena, &ef_error)) {
+            if (ef) {
+                de->extra_fields = _zip_ef_merge(de->extra_fields, _zip_ef_remove_internal(ef));
+            }
+            de->local_extra_fields_read = 1;
+        }
+        else {
+            _zip_ef_free(ef);
+            if (need_extra_fields) {
+                _zip_error_copy(error, &ef_error);
+                zip_error_fini(&ef_error);
+                _zip_free(data);
+                return false;
+            }
+        }
+        zip_error_fini(&ef_error);
+    }
+
+    _zip_free(data);
+    return true;
+}
+
+
+/* _zip_local_header_length:
+   Return length of local header at OFFSET if it is completely contained in WINDOW, 0 otherwise. */
+
+zip_uint64_t
+_zip_local_header_length(const zip_uint8_t *window, zip_uint64_t window_offset, zip_uint64_t window_length, zip_uint64_t offset) {
+    const zip_uint8_t *p;
+    zip_uint64_t length;
+
+    if (window == NULL || offset < window_offset || offset - window_offset + LENTRYSIZE > window_length) {
+        return 0;
+    }
+
+    p = window + (offset - window_offset);
+    length = LENTRYSIZE + ((zip_uint64_t)p[26] | ((zip_uint64_t)p[27] << 8)) + ((zip_uint64_t)p[28] | ((zip_uint64_t)p[29] << 8));
+
+    return offset - window_offset + length <= window_length ? length : 0;
+}
+
+
+/* _zip_local_header_window_fill:
+   Make sure the window read from SRC contains the complete local header at
+   OFFSET, or as much of it as the file has. Reads LOCAL_HEADER_READ_SIZE bytes
+   at a time, so following headers of small files are usually covered as well.
+   If READER is not NULL, it is read from instead of SRC, which may then be
+   called from multiple threads. */
+
+bool
+_zip_local_header_window_fill(zip_source_t *src, const zip_reader_t *reader, zip_uint8_t **windowp, zip_uint64_t *window_offsetp, zip_uint64_t *window_lengthp, zip_uint64_t offset, zip_error_t *error) {
+    zip_uint64_t length;
+    zip_uint8_t *window;
+    zip_int64_t n;
+
+    if (_zip_local_header_length(*windowp, *window_offsetp, *window_lengthp, offset) > 0) {
+        return true;
+    }
+
+    /* if fixed part is available, make sure complete header fits */
+    length = LOCAL_HEADER_READ_SIZE;
+    if (*windowp != NULL && offset >= *window_offsetp && offset - *window_offsetp + LENTRYSIZE <= *window_lengthp) {
+        const zip_uint8_t *p = *windowp + (offset - *window_offsetp);
+        length = ZIP_MAX(length, LENTRYSIZE + ((zip_uint64_t)p[26] | ((zip_uint64_t)p[27] << 8)) + ((zip_uint64_t)p[28] | ((zip_uint64_t)p[29] << 8)));
+    }
+
+    if ((window = (zip_uint8_t *)_zip_malloc(length)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    /* short read at end of file, incomplete header is detected when parsing it */
+    if (reader != NULL) {
+        if ((n = _zip_reader_read(reader, offset, window, length, error)) < 0) {
+            _zip_free(window);
+            return false;
+        }
+    }
+    else {
+        if (zip_source_seek(src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(error, src);
+            _zip_free(window);
+            return false;
+        }
+        if ((n = zip_source_read(src, window, length)) < 0 || ((zip_uint64_t)n < length && _zip_source_would_block(src))) {
+            if (n < 0) {
+                zip_error_set_from_source(error, src);
+            }
+            else {
+                zip_error_set(error, ZIP_ER_AGAIN, 0);
+            }
+            _zip_free(window);
+            return false;
+        }
+    }
+
+    _zip_free(*windowp);
+    *windowp = window;
+    *window_offsetp = offset;
+    *window_lengthp = (zip_uint64_t)n;
+
+    return true;
+}
+
+
+/* Whether the UTF-8 flag has to be set in the general purpose bit flags when writing de. */
+bool
+_zip_dirent_needs_utf8_flag(const zip_dirent_t *de) {
+    zip_encoding_type_t name_enc = _zip_guess_encoding(de->filename, ZIP_ENCODING_UNKNOWN);
+    zip_encoding_type_t com_enc = _zip_guess_encoding(de->comment, ZIP_ENCODING_UNKNOWN);
+
+    return (name_enc == ZIP_ENCODING_UTF8_KNOWN && com_enc == ZIP_ENCODING_ASCII) || (name_enc == ZIP_ENCODING_ASCII && com_enc == ZIP_ENCODING_UTF8_KNOWN) || (name_enc == ZIP_ENCODING_UTF8_KNOWN && com_enc == ZIP_ENCODING_UTF8_KNOWN);
 }
 
 
@@ -795,15 +1138,20 @@ _zip_dirent_write(zip_t *za, zip_dirent_t *de, zip_flags_t flags) {
     bool is_zip64;
     bool is_really_zip64;
     bool is_winzip_aes;
+    bool buffered;
     zip_uint8_t buf[CDENTRYSIZE];
     zip_buffer_t *buffer;
 
     ef = NULL;
 
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return -1;
+    }
+
     name_enc = _zip_guess_encoding(de->filename, ZIP_ENCODING_UNKNOWN);
     com_enc = _zip_guess_encoding(de->comment, ZIP_ENCODING_UNKNOWN);
 
-    if ((name_enc == ZIP_ENCODING_UTF8_KNOWN && com_enc == ZIP_ENCODING_ASCII) || (name_enc == ZIP_ENCODING_ASCII && com_enc == ZIP_ENCODING_UTF8_KNOWN) || (name_enc == ZIP_ENCODING_UTF8_KNOWN && com_enc == ZIP_ENCODING_UTF8_KNOWN))
+    if (_zip_dirent_needs_utf8_flag(de))
         de->bitflags |= ZIP_GPBF_ENCODING_UTF_8;
     else {
         de->bitflags &= (zip_uint16_t)~ZIP_GPBF_ENCODING_UTF_8;
@@ -930,7 +1278,7 @@ _zip_dirent_write(zip_t *za, zip_dirent_t *de, zip_flags_t flags) {
         dosdate = 0x2198;
     }
     else {
-        _zip_u2d_time(de->last_mod, &dostime, &dosdate);
+        _zip_dirent_get_dos_time(de, &dostime, &dosdate);
     }
     _zip_buffer_put_16(buffer, dostime);
     _zip_buffer_put_16(buffer, dosdate);
@@ -972,6 +1320,29 @@ _zip_dirent_write(zip_t *za, zip_dirent_t *de, zip_flags_t flags) {
         /* TODO: check for overflow */
         ef_total_size += (zip_uint32_t)_zip_ef_size(de->extra_fields, flags);
     }
+    if ((flags & (ZIP_FL_LOCAL | ZIP_FL_ALIGN)) == (ZIP_FL_LOCAL | ZIP_FL_ALIGN) && za->alignment > 1 && !ZIP_WANT_TORRENTZIP(za)) {
+        /* pad with alignment extra field so the data starts at a multiple of the alignment */
+        zip_uint64_t data_offset = de->offset + LENTRYSIZE + _zip_string_length(de->filename) + ef_total_size + 4 + EF_ALIGNMENT_SIZE;
+        zip_uint32_t padding = (zip_uint32_t)((za->alignment - data_offset % za->alignment) % za->alignment);
+
+        if (ef_total_size + 4 + EF_ALIGNMENT_SIZE + padding <= ZIP_UINT16_MAX) {
+            zip_extra_field_t *ef_align;
+
+            if ((ef_align = _zip_ef_new(ZIP_EF_ALIGNMENT, 0, NULL, ZIP_EF_BOTH)) == NULL || (ef_align->data = (zip_uint8_t *)_zip_calloc(1, EF_ALIGNMENT_SIZE + padding)) == NULL) {
+                zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+                _zip_ef_free(ef_align);
+                _zip_buffer_free(buffer);
+                _zip_ef_free(ef);
+                return -1;
+            }
+            ef_align->size = (zip_uint16_t)(EF_ALIGNMENT_SIZE + padding);
+            ef_align->data[0] = (zip_uint8_t)(za->alignment & 0xff);
+            ef_align->data[1] = (zip_uint8_t)(za->alignment >> 8);
+            ef_align->next = ef;
+            ef = ef_align;
+            ef_total_size += 4 + ef_align->size;
+        }
+    }
     _zip_buffer_put_16(buffer, (zip_uint16_t)ef_total_size);
 
     if ((flags & ZIP_FL_LOCAL) == 0) {
@@ -992,10 +1363,13 @@ _zip_dirent_write(zip_t *za, zip_dirent_t *de, zip_flags_t flags) {
         return -1;
     }
 
+    /* write header, name, extra fields, and comment with one call to the source */
+    buffered = _zip_write_buffer_begin(za);
+
     if (_zip_write(za, buf, _zip_buffer_offset(buffer)) < 0) {
         _zip_buffer_free(buffer);
         _zip_ef_free(ef);
-        return -1;
+        goto fail;
     }
 
     _zip_buffer_free(buffer);
@@ -1003,38 +1377,100 @@ _zip_dirent_write(zip_t *za, zip_dirent_t *de, zip_flags_t flags) {
     if (de->filename) {
         if (_zip_string_write(za, de->filename) < 0) {
             _zip_ef_free(ef);
-            return -1;
+            goto fail;
         }
     }
 
     if (ef) {
         if (_zip_ef_write(za, ef, ZIP_EF_BOTH) < 0) {
             _zip_ef_free(ef);
-            return -1;
+            goto fail;
         }
     }
     _zip_ef_free(ef);
     if (de->extra_fields && !ZIP_WANT_TORRENTZIP(za)) {
         if (_zip_ef_write(za, de->extra_fields, flags) < 0) {
-            return -1;
+            goto fail;
         }
     }
 
     if ((flags & ZIP_FL_LOCAL) == 0 && !ZIP_WANT_TORRENTZIP(za)) {
         if (de->comment) {
             if (_zip_string_write(za, de->comment) < 0) {
-                return -1;
+                goto fail;
             }
         }
     }
 
+    if (buffered && _zip_write_buffer_end(za, true) < 0) {
+        return -1;
+    }
 
     return is_zip64;
+
+fail:
+    if (buffered) {
+        (void)_zip_write_buffer_end(za, false);
+    }
+    return -1;
+}
+
+
+/* Get modification time of de as DOS time and date. */
+void
+_zip_dirent_get_dos_time(const zip_dirent_t *de, zip_uint16_t *dtime, zip_uint16_t *ddate) {
+    if (de->last_mod_dos) {
+        *dtime = de->dos_time;
+        *ddate = de->dos_date;
+    }
+    else {
+        _zip_u2d_time(de->last_mod, dtime, ddate);
+    }
 }
 
 
+/* Get modification time of de, converting DOS time and date read from archive using cache, which may be NULL. */
 time_t
-_zip_d2u_time(zip_uint16_t dtime, zip_uint16_t ddate) {
+_zip_dirent_get_last_mod(const zip_dirent_t *de, zip_dos_time_cache_t *cache) {
+    if (de->last_mod_dos) {
+        return _zip_d2u_time(cache, de->dos_time, de->dos_date);
+    }
+    return de->last_mod;
+}
+
+
+void
+_zip_dirent_set_dos_time(zip_dirent_t *de, zip_uint16_t dtime, zip_uint16_t ddate) {
+    de->dos_time = dtime;
+    de->dos_date = ddate;
+    de->last_mod_dos = true;
+}
+
+
+void
+_zip_dirent_set_last_mod(zip_dirent_t *de, time_t last_mod) {
+    de->last_mod = last_mod;
+    de->last_mod_dos = false;
+}
+
+
+/* Days since 1970-01-01 of proleptic Gregorian date, month 1 to 12, year after 0. */
+static zip_int64_t
+days_from_civil(zip_int64_t year, zip_int64_t month, zip_int64_t day) {
+    zip_int64_t era, year_of_era, day_of_year, day_of_era;
+
+    year -= month <= 2;
+    era = year / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+    return era * 146097 + day_of_era - 719468;
+}
+
+
+static time_t
+dos_mktime(zip_uint32_t year, zip_uint32_t month, zip_uint32_t day, zip_uint32_t hour, zip_uint32_t minute, zip_uint32_t second) {
     struct tm tm;
 
     memset(&tm, 0, sizeof(tm));
@@ -1042,53 +1478,72 @@ _zip_d2u_time(zip_uint16_t dtime, zip_uint16_t ddate) {
     /* let mktime decide if DST is in effect */
     tm.tm_isdst = -1;
 
-    tm.tm_year = ((ddate >> 9) & 127) + 1980 - 1900;
-    tm.tm_mon = ((ddate >> 5) & 15) - 1;
-    tm.tm_mday = ddate & 31;
+    tm.tm_year = (int)year - 1900;
+    tm.tm_mon = (int)month - 1;
+    tm.tm_mday = (int)day;
 
-    tm.tm_hour = (dtime >> 11) & 31;
-    tm.tm_min = (dtime >> 5) & 63;
-    tm.tm_sec = (dtime << 1) & 62;
+    tm.tm_hour = (int)hour;
+    tm.tm_min = (int)minute;
+    tm.tm_sec = (int)second;
 
     return mktime(&tm);
 }
 
 
+/* Convert DOS time and date, which are in local time, to time_t.
+   mktime() is slow and takes a lock in the C library, so if cache is not NULL, it is only used once for each hour
+   to find the offset from UTC; the rest is plain arithmetic. */
+time_t
+_zip_d2u_time(zip_dos_time_cache_t *cache, zip_uint16_t dtime, zip_uint16_t ddate) {
+    zip_uint32_t year = ((ddate >> 9) & 127) + 1980;
+    zip_uint32_t month = (ddate >> 5) & 15;
+    zip_uint32_t day = ddate & 31;
+    zip_uint32_t hour = (dtime >> 11) & 31;
+    zip_uint32_t minute = (dtime >> 5) & 63;
+    zip_uint32_t second = (dtime << 1) & 62;
+    zip_uint32_t key, slot;
+    zip_int64_t utc;
+
+    /* out of range days and hours are normalized the same way by mktime() and the arithmetic */
+    if (cache == NULL || month < 1 || month > 12 || minute > 59 || second > 59) {
+        return dos_mktime(year, month, day, hour, minute, second);
+    }
+
+    utc = days_from_civil(year, month, day) * 86400 + hour * 3600;
+    key = ((zip_uint32_t)ddate << 5 | hour) + 1;
+    slot = (ddate ^ hour) % ZIP_DOS_TIME_CACHE_SIZE;
+
+    if (cache->key[slot] != key) {
+        time_t start = dos_mktime(year, month, day, hour, 0, 0);
+        time_t end = dos_mktime(year, month, day, hour, 59, 58);
+
+        /* offset changes within this hour, or time can't be represented */
+        if (start == (time_t)-1 || end == (time_t)-1 || end - start != 3598) {
+            return dos_mktime(year, month, day, hour, minute, second);
+        }
+        cache->key[slot] = key;
+        cache->offset[slot] = (zip_int32_t)(utc - (zip_int64_t)start);
+    }
+
+    return (time_t)(utc - cache->offset[slot] + minute * 60 + second);
+}
+
+
 static zip_extra_field_t *
 _zip_ef_utf8(zip_uint16_t id, zip_string_t *str, zip_error_t *error) {
-    const zip_uint8_t *raw;
-    zip_uint32_t len;
-    zip_buffer_t *buffer;
+    const zip_uint8_t *data;
+    zip_uint16_t len;
     zip_extra_field_t *ef;
 
-    if ((raw = _zip_string_get(str, &len, ZIP_FL_ENC_RAW, NULL)) == NULL) {
+    if ((data = _zip_string_utf8_ef_data(str, &len, error)) == NULL) {
         /* error already set */
         return NULL;
     }
 
-    if (len + 5 > ZIP_UINT16_MAX) {
-        zip_error_set(error, ZIP_ER_INVAL, 0); /* TODO: better error code? */
-        return NULL;
-    }
-
-    if ((buffer = _zip_buffer_new(NULL, len + 5)) == NULL) {
+    if ((ef = _zip_ef_new(id, len, data, ZIP_EF_BOTH)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
-        return NULL;
-    }
-
-    _zip_buffer_put_8(buffer, 1);
-    _zip_buffer_put_32(buffer, _zip_string_crc32(str));
-    _zip_buffer_put(buffer, raw, len);
-
-    if (!_zip_buffer_ok(buffer)) {
-        zip_error_set(error, ZIP_ER_INTERNAL, 0);
-        _zip_buffer_free(buffer);
-        return NULL;
     }
 
-    ef = _zip_ef_new(id, (zip_uint16_t)(_zip_buffer_offset(buffer)), _zip_buffer_data(buffer), ZIP_EF_BOTH);
-    _zip_buffer_free(buffer);
-
     return ef;
 }
 
@@ -1104,6 +1559,9 @@ _zip_get_dirent(zip_t *za, zip_uint64_t idx, zip_flags_t flags, zip_error_t *err
     }
 
     if ((flags & ZIP_FL_UNCHANGED) || za->entry[idx].changes == NULL) {
+        if (!_zip_cdir_index_load(za, idx, error)) {
+            return NULL;
+        }
         if (za->entry[idx].orig == NULL) {
             zip_error_set(error, ZIP_ER_INVAL, 0);
             return NULL;
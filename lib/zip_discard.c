@@ -48,33 +48,63 @@ zip_discard(zip_t *za) {
     if (za == NULL)
         return;
 
+    /* background reads use the source */
+    _zip_access_profile_free(za);
+
     if (za->src) {
         zip_source_close(za->src);
         zip_source_free(za->src);
     }
 
-    free(za->default_password);
+    _zip_free(za->default_password);
     _zip_string_free(za->comment_orig);
     _zip_string_free(za->comment_changes);
+    _zip_free(za->prefix_orig);
+    _zip_free(za->prefix_changes);
+    _zip_free(za->cdir_segments);
+    _zip_free(za->data_order);
 
     _zip_hash_free(za->names);
+    _zip_cdir_index_free(za->cdir_index);
+    _zip_name_index_free(za);
 
     if (za->entry) {
         for (i = 0; i < za->nentry; i++)
             _zip_entry_finalize(za->entry + i);
-        free(za->entry);
+        _zip_free(za->entry);
+        _zip_memory_budget_release(za->memory_budget, sizeof(*za->entry) * za->nentry_alloc);
     }
+    _zip_free(za->change_log);
+    _zip_arena_free(za->arena);
 
     for (i = 0; i < za->nopen_source; i++) {
         _zip_source_invalidate(za->open_source[i]);
     }
-    free(za->open_source);
+    _zip_free(za->open_source);
+    _zip_shared_entry_detach_all(za);
 
     _zip_progress_free(za->progress);
+    _zip_free(za->io_buffer);
+    _zip_free(za->entry_buffer);
+    _zip_free(za->write_buffer);
+    _zip_read_entry_free(za);
+    _zip_entry_cache_free(za->entry_cache);
+    _zip_memory_budget_free(za->memory_budget);
+#ifdef HAVE_THREADS
+    _zip_mutex_free(za->mutex);
+#endif
+#ifdef HAVE_CRYPTO
+    _zip_winzip_aes_key_cache_free(za->aes_key_cache);
+#endif
+    _zip_free(za->crypto_provider);
+    _zip_free(za->stats);
+#if defined(HAVE_LIBZSTD)
+    _zip_zstd_dictionary_free(za->zstd_dictionary);
+#endif
 
     zip_error_fini(&za->error);
 
-    free(za);
+    _zip_free(za);
 
     return;
 }
@@ -48,4 +48,35 @@ _zip_entry_init(zip_entry_t *e) {
     e->changes = NULL;
     e->source = NULL;
     e->deleted = 0;
+    e->logged = false;
+}
+
+
+/* _zip_entry_log_change:
+   Record that original entry idx may be changed, so that finding and
+   reverting changes only has to look at logged and new entries.
+   Called before an entry is changed. */
+
+bool
+_zip_entry_log_change(zip_t *za, zip_uint64_t idx) {
+    if (idx >= za->nentry_orig || za->entry[idx].logged) {
+        return true;
+    }
+
+    if (za->nchange_log == za->nchange_log_alloc) {
+        zip_uint64_t new_alloc = za->nchange_log_alloc < 16 ? 16 : za->nchange_log_alloc * 2;
+        zip_uint64_t *new_log;
+
+        if (new_alloc > SIZE_MAX / sizeof(*new_log) || (new_log = (zip_uint64_t *)_zip_realloc(za->change_log, sizeof(*new_log) * (size_t)new_alloc)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        za->change_log = new_log;
+        za->nchange_log_alloc = new_alloc;
+    }
+
+    za->change_log[za->nchange_log++] = idx;
+    za->entry[idx].logged = true;
+
+    return true;
 }
@@ -0,0 +1,797 @@
+/*
+  zip_entry_cache.c -- cache of decompressed entry data
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+#define INITIAL_HASH_SIZE 16
+
+struct zip_entry_cache_item {
+    zip_uint64_t index;
+    zip_uint8_t *data;
+    zip_uint64_t size;
+    zip_uint32_t crc;
+    zip_uint32_t refcount; /* one while in cache, one for each user */
+    zip_entry_cache_item_t *hash_next; /* next item in same hash bucket */
+    zip_entry_cache_item_t *prev;      /* LRU list, most recently used first */
+    zip_entry_cache_item_t *next;
+};
+
+/* Shared by an archive and the sources reading cached data, which may be freed after the archive. */
+struct zip_entry_cache {
+    zip_uint64_t max_size; /* for data of all items */
+    zip_uint64_t size;
+    zip_uint64_t hits;
+    zip_uint64_t misses;
+    zip_entry_cache_item_t **hash; /* items by index */
+    zip_uint64_t hash_size;        /* power of 2 */
+    zip_uint64_t nitems;
+    zip_entry_cache_item_t *lru_head;
+    zip_entry_cache_item_t *lru_tail;
+    zip_memory_budget_t *budget; /* charged for item data */
+    zip_uint32_t refcount;
+#ifdef HAVE_THREADS
+    zip_mutex_t *mutex; /* cached data is read from different threads with ZIP_THREADSAFE */
+#endif
+};
+
+#ifdef HAVE_THREADS
+#define CACHE_LOCK(cache) _zip_mutex_lock((cache)->mutex)
+#define CACHE_UNLOCK(cache) _zip_mutex_unlock((cache)->mutex)
+#else
+#define CACHE_LOCK(cache) ((void)0)
+#define CACHE_UNLOCK(cache) ((void)0)
+#endif
+
+/* source reading data of cached item */
+struct reader {
+    zip_entry_cache_t *cache;
+    zip_entry_cache_item_t *item;
+    zip_uint64_t offset;
+    zip_error_t error;
+};
+typedef struct reader reader_t;
+
+static void cache_evict(zip_entry_cache_t *cache, zip_uint64_t size);
+static zip_entry_cache_item_t *cache_find(zip_entry_cache_t *cache, zip_uint64_t index);
+static void cache_insert(zip_entry_cache_t *cache, zip_entry_cache_item_t *item);
+static zip_entry_cache_t *cache_new(zip_memory_budget_t *budget, zip_error_t *error);
+static void cache_release(zip_entry_cache_t *cache);
+static void cache_remove(zip_entry_cache_t *cache, zip_entry_cache_item_t *item);
+static void cache_touch(zip_entry_cache_t *cache, zip_entry_cache_item_t *item);
+static zip_entry_cache_item_t *cache_use(zip_entry_cache_t *cache, zip_uint64_t index);
+static zip_entry_cache_item_t *item_new(zip_entry_cache_t *cache, zip_uint64_t index, zip_uint64_t size, zip_uint32_t crc);
+static bool item_read(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_entry_cache_item_t *item);
+static bool item_read_source(zip_source_t *src, zip_uint64_t index, zip_entry_cache_item_t *item, zip_error_t *error);
+static void item_unref(zip_entry_cache_t *cache, zip_entry_cache_item_t *item);
+static zip_int64_t read_cached(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+static zip_source_t *reader_new(zip_entry_cache_t *cache, zip_entry_cache_item_t *item, zip_error_t *error);
+static bool usable(zip_t *za, zip_uint64_t index, zip_flags_t flags);
+
+
+ZIP_EXTERN int
+zip_get_entry_cache_stats(zip_t *za, zip_uint64_t *hits, zip_uint64_t *misses) {
+    zip_uint64_t h, m;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    h = m = 0;
+    ZIP_LOCK(za);
+    if (za->entry_cache != NULL) {
+        CACHE_LOCK(za->entry_cache);
+        h = za->entry_cache->hits;
+        m = za->entry_cache->misses;
+        CACHE_UNLOCK(za->entry_cache);
+    }
+    ZIP_UNLOCK(za);
+
+    if (hits != NULL) {
+        *hits = h;
+    }
+    if (misses != NULL) {
+        *misses = m;
+    }
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_set_entry_cache_size(zip_t *za, zip_uint64_t size) {
+    if (za == NULL) {
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    if (size == 0) {
+        _zip_entry_cache_free(za->entry_cache);
+        za->entry_cache = NULL;
+    }
+    else {
+        if (za->entry_cache == NULL && (za->entry_cache = cache_new(za->memory_budget, &za->error)) == NULL) {
+            ZIP_UNLOCK(za);
+            return -1;
+        }
+        CACHE_LOCK(za->entry_cache);
+        za->entry_cache->max_size = size;
+        cache_evict(za->entry_cache, 0);
+        CACHE_UNLOCK(za->entry_cache);
+    }
+    ZIP_UNLOCK(za);
+
+    return 0;
+}
+
+
+/* Add copy of size bytes of data of entry index to cache of archive, if it is used.
+   Not being able to is not an error. */
+void
+_zip_entry_cache_add(zip_t *za, zip_uint64_t index, const void *data, zip_uint64_t size) {
+    zip_entry_cache_t *cache = za->entry_cache;
+    zip_entry_cache_item_t *item;
+
+    if (!usable(za, index, 0) || size != za->entry[index].orig->uncomp_size) {
+        return;
+    }
+
+    CACHE_LOCK(cache);
+    if (cache_find(cache, index) != NULL) {
+        CACHE_UNLOCK(cache);
+        return;
+    }
+    cache_evict(cache, size);
+    CACHE_UNLOCK(cache);
+
+    if ((item = item_new(cache, index, size, za->entry[index].orig->crc)) == NULL) {
+        return;
+    }
+    memcpy(item->data, data, (size_t)size);
+
+    CACHE_LOCK(cache);
+    if (cache_find(cache, index) == NULL) {
+        cache_evict(cache, size);
+        cache_insert(cache, item);
+    }
+    item_unref(cache, item);
+    CACHE_UNLOCK(cache);
+}
+
+
+/* Release cache for archive. Data still read by open files is freed once they are closed. */
+void
+_zip_entry_cache_free(zip_entry_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    CACHE_LOCK(cache);
+    while (cache->lru_head != NULL) {
+        cache_remove(cache, cache->lru_head);
+    }
+    CACHE_UNLOCK(cache);
+
+    cache_release(cache);
+}
+
+
+/* Open source reading data of entry index from cache of archive, adding it if it isn't cached yet.
+   Set *srcp to NULL if the entry can't be cached; the caller then reads it from the archive.
+   Return false and set za->error if the entry can't be read. */
+bool
+_zip_entry_cache_open(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_source_t **srcp) {
+    zip_entry_cache_t *cache = za->entry_cache;
+    zip_entry_cache_item_t *item, *cached;
+    zip_dirent_t *de;
+    zip_source_t *src;
+
+    *srcp = NULL;
+    if (!usable(za, index, flags)) {
+        return true;
+    }
+    de = za->entry[index].orig;
+
+    CACHE_LOCK(cache);
+    if ((item = cache_use(cache, index)) == NULL) {
+        cache_evict(cache, de->uncomp_size);
+    }
+    CACHE_UNLOCK(cache);
+
+    if (item == NULL) {
+        if ((item = item_new(cache, index, de->uncomp_size, de->crc)) == NULL) {
+            return true;
+        }
+        if (!item_read(za, index, flags, item)) {
+            CACHE_LOCK(cache);
+            item_unref(cache, item);
+            CACHE_UNLOCK(cache);
+            return false;
+        }
+
+        CACHE_LOCK(cache);
+        if ((cached = cache_find(cache, index)) != NULL) {
+            /* added by another thread meanwhile */
+            item_unref(cache, item);
+            item = cached;
+            item->refcount++;
+        }
+        else {
+            cache_evict(cache, item->size);
+            cache_insert(cache, item);
+        }
+        CACHE_UNLOCK(cache);
+    }
+
+    if ((src = reader_new(cache, item, &za->error)) == NULL) {
+        CACHE_LOCK(cache);
+        item_unref(cache, item);
+        CACHE_UNLOCK(cache);
+        return false;
+    }
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        zip_source_free(src);
+        return false;
+    }
+
+    *srcp = src;
+    return true;
+}
+
+
+/* Read data of entry index into cache of archive unless it's cached already, without counting a hit or miss.
+   Called from a background thread without holding the archive lock; errors are ignored, the entry is read again when it is used. */
+void
+_zip_entry_cache_prefetch(zip_t *za, zip_uint64_t index) {
+    zip_entry_cache_t *cache;
+    zip_entry_cache_item_t *item;
+    zip_dirent_t *de;
+    zip_source_t *src;
+    zip_error_t error;
+    bool ok;
+
+    ZIP_LOCK(za);
+    if (!usable(za, index, 0)) {
+        ZIP_UNLOCK(za);
+        return;
+    }
+    cache = za->entry_cache;
+    de = za->entry[index].orig;
+
+    CACHE_LOCK(cache);
+    if (cache_find(cache, index) != NULL) {
+        CACHE_UNLOCK(cache);
+        ZIP_UNLOCK(za);
+        return;
+    }
+    /* keep cache while data is read without archive lock */
+    cache->refcount++;
+    CACHE_UNLOCK(cache);
+
+    zip_error_init(&error);
+    src = NULL;
+    if ((item = item_new(cache, index, de->uncomp_size, de->crc)) != NULL && (src = zip_source_zip_file_create(za, index, 0, 0, -1, NULL, &error)) != NULL && zip_source_open(src) < 0) {
+        zip_source_free(src);
+        src = NULL;
+    }
+    ZIP_UNLOCK(za);
+
+    ok = src != NULL && item_read_source(src, index, item, &error);
+    zip_source_free(src);
+    zip_error_fini(&error);
+
+    if (ok) {
+        /* cache may have been replaced meanwhile */
+        ZIP_LOCK(za);
+        if (za->entry_cache == cache) {
+            CACHE_LOCK(cache);
+            if (cache_find(cache, index) == NULL) {
+                cache_evict(cache, item->size);
+                cache_insert(cache, item);
+            }
+            CACHE_UNLOCK(cache);
+        }
+        ZIP_UNLOCK(za);
+    }
+
+    if (item != NULL) {
+        CACHE_LOCK(cache);
+        item_unref(cache, item);
+        CACHE_UNLOCK(cache);
+    }
+    cache_release(cache);
+}
+
+
+/* Copy cached data of entry index into data, which has room for its uncompressed size.
+   Return false if it isn't cached. */
+bool
+_zip_entry_cache_read(zip_t *za, zip_uint64_t index, void *data) {
+    zip_entry_cache_t *cache = za->entry_cache;
+    zip_entry_cache_item_t *item;
+
+    if (!usable(za, index, 0)) {
+        return false;
+    }
+
+    CACHE_LOCK(cache);
+    item = cache_use(cache, index);
+    CACHE_UNLOCK(cache);
+
+    if (item == NULL) {
+        return false;
+    }
+
+    /* item can't be freed while we hold a reference, so copy without lock */
+    memcpy(data, item->data, (size_t)item->size);
+
+    CACHE_LOCK(cache);
+    item_unref(cache, item);
+    CACHE_UNLOCK(cache);
+
+    return true;
+}
+
+
+/* Remove least recently used items until size more bytes fit. Called with cache locked. */
+static void
+cache_evict(zip_entry_cache_t *cache, zip_uint64_t size) {
+    while (cache->lru_tail != NULL && (cache->size + size < size || cache->size + size > cache->max_size)) {
+        cache_remove(cache, cache->lru_tail);
+    }
+}
+
+
+/* Called with cache locked. */
+static zip_entry_cache_item_t *
+cache_find(zip_entry_cache_t *cache, zip_uint64_t index) {
+    zip_entry_cache_item_t *item;
+
+    for (item = cache->hash[index & (cache->hash_size - 1)]; item != NULL; item = item->hash_next) {
+        if (item->index == index) {
+            return item;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Add item as most recently used, taking a reference. Called with cache locked. */
+static void
+cache_insert(zip_entry_cache_t *cache, zip_entry_cache_item_t *item) {
+    zip_uint64_t bucket;
+
+    if (cache->nitems >= cache->hash_size && cache->hash_size <= SIZE_MAX / 2 / sizeof(cache->hash[0])) {
+        zip_entry_cache_item_t **hash;
+        zip_entry_cache_item_t *entry;
+
+        /* keep chains short; if growing fails, they just get longer */
+        if ((hash = (zip_entry_cache_item_t **)_zip_calloc((size_t)cache->hash_size * 2, sizeof(hash[0]))) != NULL) {
+            for (entry = cache->lru_head; entry != NULL; entry = entry->next) {
+                bucket = entry->index & (cache->hash_size * 2 - 1);
+                entry->hash_next = hash[bucket];
+                hash[bucket] = entry;
+            }
+            _zip_free(cache->hash);
+            cache->hash = hash;
+            cache->hash_size *= 2;
+        }
+    }
+
+    bucket = item->index & (cache->hash_size - 1);
+    item->hash_next = cache->hash[bucket];
+    cache->hash[bucket] = item;
+
+    item->prev = NULL;
+    item->next = cache->lru_head;
+    if (cache->lru_head != NULL) {
+        cache->lru_head->prev = item;
+    }
+    else {
+        cache->lru_tail = item;
+    }
+    cache->lru_head = item;
+
+    cache->nitems++;
+    cache->size += item->size;
+    item->refcount++;
+}
+
+
+static zip_entry_cache_t *
+cache_new(zip_memory_budget_t *budget, zip_error_t *error) {
+    zip_entry_cache_t *cache;
+
+    if ((cache = (zip_entry_cache_t *)_zip_malloc(sizeof(*cache))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((cache->hash = (zip_entry_cache_item_t **)_zip_calloc(INITIAL_HASH_SIZE, sizeof(cache->hash[0]))) == NULL) {
+        _zip_free(cache);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+#ifdef HAVE_THREADS
+    if ((cache->mutex = _zip_mutex_new(error)) == NULL) {
+        _zip_free(cache->hash);
+        _zip_free(cache);
+        return NULL;
+    }
+#endif
+
+    cache->max_size = 0;
+    cache->size = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->hash_size = INITIAL_HASH_SIZE;
+    cache->nitems = 0;
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->budget = _zip_memory_budget_ref(budget);
+    cache->refcount = 1;
+
+    return cache;
+}
+
+
+/* Drop reference to cache, freeing it with the last one. */
+static void
+cache_release(zip_entry_cache_t *cache) {
+    bool last;
+
+    CACHE_LOCK(cache);
+    last = --cache->refcount == 0;
+    CACHE_UNLOCK(cache);
+
+    if (!last) {
+        return;
+    }
+
+    _zip_free(cache->hash);
+    _zip_memory_budget_free(cache->budget);
+#ifdef HAVE_THREADS
+    _zip_mutex_free(cache->mutex);
+#endif
+    _zip_free(cache);
+}
+
+
+/* Called with cache locked. */
+static void
+cache_remove(zip_entry_cache_t *cache, zip_entry_cache_item_t *item) {
+    zip_entry_cache_item_t **p;
+
+    for (p = &cache->hash[item->index & (cache->hash_size - 1)]; *p != item; p = &(*p)->hash_next) {
+    }
+    *p = item->hash_next;
+
+    if (item->prev != NULL) {
+        item->prev->next = item->next;
+    }
+    else {
+        cache->lru_head = item->next;
+    }
+    if (item->next != NULL) {
+        item->next->prev = item->prev;
+    }
+    else {
+        cache->lru_tail = item->prev;
+    }
+
+    cache->nitems--;
+    cache->size -= item->size;
+    item_unref(cache, item);
+}
+
+
+/* Mark item as most recently used. Called with cache locked. */
+static void
+cache_touch(zip_entry_cache_t *cache, zip_entry_cache_item_t *item) {
+    if (cache->lru_head == item) {
+        return;
+    }
+
+    item->prev->next = item->next;
+    if (item->next != NULL) {
+        item->next->prev = item->prev;
+    }
+    else {
+        cache->lru_tail = item->prev;
+    }
+
+    item->prev = NULL;
+    item->next = cache->lru_head;
+    cache->lru_head->prev = item;
+    cache->lru_head = item;
+}
+
+
+/* Look up item for entry index, counting hit or miss, and return it with a reference taken. Called with cache locked. */
+static zip_entry_cache_item_t *
+cache_use(zip_entry_cache_t *cache, zip_uint64_t index) {
+    zip_entry_cache_item_t *item;
+
+    if ((item = cache_find(cache, index)) == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+
+    cache_touch(cache, item);
+    cache->hits++;
+    item->refcount++;
+    return item;
+}
+
+
+/* Allocate item with room for size bytes of data and one reference, or return NULL if that exceeds the memory limit. */
+static zip_entry_cache_item_t *
+item_new(zip_entry_cache_t *cache, zip_uint64_t index, zip_uint64_t size, zip_uint32_t crc) {
+    zip_entry_cache_item_t *item;
+    zip_error_t error;
+
+    zip_error_init(&error);
+    if (!_zip_memory_budget_charge(cache->budget, size, &error)) {
+        zip_error_fini(&error);
+        return NULL;
+    }
+    zip_error_fini(&error);
+
+    if ((item = (zip_entry_cache_item_t *)_zip_malloc(sizeof(*item))) == NULL) {
+        _zip_memory_budget_release(cache->budget, size);
+        return NULL;
+    }
+    if ((item->data = (zip_uint8_t *)_zip_malloc((size_t)size)) == NULL) {
+        _zip_free(item);
+        _zip_memory_budget_release(cache->budget, size);
+        return NULL;
+    }
+
+    item->index = index;
+    item->size = size;
+    item->crc = crc;
+    item->refcount = 1;
+    item->hash_next = NULL;
+    item->prev = NULL;
+    item->next = NULL;
+
+    return item;
+}
+
+
+/* Read data of entry index into item, checking it like zip_fread() does. Errors are reported in za->error. */
+static bool
+item_read(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_entry_cache_item_t *item) {
+    zip_source_t *src;
+    bool ok;
+
+    if ((src = zip_source_zip_file_create(za, index, flags, 0, -1, NULL, &za->error)) == NULL) {
+        return false;
+    }
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        zip_source_free(src);
+        return false;
+    }
+
+    ok = item_read_source(src, index, item, &za->error);
+    zip_source_free(src);
+
+    return ok;
+}
+
+
+/* Read data of entry index from open source src into item. */
+static bool
+item_read_source(zip_source_t *src, zip_uint64_t index, zip_entry_cache_item_t *item, zip_error_t *error) {
+    zip_uint64_t size;
+    zip_int64_t n;
+    zip_uint8_t extra;
+
+    size = 0;
+    n = 0;
+    while (size < item->size) {
+        if ((n = zip_source_read(src, item->data + size, item->size - size)) <= 0) {
+            break;
+        }
+        size += (zip_uint64_t)n;
+    }
+    if (n >= 0) {
+        /* read end of data, so checksum is verified */
+        n = zip_source_read(src, &extra, 1);
+    }
+
+    if (n < 0) {
+        zip_error_set_from_source(error, src);
+        return false;
+    }
+
+    if (n > 0 || size != item->size) {
+        zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, index));
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Drop reference to item, freeing it with the last one. Called with cache locked. */
+static void
+item_unref(zip_entry_cache_t *cache, zip_entry_cache_item_t *item) {
+    if (--item->refcount > 0) {
+        return;
+    }
+
+    _zip_memory_budget_release(cache->budget, item->size);
+    _zip_free(item->data);
+    _zip_free(item);
+}
+
+
+static zip_int64_t
+read_cached(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    reader_t *ctx = (reader_t *)ud;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN:
+        ctx->offset = 0;
+        return 0;
+
+    case ZIP_SOURCE_READ: {
+        zip_uint64_t n = ZIP_MIN(length, ctx->item->size - ctx->offset);
+
+        if (n > 0) {
+            memcpy(data, ctx->item->data + ctx->offset, (size_t)n);
+            ctx->offset += n;
+        }
+        return (zip_int64_t)n;
+    }
+
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, length, &ctx->error);
+
+        if (st == NULL) {
+            return -1;
+        }
+        st->size = ctx->item->size;
+        st->comp_size = ctx->item->size;
+        st->comp_method = ZIP_CM_STORE;
+        st->encryption_method = ZIP_EM_NONE;
+        st->crc = ctx->item->crc;
+        st->valid |= ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_CRC;
+        return 0;
+    }
+
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->item->size, data, length, &ctx->error);
+
+        if (new_offset < 0) {
+            return -1;
+        }
+        ctx->offset = (zip_uint64_t)new_offset;
+        return 0;
+    }
+
+    case ZIP_SOURCE_TELL:
+        return (zip_int64_t)ctx->offset;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        CACHE_LOCK(ctx->cache);
+        item_unref(ctx->cache, ctx->item);
+        CACHE_UNLOCK(ctx->cache);
+        cache_release(ctx->cache);
+        zip_error_fini(&ctx->error);
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_GET_DATA: {
+        /* data stays valid while the source holds its reference to item */
+        zip_source_args_get_data_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_get_data_t, data, length, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (args->offset > ctx->item->size || args->length > ctx->item->size - args->offset) {
+            zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+
+        args->data = ctx->item->data + args->offset;
+        return 0;
+    }
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_GET_DATA, -1);
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+
+/* Create source reading item, taking over the caller's reference to it. */
+static zip_source_t *
+reader_new(zip_entry_cache_t *cache, zip_entry_cache_item_t *item, zip_error_t *error) {
+    reader_t *ctx;
+    zip_source_t *src;
+
+    if ((ctx = (reader_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->cache = cache;
+    ctx->item = item;
+    ctx->offset = 0;
+    zip_error_init(&ctx->error);
+
+    if ((src = zip_source_function_create(read_cached, ctx, error)) == NULL) {
+        zip_error_fini(&ctx->error);
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    CACHE_LOCK(cache);
+    cache->refcount++;
+    CACHE_UNLOCK(cache);
+
+    return src;
+}
+
+
+/* Check whether data of entry index read with flags can be cached. */
+static bool
+usable(zip_t *za, zip_uint64_t index, zip_flags_t flags) {
+    zip_entry_t *entry;
+    zip_dirent_t *de;
+
+    if (za->entry_cache == NULL || (flags & (ZIP_FL_COMPRESSED | ZIP_FL_ENCRYPTED)) || index >= za->nentry) {
+        return false;
+    }
+    entry = za->entry + index;
+    if ((de = entry->orig) == NULL || entry->deleted || ((flags & ZIP_FL_UNCHANGED) == 0 && ZIP_ENTRY_DATA_CHANGED(entry))) {
+        return false;
+    }
+
+    /* caching decrypted data would make it readable without password */
+    return (de->bitflags & ZIP_GPBF_ENCRYPTED) == 0 && de->uncomp_size > 0 && de->uncomp_size <= za->entry_cache->max_size && de->uncomp_size <= SIZE_MAX;
+}
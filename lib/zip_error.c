@@ -50,7 +50,7 @@ zip_error_code_zip(const zip_error_t *error) {
 
 ZIP_EXTERN void
 zip_error_fini(zip_error_t *err) {
-    free(err->str);
+    _zip_free(err->str);
     err->str = NULL;
 }
 
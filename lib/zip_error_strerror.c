@@ -48,7 +48,7 @@ zip_error_strerror(zip_error_t *err) {
     zip_error_fini(err);
 
     if (err->zip_err < 0 || err->zip_err >= _zip_err_str_count) {
-        system_error_buffer = (char *)malloc(128);
+        system_error_buffer = (char *)_zip_malloc(128);
         if (system_error_buffer == NULL) {
             return _zip_err_str[ZIP_ER_MEMORY].description;
         }
@@ -63,7 +63,7 @@ zip_error_strerror(zip_error_t *err) {
         switch (_zip_err_str[err->zip_err].type) {
             case ZIP_ET_SYS: {
                 size_t len = strerrorlen_s(err->sys_err) + 1;
-                system_error_buffer = malloc(len);
+                system_error_buffer = _zip_malloc(len);
                 if (system_error_buffer == NULL) {
                     return _zip_err_str[ZIP_ER_MEMORY].description;
                 }
@@ -84,7 +84,7 @@ zip_error_strerror(zip_error_t *err) {
                     system_error_string = NULL;
                 }
                 else if (error >= _zip_err_details_count) {
-                    system_error_buffer = (char *)malloc(128);
+                    system_error_buffer = (char *)_zip_malloc(128);
                     if (system_error_buffer == NULL) {
                         return _zip_err_str[ZIP_ER_MEMORY].description;
                     }
@@ -93,7 +93,7 @@ zip_error_strerror(zip_error_t *err) {
                     system_error_string = system_error_buffer;
                 }
                 else if (_zip_err_details[error].type == ZIP_DETAIL_ET_ENTRY && index < MAX_DETAIL_INDEX) {
-                    system_error_buffer = (char *)malloc(128);
+                    system_error_buffer = (char *)_zip_malloc(128);
                     if (system_error_buffer == NULL) {
                         return _zip_err_str[ZIP_ER_MEMORY].description;
                     }
@@ -113,7 +113,7 @@ zip_error_strerror(zip_error_t *err) {
     }
 
     if (system_error_string == NULL) {
-        free(system_error_buffer);
+        _zip_free(system_error_buffer);
         return zip_error_string;
     }
     else {
@@ -121,20 +121,20 @@ zip_error_strerror(zip_error_t *err) {
         if (zip_error_string) {
             size_t length_error = strlen(zip_error_string);
             if (length + length_error + 2 < length) {
-                free(system_error_buffer);
+                _zip_free(system_error_buffer);
                 return _zip_err_str[ZIP_ER_MEMORY].description;
             }
             length += length_error + 2;
         }
-        if (length == SIZE_MAX || (s = (char *)malloc(length + 1)) == NULL) {
-            free(system_error_buffer);
+        if (length == SIZE_MAX || (s = (char *)_zip_malloc(length + 1)) == NULL) {
+            _zip_free(system_error_buffer);
             return _zip_err_str[ZIP_ER_MEMORY].description;
         }
 
         snprintf_s(s, length + 1, "%s%s%s", (zip_error_string ? zip_error_string : ""), (zip_error_string ? ": " : ""), system_error_string);
         err->str = s;
 
-        free(system_error_buffer);
+        _zip_free(system_error_buffer);
         return s;
     }
 }
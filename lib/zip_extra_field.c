@@ -36,6 +36,12 @@
 
 #include "zipint.h"
 
+#define EF_MERGE_HASH_MIN_FIELDS 16 /* below this, comparing with each field is faster than hashing */
+
+static bool ef_equal(const zip_extra_field_t *a, const zip_extra_field_t *b);
+static zip_uint32_t ef_hash(const zip_extra_field_t *ef);
+static zip_extra_field_t *ef_table_add(zip_extra_field_t **table, zip_uint64_t table_size, zip_extra_field_t *ef);
+
 
 zip_extra_field_t *
 _zip_ef_clone(const zip_extra_field_t *ef, zip_error_t *error) {
@@ -105,13 +111,40 @@ _zip_ef_free(zip_extra_field_t *ef) {
 
     while (ef) {
         ef2 = ef->next;
-        free(ef->data);
-        free(ef);
+        if (!ef->in_arena) {
+            _zip_free(ef->data);
+            _zip_free(ef);
+        }
         ef = ef2;
     }
 }
 
 
+/* Like _zip_ef_get_by_id for the first field with id in data, which has been checked by _zip_ef_parse. */
+const zip_uint8_t *
+_zip_ef_get_by_id_raw(const zip_uint8_t *data, zip_uint16_t len, zip_uint16_t *lenp, zip_uint16_t id) {
+    static const zip_uint8_t empty[1] = {'\0'};
+    zip_uint32_t offset;
+    zip_uint16_t fid, flen;
+
+    for (offset = 0; offset + 4 <= len; offset += 4 + (zip_uint32_t)flen) {
+        fid = (zip_uint16_t)(data[offset] | (data[offset + 1] << 8));
+        flen = (zip_uint16_t)(data[offset + 2] | (data[offset + 3] << 8));
+        if (offset + 4 + flen > len) {
+            break;
+        }
+        if (fid == id) {
+            if (lenp) {
+                *lenp = flen;
+            }
+            return flen > 0 ? data + offset + 4 : empty;
+        }
+    }
+
+    return NULL;
+}
+
+
 const zip_uint8_t *
 _zip_ef_get_by_id(const zip_extra_field_t *ef, zip_uint16_t *lenp, zip_uint16_t id, zip_uint16_t id_idx, zip_flags_t flags, zip_error_t *error) {
     static const zip_uint8_t empty[1] = {'\0'};
@@ -140,26 +173,52 @@ _zip_ef_get_by_id(const zip_extra_field_t *ef, zip_uint16_t *lenp, zip_uint16_t
 }
 
 
+/* Merge extra fields of from into to, dropping those that are already in to (adding their header flags).
+   Archives can have thousands of extra fields per entry, so above a few fields they are looked up in a hash table. */
 zip_extra_field_t *
 _zip_ef_merge(zip_extra_field_t *to, zip_extra_field_t *from) {
-    zip_extra_field_t *ef2, *tt, *tail;
+    zip_extra_field_t *ef2, *tt, *tail, **table;
+    zip_uint64_t count, table_size;
     int duplicate;
 
     if (to == NULL)
         return from;
 
+    count = 1;
     for (tail = to; tail->next; tail = tail->next)
-        ;
+        count++;
+    for (tt = from; tt; tt = tt->next)
+        count++;
+
+    table = NULL;
+    table_size = 0;
+    if (count >= EF_MERGE_HASH_MIN_FIELDS) {
+        for (table_size = EF_MERGE_HASH_MIN_FIELDS; table_size < count * 2; table_size *= 2)
+            ;
+        if ((table = (zip_extra_field_t **)_zip_calloc((size_t)table_size, sizeof(*table))) != NULL) {
+            for (tt = to; tt; tt = tt->next) {
+                (void)ef_table_add(table, table_size, tt);
+            }
+        }
+    }
 
     for (; from; from = ef2) {
         ef2 = from->next;
 
         duplicate = 0;
-        for (tt = to; tt; tt = tt->next) {
-            if (tt->id == from->id && tt->size == from->size && (tt->size == 0 || memcmp(tt->data, from->data, tt->size) == 0)) {
+        if (table != NULL) {
+            if ((tt = ef_table_add(table, table_size, from)) != from) {
                 tt->flags |= (from->flags & ZIP_EF_BOTH);
                 duplicate = 1;
-                break;
+            }
+        }
+        else {
+            for (tt = to; tt; tt = tt->next) {
+                if (ef_equal(tt, from)) {
+                    tt->flags |= (from->flags & ZIP_EF_BOTH);
+                    duplicate = 1;
+                    break;
+                }
             }
         }
 
@@ -170,6 +229,8 @@ _zip_ef_merge(zip_extra_field_t *to, zip_extra_field_t *from) {
             tail = tail->next = from;
     }
 
+    _zip_free(table);
+
     return to;
 }
 
@@ -178,16 +239,17 @@ zip_extra_field_t *
 _zip_ef_new(zip_uint16_t id, zip_uint16_t size, const zip_uint8_t *data, zip_flags_t flags) {
     zip_extra_field_t *ef;
 
-    if ((ef = (zip_extra_field_t *)malloc(sizeof(*ef))) == NULL)
+    if ((ef = (zip_extra_field_t *)_zip_malloc(sizeof(*ef))) == NULL)
         return NULL;
 
     ef->next = NULL;
+    ef->in_arena = false;
     ef->flags = flags;
     ef->id = id;
     ef->size = size;
     if (size > 0) {
         if ((ef->data = (zip_uint8_t *)_zip_memdup(data, size, NULL)) == NULL) {
-            free(ef);
+            _zip_free(ef);
             return NULL;
         }
     }
@@ -198,36 +260,64 @@ _zip_ef_new(zip_uint16_t id, zip_uint16_t size, const zip_uint8_t *data, zip_fla
 }
 
 
+/* Allocate extra field and its data in one block from ARENA; it is not freed by _zip_ef_free. */
+static zip_extra_field_t *
+ef_new_arena(zip_arena_t *arena, zip_uint16_t id, zip_uint16_t size, const zip_uint8_t *data, zip_flags_t flags, zip_error_t *error) {
+    zip_extra_field_t *ef;
+
+    if ((ef = (zip_extra_field_t *)_zip_arena_alloc(arena, sizeof(*ef) + size, error)) == NULL) {
+        return NULL;
+    }
+
+    ef->next = NULL;
+    ef->in_arena = true;
+    ef->flags = flags;
+    ef->id = id;
+    ef->size = size;
+    if (size > 0) {
+        ef->data = (zip_uint8_t *)(ef + 1);
+        (void)memcpy_s(ef->data, size, data, size);
+    }
+    else {
+        ef->data = NULL;
+    }
+
+    return ef;
+}
+
+
 bool
-_zip_ef_parse(const zip_uint8_t *data, zip_uint16_t len, zip_flags_t flags, zip_extra_field_t **ef_head_p, zip_error_t *error) {
-    zip_buffer_t *buffer;
+_zip_ef_parse(const zip_uint8_t *data, zip_uint16_t len, zip_flags_t flags, zip_extra_field_t **ef_head_p, zip_arena_t *arena, zip_error_t *error) {
+    zip_buffer_t buffer;
     zip_extra_field_t *ef, *ef2, *ef_head;
 
-    if ((buffer = _zip_buffer_new((zip_uint8_t *)data, len)) == NULL) {
-        zip_error_set(error, ZIP_ER_MEMORY, 0);
-        return false;
-    }
+    _zip_buffer_init(&buffer, (zip_uint8_t *)data, len);
 
     ef_head = ef = NULL;
 
-    while (_zip_buffer_ok(buffer) && _zip_buffer_left(buffer) >= 4) {
+    while (_zip_buffer_ok(&buffer) && _zip_buffer_left(&buffer) >= 4) {
         zip_uint16_t fid, flen;
         zip_uint8_t *ef_data;
 
-        fid = _zip_buffer_get_16(buffer);
-        flen = _zip_buffer_get_16(buffer);
-        ef_data = _zip_buffer_get(buffer, flen);
+        fid = _zip_buffer_get_16(&buffer);
+        flen = _zip_buffer_get_16(&buffer);
+        ef_data = _zip_buffer_get(&buffer, flen);
 
         if (ef_data == NULL) {
             zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_INVALID_EF_LENGTH);
-            _zip_buffer_free(buffer);
             _zip_ef_free(ef_head);
             return false;
         }
 
-        if ((ef2 = _zip_ef_new(fid, flen, ef_data, flags)) == NULL) {
-            zip_error_set(error, ZIP_ER_MEMORY, 0);
-            _zip_buffer_free(buffer);
+        if (ef_head_p == NULL) {
+            /* only check format */
+            continue;
+        }
+
+        if ((ef2 = arena != NULL ? ef_new_arena(arena, fid, flen, ef_data, flags, error) : _zip_ef_new(fid, flen, ef_data, flags)) == NULL) {
+            if (arena == NULL) {
+                zip_error_set(error, ZIP_ER_MEMORY, 0);
+            }
             _zip_ef_free(ef_head);
             return false;
         }
@@ -240,29 +330,23 @@ _zip_ef_parse(const zip_uint8_t *data, zip_uint16_t len, zip_flags_t flags, zip_
             ef_head = ef = ef2;
     }
 
-    if (!_zip_buffer_eof(buffer)) {
+    if (!_zip_buffer_eof(&buffer)) {
         /* Android APK files align stored file data with padding in extra fields; ignore. */
         /* see https://android.googlesource.com/platform/build/+/master/tools/zipalign/ZipAlign.cpp */
         /* buffer is at most 64k long, so this can't overflow. */
-        size_t glen = _zip_buffer_left(buffer);
+        size_t glen = _zip_buffer_left(&buffer);
         zip_uint8_t *garbage;
-        garbage = _zip_buffer_get(buffer, glen);
+        garbage = _zip_buffer_get(&buffer, glen);
         if (glen >= 4 || garbage == NULL || memcmp(garbage, "\0\0\0", (size_t)glen) != 0) {
             zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_EF_TRAILING_GARBAGE);
-            _zip_buffer_free(buffer);
             _zip_ef_free(ef_head);
             return false;
         }
     }
 
-    _zip_buffer_free(buffer);
-
     if (ef_head_p) {
         *ef_head_p = ef_head;
     }
-    else {
-        _zip_ef_free(ef_head);
-    }
 
     return true;
 }
@@ -351,77 +435,77 @@ _zip_ef_write(zip_t *za, const zip_extra_field_t *ef, zip_flags_t flags) {
 int
 _zip_read_local_ef(zip_t *za, zip_uint64_t idx) {
     zip_entry_t *e;
-    unsigned char b[4];
-    zip_buffer_t *buffer;
-    zip_uint16_t fname_len, ef_len;
 
     if (idx >= za->nentry) {
         zip_error_set(&za->error, ZIP_ER_INVAL, 0);
         return -1;
     }
 
+    if (!_zip_cdir_index_load(za, idx, &za->error)) {
+        return -1;
+    }
+
     e = za->entry + idx;
 
-    if (e->orig == NULL || e->orig->local_extra_fields_read)
+    if (e->orig == NULL)
         return 0;
 
-    if (e->orig->offset + 26 > ZIP_INT64_MAX) {
-        zip_error_set(&za->error, ZIP_ER_SEEK, EFBIG);
+    if (!_zip_dirent_parse_extra_fields(e->orig, za->arena, &za->error)) {
         return -1;
     }
 
-    if (zip_source_seek(za->src, (zip_int64_t)(e->orig->offset + 26), SEEK_SET) < 0) {
-        zip_error_set_from_source(&za->error, za->src);
+    /* may already have been read along with the header size, see _zip_file_get_offset */
+    if (!_zip_dirent_read_local_header(e->orig, za->src, za->arena, true, &za->error)) {
         return -1;
     }
 
-    if ((buffer = _zip_buffer_new_from_source(za->src, sizeof(b), b, &za->error)) == NULL) {
-        return -1;
+    if (e->changes && e->changes->local_extra_fields_read == 0) {
+        e->changes->extra_fields = e->orig->extra_fields;
+        e->changes->raw_extra_fields = NULL;
+        e->changes->local_extra_fields_read = 1;
     }
 
-    fname_len = _zip_buffer_get_16(buffer);
-    ef_len = _zip_buffer_get_16(buffer);
+    return 0;
+}
 
-    if (!_zip_buffer_eof(buffer)) {
-        _zip_buffer_free(buffer);
-        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
-        return -1;
-    }
 
-    _zip_buffer_free(buffer);
+static bool
+ef_equal(const zip_extra_field_t *a, const zip_extra_field_t *b) {
+    return a->id == b->id && a->size == b->size && (a->size == 0 || memcmp(a->data, b->data, a->size) == 0);
+}
 
-    if (ef_len > 0) {
-        zip_extra_field_t *ef;
-        zip_uint8_t *ef_raw;
 
-        if (zip_source_seek(za->src, fname_len, SEEK_CUR) < 0) {
-            zip_error_set(&za->error, ZIP_ER_SEEK, errno);
-            return -1;
-        }
+/* Hash of ID, size, and data of extra field: FNV-1a with final avalanche. */
+static zip_uint32_t
+ef_hash(const zip_extra_field_t *ef) {
+    zip_uint64_t value = 0xcbf29ce484222325ull;
+    zip_uint16_t i;
 
-        ef_raw = _zip_read_data(NULL, za->src, ef_len, 0, &za->error);
+    value = (value ^ ef->id) * 0x100000001b3ull;
+    value = (value ^ ef->size) * 0x100000001b3ull;
+    for (i = 0; i < ef->size; i++) {
+        value = (value ^ ef->data[i]) * 0x100000001b3ull;
+    }
 
-        if (ef_raw == NULL)
-            return -1;
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
 
-        if (!_zip_ef_parse(ef_raw, ef_len, ZIP_EF_LOCAL, &ef, &za->error)) {
-            free(ef_raw);
-            return -1;
-        }
-        free(ef_raw);
+    return (zip_uint32_t)value;
+}
 
-        if (ef) {
-            ef = _zip_ef_remove_internal(ef);
-            e->orig->extra_fields = _zip_ef_merge(e->orig->extra_fields, ef);
-        }
-    }
 
-    e->orig->local_extra_fields_read = 1;
+/* Add ef to table, whose size is a power of 2, unless an equal extra field is already in it. Returns the extra field in table. */
+static zip_extra_field_t *
+ef_table_add(zip_extra_field_t **table, zip_uint64_t table_size, zip_extra_field_t *ef) {
+    zip_uint64_t i;
 
-    if (e->changes && e->changes->local_extra_fields_read == 0) {
-        e->changes->extra_fields = e->orig->extra_fields;
-        e->changes->local_extra_fields_read = 1;
+    for (i = ef_hash(ef) & (table_size - 1); table[i] != NULL; i = (i + 1) & (table_size - 1)) {
+        if (ef_equal(table[i], ef)) {
+            return table[i];
+        }
     }
 
-    return 0;
+    table[i] = ef;
+    return ef;
 }
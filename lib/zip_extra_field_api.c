@@ -123,6 +123,10 @@ zip_file_extra_field_get(zip_t *za, zip_uint64_t idx, zip_uint16_t ef_idx, zip_u
     if ((de = _zip_get_dirent(za, idx, flags, &za->error)) == NULL)
         return NULL;
 
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return NULL;
+    }
+
     if (flags & ZIP_FL_LOCAL)
         if (_zip_read_local_ef(za, idx) < 0)
             return NULL;
@@ -163,6 +167,10 @@ zip_file_extra_field_get_by_id(zip_t *za, zip_uint64_t idx, zip_uint16_t ef_id,
     if ((de = _zip_get_dirent(za, idx, flags, &za->error)) == NULL)
         return NULL;
 
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return NULL;
+    }
+
     if (flags & ZIP_FL_LOCAL)
         if (_zip_read_local_ef(za, idx) < 0)
             return NULL;
@@ -185,6 +193,10 @@ zip_file_extra_fields_count(zip_t *za, zip_uint64_t idx, zip_flags_t flags) {
     if ((de = _zip_get_dirent(za, idx, flags, &za->error)) == NULL)
         return -1;
 
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return -1;
+    }
+
     if (flags & ZIP_FL_LOCAL)
         if (_zip_read_local_ef(za, idx) < 0)
             return -1;
@@ -212,6 +224,10 @@ zip_file_extra_fields_count_by_id(zip_t *za, zip_uint64_t idx, zip_uint16_t ef_i
     if ((de = _zip_get_dirent(za, idx, flags, &za->error)) == NULL)
         return -1;
 
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return -1;
+    }
+
     if (flags & ZIP_FL_LOCAL)
         if (_zip_read_local_ef(za, idx) < 0)
             return -1;
@@ -340,11 +356,19 @@ _zip_file_extra_field_prepare_for_change(zip_t *za, zip_uint64_t idx) {
         return -1;
     }
 
+    if (!_zip_cdir_index_load(za, idx, &za->error)) {
+        return -1;
+    }
+
     e = za->entry + idx;
 
     if (e->changes && (e->changes->changed & ZIP_DIRENT_EXTRA_FIELD))
         return 0;
 
+    if (!_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
+
     if (e->orig) {
         if (_zip_read_local_ef(za, idx) < 0)
             return -1;
@@ -357,6 +381,8 @@ _zip_file_extra_field_prepare_for_change(zip_t *za, zip_uint64_t idx) {
         }
     }
 
+    /* orig was parsed by _zip_read_local_ef */
+    e->changes->raw_extra_fields = NULL;
     if (e->orig && e->orig->extra_fields) {
         if ((e->changes->extra_fields = _zip_ef_clone(e->orig->extra_fields, &za->error)) == NULL)
             return -1;
@@ -0,0 +1,440 @@
+/*
+  zip_extract.c -- read data of all files
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+#ifdef HAVE_THREADS
+/* larger files are read in the calling thread, to bound memory used for data read ahead */
+#define EXTRACT_JOB_MAX_SIZE (16 * 1024 * 1024)
+
+/* data of entry read in worker thread */
+struct extract_job {
+    zip_thread_job_t job;
+    zip_source_t *src; /* source producing data to pass to callback */
+    zip_uint8_t *data; /* data read from src */
+    zip_uint64_t length;
+    zip_uint64_t alloc;
+    zip_error_t error;
+    int ret;
+};
+typedef struct extract_job extract_job_t;
+
+/* jobs for entries, submitted ahead of passing their data to the callback */
+struct extract_queue {
+    zip_thread_pool_t *pool;
+    zip_reader_t reader;
+    extract_job_t **jobs;         /* one per entry, NULL if entry is read directly */
+    zip_uint64_t next;            /* next entry to consider */
+    zip_uint64_t outstanding;     /* number of jobs submitted but not passed to callback yet */
+    zip_uint64_t max_outstanding; /* limit on outstanding jobs, bounds memory usage */
+};
+typedef struct extract_queue extract_queue_t;
+
+static int extract_from_job(zip_t *za, extract_queue_t *queue, zip_uint64_t idx, zip_extract_callback callback, void *ud);
+static int extract_queue_fill(zip_t *za, extract_queue_t *queue, zip_uint64_t nentries, zip_flags_t flags);
+static void extract_queue_fini(extract_queue_t *queue, zip_uint64_t nentries);
+static int extract_queue_init(zip_t *za, extract_queue_t *queue, zip_uint64_t nentries);
+#endif
+
+static int extract_entry(zip_t *za, zip_uint64_t idx, zip_flags_t flags, zip_extract_callback callback, void *ud);
+static zip_uint64_t extract_size(zip_t *za, zip_uint64_t idx, zip_flags_t flags);
+
+
+ZIP_EXTERN int
+zip_extract_all(zip_t *za, zip_flags_t flags, zip_extract_callback callback, void *ud) {
+    zip_int64_t n;
+    zip_uint64_t idx, total, done;
+    int ret = 0;
+#ifdef HAVE_THREADS
+    extract_queue_t queue;
+#endif
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    if (callback == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if ((n = zip_get_num_entries(za, flags)) < 0) {
+        return -1;
+    }
+
+    total = 0;
+    if (za->progress != NULL) {
+        for (idx = 0; idx < (zip_uint64_t)n; idx++) {
+            if ((flags & ZIP_FL_UNCHANGED) != 0 || !za->entry[idx].deleted) {
+                total += extract_size(za, idx, flags);
+            }
+        }
+    }
+    if (_zip_progress_start(za->progress, total) != 0) {
+        zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+        return -1;
+    }
+
+#ifdef HAVE_THREADS
+    if (extract_queue_init(za, &queue, (zip_uint64_t)n) < 0) {
+        return -1;
+    }
+#endif
+
+    done = 0;
+    for (idx = 0; idx < (zip_uint64_t)n; idx++) {
+        if ((flags & ZIP_FL_UNCHANGED) == 0 && za->entry[idx].deleted) {
+            continue;
+        }
+
+        if (za->progress != NULL) {
+            zip_uint64_t size = extract_size(za, idx, flags);
+
+            if (_zip_progress_subrange(za->progress, done, done + size) != 0) {
+                zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+                ret = -1;
+                break;
+            }
+            done += size;
+        }
+
+#ifdef HAVE_THREADS
+        if (extract_queue_fill(za, &queue, (zip_uint64_t)n, flags) < 0) {
+            ret = -1;
+            break;
+        }
+        if (queue.pool != NULL && queue.jobs[idx] != NULL) {
+            ret = extract_from_job(za, &queue, idx, callback, ud);
+        }
+        else
+#endif
+        {
+            ret = extract_entry(za, idx, flags, callback, ud);
+        }
+        if (ret < 0) {
+            break;
+        }
+    }
+
+#ifdef HAVE_THREADS
+    extract_queue_fini(&queue, (zip_uint64_t)n);
+#endif
+
+    if (ret == 0) {
+        _zip_progress_end(za->progress);
+    }
+
+    return ret;
+}
+
+
+/* Read entry idx in calling thread, passing its data to callback. */
+static int
+extract_entry(zip_t *za, zip_uint64_t idx, zip_flags_t flags, zip_extract_callback callback, void *ud) {
+    zip_file_t *zf;
+    zip_int64_t n;
+    zip_uint64_t length;
+    zip_uint8_t *buf;
+
+    if ((buf = _zip_io_buffer(za)) == NULL) {
+        return -1;
+    }
+
+    if ((zf = zip_fopen_index(za, idx, flags)) == NULL) {
+        return -1;
+    }
+
+    length = 0;
+    while ((n = zip_fread(zf, buf, za->io_buffer_size)) > 0) {
+        length += (zip_uint64_t)n;
+        if (callback(za, idx, buf, (zip_uint64_t)n, ud) != 0 || _zip_progress_update_bytes(za->progress, length) != 0) {
+            break;
+        }
+    }
+
+    if (n < 0) {
+        _zip_error_copy(&za->error, zip_file_get_error(zf));
+        zip_fclose(zf);
+        return -1;
+    }
+    zip_fclose(zf);
+
+    if (n > 0 || callback(za, idx, NULL, 0, ud) != 0) {
+        zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Return uncompressed size of entry idx, to weight its share of progress. */
+static zip_uint64_t
+extract_size(zip_t *za, zip_uint64_t idx, zip_flags_t flags) {
+    zip_dirent_t *de;
+    zip_stat_t st;
+    zip_error_t error;
+
+    if ((flags & ZIP_FL_UNCHANGED) == 0 && ZIP_ENTRY_DATA_CHANGED(za->entry + idx)) {
+        if (zip_source_stat(za->entry[idx].source, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0) {
+            return 0;
+        }
+        return st.size;
+    }
+
+    /* errors are reported when entry is read */
+    zip_error_init(&error);
+    de = _zip_get_dirent(za, idx, ZIP_FL_UNCHANGED, &error);
+    zip_error_fini(&error);
+
+    return de != NULL ? de->uncomp_size : 0;
+}
+
+
+#ifdef HAVE_THREADS
+static void
+extract_job_free(extract_job_t *job) {
+    if (job == NULL) {
+        return;
+    }
+
+    zip_source_free(job->src);
+    _zip_free(job->data);
+    zip_error_fini(&job->error);
+    _zip_free(job);
+}
+
+
+/* Runs in worker thread, must only access its job. */
+static void
+extract_job_run(void *ud) {
+    extract_job_t *job = (extract_job_t *)ud;
+    zip_int64_t n;
+
+    job->ret = -1;
+
+    if (zip_source_open(job->src) < 0) {
+        zip_error_set_from_source(&job->error, job->src);
+        return;
+    }
+
+    for (;;) {
+        if (job->length == job->alloc) {
+            zip_uint64_t new_alloc = job->alloc > 0 ? job->alloc * 2 : BUFSIZE;
+            zip_uint8_t *data;
+
+            if (new_alloc > SIZE_MAX || (data = (zip_uint8_t *)_zip_realloc(job->data, (size_t)new_alloc)) == NULL) {
+                zip_error_set(&job->error, ZIP_ER_MEMORY, 0);
+                break;
+            }
+            job->data = data;
+            job->alloc = new_alloc;
+        }
+
+        if ((n = zip_source_read(job->src, job->data + job->length, job->alloc - job->length)) < 0) {
+            zip_error_set_from_source(&job->error, job->src);
+            break;
+        }
+        if (n == 0) {
+            job->ret = 0;
+            break;
+        }
+        job->length += (zip_uint64_t)n;
+    }
+
+    zip_source_close(job->src);
+}
+
+
+/* Pass data read by worker thread for entry idx to callback. */
+static int
+extract_from_job(zip_t *za, extract_queue_t *queue, zip_uint64_t idx, zip_extract_callback callback, void *ud) {
+    extract_job_t *job = queue->jobs[idx];
+    int ret = 0;
+
+    _zip_thread_pool_wait(queue->pool, &job->job);
+    queue->jobs[idx] = NULL;
+    queue->outstanding--;
+
+    if (job->ret < 0) {
+        _zip_error_copy(&za->error, &job->error);
+        ret = -1;
+    }
+    else if ((job->length > 0 && callback(za, idx, job->data, job->length, ud) != 0) || _zip_progress_update_bytes(za->progress, job->length) != 0 || callback(za, idx, NULL, 0, ud) != 0) {
+        zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+        ret = -1;
+    }
+
+    extract_job_free(job);
+    return ret;
+}
+
+
+/* Create job for entry idx. Returns NULL if entry should be read in calling thread. */
+static extract_job_t *
+extract_job_new(zip_t *za, extract_queue_t *queue, zip_uint64_t idx, zip_flags_t flags) {
+    zip_entry_t *entry = za->entry + idx;
+    zip_dirent_t *de;
+    zip_source_t *data_src;
+    extract_job_t *job;
+    zip_error_t error;
+
+    if ((flags & ZIP_FL_UNCHANGED) == 0 && ZIP_ENTRY_DATA_CHANGED(entry)) {
+        return NULL;
+    }
+
+    /* errors are reported when entry is read in calling thread */
+    zip_error_init(&error);
+    if ((de = _zip_get_dirent(za, idx, ZIP_FL_UNCHANGED, &error)) == NULL || de->comp_size > EXTRACT_JOB_MAX_SIZE || de->uncomp_size > EXTRACT_JOB_MAX_SIZE) {
+        zip_error_fini(&error);
+        return NULL;
+    }
+
+    if ((job = (extract_job_t *)_zip_malloc(sizeof(*job))) == NULL) {
+        zip_error_fini(&error);
+        return NULL;
+    }
+    job->job.run = extract_job_run;
+    job->job.ud = job;
+    job->data = NULL;
+    job->length = 0;
+    /* one more byte, so reading end of data doesn't grow buffer */
+    job->alloc = ZIP_MAX(de->comp_size, de->uncomp_size) + 1;
+    zip_error_init(&job->error);
+    job->ret = -1;
+
+    if ((data_src = _zip_reader_entry_source_new(&queue->reader, de->offset, de->comp_size, &error)) == NULL) {
+        job->src = NULL;
+    }
+    else {
+        job->src = _zip_source_zip_new(za, idx, flags, 0, -1, NULL, data_src, &error);
+        zip_source_free(data_src);
+    }
+    zip_error_fini(&error);
+    if (job->src == NULL) {
+        extract_job_free(job);
+        return NULL;
+    }
+
+    if ((job->data = (zip_uint8_t *)_zip_malloc((size_t)job->alloc)) == NULL) {
+        extract_job_free(job);
+        return NULL;
+    }
+
+    return job;
+}
+
+
+/* Submit jobs for upcoming entries, up to the limit of outstanding jobs. */
+static int
+extract_queue_fill(zip_t *za, extract_queue_t *queue, zip_uint64_t nentries, zip_flags_t flags) {
+    if (queue->pool == NULL) {
+        return 0;
+    }
+
+    for (; queue->next < nentries && queue->outstanding < queue->max_outstanding; queue->next++) {
+        extract_job_t *job;
+
+        if ((flags & ZIP_FL_UNCHANGED) == 0 && za->entry[queue->next].deleted) {
+            continue;
+        }
+        if ((job = extract_job_new(za, queue, queue->next, flags)) == NULL) {
+            continue;
+        }
+
+        queue->jobs[queue->next] = job;
+        queue->outstanding++;
+        _zip_thread_pool_submit(queue->pool, &job->job);
+    }
+
+    return 0;
+}
+
+
+static void
+extract_queue_fini(extract_queue_t *queue, zip_uint64_t nentries) {
+    zip_uint64_t idx;
+
+    if (queue->pool == NULL) {
+        return;
+    }
+
+    /* waits for running jobs, so all jobs can be freed afterwards */
+    _zip_thread_pool_free(queue->pool);
+    for (idx = 0; idx < nentries; idx++) {
+        extract_job_free(queue->jobs[idx]);
+    }
+    _zip_free(queue->jobs);
+}
+
+
+static int
+extract_queue_init(zip_t *za, extract_queue_t *queue, zip_uint64_t nentries) {
+    zip_uint64_t idx;
+
+    queue->pool = NULL;
+    queue->jobs = NULL;
+    queue->next = 0;
+    queue->outstanding = 0;
+    queue->max_outstanding = 2 * (zip_uint64_t)za->num_threads;
+
+    if (za->num_threads <= 1 || nentries == 0) {
+        return 0;
+    }
+
+    if (!_zip_reader_init(&queue->reader, za->src)) {
+        /* archive can only be read through its read position */
+        return 0;
+    }
+
+    if (nentries > SIZE_MAX / sizeof(queue->jobs[0]) || (queue->jobs = (extract_job_t **)_zip_malloc(sizeof(queue->jobs[0]) * (size_t)nentries)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    for (idx = 0; idx < nentries; idx++) {
+        queue->jobs[idx] = NULL;
+    }
+
+    if ((queue->pool = _zip_thread_pool_new(za->num_threads, &za->error)) == NULL) {
+        _zip_free(queue->jobs);
+        queue->jobs = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+#endif
@@ -49,6 +49,6 @@ zip_fclose(zip_file_t *zf) {
         ret = zf->error.zip_err;
 
     zip_error_fini(&zf->error);
-    free(zf);
+    _zip_free(zf);
     return ret;
 }
@@ -0,0 +1,73 @@
+/*
+  zip_fdigest.c -- get digest of data read from file
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_fdigest(zip_file_t *zf, zip_uint8_t *digest) {
+    if (zf == NULL || digest == NULL) {
+        return -1;
+    }
+
+    if (!_zip_source_crc_get_digest(zf->src, digest)) {
+        zip_error_set(&zf->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Return layer computing the digest of the data read from open source src, which is taken over and freed on error. */
+zip_source_t *
+_zip_file_digest_source(zip_source_t *src, zip_error_t *error) {
+    zip_source_t *src_digest;
+
+    if ((src_digest = zip_source_crc_create(src, 0, error)) == NULL) {
+        zip_source_free(src);
+        return NULL;
+    }
+    _zip_source_crc_compute_digest(src_digest);
+
+    /* reopen through the new layer, so the digest covers the data from the start */
+    (void)zip_source_close(src);
+    if (zip_source_open(src_digest) < 0) {
+        zip_error_set_from_source(error, src_digest);
+        zip_source_free(src_digest);
+        return NULL;
+    }
+
+    return src_digest;
+}
@@ -41,7 +41,9 @@
 ZIP_EXTERN zip_t *
 zip_fdopen(int fd_orig, int _flags, int *zep) {
     int fd;
+#ifndef HAVE_PREAD
     FILE *fp;
+#endif
     zip_t *za;
     zip_source_t *src;
     struct zip_error error;
@@ -63,19 +65,29 @@ zip_fdopen(int fd_orig, int _flags, int *zep) {
         return NULL;
     }
 
+    zip_error_init(&error);
+#ifdef HAVE_PREAD
+    /* Read with pread(), so the file position shared with fd_orig is not used. */
+    if ((src = _zip_source_file_fd_create(fd, 0, -1, true, &error)) == NULL) {
+        close(fd);
+        _zip_set_open_error(zep, &error, 0);
+        zip_error_fini(&error);
+        return NULL;
+    }
+#else
     if ((fp = fdopen(fd, "rb")) == NULL) {
         close(fd);
         _zip_set_open_error(zep, NULL, ZIP_ER_OPEN);
         return NULL;
     }
 
-    zip_error_init(&error);
     if ((src = zip_source_filep_create(fp, 0, -1, &error)) == NULL) {
         fclose(fp);
         _zip_set_open_error(zep, &error, 0);
         zip_error_fini(&error);
         return NULL;
     }
+#endif
 
     if ((za = zip_open_from_source(src, _flags, &error)) == NULL) {
         zip_source_free(src);
@@ -0,0 +1,104 @@
+/*
+  zip_file_borrow.c -- get pointer to file data without copying
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_file_borrow(zip_file_t *zf, const void **datap, zip_uint64_t *lengthp) {
+    zip_stat_t st;
+    const void *data;
+
+    if (!zf)
+        return -1;
+
+    if (zf->error.zip_err != 0)
+        return -1;
+
+    if (datap == NULL || lengthp == NULL) {
+        zip_error_set(&zf->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (zip_source_stat(zf->src, &st) < 0) {
+        zip_error_set_from_source(&zf->error, zf->src);
+        return -1;
+    }
+
+    if ((st.valid & ZIP_STAT_SIZE) == 0) {
+        zip_error_set(&zf->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+
+    if (zip_source_get_data(zf->src, 0, st.size, &data) < 0) {
+        zip_error_set_from_source(&zf->error, zf->src);
+        return -1;
+    }
+
+    *datap = data;
+    *lengthp = st.size;
+
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_file_borrow_aligned(zip_file_t *zf, zip_uint32_t alignment, const void **datap, zip_uint64_t *lengthp) {
+    const void *data;
+    zip_uint64_t length;
+
+    if (!zf)
+        return -1;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        zip_error_set(&zf->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (zip_file_borrow(zf, &data, &length) < 0) {
+        return -1;
+    }
+
+    /* data of empty files can't be used, so it needn't be aligned */
+    if (length > 0 && ((uintptr_t)data & (alignment - 1)) != 0) {
+        zip_error_set(&zf->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+
+    *datap = data;
+    *lengthp = length;
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+  zip_file_copy.c -- copy file from another archive without recompressing
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+
+/* NOTE: Signed due to -1 on error.  See zip_add.c for more details. */
+
+ZIP_EXTERN zip_int64_t
+zip_file_copy(zip_t *za, zip_t *srcza, zip_uint64_t srcidx, zip_flags_t flags) {
+    zip_dirent_t *sde, *de;
+    zip_extra_field_t *ef;
+    zip_source_t *source;
+    zip_stat_t st;
+    const char *name;
+    zip_int64_t idx;
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (srcza == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    if (ZIP_IS_RDONLY(za)) {
+        zip_error_set(&za->error, ZIP_ER_RDONLY, 0);
+        return -1;
+    }
+
+    if ((name = zip_get_name(srcza, srcidx, flags & ZIP_FL_UNCHANGED)) == NULL || (sde = _zip_get_dirent(srcza, srcidx, flags & ZIP_FL_UNCHANGED, NULL)) == NULL || _zip_read_local_ef(srcza, srcidx) < 0) {
+        _zip_error_copy(&za->error, &srcza->error);
+        return -1;
+    }
+    if (!_zip_dirent_parse_extra_fields(sde, srcza->arena, &za->error)) {
+        return -1;
+    }
+    if ((ef = _zip_ef_clone(sde->extra_fields, &za->error)) == NULL && sde->extra_fields != NULL) {
+        return -1;
+    }
+
+    /* data is copied as stored, still compressed and encrypted */
+    if ((source = _zip_source_zip_new(srcza, srcidx, ZIP_FL_COMPRESSED | ZIP_FL_ENCRYPTED | (flags & ZIP_FL_UNCHANGED), 0, -1, NULL, NULL, &za->error)) == NULL) {
+        _zip_ef_free(ef);
+        return -1;
+    }
+    if (zip_source_stat(source, &st) < 0) {
+        zip_error_set_from_source(&za->error, source);
+        zip_source_free(source);
+        _zip_ef_free(ef);
+        return -1;
+    }
+
+    if ((idx = _zip_file_replace(za, ZIP_UINT64_MAX, name, source, (flags & ZIP_FL_OVERWRITE) | ZIP_FL_ENC_UTF_8)) < 0) {
+        zip_source_free(source);
+        _zip_ef_free(ef);
+        return -1;
+    }
+
+    if (_zip_file_extra_field_prepare_for_change(za, (zip_uint64_t)idx) < 0) {
+        _zip_ef_free(ef);
+        zip_delete(za, (zip_uint64_t)idx);
+        return -1;
+    }
+    de = za->entry[idx].changes;
+
+    _zip_ef_free(de->extra_fields);
+    de->extra_fields = ef;
+    de->changed |= ZIP_DIRENT_EXTRA_FIELD;
+
+    /* keep data as it is, see add_data_pipeline */
+    de->comp_method = (zip_int32_t)st.comp_method;
+    de->changed |= ZIP_DIRENT_COMP_METHOD;
+    de->encryption_method = st.encryption_method;
+    de->changed |= ZIP_DIRENT_ENCRYPTION_METHOD;
+    if (st.encryption_method == ZIP_EM_TRAD_PKWARE) {
+        /* determines how the password is verified */
+        de->bitflags = (zip_uint16_t)((de->bitflags & ~ZIP_GPBF_DATA_DESCRIPTOR) | (sde->bitflags & ZIP_GPBF_DATA_DESCRIPTOR));
+    }
+
+    if (sde->comment != NULL && !ZIP_WANT_TORRENTZIP(za)) {
+        if (zip_file_set_comment(za, (zip_uint64_t)idx, (const char *)sde->comment->raw, sde->comment->length, ZIP_FL_ENC_GUESS) < 0) {
+            zip_delete(za, (zip_uint64_t)idx);
+            return -1;
+        }
+    }
+
+    return idx;
+}
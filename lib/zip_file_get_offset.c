@@ -40,37 +40,25 @@
 
 /* _zip_file_get_offset(za, ze):
    Returns the offset of the file data for entry ze.
+   The size of the local header is cached in the entry, so it is only read once.
 
    On error, fills in za->error and returns 0.
 */
 
 zip_uint64_t
 _zip_file_get_offset(const zip_t *za, zip_uint64_t idx, zip_error_t *error) {
-    zip_uint64_t offset;
-    zip_int32_t size;
+    zip_dirent_t *de = za->entry[idx].orig;
 
-    if (za->entry[idx].orig == NULL) {
+    if (de == NULL) {
         zip_error_set(error, ZIP_ER_INTERNAL, 0);
         return 0;
     }
 
-    offset = za->entry[idx].orig->offset;
-
-    if (zip_source_seek(za->src, (zip_int64_t)offset, SEEK_SET) < 0) {
-        zip_error_set_from_source(error, za->src);
-        return 0;
-    }
-
-    /* TODO: cache? */
-    if ((size = _zip_dirent_size(za->src, ZIP_EF_LOCAL, error)) < 0)
-        return 0;
-
-    if (offset + (zip_uint32_t)size > ZIP_INT64_MAX) {
-        zip_error_set(error, ZIP_ER_SEEK, EFBIG);
+    if (!_zip_dirent_read_local_header(de, za->src, za->arena, false, error)) {
         return 0;
     }
 
-    return offset + (zip_uint32_t)size;
+    return de->offset + de->local_header_size;
 }
 
 zip_uint64_t
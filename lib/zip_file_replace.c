@@ -74,6 +74,13 @@ _zip_file_replace(zip_t *za, zip_uint64_t idx, const char *name, zip_source_t *s
         }
         idx = (zip_uint64_t)i;
     }
+    else if (!_zip_cdir_index_load(za, idx, &za->error)) {
+        return -1;
+    }
+
+    if (!_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
 
     if (name && _zip_set_name(za, idx, name, flags) != 0) {
         if (za->nentry != za_nentry_prev) {
@@ -85,6 +92,10 @@ _zip_file_replace(zip_t *za, zip_uint64_t idx, const char *name, zip_source_t *s
 
     /* does not change any name related data, so we can do it here;
      * needed for a double add of the same file name */
+    if (za->entry[idx].deleted) {
+        /* entry is listed again */
+        _zip_name_index_free(za);
+    }
     _zip_unchange_data(za->entry + idx);
 
     if (za->entry[idx].orig != NULL && (za->entry[idx].changes == NULL || (za->entry[idx].changes->changed & ZIP_DIRENT_COMP_METHOD) == 0)) {
@@ -60,6 +60,10 @@ zip_file_set_comment(zip_t *za, zip_uint64_t idx, const char *comment, zip_uint1
         return -1;
     }
 
+    if (!_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
+
     if (len > 0) {
         if ((cstr = _zip_string_new((const zip_uint8_t *)comment, len, flags, &za->error)) == NULL)
             return -1;
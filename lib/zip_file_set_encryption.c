@@ -61,6 +61,10 @@ zip_file_set_encryption(zip_t *za, zip_uint64_t idx, zip_uint16_t method, const
         return -1;
     }
 
+    if (!_zip_cdir_index_load(za, idx, &za->error) || !_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
+
     e = za->entry + idx;
 
     old_method = (e->orig == NULL ? ZIP_EM_NONE : e->orig->encryption_method);
@@ -69,7 +73,7 @@ zip_file_set_encryption(zip_t *za, zip_uint64_t idx, zip_uint16_t method, const
         if (e->changes) {
             if (e->changes->changed & ZIP_DIRENT_PASSWORD) {
                 _zip_crypto_clear(e->changes->password, strlen(e->changes->password));
-                free(e->changes->password);
+                _zip_free(e->changes->password);
                 e->changes->password = (e->orig == NULL ? NULL : e->orig->password);
             }
             e->changes->changed &= ~(ZIP_DIRENT_ENCRYPTION_METHOD | ZIP_DIRENT_PASSWORD);
@@ -83,7 +87,7 @@ zip_file_set_encryption(zip_t *za, zip_uint64_t idx, zip_uint16_t method, const
         char *our_password = NULL;
 
         if (password) {
-            if ((our_password = strdup(password)) == NULL) {
+            if ((our_password = _zip_strdup(password)) == NULL) {
                 zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
                 return -1;
             }
@@ -94,7 +98,7 @@ zip_file_set_encryption(zip_t *za, zip_uint64_t idx, zip_uint16_t method, const
                 if (our_password) {
                     _zip_crypto_clear(our_password, strlen(our_password));
                 }
-                free(our_password);
+                _zip_free(our_password);
                 zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
                 return -1;
             }
@@ -109,7 +113,7 @@ zip_file_set_encryption(zip_t *za, zip_uint64_t idx, zip_uint16_t method, const
         else {
             if (e->changes->changed & ZIP_DIRENT_PASSWORD) {
                 _zip_crypto_clear(e->changes->password, strlen(e->changes->password));
-                free(e->changes->password);
+                _zip_free(e->changes->password);
                 e->changes->password = e->orig ? e->orig->password : NULL;
                 e->changes->changed &= ~ZIP_DIRENT_PASSWORD;
             }
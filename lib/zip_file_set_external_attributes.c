@@ -52,6 +52,10 @@ zip_file_set_external_attributes(zip_t *za, zip_uint64_t idx, zip_flags_t flags,
         return -1;
     }
 
+    if (!_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
+
     e = za->entry + idx;
 
     unchanged_opsys = (e->orig ? (zip_uint8_t)(e->orig->version_madeby >> 8) : (zip_uint8_t)ZIP_OPSYS_DEFAULT);
@@ -33,45 +33,73 @@
 
 #include "zipint.h"
 
+static zip_dirent_t *changes_for_mtime(zip_t *za, zip_uint64_t idx);
+
+
 ZIP_EXTERN int
 zip_file_set_dostime(zip_t *za, zip_uint64_t idx, zip_uint16_t dtime, zip_uint16_t ddate, zip_flags_t flags) {
-    time_t mtime;
-    mtime = _zip_d2u_time(dtime, ddate);
-    return zip_file_set_mtime(za, idx, mtime, flags);
+    zip_dirent_t *de;
+
+    if ((de = changes_for_mtime(za, idx)) == NULL) {
+        return -1;
+    }
+
+    /* kept as is, no need to convert back and forth */
+    _zip_dirent_set_dos_time(de, dtime, ddate);
+    de->changed |= ZIP_DIRENT_LAST_MOD;
+
+    return 0;
 }
 
 ZIP_EXTERN int
 zip_file_set_mtime(zip_t *za, zip_uint64_t idx, time_t mtime, zip_flags_t flags) {
+    zip_dirent_t *de;
+
+    if ((de = changes_for_mtime(za, idx)) == NULL) {
+        return -1;
+    }
+
+    _zip_dirent_set_last_mod(de, mtime);
+    de->changed |= ZIP_DIRENT_LAST_MOD;
+
+    return 0;
+}
+
+
+/* Get changes of entry idx, whose modification time is to be changed. */
+static zip_dirent_t *
+changes_for_mtime(zip_t *za, zip_uint64_t idx) {
     zip_entry_t *e;
 
     if (_zip_get_dirent(za, idx, 0, NULL) == NULL)
-        return -1;
+        return NULL;
 
     if (ZIP_IS_RDONLY(za)) {
         zip_error_set(&za->error, ZIP_ER_RDONLY, 0);
-        return -1;
+        return NULL;
     }
     if (ZIP_WANT_TORRENTZIP(za)) {
         zip_error_set(&za->error, ZIP_ER_NOT_ALLOWED, 0);
-        return -1;
+        return NULL;
     }
 
     e = za->entry + idx;
 
     if (e->orig != NULL && e->orig->encryption_method == ZIP_EM_TRAD_PKWARE && !ZIP_ENTRY_CHANGED(e, ZIP_DIRENT_ENCRYPTION_METHOD) && !ZIP_ENTRY_DATA_CHANGED(e)) {
         zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
-        return -1;
+        return NULL;
+    }
+
+    if (!_zip_entry_log_change(za, idx)) {
+        return NULL;
     }
 
     if (e->changes == NULL) {
         if ((e->changes = _zip_dirent_clone(e->orig)) == NULL) {
             zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
-            return -1;
+            return NULL;
         }
     }
 
-    e->changes->last_mod = mtime;
-    e->changes->changed |= ZIP_DIRENT_LAST_MOD;
-
-    return 0;
+    return e->changes;
 }
@@ -37,24 +37,53 @@
 
 #include "zipint.h"
 
+/* at most this much data of the next entry is prefetched, so prefetching doesn't push data out of the cache before it's read */
+#define PREFETCH_MAX_LENGTH (8 * 1024 * 1024)
+
 static zip_file_t *_zip_file_new(zip_t *za);
+static zip_file_t *fopen_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, const char *password);
 
 
 ZIP_EXTERN zip_file_t *
 zip_fopen_index_encrypted(zip_t *za, zip_uint64_t index, zip_flags_t flags, const char *password) {
     zip_file_t *zf;
+
+    ZIP_LOCK(za);
+    zf = fopen_index(za, index, flags, password);
+    ZIP_UNLOCK(za);
+
+    return zf;
+}
+
+
+static zip_file_t *
+fopen_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, const char *password) {
+    zip_file_t *zf;
     zip_source_t *src;
 
     if (password != NULL && password[0] == '\0') {
         password = NULL;
     }
     
-    if ((src = zip_source_zip_file_create(za, index, flags, 0, -1, password, &za->error)) == NULL)
-        return NULL;
+    _zip_access_profile_note(za, index);
 
-    if (zip_source_open(src) < 0) {
-        zip_error_set_from_source(&za->error, src);
-        zip_source_free(src);
+    if (!_zip_entry_cache_open(za, index, flags, &src)) {
+        return NULL;
+    }
+    if (src == NULL && !_zip_shared_entry_open(za, index, flags, &src)) {
+        return NULL;
+    }
+    if (src == NULL) {
+        if ((src = zip_source_zip_file_create(za, index, flags, 0, -1, password, &za->error)) == NULL)
+            return NULL;
+
+        if (zip_source_open(src) < 0) {
+            zip_error_set_from_source(&za->error, src);
+            zip_source_free(src);
+            return NULL;
+        }
+    }
+    if ((flags & ZIP_FL_DIGEST) && (src = _zip_file_digest_source(src, &za->error)) == NULL) {
         return NULL;
     }
 
@@ -65,6 +94,9 @@ zip_fopen_index_encrypted(zip_t *za, zip_uint64_t index, zip_flags_t flags, cons
 
     zf->src = src;
 
+    /* entries are usually read in order, let the operating system read the next one while this one is used */
+    _zip_file_prefetch(za, index + 1);
+
     return zf;
 }
 
@@ -73,13 +105,33 @@ static zip_file_t *
 _zip_file_new(zip_t *za) {
     zip_file_t *zf;
 
-    if ((zf = (zip_file_t *)malloc(sizeof(struct zip_file))) == NULL) {
+    if ((zf = (zip_file_t *)_zip_malloc(sizeof(struct zip_file))) == NULL) {
         zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
     zip_error_init(&zf->error);
     zf->src = NULL;
+    zf->za = za->stats != NULL ? za : NULL;
 
     return zf;
 }
+
+
+void
+_zip_file_prefetch(zip_t *za, zip_uint64_t index) {
+    zip_entry_t *entry;
+    zip_dirent_t *de;
+
+    if (index >= za->nentry) {
+        return;
+    }
+
+    entry = za->entry + index;
+    /* don't read central directory records not used yet */
+    if ((de = entry->orig) == NULL || entry->deleted || entry->source != NULL) {
+        return;
+    }
+
+    _zip_source_file_prefetch(za->src, de->offset, LENTRYSIZE + _zip_string_length(de->filename) + ZIP_MIN(de->comp_size, PREFETCH_MAX_LENGTH));
+}
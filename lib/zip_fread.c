@@ -37,11 +37,16 @@
 
 ZIP_EXTERN zip_int64_t
 zip_fread(zip_file_t *zf, void *outbuf, zip_uint64_t toread) {
+    zip_uint64_t start;
     zip_int64_t n;
 
     if (!zf)
         return -1;
 
+    if (zf->error.zip_err == ZIP_ER_AGAIN) {
+        /* no data was available on last call, try again */
+        _zip_error_clear(&zf->error);
+    }
     if (zf->error.zip_err != 0)
         return -1;
 
@@ -54,10 +59,17 @@ zip_fread(zip_file_t *zf, void *outbuf, zip_uint64_t toread) {
         return 0;
     }
 
+    /* za is only set if it collects statistics */
+    start = zf->za != NULL ? _zip_stats_time() : 0;
+
     if ((n = zip_source_read(zf->src, outbuf, toread)) < 0) {
         zip_error_set_from_source(&zf->error, zf->src);
         return -1;
     }
 
+    if (zf->za != NULL) {
+        _zip_stats_add(zf->za, ZIP_PHASE_READ, start, 0, (zip_uint64_t)n);
+    }
+
     return n;
 }
@@ -0,0 +1,112 @@
+/*
+  zip_freopen_index.c -- reuse file handle for another entry
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+static int freopen_index(zip_t *za, zip_file_t *zf, zip_uint64_t index, zip_flags_t flags);
+
+
+ZIP_EXTERN int
+zip_freopen_index(zip_t *za, zip_file_t *zf, zip_uint64_t index, zip_flags_t flags) {
+    int ret;
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (zf == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    ret = freopen_index(za, zf, index, flags);
+    ZIP_UNLOCK(za);
+
+    return ret;
+}
+
+
+/* Cached entries are read from the entry cache. Otherwise, if the sources of zf can read the new entry, they are kept, otherwise they are replaced like in zip_fopen_index(). */
+static int
+freopen_index(zip_t *za, zip_file_t *zf, zip_uint64_t index, zip_flags_t flags) {
+    zip_source_t *src;
+
+    zip_error_fini(&zf->error);
+    zip_error_init(&zf->error);
+    zf->za = za->stats != NULL ? za : NULL;
+
+    _zip_access_profile_note(za, index);
+
+    if (!_zip_entry_cache_open(za, index, flags, &src)) {
+        _zip_error_copy(&zf->error, &za->error);
+        zip_source_free(zf->src);
+        zf->src = NULL;
+        return -1;
+    }
+    if (src == NULL && zf->src != NULL) {
+        (void)zip_source_close(zf->src);
+        if (_zip_source_zip_reuse(zf->src, za, index, flags) && zip_source_open(zf->src) == 0) {
+            src = zf->src;
+        }
+        else {
+            zip_source_free(zf->src);
+        }
+        zf->src = NULL;
+    }
+
+    if (src == NULL) {
+        if ((src = zip_source_zip_file_create(za, index, flags, 0, -1, NULL, &za->error)) == NULL) {
+            _zip_error_copy(&zf->error, &za->error);
+            return -1;
+        }
+        if (zip_source_open(src) < 0) {
+            zip_error_set_from_source(&za->error, src);
+            _zip_error_copy(&zf->error, &za->error);
+            zip_source_free(src);
+            return -1;
+        }
+    }
+    if ((flags & ZIP_FL_DIGEST) && (src = _zip_file_digest_source(src, &za->error)) == NULL) {
+        _zip_error_copy(&zf->error, &za->error);
+        zip_source_free(zf->src);
+        zf->src = NULL;
+        return -1;
+    }
+
+    zip_source_free(zf->src);
+    zf->src = src;
+    _zip_file_prefetch(za, index + 1);
+
+    return 0;
+}
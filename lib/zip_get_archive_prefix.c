@@ -0,0 +1,93 @@
+/*
+  zip_get_archive_prefix.c -- get archive prefix
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+
+ZIP_EXTERN const zip_uint8_t *
+zip_get_archive_prefix(zip_t *za, zip_uint64_t *lengthp, zip_flags_t flags) {
+    zip_uint64_t length;
+
+    if (za->prefix_changed && (flags & ZIP_FL_UNCHANGED) == 0) {
+        if (lengthp) {
+            *lengthp = za->prefix_changes_length;
+        }
+        return za->prefix_changes != NULL ? za->prefix_changes : (const zip_uint8_t *)"";
+    }
+
+    if (!_zip_archive_prefix_length(za, &length, &za->error)) {
+        return NULL;
+    }
+
+    if (length > 0 && za->prefix_orig == NULL) {
+        if (length > SIZE_MAX) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return NULL;
+        }
+        if (zip_source_seek(za->src, 0, SEEK_SET) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            return NULL;
+        }
+        if ((za->prefix_orig = _zip_read_data(NULL, za->src, (size_t)length, false, &za->error)) == NULL) {
+            return NULL;
+        }
+    }
+
+    if (lengthp) {
+        *lengthp = length;
+    }
+
+    return za->prefix_orig != NULL ? za->prefix_orig : (const zip_uint8_t *)"";
+}
+
+
+/* Length of data before the first entry of the archive as it was read. */
+bool
+_zip_archive_prefix_length(zip_t *za, zip_uint64_t *lengthp, zip_error_t *error) {
+    zip_uint64_t i, length;
+
+    if (!_zip_cdir_index_load_all(za, error)) {
+        return false;
+    }
+
+    length = za->cdir_offset_orig;
+    for (i = 0; i < za->nentry; i++) {
+        if (za->entry[i].orig != NULL && za->entry[i].orig->offset < length) {
+            length = za->entry[i].orig->offset;
+        }
+    }
+
+    *lengthp = length;
+    return true;
+}
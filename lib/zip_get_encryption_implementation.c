@@ -37,15 +37,29 @@
 
 zip_encryption_implementation
 _zip_get_encryption_implementation(zip_uint16_t em, int operation) {
+#ifdef LIBZIP_READ_ONLY
+    if (operation == ZIP_CODEC_ENCODE) {
+        return NULL;
+    }
+#endif
+
     switch (em) {
     case ZIP_EM_TRAD_PKWARE:
+#ifdef LIBZIP_READ_ONLY
+        return zip_source_pkware_decode;
+#else
         return operation == ZIP_CODEC_DECODE ? zip_source_pkware_decode : zip_source_pkware_encode;
+#endif
 
 #if defined(HAVE_CRYPTO)
     case ZIP_EM_AES_128:
     case ZIP_EM_AES_192:
     case ZIP_EM_AES_256:
+#ifdef LIBZIP_READ_ONLY
+        return zip_source_winzip_aes_decode;
+#else
         return operation == ZIP_CODEC_DECODE ? zip_source_winzip_aes_decode : zip_source_winzip_aes_encode;
+#endif
 #endif
 
     default:
@@ -39,7 +39,13 @@
 
 ZIP_EXTERN const char *
 zip_get_name(zip_t *za, zip_uint64_t idx, zip_flags_t flags) {
-    return _zip_get_name(za, idx, flags, &za->error);
+    const char *name;
+
+    ZIP_LOCK(za);
+    name = _zip_get_name(za, idx, flags, &za->error);
+    ZIP_UNLOCK(za);
+
+    return name;
 }
 
 
@@ -44,7 +44,7 @@ zip_get_num_entries(zip_t *za, zip_flags_t flags) {
 
     if (flags & ZIP_FL_UNCHANGED) {
         n = za->nentry;
-        while (n > 0 && za->entry[n - 1].orig == NULL)
+        while (n > 0 && za->entry[n - 1].orig == NULL && !_zip_cdir_index_pending(za, n - 1))
             --n;
         return (zip_int64_t)n;
     }
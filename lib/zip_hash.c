@@ -35,9 +35,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* parameter for the string hash function */
-#define HASH_MULTIPLIER 33
-#define HASH_START 5381
+/* Open addressing hash table with linear probing and Robin Hood insertion:
+   entries are stored in the table itself, and an entry is moved out of
+   the way if it is closer to its home slot than the one being inserted.
+   This keeps probe sequences short, so lookups only touch a few
+   consecutive slots. Deletion shifts the following entries back. */
+
+/* hint to the CPU that the memory at p will be read soon */
+#if defined(__GNUC__) || defined(__clang__)
+#define HASH_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define HASH_PREFETCH(p) ((void)(p))
+#endif
 
 /* hash table's fill ratio is kept between these by doubling/halfing its size as necessary */
 #define HASH_MAX_FILL .75
@@ -48,85 +57,375 @@
 #define HASH_MAX_SIZE 0x80000000ul
 
 struct zip_hash_entry {
-    const zip_uint8_t *name;
+    const zip_uint8_t *name; /* NULL for empty slot */
     zip_int64_t orig_index;
     zip_int64_t current_index;
-    struct zip_hash_entry *next;
     zip_uint32_t hash_value;
 };
 typedef struct zip_hash_entry zip_hash_entry_t;
 
+/* Secondary indices for ZIP_FL_NOCASE, ZIP_FL_NODIR, and ZIP_FL_NORMALIZE lookups are
+   built from the main table on first use and discarded when it changes. Keys point into
+   the names of the main table, except for normalized names that differ from them; for
+   each key, the lowest index with that key is kept. */
+
+#define INDEX_NOCASE 1
+#define INDEX_NODIR 2
+#define INDEX_UNCHANGED 4
+#define INDEX_NORMALIZE 8
+#define INDEX_COUNT 16
+
+struct zip_hash_index_entry {
+    const zip_uint8_t *key; /* NULL for empty slot */
+    zip_uint64_t index;
+    zip_uint32_t hash_value;
+    bool key_allocated; /* key is a normalized copy of the name, owned by the index */
+};
+typedef struct zip_hash_index_entry zip_hash_index_entry_t;
+
+struct zip_hash_index {
+    zip_uint32_t table_size; /* power of 2 */
+    zip_hash_index_entry_t *table;
+};
+typedef struct zip_hash_index zip_hash_index_t;
+
 struct zip_hash {
-    zip_uint32_t table_size;
+    zip_uint32_t table_size; /* 0 or power of 2 */
     zip_uint64_t nentries;
-    zip_hash_entry_t **table;
+    zip_hash_entry_t *table;
+    zip_hash_index_t *indices[INDEX_COUNT]; /* indexed by INDEX_* flags */
 };
 
 
-/* free list of entries */
-static void
-free_list(zip_hash_entry_t *entry) {
-    while (entry != NULL) {
-        zip_hash_entry_t *next = entry->next;
-        free(entry);
-        entry = next;
-    }
-}
+static void hash_index_free(zip_hash_index_t *index);
+static zip_uint32_t size_for_capacity(zip_uint64_t capacity);
 
 
-/* compute hash of string, full 32 bit value */
+/* compute hash of string, full 32 bit value: FNV-1a with final avalanche */
 static zip_uint32_t
-hash_string(const zip_uint8_t *name) {
-    zip_uint64_t value = HASH_START;
+hash_string_fold(const zip_uint8_t *name, bool nocase) {
+    zip_uint64_t value = 0xcbf29ce484222325ull;
 
     if (name == NULL) {
         return 0;
     }
 
     while (*name != 0) {
-        value = (zip_uint64_t)(((value * HASH_MULTIPLIER) + (zip_uint8_t)*name) % 0x100000000ul);
+        zip_uint8_t c = *name;
+
+        if (nocase && c >= 'A' && c <= 'Z') {
+            c = (zip_uint8_t)(c - 'A' + 'a');
+        }
+        value ^= c;
+        value *= 0x100000001b3ull;
         name++;
     }
 
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+
     return (zip_uint32_t)value;
 }
 
 
-/* resize hash table; new_size must be a power of 2, can be larger or smaller than current size */
+static zip_uint32_t
+hash_string(const zip_uint8_t *name) {
+    return hash_string_fold(name, false);
+}
+
+
+/* ASCII case insensitive comparison, like strcasecmp in the C locale */
 static bool
-hash_resize(zip_hash_t *hash, zip_uint32_t new_size, zip_error_t *error) {
-    zip_hash_entry_t **new_table;
+equal_nocase(const zip_uint8_t *a, const zip_uint8_t *b) {
+    for (;; a++, b++) {
+        zip_uint8_t ca = *a, cb = *b;
 
-    if (new_size == hash->table_size) {
-        return true;
+        if (ca >= 'A' && ca <= 'Z') {
+            ca = (zip_uint8_t)(ca - 'A' + 'a');
+        }
+        if (cb >= 'A' && cb <= 'Z') {
+            cb = (zip_uint8_t)(cb - 'A' + 'a');
+        }
+        if (ca != cb) {
+            return false;
+        }
+        if (ca == 0) {
+            return true;
+        }
+    }
+}
+
+
+static bool
+index_key_equal(const zip_uint8_t *a, const zip_uint8_t *b, int kind) {
+    if (kind & INDEX_NOCASE) {
+        return equal_nocase(a, b);
     }
+    return strcmp((const char *)a, (const char *)b) == 0;
+}
+
 
-    if ((new_table = (zip_hash_entry_t **)calloc(new_size, sizeof(zip_hash_entry_t *))) == NULL) {
+/* build secondary index of kind from main table */
+static zip_hash_index_t *
+hash_index_build(const zip_hash_t *hash, int kind, zip_error_t *error) {
+    zip_hash_index_t *index;
+    zip_uint32_t i, mask;
+
+    if ((index = (zip_hash_index_t *)_zip_malloc(sizeof(*index))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    index->table_size = size_for_capacity(hash->nentries);
+    if ((index->table = (zip_hash_index_entry_t *)_zip_calloc(index->table_size, sizeof(index->table[0]))) == NULL) {
+        _zip_free(index);
         zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    mask = index->table_size - 1;
+
+    for (i = 0; i < hash->table_size; i++) {
+        const zip_hash_entry_t *entry = hash->table + i;
+        const zip_uint8_t *key;
+        zip_int64_t value;
+        zip_uint32_t hash_value, slot;
+        bool key_allocated;
+
+        if (entry->name == NULL) {
+            continue;
+        }
+        value = (kind & INDEX_UNCHANGED) ? entry->orig_index : entry->current_index;
+        if (value == -1) {
+            continue;
+        }
+
+        key = entry->name;
+        if (kind & INDEX_NODIR) {
+            const zip_uint8_t *p = (const zip_uint8_t *)strrchr((const char *)key, '/');
+            if (p != NULL) {
+                key = p + 1;
+            }
+        }
+        key_allocated = false;
+        if (kind & INDEX_NORMALIZE) {
+            const zip_uint8_t *normalized;
+
+            if ((normalized = _zip_normalize_name(key, error)) == NULL) {
+                hash_index_free(index);
+                return NULL;
+            }
+            key_allocated = normalized != key;
+            key = normalized;
+        }
+
+        hash_value = hash_string_fold(key, (kind & INDEX_NOCASE) != 0);
+        for (slot = hash_value & mask;; slot = (slot + 1) & mask) {
+            zip_hash_index_entry_t *index_entry = index->table + slot;
+
+            if (index_entry->key == NULL) {
+                index_entry->key = key;
+                index_entry->index = (zip_uint64_t)value;
+                index_entry->hash_value = hash_value;
+                index_entry->key_allocated = key_allocated;
+                break;
+            }
+            if (index_entry->hash_value == hash_value && index_key_equal(key, index_entry->key, kind)) {
+                if ((zip_uint64_t)value < index_entry->index) {
+                    index_entry->index = (zip_uint64_t)value;
+                }
+                if (key_allocated) {
+                    _zip_free((void *)key);
+                }
+                break;
+            }
+        }
+    }
+
+    return index;
+}
+
+
+static void
+hash_index_free(zip_hash_index_t *index) {
+    zip_uint32_t i;
+
+    for (i = 0; i < index->table_size; i++) {
+        if (index->table[i].key_allocated) {
+            _zip_free((void *)index->table[i].key);
+        }
+    }
+    _zip_free(index->table);
+    _zip_free(index);
+}
+
+
+/* discard secondary indices, called whenever main table changes */
+static void
+hash_indices_free(zip_hash_t *hash) {
+    int i;
+
+    for (i = 0; i < INDEX_COUNT; i++) {
+        if (hash->indices[i] != NULL) {
+            hash_index_free(hash->indices[i]);
+            hash->indices[i] = NULL;
+        }
+    }
+}
+
+
+/* secondary index of kind, building it if necessary */
+static zip_hash_index_t *
+hash_index_get(zip_hash_t *hash, int kind, zip_error_t *error) {
+    if (hash->indices[kind] == NULL) {
+        hash->indices[kind] = hash_index_build(hash, kind, error);
+    }
+    return hash->indices[kind];
+}
+
+
+/* look up name with hash_value in secondary index of kind, building it if necessary */
+static zip_int64_t
+hash_index_lookup(zip_hash_t *hash, const zip_uint8_t *name, zip_uint32_t hash_value, int kind, zip_error_t *error) {
+    zip_hash_index_t *index;
+    zip_uint32_t mask, slot;
+
+    if (hash->nentries == 0) {
+        zip_error_set(error, ZIP_ER_NOENT, 0);
+        return -1;
+    }
+
+    if ((index = hash_index_get(hash, kind, error)) == NULL) {
+        return -1;
+    }
+
+    mask = index->table_size - 1;
+    for (slot = hash_value & mask; index->table[slot].key != NULL; slot = (slot + 1) & mask) {
+        if (index->table[slot].hash_value == hash_value && index_key_equal(name, index->table[slot].key, kind)) {
+            return (zip_int64_t)index->table[slot].index;
+        }
+    }
+
+    zip_error_set(error, ZIP_ER_NOENT, 0);
+    return -1;
+}
+
+
+/* distance of entry in slot from the slot its hash value maps to */
+static zip_uint32_t
+probe_distance(const zip_hash_t *hash, const zip_hash_entry_t *entry, zip_uint32_t slot) {
+    return (slot - (entry->hash_value & (hash->table_size - 1))) & (hash->table_size - 1);
+}
+
+
+/* find slot of name, or return false if not in hash */
+static bool
+hash_find(const zip_hash_t *hash, const zip_uint8_t *name, zip_uint32_t hash_value, zip_uint32_t *slotp) {
+    zip_uint32_t mask, slot, distance;
+
+    if (hash->nentries == 0) {
         return false;
     }
 
-    if (hash->nentries > 0) {
-        zip_uint32_t i;
+    mask = hash->table_size - 1;
+    for (slot = hash_value & mask, distance = 0;; slot = (slot + 1) & mask, distance++) {
+        zip_hash_entry_t *entry = hash->table + slot;
 
-        for (i = 0; i < hash->table_size; i++) {
-            zip_hash_entry_t *entry = hash->table[i];
-            while (entry) {
-                zip_hash_entry_t *next = entry->next;
+        /* entries are ordered by distance, so name would have displaced one that is closer to home */
+        if (entry->name == NULL || probe_distance(hash, entry, slot) < distance) {
+            return false;
+        }
+        if (entry->hash_value == hash_value && strcmp((const char *)name, (const char *)entry->name) == 0) {
+            *slotp = slot;
+            return true;
+        }
+    }
+}
 
-                zip_uint32_t new_index = entry->hash_value % new_size;
 
-                entry->next = new_table[new_index];
-                new_table[new_index] = entry;
+/* insert entry not yet in hash, return its slot; table must have a free slot */
+static zip_uint32_t
+hash_insert(zip_hash_t *hash, zip_hash_entry_t entry) {
+    zip_uint32_t mask, slot, distance, inserted_slot;
+    bool inserted = false;
+
+    mask = hash->table_size - 1;
+    inserted_slot = 0;
+    for (slot = entry.hash_value & mask, distance = 0;; slot = (slot + 1) & mask, distance++) {
+        zip_hash_entry_t *current = hash->table + slot;
+        zip_uint32_t current_distance;
+
+        if (current->name == NULL) {
+            *current = entry;
+            return inserted ? inserted_slot : slot;
+        }
 
-                entry = next;
+        if ((current_distance = probe_distance(hash, current, slot)) < distance) {
+            /* continue with displaced entry */
+            zip_hash_entry_t tmp = *current;
+            *current = entry;
+            entry = tmp;
+            distance = current_distance;
+            if (!inserted) {
+                inserted = true;
+                inserted_slot = slot;
             }
         }
     }
+}
+
+
+/* remove entry in slot, shifting following entries back to close the gap */
+static void
+hash_remove(zip_hash_t *hash, zip_uint32_t slot) {
+    zip_uint32_t mask = hash->table_size - 1;
+
+    for (;;) {
+        zip_uint32_t next = (slot + 1) & mask;
+
+        if (hash->table[next].name == NULL || probe_distance(hash, hash->table + next, next) == 0) {
+            break;
+        }
+        hash->table[slot] = hash->table[next];
+        slot = next;
+    }
+    hash->table[slot].name = NULL;
+}
+
+
+/* resize hash table; new_size must be a power of 2, can be larger or smaller than current size */
+static bool
+hash_rebuild(zip_hash_t *hash, zip_uint32_t new_size, zip_error_t *error) {
+    zip_hash_entry_t *old_table;
+    zip_uint32_t i, old_size;
 
-    free(hash->table);
-    hash->table = new_table;
+    if (new_size == hash->table_size) {
+        return true;
+    }
+
+    hash_indices_free(hash);
+
+    old_table = hash->table;
+    old_size = hash->table_size;
+
+    if ((hash->table = (zip_hash_entry_t *)_zip_calloc(new_size, sizeof(zip_hash_entry_t))) == NULL) {
+        hash->table = old_table;
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
     hash->table_size = new_size;
+    hash->nentries = 0;
+
+    for (i = 0; i < old_size; i++) {
+        zip_hash_entry_t entry = old_table[i];
+
+        if (entry.name == NULL) {
+            continue;
+        }
+        (void)hash_insert(hash, entry);
+        hash->nentries++;
+    }
+
+    _zip_free(old_table);
 
     return true;
 }
@@ -147,6 +446,9 @@ size_for_capacity(zip_uint64_t capacity) {
     if (v > HASH_MAX_SIZE) {
         return HASH_MAX_SIZE;
     }
+    if (v < HASH_MIN_SIZE) {
+        return HASH_MIN_SIZE;
+    }
 
     /* From Bit Twiddling Hacks by Sean Eron Anderson <seander@cs.stanford.edu>
      (http://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2). */
@@ -167,7 +469,7 @@ zip_hash_t *
 _zip_hash_new(zip_error_t *error) {
     zip_hash_t *hash;
 
-    if ((hash = (zip_hash_t *)malloc(sizeof(zip_hash_t))) == NULL) {
+    if ((hash = (zip_hash_t *)_zip_malloc(sizeof(zip_hash_t))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -175,6 +477,7 @@ _zip_hash_new(zip_error_t *error) {
     hash->table_size = 0;
     hash->nentries = 0;
     hash->table = NULL;
+    memset(hash->indices, 0, sizeof(hash->indices));
 
     return hash;
 }
@@ -182,28 +485,20 @@ _zip_hash_new(zip_error_t *error) {
 
 void
 _zip_hash_free(zip_hash_t *hash) {
-    zip_uint32_t i;
-
     if (hash == NULL) {
         return;
     }
 
-    if (hash->table != NULL) {
-        for (i = 0; i < hash->table_size; i++) {
-            if (hash->table[i] != NULL) {
-                free_list(hash->table[i]);
-            }
-        }
-        free(hash->table);
-    }
-    free(hash);
+    hash_indices_free(hash);
+    _zip_free(hash->table);
+    _zip_free(hash);
 }
 
 
 /* insert into hash, return error on existence or memory issues */
 bool
 _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip_flags_t flags, zip_error_t *error) {
-    zip_uint32_t hash_value, table_index;
+    zip_uint32_t hash_value, slot;
     zip_hash_entry_t *entry;
 
     if (hash == NULL || name == NULL || index > ZIP_INT64_MAX) {
@@ -211,49 +506,44 @@ _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip
         return false;
     }
 
-    if (hash->table_size == 0) {
-        if (!hash_resize(hash, HASH_MIN_SIZE, error)) {
+    hash_value = hash_string(name);
+
+    if (hash_find(hash, name, hash_value, &slot)) {
+        entry = hash->table + slot;
+        if (((flags & ZIP_FL_UNCHANGED) && entry->orig_index != -1) || entry->current_index != -1) {
+            zip_error_set(error, ZIP_ER_EXISTS, 0);
             return false;
         }
     }
-
-    hash_value = hash_string(name);
-    table_index = hash_value % hash->table_size;
-
-    for (entry = hash->table[table_index]; entry != NULL; entry = entry->next) {
-        if (entry->hash_value == hash_value && strcmp((const char *)name, (const char *)entry->name) == 0) {
-            if (((flags & ZIP_FL_UNCHANGED) && entry->orig_index != -1) || entry->current_index != -1) {
-                zip_error_set(error, ZIP_ER_EXISTS, 0);
-                return false;
+    else {
+        zip_hash_entry_t new_entry;
+
+        if (hash->nentries + 1 > hash->table_size * HASH_MAX_FILL) {
+            if (hash->table_size >= HASH_MAX_SIZE) {
+                /* keep a free slot, probing relies on it */
+                if (hash->nentries + 1 >= hash->table_size) {
+                    zip_error_set(error, ZIP_ER_MEMORY, 0);
+                    return false;
+                }
             }
-            else {
-                break;
+            else if (!hash_rebuild(hash, hash->table_size == 0 ? HASH_MIN_SIZE : hash->table_size * 2, error)) {
+                return false;
             }
         }
-    }
 
-    if (entry == NULL) {
-        if ((entry = (zip_hash_entry_t *)malloc(sizeof(zip_hash_entry_t))) == NULL) {
-            zip_error_set(error, ZIP_ER_MEMORY, 0);
-            return false;
-        }
-        entry->name = name;
-        entry->next = hash->table[table_index];
-        hash->table[table_index] = entry;
-        entry->hash_value = hash_value;
-        entry->orig_index = -1;
+        new_entry.name = name;
+        new_entry.hash_value = hash_value;
+        new_entry.orig_index = -1;
+        new_entry.current_index = -1;
+        entry = hash->table + hash_insert(hash, new_entry);
         hash->nentries++;
-        if (hash->nentries > hash->table_size * HASH_MAX_FILL && hash->table_size < HASH_MAX_SIZE) {
-            if (!hash_resize(hash, hash->table_size * 2, error)) {
-                return false;
-            }
-        }
     }
 
     if (flags & ZIP_FL_UNCHANGED) {
         entry->orig_index = (zip_int64_t)index;
     }
     entry->current_index = (zip_int64_t)index;
+    hash_indices_free(hash);
 
     return true;
 }
@@ -262,84 +552,153 @@ _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip
 /* remove entry from hash, error if not found */
 bool
 _zip_hash_delete(zip_hash_t *hash, const zip_uint8_t *name, zip_error_t *error) {
-    zip_uint32_t hash_value, index;
-    zip_hash_entry_t *entry, *previous;
+    zip_uint32_t slot;
 
     if (hash == NULL || name == NULL) {
         zip_error_set(error, ZIP_ER_INVAL, 0);
         return false;
     }
 
-    if (hash->nentries > 0) {
-        hash_value = hash_string(name);
-        index = hash_value % hash->table_size;
-        previous = NULL;
-        entry = hash->table[index];
-        while (entry) {
-            if (entry->hash_value == hash_value && strcmp((const char *)name, (const char *)entry->name) == 0) {
-                if (entry->orig_index == -1) {
-                    if (previous) {
-                        previous->next = entry->next;
-                    }
-                    else {
-                        hash->table[index] = entry->next;
-                    }
-                    free(entry);
-                    hash->nentries--;
-                    if (hash->nentries < hash->table_size * HASH_MIN_FILL && hash->table_size > HASH_MIN_SIZE) {
-                        if (!hash_resize(hash, hash->table_size / 2, error)) {
-                            return false;
-                        }
-                    }
-                }
-                else {
-                    entry->current_index = -1;
-                }
-                return true;
+    if (!hash_find(hash, name, hash_string(name), &slot)) {
+        zip_error_set(error, ZIP_ER_NOENT, 0);
+        return false;
+    }
+
+    hash_indices_free(hash);
+
+    if (hash->table[slot].orig_index == -1) {
+        hash_remove(hash, slot);
+        hash->nentries--;
+        if (hash->nentries < hash->table_size * HASH_MIN_FILL && hash->table_size > HASH_MIN_SIZE) {
+            if (!hash_rebuild(hash, hash->table_size / 2, error)) {
+                return false;
             }
-            previous = entry;
-            entry = entry->next;
         }
     }
+    else {
+        hash->table[slot].current_index = -1;
+    }
 
-    zip_error_set(error, ZIP_ER_NOENT, 0);
-    return false;
+    return true;
+}
+
+
+/* kind of secondary index for lookups with flags */
+static int
+index_kind(zip_flags_t flags) {
+    return ((flags & ZIP_FL_NOCASE) ? INDEX_NOCASE : 0) | ((flags & ZIP_FL_NODIR) ? INDEX_NODIR : 0) | ((flags & ZIP_FL_UNCHANGED) ? INDEX_UNCHANGED : 0) | ((flags & ZIP_FL_NORMALIZE) ? INDEX_NORMALIZE : 0);
+}
+
+
+/* look up name with hash_value in main table, -1 if not found */
+static zip_int64_t
+hash_lookup(const zip_hash_t *hash, const zip_uint8_t *name, zip_uint32_t hash_value, zip_flags_t flags) {
+    zip_uint32_t slot;
+
+    if (hash_find(hash, name, hash_value, &slot)) {
+        zip_hash_entry_t *entry = hash->table + slot;
+
+        return (flags & ZIP_FL_UNCHANGED) ? entry->orig_index : entry->current_index;
+    }
+
+    return -1;
 }
 
 
-/* find value for entry in hash, -1 if not found */
+/* hash value of name as used for lookups with flags, see _zip_hash_lookup_batch;
+   for ZIP_FL_NORMALIZE, name must already be normalized */
+zip_uint32_t
+_zip_hash_name(const zip_uint8_t *name, zip_flags_t flags) {
+    return hash_string_fold(name, (flags & ZIP_FL_NOCASE) != 0);
+}
+
+
+/* find value for entry in hash, -1 if not found; supports ZIP_FL_NOCASE, ZIP_FL_NODIR, and ZIP_FL_NORMALIZE */
 zip_int64_t
 _zip_hash_lookup(zip_hash_t *hash, const zip_uint8_t *name, zip_flags_t flags, zip_error_t *error) {
-    zip_uint32_t hash_value, index;
-    zip_hash_entry_t *entry;
+    zip_int64_t ret;
 
     if (hash == NULL || name == NULL) {
         zip_error_set(error, ZIP_ER_INVAL, 0);
         return -1;
     }
 
-    if (hash->nentries > 0) {
-        hash_value = hash_string(name);
-        index = hash_value % hash->table_size;
-        for (entry = hash->table[index]; entry != NULL; entry = entry->next) {
-            if (strcmp((const char *)name, (const char *)entry->name) == 0) {
-                if (flags & ZIP_FL_UNCHANGED) {
-                    if (entry->orig_index != -1) {
-                        return entry->orig_index;
-                    }
-                }
-                else {
-                    if (entry->current_index != -1) {
-                        return entry->current_index;
-                    }
+    if (flags & ZIP_FL_NORMALIZE) {
+        const zip_uint8_t *normalized;
+
+        if ((normalized = _zip_normalize_name(name, error)) == NULL) {
+            return -1;
+        }
+        ret = hash_index_lookup(hash, normalized, _zip_hash_name(normalized, flags), index_kind(flags), error);
+        if (normalized != name) {
+            _zip_free((void *)normalized);
+        }
+        return ret;
+    }
+
+    if (flags & (ZIP_FL_NOCASE | ZIP_FL_NODIR)) {
+        return hash_index_lookup(hash, name, _zip_hash_name(name, flags), index_kind(flags), error);
+    }
+
+    if ((ret = hash_lookup(hash, name, hash_string(name), flags)) < 0) {
+        zip_error_set(error, ZIP_ER_NOENT, 0);
+    }
+    return ret;
+}
+
+
+/* _zip_hash_lookup_batch:
+   Look up n names whose hash values (from _zip_hash_name) are known.
+   The home slots of all names are prefetched before the first one is
+   probed, so their cache misses overlap. Sets indices[i] to the value
+   for names[i], or -1 if it is not found. Supports ZIP_FL_NOCASE,
+   ZIP_FL_NODIR, and ZIP_FL_NORMALIZE for names that are already normalized. */
+
+bool
+_zip_hash_lookup_batch(zip_hash_t *hash, const zip_uint8_t *const *names, const zip_uint32_t *hash_values, zip_uint64_t n, zip_flags_t flags, zip_int64_t *indices, zip_error_t *error) {
+    zip_uint64_t i;
+
+    if (hash->nentries == 0) {
+        for (i = 0; i < n; i++) {
+            indices[i] = -1;
+        }
+        return true;
+    }
+
+    if (flags & ZIP_FL_NAME_INDEX) {
+        zip_hash_index_t *index;
+        zip_uint32_t mask;
+
+        if ((index = hash_index_get(hash, index_kind(flags), error)) == NULL) {
+            return false;
+        }
+        mask = index->table_size - 1;
+
+        for (i = 0; i < n; i++) {
+            HASH_PREFETCH(index->table + (hash_values[i] & mask));
+        }
+        for (i = 0; i < n; i++) {
+            zip_uint32_t slot;
+
+            indices[i] = -1;
+            for (slot = hash_values[i] & mask; index->table[slot].key != NULL; slot = (slot + 1) & mask) {
+                if (index->table[slot].hash_value == hash_values[i] && index_key_equal(names[i], index->table[slot].key, index_kind(flags))) {
+                    indices[i] = (zip_int64_t)index->table[slot].index;
+                    break;
                 }
-                break;
             }
         }
     }
+    else {
+        for (i = 0; i < n; i++) {
+            HASH_PREFETCH(hash->table + (hash_values[i] & (hash->table_size - 1)));
+        }
+        for (i = 0; i < n; i++) {
+            indices[i] = hash_lookup(hash, names[i], hash_values[i], flags);
+        }
+    }
 
-    zip_error_set(error, ZIP_ER_NOENT, 0);
-    return -1;
+    return true;
 }
 
 
@@ -357,7 +716,7 @@ _zip_hash_reserve_capacity(zip_hash_t *hash, zip_uint64_t capacity, zip_error_t
         return true;
     }
 
-    if (!hash_resize(hash, new_size, error)) {
+    if (!hash_rebuild(hash, new_size, error)) {
         return false;
     }
 
@@ -365,46 +724,22 @@ _zip_hash_reserve_capacity(zip_hash_t *hash, zip_uint64_t capacity, zip_error_t
 }
 
 
-bool
-_zip_hash_revert(zip_hash_t *hash, zip_error_t *error) {
-    zip_uint32_t i;
-    zip_hash_entry_t *entry, *previous;
+/* undo changes to entry for name: restore its original index, or remove it if it was added */
+void
+_zip_hash_revert_name(zip_hash_t *hash, const zip_uint8_t *name) {
+    zip_uint32_t slot;
 
-    for (i = 0; i < hash->table_size; i++) {
-        previous = NULL;
-        entry = hash->table[i];
-        while (entry) {
-            if (entry->orig_index == -1) {
-                zip_hash_entry_t *p;
-                if (previous) {
-                    previous->next = entry->next;
-                }
-                else {
-                    hash->table[i] = entry->next;
-                }
-                p = entry;
-                entry = entry->next;
-                /* previous does not change */
-                free(p);
-                hash->nentries--;
-            }
-            else {
-                entry->current_index = entry->orig_index;
-                previous = entry;
-                entry = entry->next;
-            }
-        }
+    if (hash == NULL || name == NULL || !hash_find(hash, name, hash_string(name), &slot)) {
+        return;
     }
 
-    if (hash->nentries < hash->table_size * HASH_MIN_FILL && hash->table_size > HASH_MIN_SIZE) {
-        zip_uint32_t new_size = hash->table_size / 2;
-        while (hash->nentries < new_size * HASH_MIN_FILL && new_size > HASH_MIN_SIZE) {
-            new_size /= 2;
-        }
-        if (!hash_resize(hash, new_size, error)) {
-            return false;
-        }
-    }
+    hash_indices_free(hash);
 
-    return true;
+    if (hash->table[slot].orig_index == -1) {
+        hash_remove(hash, slot);
+        hash->nentries--;
+    }
+    else {
+        hash->table[slot].current_index = hash->table[slot].orig_index;
+    }
 }
@@ -31,13 +31,30 @@
  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
+#define WRITEV_BATCH_SIZE 16 /* fragments passed to source at once */
+
+static int _zip_write_buffer_flush(zip_t *za);
+static int _zip_write_unbuffered(zip_t *za, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments);
+
+/* Return buffer of za->io_buffer_size bytes for copying data, which is kept until the archive is freed. */
+zip_uint8_t *
+_zip_io_buffer(zip_t *za) {
+    if (za->io_buffer == NULL) {
+        if ((za->io_buffer = (zip_uint8_t *)_zip_malloc((size_t)za->io_buffer_size)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return NULL;
+        }
+    }
+
+    return za->io_buffer;
+}
+
+
 int
 _zip_read(zip_source_t *src, zip_uint8_t *b, zip_uint64_t length, zip_error_t *error) {
     zip_int64_t n;
@@ -53,7 +70,7 @@ _zip_read(zip_source_t *src, zip_uint8_t *b, zip_uint64_t length, zip_error_t *e
     }
 
     if (n < (zip_int64_t)length) {
-        zip_error_set(error, ZIP_ER_EOF, 0);
+        zip_error_set(error, _zip_source_would_block(src) ? ZIP_ER_AGAIN : ZIP_ER_EOF, 0);
         return -1;
     }
 
@@ -69,7 +86,7 @@ _zip_read_data(zip_buffer_t *buffer, zip_source_t *src, size_t length, bool nulp
         return NULL;
     }
 
-    r = (zip_uint8_t *)malloc(length + (nulp ? 1 : 0));
+    r = (zip_uint8_t *)_zip_malloc(length + (nulp ? 1 : 0));
     if (!r) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
@@ -80,14 +97,14 @@ _zip_read_data(zip_buffer_t *buffer, zip_source_t *src, size_t length, bool nulp
 
         if (data == NULL) {
             zip_error_set(error, ZIP_ER_MEMORY, 0);
-            free(r);
+            _zip_free(r);
             return NULL;
         }
         (void)memcpy_s(r, length, data, length);
     }
     else {
         if (_zip_read(src, r, length, error) < 0) {
-            free(r);
+            _zip_free(r);
             return NULL;
         }
     }
@@ -106,24 +123,158 @@ _zip_read_data(zip_buffer_t *buffer, zip_source_t *src, size_t length, bool nulp
 
 
 zip_string_t *
-_zip_read_string(zip_buffer_t *buffer, zip_source_t *src, zip_uint16_t len, bool nulp, zip_error_t *error) {
+_zip_read_string(zip_buffer_t *buffer, zip_source_t *src, zip_uint16_t len, bool nulp, zip_arena_t *arena, zip_error_t *error) {
     zip_uint8_t *raw;
     zip_string_t *s;
 
+    /* no need to copy data from buffer if it doesn't have to be modified */
+    if (buffer != NULL && _zip_buffer_left(buffer) >= len && !(nulp && memchr(_zip_buffer_peek(buffer, len), '\0', len) != NULL)) {
+        return _zip_string_new_arena(arena, _zip_buffer_get(buffer, len), len, ZIP_FL_ENC_GUESS, error);
+    }
+
     if ((raw = _zip_read_data(buffer, src, len, nulp, error)) == NULL)
         return NULL;
 
-    s = _zip_string_new(raw, len, ZIP_FL_ENC_GUESS, error);
-    free(raw);
+    s = _zip_string_new_arena(arena, raw, len, ZIP_FL_ENC_GUESS, error);
+    _zip_free(raw);
     return s;
 }
 
 
 int
 _zip_write(zip_t *za, const void *data, zip_uint64_t length) {
+    zip_buffer_fragment_t fragment;
+
+    fragment.data = (zip_uint8_t *)data;
+    fragment.length = length;
+
+    if (za->write_buffering) {
+        if (length > ZIP_WRITE_BUFFER_SIZE) {
+            return _zip_writev(za, &fragment, 1);
+        }
+        if (length > ZIP_WRITE_BUFFER_SIZE - za->write_buffer_used && _zip_write_buffer_flush(za) < 0) {
+            return -1;
+        }
+        (void)memcpy_s(za->write_buffer + za->write_buffer_used, ZIP_WRITE_BUFFER_SIZE - za->write_buffer_used, data, length);
+        za->write_buffer_used += length;
+        return 0;
+    }
+
+    return _zip_write_unbuffered(za, &fragment, 1);
+}
+
+
+/* Write data of fragments to archive, like _zip_write() for each of them.
+   Data that doesn't fit into the write buffer is passed to the source together with the buffered data, with as few calls as possible. */
+int
+_zip_writev(zip_t *za, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments) {
+    zip_buffer_fragment_t batch[WRITEV_BATCH_SIZE];
+    zip_uint64_t i, n, length;
+
+    if (!za->write_buffering) {
+        return nfragments == 0 ? 0 : _zip_write_unbuffered(za, fragments, nfragments);
+    }
+
+    length = 0;
+    for (i = 0; i < nfragments && length <= ZIP_WRITE_BUFFER_SIZE; i++) {
+        length += fragments[i].length;
+    }
+    if (length <= ZIP_WRITE_BUFFER_SIZE) {
+        for (i = 0; i < nfragments; i++) {
+            if (_zip_write(za, fragments[i].data, fragments[i].length) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    i = 0;
+    while (i < nfragments) {
+        n = 0;
+        if (za->write_buffer_used > 0) {
+            batch[n].data = za->write_buffer;
+            batch[n].length = za->write_buffer_used;
+            n++;
+            za->write_buffer_used = 0;
+        }
+        while (n < WRITEV_BATCH_SIZE && i < nfragments) {
+            batch[n++] = fragments[i++];
+        }
+        if (_zip_write_unbuffered(za, batch, n) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Collect data written by _zip_write() in a buffer, to pass it on in large chunks.  Returns false if writes are already buffered or the buffer can't be allocated, in which case writes go through unbuffered. */
+bool
+_zip_write_buffer_begin(zip_t *za) {
+    if (za->write_buffering) {
+        return false;
+    }
+    if (za->write_buffer == NULL) {
+        if ((za->write_buffer = (zip_uint8_t *)_zip_malloc(ZIP_WRITE_BUFFER_SIZE)) == NULL) {
+            return false;
+        }
+    }
+
+    za->write_buffer_used = 0;
+    za->write_buffering = true;
+    return true;
+}
+
+
+/* Stop buffering writes started by _zip_write_buffer_begin(), writing out buffered data if flush is true. */
+int
+_zip_write_buffer_end(zip_t *za, bool flush) {
+    int ret = 0;
+
+    if (flush) {
+        ret = _zip_write_buffer_flush(za);
+    }
+    za->write_buffer_used = 0;
+    za->write_buffering = false;
+
+    return ret;
+}
+
+
+static int
+_zip_write_buffer_flush(zip_t *za) {
+    zip_buffer_fragment_t fragment;
+
+    if (za->write_buffer_used == 0) {
+        return 0;
+    }
+    fragment.data = za->write_buffer;
+    fragment.length = za->write_buffer_used;
+    za->write_buffer_used = 0;
+    return _zip_write_unbuffered(za, &fragment, 1);
+}
+
+
+/* Write data of fragments to archive, updating za->write_crc and statistics. */
+static int
+_zip_write_unbuffered(zip_t *za, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments) {
+    zip_uint64_t start = _zip_stats_start(za);
+    zip_uint64_t i, length;
     zip_int64_t n;
 
-    if ((n = zip_source_write(za->src, data, length)) < 0) {
+    if (nfragments == 1) {
+        length = fragments[0].length;
+        n = zip_source_write(za->src, fragments[0].data, length);
+    }
+    else {
+        length = 0;
+        for (i = 0; i < nfragments; i++) {
+            length += fragments[i].length;
+        }
+        n = _zip_source_writev(za->src, fragments, nfragments);
+    }
+    if (n < 0) {
         zip_error_set_from_source(&za->error, za->src);
         return -1;
     }
@@ -133,14 +284,12 @@ _zip_write(zip_t *za, const void *data, zip_uint64_t length) {
     }
 
     if (za->write_crc != NULL) {
-        zip_uint64_t position = 0;
-        while (position < length) {
-            zip_uint64_t nn = ZIP_MIN(UINT_MAX, length - position);
-
-            *za->write_crc = (zip_uint32_t)crc32(*za->write_crc, (const Bytef *)data + position, (uInt)nn);
-            position += nn;
+        for (i = 0; i < nfragments; i++) {
+            *za->write_crc = _zip_crc32(*za->write_crc, fragments[i].data, fragments[i].length);
         }
     }
 
+    _zip_stats_add(za, ZIP_PHASE_WRITE, start, length, length);
+
     return 0;
 }
@@ -44,7 +44,7 @@ _zip_memdup(const void *mem, size_t len, zip_error_t *error) {
     if (len == 0)
         return NULL;
 
-    ret = malloc(len);
+    ret = _zip_malloc(len);
     if (!ret) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
@@ -0,0 +1,171 @@
+/*
+  zip_memory_budget.c -- account memory used by archive
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+/* Shared by an archive and the compression contexts created for it, which may be freed after the archive. */
+struct zip_memory_budget {
+    zip_uint64_t limit; /* 0 for no limit */
+    zip_uint64_t used;
+    zip_uint32_t refcount;
+#ifdef HAVE_THREADS
+    zip_mutex_t *mutex; /* contexts are charged from different threads with ZIP_THREADSAFE */
+#endif
+};
+
+#ifdef HAVE_THREADS
+#define BUDGET_LOCK(budget) _zip_mutex_lock((budget)->mutex)
+#define BUDGET_UNLOCK(budget) _zip_mutex_unlock((budget)->mutex)
+#else
+#define BUDGET_LOCK(budget) ((void)0)
+#define BUDGET_UNLOCK(budget) ((void)0)
+#endif
+
+/* limit of archives created afterwards, set by zip_set_default_memory_limit() */
+static zip_uint64_t default_limit = 0;
+
+
+ZIP_EXTERN void
+zip_set_default_memory_limit(zip_uint64_t limit) {
+    default_limit = limit;
+}
+
+
+/* Charge size bytes to budget, fail with ZIP_ER_MEMLIMIT if that exceeds its limit. A NULL budget accepts everything. */
+bool
+_zip_memory_budget_charge(zip_memory_budget_t *budget, zip_uint64_t size, zip_error_t *error) {
+    bool ok;
+
+    if (budget == NULL) {
+        return true;
+    }
+
+    BUDGET_LOCK(budget);
+    ok = budget->used + size >= size && (budget->limit == 0 || budget->used + size <= budget->limit);
+    if (ok) {
+        budget->used += size;
+    }
+    BUDGET_UNLOCK(budget);
+
+    if (!ok) {
+        zip_error_set(error, ZIP_ER_MEMLIMIT, 0);
+    }
+    return ok;
+}
+
+
+void
+_zip_memory_budget_free(zip_memory_budget_t *budget) {
+    bool last;
+
+    if (budget == NULL) {
+        return;
+    }
+
+    BUDGET_LOCK(budget);
+    last = --budget->refcount == 0;
+    BUDGET_UNLOCK(budget);
+
+    if (last) {
+#ifdef HAVE_THREADS
+        _zip_mutex_free(budget->mutex);
+#endif
+        _zip_free(budget);
+    }
+}
+
+
+zip_memory_budget_t *
+_zip_memory_budget_new(zip_error_t *error) {
+    zip_memory_budget_t *budget;
+
+    if ((budget = (zip_memory_budget_t *)_zip_malloc(sizeof(*budget))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+#ifdef HAVE_THREADS
+    if ((budget->mutex = _zip_mutex_new(error)) == NULL) {
+        _zip_free(budget);
+        return NULL;
+    }
+#endif
+
+    budget->limit = default_limit;
+    budget->used = 0;
+    budget->refcount = 1;
+
+    return budget;
+}
+
+
+zip_memory_budget_t *
+_zip_memory_budget_ref(zip_memory_budget_t *budget) {
+    if (budget != NULL) {
+        BUDGET_LOCK(budget);
+        budget->refcount++;
+        BUDGET_UNLOCK(budget);
+    }
+    return budget;
+}
+
+
+void
+_zip_memory_budget_release(zip_memory_budget_t *budget, zip_uint64_t size) {
+    if (budget == NULL) {
+        return;
+    }
+
+    BUDGET_LOCK(budget);
+    budget->used -= ZIP_MIN(size, budget->used);
+    BUDGET_UNLOCK(budget);
+}
+
+
+void
+_zip_memory_budget_set_limit(zip_memory_budget_t *budget, zip_uint64_t limit) {
+    BUDGET_LOCK(budget);
+    budget->limit = limit;
+    BUDGET_UNLOCK(budget);
+}
+
+
+zip_uint64_t
+_zip_memory_budget_used(zip_memory_budget_t *budget) {
+    zip_uint64_t used;
+
+    BUDGET_LOCK(budget);
+    used = budget->used;
+    BUDGET_UNLOCK(budget);
+
+    return used;
+}
@@ -0,0 +1,127 @@
+/*
+  zip_mutex.c -- mutex for archive shared between threads
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "zipint.h"
+
+struct zip_mutex {
+    pthread_mutex_t mutex;
+};
+
+/* protects process-wide state, like the decompression context pool */
+static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+void
+_zip_global_lock(void) {
+    pthread_mutex_lock(&global_mutex);
+}
+
+
+void
+_zip_global_unlock(void) {
+    pthread_mutex_unlock(&global_mutex);
+}
+
+
+void
+_zip_mutex_free(zip_mutex_t *mutex) {
+    if (mutex == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&mutex->mutex);
+    _zip_free(mutex);
+}
+
+
+void
+_zip_mutex_lock(zip_mutex_t *mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+
+/* Mutex is recursive, since locked functions call each other. */
+zip_mutex_t *
+_zip_mutex_new(zip_error_t *error) {
+    zip_mutex_t *mutex;
+    pthread_mutexattr_t attr;
+    int ret;
+
+    if ((mutex = (zip_mutex_t *)_zip_malloc(sizeof(*mutex))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((ret = pthread_mutexattr_init(&attr)) != 0) {
+        _zip_free(mutex);
+        zip_error_set(error, ZIP_ER_INTERNAL, ret);
+        return NULL;
+    }
+    if ((ret = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)) == 0) {
+        ret = pthread_mutex_init(&mutex->mutex, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    if (ret != 0) {
+        _zip_free(mutex);
+        zip_error_set(error, ZIP_ER_INTERNAL, ret);
+        return NULL;
+    }
+
+    return mutex;
+}
+
+
+void
+_zip_mutex_unlock(zip_mutex_t *mutex) {
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+
+#ifdef ZIP_REFCOUNT_LOCKED
+/* Add delta to refcount and return new value, for compilers without atomic operations. */
+unsigned int
+_zip_refcount_add(zip_refcount_t *refcount, int delta) {
+    unsigned int value;
+
+    pthread_mutex_lock(&global_mutex);
+    value = *refcount = (unsigned int)((int)*refcount + delta);
+    pthread_mutex_unlock(&global_mutex);
+
+    return value;
+}
+#endif
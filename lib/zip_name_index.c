@@ -0,0 +1,246 @@
+/*
+  zip_name_index.c -- sorted index of entry names
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  The index lists all entries that have a name, sorted by the name as
+  returned by zip_get_name() with default flags, so that all names
+  sharing a common prefix form one contiguous range that can be found
+  by binary search. It is built when first needed and dropped whenever
+  an entry name changes.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+struct zip_name_index_entry {
+    const char *name;
+    zip_uint64_t index;
+};
+typedef struct zip_name_index_entry zip_name_index_entry_t;
+
+struct zip_name_index {
+    zip_uint64_t nentry;            /* number of entries */
+    zip_name_index_entry_t *entry;  /* entries, sorted by name */
+};
+
+static int name_compare(const void *a, const void *b);
+static zip_uint64_t prefix_lower_bound(const zip_name_index_t *index, zip_uint64_t lo, zip_uint64_t hi, const char *prefix, size_t length);
+static zip_uint64_t prefix_upper_bound(const zip_name_index_t *index, zip_uint64_t lo, zip_uint64_t hi, const char *prefix, size_t length);
+
+
+void
+_zip_name_index_free(zip_t *za) {
+    if (za->name_index == NULL) {
+        return;
+    }
+
+    _zip_free(za->name_index->entry);
+    _zip_memory_budget_release(za->memory_budget, sizeof(*za->name_index) + sizeof(za->name_index->entry[0]) * za->name_index->nentry);
+    _zip_free(za->name_index);
+    za->name_index = NULL;
+}
+
+
+/* _zip_name_index_get:
+   Return name index of ZA, building it if necessary. */
+
+zip_name_index_t *
+_zip_name_index_get(zip_t *za, zip_error_t *error) {
+    zip_name_index_t *index;
+    zip_uint64_t i, n;
+
+    if (za->name_index != NULL) {
+        return za->name_index;
+    }
+
+    if (!_zip_cdir_index_load_all(za, error)) {
+        return NULL;
+    }
+
+    if (za->nentry > SIZE_MAX / sizeof(index->entry[0])) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((index = (zip_name_index_t *)_zip_malloc(sizeof(*index))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    index->entry = NULL;
+    if (za->nentry > 0 && (index->entry = (zip_name_index_entry_t *)_zip_malloc(sizeof(index->entry[0]) * (size_t)za->nentry)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_free(index);
+        return NULL;
+    }
+
+    n = 0;
+    for (i = 0; i < za->nentry; i++) {
+        const char *name;
+
+        /* skip deleted entries and new entries without a name yet */
+        if (za->entry[i].deleted || (za->entry[i].orig == NULL && (za->entry[i].changes == NULL || za->entry[i].changes->filename == NULL))) {
+            continue;
+        }
+        if ((name = _zip_get_name(za, i, 0, error)) == NULL) {
+            _zip_free(index->entry);
+            _zip_free(index);
+            return NULL;
+        }
+        index->entry[n].name = name;
+        index->entry[n].index = i;
+        n++;
+    }
+    index->nentry = n;
+
+    if (n > 1) {
+        qsort(index->entry, (size_t)n, sizeof(index->entry[0]), name_compare);
+    }
+
+    if (!_zip_memory_budget_charge(za->memory_budget, sizeof(*index) + sizeof(index->entry[0]) * n, error)) {
+        _zip_free(index->entry);
+        _zip_free(index);
+        return NULL;
+    }
+
+    za->name_index = index;
+    return index;
+}
+
+
+/* _zip_name_index_list:
+   Find entries whose name starts with PREFIX. If CHILDREN is set, only
+   entries directly in the directory PREFIX are included: files, and
+   subdirectories (names ending in '/') without their contents.
+   Stores up to NINDICES entry indices in INDICES, in name order, and
+   returns the number of matching entries. */
+
+zip_int64_t
+_zip_name_index_list(zip_t *za, const char *prefix, bool children, zip_uint64_t *indices, zip_uint64_t nindices, zip_error_t *error) {
+    zip_name_index_t *index;
+    size_t length = strlen(prefix);
+    zip_uint64_t lo, hi, count;
+
+    if ((index = _zip_name_index_get(za, error)) == NULL) {
+        return -1;
+    }
+
+    lo = prefix_lower_bound(index, 0, index->nentry, prefix, length);
+    hi = prefix_upper_bound(index, lo, index->nentry, prefix, length);
+
+    if (!children) {
+        for (count = 0; count < hi - lo && count < nindices; count++) {
+            indices[count] = index->entry[lo + count].index;
+        }
+        return (zip_int64_t)(hi - lo);
+    }
+
+    count = 0;
+    while (lo < hi) {
+        const char *name = index->entry[lo].name;
+        const char *slash = strchr(name + length, '/');
+
+        if (name[length] == '\0') {
+            /* directory itself */
+            lo++;
+            continue;
+        }
+
+        if (slash == NULL || slash[1] == '\0') {
+            if (count < nindices) {
+                indices[count] = index->entry[lo].index;
+            }
+            count++;
+        }
+
+        if (slash == NULL) {
+            lo++;
+        }
+        else {
+            /* skip contents of subdirectory */
+            lo = prefix_upper_bound(index, lo + 1, hi, name, (size_t)(slash - name) + 1);
+        }
+    }
+
+    return (zip_int64_t)count;
+}
+
+
+static int
+name_compare(const void *a, const void *b) {
+    const zip_name_index_entry_t *ea = (const zip_name_index_entry_t *)a;
+    const zip_name_index_entry_t *eb = (const zip_name_index_entry_t *)b;
+    int ret = strcmp(ea->name, eb->name);
+
+    if (ret != 0) {
+        return ret;
+    }
+    return ea->index < eb->index ? -1 : ea->index > eb->index;
+}
+
+
+/* first entry in [lo, hi) whose name is not less than PREFIX */
+static zip_uint64_t
+prefix_lower_bound(const zip_name_index_t *index, zip_uint64_t lo, zip_uint64_t hi, const char *prefix, size_t length) {
+    while (lo < hi) {
+        zip_uint64_t mid = lo + (hi - lo) / 2;
+
+        if (strncmp(index->entry[mid].name, prefix, length) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+/* first entry in [lo, hi) whose name is greater than all names starting with PREFIX */
+static zip_uint64_t
+prefix_upper_bound(const zip_name_index_t *index, zip_uint64_t lo, zip_uint64_t hi, const char *prefix, size_t length) {
+    while (lo < hi) {
+        zip_uint64_t mid = lo + (hi - lo) / 2;
+
+        if (strncmp(index->entry[mid].name, prefix, length) <= 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
@@ -40,20 +40,115 @@
 #include "zipint.h"
 
 
+/* names shorter than this are copied to the stack by zip_name_locate_len */
+#define NAME_BUFFER_SIZE 256
+
+/* number of names zip_name_locate_many looks up in the hash table together */
+#define NAME_BATCH_SIZE 16
+
+typedef struct {
+    const zip_uint8_t *names[NAME_BATCH_SIZE];
+    zip_uint32_t hash_values[NAME_BATCH_SIZE];
+    zip_uint64_t positions[NAME_BATCH_SIZE]; /* of names in argument of zip_name_locate_many */
+    zip_int64_t indices[NAME_BATCH_SIZE];
+    zip_uint64_t n;
+} name_batch_t;
+
+static zip_int64_t name_locate(zip_t *za, const char *fname, size_t fname_length, zip_flags_t flags, zip_error_t *error);
+static zip_int64_t name_locate_sorted(zip_t *za, const char *fname, zip_error_t *error);
+static int name_locate_many(zip_t *za, const char *const *names, const zip_uint32_t *hashes, zip_uint64_t count, zip_flags_t flags, zip_int64_t *indices, zip_error_t *error);
+static bool name_batch_flush(zip_t *za, name_batch_t *batch, zip_flags_t flags, zip_int64_t *indices, zip_error_t *error);
+static bool check_lookup_error(zip_int64_t idx, zip_error_t *lookup_error, zip_error_t *error);
+static int name_equal(const char *fname, const char *fn, zip_flags_t flags, zip_error_t *error);
+
+
 ZIP_EXTERN zip_int64_t
 zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags) {
-    return _zip_name_locate(za, fname, flags, &za->error);
+    zip_int64_t idx;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    idx = _zip_name_locate(za, fname, flags, &za->error);
+    ZIP_UNLOCK(za);
+
+    return idx;
+}
+
+
+ZIP_EXTERN zip_int64_t
+zip_name_locate_len(zip_t *za, const char *fname, zip_uint64_t length, zip_flags_t flags) {
+    char buffer[NAME_BUFFER_SIZE];
+    char *name;
+    zip_int64_t idx;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    if (fname == NULL || length > ZIP_UINT16_MAX || memchr(fname, '\0', (size_t)length) != NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    /* lookup needs NUL-terminated name */
+    if (length < sizeof(buffer)) {
+        name = buffer;
+    }
+    else if ((name = (char *)_zip_malloc((size_t)length + 1)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    (void)memcpy_s(name, (size_t)length + 1, fname, (size_t)length);
+    name[length] = '\0';
+
+    ZIP_LOCK(za);
+    idx = name_locate(za, name, (size_t)length, flags, &za->error);
+    ZIP_UNLOCK(za);
+
+    if (name != buffer) {
+        _zip_free(name);
+    }
+
+    return idx;
+}
+
+
+ZIP_EXTERN int
+zip_name_locate_many(zip_t *za, const char *const *names, const zip_uint32_t *hashes, zip_uint64_t count, zip_flags_t flags, zip_int64_t *indices) {
+    int ret;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    if (count > 0 && (names == NULL || indices == NULL)) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    ret = name_locate_many(za, names, hashes, count, flags, indices, &za->error);
+    ZIP_UNLOCK(za);
+
+    return ret;
+}
+
+
+ZIP_EXTERN zip_uint32_t
+zip_name_hash(const char *name, zip_flags_t flags) {
+    if (name == NULL) {
+        return 0;
+    }
+
+    return _zip_hash_name((const zip_uint8_t *)name, flags);
 }
 
 
 zip_int64_t
 _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *error) {
-    int (*cmp)(const char *, const char *);
-    size_t fname_length;
-    zip_string_t *str = NULL;
-    const char *fn, *p;
-    zip_uint64_t i;
-
     if (za == NULL) {
         return -1;
     }
@@ -63,15 +158,28 @@ _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *e
         return -1;
     }
 
-    fname_length = strlen(fname);
+    return name_locate(za, fname, strlen(fname), flags, error);
+}
+
+
+/* Find entry named fname, which is NUL-terminated after fname_length bytes. */
+
+static zip_int64_t
+name_locate(zip_t *za, const char *fname, size_t fname_length, zip_flags_t flags, zip_error_t *error) {
+    zip_string_t *str = NULL;
+    const char *fn, *p;
+    const zip_uint8_t *normalized;
+    zip_uint64_t i;
+    int equal;
 
     if (fname_length > ZIP_UINT16_MAX) {
         zip_error_set(error, ZIP_ER_INVAL, 0);
         return -1;
     }
 
-    if ((flags & (ZIP_FL_ENC_UTF_8 | ZIP_FL_ENC_RAW)) == 0 && fname[0] != '\0') {
-        if ((str = _zip_string_new((const zip_uint8_t *)fname, (zip_uint16_t)strlen(fname), flags, error)) == NULL) {
+    /* printable ASCII is the same in all encodings, only other names need to be converted */
+    if ((flags & (ZIP_FL_ENC_UTF_8 | ZIP_FL_ENC_RAW)) == 0 && _zip_ascii_span((const zip_uint8_t *)fname, (zip_uint32_t)fname_length) < fname_length) {
+        if ((str = _zip_string_new((const zip_uint8_t *)fname, (zip_uint16_t)fname_length, flags, error)) == NULL) {
             return -1;
         }
         if ((fname = (const char *)_zip_string_get(str, NULL, 0, error)) == NULL) {
@@ -80,9 +188,13 @@ _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *e
         }
     }
 
-    if (flags & (ZIP_FL_NOCASE | ZIP_FL_NODIR | ZIP_FL_ENC_RAW | ZIP_FL_ENC_STRICT)) {
+    if (flags & (ZIP_FL_ENC_RAW | ZIP_FL_ENC_STRICT)) {
         /* can't use hash table */
-        cmp = (flags & ZIP_FL_NOCASE) ? strcasecmp : strcmp;
+        normalized = (const zip_uint8_t *)fname;
+        if ((flags & ZIP_FL_NORMALIZE) && (normalized = _zip_normalize_name((const zip_uint8_t *)fname, error)) == NULL) {
+            _zip_string_free(str);
+            return -1;
+        }
 
         for (i = 0; i < za->nentry; i++) {
             fn = _zip_get_name(za, i, flags, error);
@@ -97,20 +209,288 @@ _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *e
                     fn = p + 1;
             }
 
-            if (cmp(fname, fn) == 0) {
-                _zip_error_clear(error);
+            if ((equal = name_equal((const char *)normalized, fn, flags, error)) != 0) {
+                if (normalized != (const zip_uint8_t *)fname) {
+                    _zip_free((void *)normalized);
+                }
                 _zip_string_free(str);
+                if (equal < 0) {
+                    return -1;
+                }
+                _zip_error_clear(error);
                 return (zip_int64_t)i;
             }
         }
 
+        if (normalized != (const zip_uint8_t *)fname) {
+            _zip_free((void *)normalized);
+        }
         zip_error_set(error, ZIP_ER_NOENT, 0);
         _zip_string_free(str);
         return -1;
     }
     else {
-        zip_int64_t ret = _zip_hash_lookup(za->names, (const zip_uint8_t *)fname, flags, error);
+        zip_int64_t ret;
+
+        if (za->names_sorted && za->names_unhashed > 0 && (flags & ZIP_FL_NAME_INDEX) == 0) {
+            ret = name_locate_sorted(za, fname, error);
+            _zip_string_free(str);
+            return ret;
+        }
+
+        /* secondary indices of hash table only cover names that have been read */
+        if (((flags & ZIP_FL_NAME_INDEX) && !_zip_cdir_index_load_all(za, error)) || !_zip_names_build_hash(za, error)) {
+            _zip_string_free(str);
+            return -1;
+        }
+
+        ret = _zip_hash_lookup(za->names, (const zip_uint8_t *)fname, flags, error);
+        if (ret < 0 && za->cdir_index != NULL && (flags & ZIP_FL_NAME_INDEX) == 0) {
+            ret = _zip_cdir_index_lookup(za, fname, error);
+        }
         _zip_string_free(str);
         return ret;
     }
 }
+
+
+/* Find entries named names[0..count-1]. Names that can be looked up in the
+   hash table as they are, are looked up NAME_BATCH_SIZE at a time. */
+
+static int
+name_locate_many(zip_t *za, const char *const *names, const zip_uint32_t *hashes, zip_uint64_t count, zip_flags_t flags, zip_int64_t *indices, zip_error_t *error) {
+    name_batch_t batch;
+    zip_uint64_t i;
+
+    if ((flags & (ZIP_FL_ENC_RAW | ZIP_FL_ENC_STRICT)) == 0) {
+        if ((flags & ZIP_FL_NAME_INDEX) && !_zip_cdir_index_load_all(za, error)) {
+            return -1;
+        }
+        /* looking up many names pays for building the hash table */
+        if (count > 0 && !_zip_names_build_hash(za, error)) {
+            return -1;
+        }
+    }
+
+    batch.n = 0;
+    for (i = 0; i < count; i++) {
+        size_t length;
+
+        if (names[i] == NULL) {
+            zip_error_set(error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        length = strlen(names[i]);
+
+        /* names that need conversion or normalization and lookups that can't use the hash table are done one by one */
+        if ((flags & (ZIP_FL_ENC_RAW | ZIP_FL_ENC_STRICT)) || length > ZIP_UINT16_MAX || ((flags & (ZIP_FL_ENC_UTF_8 | ZIP_FL_NORMALIZE)) != ZIP_FL_ENC_UTF_8 && _zip_ascii_span((const zip_uint8_t *)names[i], (zip_uint32_t)length) < length)) {
+            zip_error_t lookup_error;
+
+            zip_error_init(&lookup_error);
+            indices[i] = name_locate(za, names[i], length, flags, &lookup_error);
+            if (!check_lookup_error(indices[i], &lookup_error, error)) {
+                return -1;
+            }
+            continue;
+        }
+
+        batch.names[batch.n] = (const zip_uint8_t *)names[i];
+        batch.hash_values[batch.n] = hashes != NULL ? hashes[i] : _zip_hash_name((const zip_uint8_t *)names[i], flags);
+        batch.positions[batch.n] = i;
+        if (++batch.n == NAME_BATCH_SIZE && !name_batch_flush(za, &batch, flags, indices, error)) {
+            return -1;
+        }
+    }
+
+    if (!name_batch_flush(za, &batch, flags, indices, error)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Find entry named fname by binary search among entries whose names are sorted.
+   Entries are sorted case insensitively, as for torrentzip, so the first
+   exact match is searched for among the names that are equal ignoring case. */
+
+static zip_int64_t
+name_locate_sorted(zip_t *za, const char *fname, zip_error_t *error) {
+    zip_uint64_t low, high, i;
+    const char *name;
+
+    low = 0;
+    high = za->names_unhashed;
+    while (low < high) {
+        zip_uint64_t mid = low + (high - low) / 2;
+
+        if ((name = (const char *)_zip_string_get(za->entry[mid].orig->filename, NULL, 0, error)) == NULL) {
+            return -1;
+        }
+        if (strcasecmp(name, fname) < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    for (i = low; i < za->names_unhashed; i++) {
+        if ((name = (const char *)_zip_string_get(za->entry[i].orig->filename, NULL, 0, error)) == NULL) {
+            return -1;
+        }
+        if (strcasecmp(name, fname) != 0) {
+            break;
+        }
+        if (strcmp(name, fname) == 0) {
+            return (zip_int64_t)i;
+        }
+    }
+
+    zip_error_set(error, ZIP_ER_NOENT, 0);
+    return -1;
+}
+
+
+/* _zip_names_check_sorted:
+   Check whether names of all entries are sorted like in torrentzip
+   archives, so they can be found by binary search.
+   Returns 1 if they are, 0 if not, -1 on error. */
+
+int
+_zip_names_check_sorted(zip_t *za, zip_error_t *error) {
+    const char *name, *previous;
+    zip_uint64_t i;
+
+    if (za->nentry == 0) {
+        return 0;
+    }
+
+    previous = NULL;
+    for (i = 0; i < za->nentry; i++) {
+        if ((name = (const char *)_zip_string_get(za->entry[i].orig->filename, NULL, 0, error)) == NULL) {
+            return -1;
+        }
+        if (previous != NULL && strcasecmp(previous, name) > 0) {
+            return 0;
+        }
+        previous = name;
+    }
+
+    return 1;
+}
+
+
+/* _zip_names_build_hash:
+   Add names of entries that were not added when opening the archive,
+   because they are sorted or for ZIP_LAZY_NAMES, to hash table.
+   Must be called before names are changed. */
+
+bool
+_zip_names_build_hash(zip_t *za, zip_error_t *error) {
+    zip_uint64_t i;
+
+    if (za->names_unhashed == 0) {
+        return true;
+    }
+
+    if (!_zip_hash_reserve_capacity(za->names, za->nentry, error)) {
+        return false;
+    }
+    for (i = 0; i < za->names_unhashed; i++) {
+        const zip_uint8_t *name;
+        zip_error_t hash_error;
+
+        if ((name = _zip_string_get(za->entry[i].orig->filename, NULL, 0, error)) == NULL) {
+            return false;
+        }
+
+        /* duplicate names are only found via their first entry, as in zip_open */
+        zip_error_init(&hash_error);
+        if (!_zip_hash_add(za->names, name, i, ZIP_FL_UNCHANGED, &hash_error) && zip_error_code_zip(&hash_error) != ZIP_ER_EXISTS) {
+            _zip_error_copy(error, &hash_error);
+            zip_error_fini(&hash_error);
+            return false;
+        }
+        zip_error_fini(&hash_error);
+    }
+    za->names_unhashed = 0;
+    za->names_sorted = false;
+
+    return true;
+}
+
+
+/* Look up names collected in batch and store their indices. */
+
+static bool
+name_batch_flush(zip_t *za, name_batch_t *batch, zip_flags_t flags, zip_int64_t *indices, zip_error_t *error) {
+    zip_uint64_t k;
+
+    if (batch->n == 0) {
+        return true;
+    }
+
+    if (!_zip_hash_lookup_batch(za->names, batch->names, batch->hash_values, batch->n, flags, batch->indices, error)) {
+        return false;
+    }
+
+    for (k = 0; k < batch->n; k++) {
+        zip_int64_t idx = batch->indices[k];
+
+        /* entries that have not been read yet are not in hash table */
+        if (idx < 0 && za->cdir_index != NULL && (flags & ZIP_FL_NAME_INDEX) == 0) {
+            zip_error_t lookup_error;
+
+            zip_error_init(&lookup_error);
+            idx = _zip_cdir_index_lookup(za, (const char *)batch->names[k], &lookup_error);
+            if (!check_lookup_error(idx, &lookup_error, error)) {
+                return false;
+            }
+        }
+        indices[batch->positions[k]] = idx;
+    }
+
+    batch->n = 0;
+    return true;
+}
+
+
+/* Check result of single lookup: not finding the name is not an error.
+   Returns false and sets error for other errors. */
+
+static bool
+check_lookup_error(zip_int64_t idx, zip_error_t *lookup_error, zip_error_t *error) {
+    bool ok = idx >= 0 || zip_error_code_zip(lookup_error) == ZIP_ER_OK || zip_error_code_zip(lookup_error) == ZIP_ER_NOENT;
+
+    if (!ok) {
+        _zip_error_copy(error, lookup_error);
+    }
+    zip_error_fini(lookup_error);
+    return ok;
+}
+
+
+/* Compare name fn of entry to fname, which is already normalized for ZIP_FL_NORMALIZE.
+   Returns 1 if they are equal, 0 if not, -1 on error. */
+
+static int
+name_equal(const char *fname, const char *fn, zip_flags_t flags, zip_error_t *error) {
+    int (*cmp)(const char *, const char *) = (flags & ZIP_FL_NOCASE) ? strcasecmp : strcmp;
+    const zip_uint8_t *normalized;
+    int equal;
+
+    if ((flags & ZIP_FL_NORMALIZE) == 0) {
+        return cmp(fname, fn) == 0;
+    }
+
+    if ((normalized = _zip_normalize_name((const zip_uint8_t *)fn, error)) == NULL) {
+        return -1;
+    }
+    equal = cmp(fname, (const char *)normalized) == 0;
+    if (normalized != (const zip_uint8_t *)fn) {
+        _zip_free((void *)normalized);
+    }
+
+    return equal;
+}
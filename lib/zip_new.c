@@ -33,6 +33,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "zipint.h"
 
@@ -45,14 +46,27 @@ zip_t *
 _zip_new(zip_error_t *error) {
     zip_t *za;
 
-    za = (zip_t *)malloc(sizeof(struct zip));
+    za = (zip_t *)_zip_malloc(sizeof(struct zip));
     if (!za) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
     if ((za->names = _zip_hash_new(error)) == NULL) {
-        free(za);
+        _zip_free(za);
+        return NULL;
+    }
+
+    if ((za->memory_budget = _zip_memory_budget_new(error)) == NULL) {
+        _zip_hash_free(za->names);
+        _zip_free(za);
+        return NULL;
+    }
+
+    if ((za->arena = _zip_arena_new(za->memory_budget, error)) == NULL) {
+        _zip_memory_budget_free(za->memory_budget);
+        _zip_hash_free(za->names);
+        _zip_free(za);
         return NULL;
     }
 
@@ -63,11 +77,63 @@ _zip_new(zip_error_t *error) {
     za->default_password = NULL;
     za->comment_orig = za->comment_changes = NULL;
     za->comment_changed = 0;
-    za->nentry = za->nentry_alloc = 0;
+    za->cdir_offset_orig = 0;
+    za->cdir_segments = NULL;
+    za->ncdir_segments = 0;
+    za->prefix_orig = za->prefix_changes = NULL;
+    za->prefix_changes_length = 0;
+    za->prefix_changed = false;
+    za->alignment_orig = za->alignment = 0;
+    za->data_order = NULL;
+    za->ndata_order = 0;
+    za->nentry = za->nentry_alloc = za->nentry_orig = 0;
     za->entry = NULL;
+    za->change_log = NULL;
+    za->nchange_log = za->nchange_log_alloc = 0;
     za->nopen_source = za->nopen_source_alloc = 0;
     za->open_source = NULL;
     za->progress = NULL;
+    za->num_threads = 1;
+    za->compression_level_policy = ZIP_COMPRESSION_LEVEL_DEFAULT;
+    za->compression_block_size = 0;
+    za->decompression_memory_limit = 0;
+    za->io_buffer_size = ZIP_DEFAULT_IO_BUFFER_SIZE;
+    za->progress_interval_bytes = ZIP_DEFAULT_PROGRESS_INTERVAL_BYTES;
+    za->progress_interval_time = ZIP_DEFAULT_PROGRESS_INTERVAL_TIME;
+    za->io_buffer = NULL;
+    za->buffered_entry_size = ZIP_DEFAULT_BUFFERED_ENTRY_SIZE;
+    za->entry_buffer = NULL;
+    za->entry_buffer_size = 0;
+    za->write_buffer = NULL;
+    za->write_buffer_used = 0;
+    za->write_buffering = false;
+    za->compression_cache = NULL;
+    za->dedup = NULL;
+    za->read_algorithm = NULL;
+    za->read_decompressor = NULL;
+    za->read_decompressor_charged = 0;
+    za->entry_cache = NULL;
+    za->access_profile = NULL;
+    za->prefetcher = NULL;
+    za->shared_entries = NULL;
+    memset(&za->dos_time_cache, 0, sizeof(za->dos_time_cache));
+    za->names_unhashed = 0;
+    za->names_sorted = false;
+    za->cdir_index = NULL;
+    za->cdir_index_cache = NULL;
+    za->name_index = NULL;
+    za->reader.src = NULL;
+    za->reader.data = NULL;
+    za->reader.size = 0;
+    za->reader.volumes = false;
+    za->mutex = NULL;
+    za->aes_key_cache = NULL;
+    za->crypto_provider = NULL;
+    za->zstd_dictionary = NULL;
+    za->zstd_dictionary_loaded = false;
+    za->stats = NULL;
+    za->stats_callback = NULL;
+    za->stats_callback_ud = NULL;
 
     return za;
 }
@@ -39,21 +39,77 @@
 
 #include "zipint.h"
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 typedef enum { EXISTS_ERROR = -1, EXISTS_NOT = 0, EXISTS_OK } exists_t;
 static zip_t *_zip_allocate_new(zip_source_t *src, unsigned int flags, zip_error_t *error);
+static zip_t *open_archive(zip_source_t *src, int _flags, const char *index_fn, zip_error_t *error);
 static zip_int64_t _zip_checkcons(zip_t *za, zip_cdir_t *cdir, zip_error_t *error);
 static void zip_check_torrentzip(zip_t *za, const zip_cdir_t *cdir);
 static zip_cdir_t *_zip_find_central_dir(zip_t *za, zip_uint64_t len);
 static exists_t _zip_file_exists(zip_source_t *src, zip_error_t *error);
-static int _zip_headercomp(const zip_dirent_t *, const zip_dirent_t *);
-static const unsigned char *_zip_memmem(const unsigned char *, size_t, const unsigned char *, size_t);
+static bool _zip_eocd_plausible(zip_buffer_t *buffer, zip_uint64_t eocd_offset, zip_uint64_t buf_offset);
+static const zip_uint8_t *_zip_find_eocd_magic(const zip_uint8_t *data, size_t length);
+static bool _zip_open_forksafe(zip_t *za, zip_error_t *error);
+static bool _zip_open_threadsafe(zip_t *za, zip_error_t *error);
+static bool cdir_index_key(zip_t *za, const zip_cdir_t *cd, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_cdir_index_key_t *key, zip_error_t *error);
+static zip_t *open_file(const char *fn, int _flags, const char *index_fn, int *zep);
+static zip_t *open_from_source(zip_source_t *src, int _flags, const char *index_fn, zip_error_t *error);
 static zip_cdir_t *_zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_error_t *error);
-static zip_cdir_t *_zip_read_eocd(zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_error_t *error);
-static zip_cdir_t *_zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_error_t *error);
+static zip_cdir_t *_zip_read_eocd(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_memory_budget_t *budget, zip_error_t *error);
+static zip_cdir_t *_zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_memory_budget_t *budget, zip_error_t *error);
+static bool _zip_read_eocd64_segments(zip_source_t *src, zip_buffer_t *tail, zip_uint64_t buf_offset, zip_uint64_t ext_offset, zip_uint64_t ext_length, zip_uint64_t cdir_offset, zip_cdir_segment_t **segmentsp, zip_uint64_t *nsegmentsp, zip_uint64_t *nentryp, zip_error_t *error);
+static bool cdir_read_segment(zip_t *za, zip_cdir_t *cd, const zip_cdir_segment_t *segment, zip_uint64_t *indexp, zip_error_t *error);
+static bool cdir_buffer_fill(zip_source_t *src, zip_buffer_t **bufferp, zip_uint64_t *unread, zip_error_t *error);
+#ifdef HAVE_THREADS
+static zip_int64_t cdir_read_threaded(zip_t *za, zip_cdir_t *cd, zip_uint64_t *indexp, zip_uint64_t left, zip_buffer_t *buffer, zip_error_t *error);
+#endif
+
+/* central directory not contained in tail buffer is read in chunks of this size */
+#define CDIR_READ_SIZE (16 * 1024 * 1024)
+/* largest possible central directory entry */
+#define CDENTRY_MAX_SIZE (CDENTRYSIZE + 3 * 0xffffu)
+/* with ZIP_THREADSAFE, central directories with enough entries are parsed in worker threads */
+#define CDIR_THREADS 4
+#define CDIR_MIN_ENTRIES_PER_THREAD 4096
+
+/* archives of at most this size are read into memory by zip_open, set by zip_set_default_preload_size() */
+static zip_uint64_t default_preload_size = 0;
 
 
 ZIP_EXTERN zip_t *
 zip_open(const char *fn, int _flags, int *zep) {
+    return open_file(fn, _flags, NULL, zep);
+}
+
+
+ZIP_EXTERN zip_t *
+zip_open_with_index(const char *fn, const char *index_fn, int _flags, int *zep) {
+    if (index_fn == NULL) {
+        _zip_set_open_error(zep, NULL, ZIP_ER_INVAL);
+        return NULL;
+    }
+
+    return open_file(fn, _flags | ZIP_LAZY_CDIR, index_fn, zep);
+}
+
+
+ZIP_EXTERN zip_t *
+zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
+    return open_from_source(src, _flags, NULL, error);
+}
+
+
+ZIP_EXTERN void
+zip_set_default_preload_size(zip_uint64_t size) {
+    default_preload_size = size;
+}
+
+
+static zip_t *
+open_file(const char *fn, int _flags, const char *index_fn, int *zep) {
     zip_t *za;
     zip_source_t *src;
     struct zip_error error;
@@ -64,12 +120,21 @@ zip_open(const char *fn, int _flags, int *zep) {
         zip_error_fini(&error);
         return NULL;
     }
+    _zip_source_file_set_preload(src, default_preload_size);
 
-    if ((za = zip_open_from_source(src, _flags, &error)) == NULL) {
+    if ((za = open_from_source(src, _flags, index_fn, &error)) == NULL) {
         zip_source_free(src);
-        _zip_set_open_error(zep, &error, 0);
-        zip_error_fini(&error);
-        return NULL;
+        if (zip_error_code_zip(&error) == ZIP_ER_MULTIDISK && (src = _zip_source_volumes_new_split(fn, &error)) != NULL) {
+            /* last volume of split archive, read it together with the other volumes */
+            if ((za = open_from_source(src, _flags, index_fn, &error)) == NULL) {
+                zip_source_free(src);
+            }
+        }
+        if (za == NULL) {
+            _zip_set_open_error(zep, &error, 0);
+            zip_error_fini(&error);
+            return NULL;
+        }
     }
 
     zip_error_fini(&error);
@@ -77,8 +142,28 @@ zip_open(const char *fn, int _flags, int *zep) {
 }
 
 
-ZIP_EXTERN zip_t *
-zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
+/* As open_archive, recording time spent for ZIP_COLLECT_STATS. */
+static zip_t *
+open_from_source(zip_source_t *src, int _flags, const char *index_fn, zip_error_t *error) {
+    zip_uint64_t start = 0, cpu_start = 0;
+    zip_t *za;
+
+    if (_flags >= 0 && (_flags & ZIP_COLLECT_STATS)) {
+        start = _zip_stats_time();
+        cpu_start = _zip_stats_cpu_time();
+    }
+
+    if ((za = open_archive(src, _flags, index_fn, error)) != NULL && za->stats != NULL) {
+        za->stats[ZIP_PHASE_OPEN].wall_time = _zip_stats_time() - start;
+        za->stats[ZIP_PHASE_OPEN].cpu_time = _zip_stats_cpu_time() - cpu_start;
+    }
+
+    return za;
+}
+
+
+static zip_t *
+open_archive(zip_source_t *src, int _flags, const char *index_fn, zip_error_t *error) {
     unsigned int flags;
     zip_int64_t supported;
     exists_t exists;
@@ -88,11 +173,19 @@ zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
         return NULL;
     }
     flags = (unsigned int)_flags;
+#ifdef LIBZIP_READ_ONLY
+    /* archives can't be changed or written */
+    flags |= ZIP_RDONLY;
+#endif
 
     supported = zip_source_supports(src);
     if ((supported & ZIP_SOURCE_SUPPORTS_SEEKABLE) != ZIP_SOURCE_SUPPORTS_SEEKABLE) {
-        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
-        return NULL;
+        /* output only, e.g. to a pipe: always start a new archive, written with data descriptors */
+        if ((supported & ZIP_SOURCE_SUPPORTS_STREAMING) != ZIP_SOURCE_SUPPORTS_STREAMING || (flags & (ZIP_CREATE | ZIP_TRUNCATE)) == 0 || (flags & (ZIP_RDONLY | ZIP_THREADSAFE | ZIP_FORKSAFE))) {
+            zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+            return NULL;
+        }
+        return _zip_allocate_new(src, flags | ZIP_TRUNCATE, error);
     }
     if ((supported & ZIP_SOURCE_SUPPORTS_WRITABLE) != ZIP_SOURCE_SUPPORTS_WRITABLE) {
         flags |= ZIP_RDONLY;
@@ -102,6 +195,20 @@ zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
         zip_error_set(error, ZIP_ER_RDONLY, 0);
         return NULL;
     }
+    if ((flags & ZIP_RDONLY) == 0 && (flags & (ZIP_THREADSAFE | ZIP_FORKSAFE))) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+    if (flags & ZIP_FORKSAFE) {
+        /* loading entries on first use would change metadata after opening */
+        flags &= ~(unsigned int)ZIP_LAZY_CDIR;
+    }
+#ifndef HAVE_THREADS
+    if (flags & ZIP_THREADSAFE) {
+        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+        return NULL;
+    }
+#endif
 
     exists = _zip_file_exists(src, error);
     switch (exists) {
@@ -131,7 +238,7 @@ zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
         }
         else {
             /* ZIP_CREATE gets ignored if file exists and not ZIP_EXCL, just like open() */
-            za = _zip_open(src, flags, error);
+            za = _zip_open(src, flags, index_fn, error);
         }
 
         if (za == NULL) {
@@ -145,11 +252,12 @@ zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
 
 
 zip_t *
-_zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
+_zip_open(zip_source_t *src, unsigned int flags, const char *index_fn, zip_error_t *error) {
     zip_t *za;
     zip_cdir_t *cdir;
     struct zip_stat st;
     zip_uint64_t len, idx;
+    bool recovered;
 
     zip_stat_init(&st);
     if (zip_source_stat(src, &st) < 0) {
@@ -167,12 +275,35 @@ _zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
         return NULL;
     }
 
+    if (flags & (ZIP_THREADSAFE | ZIP_FORKSAFE)) {
+        if (!_zip_open_threadsafe(za, error)) {
+            /* keep src so discard does not get rid of it */
+            zip_source_keep(src);
+            zip_discard(za);
+            return NULL;
+        }
+    }
+
     /* treat empty files as empty archives */
     if (len == 0 && zip_source_accept_empty(src)) {
         return za;
     }
 
-    if ((cdir = _zip_find_central_dir(za, len)) == NULL) {
+    za->cdir_index_cache = index_fn;
+    cdir = _zip_find_central_dir(za, len);
+    za->cdir_index_cache = NULL;
+    recovered = false;
+    if (cdir == NULL && (flags & ZIP_RECOVER) && (za->error.zip_err == ZIP_ER_NOZIP || za->error.zip_err == ZIP_ER_INCONS)) {
+        zip_error_t recover_error;
+
+        recovered = true;
+        zip_error_init(&recover_error);
+        if ((cdir = _zip_recover_cdir(za, len, &recover_error)) == NULL && zip_error_code_zip(&recover_error) != ZIP_ER_OK) {
+            _zip_error_copy(&za->error, &recover_error);
+        }
+        zip_error_fini(&recover_error);
+    }
+    if (cdir == NULL) {
         _zip_error_copy(error, &za->error);
         /* keep src so discard does not get rid of it */
         zip_source_keep(src);
@@ -180,12 +311,40 @@ _zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
         return NULL;
     }
 
+    if (za->stats != NULL) {
+        za->stats[ZIP_PHASE_OPEN].bytes_in = cdir->size;
+        za->stats[ZIP_PHASE_OPEN].count = cdir->nentry;
+    }
+
+    if (cdir->segments == NULL && !recovered) {
+        /* a regular central directory is the first segment of a log-structured one */
+        if ((cdir->segments = (zip_cdir_segment_t *)_zip_malloc(sizeof(cdir->segments[0]))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            _zip_cdir_free(cdir);
+            /* keep src so discard does not get rid of it */
+            zip_source_keep(src);
+            zip_discard(za);
+            return NULL;
+        }
+        cdir->segments[0].offset = cdir->offset;
+        cdir->segments[0].size = cdir->size;
+        cdir->segments[0].nentry = cdir->nentry;
+        cdir->nsegments = 1;
+    }
+    za->cdir_segments = cdir->segments;
+    za->ncdir_segments = cdir->nsegments;
+    za->cdir_offset_orig = cdir->offset;
     za->entry = cdir->entry;
-    za->nentry = cdir->nentry;
+    za->nentry = za->nentry_orig = cdir->nentry;
     za->nentry_alloc = cdir->nentry_alloc;
+    za->cdir_index = cdir->index;
 
     zip_check_torrentzip(za, cdir);
 
+    if (cdir->has_embedded_index) {
+        za->flags |= ZIP_AFL_EMBED_INDEX;
+    }
+
     if (ZIP_IS_TORRENTZIP(za)) {
         /* Torrentzip uses the archive comment to detect changes by tools that are not torrentzip aware. */
         _zip_string_free(cdir->comment);
@@ -194,12 +353,41 @@ _zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
         za->comment_orig = cdir->comment;
     }
 
-    free(cdir);
+    _zip_free(cdir);
 
-    _zip_hash_reserve_capacity(za->names, za->nentry, &za->error);
+    if (za->cdir_index == NULL && (flags & (ZIP_CHECKCONS | ZIP_LAZY_NAMES | ZIP_FORKSAFE)) == ZIP_LAZY_NAMES) {
+        /* hash table is built when a name is first looked up */
+        za->names_unhashed = za->nentry;
+    }
+    else if (za->cdir_index == NULL && (flags & ZIP_CHECKCONS) == 0) {
+        /* sorted names, like in torrentzip archives, are found by binary search until the hash table is needed */
+        int sorted;
 
-    for (idx = 0; idx < za->nentry; idx++) {
-        const zip_uint8_t *name = _zip_string_get(za->entry[idx].orig->filename, NULL, 0, error);
+        if ((sorted = _zip_names_check_sorted(za, error)) < 0) {
+            /* keep src so discard does not get rid of it */
+            zip_source_keep(src);
+            zip_discard(za);
+            return NULL;
+        }
+        if (sorted) {
+            za->names_unhashed = za->nentry;
+            za->names_sorted = true;
+        }
+    }
+
+    if (za->cdir_index == NULL && za->names_unhashed == 0) {
+        _zip_hash_reserve_capacity(za->names, za->nentry, &za->error);
+    }
+
+    for (idx = 0; idx < za->nentry && za->names_unhashed == 0; idx++) {
+        const zip_uint8_t *name;
+
+        if (za->entry[idx].orig == NULL) {
+            /* not read yet, added to hash table when loaded */
+            continue;
+        }
+
+        name = _zip_string_get(za->entry[idx].orig->filename, NULL, 0, error);
         if (name == NULL) {
             /* keep src so discard does not get rid of it */
             zip_source_keep(src);
@@ -218,6 +406,13 @@ _zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
         }
     }
 
+    if ((flags & ZIP_FORKSAFE) && !_zip_open_forksafe(za, error)) {
+        /* keep src so discard does not get rid of it */
+        zip_source_keep(src);
+        zip_discard(za);
+        return NULL;
+    }
+
     za->ch_flags = za->flags;
 
     return za;
@@ -254,9 +449,14 @@ static zip_cdir_t *
 _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_error_t *error) {
     zip_cdir_t *cd;
     zip_uint16_t comment_len;
-    zip_uint64_t i, left;
+    zip_uint64_t i, k, left, unread;
     zip_uint64_t eocd_offset = _zip_buffer_offset(buffer);
     zip_buffer_t *cd_buffer;
+    zip_cdir_index_key_t index_key;
+    bool write_index_cache = false;
+#ifdef HAVE_THREADS
+    bool threaded, try_threads;
+#endif
 
     if (_zip_buffer_left(buffer) < EOCDLEN) {
         /* not enough bytes left for comment */
@@ -272,11 +472,11 @@ _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_err
 
     if (eocd_offset >= EOCD64LOCLEN && memcmp(_zip_buffer_data(buffer) + eocd_offset - EOCD64LOCLEN, EOCD64LOC_MAGIC, 4) == 0) {
         _zip_buffer_set_offset(buffer, eocd_offset - EOCD64LOCLEN);
-        cd = _zip_read_eocd64(za->src, buffer, buf_offset, za->flags, error);
+        cd = _zip_read_eocd64(za->src, buffer, buf_offset, za->flags, za->memory_budget, error);
     }
     else {
         _zip_buffer_set_offset(buffer, eocd_offset);
-        cd = _zip_read_eocd(buffer, buf_offset, za->flags, error);
+        cd = _zip_read_eocd(za->src, buffer, buf_offset, za->flags, za->memory_budget, error);
     }
 
     if (cd == NULL)
@@ -312,6 +512,39 @@ _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_err
         }
     }
 
+    if ((za->open_flags & (ZIP_LAZY_CDIR | ZIP_CHECKCONS)) == ZIP_LAZY_CDIR && cd->segments == NULL) {
+        if (!_zip_cdir_index_embedded_read(cd, za->src, za->arena, error)) {
+            _zip_cdir_free(cd);
+            return NULL;
+        }
+        if (cd->index != NULL) {
+            /* index stored in archive, no need to look at central directory */
+            return cd;
+        }
+    }
+
+    if (za->cdir_index_cache != NULL && (za->open_flags & (ZIP_LAZY_CDIR | ZIP_CHECKCONS)) == ZIP_LAZY_CDIR && cd->segments == NULL) {
+        if (!cdir_index_key(za, cd, buffer, buf_offset, &index_key, error) || !_zip_cdir_index_cache_read(za->cdir_index_cache, &index_key, cd, za->src, za->arena, error)) {
+            _zip_cdir_free(cd);
+            return NULL;
+        }
+        if (cd->index != NULL) {
+            /* index read from cache, no need to look at central directory */
+            return cd;
+        }
+        write_index_cache = true;
+    }
+
+    /* entries of earlier segments of a log-structured central directory come first */
+    i = 0;
+    for (k = 0; k + 1 < cd->nsegments; k++) {
+        if (!cdir_read_segment(za, cd, cd->segments + k, &i, error)) {
+            _zip_cdir_free(cd);
+            return NULL;
+        }
+    }
+
+    unread = 0;
     if (cd->offset >= buf_offset) {
         zip_uint8_t *data;
         /* if buffer already read in, use it */
@@ -343,13 +576,35 @@ _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_err
             _zip_cdir_free(cd);
             return NULL;
         }
+
+        /* read in few large chunks instead of each entry separately, which is slow for sources with high latency */
+        unread = cd->size;
+    }
+
+    if ((za->open_flags & (ZIP_LAZY_CDIR | ZIP_CHECKCONS)) == ZIP_LAZY_CDIR && cd->segments == NULL) {
+        if ((cd->index = _zip_cdir_index_new(cd->nentry, error)) == NULL) {
+            _zip_cdir_free(cd);
+            _zip_buffer_free(cd_buffer);
+            return NULL;
+        }
     }
 
+#ifdef HAVE_THREADS
+    threaded = (za->open_flags & ZIP_THREADSAFE) && cd->index == NULL && cd->nentry >= CDIR_THREADS * CDIR_MIN_ENTRIES_PER_THREAD;
+#ifdef _SC_NPROCESSORS_ONLN
+    /* only overhead on a single processor */
+    threaded = threaded && sysconf(_SC_NPROCESSORS_ONLN) > 1;
+#endif
+    try_threads = threaded;
+#endif
+
     left = (zip_uint64_t)cd->size;
-    i = 0;
     while (left > 0) {
         bool grown = false;
-        zip_int64_t entry_size;
+        zip_int64_t entry_size = 0;
+#ifdef HAVE_THREADS
+        zip_uint64_t unread_before = unread;
+#endif
 
         if (i == cd->nentry) {
             /* InfoZIP has a hack to avoid using Zip64: it stores nentries % 0x10000 */
@@ -367,7 +622,46 @@ _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_err
             grown = true;
         }
 
-        if ((cd->entry[i].orig = _zip_dirent_new()) == NULL || (entry_size = _zip_dirent_read(cd->entry[i].orig, za->src, cd_buffer, false, error)) < 0) {
+        if (!cdir_buffer_fill(za->src, &cd_buffer, &unread, error)) {
+            _zip_cdir_free(cd);
+            _zip_buffer_free(cd_buffer);
+            return NULL;
+        }
+
+#ifdef HAVE_THREADS
+        /* try once for each chunk read */
+        if (unread != unread_before) {
+            try_threads = threaded;
+        }
+        if (try_threads) {
+            try_threads = false;
+            if ((entry_size = cdir_read_threaded(za, cd, &i, left, cd_buffer, error)) < 0) {
+                _zip_cdir_free(cd);
+                _zip_buffer_free(cd_buffer);
+                return NULL;
+            }
+            if (entry_size > 0) {
+                left -= (zip_uint64_t)entry_size;
+                continue;
+            }
+        }
+#endif
+
+        if (cd->index) {
+            if ((entry_size = _zip_cdir_index_add(cd->index, i, cd->offset + (cd->size - left), za->src, cd_buffer, error)) < 0) {
+                _zip_cdir_free(cd);
+                _zip_buffer_free(cd_buffer);
+                return NULL;
+            }
+            if ((zip_uint64_t)entry_size > left) {
+                zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_LENGTH_INVALID);
+                _zip_cdir_free(cd);
+                _zip_buffer_free(cd_buffer);
+                return NULL;
+            }
+        }
+
+        if (entry_size == 0 && ((cd->entry[i].orig = _zip_dirent_new_arena(za->arena, error)) == NULL || (entry_size = _zip_dirent_read(cd->entry[i].orig, za->src, cd_buffer, false, za->arena, error)) < 0)) {
 	    if (zip_error_code_zip(error) == ZIP_ER_INCONS) {
 		zip_error_set(error, ZIP_ER_INCONS, ADD_INDEX_TO_DETAIL(zip_error_code_system(error), i));
 	    }
@@ -389,11 +683,21 @@ _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_err
         return NULL;
     }
 
+    if (cd->index && !_zip_cdir_index_finalize(cd->index, error)) {
+        _zip_buffer_free(cd_buffer);
+        _zip_cdir_free(cd);
+        return NULL;
+    }
+
+    if (write_index_cache && cd->index != NULL) {
+        _zip_cdir_index_cache_write(cd->index, za->cdir_index_cache, &index_key);
+    }
+
     if (za->open_flags & ZIP_CHECKCONS) {
         bool ok;
 
         if (cd_buffer) {
-            ok = _zip_buffer_eof(cd_buffer);
+            ok = _zip_buffer_eof(cd_buffer) && unread == 0;
         }
         else {
             zip_int64_t offset = zip_source_tell(za->src);
@@ -413,25 +717,470 @@ _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_err
             return NULL;
         }
     }
-
     _zip_buffer_free(cd_buffer);
+
+    if (cd->index == NULL && cd->segments == NULL && !_zip_cdir_index_embedded_drop(cd, za->src, error)) {
+        _zip_cdir_free(cd);
+        return NULL;
+    }
+
     return cd;
 }
 
 
+/* cdir_read_segment:
+   Read the entries of an earlier SEGMENT of a log-structured central
+   directory into CD, starting at *INDEXP. */
+
+static bool
+cdir_read_segment(zip_t *za, zip_cdir_t *cd, const zip_cdir_segment_t *segment, zip_uint64_t *indexp, zip_error_t *error) {
+    zip_buffer_t *buffer;
+    zip_uint64_t i, left, unread, end;
+
+    if (zip_source_seek(za->src, (zip_int64_t)segment->offset, SEEK_SET) < 0) {
+        zip_error_set_from_source(error, za->src);
+        return false;
+    }
+
+    buffer = NULL;
+    unread = left = segment->size;
+    end = *indexp + segment->nentry;
+    for (i = *indexp; left > 0; i++) {
+        zip_int64_t entry_size;
+
+        if (i == end) {
+            break;
+        }
+        if (!cdir_buffer_fill(za->src, &buffer, &unread, error)) {
+            _zip_buffer_free(buffer);
+            return false;
+        }
+        if ((cd->entry[i].orig = _zip_dirent_new_arena(za->arena, error)) == NULL || (entry_size = _zip_dirent_read(cd->entry[i].orig, za->src, buffer, false, za->arena, error)) < 0) {
+            if (zip_error_code_zip(error) == ZIP_ER_INCONS) {
+                zip_error_set(error, ZIP_ER_INCONS, ADD_INDEX_TO_DETAIL(zip_error_code_system(error), i));
+            }
+            _zip_buffer_free(buffer);
+            return false;
+        }
+        if ((zip_uint64_t)entry_size > left) {
+            break;
+        }
+        left -= (zip_uint64_t)entry_size;
+    }
+    _zip_buffer_free(buffer);
+
+    if (i != end || left > 0) {
+        zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_WRONG_ENTRIES_COUNT);
+        return false;
+    }
+
+    *indexp = end;
+    return true;
+}
+
+
+/* cdir_index_key:
+   Compute key identifying central directory CD for the index cache.
+   BUFFER contains the end of the archive, starting at BUF_OFFSET. */
+
+static bool
+cdir_index_key(zip_t *za, const zip_cdir_t *cd, zip_buffer_t *buffer, zip_uint64_t buf_offset, zip_cdir_index_key_t *key, zip_error_t *error) {
+    zip_stat_t st;
+
+    zip_stat_init(&st);
+    if (zip_source_stat(za->src, &st) < 0) {
+        zip_error_set_from_source(error, za->src);
+        return false;
+    }
+
+    key->archive_size = (st.valid & ZIP_STAT_SIZE) ? st.size : 0;
+    key->archive_mtime = (st.valid & ZIP_STAT_MTIME) ? (zip_int64_t)st.mtime : -1;
+    key->cdir_offset = cd->offset;
+    key->cdir_size = cd->size;
+
+    if (cd->offset >= buf_offset) {
+        /* central directory was checked to be before EOCD, so it is in buffer */
+        key->cdir_crc = _zip_crc32(0, _zip_buffer_data(buffer) + (cd->offset - buf_offset), cd->size);
+    }
+    else {
+        zip_uint8_t *data;
+        zip_uint64_t left = cd->size;
+
+        if ((data = (zip_uint8_t *)_zip_malloc(CDIR_READ_SIZE)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        if (zip_source_seek(za->src, (zip_int64_t)cd->offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(error, za->src);
+            _zip_free(data);
+            return false;
+        }
+        key->cdir_crc = 0;
+        while (left > 0) {
+            zip_uint64_t n = ZIP_MIN(left, CDIR_READ_SIZE);
+
+            if (_zip_read(za->src, data, n, error) < 0) {
+                _zip_free(data);
+                return false;
+            }
+            key->cdir_crc = _zip_crc32(key->cdir_crc, data, n);
+            left -= n;
+        }
+        _zip_free(data);
+    }
+
+    return true;
+}
+
+
+/* cdir_buffer_fill:
+   Make sure *BUFFERP contains the next central directory entry, by
+   reading the next chunk of the central directory from SRC if
+   necessary. *UNREAD is the number of bytes not read yet. */
+
+static bool
+cdir_buffer_fill(zip_source_t *src, zip_buffer_t **bufferp, zip_uint64_t *unread, zip_error_t *error) {
+    zip_buffer_t *buffer;
+    zip_uint64_t left, length;
+
+    left = *bufferp ? _zip_buffer_left(*bufferp) : 0;
+    if (*unread == 0 || left >= CDENTRY_MAX_SIZE) {
+        return true;
+    }
+
+    length = ZIP_MIN(*unread, ZIP_MAX(CDIR_READ_SIZE, CDENTRY_MAX_SIZE - left));
+    if ((buffer = _zip_buffer_new(NULL, left + length)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    if (left > 0) {
+        (void)memcpy_s(_zip_buffer_data(buffer), left, _zip_buffer_get(*bufferp, left), left);
+    }
+    if (_zip_read(src, _zip_buffer_data(buffer) + left, length, error) < 0) {
+        _zip_buffer_free(buffer);
+        return false;
+    }
+
+    _zip_buffer_free(*bufferp);
+    *bufferp = buffer;
+    *unread -= length;
+
+    return true;
+}
+
+
+#ifdef HAVE_THREADS
+/* parse of a contiguous range of central directory entries */
+typedef struct {
+    zip_thread_job_t job;
+    zip_cdir_t *cd;
+    const zip_uint8_t *data; /* start of first entry */
+    zip_uint64_t length;     /* length of entries */
+    zip_uint64_t first;
+    zip_uint64_t last;
+    zip_arena_t *arena;
+    bool ok;
+} cdir_job_t;
+
+static void
+cdir_job_run(void *ud) {
+    cdir_job_t *job = (cdir_job_t *)ud;
+    zip_buffer_t buffer;
+    zip_error_t error;
+    zip_uint64_t i;
+
+    zip_error_init(&error);
+    _zip_buffer_init(&buffer, (zip_uint8_t *)job->data, job->length);
+    job->ok = true;
+
+    /* stops at first problem, serial parse reports it */
+    for (i = job->first; i < job->last; i++) {
+        if ((job->cd->entry[i].orig = _zip_dirent_new_arena(job->arena, &error)) == NULL || _zip_dirent_read(job->cd->entry[i].orig, NULL, &buffer, false, job->arena, &error) < 0) {
+            job->ok = false;
+            break;
+        }
+    }
+
+    zip_error_fini(&error);
+}
+
+
+/* Parse the entries starting at *indexp that are completely contained in buffer in worker threads.
+   Entry boundaries are found from the lengths in the fixed part of each entry first, then
+   the ranges are parsed into arenas of their own, which are merged into the archive's arena.
+   Returns the number of bytes consumed, 0 if the entries have to be parsed serially, or -1 on error. */
+
+static zip_int64_t
+cdir_read_threaded(zip_t *za, zip_cdir_t *cd, zip_uint64_t *indexp, zip_uint64_t left, zip_buffer_t *buffer, zip_error_t *error) {
+    cdir_job_t jobs[CDIR_THREADS];
+    zip_thread_pool_t *pool;
+    const zip_uint8_t *data;
+    zip_uint64_t available, offset, n, max_entries, i, j;
+    bool ok;
+
+    data = _zip_buffer_data(buffer) + _zip_buffer_offset(buffer);
+    available = ZIP_MIN(_zip_buffer_left(buffer), left);
+    max_entries = cd->nentry - *indexp;
+
+    /* find entry boundaries, splitting the data into ranges of about equal length */
+    offset = 0;
+    n = 0;
+    j = 0;
+    while (n < max_entries && available - offset >= CDENTRYSIZE && memcmp(data + offset, CENTRAL_MAGIC, 4) == 0) {
+        zip_uint64_t size = CDENTRYSIZE + (zip_uint64_t)_zip_get_16(data + offset + 28) + _zip_get_16(data + offset + 30) + _zip_get_16(data + offset + 32);
+
+        if (size > available - offset) {
+            break;
+        }
+        while (j < CDIR_THREADS && offset >= j * (available / CDIR_THREADS)) {
+            jobs[j].first = *indexp + n;
+            jobs[j].data = data + offset;
+            j++;
+        }
+        offset += size;
+        n++;
+    }
+    if (n < CDIR_THREADS * CDIR_MIN_ENTRIES_PER_THREAD) {
+        return 0;
+    }
+    for (; j < CDIR_THREADS; j++) {
+        jobs[j].first = *indexp + n;
+        jobs[j].data = data + offset;
+    }
+    for (j = 0; j < CDIR_THREADS; j++) {
+        jobs[j].last = j + 1 < CDIR_THREADS ? jobs[j + 1].first : *indexp + n;
+        jobs[j].length = (zip_uint64_t)((j + 1 < CDIR_THREADS ? jobs[j + 1].data : data + offset) - jobs[j].data);
+    }
+
+    for (j = 0; j < CDIR_THREADS; j++) {
+        if ((jobs[j].arena = _zip_arena_new(NULL, error)) == NULL) {
+            while (j > 0) {
+                _zip_arena_free(jobs[--j].arena);
+            }
+            return -1;
+        }
+    }
+    if ((pool = _zip_thread_pool_new(CDIR_THREADS, error)) == NULL) {
+        for (j = 0; j < CDIR_THREADS; j++) {
+            _zip_arena_free(jobs[j].arena);
+        }
+        return -1;
+    }
+
+    for (j = 0; j < CDIR_THREADS; j++) {
+        jobs[j].job.run = cdir_job_run;
+        jobs[j].job.ud = &jobs[j];
+        jobs[j].cd = cd;
+        _zip_thread_pool_submit(pool, &jobs[j].job);
+    }
+    ok = true;
+    for (j = 0; j < CDIR_THREADS; j++) {
+        _zip_thread_pool_wait(pool, &jobs[j].job);
+        ok = ok && jobs[j].ok;
+    }
+    _zip_thread_pool_free(pool);
+
+    for (j = 0; j < CDIR_THREADS && ok; j++) {
+        if (!_zip_arena_merge(za->arena, jobs[j].arena, error)) {
+            break;
+        }
+        jobs[j].arena = NULL;
+    }
+    if (j < CDIR_THREADS) {
+        for (i = *indexp; i < *indexp + n; i++) {
+            _zip_dirent_free(cd->entry[i].orig);
+            cd->entry[i].orig = NULL;
+        }
+        for (; j < CDIR_THREADS; j++) {
+            _zip_arena_free(jobs[j].arena);
+        }
+        return ok ? -1 : 0;
+    }
+
+    _zip_buffer_skip(buffer, offset);
+    *indexp += n;
+
+    return (zip_int64_t)offset;
+}
+#endif
+
+
 /* _zip_checkcons:
    Checks the consistency of the central directory by comparing central
    directory entries with local headers and checking for plausible
    file and header offsets. Returns -1 if not plausible, else the
    difference between the lowest and the highest fileposition reached */
 
+typedef struct {
+    zip_uint64_t offset;
+    zip_uint64_t index;
+} entry_offset_t;
+
+static int
+entry_offset_compare(const void *a, const void *b) {
+    const entry_offset_t *ea = (const entry_offset_t *)a;
+    const entry_offset_t *eb = (const entry_offset_t *)b;
+
+    if (ea->offset != eb->offset) {
+        return ea->offset < eb->offset ? -1 : 1;
+    }
+    return ea->index < eb->index ? -1 : (ea->index > eb->index ? 1 : 0);
+}
+
+
+#ifdef HAVE_THREADS
+/* with ZIP_THREADSAFE, local headers of archives with enough entries are checked in worker threads */
+#define CHECKCONS_THREADS 4
+#define CHECKCONS_MIN_ENTRIES_PER_THREAD 1024
+
+/* check of a contiguous range of entries in file order */
+typedef struct {
+    zip_thread_job_t job;
+    zip_cdir_t *cd;
+    const zip_reader_t *reader;
+    const entry_offset_t *order;
+    zip_uint64_t first;
+    zip_uint64_t last;
+    zip_extra_field_t **extra_fields; /* local extra fields, by entry index */
+    zip_uint32_t *header_size;        /* by entry index */
+    bool ok;
+} checkcons_job_t;
+
+static void
+checkcons_job_run(void *ud) {
+    checkcons_job_t *job = (checkcons_job_t *)ud;
+    struct zip_dirent temp;
+    zip_uint8_t *window;
+    zip_uint64_t window_offset, window_length, j;
+    zip_error_t error;
+
+    zip_error_init(&error);
+    window = NULL;
+    window_offset = window_length = 0;
+    job->ok = true;
+
+    /* stops at first problem, serial check reports it */
+    for (j = job->first; j < job->last; j++) {
+        zip_uint64_t offset = job->order[j].offset;
+        zip_uint64_t i = job->order[j].index;
+        zip_buffer_t buffer;
+        zip_int64_t ret;
+
+        if (!_zip_local_header_window_fill(NULL, job->reader, &window, &window_offset, &window_length, offset, &error) || _zip_local_header_length(window, window_offset, window_length, offset) == 0) {
+            job->ok = false;
+            break;
+        }
+        _zip_buffer_init(&buffer, window + (offset - window_offset), window_length - (offset - window_offset));
+        _zip_dirent_init(&temp);
+        if ((ret = _zip_dirent_read(&temp, NULL, &buffer, true, NULL, &error)) < 0 || _zip_headercomp(job->cd->entry[i].orig, &temp) != 0) {
+            _zip_dirent_finalize(&temp);
+            job->ok = false;
+            break;
+        }
+        job->extra_fields[i] = temp.extra_fields;
+        job->header_size[i] = (zip_uint32_t)ret;
+        temp.extra_fields = NULL;
+        _zip_dirent_finalize(&temp);
+    }
+
+    _zip_free(window);
+    zip_error_fini(&error);
+}
+
+
+/* Check local headers in worker threads and merge their extra fields into cd.
+   Returns 1 if all entries were checked, 0 if one failed and the archive has
+   to be checked serially for the exact error, -1 on error. */
+
+static int
+_zip_checkcons_threaded(zip_t *za, zip_cdir_t *cd, const entry_offset_t *order, zip_error_t *error) {
+    checkcons_job_t jobs[CHECKCONS_THREADS];
+    zip_thread_pool_t *pool;
+    zip_extra_field_t **extra_fields;
+    zip_uint32_t *header_size;
+    zip_uint64_t i, per_job;
+    bool ok;
+
+    if (cd->nentry > SIZE_MAX / sizeof(extra_fields[0])) {
+        return 0;
+    }
+    if ((extra_fields = (zip_extra_field_t **)_zip_calloc((size_t)cd->nentry, sizeof(extra_fields[0]))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    if ((header_size = (zip_uint32_t *)_zip_malloc(sizeof(header_size[0]) * (size_t)cd->nentry)) == NULL) {
+        _zip_free(extra_fields);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    if ((pool = _zip_thread_pool_new(CHECKCONS_THREADS, error)) == NULL) {
+        _zip_free(header_size);
+        _zip_free(extra_fields);
+        return -1;
+    }
+
+    per_job = (cd->nentry + CHECKCONS_THREADS - 1) / CHECKCONS_THREADS;
+    for (i = 0; i < CHECKCONS_THREADS; i++) {
+        jobs[i].job.run = checkcons_job_run;
+        jobs[i].job.ud = &jobs[i];
+        jobs[i].cd = cd;
+        jobs[i].reader = &za->reader;
+        jobs[i].order = order;
+        jobs[i].first = ZIP_MIN(i * per_job, cd->nentry);
+        jobs[i].last = ZIP_MIN((i + 1) * per_job, cd->nentry);
+        jobs[i].extra_fields = extra_fields;
+        jobs[i].header_size = header_size;
+        _zip_thread_pool_submit(pool, &jobs[i].job);
+    }
+
+    ok = true;
+    for (i = 0; i < CHECKCONS_THREADS; i++) {
+        _zip_thread_pool_wait(pool, &jobs[i].job);
+        ok = ok && jobs[i].ok;
+    }
+    _zip_thread_pool_free(pool);
+
+    for (i = 0; i < cd->nentry; i++) {
+        zip_dirent_t *de = cd->entry[i].orig;
+
+        if (!ok || !_zip_dirent_parse_extra_fields(de, za->arena, error)) {
+            break;
+        }
+        de->extra_fields = _zip_ef_merge(de->extra_fields, extra_fields[i]);
+        de->local_extra_fields_read = 1;
+        de->local_header_size = header_size[i];
+    }
+    if (i < cd->nentry) {
+        for (; i < cd->nentry; i++) {
+            _zip_ef_free(extra_fields[i]);
+        }
+        _zip_free(header_size);
+        _zip_free(extra_fields);
+        return ok ? -1 : 0;
+    }
+
+    _zip_free(header_size);
+    _zip_free(extra_fields);
+
+    return 1;
+}
+#endif
+
+
 static zip_int64_t
 _zip_checkcons(zip_t *za, zip_cdir_t *cd, zip_error_t *error) {
     zip_uint64_t i;
     zip_uint64_t min, max, j;
     struct zip_dirent temp;
+    entry_offset_t *order;
+    zip_uint8_t *window;
+    zip_uint64_t window_offset, window_length;
+
+    /* entries not read yet are needed for checks */
+    if (!_zip_cdir_index_read_all(cd, za->src, za->arena, error)) {
+        return -1;
+    }
 
-    _zip_dirent_init(&temp);
     if (cd->nentry) {
         max = cd->entry[0].orig->offset;
         min = cd->entry[0].orig->offset;
@@ -454,33 +1203,108 @@ _zip_checkcons(zip_t *za, zip_cdir_t *cd, zip_error_t *error) {
             zip_error_set(error, ZIP_ER_NOZIP, 0);
             return -1;
         }
+    }
 
-        if (zip_source_seek(za->src, (zip_int64_t)cd->entry[i].orig->offset, SEEK_SET) < 0) {
-            zip_error_set_from_source(error, za->src);
+    if (cd->nentry == 0) {
+        return (zip_int64_t)(max - min);
+    }
+
+    /* read local headers in file order, so headers close to each other are read together */
+    if ((order = (entry_offset_t *)_zip_malloc(sizeof(order[0]) * (size_t)cd->nentry)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    for (i = 0; i < cd->nentry; i++) {
+        order[i].offset = cd->entry[i].orig->offset;
+        order[i].index = i;
+    }
+    qsort(order, (size_t)cd->nentry, sizeof(order[0]), entry_offset_compare);
+
+#ifdef HAVE_THREADS
+    if ((za->open_flags & ZIP_THREADSAFE) && cd->nentry >= 2 * CHECKCONS_MIN_ENTRIES_PER_THREAD) {
+        int ok = _zip_checkcons_threaded(za, cd, order, error);
+
+        if (ok != 0) {
+            _zip_free(order);
+            if (ok < 0) {
+                return -1;
+            }
+            return (max - min) < ZIP_INT64_MAX ? (zip_int64_t)(max - min) : ZIP_INT64_MAX;
+        }
+    }
+#endif
+
+    _zip_dirent_init(&temp);
+    window = NULL;
+    window_offset = window_length = 0;
+
+    for (j = 0; j < cd->nentry; j++) {
+        zip_buffer_t *buffer;
+        zip_int64_t ret;
+
+        i = order[j].index;
+
+        if (!_zip_local_header_window_fill(za->src, NULL, &window, &window_offset, &window_length, order[j].offset, error)) {
+            _zip_free(window);
+            _zip_free(order);
             return -1;
         }
+        if (_zip_local_header_length(window, window_offset, window_length, order[j].offset) > 0) {
+            if ((buffer = _zip_buffer_new(window + (order[j].offset - window_offset), window_length - (order[j].offset - window_offset))) == NULL) {
+                zip_error_set(error, ZIP_ER_MEMORY, 0);
+                _zip_free(window);
+                _zip_free(order);
+                return -1;
+            }
+            ret = _zip_dirent_read(&temp, za->src, buffer, true, NULL, error);
+            _zip_buffer_free(buffer);
+        }
+        else {
+            /* header truncated by end of file, read directly for proper error */
+            if (zip_source_seek(za->src, (zip_int64_t)order[j].offset, SEEK_SET) < 0) {
+                zip_error_set_from_source(error, za->src);
+                _zip_free(window);
+                _zip_free(order);
+                return -1;
+            }
+            ret = _zip_dirent_read(&temp, za->src, NULL, true, NULL, error);
+        }
 
-        if (_zip_dirent_read(&temp, za->src, NULL, true, error) == -1) {
+        if (ret == -1) {
 	    if (zip_error_code_zip(error) == ZIP_ER_INCONS) {
 		zip_error_set(error, ZIP_ER_INCONS, ADD_INDEX_TO_DETAIL(zip_error_code_system(error), i));
 	    }
             _zip_dirent_finalize(&temp);
+            _zip_free(window);
+            _zip_free(order);
             return -1;
         }
 
         if (_zip_headercomp(cd->entry[i].orig, &temp) != 0) {
             zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_ENTRY_HEADER_MISMATCH, i));
             _zip_dirent_finalize(&temp);
+            _zip_free(window);
+            _zip_free(order);
             return -1;
         }
 
+        if (!_zip_dirent_parse_extra_fields(cd->entry[i].orig, za->arena, error)) {
+            _zip_dirent_finalize(&temp);
+            _zip_free(window);
+            _zip_free(order);
+            return -1;
+        }
         cd->entry[i].orig->extra_fields = _zip_ef_merge(cd->entry[i].orig->extra_fields, temp.extra_fields);
         cd->entry[i].orig->local_extra_fields_read = 1;
+        cd->entry[i].orig->local_header_size = (zip_uint32_t)ret;
         temp.extra_fields = NULL;
 
         _zip_dirent_finalize(&temp);
     }
 
+    _zip_free(window);
+    _zip_free(order);
+
     return (max - min) < ZIP_INT64_MAX ? (zip_int64_t)(max - min) : ZIP_INT64_MAX;
 }
 
@@ -489,7 +1313,7 @@ _zip_checkcons(zip_t *za, zip_cdir_t *cd, zip_error_t *error) {
    compares a central directory entry and a local file header
    Return 0 if they are consistent, -1 if not. */
 
-static int
+int
 _zip_headercomp(const zip_dirent_t *central, const zip_dirent_t *local) {
     if ((central->version_needed < local->version_needed)
 #if 0
@@ -497,7 +1321,7 @@ _zip_headercomp(const zip_dirent_t *central, const zip_dirent_t *local) {
 	   and global headers for the bitflags */
 	|| (central->bitflags != local->bitflags)
 #endif
-        || (central->comp_method != local->comp_method) || (central->last_mod != local->last_mod) || !_zip_string_equal(central->filename, local->filename))
+        || (central->comp_method != local->comp_method) || (central->dos_time != local->dos_time || central->dos_date != local->dos_date) || !_zip_string_equal(central->filename, local->filename))
         return -1;
 
     if ((central->crc != local->crc) || (central->comp_size != local->comp_size) || (central->uncomp_size != local->uncomp_size)) {
@@ -530,11 +1354,20 @@ _zip_allocate_new(zip_source_t *src, unsigned int flags, zip_error_t *error) {
         return NULL;
     }
 
+    if (flags & ZIP_COLLECT_STATS) {
+        if ((za->stats = (zip_phase_stats_t *)_zip_calloc(ZIP_PHASE_COUNT, sizeof(za->stats[0]))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            zip_discard(za);
+            return NULL;
+        }
+    }
+
     za->src = src;
     za->open_flags = flags;
     za->flags = 0;
     za->ch_flags = 0;
     za->write_crc = NULL;
+    za->cdir_index = NULL;
 
     if (flags & ZIP_RDONLY) {
         za->flags |= ZIP_AFL_RDONLY;
@@ -545,6 +1378,50 @@ _zip_allocate_new(zip_source_t *src, unsigned int flags, zip_error_t *error) {
 }
 
 
+/* Set up reading file data without using the read position of the archive source, and, for ZIP_THREADSAFE, serializing access to metadata. */
+static bool
+_zip_open_threadsafe(zip_t *za, zip_error_t *error) {
+    if (!_zip_reader_init(&za->reader, za->src)) {
+        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+        return false;
+    }
+#ifdef HAVE_THREADS
+    if ((za->open_flags & ZIP_THREADSAFE) && (za->mutex = _zip_mutex_new(error)) == NULL) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+
+/* Do all work that is otherwise done when metadata is first used, so reading the archive doesn't change it.
+   This keeps the memory pages holding it shared between processes forked after opening. */
+static bool
+_zip_open_forksafe(zip_t *za, zip_error_t *error) {
+    zip_uint64_t idx;
+
+    for (idx = 0; idx < za->nentry; idx++) {
+        zip_dirent_t *de = za->entry[idx].orig;
+
+        if (de == NULL) {
+            continue;
+        }
+        if (!_zip_dirent_parse_extra_fields(de, za->arena, error)) {
+            return false;
+        }
+        /* guess encoding and convert to UTF-8 as needed for any flags */
+        if (_zip_string_get(de->filename, NULL, ZIP_FL_ENC_STRICT, error) == NULL || _zip_string_get(de->comment, NULL, ZIP_FL_ENC_STRICT, error) == NULL) {
+            return false;
+        }
+    }
+    if (_zip_string_get(za->comment_orig, NULL, ZIP_FL_ENC_STRICT, error) == NULL) {
+        return false;
+    }
+
+    return true;
+}
+
+
 /*
  * tests for file existence
  */
@@ -576,6 +1453,8 @@ _zip_find_central_dir(zip_t *za, zip_uint64_t len) {
     zip_int64_t best;
     zip_error_t error;
     zip_buffer_t *buffer;
+    zip_uint64_t skipped_offset = 0;
+    bool skipped;
 
     if (len < EOCDLEN) {
         zip_error_set(&za->error, ZIP_ER_NOZIP, 0);
@@ -607,42 +1486,60 @@ _zip_find_central_dir(zip_t *za, zip_uint64_t len) {
         _zip_buffer_set_offset(buffer, EOCD64LOCLEN);
     }
     zip_error_set(&error, ZIP_ER_NOZIP, 0);
+    skipped = false;
 
     match = _zip_buffer_get(buffer, 0);
     /* The size of buffer never greater than CDBUFSIZE. */
-    while (_zip_buffer_left(buffer) >= EOCDLEN && (match = _zip_memmem(match, (size_t)_zip_buffer_left(buffer) - (EOCDLEN - 4), (const unsigned char *)EOCD_MAGIC, 4)) != NULL) {
-        _zip_buffer_set_offset(buffer, (zip_uint64_t)(match - _zip_buffer_data(buffer)));
-        if ((cdirnew = _zip_read_cdir(za, buffer, (zip_uint64_t)buf_offset, &error)) != NULL) {
-            if (cdir) {
-                if (best <= 0) {
-                    best = _zip_checkcons(za, cdir, &error);
-                }
-
-                a = _zip_checkcons(za, cdirnew, &error);
-                if (best < a) {
-                    _zip_cdir_free(cdir);
-                    cdir = cdirnew;
-                    best = a;
-                }
-                else {
-                    _zip_cdir_free(cdirnew);
+    while (_zip_buffer_left(buffer) >= EOCDLEN && (match = _zip_find_eocd_magic(match, (size_t)_zip_buffer_left(buffer) - (EOCDLEN - 4))) != NULL) {
+        zip_uint64_t eocd_offset = (zip_uint64_t)(match - _zip_buffer_data(buffer));
+
+        /* reading the central directory is expensive, weed out signatures in comments or file data first */
+        if (!(skipped = !_zip_eocd_plausible(buffer, eocd_offset, (zip_uint64_t)buf_offset))) {
+            _zip_buffer_set_offset(buffer, eocd_offset);
+            if ((cdirnew = _zip_read_cdir(za, buffer, (zip_uint64_t)buf_offset, &error)) != NULL) {
+                if (cdir) {
+                    if (best <= 0) {
+                        best = _zip_checkcons(za, cdir, &error);
+                    }
+
+                    a = _zip_checkcons(za, cdirnew, &error);
+                    if (best < a) {
+                        _zip_cdir_free(cdir);
+                        cdir = cdirnew;
+                        best = a;
+                    }
+                    else {
+                        _zip_cdir_free(cdirnew);
+                    }
                 }
-            }
-            else {
-                cdir = cdirnew;
-                if (za->open_flags & ZIP_CHECKCONS)
-                    best = _zip_checkcons(za, cdir, &error);
                 else {
-                    best = 0;
+                    cdir = cdirnew;
+                    if (za->open_flags & ZIP_CHECKCONS)
+                        best = _zip_checkcons(za, cdir, &error);
+                    else {
+                        best = 0;
+                    }
                 }
+                cdirnew = NULL;
             }
-            cdirnew = NULL;
+        }
+        else {
+            skipped_offset = eocd_offset;
         }
 
         match++;
         _zip_buffer_set_offset(buffer, (zip_uint64_t)(match - _zip_buffer_data(buffer)));
     }
 
+    if (cdir == NULL && skipped) {
+        /* report the error of the last candidate, as if it had been read */
+        _zip_buffer_set_offset(buffer, skipped_offset);
+        cdir = _zip_read_cdir(za, buffer, (zip_uint64_t)buf_offset, &error);
+        if (cdir != NULL) {
+            best = (za->open_flags & ZIP_CHECKCONS) ? _zip_checkcons(za, cdir, &error) : 0;
+        }
+    }
+
     _zip_buffer_free(buffer);
 
     if (best < 0) {
@@ -655,35 +1552,80 @@ _zip_find_central_dir(zip_t *za, zip_uint64_t len) {
 }
 
 
-static const unsigned char *_zip_memmem(const unsigned char *big, size_t biglen, const unsigned char *little, size_t littlelen) {
-    const unsigned char *p;
+/* _zip_eocd_plausible:
+   cheaply check the end of central directory record at eocd_offset in buffer,
+   returning false only if _zip_read_cdir would reject it */
+
+static bool
+_zip_eocd_plausible(zip_buffer_t *buffer, zip_uint64_t eocd_offset, zip_uint64_t buf_offset) {
+    const zip_uint8_t *data = _zip_buffer_data(buffer);
+    zip_uint64_t nentry_disk, nentry, size, offset;
+    zip_uint16_t comment_len;
+
+    _zip_buffer_set_offset(buffer, eocd_offset + 20);
+    comment_len = _zip_buffer_get_16(buffer);
+    if (_zip_buffer_size(buffer) - (eocd_offset + EOCDLEN) < comment_len) {
+        return false;
+    }
+
+    if (eocd_offset >= EOCD64LOCLEN && memcmp(data + eocd_offset - EOCD64LOCLEN, EOCD64LOC_MAGIC, 4) == 0) {
+        /* Zip64 records are checked when read */
+        return true;
+    }
 
-    if (littlelen == 0) {
-        return big;
+    _zip_buffer_set_offset(buffer, eocd_offset + 4);
+    if (_zip_buffer_get_16(buffer) != 0 || _zip_buffer_get_16(buffer) != 0) {
+        /* offsets of split archives are relative to their volume */
+        return true;
     }
+    nentry_disk = _zip_buffer_get_16(buffer);
+    nentry = _zip_buffer_get_16(buffer);
+    size = _zip_buffer_get_32(buffer);
+    offset = _zip_buffer_get_32(buffer);
+
+    if (nentry != nentry_disk || offset + size > buf_offset + eocd_offset) {
+        return false;
+    }
+    if (nentry > 0 && size >= 4 && offset >= buf_offset && memcmp(data + (offset - buf_offset), CENTRAL_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    return true;
+}
+
+
+/* _zip_find_eocd_magic:
+   find the first end of central directory signature in data.
+   memchr is vectorized by the C library; searching for the third byte
+   of the signature instead of 'P' avoids stopping at every 'P' in
+   textual comments. */
+
+static const zip_uint8_t *
+_zip_find_eocd_magic(const zip_uint8_t *data, size_t length) {
+    const zip_uint8_t *p, *end;
 
-    if (biglen < littlelen) {
+    if (length < 4) {
         return NULL;
     }
 
-    p = big;
-    while (true) {
-        p = (const unsigned char *)memchr(p, little[0], biglen - (littlelen - 1) - (size_t)(p - big));
-        if (p == NULL) {
-            return NULL;
-        }
-        if (memcmp(p + 1, little + 1, littlelen - 1) == 0) {
-            return p;
+    p = data + 2;
+    end = data + length - 1;
+    while ((p = (const zip_uint8_t *)memchr(p, EOCD_MAGIC[2], (size_t)(end - p))) != NULL) {
+        if (memcmp(p - 2, EOCD_MAGIC, 4) == 0) {
+            return p - 2;
         }
         p += 1;
     }
+
+    return NULL;
 }
 
 
 static zip_cdir_t *
-_zip_read_eocd(zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_error_t *error) {
+_zip_read_eocd(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_memory_budget_t *budget, zip_error_t *error) {
     zip_cdir_t *cd;
-    zip_uint64_t i, nentry, size, offset, eocd_offset;
+    zip_uint64_t i, nentry, size, offset, eocd_offset, volume_start;
+    zip_uint32_t this_disk, cdir_disk;
 
     if (_zip_buffer_left(buffer) < EOCDLEN) {
         zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_EOCD_LENGTH_INVALID);
@@ -694,23 +1636,29 @@ _zip_read_eocd(zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags
 
     _zip_buffer_get(buffer, 4); /* magic already verified */
 
-    if (_zip_buffer_get_32(buffer) != 0) {
-        zip_error_set(error, ZIP_ER_MULTIDISK, 0);
-        return NULL;
-    }
+    this_disk = _zip_buffer_get_16(buffer);
+    cdir_disk = _zip_buffer_get_16(buffer);
 
     /* number of cdir-entries on this disk */
     i = _zip_buffer_get_16(buffer);
     /* number of cdir-entries */
     nentry = _zip_buffer_get_16(buffer);
 
-    if (nentry != i) {
+    volume_start = 0;
+    if (this_disk != 0 || cdir_disk != 0) {
+        /* split archive, central directory offset is relative to its volume */
+        if (!_zip_source_volumes_start(src, cdir_disk, &volume_start)) {
+            zip_error_set(error, ZIP_ER_MULTIDISK, 0);
+            return NULL;
+        }
+    }
+    else if (nentry != i) {
         zip_error_set(error, ZIP_ER_NOZIP, 0);
         return NULL;
     }
 
     size = _zip_buffer_get_32(buffer);
-    offset = _zip_buffer_get_32(buffer);
+    offset = volume_start + _zip_buffer_get_32(buffer);
 
     if (offset + size < offset) {
         zip_error_set(error, ZIP_ER_SEEK, EFBIG);
@@ -728,7 +1676,7 @@ _zip_read_eocd(zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags
         return NULL;
     }
 
-    if ((cd = _zip_cdir_new(nentry, error)) == NULL)
+    if ((cd = _zip_cdir_new(nentry, budget, error)) == NULL)
         return NULL;
 
     cd->is_zip64 = false;
@@ -740,23 +1688,38 @@ _zip_read_eocd(zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags
 
 
 static zip_cdir_t *
-_zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_error_t *error) {
+_zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offset, unsigned int flags, zip_memory_budget_t *budget, zip_error_t *error) {
     zip_cdir_t *cd;
     zip_uint64_t offset;
     zip_uint8_t eocd[EOCD64LEN];
     zip_uint64_t eocd_offset;
-    zip_uint64_t size, nentry, i, eocdloc_offset;
+    zip_uint64_t size, record_size, nentry, i, eocdloc_offset, volume_start;
+    zip_uint64_t earlier_nentry, nsegments;
+    zip_cdir_segment_t *segments;
+    zip_buffer_t *tail = buffer;
     bool free_buffer;
-    zip_uint32_t num_disks, num_disks64, eocd_disk, eocd_disk64;
+    zip_uint32_t eocd_disk, this_disk, cdir_disk;
 
     eocdloc_offset = _zip_buffer_offset(buffer);
 
     _zip_buffer_get(buffer, 4); /* magic already verified */
 
-    num_disks = _zip_buffer_get_16(buffer);
-    eocd_disk = _zip_buffer_get_16(buffer);
+    eocd_disk = _zip_buffer_get_32(buffer);
     eocd_offset = _zip_buffer_get_64(buffer);
 
+    if (eocd_disk != 0) {
+        /* split archive, EOCD offset is relative to its volume */
+        if (!_zip_source_volumes_start(src, eocd_disk, &volume_start)) {
+            zip_error_set(error, ZIP_ER_MULTIDISK, 0);
+            return NULL;
+        }
+        if (eocd_offset > ZIP_UINT64_MAX - volume_start) {
+            zip_error_set(error, ZIP_ER_SEEK, EFBIG);
+            return NULL;
+        }
+        eocd_offset += volume_start;
+    }
+
     /* valid seek value for start of EOCD */
     if (eocd_offset > ZIP_INT64_MAX) {
         zip_error_set(error, ZIP_ER_SEEK, EFBIG);
@@ -794,7 +1757,7 @@ _zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offse
     }
 
     /* size of EOCD */
-    size = _zip_buffer_get_64(buffer);
+    record_size = size = _zip_buffer_get_64(buffer);
 
     /* is there a hole between EOCD and EOCD locator, or do they overlap? */
     if ((flags & ZIP_CHECKCONS) && size + eocd_offset + 12 != buf_offset + eocdloc_offset) {
@@ -807,26 +1770,20 @@ _zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offse
 
     _zip_buffer_get(buffer, 4); /* skip version made by/needed */
 
-    num_disks64 = _zip_buffer_get_32(buffer);
-    eocd_disk64 = _zip_buffer_get_32(buffer);
+    this_disk = _zip_buffer_get_32(buffer);
+    cdir_disk = _zip_buffer_get_32(buffer);
 
-    /* if eocd values are 0xffff, we have to use eocd64 values.
-       otherwise, if the values are not the same, it's inconsistent;
-       in any case, if the value is not 0, we don't support it */
-    if (num_disks == 0xffff) {
-        num_disks = num_disks64;
-    }
-    if (eocd_disk == 0xffff) {
-        eocd_disk = eocd_disk64;
-    }
-    if ((flags & ZIP_CHECKCONS) && (eocd_disk != eocd_disk64 || num_disks != num_disks64)) {
+    /* EOCD is on the disk the locator points to */
+    if ((flags & ZIP_CHECKCONS) && this_disk != eocd_disk) {
         zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_EOCD64_MISMATCH);
         if (free_buffer) {
             _zip_buffer_free(buffer);
         }
         return NULL;
     }
-    if (num_disks != 0 || eocd_disk != 0) {
+
+    volume_start = 0;
+    if ((this_disk != 0 || cdir_disk != 0) && !_zip_source_volumes_start(src, cdir_disk, &volume_start)) {
         zip_error_set(error, ZIP_ER_MULTIDISK, 0);
         if (free_buffer) {
             _zip_buffer_free(buffer);
@@ -834,10 +1791,12 @@ _zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offse
         return NULL;
     }
 
-    nentry = _zip_buffer_get_64(buffer);
+    /* number of cdir-entries on this disk */
     i = _zip_buffer_get_64(buffer);
+    /* number of cdir-entries */
+    nentry = _zip_buffer_get_64(buffer);
 
-    if (nentry != i) {
+    if (this_disk == 0 && cdir_disk == 0 && nentry != i) {
         zip_error_set(error, ZIP_ER_MULTIDISK, 0);
         if (free_buffer) {
             _zip_buffer_free(buffer);
@@ -861,10 +1820,11 @@ _zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offse
         _zip_buffer_free(buffer);
     }
 
-    if (offset > ZIP_INT64_MAX || offset + size < offset) {
+    if (offset > ZIP_INT64_MAX - volume_start || offset + volume_start + size < offset + volume_start) {
         zip_error_set(error, ZIP_ER_SEEK, EFBIG);
         return NULL;
     }
+    offset += volume_start;
     if (offset + size > buf_offset + eocd_offset) {
         /* cdir spans past EOCD record */
         zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_OVERLAPS_EOCD);
@@ -880,17 +1840,118 @@ _zip_read_eocd64(zip_source_t *src, zip_buffer_t *buffer, zip_uint64_t buf_offse
         return NULL;
     }
 
-    if ((cd = _zip_cdir_new(nentry, error)) == NULL)
+    segments = NULL;
+    nsegments = 0;
+    earlier_nentry = 0;
+    /* extensible data sector, which fits before EOCD locator, may list earlier segments of a log-structured central directory */
+    if (record_size > EOCD64LEN - 12 && this_disk == 0 && cdir_disk == 0 && record_size - (EOCD64LEN - 12) <= buf_offset + eocdloc_offset - (eocd_offset + EOCD64LEN)) {
+        if (!_zip_read_eocd64_segments(src, tail, buf_offset, eocd_offset + EOCD64LEN, record_size - (EOCD64LEN - 12), offset, &segments, &nsegments, &earlier_nentry, error)) {
+            return NULL;
+        }
+        if (segments != NULL) {
+            segments[nsegments - 1].offset = offset;
+            segments[nsegments - 1].size = size;
+            segments[nsegments - 1].nentry = nentry;
+        }
+    }
+
+    if ((cd = _zip_cdir_new(nentry + earlier_nentry, budget, error)) == NULL) {
+        _zip_free(segments);
         return NULL;
+    }
 
     cd->is_zip64 = true;
     cd->size = size;
     cd->offset = offset;
+    cd->segments = segments;
+    cd->nsegments = nsegments;
 
     return cd;
 }
 
 
+/* _zip_read_eocd64_segments:
+   Find list of earlier central directory segments in EXT_LENGTH bytes of
+   Zip64 extensible data at EXT_OFFSET and return them in SEGMENTSP, with
+   a slot for the segment found via the EOCD left at the end. */
+
+static bool
+_zip_read_eocd64_segments(zip_source_t *src, zip_buffer_t *tail, zip_uint64_t buf_offset, zip_uint64_t ext_offset, zip_uint64_t ext_length, zip_uint64_t cdir_offset, zip_cdir_segment_t **segmentsp, zip_uint64_t *nsegmentsp, zip_uint64_t *nentryp, zip_error_t *error) {
+    zip_buffer_t *buffer;
+    zip_cdir_segment_t *segments;
+    zip_uint64_t i, n, end, nentry;
+
+    if (ext_offset >= buf_offset && ext_offset + ext_length <= buf_offset + _zip_buffer_size(tail)) {
+        buffer = _zip_buffer_new(_zip_buffer_data(tail) + (ext_offset - buf_offset), ext_length);
+        if (buffer == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+    }
+    else {
+        if (zip_source_seek(src, (zip_int64_t)ext_offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(error, src);
+            return false;
+        }
+        if ((buffer = _zip_buffer_new_from_source(src, ext_length, NULL, error)) == NULL) {
+            return false;
+        }
+    }
+
+    segments = NULL;
+    n = 0;
+    nentry = 0;
+    while (_zip_buffer_left(buffer) >= 6) {
+        zip_uint16_t id = _zip_buffer_get_16(buffer);
+        zip_uint32_t length = _zip_buffer_get_32(buffer);
+
+        if (_zip_buffer_left(buffer) < length) {
+            /* not in header ID and size format, not written by us */
+            break;
+        }
+        if (id != EOCD64_EXT_CDIR_SEGMENTS || segments != NULL) {
+            _zip_buffer_skip(buffer, length);
+            continue;
+        }
+
+        if (length % EOCD64_EXT_CDIR_SEGMENT_SIZE != 0 || length == 0) {
+            zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_INVALID);
+            _zip_buffer_free(buffer);
+            return false;
+        }
+        n = length / EOCD64_EXT_CDIR_SEGMENT_SIZE;
+        if ((segments = (zip_cdir_segment_t *)_zip_malloc(sizeof(segments[0]) * (size_t)(n + 1))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            _zip_buffer_free(buffer);
+            return false;
+        }
+
+        end = 0;
+        for (i = 0; i < n; i++) {
+            segments[i].offset = _zip_buffer_get_64(buffer);
+            segments[i].size = _zip_buffer_get_64(buffer);
+            segments[i].nentry = _zip_buffer_get_64(buffer);
+
+            /* segments are in file order and before the last one */
+            if (segments[i].offset < end || segments[i].size > cdir_offset || segments[i].offset > cdir_offset - segments[i].size || segments[i].nentry > segments[i].size / CDENTRYSIZE) {
+                zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_INVALID);
+                _zip_free(segments);
+                _zip_buffer_free(buffer);
+                return false;
+            }
+            end = segments[i].offset + segments[i].size;
+            nentry += segments[i].nentry;
+        }
+    }
+    _zip_buffer_free(buffer);
+
+    *segmentsp = segments;
+    *nsegmentsp = segments != NULL ? n + 1 : 0;
+    *nentryp = nentry;
+    return true;
+}
+
+
 static int decode_hex(char c) {
     if (c >= '0' && c <= '9') {
         return c - '0';
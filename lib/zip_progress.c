@@ -45,28 +45,49 @@ struct zip_progress {
     void (*ud_progress_free)(void *);
     void *ud_progress;
 
+    zip_progress_bytes_callback callback_bytes;
+    void (*ud_bytes_free)(void *);
+    void *ud_bytes;
+
     zip_cancel_callback callback_cancel;
     void (*ud_cancel_free)(void *);
     void *ud_cancel;
 
     double precision;
+    double precision_bytes;
 
     /* state */
-    double last_update; /* last value callback function was called with */
+    double last_update;       /* last value callback function was called with */
+    double last_update_bytes; /* fraction done when bytes callback was last called */
+
+    zip_uint64_t total; /* bytes of data processed by whole operation */
+    zip_uint64_t start; /* start of sub-progress section, in bytes */
+    zip_uint64_t end;   /* end of sub-progress section, in bytes */
+
+    zip_uint64_t last_bytes; /* bytes done when bytes callback was last called */
+    zip_uint64_t last_time;  /* time bytes callback was last called, in nanoseconds */
+    double throughput;       /* bytes per second since the call before that */
 
-    double start; /* start of sub-progress section */
-    double end;   /* end of sub-progress section */
+    zip_uint64_t last_check_bytes; /* bytes done when callbacks were last considered, see zip_set_progress_interval() */
+    zip_uint64_t last_check_time;  /* time callbacks were last considered, in nanoseconds */
 };
 
+static void _zip_progress_free_bytes_callback(zip_progress_t *progress);
 static void _zip_progress_free_cancel_callback(zip_progress_t *progress);
 static void _zip_progress_free_progress_callback(zip_progress_t *progress);
+static void _zip_progress_free_unused(zip_t *za);
 static zip_progress_t *_zip_progress_new(zip_t *za);
+static int _zip_progress_report(zip_progress_t *progress, zip_uint64_t done, double current, bool force);
 static void _zip_progress_set_cancel_callback(zip_progress_t *progress, zip_cancel_callback callback, void (*ud_free)(void *), void *ud);
 static void _zip_progress_set_progress_callback(zip_progress_t *progress, double precision, zip_progress_callback callback, void (*ud_free)(void *), void *ud);
 
 void
 _zip_progress_end(zip_progress_t *progress) {
-    _zip_progress_update(progress, 1.0);
+    if (progress == NULL) {
+        return;
+    }
+
+    (void)_zip_progress_report(progress, progress->total, 1.0, true);
 }
 
 
@@ -77,15 +98,16 @@ _zip_progress_free(zip_progress_t *progress) {
     }
 
     _zip_progress_free_progress_callback(progress);
+    _zip_progress_free_bytes_callback(progress);
     _zip_progress_free_cancel_callback(progress);
 
-    free(progress);
+    _zip_free(progress);
 }
 
 
 static zip_progress_t *
 _zip_progress_new(zip_t *za) {
-    zip_progress_t *progress = (zip_progress_t *)malloc(sizeof(*progress));
+    zip_progress_t *progress = (zip_progress_t *)_zip_malloc(sizeof(*progress));
 
     if (progress == NULL) {
         zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
@@ -99,6 +121,15 @@ _zip_progress_new(zip_t *za) {
     progress->ud_progress = NULL;
     progress->precision = 0.0;
 
+    progress->callback_bytes = NULL;
+    progress->ud_bytes_free = NULL;
+    progress->ud_bytes = NULL;
+    progress->precision_bytes = 0.0;
+
+    progress->total = 0;
+    progress->start = 0;
+    progress->end = 0;
+
     progress->callback_cancel = NULL;
     progress->ud_cancel_free = NULL;
     progress->ud_cancel = NULL;
@@ -117,6 +148,17 @@ _zip_progress_free_progress_callback(zip_progress_t *progress) {
     progress->ud_progress_free = NULL;
 }
 
+static void
+_zip_progress_free_bytes_callback(zip_progress_t *progress) {
+    if (progress->ud_bytes_free) {
+        progress->ud_bytes_free(progress->ud_bytes);
+    }
+
+    progress->callback_bytes = NULL;
+    progress->ud_bytes = NULL;
+    progress->ud_bytes_free = NULL;
+}
+
 static void
 _zip_progress_free_cancel_callback(zip_progress_t *progress) {
     if (progress->ud_cancel_free) {
@@ -138,6 +180,15 @@ _zip_progress_set_progress_callback(zip_progress_t *progress, double precision,
     progress->precision = precision;
 }
 
+/* Free progress of za if no callback is left. */
+static void
+_zip_progress_free_unused(zip_t *za) {
+    if (za->progress != NULL && za->progress->callback_progress == NULL && za->progress->callback_bytes == NULL && za->progress->callback_cancel == NULL) {
+        _zip_progress_free(za->progress);
+        za->progress = NULL;
+    }
+}
+
 void
 _zip_progress_set_cancel_callback(zip_progress_t *progress, zip_cancel_callback callback, void (*ud_free)(void *), void *ud) {
     _zip_progress_free_cancel_callback(progress);
@@ -147,17 +198,32 @@ _zip_progress_set_cancel_callback(zip_progress_t *progress, zip_cancel_callback
     progress->ud_cancel = ud;
 }
 
+/* Start operation processing total bytes of data. */
 int
-_zip_progress_start(zip_progress_t *progress) {
+_zip_progress_start(zip_progress_t *progress, zip_uint64_t total) {
     if (progress == NULL) {
         return 0;
     }
 
+    progress->total = total;
+    progress->start = 0;
+    progress->end = total;
+    progress->last_check_bytes = 0;
+    progress->last_check_time = _zip_stats_time();
+
     if (progress->callback_progress != NULL) {
         progress->last_update = 0.0;
         progress->callback_progress(progress->za, 0.0, progress->ud_progress);
     }
 
+    if (progress->callback_bytes != NULL) {
+        progress->last_update_bytes = 0.0;
+        progress->last_bytes = 0;
+        progress->last_time = _zip_stats_time();
+        progress->throughput = 0.0;
+        progress->callback_bytes(progress->za, 0, total, 0.0, progress->ud_bytes);
+    }
+
     if (progress->callback_cancel != NULL) {
         if (progress->callback_cancel(progress->za, progress->ud_cancel)) {
             return -1;
@@ -168,35 +234,83 @@ _zip_progress_start(zip_progress_t *progress) {
 }
 
 
+/* Set section of operation that following updates refer to, from byte start to end. */
 int
-_zip_progress_subrange(zip_progress_t *progress, double start, double end) {
+_zip_progress_subrange(zip_progress_t *progress, zip_uint64_t start, zip_uint64_t end) {
     if (progress == NULL) {
         return 0;
     }
 
-    progress->start = start;
-    progress->end = end;
+    progress->start = ZIP_MIN(start, progress->total);
+    progress->end = ZIP_MAX(ZIP_MIN(end, progress->total), progress->start);
 
-    return _zip_progress_update(progress, 0.0);
+    /* callbacks are always considered at the start of a section, so cancelling takes effect between entries */
+    return _zip_progress_report(progress, progress->start, progress->total > 0 ? (double)progress->start / (double)progress->total : 0.0, true);
 }
 
+
+/* Report sub_current as fraction done of current section. */
 int
 _zip_progress_update(zip_progress_t *progress, double sub_current) {
-    double current;
+    zip_uint64_t done;
 
     if (progress == NULL) {
         return 0;
     }
 
-    if (progress->callback_progress != NULL) {
-        current = ZIP_MIN(ZIP_MAX(sub_current, 0.0), 1.0) * (progress->end - progress->start) + progress->start;
+    done = progress->start + (zip_uint64_t)(ZIP_MIN(ZIP_MAX(sub_current, 0.0), 1.0) * (double)(progress->end - progress->start));
+
+    /* always check at end of subrange, so entry boundaries are reported */
+    return _zip_progress_report(progress, done, progress->total > 0 ? (double)done / (double)progress->total : 0.0, done == progress->end);
+}
+
+
+/* Report sub_done bytes done of current section. */
+int
+_zip_progress_update_bytes(zip_progress_t *progress, zip_uint64_t sub_done) {
+    zip_uint64_t done;
+
+    if (progress == NULL) {
+        return 0;
+    }
+
+    done = progress->start + ZIP_MIN(sub_done, progress->end - progress->start);
 
+    /* always check at end of subrange, so entry boundaries are reported */
+    return _zip_progress_report(progress, done, progress->total > 0 ? (double)done / (double)progress->total : 0.0, done == progress->end);
+}
+
+
+/* Call callbacks for done bytes; unless force is set, only if enough data or time has passed since the last check. */
+static int
+_zip_progress_report(zip_progress_t *progress, zip_uint64_t done, double current, bool force) {
+    zip_uint64_t now = _zip_stats_time();
+
+    if (!force && done >= progress->last_check_bytes && done - progress->last_check_bytes < progress->za->progress_interval_bytes && now - ZIP_MIN(now, progress->last_check_time) < progress->za->progress_interval_time) {
+        return 0;
+    }
+    progress->last_check_bytes = done;
+    progress->last_check_time = now;
+
+    if (progress->callback_progress != NULL) {
         if (current - progress->last_update > progress->precision) {
             progress->callback_progress(progress->za, current, progress->ud_progress);
             progress->last_update = current;
         }
     }
 
+    if (progress->callback_bytes != NULL) {
+        if (current - progress->last_update_bytes > progress->precision_bytes) {
+            if (now > progress->last_time && done >= progress->last_bytes) {
+                progress->throughput = (double)(done - progress->last_bytes) * 1000000000.0 / (double)(now - progress->last_time);
+            }
+            progress->callback_bytes(progress->za, done, progress->total, progress->throughput, progress->ud_bytes);
+            progress->last_update_bytes = current;
+            progress->last_bytes = done;
+            progress->last_time = now;
+        }
+    }
+
     if (progress->callback_cancel != NULL) {
         if (progress->callback_cancel(progress->za, progress->ud_cancel)) {
             return -1;
@@ -220,14 +334,35 @@ zip_register_progress_callback_with_state(zip_t *za, double precision, zip_progr
     }
     else {
         if (za->progress != NULL) {
-            if (za->progress->callback_cancel == NULL) {
-                _zip_progress_free(za->progress);
-                za->progress = NULL;
-            }
-            else {
-                _zip_progress_free_progress_callback(za->progress);
+            _zip_progress_free_progress_callback(za->progress);
+            _zip_progress_free_unused(za);
+        }
+    }
+
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_register_progress_bytes_callback_with_state(zip_t *za, double precision, zip_progress_bytes_callback callback, void (*ud_free)(void *), void *ud) {
+    if (callback != NULL) {
+        if (za->progress == NULL) {
+            if ((za->progress = _zip_progress_new(za)) == NULL) {
+                return -1;
             }
         }
+
+        _zip_progress_free_bytes_callback(za->progress);
+        za->progress->callback_bytes = callback;
+        za->progress->ud_bytes_free = ud_free;
+        za->progress->ud_bytes = ud;
+        za->progress->precision_bytes = precision;
+    }
+    else {
+        if (za->progress != NULL) {
+            _zip_progress_free_bytes_callback(za->progress);
+            _zip_progress_free_unused(za);
+        }
     }
 
     return 0;
@@ -247,13 +382,8 @@ zip_register_cancel_callback_with_state(zip_t *za, zip_cancel_callback callback,
     }
     else {
         if (za->progress != NULL) {
-            if (za->progress->callback_progress == NULL) {
-                _zip_progress_free(za->progress);
-                za->progress = NULL;
-            }
-            else {
-                _zip_progress_free_cancel_callback(za->progress);
-            }
+            _zip_progress_free_cancel_callback(za->progress);
+            _zip_progress_free_unused(za);
         }
     }
 
@@ -281,13 +411,13 @@ zip_register_progress_callback(zip_t *za, zip_progress_callback_t progress_callb
         zip_register_progress_callback_with_state(za, 0, NULL, NULL, NULL);
     }
 
-    if ((ud = (struct legacy_ud *)malloc(sizeof(*ud))) == NULL) {
+    if ((ud = (struct legacy_ud *)_zip_malloc(sizeof(*ud))) == NULL) {
         return;
     }
 
     ud->callback = progress_callback;
 
     if (zip_register_progress_callback_with_state(za, 0.001, _zip_legacy_progress_callback, free, ud) < 0) {
-        free(ud);
+        _zip_free(ud);
     }
 }
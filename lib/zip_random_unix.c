@@ -59,20 +59,158 @@ zip_random_uint32(void) {
 #else /* HAVE_ARC4RANDOM */
 
 #ifndef HAVE_SECURE_RANDOM
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+
+/* Random bytes are read from the system in blocks and handed out from this pool, so writing many encrypted entries
+   doesn't need system calls for every salt. Bytes are cleared when handed out, and the pool is discarded in the
+   child after fork(), so parent and child don't use the same bytes. */
+#define RANDOM_POOL_SIZE 512
+
+static zip_uint8_t random_pool[RANDOM_POOL_SIZE];
+static size_t random_pool_available = 0; /* unused bytes at end of random_pool */
+
+#ifdef HAVE_THREADS
+static pthread_mutex_t random_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t random_pool_once = PTHREAD_ONCE_INIT;
+static bool random_pool_usable = false;
+
+static void random_pool_init(void);
+static void random_pool_lock(void);
+static void random_pool_reset_and_unlock(void);
+static void random_pool_unlock(void);
+#else
+static pid_t random_pool_pid = 0;
+#endif
+
+static bool random_read(zip_uint8_t *buffer, size_t length);
+
 
 ZIP_EXTERN bool
 zip_secure_random(zip_uint8_t *buffer, zip_uint16_t length) {
+    size_t offset;
+    bool ok = true;
+
+#ifdef HAVE_THREADS
+    pthread_once(&random_pool_once, random_pool_init);
+    if (!random_pool_usable) {
+        return random_read(buffer, length);
+    }
+#endif
+    if (length > RANDOM_POOL_SIZE / 4) {
+        return random_read(buffer, length);
+    }
+
+#ifdef HAVE_THREADS
+    random_pool_lock();
+#else
+    if (random_pool_pid != getpid()) {
+        memset(random_pool, 0, sizeof(random_pool));
+        random_pool_available = 0;
+        random_pool_pid = getpid();
+    }
+#endif
+
+    if (random_pool_available < length) {
+        if (random_read(random_pool, RANDOM_POOL_SIZE)) {
+            random_pool_available = RANDOM_POOL_SIZE;
+        }
+        else {
+            ok = false;
+        }
+    }
+    if (ok) {
+        offset = RANDOM_POOL_SIZE - random_pool_available;
+        (void)memcpy_s(buffer, length, random_pool + offset, length);
+        memset(random_pool + offset, 0, length);
+        random_pool_available -= length;
+    }
+
+#ifdef HAVE_THREADS
+    random_pool_unlock();
+#endif
+
+    return ok;
+}
+
+
+#ifdef HAVE_THREADS
+static void
+random_pool_init(void) {
+    /* Without fork handlers, the child could hand out the same bytes as the parent. */
+    random_pool_usable = pthread_atfork(random_pool_lock, random_pool_unlock, random_pool_reset_and_unlock) == 0;
+}
+
+
+static void
+random_pool_lock(void) {
+    pthread_mutex_lock(&random_pool_mutex);
+}
+
+
+static void
+random_pool_reset_and_unlock(void) {
+    memset(random_pool, 0, sizeof(random_pool));
+    random_pool_available = 0;
+    pthread_mutex_unlock(&random_pool_mutex);
+}
+
+
+static void
+random_pool_unlock(void) {
+    pthread_mutex_unlock(&random_pool_mutex);
+}
+#endif
+
+
+/* Fill buffer with random bytes from the system. */
+static bool
+random_read(zip_uint8_t *buffer, size_t length) {
     int fd;
+    ssize_t n;
+
+#ifdef HAVE_GETRANDOM
+    while (length > 0) {
+        if ((n = getrandom(buffer, length, 0)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOSYS) {
+                /* kernel too old, use /dev/urandom */
+                break;
+            }
+            return false;
+        }
+        buffer += n;
+        length -= (size_t)n;
+    }
+    if (length == 0) {
+        return true;
+    }
+#endif
 
     if ((fd = open("/dev/urandom", O_RDONLY)) < 0) {
         return false;
     }
 
-    if (read(fd, buffer, length) != length) {
-        close(fd);
-        return false;
+    while (length > 0) {
+        if ((n = read(fd, buffer, length)) <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        buffer += n;
+        length -= (size_t)n;
     }
 
     close(fd);
@@ -0,0 +1,572 @@
+/*
+  zip_read_entries.c -- read data of several entries into buffers
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* entries at most this far apart are read with one read operation */
+#define READ_BATCH_MAX_GAP (64 * 1024)
+/* maximum amount of data read at once; larger entries are read separately */
+#define READ_BATCH_MAX_RUN (8 * 1024 * 1024)
+/* room allowed for local extra fields, which are usually not known and can differ from the central ones */
+#define READ_BATCH_EXTRA_FIELDS 1024
+
+#define READ_BATCH_NO_ERROR ZIP_UINT64_MAX
+
+/* request whose data is read directly from the archive */
+struct batch_entry {
+    zip_read_request_t *request;
+    zip_uint64_t position; /* position of request in list */
+    const zip_dirent_t *de;
+    zip_uint64_t start; /* offset of local header */
+    zip_uint64_t end;   /* upper bound for end of data */
+    const zip_uint8_t *input; /* compressed data in run buffer, NULL if entry has to be read separately */
+    zip_error_t error;
+};
+typedef struct batch_entry batch_entry_t;
+
+/* decompresses every stride'th entry of a run, starting at first */
+struct batch_worker {
+#ifdef HAVE_THREADS
+    zip_thread_job_t job;
+#endif
+    zip_compression_algorithm_t *algorithm;
+    void *ud; /* decompression context, reports errors in error */
+    zip_uint64_t charged;
+    zip_error_t *error;
+    zip_error_t worker_error;
+    batch_entry_t **entries;
+    zip_uint64_t nentries;
+    zip_uint64_t first;
+    zip_uint64_t stride;
+    bool check_crc;
+};
+typedef struct batch_worker batch_worker_t;
+
+struct batch {
+    zip_t *za;
+    zip_uint8_t *buffer; /* data of current run */
+    zip_uint64_t buffer_size;
+    batch_worker_t *workers; /* first worker runs in calling thread and uses decompressor of archive */
+    zip_uint32_t nworkers;
+#ifdef HAVE_THREADS
+    zip_thread_pool_t *pool; /* runs all workers but the first */
+    bool pool_failed;
+#endif
+    zip_uint64_t error_position; /* position of first failed request */
+    zip_error_t error;
+};
+typedef struct batch batch_t;
+
+static int batch_entry_compare(const void *a, const void *b);
+static void batch_fail(batch_t *batch, zip_uint64_t position, zip_error_t *error);
+static void batch_fini(batch_t *batch);
+static bool batch_init(batch_t *batch, zip_t *za);
+static void batch_read_run(batch_t *batch, batch_entry_t **entries, zip_uint64_t nentries);
+static void batch_read_separately(batch_t *batch, batch_entry_t *entry);
+static zip_uint32_t batch_start_workers(batch_t *batch, batch_entry_t **entries, zip_uint64_t nentries);
+static void batch_worker_run(void *ud);
+
+
+/* Read data of all requested entries into their buffers, like zip_read_entry().
+   Entries that can be read directly are read in file order, with entries close to each other read together,
+   and decompressed in parallel if the archive may use more than one thread. */
+ZIP_EXTERN int
+zip_read_entries(zip_t *za, zip_read_request_t *requests, zip_uint64_t nrequests) {
+    batch_t batch;
+    batch_entry_t *entries;
+    batch_entry_t **order;
+    zip_uint64_t i, nentries, start, read_start, read_bytes;
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (requests == NULL && nrequests > 0) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    if (nrequests > SIZE_MAX / sizeof(entries[0])) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    if (!batch_init(&batch, za)) {
+        return -1;
+    }
+    entries = NULL;
+    order = NULL;
+    if (nrequests > 0 && ((entries = (batch_entry_t *)_zip_malloc(sizeof(entries[0]) * (size_t)nrequests)) == NULL || (order = (batch_entry_t **)_zip_malloc(sizeof(order[0]) * (size_t)nrequests)) == NULL)) {
+        _zip_free(entries);
+        batch_fini(&batch);
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    nentries = 0;
+    read_bytes = 0;
+    for (i = 0; i < nrequests; i++) {
+        zip_read_request_t *request = requests + i;
+        batch_entry_t *entry;
+        zip_dirent_t *de;
+        zip_error_t error;
+
+        request->result = -1;
+        zip_error_init(&error);
+        if (request->data == NULL && request->length > 0) {
+            zip_error_set(&error, ZIP_ER_INVAL, 0);
+            batch_fail(&batch, i, &error);
+            continue;
+        }
+        if (_zip_get_dirent(za, request->index, 0, &error) == NULL) {
+            batch_fail(&batch, i, &error);
+            continue;
+        }
+
+        if (!_zip_read_entry_is_direct(za, request->index)) {
+            zip_error_fini(&error);
+            if ((request->result = zip_read_entry(za, request->index, request->data, request->length)) < 0) {
+                batch_fail(&batch, i, &za->error);
+            }
+            continue;
+        }
+        ZIP_LOCK(za);
+        _zip_access_profile_note(za, request->index);
+        ZIP_UNLOCK(za);
+
+        de = za->entry[request->index].orig;
+        if (de->uncomp_size > request->length) {
+            zip_error_set(&error, ZIP_ER_INVAL, 0);
+            batch_fail(&batch, i, &error);
+            continue;
+        }
+        if (_zip_entry_cache_read(za, request->index, request->data)) {
+            request->result = (zip_int64_t)de->uncomp_size;
+            read_bytes += de->uncomp_size;
+            zip_error_fini(&error);
+            continue;
+        }
+        if (de->comp_method == ZIP_CM_STORE && de->comp_size != de->uncomp_size) {
+            zip_error_set(&error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, request->index));
+            batch_fail(&batch, i, &error);
+            continue;
+        }
+
+        entry = entries + nentries;
+        entry->request = request;
+        entry->position = i;
+        entry->de = de;
+        entry->start = de->offset;
+        entry->input = NULL;
+        zip_error_init(&entry->error);
+        if (de->comp_size > READ_BATCH_MAX_RUN || de->offset > ZIP_UINT64_MAX - READ_BATCH_MAX_RUN - LENTRYSIZE - ZIP_UINT16_MAX - READ_BATCH_EXTRA_FIELDS) {
+            /* read on its own */
+            entry->end = ZIP_UINT64_MAX;
+        }
+        else {
+            entry->end = de->offset + LENTRYSIZE + _zip_string_length(de->filename) + READ_BATCH_EXTRA_FIELDS + de->comp_size;
+        }
+        order[nentries] = entry;
+        nentries++;
+        zip_error_fini(&error);
+    }
+
+    if (nentries > 0) {
+        qsort(order, (size_t)nentries, sizeof(order[0]), batch_entry_compare);
+    }
+
+    /* entries not read directly were counted by zip_fread() */
+    read_start = _zip_stats_start(za);
+
+    for (start = 0; start < nentries;) {
+        zip_uint64_t end = order[start]->end;
+        zip_uint64_t next;
+
+        if (end == ZIP_UINT64_MAX || end - order[start]->start > READ_BATCH_MAX_RUN) {
+            batch_read_separately(&batch, order[start]);
+            start++;
+            continue;
+        }
+
+        for (next = start + 1; next < nentries; next++) {
+            if (order[next]->end == ZIP_UINT64_MAX || order[next]->start > end + READ_BATCH_MAX_GAP || ZIP_MAX(end, order[next]->end) - order[start]->start > READ_BATCH_MAX_RUN) {
+                break;
+            }
+            end = ZIP_MAX(end, order[next]->end);
+        }
+
+        batch_read_run(&batch, order + start, next - start);
+        start = next;
+    }
+
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].request->result < 0) {
+            batch_fail(&batch, entries[i].position, &entries[i].error);
+        }
+        else {
+            read_bytes += (zip_uint64_t)entries[i].request->result;
+            _zip_entry_cache_add(za, entries[i].request->index, entries[i].request->data, (zip_uint64_t)entries[i].request->result);
+        }
+        zip_error_fini(&entries[i].error);
+    }
+    _zip_stats_add(za, ZIP_PHASE_READ, read_start, 0, read_bytes);
+    _zip_free(order);
+    _zip_free(entries);
+
+    if (batch.error_position != READ_BATCH_NO_ERROR) {
+        _zip_error_copy(&za->error, &batch.error);
+        batch_fini(&batch);
+        return -1;
+    }
+
+    batch_fini(&batch);
+    return 0;
+}
+
+
+static int
+batch_entry_compare(const void *a, const void *b) {
+    const batch_entry_t *ea = *(const batch_entry_t *const *)a;
+    const batch_entry_t *eb = *(const batch_entry_t *const *)b;
+
+    if (ea->start != eb->start) {
+        return ea->start < eb->start ? -1 : 1;
+    }
+    return ea->position < eb->position ? -1 : (ea->position > eb->position ? 1 : 0);
+}
+
+
+/* Record error of request at position, keeping the one of the first failed request. */
+static void
+batch_fail(batch_t *batch, zip_uint64_t position, zip_error_t *error) {
+    if (position < batch->error_position) {
+        batch->error_position = position;
+        _zip_error_copy(&batch->error, error);
+    }
+    if (error != &batch->za->error) {
+        zip_error_fini(error);
+    }
+}
+
+
+static void
+batch_fini(batch_t *batch) {
+    zip_uint32_t i;
+
+#ifdef HAVE_THREADS
+    _zip_thread_pool_free(batch->pool);
+#endif
+    for (i = 1; i < batch->nworkers; i++) {
+        batch_worker_t *worker = batch->workers + i;
+
+        if (worker->ud != NULL) {
+            worker->algorithm->deallocate(worker->ud);
+            _zip_memory_budget_release(batch->za->memory_budget, worker->charged);
+        }
+        zip_error_fini(&worker->worker_error);
+    }
+    _zip_free(batch->workers);
+    if (batch->buffer != NULL) {
+        _zip_free(batch->buffer);
+        _zip_memory_budget_release(batch->za->memory_budget, batch->buffer_size);
+    }
+    zip_error_fini(&batch->error);
+}
+
+
+static bool
+batch_init(batch_t *batch, zip_t *za) {
+    zip_uint32_t i;
+
+    batch->za = za;
+    batch->buffer = NULL;
+    batch->buffer_size = 0;
+#ifdef HAVE_THREADS
+    batch->pool = NULL;
+    batch->pool_failed = false;
+    batch->nworkers = ZIP_MAX(za->num_threads, 1);
+#else
+    batch->nworkers = 1;
+#endif
+    batch->error_position = READ_BATCH_NO_ERROR;
+    zip_error_init(&batch->error);
+
+    if ((batch->workers = (batch_worker_t *)_zip_malloc(sizeof(batch->workers[0]) * batch->nworkers)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    for (i = 0; i < batch->nworkers; i++) {
+        batch_worker_t *worker = batch->workers + i;
+
+#ifdef HAVE_THREADS
+        worker->job.run = batch_worker_run;
+        worker->job.ud = worker;
+#endif
+        worker->algorithm = NULL;
+        worker->ud = NULL;
+        worker->charged = 0;
+        zip_error_init(&worker->worker_error);
+        worker->error = i == 0 ? &za->error : &worker->worker_error;
+        worker->stride = 1;
+        worker->check_crc = (za->open_flags & ZIP_SKIP_CRC_CHECK) == 0;
+    }
+
+    return true;
+}
+
+
+/* Read entries, which are sorted by offset and close to each other, with one read operation and decompress them. */
+static void
+batch_read_run(batch_t *batch, batch_entry_t **entries, zip_uint64_t nentries) {
+    zip_t *za = batch->za;
+    zip_uint64_t start = entries[0]->start;
+    zip_uint64_t length, i;
+    zip_uint32_t nworkers;
+    zip_int64_t n;
+    zip_error_t error;
+
+    length = 0;
+    for (i = 0; i < nentries; i++) {
+        length = ZIP_MAX(length, entries[i]->end - start);
+    }
+
+    if (length > batch->buffer_size) {
+        zip_uint8_t *buffer;
+
+        zip_error_init(&error);
+        if (!_zip_memory_budget_charge(za->memory_budget, length - batch->buffer_size, &error) || (buffer = (zip_uint8_t *)_zip_realloc(batch->buffer, (size_t)length)) == NULL) {
+            if (zip_error_code_zip(&error) == ZIP_ER_OK) {
+                _zip_memory_budget_release(za->memory_budget, length - batch->buffer_size);
+            }
+            zip_error_fini(&error);
+            /* not enough memory to read them together */
+            for (i = 0; i < nentries; i++) {
+                batch_read_separately(batch, entries[i]);
+            }
+            return;
+        }
+        zip_error_fini(&error);
+        batch->buffer = buffer;
+        batch->buffer_size = length;
+    }
+
+    /* end of last entry is only estimated and may be beyond end of archive */
+    n = 0;
+    if (zip_source_seek(za->src, (zip_int64_t)start, SEEK_SET) < 0) {
+        n = -1;
+    }
+    else {
+        while ((zip_uint64_t)n < length) {
+            zip_int64_t ret = zip_source_read(za->src, batch->buffer + n, length - (zip_uint64_t)n);
+            if (ret < 0) {
+                n = -1;
+                break;
+            }
+            if (ret == 0) {
+                break;
+            }
+            n += ret;
+        }
+    }
+    if (n < 0) {
+        for (i = 0; i < nentries; i++) {
+            zip_error_set_from_source(&entries[i]->error, za->src);
+        }
+        return;
+    }
+
+    for (i = 0; i < nentries; i++) {
+        batch_entry_t *entry = entries[i];
+        zip_uint64_t offset = entry->start - start;
+        const zip_uint8_t *p = batch->buffer + offset;
+
+        if (offset + LENTRYSIZE > (zip_uint64_t)n) {
+            continue;
+        }
+        offset += LENTRYSIZE + ((zip_uint64_t)p[26] | ((zip_uint64_t)p[27] << 8)) + ((zip_uint64_t)p[28] | ((zip_uint64_t)p[29] << 8));
+        if (offset + entry->de->comp_size > (zip_uint64_t)n) {
+            continue;
+        }
+        entry->input = batch->buffer + offset;
+    }
+
+    nworkers = batch_start_workers(batch, entries, nentries);
+    batch_worker_run(batch->workers);
+#ifdef HAVE_THREADS
+    for (i = 1; i < nworkers; i++) {
+        _zip_thread_pool_wait(batch->pool, &batch->workers[i].job);
+    }
+#else
+    (void)nworkers;
+#endif
+
+    /* local header was larger than expected or data is truncated */
+    for (i = 0; i < nentries; i++) {
+        if (entries[i]->input == NULL && zip_error_code_zip(&entries[i]->error) == ZIP_ER_OK) {
+            batch_read_separately(batch, entries[i]);
+        }
+    }
+}
+
+
+static void
+batch_read_separately(batch_t *batch, batch_entry_t *entry) {
+    if ((entry->request->result = _zip_read_entry_direct(batch->za, entry->request->index, (zip_uint8_t *)entry->request->data)) < 0) {
+        _zip_error_copy(&entry->error, &batch->za->error);
+    }
+}
+
+
+/* Prepare workers to decompress entries of run, return number of workers to use. Workers but the first are submitted to the thread pool. */
+static zip_uint32_t
+batch_start_workers(batch_t *batch, batch_entry_t **entries, zip_uint64_t nentries) {
+    zip_t *za = batch->za;
+    zip_compression_algorithm_t *algorithm = NULL;
+    zip_uint32_t nworkers, i;
+    zip_uint64_t j;
+
+    for (j = 0; j < nentries; j++) {
+        if (entries[j]->input != NULL && entries[j]->de->comp_method == ZIP_CM_DEFLATE) {
+            break;
+        }
+    }
+
+    nworkers = 1;
+    batch->workers[0].algorithm = NULL;
+    batch->workers[0].ud = NULL;
+    if (j < nentries && (algorithm = _zip_get_compression_algorithm(ZIP_CM_DEFLATE, false)) != NULL) {
+        batch->workers[0].algorithm = algorithm;
+        batch->workers[0].ud = _zip_read_entry_decompressor(za, algorithm);
+    }
+
+#ifdef HAVE_THREADS
+    if (batch->workers[0].ud != NULL && batch->nworkers > 1 && nentries > 1 && !batch->pool_failed) {
+        if (batch->pool == NULL && (batch->pool = _zip_thread_pool_new(batch->nworkers - 1, NULL)) == NULL) {
+            batch->pool_failed = true;
+        }
+        for (; batch->pool != NULL && nworkers < ZIP_MIN(batch->nworkers, nentries); nworkers++) {
+            batch_worker_t *worker = batch->workers + nworkers;
+
+            if (worker->ud != NULL && worker->algorithm != algorithm) {
+                /* implementation was registered since */
+                worker->algorithm->deallocate(worker->ud);
+                _zip_memory_budget_release(za->memory_budget, worker->charged);
+                worker->ud = NULL;
+            }
+            if (worker->ud == NULL) {
+                void *ud;
+                zip_uint64_t charged;
+
+                /* errors setting up additional workers are not fatal, fewer workers are used */
+                if ((ud = algorithm->allocate(ZIP_CM_DEFLATE, 0, worker->error)) == NULL) {
+                    zip_error_set(worker->error, ZIP_ER_OK, 0);
+                    break;
+                }
+                charged = algorithm->memory_usage != NULL ? algorithm->memory_usage(ud) : 0;
+                if (!_zip_memory_budget_charge(za->memory_budget, charged, worker->error)) {
+                    algorithm->deallocate(ud);
+                    zip_error_set(worker->error, ZIP_ER_OK, 0);
+                    break;
+                }
+                worker->algorithm = algorithm;
+                worker->ud = ud;
+                worker->charged = charged;
+            }
+        }
+    }
+#endif
+
+    for (i = 0; i < nworkers; i++) {
+        batch_worker_t *worker = batch->workers + i;
+
+        worker->entries = entries;
+        worker->nentries = nentries;
+        worker->first = i;
+        worker->stride = nworkers;
+#ifdef HAVE_THREADS
+        if (i > 0) {
+            _zip_thread_pool_submit(batch->pool, &worker->job);
+        }
+#endif
+    }
+
+    return nworkers;
+}
+
+
+/* Decompress entries assigned to worker. Runs in worker thread, must only access its worker and entries. */
+static void
+batch_worker_run(void *ud) {
+    batch_worker_t *worker = (batch_worker_t *)ud;
+    zip_uint64_t i;
+
+    for (i = worker->first; i < worker->nentries; i += worker->stride) {
+        batch_entry_t *entry = worker->entries[i];
+        const zip_dirent_t *de = entry->de;
+        zip_uint8_t *data = (zip_uint8_t *)entry->request->data;
+        zip_uint64_t size;
+
+        if (entry->input == NULL) {
+            continue;
+        }
+
+        if (de->comp_method == ZIP_CM_STORE) {
+            if (de->comp_size > 0) {
+                memcpy(data, entry->input, (size_t)de->comp_size);
+            }
+            size = de->comp_size;
+        }
+        else if (worker->ud == NULL) {
+            if (worker->algorithm == NULL) {
+                zip_error_set(&entry->error, ZIP_ER_COMPNOTSUPP, 0);
+            }
+            else {
+                /* allocating decompressor of archive failed */
+                _zip_error_copy(&entry->error, worker->error);
+            }
+            continue;
+        }
+        else if (!_zip_read_entry_decompress(worker->algorithm, worker->ud, entry->request->index, de, NULL, (zip_uint8_t *)entry->input, de->comp_size, data, &size, worker->error)) {
+            _zip_error_copy(&entry->error, worker->error);
+            zip_error_set(worker->error, ZIP_ER_OK, 0);
+            continue;
+        }
+
+        /* entries are already verified in parallel */
+        if (!_zip_read_entry_verify(entry->request->index, de, data, size, worker->check_crc, 1, &entry->error)) {
+            continue;
+        }
+        entry->request->result = (zip_int64_t)size;
+    }
+}
@@ -0,0 +1,347 @@
+/*
+  zip_read_entry.c -- read data of entry into buffer
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+static zip_int64_t read_entry_generic(zip_t *za, zip_uint64_t index, zip_uint8_t *data, zip_uint64_t length);
+
+
+/* Read all data of entry index into data, which must have room for its uncompressed size.
+   Unchanged, unencrypted entries that are stored or deflated are read directly from the archive,
+   reusing the decompressor and I/O buffer of the archive; others are read with zip_fopen_index().
+   Both use the entry cache of the archive. */
+ZIP_EXTERN zip_int64_t
+zip_read_entry(zip_t *za, zip_uint64_t index, void *data, zip_uint64_t length) {
+    zip_dirent_t *de;
+    zip_uint64_t start;
+    zip_int64_t n;
+
+    if (za == NULL) {
+        return -1;
+    }
+    if (data == NULL && length > 0) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    if (_zip_get_dirent(za, index, 0, NULL) == NULL) {
+        return -1;
+    }
+    ZIP_LOCK(za);
+    _zip_access_profile_note(za, index);
+    ZIP_UNLOCK(za);
+
+    if (!_zip_read_entry_is_direct(za, index)) {
+        /* statistics are collected by zip_fread() */
+        return read_entry_generic(za, index, (zip_uint8_t *)data, length);
+    }
+    de = za->entry[index].orig;
+
+    if (de->uncomp_size > length) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    start = _zip_stats_start(za);
+    if (_zip_entry_cache_read(za, index, data)) {
+        _zip_stats_add(za, ZIP_PHASE_READ, start, 0, de->uncomp_size);
+        return (zip_int64_t)de->uncomp_size;
+    }
+    if ((n = _zip_read_entry_direct(za, index, (zip_uint8_t *)data)) >= 0) {
+        _zip_stats_add(za, ZIP_PHASE_READ, start, 0, (zip_uint64_t)n);
+        _zip_entry_cache_add(za, index, data, (zip_uint64_t)n);
+    }
+    return n;
+}
+
+
+/* Read data of entry index, which must be direct, into data, which has room for its uncompressed size. */
+zip_int64_t
+_zip_read_entry_direct(zip_t *za, zip_uint64_t index, zip_uint8_t *data) {
+    zip_dirent_t *de = za->entry[index].orig;
+    zip_uint64_t offset, size;
+
+    if ((offset = _zip_file_get_offset(za, index, &za->error)) == 0) {
+        return -1;
+    }
+    if (zip_source_seek(za->src, (zip_int64_t)offset, SEEK_SET) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+
+    if (de->comp_method == ZIP_CM_STORE) {
+        if (de->comp_size != de->uncomp_size) {
+            zip_error_set(&za->error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, index));
+            return -1;
+        }
+        if (_zip_read(za->src, data, de->comp_size, &za->error) < 0) {
+            return -1;
+        }
+        size = de->comp_size;
+    }
+    else {
+        zip_compression_algorithm_t *algorithm;
+        zip_uint8_t *buffer;
+        void *ud;
+
+        if ((algorithm = _zip_get_compression_algorithm(ZIP_CM_DEFLATE, false)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_COMPNOTSUPP, 0);
+            return -1;
+        }
+        if ((ud = _zip_read_entry_decompressor(za, algorithm)) == NULL || (buffer = _zip_io_buffer(za)) == NULL) {
+            return -1;
+        }
+        if (!_zip_read_entry_decompress(algorithm, ud, index, de, za->src, buffer, za->io_buffer_size, data, &size, &za->error)) {
+            return -1;
+        }
+    }
+
+    if (!_zip_read_entry_verify(index, de, data, size, (za->open_flags & ZIP_SKIP_CRC_CHECK) == 0, za->num_threads, &za->error)) {
+        return -1;
+    }
+
+    return (zip_int64_t)size;
+}
+
+
+void
+_zip_read_entry_free(zip_t *za) {
+    if (za->read_decompressor == NULL) {
+        return;
+    }
+
+    za->read_algorithm->deallocate(za->read_decompressor);
+    _zip_memory_budget_release(za->memory_budget, za->read_decompressor_charged);
+    za->read_algorithm = NULL;
+    za->read_decompressor = NULL;
+    za->read_decompressor_charged = 0;
+}
+
+
+/* Check whether entry index can be read directly from the archive, bypassing zip_fopen_index(). */
+bool
+_zip_read_entry_is_direct(zip_t *za, zip_uint64_t index) {
+    zip_dirent_t *de = za->entry[index].orig;
+
+    return !ZIP_ENTRY_DATA_CHANGED(za->entry + index) && de != NULL && !ZIP_READS_POSITIONAL(za) && (de->bitflags & ZIP_GPBF_ENCRYPTED) == 0 && (de->comp_method == ZIP_CM_STORE || de->comp_method == ZIP_CM_DEFLATE);
+}
+
+
+/* Decompress data of entry with ud, a decompression context of algorithm that reports its errors in error.
+   If src is NULL, buffer holds all compressed data; otherwise src is positioned at its start and buffer of buffer_size bytes is used to read it.
+   Set sizep to length of uncompressed data. */
+bool
+_zip_read_entry_decompress(zip_compression_algorithm_t *algorithm, void *ud, zip_uint64_t index, const zip_dirent_t *de, zip_source_t *src, zip_uint8_t *buffer, zip_uint64_t buffer_size, zip_uint8_t *data, zip_uint64_t *sizep, zip_error_t *error) {
+    zip_stat_t st;
+    zip_file_attributes_t attributes;
+    zip_uint64_t remaining, size;
+    zip_uint8_t *input;
+    bool end, ok;
+
+    zip_stat_init(&st);
+    st.size = de->uncomp_size;
+    st.comp_size = de->comp_size;
+    st.comp_method = de->comp_method;
+    st.crc = de->crc;
+    st.valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC;
+    zip_file_attributes_init(&attributes);
+
+    if (!algorithm->start(ud, &st, &attributes)) {
+        return false;
+    }
+
+    remaining = de->comp_size;
+    input = buffer;
+    size = 0;
+    end = false;
+    ok = true;
+    while (!end) {
+        /* once data is full, more output means the entry is longer than recorded */
+        zip_uint8_t extra;
+        zip_uint8_t *out = size < de->uncomp_size ? data + size : &extra;
+        zip_uint64_t out_length = size < de->uncomp_size ? de->uncomp_size - size : 1;
+        zip_uint64_t n;
+
+        switch (algorithm->process(ud, out, &out_length)) {
+        case ZIP_COMPRESSION_END:
+            end = true;
+            /* fallthrough */
+        case ZIP_COMPRESSION_OK:
+            if (out == &extra && out_length > 0) {
+                end = true;
+                ok = false;
+                break;
+            }
+            size += out_length;
+            break;
+
+        case ZIP_COMPRESSION_NEED_DATA:
+            if (remaining == 0) {
+                end = true;
+                break;
+            }
+            if (src != NULL) {
+                n = ZIP_MIN(remaining, buffer_size);
+                if (_zip_read(src, buffer, n, error) < 0) {
+                    (void)algorithm->end(ud);
+                    return false;
+                }
+            }
+            else {
+                n = ZIP_MIN(remaining, ZIP_UINT32_MAX);
+            }
+            if (!algorithm->input(ud, input, n)) {
+                (void)algorithm->end(ud);
+                return false;
+            }
+            if (src == NULL) {
+                input += n;
+            }
+            remaining -= n;
+            if (remaining == 0) {
+                algorithm->end_of_input(ud);
+            }
+            break;
+
+        case ZIP_COMPRESSION_ERROR:
+            /* error set by algorithm */
+            if (zip_error_code_zip(error) == ZIP_ER_OK) {
+                zip_error_set(error, ZIP_ER_INTERNAL, 0);
+            }
+            (void)algorithm->end(ud);
+            return false;
+        }
+    }
+
+    if (!algorithm->end(ud)) {
+        return false;
+    }
+    if (!ok) {
+        zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, index));
+        return false;
+    }
+
+    *sizep = size;
+    return true;
+}
+
+
+/* Check size bytes of uncompressed data of entry against its central directory entry, computing the CRC with up to num_threads threads if check_crc is set. */
+bool
+_zip_read_entry_verify(zip_uint64_t index, const zip_dirent_t *de, const zip_uint8_t *data, zip_uint64_t size, bool check_crc, zip_uint32_t num_threads, zip_error_t *error) {
+    /* checked in the same order as when reading via zip_fread() */
+    if (check_crc && _zip_crc32_threads(0, data, size, num_threads) != de->crc) {
+        zip_error_set(error, ZIP_ER_CRC, 0);
+        return false;
+    }
+    if (size != de->uncomp_size) {
+        zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, index));
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Return decompressor for algorithm kept in archive, allocating it when first needed. Its errors are reported in za->error. */
+void *
+_zip_read_entry_decompressor(zip_t *za, zip_compression_algorithm_t *algorithm) {
+    zip_uint64_t charged;
+    void *ud;
+
+    if (za->read_decompressor != NULL) {
+        if (za->read_algorithm == algorithm) {
+            return za->read_decompressor;
+        }
+        /* implementation was registered since */
+        _zip_read_entry_free(za);
+    }
+
+    if ((ud = algorithm->allocate(ZIP_CM_DEFLATE, 0, &za->error)) == NULL) {
+        return NULL;
+    }
+    charged = algorithm->memory_usage != NULL ? algorithm->memory_usage(ud) : 0;
+    if (!_zip_memory_budget_charge(za->memory_budget, charged, &za->error)) {
+        algorithm->deallocate(ud);
+        return NULL;
+    }
+
+    za->read_algorithm = algorithm;
+    za->read_decompressor = ud;
+    za->read_decompressor_charged = charged;
+
+    return ud;
+}
+
+
+/* Read data of entry through zip_fopen_index(), failing if it doesn't fit into length bytes. */
+static zip_int64_t
+read_entry_generic(zip_t *za, zip_uint64_t index, zip_uint8_t *data, zip_uint64_t length) {
+    zip_file_t *zf;
+    zip_uint64_t size;
+    zip_int64_t n;
+    zip_uint8_t extra;
+
+    if ((zf = zip_fopen_index(za, index, 0)) == NULL) {
+        return -1;
+    }
+
+    size = 0;
+    while (size < length) {
+        if ((n = zip_fread(zf, data + size, length - size)) < 0) {
+            _zip_error_copy(&za->error, &zf->error);
+            zip_fclose(zf);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        size += (zip_uint64_t)n;
+    }
+
+    if (size == length) {
+        if ((n = zip_fread(zf, &extra, 1)) < 0) {
+            _zip_error_copy(&za->error, &zf->error);
+            zip_fclose(zf);
+            return -1;
+        }
+        if (n > 0) {
+            zip_fclose(zf);
+            zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+    }
+
+    zip_fclose(zf);
+    return (zip_int64_t)size;
+}
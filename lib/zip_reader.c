@@ -0,0 +1,232 @@
+/*
+  zip_reader.c -- read archive data without using read position of archive source
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* source for data of one entry, read via reader */
+struct entry_source {
+    const zip_reader_t *reader;
+    zip_uint64_t header_offset; /* offset of local header */
+    zip_uint64_t start;         /* offset of data, set when opened */
+    zip_uint64_t length;        /* length of data */
+    zip_uint64_t offset;        /* read position, relative to start */
+    zip_error_t error;
+};
+typedef struct entry_source entry_source_t;
+
+static zip_int64_t entry_source_callback(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+
+
+/* Set up reader for src, which must be open for reading.
+   Returns false if data of src can only be read through its read position. */
+bool
+_zip_reader_init(zip_reader_t *reader, zip_source_t *src) {
+    zip_stat_t st;
+    const void *data;
+
+    reader->src = src;
+    reader->data = NULL;
+    reader->size = 0;
+    reader->volumes = false;
+
+    if ((zip_source_supports(src) & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_GET_DATA)) && zip_source_stat(src, &st) == 0 && (st.valid & ZIP_STAT_SIZE) && zip_source_get_data(src, 0, st.size, &data) == 0) {
+        reader->data = (const zip_uint8_t *)data;
+        reader->size = st.size;
+        return true;
+    }
+
+    if (_zip_source_volumes_supports_read_at(src)) {
+        reader->volumes = true;
+        return true;
+    }
+
+    return _zip_source_file_supports_read_at(src);
+}
+
+
+/* Can be called from multiple threads. */
+zip_int64_t
+_zip_reader_read(const zip_reader_t *reader, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error) {
+    if (reader->data != NULL) {
+        if (offset >= reader->size) {
+            return 0;
+        }
+        length = ZIP_MIN(length, reader->size - offset);
+        (void)memcpy_s(data, (size_t)length, reader->data + offset, (size_t)length);
+        return (zip_int64_t)length;
+    }
+
+    if (reader->volumes) {
+        return _zip_source_volumes_read_at(reader->src, offset, data, length, error);
+    }
+
+    return _zip_source_file_read_at(reader->src, offset, data, length, error);
+}
+
+
+/* Create source for the length bytes of data of the entry whose local header is at header_offset.
+   The source only accesses reader, so it can be used from a thread other than the one using the archive. */
+zip_source_t *
+_zip_reader_entry_source_new(const zip_reader_t *reader, zip_uint64_t header_offset, zip_uint64_t length, zip_error_t *error) {
+    entry_source_t *ctx;
+    zip_source_t *src;
+
+    if ((ctx = (entry_source_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->reader = reader;
+    ctx->header_offset = header_offset;
+    ctx->start = 0;
+    ctx->length = length;
+    ctx->offset = 0;
+    zip_error_init(&ctx->error);
+
+    if ((src = zip_source_function_create(entry_source_callback, ctx, error)) == NULL) {
+        zip_error_fini(&ctx->error);
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    return src;
+}
+
+
+/* Only accesses ctx and reader. */
+static zip_int64_t
+entry_source_callback(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    entry_source_t *ctx = (entry_source_t *)ud;
+    zip_int64_t n;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN: {
+        zip_uint8_t header[LENTRYSIZE];
+        zip_uint64_t header_length;
+
+        for (header_length = 0; header_length < LENTRYSIZE; header_length += (zip_uint64_t)n) {
+            if ((n = _zip_reader_read(ctx->reader, ctx->header_offset + header_length, header + header_length, LENTRYSIZE - header_length, &ctx->error)) < 0) {
+                return -1;
+            }
+            if (n == 0) {
+                zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
+                return -1;
+            }
+        }
+        if (memcmp(header, LOCAL_MAGIC, 4) != 0) {
+            zip_error_set(&ctx->error, ZIP_ER_NOZIP, 0);
+            return -1;
+        }
+
+        /* file name and extra field lengths */
+        ctx->start = ctx->header_offset + LENTRYSIZE + (zip_uint64_t)(header[26] | (header[27] << 8)) + (zip_uint64_t)(header[28] | (header[29] << 8));
+        if (ctx->start > ZIP_INT64_MAX || ctx->start + ctx->length < ctx->start) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EFBIG);
+            return -1;
+        }
+        ctx->offset = 0;
+        return 0;
+    }
+
+    case ZIP_SOURCE_READ:
+        if ((length = ZIP_MIN(length, ctx->length - ctx->offset)) == 0) {
+            return 0;
+        }
+        if ((n = _zip_reader_read(ctx->reader, ctx->start + ctx->offset, data, length, &ctx->error)) < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
+            return -1;
+        }
+        ctx->offset += (zip_uint64_t)n;
+        return n;
+
+    case ZIP_SOURCE_READ_AT: {
+        zip_source_args_read_at_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_read_at_t, data, length, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (args->offset >= ctx->length) {
+            return 0;
+        }
+        return _zip_reader_read(ctx->reader, ctx->start + args->offset, args->data, ZIP_MIN(args->length, ctx->length - args->offset), &ctx->error);
+    }
+
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->length, data, length, &ctx->error);
+
+        if (new_offset < 0) {
+            return -1;
+        }
+        ctx->offset = (zip_uint64_t)new_offset;
+        return 0;
+    }
+
+    case ZIP_SOURCE_TELL:
+        return (zip_int64_t)ctx->offset;
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, length, &ctx->error);
+
+        if (st == NULL) {
+            return -1;
+        }
+        st->size = ctx->length;
+        st->valid |= ZIP_STAT_SIZE;
+        return sizeof(*st);
+    }
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        zip_error_fini(&ctx->error);
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_READ_AT, ZIP_SOURCE_CLOSE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
@@ -0,0 +1,316 @@
+/*
+  zip_recover.c -- rebuild central directory from local headers
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <string.h>
+
+#include "zipint.h"
+
+/* the archive is scanned through a window of this size */
+#define RECOVER_WINDOW_SIZE (1024 * 1024)
+/* largest possible local header */
+#define LENTRY_MAX_SIZE (LENTRYSIZE + 2 * 0xffffu)
+
+typedef struct {
+    zip_source_t *src;
+    zip_uint64_t length; /* of archive */
+    zip_uint8_t *data;
+    zip_uint64_t offset; /* of data in archive */
+    zip_uint64_t size;   /* of data */
+} window_t;
+
+static const zip_uint8_t *window_get(window_t *window, zip_uint64_t offset, zip_uint64_t length, zip_uint64_t *available, zip_error_t *error);
+static int window_find(window_t *window, zip_uint64_t offset, const char *magic, size_t magic_length, zip_uint64_t *found, zip_error_t *error);
+static int find_data_end(window_t *window, zip_dirent_t *de, bool zip64, zip_uint64_t data_offset, zip_uint64_t *end, zip_error_t *error);
+static int data_descriptor_at(window_t *window, zip_dirent_t *de, bool zip64, zip_uint64_t data_offset, zip_uint64_t offset, zip_uint64_t *end, zip_error_t *error);
+
+
+/* _zip_recover_cdir:
+   Build a central directory from the local headers in the first length
+   bytes of za->src, for archives whose central directory is missing or
+   damaged.  Entries written with a data descriptor end where a
+   descriptor matching the size of the data is found.  Stops at an entry
+   whose data is cut off.
+
+   Returns NULL without setting error if no entry was found. */
+
+zip_cdir_t *
+_zip_recover_cdir(zip_t *za, zip_uint64_t length, zip_error_t *error) {
+    window_t window;
+    zip_cdir_t *cd;
+    zip_dirent_t *de;
+    zip_uint64_t offset, header_offset, nentry;
+    int ret;
+
+    window.src = za->src;
+    window.length = length;
+    window.offset = 0;
+    window.size = 0;
+    if ((window.data = (zip_uint8_t *)_zip_malloc(RECOVER_WINDOW_SIZE)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((cd = _zip_cdir_new(0, za->memory_budget, error)) == NULL) {
+        _zip_free(window.data);
+        return NULL;
+    }
+
+    nentry = 0;
+    de = NULL;
+    offset = 0;
+    while ((ret = window_find(&window, offset, LOCAL_MAGIC, 4, &header_offset, error)) > 0) {
+        const zip_uint8_t *data;
+        zip_uint64_t available, data_offset, end;
+        zip_int64_t header_size;
+        zip_buffer_t buffer;
+        zip_error_t header_error;
+
+        if (de == NULL && (de = _zip_dirent_new_arena(za->arena, error)) == NULL) {
+            ret = -1;
+            break;
+        }
+        if ((data = window_get(&window, header_offset, LENTRY_MAX_SIZE, &available, error)) == NULL) {
+            ret = -1;
+            break;
+        }
+
+        /* a header that does not parse is a signature in file data */
+        zip_error_init(&header_error);
+        _zip_buffer_init(&buffer, (zip_uint8_t *)data, available);
+        header_size = _zip_dirent_read(de, za->src, &buffer, true, za->arena, &header_error);
+        zip_error_fini(&header_error);
+        if (header_size < 0) {
+            offset = header_offset + 1;
+            continue;
+        }
+        data_offset = header_offset + (zip_uint64_t)header_size;
+
+        if (de->bitflags & ZIP_GPBF_DATA_DESCRIPTOR) {
+            bool zip64;
+
+            /* sizes in Zip64 extra field mean Zip64 data descriptor */
+            _zip_buffer_set_offset(&buffer, 18);
+            zip64 = _zip_buffer_get_32(&buffer) == ZIP_UINT32_MAX || _zip_buffer_get_32(&buffer) == ZIP_UINT32_MAX;
+            if ((ret = find_data_end(&window, de, zip64, data_offset, &end, error)) <= 0) {
+                /* data cut off, nothing valid can follow */
+                break;
+            }
+        }
+        else {
+            if (de->comp_size > length - data_offset) {
+                offset = header_offset + 1;
+                continue;
+            }
+            end = data_offset + de->comp_size;
+        }
+
+        de->offset = header_offset;
+        de->local_header_size = (zip_uint32_t)header_size;
+
+        if (nentry == cd->nentry_alloc) {
+            if (!_zip_cdir_grow(cd, nentry > 0 ? nentry : 16, error)) {
+                ret = -1;
+                break;
+            }
+        }
+        cd->entry[nentry].orig = de;
+        nentry++;
+        de = NULL;
+
+        offset = end;
+    }
+
+    _zip_free(window.data);
+
+    if (ret < 0 || nentry == 0) {
+        _zip_cdir_free(cd);
+        return NULL;
+    }
+
+    cd->nentry = nentry;
+    cd->offset = offset;
+
+    return cd;
+}
+
+
+/* Make sure length bytes at offset are in window, as far as the archive extends.
+   Returns pointer to offset and sets *available to the number of bytes there. */
+
+static const zip_uint8_t *
+window_get(window_t *window, zip_uint64_t offset, zip_uint64_t length, zip_uint64_t *available, zip_error_t *error) {
+    zip_uint64_t size;
+
+    if (offset > window->length) {
+        offset = window->length;
+    }
+    if (length > window->length - offset) {
+        length = window->length - offset;
+    }
+
+    if (offset < window->offset || offset + length > window->offset + window->size) {
+        size = ZIP_MIN(RECOVER_WINDOW_SIZE, window->length - offset);
+
+        if (zip_source_seek(window->src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(error, window->src);
+            return NULL;
+        }
+        if (_zip_read(window->src, window->data, size, error) < 0) {
+            return NULL;
+        }
+        window->offset = offset;
+        window->size = size;
+    }
+
+    *available = window->offset + window->size - offset;
+    return window->data + (offset - window->offset);
+}
+
+
+/* Find first occurrence of signature magic at or after offset.
+   memchr is vectorized by the C library; searching for the last byte
+   of the signature skips the many 'P's of uncompressed text.
+   Returns 1 if found, 0 if not, -1 on error. */
+
+static int
+window_find(window_t *window, zip_uint64_t offset, const char *magic, size_t magic_length, zip_uint64_t *found, zip_error_t *error) {
+    while (offset < window->length && window->length - offset >= magic_length) {
+        const zip_uint8_t *data, *p, *end;
+        zip_uint64_t available;
+
+        if ((data = window_get(window, offset, RECOVER_WINDOW_SIZE, &available, error)) == NULL) {
+            return -1;
+        }
+        if (available < magic_length) {
+            break;
+        }
+
+        p = data + magic_length - 1;
+        end = data + available;
+        while ((p = (const zip_uint8_t *)memchr(p, magic[magic_length - 1], (size_t)(end - p))) != NULL) {
+            if (memcmp(p - (magic_length - 1), magic, magic_length - 1) == 0) {
+                *found = offset + (zip_uint64_t)(p - (magic_length - 1) - data);
+                return 1;
+            }
+            p += 1;
+        }
+
+        /* signature may straddle end of window */
+        offset += available - (magic_length - 1);
+    }
+
+    return 0;
+}
+
+
+/* Find end of data descriptor of entry de whose data starts at data_offset, and fill in its crc and sizes.
+   The descriptor is followed by the next header or the end of the archive.
+   Returns 1 if found, 0 if not, -1 on error. */
+
+static int
+find_data_end(window_t *window, zip_dirent_t *de, bool zip64, zip_uint64_t data_offset, zip_uint64_t *end, zip_error_t *error) {
+    zip_uint64_t offset = data_offset;
+    int ret;
+
+    /* all signatures start with "PK" */
+    while ((ret = window_find(window, offset, "PK", 2, &offset, error)) > 0) {
+        if ((ret = data_descriptor_at(window, de, zip64, data_offset, offset, end, error)) != 0) {
+            return ret;
+        }
+        offset += 1;
+    }
+    if (ret < 0) {
+        return -1;
+    }
+
+    return data_descriptor_at(window, de, zip64, data_offset, window->length, end, error);
+}
+
+
+/* Check for data descriptor of entry de at offset, or ending there if it has no signature. */
+
+static int
+data_descriptor_at(window_t *window, zip_dirent_t *de, bool zip64, zip_uint64_t data_offset, zip_uint64_t offset, zip_uint64_t *end, zip_error_t *error) {
+    const zip_uint8_t *data;
+    zip_uint64_t available, size, comp_size;
+    zip_buffer_t buffer;
+
+    size = zip64 ? 20 : 12;
+
+    if ((data = window_get(window, offset, 4 + size, &available, error)) == NULL) {
+        return -1;
+    }
+
+    if (available >= 4 + size && memcmp(data, DATADES_MAGIC, 4) == 0) {
+        _zip_buffer_init(&buffer, (zip_uint8_t *)data + 8, size - 4);
+        comp_size = zip64 ? _zip_buffer_get_64(&buffer) : _zip_buffer_get_32(&buffer);
+        if (comp_size == offset - data_offset) {
+            _zip_buffer_init(&buffer, (zip_uint8_t *)data + 4, size);
+            *end = offset + 4 + size;
+        }
+        else {
+            return 0;
+        }
+    }
+    else {
+        if (offset < window->length && (available < 4 || (memcmp(data, LOCAL_MAGIC, 4) != 0 && memcmp(data, CENTRAL_MAGIC, 4) != 0 && memcmp(data, EOCD_MAGIC, 4) != 0))) {
+            return 0;
+        }
+        if (offset - data_offset < size) {
+            return 0;
+        }
+        if ((data = window_get(window, offset - size, size, &available, error)) == NULL) {
+            return -1;
+        }
+        _zip_buffer_init(&buffer, (zip_uint8_t *)data + 4, size - 4);
+        comp_size = zip64 ? _zip_buffer_get_64(&buffer) : _zip_buffer_get_32(&buffer);
+        if (comp_size != offset - size - data_offset) {
+            return 0;
+        }
+        _zip_buffer_init(&buffer, (zip_uint8_t *)data, size);
+        *end = offset;
+    }
+
+    de->crc = _zip_buffer_get_32(&buffer);
+    if (zip64) {
+        de->comp_size = _zip_buffer_get_64(&buffer);
+        de->uncomp_size = _zip_buffer_get_64(&buffer);
+    }
+    else {
+        de->comp_size = _zip_buffer_get_32(&buffer);
+        de->uncomp_size = _zip_buffer_get_32(&buffer);
+    }
+
+    return 1;
+}
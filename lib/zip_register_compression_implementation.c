@@ -0,0 +1,462 @@
+/*
+  zip_register_compression_implementation.c -- use application supplied compression
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+struct registration {
+    zip_uint16_t method;
+    bool has_compress;
+    bool has_decompress;
+    zip_compression_implementation_t compress_implementation;
+    zip_compression_implementation_t decompress_implementation;
+    zip_compression_algorithm_t compress; /* calls compress_implementation */
+    zip_compression_algorithm_t decompress;
+
+    struct registration *next;
+};
+
+/* Context of registered implementation; the implementation is copied so contexts stay valid when it is replaced. */
+struct context {
+    zip_compression_implementation_t implementation;
+    void *ctx;
+};
+
+/* Context of built-in algorithm made available as implementation by zip_get_compression_implementation. */
+struct builtin_context {
+    zip_compression_algorithm_t *algorithm;
+    void *ctx;
+};
+
+static struct registration *registrations = NULL;
+
+static void *allocate(zip_uint16_t method, bool compress, zip_uint32_t compression_flags, zip_error_t *error);
+static void *compress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error);
+static void *decompress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error);
+static void deallocate(void *ud);
+static bool end(void *ud);
+static void end_of_input(void *ud);
+static struct registration *find_registration(zip_uint16_t method);
+static zip_uint16_t general_purpose_bit_flags(void *ud);
+static void init_algorithm(zip_compression_algorithm_t *algorithm, const zip_compression_implementation_t *implementation, bool compress);
+static bool input(void *ud, zip_uint8_t *data, zip_uint64_t length);
+static zip_uint64_t maximum_compressed_size(zip_uint64_t uncompressed_size);
+static zip_compression_status_t process(void *ud, zip_uint8_t *data, zip_uint64_t *length);
+static bool start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes);
+static zip_uint64_t unconsumed_input(void *ud);
+static bool valid_implementation(const zip_compression_implementation_t *implementation);
+
+static void *builtin_allocate(void *ud, zip_uint16_t method, int level, zip_error_t *error);
+static void builtin_deallocate(void *ud);
+static int builtin_end(void *ud);
+static void builtin_end_of_input(void *ud);
+static zip_uint16_t builtin_general_purpose_bit_flags(void *ud);
+static int builtin_input(void *ud, zip_uint8_t *data, zip_uint64_t length);
+static zip_uint64_t builtin_maximum_compressed_size(void *ud, zip_uint64_t uncompressed_size);
+static zip_compression_status_t builtin_process(void *ud, zip_uint8_t *data, zip_uint64_t *length);
+static int builtin_start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes);
+static zip_uint64_t builtin_unconsumed_input(void *ud);
+
+
+ZIP_EXTERN int
+zip_register_compression_implementation(zip_uint16_t method, const zip_compression_implementation_t *compress, const zip_compression_implementation_t *decompress, zip_error_t *error) {
+    struct registration *registration, **prevp;
+
+    if (method == ZIP_CM_STORE || (compress != NULL && !valid_implementation(compress)) || (decompress != NULL && !valid_implementation(decompress))) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    for (prevp = &registrations; *prevp != NULL; prevp = &(*prevp)->next) {
+        if ((*prevp)->method == method) {
+            break;
+        }
+    }
+    registration = *prevp;
+
+    if (compress == NULL && decompress == NULL) {
+        /* back to built-in implementation, if any */
+        if (registration != NULL) {
+            *prevp = registration->next;
+            _zip_free(registration);
+        }
+        return 0;
+    }
+
+    if (registration == NULL) {
+        if ((registration = (struct registration *)_zip_malloc(sizeof(*registration))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        registration->method = method;
+        registration->next = registrations;
+        registrations = registration;
+    }
+
+    registration->has_compress = compress != NULL;
+    if (compress != NULL) {
+        registration->compress_implementation = *compress;
+        init_algorithm(&registration->compress, compress, true);
+    }
+    registration->has_decompress = decompress != NULL;
+    if (decompress != NULL) {
+        registration->decompress_implementation = *decompress;
+        init_algorithm(&registration->decompress, decompress, false);
+    }
+
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_get_compression_implementation(zip_uint16_t method, int compress, zip_compression_implementation_t *implementation, zip_error_t *error) {
+    struct registration *registration;
+    zip_compression_algorithm_t *algorithm;
+
+    if (implementation == NULL) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if ((registration = find_registration(method)) != NULL && (compress ? registration->has_compress : registration->has_decompress)) {
+        *implementation = compress ? registration->compress_implementation : registration->decompress_implementation;
+        return 0;
+    }
+
+    if (method == ZIP_CM_STORE || (algorithm = _zip_get_compression_algorithm(method, compress != 0)) == NULL) {
+        zip_error_set(error, ZIP_ER_COMPNOTSUPP, 0);
+        return -1;
+    }
+
+    implementation->version = 1;
+    implementation->version_needed = algorithm->version_needed;
+    implementation->ud = algorithm;
+    implementation->maximum_compressed_size = builtin_maximum_compressed_size;
+    implementation->allocate = builtin_allocate;
+    implementation->deallocate = builtin_deallocate;
+    implementation->general_purpose_bit_flags = builtin_general_purpose_bit_flags;
+    implementation->start = builtin_start;
+    implementation->end = builtin_end;
+    implementation->input = builtin_input;
+    implementation->end_of_input = builtin_end_of_input;
+    implementation->process = builtin_process;
+    implementation->unconsumed_input = algorithm->unconsumed_input != NULL ? builtin_unconsumed_input : NULL;
+
+    return 0;
+}
+
+
+/* Return registered algorithm for method, NULL if none was registered. */
+zip_compression_algorithm_t *
+_zip_get_registered_compression_algorithm(zip_uint16_t method, bool compress) {
+    struct registration *registration;
+
+    if ((registration = find_registration(method)) == NULL) {
+        return NULL;
+    }
+    if (compress) {
+        return registration->has_compress ? &registration->compress : NULL;
+    }
+    return registration->has_decompress ? &registration->decompress : NULL;
+}
+
+
+/* Return maximum compressed size from registered implementation in *size, false if none was registered. */
+bool
+_zip_registered_maximum_compressed_size(zip_uint16_t method, zip_uint64_t uncompressed_size, zip_uint64_t *size) {
+    struct registration *registration;
+
+    if ((registration = find_registration(method)) == NULL || !registration->has_compress) {
+        return false;
+    }
+    *size = registration->compress_implementation.maximum_compressed_size(registration->compress_implementation.ud, uncompressed_size);
+    return true;
+}
+
+
+static struct registration *
+find_registration(zip_uint16_t method) {
+    struct registration *registration;
+
+    for (registration = registrations; registration != NULL; registration = registration->next) {
+        if (registration->method == method) {
+            return registration;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void
+init_algorithm(zip_compression_algorithm_t *algorithm, const zip_compression_implementation_t *implementation, bool compress) {
+    algorithm->maximum_compressed_size = maximum_compressed_size;
+    algorithm->allocate = compress ? compress_allocate : decompress_allocate;
+    algorithm->deallocate = deallocate;
+    algorithm->general_purpose_bit_flags = general_purpose_bit_flags;
+    algorithm->version_needed = implementation->version_needed;
+    algorithm->start = start;
+    algorithm->end = end;
+    algorithm->input = input;
+    algorithm->end_of_input = end_of_input;
+    algorithm->process = process;
+    algorithm->seek = NULL;
+    algorithm->seek_points = NULL;
+    algorithm->add_seek_points = NULL;
+    algorithm->unconsumed_input = implementation->unconsumed_input != NULL ? unconsumed_input : NULL;
+    algorithm->memory_usage = NULL;
+    algorithm->reset = NULL;
+}
+
+
+static bool
+valid_implementation(const zip_compression_implementation_t *implementation) {
+    return implementation->version == 1 && implementation->maximum_compressed_size != NULL && implementation->allocate != NULL && implementation->deallocate != NULL && implementation->start != NULL && implementation->end != NULL && implementation->input != NULL && implementation->end_of_input != NULL && implementation->process != NULL;
+}
+
+
+static void *
+allocate(zip_uint16_t method, bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
+    struct registration *registration;
+    struct context *ctx;
+
+    if ((registration = find_registration(method)) == NULL || !(compress ? registration->has_compress : registration->has_decompress)) {
+        /* unregistered while in use */
+        zip_error_set(error, ZIP_ER_COMPNOTSUPP, 0);
+        return NULL;
+    }
+
+    if ((ctx = (struct context *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->implementation = compress ? registration->compress_implementation : registration->decompress_implementation;
+
+    /* threads and seek points are only supported by built-in implementations */
+    if ((ctx->ctx = ctx->implementation.allocate(ctx->implementation.ud, method, compress ? (int)ZIP_COMPRESSION_FLAGS_LEVEL(compression_flags) : 0, error)) == NULL) {
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+
+static void *
+compress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error) {
+    return allocate(method, true, compression_flags, error);
+}
+
+
+static void *
+decompress_allocate(zip_uint16_t method, zip_uint32_t compression_flags, zip_error_t *error) {
+    return allocate(method, false, compression_flags, error);
+}
+
+
+static void
+deallocate(void *ud) {
+    struct context *ctx = (struct context *)ud;
+
+    ctx->implementation.deallocate(ctx->ctx);
+    _zip_free(ctx);
+}
+
+
+static bool
+end(void *ud) {
+    struct context *ctx = (struct context *)ud;
+
+    return ctx->implementation.end(ctx->ctx) == 0;
+}
+
+
+static void
+end_of_input(void *ud) {
+    struct context *ctx = (struct context *)ud;
+
+    ctx->implementation.end_of_input(ctx->ctx);
+}
+
+
+static zip_uint16_t
+general_purpose_bit_flags(void *ud) {
+    struct context *ctx = (struct context *)ud;
+
+    if (ctx->implementation.general_purpose_bit_flags == NULL) {
+        return 0;
+    }
+    return ctx->implementation.general_purpose_bit_flags(ctx->ctx);
+}
+
+
+static bool
+input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
+    struct context *ctx = (struct context *)ud;
+
+    return ctx->implementation.input(ctx->ctx, data, length) == 0;
+}
+
+
+/* not used, see _zip_registered_maximum_compressed_size() */
+static zip_uint64_t
+maximum_compressed_size(zip_uint64_t uncompressed_size) {
+    (void)uncompressed_size;
+    return ZIP_UINT64_MAX;
+}
+
+
+static zip_compression_status_t
+process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
+    struct context *ctx = (struct context *)ud;
+
+    return ctx->implementation.process(ctx->ctx, data, length);
+}
+
+
+static bool
+start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
+    struct context *ctx = (struct context *)ud;
+
+    return ctx->implementation.start(ctx->ctx, st, attributes) == 0;
+}
+
+
+static zip_uint64_t
+unconsumed_input(void *ud) {
+    struct context *ctx = (struct context *)ud;
+
+    return ctx->implementation.unconsumed_input(ctx->ctx);
+}
+
+
+/* Built-in algorithms are used without threads, since the caller drives them from one thread. */
+static void *
+builtin_allocate(void *ud, zip_uint16_t method, int level, zip_error_t *error) {
+    zip_compression_algorithm_t *algorithm = (zip_compression_algorithm_t *)ud;
+    struct builtin_context *ctx;
+
+    if ((ctx = (struct builtin_context *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->algorithm = algorithm;
+
+    if ((ctx->ctx = algorithm->allocate(method, level > 0 && level < TORRENTZIP_COMPRESSION_FLAGS ? (zip_uint32_t)level : 0, error)) == NULL) {
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+
+static void
+builtin_deallocate(void *ud) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    ctx->algorithm->deallocate(ctx->ctx);
+    _zip_free(ctx);
+}
+
+
+static int
+builtin_end(void *ud) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    return ctx->algorithm->end(ctx->ctx) ? 0 : -1;
+}
+
+
+static void
+builtin_end_of_input(void *ud) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    ctx->algorithm->end_of_input(ctx->ctx);
+}
+
+
+static zip_uint16_t
+builtin_general_purpose_bit_flags(void *ud) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    return ctx->algorithm->general_purpose_bit_flags(ctx->ctx);
+}
+
+
+static int
+builtin_input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    return ctx->algorithm->input(ctx->ctx, data, length) ? 0 : -1;
+}
+
+
+static zip_uint64_t
+builtin_maximum_compressed_size(void *ud, zip_uint64_t uncompressed_size) {
+    zip_compression_algorithm_t *algorithm = (zip_compression_algorithm_t *)ud;
+
+    return algorithm->maximum_compressed_size(uncompressed_size);
+}
+
+
+static zip_compression_status_t
+builtin_process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    return ctx->algorithm->process(ctx->ctx, data, length);
+}
+
+
+static int
+builtin_start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+    zip_file_attributes_t attributes_none;
+
+    if (attributes == NULL) {
+        zip_file_attributes_init(&attributes_none);
+        attributes = &attributes_none;
+    }
+
+    return ctx->algorithm->start(ctx->ctx, st, attributes) ? 0 : -1;
+}
+
+
+static zip_uint64_t
+builtin_unconsumed_input(void *ud) {
+    struct builtin_context *ctx = (struct builtin_context *)ud;
+
+    return ctx->algorithm->unconsumed_input(ctx->ctx);
+}
@@ -0,0 +1,78 @@
+/*
+  zip_reserve_entries.c -- preallocate space for entries
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_reserve_entries(zip_t *za, zip_uint64_t nentries) {
+    zip_uint64_t total;
+
+    if (za == NULL)
+        return -1;
+
+    if (nentries > ZIP_UINT64_MAX - za->nentry - 1) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    total = za->nentry + nentries;
+
+    /* _zip_add_entry keeps one entry spare */
+    if (total + 1 > za->nentry_alloc) {
+        zip_entry_t *rentries;
+
+        if (total + 1 > SIZE_MAX / sizeof(*rentries)) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        if (!_zip_memory_budget_charge(za->memory_budget, sizeof(*rentries) * (total + 1 - za->nentry_alloc), &za->error)) {
+            return -1;
+        }
+        if ((rentries = (zip_entry_t *)_zip_realloc(za->entry, sizeof(*rentries) * (size_t)(total + 1))) == NULL) {
+            _zip_memory_budget_release(za->memory_budget, sizeof(*rentries) * (total + 1 - za->nentry_alloc));
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        za->entry = rentries;
+        za->nentry_alloc = total + 1;
+    }
+
+    if (!_zip_hash_reserve_capacity(za->names, total, &za->error)) {
+        return -1;
+    }
+
+    return 0;
+}
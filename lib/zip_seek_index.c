@@ -0,0 +1,184 @@
+/*
+  zip_seek_index.c -- seek index extra field
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+/* The seek index extra field lists points in the compressed data at which decompression can start
+   without knowledge of preceding data, so zip_fseek doesn't have to decompress from the start.
+
+   Layout (all little endian):
+     version (1 byte, currently 1)
+     CRC, uncompressed size, compressed size of data (4, 8, 8 bytes)
+     for each point: uncompressed offset, compressed offset (8, 8 bytes)
+
+   The CRC and sizes guard against tools that replace the data but keep unknown extra fields. */
+
+#define SEEK_INDEX_VERSION 1
+#define SEEK_INDEX_HEADER_SIZE 21
+#define SEEK_INDEX_POINT_SIZE 16
+#define SEEK_INDEX_MAX_POINTS 2048
+/* room left for extra fields added when writing directory entry (Zip64, UTF-8 name and comment) */
+#define SEEK_INDEX_RESERVED_SIZE 64
+
+
+/* Return seek points from seek index of de, NULL if there is none or it doesn't match the data. */
+zip_seek_point_t *
+_zip_seek_index_get(const zip_dirent_t *de, zip_uint64_t *npointsp) {
+    const zip_uint8_t *data;
+    zip_buffer_t *buffer;
+    zip_seek_point_t *points;
+    zip_uint64_t i, npoints;
+    zip_uint16_t length;
+
+    if ((data = _zip_dirent_get_extra_field(de, &length, ZIP_EF_SEEK_INDEX, ZIP_EF_CENTRAL)) == NULL) {
+        return NULL;
+    }
+    if (length < SEEK_INDEX_HEADER_SIZE + SEEK_INDEX_POINT_SIZE || (length - SEEK_INDEX_HEADER_SIZE) % SEEK_INDEX_POINT_SIZE != 0) {
+        return NULL;
+    }
+    npoints = (length - SEEK_INDEX_HEADER_SIZE) / SEEK_INDEX_POINT_SIZE;
+
+    if ((buffer = _zip_buffer_new((zip_uint8_t *)data, length)) == NULL) {
+        return NULL;
+    }
+    if (_zip_buffer_get_8(buffer) != SEEK_INDEX_VERSION || _zip_buffer_get_32(buffer) != de->crc || _zip_buffer_get_64(buffer) != de->uncomp_size || _zip_buffer_get_64(buffer) != de->comp_size) {
+        _zip_buffer_free(buffer);
+        return NULL;
+    }
+
+    if ((points = (zip_seek_point_t *)_zip_malloc(sizeof(*points) * (size_t)npoints)) == NULL) {
+        _zip_buffer_free(buffer);
+        return NULL;
+    }
+    for (i = 0; i < npoints; i++) {
+        points[i].uncompressed_offset = _zip_buffer_get_64(buffer);
+        points[i].compressed_offset = _zip_buffer_get_64(buffer);
+
+        if (points[i].uncompressed_offset >= de->uncomp_size || points[i].compressed_offset >= de->comp_size || (i > 0 && (points[i].uncompressed_offset <= points[i - 1].uncompressed_offset || points[i].compressed_offset <= points[i - 1].compressed_offset))) {
+            _zip_free(points);
+            _zip_buffer_free(buffer);
+            return NULL;
+        }
+    }
+    _zip_buffer_free(buffer);
+
+    *npointsp = npoints;
+    return points;
+}
+
+
+/* Replace seek index of entry idx, whose data has been written, by points; remove it if npoints is 0. */
+int
+_zip_seek_index_set(zip_t *za, zip_uint64_t idx, const zip_seek_point_t *points, zip_uint64_t npoints) {
+    zip_dirent_t *de = za->entry[idx].changes;
+    zip_extra_field_t *ef;
+    zip_buffer_t *buffer;
+    zip_uint8_t *data;
+    zip_uint32_t used;
+    zip_uint64_t i, step, n;
+    zip_uint64_t max_points = 0;
+    zip_uint16_t length;
+
+    if (!_zip_dirent_parse_extra_fields(de, za->arena, &za->error)) {
+        return -1;
+    }
+
+    if (npoints > 0) {
+        used = (zip_uint32_t)_zip_ef_size(de->extra_fields, ZIP_EF_CENTRAL) + _zip_string_length(de->filename) + _zip_string_length(de->comment) + SEEK_INDEX_RESERVED_SIZE;
+        if (used + 4 + SEEK_INDEX_HEADER_SIZE + SEEK_INDEX_POINT_SIZE > ZIP_UINT16_MAX) {
+            /* no room, seek index is optional */
+            npoints = 0;
+        }
+        else {
+            max_points = ZIP_MIN(SEEK_INDEX_MAX_POINTS, (ZIP_UINT16_MAX - used - 4 - SEEK_INDEX_HEADER_SIZE) / SEEK_INDEX_POINT_SIZE);
+        }
+    }
+
+    if (npoints == 0 && _zip_ef_get_by_id(de->extra_fields, NULL, ZIP_EF_SEEK_INDEX, 0, ZIP_EF_BOTH, NULL) == NULL) {
+        return 0;
+    }
+
+    if (_zip_file_extra_field_prepare_for_change(za, idx) < 0) {
+        return -1;
+    }
+    de = za->entry[idx].changes;
+    de->extra_fields = _zip_ef_delete_by_id(de->extra_fields, ZIP_EF_SEEK_INDEX, ZIP_EXTRA_FIELD_ALL, ZIP_EF_BOTH);
+
+    if (npoints == 0) {
+        return 0;
+    }
+
+    /* keep every step-th point if there are too many */
+    step = (npoints + max_points - 1) / max_points;
+    n = (npoints + step - 1) / step;
+    length = (zip_uint16_t)(SEEK_INDEX_HEADER_SIZE + n * SEEK_INDEX_POINT_SIZE);
+
+    if ((data = (zip_uint8_t *)_zip_malloc(length)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    if ((buffer = _zip_buffer_new(data, length)) == NULL) {
+        _zip_free(data);
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    _zip_buffer_put_8(buffer, SEEK_INDEX_VERSION);
+    _zip_buffer_put_32(buffer, de->crc);
+    _zip_buffer_put_64(buffer, de->uncomp_size);
+    _zip_buffer_put_64(buffer, de->comp_size);
+    for (i = 0; i < npoints; i += step) {
+        _zip_buffer_put_64(buffer, points[i].uncompressed_offset);
+        _zip_buffer_put_64(buffer, points[i].compressed_offset);
+    }
+
+    if (!_zip_buffer_ok(buffer)) {
+        _zip_buffer_free(buffer);
+        _zip_free(data);
+        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+        return -1;
+    }
+    _zip_buffer_free(buffer);
+
+    ef = _zip_ef_new(ZIP_EF_SEEK_INDEX, length, data, ZIP_EF_CENTRAL);
+    _zip_free(data);
+    if (ef == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    de->extra_fields = _zip_ef_merge(de->extra_fields, ef);
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+  zip_set_allocator.c -- use custom memory allocator
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+#if !defined(_WIN32) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
+
+/* size of huge pages used for transparent huge pages on common platforms */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Set before any other libzip function is called, so it needs no locking. */
+static zip_allocator_t allocator;
+static bool have_allocator = false;
+
+/* data blocks of at least this size should be backed by huge pages, 0 for none, set by zip_set_huge_page_threshold() */
+static zip_uint64_t huge_page_threshold = 0;
+
+
+ZIP_EXTERN int
+zip_set_allocator(const zip_allocator_t *new_allocator) {
+    if (new_allocator == NULL) {
+        have_allocator = false;
+        return 0;
+    }
+
+    if (new_allocator->version != 1 || new_allocator->allocate == NULL || new_allocator->reallocate == NULL || new_allocator->deallocate == NULL) {
+        return -1;
+    }
+
+    allocator = *new_allocator;
+    have_allocator = true;
+
+    return 0;
+}
+
+
+ZIP_EXTERN void
+zip_set_huge_page_threshold(zip_uint64_t size) {
+    huge_page_threshold = size;
+}
+
+
+/* Ask the operating system to back data, a newly allocated block of length bytes, with huge pages if it is large enough.
+   Only a hint: only the huge pages completely inside the block are affected, and it is ignored where not supported. */
+void
+_zip_advise_huge_pages(void *data, zip_uint64_t length) {
+#if !defined(_WIN32) && defined(HAVE_MMAP) && defined(MADV_HUGEPAGE)
+    uintptr_t start, end;
+
+    if (huge_page_threshold == 0 || length < huge_page_threshold || data == NULL || length > UINTPTR_MAX - (uintptr_t)data) {
+        return;
+    }
+
+    start = ((uintptr_t)data + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    end = ((uintptr_t)data + (uintptr_t)length) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    if (start < end) {
+        (void)madvise((void *)start, end - start, MADV_HUGEPAGE);
+    }
+#else
+    (void)data;
+    (void)length;
+#endif
+}
+
+
+void *
+_zip_calloc(size_t nmemb, size_t size) {
+    void *ptr;
+
+    if (!have_allocator) {
+        return calloc(nmemb, size);
+    }
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    if ((ptr = allocator.allocate(allocator.ud, nmemb * size)) != NULL) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+
+void
+_zip_free(void *ptr) {
+    if (!have_allocator) {
+        free(ptr);
+        return;
+    }
+
+    if (ptr != NULL) {
+        allocator.deallocate(allocator.ud, ptr);
+    }
+}
+
+
+void *
+_zip_malloc(size_t size) {
+    if (!have_allocator) {
+        return malloc(size);
+    }
+
+    return allocator.allocate(allocator.ud, size);
+}
+
+
+void *
+_zip_realloc(void *ptr, size_t size) {
+    if (!have_allocator) {
+        return realloc(ptr, size);
+    }
+
+    return allocator.reallocate(allocator.ud, ptr, size);
+}
+
+
+char *
+_zip_strdup(const char *string) {
+    size_t length = strlen(string) + 1;
+    char *copy;
+
+    if ((copy = (char *)_zip_malloc(length)) != NULL) {
+        (void)memcpy_s(copy, length, string, length);
+    }
+    return copy;
+}
@@ -0,0 +1,156 @@
+/*
+  zip_set_compression_dictionary.c -- set dictionary shared by entries
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+#if defined(HAVE_LIBZSTD)
+static zip_zstd_dictionary_t *dictionary_load(zip_t *za);
+#endif
+
+
+ZIP_EXTERN int
+zip_set_compression_dictionary(zip_t *za, zip_int32_t method, const void *data, zip_uint64_t length) {
+#if defined(HAVE_LIBZSTD)
+    zip_zstd_dictionary_t *dictionary = NULL;
+#endif
+
+    if (za == NULL)
+        return -1;
+
+    if (data == NULL && length > 0) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (method != ZIP_CM_ZSTD) {
+        zip_error_set(&za->error, ZIP_ER_COMPNOTSUPP, 0);
+        return -1;
+    }
+
+#if !defined(HAVE_LIBZSTD)
+    zip_error_set(&za->error, ZIP_ER_COMPNOTSUPP, 0);
+    return -1;
+#else
+    if (length > 0) {
+        if ((dictionary = _zip_zstd_dictionary_new(data, length, &za->error)) == NULL) {
+            return -1;
+        }
+
+        /* store dictionary in archive, so readers can find it */
+        if (!ZIP_IS_RDONLY(za)) {
+            zip_source_t *src;
+            void *copy;
+            zip_int64_t idx;
+
+            if ((copy = _zip_memdup(data, (size_t)length, &za->error)) == NULL) {
+                _zip_zstd_dictionary_free(dictionary);
+                return -1;
+            }
+            if ((src = zip_source_buffer(za, copy, length, 1)) == NULL) {
+                _zip_free(copy);
+                _zip_zstd_dictionary_free(dictionary);
+                return -1;
+            }
+            if ((idx = zip_file_add(za, ZIP_ZSTD_DICTIONARY_NAME, src, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8)) < 0) {
+                zip_source_free(src);
+                _zip_zstd_dictionary_free(dictionary);
+                return -1;
+            }
+            /* it can't be compressed with itself */
+            if (zip_set_file_compression(za, (zip_uint64_t)idx, ZIP_CM_STORE, 0) < 0) {
+                _zip_zstd_dictionary_free(dictionary);
+                return -1;
+            }
+        }
+    }
+
+    _zip_zstd_dictionary_free(za->zstd_dictionary);
+    za->zstd_dictionary = dictionary;
+    za->zstd_dictionary_loaded = true;
+
+    return 0;
+#endif
+}
+
+
+#if defined(HAVE_LIBZSTD)
+/* Get dictionary for zstd compressed entries, loading it from archive when first needed. */
+zip_zstd_dictionary_t *
+_zip_zstd_dictionary_get(zip_t *za) {
+    if (!za->zstd_dictionary_loaded) {
+        /* set before loading, so reading the dictionary entry doesn't try again */
+        za->zstd_dictionary_loaded = true;
+        za->zstd_dictionary = dictionary_load(za);
+    }
+
+    return za->zstd_dictionary;
+}
+
+
+/* Read dictionary from original archive, NULL if there is none or it can't be read. Entries needing it then fail with ZIP_ER_COMPRESSED_DATA. */
+static zip_zstd_dictionary_t *
+dictionary_load(zip_t *za) {
+    zip_zstd_dictionary_t *dictionary = NULL;
+    zip_uint8_t *data = NULL;
+    zip_source_t *src;
+    zip_error_t error;
+    zip_stat_t st;
+    zip_int64_t idx;
+
+    if ((idx = _zip_name_locate(za, ZIP_ZSTD_DICTIONARY_NAME, ZIP_FL_UNCHANGED | ZIP_FL_ENC_RAW, NULL)) < 0) {
+        return NULL;
+    }
+
+    zip_error_init(&error);
+    if ((src = zip_source_zip_file_create(za, (zip_uint64_t)idx, ZIP_FL_UNCHANGED, 0, -1, NULL, &error)) == NULL) {
+        zip_error_fini(&error);
+        return NULL;
+    }
+    if (zip_source_open(src) == 0) {
+        if (zip_source_stat(src, &st) == 0 && (st.valid & ZIP_STAT_SIZE) && st.size > 0 && st.size <= SIZE_MAX && (data = (zip_uint8_t *)_zip_malloc((size_t)st.size)) != NULL) {
+            if (zip_source_read(src, data, st.size) == (zip_int64_t)st.size) {
+                dictionary = _zip_zstd_dictionary_new(data, st.size, &error);
+            }
+            _zip_free(data);
+        }
+        zip_source_close(src);
+    }
+    zip_source_free(src);
+    zip_error_fini(&error);
+
+    return dictionary;
+}
+#endif
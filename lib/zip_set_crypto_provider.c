@@ -0,0 +1,73 @@
+/*
+  zip_set_crypto_provider.c -- use custom cryptographic primitives
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_set_crypto_provider(zip_t *za, const zip_crypto_provider_t *provider) {
+    zip_crypto_provider_t *copy = NULL;
+
+    if (za == NULL)
+        return -1;
+
+    if (provider != NULL) {
+#ifndef HAVE_CRYPTO
+        zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+#else
+        if (provider->version != 1 || provider->aes_new == NULL || provider->aes_encrypt_blocks == NULL || provider->aes_free == NULL || provider->hmac_new == NULL || provider->hmac_update == NULL || provider->hmac_output == NULL || provider->hmac_free == NULL || provider->pbkdf2 == NULL) {
+            zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        if ((copy = (zip_crypto_provider_t *)_zip_malloc(sizeof(*copy))) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        *copy = *provider;
+#endif
+    }
+
+    _zip_free(za->crypto_provider);
+    za->crypto_provider = copy;
+
+#ifdef HAVE_CRYPTO
+    /* keys derived with the previous provider */
+    _zip_winzip_aes_key_cache_clear(za->aes_key_cache);
+#endif
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+  zip_set_data_order.c -- set order of file data in archive
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <string.h>
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_set_data_order(zip_t *za, const zip_uint64_t *indices, zip_uint64_t nindices) {
+    zip_uint64_t *order;
+    zip_uint8_t *seen;
+    zip_uint64_t i;
+
+    if (ZIP_IS_RDONLY(za)) {
+        zip_error_set(&za->error, ZIP_ER_RDONLY, 0);
+        return -1;
+    }
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        zip_error_set(&za->error, ZIP_ER_NOT_ALLOWED, 0);
+        return -1;
+    }
+
+    if ((nindices > 0 && indices == NULL) || nindices > za->nentry) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    order = NULL;
+    if (nindices > 0) {
+        if ((order = (zip_uint64_t *)_zip_malloc(sizeof(order[0]) * (size_t)nindices)) == NULL || (seen = (zip_uint8_t *)_zip_calloc((size_t)za->nentry, 1)) == NULL) {
+            _zip_free(order);
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        for (i = 0; i < nindices; i++) {
+            if (indices[i] >= za->nentry || seen[indices[i]]) {
+                _zip_free(seen);
+                _zip_free(order);
+                zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+                return -1;
+            }
+            seen[indices[i]] = 1;
+        }
+        _zip_free(seen);
+        (void)memcpy_s(order, sizeof(order[0]) * (size_t)nindices, indices, sizeof(order[0]) * (size_t)nindices);
+    }
+
+    _zip_free(za->data_order);
+    za->data_order = order;
+    za->ndata_order = nindices;
+
+    return 0;
+}
@@ -43,10 +43,10 @@ zip_set_default_password(zip_t *za, const char *passwd) {
     if (za == NULL)
         return -1;
 
-    free(za->default_password);
+    _zip_free(za->default_password);
 
     if (passwd && passwd[0] != '\0') {
-        if ((za->default_password = strdup(passwd)) == NULL) {
+        if ((za->default_password = _zip_strdup(passwd)) == NULL) {
             zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
             return -1;
         }
@@ -0,0 +1,73 @@
+/*
+  zip_set_executor.c -- set executor for parallel work
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+/* Set while no other libzip function is running, so it needs no locking. */
+static zip_executor_t executor;
+static bool have_executor = false;
+
+
+ZIP_EXTERN int
+zip_set_executor(const zip_executor_t *new_executor) {
+#ifndef HAVE_THREADS
+    (void)new_executor;
+    return -1;
+#else
+    if (new_executor == NULL) {
+        have_executor = false;
+        return 0;
+    }
+
+    if (new_executor->version != 1 || new_executor->submit == NULL) {
+        return -1;
+    }
+
+    executor = *new_executor;
+    have_executor = true;
+
+    return 0;
+#endif
+}
+
+
+/* Copy executor set by zip_set_executor() to *copy; false if libzip's own threads are used. */
+bool
+_zip_executor_get(zip_executor_t *copy) {
+    if (!have_executor) {
+        return false;
+    }
+
+    *copy = executor;
+    return true;
+}
@@ -59,6 +59,10 @@ zip_set_file_compression(zip_t *za, zip_uint64_t idx, zip_int32_t method, zip_ui
         return -1;
     }
 
+    if (!_zip_cdir_index_load(za, idx, &za->error) || !_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
+
     e = za->entry + idx;
 
     old_method = (e->orig == NULL ? ZIP_CM_DEFAULT : e->orig->comp_method);
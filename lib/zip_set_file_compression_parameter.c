@@ -0,0 +1,129 @@
+/*
+  zip_set_file_compression_parameter.c -- set compression parameter for file in archive
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_set_file_compression_parameter(zip_t *za, zip_uint64_t idx, zip_uint32_t parameter, zip_int64_t value) {
+    zip_entry_t *e;
+    zip_uint8_t *field;
+    zip_int64_t minimum, maximum;
+
+    if (idx >= za->nentry) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    switch (parameter) {
+    case ZIP_CP_ZSTD_WINDOW_LOG:
+    case ZIP_CP_ZSTD_WINDOW_LOG_MAX:
+        minimum = 10;
+        maximum = 31;
+        break;
+
+    case ZIP_CP_ZSTD_STRATEGY:
+        minimum = 1;
+        maximum = 9;
+        break;
+
+    case ZIP_CP_ZSTD_LONG_DISTANCE_MATCHING:
+        minimum = 0;
+        maximum = 1;
+        break;
+
+    default:
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    /* 0 restores the default */
+    if (value != 0 && (value < minimum || value > maximum)) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (!_zip_cdir_index_load(za, idx, &za->error)) {
+        return -1;
+    }
+
+    e = za->entry + idx;
+
+    if (parameter == ZIP_CP_ZSTD_WINDOW_LOG_MAX) {
+        /* only used when reading, so also allowed for read-only archives */
+        if (e->orig == NULL) {
+            zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        e->orig->zstd_parameters.window_log_max = (zip_uint8_t)value;
+        if (e->changes) {
+            e->changes->zstd_parameters.window_log_max = (zip_uint8_t)value;
+        }
+        return 0;
+    }
+
+    if (ZIP_IS_RDONLY(za)) {
+        zip_error_set(&za->error, ZIP_ER_RDONLY, 0);
+        return -1;
+    }
+
+    if (!_zip_entry_log_change(za, idx)) {
+        return -1;
+    }
+
+    if (e->changes == NULL) {
+        if ((e->changes = _zip_dirent_clone(e->orig)) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+    }
+
+    switch (parameter) {
+    case ZIP_CP_ZSTD_WINDOW_LOG:
+        field = &e->changes->zstd_parameters.window_log;
+        break;
+
+    case ZIP_CP_ZSTD_STRATEGY:
+        field = &e->changes->zstd_parameters.strategy;
+        break;
+
+    default:
+        field = &e->changes->zstd_parameters.long_distance_matching;
+        break;
+    }
+
+    *field = (zip_uint8_t)value;
+    e->changes->changed |= ZIP_DIRENT_COMPRESSION_PARAMETERS;
+
+    return 0;
+}
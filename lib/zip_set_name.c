@@ -80,6 +80,11 @@ _zip_set_name(zip_t *za, zip_uint64_t idx, const char *name, zip_flags_t flags)
         return 0;
     }
 
+    if (!_zip_cdir_index_load(za, idx, &za->error) || !_zip_entry_log_change(za, idx)) {
+        _zip_string_free(str);
+        return -1;
+    }
+
     e = za->entry + idx;
 
     if (e->orig)
@@ -120,13 +125,14 @@ _zip_set_name(zip_t *za, zip_uint64_t idx, const char *name, zip_flags_t flags)
         old_name = NULL;
     }
 
-    if (_zip_hash_add(za->names, new_name, idx, 0, &za->error) == false) {
+    if (!_zip_names_build_hash(za, &za->error) || _zip_hash_add(za->names, new_name, idx, 0, &za->error) == false) {
         _zip_string_free(str);
         return -1;
     }
     if (old_name) {
         _zip_hash_delete(za->names, old_name, NULL);
     }
+    _zip_name_index_free(za);
 
     if (same_as_orig) {
         if (e->changes) {
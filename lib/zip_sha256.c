@@ -0,0 +1,172 @@
+/*
+  zip_sha256.c -- SHA-256 message digest
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include "zipint.h"
+
+/* SHA-256 as specified in FIPS 180-4, for digests of entry data. */
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const zip_uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/* process 64 byte block */
+static void
+sha256_block(zip_uint32_t *state, const zip_uint8_t *block) {
+    zip_uint32_t w[64];
+    zip_uint32_t a, b, c, d, e, f, g, h;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = ((zip_uint32_t)block[4 * i] << 24) | ((zip_uint32_t)block[4 * i + 1] << 16) | ((zip_uint32_t)block[4 * i + 2] << 8) | (zip_uint32_t)block[4 * i + 3];
+    }
+    for (i = 16; i < 64; i++) {
+        zip_uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        zip_uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for (i = 0; i < 64; i++) {
+        zip_uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + w[i];
+        zip_uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+
+void
+_zip_sha256_init(zip_sha256_t *ctx) {
+    ctx->state[0] = 0x6a09e667;
+    ctx->state[1] = 0xbb67ae85;
+    ctx->state[2] = 0x3c6ef372;
+    ctx->state[3] = 0xa54ff53a;
+    ctx->state[4] = 0x510e527f;
+    ctx->state[5] = 0x9b05688c;
+    ctx->state[6] = 0x1f83d9ab;
+    ctx->state[7] = 0x5be0cd19;
+    ctx->length = 0;
+}
+
+
+void
+_zip_sha256_update(zip_sha256_t *ctx, const zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t used = ctx->length % ZIP_SHA256_BLOCK_SIZE;
+
+    ctx->length += length;
+
+    if (used > 0) {
+        zip_uint64_t n = ZIP_MIN(length, ZIP_SHA256_BLOCK_SIZE - used);
+
+        (void)memcpy_s(ctx->buffer + used, ZIP_SHA256_BLOCK_SIZE - used, data, (size_t)n);
+        data += n;
+        length -= n;
+        if (used + n < ZIP_SHA256_BLOCK_SIZE) {
+            return;
+        }
+        sha256_block(ctx->state, ctx->buffer);
+    }
+
+    while (length >= ZIP_SHA256_BLOCK_SIZE) {
+        sha256_block(ctx->state, data);
+        data += ZIP_SHA256_BLOCK_SIZE;
+        length -= ZIP_SHA256_BLOCK_SIZE;
+    }
+
+    if (length > 0) {
+        (void)memcpy_s(ctx->buffer, ZIP_SHA256_BLOCK_SIZE, data, (size_t)length);
+    }
+}
+
+
+void
+_zip_sha256_final(zip_sha256_t *ctx, zip_uint8_t *digest) {
+    zip_uint64_t used = ctx->length % ZIP_SHA256_BLOCK_SIZE;
+    zip_uint64_t bits = ctx->length * 8;
+    int i;
+
+    ctx->buffer[used++] = 0x80;
+    if (used > ZIP_SHA256_BLOCK_SIZE - 8) {
+        memset(ctx->buffer + used, 0, (size_t)(ZIP_SHA256_BLOCK_SIZE - used));
+        sha256_block(ctx->state, ctx->buffer);
+        used = 0;
+    }
+    memset(ctx->buffer + used, 0, (size_t)(ZIP_SHA256_BLOCK_SIZE - 8 - used));
+    for (i = 0; i < 8; i++) {
+        ctx->buffer[ZIP_SHA256_BLOCK_SIZE - 1 - i] = (zip_uint8_t)(bits >> (8 * i));
+    }
+    sha256_block(ctx->state, ctx->buffer);
+
+    for (i = 0; i < 8; i++) {
+        digest[4 * i] = (zip_uint8_t)(ctx->state[i] >> 24);
+        digest[4 * i + 1] = (zip_uint8_t)(ctx->state[i] >> 16);
+        digest[4 * i + 2] = (zip_uint8_t)(ctx->state[i] >> 8);
+        digest[4 * i + 3] = (zip_uint8_t)ctx->state[i];
+    }
+}
@@ -0,0 +1,599 @@
+/*
+  zip_shared_entry.c -- share data of entry between files reading it
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* at most this much data is kept for files reading behind others */
+#define MAX_BUFFER_SIZE (16 * 1024 * 1024)
+#define MIN_BUFFER_SIZE (64 * 1024)
+
+/* reference to shared entry, with its own read position */
+struct reader {
+    zip_shared_entry_t *entry;
+    zip_uint64_t offset;
+    bool detached;     /* data at offset is no longer shared, read from src */
+    zip_source_t *src; /* own source of detached reader, opened on first read */
+    zip_error_t error;
+    struct reader *next; /* in list of entry */
+};
+typedef struct reader reader_t;
+
+/* Data of an entry read by several files, decompressed once.
+   Kept alive by its readers, and may outlive the archive. */
+struct zip_shared_entry {
+    zip_t *za; /* NULL once archive is closed or committed */
+    zip_uint64_t index;
+    zip_flags_t flags;
+    zip_source_t *src;     /* opened source of entry data */
+    zip_uint64_t size;     /* of entry data */
+    bool seekable;         /* src can seek and size is known */
+    zip_uint64_t position; /* read position of src */
+    bool eof;              /* src is at end of data */
+    zip_error_t error;     /* of failed read from src, reported to all readers reaching it */
+    zip_uint8_t *buffer;   /* data from buffer_offset to position, for readers behind position */
+    zip_uint64_t buffer_offset;
+    zip_uint64_t buffer_alloc; /* charged to budget */
+    zip_memory_budget_t *budget;
+    reader_t *readers;
+    zip_shared_entry_t *next; /* in list of archive */
+};
+
+static void entry_compact(zip_shared_entry_t *entry, bool force);
+static void entry_detach_others(zip_shared_entry_t *entry, reader_t *reader);
+static void entry_free(zip_shared_entry_t *entry);
+static bool entry_grow(zip_shared_entry_t *entry, zip_uint64_t length);
+static zip_shared_entry_t *entry_new(zip_t *za, zip_uint64_t index, zip_flags_t flags);
+static zip_int64_t entry_read(zip_shared_entry_t *entry, reader_t *reader, zip_uint8_t *data, zip_uint64_t length);
+static bool entry_sole_reader(zip_shared_entry_t *entry, reader_t *reader);
+static zip_int64_t read_shared(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+static zip_source_t *reader_new(zip_shared_entry_t *entry, zip_error_t *error);
+static bool reader_open_own(reader_t *reader);
+static zip_int64_t reader_read(reader_t *reader, zip_uint8_t *data, zip_uint64_t length);
+static int reader_seek(reader_t *reader, zip_uint64_t offset);
+static bool shareable(zip_t *za, zip_uint64_t index, zip_flags_t flags);
+
+
+/* Stop sharing entries of archive, whose sources are invalidated by zip_discard() or zip_commit(). */
+void
+_zip_shared_entry_detach_all(zip_t *za) {
+    zip_shared_entry_t *entry;
+
+    for (entry = za->shared_entries; entry != NULL; entry = entry->next) {
+        entry->za = NULL;
+    }
+    za->shared_entries = NULL;
+}
+
+
+/* Open source reading data of entry index, sharing decompression with other files reading it from the start.
+   Set *srcp to NULL if the entry can't be shared; the caller then reads it from the archive.
+   Return false and set za->error if the entry can't be read. */
+bool
+_zip_shared_entry_open(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_source_t **srcp) {
+    zip_shared_entry_t *entry;
+    zip_source_t *src;
+
+    *srcp = NULL;
+    if (!shareable(za, index, flags)) {
+        return true;
+    }
+    flags |= ZIP_FL_UNCHANGED;
+
+    /* join only if data from the start is still buffered */
+    for (entry = za->shared_entries; entry != NULL; entry = entry->next) {
+        if (entry->index == index && entry->flags == flags && entry->buffer_offset == 0) {
+            break;
+        }
+    }
+    if (entry == NULL && (entry = entry_new(za, index, flags)) == NULL) {
+        return false;
+    }
+
+    if ((src = reader_new(entry, &za->error)) == NULL) {
+        if (entry->readers == NULL) {
+            entry_free(entry);
+        }
+        return false;
+    }
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        zip_source_free(src);
+        return false;
+    }
+
+    *srcp = src;
+    return true;
+}
+
+
+/* Drop data no reader needs anymore. Unless forced, only move data when that is at most as much as is dropped. */
+static void
+entry_compact(zip_shared_entry_t *entry, bool force) {
+    reader_t *reader;
+    zip_uint64_t start;
+
+    start = entry->position;
+    for (reader = entry->readers; reader != NULL; reader = reader->next) {
+        if (!reader->detached && reader->offset < start) {
+            start = reader->offset;
+        }
+    }
+
+    if (start == entry->buffer_offset || (!force && start - entry->buffer_offset < entry->position - start)) {
+        return;
+    }
+    if (entry->position > start) {
+        memmove(entry->buffer, entry->buffer + (start - entry->buffer_offset), (size_t)(entry->position - start));
+    }
+    entry->buffer_offset = start;
+}
+
+
+/* Make all readers but reader read on their own. */
+static void
+entry_detach_others(zip_shared_entry_t *entry, reader_t *reader) {
+    reader_t *other;
+
+    for (other = entry->readers; other != NULL; other = other->next) {
+        if (other != reader) {
+            other->detached = true;
+        }
+    }
+    entry_compact(entry, true);
+}
+
+
+static void
+entry_free(zip_shared_entry_t *entry) {
+    zip_shared_entry_t **p;
+
+    if (entry->za != NULL) {
+        for (p = &entry->za->shared_entries; *p != entry; p = &(*p)->next) {
+        }
+        *p = entry->next;
+    }
+
+    zip_source_free(entry->src);
+    _zip_free(entry->buffer);
+    _zip_memory_budget_release(entry->budget, entry->buffer_alloc);
+    _zip_memory_budget_free(entry->budget);
+    zip_error_fini(&entry->error);
+    _zip_free(entry);
+}
+
+
+/* Make room for length more bytes of data after position. */
+static bool
+entry_grow(zip_shared_entry_t *entry, zip_uint64_t length) {
+    zip_uint8_t *buffer;
+    zip_uint64_t size, alloc;
+    zip_error_t error;
+    bool ok;
+
+    if (entry->position - entry->buffer_offset + length <= entry->buffer_alloc) {
+        return true;
+    }
+    entry_compact(entry, true);
+    size = entry->position - entry->buffer_offset + length;
+    if (size <= entry->buffer_alloc) {
+        return true;
+    }
+    if (size > MAX_BUFFER_SIZE) {
+        return false;
+    }
+
+    alloc = ZIP_MAX(ZIP_MAX(entry->buffer_alloc * 2, MIN_BUFFER_SIZE), size);
+    alloc = ZIP_MIN(alloc, MAX_BUFFER_SIZE);
+
+    zip_error_init(&error);
+    ok = _zip_memory_budget_charge(entry->budget, alloc - entry->buffer_alloc, &error);
+    zip_error_fini(&error);
+    if (!ok) {
+        return false;
+    }
+    if ((buffer = (zip_uint8_t *)_zip_realloc(entry->buffer, (size_t)alloc)) == NULL) {
+        _zip_memory_budget_release(entry->budget, alloc - entry->buffer_alloc);
+        return false;
+    }
+
+    entry->buffer = buffer;
+    entry->buffer_alloc = alloc;
+    return true;
+}
+
+
+static zip_shared_entry_t *
+entry_new(zip_t *za, zip_uint64_t index, zip_flags_t flags) {
+    zip_shared_entry_t *entry;
+    zip_stat_t st;
+
+    if ((entry = (zip_shared_entry_t *)_zip_malloc(sizeof(*entry))) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((entry->src = zip_source_zip_file_create(za, index, flags, 0, -1, NULL, &za->error)) == NULL) {
+        _zip_free(entry);
+        return NULL;
+    }
+    if (zip_source_open(entry->src) < 0) {
+        zip_error_set_from_source(&za->error, entry->src);
+        zip_source_free(entry->src);
+        _zip_free(entry);
+        return NULL;
+    }
+
+    entry->za = za;
+    entry->index = index;
+    entry->flags = flags;
+    entry->seekable = zip_source_is_seekable(entry->src) > 0 && zip_source_stat(entry->src, &st) == 0 && (st.valid & ZIP_STAT_SIZE);
+    entry->size = entry->seekable ? st.size : 0;
+    entry->position = 0;
+    entry->eof = false;
+    zip_error_init(&entry->error);
+    entry->buffer = NULL;
+    entry->buffer_offset = 0;
+    entry->buffer_alloc = 0;
+    entry->budget = _zip_memory_budget_ref(za->memory_budget);
+    entry->readers = NULL;
+
+    entry->next = za->shared_entries;
+    za->shared_entries = entry;
+
+    return entry;
+}
+
+
+/* Read from source of entry for reader at position. */
+static zip_int64_t
+entry_read(zip_shared_entry_t *entry, reader_t *reader, zip_uint8_t *data, zip_uint64_t length) {
+    zip_int64_t n;
+
+    if ((n = zip_source_read(entry->src, data, length)) < 0) {
+        zip_error_set_from_source(&entry->error, entry->src);
+        _zip_error_copy(&reader->error, &entry->error);
+        return -1;
+    }
+    if (n == 0) {
+        entry->eof = true;
+    }
+    entry->position += (zip_uint64_t)n;
+
+    return n;
+}
+
+
+/* Check whether no other reader reads shared data. */
+static bool
+entry_sole_reader(zip_shared_entry_t *entry, reader_t *reader) {
+    reader_t *other;
+
+    for (other = entry->readers; other != NULL; other = other->next) {
+        if (other != reader && !other->detached) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static zip_int64_t
+read_shared(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    reader_t *reader = (reader_t *)ud;
+    zip_shared_entry_t *entry = reader->entry;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN:
+        return 0;
+
+    case ZIP_SOURCE_READ:
+        return reader_read(reader, (zip_uint8_t *)data, length);
+
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, length, &reader->error);
+
+        if (st == NULL) {
+            return -1;
+        }
+        if (zip_source_stat(entry->src, st) < 0) {
+            zip_error_set_from_source(&reader->error, entry->src);
+            return -1;
+        }
+        return 0;
+    }
+
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_offset = zip_source_seek_compute_offset(reader->offset, entry->size, data, length, &reader->error);
+
+        if (new_offset < 0) {
+            return -1;
+        }
+        return reader_seek(reader, (zip_uint64_t)new_offset);
+    }
+
+    case ZIP_SOURCE_TELL:
+        return (zip_int64_t)reader->offset;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&reader->error, data, length);
+
+    case ZIP_SOURCE_FREE: {
+        reader_t **p;
+
+        for (p = &entry->readers; *p != reader; p = &(*p)->next) {
+        }
+        *p = reader->next;
+        if (entry->readers == NULL) {
+            entry_free(entry);
+        }
+        else {
+            entry_compact(entry, false);
+        }
+
+        zip_source_free(reader->src);
+        zip_error_fini(&reader->error);
+        _zip_free(reader);
+        return 0;
+    }
+
+    case ZIP_SOURCE_GET_DATA: {
+        zip_source_args_get_data_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_get_data_t, data, length, &reader->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (zip_source_get_data(entry->src, args->offset, args->length, &args->data) < 0) {
+            zip_error_set_from_source(&reader->error, entry->src);
+            return -1;
+        }
+        return 0;
+    }
+
+    case ZIP_SOURCE_SUPPORTS: {
+        zip_int64_t supports = zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, -1);
+
+        if (entry->seekable) {
+            supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK);
+        }
+        return supports | (zip_source_supports(entry->src) & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_GET_DATA));
+    }
+
+    default:
+        zip_error_set(&reader->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+
+static zip_source_t *
+reader_new(zip_shared_entry_t *entry, zip_error_t *error) {
+    reader_t *reader;
+    zip_source_t *src;
+
+    if ((reader = (reader_t *)_zip_malloc(sizeof(*reader))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    reader->entry = entry;
+    reader->offset = 0;
+    reader->detached = false;
+    reader->src = NULL;
+    zip_error_init(&reader->error);
+
+    if ((src = zip_source_function_create(read_shared, reader, error)) == NULL) {
+        zip_error_fini(&reader->error);
+        _zip_free(reader);
+        return NULL;
+    }
+
+    reader->next = entry->readers;
+    entry->readers = reader;
+
+    return src;
+}
+
+
+/* Open own source for detached reader, positioned at its offset. */
+static bool
+reader_open_own(reader_t *reader) {
+    zip_shared_entry_t *entry = reader->entry;
+    zip_source_t *src;
+    zip_uint8_t buffer[8192];
+    zip_uint64_t offset;
+    zip_int64_t n;
+
+    if (entry->za == NULL) {
+        zip_error_set(&reader->error, ZIP_ER_ZIPCLOSED, 0);
+        return false;
+    }
+    if ((src = zip_source_zip_file_create(entry->za, entry->index, entry->flags, 0, -1, NULL, &reader->error)) == NULL) {
+        return false;
+    }
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&reader->error, src);
+        zip_source_free(src);
+        return false;
+    }
+
+    if (entry->seekable) {
+        if (zip_source_seek(src, (zip_int64_t)reader->offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(&reader->error, src);
+            zip_source_free(src);
+            return false;
+        }
+    }
+    else {
+        for (offset = 0; offset < reader->offset; offset += (zip_uint64_t)n) {
+            if ((n = zip_source_read(src, buffer, ZIP_MIN(sizeof(buffer), reader->offset - offset))) <= 0) {
+                if (n < 0) {
+                    zip_error_set_from_source(&reader->error, src);
+                }
+                else {
+                    zip_error_set(&reader->error, ZIP_ER_INCONS, 0);
+                }
+                zip_source_free(src);
+                return false;
+            }
+        }
+    }
+
+    reader->src = src;
+    return true;
+}
+
+
+static zip_int64_t
+reader_read(reader_t *reader, zip_uint8_t *data, zip_uint64_t length) {
+    zip_shared_entry_t *entry = reader->entry;
+    zip_uint64_t n;
+    zip_int64_t ret;
+
+    if (reader->detached) {
+        if (reader->src == NULL && !reader_open_own(reader)) {
+            return -1;
+        }
+        if ((ret = zip_source_read(reader->src, data, length)) < 0) {
+            zip_error_set_from_source(&reader->error, reader->src);
+            return -1;
+        }
+        reader->offset += (zip_uint64_t)ret;
+        return ret;
+    }
+
+    if (entry->za == NULL) {
+        zip_error_set(&reader->error, ZIP_ER_ZIPCLOSED, 0);
+        return -1;
+    }
+
+    if (reader->offset < entry->position) {
+        n = ZIP_MIN(length, entry->position - reader->offset);
+        memcpy(data, entry->buffer + (reader->offset - entry->buffer_offset), (size_t)n);
+        reader->offset += n;
+        entry_compact(entry, false);
+        return (zip_int64_t)n;
+    }
+
+    if (zip_error_code_zip(&entry->error) != ZIP_ER_OK) {
+        _zip_error_copy(&reader->error, &entry->error);
+        return -1;
+    }
+    if (entry->eof || length == 0) {
+        return 0;
+    }
+
+    if (!entry_sole_reader(entry, reader)) {
+        /* keep data for readers behind */
+        n = ZIP_MIN(length, MAX_BUFFER_SIZE);
+        if (entry_grow(entry, n)) {
+            if ((ret = entry_read(entry, reader, entry->buffer + (entry->position - entry->buffer_offset), n)) <= 0) {
+                return ret;
+            }
+            memcpy(data, entry->buffer + (reader->offset - entry->buffer_offset), (size_t)ret);
+            reader->offset += (zip_uint64_t)ret;
+            entry_compact(entry, false);
+            return ret;
+        }
+        /* too far behind, they have to decompress again */
+        entry_detach_others(entry, reader);
+    }
+
+    if ((ret = entry_read(entry, reader, data, length)) < 0) {
+        return -1;
+    }
+    reader->offset += (zip_uint64_t)ret;
+    entry->buffer_offset = entry->position;
+    return ret;
+}
+
+
+static int
+reader_seek(reader_t *reader, zip_uint64_t offset) {
+    zip_shared_entry_t *entry = reader->entry;
+
+    if (reader->detached) {
+        if (reader->src != NULL && zip_source_seek(reader->src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(&reader->error, reader->src);
+            return -1;
+        }
+        reader->offset = offset;
+        return 0;
+    }
+
+    if (offset < entry->buffer_offset || offset > entry->position) {
+        if (!entry_sole_reader(entry, reader)) {
+            reader->detached = true;
+            reader->offset = offset;
+            entry_compact(entry, false);
+            return 0;
+        }
+        if (zip_source_seek(entry->src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(&reader->error, entry->src);
+            return -1;
+        }
+        entry->position = offset;
+        entry->buffer_offset = offset;
+        entry->eof = false;
+    }
+
+    reader->offset = offset;
+    entry_compact(entry, false);
+    return 0;
+}
+
+
+/* Check whether data of entry index read with flags can be shared. */
+static bool
+shareable(zip_t *za, zip_uint64_t index, zip_flags_t flags) {
+    zip_entry_t *entry;
+    zip_dirent_t *de;
+
+    /* with ZIP_THREADSAFE or ZIP_FORKSAFE, files are read in parallel */
+    if (ZIP_READS_POSITIONAL(za) || (flags & (ZIP_FL_COMPRESSED | ZIP_FL_ENCRYPTED)) || index >= za->nentry) {
+        return false;
+    }
+    entry = za->entry + index;
+    if ((de = entry->orig) == NULL || ((flags & ZIP_FL_UNCHANGED) == 0 && (entry->deleted || ZIP_ENTRY_DATA_CHANGED(entry)))) {
+        return false;
+    }
+
+    /* sharing decrypted data would make it readable without password */
+    return (de->bitflags & ZIP_GPBF_ENCRYPTED) == 0 && de->uncomp_size > 0;
+}
@@ -52,6 +52,7 @@ zip_source_begin_write(zip_source_t *src) {
     }
 
     src->write_state = ZIP_SOURCE_WRITE_OPEN;
+    src->bytes_written = 0;
 
     return 0;
 }
@@ -1,5 +1,5 @@
 /*
-  zip_source_begin_write_cloning.c -- clone part of file for writing
+  zip_source_begin_write_cloning.c -- clone part of file for writing, or write in place
   Copyright (C) 2017-2021 Dieter Baron and Thomas Klausner
 
   This file is part of libzip, a library to manipulate ZIP archives.
@@ -34,9 +34,25 @@
 
 #include "zipint.h"
 
+static int begin_write(zip_source_t *src, zip_uint64_t offset, zip_source_cmd_t command);
+
 
 ZIP_EXTERN int
 zip_source_begin_write_cloning(zip_source_t *src, zip_uint64_t offset) {
+    return begin_write(src, offset, ZIP_SOURCE_BEGIN_WRITE_CLONING);
+}
+
+
+/* Like zip_source_begin_write_cloning, but src may overwrite its data after offset,
+   so that data must not be read while writing. */
+int
+_zip_source_begin_write_in_place(zip_source_t *src, zip_uint64_t offset) {
+    return begin_write(src, offset, ZIP_SOURCE_BEGIN_WRITE_IN_PLACE);
+}
+
+
+static int
+begin_write(zip_source_t *src, zip_uint64_t offset, zip_source_cmd_t command) {
     if (ZIP_SOURCE_IS_LAYERED(src)) {
         zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
         return -1;
@@ -47,7 +63,7 @@ zip_source_begin_write_cloning(zip_source_t *src, zip_uint64_t offset) {
         return -1;
     }
 
-    if (_zip_source_call(src, NULL, offset, ZIP_SOURCE_BEGIN_WRITE_CLONING) < 0) {
+    if (_zip_source_call(src, NULL, offset, command) < 0) {
         return -1;
     }
 
@@ -36,9 +36,13 @@
 
 #include "zipint.h"
 
+/* fragments allocated when writing start at WRITE_FRAGMENT_SIZE and double up to WRITE_FRAGMENT_MAX_SIZE */
 #ifndef WRITE_FRAGMENT_SIZE
 #define WRITE_FRAGMENT_SIZE (64 * 1024)
 #endif
+#ifndef WRITE_FRAGMENT_MAX_SIZE
+#define WRITE_FRAGMENT_MAX_SIZE (16 * 1024 * 1024)
+#endif
 
 struct buffer {
     zip_buffer_fragment_t *fragments; /* fragments */
@@ -54,6 +58,8 @@ struct buffer {
     zip_uint64_t size;             /* size of buffer */
     zip_uint64_t offset;           /* current offset in buffer */
     zip_uint64_t current_fragment; /* fragment current offset is in */
+
+    zip_uint64_t size_hint; /* expected size when writing */
 };
 
 typedef struct buffer buffer_t;
@@ -64,19 +70,27 @@ struct read_data {
     zip_file_attributes_t attributes;
     buffer_t *in;
     buffer_t *out;
+    zip_uint64_t write_size_hint;
+    zip_flags_t write_flags;
 };
 
 #define buffer_capacity(buffer) ((buffer)->fragment_offsets[(buffer)->nfragments])
 #define buffer_size(buffer) ((buffer)->size)
 
 static buffer_t *buffer_clone(buffer_t *buffer, zip_uint64_t length, zip_error_t *error);
+static bool buffer_coalesce(buffer_t *buffer);
+static zip_uint64_t buffer_copy(const buffer_t *buffer, zip_uint64_t i, zip_uint64_t offset, zip_uint8_t *data, zip_uint64_t length);
 static zip_uint64_t buffer_find_fragment(const buffer_t *buffer, zip_uint64_t offset);
 static void buffer_free(buffer_t *buffer);
+static int buffer_get_data(const buffer_t *buffer, void *data, zip_uint64_t len, zip_error_t *error);
 static bool buffer_grow_fragments(buffer_t *buffer, zip_uint64_t capacity, zip_error_t *error);
 static buffer_t *buffer_new(const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, int free_data, zip_error_t *error);
 static zip_int64_t buffer_read(buffer_t *buffer, zip_uint8_t *data, zip_uint64_t length);
+static zip_int64_t buffer_read_at(const buffer_t *buffer, void *data, zip_uint64_t len, zip_error_t *error);
+static bool buffer_reserve(buffer_t *buffer, zip_uint64_t length, zip_error_t *error);
 static int buffer_seek(buffer_t *buffer, void *data, zip_uint64_t len, zip_error_t *error);
 static zip_int64_t buffer_write(buffer_t *buffer, const zip_uint8_t *data, zip_uint64_t length, zip_error_t *);
+static zip_int64_t buffer_writev(buffer_t *buffer, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, zip_error_t *error);
 
 static zip_int64_t read_data(void *, void *, zip_uint64_t, zip_source_cmd_t);
 
@@ -149,7 +163,7 @@ zip_source_buffer_fragment_with_attributes_create(const zip_buffer_fragment_t *f
         return NULL;
     }
 
-    if ((ctx = (struct read_data *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct read_data *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         buffer_free(buffer);
         return NULL;
@@ -157,6 +171,8 @@ zip_source_buffer_fragment_with_attributes_create(const zip_buffer_fragment_t *f
 
     ctx->in = buffer;
     ctx->out = NULL;
+    ctx->write_size_hint = 0;
+    ctx->write_flags = 0;
     ctx->mtime = time(NULL);
     if (attributes) {
         (void)memcpy_s(&ctx->attributes, sizeof(ctx->attributes), attributes, sizeof(ctx->attributes));
@@ -168,7 +184,7 @@ zip_source_buffer_fragment_with_attributes_create(const zip_buffer_fragment_t *f
 
     if ((zs = zip_source_function_create(read_data, ctx, error)) == NULL) {
         buffer_free(ctx->in);
-        free(ctx);
+        _zip_free(ctx);
         return NULL;
     }
 
@@ -181,6 +197,108 @@ zip_source_buffer_with_attributes(zip_t *za, const void *data, zip_uint64_t len,
     return zip_source_buffer_with_attributes_create(data, len, freep, attributes, &za->error);
 }
 
+
+ZIP_EXTERN int
+zip_source_buffer_detach(zip_source_t *src, zip_buffer_fragment_t **fragmentsp, zip_uint64_t *nfragmentsp) {
+    struct read_data *ctx;
+    buffer_t *buffer, *empty;
+    zip_uint8_t **copies = NULL;
+    zip_uint64_t i, nfragments, ncopies;
+
+    if (src->src != NULL || src->cb.f != read_data || fragmentsp == NULL || nfragmentsp == NULL) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    if (ZIP_SOURCE_IS_OPEN_READING(src) || ZIP_SOURCE_IS_OPEN_WRITING(src)) {
+        zip_error_set(&src->error, ZIP_ER_INUSE, 0);
+        return -1;
+    }
+
+    ctx = (struct read_data *)src->ud;
+    buffer = ctx->in;
+
+    /* drop fragments past end of data */
+    nfragments = buffer->nfragments;
+    while (nfragments > 0 && buffer->fragment_offsets[nfragments - 1] >= buffer->size) {
+        nfragments--;
+    }
+
+    /* fragments owned by caller of zip_source_buffer_create must be copied */
+    ncopies = ZIP_MIN(buffer->first_owned_fragment, nfragments);
+    if (ncopies > 0) {
+        if (ncopies > SIZE_MAX / sizeof(copies[0]) || (copies = (zip_uint8_t **)_zip_malloc(sizeof(copies[0]) * (size_t)ncopies)) == NULL) {
+            zip_error_set(&src->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        for (i = 0; i < ncopies; i++) {
+            zip_uint64_t length = ZIP_MIN(buffer->fragment_offsets[i + 1], buffer->size) - buffer->fragment_offsets[i];
+
+            if (length > SIZE_MAX || (copies[i] = (zip_uint8_t *)_zip_malloc((size_t)length)) == NULL) {
+                while (i > 0) {
+                    _zip_free(copies[--i]);
+                }
+                _zip_free(copies);
+                zip_error_set(&src->error, ZIP_ER_MEMORY, 0);
+                return -1;
+            }
+            (void)memcpy_s(copies[i], (size_t)length, buffer->fragments[i].data, (size_t)length);
+        }
+    }
+
+    if ((empty = buffer_new(NULL, 0, 1, &src->error)) == NULL) {
+        for (i = 0; i < ncopies; i++) {
+            _zip_free(copies[i]);
+        }
+        _zip_free(copies);
+        return -1;
+    }
+
+    for (i = 0; i < nfragments; i++) {
+        if (i < ncopies) {
+            buffer->fragments[i].data = copies[i];
+        }
+        buffer->fragments[i].length = ZIP_MIN(buffer->fragment_offsets[i + 1], buffer->size) - buffer->fragment_offsets[i];
+    }
+    for (i = ZIP_MAX(nfragments, buffer->first_owned_fragment); i < buffer->nfragments; i++) {
+        _zip_free(buffer->fragments[i].data);
+    }
+    _zip_free(copies);
+
+    if (nfragments == 0) {
+        _zip_free(buffer->fragments);
+        *fragmentsp = NULL;
+    }
+    else {
+        *fragmentsp = buffer->fragments;
+    }
+    *nfragmentsp = nfragments;
+
+    buffer->fragments = NULL;
+    buffer->nfragments = 0;
+    buffer_free(buffer);
+    ctx->in = empty;
+    _zip_source_changed(src);
+
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_source_buffer_set_write_options(zip_source_t *src, zip_uint64_t size_hint, zip_flags_t flags) {
+    struct read_data *ctx;
+
+    if (src->src != NULL || src->cb.f != read_data || (flags & ~ZIP_BUFFER_FL_COALESCE) != 0) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    ctx = (struct read_data *)src->ud;
+    ctx->write_size_hint = size_hint;
+    ctx->write_flags = flags;
+
+    return 0;
+}
+
 static zip_int64_t
 read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     struct read_data *ctx = (struct read_data *)state;
@@ -192,6 +310,7 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         }
         ctx->out->offset = 0;
         ctx->out->current_fragment = 0;
+        ctx->out->size_hint = ctx->write_size_hint;
         return 0;
 
     case ZIP_SOURCE_BEGIN_WRITE_CLONING:
@@ -200,6 +319,7 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         }
         ctx->out->offset = len;
         ctx->out->current_fragment = ctx->out->nfragments;
+        ctx->out->size_hint = ctx->write_size_hint;
         return 0;
 
     case ZIP_SOURCE_CLOSE:
@@ -209,6 +329,10 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         buffer_free(ctx->in);
         ctx->in = ctx->out;
         ctx->out = NULL;
+        if (ctx->write_flags & ZIP_BUFFER_FL_COALESCE) {
+            /* keep fragments if there is not enough memory */
+            (void)buffer_coalesce(ctx->in);
+        }
         return 0;
 
     case ZIP_SOURCE_ERROR:
@@ -217,9 +341,12 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     case ZIP_SOURCE_FREE:
         buffer_free(ctx->in);
         buffer_free(ctx->out);
-        free(ctx);
+        _zip_free(ctx);
         return 0;
 
+    case ZIP_SOURCE_GET_DATA:
+        return buffer_get_data(ctx->in, data, len, &ctx->error);
+
     case ZIP_SOURCE_GET_FILE_ATTRIBUTES: {
         if (len < sizeof(ctx->attributes)) {
             zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
@@ -243,6 +370,9 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         }
         return buffer_read(ctx->in, data, len);
 
+    case ZIP_SOURCE_READ_AT:
+        return buffer_read_at(ctx->in, data, len, &ctx->error);
+
     case ZIP_SOURCE_REMOVE: {
         buffer_t *empty = buffer_new(NULL, 0, 0, &ctx->error);
         if (empty == NULL) {
@@ -287,7 +417,7 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     }
 
     case ZIP_SOURCE_SUPPORTS:
-        return zip_source_make_command_bitmap(ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_BEGIN_WRITE_CLONING, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_REMOVE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_WRITE, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
+        return zip_source_make_command_bitmap(ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_BEGIN_WRITE_CLONING, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_REMOVE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_WRITE, ZIP_SOURCE_SUPPORTS_REOPEN, ZIP_SOURCE_GET_DATA, ZIP_SOURCE_READ_AT, ZIP_SOURCE_WRITEV, -1);
 
     case ZIP_SOURCE_TELL:
         if (ctx->in->offset > ZIP_INT64_MAX) {
@@ -311,6 +441,15 @@ read_data(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         }
         return buffer_write(ctx->out, data, len, &ctx->error);
 
+    case ZIP_SOURCE_WRITEV: {
+        zip_source_args_writev_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_writev_t, data, len, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        return buffer_writev(ctx->out, args->fragments, args->nfragments, &ctx->error);
+    }
+
     default:
         zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
         return -1;
@@ -373,6 +512,76 @@ buffer_clone(buffer_t *buffer, zip_uint64_t offset, zip_error_t *error) {
 }
 
 
+/* Replace fragments by a single one of exactly the size of buffer. */
+static bool
+buffer_coalesce(buffer_t *buffer) {
+    zip_uint8_t *data;
+    zip_uint64_t i;
+
+    if (buffer->size == 0 || buffer->size > SIZE_MAX || buffer->shared_buffer != NULL) {
+        return false;
+    }
+
+    if (buffer->nfragments == 1) {
+        /* shrink fragment allocated for size hint */
+        if (buffer->first_owned_fragment == 0 && buffer->fragments[0].length > buffer->size) {
+            if ((data = (zip_uint8_t *)_zip_realloc(buffer->fragments[0].data, (size_t)buffer->size)) == NULL) {
+                return false;
+            }
+            buffer->fragments[0].data = data;
+            buffer->fragments[0].length = buffer->size;
+            buffer->fragment_offsets[1] = buffer->size;
+        }
+        return true;
+    }
+
+    if ((data = (zip_uint8_t *)_zip_malloc((size_t)buffer->size)) == NULL) {
+        return false;
+    }
+    _zip_advise_huge_pages(data, buffer->size);
+    (void)buffer_copy(buffer, 0, 0, data, buffer->size);
+
+    for (i = buffer->first_owned_fragment; i < buffer->nfragments; i++) {
+        _zip_free(buffer->fragments[i].data);
+    }
+    buffer->fragments[0].data = data;
+    buffer->fragments[0].length = buffer->size;
+    buffer->nfragments = 1;
+    buffer->fragment_offsets[1] = buffer->size;
+    buffer->first_owned_fragment = 0;
+    buffer->offset = 0;
+    buffer->current_fragment = 0;
+
+    return true;
+}
+
+
+/* Copy length bytes at offset, which is in fragment i, to data. Returns fragment containing the following byte. */
+static zip_uint64_t
+buffer_copy(const buffer_t *buffer, zip_uint64_t i, zip_uint64_t offset, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t n, fragment_offset;
+
+    fragment_offset = offset - buffer->fragment_offsets[i];
+    n = 0;
+    while (n < length) {
+        zip_uint64_t left = ZIP_MIN(length - n, buffer->fragments[i].length - fragment_offset);
+#if ZIP_UINT64_MAX > SIZE_MAX
+        left = ZIP_MIN(left, SIZE_MAX);
+#endif
+
+        (void)memcpy_s(data + n, (size_t)left, buffer->fragments[i].data + fragment_offset, (size_t)left);
+
+        if (left == buffer->fragments[i].length - fragment_offset) {
+            i++;
+        }
+        n += left;
+        fragment_offset = 0;
+    }
+
+    return i;
+}
+
+
 static zip_uint64_t
 buffer_find_fragment(const buffer_t *buffer, zip_uint64_t offset) {
     zip_uint64_t low, high, mid;
@@ -417,11 +626,40 @@ buffer_free(buffer_t *buffer) {
     }
 
     for (i = buffer->first_owned_fragment; i < buffer->nfragments; i++) {
-        free(buffer->fragments[i].data);
+        _zip_free(buffer->fragments[i].data);
     }
-    free(buffer->fragments);
-    free(buffer->fragment_offsets);
-    free(buffer);
+    _zip_free(buffer->fragments);
+    _zip_free(buffer->fragment_offsets);
+    _zip_free(buffer);
+}
+
+
+/* Only ranges within a single fragment can be returned without copying. */
+static int
+buffer_get_data(const buffer_t *buffer, void *data, zip_uint64_t len, zip_error_t *error) {
+    zip_source_args_get_data_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_get_data_t, data, len, error);
+    zip_uint64_t i;
+
+    if (args == NULL) {
+        return -1;
+    }
+    if (args->offset > buffer->size || args->length > buffer->size - args->offset) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    if (args->length == 0) {
+        args->data = "";
+        return 0;
+    }
+
+    i = buffer_find_fragment(buffer, args->offset);
+    if (args->offset + args->length > buffer->fragment_offsets[i + 1]) {
+        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+
+    args->data = buffer->fragments[i].data + (args->offset - buffer->fragment_offsets[i]);
+    return 0;
 }
 
 
@@ -442,12 +680,12 @@ buffer_grow_fragments(buffer_t *buffer, zip_uint64_t capacity, zip_error_t *erro
         return false;
     }
 
-    if ((fragments = realloc(buffer->fragments, (size_t)fragments_size)) == NULL) {
+    if ((fragments = _zip_realloc(buffer->fragments, (size_t)fragments_size)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return false;
     }
     buffer->fragments = fragments;
-    if ((offsets = realloc(buffer->fragment_offsets, (size_t)offsets_size)) == NULL) {
+    if ((offsets = _zip_realloc(buffer->fragment_offsets, (size_t)offsets_size)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return false;
     }
@@ -462,7 +700,7 @@ static buffer_t *
 buffer_new(const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, int free_data, zip_error_t *error) {
     buffer_t *buffer;
 
-    if ((buffer = malloc(sizeof(*buffer))) == NULL) {
+    if ((buffer = _zip_malloc(sizeof(*buffer))) == NULL) {
         return NULL;
     }
 
@@ -475,10 +713,11 @@ buffer_new(const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, int
     buffer->fragments_capacity = 0;
     buffer->shared_buffer = NULL;
     buffer->shared_fragments = 0;
+    buffer->size_hint = 0;
 
     if (nfragments == 0) {
-        if ((buffer->fragment_offsets = malloc(sizeof(buffer->fragment_offsets[0]))) == NULL) {
-            free(buffer);
+        if ((buffer->fragment_offsets = _zip_malloc(sizeof(buffer->fragment_offsets[0]))) == NULL) {
+            _zip_free(buffer);
             zip_error_set(error, ZIP_ER_MEMORY, 0);
             return NULL;
         }
@@ -521,8 +760,6 @@ buffer_new(const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, int
 
 static zip_int64_t
 buffer_read(buffer_t *buffer, zip_uint8_t *data, zip_uint64_t length) {
-    zip_uint64_t n, i, fragment_offset;
-
     length = ZIP_MIN(length, buffer->size - buffer->offset);
 
     if (length == 0) {
@@ -532,27 +769,32 @@ buffer_read(buffer_t *buffer, zip_uint8_t *data, zip_uint64_t length) {
         return -1;
     }
 
-    i = buffer->current_fragment;
-    fragment_offset = buffer->offset - buffer->fragment_offsets[i];
-    n = 0;
-    while (n < length) {
-        zip_uint64_t left = ZIP_MIN(length - n, buffer->fragments[i].length - fragment_offset);
-#if ZIP_UINT64_MAX > SIZE_MAX
-        left = ZIP_MIN(left, SIZE_MAX);
-#endif
+    buffer->current_fragment = buffer_copy(buffer, buffer->current_fragment, buffer->offset, data, length);
+    buffer->offset += length;
+    return (zip_int64_t)length;
+}
 
-        (void)memcpy_s(data + n, (size_t)left, buffer->fragments[i].data + fragment_offset, (size_t)left);
 
-        if (left == buffer->fragments[i].length - fragment_offset) {
-            i++;
-        }
-        n += left;
-        fragment_offset = 0;
+static zip_int64_t
+buffer_read_at(const buffer_t *buffer, void *data, zip_uint64_t len, zip_error_t *error) {
+    zip_source_args_read_at_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_read_at_t, data, len, error);
+    zip_uint64_t length;
+
+    if (args == NULL) {
+        return -1;
+    }
+    if (args->offset >= buffer->size) {
+        return 0;
     }
 
-    buffer->offset += n;
-    buffer->current_fragment = i;
-    return (zip_int64_t)n;
+    length = ZIP_MIN(args->length, buffer->size - args->offset);
+    if (length > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    (void)buffer_copy(buffer, buffer_find_fragment(buffer, args->offset), args->offset, (zip_uint8_t *)args->data, length);
+    return (zip_int64_t)length;
 }
 
 
@@ -570,46 +812,62 @@ buffer_seek(buffer_t *buffer, void *data, zip_uint64_t len, zip_error_t *error)
 }
 
 
-static zip_int64_t
-buffer_write(buffer_t *buffer, const zip_uint8_t *data, zip_uint64_t length, zip_error_t *error) {
-    zip_uint64_t copied, i, fragment_offset, capacity;
+/* Size of fragment to allocate when writing beyond capacity. */
+static zip_uint64_t
+buffer_next_fragment_size(const buffer_t *buffer, zip_uint64_t capacity) {
+    /* grow geometrically, so large buffers consist of few fragments */
+    zip_uint64_t size = ZIP_MAX(WRITE_FRAGMENT_SIZE, ZIP_MIN(capacity, WRITE_FRAGMENT_MAX_SIZE));
 
-    if (buffer->offset + length + WRITE_FRAGMENT_SIZE - 1 < length) {
-        zip_error_set(error, ZIP_ER_INVAL, 0);
-        return -1;
+    if (buffer->size_hint > capacity) {
+        size = ZIP_MAX(size, buffer->size_hint - capacity);
     }
 
-    /* grow buffer if needed */
-    capacity = buffer_capacity(buffer);
-    if (buffer->offset + length > capacity) {
-        zip_uint64_t needed_fragments = buffer->nfragments + (length - (capacity - buffer->offset) + WRITE_FRAGMENT_SIZE - 1) / WRITE_FRAGMENT_SIZE;
+    return size;
+}
 
-        if (needed_fragments > buffer->fragments_capacity) {
-            zip_uint64_t new_capacity = buffer->fragments_capacity;
 
-            if (new_capacity == 0) {
-                new_capacity = 16;
-            }
-            while (new_capacity < needed_fragments) {
-                new_capacity *= 2;
-            }
+/* Allocate fragments so that length bytes can be written at the current offset. */
+static bool
+buffer_reserve(buffer_t *buffer, zip_uint64_t length, zip_error_t *error) {
+    zip_uint64_t capacity;
+
+    if (buffer->offset + length < length) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    capacity = buffer_capacity(buffer);
+    while (buffer->offset + length > capacity) {
+        zip_uint64_t fragment_size = buffer_next_fragment_size(buffer, capacity);
 
-            if (!buffer_grow_fragments(buffer, new_capacity, error)) {
+        if (buffer->nfragments == buffer->fragments_capacity) {
+            if (!buffer_grow_fragments(buffer, buffer->fragments_capacity == 0 ? 16 : buffer->fragments_capacity * 2, error)) {
                 zip_error_set(error, ZIP_ER_MEMORY, 0);
-                return -1;
+                return false;
             }
         }
 
-        while (buffer->nfragments < needed_fragments) {
-            if ((buffer->fragments[buffer->nfragments].data = malloc(WRITE_FRAGMENT_SIZE)) == NULL) {
-                zip_error_set(error, ZIP_ER_MEMORY, 0);
-                return -1;
-            }
-            buffer->fragments[buffer->nfragments].length = WRITE_FRAGMENT_SIZE;
-            buffer->nfragments++;
-            capacity += WRITE_FRAGMENT_SIZE;
-            buffer->fragment_offsets[buffer->nfragments] = capacity;
+        if (fragment_size > SIZE_MAX || capacity + fragment_size < capacity || (buffer->fragments[buffer->nfragments].data = _zip_malloc((size_t)fragment_size)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
         }
+        _zip_advise_huge_pages(buffer->fragments[buffer->nfragments].data, fragment_size);
+        buffer->fragments[buffer->nfragments].length = fragment_size;
+        buffer->nfragments++;
+        capacity += fragment_size;
+        buffer->fragment_offsets[buffer->nfragments] = capacity;
+    }
+
+    return true;
+}
+
+
+static zip_int64_t
+buffer_write(buffer_t *buffer, const zip_uint8_t *data, zip_uint64_t length, zip_error_t *error) {
+    zip_uint64_t copied, i, fragment_offset;
+
+    if (!buffer_reserve(buffer, length, error)) {
+        return -1;
     }
 
     i = buffer->current_fragment;
@@ -641,3 +899,31 @@ buffer_write(buffer_t *buffer, const zip_uint8_t *data, zip_uint64_t length, zip
 
     return (zip_int64_t)copied;
 }
+
+
+/* Write data of all fragments, allocating space for all of them first. */
+static zip_int64_t
+buffer_writev(buffer_t *buffer, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments, zip_error_t *error) {
+    zip_uint64_t i, length;
+
+    length = 0;
+    for (i = 0; i < nfragments; i++) {
+        if (fragments[i].length > ZIP_INT64_MAX - length) {
+            zip_error_set(error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        length += fragments[i].length;
+    }
+
+    if (!buffer_reserve(buffer, length, error)) {
+        return -1;
+    }
+
+    for (i = 0; i < nfragments; i++) {
+        if (buffer_write(buffer, fragments[i].data, fragments[i].length, error) < 0) {
+            return -1;
+        }
+    }
+
+    return (zip_int64_t)length;
+}
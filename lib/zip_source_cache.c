@@ -0,0 +1,401 @@
+/*
+  zip_source_cache.c -- cache blocks of data of seekable source
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+#define DEFAULT_BLOCK_SIZE (64 * 1024)
+#define DEFAULT_NUM_BLOCKS 64
+
+struct block {
+    zip_uint64_t number; /* position in source divided by block size */
+    zip_uint64_t length; /* amount of data, less than block size only at end of source */
+    zip_uint8_t *data;   /* NULL if block was never used */
+    bool valid;
+    struct block *hash_next; /* next block in same hash bucket */
+    struct block *prev;      /* LRU list, most recently used first */
+    struct block *next;
+};
+typedef struct block block_t;
+
+struct context {
+    zip_uint64_t block_size;
+    zip_uint64_t num_blocks;
+    block_t *blocks;
+    block_t **hash; /* valid blocks by number */
+    zip_uint64_t hash_size;
+    block_t *lru_head;
+    block_t *lru_tail;
+
+    zip_uint64_t offset;       /* read position */
+    zip_uint64_t size;         /* size of data of lower source */
+    zip_uint64_t lower_offset; /* read position of lower source */
+
+    zip_error_t error;
+};
+typedef struct context cache_t;
+
+static zip_int64_t cache(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+static void cache_free(cache_t *ctx);
+static void cache_invalidate(cache_t *ctx);
+static block_t *cache_load(cache_t *ctx, zip_source_t *src, zip_uint64_t number);
+static block_t *cache_lookup(cache_t *ctx, zip_uint64_t number);
+static zip_int64_t cache_read(cache_t *ctx, zip_source_t *src, zip_uint8_t *data, zip_uint64_t length);
+static void cache_touch(cache_t *ctx, block_t *block);
+static zip_int64_t read_lower(cache_t *ctx, zip_source_t *src, zip_uint64_t offset, zip_uint8_t *data, zip_uint64_t length);
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_cache(zip_t *za, zip_source_t *src, zip_uint64_t block_size, zip_uint64_t num_blocks) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_cache_create(src, block_size, num_blocks, &za->error);
+}
+
+
+/* Create layered source that reads src in blocks of block_size bytes, keeping the num_blocks most recently used ones.
+   Reads covering whole blocks that are not cached are passed to src as one read and not cached, so sequential reading of file data doesn't evict blocks needed again, like those of the central directory. */
+ZIP_EXTERN zip_source_t *
+zip_source_cache_create(zip_source_t *src, zip_uint64_t block_size, zip_uint64_t num_blocks, zip_error_t *error) {
+    cache_t *ctx;
+    zip_source_t *s2;
+    zip_uint64_t i;
+
+    if (src == NULL) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+    if ((zip_source_supports(src) & ZIP_SOURCE_SUPPORTS_SEEKABLE) != ZIP_SOURCE_SUPPORTS_SEEKABLE) {
+        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+        return NULL;
+    }
+
+    if (block_size == 0) {
+        block_size = DEFAULT_BLOCK_SIZE;
+    }
+    if (num_blocks == 0) {
+        num_blocks = DEFAULT_NUM_BLOCKS;
+    }
+    if (block_size > SIZE_MAX || num_blocks > SIZE_MAX / 2 / sizeof(block_t)) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((ctx = (cache_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    ctx->block_size = block_size;
+    ctx->num_blocks = num_blocks;
+    for (ctx->hash_size = 1; ctx->hash_size < 2 * num_blocks; ctx->hash_size *= 2) {
+    }
+    zip_error_init(&ctx->error);
+    ctx->blocks = (block_t *)_zip_malloc(sizeof(ctx->blocks[0]) * (size_t)num_blocks);
+    ctx->hash = (block_t **)_zip_malloc(sizeof(ctx->hash[0]) * (size_t)ctx->hash_size);
+    if (ctx->blocks == NULL || ctx->hash == NULL) {
+        _zip_free(ctx->blocks);
+        _zip_free(ctx->hash);
+        _zip_free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    for (i = 0; i < num_blocks; i++) {
+        ctx->blocks[i].data = NULL;
+    }
+    cache_invalidate(ctx);
+
+    if ((s2 = zip_source_layered_create(src, cache, ctx, error)) == NULL) {
+        cache_free(ctx);
+        return NULL;
+    }
+
+    return s2;
+}
+
+
+static zip_int64_t
+cache(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    cache_t *ctx = (cache_t *)ud;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN: {
+        zip_stat_t st;
+        zip_int64_t size;
+
+        /* data of lower source may have changed since it was last open */
+        cache_invalidate(ctx);
+        ctx->offset = 0;
+
+        if (zip_source_stat(src, &st) == 0 && (st.valid & ZIP_STAT_SIZE)) {
+            ctx->size = st.size;
+        }
+        else {
+            if (zip_source_seek(src, 0, SEEK_END) < 0 || (size = zip_source_tell(src)) < 0) {
+                zip_error_set_from_source(&ctx->error, src);
+                return -1;
+            }
+            ctx->size = (zip_uint64_t)size;
+        }
+        ctx->lower_offset = ZIP_UINT64_MAX;
+        return 0;
+    }
+
+    case ZIP_SOURCE_READ:
+        return cache_read(ctx, src, (zip_uint8_t *)data, length);
+
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        cache_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->size, data, length, &ctx->error);
+
+        if (new_offset < 0) {
+            return -1;
+        }
+
+        ctx->offset = (zip_uint64_t)new_offset;
+        return 0;
+    }
+
+    case ZIP_SOURCE_STAT:
+        /* data holds stat of lower source */
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS: {
+        zip_int64_t mask = zip_source_supports(src);
+
+        if (mask < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+
+        return mask & zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, -1);
+    }
+
+    case ZIP_SOURCE_TELL:
+        return (zip_int64_t)ctx->offset;
+
+    default:
+        return zip_source_pass_to_lower_layer(src, data, length, cmd);
+    }
+}
+
+
+static void
+cache_free(cache_t *ctx) {
+    zip_uint64_t i;
+
+    for (i = 0; i < ctx->num_blocks; i++) {
+        _zip_free(ctx->blocks[i].data);
+    }
+    _zip_free(ctx->blocks);
+    _zip_free(ctx->hash);
+    zip_error_fini(&ctx->error);
+    _zip_free(ctx);
+}
+
+
+/* Discard all cached data, keeping allocated blocks. */
+static void
+cache_invalidate(cache_t *ctx) {
+    zip_uint64_t i;
+
+    for (i = 0; i < ctx->hash_size; i++) {
+        ctx->hash[i] = NULL;
+    }
+    for (i = 0; i < ctx->num_blocks; i++) {
+        block_t *block = ctx->blocks + i;
+
+        block->valid = false;
+        block->hash_next = NULL;
+        block->prev = i > 0 ? block - 1 : NULL;
+        block->next = i + 1 < ctx->num_blocks ? block + 1 : NULL;
+    }
+    ctx->lru_head = ctx->blocks;
+    ctx->lru_tail = ctx->blocks + ctx->num_blocks - 1;
+}
+
+
+/* Read block number from lower source into least recently used block. */
+static block_t *
+cache_load(cache_t *ctx, zip_source_t *src, zip_uint64_t number) {
+    block_t *block = ctx->lru_tail;
+    zip_int64_t n;
+
+    if (block->valid) {
+        block_t **p;
+
+        for (p = ctx->hash + (block->number & (ctx->hash_size - 1)); *p != block; p = &(*p)->hash_next) {
+        }
+        *p = block->hash_next;
+        block->valid = false;
+    }
+    if (block->data == NULL && (block->data = (zip_uint8_t *)_zip_malloc((size_t)ctx->block_size)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((n = read_lower(ctx, src, number * ctx->block_size, block->data, ZIP_MIN(ctx->block_size, ctx->size - number * ctx->block_size))) < 0) {
+        return NULL;
+    }
+
+    block->number = number;
+    block->length = (zip_uint64_t)n;
+    block->valid = true;
+    block->hash_next = ctx->hash[number & (ctx->hash_size - 1)];
+    ctx->hash[number & (ctx->hash_size - 1)] = block;
+
+    return block;
+}
+
+
+static block_t *
+cache_lookup(cache_t *ctx, zip_uint64_t number) {
+    block_t *block;
+
+    for (block = ctx->hash[number & (ctx->hash_size - 1)]; block != NULL; block = block->hash_next) {
+        if (block->number == number) {
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+
+static zip_int64_t
+cache_read(cache_t *ctx, zip_source_t *src, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t total = 0;
+
+    while (total < length && ctx->offset < ctx->size) {
+        zip_uint64_t number = ctx->offset / ctx->block_size;
+        zip_uint64_t in_block = ctx->offset % ctx->block_size;
+        zip_uint64_t remaining = ZIP_MIN(length - total, ctx->size - ctx->offset);
+        block_t *block = cache_lookup(ctx, number);
+        zip_uint64_t n;
+
+        if (block == NULL && in_block == 0 && remaining >= ctx->block_size) {
+            /* read consecutive uncached blocks covered by request at once, bypassing cache */
+            zip_uint64_t count = 1;
+            zip_int64_t ret;
+
+            while ((count + 1) * ctx->block_size <= remaining && cache_lookup(ctx, number + count) == NULL) {
+                count++;
+            }
+            if ((ret = read_lower(ctx, src, ctx->offset, data + total, count * ctx->block_size)) < 0) {
+                return -1;
+            }
+            ctx->offset += (zip_uint64_t)ret;
+            total += (zip_uint64_t)ret;
+            continue;
+        }
+
+        if (block == NULL && (block = cache_load(ctx, src, number)) == NULL) {
+            return -1;
+        }
+        cache_touch(ctx, block);
+
+        if (in_block >= block->length) {
+            /* lower source ended early */
+            break;
+        }
+        n = ZIP_MIN(remaining, block->length - in_block);
+        memcpy(data + total, block->data + in_block, (size_t)n);
+        ctx->offset += n;
+        total += n;
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+/* Move block to head of LRU list. */
+static void
+cache_touch(cache_t *ctx, block_t *block) {
+    if (block == ctx->lru_head) {
+        return;
+    }
+
+    block->prev->next = block->next;
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+    else {
+        ctx->lru_tail = block->prev;
+    }
+
+    block->prev = NULL;
+    block->next = ctx->lru_head;
+    ctx->lru_head->prev = block;
+    ctx->lru_head = block;
+}
+
+
+/* Read length bytes at offset from lower source, seeking only if needed. A short read means the lower source ended early, its size is adjusted. */
+static zip_int64_t
+read_lower(cache_t *ctx, zip_source_t *src, zip_uint64_t offset, zip_uint8_t *data, zip_uint64_t length) {
+    zip_int64_t n;
+
+    if (offset != ctx->lower_offset) {
+        if (offset > ZIP_INT64_MAX || zip_source_seek(src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            ctx->lower_offset = ZIP_UINT64_MAX;
+            return -1;
+        }
+    }
+
+    if ((n = zip_source_read(src, data, length)) < 0) {
+        zip_error_set_from_source(&ctx->error, src);
+        ctx->lower_offset = ZIP_UINT64_MAX;
+        return -1;
+    }
+    ctx->lower_offset = offset + (zip_uint64_t)n;
+
+    if ((zip_uint64_t)n < length) {
+        ctx->size = offset + (zip_uint64_t)n;
+    }
+
+    return n;
+}
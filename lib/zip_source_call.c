@@ -1,6 +1,6 @@
 /*
  zip_source_call.c -- invoke callback command on zip_source
- Copyright (C) 2009-2021 Dieter Baron and Thomas Klausner
+ Copyright (C) 2009-2026 Dieter Baron and Thomas Klausner
 
  This file is part of libzip, a library to manipulate ZIP archives.
  The authors can be contacted at <info@libzip.org>
@@ -34,11 +34,92 @@
 
 #include "zipint.h"
 
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define PROBE_CALL_START(src, command, length) DTRACE_PROBE3(libzip, source__call__start, src, command, length)
+#define PROBE_CALL_DONE(src, command, length, ret) DTRACE_PROBE4(libzip, source__call__done, src, command, length, ret)
+#else
+#define PROBE_CALL_START(src, command, length)
+#define PROBE_CALL_DONE(src, command, length, ret)
+#endif
+
+/* Set before any source is used, like the allocator, so it needs no locking. */
+static zip_source_trace_callback trace_callback = NULL;
+static void *trace_ud = NULL;
+
+/* Commands that don't change the results of ZIP_SOURCE_STAT and ZIP_SOURCE_GET_FILE_ATTRIBUTES. */
+#define COMMAND_KEEPS_STAT(command) ((command) == ZIP_SOURCE_STAT || (command) == ZIP_SOURCE_GET_FILE_ATTRIBUTES || (command) == ZIP_SOURCE_ERROR || (command) == ZIP_SOURCE_SUPPORTS || (command) == ZIP_SOURCE_ACCEPT_EMPTY)
+
+static zip_int64_t source_call(zip_source_t *src, void *data, zip_uint64_t length, zip_source_cmd_t command);
+
+
+ZIP_EXTERN int
+zip_set_source_trace_callback(zip_source_trace_callback callback, void *ud) {
+    trace_callback = callback;
+    trace_ud = ud;
+
+    return 0;
+}
+
 
 zip_int64_t
 _zip_source_call(zip_source_t *src, void *data, zip_uint64_t length, zip_source_cmd_t command) {
     zip_int64_t ret;
 
+    if (!COMMAND_KEEPS_STAT(command)) {
+        _zip_source_changed(src);
+    }
+
+    PROBE_CALL_START(src, command, length);
+
+    if (trace_callback == NULL) {
+        ret = source_call(src, data, length, command);
+    }
+    else {
+        zip_uint32_t layer = 0;
+        zip_uint64_t start;
+        zip_source_t *lower;
+
+        /* layer 0 is the source at the bottom of the stack */
+        for (lower = src->src; lower != NULL; lower = lower->src) {
+            layer++;
+        }
+        start = _zip_stats_time();
+        ret = source_call(src, data, length, command);
+        trace_callback(src, layer, command, length, ret, _zip_stats_time() - start, trace_ud);
+    }
+
+    PROBE_CALL_DONE(src, command, length, ret);
+
+    return ret;
+}
+
+
+/* Record that results of ZIP_SOURCE_STAT and ZIP_SOURCE_GET_FILE_ATTRIBUTES of src may have changed, so cached ones are no longer used.
+   Must be called by functions that change the state of a source other than through a command. */
+void
+_zip_source_changed(zip_source_t *src) {
+    src->generation++;
+}
+
+
+/* Return generation of src and the sources below it, which changes whenever one of them is changed. */
+zip_uint64_t
+_zip_source_generation(zip_source_t *src) {
+    zip_uint64_t generation = 0;
+
+    for (; src != NULL; src = src->src) {
+        generation += src->generation;
+    }
+
+    return generation;
+}
+
+
+static zip_int64_t
+source_call(zip_source_t *src, void *data, zip_uint64_t length, zip_source_cmd_t command) {
+    zip_int64_t ret;
+
     if ((src->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(command)) == 0) {
         zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
         return -1;
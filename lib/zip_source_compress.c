@@ -36,6 +36,22 @@
 
 #include "zipint.h"
 
+/* ZIP_CM_FL_AUTO examines the first AUTO_SAMPLE_SIZE bytes. Data estimated to shrink to no less than
+   AUTO_STORE_THRESHOLD thousandths of its size is stored, to no less than AUTO_FAST_THRESHOLD is
+   compressed with AUTO_FAST_LEVEL, anything else with the requested level. */
+#define AUTO_SAMPLE_SIZE (64 * 1024)
+#define AUTO_MIN_SAMPLE_SIZE 512
+#define AUTO_STORE_THRESHOLD 950
+#define AUTO_FAST_THRESHOLD 800
+#define AUTO_FAST_LEVEL 1
+#define AUTO_HASH_BITS 12
+#define AUTO_MIN_MATCH 4
+
+/* ZIP_CM_FL_EARLY_STORE checks the output size once EARLY_STORE_SIZE bytes of input have been compressed,
+   and gives up if it is not below EARLY_STORE_THRESHOLD thousandths of the input. */
+#define EARLY_STORE_SIZE (4 * 1024 * 1024)
+#define EARLY_STORE_THRESHOLD 950
+
 struct context {
     zip_error_t error;
 
@@ -48,12 +64,63 @@ struct context {
 
     zip_uint64_t size;
     zip_int64_t first_read;
-    zip_uint8_t buffer[BUFSIZE];
+    zip_uint8_t *buffer; /* for input data */
+    zip_uint64_t buffer_size;
+    zip_uint8_t *out; /* output of algorithm for reads smaller than buffer_size, allocated when first needed */
+    zip_uint64_t out_length;
+    zip_uint64_t out_offset; /* how much of out has been returned */
+
+    /* CRC of decompressed data, validated at end of data, like zip_source_crc_create() */
+    bool crc_validate;
+    bool crc_input; /* compression: CRC of input instead, for zip_close() */
+    bool crc_complete;
+    zip_uint64_t crc_position; /* how far we've computed the CRC */
+    zip_uint32_t crc;
 
     zip_compression_algorithm_t *algorithm;
     void *ud;
+    zip_uint32_t compression_flags;
+    zip_uint32_t algorithm_flags; /* ud was allocated with, differs from compression_flags if auto_select chose fast compression */
+#if defined(HAVE_LIBZSTD)
+    zip_zstd_dictionary_t *dictionary; /* for reallocated ud, owned by archive */
+    zip_zstd_parameters_t zstd_parameters;
+#endif
+    zip_uint64_t block_size;   /* for parallel compression, 0 for algorithm default */
+    zip_uint64_t memory_limit; /* for decompression, 0 for unlimited */
+
+    /* ZIP_CM_FL_AUTO: choose from first input whether to store, compress fast or with requested level */
+    bool auto_select;
+    bool auto_can_store;
+    bool pass_through;        /* storing chosen by auto_select, algorithm is not used */
+    zip_uint64_t buffer_used; /* pass_through: how much of first input has been returned */
+
+    /* ZIP_CM_FL_EARLY_STORE: stop compressing data that doesn't shrink, zip_close() writes it again stored */
+    bool early_store;         /* requested in compression flags */
+    bool early_store_enabled; /* caller can restart, ratio not checked yet */
+    bool stored_early;        /* gave up, output is incomplete */
+    zip_uint64_t input_size;  /* passed to algorithm */
+
+    zip_compression_cache_t *cache; /* where to return context when source is freed, NULL to free it */
+    struct context *next;           /* in cache */
+
+    zip_memory_budget_t *budget; /* of archive, referenced since context may outlive it */
+    zip_uint64_t charged;        /* to budget */
 };
 
+/* Unused compression contexts, reused for entries with the same method and flags
+   instead of allocating the algorithm state for each of them. */
+struct zip_compression_cache {
+    struct context *contexts; /* most recently returned first */
+    zip_uint32_t ncontexts;
+    zip_uint32_t max_contexts;
+};
+
+#ifdef HAVE_THREADS
+/* Unused decompression contexts shared by all archives of the process, see zip_set_decompression_pool_size().
+   Protected by _zip_global_lock(); contexts in it are not charged to any archive. */
+static zip_compression_cache_t decompression_pool = {NULL, 0, 0};
+#endif
+
 
 struct implementation {
     zip_uint16_t method;
@@ -63,6 +130,7 @@ struct implementation {
 
 static struct implementation implementations[] = {
     {ZIP_CM_DEFLATE, &zip_algorithm_deflate_compress, &zip_algorithm_deflate_decompress},
+    {ZIP_CM_DEFLATE64, NULL, &zip_algorithm_deflate64_decompress},
 #if defined(HAVE_LIBBZ2)
     {ZIP_CM_BZIP2, &zip_algorithm_bzip2_compress, &zip_algorithm_bzip2_decompress},
 #endif
@@ -78,19 +146,90 @@ static struct implementation implementations[] = {
 #if defined(HAVE_LIBZSTD)
     {ZIP_CM_ZSTD, &zip_algorithm_zstd_compress, &zip_algorithm_zstd_decompress},
 #endif
+#if defined(HAVE_LIBLZ4)
+    {ZIP_CM_LZ4, &zip_algorithm_lz4_compress, &zip_algorithm_lz4_decompress},
+#endif
 
 };
 
 static size_t implementations_size = sizeof(implementations) / sizeof(implementations[0]);
 
-static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags);
+/* levels used for level 0 by ZIP_COMPRESSION_LEVEL_SPEED, _BALANCED and _MAX; other methods use their default */
+struct level_policy {
+    zip_uint16_t method;
+    zip_uint32_t level[3];
+};
+
+static const struct level_policy level_policies[] = {
+    {ZIP_CM_DEFLATE, {1, 6, 9}},
+    {ZIP_CM_BZIP2, {1, 6, 9}},
+    {ZIP_CM_LZMA, {1, 6, 9}},
+    {ZIP_CM_XZ, {1, 6, 9}},
+    {ZIP_CM_ZSTD, {1, 3, 19}},
+    {ZIP_CM_LZ4, {1, 9, 12}},
+};
+
+static const size_t level_policies_size = sizeof(level_policies) / sizeof(level_policies[0]);
+
+static zip_compression_algorithm_t *builtin_compression_algorithm(zip_int32_t method, bool compress);
+static struct context *compression_context(zip_source_t *src);
+static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_uint32_t mode_flags);
+static zip_uint64_t auto_estimate(const zip_uint8_t *data, zip_uint64_t length);
+static zip_uint64_t auto_log2(zip_uint64_t x);
+static bool auto_select(zip_source_t *src, struct context *ctx);
+static zip_uint32_t policy_level(zip_uint32_t policy, zip_int32_t method);
 static zip_int64_t compress_callback(zip_source_t *, void *, void *, zip_uint64_t, zip_source_cmd_t);
 static void context_free(struct context *ctx);
-static struct context *context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm);
+static zip_uint32_t decompression_flags(zip_t *za);
+static struct context *context_get(zip_compression_cache_t *cache, zip_int32_t method, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, zip_uint64_t buffer_size);
+static struct context *context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, zip_uint64_t buffer_size, zip_memory_budget_t *budget, zip_error_t *error);
+#ifdef HAVE_THREADS
+static struct context *decompression_pool_get(zip_int32_t method, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, zip_uint64_t buffer_size, zip_memory_budget_t *budget);
+static void decompression_pool_put(struct context *ctx);
+static bool decompression_pool_usable(zip_int32_t method, zip_compression_algorithm_t *algorithm);
+#endif
+static void context_release(struct context *ctx);
+static void context_reset(struct context *ctx, zip_int32_t method);
+static void context_configure_algorithm(struct context *ctx);
+static bool context_set_algorithm_flags(struct context *ctx, zip_uint32_t flags);
+static void compress_input(struct context *ctx, zip_int64_t n);
+static void input_crc(struct context *ctx, const zip_uint8_t *data, zip_uint64_t length);
+static zip_int64_t compress_process(zip_source_t *, struct context *, void *, zip_uint64_t);
 static zip_int64_t compress_read(zip_source_t *, struct context *, void *, zip_uint64_t);
+static zip_int64_t pass_through_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len);
+static bool decompress_crc_end(zip_source_t *src, struct context *ctx);
+static int decompress_seek(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len);
 
+/* Implementations registered with zip_register_compression_implementation() take precedence over built-in ones. */
 zip_compression_algorithm_t *
 _zip_get_compression_algorithm(zip_int32_t method, bool compress) {
+    zip_compression_algorithm_t *algorithm;
+
+    if ((algorithm = _zip_get_registered_compression_algorithm(ZIP_CM_ACTUAL(method), compress)) != NULL) {
+        return algorithm;
+    }
+    return builtin_compression_algorithm(method, compress);
+}
+
+
+/* Upper bound for compressed size of data compressed by zip_source_compress(), ZIP_UINT64_MAX if method is not supported. */
+zip_uint64_t
+_zip_compression_maximum_size(zip_int32_t method, zip_uint32_t compression_flags, zip_uint64_t uncompressed_size) {
+    zip_compression_algorithm_t *algorithm;
+    zip_uint64_t size;
+
+    if (compression_flags != TORRENTZIP_COMPRESSION_FLAGS && _zip_registered_maximum_compressed_size(ZIP_CM_ACTUAL(method), uncompressed_size, &size)) {
+        return size;
+    }
+    if ((algorithm = builtin_compression_algorithm(method, true)) == NULL) {
+        return ZIP_UINT64_MAX;
+    }
+    return algorithm->maximum_compressed_size(uncompressed_size);
+}
+
+
+static zip_compression_algorithm_t *
+builtin_compression_algorithm(zip_int32_t method, bool compress) {
     size_t i;
     zip_uint16_t real_method = ZIP_CM_ACTUAL(method);
 
@@ -118,17 +257,225 @@ zip_compression_method_supported(zip_int32_t method, int compress) {
 
 zip_source_t *
 zip_source_compress(zip_t *za, zip_source_t *src, zip_int32_t method, zip_uint32_t compression_flags) {
-    return compression_source_new(za, src, method, true, compression_flags);
+    zip_uint32_t mode_flags = 0;
+
+    if (ZIP_WANT_AUTO_COMPRESSION(compression_flags)) {
+        mode_flags |= compression_flags & (ZIP_CM_FL_AUTO | ZIP_CM_FL_AUTO_NO_STORE);
+    }
+    if (ZIP_WANT_EARLY_STORE(compression_flags)) {
+        mode_flags |= ZIP_CM_FL_EARLY_STORE;
+    }
+    if (compression_flags != TORRENTZIP_COMPRESSION_FLAGS) {
+        compression_flags &= ~(zip_uint32_t)(ZIP_CM_FL_AUTO | ZIP_CM_FL_AUTO_NO_STORE | ZIP_CM_FL_EARLY_STORE);
+        if (ZIP_COMPRESSION_FLAGS_LEVEL(compression_flags & ~(zip_uint32_t)(ZIP_CM_FL_PARALLEL | ZIP_CM_FL_SEEKABLE | ZIP_CM_FL_LZ4_BLOCK | ZIP_CM_FL_RSYNCABLE)) == 0) {
+            compression_flags |= policy_level(za->compression_level_policy, ZIP_CM_ACTUAL(method));
+        }
+    }
+    if (ZIP_WANT_PARALLEL_COMPRESSION(compression_flags)) {
+        compression_flags &= ~ZIP_CM_FL_PARALLEL;
+        if (ZIP_CM_SUPPORTS_PARALLEL(method)) {
+            /* blocks are the same for any number of threads, with one they are compressed in the calling thread */
+            compression_flags |= (zip_uint32_t)ZIP_MIN(ZIP_MAX(za->num_threads, 1), ZIP_COMPRESSION_FLAGS_MAX_THREADS) << 16;
+        }
+    }
+    if (ZIP_WANT_SEEKABLE_COMPRESSION(compression_flags)) {
+        compression_flags &= ~ZIP_CM_FL_SEEKABLE;
+        compression_flags |= ZIP_COMPRESSION_FLAGS_SEEK_POINTS;
+    }
+    if (ZIP_WANT_RSYNCABLE_COMPRESSION(compression_flags)) {
+        compression_flags &= ~ZIP_CM_FL_RSYNCABLE;
+        compression_flags |= ZIP_COMPRESSION_FLAGS_RSYNCABLE;
+    }
+
+    return compression_source_new(za, src, method, true, compression_flags, mode_flags);
 }
 
 zip_source_t *
 zip_source_decompress(zip_t *za, zip_source_t *src, zip_int32_t method) {
-    return compression_source_new(za, src, method, false, 0);
+    return compression_source_new(za, src, method, false, decompression_flags(za), 0);
+}
+
+
+static zip_uint32_t
+decompression_flags(zip_t *za) {
+    zip_uint32_t compression_flags = 0;
+
+    /* algorithms that can decompress in parallel use this, others ignore it */
+    if (za->num_threads > 1) {
+        compression_flags |= (zip_uint32_t)ZIP_MIN(za->num_threads, ZIP_COMPRESSION_FLAGS_MAX_THREADS) << 16;
+    }
+
+    return compression_flags;
+}
+
+
+/* Return topmost compression layer of src, NULL if there is none. */
+static zip_source_t *
+compression_layer(zip_source_t *src) {
+    for (; src != NULL; src = src->src) {
+        if (src->src != NULL && src->cb.l == compress_callback) {
+            return src;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Return context of topmost compression layer of src, NULL if there is none. */
+static struct context *
+compression_context(zip_source_t *src) {
+    zip_source_t *layer = compression_layer(src);
+
+    return layer != NULL ? (struct context *)layer->ud : NULL;
+}
+
+
+/* Let topmost compression layer of src give up if ZIP_CM_FL_EARLY_STORE was requested, return whether it was. */
+bool
+_zip_source_compress_enable_early_store(zip_source_t *src) {
+    zip_source_t *layer = compression_layer(src);
+    struct context *ctx = layer != NULL ? (struct context *)layer->ud : NULL;
+
+    if (ctx == NULL || !ctx->compress || !ctx->early_store) {
+        return false;
+    }
+
+    ctx->early_store_enabled = true;
+    _zip_source_changed(layer);
+    return true;
+}
+
+
+/* Return whether topmost compression layer of src gave up because the data doesn't compress well. */
+bool
+_zip_source_compress_stored_early(zip_source_t *src) {
+    struct context *ctx = compression_context(src);
+
+    return ctx != NULL && ctx->stored_early;
+}
+
+
+/* Return seek points recorded by topmost compression layer of src, NULL if there are none. */
+const zip_seek_point_t *
+_zip_source_compress_seek_points(zip_source_t *src, zip_uint64_t *npoints) {
+    struct context *ctx = compression_context(src);
+
+    if (ctx == NULL || !ctx->compress || !ctx->end_of_stream || ctx->is_stored || ctx->algorithm->seek_points == NULL) {
+        return NULL;
+    }
+
+    return ctx->algorithm->seek_points(ctx->ud, npoints);
+}
+
+
+/* Set zstd parameters of entry for topmost compression layer of src before it is opened. */
+void
+_zip_source_compress_set_zstd_parameters(zip_source_t *src, const zip_zstd_parameters_t *parameters) {
+#if defined(HAVE_LIBZSTD)
+    struct context *ctx = compression_context(src);
+
+    if (ctx == NULL || (ctx->algorithm != &zip_algorithm_zstd_compress && ctx->algorithm != &zip_algorithm_zstd_decompress)) {
+        return;
+    }
+
+    ctx->zstd_parameters = *parameters;
+    context_configure_algorithm(ctx);
+#else
+    (void)src;
+    (void)parameters;
+#endif
+}
+
+
+/* Provide seek points to decompression layer src before it is opened. */
+bool
+_zip_source_decompress_add_seek_points(zip_source_t *src, const zip_seek_point_t *points, zip_uint64_t npoints) {
+    struct context *ctx;
+
+    if (src->src == NULL || src->cb.l != compress_callback) {
+        return false;
+    }
+
+    ctx = (struct context *)src->ud;
+    if (ctx->compress || ctx->algorithm->add_seek_points == NULL) {
+        return false;
+    }
+
+    return ctx->algorithm->add_seek_points(ctx->ud, points, npoints);
+}
+
+
+/* Prepare closed decompression layer src, created by zip_source_decompress(za, ...) and validating CRC, to decompress other data with method.
+   The algorithm state is kept, avoiding its reallocation. Returns false if src can't be used that way. */
+bool
+_zip_source_decompress_reuse(zip_t *za, zip_source_t *src, zip_int32_t method) {
+    struct context *ctx;
+
+    if (src->src == NULL || src->cb.l != compress_callback) {
+        return false;
+    }
+
+    ctx = (struct context *)src->ud;
+    if (ctx->compress || !ctx->crc_validate || ZIP_CM_ACTUAL(ctx->method) != ZIP_CM_ACTUAL(method) || ctx->algorithm != _zip_get_compression_algorithm(method, false) || ctx->compression_flags != decompression_flags(za) || ctx->buffer_size != za->io_buffer_size || ctx->memory_limit != za->decompression_memory_limit) {
+        return false;
+    }
+    if (ctx->algorithm->reset != NULL) {
+        ctx->algorithm->reset(ctx->ud);
+    }
+    else if (ctx->algorithm->seek != NULL) {
+        return false;
+    }
+
+    zip_error_fini(&ctx->error);
+    zip_error_init(&ctx->error);
+    ctx->method = method;
+    ctx->crc_complete = false;
+    ctx->crc_position = 0;
+    ctx->crc = 0;
+    _zip_source_changed(src);
+    return true;
+}
+
+
+/* Have compression layer src compute the CRC and size of its input while it is in the buffer, instead of a separate CRC layer below. */
+bool
+_zip_source_compress_compute_crc(zip_source_t *src) {
+    zip_source_t *layer = compression_layer(src);
+    struct context *ctx = layer != NULL ? (struct context *)layer->ud : NULL;
+
+    if (ctx == NULL || !ctx->compress) {
+        return false;
+    }
+
+    ctx->crc_input = true;
+    _zip_source_changed(layer);
+    return true;
+}
+
+
+/* Have decompression layer src compute the CRC of its output and validate it, instead of a separate CRC layer on top. */
+bool
+_zip_source_decompress_validate_crc(zip_source_t *src) {
+    struct context *ctx;
+
+    if (src->src == NULL || src->cb.l != compress_callback) {
+        return false;
+    }
+
+    ctx = (struct context *)src->ud;
+    if (ctx->compress) {
+        return false;
+    }
+
+    ctx->crc_validate = true;
+    _zip_source_changed(src);
+    return true;
 }
 
 
 static zip_source_t *
-compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags) {
+compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_uint32_t mode_flags) {
     struct context *ctx;
     zip_source_t *s2;
     zip_compression_algorithm_t *algorithm = NULL;
@@ -138,18 +485,62 @@ compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool co
         return NULL;
     }
 
-    if ((algorithm = _zip_get_compression_algorithm(method, compress)) == NULL) {
+    /* torrentzip requires the built-in deflate implementation */
+    if (compress && compression_flags == TORRENTZIP_COMPRESSION_FLAGS) {
+        algorithm = builtin_compression_algorithm(method, compress);
+    }
+    else {
+        algorithm = _zip_get_compression_algorithm(method, compress);
+    }
+    if (algorithm == NULL) {
         zip_error_set(&za->error, ZIP_ER_COMPNOTSUPP, 0);
         return NULL;
     }
 
-    if ((ctx = context_new(method, compress, compression_flags, algorithm)) == NULL) {
-        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+    ctx = NULL;
+    if (compress && za->compression_cache != NULL) {
+        ctx = context_get(za->compression_cache, method, compression_flags, algorithm, za->io_buffer_size);
+    }
+#ifdef HAVE_THREADS
+    else if (!compress && decompression_pool_usable(method, algorithm)) {
+        ctx = decompression_pool_get(method, compression_flags, algorithm, za->io_buffer_size, za->memory_budget);
+    }
+#endif
+    if (ctx == NULL && (ctx = context_new(method, compress, compression_flags, algorithm, za->io_buffer_size, za->memory_budget, &za->error)) == NULL) {
+        return NULL;
+    }
+    if (compress) {
+        ctx->cache = za->compression_cache;
+    }
+    else {
+#ifdef HAVE_THREADS
+        ctx->cache = decompression_pool_usable(method, algorithm) ? &decompression_pool : NULL;
+#else
+        ctx->cache = NULL;
+#endif
+    }
+    ctx->auto_select = (mode_flags & ZIP_CM_FL_AUTO) != 0;
+    ctx->auto_can_store = (mode_flags & ZIP_CM_FL_AUTO_NO_STORE) == 0;
+    ctx->early_store = (mode_flags & ZIP_CM_FL_EARLY_STORE) != 0;
+#if defined(HAVE_LIBZSTD)
+    if (algorithm == &zip_algorithm_zstd_compress || algorithm == &zip_algorithm_zstd_decompress) {
+        ctx->dictionary = _zip_zstd_dictionary_get(za);
+    }
+    /* reused context may have been configured for another entry */
+    memset(&ctx->zstd_parameters, 0, sizeof(ctx->zstd_parameters));
+#endif
+    ctx->block_size = za->compression_block_size;
+    ctx->memory_limit = compress ? 0 : za->decompression_memory_limit;
+    context_configure_algorithm(ctx);
+    /* reused context that auto_select switched to fast compression; general purpose bit flags may be asked for before opening */
+    if (!context_set_algorithm_flags(ctx, compression_flags)) {
+        _zip_error_copy(&za->error, &ctx->error);
+        context_release(ctx);
         return NULL;
     }
 
     if ((s2 = zip_source_layered(za, src, compress_callback, ctx)) == NULL) {
-        context_free(ctx);
+        context_release(ctx);
         return NULL;
     }
 
@@ -157,28 +548,105 @@ compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool co
 }
 
 
+void
+_zip_compression_cache_free(zip_compression_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    while (cache->contexts != NULL) {
+        struct context *ctx = cache->contexts;
+
+        cache->contexts = ctx->next;
+        context_free(ctx);
+    }
+    _zip_free(cache);
+}
+
+
+/* Caching is an optimization, so NULL is returned without setting an error. */
+zip_compression_cache_t *
+_zip_compression_cache_new(zip_uint32_t max_contexts) {
+    zip_compression_cache_t *cache;
+
+    if ((cache = (zip_compression_cache_t *)_zip_malloc(sizeof(*cache))) == NULL) {
+        return NULL;
+    }
+    cache->contexts = NULL;
+    cache->ncontexts = 0;
+    cache->max_contexts = max_contexts;
+
+    return cache;
+}
+
+
+/* Take unused compression context from cache, NULL if there is none matching. */
 static struct context *
-context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm) {
+context_get(zip_compression_cache_t *cache, zip_int32_t method, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, zip_uint64_t buffer_size) {
+    struct context **ctxp;
+
+    for (ctxp = &cache->contexts; *ctxp != NULL; ctxp = &(*ctxp)->next) {
+        struct context *ctx = *ctxp;
+
+        if (ctx->algorithm == algorithm && ZIP_CM_ACTUAL(ctx->method) == ZIP_CM_ACTUAL(method) && ctx->compression_flags == compression_flags && ctx->buffer_size == buffer_size) {
+            *ctxp = ctx->next;
+            cache->ncontexts--;
+            zip_error_init(&ctx->error);
+            context_reset(ctx, method);
+            return ctx;
+        }
+    }
+
+    return NULL;
+}
+
+
+static struct context *
+context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, zip_uint64_t buffer_size, zip_memory_budget_t *budget, zip_error_t *error) {
     struct context *ctx;
 
-    if ((ctx = (struct context *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct context *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
+    if ((ctx->buffer = (zip_uint8_t *)_zip_malloc((size_t)buffer_size)) == NULL) {
+        _zip_free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->buffer_size = buffer_size;
+    ctx->out = NULL;
     zip_error_init(&ctx->error);
-    ctx->can_store = compress ? ZIP_CM_IS_DEFAULT(method) : false;
     ctx->algorithm = algorithm;
-    ctx->method = method;
     ctx->compress = compress;
-    ctx->end_of_input = false;
-    ctx->end_of_stream = false;
-    ctx->is_stored = false;
+    ctx->compression_flags = compression_flags;
+    ctx->algorithm_flags = compression_flags;
+#if defined(HAVE_LIBZSTD)
+    ctx->dictionary = NULL;
+#endif
+    ctx->cache = NULL;
+    ctx->next = NULL;
+    context_reset(ctx, method);
 
     if ((ctx->ud = ctx->algorithm->allocate(ZIP_CM_ACTUAL(method), compression_flags, &ctx->error)) == NULL) {
+        _zip_error_copy(error, &ctx->error);
         zip_error_fini(&ctx->error);
-        free(ctx);
+        _zip_free(ctx->buffer);
+        _zip_free(ctx);
         return NULL;
     }
 
+    /* The algorithm state is usually much larger than our buffers; it is allocated by the compression library, so we rely on its estimate. */
+    ctx->charged = sizeof(*ctx) + buffer_size + (ctx->algorithm->memory_usage != NULL ? ctx->algorithm->memory_usage(ctx->ud) : 0);
+    if (!_zip_memory_budget_charge(budget, ctx->charged, error)) {
+        ctx->algorithm->deallocate(ctx->ud);
+        zip_error_fini(&ctx->error);
+        _zip_free(ctx->buffer);
+        _zip_free(ctx);
+        return NULL;
+    }
+    ctx->budget = _zip_memory_budget_ref(budget);
+
     return ctx;
 }
 
@@ -191,26 +659,425 @@ context_free(struct context *ctx) {
 
     ctx->algorithm->deallocate(ctx->ud);
     zip_error_fini(&ctx->error);
+    _zip_free(ctx->buffer);
+    _zip_free(ctx->out);
+    _zip_memory_budget_release(ctx->budget, ctx->charged);
+    _zip_memory_budget_free(ctx->budget);
+
+    _zip_free(ctx);
+}
+
+
+/* Return context to its cache if there is room, free it otherwise. */
+static void
+context_release(struct context *ctx) {
+    zip_compression_cache_t *cache = ctx->cache;
+
+#ifdef HAVE_THREADS
+    if (cache == &decompression_pool && zip_error_code_zip(&ctx->error) == ZIP_ER_OK) {
+        decompression_pool_put(ctx);
+        return;
+    }
+#endif
+    if (cache == NULL || cache->ncontexts >= cache->max_contexts || zip_error_code_zip(&ctx->error) != ZIP_ER_OK) {
+        context_free(ctx);
+        return;
+    }
+
+    zip_error_fini(&ctx->error);
+    ctx->cache = NULL;
+    ctx->next = cache->contexts;
+    cache->contexts = ctx;
+    cache->ncontexts++;
+}
+
+
+ZIP_EXTERN int
+zip_set_decompression_pool_size(zip_uint32_t max_contexts) {
+#ifdef HAVE_THREADS
+    struct context *excess = NULL;
+
+    _zip_global_lock();
+    decompression_pool.max_contexts = max_contexts;
+    while (decompression_pool.ncontexts > max_contexts) {
+        struct context *ctx = decompression_pool.contexts;
+
+        decompression_pool.contexts = ctx->next;
+        decompression_pool.ncontexts--;
+        ctx->next = excess;
+        excess = ctx;
+    }
+    _zip_global_unlock();
+
+    /* freed outside the lock, algorithms may take a while */
+    while (excess != NULL) {
+        struct context *ctx = excess;
+
+        excess = ctx->next;
+        context_free(ctx);
+    }
+
+    return 0;
+#else
+    (void)max_contexts;
+    return -1;
+#endif
+}
+
+
+#ifdef HAVE_THREADS
+/* Take unused decompression context from process-wide pool and charge it to budget, NULL if there is none matching. */
+static struct context *
+decompression_pool_get(zip_int32_t method, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, zip_uint64_t buffer_size, zip_memory_budget_t *budget) {
+    struct context *ctx;
+
+    _zip_global_lock();
+    ctx = context_get(&decompression_pool, method, compression_flags, algorithm, buffer_size);
+    _zip_global_unlock();
+
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    if (ctx->algorithm->reset != NULL) {
+        ctx->algorithm->reset(ctx->ud);
+    }
+    /* if this exceeds the limit, allocating a new context reports the error */
+    if (!_zip_memory_budget_charge(budget, ctx->charged, NULL)) {
+        context_free(ctx);
+        return NULL;
+    }
+    ctx->budget = _zip_memory_budget_ref(budget);
+
+    return ctx;
+}
+
+
+/* Detach decompression context from its archive and return it to process-wide pool if there is room, free it otherwise. */
+static void
+decompression_pool_put(struct context *ctx) {
+#if defined(HAVE_LIBZSTD)
+    ctx->dictionary = NULL;
+    memset(&ctx->zstd_parameters, 0, sizeof(ctx->zstd_parameters));
+#endif
+    ctx->memory_limit = 0;
+    context_configure_algorithm(ctx);
+    _zip_memory_budget_release(ctx->budget, ctx->charged);
+    _zip_memory_budget_free(ctx->budget);
+    ctx->budget = NULL;
+    zip_error_fini(&ctx->error);
+    ctx->cache = NULL;
+
+    _zip_global_lock();
+    if (decompression_pool.ncontexts < decompression_pool.max_contexts) {
+        ctx->next = decompression_pool.contexts;
+        decompression_pool.contexts = ctx;
+        decompression_pool.ncontexts++;
+        ctx = NULL;
+    }
+    _zip_global_unlock();
+
+    if (ctx != NULL) {
+        context_free(ctx);
+    }
+}
+
+
+/* Only built-in algorithms are pooled, registered ones may go away; algorithms that can seek must be able to drop their checkpoints. */
+static bool
+decompression_pool_usable(zip_int32_t method, zip_compression_algorithm_t *algorithm) {
+    return algorithm == builtin_compression_algorithm(method, false) && (algorithm->reset != NULL || algorithm->seek == NULL);
+}
+#endif
+
+
+/* Estimate compressed size of data, in thousandths of its length, from its byte entropy and a quick LZ pass. */
+static zip_uint64_t
+auto_estimate(const zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint32_t counts[256];
+    zip_uint16_t table[1u << AUTO_HASH_BITS];
+    zip_uint64_t i, entropy_bits, lz_size, literals, matches;
+
+    length = ZIP_MIN(length, AUTO_SAMPLE_SIZE);
+
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < length; i++) {
+        counts[data[i]]++;
+    }
+    /* sum of -c * log2(c / n) in 1/65536 bits */
+    entropy_bits = 0;
+    for (i = 0; i < 256; i++) {
+        if (counts[i] > 0) {
+            entropy_bits += counts[i] * (auto_log2(length) - auto_log2(counts[i]));
+        }
+    }
+
+    /* matches of at least AUTO_MIN_MATCH bytes with the last position of the same hash, counted as 3 bytes each */
+    memset(table, 0, sizeof(table));
+    literals = matches = 0;
+    i = 0;
+    while (i + AUTO_MIN_MATCH <= length) {
+        zip_uint32_t hash = ((zip_uint32_t)data[i] | (zip_uint32_t)data[i + 1] << 8 | (zip_uint32_t)data[i + 2] << 16 | (zip_uint32_t)data[i + 3] << 24) * 2654435761u >> (32 - AUTO_HASH_BITS);
+        zip_uint64_t candidate = table[hash];
+
+        table[hash] = (zip_uint16_t)i;
+        if (candidate < i && memcmp(data + candidate, data + i, AUTO_MIN_MATCH) == 0) {
+            zip_uint64_t match_length = AUTO_MIN_MATCH;
+
+            while (i + match_length < length && match_length < 258 && data[candidate + match_length] == data[i + match_length]) {
+                match_length++;
+            }
+            matches++;
+            i += match_length;
+        }
+        else {
+            literals++;
+            i++;
+        }
+    }
+    literals += length - i;
+    lz_size = literals + 3 * matches;
+
+    return ZIP_MIN(entropy_bits / (8 * 65536), lz_size) * 1000 / length;
+}
+
+
+/* Read first input and choose how to compress data (ZIP_CM_FL_AUTO). */
+static bool
+auto_select(zip_source_t *src, struct context *ctx) {
+    zip_uint64_t estimate;
+    zip_int64_t n;
+
+    if ((n = zip_source_read(src, ctx->buffer, ctx->buffer_size)) < 0) {
+        zip_error_set_from_source(&ctx->error, src);
+        return false;
+    }
+    ctx->first_read = n;
+
+    if (n < AUTO_MIN_SAMPLE_SIZE) {
+        /* too little data to tell, and cheap to compress */
+        return context_set_algorithm_flags(ctx, ctx->compression_flags);
+    }
+
+    estimate = auto_estimate(ctx->buffer, (zip_uint64_t)n);
+    if (estimate >= AUTO_STORE_THRESHOLD && ctx->auto_can_store) {
+        ctx->pass_through = true;
+        ctx->is_stored = true;
+        ctx->buffer_used = 0;
+        input_crc(ctx, ctx->buffer, (zip_uint64_t)n);
+        return true;
+    }
+    if (estimate >= AUTO_FAST_THRESHOLD) {
+        return context_set_algorithm_flags(ctx, (ctx->compression_flags & ~(zip_uint32_t)0xff) | AUTO_FAST_LEVEL);
+    }
+    return context_set_algorithm_flags(ctx, ctx->compression_flags);
+}
+
+
+/* log2(x) in 1/65536, interpolated linearly between powers of 2. */
+static zip_uint64_t
+auto_log2(zip_uint64_t x) {
+    zip_uint64_t k = 0;
+
+    while ((x >> k) > 1) {
+        k++;
+    }
+
+    return (k << 16) + ((x << 16) >> k) - 65536;
+}
+
+
+/* Return level to use for level 0 with policy for method, 0 for its default. */
+static zip_uint32_t
+policy_level(zip_uint32_t policy, zip_int32_t method) {
+    size_t i;
+
+    if (policy == ZIP_COMPRESSION_LEVEL_DEFAULT || policy > ZIP_COMPRESSION_LEVEL_MAX) {
+        return 0;
+    }
+
+    for (i = 0; i < level_policies_size; i++) {
+        if (level_policies[i].method == method) {
+            return level_policies[i].level[policy - 1];
+        }
+    }
+
+    return 0;
+}
+
+
+/* Initialize state for a new source, the algorithm resets its own state in start. */
+static void
+context_reset(struct context *ctx, zip_int32_t method) {
+    ctx->can_store = ctx->compress ? ZIP_CM_IS_DEFAULT(method) : false;
+    ctx->method = method;
+    ctx->end_of_input = false;
+    ctx->end_of_stream = false;
+    ctx->is_stored = false;
+    ctx->crc_validate = false;
+    ctx->crc_input = false;
+    ctx->crc_complete = false;
+    ctx->crc_position = 0;
+    ctx->crc = 0;
+    ctx->auto_select = false;
+    ctx->auto_can_store = false;
+    ctx->pass_through = false;
+    ctx->early_store = false;
+    ctx->early_store_enabled = false;
+    ctx->stored_early = false;
+    ctx->input_size = 0;
+}
+
+
+/* Change compression flags of algorithm, reallocating its state. */
+static bool
+context_set_algorithm_flags(struct context *ctx, zip_uint32_t flags) {
+    void *ud;
+
+    if (flags == ctx->algorithm_flags) {
+        return true;
+    }
+
+    if ((ud = ctx->algorithm->allocate(ZIP_CM_ACTUAL(ctx->method), flags, &ctx->error)) == NULL) {
+        return false;
+    }
+    ctx->algorithm->deallocate(ctx->ud);
+    ctx->ud = ud;
+    ctx->algorithm_flags = flags;
+    context_configure_algorithm(ctx);
+
+    return true;
+}
+
+
+/* Pass archive settings that don't fit into the compression flags to the algorithm state. */
+static void
+context_configure_algorithm(struct context *ctx) {
+#if defined(HAVE_LIBZSTD)
+    if (ctx->algorithm == &zip_algorithm_zstd_compress || ctx->algorithm == &zip_algorithm_zstd_decompress) {
+        _zip_zstd_set_dictionary(ctx->ud, ctx->dictionary);
+        _zip_zstd_set_parameters(ctx->ud, &ctx->zstd_parameters);
+        _zip_zstd_set_memory_limit(ctx->ud, ctx->memory_limit);
+    }
+#endif
+#if defined(HAVE_LIBLZMA)
+    if (ctx->algorithm == &zip_algorithm_xz_compress) {
+        _zip_xz_set_block_size(ctx->ud, ctx->block_size);
+    }
+    if (ctx->algorithm == &zip_algorithm_xz_decompress) {
+        _zip_xz_set_memory_limit(ctx->ud, ctx->memory_limit);
+    }
+#endif
+    (void)ctx;
+}
+
+
+/* Pass n bytes read into ctx->buffer to algorithm, 0 for end of input. */
+static void
+compress_input(struct context *ctx, zip_int64_t n) {
+    if (n == 0) {
+        ctx->end_of_input = true;
+        ctx->crc_complete = ctx->crc_input;
+        ctx->algorithm->end_of_input(ctx->ud);
+        if (ctx->first_read < 0) {
+            ctx->first_read = 0;
+        }
+        return;
+    }
+
+    if (ctx->first_read >= 0) {
+        /* we overwrote a previously filled ctx->buffer */
+        ctx->can_store = false;
+    }
+    else {
+        ctx->first_read = n;
+        if (n > BUFSIZE) {
+            /* only small files are stored if compression doesn't help, independent of ctx->buffer_size */
+            ctx->can_store = false;
+        }
+    }
+
+    ctx->input_size += (zip_uint64_t)n;
+    input_crc(ctx, ctx->buffer, (zip_uint64_t)n);
+    ctx->algorithm->input(ctx->ud, ctx->buffer, (zip_uint64_t)n);
+}
+
+
+/* Compute CRC of input while it is still in cache. */
+static void
+input_crc(struct context *ctx, const zip_uint8_t *data, zip_uint64_t length) {
+    if (ctx->crc_input) {
+        ctx->crc = _zip_crc32(ctx->crc, data, length);
+        ctx->crc_position += length;
+    }
+}
+
 
-    free(ctx);
+/* Return output buffer, allocating it if needed. */
+static zip_uint8_t *
+output_buffer(struct context *ctx) {
+    if (ctx->out == NULL && (ctx->out = (zip_uint8_t *)_zip_malloc((size_t)ctx->buffer_size)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+    }
+    return ctx->out;
 }
 
 
+/* Small reads are served from ctx->out, so the algorithm always works on chunks of buffer_size, which avoids its overhead per call. */
 static zip_int64_t
 compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len) {
+    zip_uint64_t n;
+
+    if (ctx->out_offset == ctx->out_length) {
+        zip_int64_t ret;
+
+        if (len >= ctx->buffer_size) {
+            return compress_process(src, ctx, data, len);
+        }
+        if (output_buffer(ctx) == NULL) {
+            return -1;
+        }
+        if ((ret = compress_process(src, ctx, ctx->out, ctx->buffer_size)) <= 0) {
+            return ret;
+        }
+        ctx->out_length = (zip_uint64_t)ret;
+        ctx->out_offset = 0;
+    }
+
+    n = ZIP_MIN(len, ctx->out_length - ctx->out_offset);
+    (void)memcpy_s(data, len, ctx->out + ctx->out_offset, n);
+    ctx->out_offset += n;
+
+    return (zip_int64_t)n;
+}
+
+
+/* Run algorithm to produce up to len bytes of output; ctx->size counts output produced, including what is still in ctx->out. */
+static zip_int64_t
+compress_process(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len) {
     zip_compression_status_t ret;
     bool end;
     zip_int64_t n;
     zip_uint64_t out_offset;
     zip_uint64_t out_len;
 
+    if (zip_error_code_zip(&ctx->error) == ZIP_ER_AGAIN) {
+        /* input wasn't available on last call, try again */
+        _zip_error_clear(&ctx->error);
+    }
     if (zip_error_code_zip(&ctx->error) != ZIP_ER_OK) {
         return -1;
     }
 
-    if (len == 0 || ctx->end_of_stream) {
+    if (len == 0) {
         return 0;
     }
+    if (ctx->pass_through) {
+        return pass_through_read(src, ctx, data, len);
+    }
+    if (ctx->end_of_stream) {
+        return decompress_crc_end(src, ctx) ? 0 : -1;
+    }
 
     out_offset = 0;
 
@@ -256,29 +1123,12 @@ compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t l
                 break;
             }
 
-            if ((n = zip_source_read(src, ctx->buffer, sizeof(ctx->buffer))) < 0) {
+            if ((n = zip_source_read(src, ctx->buffer, ctx->buffer_size)) < 0) {
                 zip_error_set_from_source(&ctx->error, src);
                 end = true;
                 break;
             }
-            else if (n == 0) {
-                ctx->end_of_input = true;
-                ctx->algorithm->end_of_input(ctx->ud);
-                if (ctx->first_read < 0) {
-                    ctx->first_read = 0;
-                }
-            }
-            else {
-                if (ctx->first_read >= 0) {
-                    /* we overwrote a previously filled ctx->buffer */
-                    ctx->can_store = false;
-                }
-                else {
-                    ctx->first_read = n;
-                }
-
-                ctx->algorithm->input(ctx->ud, ctx->buffer, (zip_uint64_t)n);
-            }
+            compress_input(ctx, n);
             break;
 
         case ZIP_COMPRESSION_ERROR:
@@ -292,12 +1142,145 @@ compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t l
     }
 
     if (out_offset > 0) {
+        /* compute CRC while output is still in cache */
+        if (ctx->crc_validate && !ctx->crc_complete && ctx->size <= ctx->crc_position && ctx->crc_position < ctx->size + out_offset) {
+            zip_uint64_t i = ctx->crc_position - ctx->size;
+
+            ctx->crc = _zip_crc32(ctx->crc, (const zip_uint8_t *)data + i, out_offset - i);
+            ctx->crc_position += out_offset - i;
+        }
         ctx->can_store = false;
         ctx->size += out_offset;
+        if (ctx->early_store_enabled && ctx->input_size >= EARLY_STORE_SIZE) {
+            ctx->early_store_enabled = false;
+            if (ctx->size < ctx->input_size && ctx->size * 1000 >= ctx->input_size * EARLY_STORE_THRESHOLD) {
+                ctx->stored_early = true;
+                zip_error_set(&ctx->error, ZIP_ER_CANCELLED, 0);
+                return -1;
+            }
+        }
         return (zip_int64_t)out_offset;
     }
 
-    return (zip_error_code_zip(&ctx->error) == ZIP_ER_OK) ? 0 : -1;
+    if (zip_error_code_zip(&ctx->error) != ZIP_ER_OK) {
+        return -1;
+    }
+    return decompress_crc_end(src, ctx) ? 0 : -1;
+}
+
+
+/* Return data unchanged, starting with first input read by auto_select. */
+static zip_int64_t
+pass_through_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len) {
+    zip_uint64_t out_offset = 0;
+    zip_int64_t n;
+
+    if (ctx->buffer_used < (zip_uint64_t)ctx->first_read) {
+        out_offset = ZIP_MIN(len, (zip_uint64_t)ctx->first_read - ctx->buffer_used);
+        (void)memcpy_s(data, len, ctx->buffer + ctx->buffer_used, out_offset);
+        ctx->buffer_used += out_offset;
+    }
+
+    if (out_offset < len && !ctx->end_of_input) {
+        if ((n = zip_source_read(src, (zip_uint8_t *)data + out_offset, len - out_offset)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+        if (n == 0) {
+            ctx->end_of_input = true;
+            ctx->crc_complete = ctx->crc_input;
+        }
+        input_crc(ctx, (zip_uint8_t *)data + out_offset, (zip_uint64_t)n);
+        out_offset += (zip_uint64_t)n;
+    }
+
+    if (ctx->end_of_input && ctx->buffer_used == (zip_uint64_t)ctx->first_read) {
+        ctx->end_of_stream = true;
+    }
+    ctx->size += out_offset;
+    return (zip_int64_t)out_offset;
+}
+
+
+/* Called when reaching end of decompressed data, validates CRC if it was computed over all of it. */
+static bool
+decompress_crc_end(zip_source_t *src, struct context *ctx) {
+    zip_stat_t st;
+
+    if (!ctx->crc_validate || ctx->crc_position != ctx->size) {
+        return true;
+    }
+
+    ctx->crc_complete = true;
+
+    if (zip_source_stat(src, &st) < 0) {
+        zip_error_set_from_source(&ctx->error, src);
+        return false;
+    }
+    if ((st.valid & ZIP_STAT_CRC) && st.crc != ctx->crc) {
+        zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Seek in decompressed data by restarting the decompressor at a suitable point and skipping forward from there. */
+static int
+decompress_seek(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len) {
+    zip_stat_t st;
+    zip_int64_t new_offset;
+    zip_uint64_t uncompressed_offset, compressed_offset;
+    zip_uint64_t buffered = ctx->out_length - ctx->out_offset;
+
+    if (zip_error_code_zip(&ctx->error) != ZIP_ER_OK) {
+        return -1;
+    }
+
+    if (zip_source_stat(src, &st) < 0) {
+        zip_error_set_from_source(&ctx->error, src);
+        return -1;
+    }
+    if ((new_offset = zip_source_seek_compute_offset(ctx->size - buffered, (st.valid & ZIP_STAT_SIZE) ? st.size : ZIP_INT64_MAX, data, len, &ctx->error)) < 0) {
+        return -1;
+    }
+
+    if ((zip_uint64_t)new_offset <= ctx->size && ctx->size - (zip_uint64_t)new_offset <= ctx->out_length) {
+        /* still in output buffer */
+        ctx->out_offset = ctx->out_length - (ctx->size - (zip_uint64_t)new_offset);
+        return 0;
+    }
+    ctx->out_length = ctx->out_offset = 0;
+    if (output_buffer(ctx) == NULL) {
+        return -1;
+    }
+
+    if (!ctx->algorithm->seek(ctx->ud, (zip_uint64_t)new_offset, &uncompressed_offset, &compressed_offset)) {
+        return -1;
+    }
+    if (compressed_offset > ZIP_INT64_MAX || zip_source_seek(src, (zip_int64_t)compressed_offset, SEEK_SET) < 0) {
+        zip_error_set_from_source(&ctx->error, src);
+        return -1;
+    }
+    ctx->size = uncompressed_offset;
+    ctx->end_of_input = false;
+    ctx->end_of_stream = false;
+
+    while (ctx->size < (zip_uint64_t)new_offset) {
+        zip_int64_t n = compress_process(src, ctx, ctx->out, ZIP_MIN(ctx->buffer_size, (zip_uint64_t)new_offset - ctx->size));
+
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            /* only possible if size is unknown */
+            zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 
@@ -313,19 +1296,44 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
         zip_file_attributes_t attributes;
         
         ctx->size = 0;
+        ctx->out_length = ctx->out_offset = 0;
         ctx->end_of_input = false;
         ctx->end_of_stream = false;
         ctx->is_stored = false;
         ctx->first_read = -1;
+        ctx->pass_through = false;
+        ctx->stored_early = false;
+        ctx->input_size = 0;
+        if (ctx->crc_input) {
+            ctx->crc_complete = false;
+            ctx->crc_position = 0;
+            ctx->crc = 0;
+        }
         
         if (zip_source_stat(src, &st) < 0 || zip_source_get_file_attributes(src, &attributes) < 0) {
             zip_error_set_from_source(&ctx->error, src);
             return -1;
         }
 
+        if (ctx->auto_select) {
+            if (!auto_select(src, ctx)) {
+                return -1;
+            }
+            if (ctx->pass_through) {
+                return 0;
+            }
+        }
+
         if (!ctx->algorithm->start(ctx->ud, &st, &attributes)) {
             return -1;
         }
+        if (ctx->first_read >= 0) {
+            /* data read by auto_select */
+            zip_int64_t n = ctx->first_read;
+
+            ctx->first_read = -1;
+            compress_input(ctx, n);
+        }
 
         return 0;
     }
@@ -334,7 +1342,7 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
         return compress_read(src, ctx, data, len);
 
     case ZIP_SOURCE_CLOSE:
-        if (!ctx->algorithm->end(ctx->ud)) {
+        if (!ctx->pass_through && !ctx->algorithm->end(ctx->ud)) {
             return -1;
         }
         return 0;
@@ -345,6 +1353,17 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
         st = (zip_stat_t *)data;
 
         if (ctx->compress) {
+            if (ctx->crc_complete) {
+                /* as zip_source_crc_create() below would */
+                if ((st->valid & ZIP_STAT_SIZE) && st->size != ctx->crc_position) {
+                    zip_error_set(&ctx->error, ZIP_ER_DATA_LENGTH, 0);
+                    return -1;
+                }
+                st->size = ctx->crc_position;
+                st->crc = ctx->crc;
+                st->encryption_method = ZIP_EM_NONE;
+                st->valid |= ZIP_STAT_SIZE | ZIP_STAT_CRC | ZIP_STAT_ENCRYPTION_METHOD;
+            }
             if (ctx->end_of_stream) {
                 st->comp_method = ctx->is_stored ? ZIP_CM_STORE : ZIP_CM_ACTUAL(ctx->method);
                 st->comp_size = ctx->size;
@@ -362,6 +1381,13 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
                 st->size = ctx->size;
                 st->valid |= ZIP_STAT_SIZE;
             }
+            if (ctx->crc_complete) {
+                /* as zip_source_crc_create() would */
+                st->crc = ctx->crc;
+                st->comp_size = ctx->crc_position;
+                st->encryption_method = ZIP_EM_NONE;
+                st->valid |= ZIP_STAT_CRC | ZIP_STAT_COMP_SIZE | ZIP_STAT_ENCRYPTION_METHOD;
+            }
         }
     }
         return 0;
@@ -370,7 +1396,7 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
         return zip_error_to_data(&ctx->error, data, len);
 
     case ZIP_SOURCE_FREE:
-        context_free(ctx);
+        context_release(ctx);
         return 0;
 
     case ZIP_SOURCE_GET_FILE_ATTRIBUTES: {
@@ -389,8 +1415,20 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
         return sizeof(*attributes);
     }
 
-    case ZIP_SOURCE_SUPPORTS:
-        return ZIP_SOURCE_SUPPORTS_READABLE | zip_source_make_command_bitmap(ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
+    case ZIP_SOURCE_SUPPORTS: {
+        zip_int64_t supports = ZIP_SOURCE_SUPPORTS_READABLE | zip_source_make_command_bitmap(ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
+
+        if (!ctx->compress && ctx->algorithm->seek != NULL && (zip_source_supports(src) & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK))) {
+            supports |= ZIP_SOURCE_SUPPORTS_SEEKABLE;
+        }
+        return supports;
+    }
+
+    case ZIP_SOURCE_SEEK:
+        return decompress_seek(src, ctx, data, len);
+
+    case ZIP_SOURCE_TELL:
+        return (zip_int64_t)(ctx->size - (ctx->out_length - ctx->out_offset));
 
     default:
         return zip_source_pass_to_lower_layer(src, data, len, cmd);
@@ -0,0 +1,79 @@
+/*
+  zip_source_copy_data.c -- copy data from read to write position
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "zipint.h"
+
+
+/* Copy up to length bytes from the read position to the write position of src without passing them through a buffer.
+   Returns the number of bytes copied, 0 if src can't copy (the rest of) the data this way. */
+zip_int64_t
+_zip_source_copy_data(zip_source_t *src, zip_uint64_t length) {
+    zip_int64_t n;
+
+    if (!ZIP_SOURCE_IS_OPEN_READING(src) || !ZIP_SOURCE_IS_OPEN_WRITING(src) || length > ZIP_INT64_MAX) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (!ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(src), ZIP_SOURCE_COPY_DATA) || length == 0) {
+        return 0;
+    }
+
+    if ((n = _zip_source_call(src, NULL, length, ZIP_SOURCE_COPY_DATA)) > 0) {
+        src->bytes_written += (zip_uint64_t)n;
+    }
+
+    return n;
+}
+
+
+/* Copy up to length bytes from the read position of src to the write position of dst without passing them through a buffer.
+   This is possible for archive entry data in files that dst can copy from.
+   Returns the number of bytes copied, 0 if src can't copy (the rest of) the data this way. */
+zip_int64_t
+_zip_source_copy_data_from(zip_source_t *dst, zip_source_t *src, zip_uint64_t length) {
+    zip_int64_t n;
+
+    if (!ZIP_SOURCE_IS_OPEN_READING(src) || !ZIP_SOURCE_IS_OPEN_WRITING(dst) || length > ZIP_INT64_MAX) {
+        zip_error_set(&dst->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if ((n = _zip_source_window_copy_data_to(src, dst, length)) > 0) {
+        dst->bytes_written += (zip_uint64_t)n;
+    }
+
+    return n;
+}
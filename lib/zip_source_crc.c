@@ -32,9 +32,8 @@
 */
 
 
-#include <limits.h>
 #include <stdlib.h>
-#include <zlib.h>
+#include <string.h>
 
 #include "zipint.h"
 
@@ -46,8 +45,12 @@ struct crc_context {
     zip_uint64_t position;     /* current reading position */
     zip_uint64_t crc_position; /* how far we've computed the CRC */
     zip_uint32_t crc;
+    bool digest;                 /* whether to also compute SHA-256 digest of data */
+    zip_sha256_t sha256;         /* state of digest computation, in step with CRC */
+    zip_uint8_t digest_value[ZIP_DIGEST_LENGTH]; /* digest, once crc_complete */
 };
 
+static struct crc_context *crc_context(zip_source_t *src);
 static zip_int64_t crc_read(zip_source_t *, void *, void *, zip_uint64_t, zip_source_cmd_t);
 
 
@@ -60,7 +63,7 @@ zip_source_crc_create(zip_source_t *src, int validate, zip_error_t *error) {
         return NULL;
     }
 
-    if ((ctx = (struct crc_context *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct crc_context *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -69,13 +72,56 @@ zip_source_crc_create(zip_source_t *src, int validate, zip_error_t *error) {
     ctx->validate = validate;
     ctx->crc_complete = 0;
     ctx->crc_position = 0;
-    ctx->crc = (zip_uint32_t)crc32(0, NULL, 0);
+    ctx->crc = 0;
     ctx->size = 0;
+    ctx->digest = false;
 
     return zip_source_layered_create(src, crc_read, ctx, error);
 }
 
 
+/* Have topmost CRC layer of src also compute the SHA-256 digest of the data, in the same pass; must be called before data is read. */
+bool
+_zip_source_crc_compute_digest(zip_source_t *src) {
+    struct crc_context *ctx = crc_context(src);
+
+    if (ctx == NULL || ctx->crc_position > 0 || ctx->crc_complete) {
+        return false;
+    }
+
+    ctx->digest = true;
+    _zip_sha256_init(&ctx->sha256);
+    return true;
+}
+
+
+/* Get digest computed by topmost CRC layer of src, return whether it was computed over all of the data. */
+bool
+_zip_source_crc_get_digest(zip_source_t *src, zip_uint8_t *digest) {
+    struct crc_context *ctx = crc_context(src);
+
+    if (ctx == NULL || !ctx->digest || !ctx->crc_complete) {
+        return false;
+    }
+
+    (void)memcpy_s(digest, ZIP_DIGEST_LENGTH, ctx->digest_value, ZIP_DIGEST_LENGTH);
+    return true;
+}
+
+
+/* Return context of topmost CRC layer of src, NULL if there is none. */
+static struct crc_context *
+crc_context(zip_source_t *src) {
+    for (; src != NULL; src = src->src) {
+        if (src->src != NULL && src->cb.l == crc_read) {
+            return (struct crc_context *)src->ud;
+        }
+    }
+
+    return NULL;
+}
+
+
 static zip_int64_t
 crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     struct crc_context *ctx;
@@ -96,6 +142,9 @@ crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source
 
         if (n == 0) {
             if (ctx->crc_position == ctx->position) {
+                if (ctx->digest && !ctx->crc_complete) {
+                    _zip_sha256_final(&ctx->sha256, ctx->digest_value);
+                }
                 ctx->crc_complete = 1;
                 ctx->size = ctx->position;
 
@@ -120,13 +169,14 @@ crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source
             }
         }
         else if (!ctx->crc_complete && ctx->position <= ctx->crc_position) {
-            zip_uint64_t i, nn;
+            zip_uint64_t i = ctx->crc_position - ctx->position;
 
-            for (i = ctx->crc_position - ctx->position; i < (zip_uint64_t)n; i += nn) {
-                nn = ZIP_MIN(UINT_MAX, (zip_uint64_t)n - i);
-
-                ctx->crc = (zip_uint32_t)crc32(ctx->crc, (const Bytef *)data + i, (uInt)nn);
-                ctx->crc_position += nn;
+            if (i < (zip_uint64_t)n) {
+                ctx->crc = _zip_crc32(ctx->crc, (const zip_uint8_t *)data + i, (zip_uint64_t)n - i);
+                if (ctx->digest) {
+                    _zip_sha256_update(&ctx->sha256, (const zip_uint8_t *)data + i, (zip_uint64_t)n - i);
+                }
+                ctx->crc_position += (zip_uint64_t)n - i;
             }
         }
         ctx->position += (zip_uint64_t)n;
@@ -161,9 +211,52 @@ crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source
         return zip_error_to_data(&ctx->error, data, len);
 
     case ZIP_SOURCE_FREE:
-        free(ctx);
+        _zip_free(ctx);
         return 0;
 
+    case ZIP_SOURCE_GET_DATA: {
+        zip_source_args_get_data_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_get_data_t, data, len, &ctx->error);
+        struct zip_stat st;
+        const void *lower_data;
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (zip_source_get_data(src, args->offset, args->length, &lower_data) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+
+        /* When all data is requested, compute CRC in one pass over it. */
+        if (!ctx->crc_complete && args->offset == 0) {
+            if (zip_source_stat(src, &st) < 0) {
+                zip_error_set_from_source(&ctx->error, src);
+                return -1;
+            }
+            if ((st.valid & ZIP_STAT_SIZE) && st.size == args->length) {
+                zip_uint32_t crc = _zip_crc32(0, lower_data, args->length);
+
+                if (ctx->validate && (st.valid & ZIP_STAT_CRC) && st.crc != crc) {
+                    zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
+                    return -1;
+                }
+
+                if (ctx->digest) {
+                    _zip_sha256_init(&ctx->sha256);
+                    _zip_sha256_update(&ctx->sha256, lower_data, args->length);
+                    _zip_sha256_final(&ctx->sha256, ctx->digest_value);
+                }
+                ctx->crc = crc;
+                ctx->crc_position = args->length;
+                ctx->size = args->length;
+                ctx->crc_complete = 1;
+            }
+        }
+
+        args->data = lower_data;
+        return 0;
+    }
+
     case ZIP_SOURCE_SUPPORTS: {
         zip_int64_t mask = zip_source_supports(src);
 
@@ -172,7 +265,7 @@ crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source
             return -1;
         }
 
-        mask &= ~zip_source_make_command_bitmap(ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_REMOVE, ZIP_SOURCE_GET_FILE_ATTRIBUTES, -1);
+        mask &= ~zip_source_make_command_bitmap(ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_SEEK_WRITE, ZIP_SOURCE_TELL_WRITE, ZIP_SOURCE_REMOVE, ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_READ_AT, -1);
         mask |= zip_source_make_command_bitmap(ZIP_SOURCE_FREE, -1);
         return mask;
     }
@@ -55,10 +55,17 @@ struct zip_source_file_context {
     zip_uint64_t start;               /* start offset of data to read */
     zip_uint64_t len;                 /* length of the file, 0 for up to EOF */
     zip_uint64_t offset;              /* current offset relative to start (0 is beginning of part we read) */
+    zip_uint64_t preload_limit;       /* read data into memory when opening if it is at most this long, 0 for never */
+    zip_uint8_t *preload;             /* data read into memory, NULL if not preloaded */
+    zip_uint64_t preload_length;      /* length of preloaded data */
 
     /* writing */
     char *tmpname;
     void *fout;
+    void *journal; /* when writing in place: backup of overwritten data, tmpname is its name */
+    void *journal_patches; /* when writing in place: writes before the journaled data, applied on commit */
+    bool preallocated; /* fout was extended by preallocate */
+    char *output_name; /* if not NULL, written instead of a temporary file and kept on rollback, see open_output */
 
     zip_source_file_operations_t *ops;
     void *ops_userdata;
@@ -69,15 +76,37 @@ struct zip_source_file_context {
    - close, read, seek, and stat must always be implemented.
    - To support specifying the file by name, open, and strdup must be implemented.
    - For write support, the file must be specified by name and close, commit_write, create_temp_output, remove, rollback_write, and tell must be implemented.
-   - create_temp_output_cloning is always optional. */
+   - create_temp_output_cloning is always optional.
+   - open_output is optional. It opens output_name for writing instead of a temporary file, keeping its contents, so
+     an interrupted write can be continued; commit_write must cut it to the data written, and rollback_write must keep it.
+   - create_output_in_place is optional. It opens the original file for writing after saving the data it will overwrite
+     in a journal; commit_write and rollback_write must handle this case.
+   - copy_data is optional. It copies data from f of from, which is either ctx or another context using the same
+     operations, at an absolute offset to the current position of fout without passing it through user space, returning the
+     number of bytes copied, which may be less than requested or 0 if it can't be done.
+   - free is optional. It releases ops_userdata when the source is freed, after f has been closed.
+   - preallocate is optional. It reserves space for len bytes at offset of fout, which will be written soon. It can't fail.
+     If it changes the size of fout, commit_write must cut fout to the data written, which ends at its write position.
+   - prefetch is optional. It tells the operating system that len bytes at an absolute offset of f will be read soon. It can't
+     fail and may be called from multiple threads at the same time, like read_at.
+   - read_at is optional. It reads at an absolute offset without changing the file position of f and may be called from
+     multiple threads at the same time, so it must not modify ctx and reports errors in error instead of ctx->error.
+   - writev is optional. It writes the data of nfragments fragments to fout like write, with as few system calls as possible. */
 
 struct zip_source_file_operations {
     void (*close)(zip_source_file_context_t *ctx);
     zip_int64_t (*commit_write)(zip_source_file_context_t *ctx);
+    zip_int64_t (*copy_data)(zip_source_file_context_t *ctx, zip_source_file_context_t *from, zip_uint64_t offset, zip_uint64_t length);
+    zip_int64_t (*create_output_in_place)(zip_source_file_context_t *ctx, zip_uint64_t offset);
     zip_int64_t (*create_temp_output)(zip_source_file_context_t *ctx);
     zip_int64_t (*create_temp_output_cloning)(zip_source_file_context_t *ctx, zip_uint64_t len);
+    void (*free)(zip_source_file_context_t *ctx);
     bool (*open)(zip_source_file_context_t *ctx);
+    zip_int64_t (*open_output)(zip_source_file_context_t *ctx);
+    void (*preallocate)(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
+    void (*prefetch)(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
     zip_int64_t (*read)(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+    zip_int64_t (*read_at)(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error);
     zip_int64_t (*remove)(zip_source_file_context_t *ctx);
     void (*rollback_write)(zip_source_file_context_t *ctx);
     bool (*seek)(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
@@ -85,6 +114,7 @@ struct zip_source_file_operations {
     char *(*string_duplicate)(zip_source_file_context_t *ctx, const char *);
     zip_int64_t (*tell)(zip_source_file_context_t *ctx, void *f);
     zip_int64_t (*write)(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len);
+    zip_int64_t (*writev)(zip_source_file_context_t *ctx, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments);
 };
 
 zip_source_t *zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zip_int64_t len, const zip_stat_t *st, zip_source_file_operations_t *ops, void *ops_userdata, zip_error_t *error);
@@ -0,0 +1,965 @@
+/*
+  zip_source_file_async.c -- source for file opened by name, using asynchronous I/O
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+#define ASYNC_DEFAULT_QUEUE_DEPTH 8
+#define ASYNC_MAX_QUEUE_DEPTH 256
+
+#ifdef HAVE_IO_URING
+#include "zip_source_file.h"
+#include "zip_source_file_stdio.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Reads are issued ahead of the read position and writes are collected and issued behind the write position, each in
+   queue_depth chunks of ASYNC_CHUNK_SIZE bytes, using one io_uring per source.
+
+   Sequential reads are answered from the chunks in order; seeking waits for the chunks in flight and starts reading
+   ahead from the new position. Written data is copied into a chunk, which is written when it is full; the output is
+   brought up to date before anything else uses it (seek, tell after seek, copy_data, commit). When writing in place,
+   input and output are the same file, and both are accessed synchronously.
+
+   The ring and the chunks are only set up while the source is reading or writing, so many sources can be created, for
+   example to add many files to an archive, without holding a file descriptor and buffers each. If the ring can't be
+   set up, the source uses synchronous I/O until it is closed. */
+
+#define ASYNC_CHUNK_SIZE (128 * 1024)
+
+struct ring {
+    int fd;
+
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    unsigned unsubmitted; /* SQEs queued since last io_uring_enter */
+};
+typedef struct ring ring_t;
+
+struct chunk {
+    zip_uint8_t *data;
+    zip_uint64_t offset; /* absolute offset in file */
+    zip_uint64_t length; /* amount requested */
+    zip_int64_t result;  /* bytes transferred or -errno, valid when done */
+    bool in_flight;
+    bool done;
+};
+typedef struct chunk chunk_t;
+
+struct async {
+    ring_t ring;
+    bool have_ring;   /* ring is set up */
+    bool ring_failed; /* setting up ring failed, use synchronous I/O until released */
+    zip_uint32_t queue_depth;
+
+    /* reading, chunks in order of offset starting at read_head */
+    chunk_t *read_chunks;
+    zip_uint32_t read_head;
+    zip_uint32_t read_count;   /* number of chunks submitted */
+    zip_uint64_t read_offset;  /* absolute read position */
+    zip_uint64_t read_next;    /* offset of next chunk to submit */
+    bool read_eof;             /* chunk at end of file was read, don't submit more */
+
+    /* writing, filling write_chunks[write_current], earlier chunks may still be in flight */
+    chunk_t *write_chunks;
+    zip_uint32_t write_current;
+    zip_uint64_t write_fill;   /* data in current chunk */
+    zip_uint64_t write_offset; /* absolute offset of current chunk */
+    bool write_active;         /* output position is tracked here, not by fout */
+    int write_errno;           /* first failed asynchronous write */
+};
+typedef struct async async_t;
+
+static void async_close(zip_source_file_context_t *ctx);
+static zip_int64_t async_commit_write(zip_source_file_context_t *ctx);
+#ifdef HAVE_COPY_FILE_RANGE
+static zip_int64_t async_copy_data(zip_source_file_context_t *ctx, zip_source_file_context_t *from, zip_uint64_t offset, zip_uint64_t length);
+#endif
+#ifdef CAN_WRITE_IN_PLACE
+static zip_int64_t async_create_output_in_place(zip_source_file_context_t *ctx, zip_uint64_t offset);
+#endif
+static zip_int64_t async_create_temp_output(zip_source_file_context_t *ctx);
+#ifdef CAN_CLONE
+static zip_int64_t async_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uint64_t offset);
+#endif
+static void async_free(zip_source_file_context_t *ctx);
+static bool async_open(zip_source_file_context_t *ctx);
+static zip_int64_t async_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+static zip_int64_t async_remove(zip_source_file_context_t *ctx);
+static void async_rollback_write(zip_source_file_context_t *ctx);
+static bool async_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
+static bool async_stat(zip_source_file_context_t *ctx, zip_source_file_stat_t *st);
+static char *async_string_duplicate(zip_source_file_context_t *ctx, const char *string);
+static zip_int64_t async_tell(zip_source_file_context_t *ctx, void *f);
+static zip_int64_t async_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len);
+
+static bool chunk_submit(async_t *async, chunk_t *chunk, int fd, zip_uint8_t opcode, zip_uint64_t offset, zip_uint64_t length);
+static bool chunk_wait(async_t *async, chunk_t *chunk);
+static chunk_t *chunks_new(zip_uint32_t n);
+static void chunks_free(chunk_t *chunks, zip_uint32_t n);
+static void read_reset(async_t *async, zip_uint64_t offset);
+static bool read_fill(zip_source_file_context_t *ctx, async_t *async);
+static void ring_fini(ring_t *ring);
+static bool ring_init(ring_t *ring, unsigned entries, zip_error_t *error);
+static void ring_reap(ring_t *ring);
+static void ring_release(async_t *async);
+static bool ring_start(async_t *async);
+static bool ring_submit(ring_t *ring, unsigned wait_nr);
+static bool write_flush(zip_source_file_context_t *ctx, async_t *async);
+static bool write_submit_current(zip_source_file_context_t *ctx, async_t *async);
+
+/* clang-format off */
+static zip_source_file_operations_t ops_async = {
+    async_close,
+    async_commit_write,
+#ifdef HAVE_COPY_FILE_RANGE
+    async_copy_data,
+#else
+    NULL,
+#endif
+#ifdef CAN_WRITE_IN_PLACE
+    async_create_output_in_place,
+#else
+    NULL,
+#endif
+    async_create_temp_output,
+#ifdef CAN_CLONE
+    async_create_temp_output_cloning,
+#else
+    NULL,
+#endif
+    async_free,
+    async_open,
+    NULL,
+    NULL,
+#ifdef HAVE_POSIX_FADVISE
+    _zip_stdio_op_prefetch,
+#else
+    NULL,
+#endif
+    async_read,
+    NULL, /* readers of archive entries use read position, so their data is read ahead */
+    async_remove,
+    async_rollback_write,
+    async_seek,
+    async_stat,
+    async_string_duplicate,
+    async_tell,
+    async_write,
+    NULL
+};
+/* clang-format on */
+
+#define NAMED (&_zip_source_file_stdio_named_ops)
+#endif
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_file_async(zip_t *za, const char *fname, zip_uint64_t start, zip_int64_t len, zip_uint32_t queue_depth) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_file_async_create(fname, start, len, queue_depth, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_file_async_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_uint32_t queue_depth, zip_error_t *error) {
+#ifdef HAVE_IO_URING
+    async_t *async;
+    zip_source_t *src;
+#endif
+
+    if (fname == NULL || queue_depth > ASYNC_MAX_QUEUE_DEPTH) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+#ifndef HAVE_IO_URING
+    (void)queue_depth;
+    return zip_source_file_create(fname, start, length, error);
+#else
+    if (queue_depth == 0) {
+        queue_depth = ASYNC_DEFAULT_QUEUE_DEPTH;
+    }
+
+    if ((async = (async_t *)_zip_malloc(sizeof(*async))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    async->have_ring = false;
+    async->ring_failed = false;
+    async->queue_depth = queue_depth;
+    async->read_chunks = NULL;
+    async->write_chunks = NULL;
+    async->write_current = 0;
+    async->write_fill = 0;
+    async->write_offset = 0;
+    async->write_active = false;
+    async->write_errno = 0;
+    read_reset(async, 0);
+
+    if ((src = _zip_source_file_stdio_named_create(fname, start, length, &ops_async, async, error)) == NULL) {
+        _zip_free(async);
+        return NULL;
+    }
+
+    return src;
+#endif
+}
+
+
+#ifdef HAVE_IO_URING
+static void
+async_close(zip_source_file_context_t *ctx) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    read_reset(async, 0);
+    chunks_free(async->read_chunks, async->queue_depth);
+    async->read_chunks = NULL;
+    ring_release(async);
+    NAMED->close(ctx);
+}
+
+
+static zip_int64_t
+async_commit_write(zip_source_file_context_t *ctx) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    if (!write_flush(ctx, async)) {
+        /* like a failed commit of the stdio source, close output */
+        (void)fclose((FILE *)ctx->fout);
+        return -1;
+    }
+    chunks_free(async->write_chunks, async->queue_depth);
+    async->write_chunks = NULL;
+    ring_release(async);
+    return NAMED->commit_write(ctx);
+}
+
+
+#ifdef HAVE_COPY_FILE_RANGE
+static zip_int64_t
+async_copy_data(zip_source_file_context_t *ctx, zip_source_file_context_t *from, zip_uint64_t offset, zip_uint64_t length) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    if (!write_flush(ctx, async)) {
+        return -1;
+    }
+    return NAMED->copy_data(ctx, from, offset, length);
+}
+#endif
+
+
+#ifdef CAN_WRITE_IN_PLACE
+static zip_int64_t
+async_create_output_in_place(zip_source_file_context_t *ctx, zip_uint64_t offset) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    /* input is overwritten, data read ahead may become stale */
+    read_reset(async, async->read_offset);
+    return NAMED->create_output_in_place(ctx, offset);
+}
+#endif
+
+
+static zip_int64_t
+async_create_temp_output(zip_source_file_context_t *ctx) {
+    return NAMED->create_temp_output(ctx);
+}
+
+
+#ifdef CAN_CLONE
+static zip_int64_t
+async_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uint64_t offset) {
+    return NAMED->create_temp_output_cloning(ctx, offset);
+}
+#endif
+
+
+static void
+async_free(zip_source_file_context_t *ctx) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    read_reset(async, 0);
+    if (async->write_chunks != NULL) {
+        zip_uint32_t i;
+
+        for (i = 0; i < async->queue_depth; i++) {
+            (void)chunk_wait(async, async->write_chunks + i);
+        }
+    }
+    if (async->have_ring) {
+        ring_fini(&async->ring);
+    }
+    chunks_free(async->read_chunks, async->queue_depth);
+    chunks_free(async->write_chunks, async->queue_depth);
+    _zip_free(async);
+}
+
+
+static bool
+async_open(zip_source_file_context_t *ctx) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    if (!NAMED->open(ctx)) {
+        return false;
+    }
+    read_reset(async, 0);
+    return true;
+}
+
+
+static zip_int64_t
+async_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+    zip_uint64_t total;
+
+    if (len > ZIP_INT64_MAX) {
+        len = ZIP_INT64_MAX;
+    }
+
+    if (ctx->journal == NULL && async->read_chunks == NULL) {
+        (void)ring_start(async);
+    }
+
+    if (ctx->journal != NULL || !async->have_ring) {
+        ssize_t n;
+
+        read_reset(async, async->read_offset);
+        if (len > SIZE_MAX / 2) {
+            len = SIZE_MAX / 2;
+        }
+        if ((n = pread(fileno((FILE *)ctx->f), buf, (size_t)len, (off_t)async->read_offset)) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return -1;
+        }
+        async->read_offset += (zip_uint64_t)n;
+        return (zip_int64_t)n;
+    }
+
+    if (async->read_chunks == NULL && (async->read_chunks = chunks_new(async->queue_depth)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    total = 0;
+    while (total < len) {
+        chunk_t *chunk;
+        zip_uint64_t available, n;
+
+        if (!read_fill(ctx, async)) {
+            return -1;
+        }
+        if (async->read_count == 0) {
+            /* end of file */
+            break;
+        }
+
+        chunk = async->read_chunks + async->read_head;
+        if (!chunk_wait(async, chunk)) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return -1;
+        }
+        if (chunk->result < 0) {
+            errno = (int)-chunk->result;
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return total > 0 ? (zip_int64_t)total : -1;
+        }
+        if ((zip_uint64_t)chunk->result < chunk->length) {
+            /* file ends in this chunk */
+            async->read_eof = true;
+        }
+
+        available = chunk->offset + (zip_uint64_t)chunk->result - async->read_offset;
+        n = ZIP_MIN(available, len - total);
+        (void)memcpy_s((zip_uint8_t *)buf + total, (size_t)n, chunk->data + (async->read_offset - chunk->offset), (size_t)n);
+        total += n;
+        async->read_offset += n;
+
+        if (n == available) {
+            /* chunk used up, reuse it for the next one */
+            async->read_head = (async->read_head + 1) % async->queue_depth;
+            async->read_count--;
+            if (async->read_eof) {
+                if (async->read_count > 0) {
+                    /* chunks past the end of file */
+                    read_reset(async, async->read_offset);
+                    async->read_eof = true;
+                }
+                break;
+            }
+        }
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+static zip_int64_t
+async_remove(zip_source_file_context_t *ctx) {
+    return NAMED->remove(ctx);
+}
+
+
+static void
+async_rollback_write(zip_source_file_context_t *ctx) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    if (async->write_chunks != NULL) {
+        zip_uint32_t i;
+
+        for (i = 0; i < async->queue_depth; i++) {
+            (void)chunk_wait(async, async->write_chunks + i);
+        }
+    }
+    chunks_free(async->write_chunks, async->queue_depth);
+    async->write_chunks = NULL;
+    async->write_active = false;
+    async->write_errno = 0;
+    ring_release(async);
+    NAMED->rollback_write(ctx);
+}
+
+
+static bool
+async_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+    zip_int64_t new_offset;
+
+    if (f == ctx->fout) {
+        if (!write_flush(ctx, async)) {
+            return false;
+        }
+        return NAMED->seek(ctx, f, offset, whence);
+    }
+
+    switch (whence) {
+    case SEEK_SET:
+        new_offset = offset;
+        break;
+
+    case SEEK_CUR:
+        if (offset > 0 && (zip_uint64_t)offset > ZIP_INT64_MAX - async->read_offset) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EOVERFLOW);
+            return false;
+        }
+        new_offset = (zip_int64_t)async->read_offset + offset;
+        break;
+
+    case SEEK_END: {
+        struct stat sb;
+
+        if (fstat(fileno((FILE *)f), &sb) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+            return false;
+        }
+        if (offset > 0 && (zip_uint64_t)offset > ZIP_INT64_MAX - (zip_uint64_t)sb.st_size) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EOVERFLOW);
+            return false;
+        }
+        new_offset = (zip_int64_t)sb.st_size + offset;
+        break;
+    }
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    if (new_offset < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, EINVAL);
+        return false;
+    }
+
+    if ((zip_uint64_t)new_offset != async->read_offset) {
+        read_reset(async, (zip_uint64_t)new_offset);
+    }
+    return true;
+}
+
+
+static bool
+async_stat(zip_source_file_context_t *ctx, zip_source_file_stat_t *st) {
+    return NAMED->stat(ctx, st);
+}
+
+
+static char *
+async_string_duplicate(zip_source_file_context_t *ctx, const char *string) {
+    return NAMED->string_duplicate(ctx, string);
+}
+
+
+static zip_int64_t
+async_tell(zip_source_file_context_t *ctx, void *f) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+
+    if (f == ctx->fout) {
+        if (async->write_active) {
+            return (zip_int64_t)(async->write_offset + async->write_fill);
+        }
+        return NAMED->tell(ctx, f);
+    }
+
+    return (zip_int64_t)async->read_offset;
+}
+
+
+static zip_int64_t
+async_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len) {
+    async_t *async = (async_t *)ctx->ops_userdata;
+    zip_uint64_t total;
+
+    if (ctx->journal != NULL || (async->write_chunks == NULL && !ring_start(async))) {
+        return NAMED->write(ctx, data, len);
+    }
+
+    if (async->write_chunks == NULL && (async->write_chunks = chunks_new(async->queue_depth)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    if (!async->write_active) {
+        off_t offset;
+
+        /* take over output position from stdio */
+        if (fflush((FILE *)ctx->fout) != 0 || (offset = ftello((FILE *)ctx->fout)) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return -1;
+        }
+        async->write_offset = (zip_uint64_t)offset;
+        async->write_fill = 0;
+        async->write_active = true;
+    }
+
+    if (async->write_errno != 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, async->write_errno);
+        return -1;
+    }
+
+    total = 0;
+    while (total < len) {
+        chunk_t *chunk = async->write_chunks + async->write_current;
+        zip_uint64_t n = ZIP_MIN(len - total, ASYNC_CHUNK_SIZE - async->write_fill);
+
+        (void)memcpy_s(chunk->data + async->write_fill, (size_t)n, (const zip_uint8_t *)data + total, (size_t)n);
+        async->write_fill += n;
+        total += n;
+
+        if (async->write_fill == ASYNC_CHUNK_SIZE && !write_submit_current(ctx, async)) {
+            return -1;
+        }
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+/* Queue read or write of chunk, submitting it with other queued requests when the kernel next is entered. */
+static bool
+chunk_submit(async_t *async, chunk_t *chunk, int fd, zip_uint8_t opcode, zip_uint64_t offset, zip_uint64_t length) {
+    ring_t *ring = &async->ring;
+    unsigned tail = *ring->sq_tail;
+    unsigned index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > *ring->sq_mask) {
+        /* can't happen, ring has room for all chunks */
+        errno = EBUSY;
+        return false;
+    }
+
+    index = tail & *ring->sq_mask;
+    sqe = ring->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = (zip_uint64_t)(uintptr_t)chunk->data;
+    sqe->len = (zip_uint32_t)length;
+    sqe->user_data = (zip_uint64_t)(uintptr_t)chunk;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+
+    chunk->offset = offset;
+    chunk->length = length;
+    chunk->in_flight = true;
+    chunk->done = false;
+
+    return true;
+}
+
+
+/* Wait until chunk is done, submitting queued requests. Returns false with errno set if the ring fails. */
+static bool
+chunk_wait(async_t *async, chunk_t *chunk) {
+    if (!chunk->in_flight) {
+        return true;
+    }
+
+    for (;;) {
+        ring_reap(&async->ring);
+        if (chunk->done) {
+            chunk->in_flight = false;
+            return true;
+        }
+        if (!ring_submit(&async->ring, 1)) {
+            return false;
+        }
+    }
+}
+
+
+static chunk_t *
+chunks_new(zip_uint32_t n) {
+    chunk_t *chunks;
+    zip_uint32_t i;
+
+    if ((chunks = (chunk_t *)_zip_calloc(n, sizeof(*chunks))) == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        if ((chunks[i].data = (zip_uint8_t *)_zip_malloc(ASYNC_CHUNK_SIZE)) == NULL) {
+            chunks_free(chunks, i);
+            return NULL;
+        }
+    }
+
+    return chunks;
+}
+
+
+static void
+chunks_free(chunk_t *chunks, zip_uint32_t n) {
+    zip_uint32_t i;
+
+    if (chunks == NULL) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        _zip_free(chunks[i].data);
+    }
+    _zip_free(chunks);
+}
+
+
+/* Wait for reads in flight and discard data read ahead, continue reading at offset. */
+static void
+read_reset(async_t *async, zip_uint64_t offset) {
+    if (async->read_chunks != NULL) {
+        zip_uint32_t i;
+
+        for (i = 0; i < async->queue_depth; i++) {
+            (void)chunk_wait(async, async->read_chunks + i);
+        }
+    }
+    async->read_head = 0;
+    async->read_count = 0;
+    async->read_offset = offset;
+    async->read_next = offset;
+    async->read_eof = false;
+}
+
+
+/* Submit reads for all free chunks, up to the end of the data of the source. */
+static bool
+read_fill(zip_source_file_context_t *ctx, async_t *async) {
+    zip_uint64_t end = ctx->len > 0 ? ctx->start + ctx->len : ZIP_UINT64_MAX;
+    bool queued = false;
+
+    while (!async->read_eof && async->read_count < async->queue_depth && async->read_next < end) {
+        chunk_t *chunk = async->read_chunks + (async->read_head + async->read_count) % async->queue_depth;
+        zip_uint64_t length = ZIP_MIN(ASYNC_CHUNK_SIZE - async->read_next % ASYNC_CHUNK_SIZE, end - async->read_next);
+
+        /* chunk may still be in flight after an error */
+        if (!chunk_wait(async, chunk) || !chunk_submit(async, chunk, fileno((FILE *)ctx->f), IORING_OP_READ, async->read_next, length)) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return false;
+        }
+        async->read_next += length;
+        async->read_count++;
+        queued = true;
+    }
+
+    if (queued && !ring_submit(&async->ring, 0)) {
+        zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+static void
+ring_fini(ring_t *ring) {
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map != NULL) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    close(ring->fd);
+}
+
+
+static bool
+ring_init(ring_t *ring, unsigned entries, zip_error_t *error) {
+    struct io_uring_params params;
+    zip_uint8_t *sq, *cq;
+
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    if ((ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+        zip_error_set(error, ZIP_ER_OPNOTSUPP, errno);
+        return false;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_map_size = ring->cq_map_size = ZIP_MAX(ring->sq_map_size, ring->cq_map_size);
+    }
+
+    if ((ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+        ring->sq_map = NULL;
+        zip_error_set(error, ZIP_ER_MEMORY, errno);
+        ring_fini(ring);
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    }
+    else if ((ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+        ring->cq_map = NULL;
+        zip_error_set(error, ZIP_ER_MEMORY, errno);
+        ring_fini(ring);
+        return false;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if ((ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES)) == MAP_FAILED) {
+        ring->sqes = NULL;
+        zip_error_set(error, ZIP_ER_MEMORY, errno);
+        ring_fini(ring);
+        return false;
+    }
+
+    sq = (zip_uint8_t *)ring->sq_map;
+    cq = (zip_uint8_t *)ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+
+/* Record results of completed requests in their chunks. */
+static void
+ring_reap(ring_t *ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = ring->cqes + (head & *ring->cq_mask);
+        chunk_t *chunk = (chunk_t *)(uintptr_t)cqe->user_data;
+
+        chunk->result = cqe->res;
+        chunk->done = true;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+/* Tear down ring once neither reading nor writing uses it. */
+static void
+ring_release(async_t *async) {
+    if (async->read_chunks != NULL || async->write_chunks != NULL) {
+        return;
+    }
+    if (async->have_ring) {
+        ring_fini(&async->ring);
+        async->have_ring = false;
+    }
+    async->ring_failed = false;
+}
+
+
+/* Set up ring if needed. Returns false if io_uring can't be used, e.g. kernel too old, io_uring disabled, or out of file descriptors. */
+static bool
+ring_start(async_t *async) {
+    zip_error_t error;
+
+    if (async->have_ring || async->ring_failed) {
+        return async->have_ring;
+    }
+
+    /* reads and writes can be in flight at the same time */
+    zip_error_init(&error);
+    if (ring_init(&async->ring, 2 * async->queue_depth, &error)) {
+        async->have_ring = true;
+    }
+    else {
+        async->ring_failed = true;
+    }
+    zip_error_fini(&error);
+
+    return async->have_ring;
+}
+
+
+/* Submit queued requests and wait for wait_nr of them to complete. */
+static bool
+ring_submit(ring_t *ring, unsigned wait_nr) {
+    for (;;) {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+        if (ret >= 0) {
+            ring->unsubmitted -= ZIP_MIN((unsigned)ret, ring->unsubmitted);
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+
+/* Wait for all writes and hand output position back to stdio. */
+static bool
+write_flush(zip_source_file_context_t *ctx, async_t *async) {
+    zip_uint32_t i;
+
+    if (!async->write_active) {
+        return true;
+    }
+
+    if (async->write_fill > 0 && !write_submit_current(ctx, async)) {
+        return false;
+    }
+    for (i = 0; i < async->queue_depth; i++) {
+        chunk_t *chunk = async->write_chunks + i;
+
+        if (!chunk_wait(async, chunk)) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return false;
+        }
+    }
+    /* write_submit_current checked all chunks but the ones just waited for */
+    for (i = 0; i < async->queue_depth; i++) {
+        chunk_t *chunk = async->write_chunks + i;
+
+        if (chunk->length > 0 && chunk->result != (zip_int64_t)chunk->length && async->write_errno == 0) {
+            async->write_errno = chunk->result < 0 ? (int)-chunk->result : ENOSPC;
+        }
+        chunk->length = 0;
+    }
+
+    async->write_active = false;
+    if (async->write_errno != 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, async->write_errno);
+        return false;
+    }
+    if (fseeko((FILE *)ctx->fout, (off_t)async->write_offset, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Start writing current chunk, make next chunk current once it is done. */
+static bool
+write_submit_current(zip_source_file_context_t *ctx, async_t *async) {
+    chunk_t *chunk = async->write_chunks + async->write_current;
+
+    if (!chunk_submit(async, chunk, fileno((FILE *)ctx->fout), IORING_OP_WRITE, async->write_offset, async->write_fill) || !ring_submit(&async->ring, 0)) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+    async->write_offset += async->write_fill;
+    async->write_fill = 0;
+    async->write_current = (async->write_current + 1) % async->queue_depth;
+
+    chunk = async->write_chunks + async->write_current;
+    if (!chunk_wait(async, chunk)) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+    if (chunk->length > 0) {
+        if (chunk->result != (zip_int64_t)chunk->length) {
+            /* short writes to regular files only happen on errors like a full disk */
+            async->write_errno = chunk->result < 0 ? (int)-chunk->result : ENOSPC;
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, async->write_errno);
+            return false;
+        }
+        chunk->length = 0;
+    }
+
+    return true;
+}
+#endif
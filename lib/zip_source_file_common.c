@@ -39,7 +39,10 @@
 
 #include "zip_source_file.h"
 
+static zip_int64_t file_read_at(zip_source_file_context_t *ctx, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error);
+static bool preload(zip_source_file_context_t *ctx);
 static zip_int64_t read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd);
+static void update_after_commit(zip_source_file_context_t *ctx);
 
 static void
 zip_source_file_stat_init(zip_source_file_stat_t *st) {
@@ -98,7 +101,7 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
         return NULL;
     }
 
-    if ((ctx = (zip_source_file_context_t *)malloc(sizeof(zip_source_file_context_t))) == NULL) {
+    if ((ctx = (zip_source_file_context_t *)_zip_malloc(sizeof(zip_source_file_context_t))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -109,7 +112,7 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
     if (fname) {
         if ((ctx->fname = ops->string_duplicate(ctx, fname)) == NULL) {
             zip_error_set(error, ZIP_ER_MEMORY, 0);
-            free(ctx);
+            _zip_free(ctx);
             return NULL;
         }
     }
@@ -132,19 +135,28 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
 
     zip_error_init(&ctx->stat_error);
 
+    ctx->preload_limit = 0;
+    ctx->preload = NULL;
+    ctx->preload_length = 0;
+
     ctx->tmpname = NULL;
     ctx->fout = NULL;
+    ctx->journal = NULL;
+    ctx->journal_patches = NULL;
+    ctx->preallocated = false;
+    ctx->output_name = NULL;
 
     zip_error_init(&ctx->error);
     zip_file_attributes_init(&ctx->attributes);
 
-    ctx->supports = ZIP_SOURCE_SUPPORTS_READABLE | zip_source_make_command_bitmap(ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
+    /* data of pipes and devices can only be read once, so it is streamed and can't be read again */
+    ctx->supports = ZIP_SOURCE_SUPPORTS_READABLE | zip_source_make_command_bitmap(ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_TELL, -1);
 
     zip_source_file_stat_init(&sb);
     if (!ops->stat(ctx, &sb)) {
         _zip_error_copy(error, &ctx->error);
-        free(ctx->fname);
-        free(ctx);
+        _zip_free(ctx->fname);
+        _zip_free(ctx);
         return NULL;
     }
 
@@ -156,8 +168,8 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
         }
         else {
             zip_error_set(&ctx->stat_error, ZIP_ER_READ, ENOENT);
-            free(ctx->fname);
-            free(ctx);
+            _zip_free(ctx->fname);
+            _zip_free(ctx);
             return NULL;
         }
     }
@@ -171,8 +183,8 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
 
             if (ctx->start + ctx->len > sb.size) {
                 zip_error_set(error, ZIP_ER_INVAL, 0);
-                free(ctx->fname);
-                free(ctx);
+                _zip_free(ctx->fname);
+                _zip_free(ctx);
                 return NULL;
             }
 
@@ -199,10 +211,22 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
             ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE_CLONING);
         }
     }
+    if (ops->create_output_in_place != NULL && (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE))) {
+        ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE_IN_PLACE);
+    }
+    if (ops->copy_data != NULL && (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE)) && (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK))) {
+        ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_COPY_DATA);
+    }
+    if (ops->read_at != NULL && (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK))) {
+        ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_READ_AT);
+    }
+    if (ops->writev != NULL && (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_WRITE))) {
+        ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_WRITEV);
+    }
 
     if ((zs = zip_source_function_create(read_file, ctx, error)) == NULL) {
-        free(ctx->fname);
-        free(ctx);
+        _zip_free(ctx->fname);
+        _zip_free(ctx);
         return NULL;
     }
 
@@ -210,6 +234,185 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
 }
 
 
+/* Copy up to length bytes at offset of file source src to the write position of file source dst without passing them
+   through a buffer. Returns the number of bytes copied, 0 if it can't be done for these sources, -1 on error (set in dst). */
+zip_int64_t
+_zip_source_file_copy_data_from(zip_source_t *dst, zip_source_t *src, zip_uint64_t offset, zip_uint64_t length) {
+    zip_source_file_context_t *ctx, *from;
+    zip_int64_t n;
+
+    if (dst->src != NULL || dst->cb.f != read_file || src->src != NULL || src->cb.f != read_file) {
+        return 0;
+    }
+
+    ctx = (zip_source_file_context_t *)dst->ud;
+    from = (zip_source_file_context_t *)src->ud;
+    if (from->ops != ctx->ops || (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_COPY_DATA)) == 0 || ctx->fout == NULL || from->f == NULL) {
+        return 0;
+    }
+    if (from->len > 0) {
+        if (offset >= from->len) {
+            return 0;
+        }
+        length = ZIP_MIN(length, from->len - offset);
+    }
+    if (from->start + offset < from->start) {
+        return 0;
+    }
+
+    if ((n = ctx->ops->copy_data(ctx, from, from->start + offset, length)) < 0) {
+        _zip_error_copy(&dst->error, &ctx->error);
+        return -1;
+    }
+
+    return n;
+}
+
+
+/* Tell the operating system that length bytes at offset of src will be read soon, if src is a file source open for reading.
+   Can be called from multiple threads while src stays open. */
+void
+_zip_source_file_prefetch(zip_source_t *src, zip_uint64_t offset, zip_uint64_t length) {
+    zip_source_file_context_t *ctx;
+
+    if (src->src != NULL || src->cb.f != read_file || !ZIP_SOURCE_IS_OPEN_READING(src)) {
+        return;
+    }
+
+    ctx = (zip_source_file_context_t *)src->ud;
+    if (ctx->ops->prefetch == NULL || ctx->f == NULL) {
+        return;
+    }
+    if (ctx->len > 0) {
+        if (offset >= ctx->len) {
+            return;
+        }
+        length = ZIP_MIN(length, ctx->len - offset);
+    }
+    if (ctx->start + offset < ctx->start) {
+        return;
+    }
+
+    ctx->ops->prefetch(ctx, ctx->start + offset, length);
+}
+
+
+/* Tell file source src that about length bytes will be written at offset, if it is open for writing. Only a hint. */
+void
+_zip_source_file_preallocate(zip_source_t *src, zip_uint64_t offset, zip_uint64_t length) {
+    zip_source_file_context_t *ctx;
+
+    if (src->src != NULL || src->cb.f != read_file || !ZIP_SOURCE_IS_OPEN_WRITING(src) || length == 0) {
+        return;
+    }
+
+    ctx = (zip_source_file_context_t *)src->ud;
+    if (ctx->ops->preallocate == NULL || ctx->fout == NULL) {
+        return;
+    }
+
+    ctx->ops->preallocate(ctx, offset, length);
+}
+
+
+/* Name of file source src, NULL if it is not a file source or has no name. */
+const char *
+_zip_source_file_name(zip_source_t *src) {
+    if (src->src != NULL || src->cb.f != read_file) {
+        return NULL;
+    }
+
+    return ((zip_source_file_context_t *)src->ud)->fname;
+}
+
+
+/* Make file source src write to file name instead of a temporary file, which is kept on rollback so writing can be
+   continued; name NULL restores temporary files. Returns false if src doesn't support this. Takes effect the next
+   time writing begins. */
+bool
+_zip_source_file_set_output(zip_source_t *src, const char *name) {
+    zip_source_file_context_t *ctx;
+    char *copy;
+
+    if (src->src != NULL || src->cb.f != read_file) {
+        return false;
+    }
+
+    ctx = (zip_source_file_context_t *)src->ud;
+    if (ctx->fname == NULL || ctx->ops->open_output == NULL || ZIP_SOURCE_IS_OPEN_WRITING(src)) {
+        return false;
+    }
+
+    copy = NULL;
+    if (name != NULL && (copy = ctx->ops->string_duplicate(ctx, name)) == NULL) {
+        return false;
+    }
+    _zip_free(ctx->output_name);
+    ctx->output_name = copy;
+
+    return true;
+}
+
+
+/* Read data of file source src into memory when it is opened, if it is at most limit bytes long. Writing is not affected.
+   Takes effect the next time src is opened. */
+void
+_zip_source_file_set_preload(zip_source_t *src, zip_uint64_t limit) {
+    if (src->src != NULL || src->cb.f != read_file) {
+        return;
+    }
+
+    ((zip_source_file_context_t *)src->ud)->preload_limit = limit;
+}
+
+
+/* Whether data of src can be read with _zip_source_file_read_at. */
+bool
+_zip_source_file_supports_read_at(zip_source_t *src) {
+    zip_source_file_context_t *ctx;
+
+    if (src->src != NULL || src->cb.f != read_file || !ZIP_SOURCE_IS_OPEN_READING(src)) {
+        return false;
+    }
+
+    ctx = (zip_source_file_context_t *)src->ud;
+    return (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_READ_AT)) && ctx->f != NULL;
+}
+
+
+/* Read from file source src at offset, without changing its read position.
+   Can be called from multiple threads while src stays open. */
+zip_int64_t
+_zip_source_file_read_at(zip_source_t *src, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error) {
+    return file_read_at((zip_source_file_context_t *)src->ud, offset, data, length, error);
+}
+
+
+static zip_int64_t
+file_read_at(zip_source_file_context_t *ctx, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error) {
+    if (ctx->len > 0) {
+        if (offset >= ctx->len) {
+            return 0;
+        }
+        length = ZIP_MIN(length, ctx->len - offset);
+    }
+    if (ctx->preload != NULL) {
+        if (offset >= ctx->preload_length) {
+            return 0;
+        }
+        length = ZIP_MIN(length, ctx->preload_length - offset);
+        (void)memcpy_s(data, (size_t)length, ctx->preload + offset, (size_t)length);
+        return (zip_int64_t)length;
+    }
+    if (ctx->start + offset < ctx->start) {
+        zip_error_set(error, ZIP_ER_SEEK, EOVERFLOW);
+        return -1;
+    }
+
+    return ctx->ops->read_at(ctx, data, length, ctx->start + offset, error);
+}
+
+
 static zip_int64_t
 read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     zip_source_file_context_t *ctx;
@@ -228,6 +431,9 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
             zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
             return -1;
         }
+        if (ctx->output_name != NULL) {
+            return ctx->ops->open_output(ctx);
+        }
         return ctx->ops->create_temp_output(ctx);
 
     case ZIP_SOURCE_BEGIN_WRITE_CLONING:
@@ -238,7 +444,17 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         }
         return ctx->ops->create_temp_output_cloning(ctx, len);
 
+    case ZIP_SOURCE_BEGIN_WRITE_IN_PLACE:
+        /* write support should not be set if fname is NULL */
+        if (ctx->fname == NULL) {
+            zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+            return -1;
+        }
+        return ctx->ops->create_output_in_place(ctx, len);
+
     case ZIP_SOURCE_CLOSE:
+        _zip_free(ctx->preload);
+        ctx->preload = NULL;
         if (ctx->fname) {
             ctx->ops->close(ctx);
             ctx->f = NULL;
@@ -248,23 +464,49 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     case ZIP_SOURCE_COMMIT_WRITE: {
         zip_int64_t ret = ctx->ops->commit_write(ctx);
         ctx->fout = NULL;
+        ctx->preallocated = false;
         if (ret == 0) {
-            free(ctx->tmpname);
+            _zip_free(ctx->tmpname);
             ctx->tmpname = NULL;
+            update_after_commit(ctx);
         }
         return ret;
     }
 
+    case ZIP_SOURCE_COPY_DATA: {
+        zip_int64_t i;
+        zip_uint64_t n;
+
+        if (ctx->len > 0) {
+            n = ZIP_MIN(ctx->len - ctx->offset, len);
+        }
+        else {
+            n = len;
+        }
+
+        if ((i = ctx->ops->copy_data(ctx, ctx, ctx->start + ctx->offset, n)) < 0) {
+            return -1;
+        }
+        ctx->offset += (zip_uint64_t)i;
+
+        return i;
+    }
+
     case ZIP_SOURCE_ERROR:
         return zip_error_to_data(&ctx->error, data, len);
 
     case ZIP_SOURCE_FREE:
-        free(ctx->fname);
-        free(ctx->tmpname);
+        _zip_free(ctx->preload);
+        _zip_free(ctx->fname);
+        _zip_free(ctx->tmpname);
+        _zip_free(ctx->output_name);
         if (ctx->f) {
             ctx->ops->close(ctx);
         }
-        free(ctx);
+        if (ctx->ops->free != NULL) {
+            ctx->ops->free(ctx);
+        }
+        _zip_free(ctx);
         return 0;
 
     case ZIP_SOURCE_GET_FILE_ATTRIBUTES:
@@ -289,6 +531,13 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
             }
         }
         ctx->offset = 0;
+        if (ctx->preload_limit > 0 && !preload(ctx)) {
+            if (ctx->fname) {
+                ctx->ops->close(ctx);
+                ctx->f = NULL;
+            }
+            return -1;
+        }
         return 0;
 
     case ZIP_SOURCE_READ: {
@@ -302,8 +551,19 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
             n = len;
         }
 
+        if (ctx->preload != NULL) {
+            if (ctx->offset >= ctx->preload_length) {
+                return 0;
+            }
+            n = ZIP_MIN(n, ctx->preload_length - ctx->offset);
+            (void)memcpy_s(buf, (size_t)n, ctx->preload + ctx->offset, (size_t)n);
+            ctx->offset += n;
+            return (zip_int64_t)n;
+        }
+
         if ((i = ctx->ops->read(ctx, buf, n)) < 0) {
-            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            /* non-blocking file descriptor without data available yet */
+            zip_error_set(&ctx->error, errno == EAGAIN ? ZIP_ER_AGAIN : ZIP_ER_READ, errno);
             return -1;
         }
         ctx->offset += (zip_uint64_t)i;
@@ -311,13 +571,23 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
         return i;
     }
 
+    case ZIP_SOURCE_READ_AT: {
+        zip_source_args_read_at_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_read_at_t, data, len, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        return file_read_at(ctx, args->offset, args->data, args->length, &ctx->error);
+    }
+
     case ZIP_SOURCE_REMOVE:
         return ctx->ops->remove(ctx);
 
     case ZIP_SOURCE_ROLLBACK_WRITE:
         ctx->ops->rollback_write(ctx);
         ctx->fout = NULL;
-        free(ctx->tmpname);
+        ctx->preallocated = false;
+        _zip_free(ctx->tmpname);
         ctx->tmpname = NULL;
         return 0;
 
@@ -336,7 +606,7 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
 
         ctx->offset = (zip_uint64_t)new_offset;
 
-        if (ctx->ops->seek(ctx, ctx->f, (zip_int64_t)(ctx->offset + ctx->start), SEEK_SET) == false) {
+        if (ctx->preload == NULL && ctx->ops->seek(ctx, ctx->f, (zip_int64_t)(ctx->offset + ctx->start), SEEK_SET) == false) {
             return -1;
         }
         return 0;
@@ -381,8 +651,83 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     case ZIP_SOURCE_WRITE:
         return ctx->ops->write(ctx, data, len);
 
+    case ZIP_SOURCE_WRITEV: {
+        zip_source_args_writev_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_writev_t, data, len, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        return ctx->ops->writev(ctx, args->fragments, args->nfragments);
+    }
+
     default:
         zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
         return -1;
     }
 }
+
+
+/* Update size and modification time from the file just written, so reopening the source reads all of it. */
+/* Read data into memory if it is short enough, so reading, seeking, and reading at an offset don't access the file.
+   Data written later, e.g. with copy_data or in place, still goes to and comes from the file. */
+static bool
+preload(zip_source_file_context_t *ctx) {
+    zip_source_file_stat_t sb;
+    zip_uint64_t length;
+
+    zip_source_file_stat_init(&sb);
+    if (!ctx->ops->stat(ctx, &sb) || !sb.exists || !sb.regular_file || sb.size < ctx->start) {
+        /* not preloaded, read from file */
+        return true;
+    }
+    length = sb.size - ctx->start;
+    if (ctx->len > 0) {
+        length = ZIP_MIN(length, ctx->len);
+    }
+    if (length > ctx->preload_limit || length > SIZE_MAX) {
+        return true;
+    }
+
+    if ((ctx->preload = (zip_uint8_t *)_zip_malloc(length > 0 ? (size_t)length : 1)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    _zip_advise_huge_pages(ctx->preload, length);
+    ctx->preload_length = 0;
+    while (ctx->preload_length < length) {
+        zip_int64_t n;
+
+        if ((n = ctx->ops->read(ctx, ctx->preload + ctx->preload_length, length - ctx->preload_length)) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            _zip_free(ctx->preload);
+            ctx->preload = NULL;
+            return false;
+        }
+        if (n == 0) {
+            /* file got shorter */
+            break;
+        }
+        ctx->preload_length += (zip_uint64_t)n;
+    }
+
+    return true;
+}
+
+
+static void
+update_after_commit(zip_source_file_context_t *ctx) {
+    zip_source_file_stat_t sb;
+
+    zip_source_file_stat_init(&sb);
+    if (!ctx->ops->stat(ctx, &sb) || !sb.exists) {
+        return;
+    }
+
+    ctx->len = sb.size;
+    ctx->st.size = sb.size;
+    ctx->st.mtime = sb.mtime;
+    ctx->st.valid |= ZIP_STAT_SIZE | ZIP_STAT_MTIME;
+    ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_GET_FILE_ATTRIBUTES);
+    /* file exists now */
+    zip_error_init(&ctx->stat_error);
+}
@@ -0,0 +1,631 @@
+/*
+  zip_source_file_direct.c -- source for file opened by name, bypassing the page cache
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* for O_DIRECT */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "zipint.h"
+
+#ifdef HAVE_PREAD
+#include "zip_source_file.h"
+#include "zip_source_file_stdio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Input and output are accessed through a window of DIRECT_WINDOW_SIZE bytes each, starting at an offset aligned to
+   DIRECT_ALIGNMENT, with pread and pwrite of whole aligned blocks on file descriptors that bypass the page cache
+   (O_DIRECT, or F_NOCACHE on macOS).
+
+   Sequential reads are answered from the input window. Written data is copied into the output window, which is written
+   when data outside of it is written or the output is committed. Rewriting a local header
+   in data already written reads the blocks around it back into the window first. The last block is written padded,
+   the output is cut to its real size on commit.
+
+   If the file system doesn't support bypassing the page cache, the same windows are used with buffered I/O, and the
+   kernel is told that the data is not needed anymore after each window is read or written. Cloning, writing in place,
+   and copying data between files are not offered, since they would go through the page cache. */
+
+#define DIRECT_ALIGNMENT 4096
+#define DIRECT_WINDOW_SIZE (1024 * 1024)
+
+struct window {
+    zip_uint8_t *data;   /* DIRECT_WINDOW_SIZE bytes aligned to DIRECT_ALIGNMENT, allocated when first used */
+    zip_uint64_t offset; /* of data in file, aligned to DIRECT_ALIGNMENT */
+    zip_uint64_t length; /* valid data */
+    bool uncached;       /* file descriptor bypasses page cache */
+};
+typedef struct window window_t;
+
+struct direct {
+    window_t read;
+    zip_uint64_t read_offset; /* absolute read position */
+
+    window_t write;
+    zip_uint64_t write_offset; /* absolute output position */
+    zip_uint64_t write_size;   /* size of output */
+    bool write_dirty;          /* window has data not yet written */
+};
+typedef struct direct direct_t;
+
+static void direct_close(zip_source_file_context_t *ctx);
+static zip_int64_t direct_commit_write(zip_source_file_context_t *ctx);
+static zip_int64_t direct_create_temp_output(zip_source_file_context_t *ctx);
+static void direct_free(zip_source_file_context_t *ctx);
+static bool direct_open(zip_source_file_context_t *ctx);
+static zip_int64_t direct_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+static zip_int64_t direct_remove(zip_source_file_context_t *ctx);
+static void direct_rollback_write(zip_source_file_context_t *ctx);
+static bool direct_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
+static char *direct_string_duplicate(zip_source_file_context_t *ctx, const char *string);
+static zip_int64_t direct_tell(zip_source_file_context_t *ctx, void *f);
+static zip_int64_t direct_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len);
+
+static bool set_uncached(int fd, bool uncached);
+static bool window_alloc(window_t *window, zip_error_t *error);
+static void window_fini(window_t *window);
+static void window_init(window_t *window, int fd);
+static bool window_read(window_t *window, int fd, zip_uint64_t offset, zip_error_t *error);
+static bool window_write(window_t *window, int fd, zip_error_t *error);
+static bool write_flush(zip_source_file_context_t *ctx, direct_t *direct);
+static bool write_move(zip_source_file_context_t *ctx, direct_t *direct, zip_uint64_t offset);
+
+/* clang-format off */
+static zip_source_file_operations_t ops_direct = {
+    direct_close,
+    direct_commit_write,
+    NULL,
+    NULL,
+    direct_create_temp_output,
+    NULL,
+    direct_free,
+    direct_open,
+    NULL,
+    NULL,
+    NULL,
+    direct_read,
+    NULL, /* readers of archive entries use read position, so their data is read through the window */
+    direct_remove,
+    direct_rollback_write,
+    direct_seek,
+    _zip_stdio_op_stat,
+    direct_string_duplicate,
+    direct_tell,
+    direct_write,
+    NULL
+};
+/* clang-format on */
+
+#define NAMED (&_zip_source_file_stdio_named_ops)
+#endif
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_file_direct(zip_t *za, const char *fname, zip_uint64_t start, zip_int64_t len) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_file_direct_create(fname, start, len, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_file_direct_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_error_t *error) {
+#ifdef HAVE_PREAD
+    direct_t *direct;
+    zip_source_t *src;
+#endif
+
+    if (fname == NULL) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+#ifndef HAVE_PREAD
+    return zip_source_file_create(fname, start, length, error);
+#else
+    if ((direct = (direct_t *)_zip_malloc(sizeof(*direct))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    direct->read.data = NULL;
+    window_init(&direct->read, -1);
+    direct->read_offset = 0;
+    direct->write.data = NULL;
+    window_init(&direct->write, -1);
+    direct->write_offset = 0;
+    direct->write_size = 0;
+    direct->write_dirty = false;
+
+    if ((src = _zip_source_file_stdio_named_create(fname, start, length, &ops_direct, direct, error)) == NULL) {
+        _zip_free(direct);
+        return NULL;
+    }
+
+    return src;
+#endif
+}
+
+
+#ifdef HAVE_PREAD
+static void
+direct_close(zip_source_file_context_t *ctx) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+
+    window_fini(&direct->read);
+    NAMED->close(ctx);
+}
+
+
+static zip_int64_t
+direct_commit_write(zip_source_file_context_t *ctx) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+    int fd = fileno((FILE *)ctx->fout);
+
+    if (!write_flush(ctx, direct)) {
+        /* like a failed commit of the stdio source, close output */
+        (void)fclose((FILE *)ctx->fout);
+        window_fini(&direct->write);
+        return -1;
+    }
+    window_fini(&direct->write);
+
+    /* cut off padding of last block and hand output position back to stdio */
+    if (ftruncate(fd, (off_t)direct->write_size) < 0 || fseeko((FILE *)ctx->fout, (off_t)direct->write_size, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        (void)fclose((FILE *)ctx->fout);
+        return -1;
+    }
+    return NAMED->commit_write(ctx);
+}
+
+
+static zip_int64_t
+direct_create_temp_output(zip_source_file_context_t *ctx) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+
+    if (NAMED->create_temp_output(ctx) < 0) {
+        return -1;
+    }
+
+    window_init(&direct->write, fileno((FILE *)ctx->fout));
+    direct->write_offset = 0;
+    direct->write_size = 0;
+    direct->write_dirty = false;
+    return 0;
+}
+
+
+static void
+direct_free(zip_source_file_context_t *ctx) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+
+    window_fini(&direct->read);
+    window_fini(&direct->write);
+    _zip_free(direct);
+}
+
+
+static bool
+direct_open(zip_source_file_context_t *ctx) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+
+    if (!NAMED->open(ctx)) {
+        return false;
+    }
+    window_init(&direct->read, fileno((FILE *)ctx->f));
+    direct->read_offset = 0;
+    return true;
+}
+
+
+static zip_int64_t
+direct_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+    window_t *window = &direct->read;
+    zip_uint64_t total;
+
+    if (len > ZIP_INT64_MAX) {
+        len = ZIP_INT64_MAX;
+    }
+
+    total = 0;
+    while (total < len) {
+        zip_uint64_t n;
+
+        if (window->data == NULL || direct->read_offset < window->offset || direct->read_offset - window->offset >= window->length) {
+            if (!window_read(window, fileno((FILE *)ctx->f), direct->read_offset, &ctx->error)) {
+                return -1;
+            }
+            if (direct->read_offset - window->offset >= window->length) {
+                /* end of file */
+                break;
+            }
+        }
+
+        n = ZIP_MIN(len - total, window->length - (direct->read_offset - window->offset));
+        (void)memcpy_s((zip_uint8_t *)buf + total, (size_t)n, window->data + (direct->read_offset - window->offset), (size_t)n);
+        direct->read_offset += n;
+        total += n;
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+static zip_int64_t
+direct_remove(zip_source_file_context_t *ctx) {
+    return NAMED->remove(ctx);
+}
+
+
+static void
+direct_rollback_write(zip_source_file_context_t *ctx) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+
+    window_fini(&direct->write);
+    direct->write_dirty = false;
+    NAMED->rollback_write(ctx);
+}
+
+
+static bool
+direct_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+    zip_uint64_t *position, size;
+    zip_int64_t new_offset;
+
+    if (f == ctx->fout) {
+        position = &direct->write_offset;
+        size = direct->write_size;
+    }
+    else {
+        struct stat sb;
+
+        position = &direct->read_offset;
+        if (whence == SEEK_END) {
+            if (fstat(fileno((FILE *)f), &sb) < 0) {
+                zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+                return false;
+            }
+            size = (zip_uint64_t)sb.st_size;
+        }
+        else {
+            size = 0;
+        }
+    }
+
+    switch (whence) {
+    case SEEK_SET:
+        new_offset = offset;
+        break;
+
+    case SEEK_CUR:
+        if (offset > 0 && (zip_uint64_t)offset > ZIP_INT64_MAX - *position) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EOVERFLOW);
+            return false;
+        }
+        new_offset = (zip_int64_t)*position + offset;
+        break;
+
+    case SEEK_END:
+        if (offset > 0 && (zip_uint64_t)offset > ZIP_INT64_MAX - size) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EOVERFLOW);
+            return false;
+        }
+        new_offset = (zip_int64_t)size + offset;
+        break;
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    if (new_offset < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, EINVAL);
+        return false;
+    }
+
+    *position = (zip_uint64_t)new_offset;
+    return true;
+}
+
+
+static char *
+direct_string_duplicate(zip_source_file_context_t *ctx, const char *string) {
+    return NAMED->string_duplicate(ctx, string);
+}
+
+
+static zip_int64_t
+direct_tell(zip_source_file_context_t *ctx, void *f) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+
+    if (f == ctx->fout) {
+        return (zip_int64_t)direct->write_offset;
+    }
+
+    return (zip_int64_t)direct->read_offset;
+}
+
+
+static zip_int64_t
+direct_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len) {
+    direct_t *direct = (direct_t *)ctx->ops_userdata;
+    window_t *window = &direct->write;
+    zip_uint64_t total;
+
+    if (len > ZIP_INT64_MAX - direct->write_offset) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, EFBIG);
+        return -1;
+    }
+
+    total = 0;
+    while (total < len) {
+        zip_uint64_t start, n;
+
+        if (window->data == NULL || direct->write_offset < window->offset || direct->write_offset - window->offset >= DIRECT_WINDOW_SIZE || direct->write_offset - window->offset > window->length) {
+            if (!write_move(ctx, direct, direct->write_offset)) {
+                return -1;
+            }
+        }
+
+        start = direct->write_offset - window->offset;
+        n = ZIP_MIN(len - total, DIRECT_WINDOW_SIZE - start);
+        (void)memcpy_s(window->data + start, (size_t)n, (const zip_uint8_t *)data + total, (size_t)n);
+        direct->write_dirty = true;
+        direct->write_offset += n;
+        total += n;
+
+        if (start + n > window->length) {
+            window->length = start + n;
+        }
+        if (direct->write_offset > direct->write_size) {
+            direct->write_size = direct->write_offset;
+        }
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+/* Switch fd between bypassing the page cache and buffered I/O. */
+static bool
+set_uncached(int fd, bool uncached) {
+#if defined(O_DIRECT)
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL)) < 0) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, uncached ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) == 0;
+#elif defined(F_NOCACHE)
+    return fcntl(fd, F_NOCACHE, uncached ? 1 : 0) == 0;
+#else
+    return !uncached;
+#endif
+}
+
+
+/* Allocate aligned buffer of window if not done yet. */
+static bool
+window_alloc(window_t *window, zip_error_t *error) {
+    void *data;
+
+    if (window->data != NULL) {
+        return true;
+    }
+    if (posix_memalign(&data, DIRECT_ALIGNMENT, DIRECT_WINDOW_SIZE) != 0) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    window->data = (zip_uint8_t *)data;
+    return true;
+}
+
+
+static void
+window_fini(window_t *window) {
+    free(window->data);
+    window->data = NULL;
+    window->offset = 0;
+    window->length = 0;
+}
+
+
+/* Reset window for new file descriptor fd, -1 for none. */
+static void
+window_init(window_t *window, int fd) {
+    window_fini(window);
+    /* not supported by all file systems, e.g. tmpfs */
+    window->uncached = fd >= 0 && set_uncached(fd, true);
+}
+
+
+/* Fill window with data from fd at offset, aligned down. Reaching end of file is not an error. */
+static bool
+window_read(window_t *window, int fd, zip_uint64_t offset, zip_error_t *error) {
+    zip_uint64_t start;
+
+    if (!window_alloc(window, error)) {
+        return false;
+    }
+
+    start = offset - offset % DIRECT_ALIGNMENT;
+    if (start > ZIP_OFF_MAX - DIRECT_WINDOW_SIZE) {
+        zip_error_set(error, ZIP_ER_SEEK, EOVERFLOW);
+        return false;
+    }
+
+    window->offset = start;
+    window->length = 0;
+    while (window->length < DIRECT_WINDOW_SIZE) {
+        ssize_t n = pread(fd, window->data + window->length, DIRECT_WINDOW_SIZE - window->length, (off_t)(start + window->length));
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && window->uncached && set_uncached(fd, false)) {
+                /* device needs larger alignment */
+                window->uncached = false;
+                continue;
+            }
+            zip_error_set(error, ZIP_ER_READ, errno);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        window->length += (zip_uint64_t)n;
+        if (window->uncached && window->length % DIRECT_ALIGNMENT != 0) {
+            /* partial block only at end of file */
+            break;
+        }
+    }
+
+#ifdef HAVE_POSIX_FADVISE
+    if (!window->uncached && window->length > 0) {
+        /* only a hint, failure doesn't matter */
+        (void)posix_fadvise(fd, (off_t)start, (off_t)window->length, POSIX_FADV_DONTNEED);
+    }
+#endif
+
+    return true;
+}
+
+
+/* Write data in window to fd, padding the last block when bypassing the page cache. */
+static bool
+window_write(window_t *window, int fd, zip_error_t *error) {
+    zip_uint64_t length = window->length;
+    zip_uint64_t done;
+
+    if (window->uncached && length % DIRECT_ALIGNMENT != 0) {
+        zip_uint64_t padding = DIRECT_ALIGNMENT - length % DIRECT_ALIGNMENT;
+
+        (void)memset(window->data + length, 0, (size_t)padding);
+        length += padding;
+    }
+
+    done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, window->data + done, (size_t)(length - done), (off_t)(window->offset + done));
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && window->uncached && set_uncached(fd, false)) {
+                /* device needs larger alignment, padding is cut off on commit */
+                window->uncached = false;
+                continue;
+            }
+            zip_error_set(error, ZIP_ER_WRITE, errno);
+            return false;
+        }
+        if (n == 0) {
+            zip_error_set(error, ZIP_ER_WRITE, ENOSPC);
+            return false;
+        }
+        done += (zip_uint64_t)n;
+    }
+
+#ifdef HAVE_POSIX_FADVISE
+    if (!window->uncached) {
+        /* only a hint, failure doesn't matter */
+        (void)posix_fadvise(fd, (off_t)window->offset, (off_t)length, POSIX_FADV_DONTNEED);
+    }
+#endif
+
+    return true;
+}
+
+
+/* Write output window if it has data not yet written. */
+static bool
+write_flush(zip_source_file_context_t *ctx, direct_t *direct) {
+    if (!direct->write_dirty) {
+        return true;
+    }
+    if (!window_write(&direct->write, fileno((FILE *)ctx->fout), &ctx->error)) {
+        return false;
+    }
+    direct->write_dirty = false;
+    return true;
+}
+
+
+/* Move output window to contain offset, reading data already written around it. */
+static bool
+write_move(zip_source_file_context_t *ctx, direct_t *direct, zip_uint64_t offset) {
+    window_t *window = &direct->write;
+    zip_uint64_t start = offset - offset % DIRECT_ALIGNMENT;
+
+    if (!write_flush(ctx, direct)) {
+        return false;
+    }
+
+    if (start < direct->write_size) {
+        if (!window_read(window, fileno((FILE *)ctx->fout), start, &ctx->error)) {
+            return false;
+        }
+        /* ignore padding of last block */
+        window->length = ZIP_MIN(window->length, direct->write_size - start);
+    }
+    else {
+        if (!window_alloc(window, &ctx->error)) {
+            return false;
+        }
+        window->offset = start;
+        window->length = 0;
+    }
+
+    if (offset - start > window->length) {
+        /* seeked past end of output, fill gap with zeros */
+        (void)memset(window->data + window->length, 0, (size_t)(offset - start - window->length));
+        window->length = offset - start;
+        direct->write_dirty = true;
+    }
+
+    return true;
+}
+#endif
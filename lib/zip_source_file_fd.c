@@ -0,0 +1,280 @@
+/*
+  zip_source_file_fd.c -- read-only file descriptor source implementation
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+#ifdef HAVE_PREAD
+#include "zip_source_file.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The file is only accessed with positional reads, so the file
+   position of the descriptor is neither used nor changed and the
+   descriptor can be shared with other sources or users. */
+
+struct fd_file {
+    int fd;
+    bool close_fd;         /* close fd when source is freed */
+    zip_uint64_t position; /* absolute read position */
+};
+typedef struct fd_file fd_file_t;
+
+static void fd_close(zip_source_file_context_t *ctx);
+#ifdef HAVE_POSIX_FADVISE
+static void fd_prefetch(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
+#endif
+static zip_int64_t fd_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+static zip_int64_t fd_read_at(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error);
+static bool fd_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
+static bool fd_stat(zip_source_file_context_t *ctx, zip_source_file_stat_t *st);
+static zip_int64_t fd_tell(zip_source_file_context_t *ctx, void *f);
+
+/* clang-format off */
+static zip_source_file_operations_t ops_fd_read = {
+    fd_close,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+#ifdef HAVE_POSIX_FADVISE
+    fd_prefetch,
+#else
+    NULL,
+#endif
+    fd_read,
+    fd_read_at,
+    NULL,
+    NULL,
+    fd_seek,
+    fd_stat,
+    NULL,
+    fd_tell,
+    NULL,
+    NULL
+};
+/* clang-format on */
+#endif
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_fd(zip_t *za, int fd, zip_uint64_t start, zip_int64_t len) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_fd_create(fd, start, len, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_fd_create(int fd, zip_uint64_t start, zip_int64_t length, zip_error_t *error) {
+    return _zip_source_file_fd_create(fd, start, length, false, error);
+}
+
+
+/* Create source reading from FD, which is closed when the source is
+   freed if CLOSE_FD is true. On error, FD is left open. */
+
+zip_source_t *
+_zip_source_file_fd_create(int fd, zip_uint64_t start, zip_int64_t length, bool close_fd, zip_error_t *error) {
+#ifdef HAVE_PREAD
+    fd_file_t *file;
+    zip_source_t *src;
+#endif
+
+    if (fd < 0 || length < ZIP_LENGTH_UNCHECKED) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+#ifndef HAVE_PREAD
+    (void)start;
+    (void)close_fd;
+    zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+    return NULL;
+#else
+    if ((file = (fd_file_t *)_zip_malloc(sizeof(*file))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    file->fd = fd;
+    file->close_fd = close_fd;
+    file->position = 0;
+
+    if ((src = zip_source_file_common_new(NULL, file, start, length, NULL, &ops_fd_read, NULL, error)) == NULL) {
+        _zip_free(file);
+        return NULL;
+    }
+
+    return src;
+#endif
+}
+
+
+#ifdef HAVE_PREAD
+static void
+fd_close(zip_source_file_context_t *ctx) {
+    fd_file_t *file = (fd_file_t *)ctx->f;
+
+    if (file->close_fd) {
+        close(file->fd);
+    }
+    _zip_free(file);
+}
+
+
+#ifdef HAVE_POSIX_FADVISE
+static void
+fd_prefetch(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len) {
+    if (offset > ZIP_OFF_MAX || len > ZIP_OFF_MAX - offset) {
+        return;
+    }
+
+    /* only a hint, failure doesn't matter */
+    (void)posix_fadvise(((fd_file_t *)ctx->f)->fd, (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+}
+#endif
+
+
+static zip_int64_t
+fd_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len) {
+    fd_file_t *file = (fd_file_t *)ctx->f;
+    zip_int64_t n;
+
+    if ((n = fd_read_at(ctx, buf, len, file->position, &ctx->error)) < 0) {
+        return -1;
+    }
+    file->position += (zip_uint64_t)n;
+
+    return n;
+}
+
+
+static zip_int64_t
+fd_read_at(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error) {
+    ssize_t i;
+
+    if (len > SIZE_MAX / 2) {
+        len = SIZE_MAX / 2;
+    }
+    if (offset > ZIP_OFF_MAX) {
+        zip_error_set(error, ZIP_ER_SEEK, EOVERFLOW);
+        return -1;
+    }
+
+    if ((i = pread(((fd_file_t *)ctx->f)->fd, buf, (size_t)len, (off_t)offset)) < 0) {
+        zip_error_set(error, ZIP_ER_READ, errno);
+        return -1;
+    }
+
+    return (zip_int64_t)i;
+}
+
+
+static bool
+fd_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
+    fd_file_t *file = (fd_file_t *)f;
+    zip_int64_t base;
+
+    switch (whence) {
+    case SEEK_SET:
+        base = 0;
+        break;
+
+    case SEEK_CUR:
+        base = (zip_int64_t)file->position;
+        break;
+
+    case SEEK_END: {
+        struct stat sb;
+
+        if (fstat(file->fd, &sb) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+            return false;
+        }
+        base = (zip_int64_t)sb.st_size;
+        break;
+    }
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, EINVAL);
+        return false;
+    }
+
+    if ((offset > 0 && base > ZIP_INT64_MAX - offset) || base + offset < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, offset > 0 ? EOVERFLOW : EINVAL);
+        return false;
+    }
+
+    file->position = (zip_uint64_t)(base + offset);
+    return true;
+}
+
+
+static bool
+fd_stat(zip_source_file_context_t *ctx, zip_source_file_stat_t *st) {
+    struct stat sb;
+
+    if (fstat(((fd_file_t *)ctx->f)->fd, &sb) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+        return false;
+    }
+
+    st->size = (zip_uint64_t)sb.st_size;
+    st->mtime = sb.st_mtime;
+
+    st->regular_file = S_ISREG(sb.st_mode);
+    st->exists = true;
+
+    ctx->attributes.valid = ZIP_FILE_ATTRIBUTES_HOST_SYSTEM | ZIP_FILE_ATTRIBUTES_EXTERNAL_FILE_ATTRIBUTES;
+    ctx->attributes.host_system = ZIP_OPSYS_UNIX;
+    ctx->attributes.external_file_attributes = (((zip_uint32_t)sb.st_mode) << 16) | ((sb.st_mode & S_IWUSR) ? 0 : 1);
+
+    return true;
+}
+
+
+static zip_int64_t
+fd_tell(zip_source_file_context_t *ctx, void *f) {
+    (void)ctx;
+
+    return (zip_int64_t)((fd_file_t *)f)->position;
+}
+#endif
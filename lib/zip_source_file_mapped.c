@@ -0,0 +1,428 @@
+/*
+  zip_source_file_mapped.c -- source for file opened by name, writing through a memory mapping
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* for fallocate */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "zipint.h"
+
+#if defined(HAVE_MMAP) && !defined(_WIN32)
+#include "zip_source_file.h"
+#include "zip_source_file_stdio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Reading works like the stdio source. Output is written by copying it into a window of MAPPED_WINDOW_SIZE bytes of
+   the temporary file mapped into memory, which is moved along with the write position, instead of calling fwrite.
+
+   Before data is copied into the window, the file is grown to cover it in extents that double its size, between
+   MAPPED_EXTENT_MIN and MAPPED_EXTENT_MAX bytes, with fallocate where available, so running out of space is reported
+   as a write error instead of a signal when touching the mapping. On commit, the window is unmapped and the file is
+   cut to the data written.
+
+   Cloning, writing in place, continuing interrupted writes, and copying data between files are not offered, since
+   they write to the file descriptor directly. */
+
+#define MAPPED_WINDOW_SIZE (4 * 1024 * 1024)
+#define MAPPED_EXTENT_MIN (1024 * 1024)
+#define MAPPED_EXTENT_MAX (64 * 1024 * 1024)
+
+struct mapped {
+    zip_uint8_t *map;          /* mapped window of output, NULL if none */
+    zip_uint64_t map_offset;   /* of window in file, multiple of MAPPED_WINDOW_SIZE */
+    zip_uint64_t write_offset; /* absolute output position */
+    zip_uint64_t write_size;   /* size of output */
+    zip_uint64_t file_size;    /* size of output file, including extent not yet used */
+};
+typedef struct mapped mapped_t;
+
+static zip_int64_t mapped_commit_write(zip_source_file_context_t *ctx);
+static zip_int64_t mapped_create_temp_output(zip_source_file_context_t *ctx);
+static void mapped_free(zip_source_file_context_t *ctx);
+static bool mapped_open(zip_source_file_context_t *ctx);
+static void mapped_preallocate(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
+static zip_int64_t mapped_remove(zip_source_file_context_t *ctx);
+static void mapped_rollback_write(zip_source_file_context_t *ctx);
+static bool mapped_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
+static char *mapped_string_duplicate(zip_source_file_context_t *ctx, const char *string);
+static zip_int64_t mapped_tell(zip_source_file_context_t *ctx, void *f);
+static zip_int64_t mapped_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len);
+static zip_int64_t mapped_writev(zip_source_file_context_t *ctx, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments);
+
+static bool output_grow(mapped_t *mapped, int fd, zip_uint64_t size, zip_error_t *error);
+static void window_unmap(mapped_t *mapped);
+
+/* clang-format off */
+static zip_source_file_operations_t ops_mapped = {
+    _zip_stdio_op_close,
+    mapped_commit_write,
+    NULL,
+    NULL,
+    mapped_create_temp_output,
+    NULL,
+    mapped_free,
+    mapped_open,
+    NULL,
+    mapped_preallocate,
+#ifdef HAVE_POSIX_FADVISE
+    _zip_stdio_op_prefetch,
+#else
+    NULL,
+#endif
+    _zip_stdio_op_read,
+#ifdef HAVE_PREAD
+    _zip_stdio_op_read_at,
+#else
+    NULL,
+#endif
+    mapped_remove,
+    mapped_rollback_write,
+    mapped_seek,
+    _zip_stdio_op_stat,
+    mapped_string_duplicate,
+    mapped_tell,
+    mapped_write,
+    mapped_writev
+};
+/* clang-format on */
+
+#define NAMED (&_zip_source_file_stdio_named_ops)
+#endif
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_file_mapped(zip_t *za, const char *fname, zip_uint64_t start, zip_int64_t len) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_file_mapped_create(fname, start, len, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_file_mapped_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_error_t *error) {
+#if defined(HAVE_MMAP) && !defined(_WIN32)
+    mapped_t *mapped;
+    zip_source_t *src;
+#endif
+
+    if (fname == NULL) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+#if !defined(HAVE_MMAP) || defined(_WIN32)
+    return zip_source_file_create(fname, start, length, error);
+#else
+    if ((mapped = (mapped_t *)_zip_malloc(sizeof(*mapped))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    mapped->map = NULL;
+    mapped->map_offset = 0;
+    mapped->write_offset = 0;
+    mapped->write_size = 0;
+    mapped->file_size = 0;
+
+    if ((src = _zip_source_file_stdio_named_create(fname, start, length, &ops_mapped, mapped, error)) == NULL) {
+        _zip_free(mapped);
+        return NULL;
+    }
+
+    return src;
+#endif
+}
+
+
+#if defined(HAVE_MMAP) && !defined(_WIN32)
+static zip_int64_t
+mapped_commit_write(zip_source_file_context_t *ctx) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+
+    /* data in the mapping is in the file once it is unmapped, like after fflush */
+    window_unmap(mapped);
+
+    /* cut off unused extent and hand output position back to stdio */
+    if (ftruncate(fileno((FILE *)ctx->fout), (off_t)mapped->write_size) < 0 || fseeko((FILE *)ctx->fout, (off_t)mapped->write_size, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        (void)fclose((FILE *)ctx->fout);
+        return -1;
+    }
+    return NAMED->commit_write(ctx);
+}
+
+
+static zip_int64_t
+mapped_create_temp_output(zip_source_file_context_t *ctx) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+
+    if (NAMED->create_temp_output(ctx) < 0) {
+        return -1;
+    }
+
+    window_unmap(mapped);
+    mapped->write_offset = 0;
+    mapped->write_size = 0;
+    mapped->file_size = 0;
+    return 0;
+}
+
+
+static void
+mapped_free(zip_source_file_context_t *ctx) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+
+    window_unmap(mapped);
+    _zip_free(mapped);
+}
+
+
+static bool
+mapped_open(zip_source_file_context_t *ctx) {
+    return NAMED->open(ctx);
+}
+
+
+static void
+mapped_preallocate(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+    zip_error_t error;
+
+    if (offset > ZIP_OFF_MAX || len > ZIP_OFF_MAX - offset) {
+        return;
+    }
+
+    /* only a hint, failure doesn't matter */
+    zip_error_init(&error);
+    (void)output_grow(mapped, fileno((FILE *)ctx->fout), offset + len, &error);
+    zip_error_fini(&error);
+}
+
+
+static zip_int64_t
+mapped_remove(zip_source_file_context_t *ctx) {
+    return NAMED->remove(ctx);
+}
+
+
+static void
+mapped_rollback_write(zip_source_file_context_t *ctx) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+
+    window_unmap(mapped);
+    NAMED->rollback_write(ctx);
+}
+
+
+static bool
+mapped_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+    zip_int64_t new_offset;
+
+    if (f != ctx->fout) {
+        return _zip_stdio_op_seek(ctx, f, offset, whence);
+    }
+
+    switch (whence) {
+    case SEEK_SET:
+        new_offset = offset;
+        break;
+
+    case SEEK_CUR:
+        if (offset > 0 && (zip_uint64_t)offset > ZIP_INT64_MAX - mapped->write_offset) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EOVERFLOW);
+            return false;
+        }
+        new_offset = (zip_int64_t)mapped->write_offset + offset;
+        break;
+
+    case SEEK_END:
+        if (offset > 0 && (zip_uint64_t)offset > ZIP_INT64_MAX - mapped->write_size) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, EOVERFLOW);
+            return false;
+        }
+        new_offset = (zip_int64_t)mapped->write_size + offset;
+        break;
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    if (new_offset < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, EINVAL);
+        return false;
+    }
+
+    mapped->write_offset = (zip_uint64_t)new_offset;
+    return true;
+}
+
+
+static char *
+mapped_string_duplicate(zip_source_file_context_t *ctx, const char *string) {
+    return NAMED->string_duplicate(ctx, string);
+}
+
+
+static zip_int64_t
+mapped_tell(zip_source_file_context_t *ctx, void *f) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+
+    if (f != ctx->fout) {
+        return _zip_stdio_op_tell(ctx, f);
+    }
+
+    return (zip_int64_t)mapped->write_offset;
+}
+
+
+static zip_int64_t
+mapped_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len) {
+    mapped_t *mapped = (mapped_t *)ctx->ops_userdata;
+    int fd = fileno((FILE *)ctx->fout);
+    zip_uint64_t total;
+
+    if (len > ZIP_OFF_MAX || mapped->write_offset > ZIP_OFF_MAX - len) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, EFBIG);
+        return -1;
+    }
+    if (!output_grow(mapped, fd, mapped->write_offset + len, &ctx->error)) {
+        return -1;
+    }
+
+    total = 0;
+    while (total < len) {
+        zip_uint64_t start, n;
+
+        if (mapped->map == NULL || mapped->write_offset < mapped->map_offset || mapped->write_offset - mapped->map_offset >= MAPPED_WINDOW_SIZE) {
+            void *map;
+            zip_uint64_t map_offset = mapped->write_offset - mapped->write_offset % MAPPED_WINDOW_SIZE;
+
+            window_unmap(mapped);
+            /* window may extend past end of file, only the part covered by the file is touched */
+            if ((map = mmap(NULL, MAPPED_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)map_offset)) == MAP_FAILED) {
+                zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+                return -1;
+            }
+            mapped->map = (zip_uint8_t *)map;
+            mapped->map_offset = map_offset;
+#ifdef MADV_POPULATE_WRITE
+            /* fault in part of window in file with one system call instead of one page fault per page written; only a hint, not supported by all kernels */
+            (void)madvise(map, (size_t)ZIP_MIN(MAPPED_WINDOW_SIZE, mapped->file_size - map_offset), MADV_POPULATE_WRITE);
+#endif
+        }
+
+        start = mapped->write_offset - mapped->map_offset;
+        n = ZIP_MIN(len - total, MAPPED_WINDOW_SIZE - start);
+        (void)memcpy_s(mapped->map + start, (size_t)n, (const zip_uint8_t *)data + total, (size_t)n);
+        mapped->write_offset += n;
+        total += n;
+    }
+
+    if (mapped->write_offset > mapped->write_size) {
+        mapped->write_size = mapped->write_offset;
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+static zip_int64_t
+mapped_writev(zip_source_file_context_t *ctx, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments) {
+    zip_uint64_t i, total;
+
+    total = 0;
+    for (i = 0; i < nfragments; i++) {
+        if (mapped_write(ctx, fragments[i].data, fragments[i].length) < 0) {
+            return -1;
+        }
+        total += fragments[i].length;
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+/* Grow output file to at least size bytes, by at least one extent. */
+static bool
+output_grow(mapped_t *mapped, int fd, zip_uint64_t size, zip_error_t *error) {
+    zip_uint64_t new_size;
+
+    if (size <= mapped->file_size) {
+        return true;
+    }
+
+    new_size = mapped->file_size + ZIP_MAX(MAPPED_EXTENT_MIN, ZIP_MIN(mapped->file_size, MAPPED_EXTENT_MAX));
+    if (new_size < size || new_size > ZIP_OFF_MAX) {
+        new_size = size;
+    }
+
+#ifdef HAVE_FALLOCATE
+    if (fallocate(fd, 0, (off_t)mapped->file_size, (off_t)(new_size - mapped->file_size)) == 0) {
+        mapped->file_size = new_size;
+        return true;
+    }
+    if (errno != EOPNOTSUPP) {
+        zip_error_set(error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+    /* not supported by file system, extend file without reserving space */
+#endif
+    if (ftruncate(fd, (off_t)new_size) < 0) {
+        zip_error_set(error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+    mapped->file_size = new_size;
+    return true;
+}
+
+
+static void
+window_unmap(mapped_t *mapped) {
+    if (mapped->map != NULL) {
+        (void)munmap(mapped->map, MAPPED_WINDOW_SIZE);
+        mapped->map = NULL;
+    }
+}
+#endif
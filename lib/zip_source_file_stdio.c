@@ -40,6 +40,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #ifdef _WIN32
 #ifndef S_IWUSR
@@ -54,13 +57,29 @@ static zip_source_file_operations_t ops_stdio_read = {
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+#ifdef HAVE_POSIX_FADVISE
+    _zip_stdio_op_prefetch,
+#else
+    NULL,
+#endif
     _zip_stdio_op_read,
+#ifdef HAVE_PREAD
+    _zip_stdio_op_read_at,
+#else
+    NULL,
+#endif
     NULL,
     NULL,
     _zip_stdio_op_seek,
     _zip_stdio_op_stat,
     NULL,
     _zip_stdio_op_tell,
+    NULL,
     NULL
 };
 /* clang-format on */
@@ -93,6 +112,19 @@ _zip_stdio_op_close(zip_source_file_context_t *ctx) {
 }
 
 
+#ifdef HAVE_POSIX_FADVISE
+void
+_zip_stdio_op_prefetch(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len) {
+    if (offset > ZIP_OFF_MAX || len > ZIP_OFF_MAX - offset) {
+        return;
+    }
+
+    /* only a hint, failure doesn't matter */
+    (void)posix_fadvise(fileno((FILE *)ctx->f), (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+}
+#endif
+
+
 zip_int64_t
 _zip_stdio_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len) {
     size_t i;
@@ -103,6 +135,10 @@ _zip_stdio_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len)
     if ((i = fread(buf, 1, (size_t)len, ctx->f)) == 0) {
         if (ferror((FILE *)ctx->f)) {
             zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            if (errno == EAGAIN) {
+                /* no data available yet on non-blocking file, allow reading again */
+                clearerr((FILE *)ctx->f);
+            }
             return -1;
         }
     }
@@ -111,6 +147,29 @@ _zip_stdio_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len)
 }
 
 
+#ifdef HAVE_PREAD
+zip_int64_t
+_zip_stdio_op_read_at(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error) {
+    ssize_t i;
+
+    if (len > SIZE_MAX / 2) {
+        len = SIZE_MAX / 2;
+    }
+    if (offset > ZIP_OFF_MAX) {
+        zip_error_set(error, ZIP_ER_SEEK, EOVERFLOW);
+        return -1;
+    }
+
+    if ((i = pread(fileno((FILE *)ctx->f), buf, (size_t)len, (off_t)offset)) < 0) {
+        zip_error_set(error, ZIP_ER_READ, errno);
+        return -1;
+    }
+
+    return (zip_int64_t)i;
+}
+#endif
+
+
 bool
 _zip_stdio_op_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
 #if ZIP_FSEEK_MAX > ZIP_INT64_MAX
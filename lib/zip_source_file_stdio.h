@@ -36,8 +36,29 @@
 
 #include <stdio.h>
 
+/* optional operations provided by _zip_source_file_stdio_named_ops */
+#if defined(HAVE_CLONEFILE) || defined(HAVE_FICLONERANGE)
+#define CAN_CLONE
+#endif
+#ifdef HAVE_FLOCK
+#define CAN_WRITE_IN_PLACE
+#endif
+#ifdef HAVE_UNISTD_H
+#define CAN_RESUME_WRITE
+#endif
+
+extern zip_source_file_operations_t _zip_source_file_stdio_named_ops;
+
+zip_source_t *_zip_source_file_stdio_named_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_source_file_operations_t *ops, void *ops_userdata, zip_error_t *error);
+
 void _zip_stdio_op_close(zip_source_file_context_t *ctx);
 zip_int64_t _zip_stdio_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+#ifdef HAVE_POSIX_FADVISE
+void _zip_stdio_op_prefetch(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
+#endif
+#ifdef HAVE_PREAD
+zip_int64_t _zip_stdio_op_read_at(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error);
+#endif
 bool _zip_stdio_op_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
 bool _zip_stdio_op_stat(zip_source_file_context_t *ctx, zip_source_file_stat_t *st);
 zip_int64_t _zip_stdio_op_tell(zip_source_file_context_t *ctx, void *f);
@@ -31,6 +31,11 @@
   IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+/* for O_TMPFILE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "zipint.h"
 
 #include "zip_source_file.h"
@@ -46,47 +51,153 @@
 #ifdef HAVE_CLONEFILE
 #include <sys/attr.h>
 #include <sys/clonefile.h>
-#define CAN_CLONE
 #endif
 #ifdef HAVE_FICLONERANGE
 #include <linux/fs.h>
 #include <sys/ioctl.h>
-#define CAN_CLONE
 #endif
+#ifdef HAVE_COPY_FILE_RANGE
+#define COPY_FILE_RANGE_MAX (1024 * 1024 * 1024) /* maximum length per call */
+#endif
+#ifdef HAVE_FLOCK
+#include <sys/file.h>
+#endif
+#ifdef HAVE_WRITEV
+#include <sys/uio.h>
+#define WRITEV_MAX_FRAGMENTS 64              /* maximum number of buffers per call */
+#define WRITEV_MAX_LENGTH (1024 * 1024 * 1024) /* maximum length per call */
+#endif
+
+#ifdef CAN_WRITE_IN_PLACE
+/* When writing in place, the data after offset is saved in a journal before the file is truncated there.
+   The journal is named like the file with JOURNAL_SUFFIX appended. It is written and synced under a temporary name
+   and then linked to its final name, so it is always complete, and it is locked while the file is being written.
+   It is removed after committing, or after restoring the data on rollback. If the writing process dies,
+   the data is restored the next time a source for the file is created.
+
+   Writes before offset are kept in memory until committing. Then the data they overwrite is appended to the
+   journal as records and synced before the writes are applied; an incomplete last record is ignored on restore,
+   since nothing was overwritten yet. */
+#define JOURNAL_SUFFIX "-journal"
+#define JOURNAL_MAGIC "LZJRNL01"
+#define JOURNAL_MAGIC_LENGTH 8
+#define JOURNAL_HEADER_SIZE (JOURNAL_MAGIC_LENGTH + 8 + 8) /* magic, offset, original file size */
+#define JOURNAL_RECORD_HEADER_SIZE (8 + 8)                   /* offset, length */
+
+typedef struct {
+    zip_uint64_t offset;   /* data after offset is saved in the journal */
+    zip_uint8_t *records;  /* offset, length, and data of writes before offset, in journal record format */
+    zip_uint64_t length;   /* length of records */
+    zip_uint64_t alloc;    /* allocated size of records */
+} journal_patches_t;
 
+static bool copy_data(FILE *in, FILE *out, zip_uint64_t length, zip_error_t *error);
+static void discard_journal(zip_source_file_context_t *ctx, FILE *journal);
+static char *journal_name(const char *fname, zip_error_t *error);
+static void journal_recover(const char *fname);
+static bool journal_patches_apply(zip_source_file_context_t *ctx);
+static void journal_patches_free(zip_source_file_context_t *ctx);
+static zip_int64_t journal_patches_write(zip_source_file_context_t *ctx, const zip_uint8_t *data, zip_uint64_t length);
+static bool journal_record_header(zip_uint8_t *record, zip_uint64_t *offset, zip_uint64_t *length, zip_error_t *error);
+static bool journal_restore(const char *fname, FILE *journal, zip_error_t *error);
+static bool journal_restore_records(FILE *journal, FILE *fout, zip_uint64_t length, zip_uint64_t offset, zip_error_t *error);
+static void sync_directory(const char *fname);
+#endif
+
+#if defined(CAN_WRITE_IN_PLACE) || defined(HAVE_O_TMPFILE)
+static char *directory_name(const char *fname);
+#endif
+#ifdef HAVE_O_TMPFILE
+/* The temporary file is created without a name in the directory of the file and linked to its final name on commit,
+   so a new archive costs a single directory operation and nothing is left behind if the writing process dies. */
+#define PROC_FD_NAME_SIZE 32
+static zip_int64_t commit_anonymous_temp_file(zip_source_file_context_t *ctx);
+static int create_anonymous_temp_file(zip_source_file_context_t *ctx);
+#endif
 static int create_temp_file(zip_source_file_context_t *ctx, bool create_file);
 
 static zip_int64_t _zip_stdio_op_commit_write(zip_source_file_context_t *ctx);
+#ifdef HAVE_COPY_FILE_RANGE
+static zip_int64_t _zip_stdio_op_copy_data(zip_source_file_context_t *ctx, zip_source_file_context_t *from, zip_uint64_t offset, zip_uint64_t length);
+#endif
+#ifdef CAN_WRITE_IN_PLACE
+static zip_int64_t _zip_stdio_op_create_output_in_place(zip_source_file_context_t *ctx, zip_uint64_t offset);
+#endif
 static zip_int64_t _zip_stdio_op_create_temp_output(zip_source_file_context_t *ctx);
 #ifdef CAN_CLONE
 static zip_int64_t _zip_stdio_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uint64_t offset);
 #endif
 static bool _zip_stdio_op_open(zip_source_file_context_t *ctx);
+#ifdef CAN_RESUME_WRITE
+static zip_int64_t _zip_stdio_op_open_output(zip_source_file_context_t *ctx);
+#endif
+#ifdef HAVE_FALLOCATE
+static void _zip_stdio_op_preallocate(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
+#endif
 static zip_int64_t _zip_stdio_op_remove(zip_source_file_context_t *ctx);
 static void _zip_stdio_op_rollback_write(zip_source_file_context_t *ctx);
 static char *_zip_stdio_op_strdup(zip_source_file_context_t *ctx, const char *string);
 static zip_int64_t _zip_stdio_op_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len);
+#ifdef HAVE_WRITEV
+static zip_int64_t _zip_stdio_op_writev(zip_source_file_context_t *ctx, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments);
+#endif
 static FILE *_zip_fopen_close_on_exec(const char *name, bool writeable);
 
 /* clang-format off */
-static zip_source_file_operations_t ops_stdio_named = {
+zip_source_file_operations_t _zip_source_file_stdio_named_ops = {
     _zip_stdio_op_close,
     _zip_stdio_op_commit_write,
+#ifdef HAVE_COPY_FILE_RANGE
+    _zip_stdio_op_copy_data,
+#else
+    NULL,
+#endif
+#ifdef CAN_WRITE_IN_PLACE
+    _zip_stdio_op_create_output_in_place,
+#else
+    NULL,
+#endif
     _zip_stdio_op_create_temp_output,
 #ifdef CAN_CLONE
     _zip_stdio_op_create_temp_output_cloning,
 #else
     NULL,
 #endif
+    NULL,
     _zip_stdio_op_open,
+#ifdef CAN_RESUME_WRITE
+    _zip_stdio_op_open_output,
+#else
+    NULL,
+#endif
+#ifdef HAVE_FALLOCATE
+    _zip_stdio_op_preallocate,
+#else
+    NULL,
+#endif
+#ifdef HAVE_POSIX_FADVISE
+    _zip_stdio_op_prefetch,
+#else
+    NULL,
+#endif
     _zip_stdio_op_read,
+#ifdef HAVE_PREAD
+    _zip_stdio_op_read_at,
+#else
+    NULL,
+#endif
     _zip_stdio_op_remove,
     _zip_stdio_op_rollback_write,
     _zip_stdio_op_seek,
     _zip_stdio_op_stat,
     _zip_stdio_op_strdup,
     _zip_stdio_op_tell,
-    _zip_stdio_op_write
+    _zip_stdio_op_write,
+#ifdef HAVE_WRITEV
+    _zip_stdio_op_writev
+#else
+    NULL
+#endif
 };
 /* clang-format on */
 
@@ -101,17 +212,73 @@ zip_source_file(zip_t *za, const char *fname, zip_uint64_t start, zip_int64_t le
 
 ZIP_EXTERN zip_source_t *
 zip_source_file_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_error_t *error) {
+    return _zip_source_file_stdio_named_create(fname, start, length, &_zip_source_file_stdio_named_ops, NULL, error);
+}
+
+
+/* Create source for named file using ops, which are based on _zip_source_file_stdio_named_ops. */
+zip_source_t *
+_zip_source_file_stdio_named_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_source_file_operations_t *ops, void *ops_userdata, zip_error_t *error) {
     if (fname == NULL || length < ZIP_LENGTH_UNCHECKED) {
         zip_error_set(error, ZIP_ER_INVAL, 0);
         return NULL;
     }
 
-    return zip_source_file_common_new(fname, NULL, start, length, NULL, &ops_stdio_named, NULL, error);
+#ifdef CAN_WRITE_IN_PLACE
+    if (start == 0 && (length == ZIP_LENGTH_TO_END || length == -1)) {
+        /* restore data if writing in place was interrupted */
+        journal_recover(fname);
+    }
+#endif
+
+    return zip_source_file_common_new(fname, NULL, start, length, NULL, ops, ops_userdata, error);
 }
 
 
 static zip_int64_t
 _zip_stdio_op_commit_write(zip_source_file_context_t *ctx) {
+#ifdef CAN_WRITE_IN_PLACE
+    if (ctx->journal != NULL) {
+        if (!journal_patches_apply(ctx)) {
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+        if (fflush(ctx->fout) != 0 || fsync(fileno(ctx->fout)) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+        if (fclose(ctx->fout) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return -1;
+        }
+
+        /* remove while still locked, see journal_recover */
+        (void)remove(ctx->tmpname);
+        (void)fclose(ctx->journal);
+        ctx->journal = NULL;
+        journal_patches_free(ctx);
+        return 0;
+    }
+#endif
+#if defined(HAVE_FALLOCATE) || defined(CAN_RESUME_WRITE)
+    if (ctx->preallocated || ctx->output_name != NULL) {
+        /* cut off space reserved but not used, or data left from an earlier write */
+        off_t size;
+
+        if (fflush(ctx->fout) != 0 || (size = ftello(ctx->fout)) < 0 || ftruncate(fileno(ctx->fout), size) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+    }
+#endif
+#ifdef HAVE_O_TMPFILE
+    if (ctx->tmpname == NULL) {
+        return commit_anonymous_temp_file(ctx);
+    }
+#endif
+
     if (fclose(ctx->fout) < 0) {
         zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
         return -1;
@@ -125,10 +292,206 @@ _zip_stdio_op_commit_write(zip_source_file_context_t *ctx) {
 }
 
 
+#ifdef HAVE_COPY_FILE_RANGE
+static zip_int64_t
+_zip_stdio_op_copy_data(zip_source_file_context_t *ctx, zip_source_file_context_t *from, zip_uint64_t offset, zip_uint64_t length) {
+    off_t in_offset, out_offset;
+    zip_uint64_t copied;
+
+    if (offset > ZIP_OFF_MAX || length > ZIP_OFF_MAX - offset) {
+        return 0;
+    }
+
+    if (fflush(ctx->fout) != 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return -1;
+    }
+    if ((out_offset = ftello(ctx->fout)) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_TELL, errno);
+        return -1;
+    }
+    in_offset = (off_t)offset;
+
+    copied = 0;
+    while (copied < length) {
+        ssize_t n = copy_file_range(fileno(from->f), &in_offset, fileno(ctx->fout), &out_offset, (size_t)ZIP_MIN(length - copied, COPY_FILE_RANGE_MAX), 0);
+
+        /* Not supported between these files, or an error that reading will report; the caller copies the rest. */
+        if (n <= 0) {
+            break;
+        }
+        copied += (zip_uint64_t)n;
+    }
+
+    if (copied == 0) {
+        return 0;
+    }
+
+    /* copy_file_range doesn't change the file positions */
+    if (fseeko(ctx->fout, out_offset, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+        return -1;
+    }
+    /* other files are read at explicit offsets, see _zip_source_window_copy_data_to */
+    if (from == ctx && fseeko(ctx->f, in_offset, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+        return -1;
+    }
+
+    return (zip_int64_t)copied;
+}
+#endif
+
+
+#ifdef CAN_WRITE_IN_PLACE
+static zip_int64_t
+_zip_stdio_op_create_output_in_place(zip_source_file_context_t *ctx, zip_uint64_t offset) {
+    FILE *fout, *journal;
+    journal_patches_t *patches;
+    struct stat st;
+    zip_uint8_t header[JOURNAL_HEADER_SIZE];
+    zip_buffer_t *buffer;
+    char *name;
+    int fd;
+
+    if (offset > ZIP_OFF_MAX) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, E2BIG);
+        return -1;
+    }
+
+    if ((fout = _zip_fopen_close_on_exec(ctx->fname, true)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_OPEN, errno);
+        return -1;
+    }
+    if (fstat(fileno(fout), &st) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+        (void)fclose(fout);
+        return -1;
+    }
+    if ((zip_uint64_t)st.st_size < offset) {
+        zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+        (void)fclose(fout);
+        return -1;
+    }
+
+    if ((fd = create_temp_file(ctx, true)) < 0) {
+        (void)fclose(fout);
+        return -1;
+    }
+    if ((journal = fdopen(fd, "r+b")) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+        (void)close(fd);
+        (void)remove(ctx->tmpname);
+        _zip_free(ctx->tmpname);
+        ctx->tmpname = NULL;
+        (void)fclose(fout);
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+
+    if ((buffer = _zip_buffer_new(header, sizeof(header))) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    _zip_buffer_put(buffer, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH);
+    _zip_buffer_put_64(buffer, offset);
+    _zip_buffer_put_64(buffer, (zip_uint64_t)st.st_size);
+    _zip_buffer_free(buffer);
+
+    if (fwrite(header, 1, sizeof(header), journal) != sizeof(header)) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    if (fseeko(fout, (off_t)offset, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    if (!copy_data(fout, journal, (zip_uint64_t)st.st_size - offset, &ctx->error)) {
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    if (fflush(journal) != 0 || fsync(fd) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+
+    /* fails if there is a journal already, e.g. from an interrupted write that could not be restored */
+    if ((name = journal_name(ctx->fname, &ctx->error)) == NULL) {
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    if (link(ctx->tmpname, name) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+        _zip_free(name);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    (void)remove(ctx->tmpname);
+    _zip_free(ctx->tmpname);
+    ctx->tmpname = name;
+    sync_directory(ctx->fname);
+
+    if ((patches = (journal_patches_t *)_zip_malloc(sizeof(*patches))) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+    patches->offset = offset;
+    patches->records = NULL;
+    patches->length = 0;
+    patches->alloc = 0;
+
+    if (ftruncate(fileno(fout), (off_t)offset) < 0 || fseeko(fout, (off_t)offset, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        _zip_free(patches);
+        discard_journal(ctx, journal);
+        (void)fclose(fout);
+        return -1;
+    }
+
+    ctx->fout = fout;
+    ctx->journal = journal;
+    ctx->journal_patches = patches;
+
+    return 0;
+}
+#endif
+
+
 static zip_int64_t
 _zip_stdio_op_create_temp_output(zip_source_file_context_t *ctx) {
-    int fd = create_temp_file(ctx, true);
-    
+    int fd;
+
+#ifdef HAVE_O_TMPFILE
+    if ((fd = create_anonymous_temp_file(ctx)) >= 0) {
+        if ((ctx->fout = fdopen(fd, "r+b")) == NULL) {
+            zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+            (void)close(fd);
+            return -1;
+        }
+        return 0;
+    }
+    /* not supported by file system, use named temporary file */
+#endif
+
+    fd = create_temp_file(ctx, true);
     if (fd < 0) {
         return -1;
     }
@@ -137,7 +500,7 @@ _zip_stdio_op_create_temp_output(zip_source_file_context_t *ctx) {
         zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
         close(fd);
         (void)remove(ctx->tmpname);
-        free(ctx->tmpname);
+        _zip_free(ctx->tmpname);
         ctx->tmpname = NULL;
         return -1;
     }
@@ -163,14 +526,14 @@ _zip_stdio_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uin
     
     if (clonefile(ctx->fname, ctx->tmpname, 0) < 0) {
         zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
-        free(ctx->tmpname);
+        _zip_free(ctx->tmpname);
         ctx->tmpname = NULL;
         return -1;
     }
     if ((tfp = _zip_fopen_close_on_exec(ctx->tmpname, true)) == NULL) {
         zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
         (void)remove(ctx->tmpname);
-        free(ctx->tmpname);
+        _zip_free(ctx->tmpname);
         ctx->tmpname = NULL;
         return -1;
     }
@@ -200,7 +563,7 @@ _zip_stdio_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uin
             zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
             (void)close(fd);
             (void)remove(ctx->tmpname);
-            free(ctx->tmpname);
+            _zip_free(ctx->tmpname);
             ctx->tmpname = NULL;
             return -1;
         }
@@ -209,7 +572,7 @@ _zip_stdio_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uin
             zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
             (void)close(fd);
             (void)remove(ctx->tmpname);
-            free(ctx->tmpname);
+            _zip_free(ctx->tmpname);
             ctx->tmpname = NULL;
             return -1;
         }
@@ -219,7 +582,7 @@ _zip_stdio_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uin
     if (ftruncate(fileno(tfp), (off_t)offset) < 0) {
         (void)fclose(tfp);
         (void)remove(ctx->tmpname);
-        free(ctx->tmpname);
+        _zip_free(ctx->tmpname);
         ctx->tmpname = NULL;
         return -1;
     }
@@ -227,7 +590,7 @@ _zip_stdio_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uin
         zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
         (void)fclose(tfp);
         (void)remove(ctx->tmpname);
-        free(ctx->tmpname);
+        _zip_free(ctx->tmpname);
         ctx->tmpname = NULL;
         return -1;
     }
@@ -244,10 +607,55 @@ _zip_stdio_op_open(zip_source_file_context_t *ctx) {
         zip_error_set(&ctx->error, ZIP_ER_OPEN, errno);
         return false;
     }
+#ifdef HAVE_POSIX_FADVISE
+    /* archives and files to add are mostly read front to back; only a hint, failure doesn't matter */
+    if (ctx->start <= ZIP_OFF_MAX && ctx->len <= ZIP_OFF_MAX - ctx->start) {
+        (void)posix_fadvise(fileno((FILE *)ctx->f), (off_t)ctx->start, (off_t)ctx->len, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
     return true;
 }
 
 
+#ifdef CAN_RESUME_WRITE
+static zip_int64_t
+_zip_stdio_op_open_output(zip_source_file_context_t *ctx) {
+    struct stat st;
+    int fd;
+
+    if ((ctx->tmpname = _zip_strdup(ctx->output_name)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    /* like a temporary file, it gets the permissions of the file it replaces */
+    if ((fd = open(ctx->tmpname, O_CREAT | O_RDWR | O_CLOEXEC, 0666)) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+        _zip_free(ctx->tmpname);
+        ctx->tmpname = NULL;
+        return -1;
+    }
+    if (stat(ctx->fname, &st) == 0) {
+#ifdef HAVE_FCHMOD
+        (void)fchmod(fd, st.st_mode);
+#else
+        (void)chmod(ctx->tmpname, st.st_mode);
+#endif
+    }
+
+    if ((ctx->fout = fdopen(fd, "r+b")) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+        (void)close(fd);
+        _zip_free(ctx->tmpname);
+        ctx->tmpname = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+
 static zip_int64_t
 _zip_stdio_op_remove(zip_source_file_context_t *ctx) {
     if (remove(ctx->fname) < 0) {
@@ -258,35 +666,269 @@ _zip_stdio_op_remove(zip_source_file_context_t *ctx) {
 }
 
 
+#ifdef HAVE_FALLOCATE
+static void
+_zip_stdio_op_preallocate(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len) {
+    if (ctx->journal != NULL || offset > ZIP_OFF_MAX || len > ZIP_OFF_MAX - offset) {
+        /* don't grow the archive itself when writing in place */
+        return;
+    }
+
+    /* only a hint, failure (e.g. not supported by file system) doesn't matter */
+    if (fallocate(fileno((FILE *)ctx->fout), 0, (off_t)offset, (off_t)len) == 0) {
+        ctx->preallocated = true;
+    }
+}
+#endif
+
+
 static void
 _zip_stdio_op_rollback_write(zip_source_file_context_t *ctx) {
     if (ctx->fout) {
         fclose(ctx->fout);
     }
-    (void)remove(ctx->tmpname);
+#ifdef CAN_WRITE_IN_PLACE
+    if (ctx->journal != NULL) {
+        zip_error_t error;
+
+        zip_error_init(&error);
+        if (journal_restore(ctx->fname, ctx->journal, &error)) {
+            (void)remove(ctx->tmpname);
+        }
+        /* otherwise, the journal is kept and restored by journal_recover */
+        zip_error_fini(&error);
+        (void)fclose(ctx->journal);
+        ctx->journal = NULL;
+        journal_patches_free(ctx);
+        return;
+    }
+#endif
+    /* anonymous temporary file vanishes when closed, output_name is kept to continue writing later */
+    if (ctx->tmpname != NULL && ctx->output_name == NULL) {
+        (void)remove(ctx->tmpname);
+    }
 }
 
 static char *
 _zip_stdio_op_strdup(zip_source_file_context_t *ctx, const char *string) {
-    return strdup(string);
+    return _zip_strdup(string);
 }
 
 
 static zip_int64_t
 _zip_stdio_op_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len) {
     size_t ret;
+    zip_uint64_t kept = 0;
+
+#ifdef CAN_WRITE_IN_PLACE
+    if (ctx->journal_patches != NULL) {
+        zip_int64_t n;
+
+        if ((n = journal_patches_write(ctx, (const zip_uint8_t *)data, len)) < 0) {
+            return -1;
+        }
+        kept = (zip_uint64_t)n;
+        if (kept == len) {
+            return (zip_int64_t)len;
+        }
+    }
+#endif
 
     clearerr((FILE *)ctx->fout);
-    ret = fwrite(data, 1, len, (FILE *)ctx->fout);
-    if (ret != len || ferror((FILE *)ctx->fout)) {
+    ret = fwrite((const zip_uint8_t *)data + kept, 1, len - kept, (FILE *)ctx->fout);
+    if (ret != len - kept || ferror((FILE *)ctx->fout)) {
         zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
         return -1;
     }
 
-    return (zip_int64_t)ret;
+    return (zip_int64_t)len;
 }
 
 
+
+#ifdef HAVE_WRITEV
+/* Write buffered data and all fragments with writev on the file descriptor, then resynchronize the stream with it. */
+static zip_int64_t
+_zip_stdio_op_writev(zip_source_file_context_t *ctx, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments) {
+    struct iovec iov[WRITEV_MAX_FRAGMENTS];
+    FILE *fout = (FILE *)ctx->fout;
+    zip_uint64_t i, done, total;
+    off_t offset;
+    int fd;
+
+#ifdef CAN_WRITE_IN_PLACE
+    if (ctx->journal_patches != NULL) {
+        /* writes before the journaled data are kept in memory */
+        total = 0;
+        for (i = 0; i < nfragments; i++) {
+            if (_zip_stdio_op_write(ctx, fragments[i].data, fragments[i].length) < 0) {
+                return -1;
+            }
+            total += fragments[i].length;
+        }
+        return (zip_int64_t)total;
+    }
+#endif
+
+    if (fflush(fout) != 0 || (offset = ftello(fout)) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return -1;
+    }
+    fd = fileno(fout);
+
+    i = 0;
+    done = 0; /* bytes of fragments[i] already written */
+    total = 0;
+    for (;;) {
+        zip_uint64_t j, length;
+        ssize_t n;
+        int count;
+
+        while (i < nfragments && done == fragments[i].length) {
+            i++;
+            done = 0;
+        }
+        if (i == nfragments) {
+            break;
+        }
+
+        count = 0;
+        length = 0;
+        for (j = i; j < nfragments && count < WRITEV_MAX_FRAGMENTS && length < WRITEV_MAX_LENGTH; j++) {
+            zip_uint64_t n_fragment = ZIP_MIN(fragments[j].length - (j == i ? done : 0), WRITEV_MAX_LENGTH - length);
+
+            if (n_fragment > 0) {
+                iov[count].iov_base = fragments[j].data + (j == i ? done : 0);
+                iov[count].iov_len = (size_t)n_fragment;
+                count++;
+                length += n_fragment;
+            }
+        }
+
+        if ((n = writev(fd, iov, count)) <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, n < 0 ? errno : EIO);
+            return -1;
+        }
+        total += (zip_uint64_t)n;
+
+        while (n > 0) {
+            zip_uint64_t left = fragments[i].length - done;
+
+            if ((zip_uint64_t)n < left) {
+                done += (zip_uint64_t)n;
+                break;
+            }
+            n -= (ssize_t)left;
+            i++;
+            done = 0;
+        }
+    }
+
+    /* the stream doesn't know about the data written to its file descriptor */
+    if (fseeko(fout, offset + (off_t)total, SEEK_SET) != 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+        return -1;
+    }
+
+    return (zip_int64_t)total;
+}
+#endif
+
+#ifdef HAVE_O_TMPFILE
+static zip_int64_t
+commit_anonymous_temp_file(zip_source_file_context_t *ctx) {
+    char name[PROC_FD_NAME_SIZE];
+
+    if (fflush(ctx->fout) != 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        (void)fclose(ctx->fout);
+        return -1;
+    }
+    snprintf_s(name, sizeof(name), "/proc/self/fd/%d", fileno(ctx->fout));
+
+    if (linkat(AT_FDCWD, name, AT_FDCWD, ctx->fname, AT_SYMLINK_FOLLOW) < 0) {
+        if (errno != EEXIST) {
+            zip_error_set(&ctx->error, ZIP_ER_RENAME, errno);
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+
+        /* replace existing file atomically */
+        if (create_temp_file(ctx, false) < 0) {
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+        if (linkat(AT_FDCWD, name, AT_FDCWD, ctx->tmpname, AT_SYMLINK_FOLLOW) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
+            _zip_free(ctx->tmpname);
+            ctx->tmpname = NULL;
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+        if (rename(ctx->tmpname, ctx->fname) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_RENAME, errno);
+            (void)remove(ctx->tmpname);
+            _zip_free(ctx->tmpname);
+            ctx->tmpname = NULL;
+            (void)fclose(ctx->fout);
+            return -1;
+        }
+    }
+
+    if (fclose(ctx->fout) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Returns -1 without setting an error if anonymous temporary files are not available. */
+static int
+create_anonymous_temp_file(zip_source_file_context_t *ctx) {
+    char name[PROC_FD_NAME_SIZE];
+    struct stat st;
+    char *directory;
+    int mode;
+    int fd;
+
+    if (stat(ctx->fname, &st) == 0) {
+        mode = st.st_mode;
+    }
+    else {
+        mode = -1;
+    }
+
+    if ((directory = directory_name(ctx->fname)) == NULL) {
+        return -1;
+    }
+    fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, mode == -1 ? 0666 : (mode_t)mode);
+    _zip_free(directory);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* linking on commit needs /proc */
+    snprintf_s(name, sizeof(name), "/proc/self/fd/%d", fd);
+    if (stat(name, &st) < 0) {
+        (void)close(fd);
+        return -1;
+    }
+
+    if (mode != -1) {
+        /* open() honors umask(), which we don't want in this case */
+        (void)fchmod(fd, (mode_t)mode);
+    }
+
+    return fd;
+}
+#endif
+
+
 static int create_temp_file(zip_source_file_context_t *ctx, bool create_file) {
     char *temp;
     int mode;
@@ -302,7 +944,7 @@ static int create_temp_file(zip_source_file_context_t *ctx, bool create_file) {
     }
     
     size_t temp_size = strlen(ctx->fname) + 13;
-    if ((temp = (char *)malloc(temp_size)) == NULL) {
+    if ((temp = (char *)_zip_malloc(temp_size)) == NULL) {
         zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
         return -1;
     }
@@ -339,7 +981,7 @@ static int create_temp_file(zip_source_file_context_t *ctx, bool create_file) {
             }
             if (errno != EEXIST) {
                 zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
-                free(temp);
+                _zip_free(temp);
                 return -1;
             }
         }
@@ -350,7 +992,7 @@ static int create_temp_file(zip_source_file_context_t *ctx, bool create_file) {
                 }
                 else {
                     zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, errno);
-                    free(temp);
+                    _zip_free(temp);
                     return -1;
                 }
             }
@@ -390,3 +1032,380 @@ static FILE *_zip_fopen_close_on_exec(const char *name, bool writeable) {
     }
     return fp;
 }
+
+
+#ifdef CAN_WRITE_IN_PLACE
+static bool
+copy_data(FILE *in, FILE *out, zip_uint64_t length, zip_error_t *error) {
+    zip_uint8_t buffer[BUFSIZE];
+
+    while (length > 0) {
+        size_t n = (size_t)ZIP_MIN(length, sizeof(buffer));
+
+        if (fread(buffer, 1, n, in) != n) {
+            zip_error_set(error, ZIP_ER_READ, ferror(in) ? errno : 0);
+            return false;
+        }
+        if (fwrite(buffer, 1, n, out) != n) {
+            zip_error_set(error, ZIP_ER_WRITE, errno);
+            return false;
+        }
+        length -= n;
+    }
+
+    return true;
+}
+
+
+/* Keep the part of a write of length bytes of data that comes before the data saved in the journal, to be applied
+   when committing. Returns the number of bytes kept. */
+static zip_int64_t
+journal_patches_write(zip_source_file_context_t *ctx, const zip_uint8_t *data, zip_uint64_t length) {
+    journal_patches_t *patches = (journal_patches_t *)ctx->journal_patches;
+    zip_buffer_t *buffer;
+    zip_uint64_t n, needed;
+    off_t position;
+
+    if ((position = ftello((FILE *)ctx->fout)) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_TELL, errno);
+        return -1;
+    }
+    if ((zip_uint64_t)position >= patches->offset) {
+        return 0;
+    }
+
+    n = ZIP_MIN(length, patches->offset - (zip_uint64_t)position);
+    needed = patches->length + JOURNAL_RECORD_HEADER_SIZE + n;
+    if (needed > patches->alloc) {
+        zip_uint64_t new_alloc = ZIP_MAX(needed, patches->alloc * 2);
+        zip_uint8_t *records;
+
+        if (new_alloc > SIZE_MAX || (records = (zip_uint8_t *)_zip_realloc(patches->records, (size_t)new_alloc)) == NULL) {
+            zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        patches->records = records;
+        patches->alloc = new_alloc;
+    }
+
+    if ((buffer = _zip_buffer_new(patches->records + patches->length, JOURNAL_RECORD_HEADER_SIZE + n)) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    _zip_buffer_put_64(buffer, (zip_uint64_t)position);
+    _zip_buffer_put_64(buffer, n);
+    _zip_buffer_put(buffer, data, (size_t)n);
+    _zip_buffer_free(buffer);
+    patches->length = needed;
+
+    if (fseeko((FILE *)ctx->fout, position + (off_t)n, SEEK_SET) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+        return -1;
+    }
+
+    return (zip_int64_t)n;
+}
+
+
+static bool
+journal_record_header(zip_uint8_t *record, zip_uint64_t *offset, zip_uint64_t *length, zip_error_t *error) {
+    zip_buffer_t *buffer;
+
+    if ((buffer = _zip_buffer_new(record, JOURNAL_RECORD_HEADER_SIZE)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    *offset = _zip_buffer_get_64(buffer);
+    *length = _zip_buffer_get_64(buffer);
+    _zip_buffer_free(buffer);
+
+    return true;
+}
+
+
+/* Save the data overwritten by the kept writes in the journal, then apply them. */
+static bool
+journal_patches_apply(zip_source_file_context_t *ctx) {
+    journal_patches_t *patches = (journal_patches_t *)ctx->journal_patches;
+    FILE *fout = (FILE *)ctx->fout;
+    FILE *journal = (FILE *)ctx->journal;
+    zip_uint8_t *old_data = NULL;
+    zip_uint64_t old_data_size = 0;
+    zip_uint64_t i;
+
+    if (patches == NULL || patches->length == 0) {
+        return true;
+    }
+
+    if (fflush(fout) != 0 || fseeko(journal, 0, SEEK_END) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+    for (i = 0; i < patches->length;) {
+        zip_uint8_t *record = patches->records + i;
+        zip_uint64_t offset, length;
+
+        if (!journal_record_header(record, &offset, &length, &ctx->error)) {
+            _zip_free(old_data);
+            return false;
+        }
+
+        if (length > old_data_size) {
+            zip_uint8_t *p;
+
+            if ((p = (zip_uint8_t *)_zip_realloc(old_data, (size_t)length)) == NULL) {
+                zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+                _zip_free(old_data);
+                return false;
+            }
+            old_data = p;
+            old_data_size = length;
+        }
+        if (fseeko(fout, (off_t)offset, SEEK_SET) < 0 || fread(old_data, 1, (size_t)length, fout) != length) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            _zip_free(old_data);
+            return false;
+        }
+        if (fwrite(record, 1, JOURNAL_RECORD_HEADER_SIZE, journal) != JOURNAL_RECORD_HEADER_SIZE || fwrite(old_data, 1, (size_t)length, journal) != length) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            _zip_free(old_data);
+            return false;
+        }
+        i += JOURNAL_RECORD_HEADER_SIZE + length;
+    }
+    _zip_free(old_data);
+
+    if (fflush(journal) != 0 || fsync(fileno(journal)) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+
+    for (i = 0; i < patches->length;) {
+        zip_uint8_t *record = patches->records + i;
+        zip_uint64_t offset, length;
+
+        if (!journal_record_header(record, &offset, &length, &ctx->error)) {
+            return false;
+        }
+
+        if (fseeko(fout, (off_t)offset, SEEK_SET) < 0 || fwrite(record + JOURNAL_RECORD_HEADER_SIZE, 1, (size_t)length, fout) != length) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return false;
+        }
+        i += JOURNAL_RECORD_HEADER_SIZE + length;
+    }
+
+    return true;
+}
+
+
+static void
+journal_patches_free(zip_source_file_context_t *ctx) {
+    journal_patches_t *patches = (journal_patches_t *)ctx->journal_patches;
+
+    if (patches == NULL) {
+        return;
+    }
+    _zip_free(patches->records);
+    _zip_free(patches);
+    ctx->journal_patches = NULL;
+}
+
+
+/* Close and remove journal before the original file is modified. */
+static void
+discard_journal(zip_source_file_context_t *ctx, FILE *journal) {
+    (void)remove(ctx->tmpname);
+    (void)fclose(journal);
+    _zip_free(ctx->tmpname);
+    ctx->tmpname = NULL;
+}
+
+
+static char *
+journal_name(const char *fname, zip_error_t *error) {
+    size_t size = strlen(fname) + strlen(JOURNAL_SUFFIX) + 1;
+    char *name;
+
+    if ((name = (char *)_zip_malloc(size)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    snprintf_s(name, size, "%s%s", fname, JOURNAL_SUFFIX);
+
+    return name;
+}
+
+
+/* Restore data from journal left by an interrupted write in place. */
+static void
+journal_recover(const char *fname) {
+    zip_error_t error;
+    struct stat st;
+    FILE *journal;
+    char *name;
+    int fd;
+
+    zip_error_init(&error);
+    if ((name = journal_name(fname, &error)) == NULL) {
+        zip_error_fini(&error);
+        return;
+    }
+
+    if ((fd = open(name, O_RDWR | O_CLOEXEC)) < 0) {
+        _zip_free(name);
+        zip_error_fini(&error);
+        return;
+    }
+
+    /* Journal is locked while the file is being written and removed before the lock is released.  */
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0 || fstat(fd, &st) < 0 || st.st_nlink == 0 || (journal = fdopen(fd, "r+b")) == NULL) {
+        (void)close(fd);
+        _zip_free(name);
+        zip_error_fini(&error);
+        return;
+    }
+
+    if (journal_restore(fname, journal, &error)) {
+        (void)remove(name);
+    }
+
+    (void)fclose(journal);
+    _zip_free(name);
+    zip_error_fini(&error);
+}
+
+
+/* Write data saved in journal back to fname, truncate it to its original size, and undo writes recorded in it. */
+static bool
+journal_restore(const char *fname, FILE *journal, zip_error_t *error) {
+    zip_uint8_t header[JOURNAL_HEADER_SIZE];
+    zip_buffer_t *buffer;
+    zip_uint64_t offset, size;
+    struct stat st;
+    FILE *fout;
+    bool ok;
+
+    if (fseeko(journal, 0, SEEK_SET) < 0 || fread(header, 1, sizeof(header), journal) != sizeof(header)) {
+        zip_error_set(error, ZIP_ER_READ, errno);
+        return false;
+    }
+    if ((buffer = _zip_buffer_new(header, sizeof(header))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    ok = memcmp(_zip_buffer_get(buffer, JOURNAL_MAGIC_LENGTH), JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH) == 0;
+    offset = _zip_buffer_get_64(buffer);
+    size = _zip_buffer_get_64(buffer);
+    _zip_buffer_free(buffer);
+
+    /* not our journal, or not written completely */
+    if (!ok || offset > size || size > ZIP_OFF_MAX || fstat(fileno(journal), &st) < 0 || (zip_uint64_t)st.st_size < JOURNAL_HEADER_SIZE + (size - offset)) {
+        zip_error_set(error, ZIP_ER_INCONS, 0);
+        return false;
+    }
+
+    if ((fout = _zip_fopen_close_on_exec(fname, true)) == NULL) {
+        zip_error_set(error, ZIP_ER_OPEN, errno);
+        return false;
+    }
+    if (fseeko(fout, (off_t)offset, SEEK_SET) < 0) {
+        zip_error_set(error, ZIP_ER_SEEK, errno);
+        (void)fclose(fout);
+        return false;
+    }
+    if (!copy_data(journal, fout, size - offset, error)) {
+        (void)fclose(fout);
+        return false;
+    }
+    if (!journal_restore_records(journal, fout, (zip_uint64_t)st.st_size - (JOURNAL_HEADER_SIZE + (size - offset)), offset, error)) {
+        (void)fclose(fout);
+        return false;
+    }
+    if (fflush(fout) != 0 || ftruncate(fileno(fout), (off_t)size) < 0 || fsync(fileno(fout)) < 0) {
+        zip_error_set(error, ZIP_ER_WRITE, errno);
+        (void)fclose(fout);
+        return false;
+    }
+    if (fclose(fout) < 0) {
+        zip_error_set(error, ZIP_ER_WRITE, errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Write back data overwritten before offset, saved in records of total length length following the data saved from
+   after offset. An incomplete last record was not applied yet and is ignored. */
+static bool
+journal_restore_records(FILE *journal, FILE *fout, zip_uint64_t length, zip_uint64_t offset, zip_error_t *error) {
+    zip_uint8_t header[JOURNAL_RECORD_HEADER_SIZE];
+    zip_uint64_t record_offset, record_length;
+
+    while (length >= JOURNAL_RECORD_HEADER_SIZE) {
+        if (fread(header, 1, sizeof(header), journal) != sizeof(header)) {
+            zip_error_set(error, ZIP_ER_READ, errno);
+            return false;
+        }
+        if (!journal_record_header(header, &record_offset, &record_length, error)) {
+            return false;
+        }
+        length -= JOURNAL_RECORD_HEADER_SIZE;
+        if (record_length > length) {
+            break;
+        }
+        if (record_offset > offset || record_length > offset - record_offset) {
+            zip_error_set(error, ZIP_ER_INCONS, 0);
+            return false;
+        }
+        if (fseeko(fout, (off_t)record_offset, SEEK_SET) < 0) {
+            zip_error_set(error, ZIP_ER_SEEK, errno);
+            return false;
+        }
+        if (!copy_data(journal, fout, record_length, error)) {
+            return false;
+        }
+        length -= record_length;
+    }
+
+    return true;
+}
+
+
+/* Make creation of journal durable. Errors are ignored, not all file systems support this. */
+static void
+sync_directory(const char *fname) {
+    char *name;
+    int fd;
+
+    if ((name = directory_name(fname)) == NULL) {
+        return;
+    }
+
+    if ((fd = open(name, O_RDONLY | O_CLOEXEC)) >= 0) {
+        (void)fsync(fd);
+        (void)close(fd);
+    }
+    _zip_free(name);
+}
+#endif
+
+
+#if defined(CAN_WRITE_IN_PLACE) || defined(HAVE_O_TMPFILE)
+/* Return name of directory containing fname, NULL if out of memory. */
+static char *
+directory_name(const char *fname) {
+    const char *slash = strrchr(fname, '/');
+    size_t length = slash == NULL ? 1 : ZIP_MAX((size_t)(slash - fname), 1);
+    char *name;
+
+    if ((name = (char *)_zip_malloc(length + 1)) == NULL) {
+        return NULL;
+    }
+    (void)memcpy_s(name, length + 1, slash == NULL ? "." : fname, length);
+    name[length] = '\0';
+
+    return name;
+}
+#endif
@@ -45,13 +45,21 @@ static zip_source_file_operations_t ops_win32_read = {
     NULL,
     NULL,
     NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
     _zip_win32_op_read,
+    _zip_win32_op_read_at,
     NULL,
     NULL,
     _zip_win32_op_seek,
     _zip_win32_op_stat,
     NULL,
     _zip_win32_op_tell,
+    NULL,
     NULL
 };
 
@@ -84,11 +92,20 @@ _zip_win32_op_close(zip_source_file_context_t *ctx) {
 }
 
 
+/* Reads from seekable files are positional: they start at start + offset of ctx, not at the file pointer, so
+   _zip_win32_op_read_at can be used from other threads at the same time. */
 zip_int64_t
 _zip_win32_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len) {
     DWORD i;
 
-    /* TODO: cap len to "DWORD_MAX" */
+    if (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK)) {
+        return _zip_win32_op_read_at(ctx, buf, len, ctx->start + ctx->offset, &ctx->error);
+    }
+
+    if (len > ZIP_WIN32_MAX_TRANSFER) {
+        len = ZIP_WIN32_MAX_TRANSFER;
+    }
+
     if (!ReadFile((HANDLE)ctx->f, buf, (DWORD)len, &i, NULL)) {
         zip_error_set(&ctx->error, ZIP_ER_READ, _zip_win32_error_to_errno(GetLastError()));
         return -1;
@@ -98,6 +115,46 @@ _zip_win32_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len)
 }
 
 
+/* Works on handles opened with and without FILE_FLAG_OVERLAPPED. Each call waits on its own event, since
+   several reads may be in progress on the same handle. */
+zip_int64_t
+_zip_win32_op_read_at(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error) {
+    OVERLAPPED overlapped;
+    DWORD i, win32err;
+
+    if (len > ZIP_WIN32_MAX_TRANSFER) {
+        len = ZIP_WIN32_MAX_TRANSFER;
+    }
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.Offset = (DWORD)(offset & 0xffffffff);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    if ((overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL)) == NULL) {
+        zip_error_set(error, ZIP_ER_READ, _zip_win32_error_to_errno(GetLastError()));
+        return -1;
+    }
+
+    win32err = ERROR_SUCCESS;
+    if (!ReadFile((HANDLE)ctx->f, buf, (DWORD)len, &i, &overlapped)) {
+        win32err = GetLastError();
+        if (win32err == ERROR_IO_PENDING) {
+            win32err = GetOverlappedResult((HANDLE)ctx->f, &overlapped, &i, TRUE) ? ERROR_SUCCESS : GetLastError();
+        }
+    }
+    CloseHandle(overlapped.hEvent);
+
+    if (win32err == ERROR_HANDLE_EOF) {
+        return 0;
+    }
+    if (win32err != ERROR_SUCCESS) {
+        zip_error_set(error, ZIP_ER_READ, _zip_win32_error_to_errno(win32err));
+        return -1;
+    }
+
+    return (zip_int64_t)i;
+}
+
+
 bool
 _zip_win32_op_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
     LARGE_INTEGER li;
@@ -49,6 +49,9 @@
 
 #include "zip_source_file.h"
 
+/* largest number of bytes passed to ReadFile or WriteFile at once */
+#define ZIP_WIN32_MAX_TRANSFER ((DWORD)1 << 30)
+
 struct zip_win32_file_operations {
     char *(*allocate_tempname)(const char *name, size_t extra_chars, size_t *lengthp);
     HANDLE(__stdcall *create_file)(const void *name, DWORD access, DWORD share_mode, PSECURITY_ATTRIBUTES security_attributes, DWORD creation_disposition, DWORD file_attributes, HANDLE template_file);
@@ -67,6 +70,7 @@ extern zip_source_file_operations_t _zip_source_file_win32_named_ops;
 
 void _zip_win32_op_close(zip_source_file_context_t *ctx);
 zip_int64_t _zip_win32_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+zip_int64_t _zip_win32_op_read_at(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len, zip_uint64_t offset, zip_error_t *error);
 bool _zip_win32_op_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
 zip_int64_t _zip_win32_op_tell(zip_source_file_context_t *ctx, void *f);
 
@@ -77,7 +77,7 @@ zip_source_win32a_create(const char *fname, zip_uint64_t start, zip_int64_t leng
 static char *
 ansi_allocate_tempname(const char *name, size_t extra_chars, size_t *lengthp) {
     *lengthp = strlen(name) + extra_chars;
-    return (char *)malloc(*lengthp);
+    return (char *)_zip_malloc(*lengthp);
 }
 
 
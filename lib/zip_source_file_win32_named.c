@@ -33,9 +33,27 @@
 
 #include "zip_source_file_win32.h"
 
+#include <winioctl.h>
+
+/* block cloning (ReFS, Dev Drive) needs headers for Windows Server 2016 / Windows 10 or later */
+#if defined(FSCTL_DUPLICATE_EXTENTS_TO_FILE) && defined(FILE_SUPPORTS_BLOCK_REFCOUNTING) && !defined(MS_UWP)
+#define CAN_CLONE
+#endif
+
+/* SetFileInformationByHandle needs Windows Vista */
+#if _WIN32_WINNT >= 0x0600
+#define CAN_PREALLOCATE
+#endif
+
 static zip_int64_t _zip_win32_named_op_commit_write(zip_source_file_context_t *ctx);
 static zip_int64_t _zip_win32_named_op_create_temp_output(zip_source_file_context_t *ctx);
+#ifdef CAN_CLONE
+static zip_int64_t _zip_win32_named_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uint64_t offset);
+#endif
 static bool _zip_win32_named_op_open(zip_source_file_context_t *ctx);
+#ifdef CAN_PREALLOCATE
+static void _zip_win32_named_op_preallocate(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len);
+#endif
 static zip_int64_t _zip_win32_named_op_remove(zip_source_file_context_t *ctx);
 static void _zip_win32_named_op_rollback_write(zip_source_file_context_t *ctx);
 static bool _zip_win32_named_op_stat(zip_source_file_context_t *ctx, zip_source_file_stat_t *st);
@@ -48,17 +66,33 @@ static HANDLE win32_named_open(zip_source_file_context_t *ctx, const char *name,
 zip_source_file_operations_t _zip_source_file_win32_named_ops = {
     _zip_win32_op_close,
     _zip_win32_named_op_commit_write,
+    NULL,
+    NULL,
     _zip_win32_named_op_create_temp_output,
+#ifdef CAN_CLONE
+    _zip_win32_named_op_create_temp_output_cloning,
+#else
+    NULL,
+#endif
     NULL,
     _zip_win32_named_op_open,
+    NULL,
+#ifdef CAN_PREALLOCATE
+    _zip_win32_named_op_preallocate,
+#else
+    NULL,
+#endif
+    NULL,
     _zip_win32_op_read,
+    _zip_win32_op_read_at,
     _zip_win32_named_op_remove,
     _zip_win32_named_op_rollback_write,
     _zip_win32_op_seek,
     _zip_win32_named_op_stat,
     _zip_win32_named_op_string_duplicate,
     _zip_win32_op_tell,
-    _zip_win32_named_op_write
+    _zip_win32_named_op_write,
+    NULL
 };
 /* clang-format on */
 
@@ -139,7 +173,7 @@ _zip_win32_named_op_create_temp_output(zip_source_file_context_t *ctx) {
     }
 
     if (th == INVALID_HANDLE_VALUE) {
-        free(tempname);
+        _zip_free(tempname);
         LocalFree(psd);
         zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, _zip_win32_error_to_errno(GetLastError()));
         return -1;
@@ -153,6 +187,87 @@ _zip_win32_named_op_create_temp_output(zip_source_file_context_t *ctx) {
 }
 
 
+#ifdef CAN_CLONE
+/* Create temporary output sharing the clusters of the first offset bytes of the archive with it. Fails if the volume
+   doesn't support block cloning, in which case the caller copies the data instead. */
+static zip_int64_t
+_zip_win32_named_op_create_temp_output_cloning(zip_source_file_context_t *ctx, zip_uint64_t offset) {
+    zip_win32_file_operations_t *file_ops = (zip_win32_file_operations_t *)ctx->ops_userdata;
+    DWORD fs_flags, n;
+    FSCTL_GET_INTEGRITY_INFORMATION_BUFFER integrity;
+    FSCTL_SET_INTEGRITY_INFORMATION_BUFFER set_integrity;
+    DUPLICATE_EXTENTS_DATA duplicate;
+    FILE_END_OF_FILE_INFO eof;
+    zip_uint64_t length;
+
+    if (offset > ZIP_INT64_MAX) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, E2BIG);
+        return -1;
+    }
+
+    if (!GetVolumeInformationByHandleW((HANDLE)ctx->f, NULL, 0, NULL, NULL, &fs_flags, NULL, 0)) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, _zip_win32_error_to_errno(GetLastError()));
+        return -1;
+    }
+    if ((fs_flags & FILE_SUPPORTS_BLOCK_REFCOUNTING) == 0) {
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+    /* also gives the cluster size, to which cloned ranges must be aligned */
+    if (!DeviceIoControl((HANDLE)ctx->f, FSCTL_GET_INTEGRITY_INFORMATION, NULL, 0, &integrity, sizeof(integrity), &n, NULL) || integrity.ClusterSizeInBytes == 0) {
+        zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, _zip_win32_error_to_errno(GetLastError()));
+        return -1;
+    }
+
+    if (_zip_win32_named_op_create_temp_output(ctx) < 0) {
+        return -1;
+    }
+
+    /* source and target must agree on integrity streams */
+    set_integrity.ChecksumAlgorithm = integrity.ChecksumAlgorithm;
+    set_integrity.Reserved = 0;
+    set_integrity.Flags = integrity.Flags;
+    if (!DeviceIoControl((HANDLE)ctx->fout, FSCTL_SET_INTEGRITY_INFORMATION, &set_integrity, sizeof(set_integrity), NULL, 0, &n, NULL)) {
+        goto fail;
+    }
+
+    length = ((offset + integrity.ClusterSizeInBytes - 1) / integrity.ClusterSizeInBytes) * integrity.ClusterSizeInBytes;
+    if (length > 0) {
+        /* target range must exist before cloning into it */
+        eof.EndOfFile.QuadPart = (LONGLONG)length;
+        if (!SetFileInformationByHandle((HANDLE)ctx->fout, FileEndOfFileInfo, &eof, sizeof(eof))) {
+            goto fail;
+        }
+
+        duplicate.FileHandle = (HANDLE)ctx->f;
+        duplicate.SourceFileOffset.QuadPart = 0;
+        duplicate.TargetFileOffset.QuadPart = 0;
+        duplicate.ByteCount.QuadPart = (LONGLONG)length;
+        if (!DeviceIoControl((HANDLE)ctx->fout, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &duplicate, sizeof(duplicate), NULL, 0, &n, NULL)) {
+            goto fail;
+        }
+    }
+
+    /* cut off the rest of the last cluster, new data is written from offset on */
+    eof.EndOfFile.QuadPart = (LONGLONG)offset;
+    if (!SetFileInformationByHandle((HANDLE)ctx->fout, FileEndOfFileInfo, &eof, sizeof(eof)) || !_zip_win32_op_seek(ctx, ctx->fout, (zip_int64_t)offset, SEEK_SET)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    zip_error_set(&ctx->error, ZIP_ER_TMPOPEN, _zip_win32_error_to_errno(GetLastError()));
+    CloseHandle((HANDLE)ctx->fout);
+    file_ops->delete_file(ctx->tmpname);
+    _zip_free(ctx->tmpname);
+    ctx->tmpname = NULL;
+    ctx->fout = NULL;
+    return -1;
+}
+#endif
+
+
 static bool
 _zip_win32_named_op_open(zip_source_file_context_t *ctx) {
     HANDLE h = win32_named_open(ctx, ctx->fname, false, NULL);
@@ -166,6 +281,23 @@ _zip_win32_named_op_open(zip_source_file_context_t *ctx) {
 }
 
 
+#ifdef CAN_PREALLOCATE
+/* Sets allocation size, not end of file, so nothing needs to be cut off when committing. */
+static void
+_zip_win32_named_op_preallocate(zip_source_file_context_t *ctx, zip_uint64_t offset, zip_uint64_t len) {
+    FILE_ALLOCATION_INFO info;
+
+    if (offset > ZIP_INT64_MAX || len > ZIP_INT64_MAX - offset) {
+        return;
+    }
+
+    /* only a hint, failure doesn't matter */
+    info.AllocationSize.QuadPart = (LONGLONG)(offset + len);
+    (void)SetFileInformationByHandle((HANDLE)ctx->fout, FileAllocationInfo, &info, sizeof(info));
+}
+#endif
+
+
 static zip_int64_t
 _zip_win32_named_op_remove(zip_source_file_context_t *ctx) {
     zip_win32_file_operations_t *file_ops = (zip_win32_file_operations_t *)ctx->ops_userdata;
@@ -237,13 +369,20 @@ _zip_win32_named_op_string_duplicate(zip_source_file_context_t *ctx, const char
 
 static zip_int64_t
 _zip_win32_named_op_write(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len) {
-    DWORD ret;
-    if (!WriteFile((HANDLE)ctx->fout, data, (DWORD)len, &ret, NULL) || ret != len) {
-        zip_error_set(&ctx->error, ZIP_ER_WRITE, _zip_win32_error_to_errno(GetLastError()));
-        return -1;
+    const zip_uint8_t *p = (const zip_uint8_t *)data;
+    zip_uint64_t done = 0;
+    DWORD n, ret;
+
+    while (done < len) {
+        n = (DWORD)ZIP_MIN(len - done, ZIP_WIN32_MAX_TRANSFER);
+        if (!WriteFile((HANDLE)ctx->fout, p + done, n, &ret, NULL) || ret != n) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, _zip_win32_error_to_errno(GetLastError()));
+            return -1;
+        }
+        done += ret;
     }
 
-    return (zip_int64_t)ret;
+    return (zip_int64_t)done;
 }
 
 
@@ -257,6 +396,10 @@ win32_named_open(zip_source_file_context_t *ctx, const char *name, bool temporar
     DWORD file_attributes = FILE_ATTRIBUTE_NORMAL;
     HANDLE h;
 
+    if (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK)) {
+        /* only read with positional reads, which can then run in parallel */
+        file_attributes |= FILE_FLAG_OVERLAPPED;
+    }
     if (temporary) {
         access = GENERIC_READ | GENERIC_WRITE;
         share_mode = FILE_SHARE_READ;
@@ -80,7 +80,7 @@ zip_source_win32w_create(const wchar_t *fname, zip_uint64_t start, zip_int64_t l
 static char *
 utf16_allocate_tempname(const char *name, size_t extra_chars, size_t *lengthp) {
     *lengthp = wcslen((const wchar_t *)name) + extra_chars;
-    return (char *)malloc(*lengthp * sizeof(wchar_t));
+    return (char *)_zip_malloc(*lengthp * sizeof(wchar_t));
 }
 
 
@@ -60,7 +60,7 @@ zip_source_file_create(const char *fname, zip_uint64_t start, zip_int64_t length
         zip_error_set(error, ZIP_ER_INVAL, 0);
         return NULL;
     }
-    if ((wfname = (wchar_t *)malloc(sizeof(wchar_t) * size)) == NULL) {
+    if ((wfname = (wchar_t *)_zip_malloc(sizeof(wchar_t) * size)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -68,6 +68,6 @@ zip_source_file_create(const char *fname, zip_uint64_t start, zip_int64_t length
 
     source = zip_source_win32w_create(wfname, start, length, error);
 
-    free(wfname);
+    _zip_free(wfname);
     return source;
 }
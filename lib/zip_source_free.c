@@ -42,10 +42,7 @@ zip_source_free(zip_source_t *src) {
     if (src == NULL)
         return;
 
-    if (src->refcount > 0) {
-        src->refcount--;
-    }
-    if (src->refcount > 0) {
+    if (ZIP_REFCOUNT_GET(src->refcount) > 0 && ZIP_REFCOUNT_DECREMENT(src->refcount) > 0) {
         return;
     }
 
@@ -67,5 +64,5 @@ zip_source_free(zip_source_t *src) {
         zip_source_free(src->src);
     }
 
-    free(src);
+    _zip_free(src);
 }
@@ -69,7 +69,7 @@ zip_source_function_create(zip_source_callback zcb, void *ud, zip_error_t *error
 
 ZIP_EXTERN void
 zip_source_keep(zip_source_t *src) {
-    src->refcount++;
+    ZIP_REFCOUNT_INCREMENT(src->refcount);
 }
 
 
@@ -77,7 +77,7 @@ zip_source_t *
 _zip_source_new(zip_error_t *error) {
     zip_source_t *src;
 
-    if ((src = (zip_source_t *)malloc(sizeof(*src))) == NULL) {
+    if ((src = (zip_source_t *)_zip_malloc(sizeof(*src))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -89,11 +89,16 @@ _zip_source_new(zip_error_t *error) {
     src->write_state = ZIP_SOURCE_WRITE_CLOSED;
     src->source_closed = false;
     src->source_archive = NULL;
-    src->refcount = 1;
+    ZIP_REFCOUNT_INIT(src->refcount, 1);
     zip_error_init(&src->error);
     src->eof = false;
     src->had_read_error = false;
+    src->would_block = false;
     src->bytes_read = 0;
+    src->bytes_written = 0;
+    src->generation = 1;
+    src->stat_generation = 0;
+    src->attributes_generation = 0;
 
     return src;
 }
@@ -49,6 +49,11 @@ zip_source_get_file_attributes(zip_source_t *src, zip_file_attributes_t *attribu
         return -1;
     }
 
+    if (src->attributes_generation == _zip_source_generation(src)) {
+        (void)memcpy_s(attributes, sizeof(*attributes), &src->attributes, sizeof(src->attributes));
+        return 0;
+    }
+
     zip_file_attributes_init(attributes);
 
     if (src->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_GET_FILE_ATTRIBUTES)) {
@@ -104,5 +109,8 @@ zip_source_get_file_attributes(zip_source_t *src, zip_file_attributes_t *attribu
         }
     }
 
+    (void)memcpy_s(&src->attributes, sizeof(src->attributes), attributes, sizeof(*attributes));
+    src->attributes_generation = _zip_source_generation(src);
+
     return 0;
 }
@@ -0,0 +1,127 @@
+/*
+  zip_source_meter.c -- measure time spent in lower layers
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+struct context {
+    zip_stats_pipeline_t *pipeline;
+    zip_uint32_t phase;
+};
+typedef struct context meter_t;
+
+static zip_int64_t meter(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+
+
+/* Create layered source that adds time spent reading src and data read from it to phase of pipeline.
+   Time spent in meters below src in the same pipeline is not counted again. */
+zip_source_t *
+_zip_source_meter_new(zip_source_t *src, zip_stats_pipeline_t *pipeline, zip_uint32_t phase, zip_error_t *error) {
+    meter_t *ctx;
+    zip_source_t *s2;
+
+    if (src == NULL || pipeline == NULL || phase >= ZIP_PHASE_COUNT) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((ctx = (meter_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    ctx->pipeline = pipeline;
+    ctx->phase = phase;
+
+    if ((s2 = zip_source_layered_create(src, meter, ctx, error)) == NULL) {
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    pipeline->below[phase] = pipeline->top_phase;
+    pipeline->top_phase = (int)phase;
+
+    return s2;
+}
+
+
+static zip_int64_t
+meter(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    meter_t *ctx = (meter_t *)ud;
+    zip_phase_stats_t *stats = ctx->pipeline->phase + ctx->phase;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN:
+        stats->count++;
+        return 0;
+
+    case ZIP_SOURCE_READ: {
+        zip_uint64_t accounted = ctx->pipeline->accounted;
+        zip_uint64_t start = _zip_stats_time();
+        zip_uint64_t elapsed;
+        zip_int64_t n;
+
+        n = zip_source_read(src, data, length);
+        elapsed = _zip_stats_time() - start;
+        /* inner meters added their share to accounted */
+        stats->wall_time += elapsed - ZIP_MIN(elapsed, ctx->pipeline->accounted - accounted);
+        ctx->pipeline->accounted = accounted + elapsed;
+        if (n > 0) {
+            stats->bytes_out += (zip_uint64_t)n;
+        }
+        return n;
+    }
+
+    case ZIP_SOURCE_ERROR:
+        /* all errors come from lower source */
+        return zip_error_to_data(zip_source_error(src), data, length);
+
+    case ZIP_SOURCE_FREE:
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS: {
+        zip_int64_t mask = zip_source_pass_to_lower_layer(src, data, length, cmd);
+
+        if (mask < 0) {
+            return mask;
+        }
+        return mask | zip_source_make_command_bitmap(ZIP_SOURCE_FREE, -1);
+    }
+
+    default:
+        return zip_source_pass_to_lower_layer(src, data, length, cmd);
+    }
+}
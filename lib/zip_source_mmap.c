@@ -0,0 +1,377 @@
+/*
+  zip_source_mmap.c -- create data source from memory mapped file
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+#if defined(_WIN32)
+#if !defined(MS_UWP)
+#include "zip_source_file_win32.h"
+#define HAVE_MAPPING
+#endif
+#elif defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#define HAVE_MAPPING
+#endif
+
+struct mmap_ctx {
+    zip_error_t error;
+    void *map;                /* start of mapping, NULL for empty file */
+    zip_uint64_t map_size;    /* size of mapping */
+#if defined(_WIN32) && defined(HAVE_MAPPING)
+    HANDLE mapping;
+#endif
+    const zip_uint8_t *data;  /* start of data */
+    zip_uint64_t size;        /* size of data */
+    zip_uint64_t offset;      /* current read position */
+    zip_stat_t st;
+};
+
+typedef struct mmap_ctx mmap_ctx_t;
+
+static bool mmap_map(mmap_ctx_t *ctx, const char *fname, zip_error_t *error);
+static void mmap_unmap(mmap_ctx_t *ctx);
+static zip_int64_t read_mmap(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_mmap(zip_t *za, const char *fname, zip_uint64_t start, zip_int64_t len) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_mmap_create(fname, start, len, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_mmap_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_error_t *error) {
+    mmap_ctx_t *ctx;
+    zip_source_t *zs;
+
+    if (fname == NULL || length < -1) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((ctx = (mmap_ctx_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    zip_error_init(&ctx->error);
+    ctx->map = NULL;
+    ctx->map_size = 0;
+    ctx->offset = 0;
+
+    if (!mmap_map(ctx, fname, error)) {
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    if (start > ctx->map_size || (length > 0 && (zip_uint64_t)length > ctx->map_size - start)) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        mmap_unmap(ctx);
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    ctx->data = (const zip_uint8_t *)ctx->map + start;
+    ctx->size = (length <= 0) ? ctx->map_size - start : (zip_uint64_t)length;
+
+    ctx->st.valid |= ZIP_STAT_SIZE;
+    ctx->st.size = ctx->size;
+
+    if ((zs = zip_source_function_create(read_mmap, ctx, error)) == NULL) {
+        mmap_unmap(ctx);
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    return zs;
+}
+
+
+static zip_int64_t
+read_mmap(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    mmap_ctx_t *ctx = (mmap_ctx_t *)state;
+
+    switch (cmd) {
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, len);
+
+    case ZIP_SOURCE_FREE:
+        mmap_unmap(ctx);
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_GET_DATA: {
+        zip_source_args_get_data_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_get_data_t, data, len, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (args->offset > ctx->size || args->length > ctx->size - args->offset) {
+            zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+
+        args->data = ctx->size > 0 ? ctx->data + args->offset : (const zip_uint8_t *)"";
+        return 0;
+    }
+
+    case ZIP_SOURCE_OPEN:
+        ctx->offset = 0;
+        return 0;
+
+    case ZIP_SOURCE_READ:
+        if (len > ctx->size - ctx->offset) {
+            len = ctx->size - ctx->offset;
+        }
+        if (len > ZIP_INT64_MAX) {
+            len = ZIP_INT64_MAX;
+        }
+        if (len > 0) {
+            (void)memcpy_s(data, (size_t)len, ctx->data + ctx->offset, (size_t)len);
+            ctx->offset += len;
+        }
+        return (zip_int64_t)len;
+
+    case ZIP_SOURCE_READ_AT: {
+        zip_source_args_read_at_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_read_at_t, data, len, &ctx->error);
+        zip_uint64_t length;
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (args->offset >= ctx->size) {
+            return 0;
+        }
+
+        length = ZIP_MIN(args->length, ctx->size - args->offset);
+        if (length > ZIP_INT64_MAX) {
+            length = ZIP_INT64_MAX;
+        }
+        (void)memcpy_s(args->data, (size_t)length, ctx->data + args->offset, (size_t)length);
+        return (zip_int64_t)length;
+    }
+
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->size, data, len, &ctx->error);
+
+        if (new_offset < 0) {
+            return -1;
+        }
+
+        ctx->offset = (zip_uint64_t)new_offset;
+        return 0;
+    }
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st;
+
+        if ((st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, len, &ctx->error)) == NULL) {
+            return -1;
+        }
+
+        memcpy(st, &ctx->st, sizeof(*st));
+        return 0;
+    }
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_GET_DATA, ZIP_SOURCE_READ_AT, -1);
+
+    case ZIP_SOURCE_TELL:
+        if (ctx->offset > ZIP_INT64_MAX) {
+            zip_error_set(&ctx->error, ZIP_ER_TELL, EOVERFLOW);
+            return -1;
+        }
+        return (zip_int64_t)ctx->offset;
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+
+#if defined(_WIN32) && defined(HAVE_MAPPING)
+
+static bool
+mmap_map(mmap_ctx_t *ctx, const char *fname, zip_error_t *error) {
+    HANDLE h;
+    LARGE_INTEGER size;
+    FILETIME mtimeft;
+    time_t mtime;
+    wchar_t *wname;
+    int len;
+
+    zip_stat_init(&ctx->st);
+    ctx->mapping = NULL;
+
+    /* convert UTF-8 file name to wide characters, like zip_source_file_create */
+    if ((len = MultiByteToWideChar(CP_UTF8, 0, fname, -1, NULL, 0)) == 0) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+    if ((wname = (wchar_t *)_zip_malloc(sizeof(wchar_t) * (size_t)len)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    MultiByteToWideChar(CP_UTF8, 0, fname, -1, wname, len);
+
+    h = CreateFileW(wname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    _zip_free(wname);
+    if (h == INVALID_HANDLE_VALUE) {
+        zip_error_set(error, ZIP_ER_OPEN, _zip_win32_error_to_errno(GetLastError()));
+        return false;
+    }
+
+    if (!GetFileSizeEx(h, &size) || !GetFileTime(h, NULL, NULL, &mtimeft)) {
+        zip_error_set(error, ZIP_ER_READ, _zip_win32_error_to_errno(GetLastError()));
+        CloseHandle(h);
+        return false;
+    }
+    if (_zip_filetime_to_time_t(mtimeft, &mtime)) {
+        ctx->st.valid |= ZIP_STAT_MTIME;
+        ctx->st.mtime = mtime;
+    }
+
+    ctx->map_size = (zip_uint64_t)size.QuadPart;
+    if (ctx->map_size > 0) {
+        if ((ctx->mapping = CreateFileMappingW(h, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL || (ctx->map = MapViewOfFile(ctx->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL) {
+            zip_error_set(error, ZIP_ER_READ, _zip_win32_error_to_errno(GetLastError()));
+            if (ctx->mapping != NULL) {
+                CloseHandle(ctx->mapping);
+            }
+            CloseHandle(h);
+            return false;
+        }
+    }
+
+    CloseHandle(h);
+    return true;
+}
+
+
+static void
+mmap_unmap(mmap_ctx_t *ctx) {
+    if (ctx->map != NULL) {
+        UnmapViewOfFile(ctx->map);
+        CloseHandle(ctx->mapping);
+    }
+    ctx->map = NULL;
+}
+
+#elif defined(HAVE_MAPPING)
+
+static bool
+mmap_map(mmap_ctx_t *ctx, const char *fname, zip_error_t *error) {
+    struct stat sb;
+    int fd;
+
+    zip_stat_init(&ctx->st);
+
+    if ((fd = open(fname, O_RDONLY)) < 0) {
+        zip_error_set(error, ZIP_ER_OPEN, errno);
+        return false;
+    }
+
+    if (fstat(fd, &sb) < 0) {
+        zip_error_set(error, ZIP_ER_READ, errno);
+        close(fd);
+        return false;
+    }
+
+    if (!S_ISREG(sb.st_mode) || (zip_uint64_t)sb.st_size > SIZE_MAX) {
+        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+        close(fd);
+        return false;
+    }
+
+    ctx->st.valid |= ZIP_STAT_MTIME;
+    ctx->st.mtime = sb.st_mtime;
+
+    ctx->map_size = (zip_uint64_t)sb.st_size;
+    if (ctx->map_size > 0) {
+        void *map = mmap(NULL, (size_t)ctx->map_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (map == MAP_FAILED) {
+            zip_error_set(error, ZIP_ER_READ, errno);
+            close(fd);
+            return false;
+        }
+        ctx->map = map;
+    }
+
+    close(fd);
+    return true;
+}
+
+
+static void
+mmap_unmap(mmap_ctx_t *ctx) {
+    if (ctx->map != NULL) {
+        munmap(ctx->map, (size_t)ctx->map_size);
+    }
+    ctx->map = NULL;
+}
+
+#else
+
+static bool
+mmap_map(mmap_ctx_t *ctx, const char *fname, zip_error_t *error) {
+    (void)ctx;
+    (void)fname;
+    zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+    return false;
+}
+
+
+static void
+mmap_unmap(mmap_ctx_t *ctx) {
+    (void)ctx;
+}
+
+#endif
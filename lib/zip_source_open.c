@@ -68,6 +68,7 @@ zip_source_open(zip_source_t *src) {
 
     src->eof = false;
     src->had_read_error = false;
+    src->would_block = false;
     _zip_error_clear(&src->error);
     src->bytes_read = 0;
     src->open_count++;
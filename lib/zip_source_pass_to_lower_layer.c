@@ -69,7 +69,8 @@ zip_int64_t zip_source_pass_to_lower_layer(zip_source_t *src, void *data, zip_ui
             zip_error_set(&src->error, ZIP_ER_INTERNAL, 0);
             return -1;
         }
-        return *(zip_int64_t *)data;
+        /* data is transformed by the layer, so it can't be accessed directly */
+        return *(zip_int64_t *)data & ~zip_source_make_command_bitmap(ZIP_SOURCE_GET_DATA, ZIP_SOURCE_READ_AT, -1);
 
     default:
         zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
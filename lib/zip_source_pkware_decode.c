@@ -191,14 +191,14 @@ static struct trad_pkware *
 trad_pkware_new(const char *password, zip_error_t *error) {
     struct trad_pkware *ctx;
 
-    if ((ctx = (struct trad_pkware *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct trad_pkware *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
-    if ((ctx->password = strdup(password)) == NULL) {
+    if ((ctx->password = _zip_strdup(password)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
-        free(ctx);
+        _zip_free(ctx);
         return NULL;
     }
 
@@ -214,6 +214,6 @@ trad_pkware_free(struct trad_pkware *ctx) {
         return;
     }
 
-    free(ctx->password);
-    free(ctx);
+    _zip_free(ctx->password);
+    _zip_free(ctx);
 }
@@ -226,14 +226,14 @@ static struct trad_pkware *
 trad_pkware_new(const char *password, zip_error_t *error) {
     struct trad_pkware *ctx;
 
-    if ((ctx = (struct trad_pkware *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct trad_pkware *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
-    if ((ctx->password = strdup(password)) == NULL) {
+    if ((ctx->password = _zip_strdup(password)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
-        free(ctx);
+        _zip_free(ctx);
         return NULL;
     }
     ctx->buffer = NULL;
@@ -251,10 +251,10 @@ trad_pkware_free(struct trad_pkware *ctx) {
         return;
     }
 
-    free(ctx->password);
+    _zip_free(ctx->password);
     _zip_buffer_free(ctx->buffer);
     zip_error_fini(&ctx->error);
-    free(ctx);
+    _zip_free(ctx);
 }
 
 
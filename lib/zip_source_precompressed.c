@@ -0,0 +1,117 @@
+/*
+  zip_source_precompressed.c -- provide already compressed data
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+struct context {
+    zip_uint16_t method;
+    zip_uint64_t size;
+    zip_uint32_t crc;
+};
+typedef struct context precompressed_t;
+
+static zip_int64_t precompressed(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_precompressed(zip_t *za, zip_source_t *src, zip_int32_t method, zip_uint64_t size, zip_uint32_t crc) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_precompressed_create(src, method, size, crc, &za->error);
+}
+
+
+/* Create layered source that reports the data of src as compressed with method, with uncompressed size and CRC as given.
+   zip_close() copies it into the archive as is unless a different compression method or encryption is requested for the entry. */
+ZIP_EXTERN zip_source_t *
+zip_source_precompressed_create(zip_source_t *src, zip_int32_t method, zip_uint64_t size, zip_uint32_t crc, zip_error_t *error) {
+    precompressed_t *ctx;
+    zip_source_t *s2;
+
+    if (src == NULL || method < 0 || method > ZIP_UINT16_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((ctx = (precompressed_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    ctx->method = (zip_uint16_t)method;
+    ctx->size = size;
+    ctx->crc = crc;
+
+    if ((s2 = zip_source_layered_create(src, precompressed, ctx, error)) == NULL) {
+        _zip_free(ctx);
+        return NULL;
+    }
+
+    return s2;
+}
+
+
+static zip_int64_t
+precompressed(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    precompressed_t *ctx = (precompressed_t *)ud;
+
+    switch (cmd) {
+    case ZIP_SOURCE_FREE:
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st = (zip_stat_t *)data;
+
+        /* size of lower source is size of compressed data */
+        if (st->valid & ZIP_STAT_SIZE) {
+            st->comp_size = st->size;
+            st->valid |= ZIP_STAT_COMP_SIZE;
+        }
+        st->size = ctx->size;
+        st->crc = ctx->crc;
+        st->comp_method = ctx->method;
+        st->valid |= ZIP_STAT_SIZE | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD;
+        return 0;
+    }
+
+    default:
+        return zip_source_pass_to_lower_layer(src, data, length, cmd);
+    }
+}
@@ -60,9 +60,18 @@ zip_source_read(zip_source_t *src, void *data, zip_uint64_t len) {
         return 0;
     }
 
+    src->would_block = false;
     bytes_read = 0;
     while (bytes_read < len) {
         if ((n = _zip_source_call(src, (zip_uint8_t *)data + bytes_read, len - bytes_read, ZIP_SOURCE_READ)) < 0) {
+            if (zip_error_code_zip(&src->error) == ZIP_ER_AGAIN) {
+                /* no more data available yet, reading can be resumed later */
+                src->would_block = true;
+                if (bytes_read == 0) {
+                    return -1;
+                }
+                break;
+            }
             src->had_read_error = true;
             if (bytes_read == 0) {
                 return -1;
@@ -94,3 +103,9 @@ bool
 _zip_source_eof(zip_source_t *src) {
     return src->eof;
 }
+
+
+bool
+_zip_source_would_block(zip_source_t *src) {
+    return src->would_block;
+}
@@ -0,0 +1,233 @@
+/*
+  zip_source_read_ahead.c -- read lower source ahead in worker thread
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+struct context {
+    zip_thread_job_t job;
+    zip_thread_pool_t *pool;
+    zip_source_t *src; /* lower source, read by job */
+
+    zip_uint8_t *buffer[2];
+    zip_uint64_t buffer_size;
+    int current;         /* buffer data is returned from, job reads into the other one */
+    zip_uint64_t length; /* amount of data in current buffer */
+    zip_uint64_t offset; /* amount of data in current buffer already returned */
+    bool in_flight;      /* job submitted but not waited for */
+    bool eof;            /* lower source is exhausted */
+    zip_int64_t n;       /* result of read done by job */
+
+    zip_error_t error;
+};
+typedef struct context read_ahead_t;
+
+static void context_free(read_ahead_t *ctx);
+static int next_buffer(read_ahead_t *ctx);
+static void read_job(void *ud);
+static zip_int64_t read_ahead(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+static void settle(read_ahead_t *ctx);
+
+
+/* Create layered source that reads src in buffer_size chunks in a worker thread, one chunk ahead of the data returned.
+   src must not be used by other threads, and only sequential reading is supported. */
+zip_source_t *
+_zip_source_read_ahead_new(zip_source_t *src, zip_uint64_t buffer_size, zip_error_t *error) {
+    read_ahead_t *ctx;
+    zip_source_t *s2;
+
+    if (src == NULL || buffer_size == 0 || buffer_size > SIZE_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((ctx = (read_ahead_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    ctx->job.run = read_job;
+    ctx->job.ud = ctx;
+    ctx->src = src;
+    ctx->buffer_size = buffer_size;
+    ctx->in_flight = false;
+    zip_error_init(&ctx->error);
+    ctx->buffer[0] = (zip_uint8_t *)_zip_malloc((size_t)buffer_size);
+    ctx->buffer[1] = (zip_uint8_t *)_zip_malloc((size_t)buffer_size);
+    if (ctx->buffer[0] == NULL || ctx->buffer[1] == NULL) {
+        ctx->pool = NULL;
+        context_free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((ctx->pool = _zip_thread_pool_new(1, error)) == NULL) {
+        context_free(ctx);
+        return NULL;
+    }
+
+    if ((s2 = zip_source_layered_create(src, read_ahead, ctx, error)) == NULL) {
+        context_free(ctx);
+        return NULL;
+    }
+
+    return s2;
+}
+
+
+static void
+context_free(read_ahead_t *ctx) {
+    settle(ctx);
+    _zip_thread_pool_free(ctx->pool);
+    _zip_free(ctx->buffer[0]);
+    _zip_free(ctx->buffer[1]);
+    zip_error_fini(&ctx->error);
+    _zip_free(ctx);
+}
+
+
+/* Wait for job reading the next chunk, make it current and start reading the one after it. */
+static int
+next_buffer(read_ahead_t *ctx) {
+    if (!ctx->in_flight) {
+        ctx->in_flight = true;
+        _zip_thread_pool_submit(ctx->pool, &ctx->job);
+    }
+    settle(ctx);
+
+    if (ctx->n < 0) {
+        zip_error_set_from_source(&ctx->error, ctx->src);
+        return -1;
+    }
+
+    ctx->current = 1 - ctx->current;
+    ctx->length = (zip_uint64_t)ctx->n;
+    ctx->offset = 0;
+    /* a short read can also mean an error, which the next read reports */
+    ctx->eof = ctx->n == 0 || _zip_source_eof(ctx->src);
+
+    if (!ctx->eof) {
+        ctx->in_flight = true;
+        _zip_thread_pool_submit(ctx->pool, &ctx->job);
+    }
+
+    return 0;
+}
+
+
+static void
+read_job(void *ud) {
+    read_ahead_t *ctx = (read_ahead_t *)ud;
+
+    ctx->n = zip_source_read(ctx->src, ctx->buffer[1 - ctx->current], ctx->buffer_size);
+}
+
+
+/* Wait for outstanding job, so lower source can be used by calling thread. */
+static void
+settle(read_ahead_t *ctx) {
+    if (ctx->in_flight) {
+        _zip_thread_pool_wait(ctx->pool, &ctx->job);
+        ctx->in_flight = false;
+    }
+}
+
+
+static zip_int64_t
+read_ahead(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    read_ahead_t *ctx = (read_ahead_t *)ud;
+
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN:
+        ctx->current = 0;
+        ctx->length = 0;
+        ctx->offset = 0;
+        ctx->eof = false;
+        return 0;
+
+    case ZIP_SOURCE_READ: {
+        zip_uint64_t total = 0;
+
+        while (total < length) {
+            zip_uint64_t n;
+
+            if (ctx->offset == ctx->length) {
+                if (ctx->eof) {
+                    break;
+                }
+                if (next_buffer(ctx) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+
+            n = ZIP_MIN(length - total, ctx->length - ctx->offset);
+            memcpy((zip_uint8_t *)data + total, ctx->buffer[ctx->current] + ctx->offset, (size_t)n);
+            ctx->offset += n;
+            total += n;
+        }
+
+        return (zip_int64_t)total;
+    }
+
+    case ZIP_SOURCE_CLOSE:
+        settle(ctx);
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        context_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS: {
+        zip_int64_t mask = zip_source_supports(src);
+
+        if (mask < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+
+        return mask & zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_GET_FILE_ATTRIBUTES, -1);
+    }
+
+    default:
+        /* job must not use lower source concurrently */
+        settle(ctx);
+        return zip_source_pass_to_lower_layer(src, data, length, cmd);
+    }
+}
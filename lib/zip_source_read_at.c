@@ -0,0 +1,76 @@
+/*
+  zip_source_read_at.c -- read data at offset
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+
+/* Read up to length bytes at offset, without changing the read position of src. */
+zip_int64_t
+zip_source_read_at(zip_source_t *src, zip_uint64_t offset, void *data, zip_uint64_t length) {
+    zip_source_args_read_at_t args;
+    zip_uint64_t bytes_read;
+    zip_int64_t n;
+
+    if (src->source_closed) {
+        return -1;
+    }
+    if (!ZIP_SOURCE_IS_OPEN_READING(src) || length > ZIP_INT64_MAX || (length > 0 && data == NULL)) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    bytes_read = 0;
+    while (bytes_read < length) {
+        if (offset + bytes_read < offset) {
+            zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        args.offset = offset + bytes_read;
+        args.data = (zip_uint8_t *)data + bytes_read;
+        args.length = length - bytes_read;
+
+        if ((n = _zip_source_call(src, &args, sizeof(args), ZIP_SOURCE_READ_AT)) < 0) {
+            if (bytes_read == 0) {
+                return -1;
+            }
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        bytes_read += (zip_uint64_t)n;
+    }
+
+    return (zip_int64_t)bytes_read;
+}
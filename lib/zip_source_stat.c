@@ -49,6 +49,12 @@ zip_source_stat(zip_source_t *src, zip_stat_t *st) {
         zip_error_set(&src->error, ZIP_ER_READ, ENOENT);
     }
 
+    /* layers below are asked again for each layer, so reuse result while nothing has changed */
+    if (src->stat_generation == _zip_source_generation(src)) {
+        (void)memcpy_s(st, sizeof(*st), &src->stat, sizeof(src->stat));
+        return 0;
+    }
+
     zip_stat_init(st);
 
     if (ZIP_SOURCE_IS_LAYERED(src)) {
@@ -62,5 +68,8 @@ zip_source_stat(zip_source_t *src, zip_stat_t *st) {
         return -1;
     }
 
+    (void)memcpy_s(&src->stat, sizeof(src->stat), st, sizeof(*st));
+    src->stat_generation = _zip_source_generation(src);
+
     return 0;
 }
@@ -70,5 +70,6 @@ zip_source_make_command_bitmap(zip_source_cmd_t cmd0, ...) {
 
 
 ZIP_EXTERN int zip_source_is_seekable(zip_source_t *src) {
-    return ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(src->src), ZIP_SOURCE_SEEK);
+    /* sources not layered on another, like those reading shared or cached entry data, decide themselves */
+    return ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(ZIP_SOURCE_IS_LAYERED(src) ? src->src : src), ZIP_SOURCE_SEEK);
 }
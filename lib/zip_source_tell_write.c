@@ -47,5 +47,13 @@ zip_source_tell_write(zip_source_t *src) {
         return -1;
     }
 
+    if ((src->supports & (ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_TELL_WRITE) | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK_WRITE))) == 0) {
+        if (src->bytes_written > ZIP_INT64_MAX) {
+            zip_error_set(&src->error, ZIP_ER_TELL, EOVERFLOW);
+            return -1;
+        }
+        return (zip_int64_t)src->bytes_written;
+    }
+
     return _zip_source_call(src, NULL, 0, ZIP_SOURCE_TELL_WRITE);
 }
@@ -0,0 +1,443 @@
+/*
+  zip_source_volumes.c -- create data source from volumes of split archive
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* Data of the volumes of a split archive, one after the other. Offsets relative to a volume, as used in the central
+   directory of split archives, are converted with _zip_source_volumes_start. */
+
+struct volumes_ctx {
+    zip_error_t error;
+    zip_source_t **volumes;
+    zip_uint64_t nvolumes;
+    zip_uint64_t *starts; /* offset of each volume, followed by total size */
+    bool read_at;         /* all volumes can be read with _zip_source_file_read_at */
+    zip_uint64_t offset;  /* current read position */
+    zip_stat_t st;
+};
+
+typedef struct volumes_ctx volumes_ctx_t;
+
+static void volumes_close(volumes_ctx_t *ctx, zip_uint64_t n);
+static zip_uint64_t volumes_find(const volumes_ctx_t *ctx, zip_uint64_t offset);
+static void volumes_free(zip_source_t **volumes, zip_uint64_t n);
+static zip_source_t *volumes_new(zip_source_t **volumes, zip_uint64_t nvolumes, zip_error_t *error);
+static zip_int64_t volumes_read(volumes_ctx_t *ctx, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error);
+static zip_int64_t read_volumes(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd);
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_volumes(zip_t *za, const char *const *names, zip_uint64_t nvolumes) {
+    if (za == NULL) {
+        return NULL;
+    }
+
+    return zip_source_volumes_create(names, nvolumes, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_volumes_create(const char *const *names, zip_uint64_t nvolumes, zip_error_t *error) {
+    zip_source_t **volumes;
+    zip_uint64_t i;
+
+    if (names == NULL || nvolumes == 0 || nvolumes > ZIP_UINT32_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((volumes = (zip_source_t **)_zip_calloc((size_t)nvolumes, sizeof(volumes[0]))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    for (i = 0; i < nvolumes; i++) {
+        if (names[i] == NULL) {
+            zip_error_set(error, ZIP_ER_INVAL, 0);
+            volumes_free(volumes, i);
+            return NULL;
+        }
+        if ((volumes[i] = zip_source_file_create(names[i], 0, ZIP_LENGTH_TO_END, error)) == NULL) {
+            volumes_free(volumes, i);
+            return NULL;
+        }
+    }
+
+    return volumes_new(volumes, nvolumes, error);
+}
+
+
+/* Create source for split archive fname, whose other volumes are named like fname with extension .z01, .z02, and so on.
+   Sets error to ZIP_ER_MULTIDISK if there are no other volumes. */
+zip_source_t *
+_zip_source_volumes_new_split(const char *fname, zip_error_t *error) {
+    zip_source_t **volumes = NULL;
+    zip_uint64_t nvolumes = 0, alloc = 0;
+    size_t length = strlen(fname);
+    char *name;
+
+    /* name of volume n replaces "ip" of extension ".zip" */
+    if (length < 4 || fname[length - 4] != '.' || (fname[length - 3] != 'z' && fname[length - 3] != 'Z')) {
+        zip_error_set(error, ZIP_ER_MULTIDISK, 0);
+        return NULL;
+    }
+    if ((name = (char *)_zip_malloc(length + 9)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    (void)memcpy_s(name, length + 9, fname, length - 2);
+
+    for (;;) {
+        zip_source_t *src;
+        zip_stat_t st;
+        zip_error_t volume_error;
+
+        if (nvolumes == alloc) {
+            zip_uint64_t new_alloc = alloc > 0 ? alloc * 2 : 8;
+            zip_source_t **new_volumes;
+
+            if ((new_volumes = (zip_source_t **)_zip_realloc(volumes, (size_t)new_alloc * sizeof(volumes[0]))) == NULL) {
+                zip_error_set(error, ZIP_ER_MEMORY, 0);
+                volumes_free(volumes, nvolumes);
+                _zip_free(name);
+                return NULL;
+            }
+            volumes = new_volumes;
+            alloc = new_alloc;
+        }
+
+        if (nvolumes + 1 == ZIP_UINT32_MAX) {
+            break;
+        }
+        (void)snprintf_s(name + length - 2, 11, "%02u", (unsigned int)(nvolumes + 1));
+
+        /* first volume that doesn't exist ends the list */
+        zip_error_init(&volume_error);
+        if ((src = zip_source_file_create(name, 0, ZIP_LENGTH_TO_END, &volume_error)) == NULL || zip_source_stat(src, &st) < 0) {
+            zip_source_free(src);
+            zip_error_fini(&volume_error);
+            break;
+        }
+        zip_error_fini(&volume_error);
+        volumes[nvolumes++] = src;
+    }
+    _zip_free(name);
+
+    if (nvolumes == 0) {
+        zip_error_set(error, ZIP_ER_MULTIDISK, 0);
+        _zip_free(volumes);
+        return NULL;
+    }
+
+    /* archive file itself is last volume */
+    if ((volumes[nvolumes] = zip_source_file_create(fname, 0, ZIP_LENGTH_TO_END, error)) == NULL) {
+        volumes_free(volumes, nvolumes);
+        return NULL;
+    }
+
+    return volumes_new(volumes, nvolumes + 1, error);
+}
+
+
+/* Whether data of src can be read with _zip_source_volumes_read_at. */
+bool
+_zip_source_volumes_supports_read_at(zip_source_t *src) {
+    if (src->src != NULL || src->cb.f != read_volumes || !ZIP_SOURCE_IS_OPEN_READING(src)) {
+        return false;
+    }
+
+    return ((volumes_ctx_t *)src->ud)->read_at;
+}
+
+
+/* Read from volumes source src at offset, without changing its read position.
+   Can be called from multiple threads while src stays open. */
+zip_int64_t
+_zip_source_volumes_read_at(zip_source_t *src, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error) {
+    return volumes_read((volumes_ctx_t *)src->ud, offset, data, length, error);
+}
+
+
+/* Get offset of volume in src. Returns false if src is not a volumes source or has no such volume. */
+bool
+_zip_source_volumes_start(zip_source_t *src, zip_uint32_t volume, zip_uint64_t *start) {
+    volumes_ctx_t *ctx;
+
+    if (src == NULL || src->src != NULL || src->cb.f != read_volumes) {
+        return false;
+    }
+
+    ctx = (volumes_ctx_t *)src->ud;
+    if (volume >= ctx->nvolumes) {
+        return false;
+    }
+
+    *start = ctx->starts[volume];
+    return true;
+}
+
+
+static void
+volumes_close(volumes_ctx_t *ctx, zip_uint64_t n) {
+    zip_uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        zip_source_close(ctx->volumes[i]);
+    }
+}
+
+
+/* Return index of volume containing offset, nvolumes if offset is at or past the end. */
+static zip_uint64_t
+volumes_find(const volumes_ctx_t *ctx, zip_uint64_t offset) {
+    zip_uint64_t low = 0, high = ctx->nvolumes;
+
+    if (offset >= ctx->starts[ctx->nvolumes]) {
+        return ctx->nvolumes;
+    }
+
+    /* starts[low] <= offset < starts[high] */
+    while (high - low > 1) {
+        zip_uint64_t mid = low + (high - low) / 2;
+
+        if (ctx->starts[mid] <= offset) {
+            low = mid;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+static void
+volumes_free(zip_source_t **volumes, zip_uint64_t n) {
+    zip_uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        zip_source_free(volumes[i]);
+    }
+    _zip_free(volumes);
+}
+
+
+/* Create source reading volumes one after the other, takes ownership of volumes. */
+static zip_source_t *
+volumes_new(zip_source_t **volumes, zip_uint64_t nvolumes, zip_error_t *error) {
+    volumes_ctx_t *ctx;
+    zip_source_t *zs;
+    zip_uint64_t i;
+
+    if ((ctx = (volumes_ctx_t *)_zip_malloc(sizeof(*ctx))) == NULL || (ctx->starts = (zip_uint64_t *)_zip_malloc(sizeof(ctx->starts[0]) * (size_t)(nvolumes + 1))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_free(ctx);
+        volumes_free(volumes, nvolumes);
+        return NULL;
+    }
+
+    zip_error_init(&ctx->error);
+    ctx->volumes = volumes;
+    ctx->nvolumes = nvolumes;
+    ctx->read_at = true;
+    ctx->offset = 0;
+    zip_stat_init(&ctx->st);
+
+    ctx->starts[0] = 0;
+    for (i = 0; i < nvolumes; i++) {
+        zip_stat_t st;
+
+        if (zip_source_stat(volumes[i], &st) < 0) {
+            zip_error_set_from_source(error, volumes[i]);
+            break;
+        }
+        if ((st.valid & ZIP_STAT_SIZE) == 0 || st.size > ZIP_INT64_MAX - ctx->starts[i]) {
+            zip_error_set(error, ZIP_ER_SEEK, EOVERFLOW);
+            break;
+        }
+        ctx->starts[i + 1] = ctx->starts[i] + st.size;
+        if (st.valid & ZIP_STAT_MTIME) {
+            ctx->st.mtime = st.mtime;
+            ctx->st.valid |= ZIP_STAT_MTIME;
+        }
+        if ((zip_source_supports(volumes[i]) & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_READ_AT)) == 0) {
+            ctx->read_at = false;
+        }
+    }
+    if (i < nvolumes) {
+        _zip_free(ctx->starts);
+        _zip_free(ctx);
+        volumes_free(volumes, nvolumes);
+        return NULL;
+    }
+
+    ctx->st.size = ctx->starts[nvolumes];
+    ctx->st.valid |= ZIP_STAT_SIZE;
+
+    if ((zs = zip_source_function_create(read_volumes, ctx, error)) == NULL) {
+        _zip_free(ctx->starts);
+        _zip_free(ctx);
+        volumes_free(volumes, nvolumes);
+        return NULL;
+    }
+
+    return zs;
+}
+
+
+/* Read up to length bytes at offset from the volume containing it. Only accesses volumes if ctx->read_at is set. */
+static zip_int64_t
+volumes_read(volumes_ctx_t *ctx, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error) {
+    zip_uint64_t i = volumes_find(ctx, offset);
+    zip_source_t *volume;
+    zip_int64_t n;
+
+    if (i == ctx->nvolumes) {
+        return 0;
+    }
+
+    volume = ctx->volumes[i];
+    length = ZIP_MIN(length, ctx->starts[i + 1] - offset);
+    offset -= ctx->starts[i];
+
+    if (ctx->read_at) {
+        return _zip_source_file_read_at(volume, offset, data, length, error);
+    }
+
+    if (zip_source_seek(volume, (zip_int64_t)offset, SEEK_SET) < 0 || (n = zip_source_read(volume, data, length)) < 0) {
+        zip_error_set_from_source(error, volume);
+        return -1;
+    }
+    return n;
+}
+
+
+static zip_int64_t
+read_volumes(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    volumes_ctx_t *ctx = (volumes_ctx_t *)state;
+
+    switch (cmd) {
+    case ZIP_SOURCE_CLOSE:
+        volumes_close(ctx, ctx->nvolumes);
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, len);
+
+    case ZIP_SOURCE_FREE:
+        volumes_free(ctx->volumes, ctx->nvolumes);
+        _zip_free(ctx->starts);
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_OPEN: {
+        zip_uint64_t i;
+
+        /* all volumes are opened, so they can be read from multiple threads */
+        for (i = 0; i < ctx->nvolumes; i++) {
+            if (zip_source_open(ctx->volumes[i]) < 0) {
+                zip_error_set_from_source(&ctx->error, ctx->volumes[i]);
+                volumes_close(ctx, i);
+                return -1;
+            }
+            if (ctx->read_at && !_zip_source_file_supports_read_at(ctx->volumes[i])) {
+                ctx->read_at = false;
+            }
+        }
+        ctx->offset = 0;
+        return 0;
+    }
+
+    case ZIP_SOURCE_READ: {
+        zip_int64_t n;
+
+        if ((n = volumes_read(ctx, ctx->offset, data, len, &ctx->error)) < 0) {
+            return -1;
+        }
+        ctx->offset += (zip_uint64_t)n;
+        return n;
+    }
+
+    case ZIP_SOURCE_READ_AT: {
+        zip_source_args_read_at_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_read_at_t, data, len, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        return volumes_read(ctx, args->offset, args->data, args->length, &ctx->error);
+    }
+
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->st.size, data, len, &ctx->error);
+
+        if (new_offset < 0) {
+            return -1;
+        }
+
+        ctx->offset = (zip_uint64_t)new_offset;
+        return 0;
+    }
+
+    case ZIP_SOURCE_STAT: {
+        zip_stat_t *st;
+
+        if ((st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, len, &ctx->error)) == NULL) {
+            return -1;
+        }
+
+        (void)memcpy_s(st, sizeof(*st), &ctx->st, sizeof(ctx->st));
+        return 0;
+    }
+
+    case ZIP_SOURCE_SUPPORTS:
+        if (ctx->read_at) {
+            return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_READ_AT, -1);
+        }
+        return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, -1);
+
+    case ZIP_SOURCE_TELL:
+        if (ctx->offset > ZIP_INT64_MAX) {
+            zip_error_set(&ctx->error, ZIP_ER_TELL, EOVERFLOW);
+            return -1;
+        }
+        return (zip_int64_t)ctx->offset;
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
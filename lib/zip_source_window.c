@@ -37,6 +37,9 @@
 
 #include "zipint.h"
 
+/* largest buffer used for skipping to start of window in non-seekable source */
+#define SKIP_BUFFER_SIZE (64 * 1024)
+
 struct window {
     zip_uint64_t start; /* where in file we start reading */
     zip_uint64_t end;   /* where in file we stop reading */
@@ -54,8 +57,21 @@ struct window {
     zip_error_t error;
     zip_int64_t supports;
     bool needs_seek;
+    bool read_at; /* read with ZIP_SOURCE_READ_AT, leaving read position of src alone */
+
+    /* CRC of data, validated at end of data, like zip_source_crc_create() */
+    bool crc_validate;
+    bool crc_complete;
+    zip_uint64_t crc_position; /* how far we've computed the CRC, relative to start */
+    zip_uint32_t crc;
+    zip_uint32_t crc_threads; /* number of threads to compute CRC of all data at once */
+
+    /* kept for reopening, skipping in chunks of BUFSIZE is slow through decryption and decompression layers */
+    zip_uint8_t *skip_buffer;
+    zip_uint64_t skip_buffer_size;
 };
 
+static bool window_crc_end(struct window *ctx);
 static zip_int64_t window_read(zip_source_t *, void *, void *, zip_uint64_t, zip_source_cmd_t);
 
 
@@ -82,7 +98,7 @@ _zip_source_window_new(zip_source_t *src, zip_uint64_t start, zip_int64_t length
         }
     }
 
-    if ((ctx = (struct window *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct window *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -106,12 +122,20 @@ _zip_source_window_new(zip_source_t *src, zip_uint64_t start, zip_int64_t length
     ctx->source_archive = source_archive;
     ctx->source_index = source_index;
     zip_error_init(&ctx->error);
-    ctx->supports = (zip_source_supports(src) & (ZIP_SOURCE_SUPPORTS_SEEKABLE | ZIP_SOURCE_SUPPORTS_REOPEN)) | (zip_source_make_command_bitmap(ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_TELL, ZIP_SOURCE_FREE, -1));
-    ctx->needs_seek = (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK)) ? true : false;
+    ctx->supports = (zip_source_supports(src) & (ZIP_SOURCE_SUPPORTS_SEEKABLE | ZIP_SOURCE_SUPPORTS_REOPEN | zip_source_make_command_bitmap(ZIP_SOURCE_GET_DATA, ZIP_SOURCE_READ_AT, -1))) | (zip_source_make_command_bitmap(ZIP_SOURCE_GET_FILE_ATTRIBUTES, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_TELL, ZIP_SOURCE_FREE, -1));
+    ctx->read_at = (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_READ_AT)) ? true : false;
+    ctx->needs_seek = !ctx->read_at && (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK));
+    ctx->crc_validate = false;
+    ctx->crc_complete = false;
+    ctx->crc_position = 0;
+    ctx->crc = 0;
+    ctx->crc_threads = 1;
+    ctx->skip_buffer = NULL;
+    ctx->skip_buffer_size = 0;
 
     if (st) {
         if (_zip_stat_merge(&ctx->stat, st, error) < 0) {
-            free(ctx);
+            _zip_free(ctx);
             return NULL;
         }
     }
@@ -124,6 +148,63 @@ _zip_source_window_new(zip_source_t *src, zip_uint64_t start, zip_int64_t length
 }
 
 
+/* Make closed window src, created for the whole data of an entry of za, read the data of entry index instead.
+   Returns false if src isn't such a window, or doesn't validate CRC as requested. */
+bool
+_zip_source_window_reuse(zip_source_t *src, zip_t *za, zip_uint64_t index, const zip_stat_t *st, const zip_file_attributes_t *attributes, bool validate_crc) {
+    struct window *ctx;
+
+    if (src->src == NULL || src->cb.l != window_read || src->src != za->src || src->source_closed || ZIP_SOURCE_IS_OPEN_READING(src)) {
+        return false;
+    }
+
+    ctx = (struct window *)src->ud;
+    if (ctx->crc_validate != validate_crc) {
+        return false;
+    }
+
+    zip_stat_init(&ctx->stat);
+    if (_zip_stat_merge(&ctx->stat, st, &ctx->error) < 0) {
+        return false;
+    }
+    (void)memcpy_s(&ctx->attributes, sizeof(ctx->attributes), attributes, sizeof(ctx->attributes));
+    ctx->start = 0;
+    ctx->end = st->comp_size;
+    ctx->end_valid = true;
+    ctx->source_archive = za;
+    ctx->source_index = index;
+    zip_error_fini(&ctx->error);
+    zip_error_init(&ctx->error);
+    ctx->crc_complete = false;
+    ctx->crc_position = 0;
+    ctx->crc = 0;
+    _zip_source_changed(src);
+
+    return true;
+}
+
+
+/* Have window src compute the CRC of its data and validate it, instead of a separate CRC layer on top.
+   Like that layer, it then no longer supports reading at an offset. When all data is accessed at once, num_threads threads are used. */
+bool
+_zip_source_window_validate_crc(zip_source_t *src, zip_uint32_t num_threads) {
+    struct window *ctx;
+    zip_int64_t hidden = ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_READ_AT);
+
+    if (src->src == NULL || src->cb.l != window_read) {
+        return false;
+    }
+
+    ctx = (struct window *)src->ud;
+    ctx->crc_validate = true;
+    ctx->crc_threads = num_threads;
+    ctx->supports &= ~hidden;
+    src->supports &= ~hidden;
+    _zip_source_changed(src);
+    return true;
+}
+
+
 int
 _zip_source_set_source_archive(zip_source_t *src, zip_t *za) {
     src->source_archive = za;
@@ -131,6 +212,62 @@ _zip_source_set_source_archive(zip_source_t *src, zip_t *za) {
 }
 
 
+/* Copy up to length bytes from the read position of window src to the write position of dst, if the window is on a file
+   source that dst can copy from directly. Returns the number of bytes copied, 0 if it can't be done, -1 on error (set in dst). */
+zip_int64_t
+_zip_source_window_copy_data_to(zip_source_t *src, zip_source_t *dst, zip_uint64_t length) {
+    struct window *ctx;
+    zip_int64_t n;
+
+    if (src->src == NULL || src->cb.l != window_read || src->source_closed) {
+        return 0;
+    }
+
+    ctx = (struct window *)src->ud;
+    /* only if reads don't rely on the file position of the lower source */
+    if (ctx->source_archive != NULL || (!ctx->needs_seek && !ctx->read_at)) {
+        return 0;
+    }
+    if (ctx->end_valid) {
+        length = ZIP_MIN(length, ctx->end - ctx->offset);
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    if ((n = _zip_source_file_copy_data_from(dst, src->src, ctx->offset, length)) > 0) {
+        ctx->offset += (zip_uint64_t)n;
+    }
+
+    return n;
+}
+
+
+/* Called when reaching end of data, validates CRC if it was computed over all of it. */
+static bool
+window_crc_end(struct window *ctx) {
+    zip_uint64_t size = ctx->offset - ctx->start;
+
+    if (!ctx->crc_validate || ctx->crc_complete || ctx->crc_position != size) {
+        return true;
+    }
+
+    ctx->crc_complete = true;
+
+    if ((ctx->stat.valid & ZIP_STAT_CRC) && ctx->stat.crc != ctx->crc) {
+        zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
+        return false;
+    }
+    if ((ctx->stat.valid & ZIP_STAT_SIZE) && ctx->stat.size != size) {
+        /* We don't have the index here, but the caller should know which file they are reading from. */
+        zip_error_set(&ctx->error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, MAX_DETAIL_INDEX));
+        return false;
+    }
+
+    return true;
+}
+
+
 /* called by zip_discard to avoid operating on file from closed archive */
 void
 _zip_source_invalidate(zip_source_t *src) {
@@ -158,8 +295,47 @@ window_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_sou
         return zip_error_to_data(&ctx->error, data, len);
 
     case ZIP_SOURCE_FREE:
-        free(ctx);
+        _zip_free(ctx->skip_buffer);
+        _zip_free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_GET_DATA: {
+        zip_source_args_get_data_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_get_data_t, data, len, &ctx->error);
+        const void *window_data;
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (ctx->source_archive) {
+            /* start of data is only known once source is opened */
+            zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        if (ctx->start + args->offset < ctx->start || (ctx->end_valid && (args->offset > ctx->end - ctx->start || args->length > ctx->end - ctx->start - args->offset))) {
+            zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        if (zip_source_get_data(src, ctx->start + args->offset, args->length, &window_data) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+
+        /* When all data is requested, compute CRC in one pass over it. */
+        if (ctx->crc_validate && !ctx->crc_complete && args->offset == 0 && (ctx->stat.valid & ZIP_STAT_SIZE) && ctx->stat.size == args->length) {
+            zip_uint32_t crc = _zip_crc32_threads(0, window_data, args->length, ctx->crc_threads);
+
+            if ((ctx->stat.valid & ZIP_STAT_CRC) && ctx->stat.crc != crc) {
+                zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
+                return -1;
+            }
+            ctx->crc = crc;
+            ctx->crc_position = args->length;
+            ctx->crc_complete = true;
+        }
+
+        args->data = window_data;
         return 0;
+    }
 
     case ZIP_SOURCE_OPEN:
         if (ctx->source_archive) {
@@ -178,29 +354,28 @@ window_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_sou
             ctx->source_archive = NULL;
         }
 
-        if (!ctx->needs_seek) {
-            DEFINE_BYTE_ARRAY(b, BUFSIZE);
+        if (!ctx->needs_seek && !ctx->read_at && ctx->start > 0) {
+            if (ctx->skip_buffer == NULL) {
+                zip_uint64_t size = ctx->start > SKIP_BUFFER_SIZE ? SKIP_BUFFER_SIZE : ctx->start;
 
-            if (!byte_array_init(b, BUFSIZE)) {
-                zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
-                return -1;
+                if ((ctx->skip_buffer = (zip_uint8_t *)_zip_malloc((size_t)size)) == NULL) {
+                    zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+                    return -1;
+                }
+                ctx->skip_buffer_size = size;
             }
 
             for (n = 0; n < ctx->start; n += (zip_uint64_t)ret) {
-                i = (ctx->start - n > BUFSIZE ? BUFSIZE : ctx->start - n);
-                if ((ret = zip_source_read(src, b, i)) < 0) {
+                i = (ctx->start - n > ctx->skip_buffer_size ? ctx->skip_buffer_size : ctx->start - n);
+                if ((ret = zip_source_read(src, ctx->skip_buffer, i)) < 0) {
                     zip_error_set_from_source(&ctx->error, src);
-                    byte_array_fini(b);
                     return -1;
                 }
                 if (ret == 0) {
                     zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
-                    byte_array_fini(b);
                     return -1;
                 }
             }
-
-            byte_array_fini(b);
         }
 
         ctx->offset = ctx->start;
@@ -212,21 +387,40 @@ window_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_sou
         }
 
         if (len == 0) {
-            return 0;
+            return window_crc_end(ctx) ? 0 : -1;
         }
 
-        if (ctx->needs_seek) {
-            if (zip_source_seek(src, (zip_int64_t)ctx->offset, SEEK_SET) < 0) {
+        if (ctx->read_at) {
+            if ((ret = zip_source_read_at(src, ctx->offset, data, len)) < 0) {
                 zip_error_set_from_source(&ctx->error, src);
                 return -1;
             }
         }
+        else {
+            if (ctx->needs_seek) {
+                if (zip_source_seek(src, (zip_int64_t)ctx->offset, SEEK_SET) < 0) {
+                    zip_error_set_from_source(&ctx->error, src);
+                    return -1;
+                }
+            }
 
-        if ((ret = zip_source_read(src, data, len)) < 0) {
-            zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
-            return -1;
+            if ((ret = zip_source_read(src, data, len)) < 0) {
+                if (_zip_source_would_block(src)) {
+                    zip_error_set_from_source(&ctx->error, src);
+                }
+                else {
+                    zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
+                }
+                return -1;
+            }
         }
 
+        if (ctx->crc_validate && !ctx->crc_complete && ctx->offset - ctx->start <= ctx->crc_position && ctx->crc_position - (ctx->offset - ctx->start) < (zip_uint64_t)ret) {
+            zip_uint64_t i = ctx->crc_position - (ctx->offset - ctx->start);
+
+            ctx->crc = _zip_crc32(ctx->crc, (const zip_uint8_t *)data + i, (zip_uint64_t)ret - i);
+            ctx->crc_position += (zip_uint64_t)ret - i;
+        }
         ctx->offset += (zip_uint64_t)ret;
 
         if (ret == 0) {
@@ -234,9 +428,42 @@ window_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_sou
                 zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
                 return -1;
             }
+            if (!window_crc_end(ctx)) {
+                return -1;
+            }
         }
         return ret;
 
+    case ZIP_SOURCE_READ_AT: {
+        zip_source_args_read_at_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_read_at_t, data, len, &ctx->error);
+        zip_uint64_t length;
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (ctx->start + args->offset < ctx->start) {
+            zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        length = args->length;
+        if (ctx->end_valid) {
+            if (args->offset >= ctx->end - ctx->start) {
+                return 0;
+            }
+            length = ZIP_MIN(length, ctx->end - ctx->start - args->offset);
+        }
+
+        if ((ret = zip_source_read_at(src, ctx->start + args->offset, args->data, length)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+        if ((zip_uint64_t)ret < length && ctx->end_valid) {
+            zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
+            return -1;
+        }
+        return ret;
+    }
+
     case ZIP_SOURCE_SEEK: {
         zip_int64_t new_offset;
         
@@ -297,6 +524,20 @@ window_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_sou
 
         st->valid &= ~ctx->stat_invalid;
 
+        if (ctx->crc_complete) {
+            /* as zip_source_crc_create() would */
+            if ((st->valid & ZIP_STAT_SIZE) && st->size != ctx->crc_position) {
+                zip_error_set(&ctx->error, ZIP_ER_DATA_LENGTH, 0);
+                return -1;
+            }
+            st->size = ctx->crc_position;
+            st->crc = ctx->crc;
+            st->comp_size = ctx->crc_position;
+            st->comp_method = ZIP_CM_STORE;
+            st->encryption_method = ZIP_EM_NONE;
+            st->valid |= ZIP_STAT_SIZE | ZIP_STAT_CRC | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+        }
+
         return 0;
     }
 
@@ -325,6 +566,7 @@ void
 _zip_deregister_source(zip_t *za, zip_source_t *src) {
     unsigned int i;
 
+    ZIP_LOCK(za);
     for (i = 0; i < za->nopen_source; i++) {
         if (za->open_source[i] == src) {
             za->open_source[i] = za->open_source[za->nopen_source - 1];
@@ -332,6 +574,7 @@ _zip_deregister_source(zip_t *za, zip_source_t *src) {
             break;
         }
     }
+    ZIP_UNLOCK(za);
 }
 
 
@@ -339,12 +582,14 @@ int
 _zip_register_source(zip_t *za, zip_source_t *src) {
     zip_source_t **open_source;
 
+    ZIP_LOCK(za);
     if (za->nopen_source + 1 >= za->nopen_source_alloc) {
         unsigned int n;
         n = za->nopen_source_alloc + 10;
-        open_source = (zip_source_t **)realloc(za->open_source, n * sizeof(zip_source_t *));
+        open_source = (zip_source_t **)_zip_realloc(za->open_source, n * sizeof(zip_source_t *));
         if (open_source == NULL) {
             zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            ZIP_UNLOCK(za);
             return -1;
         }
         za->nopen_source_alloc = n;
@@ -352,6 +597,7 @@ _zip_register_source(zip_t *za, zip_source_t *src) {
     }
 
     za->open_source[za->nopen_source++] = src;
+    ZIP_UNLOCK(za);
 
     return 0;
 }
@@ -38,15 +38,49 @@
 #include "zipint.h"
 #include "zip_crypto.h"
 
+#ifdef HAVE_THREADS
+/* Entries at least this large are decrypted in chunks, with the HMAC computed in a worker thread. */
+#define PARALLEL_MIN_SIZE (1024 * 1024)
+#define PARALLEL_CHUNK_SIZE (256 * 1024)
+
+struct winzip_aes;
+
+struct chunk {
+    struct winzip_aes *ctx;
+    zip_uint8_t *data; /* encrypted data, read by HMAC job until it is done */
+    zip_uint64_t length;
+    zip_uint64_t offset; /* of first byte not yet returned */
+    zip_thread_job_t job;
+    bool submitted;
+};
+#endif
+
 struct winzip_aes {
     char *password;
     zip_uint16_t encryption_method;
 
     zip_uint64_t data_length;
     zip_uint64_t current_position;
+    bool seekable; /* lower layer is seekable, so data can be decrypted at any position */
+
+    /* HMAC of data, computed while data is read in order from the start and checked at end of data, like CRC in zip_source_window.c */
+    zip_uint64_t hmac_position; /* how far we've computed the HMAC */
+    bool hmac_done;             /* HMAC was checked or can't be computed anymore */
 
     zip_winzip_aes_t *aes_ctx;
+    zip_winzip_aes_key_cache_t *key_cache; /* owned by archive */
+    bool have_provider;
+    zip_crypto_provider_t provider; /* copy of archive's crypto provider */
     zip_error_t error;
+
+#ifdef HAVE_THREADS
+    zip_uint32_t num_threads;
+    zip_thread_pool_t *pool; /* only set when decrypting in chunks */
+    struct chunk chunk[2];   /* one is returned while the HMAC of the other is computed */
+    int current_chunk;
+    zip_uint64_t read_position; /* of data read from lower layer */
+    bool hmac_failed;           /* set by HMAC job */
+#endif
 };
 
 
@@ -54,6 +88,12 @@ static int decrypt_header(zip_source_t *src, struct winzip_aes *ctx);
 static void winzip_aes_free(struct winzip_aes *);
 static zip_int64_t winzip_aes_decrypt(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip_source_cmd_t cmd);
 static struct winzip_aes *winzip_aes_new(zip_uint16_t encryption_method, const char *password, zip_error_t *error);
+#ifdef HAVE_THREADS
+static void parallel_end(struct winzip_aes *ctx);
+static zip_int64_t parallel_read(zip_source_t *src, struct winzip_aes *ctx, zip_uint8_t *data, zip_uint64_t len);
+static void parallel_start(struct winzip_aes *ctx);
+static bool parallel_wait(struct winzip_aes *ctx);
+#endif
 
 
 zip_source_t *
@@ -84,11 +124,24 @@ zip_source_winzip_aes_decode(zip_t *za, zip_source_t *src, zip_uint16_t encrypti
         return NULL;
     }
 
+    if (_zip_winzip_aes_key_cache_get(za) == NULL) {
+        return NULL;
+    }
+
     if ((ctx = winzip_aes_new(encryption_method, password, &za->error)) == NULL) {
         return NULL;
     }
+    ctx->key_cache = za->aes_key_cache;
+    if (za->crypto_provider != NULL) {
+        ctx->have_provider = true;
+        ctx->provider = *za->crypto_provider;
+    }
 
     ctx->data_length = st.comp_size - aux_length;
+    ctx->seekable = (zip_source_supports(src) & ZIP_SOURCE_SUPPORTS_SEEKABLE) == ZIP_SOURCE_SUPPORTS_SEEKABLE;
+#ifdef HAVE_THREADS
+    ctx->num_threads = za->num_threads;
+#endif
 
     if ((s2 = zip_source_layered(za, src, winzip_aes_decrypt, ctx)) == NULL) {
         winzip_aes_free(ctx);
@@ -117,7 +170,7 @@ decrypt_header(zip_source_t *src, struct winzip_aes *ctx) {
         return -1;
     }
 
-    if ((ctx->aes_ctx = _zip_winzip_aes_new((zip_uint8_t *)ctx->password, strlen(ctx->password), header, ctx->encryption_method, password_verification, &ctx->error)) == NULL) {
+    if ((ctx->aes_ctx = _zip_winzip_aes_new((zip_uint8_t *)ctx->password, strlen(ctx->password), header, ctx->encryption_method, password_verification, ctx->have_provider ? &ctx->provider : NULL, ctx->key_cache, &ctx->error)) == NULL) {
         return -1;
     }
     if (memcmp(password_verification, header + SALT_LENGTH(ctx->encryption_method), WINZIP_AES_PASSWORD_VERIFY_LENGTH) != 0) {
@@ -133,6 +186,20 @@ decrypt_header(zip_source_t *src, struct winzip_aes *ctx) {
 static bool
 verify_hmac(zip_source_t *src, struct winzip_aes *ctx) {
     unsigned char computed[ZIP_CRYPTO_SHA1_LENGTH], from_file[HMAC_LENGTH];
+
+#ifdef HAVE_THREADS
+    if (ctx->pool != NULL) {
+        if (!parallel_wait(ctx)) {
+            return false;
+        }
+        ctx->hmac_position = ctx->read_position;
+    }
+#endif
+    if (ctx->hmac_done || ctx->hmac_position != ctx->data_length) {
+        /* data was not read completely in order, so it isn't authenticated */
+        return true;
+    }
+
     if (zip_source_read(src, from_file, HMAC_LENGTH) < HMAC_LENGTH) {
         zip_error_set_from_source(&ctx->error, src);
         return false;
@@ -142,8 +209,8 @@ verify_hmac(zip_source_t *src, struct winzip_aes *ctx) {
         zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
         return false;
     }
-    _zip_winzip_aes_free(ctx->aes_ctx);
-    ctx->aes_ctx = NULL;
+    /* aes_ctx is kept for seeking back */
+    ctx->hmac_done = true;
 
     if (memcmp(from_file, computed, HMAC_LENGTH) != 0) {
         zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
@@ -163,10 +230,17 @@ winzip_aes_decrypt(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zi
 
     switch (cmd) {
     case ZIP_SOURCE_OPEN:
+        _zip_winzip_aes_free(ctx->aes_ctx);
+        ctx->aes_ctx = NULL;
         if (decrypt_header(src, ctx) < 0) {
             return -1;
         }
         ctx->current_position = 0;
+        ctx->hmac_position = 0;
+        ctx->hmac_done = false;
+#ifdef HAVE_THREADS
+        parallel_start(ctx);
+#endif
         return 0;
 
     case ZIP_SOURCE_READ:
@@ -181,13 +255,34 @@ winzip_aes_decrypt(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zi
             return 0;
         }
 
+#ifdef HAVE_THREADS
+        if (ctx->pool != NULL) {
+            if ((n = parallel_read(src, ctx, (zip_uint8_t *)data, len)) < 0) {
+                return -1;
+            }
+            ctx->current_position += (zip_uint64_t)n;
+            return n;
+        }
+#endif
+
         if ((n = zip_source_read(src, data, len)) < 0) {
             zip_error_set_from_source(&ctx->error, src);
             return -1;
         }
+
+        /* HMAC is computed over encrypted data */
+        if (!ctx->hmac_done && ctx->current_position <= ctx->hmac_position && ctx->hmac_position - ctx->current_position < (zip_uint64_t)n) {
+            zip_uint64_t i = ctx->hmac_position - ctx->current_position;
+
+            if (!_zip_winzip_aes_hmac(ctx->aes_ctx, (zip_uint8_t *)data + i, (zip_uint64_t)n - i)) {
+                zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+                return -1;
+            }
+            ctx->hmac_position += (zip_uint64_t)n - i;
+        }
         ctx->current_position += (zip_uint64_t)n;
 
-        if (!_zip_winzip_aes_decrypt(ctx->aes_ctx, (zip_uint8_t *)data, (zip_uint64_t)n)) {
+        if (!_zip_winzip_aes_crypt(ctx->aes_ctx, (zip_uint8_t *)data, (zip_uint64_t)n)) {
             zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
             return -1;
         }
@@ -195,6 +290,9 @@ winzip_aes_decrypt(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zi
         return n;
 
     case ZIP_SOURCE_CLOSE:
+#ifdef HAVE_THREADS
+        parallel_end(ctx);
+#endif
         return 0;
 
     case ZIP_SOURCE_STAT: {
@@ -211,7 +309,40 @@ winzip_aes_decrypt(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zi
         return 0;
     }
 
+    case ZIP_SOURCE_SEEK: {
+        zip_int64_t new_position = zip_source_seek_compute_offset(ctx->current_position, ctx->data_length, data, len, &ctx->error);
+
+        if (new_position < 0) {
+            return -1;
+        }
+        if ((zip_uint64_t)new_position == ctx->current_position) {
+            return 0;
+        }
+
+#ifdef HAVE_THREADS
+        parallel_end(ctx);
+#endif
+        /* CTR mode allows decrypting at any position */
+        if (zip_source_seek(src, (zip_int64_t)(WINZIP_AES_PASSWORD_VERIFY_LENGTH + SALT_LENGTH(ctx->encryption_method) + (zip_uint64_t)new_position), SEEK_SET) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+        if (!_zip_winzip_aes_set_position(ctx->aes_ctx, (zip_uint64_t)new_position)) {
+            zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+            return -1;
+        }
+        /* HMAC computation resumes if data is read from hmac_position again */
+        ctx->current_position = (zip_uint64_t)new_position;
+        return 0;
+    }
+
+    case ZIP_SOURCE_TELL:
+        return (zip_int64_t)ctx->current_position;
+
     case ZIP_SOURCE_SUPPORTS:
+        if (ctx->seekable) {
+            return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
+        }
         return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
 
     case ZIP_SOURCE_ERROR:
@@ -233,11 +364,16 @@ winzip_aes_free(struct winzip_aes *ctx) {
         return;
     }
 
+#ifdef HAVE_THREADS
+    parallel_end(ctx);
+    _zip_free(ctx->chunk[0].data);
+    _zip_free(ctx->chunk[1].data);
+#endif
     _zip_crypto_clear(ctx->password, strlen(ctx->password));
-    free(ctx->password);
+    _zip_free(ctx->password);
     zip_error_fini(&ctx->error);
     _zip_winzip_aes_free(ctx->aes_ctx);
-    free(ctx);
+    _zip_free(ctx);
 }
 
 
@@ -245,21 +381,194 @@ static struct winzip_aes *
 winzip_aes_new(zip_uint16_t encryption_method, const char *password, zip_error_t *error) {
     struct winzip_aes *ctx;
 
-    if ((ctx = (struct winzip_aes *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct winzip_aes *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
-    if ((ctx->password = strdup(password)) == NULL) {
+    if ((ctx->password = _zip_strdup(password)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
-        free(ctx);
+        _zip_free(ctx);
         return NULL;
     }
 
     ctx->encryption_method = encryption_method;
+    ctx->seekable = false;
+    ctx->hmac_position = 0;
+    ctx->hmac_done = false;
     ctx->aes_ctx = NULL;
+    ctx->key_cache = NULL;
+    ctx->have_provider = false;
+#ifdef HAVE_THREADS
+    ctx->num_threads = 0;
+    ctx->pool = NULL;
+    ctx->chunk[0].data = ctx->chunk[1].data = NULL;
+#endif
 
     zip_error_init(&ctx->error);
 
     return ctx;
 }
+
+
+#ifdef HAVE_THREADS
+static void
+hmac_job(void *ud) {
+    struct chunk *chunk = (struct chunk *)ud;
+
+    if (!_zip_winzip_aes_hmac(chunk->ctx->aes_ctx, chunk->data, chunk->length)) {
+        chunk->ctx->hmac_failed = true;
+    }
+}
+
+
+/* Refill CHUNK with the next encrypted data and start computing its HMAC.
+   The worker pool has a single thread, so the HMAC jobs run in the order they are submitted. */
+static bool
+fill_chunk(zip_source_t *src, struct winzip_aes *ctx, struct chunk *chunk) {
+    zip_uint64_t length;
+    zip_int64_t n;
+
+    if (chunk->submitted) {
+        _zip_thread_pool_wait(ctx->pool, &chunk->job);
+        chunk->submitted = false;
+        if (ctx->hmac_failed) {
+            zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+            return false;
+        }
+    }
+
+    chunk->offset = chunk->length = 0;
+    length = ZIP_MIN(PARALLEL_CHUNK_SIZE, ctx->data_length - ctx->read_position);
+    while (chunk->length < length) {
+        if ((n = zip_source_read(src, chunk->data + chunk->length, length - chunk->length)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return false;
+        }
+        if (n == 0) {
+            zip_error_set(&ctx->error, ZIP_ER_EOF, 0);
+            return false;
+        }
+        chunk->length += (zip_uint64_t)n;
+    }
+    ctx->read_position += chunk->length;
+
+    if (chunk->length > 0) {
+        _zip_thread_pool_submit(ctx->pool, &chunk->job);
+        chunk->submitted = true;
+    }
+
+    return true;
+}
+
+
+static void
+parallel_end(struct winzip_aes *ctx) {
+    if (ctx->pool == NULL) {
+        return;
+    }
+
+    /* the HMAC jobs have covered all data read from the lower layer */
+    if (parallel_wait(ctx)) {
+        ctx->hmac_position = ctx->read_position;
+    }
+    else {
+        ctx->hmac_done = true;
+    }
+    _zip_thread_pool_free(ctx->pool);
+    ctx->pool = NULL;
+}
+
+
+static zip_int64_t
+parallel_read(zip_source_t *src, struct winzip_aes *ctx, zip_uint8_t *data, zip_uint64_t len) {
+    zip_uint64_t total = 0;
+
+    while (total < len) {
+        struct chunk *chunk = ctx->chunk + ctx->current_chunk;
+        zip_uint64_t n;
+
+        if (chunk->offset == chunk->length) {
+            struct chunk *other = ctx->chunk + (ctx->current_chunk ^ 1);
+
+            if (ctx->read_position == ctx->data_length && other->offset == other->length) {
+                break;
+            }
+            if (!fill_chunk(src, ctx, chunk)) {
+                return -1;
+            }
+            ctx->current_chunk ^= 1;
+            continue;
+        }
+
+        /* the HMAC job only reads the encrypted data, so decryption happens on a copy */
+        n = ZIP_MIN(len - total, chunk->length - chunk->offset);
+        (void)memcpy_s(data + total, n, chunk->data + chunk->offset, n);
+        if (!_zip_winzip_aes_crypt(ctx->aes_ctx, data + total, n)) {
+            zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+            return -1;
+        }
+        chunk->offset += n;
+        total += n;
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+static void
+parallel_start(struct winzip_aes *ctx) {
+    int i;
+
+    if (ctx->num_threads <= 1 || ctx->data_length < PARALLEL_MIN_SIZE) {
+        return;
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (ctx->chunk[i].data == NULL && (ctx->chunk[i].data = (zip_uint8_t *)_zip_malloc(PARALLEL_CHUNK_SIZE)) == NULL) {
+            return;
+        }
+    }
+
+    /* decrypt in calling thread if pool can't be created */
+    if ((ctx->pool = _zip_thread_pool_new(1, NULL)) == NULL) {
+        return;
+    }
+
+    for (i = 0; i < 2; i++) {
+        ctx->chunk[i].ctx = ctx;
+        ctx->chunk[i].length = ctx->chunk[i].offset = 0;
+        ctx->chunk[i].job.run = hmac_job;
+        ctx->chunk[i].job.ud = ctx->chunk + i;
+        ctx->chunk[i].submitted = false;
+    }
+    ctx->current_chunk = 0;
+    ctx->read_position = 0;
+    ctx->hmac_failed = false;
+}
+
+
+/* Wait until the HMAC of all data read so far has been computed. */
+static bool
+parallel_wait(struct winzip_aes *ctx) {
+    int i;
+
+    if (ctx->pool == NULL) {
+        return true;
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (ctx->chunk[i].submitted) {
+            _zip_thread_pool_wait(ctx->pool, &ctx->chunk[i].job);
+            ctx->chunk[i].submitted = false;
+        }
+    }
+
+    if (ctx->hmac_failed) {
+        zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+        return false;
+    }
+
+    return true;
+}
+#endif
@@ -46,6 +46,9 @@ struct winzip_aes {
     zip_buffer_t *buffer;
 
     zip_winzip_aes_t *aes_ctx;
+    zip_winzip_aes_key_cache_t *key_cache; /* owned by archive, may hold keys derived ahead by zip_close() */
+    bool have_provider;
+    zip_crypto_provider_t provider; /* copy of archive's crypto provider */
     bool eof;
     zip_error_t error;
 };
@@ -70,6 +73,11 @@ zip_source_winzip_aes_encode(zip_t *za, zip_source_t *src, zip_uint16_t encrypti
     if ((ctx = winzip_aes_new(encryption_method, password, &za->error)) == NULL) {
         return NULL;
     }
+    ctx->key_cache = za->aes_key_cache;
+    if (za->crypto_provider != NULL) {
+        ctx->have_provider = true;
+        ctx->provider = *za->crypto_provider;
+    }
 
     if ((s2 = zip_source_layered(za, src, winzip_aes_encrypt, ctx)) == NULL) {
         winzip_aes_free(ctx);
@@ -83,18 +91,24 @@ zip_source_winzip_aes_encode(zip_t *za, zip_source_t *src, zip_uint16_t encrypti
 static int
 encrypt_header(zip_source_t *src, struct winzip_aes *ctx) {
     zip_uint16_t salt_length = SALT_LENGTH(ctx->encryption_method);
+    zip_winzip_aes_key_cache_t *key_cache = ctx->key_cache;
+
     /* TODO: The memset() is just for testing the memory sanitizer,
        zip_secure_random() will overwrite the same bytes */
     memset(ctx->data, 0xff, salt_length);
-    if (!zip_secure_random(ctx->data, salt_length)) {
-        zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
-        return -1;
+    if (key_cache == NULL || !_zip_winzip_aes_key_cache_take_salt(key_cache, (zip_uint8_t *)ctx->password, strlen(ctx->password), ctx->encryption_method, ctx->data)) {
+        /* fresh salts are not worth caching */
+        key_cache = NULL;
+        if (!zip_secure_random(ctx->data, salt_length)) {
+            zip_error_set(&ctx->error, ZIP_ER_INTERNAL, 0);
+            return -1;
+        }
     }
 
     /* TODO: The memset() is just for testing the memory sanitizer,
        _zip_winzip_aes_new() will overwrite the same bytes */
     memset(ctx->data + salt_length, 0xff, WINZIP_AES_PASSWORD_VERIFY_LENGTH);
-    if ((ctx->aes_ctx = _zip_winzip_aes_new((zip_uint8_t *)ctx->password, strlen(ctx->password), ctx->data, ctx->encryption_method, ctx->data + salt_length, &ctx->error)) == NULL) {
+    if ((ctx->aes_ctx = _zip_winzip_aes_new((zip_uint8_t *)ctx->password, strlen(ctx->password), ctx->data, ctx->encryption_method, ctx->data + salt_length, ctx->have_provider ? &ctx->provider : NULL, key_cache, &ctx->error)) == NULL) {
         return -1;
     }
 
@@ -225,11 +239,11 @@ winzip_aes_free(struct winzip_aes *ctx) {
     }
 
     _zip_crypto_clear(ctx->password, strlen(ctx->password));
-    free(ctx->password);
+    _zip_free(ctx->password);
     zip_error_fini(&ctx->error);
     _zip_buffer_free(ctx->buffer);
     _zip_winzip_aes_free(ctx->aes_ctx);
-    free(ctx);
+    _zip_free(ctx);
 }
 
 
@@ -237,13 +251,13 @@ static struct winzip_aes *
 winzip_aes_new(zip_uint16_t encryption_method, const char *password, zip_error_t *error) {
     struct winzip_aes *ctx;
 
-    if ((ctx = (struct winzip_aes *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (struct winzip_aes *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
-    if ((ctx->password = strdup(password)) == NULL) {
-        free(ctx);
+    if ((ctx->password = _zip_strdup(password)) == NULL) {
+        _zip_free(ctx);
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
@@ -251,6 +265,8 @@ winzip_aes_new(zip_uint16_t encryption_method, const char *password, zip_error_t
     ctx->encryption_method = encryption_method;
     ctx->buffer = NULL;
     ctx->aes_ctx = NULL;
+    ctx->key_cache = NULL;
+    ctx->have_provider = false;
 
     zip_error_init(&ctx->error);
 
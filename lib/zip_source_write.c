@@ -37,10 +37,63 @@
 
 ZIP_EXTERN zip_int64_t
 zip_source_write(zip_source_t *src, const void *data, zip_uint64_t length) {
+    zip_int64_t n;
+
     if (!ZIP_SOURCE_IS_OPEN_WRITING(src) || length > ZIP_INT64_MAX) {
         zip_error_set(&src->error, ZIP_ER_INVAL, 0);
         return -1;
     }
 
-    return _zip_source_call(src, (void *)data, length, ZIP_SOURCE_WRITE);
+    if ((n = _zip_source_call(src, (void *)data, length, ZIP_SOURCE_WRITE)) > 0) {
+        src->bytes_written += (zip_uint64_t)n;
+    }
+
+    return n;
+}
+
+
+/* Write the data of nfragments fragments to src, in a single ZIP_SOURCE_WRITEV if src supports it.
+   Returns the number of bytes written. */
+zip_int64_t
+_zip_source_writev(zip_source_t *src, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments) {
+    zip_source_args_writev_t args;
+    zip_uint64_t i, length;
+    zip_int64_t n;
+
+    if (!ZIP_SOURCE_IS_OPEN_WRITING(src)) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    length = 0;
+    for (i = 0; i < nfragments; i++) {
+        if (fragments[i].length > ZIP_INT64_MAX - length) {
+            zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        length += fragments[i].length;
+    }
+
+    if (!ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(src), ZIP_SOURCE_WRITEV)) {
+        zip_uint64_t written = 0;
+
+        for (i = 0; i < nfragments; i++) {
+            if ((n = zip_source_write(src, fragments[i].data, fragments[i].length)) < 0) {
+                return -1;
+            }
+            written += (zip_uint64_t)n;
+            if ((zip_uint64_t)n != fragments[i].length) {
+                break;
+            }
+        }
+        return (zip_int64_t)written;
+    }
+
+    args.fragments = fragments;
+    args.nfragments = nfragments;
+    if ((n = _zip_source_call(src, &args, sizeof(args), ZIP_SOURCE_WRITEV)) > 0) {
+        src->bytes_written += (zip_uint64_t)n;
+    }
+
+    return n;
 }
@@ -44,6 +44,14 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file(zip_t* za, zip_t *srcza, zip_uint64
 
 
 ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t srcidx, zip_flags_t flags, zip_uint64_t start, zip_int64_t len, const char *password, zip_error_t *error) {
+    return _zip_source_zip_new(srcza, srcidx, flags, start, len, password, NULL, error);
+}
+
+
+/* If data_src is not NULL, the data of the unchanged entry is read from it instead of from the archive.
+   It must return the (compressed) file data only, starting after the local header. */
+zip_source_t *
+_zip_source_zip_new(zip_t *srcza, zip_uint64_t srcidx, zip_flags_t flags, zip_uint64_t start, zip_int64_t len, const char *password, zip_source_t *data_src, zip_error_t *error) {
     /* TODO: We need to make sure that the returned source is invalidated when srcza is closed. */
     zip_source_t *src, *s2;
     zip_stat_t st;
@@ -130,7 +138,10 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
     compressed = (st.valid & ZIP_STAT_COMP_METHOD) && (st.comp_method != ZIP_CM_STORE);
     needs_decompress = ((flags & ZIP_FL_COMPRESSED) == 0) && compressed;
     /* when reading the whole file, check for CRC errors */
-    needs_crc = ((flags & ZIP_FL_COMPRESSED) == 0 || !compressed) && !partial_data && (st.valid & ZIP_STAT_CRC) != 0;
+    needs_crc = ((flags & ZIP_FL_COMPRESSED) == 0 || !compressed) && (!encrypted || needs_decrypt) && !partial_data && (st.valid & ZIP_STAT_CRC) != 0;
+    if ((srcza->open_flags & ZIP_SKIP_CRC_CHECK) && (flags & ZIP_FL_CHECK_CRC) == 0) {
+        needs_crc = false;
+    }
 
     if (needs_decrypt) {
         if (password == NULL) {
@@ -148,7 +159,8 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
     _zip_file_attributes_from_dirent(&attributes, de);
 
     have_comp_size = (st.valid & ZIP_STAT_COMP_SIZE) != 0;
-    if (needs_decrypt || needs_decompress) {
+    if (compressed || encrypted) {
+        /* data is read as stored if it isn't decompressed or decrypted, e.g. an empty file compresses to some bytes */
         empty_data = (have_comp_size && st.comp_size == 0);
     }
     else {
@@ -170,6 +182,14 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
        source */
     changed_data = changed_data || (src != NULL);
 
+    if (!changed_data && data_src == NULL && ZIP_READS_POSITIONAL(srcza)) {
+        /* the read position of the archive source is shared by all threads and processes */
+        if ((data_src = _zip_reader_entry_source_new(&srcza->reader, de->offset, st.comp_size, error)) == NULL) {
+            return NULL;
+        }
+        take_ownership = true;
+    }
+
     if (partial_data && !needs_decrypt && !needs_decompress) {
         struct zip_stat st2;
         zip_t *source_archive;
@@ -182,6 +202,11 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
             source_archive = NULL;
             source_index = 0;
         }
+        else if (data_src != NULL) {
+            src = data_src;
+            source_archive = NULL;
+            source_index = 0;
+        }
         else {
             src = srcza->src;
             source_archive = srcza;
@@ -200,9 +225,13 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
             st2.valid |= ZIP_STAT_MTIME;
         }
 
-        if ((src = _zip_source_window_new(src, start, data_len, &st2, ZIP_STAT_NAME, &attributes, source_archive, source_index, take_ownership, error)) == NULL) {
+        if ((s2 = _zip_source_window_new(src, start, data_len, &st2, ZIP_STAT_NAME | ZIP_STAT_CRC, &attributes, source_archive, source_index, take_ownership, error)) == NULL) {
+            if (take_ownership) {
+                zip_source_free(src);
+            }
             return NULL;
         }
+        src = s2;
     }
     /* here we restrict src to file data, so no point in doing it for
        source that already represents only the file data */
@@ -211,6 +240,9 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
            that stat data come from the archive too, so it's safe to
            assume that st has a comp_size specified */
         if (st.comp_size > ZIP_INT64_MAX) {
+            if (take_ownership) {
+                zip_source_free(data_src);
+            }
             zip_error_set(error, ZIP_ER_INVAL, 0);
             return NULL;
         }
@@ -219,7 +251,16 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
            attributes and to have a source that positions the read
            offset properly before each read for multiple zip_file_t
            referring to the same underlying source */
-        if ((src =  _zip_source_window_new(srcza->src, 0, (zip_int64_t)st.comp_size, &st, ZIP_STAT_NAME, &attributes, srcza, srcidx, take_ownership, error)) == NULL) {
+        if (data_src != NULL) {
+            src = _zip_source_window_new(data_src, 0, (zip_int64_t)st.comp_size, &st, ZIP_STAT_NAME, &attributes, NULL, 0, take_ownership, error);
+            if (src == NULL && take_ownership) {
+                zip_source_free(data_src);
+            }
+        }
+        else {
+            src = _zip_source_window_new(srcza->src, 0, (zip_int64_t)st.comp_size, &st, ZIP_STAT_NAME, &attributes, srcza, srcidx, take_ownership, error);
+        }
+        if (src == NULL) {
             return NULL;
         }
     }
@@ -260,6 +301,7 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
 
         s2 = enc_impl(srcza, src, st.encryption_method, 0, password);
         if (s2 == NULL) {
+            _zip_error_copy(error, &srcza->error);
             zip_source_free(src);
             return NULL;
         }
@@ -269,12 +311,27 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
     if (needs_decompress) {
         s2 = zip_source_decompress(srcza, src, st.comp_method);
         if (s2 == NULL) {
+            _zip_error_copy(error, &srcza->error);
             zip_source_free(src);
             return NULL;
         }
         src = s2;
+        _zip_source_compress_set_zstd_parameters(src, &de->zstd_parameters);
+
+        /* seek index describes data in archive */
+        if (!changed_data && !encrypted) {
+            zip_seek_point_t *points;
+            zip_uint64_t npoints;
+
+            if ((points = _zip_seek_index_get(de, &npoints)) != NULL) {
+                /* seek index is optional, ignore failure */
+                (void)_zip_source_decompress_add_seek_points(src, points, npoints);
+                _zip_free(points);
+            }
+        }
     }
-    if (needs_crc) {
+    /* decompression layer or window can compute CRC as they produce data */
+    if (needs_crc && !(needs_decompress ? _zip_source_decompress_validate_crc(src) : _zip_source_window_validate_crc(src, srcza->num_threads))) {
         s2 = zip_source_crc_create(src, 1, error);
         if (s2 == NULL) {
             zip_source_free(src);
@@ -290,7 +347,7 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
             st2.valid = ZIP_STAT_SIZE;
             st2.size = (zip_uint64_t)data_len;
         }
-        s2 = _zip_source_window_new(src, start, data_len, &st2, ZIP_STAT_NAME, NULL, NULL, 0, true, error);
+        s2 = _zip_source_window_new(src, start, data_len, &st2, ZIP_STAT_NAME | ZIP_STAT_CRC, NULL, NULL, 0, true, error);
         if (s2 == NULL) {
             zip_source_free(src);
             return NULL;
@@ -301,6 +358,63 @@ ZIP_EXTERN zip_source_t *zip_source_zip_file_create(zip_t *srcza, zip_uint64_t s
     return src;
 }
 
+/* Make closed src, created by _zip_source_zip_new() for an entry of srcza, read entry srcidx instead, reusing its sources and decompression state.
+   This is done if both entries are unchanged, unencrypted, read whole, and use the same compression method.
+   Returns false if src can't be reused; it must then be freed. */
+bool
+_zip_source_zip_reuse(zip_source_t *src, zip_t *srcza, zip_uint64_t srcidx, zip_flags_t flags) {
+    zip_entry_t *entry;
+    zip_dirent_t *de;
+    zip_stat_t st;
+    zip_file_attributes_t attributes;
+    zip_error_t error;
+    bool compressed;
+
+    if ((flags & (ZIP_FL_COMPRESSED | ZIP_FL_ENCRYPTED)) || ZIP_READS_POSITIONAL(srcza) || srcidx >= srcza->nentry) {
+        return false;
+    }
+    entry = srcza->entry + srcidx;
+    if (ZIP_ENTRY_DATA_CHANGED(entry) || entry->deleted) {
+        return false;
+    }
+
+    if (zip_stat_index(srcza, srcidx, flags | ZIP_FL_UNCHANGED, &st) < 0) {
+        return false;
+    }
+    zip_error_init(&error);
+    de = _zip_get_dirent(srcza, srcidx, flags, &error);
+    zip_error_fini(&error);
+    if (de == NULL) {
+        return false;
+    }
+
+    /* empty and encrypted entries get different sources */
+    if ((st.valid & (ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC)) != (ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC) || ((st.valid & ZIP_STAT_ENCRYPTION_METHOD) && st.encryption_method != ZIP_EM_NONE) || st.size == 0 || st.comp_size == 0 || st.comp_size > ZIP_INT64_MAX) {
+        return false;
+    }
+    _zip_file_attributes_from_dirent(&attributes, de);
+
+    compressed = st.comp_method != ZIP_CM_STORE;
+    if (compressed) {
+        zip_seek_point_t *points;
+        zip_uint64_t npoints;
+
+        if (!_zip_source_decompress_reuse(srcza, src, st.comp_method)) {
+            return false;
+        }
+        _zip_source_compress_set_zstd_parameters(src, &de->zstd_parameters);
+        if ((points = _zip_seek_index_get(de, &npoints)) != NULL) {
+            /* seek index is optional, ignore failure */
+            (void)_zip_source_decompress_add_seek_points(src, points, npoints);
+            _zip_free(points);
+        }
+        src = src->src;
+    }
+
+    return _zip_source_window_reuse(src, srcza, srcidx, &st, &attributes, !compressed && (srcza->open_flags & ZIP_SKIP_CRC_CHECK) == 0);
+}
+
+
 static void
 _zip_file_attributes_from_dirent(zip_file_attributes_t *attributes, zip_dirent_t *de) {
     zip_file_attributes_init(attributes);
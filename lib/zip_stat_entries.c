@@ -0,0 +1,134 @@
+/*
+  zip_stat_entries.c -- get information about a range of entries
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+
+static zip_int64_t stat_entries(zip_t *za, zip_uint64_t first, zip_uint64_t count, zip_flags_t flags, zip_entry_info_t *infos);
+
+
+ZIP_EXTERN zip_int64_t
+zip_stat_entries(zip_t *za, zip_uint64_t first, zip_uint64_t count, zip_flags_t flags, zip_entry_info_t *infos) {
+    zip_int64_t n;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    if (infos == NULL && count > 0) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    n = stat_entries(za, first, count, flags, infos);
+    ZIP_UNLOCK(za);
+
+    return n;
+}
+
+
+static zip_int64_t
+stat_entries(zip_t *za, zip_uint64_t first, zip_uint64_t count, zip_flags_t flags, zip_entry_info_t *infos) {
+    zip_uint64_t i;
+
+    if (first > za->nentry) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+    count = ZIP_MIN(count, za->nentry - first);
+    if (count > ZIP_INT64_MAX) {
+        count = ZIP_INT64_MAX;
+    }
+
+    for (i = 0; i < count; i++) {
+        zip_uint64_t index = first + i;
+        zip_entry_t *entry = za->entry + index;
+        zip_entry_info_t *info = infos + i;
+        zip_dirent_t *de;
+        const zip_uint8_t *name;
+        bool unchanged_data;
+
+        if (!_zip_cdir_index_load(za, index, &za->error)) {
+            return -1;
+        }
+
+        if ((flags & ZIP_FL_UNCHANGED) ? entry->orig == NULL : entry->deleted) {
+            info->name = NULL;
+            info->valid = 0;
+            info->offset = ZIP_UINT64_MAX;
+            continue;
+        }
+
+        unchanged_data = entry->orig != NULL && ((flags & ZIP_FL_UNCHANGED) || !ZIP_ENTRY_DATA_CHANGED(entry));
+        info->offset = unchanged_data ? entry->orig->offset : ZIP_UINT64_MAX;
+
+        if (!unchanged_data || ((za->ch_flags & ZIP_AFL_WANT_TORRENTZIP) && (flags & ZIP_FL_UNCHANGED) == 0)) {
+            /* needs source stat or adjustments, rare enough to take the slow path */
+            zip_stat_t st;
+
+            if (_zip_stat_index(za, index, flags, &st) < 0) {
+                return -1;
+            }
+            info->name = st.name;
+            info->size = st.size;
+            info->comp_size = st.comp_size;
+            info->mtime = st.mtime;
+            info->crc = st.crc;
+            info->comp_method = st.comp_method;
+            info->encryption_method = st.encryption_method;
+            info->valid = (zip_uint32_t)(st.valid & (ZIP_STAT_NAME | ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD));
+            continue;
+        }
+
+        de = (flags & ZIP_FL_UNCHANGED) || entry->changes == NULL ? entry->orig : entry->changes;
+        if ((name = _zip_string_get(de->filename, NULL, flags, &za->error)) == NULL) {
+            return -1;
+        }
+
+        info->name = (const char *)name;
+        info->size = de->uncomp_size;
+        info->comp_size = de->comp_size;
+        info->mtime = _zip_dirent_get_last_mod(de, &za->dos_time_cache);
+        info->crc = de->crc;
+        info->comp_method = (zip_uint16_t)de->comp_method;
+        info->encryption_method = de->encryption_method;
+        info->valid = ZIP_STAT_NAME | (de->crc_valid ? ZIP_STAT_CRC : 0) | ZIP_STAT_SIZE | ZIP_STAT_MTIME | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+        if (entry->changes != NULL && (entry->changes->changed & ZIP_DIRENT_COMP_METHOD) && (flags & ZIP_FL_UNCHANGED) == 0) {
+            info->valid &= ~(zip_uint32_t)ZIP_STAT_COMP_SIZE;
+        }
+    }
+
+    return (zip_int64_t)count;
+}
@@ -37,6 +37,18 @@
 
 ZIP_EXTERN int
 zip_stat_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_stat_t *st) {
+    int ret;
+
+    ZIP_LOCK(za);
+    ret = _zip_stat_index(za, index, flags, st);
+    ZIP_UNLOCK(za);
+
+    return ret;
+}
+
+
+int
+_zip_stat_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_stat_t *st) {
     const char *name;
     zip_dirent_t *de;
     zip_entry_t *entry;
@@ -77,7 +89,7 @@ zip_stat_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_stat_t *st)
         }
 
         if (entry->changes != NULL && entry->changes->changed & ZIP_DIRENT_LAST_MOD) {
-            st->mtime = de->last_mod;
+            st->mtime = _zip_dirent_get_last_mod(de, &za->dos_time_cache);
             st->valid |= ZIP_STAT_MTIME;
         }
     }
@@ -86,7 +98,7 @@ zip_stat_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_stat_t *st)
 
         st->crc = de->crc;
         st->size = de->uncomp_size;
-        st->mtime = de->last_mod;
+        st->mtime = _zip_dirent_get_last_mod(de, &za->dos_time_cache);
         st->comp_size = de->comp_size;
         st->comp_method = (zip_uint16_t)de->comp_method;
         st->encryption_method = de->encryption_method;
@@ -98,7 +110,7 @@ zip_stat_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_stat_t *st)
 
     if ((za->ch_flags & ZIP_AFL_WANT_TORRENTZIP) && (flags & ZIP_FL_UNCHANGED) == 0) {
         st->comp_method = ZIP_CM_DEFLATE;
-        st->mtime = _zip_d2u_time(0xbc00, 0x2198);
+        st->mtime = _zip_d2u_time(&za->dos_time_cache, 0xbc00, 0x2198);
         st->valid |= ZIP_STAT_MTIME | ZIP_STAT_COMP_METHOD;
         st->valid &= ~ZIP_STAT_COMP_SIZE;
     }
@@ -0,0 +1,200 @@
+/*
+  zip_stats.c -- statistics about time spent and data processed
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_get_stats(zip_t *za, zip_uint32_t phase, zip_phase_stats_t *stats) {
+    if (za == NULL || stats == NULL) {
+        return -1;
+    }
+
+    if (phase >= ZIP_PHASE_COUNT || za->stats == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    ZIP_LOCK(za);
+    *stats = za->stats[phase];
+    ZIP_UNLOCK(za);
+
+    return 0;
+}
+
+
+ZIP_EXTERN int
+zip_register_stats_callback(zip_t *za, zip_stats_callback callback, void *ud) {
+    if (za == NULL) {
+        return -1;
+    }
+
+    if (callback != NULL && za->stats == NULL) {
+        /* statistics are collected from now on */
+        if ((za->stats = (zip_phase_stats_t *)_zip_calloc(ZIP_PHASE_COUNT, sizeof(za->stats[0]))) == NULL) {
+            zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+    }
+
+    za->stats_callback = callback;
+    za->stats_callback_ud = ud;
+
+    return 0;
+}
+
+
+/* Add one call to phase that started at start, as returned by _zip_stats_start(). */
+void
+_zip_stats_add(zip_t *za, zip_uint32_t phase, zip_uint64_t start, zip_uint64_t bytes_in, zip_uint64_t bytes_out) {
+    zip_uint64_t now;
+
+    if (za->stats == NULL) {
+        return;
+    }
+
+    now = _zip_stats_time();
+
+    ZIP_LOCK(za);
+    za->stats[phase].wall_time += now - ZIP_MIN(now, start);
+    za->stats[phase].bytes_in += bytes_in;
+    za->stats[phase].bytes_out += bytes_out;
+    za->stats[phase].count++;
+    ZIP_UNLOCK(za);
+}
+
+
+/* Return processor time used by process in nanoseconds. */
+zip_uint64_t
+_zip_stats_cpu_time(void) {
+    clock_t t = clock();
+
+    if (t == (clock_t)-1) {
+        return 0;
+    }
+
+    return (zip_uint64_t)((double)t * (1000000000.0 / (double)CLOCKS_PER_SEC));
+}
+
+
+void
+_zip_stats_notify(zip_t *za, zip_int64_t index) {
+    if (za->stats_callback != NULL) {
+        za->stats_callback(za, index, za->stats_callback_ud);
+    }
+}
+
+
+void
+_zip_stats_pipeline_init(zip_stats_pipeline_t *pipeline) {
+    int i;
+
+    memset(pipeline->phase, 0, sizeof(pipeline->phase));
+    pipeline->accounted = 0;
+    for (i = 0; i < ZIP_PHASE_COUNT; i++) {
+        pipeline->below[i] = -1;
+    }
+    pipeline->top_phase = -1;
+}
+
+
+/* Add statistics of pipeline to archive. Data going into a layer is what the meter below it counted coming out. */
+void
+_zip_stats_pipeline_merge(zip_t *za, const zip_stats_pipeline_t *pipeline) {
+    int i;
+
+    if (za->stats == NULL || pipeline->top_phase < 0) {
+        return;
+    }
+
+    for (i = 0; i < ZIP_PHASE_COUNT; i++) {
+        const zip_phase_stats_t *stats = pipeline->phase + i;
+
+        if (stats->count == 0) {
+            continue;
+        }
+
+        za->stats[i].wall_time += stats->wall_time;
+        za->stats[i].bytes_in += pipeline->below[i] >= 0 ? pipeline->phase[pipeline->below[i]].bytes_out : stats->bytes_out;
+        za->stats[i].bytes_out += stats->bytes_out;
+        za->stats[i].count += stats->count;
+    }
+}
+
+
+/* Return start time for _zip_stats_add(), 0 if za doesn't collect statistics. */
+zip_uint64_t
+_zip_stats_start(zip_t *za) {
+    return za->stats != NULL ? _zip_stats_time() : 0;
+}
+
+
+/* Return monotonic wall clock time in nanoseconds. */
+zip_uint64_t
+_zip_stats_time(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (zip_uint64_t)ts.tv_sec * 1000000000 + (zip_uint64_t)ts.tv_nsec;
+    }
+    return 0;
+#elif defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0 && !QueryPerformanceFrequency(&frequency)) {
+        return 0;
+    }
+    QueryPerformanceCounter(&counter);
+    return (zip_uint64_t)((double)counter.QuadPart * (1000000000.0 / (double)frequency.QuadPart));
+#elif defined(TIME_UTC)
+    struct timespec ts;
+
+    if (timespec_get(&ts, TIME_UTC) == TIME_UTC) {
+        return (zip_uint64_t)ts.tv_sec * 1000000000 + (zip_uint64_t)ts.tv_nsec;
+    }
+    return 0;
+#else
+    return (zip_uint64_t)time(NULL) * 1000000000;
+#endif
+}
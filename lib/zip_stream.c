@@ -0,0 +1,712 @@
+/*
+  zip_stream.c -- read zip archive front to back, without seeking
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* Entries are found via their local headers, the central directory is never read.
+   For entries with a data descriptor, the end of the data is only known once the decompressor reaches the end of the compressed stream. */
+
+typedef enum {
+    STREAM_NO_ENTRY,     /* before first entry */
+    STREAM_ENTRY_DATA,   /* reading data of current entry */
+    STREAM_ENTRY_DONE,   /* all data of current entry read */
+    STREAM_END,          /* central directory reached */
+    STREAM_BROKEN        /* can't continue after error */
+} stream_state_t;
+
+struct zip_stream {
+    zip_source_t *src; /* archive, open for reading */
+    zip_error_t error;
+    stream_state_t state;
+
+    zip_uint8_t *buffer;        /* data read from src, not used yet */
+    zip_uint64_t buffer_size;
+    zip_uint64_t buffer_offset; /* start of data not used yet */
+    zip_uint64_t buffer_length; /* end of data read */
+    bool eof;                   /* src has no more data */
+
+    zip_uint64_t index;   /* index of current entry */
+    zip_dirent_t *dirent; /* local header of current entry */
+    bool has_descriptor;  /* sizes and CRC follow data */
+    bool is_zip64;        /* local header has Zip64 extra field, so data descriptor has 64 bit sizes */
+
+    zip_compression_algorithm_t *algorithm; /* decompressor for current entry, NULL if stored or not supported */
+    void *algorithm_ctx;
+    zip_uint16_t algorithm_method; /* method algorithm_ctx was allocated for, kept for following entries */
+    bool algorithm_started;
+    zip_uint64_t input_length; /* number of bytes at buffer_offset given to decompressor */
+    bool end_of_input;
+
+    zip_uint64_t comp_read;   /* compressed data of current entry used */
+    zip_uint64_t uncomp_read; /* data of current entry returned */
+    zip_uint32_t crc;
+};
+
+static void algorithm_stop(zip_stream_t *zs);
+static bool buffer_fill(zip_stream_t *zs, zip_uint64_t length);
+static void buffer_consume(zip_stream_t *zs, zip_uint64_t length);
+static bool entry_finish(zip_stream_t *zs);
+static bool entry_skip(zip_stream_t *zs);
+static bool entry_start(zip_stream_t *zs, zip_stat_t *st);
+static zip_int64_t read_compressed(zip_stream_t *zs, zip_uint8_t *data, zip_uint64_t length);
+static zip_int64_t read_stored(zip_stream_t *zs, zip_uint8_t *data, zip_uint64_t length);
+static zip_int64_t read_stored_until_descriptor(zip_stream_t *zs, zip_uint8_t *data, zip_uint64_t length);
+
+#define BUFFER_AVAILABLE(zs) ((zs)->buffer_length - (zs)->buffer_offset)
+#define BUFFER_DATA(zs) ((zs)->buffer + (zs)->buffer_offset)
+
+
+ZIP_EXTERN zip_stream_t *
+zip_stream_open(zip_source_t *src, zip_error_t *error) {
+    zip_stream_t *zs;
+
+    if (src == NULL) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((zs = (zip_stream_t *)_zip_malloc(sizeof(*zs))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((zs->buffer = (zip_uint8_t *)_zip_malloc(ZIP_DEFAULT_IO_BUFFER_SIZE)) == NULL) {
+        _zip_free(zs);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(error, src);
+        _zip_free(zs->buffer);
+        _zip_free(zs);
+        return NULL;
+    }
+
+    zs->src = src;
+    zip_error_init(&zs->error);
+    zs->state = STREAM_NO_ENTRY;
+    zs->buffer_size = ZIP_DEFAULT_IO_BUFFER_SIZE;
+    zs->buffer_offset = zs->buffer_length = 0;
+    zs->eof = false;
+    zs->index = 0;
+    zs->dirent = NULL;
+    zs->has_descriptor = false;
+    zs->is_zip64 = false;
+    zs->algorithm = NULL;
+    zs->algorithm_ctx = NULL;
+    zs->algorithm_method = ZIP_CM_STORE;
+    zs->algorithm_started = false;
+    zs->input_length = 0;
+    zs->end_of_input = false;
+    zs->comp_read = zs->uncomp_read = 0;
+    zs->crc = 0;
+
+    return zs;
+}
+
+
+ZIP_EXTERN void
+zip_stream_close(zip_stream_t *zs) {
+    if (zs == NULL) {
+        return;
+    }
+
+    algorithm_stop(zs);
+    if (zs->algorithm_ctx != NULL) {
+        _zip_get_compression_algorithm(zs->algorithm_method, false)->deallocate(zs->algorithm_ctx);
+    }
+    _zip_dirent_free(zs->dirent);
+    zip_source_close(zs->src);
+    zip_source_free(zs->src);
+    _zip_free(zs->buffer);
+    zip_error_fini(&zs->error);
+    _zip_free(zs);
+}
+
+
+ZIP_EXTERN zip_error_t *
+zip_stream_get_error(zip_stream_t *zs) {
+    return &zs->error;
+}
+
+
+/* Advance to next entry, skipping the rest of the current one.
+   Returns 1 and fills in st for next entry, 0 at end of archive, -1 on error. */
+ZIP_EXTERN int
+zip_stream_next(zip_stream_t *zs, zip_stat_t *st) {
+    switch (zs->state) {
+    case STREAM_BROKEN:
+        return -1;
+
+    case STREAM_END:
+        return 0;
+
+    case STREAM_ENTRY_DATA:
+        if (!entry_skip(zs)) {
+            return -1;
+        }
+        zs->index++;
+        break;
+
+    case STREAM_ENTRY_DONE:
+        zs->index++;
+        break;
+
+    case STREAM_NO_ENTRY:
+        break;
+    }
+
+    _zip_dirent_free(zs->dirent);
+    zs->dirent = NULL;
+
+    if (!buffer_fill(zs, 4)) {
+        zs->state = STREAM_BROKEN;
+        return -1;
+    }
+    if (BUFFER_AVAILABLE(zs) < 4) {
+        /* archive ends without central directory */
+        zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+        zs->state = STREAM_BROKEN;
+        return -1;
+    }
+
+    if (zs->index == 0 && memcmp(BUFFER_DATA(zs), DATADES_MAGIC, 4) == 0) {
+        /* spanning marker of archive written as single segment */
+        buffer_consume(zs, 4);
+        if (!buffer_fill(zs, 4)) {
+            zs->state = STREAM_BROKEN;
+            return -1;
+        }
+    }
+
+    if (BUFFER_AVAILABLE(zs) >= 4 && memcmp(BUFFER_DATA(zs), LOCAL_MAGIC, 4) != 0) {
+        if (memcmp(BUFFER_DATA(zs), CENTRAL_MAGIC, 4) == 0 || memcmp(BUFFER_DATA(zs), EOCD_MAGIC, 4) == 0 || memcmp(BUFFER_DATA(zs), EOCD64_MAGIC, 4) == 0) {
+            zs->state = STREAM_END;
+            return 0;
+        }
+        zip_error_set(&zs->error, zs->index == 0 ? ZIP_ER_NOZIP : ZIP_ER_INCONS, 0);
+        zs->state = STREAM_BROKEN;
+        return -1;
+    }
+
+    if (!entry_start(zs, st)) {
+        zs->state = STREAM_BROKEN;
+        return -1;
+    }
+
+    zs->state = STREAM_ENTRY_DATA;
+    return 1;
+}
+
+
+/* Read data of current entry, returns 0 at end of its data. */
+ZIP_EXTERN zip_int64_t
+zip_stream_read(zip_stream_t *zs, void *data, zip_uint64_t length) {
+    zip_int64_t n;
+
+    if (zs->state == STREAM_BROKEN) {
+        return -1;
+    }
+    if (zs->state != STREAM_ENTRY_DATA || length == 0) {
+        return 0;
+    }
+
+    if (length > ZIP_INT64_MAX) {
+        length = ZIP_INT64_MAX;
+    }
+
+    if (zs->dirent->encryption_method != ZIP_EM_NONE) {
+        zip_error_set(&zs->error, ZIP_ER_ENCRNOTSUPP, 0);
+        n = -1;
+    }
+    else if (zs->dirent->comp_method == ZIP_CM_STORE) {
+        n = read_stored(zs, (zip_uint8_t *)data, length);
+    }
+    else {
+        n = read_compressed(zs, (zip_uint8_t *)data, length);
+    }
+
+    if (n < 0) {
+        if (zs->has_descriptor) {
+            /* end of data can't be found, neither can the next entry */
+            zs->state = STREAM_BROKEN;
+        }
+        return -1;
+    }
+
+    zs->crc = _zip_crc32(zs->crc, data, (zip_uint64_t)n);
+    zs->uncomp_read += (zip_uint64_t)n;
+
+    if (zs->state == STREAM_ENTRY_DONE) {
+        if (!entry_finish(zs)) {
+            zs->state = STREAM_BROKEN;
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+
+static void
+algorithm_stop(zip_stream_t *zs) {
+    if (zs->algorithm_started) {
+        zs->algorithm->end(zs->algorithm_ctx);
+        zs->algorithm_started = false;
+    }
+    zs->input_length = 0;
+    zs->end_of_input = false;
+}
+
+
+/* Make at least length bytes available in buffer, unless src ends before. */
+static bool
+buffer_fill(zip_stream_t *zs, zip_uint64_t length) {
+    zip_int64_t n;
+
+    if (BUFFER_AVAILABLE(zs) >= length || zs->eof) {
+        return true;
+    }
+
+    if (length > zs->buffer_size) {
+        zip_uint8_t *buffer;
+
+        if (length > SIZE_MAX || (buffer = (zip_uint8_t *)_zip_realloc(zs->buffer, (size_t)length)) == NULL) {
+            zip_error_set(&zs->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        zs->buffer = buffer;
+        zs->buffer_size = length;
+    }
+
+    if (zs->buffer_offset > 0) {
+        memmove(zs->buffer, BUFFER_DATA(zs), (size_t)BUFFER_AVAILABLE(zs));
+        zs->buffer_length -= zs->buffer_offset;
+        zs->buffer_offset = 0;
+    }
+
+    while (zs->buffer_length < length) {
+        if ((n = zip_source_read(zs->src, zs->buffer + zs->buffer_length, zs->buffer_size - zs->buffer_length)) < 0) {
+            zip_error_set_from_source(&zs->error, zs->src);
+            return false;
+        }
+        if (n == 0) {
+            zs->eof = true;
+            break;
+        }
+        zs->buffer_length += (zip_uint64_t)n;
+    }
+
+    return true;
+}
+
+
+static void
+buffer_consume(zip_stream_t *zs, zip_uint64_t length) {
+    zs->buffer_offset += length;
+    if (zs->buffer_offset == zs->buffer_length) {
+        zs->buffer_offset = zs->buffer_length = 0;
+    }
+}
+
+
+/* Read data descriptor if there is one and check what was read against it. */
+static bool
+entry_finish(zip_stream_t *zs) {
+    zip_dirent_t *de = zs->dirent;
+
+    algorithm_stop(zs);
+
+    if (zs->has_descriptor) {
+        zip_uint64_t size = zs->is_zip64 ? 20 : 12;
+        zip_buffer_t *buffer;
+
+        if (!buffer_fill(zs, size + 4)) {
+            return false;
+        }
+        if (BUFFER_AVAILABLE(zs) >= 4 && memcmp(BUFFER_DATA(zs), DATADES_MAGIC, 4) == 0) {
+            /* signature is optional */
+            buffer_consume(zs, 4);
+        }
+        if (BUFFER_AVAILABLE(zs) < size) {
+            zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+            return false;
+        }
+
+        if ((buffer = _zip_buffer_new(BUFFER_DATA(zs), size)) == NULL) {
+            zip_error_set(&zs->error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        de->crc = _zip_buffer_get_32(buffer);
+        if (zs->is_zip64) {
+            de->comp_size = _zip_buffer_get_64(buffer);
+            de->uncomp_size = _zip_buffer_get_64(buffer);
+        }
+        else {
+            de->comp_size = _zip_buffer_get_32(buffer);
+            de->uncomp_size = _zip_buffer_get_32(buffer);
+        }
+        _zip_buffer_free(buffer);
+        buffer_consume(zs, size);
+    }
+
+    if (de->comp_size != zs->comp_read || de->uncomp_size != zs->uncomp_read) {
+        zip_error_set(&zs->error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, zs->index));
+        return false;
+    }
+    if (de->crc != zs->crc) {
+        zip_error_set(&zs->error, ZIP_ER_CRC, 0);
+        return false;
+    }
+
+    return true;
+}
+
+
+/* Skip remaining data of current entry. */
+static bool
+entry_skip(zip_stream_t *zs) {
+    if (zs->has_descriptor) {
+        zip_uint8_t buf[BUFSIZE];
+        zip_int64_t n;
+
+        /* end of data is only found by decompressing it */
+        while ((n = zip_stream_read(zs, buf, sizeof(buf))) > 0) {
+        }
+        return n == 0;
+    }
+
+    zs->comp_read += zs->input_length;
+    buffer_consume(zs, zs->input_length);
+    algorithm_stop(zs);
+
+    while (zs->comp_read < zs->dirent->comp_size) {
+        zip_uint64_t n;
+
+        if (!buffer_fill(zs, 1)) {
+            zs->state = STREAM_BROKEN;
+            return false;
+        }
+        if (BUFFER_AVAILABLE(zs) == 0) {
+            zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+            zs->state = STREAM_BROKEN;
+            return false;
+        }
+        n = ZIP_MIN(BUFFER_AVAILABLE(zs), zs->dirent->comp_size - zs->comp_read);
+        buffer_consume(zs, n);
+        zs->comp_read += n;
+    }
+
+    return true;
+}
+
+
+/* Read local header at start of buffer and prepare reading entry data. */
+static bool
+entry_start(zip_stream_t *zs, zip_stat_t *st) {
+    zip_buffer_t *buffer;
+    zip_uint64_t size;
+    zip_uint16_t filename_len, ef_len;
+    zip_dirent_t *de;
+    zip_file_attributes_t attributes;
+
+    if (!buffer_fill(zs, LENTRYSIZE)) {
+        return false;
+    }
+    if (BUFFER_AVAILABLE(zs) < LENTRYSIZE) {
+        zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+        return false;
+    }
+    filename_len = (zip_uint16_t)(BUFFER_DATA(zs)[26] | (BUFFER_DATA(zs)[27] << 8));
+    ef_len = (zip_uint16_t)(BUFFER_DATA(zs)[28] | (BUFFER_DATA(zs)[29] << 8));
+    size = LENTRYSIZE + (zip_uint64_t)filename_len + ef_len;
+
+    if (!buffer_fill(zs, size)) {
+        return false;
+    }
+    if (BUFFER_AVAILABLE(zs) < size) {
+        zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+        return false;
+    }
+
+    zs->is_zip64 = false;
+    if (ef_len > 0) {
+        zip_extra_field_t *ef;
+
+        /* Zip64 extra field is removed by _zip_dirent_read */
+        if (!_zip_ef_parse(BUFFER_DATA(zs) + LENTRYSIZE + filename_len, ef_len, ZIP_EF_LOCAL, &ef, NULL, &zs->error)) {
+            return false;
+        }
+        zs->is_zip64 = _zip_ef_get_by_id(ef, NULL, ZIP_EF_ZIP64, 0, ZIP_EF_LOCAL, NULL) != NULL;
+        _zip_ef_free(ef);
+    }
+
+    if ((de = _zip_dirent_new()) == NULL) {
+        zip_error_set(&zs->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    if ((buffer = _zip_buffer_new(BUFFER_DATA(zs), size)) == NULL) {
+        _zip_dirent_free(de);
+        zip_error_set(&zs->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    if (_zip_dirent_read(de, NULL, buffer, true, NULL, &zs->error) < 0) {
+        _zip_buffer_free(buffer);
+        _zip_dirent_free(de);
+        return false;
+    }
+    _zip_buffer_free(buffer);
+    buffer_consume(zs, size);
+
+    zs->dirent = de;
+    zs->has_descriptor = (de->bitflags & ZIP_GPBF_DATA_DESCRIPTOR) != 0;
+    zs->comp_read = zs->uncomp_read = 0;
+    zs->crc = 0;
+
+    zip_stat_init(st);
+    st->valid = ZIP_STAT_INDEX | ZIP_STAT_MTIME | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+    st->index = zs->index;
+    st->mtime = _zip_dirent_get_last_mod(de, NULL);
+    st->comp_method = (zip_uint16_t)de->comp_method;
+    st->encryption_method = de->encryption_method;
+    if ((st->name = (const char *)_zip_string_get(de->filename, NULL, 0, NULL)) != NULL) {
+        st->valid |= ZIP_STAT_NAME;
+    }
+    if (!zs->has_descriptor) {
+        st->valid |= ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC;
+        st->size = de->uncomp_size;
+        st->comp_size = de->comp_size;
+        st->crc = de->crc;
+    }
+
+    /* entries that can't be read are only reported when reading, so they can be skipped */
+    zs->algorithm = NULL;
+    if (de->comp_method == ZIP_CM_STORE || de->encryption_method != ZIP_EM_NONE) {
+        return true;
+    }
+    if ((zs->algorithm = _zip_get_compression_algorithm(de->comp_method, false)) == NULL) {
+        return true;
+    }
+
+    if (zs->algorithm_ctx != NULL && zs->algorithm_method != de->comp_method) {
+        _zip_get_compression_algorithm(zs->algorithm_method, false)->deallocate(zs->algorithm_ctx);
+        zs->algorithm_ctx = NULL;
+    }
+    if (zs->algorithm_ctx == NULL) {
+        if ((zs->algorithm_ctx = zs->algorithm->allocate((zip_uint16_t)de->comp_method, 0, &zs->error)) == NULL) {
+            return false;
+        }
+        zs->algorithm_method = (zip_uint16_t)de->comp_method;
+    }
+
+    zip_file_attributes_init(&attributes);
+    attributes.valid = ZIP_FILE_ATTRIBUTES_GENERAL_PURPOSE_BIT_FLAGS;
+    attributes.general_purpose_bit_flags = de->bitflags;
+    attributes.general_purpose_bit_mask = ZIP_FILE_ATTRIBUTES_GENERAL_PURPOSE_BIT_FLAGS_ALLOWED_MASK;
+    if (!zs->algorithm->start(zs->algorithm_ctx, st, &attributes)) {
+        return false;
+    }
+    zs->algorithm_started = true;
+
+    return true;
+}
+
+
+static zip_int64_t
+read_compressed(zip_stream_t *zs, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t total = 0;
+
+    if (zs->algorithm == NULL) {
+        zip_error_set(&zs->error, ZIP_ER_COMPNOTSUPP, 0);
+        return -1;
+    }
+    if (zs->has_descriptor && zs->algorithm->unconsumed_input == NULL) {
+        /* end of compressed data can't be found */
+        zip_error_set(&zs->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+
+    while (total < length) {
+        zip_uint64_t n;
+
+        if (zs->input_length == 0 && !zs->end_of_input) {
+            if (!zs->has_descriptor && zs->comp_read == zs->dirent->comp_size) {
+                zs->algorithm->end_of_input(zs->algorithm_ctx);
+                zs->end_of_input = true;
+            }
+            else {
+                if (!buffer_fill(zs, 1)) {
+                    return -1;
+                }
+                if ((n = BUFFER_AVAILABLE(zs)) == 0) {
+                    zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+                    return -1;
+                }
+                if (!zs->has_descriptor) {
+                    n = ZIP_MIN(n, zs->dirent->comp_size - zs->comp_read);
+                }
+                if (!zs->algorithm->input(zs->algorithm_ctx, BUFFER_DATA(zs), n)) {
+                    return -1;
+                }
+                zs->input_length = n;
+            }
+        }
+
+        n = length - total;
+        switch (zs->algorithm->process(zs->algorithm_ctx, data + total, &n)) {
+        case ZIP_COMPRESSION_OK:
+            total += n;
+            break;
+
+        case ZIP_COMPRESSION_NEED_DATA:
+            total += n;
+            if (zs->end_of_input) {
+                /* compressed data ends prematurely */
+                zip_error_set(&zs->error, ZIP_ER_COMPRESSED_DATA, 0);
+                return -1;
+            }
+            zs->comp_read += zs->input_length;
+            buffer_consume(zs, zs->input_length);
+            zs->input_length = 0;
+            break;
+
+        case ZIP_COMPRESSION_END:
+            total += n;
+            if (zs->has_descriptor) {
+                zs->input_length -= zs->algorithm->unconsumed_input(zs->algorithm_ctx);
+            }
+            zs->comp_read += zs->input_length;
+            buffer_consume(zs, zs->input_length);
+            zs->input_length = 0;
+            zs->state = STREAM_ENTRY_DONE;
+            return (zip_int64_t)total;
+
+        case ZIP_COMPRESSION_ERROR:
+        default:
+            /* error set by algorithm */
+            return -1;
+        }
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+static zip_int64_t
+read_stored(zip_stream_t *zs, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t total = 0;
+
+    if (zs->has_descriptor) {
+        return read_stored_until_descriptor(zs, data, length);
+    }
+
+    while (total < length && zs->comp_read < zs->dirent->comp_size) {
+        zip_uint64_t n;
+
+        if (!buffer_fill(zs, 1)) {
+            return -1;
+        }
+        if (BUFFER_AVAILABLE(zs) == 0) {
+            zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+            return -1;
+        }
+        n = ZIP_MIN(ZIP_MIN(BUFFER_AVAILABLE(zs), length - total), zs->dirent->comp_size - zs->comp_read);
+        (void)memcpy_s(data + total, length - total, BUFFER_DATA(zs), n);
+        buffer_consume(zs, n);
+        zs->comp_read += n;
+        total += n;
+    }
+
+    if (zs->comp_read == zs->dirent->comp_size) {
+        zs->state = STREAM_ENTRY_DONE;
+    }
+
+    return (zip_int64_t)total;
+}
+
+
+/* Stored data is only ended by the data descriptor, found by its signature and matching sizes and CRC. */
+static zip_int64_t
+read_stored_until_descriptor(zip_stream_t *zs, zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t descriptor_size = 4 + (zs->is_zip64 ? 20 : 12);
+    zip_uint64_t i, n;
+    const zip_uint8_t *p;
+
+    if (!buffer_fill(zs, descriptor_size)) {
+        return -1;
+    }
+    if (BUFFER_AVAILABLE(zs) < descriptor_size) {
+        zip_error_set(&zs->error, ZIP_ER_EOF, 0);
+        return -1;
+    }
+
+    /* data can't end where a complete descriptor wouldn't fit in the buffer, that's decided after it's refilled */
+    n = BUFFER_AVAILABLE(zs) - descriptor_size + 1;
+    p = BUFFER_DATA(zs);
+    for (i = 0; i < n; i++) {
+        if (p[i] == 'P' && memcmp(p + i, DATADES_MAGIC, 4) == 0) {
+            zip_uint64_t size = zs->comp_read + i;
+            zip_uint64_t comp_size, uncomp_size;
+            zip_uint32_t crc;
+            zip_buffer_t *buffer;
+
+            if ((buffer = _zip_buffer_new((zip_uint8_t *)p + i + 4, descriptor_size - 4)) == NULL) {
+                zip_error_set(&zs->error, ZIP_ER_MEMORY, 0);
+                return -1;
+            }
+            crc = _zip_buffer_get_32(buffer);
+            comp_size = zs->is_zip64 ? _zip_buffer_get_64(buffer) : _zip_buffer_get_32(buffer);
+            uncomp_size = zs->is_zip64 ? _zip_buffer_get_64(buffer) : _zip_buffer_get_32(buffer);
+            _zip_buffer_free(buffer);
+
+            if (comp_size == size && uncomp_size == size && _zip_crc32(zs->crc, p, i) == crc) {
+                n = i;
+                if (n <= length) {
+                    zs->state = STREAM_ENTRY_DONE;
+                }
+                break;
+            }
+        }
+    }
+
+    n = ZIP_MIN(n, length);
+    (void)memcpy_s(data, length, p, n);
+    buffer_consume(zs, n);
+    zs->comp_read += n;
+
+    return (zip_int64_t)n;
+}
@@ -34,20 +34,16 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
 zip_uint32_t
 _zip_string_crc32(const zip_string_t *s) {
-    zip_uint32_t crc;
-
-    crc = (zip_uint32_t)crc32(0L, Z_NULL, 0);
-
-    if (s != NULL)
-        crc = (zip_uint32_t)crc32(crc, s->raw, s->length);
+    if (s == NULL) {
+        return 0;
+    }
 
-    return crc;
+    return _zip_crc32(0, s->raw, s->length);
 }
 
 
@@ -70,9 +66,12 @@ _zip_string_free(zip_string_t *s) {
     if (s == NULL)
         return;
 
-    free(s->raw);
-    free(s->converted);
-    free(s);
+    _zip_free(s->converted);
+    _zip_free(s->utf8_ef_data);
+    if (!s->in_arena) {
+        _zip_free(s->raw);
+        _zip_free(s);
+    }
 }
 
 
@@ -110,6 +109,44 @@ _zip_string_get(zip_string_t *string, zip_uint32_t *lenp, zip_flags_t flags, zip
 }
 
 
+/* Return data of Info-ZIP Unicode Path or Comment extra field for string.
+   It is built on first use and kept, since it is written to both the local header and the central directory. */
+const zip_uint8_t *
+_zip_string_utf8_ef_data(zip_string_t *s, zip_uint16_t *lenp, zip_error_t *error) {
+    zip_buffer_t *buffer;
+
+    if (s->length + 5 > ZIP_UINT16_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0); /* TODO: better error code? */
+        return NULL;
+    }
+
+    if (s->utf8_ef_data == NULL) {
+        if ((buffer = _zip_buffer_new(NULL, (zip_uint64_t)s->length + 5)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return NULL;
+        }
+
+        _zip_buffer_put_8(buffer, 1);
+        _zip_buffer_put_32(buffer, _zip_string_crc32(s));
+        _zip_buffer_put(buffer, s->raw, s->length);
+
+        if (!_zip_buffer_ok(buffer)) {
+            zip_error_set(error, ZIP_ER_INTERNAL, 0);
+            _zip_buffer_free(buffer);
+            return NULL;
+        }
+
+        /* keep data, free only buffer */
+        s->utf8_ef_data = _zip_buffer_data(buffer);
+        buffer->free_data = false;
+        _zip_buffer_free(buffer);
+    }
+
+    *lenp = (zip_uint16_t)(s->length + 5);
+    return s->utf8_ef_data;
+}
+
+
 zip_uint16_t
 _zip_string_length(const zip_string_t *s) {
     if (s == NULL)
@@ -121,6 +158,15 @@ _zip_string_length(const zip_string_t *s) {
 
 zip_string_t *
 _zip_string_new(const zip_uint8_t *raw, zip_uint16_t length, zip_flags_t flags, zip_error_t *error) {
+    return _zip_string_new_arena(NULL, raw, length, flags, error);
+}
+
+
+/* _zip_string_new_arena:
+   Like _zip_string_new, but allocate string from ARENA if it is not NULL. */
+
+zip_string_t *
+_zip_string_new_arena(zip_arena_t *arena, const zip_uint8_t *raw, zip_uint16_t length, zip_flags_t flags, zip_error_t *error) {
     zip_string_t *s;
     zip_encoding_type_t expected_encoding;
 
@@ -142,14 +188,24 @@ _zip_string_new(const zip_uint8_t *raw, zip_uint16_t length, zip_flags_t flags,
         return NULL;
     }
 
-    if ((s = (zip_string_t *)malloc(sizeof(*s))) == NULL) {
-        zip_error_set(error, ZIP_ER_MEMORY, 0);
-        return NULL;
+    if (arena != NULL) {
+        if ((s = (zip_string_t *)_zip_arena_alloc(arena, sizeof(*s) + (size_t)length + 1, error)) == NULL) {
+            return NULL;
+        }
+        s->raw = (zip_uint8_t *)(s + 1);
+        s->in_arena = true;
     }
+    else {
+        if ((s = (zip_string_t *)_zip_malloc(sizeof(*s))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return NULL;
+        }
 
-    if ((s->raw = (zip_uint8_t *)malloc((size_t)length + 1)) == NULL) {
-        free(s);
-        return NULL;
+        if ((s->raw = (zip_uint8_t *)_zip_malloc((size_t)length + 1)) == NULL) {
+            _zip_free(s);
+            return NULL;
+        }
+        s->in_arena = false;
     }
 
     (void)memcpy_s(s->raw, length + 1, raw, length);
@@ -158,6 +214,7 @@ _zip_string_new(const zip_uint8_t *raw, zip_uint16_t length, zip_flags_t flags,
     s->encoding = ZIP_ENCODING_UNKNOWN;
     s->converted = NULL;
     s->converted_length = 0;
+    s->utf8_ef_data = NULL;
 
     if (expected_encoding != ZIP_ENCODING_UNKNOWN) {
         if (_zip_guess_encoding(s, expected_encoding) == ZIP_ENCODING_ERROR) {
@@ -0,0 +1,406 @@
+/*
+  zip_thread_pool.c -- pool of worker threads
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "zipint.h"
+
+/* job passed to executor */
+struct zip_thread_task {
+    zip_thread_pool_t *pool;
+    zip_thread_job_t *job; /* NULL if job was taken back or dropped before task was started */
+    struct zip_thread_task *prev;
+    struct zip_thread_task *next;
+};
+typedef struct zip_thread_task zip_thread_task_t;
+
+struct zip_thread_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available; /* signalled when job is queued or pool is shut down */
+    pthread_cond_t work_done;      /* signalled when job is done */
+
+    zip_thread_job_t *head; /* queued jobs */
+    zip_thread_job_t *tail;
+    bool shutdown;
+
+    pthread_t *threads;
+    zip_uint32_t nthreads;
+
+    /* If an executor is set with zip_set_executor(), jobs are passed to it instead of worker threads. */
+    bool use_executor;
+    zip_executor_t executor;
+    zip_uint32_t max_running; /* at most this many jobs are passed to executor or run by waiting threads */
+    zip_uint32_t nrunning;
+    zip_thread_task_t *tasks; /* tasks not started yet */
+    zip_uint32_t ntasks;      /* tasks executor hasn't returned from yet; pool is kept until this is 0 */
+    bool freed;
+};
+
+static void dispatch(zip_thread_pool_t *pool);
+static void pool_destroy(zip_thread_pool_t *pool);
+static void run_job(zip_thread_pool_t *pool, zip_thread_job_t *job);
+static void run_task(void *ud);
+static void task_unlink(zip_thread_pool_t *pool, zip_thread_task_t *task);
+static void *worker(void *ud);
+
+
+void
+_zip_thread_pool_free(zip_thread_pool_t *pool) {
+    zip_uint32_t i, nthreads;
+    bool last;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    /* Jobs that haven't started yet are dropped, running jobs are waited for. */
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pool->head = pool->tail = NULL;
+    pthread_cond_broadcast(&pool->work_available);
+    if (pool->use_executor) {
+        while (pool->tasks != NULL) {
+            task_unlink(pool, pool->tasks);
+            pool->nrunning--;
+        }
+        while (pool->nrunning > 0) {
+            pthread_cond_wait(&pool->work_done, &pool->mutex);
+        }
+    }
+    /* Tasks the executor hasn't started yet still refer to pool, the last one frees it. */
+    pool->freed = true;
+    last = pool->ntasks == 0;
+    nthreads = pool->nthreads;
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    if (last) {
+        pool_destroy(pool);
+    }
+}
+
+
+/* Create pool of num_threads worker threads, or pass jobs to executor set with zip_set_executor(), at most num_threads at a time.
+   A pool without threads runs jobs in the thread waiting for them, in the order they were submitted,
+   so code written for a pool produces the same results without additional threads. */
+zip_thread_pool_t *
+_zip_thread_pool_new(zip_uint32_t num_threads, zip_error_t *error) {
+    zip_thread_pool_t *pool;
+    int ret = 0;
+
+    if ((pool = (zip_thread_pool_t *)_zip_malloc(sizeof(*pool))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if ((pool->threads = (pthread_t *)_zip_malloc(sizeof(pool->threads[0]) * ZIP_MAX(num_threads, 1))) == NULL) {
+        _zip_free(pool);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    pool->head = pool->tail = NULL;
+    pool->shutdown = false;
+    pool->nthreads = 0;
+    pool->use_executor = num_threads > 0 && _zip_executor_get(&pool->executor);
+    pool->max_running = num_threads;
+    pool->nrunning = 0;
+    pool->tasks = NULL;
+    pool->ntasks = 0;
+    pool->freed = false;
+
+    if ((ret = pthread_mutex_init(&pool->mutex, NULL)) != 0) {
+        _zip_free(pool->threads);
+        _zip_free(pool);
+        zip_error_set(error, ZIP_ER_INTERNAL, ret);
+        return NULL;
+    }
+    if ((ret = pthread_cond_init(&pool->work_available, NULL)) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        _zip_free(pool->threads);
+        _zip_free(pool);
+        zip_error_set(error, ZIP_ER_INTERNAL, ret);
+        return NULL;
+    }
+    if ((ret = pthread_cond_init(&pool->work_done, NULL)) != 0) {
+        pthread_cond_destroy(&pool->work_available);
+        pthread_mutex_destroy(&pool->mutex);
+        _zip_free(pool->threads);
+        _zip_free(pool);
+        zip_error_set(error, ZIP_ER_INTERNAL, ret);
+        return NULL;
+    }
+
+    if (pool->use_executor) {
+        return pool;
+    }
+
+    for (; pool->nthreads < num_threads; pool->nthreads++) {
+        if ((ret = pthread_create(pool->threads + pool->nthreads, NULL, worker, pool)) != 0) {
+            break;
+        }
+    }
+
+    if (pool->nthreads == 0 && num_threads > 0) {
+        _zip_thread_pool_free(pool);
+        zip_error_set(error, ZIP_ER_INTERNAL, ret);
+        return NULL;
+    }
+
+    return pool;
+}
+
+
+void
+_zip_thread_pool_submit(zip_thread_pool_t *pool, zip_thread_job_t *job) {
+    job->done = false;
+    job->next = NULL;
+    job->queued = true;
+    job->task = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->tail == NULL) {
+        pool->head = job;
+    }
+    else {
+        pool->tail->next = job;
+    }
+    pool->tail = job;
+    if (pool->use_executor) {
+        dispatch(pool);
+    }
+    else {
+        pthread_cond_signal(&pool->work_available);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+void
+_zip_thread_pool_wait(zip_thread_pool_t *pool, zip_thread_job_t *job) {
+    pthread_mutex_lock(&pool->mutex);
+    while (!job->done) {
+        if (pool->use_executor) {
+            /* Don't rely on the executor starting tasks while this thread waits, it may be one of its threads. */
+            if (pool->tasks != NULL) {
+                /* passed to executor but not started, run it here instead */
+                zip_thread_job_t *next = job->task != NULL ? job : pool->tasks->job;
+
+                task_unlink(pool, next->task);
+                run_job(pool, next);
+                pool->nrunning--;
+                dispatch(pool);
+                continue;
+            }
+            if (pool->head != NULL && pool->nrunning < pool->max_running) {
+                /* executor refused job, run queued jobs up to job in calling thread */
+                zip_thread_job_t *next = pool->head;
+
+                if ((pool->head = next->next) == NULL) {
+                    pool->tail = NULL;
+                }
+                next->queued = false;
+                pool->nrunning++;
+                run_job(pool, next);
+                pool->nrunning--;
+                continue;
+            }
+        }
+        else if (pool->nthreads == 0) {
+            /* no workers, run queued jobs up to job in calling thread */
+            zip_thread_job_t *next = pool->head;
+
+            if (next == NULL) {
+                /* job was never submitted */
+                break;
+            }
+            if ((pool->head = next->next) == NULL) {
+                pool->tail = NULL;
+            }
+            next->queued = false;
+            run_job(pool, next);
+            continue;
+        }
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/* Pass queued jobs to executor while fewer than max_running are running.
+   Called with pool locked, unlocks it while calling executor. */
+static void
+dispatch(zip_thread_pool_t *pool) {
+    while (!pool->shutdown && pool->head != NULL && pool->nrunning < pool->max_running) {
+        zip_thread_job_t *job = pool->head;
+        zip_thread_task_t *task;
+        int ret;
+
+        if ((task = (zip_thread_task_t *)_zip_malloc(sizeof(*task))) == NULL) {
+            /* job stays queued and is run by thread waiting for it */
+            return;
+        }
+
+        if ((pool->head = job->next) == NULL) {
+            pool->tail = NULL;
+        }
+        job->queued = false;
+        job->task = task;
+        task->pool = pool;
+        task->job = job;
+        task->prev = NULL;
+        if ((task->next = pool->tasks) != NULL) {
+            task->next->prev = task;
+        }
+        pool->tasks = task;
+        pool->ntasks++;
+        pool->nrunning++;
+
+        pthread_mutex_unlock(&pool->mutex);
+        ret = pool->executor.submit(pool->executor.ud, run_task, task);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (ret != 0) {
+            if (task->job != NULL) {
+                /* put job back at head of queue, thread waiting for it runs it */
+                task_unlink(pool, task);
+                pool->nrunning--;
+                job->queued = true;
+                if ((job->next = pool->head) == NULL) {
+                    pool->tail = job;
+                }
+                pool->head = job;
+                pthread_cond_broadcast(&pool->work_done);
+            }
+            pool->ntasks--;
+            _zip_free(task);
+            return;
+        }
+    }
+}
+
+
+static void
+pool_destroy(zip_thread_pool_t *pool) {
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->mutex);
+    _zip_free(pool->threads);
+    _zip_free(pool);
+}
+
+
+/* Run job with pool unlocked and mark it as done. Called with pool locked. */
+static void
+run_job(zip_thread_pool_t *pool, zip_thread_job_t *job) {
+    pthread_mutex_unlock(&pool->mutex);
+    job->run(job->ud);
+    pthread_mutex_lock(&pool->mutex);
+    job->done = true;
+    pthread_cond_broadcast(&pool->work_done);
+}
+
+
+/* Called by executor. */
+static void
+run_task(void *ud) {
+    zip_thread_task_t *task = (zip_thread_task_t *)ud;
+    zip_thread_pool_t *pool = task->pool;
+    zip_thread_job_t *job;
+    bool last;
+
+    pthread_mutex_lock(&pool->mutex);
+    if ((job = task->job) != NULL) {
+        task_unlink(pool, task);
+        run_job(pool, job);
+        pool->nrunning--;
+        dispatch(pool);
+    }
+    pool->ntasks--;
+    last = pool->freed && pool->ntasks == 0;
+    pthread_mutex_unlock(&pool->mutex);
+
+    _zip_free(task);
+    if (last) {
+        pool_destroy(pool);
+    }
+}
+
+
+/* Remove task from list of tasks not started yet and detach it from its job. */
+static void
+task_unlink(zip_thread_pool_t *pool, zip_thread_task_t *task) {
+    if (task->prev != NULL) {
+        task->prev->next = task->next;
+    }
+    else {
+        pool->tasks = task->next;
+    }
+    if (task->next != NULL) {
+        task->next->prev = task->prev;
+    }
+    task->job->task = NULL;
+    task->job = NULL;
+}
+
+
+static void *
+worker(void *ud) {
+    zip_thread_pool_t *pool = (zip_thread_pool_t *)ud;
+    zip_thread_job_t *job;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (pool->head == NULL && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+
+        job = pool->head;
+        if ((pool->head = job->next) == NULL) {
+            pool->tail = NULL;
+        }
+        job->queued = false;
+        run_job(pool, job);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
@@ -54,6 +54,9 @@ _zip_unchange(zip_t *za, zip_uint64_t idx, int allow_duplicates) {
     }
 
     renamed = za->entry[idx].changes && (za->entry[idx].changes->changed & ZIP_DIRENT_FILENAME);
+    if (renamed || za->entry[idx].deleted) {
+        _zip_name_index_free(za);
+    }
     if (!allow_duplicates && (renamed || za->entry[idx].deleted)) {
         const char *orig_name = NULL;
         const char *changed_name = NULL;
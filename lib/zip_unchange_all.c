@@ -35,20 +35,61 @@
 #include "zipint.h"
 
 
+static int revert_names(zip_t *za, zip_uint64_t idx);
+
+
 ZIP_EXTERN int
 zip_unchange_all(zip_t *za) {
     int ret;
     zip_uint64_t i;
 
-    if (!_zip_hash_revert(za->names, &za->error)) {
-        return -1;
+    /* only logged and new entries can have changes; names point into changes, so revert them first */
+    for (i = 0; i < za->nchange_log; i++) {
+        if (revert_names(za, za->change_log[i]) < 0) {
+            return -1;
+        }
+    }
+    for (i = za->nentry_orig; i < za->nentry; i++) {
+        if (revert_names(za, i) < 0) {
+            return -1;
+        }
     }
+    _zip_name_index_free(za);
 
     ret = 0;
-    for (i = 0; i < za->nentry; i++)
+    for (i = 0; i < za->nchange_log; i++) {
+        ret |= _zip_unchange(za, za->change_log[i], 1);
+        za->entry[za->change_log[i]].logged = false;
+    }
+    za->nchange_log = 0;
+    for (i = za->nentry_orig; i < za->nentry; i++) {
         ret |= _zip_unchange(za, i, 1);
+    }
 
     ret |= zip_unchange_archive(za);
 
     return ret;
 }
+
+
+/* Restore hash table entries for original and changed name of entry idx. */
+static int
+revert_names(zip_t *za, zip_uint64_t idx) {
+    zip_entry_t *e = za->entry + idx;
+    const zip_uint8_t *name;
+
+    if (e->orig != NULL) {
+        if ((name = _zip_string_get(e->orig->filename, NULL, 0, &za->error)) == NULL) {
+            return -1;
+        }
+        _zip_hash_revert_name(za->names, name);
+    }
+    if (e->changes != NULL && (e->changes->changed & ZIP_DIRENT_FILENAME)) {
+        if ((name = _zip_string_get(e->changes->filename, NULL, 0, &za->error)) == NULL) {
+            return -1;
+        }
+        _zip_hash_revert_name(za->names, name);
+    }
+
+    return 0;
+}
@@ -44,8 +44,18 @@ zip_unchange_archive(zip_t *za) {
         za->comment_changes = NULL;
         za->comment_changed = 0;
     }
+    if (za->prefix_changed) {
+        _zip_free(za->prefix_changes);
+        za->prefix_changes = NULL;
+        za->prefix_changes_length = 0;
+        za->prefix_changed = false;
+    }
 
     za->ch_flags = za->flags;
+    za->alignment = za->alignment_orig;
+    _zip_free(za->data_order);
+    za->data_order = NULL;
+    za->ndata_order = 0;
 
     return 0;
 }
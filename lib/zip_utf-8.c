@@ -35,6 +35,15 @@
 #include "zipint.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASCII_SPAN_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ASCII_SPAN_NEON
+#endif
 
 
 static const zip_uint16_t _cp437_to_unicode[256] = {
@@ -96,6 +105,44 @@ static const zip_uint16_t _cp437_to_unicode[256] = {
 #define UTF_8_CONTINUE_MATCH 0x80
 
 
+/* Return length of the run of printable ASCII characters (0x20 - 0x7e) at the start of data.
+   These are the same in ASCII, UTF-8, and CP437, so they need neither guessing nor conversion. */
+zip_uint32_t
+_zip_ascii_span(const zip_uint8_t *data, zip_uint32_t length) {
+    zip_uint32_t i = 0;
+
+#if defined(ASCII_SPAN_SSE2)
+    const __m128i lower = _mm_set1_epi8(0x1f);
+    const __m128i upper = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        /* signed comparison, bytes >= 0x80 are negative */
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(x, lower), _mm_cmplt_epi8(x, upper)));
+        if (mask != 0xffff) {
+            break;
+        }
+    }
+#elif defined(ASCII_SPAN_NEON)
+    const uint8x16_t lower = vdupq_n_u8(0x20);
+    const uint8x16_t upper = vdupq_n_u8(0x7e);
+
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t x = vld1q_u8(data + i);
+        if (vminvq_u8(vandq_u8(vcgeq_u8(x, lower), vcleq_u8(x, upper))) != 0xff) {
+            break;
+        }
+    }
+#endif
+
+    while (i < length && data[i] >= 0x20 && data[i] <= 0x7e) {
+        i++;
+    }
+
+    return i;
+}
+
+
 zip_encoding_type_t
 _zip_guess_encoding(zip_string_t *str, zip_encoding_type_t expected_encoding) {
     zip_encoding_type_t enc;
@@ -111,7 +158,7 @@ _zip_guess_encoding(zip_string_t *str, zip_encoding_type_t expected_encoding) {
         enc = str->encoding;
     else {
         enc = ZIP_ENCODING_ASCII;
-        for (i = 0; i < str->length; i++) {
+        for (i = _zip_ascii_span(name, str->length); i < str->length; i++) {
             if ((name[i] > 31 && name[i] < 128) || name[i] == '\r' || name[i] == '\n' || name[i] == '\t')
                 continue;
 
@@ -207,17 +254,28 @@ _zip_cp437_to_utf8(const zip_uint8_t *const _cp437buf, zip_uint32_t len, zip_uin
     }
 
     buflen = 1;
-    for (i = 0; i < len; i++)
-        buflen += _zip_unicode_to_utf8_len(_cp437_to_unicode[cp437buf[i]]);
+    for (i = 0; i < len; i++) {
+        zip_uint32_t n = _zip_ascii_span(cp437buf + i, len - i);
+        buflen += n;
+        i += n;
+        if (i < len)
+            buflen += _zip_unicode_to_utf8_len(_cp437_to_unicode[cp437buf[i]]);
+    }
 
-    if ((utf8buf = (zip_uint8_t *)malloc(buflen)) == NULL) {
+    if ((utf8buf = (zip_uint8_t *)_zip_malloc(buflen)) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
     offset = 0;
-    for (i = 0; i < len; i++)
-        offset += _zip_unicode_to_utf8(_cp437_to_unicode[cp437buf[i]], utf8buf + offset);
+    for (i = 0; i < len; i++) {
+        zip_uint32_t n = _zip_ascii_span(cp437buf + i, len - i);
+        (void)memcpy_s(utf8buf + offset, buflen - offset, cp437buf + i, n);
+        offset += n;
+        i += n;
+        if (i < len)
+            offset += _zip_unicode_to_utf8(_cp437_to_unicode[cp437buf[i]], utf8buf + offset);
+    }
 
     utf8buf[buflen - 1] = 0;
     if (utf8_lenp)
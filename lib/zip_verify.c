@@ -0,0 +1,395 @@
+/*
+  zip_verify.c -- check headers and data of all entries
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/* size of buffer data is read into and discarded */
+#define VERIFY_BUFFER_SIZE (64 * 1024)
+
+/* verification of one entry, run in worker thread if there is a thread pool */
+struct verify_job {
+    zip_thread_job_t job;
+    const zip_reader_t *reader; /* NULL if archive is read through src of archive, in calling thread */
+    zip_source_t *archive_src;
+    zip_dirent_t *de;
+    zip_uint64_t index;
+    zip_source_t *src; /* data of entry, NULL if it couldn't be created */
+    zip_error_t error;
+};
+typedef struct verify_job verify_job_t;
+
+/* jobs for entries, created ahead of reporting their results */
+struct verify_queue {
+    zip_reader_t reader;
+    bool have_reader;
+#ifdef HAVE_THREADS
+    zip_thread_pool_t *pool;
+    verify_job_t **jobs;          /* one per entry, NULL if not submitted */
+    zip_uint64_t next;            /* next entry to submit */
+    zip_uint64_t outstanding;     /* number of jobs submitted but not reported yet */
+    zip_uint64_t max_outstanding; /* limit on outstanding jobs, bounds memory usage */
+#endif
+};
+typedef struct verify_queue verify_queue_t;
+
+static bool read_fully(const zip_reader_t *reader, zip_uint64_t offset, zip_uint8_t *data, zip_uint64_t length, zip_error_t *error);
+static void verify_job_free(verify_job_t *job);
+static verify_job_t *verify_job_new(zip_t *za, verify_queue_t *queue, zip_uint64_t index);
+static void verify_job_run(void *ud);
+static bool verify_local_header(verify_job_t *job, zip_error_t *error);
+static void verify_queue_fini(verify_queue_t *queue, zip_uint64_t nentries);
+static int verify_queue_init(zip_t *za, verify_queue_t *queue, zip_uint64_t nentries);
+static verify_job_t *verify_queue_take(zip_t *za, verify_queue_t *queue, zip_uint64_t index, zip_uint64_t nentries);
+
+
+ZIP_EXTERN int
+zip_verify(zip_t *za, zip_verify_callback callback, void *ud) {
+    verify_queue_t queue;
+    zip_int64_t n;
+    zip_uint64_t idx;
+    bool failed = false;
+    int ret = 0;
+
+    if (za == NULL) {
+        return -1;
+    }
+
+    if ((n = zip_get_num_entries(za, ZIP_FL_UNCHANGED)) < 0) {
+        return -1;
+    }
+
+    if (verify_queue_init(za, &queue, (zip_uint64_t)n) < 0) {
+        return -1;
+    }
+
+    for (idx = 0; idx < (zip_uint64_t)n; idx++) {
+        verify_job_t *job;
+
+        if ((job = verify_queue_take(za, &queue, idx, (zip_uint64_t)n)) == NULL) {
+            ret = -1;
+            break;
+        }
+
+        if (zip_error_code_zip(&job->error) != ZIP_ER_OK && !failed) {
+            _zip_error_copy(&za->error, &job->error);
+            failed = true;
+        }
+        if (callback != NULL && callback(za, idx, &job->error, ud) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            verify_job_free(job);
+            ret = -1;
+            break;
+        }
+        verify_job_free(job);
+    }
+
+    verify_queue_fini(&queue, (zip_uint64_t)n);
+
+    return failed ? -1 : ret;
+}
+
+
+static bool
+read_fully(const zip_reader_t *reader, zip_uint64_t offset, zip_uint8_t *data, zip_uint64_t length, zip_error_t *error) {
+    zip_uint64_t done;
+    zip_int64_t n;
+
+    for (done = 0; done < length; done += (zip_uint64_t)n) {
+        if ((n = _zip_reader_read(reader, offset + done, data + done, length - done, error)) < 0) {
+            return false;
+        }
+        if (n == 0) {
+            zip_error_set(error, ZIP_ER_EOF, 0);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void
+verify_job_free(verify_job_t *job) {
+    if (job == NULL) {
+        return;
+    }
+
+    zip_source_free(job->src);
+    zip_error_fini(&job->error);
+    _zip_free(job);
+}
+
+
+/* Create job for entry index. Errors other than running out of memory are recorded in the job. */
+static verify_job_t *
+verify_job_new(zip_t *za, verify_queue_t *queue, zip_uint64_t index) {
+    verify_job_t *job;
+    zip_source_t *data_src = NULL;
+
+    if ((job = (verify_job_t *)_zip_malloc(sizeof(*job))) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    job->job.run = verify_job_run;
+    job->job.ud = job;
+    job->reader = queue->have_reader ? &queue->reader : NULL;
+    job->archive_src = za->src;
+    job->index = index;
+    job->src = NULL;
+    zip_error_init(&job->error);
+
+    if ((job->de = _zip_get_dirent(za, index, ZIP_FL_UNCHANGED, &job->error)) == NULL) {
+        return job;
+    }
+
+    if (job->reader != NULL && (data_src = _zip_reader_entry_source_new(job->reader, job->de->offset, job->de->comp_size, &job->error)) == NULL) {
+        return job;
+    }
+    job->src = _zip_source_zip_new(za, index, ZIP_FL_UNCHANGED | ZIP_FL_CHECK_CRC, 0, -1, NULL, data_src, &job->error);
+    zip_source_free(data_src);
+
+    return job;
+}
+
+
+/* Runs in worker thread if job has a reader, must only access its job then. */
+static void
+verify_job_run(void *ud) {
+    verify_job_t *job = (verify_job_t *)ud;
+    zip_uint8_t *buffer;
+    zip_error_t error;
+    zip_int64_t n;
+
+    if (job->de == NULL) {
+        return;
+    }
+
+    zip_error_init(&error);
+    if (!verify_local_header(job, &error)) {
+        _zip_error_copy(&job->error, &error);
+        zip_error_fini(&error);
+        return;
+    }
+    zip_error_fini(&error);
+
+    if (job->src == NULL) {
+        /* error creating source is in job->error */
+        return;
+    }
+
+    if ((buffer = (zip_uint8_t *)_zip_malloc(VERIFY_BUFFER_SIZE)) == NULL) {
+        zip_error_set(&job->error, ZIP_ER_MEMORY, 0);
+        return;
+    }
+
+    /* layers of source validate CRC and length at end of data */
+    if (zip_source_open(job->src) < 0) {
+        zip_error_set_from_source(&job->error, job->src);
+        _zip_free(buffer);
+        return;
+    }
+    while ((n = zip_source_read(job->src, buffer, VERIFY_BUFFER_SIZE)) > 0) {
+    }
+    if (n < 0) {
+        zip_error_set_from_source(&job->error, job->src);
+    }
+    zip_source_close(job->src);
+    _zip_free(buffer);
+}
+
+
+/* Read local header of entry and compare it to central directory entry. */
+static bool
+verify_local_header(verify_job_t *job, zip_error_t *error) {
+    zip_dirent_t local;
+    zip_int64_t ret;
+
+    if (job->reader != NULL) {
+        zip_uint8_t fixed[LENTRYSIZE];
+        zip_uint8_t *data;
+        zip_buffer_t *buffer;
+        zip_uint64_t length;
+
+        if (!read_fully(job->reader, job->de->offset, fixed, LENTRYSIZE, error)) {
+            return false;
+        }
+        if (memcmp(fixed, LOCAL_MAGIC, 4) != 0) {
+            zip_error_set(error, ZIP_ER_NOZIP, 0);
+            return false;
+        }
+        /* file name and extra field lengths */
+        length = LENTRYSIZE + (zip_uint64_t)(fixed[26] | (fixed[27] << 8)) + (zip_uint64_t)(fixed[28] | (fixed[29] << 8));
+
+        if ((data = (zip_uint8_t *)_zip_malloc((size_t)length)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        if (!read_fully(job->reader, job->de->offset, data, length, error)) {
+            _zip_free(data);
+            return false;
+        }
+        if ((buffer = _zip_buffer_new(data, length)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            _zip_free(data);
+            return false;
+        }
+        ret = _zip_dirent_read(&local, NULL, buffer, true, NULL, error);
+        _zip_buffer_free(buffer);
+        _zip_free(data);
+    }
+    else {
+        if (zip_source_seek(job->archive_src, (zip_int64_t)job->de->offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(error, job->archive_src);
+            return false;
+        }
+        ret = _zip_dirent_read(&local, job->archive_src, NULL, true, NULL, error);
+    }
+
+    if (ret < 0) {
+        if (zip_error_code_zip(error) == ZIP_ER_INCONS) {
+            zip_error_set(error, ZIP_ER_INCONS, ADD_INDEX_TO_DETAIL(zip_error_code_system(error), job->index));
+        }
+        return false;
+    }
+
+    if (_zip_headercomp(job->de, &local) != 0) {
+        zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_ENTRY_HEADER_MISMATCH, job->index));
+        _zip_dirent_finalize(&local);
+        return false;
+    }
+
+    _zip_dirent_finalize(&local);
+    return true;
+}
+
+
+static void
+verify_queue_fini(verify_queue_t *queue, zip_uint64_t nentries) {
+#ifdef HAVE_THREADS
+    zip_uint64_t idx;
+
+    if (queue->pool == NULL) {
+        return;
+    }
+
+    /* waits for running jobs, so all jobs can be freed afterwards */
+    _zip_thread_pool_free(queue->pool);
+    for (idx = 0; idx < nentries; idx++) {
+        verify_job_free(queue->jobs[idx]);
+    }
+    _zip_free(queue->jobs);
+#else
+    (void)queue;
+    (void)nentries;
+#endif
+}
+
+
+static int
+verify_queue_init(zip_t *za, verify_queue_t *queue, zip_uint64_t nentries) {
+#ifdef HAVE_THREADS
+    zip_uint64_t idx;
+#endif
+
+    queue->have_reader = _zip_reader_init(&queue->reader, za->src);
+
+#ifdef HAVE_THREADS
+    queue->pool = NULL;
+    queue->jobs = NULL;
+    queue->next = 0;
+    queue->outstanding = 0;
+    queue->max_outstanding = 2 * (zip_uint64_t)za->num_threads;
+
+    if (za->num_threads <= 1 || nentries == 0 || !queue->have_reader) {
+        /* entries are verified in calling thread */
+        return 0;
+    }
+
+    if (nentries > SIZE_MAX / sizeof(queue->jobs[0]) || (queue->jobs = (verify_job_t **)_zip_malloc(sizeof(queue->jobs[0]) * (size_t)nentries)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+    for (idx = 0; idx < nentries; idx++) {
+        queue->jobs[idx] = NULL;
+    }
+
+    if ((queue->pool = _zip_thread_pool_new(za->num_threads, &za->error)) == NULL) {
+        _zip_free(queue->jobs);
+        queue->jobs = NULL;
+        return -1;
+    }
+#else
+    (void)nentries;
+#endif
+
+    return 0;
+}
+
+
+/* Return finished job for entry index, submitting jobs for upcoming entries first. */
+static verify_job_t *
+verify_queue_take(zip_t *za, verify_queue_t *queue, zip_uint64_t index, zip_uint64_t nentries) {
+    verify_job_t *job;
+
+#ifdef HAVE_THREADS
+    if (queue->pool != NULL) {
+        for (; queue->next < nentries && queue->outstanding < queue->max_outstanding; queue->next++) {
+            if ((job = verify_job_new(za, queue, queue->next)) == NULL) {
+                return NULL;
+            }
+            queue->jobs[queue->next] = job;
+            queue->outstanding++;
+            _zip_thread_pool_submit(queue->pool, &job->job);
+        }
+
+        job = queue->jobs[index];
+        _zip_thread_pool_wait(queue->pool, &job->job);
+        queue->jobs[index] = NULL;
+        queue->outstanding--;
+        return job;
+    }
+#else
+    (void)nentries;
+#endif
+
+    if ((job = verify_job_new(za, queue, index)) == NULL) {
+        return NULL;
+    }
+    verify_job_run(job);
+    return job;
+}
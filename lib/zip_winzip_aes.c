@@ -42,32 +42,121 @@
 #define MAX_KEY_LENGTH 256
 #define PBKDF2_ITERATIONS 1000
 
+/* number of key stream blocks computed in one call to the crypto backend */
+#define PAD_BLOCKS 64
+/* data encrypted before it is passed to the HMAC, small enough to still be in the cache */
+#define STITCH_LENGTH (16 * 1024)
+
+/* AES key, HMAC key, password verifier */
+#define KEY_MATERIAL_LENGTH (2 * (MAX_KEY_LENGTH / 8) + WINZIP_AES_PASSWORD_VERIFY_LENGTH)
+#define KEY_MATERIAL_USED(key_size) (2 * ((key_size) / 8) + WINZIP_AES_PASSWORD_VERIFY_LENGTH)
+#define KEY_CACHE_SIZE 64
+
 struct _zip_winzip_aes {
     _zip_crypto_aes_t *aes;
     _zip_crypto_hmac_t *hmac;
+    bool have_provider; /* use provider instead of aes and hmac */
+    zip_crypto_provider_t provider;
+    void *provider_aes;
+    void *provider_hmac;
     zip_uint8_t counter[ZIP_CRYPTO_AES_BLOCK_LENGTH];
-    zip_uint8_t pad[ZIP_CRYPTO_AES_BLOCK_LENGTH];
-    int pad_offset;
+    zip_uint8_t counters[PAD_BLOCKS * ZIP_CRYPTO_AES_BLOCK_LENGTH];
+    zip_uint8_t pad[PAD_BLOCKS * ZIP_CRYPTO_AES_BLOCK_LENGTH];
+    zip_uint64_t pad_offset;
+    zip_uint64_t pad_length;
+};
+
+/* key material derived by PBKDF2, for a password, salt, and key size */
+
+struct key_cache_entry {
+    bool prepared; /* derived ahead for a random salt, not used yet */
+    zip_uint8_t *password;
+    zip_uint64_t password_length;
+    zip_uint16_t key_size;
+    zip_uint8_t salt[(MAX_KEY_LENGTH / 8) / 2];
+    zip_uint8_t key_material[KEY_MATERIAL_LENGTH];
 };
 
+struct zip_winzip_aes_key_cache {
+#ifdef HAVE_THREADS
+    zip_mutex_t *mutex; /* sources using the cache may be opened in worker threads */
+#endif
+    struct key_cache_entry entry[KEY_CACHE_SIZE];
+    unsigned int nentry;
+    unsigned int next; /* entry to replace when full */
+};
+
+static bool derive_key(const zip_crypto_provider_t *provider, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t salt_length, zip_uint8_t *key_material, zip_uint16_t key_material_length);
+static void key_cache_add(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t key_size, const zip_uint8_t *key_material, bool prepared);
+static bool key_cache_find(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t key_size, zip_uint8_t *key_material);
+
+/* Compute the key stream for the next N counter values into ctx->pad.
+   The counter is little endian, so the CTR modes of the crypto backends can't be used; the counter blocks are encrypted in ECB mode instead. */
 static bool
-aes_crypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
+fill_pad(zip_winzip_aes_t *ctx, zip_uint64_t n) {
     zip_uint64_t i, j;
 
-    for (i = 0; i < length; i++) {
-        if (ctx->pad_offset == AES_BLOCK_SIZE) {
-            for (j = 0; j < 8; j++) {
-                ctx->counter[j]++;
-                if (ctx->counter[j] != 0) {
-                    break;
-                }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 8; j++) {
+            ctx->counter[j]++;
+            if (ctx->counter[j] != 0) {
+                break;
             }
-            if (!_zip_crypto_aes_encrypt_block(ctx->aes, ctx->counter, ctx->pad)) {
+        }
+        (void)memcpy_s(ctx->counters + i * ZIP_CRYPTO_AES_BLOCK_LENGTH, ZIP_CRYPTO_AES_BLOCK_LENGTH, ctx->counter, ZIP_CRYPTO_AES_BLOCK_LENGTH);
+    }
+
+    if (ctx->have_provider) {
+        if (ctx->provider.aes_encrypt_blocks(ctx->provider.ud, ctx->provider_aes, ctx->counters, ctx->pad, n * ZIP_CRYPTO_AES_BLOCK_LENGTH) < 0) {
+            return false;
+        }
+    }
+    else if (!_zip_crypto_aes_encrypt_blocks(ctx->aes, ctx->counters, ctx->pad, n * ZIP_CRYPTO_AES_BLOCK_LENGTH)) {
+        return false;
+    }
+    ctx->pad_offset = 0;
+    ctx->pad_length = n * ZIP_CRYPTO_AES_BLOCK_LENGTH;
+
+    return true;
+}
+
+
+static void
+xor_pad(zip_uint8_t *data, const zip_uint8_t *pad, zip_uint64_t length) {
+    zip_uint64_t i;
+
+    for (i = 0; i + sizeof(zip_uint64_t) <= length; i += sizeof(zip_uint64_t)) {
+        zip_uint64_t d, p;
+
+        (void)memcpy_s(&d, sizeof(d), data + i, sizeof(d));
+        (void)memcpy_s(&p, sizeof(p), pad + i, sizeof(p));
+        d ^= p;
+        (void)memcpy_s(data + i, sizeof(d), &d, sizeof(d));
+    }
+    for (; i < length; i++) {
+        data[i] ^= pad[i];
+    }
+}
+
+
+static bool
+aes_crypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    while (length > 0) {
+        zip_uint64_t n;
+
+        if (ctx->pad_offset == ctx->pad_length) {
+            zip_uint64_t blocks = (length + ZIP_CRYPTO_AES_BLOCK_LENGTH - 1) / ZIP_CRYPTO_AES_BLOCK_LENGTH;
+
+            if (!fill_pad(ctx, ZIP_MIN(blocks, PAD_BLOCKS))) {
                 return false;
             }
-            ctx->pad_offset = 0;
         }
-        data[i] ^= ctx->pad[ctx->pad_offset++];
+
+        n = ZIP_MIN(length, ctx->pad_length - ctx->pad_offset);
+        xor_pad(data, ctx->pad + ctx->pad_offset, n);
+        ctx->pad_offset += n;
+        data += n;
+        length -= n;
     }
 
     return true;
@@ -75,9 +164,9 @@ aes_crypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
 
 
 zip_winzip_aes_t *
-_zip_winzip_aes_new(const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t encryption_method, zip_uint8_t *password_verify, zip_error_t *error) {
+_zip_winzip_aes_new(const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t encryption_method, zip_uint8_t *password_verify, const zip_crypto_provider_t *provider, zip_winzip_aes_key_cache_t *cache, zip_error_t *error) {
     zip_winzip_aes_t *ctx;
-    zip_uint8_t buffer[2 * (MAX_KEY_LENGTH / 8) + WINZIP_AES_PASSWORD_VERIFY_LENGTH];
+    zip_uint8_t buffer[KEY_MATERIAL_LENGTH];
     zip_uint16_t key_size = 0; /* in bits */
     zip_uint16_t key_length;   /* in bytes */
 
@@ -100,28 +189,56 @@ _zip_winzip_aes_new(const zip_uint8_t *password, zip_uint64_t password_length, c
 
     key_length = key_size / 8;
 
-    if ((ctx = (zip_winzip_aes_t *)malloc(sizeof(*ctx))) == NULL) {
+    if ((ctx = (zip_winzip_aes_t *)_zip_malloc(sizeof(*ctx))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
     memset(ctx->counter, 0, sizeof(ctx->counter));
-    ctx->pad_offset = ZIP_CRYPTO_AES_BLOCK_LENGTH;
+    ctx->pad_offset = 0;
+    ctx->pad_length = 0;
+    ctx->aes = NULL;
+    ctx->hmac = NULL;
+    ctx->have_provider = provider != NULL;
+    if (provider != NULL) {
+        ctx->provider = *provider;
+    }
 
-    if (!_zip_crypto_pbkdf2(password, password_length, salt, key_length / 2, PBKDF2_ITERATIONS, buffer, 2 * key_length + WINZIP_AES_PASSWORD_VERIFY_LENGTH)) {
-        free(ctx);
-        return NULL;
+    if (cache == NULL || !key_cache_find(cache, password, password_length, salt, key_size, buffer)) {
+        if (!derive_key(provider, password, password_length, salt, key_length / 2, buffer, 2 * key_length + WINZIP_AES_PASSWORD_VERIFY_LENGTH)) {
+            _zip_free(ctx);
+            return NULL;
+        }
+        if (cache != NULL) {
+            key_cache_add(cache, password, password_length, salt, key_size, buffer, false);
+        }
     }
 
-    if ((ctx->aes = _zip_crypto_aes_new(buffer, key_size, error)) == NULL) {
-        _zip_crypto_clear(ctx, sizeof(*ctx));
-        free(ctx);
-        return NULL;
+    if (provider != NULL) {
+        if ((ctx->provider_aes = provider->aes_new(provider->ud, buffer, key_size)) == NULL) {
+            zip_error_set(error, ZIP_ER_INTERNAL, 0);
+            _zip_crypto_clear(ctx, sizeof(*ctx));
+            _zip_free(ctx);
+            return NULL;
+        }
+        if ((ctx->provider_hmac = provider->hmac_new(provider->ud, buffer + key_length, key_length)) == NULL) {
+            zip_error_set(error, ZIP_ER_INTERNAL, 0);
+            provider->aes_free(provider->ud, ctx->provider_aes);
+            _zip_free(ctx);
+            return NULL;
+        }
     }
-    if ((ctx->hmac = _zip_crypto_hmac_new(buffer + key_length, key_length, error)) == NULL) {
-        _zip_crypto_aes_free(ctx->aes);
-        free(ctx);
-        return NULL;
+    else {
+        if ((ctx->aes = _zip_crypto_aes_new(buffer, key_size, error)) == NULL) {
+            _zip_crypto_clear(ctx, sizeof(*ctx));
+            _zip_free(ctx);
+            return NULL;
+        }
+        if ((ctx->hmac = _zip_crypto_hmac_new(buffer + key_length, key_length, error)) == NULL) {
+            _zip_crypto_aes_free(ctx->aes);
+            _zip_free(ctx);
+            return NULL;
+        }
     }
 
     if (password_verify) {
@@ -132,20 +249,71 @@ _zip_winzip_aes_new(const zip_uint8_t *password, zip_uint64_t password_length, c
 }
 
 
+/* Only en- or decrypt DATA, without updating the HMAC.
+   Together with _zip_winzip_aes_hmac(), this allows computing the HMAC in a different thread; the two functions don't share state. */
+
+bool
+_zip_winzip_aes_crypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    return aes_crypt(ctx, data, length);
+}
+
+
+/* Encrypt data and add it to the HMAC, a chunk at a time, so the HMAC reads the encrypted data from the cache. */
 bool
 _zip_winzip_aes_encrypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
-    return aes_crypt(ctx, data, length) && _zip_crypto_hmac(ctx->hmac, data, length);
+    while (length > 0) {
+        zip_uint64_t n = ZIP_MIN(length, STITCH_LENGTH);
+
+        if (!aes_crypt(ctx, data, n) || !_zip_winzip_aes_hmac(ctx, data, n)) {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+
+/* Continue en- or decryption at offset of data. Data skipped this way is not included in the HMAC. */
+bool
+_zip_winzip_aes_set_position(zip_winzip_aes_t *ctx, zip_uint64_t offset) {
+    zip_uint64_t block = offset / ZIP_CRYPTO_AES_BLOCK_LENGTH;
+    zip_uint64_t i;
+
+    /* filling the pad increments the counter first, so block n uses counter n + 1 */
+    memset(ctx->counter, 0, sizeof(ctx->counter));
+    for (i = 0; i < 8; i++) {
+        ctx->counter[i] = (zip_uint8_t)(block >> (8 * i));
+    }
+    ctx->pad_offset = 0;
+    ctx->pad_length = 0;
+
+    if (offset % ZIP_CRYPTO_AES_BLOCK_LENGTH != 0) {
+        if (!fill_pad(ctx, 1)) {
+            return false;
+        }
+        ctx->pad_offset = offset % ZIP_CRYPTO_AES_BLOCK_LENGTH;
+    }
+
+    return true;
 }
 
 
 bool
-_zip_winzip_aes_decrypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
-    return _zip_crypto_hmac(ctx->hmac, data, length) && aes_crypt(ctx, data, length);
+_zip_winzip_aes_hmac(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    if (ctx->have_provider) {
+        return ctx->provider.hmac_update(ctx->provider.ud, ctx->provider_hmac, data, length) == 0;
+    }
+    return _zip_crypto_hmac(ctx->hmac, data, length);
 }
 
 
 bool
 _zip_winzip_aes_finish(zip_winzip_aes_t *ctx, zip_uint8_t *hmac) {
+    if (ctx->have_provider) {
+        return ctx->provider.hmac_output(ctx->provider.ud, ctx->provider_hmac, hmac) == 0;
+    }
     return _zip_crypto_hmac_output(ctx->hmac, hmac);
 }
 
@@ -156,7 +324,222 @@ _zip_winzip_aes_free(zip_winzip_aes_t *ctx) {
         return;
     }
 
-    _zip_crypto_aes_free(ctx->aes);
-    _zip_crypto_hmac_free(ctx->hmac);
-    free(ctx);
+    if (ctx->have_provider) {
+        ctx->provider.aes_free(ctx->provider.ud, ctx->provider_aes);
+        ctx->provider.hmac_free(ctx->provider.ud, ctx->provider_hmac);
+    }
+    else {
+        _zip_crypto_aes_free(ctx->aes);
+        _zip_crypto_hmac_free(ctx->hmac);
+    }
+    _zip_free(ctx);
+}
+
+
+/* Forget all keys, e.g. because they were derived with a different crypto provider. */
+void
+_zip_winzip_aes_key_cache_clear(zip_winzip_aes_key_cache_t *cache) {
+    unsigned int i;
+
+    if (cache == NULL) {
+        return;
+    }
+
+#ifdef HAVE_THREADS
+    _zip_mutex_lock(cache->mutex);
+#endif
+    for (i = 0; i < cache->nentry; i++) {
+        _zip_crypto_clear(cache->entry[i].password, cache->entry[i].password_length);
+        _zip_free(cache->entry[i].password);
+        _zip_crypto_clear(cache->entry + i, sizeof(cache->entry[i]));
+    }
+    cache->nentry = 0;
+    cache->next = 0;
+#ifdef HAVE_THREADS
+    _zip_mutex_unlock(cache->mutex);
+#endif
+}
+
+
+void
+_zip_winzip_aes_key_cache_free(zip_winzip_aes_key_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    _zip_winzip_aes_key_cache_clear(cache);
+#ifdef HAVE_THREADS
+    _zip_mutex_free(cache->mutex);
+#endif
+    _zip_crypto_clear(cache, sizeof(*cache));
+    _zip_free(cache);
+}
+
+
+/* Get the key cache of ZA, creating it if necessary. */
+zip_winzip_aes_key_cache_t *
+_zip_winzip_aes_key_cache_get(zip_t *za) {
+    if (za->aes_key_cache == NULL) {
+        za->aes_key_cache = _zip_winzip_aes_key_cache_new(&za->error);
+    }
+    return za->aes_key_cache;
+}
+
+
+zip_winzip_aes_key_cache_t *
+_zip_winzip_aes_key_cache_new(zip_error_t *error) {
+    zip_winzip_aes_key_cache_t *cache;
+
+    if ((cache = (zip_winzip_aes_key_cache_t *)_zip_malloc(sizeof(*cache))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+#ifdef HAVE_THREADS
+    if ((cache->mutex = _zip_mutex_new(error)) == NULL) {
+        _zip_free(cache);
+        return NULL;
+    }
+#endif
+    cache->nentry = 0;
+    cache->next = 0;
+
+    return cache;
+}
+
+
+/* Derive key material for a new random salt, to be used by _zip_winzip_aes_key_cache_take_salt() when encrypting.
+   This is meant to be run in a worker thread ahead of time. */
+bool
+_zip_winzip_aes_key_cache_prepare(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, zip_uint16_t encryption_method, const zip_crypto_provider_t *provider) {
+    zip_uint8_t salt[(MAX_KEY_LENGTH / 8) / 2];
+    zip_uint8_t buffer[KEY_MATERIAL_LENGTH];
+    zip_uint16_t key_size;
+
+    switch (encryption_method) {
+    case ZIP_EM_AES_128:
+        key_size = 128;
+        break;
+    case ZIP_EM_AES_192:
+        key_size = 192;
+        break;
+    case ZIP_EM_AES_256:
+        key_size = 256;
+        break;
+    default:
+        return false;
+    }
+
+    if (!zip_secure_random(salt, key_size / 16)) {
+        return false;
+    }
+    if (!derive_key(provider, password, password_length, salt, key_size / 16, buffer, KEY_MATERIAL_USED(key_size))) {
+        return false;
+    }
+    key_cache_add(cache, password, password_length, salt, key_size, buffer, true);
+    _zip_crypto_clear(buffer, sizeof(buffer));
+
+    return true;
+}
+
+
+/* Take a salt prepared by _zip_winzip_aes_key_cache_prepare() for PASSWORD and ENCRYPTION_METHOD, if there is one.
+   Its key material is then found by _zip_winzip_aes_new(). */
+bool
+_zip_winzip_aes_key_cache_take_salt(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, zip_uint16_t encryption_method, zip_uint8_t *salt) {
+    zip_uint16_t key_size = encryption_method == ZIP_EM_AES_128 ? 128 : (encryption_method == ZIP_EM_AES_192 ? 192 : 256);
+    unsigned int i;
+    bool found = false;
+
+#ifdef HAVE_THREADS
+    _zip_mutex_lock(cache->mutex);
+#endif
+    for (i = 0; i < cache->nentry; i++) {
+        struct key_cache_entry *entry = cache->entry + i;
+
+        if (entry->prepared && entry->key_size == key_size && entry->password_length == password_length && memcmp(entry->password, password, (size_t)password_length) == 0) {
+            (void)memcpy_s(salt, key_size / 16, entry->salt, key_size / 16);
+            entry->prepared = false;
+            found = true;
+            break;
+        }
+    }
+#ifdef HAVE_THREADS
+    _zip_mutex_unlock(cache->mutex);
+#endif
+
+    return found;
+}
+
+
+static bool
+derive_key(const zip_crypto_provider_t *provider, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t salt_length, zip_uint8_t *key_material, zip_uint16_t key_material_length) {
+    if (provider != NULL) {
+        return provider->pbkdf2(provider->ud, password, password_length, salt, salt_length, PBKDF2_ITERATIONS, key_material, key_material_length) == 0;
+    }
+    return _zip_crypto_pbkdf2(password, password_length, salt, salt_length, PBKDF2_ITERATIONS, key_material, key_material_length);
+}
+
+
+/* Remember key material; if memory can't be allocated, it just isn't cached. */
+static void
+key_cache_add(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t key_size, const zip_uint8_t *key_material, bool prepared) {
+    struct key_cache_entry *entry;
+    zip_uint8_t *copy;
+    unsigned int i;
+
+    if (password_length > SIZE_MAX || (copy = (zip_uint8_t *)_zip_malloc((size_t)password_length)) == NULL) {
+        return;
+    }
+    (void)memcpy_s(copy, (size_t)password_length, password, (size_t)password_length);
+
+#ifdef HAVE_THREADS
+    _zip_mutex_lock(cache->mutex);
+#endif
+    if (cache->nentry < KEY_CACHE_SIZE) {
+        entry = cache->entry + cache->nentry++;
+    }
+    else {
+        /* keep prepared entries, unless there are only those */
+        for (i = 0; i < KEY_CACHE_SIZE - 1 && cache->entry[(cache->next + i) % KEY_CACHE_SIZE].prepared; i++) {
+        }
+        entry = cache->entry + (cache->next + i) % KEY_CACHE_SIZE;
+        cache->next = (cache->next + i + 1) % KEY_CACHE_SIZE;
+        _zip_crypto_clear(entry->password, entry->password_length);
+        _zip_free(entry->password);
+    }
+    entry->prepared = prepared;
+    entry->password = copy;
+    entry->password_length = password_length;
+    entry->key_size = key_size;
+    (void)memcpy_s(entry->salt, sizeof(entry->salt), salt, key_size / 16);
+    (void)memcpy_s(entry->key_material, sizeof(entry->key_material), key_material, KEY_MATERIAL_USED(key_size));
+#ifdef HAVE_THREADS
+    _zip_mutex_unlock(cache->mutex);
+#endif
+}
+
+
+static bool
+key_cache_find(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t key_size, zip_uint8_t *key_material) {
+    unsigned int i;
+    bool found = false;
+
+#ifdef HAVE_THREADS
+    _zip_mutex_lock(cache->mutex);
+#endif
+    for (i = 0; i < cache->nentry; i++) {
+        struct key_cache_entry *entry = cache->entry + i;
+
+        if (!entry->prepared && entry->key_size == key_size && entry->password_length == password_length && memcmp(entry->salt, salt, key_size / 16) == 0 && memcmp(entry->password, password, (size_t)password_length) == 0) {
+            (void)memcpy_s(key_material, KEY_MATERIAL_LENGTH, entry->key_material, KEY_MATERIAL_USED(key_size));
+            found = true;
+            break;
+        }
+    }
+#ifdef HAVE_THREADS
+    _zip_mutex_unlock(cache->mutex);
+#endif
+
+    return found;
 }
@@ -64,9 +64,27 @@
 #define EOCD64LOCLEN 20
 #define EOCD64LEN 56
 #define CDBUFSIZE (MAXCOMLEN + EOCDLEN + EOCD64LOCLEN)
+/* record in Zip64 EOCD extensible data listing earlier central directory segments, see ZIP_AFL_LOG_STRUCTURED */
+#define EOCD64_EXT_CDIR_SEGMENTS 0x4c53
+#define EOCD64_EXT_CDIR_SEGMENT_SIZE 24
+/* central directory segments after which the archive is compacted into a single central directory */
+#define ZIP_CDIR_MAX_SEGMENTS 32
+/* name of hidden entry containing index of central directory, see ZIP_AFL_EMBED_INDEX */
+#define ZIP_EMBEDDED_INDEX_NAME ".libzip-index"
 #define BUFSIZE 8192
+/* default size of buffers used when copying or compressing file data, see zip_set_io_buffer_size() */
+#define ZIP_DEFAULT_IO_BUFFER_SIZE (64 * 1024)
+/* size of buffer collecting headers and central directory before they are written */
+#define ZIP_WRITE_BUFFER_SIZE (256 * 1024)
+/* default size up to which entries are processed in memory and written in one go, see zip_set_buffered_entry_size() */
+#define ZIP_DEFAULT_BUFFERED_ENTRY_SIZE (64 * 1024)
+/* default data and time between progress and cancel checks while copying, see zip_set_progress_interval() */
+#define ZIP_DEFAULT_PROGRESS_INTERVAL_BYTES (1024 * 1024)
+#define ZIP_DEFAULT_PROGRESS_INTERVAL_TIME (100 * 1000000) /* nanoseconds */
 #define EFZIP64SIZE 28
 #define EF_WINZIP_AES_SIZE 7
+#define EF_ALIGNMENT_SIZE 2 /* without padding */
+#define ZIP_ALIGNMENT_MAX 32768 /* padding up to alignment - 1 has to fit in one extra field */
 #define MAX_DATA_DESCRIPTOR_LENGTH 24
 
 #define TORRENTZIP_SIGNATURE "TORRENTZIPPED-"
@@ -89,12 +107,32 @@
 #define ZIP_CM_IS_DEFAULT(x) ((x) == ZIP_CM_DEFAULT || (x) == ZIP_CM_REPLACED_DEFAULT)
 #define ZIP_CM_ACTUAL(x) ((zip_uint16_t)(ZIP_CM_IS_DEFAULT(x) ? ZIP_CM_DEFLATE : (x)))
 
+/* number of threads algorithm may use, passed in bits 16-29 of compression flags; bit 30 requests resets at
+   content-defined boundaries (ZIP_CM_FL_RSYNCABLE), bit 31 requests seek points.
+   When compressing, a nonzero number requests compression in independent blocks (ZIP_CM_FL_PARALLEL). */
+#define ZIP_COMPRESSION_FLAGS_LEVEL(flags) ((flags) & ZIP_UINT16_MAX)
+#define ZIP_COMPRESSION_FLAGS_THREADS(flags) (((flags) >> 16) & 0x3fffu)
+#define ZIP_COMPRESSION_FLAGS_MAX_THREADS 0x3fffu
+#define ZIP_COMPRESSION_FLAGS_RSYNCABLE 0x40000000u
+#define ZIP_COMPRESSION_FLAGS_SEEK_POINTS 0x80000000u
+#define ZIP_WANT_PARALLEL_COMPRESSION(flags) ((flags) != TORRENTZIP_COMPRESSION_FLAGS && ((flags) & ZIP_CM_FL_PARALLEL) != 0)
+#define ZIP_WANT_SEEKABLE_COMPRESSION(flags) ((flags) != TORRENTZIP_COMPRESSION_FLAGS && ((flags) & ZIP_CM_FL_SEEKABLE) != 0)
+#define ZIP_WANT_AUTO_COMPRESSION(flags) ((flags) != TORRENTZIP_COMPRESSION_FLAGS && ((flags) & ZIP_CM_FL_AUTO) != 0)
+#define ZIP_WANT_EARLY_STORE(flags) ((flags) != TORRENTZIP_COMPRESSION_FLAGS && ((flags) & ZIP_CM_FL_EARLY_STORE) != 0)
+#define ZIP_WANT_RSYNCABLE_COMPRESSION(flags) ((flags) != TORRENTZIP_COMPRESSION_FLAGS && ((flags) & ZIP_CM_FL_RSYNCABLE) != 0)
+/* ZIP_CM_FL_AUTO must not switch to storing, set when the compression method is written before the data */
+#define ZIP_CM_FL_AUTO_NO_STORE 0x8000u
+#define ZIP_CM_SUPPORTS_PARALLEL(x) (ZIP_CM_ACTUAL(x) == ZIP_CM_DEFLATE || ZIP_CM_ACTUAL(x) == ZIP_CM_BZIP2 || ZIP_CM_ACTUAL(x) == ZIP_CM_XZ || ZIP_CM_ACTUAL(x) == ZIP_CM_ZSTD)
+
+#define ZIP_EF_ALIGNMENT 0xd935 /* Android zipalign: alignment, then padding */
+#define ZIP_EF_DIGEST 0x7a64 /* libzip private: SHA-256 digest of uncompressed data */
+#define ZIP_EF_SEEK_INDEX 0x7a6c /* libzip private: points to restart decompression */
 #define ZIP_EF_UTF_8_COMMENT 0x6375
 #define ZIP_EF_UTF_8_NAME 0x7075
 #define ZIP_EF_WINZIP_AES 0x9901
 #define ZIP_EF_ZIP64 0x0001
 
-#define ZIP_EF_IS_INTERNAL(id) ((id) == ZIP_EF_UTF_8_COMMENT || (id) == ZIP_EF_UTF_8_NAME || (id) == ZIP_EF_WINZIP_AES || (id) == ZIP_EF_ZIP64)
+#define ZIP_EF_IS_INTERNAL(id) ((id) == ZIP_EF_ALIGNMENT || (id) == ZIP_EF_UTF_8_COMMENT || (id) == ZIP_EF_UTF_8_NAME || (id) == ZIP_EF_WINZIP_AES || (id) == ZIP_EF_ZIP64)
 
 /* according to unzip-6.0's zipinfo.c, this corresponds to a regular file with rw permissions for everyone */
 #define ZIP_EXT_ATTRIB_DEFAULT (0100666u << 16)
@@ -118,15 +156,22 @@ typedef zip_source_t *(*zip_encryption_implementation)(zip_t *, zip_source_t *,
 
 zip_encryption_implementation _zip_get_encryption_implementation(zip_uint16_t method, int operation);
 
-/* clang-format off */
-enum zip_compression_status {
-    ZIP_COMPRESSION_OK,
-    ZIP_COMPRESSION_END,
-    ZIP_COMPRESSION_ERROR,
-    ZIP_COMPRESSION_NEED_DATA
+/* point at which decompression can start without knowledge of preceding data */
+struct zip_seek_point {
+    zip_uint64_t uncompressed_offset;
+    zip_uint64_t compressed_offset;
 };
-/* clang-format on */
-typedef enum zip_compression_status zip_compression_status_t;
+typedef struct zip_seek_point zip_seek_point_t;
+
+/* state of SHA-256 computation */
+#define ZIP_SHA256_BLOCK_SIZE 64
+
+struct zip_sha256 {
+    zip_uint32_t state[8];
+    zip_uint64_t length; /* bytes processed so far */
+    zip_uint8_t buffer[ZIP_SHA256_BLOCK_SIZE];
+};
+typedef struct zip_sha256 zip_sha256_t;
 
 struct zip_compression_algorithm {
     /* Return maximum compressed size for uncompressed data of given size. */
@@ -155,6 +200,31 @@ struct zip_compression_algorithm {
 
     /* process input data, writing to data, which has room for length bytes, update length to number of bytes written */
     zip_compression_status_t (*process)(void *ctx, zip_uint8_t *data, zip_uint64_t *length);
+
+    /* Prepare decompression to continue at the latest point at or before uncompressed offset it can restart from, discarding pending input.
+       Set uncompressed_offset and compressed_offset to that point; input has to be provided from there.
+       NULL if not supported. */
+    bool (*seek)(void *ctx, zip_uint64_t offset, zip_uint64_t *uncompressed_offset, zip_uint64_t *compressed_offset);
+
+    /* Return seek points created while compressing, sorted by offset, set npoints to their number. Valid until deallocate.
+       NULL if not supported. */
+    const zip_seek_point_t *(*seek_points)(void *ctx, zip_uint64_t *npoints);
+
+    /* Provide seek points, e.g. from seek index of entry, for use by seek. Called before start.
+       NULL if not supported. */
+    bool (*add_seek_points)(void *ctx, const zip_seek_point_t *points, zip_uint64_t npoints);
+
+    /* Return number of bytes of last input that were not used when process returned ZIP_COMPRESSION_END, to find the end of compressed data of unknown length.
+       NULL if not supported. */
+    zip_uint64_t (*unconsumed_input)(void *ctx);
+
+    /* Return estimate of memory allocated for ctx, for accounting against memory limit of archive.
+       NULL if not known. */
+    zip_uint64_t (*memory_usage)(void *ctx);
+
+    /* Discard state kept for previous data, like checkpoints for seeking, before starting on other data.
+       NULL if not needed; decompression contexts of algorithms that can seek are then not used for other data. */
+    void (*reset)(void *ctx);
 };
 typedef struct zip_compression_algorithm zip_compression_algorithm_t;
 
@@ -162,12 +232,42 @@ extern zip_compression_algorithm_t zip_algorithm_bzip2_compress;
 extern zip_compression_algorithm_t zip_algorithm_bzip2_decompress;
 extern zip_compression_algorithm_t zip_algorithm_deflate_compress;
 extern zip_compression_algorithm_t zip_algorithm_deflate_decompress;
+extern zip_compression_algorithm_t zip_algorithm_deflate64_decompress;
+extern zip_compression_algorithm_t zip_algorithm_lz4_compress;
+extern zip_compression_algorithm_t zip_algorithm_lz4_decompress;
 extern zip_compression_algorithm_t zip_algorithm_xz_compress;
 extern zip_compression_algorithm_t zip_algorithm_xz_decompress;
 extern zip_compression_algorithm_t zip_algorithm_zstd_compress;
 extern zip_compression_algorithm_t zip_algorithm_zstd_decompress;
 
+typedef struct zip_zstd_dictionary zip_zstd_dictionary_t;
+
+/* zstd parameters of entry, 0 for default */
+struct zip_zstd_parameters {
+    zip_uint8_t window_log;
+    zip_uint8_t strategy;
+    zip_uint8_t long_distance_matching;
+    zip_uint8_t window_log_max; /* for decompressing */
+};
+typedef struct zip_zstd_parameters zip_zstd_parameters_t;
+
+#if defined(HAVE_LIBZSTD)
+void _zip_zstd_dictionary_free(zip_zstd_dictionary_t *dictionary);
+zip_zstd_dictionary_t *_zip_zstd_dictionary_get(zip_t *za);
+zip_zstd_dictionary_t *_zip_zstd_dictionary_new(const void *data, zip_uint64_t length, zip_error_t *error);
+void _zip_zstd_set_dictionary(void *ud, zip_zstd_dictionary_t *dictionary);
+void _zip_zstd_set_memory_limit(void *ud, zip_uint64_t limit);
+void _zip_zstd_set_parameters(void *ud, const zip_zstd_parameters_t *parameters);
+#endif
+#if defined(HAVE_LIBLZMA)
+void _zip_xz_set_block_size(void *ud, zip_uint64_t block_size);
+void _zip_xz_set_memory_limit(void *ud, zip_uint64_t limit);
+#endif
+
+zip_uint64_t _zip_compression_maximum_size(zip_int32_t method, zip_uint32_t compression_flags, zip_uint64_t uncompressed_size);
 zip_compression_algorithm_t *_zip_get_compression_algorithm(zip_int32_t method, bool compress);
+zip_compression_algorithm_t *_zip_get_registered_compression_algorithm(zip_uint16_t method, bool compress);
+bool _zip_registered_maximum_compressed_size(zip_uint16_t method, zip_uint64_t uncompressed_size, zip_uint64_t *size);
 
 /* This API is not final yet, but we need it internally, so it's private for now. */
 
@@ -180,8 +280,10 @@ const zip_uint8_t *zip_get_extra_field_by_id(zip_t *, int, int, zip_uint16_t, in
 zip_source_t *zip_source_compress(zip_t *za, zip_source_t *src, zip_int32_t cm, zip_uint32_t compression_flags);
 zip_source_t *zip_source_crc_create(zip_source_t *, int, zip_error_t *error);
 zip_source_t *zip_source_decompress(zip_t *za, zip_source_t *src, zip_int32_t cm);
+int zip_source_get_data(zip_source_t *src, zip_uint64_t offset, zip_uint64_t length, const void **datap);
 zip_source_t *zip_source_pkware_decode(zip_t *, zip_source_t *, zip_uint16_t, int, const char *);
 zip_source_t *zip_source_pkware_encode(zip_t *, zip_source_t *, zip_uint16_t, int, const char *);
+zip_int64_t zip_source_read_at(zip_source_t *src, zip_uint64_t offset, void *data, zip_uint64_t length);
 int zip_source_remove(zip_source_t *);
 zip_int64_t zip_source_supports(zip_source_t *src);
 bool zip_source_supports_reopen(zip_source_t *src);
@@ -250,8 +352,11 @@ extern const int _zip_err_details_count;
 #define ZIP_EF_BOTH (ZIP_EF_LOCAL | ZIP_EF_CENTRAL) /* include in both */
 
 #define ZIP_FL_FORCE_ZIP64 1024 /* force zip64 extra field (_zip_dirent_write) */
+#define ZIP_FL_ALIGN 32768u /* pad local header so data is aligned to za->alignment (_zip_dirent_write) */
+#define ZIP_FL_CHECK_CRC 65536u /* check CRC even if archive was opened with ZIP_SKIP_CRC_CHECK (_zip_source_zip_new) */
 
 #define ZIP_FL_ENCODING_ALL (ZIP_FL_ENC_GUESS | ZIP_FL_ENC_CP437 | ZIP_FL_ENC_UTF_8)
+#define ZIP_FL_NAME_INDEX (ZIP_FL_NOCASE | ZIP_FL_NODIR | ZIP_FL_NORMALIZE) /* name lookups that use a secondary index of the hash table */
 
 
 /* encoding type */
@@ -269,14 +374,64 @@ typedef enum zip_encoding_type zip_encoding_type_t;
 struct zip_hash;
 struct zip_progress;
 
+typedef struct zip_access_profile zip_access_profile_t;
+typedef struct zip_arena zip_arena_t;
 typedef struct zip_cdir zip_cdir_t;
+typedef struct zip_cdir_index zip_cdir_index_t;
+typedef struct zip_cdir_index_key zip_cdir_index_key_t;
+typedef struct zip_cdir_segment zip_cdir_segment_t;
+typedef struct zip_checkpoint zip_checkpoint_t;
+typedef struct zip_compression_cache zip_compression_cache_t;
+typedef struct zip_dedup zip_dedup_t;
 typedef struct zip_dirent zip_dirent_t;
 typedef struct zip_entry zip_entry_t;
+typedef struct zip_entry_cache zip_entry_cache_t;
+typedef struct zip_entry_cache_item zip_entry_cache_item_t;
+typedef struct zip_prefetcher zip_prefetcher_t;
 typedef struct zip_extra_field zip_extra_field_t;
 typedef struct zip_string zip_string_t;
 typedef struct zip_buffer zip_buffer_t;
 typedef struct zip_hash zip_hash_t;
+typedef struct zip_memory_budget zip_memory_budget_t;
+typedef struct zip_name_index zip_name_index_t;
+typedef struct zip_mutex zip_mutex_t;
 typedef struct zip_progress zip_progress_t;
+typedef struct zip_reader zip_reader_t;
+typedef struct zip_shared_entry zip_shared_entry_t;
+typedef struct zip_stats_pipeline zip_stats_pipeline_t;
+typedef struct zip_thread_job zip_thread_job_t;
+typedef struct zip_thread_pool zip_thread_pool_t;
+typedef struct zip_winzip_aes_key_cache zip_winzip_aes_key_cache_t;
+
+/* offsets of local time from UTC by DOS date and hour, so converting DOS times rarely needs mktime() */
+
+#define ZIP_DOS_TIME_CACHE_SIZE 16
+
+struct zip_dos_time_cache {
+    zip_uint32_t key[ZIP_DOS_TIME_CACHE_SIZE];   /* DOS date and hour, plus one; 0 if unused */
+    zip_int32_t offset[ZIP_DOS_TIME_CACHE_SIZE]; /* UTC minus local time, in seconds */
+};
+typedef struct zip_dos_time_cache zip_dos_time_cache_t;
+
+/* positional access to archive data that does not use the read position of the archive source, so it can be used from multiple threads */
+
+struct zip_reader {
+    zip_source_t *src;       /* archive source, read with _zip_source_file_read_at if data is NULL */
+    const zip_uint8_t *data; /* archive data, if source provides direct access */
+    zip_uint64_t size;
+    bool volumes;            /* src is volumes of split archive, read with _zip_source_volumes_read_at */
+};
+
+#define ZIP_PHASE_COUNT 10 /* number of ZIP_PHASE_* */
+
+/* statistics of the layers writing one entry, merged into the archive when it is done */
+
+struct zip_stats_pipeline {
+    zip_phase_stats_t phase[ZIP_PHASE_COUNT];
+    zip_uint64_t accounted;     /* wall time already added to a phase by meters of pipeline */
+    int below[ZIP_PHASE_COUNT]; /* phase of meter reading data from lower layers, -1 for none */
+    int top_phase;              /* phase of topmost meter, -1 for none */
+};
 
 /* zip archive, part of API */
 
@@ -294,19 +449,83 @@ struct zip {
     zip_string_t *comment_changes; /* changed archive comment */
     bool comment_changed;          /* whether archive comment was changed */
 
+    zip_uint64_t cdir_offset_orig;   /* of central directory read, bounds length of archive prefix */
+    zip_cdir_segment_t *cdir_segments; /* central directory segments as read or last written, oldest first; NULL if unknown */
+    zip_uint64_t ncdir_segments;
+    zip_uint8_t *prefix_orig;        /* data before first entry, read when first needed */
+    zip_uint8_t *prefix_changes;     /* changed archive prefix */
+    zip_uint64_t prefix_changes_length;
+    bool prefix_changed;             /* whether archive prefix was changed */
+
+    zip_uint32_t alignment_orig; /* data alignment of stored entries as last written, 0 for none */
+    zip_uint32_t alignment;      /* data alignment of stored entries to write */
+
+    zip_uint64_t *data_order; /* entries whose data is written first, in this order, see zip_set_data_order(); NULL for none */
+    zip_uint64_t ndata_order;
+
     zip_uint64_t nentry;       /* number of entries */
     zip_uint64_t nentry_alloc; /* number of entries allocated */
     zip_entry_t *entry;        /* entries */
+    zip_uint64_t nentry_orig;  /* number of entries when archive was opened or last committed, later ones are new */
+
+    zip_uint64_t *change_log;       /* indices of original entries that may have been changed, see _zip_entry_log_change() */
+    zip_uint64_t nchange_log;       /* number of indices in change_log */
+    zip_uint64_t nchange_log_alloc; /* number of indices allocated */
 
     unsigned int nopen_source;       /* number of open sources using archive */
     unsigned int nopen_source_alloc; /* number of sources allocated */
     zip_source_t **open_source;      /* open sources using archive */
 
     zip_hash_t *names; /* hash table for name lookup */
-
-    zip_progress_t *progress; /* progress callback for zip_close() */
+    zip_uint64_t names_unhashed; /* if not 0, first names_unhashed entries are not in names yet, see _zip_names_build_hash() */
+    bool names_sorted;           /* names of entries not in names yet are sorted and found by binary search */
+    zip_cdir_index_t *cdir_index; /* central directory entries not read yet, for ZIP_LAZY_CDIR */
+    const char *cdir_index_cache; /* cache file for cdir_index, only while opening, see zip_open_with_index() */
+    zip_name_index_t *name_index; /* entries sorted by name, for zip_name_list(); built when first needed */
+    zip_arena_t *arena;           /* memory for original directory entries, freed in zip_discard() */
+    zip_memory_budget_t *memory_budget; /* accounts memory used for archive, see zip_set_memory_limit() */
+
+    zip_progress_t *progress; /* progress callbacks for zip_close() and zip_extract_all() */
+    zip_uint64_t progress_interval_bytes; /* data processed between progress and cancel checks */
+    zip_uint64_t progress_interval_time;  /* or time between them, in nanoseconds */
+    zip_uint32_t num_threads; /* number of threads zip_close() may use for compression */
+    zip_uint32_t compression_level_policy; /* ZIP_COMPRESSION_LEVEL_*, used for compression level 0 */
+    zip_uint64_t compression_block_size;   /* block size for parallel compression, 0 for default */
+    zip_uint64_t decompression_memory_limit; /* memory xz and zstd decoders may use per file, 0 for unlimited */
+
+    zip_uint64_t io_buffer_size; /* size of buffers for copying and compressing file data */
+    zip_uint8_t *io_buffer;      /* buffer for copying data, allocated when first needed */
+    zip_uint64_t buffered_entry_size; /* entries up to this size are processed in memory before writing */
+    zip_uint8_t *entry_buffer;        /* for their data, grown as needed */
+    zip_uint64_t entry_buffer_size;
+    zip_compression_cache_t *compression_cache; /* compression contexts for reuse, only during zip_close() */
+    zip_dedup_t *dedup;                         /* duplicate new data for ZIP_AFL_DEDUPLICATE, only during zip_close() */
+    zip_compression_algorithm_t *read_algorithm; /* of read_decompressor */
+    void *read_decompressor;                     /* kept by zip_read_entry() for reuse, allocated when first needed */
+    zip_uint64_t read_decompressor_charged;      /* to memory_budget */
+    zip_entry_cache_t *entry_cache;              /* decompressed entry data, see zip_set_entry_cache_size() */
+    zip_access_profile_t *access_profile;        /* entries opened, see zip_set_access_profiling() */
+    zip_prefetcher_t *prefetcher;                /* reads entries into entry_cache ahead of use, see zip_set_prefetch_profile() */
+    zip_shared_entry_t *shared_entries;          /* entries read by open files, decompressed once for all of them */
+    zip_dos_time_cache_t dos_time_cache;         /* for modification times of entries */
 
     zip_uint32_t* write_crc; /* have _zip_write() compute CRC */
+    zip_uint8_t *write_buffer;      /* of ZIP_WRITE_BUFFER_SIZE bytes, allocated when first needed */
+    zip_uint64_t write_buffer_used; /* bytes in write_buffer not yet written */
+    bool write_buffering;           /* _zip_write() collects data in write_buffer */
+
+    zip_reader_t reader; /* for reading file data, for ZIP_THREADSAFE and ZIP_FORKSAFE */
+    zip_mutex_t *mutex;  /* serializes access to archive metadata, for ZIP_THREADSAFE */
+
+    zip_winzip_aes_key_cache_t *aes_key_cache; /* derived WinZip AES keys, created when first decrypting */
+    zip_crypto_provider_t *crypto_provider;    /* set by zip_set_crypto_provider, copied by sources using it */
+
+    zip_zstd_dictionary_t *zstd_dictionary; /* shared by all zstd compressed entries, see zip_set_compression_dictionary */
+    bool zstd_dictionary_loaded;            /* zstd_dictionary has been set or looked up in archive */
+
+    zip_phase_stats_t *stats;            /* ZIP_PHASE_COUNT entries, NULL if statistics are not collected, see zip_get_stats() */
+    zip_stats_callback stats_callback;   /* called by zip_close() after each entry written */
+    void *stats_callback_ud;
 };
 
 /* file in zip archive, part of API */
@@ -314,6 +533,7 @@ struct zip {
 struct zip_file {
     zip_error_t error; /* error information */
     zip_source_t *src; /* data source */
+    zip_t *za;         /* archive file belongs to, for statistics */
 };
 
 /* zip archive directory entry (central or local) */
@@ -326,34 +546,45 @@ struct zip_file {
 #define ZIP_DIRENT_LAST_MOD 0x0020u
 #define ZIP_DIRENT_ENCRYPTION_METHOD 0x0040u
 #define ZIP_DIRENT_PASSWORD 0x0080u
+#define ZIP_DIRENT_COMPRESSION_PARAMETERS 0x0100u
 #define ZIP_DIRENT_ALL ZIP_UINT32_MAX
 
+/* One is kept for each entry read from the archive, so members are ordered by size to avoid padding. */
 struct zip_dirent {
+    time_t last_mod;                     /* (cl) time of last modification, unless last_mod_dos */
+    zip_uint64_t comp_size;              /* (cl) size of compressed data */
+    zip_uint64_t uncomp_size;            /* (cl) size of uncompressed data */
+    zip_uint64_t offset;                 /* (c)  offset of local header */
+    zip_string_t *filename;              /* (cl) file name (NUL-terminated) */
+    zip_extra_field_t *extra_fields;     /* (cl) extra fields, parsed */
+    const zip_uint8_t *raw_extra_fields; /* (c)  extra fields not parsed yet (in archive arena), see _zip_dirent_parse_extra_fields */
+    zip_string_t *comment;               /* (c)  file comment */
+    char *password;                      /*      file specific encryption password */
+
     zip_uint32_t changed;
-    bool local_extra_fields_read; /*      whether we already read in local header extra fields */
-    bool cloned;                  /*      whether this instance is cloned, and thus shares non-changed strings */
+    zip_uint32_t crc;               /* (cl) CRC-32 of uncompressed data */
+    zip_int32_t comp_method;        /* (cl) compression method used (uint16 and ZIP_CM_DEFAULT (-1)) */
+    zip_uint32_t disk_number;       /* (c)  disk number start */
+    zip_uint32_t ext_attrib;        /* (c)  external file attributes */
+    zip_uint32_t compression_level; /*      level of compression to use (never valid in orig) */
+    zip_uint32_t local_header_size; /* (c)  size of local header, 0 if not read yet */
 
-    bool crc_valid; /*      if CRC is valid (sometimes not for encrypted archives) */
-
-    zip_uint16_t version_madeby;     /* (c)  version of creator */
-    zip_uint16_t version_needed;     /* (cl) version needed to extract */
-    zip_uint16_t bitflags;           /* (cl) general purpose bit flag */
-    zip_int32_t comp_method;         /* (cl) compression method used (uint16 and ZIP_CM_DEFAULT (-1)) */
-    time_t last_mod;                 /* (cl) time of last modification */
-    zip_uint32_t crc;                /* (cl) CRC-32 of uncompressed data */
-    zip_uint64_t comp_size;          /* (cl) size of compressed data */
-    zip_uint64_t uncomp_size;        /* (cl) size of uncompressed data */
-    zip_string_t *filename;          /* (cl) file name (NUL-terminated) */
-    zip_extra_field_t *extra_fields; /* (cl) extra fields, parsed */
-    zip_string_t *comment;           /* (c)  file comment */
-    zip_uint32_t disk_number;        /* (c)  disk number start */
-    zip_uint16_t int_attrib;         /* (c)  internal file attributes */
-    zip_uint32_t ext_attrib;         /* (c)  external file attributes */
-    zip_uint64_t offset;             /* (c)  offset of local header */
+    zip_uint16_t version_madeby;          /* (c)  version of creator */
+    zip_uint16_t version_needed;          /* (cl) version needed to extract */
+    zip_uint16_t bitflags;                /* (cl) general purpose bit flag */
+    zip_uint16_t int_attrib;              /* (c)  internal file attributes */
+    zip_uint16_t encryption_method;       /*      encryption method, computed from other fields */
+    zip_uint16_t raw_extra_fields_length; /* (c)  length of raw_extra_fields */
+    zip_uint16_t dos_time;                /* (cl) time of last modification as read, if last_mod_dos */
+    zip_uint16_t dos_date;                /* (cl) date of last modification as read, if last_mod_dos */
 
-    zip_uint32_t compression_level; /*      level of compression to use (never valid in orig) */
-    zip_uint16_t encryption_method; /*      encryption method, computed from other fields */
-    char *password;                 /*      file specific encryption password */
+    zip_zstd_parameters_t zstd_parameters; /*      set with zip_set_file_compression_parameter(), window_log_max also in orig */
+
+    bool local_extra_fields_read; /*      whether we already read in local header extra fields */
+    bool cloned;                  /*      whether this instance is cloned, and thus shares non-changed strings */
+    bool in_arena;                /*      whether this instance was allocated from archive arena (set on allocation, not by _zip_dirent_init) */
+    bool crc_valid;               /*      if CRC is valid (sometimes not for encrypted archives) */
+    bool last_mod_dos;            /*      modification time is given by dos_time and dos_date, converted when needed */
 };
 
 /* zip archive central directory */
@@ -367,16 +598,70 @@ struct zip_cdir {
     zip_uint64_t offset;   /* offset of central directory in file */
     zip_string_t *comment; /* zip archive comment */
     bool is_zip64;         /* central directory in zip64 format */
+
+    zip_cdir_index_t *index; /* entries not read yet, for ZIP_LAZY_CDIR */
+    zip_memory_budget_t *budget; /* charged for entry array, NULL for none */
+
+    zip_cdir_segment_t *segments; /* segments of log-structured central directory, oldest first, the last one at offset; NULL if there is only one */
+    zip_uint64_t nsegments;
+    bool has_embedded_index; /* entry containing embedded index was removed, see ZIP_AFL_EMBED_INDEX */
+};
+
+/* part of the central directory written by one update of a log-structured archive */
+struct zip_cdir_segment {
+    zip_uint64_t offset; /* of first entry */
+    zip_uint64_t size;
+    zip_uint64_t nentry;
+};
+
+/* identifies the central directory a cached cdir index was built from */
+struct zip_cdir_index_key {
+    zip_uint64_t archive_size;
+    zip_int64_t archive_mtime;
+    zip_uint64_t cdir_offset;
+    zip_uint64_t cdir_size;
+    zip_uint32_t cdir_crc;
 };
 
 struct zip_extra_field {
     zip_extra_field_t *next;
+    zip_uint8_t *data;
     zip_flags_t flags; /* in local/central header */
     zip_uint16_t id;   /* header id */
     zip_uint16_t size; /* data size */
-    zip_uint8_t *data;
+    bool in_arena;     /* whether struct and data were allocated from archive arena */
 };
 
+/* reference count that may be changed from several threads at the same time */
+#if defined(HAVE_THREADS) && defined(HAVE_STDATOMIC_H) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef atomic_uint zip_refcount_t;
+#define ZIP_REFCOUNT_INIT(r, n) atomic_init(&(r), (n))
+#define ZIP_REFCOUNT_GET(r) atomic_load_explicit(&(r), memory_order_acquire)
+#define ZIP_REFCOUNT_INCREMENT(r) ((void)atomic_fetch_add_explicit(&(r), 1, memory_order_relaxed))
+/* returns new count; when it is 0, all changes made by other holders before their decrement are visible */
+#define ZIP_REFCOUNT_DECREMENT(r) (atomic_fetch_sub_explicit(&(r), 1, memory_order_acq_rel) - 1)
+#elif defined(HAVE_THREADS) && defined(__GNUC__)
+typedef unsigned int zip_refcount_t;
+#define ZIP_REFCOUNT_INIT(r, n) ((r) = (n))
+#define ZIP_REFCOUNT_GET(r) __atomic_load_n(&(r), __ATOMIC_ACQUIRE)
+#define ZIP_REFCOUNT_INCREMENT(r) ((void)__atomic_fetch_add(&(r), 1, __ATOMIC_RELAXED))
+#define ZIP_REFCOUNT_DECREMENT(r) __atomic_sub_fetch(&(r), 1, __ATOMIC_ACQ_REL)
+#elif defined(HAVE_THREADS)
+#define ZIP_REFCOUNT_LOCKED /* no atomic operations, use global lock */
+typedef unsigned int zip_refcount_t;
+#define ZIP_REFCOUNT_INIT(r, n) ((r) = (n))
+#define ZIP_REFCOUNT_GET(r) _zip_refcount_add(&(r), 0)
+#define ZIP_REFCOUNT_INCREMENT(r) ((void)_zip_refcount_add(&(r), 1))
+#define ZIP_REFCOUNT_DECREMENT(r) _zip_refcount_add(&(r), -1)
+#else
+typedef unsigned int zip_refcount_t;
+#define ZIP_REFCOUNT_INIT(r, n) ((r) = (n))
+#define ZIP_REFCOUNT_GET(r) (r)
+#define ZIP_REFCOUNT_INCREMENT(r) ((void)(r)++)
+#define ZIP_REFCOUNT_DECREMENT(r) (--(r))
+#endif
+
 enum zip_source_write_state {
     ZIP_SOURCE_WRITE_CLOSED, /* write is not in progress */
     ZIP_SOURCE_WRITE_OPEN,   /* write is in progress */
@@ -398,10 +683,17 @@ struct zip_source {
     zip_source_write_state_t write_state; /* whether source is open for writing */
     bool source_closed;                   /* set if source archive is closed */
     zip_t *source_archive;                /* zip archive we're reading from, NULL if not from archive */
-    unsigned int refcount;
+    zip_refcount_t refcount;
     bool eof;                /* EOF reached */
     bool had_read_error;     /* a previous ZIP_SOURCE_READ reported an error */
+    bool would_block;        /* last read stopped because no more data was available yet */
     zip_uint64_t bytes_read; /* for sources that don't support ZIP_SOURCE_TELL. */
+    zip_uint64_t bytes_written; /* for sources that don't support ZIP_SOURCE_TELL_WRITE. */
+    zip_uint64_t generation;    /* changed by commands that may change stat or file attributes, see _zip_source_generation() */
+    zip_uint64_t stat_generation;       /* generation of source stack when stat was cached, 0 if not cached */
+    zip_stat_t stat;                    /* cached result of zip_source_stat() */
+    zip_uint64_t attributes_generation; /* generation of source stack when attributes were cached, 0 if not cached */
+    zip_file_attributes_t attributes;   /* cached result of zip_source_get_file_attributes() */
 };
 
 #define ZIP_SOURCE_IS_OPEN_READING(src) ((src)->open_count > 0)
@@ -415,6 +707,7 @@ struct zip_entry {
     zip_dirent_t *changes;
     zip_source_t *source;
     bool deleted;
+    bool logged; /* in change_log of archive */
 };
 
 
@@ -422,10 +715,12 @@ struct zip_entry {
 
 struct zip_string {
     zip_uint8_t *raw;                /* raw string */
-    zip_uint16_t length;             /* length of raw string */
-    enum zip_encoding_type encoding; /* autorecognized encoding */
     zip_uint8_t *converted;          /* autoconverted string */
     zip_uint32_t converted_length;   /* length of converted */
+    zip_uint8_t *utf8_ef_data;       /* data of UTF-8 extra field for this string, built on first use */
+    enum zip_encoding_type encoding; /* autorecognized encoding */
+    zip_uint16_t length;             /* length of raw string */
+    bool in_arena;                   /* whether struct and raw were allocated from archive arena */
 };
 
 
@@ -437,8 +732,8 @@ struct zip_string {
 
 #ifdef ZIP_ALLOCATE_BUFFER
 #define DEFINE_BYTE_ARRAY(buf, size) zip_uint8_t *buf
-#define byte_array_init(buf, size) (((buf) = (zip_uint8_t *)malloc(size)) != NULL)
-#define byte_array_fini(buf) (free(buf))
+#define byte_array_init(buf, size) (((buf) = (zip_uint8_t *)_zip_malloc(size)) != NULL)
+#define byte_array_fini(buf) (_zip_free(buf))
 #else
 #define DEFINE_BYTE_ARRAY(buf, size) zip_uint8_t buf[size]
 #define byte_array_init(buf, size) (1)
@@ -462,10 +757,24 @@ struct zip_buffer {
 struct zip_filelist {
     zip_uint64_t idx;
     const char *name;
+    zip_uint64_t progress_end; /* bytes of data processed up to and including this entry, for progress */
 };
 
 typedef struct zip_filelist zip_filelist_t;
 
+/* job run by thread pool */
+
+struct zip_thread_job {
+    void (*run)(void *ud); /* function to run in worker thread */
+    void *ud;              /* argument for run */
+    bool done;             /* set when run returned */
+    zip_thread_job_t *next;
+
+    /* used by pool */
+    bool queued;                  /* in queue, not yet taken by worker */
+    struct zip_thread_task *task; /* passed to executor, not yet started */
+};
+
 struct _zip_winzip_aes;
 typedef struct _zip_winzip_aes zip_winzip_aes_t;
 
@@ -477,13 +786,36 @@ typedef struct _zip_pkware_keys zip_pkware_keys_t;
 #define ZIP_MAX(a, b) ((a) > (b) ? (a) : (b))
 #define ZIP_MIN(a, b) ((a) < (b) ? (a) : (b))
 
+#ifdef LIBZIP_READ_ONLY
+/* archives and entries are never changed, let the compiler drop code handling changes */
+#define ZIP_ENTRY_CHANGED(e, f) ((void)(e), 0)
+#define ZIP_ENTRY_DATA_CHANGED(x) ((void)(x), 0)
+#define ZIP_ENTRY_HAS_CHANGES(e) ((void)(e), 0)
+
+#define ZIP_IS_RDONLY(za) ((void)(za), 1)
+#else
 #define ZIP_ENTRY_CHANGED(e, f) ((e)->changes && ((e)->changes->changed & (f)))
 #define ZIP_ENTRY_DATA_CHANGED(x) ((x)->source != NULL)
 #define ZIP_ENTRY_HAS_CHANGES(e) (ZIP_ENTRY_DATA_CHANGED(e) || (e)->deleted || ZIP_ENTRY_CHANGED((e), ZIP_DIRENT_ALL))
 
 #define ZIP_IS_RDONLY(za) ((za)->ch_flags & ZIP_AFL_RDONLY)
+#endif
 #define ZIP_IS_TORRENTZIP(za) ((za)->flags & ZIP_AFL_IS_TORRENTZIP)
 #define ZIP_WANT_TORRENTZIP(za) ((za)->ch_flags & ZIP_AFL_WANT_TORRENTZIP)
+/* file data is read through za->reader, without changing state shared by all files of the archive */
+#define ZIP_READS_POSITIONAL(za) ((za)->open_flags & (ZIP_THREADSAFE | ZIP_FORKSAFE))
+/* commands a source needs to support to have an archive written to it without seeking */
+#define ZIP_SOURCE_SUPPORTS_STREAMING (ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE) | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_COMMIT_WRITE) | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_ROLLBACK_WRITE) | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_WRITE))
+/* archive is written to a source that can't seek, entries are written with data descriptors */
+#define ZIP_IS_STREAMING(za) (((za)->src->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SEEK_WRITE)) == 0)
+
+#ifdef HAVE_THREADS
+#define ZIP_LOCK(za) ((za)->mutex != NULL ? _zip_mutex_lock((za)->mutex) : (void)0)
+#define ZIP_UNLOCK(za) ((za)->mutex != NULL ? _zip_mutex_unlock((za)->mutex) : (void)0)
+#else
+#define ZIP_LOCK(za) ((void)0)
+#define ZIP_UNLOCK(za) ((void)0)
+#endif
 
 
 #ifdef HAVE_EXPLICIT_MEMSET
@@ -498,8 +830,15 @@ typedef struct _zip_pkware_keys zip_pkware_keys_t;
 #endif
 
 
+void _zip_access_profile_free(zip_t *za);
+void _zip_access_profile_note(zip_t *za, zip_uint64_t index);
 zip_int64_t _zip_add_entry(zip_t *);
 
+void *_zip_arena_alloc(zip_arena_t *arena, size_t size, zip_error_t *error);
+void _zip_arena_free(zip_arena_t *arena);
+bool _zip_arena_merge(zip_arena_t *arena, zip_arena_t *other, zip_error_t *error);
+zip_arena_t *_zip_arena_new(zip_memory_budget_t *budget, zip_error_t *error);
+
 zip_uint8_t *_zip_buffer_data(zip_buffer_t *buffer);
 bool _zip_buffer_eof(zip_buffer_t *buffer);
 void _zip_buffer_free(zip_buffer_t *buffer);
@@ -509,6 +848,7 @@ zip_uint32_t _zip_buffer_get_32(zip_buffer_t *buffer);
 zip_uint64_t _zip_buffer_get_64(zip_buffer_t *buffer);
 zip_uint8_t _zip_buffer_get_8(zip_buffer_t *buffer);
 zip_uint64_t _zip_buffer_left(zip_buffer_t *buffer);
+void _zip_buffer_init(zip_buffer_t *buffer, zip_uint8_t *data, zip_uint64_t size);
 zip_buffer_t *_zip_buffer_new(zip_uint8_t *data, zip_uint64_t size);
 zip_buffer_t *_zip_buffer_new_from_source(zip_source_t *src, zip_uint64_t size, zip_uint8_t *buf, zip_error_t *error);
 zip_uint64_t _zip_buffer_offset(zip_buffer_t *buffer);
@@ -524,11 +864,66 @@ int _zip_buffer_skip(zip_buffer_t *buffer, zip_uint64_t length);
 int _zip_buffer_set_offset(zip_buffer_t *buffer, zip_uint64_t offset);
 zip_uint64_t _zip_buffer_size(zip_buffer_t *buffer);
 
+/* Little endian loads from possibly unaligned data, for fixed size records whose length was checked as a whole. */
+static inline zip_uint16_t
+_zip_get_16(const zip_uint8_t *data) {
+#ifdef WORDS_BIGENDIAN
+    return (zip_uint16_t)(data[0] | (data[1] << 8));
+#else
+    zip_uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+#endif
+}
+
+static inline zip_uint32_t
+_zip_get_32(const zip_uint8_t *data) {
+#ifdef WORDS_BIGENDIAN
+    return (zip_uint32_t)data[0] | ((zip_uint32_t)data[1] << 8) | ((zip_uint32_t)data[2] << 16) | ((zip_uint32_t)data[3] << 24);
+#else
+    zip_uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+#endif
+}
+
 void _zip_cdir_free(zip_cdir_t *);
 bool _zip_cdir_grow(zip_cdir_t *cd, zip_uint64_t additional_entries, zip_error_t *error);
-zip_cdir_t *_zip_cdir_new(zip_uint64_t, zip_error_t *);
-zip_int64_t _zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors);
-time_t _zip_d2u_time(zip_uint16_t, zip_uint16_t);
+zip_int64_t _zip_cdir_index_add(zip_cdir_index_t *index, zip_uint64_t idx, zip_uint64_t offset, zip_source_t *src, zip_buffer_t *buffer, zip_error_t *error);
+bool _zip_cdir_index_cache_read(const char *path, const zip_cdir_index_key_t *key, zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error);
+void _zip_cdir_index_cache_write(const zip_cdir_index_t *index, const char *path, const zip_cdir_index_key_t *key);
+bool _zip_cdir_index_embedded_drop(zip_cdir_t *cd, zip_source_t *src, zip_error_t *error);
+zip_buffer_t *_zip_cdir_index_embedded_new(const zip_uint8_t *records, zip_uint64_t size, zip_uint64_t nentry, zip_uint64_t data_offset, zip_error_t *error);
+bool _zip_cdir_index_embedded_read(zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error);
+bool _zip_cdir_index_finalize(zip_cdir_index_t *index, zip_error_t *error);
+void _zip_cdir_index_free(zip_cdir_index_t *index);
+bool _zip_cdir_index_load(zip_t *za, zip_uint64_t idx, zip_error_t *error);
+bool _zip_cdir_index_load_all(zip_t *za, zip_error_t *error);
+zip_int64_t _zip_cdir_index_lookup(zip_t *za, const char *name, zip_error_t *error);
+zip_cdir_index_t *_zip_cdir_index_new(zip_uint64_t nentry, zip_error_t *error);
+bool _zip_cdir_index_read_all(zip_cdir_t *cd, zip_source_t *src, zip_arena_t *arena, zip_error_t *error);
+bool _zip_cdir_index_pending(const zip_t *za, zip_uint64_t idx);
+zip_cdir_t *_zip_cdir_new(zip_uint64_t, zip_memory_budget_t *, zip_error_t *);
+zip_int64_t _zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, const zip_cdir_segment_t *segments, zip_uint64_t nsegments);
+int _zip_cdir_write_end(zip_t *za, zip_uint64_t offset, zip_uint64_t size, zip_uint64_t nentry, bool is_zip64, zip_uint32_t cdir_crc, const zip_cdir_segment_t *segments, zip_uint64_t nsegments);
+int _zip_cdir_write_entries(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors);
+void _zip_checkpoint_finish(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist, bool committed);
+zip_checkpoint_t *_zip_checkpoint_new(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors);
+zip_int64_t _zip_checkpoint_resume(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist);
+void _zip_checkpoint_update(zip_checkpoint_t *checkpoint, zip_t *za, const zip_filelist_t *filelist, zip_uint64_t completed);
+void _zip_compression_cache_free(zip_compression_cache_t *cache);
+zip_compression_cache_t *_zip_compression_cache_new(zip_uint32_t max_contexts);
+zip_source_t *_zip_dedup_capture(zip_dedup_t *dedup, zip_uint64_t idx, zip_source_t *src, zip_error_t *error);
+const zip_uint8_t *_zip_dedup_data(const zip_dedup_t *dedup, zip_uint64_t idx, zip_uint64_t *lengthp);
+int _zip_dedup_find(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors);
+void _zip_dedup_free(zip_dedup_t *dedup);
+zip_dedup_t *_zip_dedup_new(zip_uint64_t nentry, zip_memory_budget_t *budget, zip_error_t *error);
+zip_uint64_t _zip_dedup_original(const zip_dedup_t *dedup, zip_uint64_t idx);
+void _zip_dedup_release(zip_dedup_t *dedup, zip_uint64_t idx);
+zip_uint32_t _zip_crc32(zip_uint32_t crc, const void *data, zip_uint64_t length);
+zip_uint32_t _zip_crc32_combine(zip_uint32_t crc1, zip_uint32_t crc2, zip_uint64_t length2);
+zip_uint32_t _zip_crc32_threads(zip_uint32_t crc, const void *data, zip_uint64_t length, zip_uint32_t num_threads);
+time_t _zip_d2u_time(zip_dos_time_cache_t *cache, zip_uint16_t dtime, zip_uint16_t ddate);
 void _zip_deregister_source(zip_t *za, zip_source_t *src);
 
 void _zip_dirent_apply_attributes(zip_dirent_t *, zip_file_attributes_t *, bool, zip_uint32_t);
@@ -536,29 +931,46 @@ zip_dirent_t *_zip_dirent_clone(const zip_dirent_t *);
 void _zip_dirent_free(zip_dirent_t *);
 void _zip_dirent_finalize(zip_dirent_t *);
 void _zip_dirent_init(zip_dirent_t *);
+void _zip_dirent_get_dos_time(const zip_dirent_t *de, zip_uint16_t *dtime, zip_uint16_t *ddate);
+const zip_uint8_t *_zip_dirent_get_extra_field(const zip_dirent_t *de, zip_uint16_t *lenp, zip_uint16_t id, zip_flags_t flags);
+time_t _zip_dirent_get_last_mod(const zip_dirent_t *de, zip_dos_time_cache_t *cache);
+bool _zip_dirent_parse_extra_fields(zip_dirent_t *de, zip_arena_t *arena, zip_error_t *error);
+bool _zip_dirent_needs_utf8_flag(const zip_dirent_t *de);
 bool _zip_dirent_needs_zip64(const zip_dirent_t *, zip_flags_t);
 zip_dirent_t *_zip_dirent_new(void);
+zip_dirent_t *_zip_dirent_new_arena(zip_arena_t *arena, zip_error_t *error);
 bool zip_dirent_process_ef_zip64(zip_dirent_t * zde, const zip_uint8_t * ef, zip_uint64_t got_len, bool local, zip_error_t * error);
-zip_int64_t _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, bool local, zip_error_t *error);
+zip_int64_t _zip_dirent_read(zip_dirent_t *zde, zip_source_t *src, zip_buffer_t *buffer, bool local, zip_arena_t *arena, zip_error_t *error);
+bool _zip_dirent_read_local_header(zip_dirent_t *de, zip_source_t *src, zip_arena_t *arena, bool need_extra_fields, zip_error_t *error);
+void _zip_dirent_set_dos_time(zip_dirent_t *de, zip_uint16_t dtime, zip_uint16_t ddate);
+void _zip_dirent_set_last_mod(zip_dirent_t *de, time_t last_mod);
 void _zip_dirent_set_version_needed(zip_dirent_t *de, bool force_zip64);
 void zip_dirent_torrentzip_normalize(zip_dirent_t *de);
 
-zip_int32_t _zip_dirent_size(zip_source_t *src, zip_uint16_t, zip_error_t *);
 int _zip_dirent_write(zip_t *za, zip_dirent_t *dirent, zip_flags_t flags);
 
 zip_extra_field_t *_zip_ef_clone(const zip_extra_field_t *, zip_error_t *);
 zip_extra_field_t *_zip_ef_delete_by_id(zip_extra_field_t *, zip_uint16_t, zip_uint16_t, zip_flags_t);
 void _zip_ef_free(zip_extra_field_t *);
+const zip_uint8_t *_zip_ef_get_by_id_raw(const zip_uint8_t *data, zip_uint16_t len, zip_uint16_t *lenp, zip_uint16_t id);
 const zip_uint8_t *_zip_ef_get_by_id(const zip_extra_field_t *, zip_uint16_t *, zip_uint16_t, zip_uint16_t, zip_flags_t, zip_error_t *);
 zip_extra_field_t *_zip_ef_merge(zip_extra_field_t *, zip_extra_field_t *);
 zip_extra_field_t *_zip_ef_new(zip_uint16_t, zip_uint16_t, const zip_uint8_t *, zip_flags_t);
-bool _zip_ef_parse(const zip_uint8_t *, zip_uint16_t, zip_flags_t, zip_extra_field_t **, zip_error_t *);
+bool _zip_ef_parse(const zip_uint8_t *, zip_uint16_t, zip_flags_t, zip_extra_field_t **, zip_arena_t *, zip_error_t *);
 zip_extra_field_t *_zip_ef_remove_internal(zip_extra_field_t *);
 zip_uint16_t _zip_ef_size(const zip_extra_field_t *, zip_flags_t);
 int _zip_ef_write(zip_t *za, const zip_extra_field_t *ef, zip_flags_t flags);
 
+void _zip_entry_cache_add(zip_t *za, zip_uint64_t index, const void *data, zip_uint64_t size);
+void _zip_entry_cache_free(zip_entry_cache_t *cache);
+bool _zip_entry_cache_open(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_source_t **srcp);
+void _zip_entry_cache_prefetch(zip_t *za, zip_uint64_t index);
+bool _zip_entry_cache_read(zip_t *za, zip_uint64_t index, void *data);
 void _zip_entry_finalize(zip_entry_t *);
 void _zip_entry_init(zip_entry_t *);
+bool _zip_entry_log_change(zip_t *za, zip_uint64_t idx);
+
+bool _zip_executor_get(zip_executor_t *copy);
 
 void _zip_error_clear(zip_error_t *);
 void _zip_error_get(const zip_error_t *, int *, int *);
@@ -567,70 +979,156 @@ void _zip_error_copy(zip_error_t *dst, const zip_error_t *src);
 
 const zip_uint8_t *_zip_extract_extra_field_by_id(zip_error_t *, zip_uint16_t, int, const zip_uint8_t *, zip_uint16_t, zip_uint16_t *);
 
+zip_source_t *_zip_file_digest_source(zip_source_t *src, zip_error_t *error);
 int _zip_file_extra_field_prepare_for_change(zip_t *, zip_uint64_t);
 int _zip_file_fillbuf(void *, size_t, zip_file_t *);
 zip_uint64_t _zip_file_get_end(const zip_t *za, zip_uint64_t index, zip_error_t *error);
 zip_uint64_t _zip_file_get_offset(const zip_t *, zip_uint64_t, zip_error_t *);
+void _zip_file_prefetch(zip_t *za, zip_uint64_t index);
 
 zip_dirent_t *_zip_get_dirent(zip_t *, zip_uint64_t, zip_flags_t, zip_error_t *);
 
+zip_uint32_t _zip_ascii_span(const zip_uint8_t *data, zip_uint32_t length);
 enum zip_encoding_type _zip_guess_encoding(zip_string_t *, enum zip_encoding_type);
 zip_uint8_t *_zip_cp437_to_utf8(const zip_uint8_t *const, zip_uint32_t, zip_uint32_t *, zip_error_t *);
 
+int _zip_headercomp(const zip_dirent_t *central, const zip_dirent_t *local);
 bool _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip_flags_t flags, zip_error_t *error);
 bool _zip_hash_delete(zip_hash_t *hash, const zip_uint8_t *key, zip_error_t *error);
 void _zip_hash_free(zip_hash_t *hash);
 zip_int64_t _zip_hash_lookup(zip_hash_t *hash, const zip_uint8_t *name, zip_flags_t flags, zip_error_t *error);
+bool _zip_hash_lookup_batch(zip_hash_t *hash, const zip_uint8_t *const *names, const zip_uint32_t *hash_values, zip_uint64_t n, zip_flags_t flags, zip_int64_t *indices, zip_error_t *error);
+zip_uint32_t _zip_hash_name(const zip_uint8_t *name, zip_flags_t flags);
 zip_hash_t *_zip_hash_new(zip_error_t *error);
 bool _zip_hash_reserve_capacity(zip_hash_t *hash, zip_uint64_t capacity, zip_error_t *error);
-bool _zip_hash_revert(zip_hash_t *hash, zip_error_t *error);
+void _zip_hash_revert_name(zip_hash_t *hash, const zip_uint8_t *name);
 
 int _zip_mkstempm(char *path, int mode, bool create_file);
 
-zip_t *_zip_open(zip_source_t *, unsigned int, zip_error_t *);
+zip_t *_zip_open(zip_source_t *, unsigned int, const char *, zip_error_t *);
+
+bool _zip_archive_prefix_length(zip_t *za, zip_uint64_t *lengthp, zip_error_t *error);
+
+zip_cdir_t *_zip_recover_cdir(zip_t *za, zip_uint64_t length, zip_error_t *error);
 
 void _zip_progress_end(zip_progress_t *progress);
 void _zip_progress_free(zip_progress_t *progress);
-int _zip_progress_start(zip_progress_t *progress);
-int _zip_progress_subrange(zip_progress_t *progress, double start, double end);
+int _zip_progress_start(zip_progress_t *progress, zip_uint64_t total);
+int _zip_progress_subrange(zip_progress_t *progress, zip_uint64_t start, zip_uint64_t end);
 int _zip_progress_update(zip_progress_t *progress, double value);
+int _zip_progress_update_bytes(zip_progress_t *progress, zip_uint64_t sub_done);
 
 /* this symbol is extern so it can be overridden for regression testing */
 ZIP_EXTERN bool zip_secure_random(zip_uint8_t *buffer, zip_uint16_t length);
 zip_uint32_t zip_random_uint32(void);
 
+zip_uint8_t *_zip_io_buffer(zip_t *za);
 int _zip_read(zip_source_t *src, zip_uint8_t *data, zip_uint64_t length, zip_error_t *error);
+bool _zip_read_entry_decompress(zip_compression_algorithm_t *algorithm, void *ud, zip_uint64_t index, const zip_dirent_t *de, zip_source_t *src, zip_uint8_t *buffer, zip_uint64_t buffer_size, zip_uint8_t *data, zip_uint64_t *sizep, zip_error_t *error);
+void *_zip_read_entry_decompressor(zip_t *za, zip_compression_algorithm_t *algorithm);
+zip_int64_t _zip_read_entry_direct(zip_t *za, zip_uint64_t index, zip_uint8_t *data);
+void _zip_read_entry_free(zip_t *za);
+bool _zip_read_entry_is_direct(zip_t *za, zip_uint64_t index);
+bool _zip_read_entry_verify(zip_uint64_t index, const zip_dirent_t *de, const zip_uint8_t *data, zip_uint64_t size, bool check_crc, zip_uint32_t num_threads, zip_error_t *error);
 int _zip_read_at_offset(zip_source_t *src, zip_uint64_t offset, unsigned char *b, size_t length, zip_error_t *error);
 zip_uint8_t *_zip_read_data(zip_buffer_t *buffer, zip_source_t *src, size_t length, bool nulp, zip_error_t *error);
 int _zip_read_local_ef(zip_t *, zip_uint64_t);
-zip_string_t *_zip_read_string(zip_buffer_t *buffer, zip_source_t *src, zip_uint16_t length, bool nulp, zip_error_t *error);
+zip_string_t *_zip_read_string(zip_buffer_t *buffer, zip_source_t *src, zip_uint16_t length, bool nulp, zip_arena_t *arena, zip_error_t *error);
+zip_source_t *_zip_reader_entry_source_new(const zip_reader_t *reader, zip_uint64_t header_offset, zip_uint64_t length, zip_error_t *error);
+bool _zip_reader_init(zip_reader_t *reader, zip_source_t *src);
+zip_int64_t _zip_reader_read(const zip_reader_t *reader, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error);
 int _zip_register_source(zip_t *za, zip_source_t *src);
 
 void _zip_set_open_error(int *zep, const zip_error_t *err, int ze);
+void _zip_shared_entry_detach_all(zip_t *za);
+bool _zip_shared_entry_open(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_source_t **srcp);
 
 bool zip_source_accept_empty(zip_source_t *src);
+int _zip_source_begin_write_in_place(zip_source_t *src, zip_uint64_t offset);
 zip_int64_t _zip_source_call(zip_source_t *src, void *data, zip_uint64_t length, zip_source_cmd_t command);
+void _zip_source_changed(zip_source_t *src);
+zip_int64_t _zip_source_copy_data(zip_source_t *src, zip_uint64_t length);
+zip_int64_t _zip_source_copy_data_from(zip_source_t *dst, zip_source_t *src, zip_uint64_t length);
+bool _zip_source_compress_compute_crc(zip_source_t *src);
+bool _zip_source_crc_compute_digest(zip_source_t *src);
+bool _zip_source_crc_get_digest(zip_source_t *src, zip_uint8_t *digest);
+bool _zip_source_compress_enable_early_store(zip_source_t *src);
+const zip_seek_point_t *_zip_source_compress_seek_points(zip_source_t *src, zip_uint64_t *npoints);
+bool _zip_source_compress_stored_early(zip_source_t *src);
+void _zip_source_compress_set_zstd_parameters(zip_source_t *src, const zip_zstd_parameters_t *parameters);
+bool _zip_source_decompress_add_seek_points(zip_source_t *src, const zip_seek_point_t *points, zip_uint64_t npoints);
+bool _zip_source_decompress_reuse(zip_t *za, zip_source_t *src, zip_int32_t method);
+bool _zip_source_decompress_validate_crc(zip_source_t *src);
 bool _zip_source_eof(zip_source_t *);
+bool _zip_source_would_block(zip_source_t *);
+zip_int64_t _zip_source_file_copy_data_from(zip_source_t *dst, zip_source_t *src, zip_uint64_t offset, zip_uint64_t length);
+zip_source_t *_zip_source_file_fd_create(int fd, zip_uint64_t start, zip_int64_t length, bool close_fd, zip_error_t *error);
+const char *_zip_source_file_name(zip_source_t *src);
 zip_source_t *_zip_source_file_or_p(const char *, FILE *, zip_uint64_t, zip_int64_t, const zip_stat_t *, zip_error_t *error);
+void _zip_source_file_preallocate(zip_source_t *src, zip_uint64_t offset, zip_uint64_t length);
+void _zip_source_file_prefetch(zip_source_t *src, zip_uint64_t offset, zip_uint64_t length);
+zip_int64_t _zip_source_file_read_at(zip_source_t *src, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error);
+bool _zip_source_file_set_output(zip_source_t *src, const char *name);
+void _zip_source_file_set_preload(zip_source_t *src, zip_uint64_t limit);
+bool _zip_source_file_supports_read_at(zip_source_t *src);
+zip_uint64_t _zip_source_generation(zip_source_t *src);
 bool _zip_source_had_error(zip_source_t *);
 void _zip_source_invalidate(zip_source_t *src);
+zip_source_t *_zip_source_volumes_new_split(const char *fname, zip_error_t *error);
+zip_int64_t _zip_source_volumes_read_at(zip_source_t *src, zip_uint64_t offset, void *data, zip_uint64_t length, zip_error_t *error);
+bool _zip_source_volumes_start(zip_source_t *src, zip_uint32_t volume, zip_uint64_t *start);
+bool _zip_source_volumes_supports_read_at(zip_source_t *src);
+zip_source_t *_zip_source_meter_new(zip_source_t *src, zip_stats_pipeline_t *pipeline, zip_uint32_t phase, zip_error_t *error);
 zip_source_t *_zip_source_new(zip_error_t *error);
 int _zip_source_set_source_archive(zip_source_t *, zip_t *);
+bool _zip_source_window_reuse(zip_source_t *src, zip_t *za, zip_uint64_t index, const zip_stat_t *st, const zip_file_attributes_t *attributes, bool validate_crc);
+bool _zip_source_window_validate_crc(zip_source_t *src, zip_uint32_t num_threads);
+zip_int64_t _zip_source_window_copy_data_to(zip_source_t *src, zip_source_t *dst, zip_uint64_t length);
 zip_source_t *_zip_source_window_new(zip_source_t *src, zip_uint64_t start, zip_int64_t length, zip_stat_t *st, zip_uint64_t st_invalid, zip_file_attributes_t *attributes, zip_t *source_archive, zip_uint64_t source_index, bool take_ownership, zip_error_t *error);
+zip_int64_t _zip_source_writev(zip_source_t *src, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments);
+bool _zip_source_zip_reuse(zip_source_t *src, zip_t *srcza, zip_uint64_t srcidx, zip_flags_t flags);
+zip_source_t *_zip_source_zip_new(zip_t *srcza, zip_uint64_t srcidx, zip_flags_t flags, zip_uint64_t start, zip_int64_t len, const char *password, zip_source_t *data_src, zip_error_t *error);
+
+bool _zip_digest_get(const zip_dirent_t *de, zip_uint8_t *digest);
+int _zip_digest_set(zip_t *za, zip_uint64_t idx, const zip_uint8_t *digest);
+
+void _zip_sha256_init(zip_sha256_t *ctx);
+void _zip_sha256_update(zip_sha256_t *ctx, const zip_uint8_t *data, zip_uint64_t length);
+void _zip_sha256_final(zip_sha256_t *ctx, zip_uint8_t *digest);
+
+zip_seek_point_t *_zip_seek_index_get(const zip_dirent_t *de, zip_uint64_t *npointsp);
+int _zip_seek_index_set(zip_t *za, zip_uint64_t idx, const zip_seek_point_t *points, zip_uint64_t npoints);
 
 int _zip_stat_merge(zip_stat_t *dst, const zip_stat_t *src, zip_error_t *error);
+void _zip_stats_add(zip_t *za, zip_uint32_t phase, zip_uint64_t start, zip_uint64_t bytes_in, zip_uint64_t bytes_out);
+zip_uint64_t _zip_stats_cpu_time(void);
+void _zip_stats_notify(zip_t *za, zip_int64_t index);
+void _zip_stats_pipeline_init(zip_stats_pipeline_t *pipeline);
+void _zip_stats_pipeline_merge(zip_t *za, const zip_stats_pipeline_t *pipeline);
+zip_uint64_t _zip_stats_start(zip_t *za);
+zip_uint64_t _zip_stats_time(void);
 int _zip_string_equal(const zip_string_t *a, const zip_string_t *b);
 void _zip_string_free(zip_string_t *string);
 zip_uint32_t _zip_string_crc32(const zip_string_t *string);
 const zip_uint8_t *_zip_string_get(zip_string_t *string, zip_uint32_t *lenp, zip_flags_t flags, zip_error_t *error);
 zip_uint16_t _zip_string_length(const zip_string_t *string);
+const zip_uint8_t *_zip_string_utf8_ef_data(zip_string_t *string, zip_uint16_t *lenp, zip_error_t *error);
 zip_string_t *_zip_string_new(const zip_uint8_t *raw, zip_uint16_t length, zip_flags_t flags, zip_error_t *error);
+zip_string_t *_zip_string_new_arena(zip_arena_t *arena, const zip_uint8_t *raw, zip_uint16_t length, zip_flags_t flags, zip_error_t *error);
 int _zip_string_write(zip_t *za, const zip_string_t *string);
-bool _zip_winzip_aes_decrypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length);
+bool _zip_winzip_aes_crypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length);
 bool _zip_winzip_aes_encrypt(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length);
 bool _zip_winzip_aes_finish(zip_winzip_aes_t *ctx, zip_uint8_t *hmac);
 void _zip_winzip_aes_free(zip_winzip_aes_t *ctx);
-zip_winzip_aes_t *_zip_winzip_aes_new(const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t key_size, zip_uint8_t *password_verify, zip_error_t *error);
+bool _zip_winzip_aes_hmac(zip_winzip_aes_t *ctx, zip_uint8_t *data, zip_uint64_t length);
+void _zip_winzip_aes_key_cache_clear(zip_winzip_aes_key_cache_t *cache);
+void _zip_winzip_aes_key_cache_free(zip_winzip_aes_key_cache_t *cache);
+zip_winzip_aes_key_cache_t *_zip_winzip_aes_key_cache_get(zip_t *za);
+zip_winzip_aes_key_cache_t *_zip_winzip_aes_key_cache_new(zip_error_t *error);
+bool _zip_winzip_aes_key_cache_prepare(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, zip_uint16_t encryption_method, const zip_crypto_provider_t *provider);
+bool _zip_winzip_aes_key_cache_take_salt(zip_winzip_aes_key_cache_t *cache, const zip_uint8_t *password, zip_uint64_t password_length, zip_uint16_t encryption_method, zip_uint8_t *salt);
+zip_winzip_aes_t *_zip_winzip_aes_new(const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t key_size, zip_uint8_t *password_verify, const zip_crypto_provider_t *provider, zip_winzip_aes_key_cache_t *cache, zip_error_t *error);
+bool _zip_winzip_aes_set_position(zip_winzip_aes_t *ctx, zip_uint64_t offset);
 
 void _zip_pkware_encrypt(zip_pkware_keys_t *keys, zip_uint8_t *out, const zip_uint8_t *in, zip_uint64_t len);
 void _zip_pkware_decrypt(zip_pkware_keys_t *keys, zip_uint8_t *out, const zip_uint8_t *in, zip_uint64_t len);
@@ -638,18 +1136,65 @@ zip_pkware_keys_t *_zip_pkware_keys_new(zip_error_t *error);
 void _zip_pkware_keys_free(zip_pkware_keys_t *keys);
 void _zip_pkware_keys_reset(zip_pkware_keys_t *keys);
 
+#ifdef HAVE_THREADS
+bool _zip_memory_budget_charge(zip_memory_budget_t *budget, zip_uint64_t size, zip_error_t *error);
+void _zip_memory_budget_free(zip_memory_budget_t *budget);
+zip_memory_budget_t *_zip_memory_budget_new(zip_error_t *error);
+zip_memory_budget_t *_zip_memory_budget_ref(zip_memory_budget_t *budget);
+void _zip_memory_budget_release(zip_memory_budget_t *budget, zip_uint64_t size);
+void _zip_memory_budget_set_limit(zip_memory_budget_t *budget, zip_uint64_t limit);
+zip_uint64_t _zip_memory_budget_used(zip_memory_budget_t *budget);
+
+void _zip_global_lock(void);
+void _zip_global_unlock(void);
+void _zip_mutex_free(zip_mutex_t *mutex);
+void _zip_mutex_lock(zip_mutex_t *mutex);
+zip_mutex_t *_zip_mutex_new(zip_error_t *error);
+void _zip_mutex_unlock(zip_mutex_t *mutex);
+#ifdef ZIP_REFCOUNT_LOCKED
+unsigned int _zip_refcount_add(zip_refcount_t *refcount, int delta);
+#endif
+
+zip_source_t *_zip_source_read_ahead_new(zip_source_t *src, zip_uint64_t buffer_size, zip_error_t *error);
+
+void _zip_thread_pool_free(zip_thread_pool_t *pool);
+zip_thread_pool_t *_zip_thread_pool_new(zip_uint32_t num_threads, zip_error_t *error);
+void _zip_thread_pool_submit(zip_thread_pool_t *pool, zip_thread_job_t *job);
+void _zip_thread_pool_wait(zip_thread_pool_t *pool, zip_thread_job_t *job);
+#endif
+
+void _zip_advise_huge_pages(void *data, zip_uint64_t length);
+void *_zip_calloc(size_t nmemb, size_t size);
+void _zip_free(void *ptr);
+void *_zip_malloc(size_t size);
+void *_zip_realloc(void *ptr, size_t size);
+char *_zip_strdup(const char *string);
+
 int _zip_changed(const zip_t *, zip_uint64_t *);
 const char *_zip_get_name(zip_t *, zip_uint64_t, zip_flags_t, zip_error_t *);
 int _zip_local_header_read(zip_t *, int);
+zip_uint64_t _zip_local_header_length(const zip_uint8_t *window, zip_uint64_t window_offset, zip_uint64_t window_length, zip_uint64_t offset);
+bool _zip_local_header_window_fill(zip_source_t *src, const zip_reader_t *reader, zip_uint8_t **windowp, zip_uint64_t *window_offsetp, zip_uint64_t *window_lengthp, zip_uint64_t offset, zip_error_t *error);
 void *_zip_memdup(const void *, size_t, zip_error_t *);
 zip_int64_t _zip_name_locate(zip_t *, const char *, zip_flags_t, zip_error_t *);
+bool _zip_names_build_hash(zip_t *za, zip_error_t *error);
+int _zip_names_check_sorted(zip_t *za, zip_error_t *error);
+void _zip_name_index_free(zip_t *za);
+zip_name_index_t *_zip_name_index_get(zip_t *za, zip_error_t *error);
+zip_int64_t _zip_name_index_list(zip_t *za, const char *prefix, bool children, zip_uint64_t *indices, zip_uint64_t nindices, zip_error_t *error);
 zip_t *_zip_new(zip_error_t *);
+const zip_uint8_t *_zip_normalize_name(const zip_uint8_t *name, zip_error_t *error);
 
 zip_int64_t _zip_file_replace(zip_t *, zip_uint64_t, const char *, zip_source_t *, zip_flags_t);
 int _zip_set_name(zip_t *, zip_uint64_t, const char *, zip_flags_t);
+int _zip_stat_index(zip_t *za, zip_uint64_t index, zip_flags_t flags, zip_stat_t *st);
 void _zip_u2d_time(time_t, zip_uint16_t *, zip_uint16_t *);
 int _zip_unchange(zip_t *, zip_uint64_t, int);
 void _zip_unchange_data(zip_entry_t *);
 int _zip_write(zip_t *za, const void *data, zip_uint64_t length);
+bool _zip_write_buffer_begin(zip_t *za);
+int _zip_write_buffer_end(zip_t *za, bool flush);
+int _zip_writev(zip_t *za, const zip_buffer_fragment_t *fragments, zip_uint64_t nfragments);
+int _zip_write_changes(zip_t *za, zip_filelist_t **filelistp, zip_uint64_t *survivorsp);
 
 #endif /* zipint.h */
@@ -0,0 +1,211 @@
+/*
+  allocator.c -- test custom memory allocator
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zip.h"
+
+/* header in front of each allocation, to detect memory not allocated by us */
+#define HEADER_SIZE 16
+#define MAGIC 0x7a6970616c6c6f63ull
+
+struct counts {
+    zip_uint64_t allocations;
+    zip_uint64_t outstanding;
+};
+
+static const char *teststr = "This is a test, which is compressed with different methods.\n";
+
+static void *
+test_allocate(void *ud, size_t size) {
+    struct counts *counts = (struct counts *)ud;
+    zip_uint8_t *ptr;
+    zip_uint64_t magic = MAGIC;
+
+    if ((ptr = (zip_uint8_t *)malloc(HEADER_SIZE + size)) == NULL) {
+        return NULL;
+    }
+    memcpy(ptr, &magic, sizeof(magic));
+    counts->allocations++;
+    counts->outstanding++;
+    return ptr + HEADER_SIZE;
+}
+
+
+static zip_uint8_t *
+check_header(void *ptr) {
+    zip_uint8_t *header = (zip_uint8_t *)ptr - HEADER_SIZE;
+    zip_uint64_t magic;
+
+    memcpy(&magic, header, sizeof(magic));
+    if (magic != MAGIC) {
+        fprintf(stderr, "memory not allocated with custom allocator\n");
+        abort();
+    }
+    return header;
+}
+
+
+static void
+test_deallocate(void *ud, void *ptr) {
+    struct counts *counts = (struct counts *)ud;
+    zip_uint8_t *header = check_header(ptr);
+
+    memset(header, 0, sizeof(zip_uint64_t));
+    free(header);
+    counts->outstanding--;
+}
+
+
+static void *
+test_reallocate(void *ud, void *ptr, size_t size) {
+    zip_uint8_t *header;
+
+    if (ptr == NULL) {
+        return test_allocate(ud, size);
+    }
+
+    if ((header = (zip_uint8_t *)realloc(check_header(ptr), HEADER_SIZE + size)) == NULL) {
+        return NULL;
+    }
+    return header + HEADER_SIZE;
+}
+
+
+static int
+read_all(zip_t *za) {
+    zip_int64_t i, n;
+    char buf[8192];
+
+    n = zip_get_num_entries(za, 0);
+    for (i = 0; i < n; i++) {
+        zip_file_t *zf;
+        zip_int64_t len;
+
+        if ((zf = zip_fopen_index(za, (zip_uint64_t)i, 0)) == NULL) {
+            fprintf(stderr, "can't open entry %d: %s\n", (int)i, zip_strerror(za));
+            return -1;
+        }
+        while ((len = zip_fread(zf, buf, sizeof(buf))) > 0) {
+        }
+        if (len < 0) {
+            fprintf(stderr, "can't read entry %d: %s\n", (int)i, zip_file_strerror(zf));
+            zip_fclose(zf);
+            return -1;
+        }
+        zip_fclose(zf);
+    }
+
+    return 0;
+}
+
+
+static int
+add_entry(zip_t *za, const char *name, zip_int32_t method) {
+    zip_source_t *zs;
+    zip_int64_t idx;
+
+    if ((zs = zip_source_buffer(za, teststr, strlen(teststr), 0)) == NULL || (idx = zip_file_add(za, name, zs, 0)) < 0) {
+        fprintf(stderr, "can't add '%s': %s\n", name, zip_strerror(za));
+        zip_source_free(zs);
+        return -1;
+    }
+    if (zip_file_set_mtime(za, (zip_uint64_t)idx, 1407272201, 0) < 0 || zip_set_file_compression(za, (zip_uint64_t)idx, method, 0) < 0) {
+        fprintf(stderr, "can't set mtime or compression for '%s': %s\n", name, zip_strerror(za));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int
+main(int argc, char *argv[]) {
+    struct counts counts = {0, 0};
+    zip_allocator_t allocator;
+    const char *archive;
+    zip_t *za;
+    int err;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s archive\n", argv[0]);
+        return 1;
+    }
+    archive = argv[1];
+
+    allocator.version = 1;
+    allocator.ud = &counts;
+    allocator.allocate = test_allocate;
+    allocator.reallocate = test_reallocate;
+    allocator.deallocate = test_deallocate;
+    if (zip_set_allocator(&allocator) < 0) {
+        fprintf(stderr, "can't set allocator\n");
+        return 1;
+    }
+
+    if ((za = zip_open(archive, 0, &err)) == NULL) {
+        fprintf(stderr, "can't open zip archive '%s': error %d\n", archive, err);
+        return 1;
+    }
+    if (read_all(za) < 0 || add_entry(za, "deflate", ZIP_CM_DEFLATE) < 0 || add_entry(za, "bzip2", ZIP_CM_BZIP2) < 0 || add_entry(za, "xz", ZIP_CM_XZ) < 0) {
+        zip_discard(za);
+        return 1;
+    }
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "can't close zip archive '%s': %s\n", archive, zip_strerror(za));
+        zip_discard(za);
+        return 1;
+    }
+
+    if ((za = zip_open(archive, ZIP_CHECKCONS, &err)) == NULL) {
+        fprintf(stderr, "can't reopen zip archive '%s': error %d\n", archive, err);
+        return 1;
+    }
+    if (read_all(za) < 0) {
+        zip_discard(za);
+        return 1;
+    }
+    zip_discard(za);
+
+    zip_set_allocator(NULL);
+
+    if (counts.allocations == 0 || counts.outstanding != 0) {
+        printf("%d of %d allocations not freed\n", (int)counts.outstanding, (int)counts.allocations);
+        return 1;
+    }
+    printf("all allocations freed\n");
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+  close_async.c -- test case for closing archive in background
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zip.h"
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t caller;
+    int done;
+    int progress_called;
+    int progress_in_caller;
+    zip_t *za;
+} state_t;
+
+static void
+close_done(zip_t *za, void *ud) {
+    state_t *state = (state_t *)ud;
+
+    pthread_mutex_lock(&state->mutex);
+    state->za = za;
+    state->done = 1;
+    pthread_cond_signal(&state->cond);
+    pthread_mutex_unlock(&state->mutex);
+}
+
+
+static void
+progress(zip_t *za, double done, void *ud) {
+    state_t *state = (state_t *)ud;
+
+    (void)za;
+    (void)done;
+    state->progress_called = 1;
+    if (pthread_equal(pthread_self(), state->caller)) {
+        state->progress_in_caller = 1;
+    }
+}
+
+
+static int
+cancel(zip_t *za, void *ud) {
+    (void)za;
+    (void)ud;
+    return 1;
+}
+
+
+int
+main(int argc, char *argv[]) {
+    const char *archive;
+    zip_t *za;
+    zip_source_t *src;
+    state_t state;
+    int err;
+
+    if (argc < 4 || argc > 5 || (argc == 5 && strcmp(argv[4], "cancel") != 0)) {
+        fprintf(stderr, "usage: %s archive name content [cancel]\n", argv[0]);
+        return 1;
+    }
+
+    archive = argv[1];
+
+    if ((za = zip_open(archive, ZIP_CREATE, &err)) == NULL) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, err);
+        fprintf(stderr, "can't open zip archive '%s': %s\n", archive, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return 1;
+    }
+
+    if ((src = zip_source_buffer(za, argv[3], strlen(argv[3]), 0)) == NULL || zip_file_add(za, argv[2], src, 0) < 0) {
+        zip_source_free(src);
+        fprintf(stderr, "can't add '%s': %s\n", argv[2], zip_strerror(za));
+        zip_discard(za);
+        return 1;
+    }
+
+    pthread_mutex_init(&state.mutex, NULL);
+    pthread_cond_init(&state.cond, NULL);
+    state.caller = pthread_self();
+    state.done = 0;
+    state.progress_called = 0;
+    state.progress_in_caller = 0;
+    state.za = NULL;
+
+    zip_register_progress_callback_with_state(za, 0.001, progress, NULL, &state);
+    if (argc == 5) {
+        zip_register_cancel_callback_with_state(za, cancel, NULL, NULL);
+    }
+
+    if (zip_close_async(za, close_done, &state) < 0) {
+        fprintf(stderr, "can't start closing zip archive '%s': %s\n", archive, zip_strerror(za));
+        zip_discard(za);
+        return 1;
+    }
+
+    pthread_mutex_lock(&state.mutex);
+    while (!state.done) {
+        pthread_cond_wait(&state.cond, &state.mutex);
+    }
+    pthread_mutex_unlock(&state.mutex);
+
+    if (state.progress_called) {
+        printf("progress reported%s\n", state.progress_in_caller ? " in calling thread" : "");
+    }
+    if (state.za != NULL) {
+        printf("can't close zip archive '%s': %s\n", archive, zip_strerror(state.za));
+        zip_discard(state.za);
+        return 1;
+    }
+    printf("closed\n");
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+  close_multiple.c -- test case for writing several archives sharing data
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zip.h"
+
+#define REPEAT 1000
+
+static int opened;
+
+static zip_int64_t
+count_opens(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t command) {
+    (void)ud;
+
+    if (command == ZIP_SOURCE_OPEN) {
+        opened++;
+    }
+    return zip_source_pass_to_lower_layer(src, data, length, command);
+}
+
+
+static zip_int32_t
+get_method(const char *arg) {
+    if (strcmp(arg, "deflate") == 0) {
+        return ZIP_CM_DEFLATE;
+    }
+    if (strcmp(arg, "store") == 0) {
+        return ZIP_CM_STORE;
+    }
+    return -1;
+}
+
+
+int
+main(int argc, char *argv[]) {
+    zip_t *archives[8];
+    zip_source_t *src, *counted;
+    zip_error_t error;
+    char *content;
+    size_t length;
+    int i, n, err;
+
+    if (argc < 5 || argc % 2 != 1 || (argc - 3) / 2 > 8) {
+        fprintf(stderr, "usage: %s name content method archive [method archive ...]\n", argv[0]);
+        return 1;
+    }
+
+    /* repeat content, so it is worth compressing */
+    length = strlen(argv[2]);
+    if ((content = malloc(length * REPEAT)) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < REPEAT; i++) {
+        memcpy(content + (size_t)i * length, argv[2], length);
+    }
+
+    zip_error_init(&error);
+    if ((src = zip_source_buffer_create(content, length * REPEAT, 1, &error)) == NULL || (counted = zip_source_layered_create(src, count_opens, NULL, &error)) == NULL) {
+        fprintf(stderr, "can't create source: %s\n", zip_error_strerror(&error));
+        return 1;
+    }
+
+    n = 0;
+    for (i = 3; i < argc; i += 2) {
+        zip_int32_t method = get_method(argv[i]);
+
+        if (method < 0) {
+            fprintf(stderr, "unknown compression method '%s'\n", argv[i]);
+            return 1;
+        }
+        if ((archives[n] = zip_open(argv[i + 1], ZIP_CREATE | ZIP_TRUNCATE, &err)) == NULL) {
+            zip_error_init_with_code(&error, err);
+            fprintf(stderr, "can't open zip archive '%s': %s\n", argv[i + 1], zip_error_strerror(&error));
+            return 1;
+        }
+        zip_source_keep(counted);
+        if (zip_file_add(archives[n], argv[1], counted, 0) < 0 || zip_set_file_compression(archives[n], 0, method, 0) < 0 || zip_file_set_mtime(archives[n], 0, 1407272201, 0) < 0) {
+            fprintf(stderr, "can't add '%s' to '%s': %s\n", argv[1], argv[i + 1], zip_strerror(archives[n]));
+            return 1;
+        }
+        n++;
+    }
+
+    if (zip_close_multiple(archives, (zip_uint64_t)n) < 0) {
+        for (i = 0; i < n; i++) {
+            if (archives[i] != NULL) {
+                printf("can't close zip archive '%s': %s\n", argv[3 + 2 * i + 1], zip_strerror(archives[i]));
+                break;
+            }
+        }
+        for (; i < n; i++) {
+            zip_discard(archives[i]);
+        }
+        return 1;
+    }
+    zip_source_free(counted);
+
+    printf("source opened %d time%s\n", opened, opened == 1 ? "" : "s");
+
+    return 0;
+}
@@ -0,0 +1,655 @@
+/*
+  compression_benchmark.c -- compare speed and size of compression level policies and implementations
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef HAVE_GETOPT
+#include "getopt.h"
+#endif
+
+#include "zip.h"
+
+#define DEFAULT_BUFFER_SIZES "4096,65536,1048576"
+#define DEFAULT_LEVELS "1,0,9"
+#define MAX_VALUES 32
+
+typedef struct {
+    zip_uint8_t *data;
+    zip_uint64_t length;
+} corpus_file_t;
+
+typedef struct {
+    zip_uint8_t *data;
+    zip_uint64_t length;
+    zip_uint64_t size;
+} output_t;
+
+typedef struct {
+    corpus_file_t *files;
+    zip_uint64_t nfiles;
+    zip_uint64_t nfiles_alloc;
+    zip_uint64_t size;
+} corpus_t;
+
+static const char *prg;
+
+static const struct {
+    const char *name;
+    zip_int32_t method;
+} methods[] = {{"deflate", ZIP_CM_DEFLATE}, {"bzip2", ZIP_CM_BZIP2}, {"xz", ZIP_CM_XZ}, {"zstd", ZIP_CM_ZSTD}, {"lz4", ZIP_CM_LZ4}};
+
+static const struct {
+    const char *name;
+    zip_uint32_t policy;
+} policies[] = {{"default", ZIP_COMPRESSION_LEVEL_DEFAULT}, {"speed", ZIP_COMPRESSION_LEVEL_SPEED}, {"balanced", ZIP_COMPRESSION_LEVEL_BALANCED}, {"max", ZIP_COMPRESSION_LEVEL_MAX}};
+
+static int benchmark(const corpus_t *corpus, zip_int32_t method, zip_uint32_t policy, zip_uint64_t *sizep, double *secondsp);
+static int benchmark_implementation(const corpus_t *corpus, zip_uint16_t method, int level, zip_uint64_t buffer_size, zip_uint64_t *sizep, double *compress_secondsp, double *decompress_secondsp);
+static int benchmark_implementations(const corpus_t *corpus, const char *method_list, const char *level_list, const char *buffer_size_list);
+static int benchmark_policies(const corpus_t *corpus);
+static int corpus_add(corpus_t *corpus, zip_uint8_t *data, zip_uint64_t length);
+static void corpus_free(corpus_t *corpus);
+static int corpus_read(corpus_t *corpus, const char *fname);
+static int corpus_read_archive(corpus_t *corpus, zip_t *za);
+static const char *method_name(zip_uint16_t method);
+static int parse_list(const char *list, zip_int64_t *values, zip_int64_t minimum);
+static int parse_method_list(const char *list, zip_uint16_t *methods);
+static int run(void *ctx, const zip_compression_implementation_t *implementation, zip_uint8_t *data, zip_uint64_t length, zip_uint64_t buffer_size, zip_uint8_t *buffer, zip_int64_t expected_length, output_t *output);
+static double seconds_since(clock_t start);
+
+
+int
+main(int argc, char *argv[]) {
+    corpus_t corpus;
+    const char *buffer_sizes = DEFAULT_BUFFER_SIZES, *levels = DEFAULT_LEVELS, *methods_list = NULL;
+    bool implementations = false;
+    int c, i, ret;
+
+    prg = argv[0];
+
+    while ((c = getopt(argc, argv, "b:il:m:")) != -1) {
+        switch (c) {
+        case 'b':
+            buffer_sizes = optarg;
+            break;
+        case 'i':
+            implementations = true;
+            break;
+        case 'l':
+            levels = optarg;
+            break;
+        case 'm':
+            methods_list = optarg;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-i [-b sizes] [-l levels] [-m methods]] file ...\n", prg);
+        fprintf(stderr, "zip archives are replaced by the files they contain\n");
+        fprintf(stderr, "  -i  drive compression implementations directly instead of writing archives\n");
+        fprintf(stderr, "  -b  comma separated sizes of input and output buffers (default %s)\n", DEFAULT_BUFFER_SIZES);
+        fprintf(stderr, "  -l  comma separated compression levels, 0 for default (default %s)\n", DEFAULT_LEVELS);
+        fprintf(stderr, "  -m  comma separated method names or numbers (default all supported)\n");
+        return 1;
+    }
+
+    memset(&corpus, 0, sizeof(corpus));
+    for (i = optind; i < argc; i++) {
+        if (corpus_read(&corpus, argv[i]) < 0) {
+            corpus_free(&corpus);
+            return 1;
+        }
+    }
+    if (corpus.size == 0) {
+        fprintf(stderr, "%s: no data to compress\n", prg);
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    printf("%s\n", zip_libzip_version());
+    printf("%llu files, %llu bytes\n", (unsigned long long)corpus.nfiles, (unsigned long long)corpus.size);
+
+    if (implementations) {
+        ret = benchmark_implementations(&corpus, methods_list, levels, buffer_sizes);
+    }
+    else {
+        ret = benchmark_policies(&corpus);
+    }
+
+    corpus_free(&corpus);
+    return ret < 0 ? 1 : 0;
+}
+
+
+/* Compare compression level policies by writing archives. */
+static int
+benchmark_policies(const corpus_t *corpus) {
+    size_t i, j;
+
+    printf("%-8s %-9s %12s %7s %10s\n", "method", "policy", "size", "ratio", "MB/s");
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (!zip_compression_method_supported(methods[i].method, 1)) {
+            continue;
+        }
+        for (j = 0; j < sizeof(policies) / sizeof(policies[0]); j++) {
+            zip_uint64_t size;
+            double seconds;
+
+            if (benchmark(corpus, methods[i].method, policies[j].policy, &size, &seconds) < 0) {
+                return -1;
+            }
+            printf("%-8s %-9s %12llu %6.2f%% %10.1f\n", methods[i].name, policies[j].name, (unsigned long long)size, 100.0 * (double)size / (double)corpus->size, (double)corpus->size / (1024 * 1024) / seconds);
+        }
+    }
+
+    return 0;
+}
+
+
+/* Compare compression implementations, as returned by zip_get_compression_implementation, by compressing each file of
+   corpus and decompressing it again, without any archive around it, with each combination of level and buffer size. */
+static int
+benchmark_implementations(const corpus_t *corpus, const char *method_list, const char *level_list, const char *buffer_size_list) {
+    zip_uint16_t method_numbers[MAX_VALUES];
+    zip_int64_t levels[MAX_VALUES], buffer_sizes[MAX_VALUES];
+    int nmethods, nlevels, nbuffer_sizes, i, j, k;
+
+    if ((nmethods = parse_method_list(method_list, method_numbers)) < 0 || (nlevels = parse_list(level_list, levels, 0)) < 0 || (nbuffer_sizes = parse_list(buffer_size_list, buffer_sizes, 1)) < 0) {
+        return -1;
+    }
+
+    printf("%-8s %-7s %8s %12s %7s %10s %12s\n", "method", "level", "buffer", "size", "ratio", "MB/s", "decomp MB/s");
+
+    for (i = 0; i < nmethods; i++) {
+        for (j = 0; j < nlevels; j++) {
+            for (k = 0; k < nbuffer_sizes; k++) {
+                zip_uint64_t size;
+                double compress_seconds, decompress_seconds;
+                char level[16];
+
+                if (benchmark_implementation(corpus, method_numbers[i], (int)levels[j], (zip_uint64_t)buffer_sizes[k], &size, &compress_seconds, &decompress_seconds) < 0) {
+                    return -1;
+                }
+                if (levels[j] == 0) {
+                    strcpy(level, "default");
+                }
+                else {
+                    snprintf(level, sizeof(level), "%d", (int)levels[j]);
+                }
+                printf("%-8s %-7s %8llu %12llu %6.2f%% %10.1f %12.1f\n", method_name(method_numbers[i]), level, (unsigned long long)buffer_sizes[k], (unsigned long long)size, 100.0 * (double)size / (double)corpus->size, (double)corpus->size / (1024 * 1024) / compress_seconds, (double)corpus->size / (1024 * 1024) / decompress_seconds);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/* Compress all files of corpus with implementation of method, passing data in and out in pieces of buffer_size bytes,
+   then decompress and check them. Return compressed size and the time compressing and decompressing took. */
+static int
+benchmark_implementation(const corpus_t *corpus, zip_uint16_t method, int level, zip_uint64_t buffer_size, zip_uint64_t *sizep, double *compress_secondsp, double *decompress_secondsp) {
+    zip_compression_implementation_t compress, decompress;
+    zip_error_t compress_error, decompress_error;
+    void *compress_ctx = NULL, *decompress_ctx = NULL;
+    output_t compressed, decompressed;
+    zip_uint8_t *buffer;
+    zip_uint64_t i, size = 0;
+    double compress_seconds = 0, decompress_seconds = 0;
+    int ret = -1;
+
+    zip_error_init(&compress_error);
+    zip_error_init(&decompress_error);
+    memset(&compressed, 0, sizeof(compressed));
+    memset(&decompressed, 0, sizeof(decompressed));
+
+    if ((buffer = (zip_uint8_t *)malloc((size_t)buffer_size)) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+
+    if (zip_get_compression_implementation(method, 1, &compress, &compress_error) < 0 || zip_get_compression_implementation(method, 0, &decompress, &decompress_error) < 0) {
+        fprintf(stderr, "%s: method %s not supported\n", prg, method_name(method));
+        goto end;
+    }
+    if ((compress_ctx = compress.allocate(compress.ud, method, level, &compress_error)) == NULL || (decompress_ctx = decompress.allocate(decompress.ud, method, 0, &decompress_error)) == NULL) {
+        fprintf(stderr, "%s: can't allocate context for method %s: %s\n", prg, method_name(method), zip_error_strerror(compress_ctx == NULL ? &compress_error : &decompress_error));
+        goto end;
+    }
+
+    for (i = 0; i < corpus->nfiles; i++) {
+        const corpus_file_t *file = corpus->files + i;
+        zip_stat_t st;
+        zip_file_attributes_t attributes;
+        clock_t start;
+
+        zip_stat_init(&st);
+        st.valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_METHOD;
+        st.size = file->length;
+        st.comp_method = ZIP_CM_STORE;
+        zip_file_attributes_init(&attributes);
+
+        compressed.length = 0;
+        start = clock();
+        if (compress.start(compress_ctx, &st, &attributes) < 0 || run(compress_ctx, &compress, file->data, file->length, buffer_size, buffer, -1, &compressed) < 0 || compress.end(compress_ctx) < 0) {
+            fprintf(stderr, "%s: can't compress with method %s: %s\n", prg, method_name(method), zip_error_strerror(&compress_error));
+            goto end;
+        }
+        compress_seconds += seconds_since(start);
+        size += compressed.length;
+
+        st.valid |= ZIP_STAT_COMP_SIZE;
+        st.comp_size = compressed.length;
+        st.comp_method = (zip_int32_t)method;
+        attributes.valid |= ZIP_FILE_ATTRIBUTES_GENERAL_PURPOSE_BIT_FLAGS;
+        attributes.general_purpose_bit_flags = compress.general_purpose_bit_flags != NULL ? compress.general_purpose_bit_flags(compress_ctx) : 0;
+        attributes.general_purpose_bit_mask = 0xffff;
+
+        decompressed.length = 0;
+        start = clock();
+        if (decompress.start(decompress_ctx, &st, &attributes) < 0 || run(decompress_ctx, &decompress, compressed.data, compressed.length, buffer_size, buffer, (zip_int64_t)file->length, &decompressed) < 0 || decompress.end(decompress_ctx) < 0) {
+            fprintf(stderr, "%s: can't decompress with method %s: %s\n", prg, method_name(method), zip_error_strerror(&decompress_error));
+            goto end;
+        }
+        decompress_seconds += seconds_since(start);
+
+        if (decompressed.length != file->length || (file->length > 0 && memcmp(decompressed.data, file->data, (size_t)file->length) != 0)) {
+            fprintf(stderr, "%s: data changed by compressing and decompressing with method %s\n", prg, method_name(method));
+            goto end;
+        }
+    }
+
+    *sizep = size;
+    *compress_secondsp = compress_seconds;
+    *decompress_secondsp = decompress_seconds;
+    ret = 0;
+
+end:
+    if (compress_ctx != NULL) {
+        compress.deallocate(compress_ctx);
+    }
+    if (decompress_ctx != NULL) {
+        decompress.deallocate(decompress_ctx);
+    }
+    zip_error_fini(&compress_error);
+    zip_error_fini(&decompress_error);
+    free(compressed.data);
+    free(decompressed.data);
+    free(buffer);
+    return ret;
+}
+
+
+/* Write all files of corpus into an in-memory archive, return its size and the time zip_close() took. */
+static int
+benchmark(const corpus_t *corpus, zip_int32_t method, zip_uint32_t policy, zip_uint64_t *sizep, double *secondsp) {
+    zip_source_t *src;
+    zip_t *za;
+    zip_error_t error;
+    zip_stat_t st;
+    zip_uint64_t i;
+    clock_t start;
+
+    zip_error_init(&error);
+    if ((src = zip_source_buffer_create(NULL, 0, 0, &error)) == NULL || (za = zip_open_from_source(src, ZIP_CREATE, &error)) == NULL) {
+        fprintf(stderr, "%s: can't create archive: %s\n", prg, zip_error_strerror(&error));
+        zip_source_free(src);
+        zip_error_fini(&error);
+        return -1;
+    }
+    zip_source_keep(src);
+
+    if (zip_set_compression_level_policy(za, policy) < 0) {
+        fprintf(stderr, "%s: can't set compression level policy: %s\n", prg, zip_strerror(za));
+        zip_discard(za);
+        zip_source_free(src);
+        return -1;
+    }
+
+    for (i = 0; i < corpus->nfiles; i++) {
+        zip_source_t *data;
+        zip_int64_t idx;
+        char name[32];
+
+        snprintf(name, sizeof(name), "%llu", (unsigned long long)i);
+        if ((data = zip_source_buffer(za, corpus->files[i].data, corpus->files[i].length, 0)) == NULL || (idx = zip_file_add(za, name, data, 0)) < 0 || zip_set_file_compression(za, (zip_uint64_t)idx, method, 0) < 0) {
+            fprintf(stderr, "%s: can't add file: %s\n", prg, zip_strerror(za));
+            zip_source_free(data);
+            zip_discard(za);
+            zip_source_free(src);
+            return -1;
+        }
+    }
+
+    start = clock();
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write archive: %s\n", prg, zip_strerror(za));
+        zip_discard(za);
+        zip_source_free(src);
+        return -1;
+    }
+    *secondsp = seconds_since(start);
+
+    if (zip_source_stat(src, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0) {
+        fprintf(stderr, "%s: can't get archive size: %s\n", prg, zip_error_strerror(zip_source_error(src)));
+        zip_source_free(src);
+        return -1;
+    }
+    *sizep = st.size;
+
+    zip_source_free(src);
+    return 0;
+}
+
+
+static int
+corpus_add(corpus_t *corpus, zip_uint8_t *data, zip_uint64_t length) {
+    if (corpus->nfiles == corpus->nfiles_alloc) {
+        zip_uint64_t nalloc = corpus->nfiles_alloc > 0 ? corpus->nfiles_alloc * 2 : 64;
+        corpus_file_t *files;
+
+        if ((files = (corpus_file_t *)realloc(corpus->files, nalloc * sizeof(*files))) == NULL) {
+            fprintf(stderr, "%s: malloc failure\n", prg);
+            return -1;
+        }
+        corpus->files = files;
+        corpus->nfiles_alloc = nalloc;
+    }
+
+    corpus->files[corpus->nfiles].data = data;
+    corpus->files[corpus->nfiles].length = length;
+    corpus->nfiles++;
+    corpus->size += length;
+    return 0;
+}
+
+
+static void
+corpus_free(corpus_t *corpus) {
+    zip_uint64_t i;
+
+    for (i = 0; i < corpus->nfiles; i++) {
+        free(corpus->files[i].data);
+    }
+    free(corpus->files);
+}
+
+
+/* Add fname to corpus, or the files it contains if it is a zip archive. */
+static int
+corpus_read(corpus_t *corpus, const char *fname) {
+    zip_t *za;
+    FILE *fp;
+    zip_uint8_t *data;
+    long length;
+
+    if ((za = zip_open(fname, ZIP_RDONLY, NULL)) != NULL) {
+        int ret = corpus_read_archive(corpus, za);
+
+        zip_discard(za);
+        return ret;
+    }
+
+    if ((fp = fopen(fname, "rb")) == NULL) {
+        fprintf(stderr, "%s: can't open '%s'\n", prg, fname);
+        return -1;
+    }
+    if (fseek(fp, 0, SEEK_END) < 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0) {
+        fprintf(stderr, "%s: can't get size of '%s'\n", prg, fname);
+        fclose(fp);
+        return -1;
+    }
+    if ((data = (zip_uint8_t *)malloc(length > 0 ? (size_t)length : 1)) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        fclose(fp);
+        return -1;
+    }
+    if (fread(data, 1, (size_t)length, fp) != (size_t)length) {
+        fprintf(stderr, "%s: can't read '%s'\n", prg, fname);
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    if (corpus_add(corpus, data, (zip_uint64_t)length) < 0) {
+        free(data);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Add data of all files in za that can be read without password. */
+static int
+corpus_read_archive(corpus_t *corpus, zip_t *za) {
+    zip_int64_t i, n;
+
+    n = zip_get_num_entries(za, 0);
+    for (i = 0; i < n; i++) {
+        zip_stat_t st;
+        zip_file_t *zf;
+        zip_uint8_t *data;
+
+        if (zip_stat_index(za, (zip_uint64_t)i, 0, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0 || st.size == 0 || st.size > 256 * 1024 * 1024) {
+            continue;
+        }
+        if ((zf = zip_fopen_index(za, (zip_uint64_t)i, 0)) == NULL) {
+            continue;
+        }
+        if ((data = (zip_uint8_t *)malloc(st.size)) == NULL) {
+            fprintf(stderr, "%s: malloc failure\n", prg);
+            zip_fclose(zf);
+            return -1;
+        }
+        if (zip_fread(zf, data, st.size) != (zip_int64_t)st.size) {
+            free(data);
+            zip_fclose(zf);
+            continue;
+        }
+        zip_fclose(zf);
+
+        if (corpus_add(corpus, data, st.size) < 0) {
+            free(data);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static const char *
+method_name(zip_uint16_t method) {
+    static char number[8];
+    size_t i;
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (methods[i].method == method) {
+            return methods[i].name;
+        }
+    }
+    snprintf(number, sizeof(number), "%u", method);
+    return number;
+}
+
+
+/* Parse comma separated list of at most MAX_VALUES numbers of at least minimum into values, return their number or -1 on error. */
+static int
+parse_list(const char *list, zip_int64_t *values, zip_int64_t minimum) {
+    const char *p = list;
+    int n = 0;
+
+    while (*p != '\0') {
+        char *end;
+
+        if (n == MAX_VALUES || (values[n] = strtoll(p, &end, 10)) < minimum || end == p || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "%s: invalid list '%s'\n", prg, list);
+            return -1;
+        }
+        n++;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    if (n == 0) {
+        fprintf(stderr, "%s: empty list\n", prg);
+        return -1;
+    }
+    return n;
+}
+
+
+/* Parse comma separated list of method names or numbers into methods; all supported built-in methods if list is NULL. */
+static int
+parse_method_list(const char *list, zip_uint16_t *method_numbers) {
+    const char *p;
+    size_t i;
+    int n = 0;
+
+    if (list == NULL) {
+        for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+            if (zip_compression_method_supported(methods[i].method, 1)) {
+                method_numbers[n++] = (zip_uint16_t)methods[i].method;
+            }
+        }
+        return n;
+    }
+
+    for (p = list; *p != '\0' && n < MAX_VALUES;) {
+        size_t length = strcspn(p, ",");
+        char *end;
+        unsigned long number = strtoul(p, &end, 10);
+
+        if (end == p + length && length > 0 && number <= ZIP_UINT16_MAX) {
+            method_numbers[n++] = (zip_uint16_t)number;
+        }
+        else {
+            for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+                if (strlen(methods[i].name) == length && strncmp(methods[i].name, p, length) == 0) {
+                    break;
+                }
+            }
+            if (i == sizeof(methods) / sizeof(methods[0])) {
+                fprintf(stderr, "%s: unknown method '%.*s'\n", prg, (int)length, p);
+                return -1;
+            }
+            method_numbers[n++] = (zip_uint16_t)methods[i].method;
+        }
+        p += length;
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    return n;
+}
+
+
+/* Feed length bytes of data to ctx in pieces of at most buffer_size bytes and append its output, produced in pieces of at most buffer_size bytes, to output.
+   If expected_length is not -1, stop once that much output was produced, like zip_source_decompress does for algorithms that don't signal the end of the stream. */
+static int
+run(void *ctx, const zip_compression_implementation_t *implementation, zip_uint8_t *data, zip_uint64_t length, zip_uint64_t buffer_size, zip_uint8_t *buffer, zip_int64_t expected_length, output_t *output) {
+    zip_uint64_t offset = 0;
+    bool end_of_input = false;
+
+    for (;;) {
+        zip_uint64_t n = buffer_size;
+        zip_compression_status_t status = implementation->process(ctx, buffer, &n);
+
+        if (status == ZIP_COMPRESSION_ERROR) {
+            return -1;
+        }
+
+        /* output can come with ZIP_COMPRESSION_END */
+        if (n > 0) {
+            if (output->length + n > output->size) {
+                zip_uint64_t size = output->size > 0 ? output->size : 65536;
+                zip_uint8_t *p;
+
+                while (output->length + n > size) {
+                    size *= 2;
+                }
+                if ((p = (zip_uint8_t *)realloc(output->data, (size_t)size)) == NULL) {
+                    fprintf(stderr, "%s: malloc failure\n", prg);
+                    return -1;
+                }
+                output->data = p;
+                output->size = size;
+            }
+            memcpy(output->data + output->length, buffer, (size_t)n);
+            output->length += n;
+        }
+
+        if (status == ZIP_COMPRESSION_END || (expected_length >= 0 && output->length >= (zip_uint64_t)expected_length)) {
+            return 0;
+        }
+        if (status == ZIP_COMPRESSION_NEED_DATA) {
+            if (offset < length) {
+                zip_uint64_t chunk = length - offset < buffer_size ? length - offset : buffer_size;
+
+                if (implementation->input(ctx, data + offset, chunk) < 0) {
+                    return -1;
+                }
+                offset += chunk;
+            }
+            else if (!end_of_input) {
+                implementation->end_of_input(ctx);
+                end_of_input = true;
+            }
+            else if (n == 0) {
+                /* no progress possible: stream ended prematurely */
+                return -1;
+            }
+        }
+    }
+}
+
+
+static double
+seconds_since(clock_t start) {
+    double t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    return t > 0 ? t : 1.0 / CLOCKS_PER_SEC;
+}
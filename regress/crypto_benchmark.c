@@ -0,0 +1,231 @@
+/*
+  crypto_benchmark.c -- measure speed of WinZip AES encryption
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "zip.h"
+
+#define PASSWORD "benchmark"
+
+static const char *prg;
+
+static zip_t *open_buffer(zip_source_t *src);
+static double seconds_since(clock_t start);
+static int benchmark_key_derivation(zip_uint64_t count);
+static int benchmark_throughput(zip_uint64_t size);
+
+
+int
+main(int argc, char *argv[]) {
+    zip_uint64_t count, size;
+
+    prg = argv[0];
+
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [size-in-mb [number-of-keys]]\n", prg);
+        return 1;
+    }
+
+    size = argc > 1 ? strtoull(argv[1], NULL, 10) : 64;
+    count = argc > 2 ? strtoull(argv[2], NULL, 10) : 200;
+
+    if (size == 0 || count == 0) {
+        fprintf(stderr, "%s: size and number of keys must be positive\n", prg);
+        return 1;
+    }
+
+    printf("%s\n", zip_libzip_version());
+    if (benchmark_key_derivation(count) < 0 || benchmark_throughput(size * 1024 * 1024) < 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* Each entry has its own salt, so opening it derives a new key (PBKDF2-HMAC-SHA1, 1000 iterations). */
+static int
+benchmark_key_derivation(zip_uint64_t count) {
+    zip_source_t *src;
+    zip_t *za;
+    zip_file_t *zf;
+    zip_uint64_t i;
+    clock_t start;
+    double t;
+    char name[32];
+
+    if ((src = zip_source_buffer_create(NULL, 0, 0, NULL)) == NULL || (za = open_buffer(src)) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        zip_source_t *data;
+        zip_int64_t idx;
+
+        snprintf(name, sizeof(name), "%llu", (unsigned long long)i);
+        if ((data = zip_source_buffer(za, name, strlen(name), 0)) == NULL || (idx = zip_file_add(za, name, data, 0)) < 0 || zip_set_file_compression(za, (zip_uint64_t)idx, ZIP_CM_STORE, 0) < 0 || zip_file_set_encryption(za, (zip_uint64_t)idx, ZIP_EM_AES_256, PASSWORD) < 0) {
+            fprintf(stderr, "%s: can't add file: %s\n", prg, zip_strerror(za));
+            zip_source_free(data);
+            zip_discard(za);
+            return -1;
+        }
+    }
+
+    start = clock();
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write archive: %s\n", prg, zip_strerror(za));
+        zip_discard(za);
+        return -1;
+    }
+    t = seconds_since(start);
+    printf("key derivation (encrypt): %.1f keys/s\n", (double)count / t);
+
+    if ((za = open_buffer(src)) == NULL) {
+        return -1;
+    }
+    start = clock();
+    for (i = 0; i < count; i++) {
+        if ((zf = zip_fopen_index_encrypted(za, i, 0, PASSWORD)) == NULL) {
+            fprintf(stderr, "%s: can't open file %llu: %s\n", prg, (unsigned long long)i, zip_strerror(za));
+            zip_discard(za);
+            return -1;
+        }
+        zip_fclose(zf);
+    }
+    t = seconds_since(start);
+    printf("key derivation (decrypt): %.1f keys/s\n", (double)count / t);
+
+    zip_discard(za);
+    zip_source_free(src);
+    return 0;
+}
+
+
+/* AES-CTR and HMAC-SHA1 over one stored entry; key derivation is negligible at this size. */
+static int
+benchmark_throughput(zip_uint64_t size) {
+    zip_source_t *src, *data;
+    zip_t *za;
+    zip_file_t *zf;
+    zip_int64_t n, idx;
+    zip_uint8_t *buffer;
+    clock_t start;
+    double t, mb;
+
+    if ((buffer = (zip_uint8_t *)malloc(size)) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", prg);
+        return -1;
+    }
+    memset(buffer, 'x', size);
+    mb = (double)size / (1024 * 1024);
+
+    if ((src = zip_source_buffer_create(NULL, 0, 0, NULL)) == NULL || (za = open_buffer(src)) == NULL) {
+        free(buffer);
+        return -1;
+    }
+    if ((data = zip_source_buffer(za, buffer, size, 0)) == NULL || (idx = zip_file_add(za, "data", data, 0)) < 0 || zip_set_file_compression(za, (zip_uint64_t)idx, ZIP_CM_STORE, 0) < 0 || zip_file_set_encryption(za, (zip_uint64_t)idx, ZIP_EM_AES_256, PASSWORD) < 0) {
+        fprintf(stderr, "%s: can't add file: %s\n", prg, zip_strerror(za));
+        zip_source_free(data);
+        zip_discard(za);
+        free(buffer);
+        return -1;
+    }
+
+    start = clock();
+    if (zip_close(za) < 0) {
+        fprintf(stderr, "%s: can't write archive: %s\n", prg, zip_strerror(za));
+        zip_discard(za);
+        free(buffer);
+        return -1;
+    }
+    t = seconds_since(start);
+    printf("encryption: %.1f MB/s\n", mb / t);
+
+    if ((za = open_buffer(src)) == NULL) {
+        free(buffer);
+        return -1;
+    }
+    start = clock();
+    if ((zf = zip_fopen_index_encrypted(za, 0, 0, PASSWORD)) == NULL) {
+        fprintf(stderr, "%s: can't open file: %s\n", prg, zip_strerror(za));
+        zip_discard(za);
+        free(buffer);
+        return -1;
+    }
+    while ((n = zip_fread(zf, buffer, size)) > 0) {
+        ;
+    }
+    if (n < 0) {
+        fprintf(stderr, "%s: can't read file: %s\n", prg, zip_file_strerror(zf));
+        zip_fclose(zf);
+        zip_discard(za);
+        free(buffer);
+        return -1;
+    }
+    zip_fclose(zf);
+    t = seconds_since(start);
+    printf("decryption: %.1f MB/s\n", mb / t);
+
+    zip_discard(za);
+    zip_source_free(src);
+    free(buffer);
+    return 0;
+}
+
+
+/* Open archive in SRC, keeping SRC alive after the archive is closed. */
+static zip_t *
+open_buffer(zip_source_t *src) {
+    zip_t *za;
+    zip_error_t error;
+
+    zip_error_init(&error);
+    if ((za = zip_open_from_source(src, ZIP_CREATE, &error)) == NULL) {
+        fprintf(stderr, "%s: can't open archive: %s\n", prg, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return NULL;
+    }
+    zip_source_keep(src);
+    return za;
+}
+
+
+static double
+seconds_since(clock_t start) {
+    double t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    return t > 0 ? t : 1.0 / CLOCKS_PER_SEC;
+}
@@ -35,6 +35,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef HAVE_GETOPT
 #include "getopt.h"
@@ -47,6 +48,7 @@ enum when { WHEN_NEVER, WHEN_OPEN, WHEN_READ, WHEN_CLOSE };
 const char *when_name[] = {"no", "zip_fopen", "zip_fread", "zip_fclose"};
 
 static int do_read(zip_t *z, const char *name, zip_flags_t flags, enum when when_ex, int ze_ex, int se_ex);
+static int do_read_twice(zip_t *z, const char *name, int ze_ex);
 
 int verbose;
 
@@ -109,6 +111,11 @@ main(int argc, char *argv[]) {
     fail += do_read(z, "storedcrcerror", ZIP_FL_COMPRESSED, WHEN_READ, ZIP_ER_CRC, 0);
     fail += do_read(z, "storedok", ZIP_FL_COMPRESSED, WHEN_NEVER, 0, 0);
 
+    fail += do_read_twice(z, "storedok", 0);
+    fail += do_read_twice(z, "deflateok", 0);
+    fail += do_read_twice(z, "storedcrcerror", ZIP_ER_CRC);
+    fail += do_read_twice(z, "deflatecrcerror", ZIP_ER_CRC);
+
     fail += do_read(z, "cryptok", 0, WHEN_OPEN, ZIP_ER_NOPASSWD, 0);
     zip_set_default_password(z, "crypt");
     fail += do_read(z, "cryptok", 0, WHEN_NEVER, 0, 0);
@@ -210,3 +217,73 @@ do_read(zip_t *z, const char *name, zip_flags_t flags, enum when when_ex, int ze
 
     return 0;
 }
+
+
+/* read file with two zip_file_t at different speeds, the second one seeking back to the start if possible */
+static int
+do_read_twice(zip_t *z, const char *name, int ze_ex) {
+    static char data[2][65536];
+    zip_file_t *zf[2];
+    zip_uint64_t length[2];
+    int ze_got[2];
+    zip_int64_t n;
+    int i, j, fail;
+
+    fail = 0;
+    for (i = 0; i < 2; i++) {
+        if ((zf[i] = zip_fopen(z, name, 0)) == NULL) {
+            printf("%s: %s: can't open file twice: %s\n", progname, name, zip_strerror(z));
+            if (i > 0) {
+                zip_fclose(zf[0]);
+            }
+            return 1;
+        }
+        length[i] = 0;
+        ze_got[i] = 0;
+    }
+
+    for (j = 0; ze_got[0] == 0 || ze_got[1] == 0; j++) {
+        for (i = 0; i < 2; i++) {
+            if (ze_got[i] != 0 || (i == 0 && j % 3 != 0)) {
+                continue;
+            }
+            n = zip_fread(zf[i], data[i] + length[i], sizeof(data[i]) - length[i] < 1000 ? sizeof(data[i]) - length[i] : 1000);
+            if (n < 0) {
+                ze_got[i] = zip_error_code_zip(zip_file_get_error(zf[i]));
+            }
+            else if (n == 0) {
+                ze_got[i] = -1;
+            }
+            else {
+                length[i] += (zip_uint64_t)n;
+            }
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (ze_got[i] != (ze_ex == 0 ? -1 : ze_ex)) {
+            printf("%s: %s: file %d: got error %d, expected %d\n", progname, name, i, ze_got[i], ze_ex);
+            fail = 1;
+        }
+    }
+    if (length[0] != length[1] || memcmp(data[0], data[1], (size_t)length[0]) != 0) {
+        printf("%s: %s: files read different data\n", progname, name);
+        fail = 1;
+    }
+
+    if (ze_ex == 0 && zip_file_is_seekable(zf[1]) > 0) {
+        if (zip_fseek(zf[1], 0, SEEK_SET) < 0 || zip_fread(zf[1], data[1], length[0]) != (zip_int64_t)length[0] || memcmp(data[0], data[1], (size_t)length[0]) != 0) {
+            printf("%s: %s: reading again after seek failed\n", progname, name);
+            fail = 1;
+        }
+    }
+
+    zip_fclose(zf[0]);
+    zip_fclose(zf[1]);
+
+    if (fail == 0 && verbose) {
+        printf("%s: %s: read twice passed\n", progname, name);
+    }
+
+    return fail;
+}
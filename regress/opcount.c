@@ -0,0 +1,339 @@
+/*
+  opcount.c -- count allocations and I/O calls, for benchmarks
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#define __USE_GNU
+#include <dlfcn.h>
+#undef __USE_GNU
+
+#include "config.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "opcount.h"
+
+#if !defined(RTLD_NEXT)
+#define RTLD_NEXT RTLD_DEFAULT
+#endif
+
+/* Counters may be changed from several threads at the same time. */
+#if defined(HAVE_STDATOMIC_H) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef atomic_ullong counter_t;
+#define COUNTER_ADD(c, n) ((void)atomic_fetch_add_explicit(&(c), (n), memory_order_relaxed))
+#define COUNTER_GET(c) atomic_load_explicit(&(c), memory_order_relaxed)
+#elif defined(__GNUC__)
+typedef unsigned long long counter_t;
+#define COUNTER_ADD(c, n) ((void)__atomic_fetch_add(&(c), (n), __ATOMIC_RELAXED))
+#define COUNTER_GET(c) __atomic_load_n(&(c), __ATOMIC_RELAXED)
+#else
+typedef unsigned long long counter_t;
+#define COUNTER_ADD(c, n) ((c) += (n))
+#define COUNTER_GET(c) (c)
+#endif
+
+/* dlsym() may allocate memory before the real functions are known, it is taken from here and never freed */
+#define BOOTSTRAP_SIZE 4096
+
+static counter_t allocations, frees, bytes_allocated, reads, writes, seeks;
+
+static int inited = 0;
+static int initializing = 0;
+static unsigned char bootstrap[BOOTSTRAP_SIZE];
+static size_t bootstrap_used = 0;
+
+static void *(*real_malloc)(size_t size) = NULL;
+static void *(*real_calloc)(size_t number, size_t size) = NULL;
+static void *(*real_realloc)(void *ptr, size_t size) = NULL;
+static void (*real_free)(void *ptr) = NULL;
+static int (*real_posix_memalign)(void **ptr, size_t alignment, size_t size) = NULL;
+static ssize_t (*real_read)(int fd, void *buf, size_t nbytes) = NULL;
+static ssize_t (*real_pread)(int fd, void *buf, size_t nbytes, off_t offset) = NULL;
+static size_t (*real_fread)(void *ptr, size_t size, size_t nmemb, FILE *stream) = NULL;
+static ssize_t (*real_write)(int fd, const void *buf, size_t nbytes) = NULL;
+static ssize_t (*real_pwrite)(int fd, const void *buf, size_t nbytes, off_t offset) = NULL;
+static size_t (*real_fwrite)(const void *ptr, size_t size, size_t nmemb, FILE *stream) = NULL;
+static off_t (*real_lseek)(int fd, off_t offset, int whence) = NULL;
+static int (*real_fseeko)(FILE *stream, off_t offset, int whence) = NULL;
+static int (*real_fseek)(FILE *stream, long offset, int whence) = NULL;
+
+
+static void *
+bootstrap_alloc(size_t size) {
+    void *ptr;
+
+    size = (size + 15) & ~(size_t)15;
+    if (size > BOOTSTRAP_SIZE - bootstrap_used) {
+        return NULL;
+    }
+    ptr = bootstrap + bootstrap_used;
+    bootstrap_used += size;
+    return ptr;
+}
+
+
+static int
+is_bootstrap(const void *ptr) {
+    return (const unsigned char *)ptr >= bootstrap && (const unsigned char *)ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+
+static void *
+lookup(const char *name) {
+    void *fn;
+
+    if ((fn = dlsym(RTLD_NEXT, name)) == NULL) {
+        abort();
+    }
+    return fn;
+}
+
+
+static void
+init(void) {
+    initializing = 1;
+    real_malloc = lookup("malloc");
+    real_calloc = lookup("calloc");
+    real_realloc = lookup("realloc");
+    real_free = lookup("free");
+    real_posix_memalign = lookup("posix_memalign");
+    real_read = lookup("read");
+    real_pread = lookup("pread");
+    real_fread = lookup("fread");
+    real_write = lookup("write");
+    real_pwrite = lookup("pwrite");
+    real_fwrite = lookup("fwrite");
+    real_lseek = lookup("lseek");
+    real_fseeko = lookup("fseeko");
+    real_fseek = lookup("fseek");
+    initializing = 0;
+    inited = 1;
+}
+
+
+void
+opcount_get(opcount_t *counts) {
+    counts->allocations = COUNTER_GET(allocations);
+    counts->frees = COUNTER_GET(frees);
+    counts->bytes_allocated = COUNTER_GET(bytes_allocated);
+    counts->reads = COUNTER_GET(reads);
+    counts->writes = COUNTER_GET(writes);
+    counts->seeks = COUNTER_GET(seeks);
+}
+
+
+void *
+malloc(size_t size) {
+    if (!inited) {
+        if (initializing) {
+            return bootstrap_alloc(size);
+        }
+        init();
+    }
+
+    COUNTER_ADD(allocations, 1);
+    COUNTER_ADD(bytes_allocated, size);
+    return real_malloc(size);
+}
+
+
+void *
+calloc(size_t number, size_t size) {
+    if (!inited) {
+        if (initializing) {
+            /* bootstrap memory is still zero */
+            return size != 0 && number > BOOTSTRAP_SIZE / size ? NULL : bootstrap_alloc(number * size);
+        }
+        init();
+    }
+
+    COUNTER_ADD(allocations, 1);
+    COUNTER_ADD(bytes_allocated, number * size);
+    return real_calloc(number, size);
+}
+
+
+void *
+realloc(void *ptr, size_t size) {
+    if (!inited) {
+        if (initializing) {
+            return ptr == NULL ? bootstrap_alloc(size) : NULL;
+        }
+        init();
+    }
+
+    COUNTER_ADD(allocations, 1);
+    COUNTER_ADD(bytes_allocated, size);
+    if (is_bootstrap(ptr)) {
+        void *copy;
+
+        /* size of allocation is not known, copy what can be there */
+        if ((copy = real_malloc(size)) != NULL) {
+            size_t available = (size_t)(bootstrap + BOOTSTRAP_SIZE - (unsigned char *)ptr);
+            memcpy(copy, ptr, size < available ? size : available);
+        }
+        return copy;
+    }
+    return real_realloc(ptr, size);
+}
+
+
+void
+free(void *ptr) {
+    if (ptr == NULL || is_bootstrap(ptr)) {
+        return;
+    }
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(frees, 1);
+    real_free(ptr);
+}
+
+
+int
+posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(allocations, 1);
+    COUNTER_ADD(bytes_allocated, size);
+    return real_posix_memalign(ptr, alignment, size);
+}
+
+
+ssize_t
+read(int fd, void *buf, size_t nbytes) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(reads, 1);
+    return real_read(fd, buf, nbytes);
+}
+
+
+ssize_t
+pread(int fd, void *buf, size_t nbytes, off_t offset) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(reads, 1);
+    return real_pread(fd, buf, nbytes, offset);
+}
+
+
+size_t
+fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(reads, 1);
+    return real_fread(ptr, size, nmemb, stream);
+}
+
+
+ssize_t
+write(int fd, const void *buf, size_t nbytes) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(writes, 1);
+    return real_write(fd, buf, nbytes);
+}
+
+
+ssize_t
+pwrite(int fd, const void *buf, size_t nbytes, off_t offset) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(writes, 1);
+    return real_pwrite(fd, buf, nbytes, offset);
+}
+
+
+size_t
+fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(writes, 1);
+    return real_fwrite(ptr, size, nmemb, stream);
+}
+
+
+off_t
+lseek(int fd, off_t offset, int whence) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(seeks, 1);
+    return real_lseek(fd, offset, whence);
+}
+
+
+int
+fseeko(FILE *stream, off_t offset, int whence) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(seeks, 1);
+    return real_fseeko(stream, offset, whence);
+}
+
+
+int
+fseek(FILE *stream, long offset, int whence) {
+    if (!inited) {
+        init();
+    }
+
+    COUNTER_ADD(seeks, 1);
+    return real_fseek(stream, offset, whence);
+}
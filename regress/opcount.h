@@ -0,0 +1,51 @@
+#ifndef _HAD_OPCOUNT_H
+#define _HAD_OPCOUNT_H
+
+/*
+  opcount.h -- counters kept by the opcount interposer
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Counts since the program started; preload libopcount to have them kept, and look up opcount_get with dlsym(). */
+typedef struct {
+    unsigned long long allocations;     /* calls to malloc, calloc, realloc, posix_memalign */
+    unsigned long long frees;           /* calls to free with a pointer other than NULL */
+    unsigned long long bytes_allocated; /* bytes requested by allocations */
+    unsigned long long reads;           /* calls to read, pread, fread */
+    unsigned long long writes;          /* calls to write, pwrite, fwrite */
+    unsigned long long seeks;           /* calls to lseek, fseeko, fseek */
+} opcount_t;
+
+typedef void (*opcount_get_fn)(opcount_t *counts);
+
+void opcount_get(opcount_t *counts);
+
+#endif /* _HAD_OPCOUNT_H */
@@ -0,0 +1,305 @@
+/*
+  open_index.c -- test opening archives with index cache file
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zip.h"
+
+typedef struct {
+    zip_int64_t nentry;
+    char **name;
+    zip_int64_t *located;
+    zip_uint32_t *crc;
+} listing_t;
+
+static int compare_listing(const listing_t *expected, zip_t *za);
+static void free_listing(listing_t *listing);
+static int open_and_compare(const char *archive, const char *index, const listing_t *expected, const char *description);
+static char *read_file(const char *fname, long *sizep);
+static int read_listing(zip_t *za, listing_t *listing);
+static int write_file(const char *fname, const char *data, long size);
+
+const char *progname;
+#define USAGE "usage: %s archive index\n"
+
+int
+main(int argc, char *argv[]) {
+    const char *archive, *index;
+    listing_t expected;
+    zip_t *za;
+    char *data, *current;
+    long size, current_size;
+    int err, ret;
+
+    progname = argv[0];
+
+    if (argc != 3) {
+        fprintf(stderr, USAGE, progname);
+        return 1;
+    }
+    archive = argv[1];
+    index = argv[2];
+
+    if ((za = zip_open(archive, ZIP_RDONLY, &err)) == NULL) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, err);
+        fprintf(stderr, "%s: can't open '%s': %s\n", progname, archive, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return 1;
+    }
+    ret = read_listing(za, &expected);
+    zip_close(za);
+    if (ret < 0) {
+        return 1;
+    }
+
+    ret = 0;
+    data = NULL;
+
+    if (open_and_compare(archive, index, &expected, "without index") < 0 || (data = read_file(index, &size)) == NULL) {
+        ret = 1;
+    }
+    else {
+        int i;
+
+        printf("index created\n");
+
+        for (i = 0; i < 3 && ret == 0; i++) {
+            const char *description;
+
+            switch (i) {
+            case 0:
+                description = "with index";
+                break;
+
+            case 1:
+                description = "with corrupted index";
+                data[size / 2] ^= 0x55;
+                ret = write_file(index, data, size);
+                data[size / 2] ^= 0x55;
+                break;
+
+            default:
+                description = "with truncated index";
+                ret = write_file(index, data, size / 2);
+                break;
+            }
+
+            if (ret < 0 || open_and_compare(archive, index, &expected, description) < 0 || (current = read_file(index, &current_size)) == NULL) {
+                ret = 1;
+                break;
+            }
+            if (current_size != size || memcmp(current, data, (size_t)size) != 0) {
+                printf("%s: index differs after opening\n", description);
+                ret = 1;
+            }
+            free(current);
+        }
+    }
+
+    free(data);
+    free_listing(&expected);
+    remove(index);
+
+    return ret;
+}
+
+
+static int
+compare_listing(const listing_t *expected, zip_t *za) {
+    zip_int64_t i;
+    int ret = 0;
+
+    if (zip_get_num_entries(za, 0) != expected->nentry) {
+        printf("got %" PRId64 " entries, expected %" PRId64 "\n", zip_get_num_entries(za, 0), expected->nentry);
+        return -1;
+    }
+
+    /* look up names first, before entries are read on access */
+    for (i = 0; i < expected->nentry; i++) {
+        if (expected->name[i] != NULL && zip_name_locate(za, expected->name[i], 0) != expected->located[i]) {
+            printf("locating '%s' returned %" PRId64 ", expected %" PRId64 "\n", expected->name[i], zip_name_locate(za, expected->name[i], 0), expected->located[i]);
+            ret = -1;
+        }
+    }
+
+    for (i = 0; i < expected->nentry; i++) {
+        zip_stat_t st;
+
+        if (zip_stat_index(za, (zip_uint64_t)i, 0, &st) < 0) {
+            printf("can't stat entry %" PRId64 ": %s\n", i, zip_strerror(za));
+            ret = -1;
+            continue;
+        }
+        if ((st.name == NULL) != (expected->name[i] == NULL) || (st.name != NULL && strcmp(st.name, expected->name[i]) != 0) || st.crc != expected->crc[i]) {
+            printf("entry %" PRId64 " differs\n", i);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+
+static void
+free_listing(listing_t *listing) {
+    zip_int64_t i;
+
+    for (i = 0; i < listing->nentry; i++) {
+        free(listing->name[i]);
+    }
+    free(listing->name);
+    free(listing->located);
+    free(listing->crc);
+}
+
+
+static int
+open_and_compare(const char *archive, const char *index, const listing_t *expected, const char *description) {
+    zip_t *za;
+    int err, ret;
+
+    if ((za = zip_open_with_index(archive, index, ZIP_RDONLY, &err)) == NULL) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, err);
+        printf("%s: can't open archive: %s\n", description, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return -1;
+    }
+
+    ret = compare_listing(expected, za);
+    zip_close(za);
+
+    if (ret == 0) {
+        printf("%s: ok\n", description);
+    }
+    return ret;
+}
+
+
+static char *
+read_file(const char *fname, long *sizep) {
+    FILE *f;
+    char *data;
+    long size;
+
+    if ((f = fopen(fname, "rb")) == NULL) {
+        printf("can't open '%s': %s\n", fname, strerror(errno));
+        return NULL;
+    }
+    if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) < 0) {
+        printf("can't get size of '%s'\n", fname);
+        fclose(f);
+        return NULL;
+    }
+    if ((data = (char *)malloc((size_t)size)) == NULL) {
+        printf("malloc failure\n");
+        fclose(f);
+        return NULL;
+    }
+    if (fread(data, (size_t)size, 1, f) != 1) {
+        printf("can't read '%s': %s\n", fname, strerror(errno));
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+
+    *sizep = size;
+    return data;
+}
+
+
+static int
+read_listing(zip_t *za, listing_t *listing) {
+    zip_int64_t i;
+
+    listing->nentry = zip_get_num_entries(za, 0);
+    listing->name = (char **)calloc((size_t)listing->nentry + 1, sizeof(listing->name[0]));
+    listing->located = (zip_int64_t *)calloc((size_t)listing->nentry + 1, sizeof(listing->located[0]));
+    listing->crc = (zip_uint32_t *)calloc((size_t)listing->nentry + 1, sizeof(listing->crc[0]));
+    if (listing->name == NULL || listing->located == NULL || listing->crc == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", progname);
+        listing->nentry = 0;
+        free_listing(listing);
+        return -1;
+    }
+
+    for (i = 0; i < listing->nentry; i++) {
+        zip_stat_t st;
+
+        if (zip_stat_index(za, (zip_uint64_t)i, 0, &st) < 0) {
+            fprintf(stderr, "%s: can't stat entry %" PRId64 ": %s\n", progname, i, zip_strerror(za));
+            listing->nentry = i;
+            free_listing(listing);
+            return -1;
+        }
+        listing->crc[i] = st.crc;
+        if (st.name != NULL) {
+            if ((listing->name[i] = strdup(st.name)) == NULL) {
+                fprintf(stderr, "%s: malloc failure\n", progname);
+                listing->nentry = i;
+                free_listing(listing);
+                return -1;
+            }
+            listing->located[i] = zip_name_locate(za, st.name, 0);
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+write_file(const char *fname, const char *data, long size) {
+    FILE *f;
+
+    if ((f = fopen(fname, "wb")) == NULL) {
+        printf("can't create '%s': %s\n", fname, strerror(errno));
+        return -1;
+    }
+    if (fwrite(data, (size_t)size, 1, f) != 1) {
+        printf("can't write '%s': %s\n", fname, strerror(errno));
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) != 0) {
+        printf("can't write '%s': %s\n", fname, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+  source_fd.c -- test sharing file descriptor between archives
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "zip.h"
+
+static zip_t *open_fd(int fd);
+
+const char *progname;
+#define USAGE "usage: %s archive\n"
+
+int
+main(int argc, char *argv[]) {
+    zip_t *za[2];
+    zip_file_t *zf[2];
+    zip_int64_t i, nentry;
+    off_t position;
+    int fd, ret;
+
+    progname = argv[0];
+
+    if (argc != 2) {
+        fprintf(stderr, USAGE, progname);
+        return 1;
+    }
+
+    if ((fd = open(argv[1], O_RDONLY)) < 0) {
+        fprintf(stderr, "%s: can't open '%s': %s\n", progname, argv[1], strerror(errno));
+        return 1;
+    }
+    /* position of fd must not be used or changed by the archives */
+    if ((position = lseek(fd, 7, SEEK_SET)) < 0) {
+        fprintf(stderr, "%s: can't seek: %s\n", progname, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    if ((za[0] = open_fd(fd)) == NULL) {
+        close(fd);
+        return 1;
+    }
+    if ((za[1] = open_fd(fd)) == NULL) {
+        zip_discard(za[0]);
+        close(fd);
+        return 1;
+    }
+
+    ret = 0;
+    nentry = zip_get_num_entries(za[0], 0);
+    for (i = 0; i < nentry && ret == 0; i++) {
+        char buf[2][1024];
+        zip_int64_t n[2];
+        int j;
+
+        for (j = 0; j < 2; j++) {
+            if ((zf[j] = zip_fopen_index(za[j], (zip_uint64_t)i, 0)) == NULL) {
+                printf("can't open entry %" PRId64 " in archive %d: %s\n", i, j, zip_strerror(za[j]));
+                ret = 1;
+            }
+        }
+
+        /* read both entries interleaved */
+        while (ret == 0) {
+            for (j = 0; j < 2; j++) {
+                if ((n[j] = zip_fread(zf[j], buf[j], 7)) < 0) {
+                    printf("can't read entry %" PRId64 " in archive %d: %s\n", i, j, zip_file_strerror(zf[j]));
+                    ret = 1;
+                }
+            }
+            if (ret != 0 || n[0] == 0) {
+                break;
+            }
+            if (n[0] != n[1] || memcmp(buf[0], buf[1], (size_t)n[0]) != 0) {
+                printf("data of entry %" PRId64 " differs\n", i);
+                ret = 1;
+            }
+        }
+
+        for (j = 0; j < 2; j++) {
+            if (zf[j] != NULL) {
+                zip_fclose(zf[j]);
+            }
+        }
+        if (ret == 0) {
+            printf("%s: ok\n", zip_get_name(za[0], (zip_uint64_t)i, 0));
+        }
+    }
+
+    zip_discard(za[0]);
+    zip_discard(za[1]);
+
+    if (lseek(fd, 0, SEEK_CUR) != position) {
+        printf("file position changed\n");
+        ret = 1;
+    }
+    if (close(fd) < 0) {
+        printf("file descriptor was closed\n");
+        ret = 1;
+    }
+
+    return ret;
+}
+
+
+static zip_t *
+open_fd(int fd) {
+    zip_source_t *src;
+    zip_error_t error;
+    zip_t *za;
+
+    zip_error_init(&error);
+    if ((src = zip_source_fd_create(fd, 0, -1, &error)) == NULL) {
+        fprintf(stderr, "%s: can't create source: %s\n", progname, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return NULL;
+    }
+    if ((za = zip_open_from_source(src, ZIP_RDONLY, &error)) == NULL) {
+        fprintf(stderr, "%s: can't open archive: %s\n", progname, zip_error_strerror(&error));
+        zip_source_free(src);
+        zip_error_fini(&error);
+        return NULL;
+    }
+    zip_error_fini(&error);
+
+    return za;
+}
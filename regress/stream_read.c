@@ -0,0 +1,201 @@
+/*
+  stream_read.c -- read archive through source that can't seek
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HAVE_GETOPT
+#include "getopt.h"
+#endif
+
+#include "zip.h"
+
+/* source that can only be read front to back, like a pipe */
+typedef struct {
+    zip_error_t error;
+    FILE *fp;
+} pipe_t;
+
+static zip_int64_t pipe_callback(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd);
+
+const char *progname;
+#define USAGE "usage: %s [-cn] archive\n"
+
+int
+main(int argc, char *argv[]) {
+    const char *archive;
+    pipe_t *ctx;
+    zip_source_t *src;
+    zip_stream_t *zs;
+    zip_error_t error;
+    zip_stat_t st;
+    int c, ret;
+    int cat, no_data;
+
+    progname = argv[0];
+    cat = no_data = 0;
+
+    while ((c = getopt(argc, argv, "cn")) != -1) {
+        switch (c) {
+        case 'c':
+            cat = 1;
+            break;
+        case 'n':
+            no_data = 1;
+            break;
+        default:
+            fprintf(stderr, USAGE, progname);
+            return 1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, USAGE, progname);
+        return 1;
+    }
+    archive = argv[optind];
+
+    if ((ctx = (pipe_t *)malloc(sizeof(*ctx))) == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", progname);
+        return 1;
+    }
+    zip_error_init(&ctx->error);
+    if ((ctx->fp = fopen(archive, "rb")) == NULL) {
+        fprintf(stderr, "%s: can't open '%s': %s\n", progname, archive, strerror(errno));
+        free(ctx);
+        return 1;
+    }
+
+    zip_error_init(&error);
+    if ((src = zip_source_function_create(pipe_callback, ctx, &error)) == NULL) {
+        fprintf(stderr, "%s: can't create source: %s\n", progname, zip_error_strerror(&error));
+        fclose(ctx->fp);
+        free(ctx);
+        return 1;
+    }
+    if ((zs = zip_stream_open(src, &error)) == NULL) {
+        fprintf(stderr, "%s: can't open stream '%s': %s\n", progname, archive, zip_error_strerror(&error));
+        zip_source_free(src);
+        return 1;
+    }
+    zip_error_fini(&error);
+
+    while ((ret = zip_stream_next(zs, &st)) > 0) {
+        char buf[8192];
+        zip_int64_t n;
+        zip_uint64_t total;
+
+        if (!cat) {
+            printf("%" PRIu64 ": '%s'", st.index, st.name);
+            if (st.valid & ZIP_STAT_SIZE) {
+                printf(", %" PRIu64 " bytes", st.size);
+            }
+            printf("\n");
+        }
+
+        if (no_data) {
+            continue;
+        }
+
+        total = 0;
+        while ((n = zip_stream_read(zs, buf, sizeof(buf))) > 0) {
+            if (cat && fwrite(buf, (size_t)n, 1, stdout) != 1) {
+                fprintf(stderr, "%s: can't write to stdout: %s\n", progname, strerror(errno));
+                zip_stream_close(zs);
+                return 1;
+            }
+            total += (zip_uint64_t)n;
+        }
+        if (n < 0) {
+            fprintf(stderr, "%s: can't read entry %" PRIu64 ": %s\n", progname, st.index, zip_error_strerror(zip_stream_get_error(zs)));
+            zip_stream_close(zs);
+            return 1;
+        }
+        if (!cat) {
+            printf("%" PRIu64 ": read %" PRIu64 " bytes\n", st.index, total);
+        }
+    }
+    if (ret < 0) {
+        fprintf(stderr, "%s: can't read next entry: %s\n", progname, zip_error_strerror(zip_stream_get_error(zs)));
+        zip_stream_close(zs);
+        return 1;
+    }
+
+    zip_stream_close(zs);
+    return 0;
+}
+
+
+static zip_int64_t
+pipe_callback(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    pipe_t *ctx = (pipe_t *)ud;
+    size_t n;
+
+    switch (cmd) {
+    case ZIP_SOURCE_CLOSE:
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        fclose(ctx->fp);
+        free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_OPEN:
+        return 0;
+
+    case ZIP_SOURCE_READ:
+        n = fread(data, 1, (size_t)length, ctx->fp);
+        if (n < length && ferror(ctx->fp)) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return -1;
+        }
+        return (zip_int64_t)n;
+
+    case ZIP_SOURCE_STAT:
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_CLOSE, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_STAT, -1);
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
@@ -0,0 +1,208 @@
+/*
+  threadsafe.c -- test case for reading archive from multiple threads
+  Copyright (C) 2026 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zip.h"
+
+#define NUM_THREADS 4
+#define ROUNDS 10
+
+typedef struct {
+    zip_t *za;
+    zip_uint64_t num_entries;
+    zip_uint8_t **contents;
+    zip_uint64_t *sizes;
+    unsigned int id;
+    int ret;
+} worker_t;
+
+static zip_uint8_t *
+read_entry(zip_t *za, zip_uint64_t idx, zip_uint64_t *sizep) {
+    zip_stat_t st;
+    zip_file_t *zf;
+    zip_uint8_t *data;
+    zip_int64_t n;
+
+    if (zip_stat_index(za, idx, 0, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0) {
+        fprintf(stderr, "can't stat entry %" PRIu64 "\n", idx);
+        return NULL;
+    }
+    if ((data = (zip_uint8_t *)malloc(st.size + 1)) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return NULL;
+    }
+    if ((zf = zip_fopen_index(za, idx, 0)) == NULL) {
+        fprintf(stderr, "can't open entry %" PRIu64 "\n", idx);
+        free(data);
+        return NULL;
+    }
+    /* read one byte more than expected to detect excess data */
+    if ((n = zip_fread(zf, data, st.size + 1)) < 0 || (zip_uint64_t)n != st.size) {
+        fprintf(stderr, "can't read entry %" PRIu64 ": %s\n", idx, zip_file_strerror(zf));
+        zip_fclose(zf);
+        free(data);
+        return NULL;
+    }
+    if (zip_fclose(zf) != 0) {
+        fprintf(stderr, "can't close entry %" PRIu64 "\n", idx);
+        free(data);
+        return NULL;
+    }
+
+    *sizep = st.size;
+    return data;
+}
+
+
+static void *
+worker(void *ud) {
+    worker_t *w = (worker_t *)ud;
+    zip_uint64_t i, j;
+    int round;
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (j = 0; j < w->num_entries; j++) {
+            zip_uint8_t *data;
+            zip_uint64_t size;
+
+            i = (j + w->id) % w->num_entries;
+            if ((data = read_entry(w->za, i, &size)) == NULL) {
+                w->ret = -1;
+                return NULL;
+            }
+            if (size != w->sizes[i] || (size > 0 && memcmp(data, w->contents[i], size) != 0)) {
+                fprintf(stderr, "thread %u: data of entry %" PRIu64 " differs\n", w->id, i);
+                free(data);
+                w->ret = -1;
+                return NULL;
+            }
+            free(data);
+        }
+    }
+
+    w->ret = 0;
+    return NULL;
+}
+
+
+int
+main(int argc, char *argv[]) {
+    const char *archive;
+    zip_t *za;
+    zip_int64_t num_entries;
+    zip_uint64_t i;
+    zip_uint8_t **contents;
+    zip_uint64_t *sizes;
+    worker_t workers[NUM_THREADS];
+    pthread_t threads[NUM_THREADS];
+    unsigned int t;
+    int err, ret;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s archive\n", argv[0]);
+        return 1;
+    }
+
+    archive = argv[1];
+
+    if ((za = zip_open(archive, ZIP_RDONLY | ZIP_THREADSAFE, &err)) == NULL) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, err);
+        fprintf(stderr, "can't open zip archive '%s': %s\n", archive, zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return 1;
+    }
+
+    if ((num_entries = zip_get_num_entries(za, 0)) <= 0) {
+        fprintf(stderr, "no entries in zip archive '%s'\n", archive);
+        zip_discard(za);
+        return 1;
+    }
+
+    /* read reference contents from a single thread */
+    contents = (zip_uint8_t **)calloc((size_t)num_entries, sizeof(contents[0]));
+    sizes = (zip_uint64_t *)calloc((size_t)num_entries, sizeof(sizes[0]));
+    if (contents == NULL || sizes == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        exit(1);
+    }
+    for (i = 0; i < (zip_uint64_t)num_entries; i++) {
+        if ((contents[i] = read_entry(za, i, sizes + i)) == NULL) {
+            exit(1);
+        }
+    }
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        workers[t].za = za;
+        workers[t].num_entries = (zip_uint64_t)num_entries;
+        workers[t].contents = contents;
+        workers[t].sizes = sizes;
+        workers[t].id = t;
+        workers[t].ret = -1;
+        if (pthread_create(threads + t, NULL, worker, workers + t) != 0) {
+            fprintf(stderr, "can't create thread\n");
+            exit(1);
+        }
+    }
+
+    ret = 0;
+    for (t = 0; t < NUM_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        if (workers[t].ret < 0) {
+            ret = 1;
+        }
+    }
+
+    for (i = 0; i < (zip_uint64_t)num_entries; i++) {
+        free(contents[i]);
+    }
+    free(contents);
+    free(sizes);
+
+    if (zip_close(za) == -1) {
+        fprintf(stderr, "can't close zip archive '%s': %s\n", archive, zip_strerror(za));
+        return 1;
+    }
+
+    if (ret == 0) {
+        printf("%u threads read %" PRIu64 " entries %d times\n", NUM_THREADS, (zip_uint64_t)num_entries, ROUNDS);
+    }
+
+    return ret;
+}
@@ -6,56 +6,104 @@
 
 #define FOR_REGRESS
 
-typedef enum { SOURCE_TYPE_NONE, SOURCE_TYPE_IN_MEMORY, SOURCE_TYPE_HOLE } source_type_t;
+typedef enum { SOURCE_TYPE_NONE, SOURCE_TYPE_IN_MEMORY, SOURCE_TYPE_HOLE, SOURCE_TYPE_MMAP, SOURCE_TYPE_STREAM, SOURCE_TYPE_ASYNC, SOURCE_TYPE_CACHE, SOURCE_TYPE_DIRECT, SOURCE_TYPE_NONBLOCKING, SOURCE_TYPE_MAPPED } source_type_t;
 
 source_type_t source_type = SOURCE_TYPE_NONE;
 zip_uint64_t fragment_size = 0;
+zip_uint32_t async_queue_depth = 2;
+zip_uint64_t cache_block_size = 0;
+zip_uint64_t nonblocking_block_size = 0;
 zip_file_t *z_files[16];
 unsigned int z_files_count;
 int commands_from_stdin = 0;
 
 static int add_nul(char *argv[]);
+static int add_random(char *argv[]);
+static int add_text(char *argv[]);
 static int cancel(char *argv[]);
 static int extract_as(char *argv[]);
+static int regress_fborrow(char *argv[]);
+static int regress_fborrow_aligned(char *argv[]);
 static int regress_fopen(char *argv[]);
 static int regress_fread(char *argv[]);
+static int regress_freopen(char *argv[]);
 static int regress_fseek(char *argv[]);
 static int is_seekable(char *argv[]);
+static int register_fake_compression(char *argv[]);
+static int set_buffer_write_options(char *argv[]);
+static int set_deferred_executor(char *argv[]);
+static int set_fake_crypto_provider(char *argv[]);
 static int unchange_one(char *argv[]);
 static int unchange_all(char *argv[]);
 static int zin_close(char *argv[]);
 
-#define OPTIONS_REGRESS "F:Himx"
-
-#define USAGE_REGRESS " [-Himx] [-F fragment-size]"
-
-#define GETOPT_REGRESS                              \
-    case 'H':                                       \
-        source_type = SOURCE_TYPE_HOLE;             \
-        break;                                      \
-    case 'i':                                       \
-        commands_from_stdin = 1;                    \
-        break;                                      \
-    case 'm':                                       \
-        source_type = SOURCE_TYPE_IN_MEMORY;        \
-        break;                                      \
-    case 'F':                                       \
-        fragment_size = strtoull(optarg, NULL, 10); \
-        break;                                      \
-    case 'x':                                       \
-        hex_encoded_filenames = 1;                  \
+#define OPTIONS_REGRESS "A:B:C:dF:HiMmSW:wx"
+
+#define USAGE_REGRESS " [-dHiMmSwx] [-A queue-depth] [-B memory-limit] [-C block-size] [-F fragment-size] [-W block-size]"
+
+#define GETOPT_REGRESS                                               \
+    case 'A':                                                        \
+        source_type = SOURCE_TYPE_ASYNC;                             \
+        async_queue_depth = (zip_uint32_t)strtoul(optarg, NULL, 10); \
+        break;                                                       \
+    case 'B':                                                        \
+        zip_set_default_memory_limit(strtoull(optarg, NULL, 10));    \
+        break;                                                       \
+    case 'C':                                                        \
+        source_type = SOURCE_TYPE_CACHE;                             \
+        cache_block_size = strtoull(optarg, NULL, 10);               \
+        break;                                                       \
+    case 'd':                                                        \
+        source_type = SOURCE_TYPE_DIRECT;                            \
+        break;                                                       \
+    case 'H':                                                        \
+        source_type = SOURCE_TYPE_HOLE;                              \
+        break;                                                       \
+    case 'i':                                                        \
+        commands_from_stdin = 1;                                     \
+        break;                                                       \
+    case 'M':                                                        \
+        source_type = SOURCE_TYPE_MMAP;                              \
+        break;                                                       \
+    case 'm':                                                        \
+        source_type = SOURCE_TYPE_IN_MEMORY;                         \
+        break;                                                       \
+    case 'S':                                                        \
+        source_type = SOURCE_TYPE_STREAM;                            \
+        break;                                                       \
+    case 'W':                                                        \
+        source_type = SOURCE_TYPE_NONBLOCKING;                       \
+        nonblocking_block_size = strtoull(optarg, NULL, 10);         \
+        break;                                                       \
+    case 'w':                                                        \
+        source_type = SOURCE_TYPE_MAPPED;                            \
+        break;                                                       \
+    case 'F':                                                        \
+        fragment_size = strtoull(optarg, NULL, 10);                  \
+        break;                                                       \
+    case 'x':                                                        \
+        hex_encoded_filenames = 1;                                   \
         break;
 
 /* clang-format off */
 
 #define DISPATCH_REGRESS \
     {"add_nul", 2, "name length", "add NUL bytes", add_nul}, \
+    {"add_random", 2, "name length", "add pseudo-random bytes", add_random}, \
+    {"add_text", 2, "name length", "add pseudo-random letters, which compress to about half", add_text}, \
     {"cancel", 1, "limit", "cancel writing archive when limit% have been written (calls print_progress)", cancel}, \
     {"extract_as", 2, "index name", "extract file data to given file name", extract_as}, \
+    {"fborrow", 1, "file_index", "print data of fopened file without copying", regress_fborrow}, \
+    {"fborrow_aligned", 2, "file_index alignment", "print data of fopened file without copying if it is aligned", regress_fborrow_aligned}, \
     {"fopen", 1, "name", "open archive entry", regress_fopen}, \
     {"fread", 2, "file_index length", "read from fopened file and print", regress_fread}, \
+    {"freopen", 2, "file_index index", "reuse fopened file for entry at index", regress_freopen}, \
     {"fseek", 3, "file_index offset whence", "seek in fopened file", regress_fseek}, \
     {"is_seekable", 1, "index", "report if entry is seekable", is_seekable}, \
+    {"register_fake_compression", 0, "", "use run length encoding for compression method 'unknown' (for internal tests)", register_fake_compression}, \
+    {"set_buffer_write_options", 2, "size_hint coalesce", "set write options of in-memory archive source (for internal tests)", set_buffer_write_options}, \
+    {"set_deferred_executor", 0, "", "use executor that runs tasks only at exit, so waiting threads have to run them (for internal tests)", set_deferred_executor}, \
+    {"set_fake_crypto_provider", 0, "", "use insecure crypto provider (for internal tests)", set_fake_crypto_provider}, \
     {"unchange", 1, "index", "revert changes for entry", unchange_one}, \
     {"unchange_all", 0, "", "revert all changes", unchange_all}, \
     {"zin_close", 1, "index", "close input zip_source (for internal tests)", zin_close}
@@ -124,10 +172,261 @@ int get_stdin_commands(void) {
 
 zip_source_t *memory_src = NULL;
 
+static zip_t *
+read_async(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len) {
+    zip_source_t *src = NULL;
+    zip_t *zs = NULL;
+
+    if (len > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((src = zip_source_file_async_create(archive, offset, len == 0 ? ZIP_LENGTH_TO_END : (zip_int64_t)len, async_queue_depth, error)) == NULL || (zs = zip_open_from_source(src, flags, error)) == NULL) {
+        zip_source_free(src);
+    }
+
+    return zs;
+}
+
+
+/* few blocks, so small block sizes exercise eviction */
+#define CACHE_NUM_BLOCKS 4
+
+static zip_t *
+read_cached(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len) {
+    zip_source_t *src = NULL;
+    zip_source_t *cache = NULL;
+    zip_t *zs = NULL;
+
+    if (len > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((src = zip_source_file_create(archive, offset, len == 0 ? ZIP_LENGTH_TO_END : (zip_int64_t)len, error)) == NULL || (cache = zip_source_cache_create(src, cache_block_size, CACHE_NUM_BLOCKS, error)) == NULL) {
+        zip_source_free(src);
+        return NULL;
+    }
+    if ((zs = zip_open_from_source(cache, flags, error)) == NULL) {
+        zip_source_free(cache);
+    }
+
+    return zs;
+}
+
+
+static zip_t *
+read_direct(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len) {
+    zip_source_t *src = NULL;
+    zip_t *zs = NULL;
+
+    if (len > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((src = zip_source_file_direct_create(archive, offset, len == 0 ? ZIP_LENGTH_TO_END : (zip_int64_t)len, error)) == NULL || (zs = zip_open_from_source(src, flags, error)) == NULL) {
+        zip_source_free(src);
+    }
+
+    return zs;
+}
+
+
+/* Source that makes blocks of the file available only after they have been requested once, like data arriving over a network. */
+typedef struct {
+    zip_uint64_t block_size;
+    zip_uint64_t num_blocks;
+    zip_uint8_t *available;
+    zip_error_t error;
+} nonblocking_t;
+
+static zip_int64_t
+source_nonblocking(zip_source_t *src, void *ud, void *data, zip_uint64_t length, zip_source_cmd_t command) {
+    nonblocking_t *ctx = (nonblocking_t *)ud;
+
+    switch (command) {
+    case ZIP_SOURCE_CLOSE:
+    case ZIP_SOURCE_OPEN:
+    case ZIP_SOURCE_STAT:
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        free(ctx->available);
+        zip_error_fini(&ctx->error);
+        free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_READ: {
+        zip_int64_t offset, n;
+        zip_uint64_t block, end;
+
+        if ((offset = zip_source_tell(src)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+        end = ZIP_MIN((zip_uint64_t)offset + length, ctx->num_blocks * ctx->block_size);
+        block = (zip_uint64_t)offset / ctx->block_size;
+        if (end > (zip_uint64_t)offset && !ctx->available[block]) {
+            /* request missing blocks, they are available on next call */
+            for (; block * ctx->block_size < end; block++) {
+                ctx->available[block] = 1;
+            }
+            zip_error_set(&ctx->error, ZIP_ER_AGAIN, 0);
+            return -1;
+        }
+        /* return data up to first missing block */
+        while (block * ctx->block_size < end && ctx->available[block]) {
+            block++;
+        }
+        if (block * ctx->block_size < end) {
+            length = block * ctx->block_size - (zip_uint64_t)offset;
+        }
+        if ((n = zip_source_read(src, data, length)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+        return n;
+    }
+
+    case ZIP_SOURCE_SEEK: {
+        zip_source_args_seek_t *args = ZIP_SOURCE_GET_ARGS(zip_source_args_seek_t, data, length, &ctx->error);
+
+        if (args == NULL) {
+            return -1;
+        }
+        if (zip_source_seek(src, args->offset, args->whence) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
+        }
+        return 0;
+    }
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_SEEK, ZIP_SOURCE_TELL, ZIP_SOURCE_SUPPORTS, -1);
+
+    case ZIP_SOURCE_TELL: {
+        zip_int64_t offset;
+
+        if ((offset = zip_source_tell(src)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+        }
+        return offset;
+    }
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+
+static zip_t *
+read_nonblocking(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len) {
+    zip_source_t *src = NULL;
+    zip_source_t *layered = NULL;
+    nonblocking_t *ctx;
+    zip_stat_t st;
+    zip_t *zs = NULL;
+
+    if (len > ZIP_INT64_MAX || nonblocking_block_size == 0) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((src = zip_source_file_create(archive, offset, len == 0 ? ZIP_LENGTH_TO_END : (zip_int64_t)len, error)) == NULL) {
+        return NULL;
+    }
+    if (zip_source_stat(src, &st) < 0 || !(st.valid & ZIP_STAT_SIZE)) {
+        zip_error_set_from_source(error, src);
+        zip_source_free(src);
+        return NULL;
+    }
+    if ((ctx = (nonblocking_t *)malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        zip_source_free(src);
+        return NULL;
+    }
+    ctx->block_size = nonblocking_block_size;
+    ctx->num_blocks = (st.size + nonblocking_block_size - 1) / nonblocking_block_size;
+    zip_error_init(&ctx->error);
+    if ((ctx->available = (zip_uint8_t *)calloc((size_t)ctx->num_blocks + 1, 1)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        free(ctx);
+        zip_source_free(src);
+        return NULL;
+    }
+    if ((layered = zip_source_layered_create(src, source_nonblocking, ctx, error)) == NULL) {
+        free(ctx->available);
+        free(ctx);
+        zip_source_free(src);
+        return NULL;
+    }
+
+    /* retry until all data needed to open the archive has arrived */
+    while ((zs = zip_open_from_source(layered, flags, error)) == NULL && zip_error_code_zip(error) == ZIP_ER_AGAIN) {
+        zip_error_fini(error);
+        zip_error_init(error);
+    }
+    if (zs == NULL) {
+        zip_source_free(layered);
+    }
+
+    return zs;
+}
+
+
+static zip_t *
+read_mapped(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len) {
+    zip_source_t *src = NULL;
+    zip_t *zs = NULL;
+
+    if (len > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((src = zip_source_file_mapped_create(archive, offset, len == 0 ? ZIP_LENGTH_TO_END : (zip_int64_t)len, error)) == NULL || (zs = zip_open_from_source(src, flags, error)) == NULL) {
+        zip_source_free(src);
+    }
+
+    return zs;
+}
+
+
+static zip_t *
+read_mmap(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len) {
+    zip_source_t *src = NULL;
+    zip_t *zs = NULL;
+
+    if (len > ZIP_INT64_MAX) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+    if ((src = zip_source_mmap_create(archive, offset, len == 0 ? ZIP_LENGTH_TO_END : (zip_int64_t)len, error)) == NULL || (zs = zip_open_from_source(src, flags, error)) == NULL) {
+        zip_source_free(src);
+    }
+
+    return zs;
+}
+
+
 static int get_whence(const char *str);
 zip_source_t *source_hole_create(const char *, int flags, zip_error_t *);
+static zip_t *read_async(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len);
+static zip_t *read_cached(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len);
+static zip_t *read_direct(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len);
+static zip_t *read_mapped(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len);
+static zip_t *read_mmap(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len);
+static zip_t *read_nonblocking(const char *archive, int flags, zip_error_t *error, zip_uint64_t offset, zip_uint64_t len);
 static zip_t *read_to_memory(const char *archive, int flags, zip_error_t *error, zip_source_t **srcp);
-static zip_source_t *source_nul(zip_t *za, zip_uint64_t length);
+static zip_source_t *source_nul(zip_t *za, zip_uint64_t length, bool pseudo_random, bool text);
+static zip_t *write_stream(const char *archive, int flags, zip_error_t *error);
 
 
 static int
@@ -135,7 +434,43 @@ add_nul(char *argv[]) {
     zip_source_t *zs;
     zip_uint64_t length = strtoull(argv[1], NULL, 10);
 
-    if ((zs = source_nul(za, length)) == NULL) {
+    if ((zs = source_nul(za, length, false, false)) == NULL) {
+        fprintf(stderr, "can't create zip_source for length: %s\n", zip_strerror(za));
+        return -1;
+    }
+
+    if (zip_file_add(za, argv[0], zs, 0) == -1) {
+        zip_source_free(zs);
+        fprintf(stderr, "can't add file '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+add_random(char *argv[]) {
+    zip_source_t *zs;
+    zip_uint64_t length = strtoull(argv[1], NULL, 10);
+
+    if ((zs = source_nul(za, length, true, false)) == NULL) {
+        fprintf(stderr, "can't create zip_source for length: %s\n", zip_strerror(za));
+        return -1;
+    }
+
+    if (zip_file_add(za, argv[0], zs, 0) == -1) {
+        zip_source_free(zs);
+        fprintf(stderr, "can't add file '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+add_text(char *argv[]) {
+    zip_source_t *zs;
+    zip_uint64_t length = strtoull(argv[1], NULL, 10);
+
+    if ((zs = source_nul(za, length, true, true)) == NULL) {
         fprintf(stderr, "can't create zip_source for length: %s\n", zip_strerror(za));
         return -1;
     }
@@ -148,6 +483,7 @@ add_nul(char *argv[]) {
     return 0;
 }
 
+
 static int
 cancel_callback(zip_t *archive, void *ud) {
     if (progress_userdata.percentage >= progress_userdata.limit) {
@@ -264,6 +600,366 @@ unchange_one(char *argv[]) {
     return 0;
 }
 
+/* Run length encoding as (count, byte) pairs, to test registering compression implementations. */
+
+struct fake_compression {
+    bool compress;
+    zip_error_t *error;
+    const zip_uint8_t *in;
+    zip_uint64_t in_length;
+    bool end_of_input;
+    bool have_count;
+    zip_uint8_t run_byte;
+    zip_uint64_t run_length;
+    zip_uint8_t out[2];
+    int out_length;
+    int out_offset;
+};
+
+static bool fake_compression_compress = true;
+static bool fake_compression_decompress = false;
+
+static zip_uint64_t
+fake_compression_maximum_compressed_size(void *ud, zip_uint64_t uncompressed_size) {
+    (void)ud;
+    return 2 * uncompressed_size;
+}
+
+static void *
+fake_compression_allocate(void *ud, zip_uint16_t method, int level, zip_error_t *error) {
+    struct fake_compression *ctx;
+
+    (void)method;
+    (void)level;
+    if ((ctx = (struct fake_compression *)malloc(sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->compress = *(bool *)ud;
+    ctx->error = error;
+    return ctx;
+}
+
+static void
+fake_compression_deallocate(void *ctx) {
+    free(ctx);
+}
+
+static int
+fake_compression_start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
+    struct fake_compression *ctx = (struct fake_compression *)ud;
+
+    (void)st;
+    (void)attributes;
+    ctx->in_length = 0;
+    ctx->end_of_input = false;
+    ctx->have_count = false;
+    ctx->run_length = 0;
+    ctx->out_length = 0;
+    ctx->out_offset = 0;
+    return 0;
+}
+
+static int
+fake_compression_end(void *ud) {
+    (void)ud;
+    return 0;
+}
+
+static int
+fake_compression_input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
+    struct fake_compression *ctx = (struct fake_compression *)ud;
+
+    ctx->in = data;
+    ctx->in_length = length;
+    return 0;
+}
+
+static void
+fake_compression_end_of_input(void *ud) {
+    struct fake_compression *ctx = (struct fake_compression *)ud;
+
+    ctx->end_of_input = true;
+}
+
+static zip_compression_status_t
+fake_compression_process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
+    struct fake_compression *ctx = (struct fake_compression *)ud;
+    zip_uint64_t n = 0;
+
+    while (n < *length) {
+        if (ctx->compress) {
+            if (ctx->out_offset < ctx->out_length) {
+                data[n++] = ctx->out[ctx->out_offset++];
+                continue;
+            }
+            if (ctx->run_length > 0 && ((ctx->in_length > 0 && (ctx->in[0] != ctx->run_byte || ctx->run_length == 255)) || (ctx->in_length == 0 && ctx->end_of_input))) {
+                ctx->out[0] = (zip_uint8_t)ctx->run_length;
+                ctx->out[1] = ctx->run_byte;
+                ctx->out_length = 2;
+                ctx->out_offset = 0;
+                ctx->run_length = 0;
+                continue;
+            }
+            if (ctx->in_length == 0) {
+                break;
+            }
+            ctx->run_byte = ctx->in[0];
+            ctx->run_length++;
+        }
+        else {
+            if (!ctx->have_count && ctx->run_length > 0) {
+                data[n++] = ctx->run_byte;
+                ctx->run_length--;
+                continue;
+            }
+            if (ctx->in_length == 0) {
+                break;
+            }
+            if (ctx->have_count) {
+                ctx->run_byte = ctx->in[0];
+            }
+            else {
+                ctx->run_length = ctx->in[0];
+            }
+            ctx->have_count = !ctx->have_count;
+        }
+        ctx->in++;
+        ctx->in_length--;
+    }
+
+    *length = n;
+    if (n > 0) {
+        return ZIP_COMPRESSION_OK;
+    }
+    if (!ctx->end_of_input) {
+        return ZIP_COMPRESSION_NEED_DATA;
+    }
+    if (!ctx->compress && ctx->have_count) {
+        zip_error_set(ctx->error, ZIP_ER_COMPRESSED_DATA, 0);
+        return ZIP_COMPRESSION_ERROR;
+    }
+    return ZIP_COMPRESSION_END;
+}
+
+static int
+register_fake_compression(char *argv[]) {
+    zip_compression_implementation_t compress, decompress;
+    zip_error_t error;
+
+    (void)argv;
+    compress.version = 1;
+    compress.version_needed = 63;
+    compress.ud = &fake_compression_compress;
+    compress.maximum_compressed_size = fake_compression_maximum_compressed_size;
+    compress.allocate = fake_compression_allocate;
+    compress.deallocate = fake_compression_deallocate;
+    compress.general_purpose_bit_flags = NULL;
+    compress.start = fake_compression_start;
+    compress.end = fake_compression_end;
+    compress.input = fake_compression_input;
+    compress.end_of_input = fake_compression_end_of_input;
+    compress.process = fake_compression_process;
+    compress.unconsumed_input = NULL;
+    decompress = compress;
+    decompress.ud = &fake_compression_decompress;
+
+    zip_error_init(&error);
+    if (zip_register_compression_implementation((zip_uint16_t)get_compression_method("unknown"), &compress, &decompress, &error) < 0) {
+        fprintf(stderr, "can't register compression implementation: %s\n", zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return -1;
+    }
+    return 0;
+}
+
+/* Insecure stand-ins for the cryptographic primitives, to test that a crypto provider is used. */
+
+struct fake_crypto {
+    zip_uint8_t key[32];
+    zip_uint64_t length;
+    zip_uint32_t hash;
+};
+
+static void *
+fake_crypto_new(const zip_uint8_t *key, zip_uint64_t length) {
+    struct fake_crypto *ctx;
+    zip_uint64_t i;
+
+    if ((ctx = (struct fake_crypto *)malloc(sizeof(*ctx))) == NULL) {
+        return NULL;
+    }
+    ctx->length = ZIP_MIN(length, sizeof(ctx->key));
+    ctx->hash = 2166136261u;
+    for (i = 0; i < ctx->length; i++) {
+        ctx->key[i] = key[i];
+        ctx->hash = (ctx->hash ^ key[i]) * 16777619u;
+    }
+    return ctx;
+}
+
+static void *
+fake_aes_new(void *ud, const zip_uint8_t *key, zip_uint16_t key_size) {
+    (void)ud;
+    return fake_crypto_new(key, key_size / 8);
+}
+
+static int
+fake_aes_encrypt_blocks(void *ud, void *aes, const zip_uint8_t *in, zip_uint8_t *out, zip_uint64_t length) {
+    struct fake_crypto *ctx = (struct fake_crypto *)aes;
+    zip_uint64_t i;
+
+    (void)ud;
+    for (i = 0; i < length; i++) {
+        out[i] = (zip_uint8_t)(in[i] ^ ctx->key[i % ctx->length] ^ in[i - i % 16]);
+    }
+    return 0;
+}
+
+static void
+fake_crypto_free(void *ud, void *ctx) {
+    (void)ud;
+    free(ctx);
+}
+
+static void *
+fake_hmac_new(void *ud, const zip_uint8_t *secret, zip_uint64_t secret_length) {
+    (void)ud;
+    return fake_crypto_new(secret, secret_length);
+}
+
+static int
+fake_hmac_update(void *ud, void *hmac, const zip_uint8_t *data, zip_uint64_t length) {
+    struct fake_crypto *ctx = (struct fake_crypto *)hmac;
+    zip_uint64_t i;
+
+    (void)ud;
+    for (i = 0; i < length; i++) {
+        ctx->hash = (ctx->hash ^ data[i]) * 16777619u;
+    }
+    return 0;
+}
+
+static int
+fake_hmac_output(void *ud, void *hmac, zip_uint8_t *digest) {
+    struct fake_crypto *ctx = (struct fake_crypto *)hmac;
+    int i;
+
+    (void)ud;
+    for (i = 0; i < 20; i++) {
+        digest[i] = (zip_uint8_t)(ctx->hash >> (8 * (i % 4)));
+    }
+    return 0;
+}
+
+static int
+fake_pbkdf2(void *ud, const zip_uint8_t *password, zip_uint64_t password_length, const zip_uint8_t *salt, zip_uint16_t salt_length, zip_uint16_t iterations, zip_uint8_t *output, zip_uint16_t output_length) {
+    zip_uint16_t i;
+
+    (void)ud;
+    (void)iterations;
+    for (i = 0; i < output_length; i++) {
+        output[i] = (zip_uint8_t)(password[i % password_length] ^ salt[i % salt_length] ^ i);
+    }
+    return 0;
+}
+
+static int
+set_buffer_write_options(char *argv[]) {
+    zip_uint64_t size_hint;
+    zip_flags_t flags;
+
+    if (memory_src == NULL) {
+        fprintf(stderr, "set_buffer_write_options requires in-memory archive (-m)\n");
+        return -1;
+    }
+
+    size_hint = strtoull(argv[0], NULL, 10);
+    flags = strtoul(argv[1], NULL, 10) != 0 ? ZIP_BUFFER_FL_COALESCE : 0;
+    if (zip_source_buffer_set_write_options(memory_src, size_hint, flags) < 0) {
+        fprintf(stderr, "can't set buffer write options: %s\n", zip_error_strerror(zip_source_error(memory_src)));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+typedef struct deferred_task {
+    void (*task)(void *);
+    void *ud;
+    struct deferred_task *next;
+} deferred_task_t;
+
+static deferred_task_t *deferred_tasks = NULL;
+
+static int
+deferred_submit(void *ud, void (*task)(void *), void *task_ud) {
+    deferred_task_t *t;
+
+    (void)ud;
+    if ((t = (deferred_task_t *)malloc(sizeof(*t))) == NULL) {
+        return -1;
+    }
+    t->task = task;
+    t->ud = task_ud;
+    t->next = deferred_tasks;
+    deferred_tasks = t;
+    return 0;
+}
+
+static void
+run_deferred_tasks(void) {
+    while (deferred_tasks != NULL) {
+        deferred_task_t *t = deferred_tasks;
+
+        deferred_tasks = t->next;
+        t->task(t->ud);
+        free(t);
+    }
+}
+
+static int
+set_deferred_executor(char *argv[]) {
+    zip_executor_t executor;
+
+    (void)argv;
+    executor.version = 1;
+    executor.ud = NULL;
+    executor.submit = deferred_submit;
+
+    if (zip_set_executor(&executor) < 0) {
+        fprintf(stderr, "can't set executor\n");
+        return -1;
+    }
+    atexit(run_deferred_tasks);
+    return 0;
+}
+
+
+static int
+set_fake_crypto_provider(char *argv[]) {
+    zip_crypto_provider_t provider;
+
+    (void)argv;
+    provider.version = 1;
+    provider.ud = NULL;
+    provider.aes_new = fake_aes_new;
+    provider.aes_encrypt_blocks = fake_aes_encrypt_blocks;
+    provider.aes_free = fake_crypto_free;
+    provider.hmac_new = fake_hmac_new;
+    provider.hmac_update = fake_hmac_update;
+    provider.hmac_output = fake_hmac_output;
+    provider.hmac_free = fake_crypto_free;
+    provider.pbkdf2 = fake_pbkdf2;
+
+    if (zip_set_crypto_provider(za, &provider) < 0) {
+        fprintf(stderr, "can't set crypto provider: %s\n", zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 zin_close(char *argv[]) {
     zip_uint64_t idx;
@@ -289,7 +985,11 @@ regress_fopen(char *argv[]) {
         fprintf(stderr, "too many open files\n");
         return -1;
     }
-    if ((z_files[z_files_count] = zip_fopen(za, argv[0], 0)) == NULL) {
+    /* retry while a non-blocking source has no data available yet */
+    while ((z_files[z_files_count] = zip_fopen(za, argv[0], 0)) == NULL && zip_error_code_zip(zip_get_error(za)) == ZIP_ER_AGAIN) {
+        zip_error_clear(za);
+    }
+    if (z_files[z_files_count] == NULL) {
         fprintf(stderr, "can't open entry '%s' from input archive: %s\n", argv[0], zip_strerror(za));
         return -1;
     }
@@ -299,6 +999,60 @@ regress_fopen(char *argv[]) {
 }
 
 
+static int
+regress_fborrow(char *argv[]) {
+    zip_uint64_t file_idx;
+    const void *data;
+    zip_uint64_t length;
+    zip_file_t *f;
+
+    file_idx = strtoull(argv[0], NULL, 10);
+
+    if (file_idx >= z_files_count || z_files[file_idx] == NULL) {
+        fprintf(stderr, "trying to borrow from invalid opened file\n");
+        return -1;
+    }
+    f = z_files[file_idx];
+    if (zip_file_borrow(f, &data, &length) < 0) {
+        fprintf(stderr, "can't borrow data of opened file %" PRIu64 ": %s\n", file_idx, zip_file_strerror(f));
+        return -1;
+    }
+    if (length > 0 && fwrite(data, (size_t)length, 1, stdout) != 1) {
+        fprintf(stderr, "can't write file contents to stdout: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+regress_fborrow_aligned(char *argv[]) {
+    zip_uint64_t file_idx;
+    zip_uint32_t alignment;
+    const void *data;
+    zip_uint64_t length;
+    zip_file_t *f;
+
+    file_idx = strtoull(argv[0], NULL, 10);
+    alignment = (zip_uint32_t)strtoul(argv[1], NULL, 10);
+
+    if (file_idx >= z_files_count || z_files[file_idx] == NULL) {
+        fprintf(stderr, "trying to borrow from invalid opened file\n");
+        return -1;
+    }
+    f = z_files[file_idx];
+    if (zip_file_borrow_aligned(f, alignment, &data, &length) < 0) {
+        fprintf(stderr, "can't borrow aligned data of opened file %" PRIu64 ": %s\n", file_idx, zip_file_strerror(f));
+        return -1;
+    }
+    if (length > 0 && fwrite(data, (size_t)length, 1, stdout) != 1) {
+        fprintf(stderr, "can't write file contents to stdout: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
 static int
 regress_fread(char *argv[]) {
     zip_uint64_t file_idx;
@@ -324,6 +1078,9 @@ regress_fread(char *argv[]) {
             to_read = length;
         }
         n = zip_fread(f, buf, to_read);
+        if (n < 0 && zip_error_code_zip(zip_file_get_error(f)) == ZIP_ER_AGAIN) {
+            continue;
+        }
         if (n < 0) {
             fprintf(stderr, "can't read opened file %" PRIu64 ": %s\n", file_idx, zip_file_strerror(f));
             return -1;
@@ -346,6 +1103,26 @@ regress_fread(char *argv[]) {
 }
 
 
+static int
+regress_freopen(char *argv[]) {
+    zip_uint64_t file_idx;
+    zip_uint64_t idx;
+
+    file_idx = strtoull(argv[0], NULL, 10);
+    idx = strtoull(argv[1], NULL, 10);
+
+    if (file_idx >= z_files_count || z_files[file_idx] == NULL) {
+        fprintf(stderr, "trying to reopen invalid opened file\n");
+        return -1;
+    }
+    if (zip_freopen_index(za, z_files[file_idx], idx, 0) < 0) {
+        fprintf(stderr, "can't reopen file %" PRIu64 " for entry %" PRIu64 ": %s\n", file_idx, idx, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+
 static zip_t *
 read_hole(const char *archive, int flags, zip_error_t *error) {
     zip_source_t *src = NULL;
@@ -495,6 +1272,9 @@ typedef struct source_nul {
     zip_error_t error;
     zip_uint64_t length;
     zip_uint64_t offset;
+    bool random;          /* pseudo-random bytes instead of NUL bytes */
+    bool text;            /* limit pseudo-random bytes to 16 letters */
+    zip_uint32_t state;
 } source_nul_t;
 
 static zip_int64_t
@@ -514,6 +1294,7 @@ source_nul_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t comman
 
     case ZIP_SOURCE_OPEN:
         ctx->offset = 0;
+        ctx->state = 1;
         return 0;
 
     case ZIP_SOURCE_READ:
@@ -526,7 +1307,17 @@ source_nul_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t comman
             length = ctx->length - ctx->offset;
         }
 
-        memset(data, 0, length);
+        if (ctx->random) {
+            zip_uint64_t i;
+
+            for (i = 0; i < length; i++) {
+                ctx->state = ctx->state * 1103515245 + 12345;
+                ((zip_uint8_t *)data)[i] = ctx->text ? (zip_uint8_t)('a' + (ctx->state >> 24) % 16) : (zip_uint8_t)(ctx->state >> 24);
+            }
+        }
+        else {
+            memset(data, 0, length);
+        }
         ctx->offset += length;
         return (zip_int64_t)length;
 
@@ -544,6 +1335,10 @@ source_nul_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t comman
     }
 
     case ZIP_SOURCE_SUPPORTS:
+        if (ctx->random) {
+            /* data starts over when opened again */
+            return zip_source_make_command_bitmap(ZIP_SOURCE_CLOSE, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_STAT, ZIP_SOURCE_SUPPORTS_REOPEN, -1);
+        }
         return zip_source_make_command_bitmap(ZIP_SOURCE_CLOSE, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_STAT, -1);
 
     default:
@@ -553,7 +1348,7 @@ source_nul_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t comman
 }
 
 static zip_source_t *
-source_nul(zip_t *zs, zip_uint64_t length) {
+source_nul(zip_t *zs, zip_uint64_t length, bool pseudo_random, bool text) {
     source_nul_t *ctx;
     zip_source_t *src;
 
@@ -565,6 +1360,9 @@ source_nul(zip_t *zs, zip_uint64_t length) {
     zip_error_init(&ctx->error);
     ctx->length = length;
     ctx->offset = 0;
+    ctx->random = pseudo_random;
+    ctx->text = text;
+    ctx->state = 1;
 
     if ((src = zip_source_function(zs, source_nul_cb, ctx)) == NULL) {
         free(ctx);
@@ -575,51 +1373,141 @@ source_nul(zip_t *zs, zip_uint64_t length) {
 }
 
 
-static int
-write_memory_src_to_file(const char *archive, zip_source_t *src) {
-    zip_stat_t zst;
-    char *buf;
+/* write-only source that can't seek or tell, like a pipe */
+typedef struct source_stream {
+    zip_error_t error;
+    char *fname;
     FILE *fp;
+} source_stream_t;
 
-    if (zip_source_stat(src, &zst) < 0) {
-        fprintf(stderr, "zip_source_stat on buffer failed: %s\n", zip_error_strerror(zip_source_error(src)));
-        return -1;
+static zip_int64_t
+source_stream_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t command) {
+    source_stream_t *ctx = (source_stream_t *)ud;
+
+    switch (command) {
+    case ZIP_SOURCE_BEGIN_WRITE:
+        if ((ctx->fp = fopen(ctx->fname, "wb")) == NULL) {
+            zip_error_set(&ctx->error, ZIP_ER_OPEN, errno);
+            return -1;
+        }
+        return 0;
+
+    case ZIP_SOURCE_COMMIT_WRITE: {
+        int ret = fclose(ctx->fp);
+        ctx->fp = NULL;
+        if (ret != 0) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return -1;
+        }
+        return 0;
     }
-    if (zip_source_open(src) < 0) {
-        if (zip_error_code_zip(zip_source_error(src)) == ZIP_ER_DELETED) {
-            if (unlink(archive) < 0 && errno != ENOENT) {
-                fprintf(stderr, "unlink failed: %s\n", strerror(errno));
-                return -1;
-            }
-            return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        if (ctx->fp != NULL) {
+            fclose(ctx->fp);
+        }
+        free(ctx->fname);
+        free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_ROLLBACK_WRITE:
+        if (ctx->fp != NULL) {
+            fclose(ctx->fp);
+            ctx->fp = NULL;
+        }
+        (void)remove(ctx->fname);
+        return 0;
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_SUPPORTS, ZIP_SOURCE_WRITE, -1);
+
+    case ZIP_SOURCE_WRITE:
+        if (length > 0 && fwrite(data, (size_t)length, 1, ctx->fp) != 1) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return -1;
         }
-        fprintf(stderr, "zip_source_open on buffer failed: %s\n", zip_error_strerror(zip_source_error(src)));
+        return (zip_int64_t)length;
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
         return -1;
     }
-    if ((buf = malloc(zst.size)) == NULL) {
-        fprintf(stderr, "malloc failed: %s\n", strerror(errno));
-        zip_source_close(src);
-        return -1;
+}
+
+
+static zip_t *
+write_stream(const char *archive, int flags, zip_error_t *error) {
+    source_stream_t *ctx;
+    zip_source_t *src;
+    zip_t *zs;
+
+    if ((ctx = (source_stream_t *)malloc(sizeof(*ctx))) == NULL || (ctx->fname = strdup(archive)) == NULL) {
+        free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    zip_error_init(&ctx->error);
+    ctx->fp = NULL;
+
+    if ((src = zip_source_function_create(source_stream_cb, ctx, error)) == NULL) {
+        free(ctx->fname);
+        free(ctx);
+        return NULL;
+    }
+
+    if ((zs = zip_open_from_source(src, flags, error)) == NULL) {
+        zip_source_free(src);
+    }
+
+    return zs;
+}
+
+
+static void
+free_fragments(zip_buffer_fragment_t *fragments, zip_uint64_t nfragments) {
+    zip_uint64_t i;
+
+    for (i = 0; i < nfragments; i++) {
+        free(fragments[i].data);
+    }
+    free(fragments);
+}
+
+
+static int
+write_memory_src_to_file(const char *archive, zip_source_t *src) {
+    zip_buffer_fragment_t *fragments;
+    zip_uint64_t i, nfragments;
+    FILE *fp;
+
+    if (zip_source_is_deleted(src)) {
+        if (unlink(archive) < 0 && errno != ENOENT) {
+            fprintf(stderr, "unlink failed: %s\n", strerror(errno));
+            return -1;
+        }
+        return 0;
     }
-    if (zip_source_read(src, buf, zst.size) < (zip_int64_t)zst.size) {
-        fprintf(stderr, "zip_source_read on buffer failed: %s\n", zip_error_strerror(zip_source_error(src)));
-        zip_source_close(src);
-        free(buf);
+    if (zip_source_buffer_detach(src, &fragments, &nfragments) < 0) {
+        fprintf(stderr, "zip_source_buffer_detach failed: %s\n", zip_error_strerror(zip_source_error(src)));
         return -1;
     }
-    zip_source_close(src);
     if ((fp = fopen(archive, "wb")) == NULL) {
         fprintf(stderr, "fopen failed: %s\n", strerror(errno));
-        free(buf);
+        free_fragments(fragments, nfragments);
         return -1;
     }
-    if (fwrite(buf, zst.size, 1, fp) < 1) {
-        fprintf(stderr, "fwrite failed: %s\n", strerror(errno));
-        free(buf);
-        fclose(fp);
-        return -1;
+    for (i = 0; i < nfragments; i++) {
+        if (fwrite(fragments[i].data, fragments[i].length, 1, fp) < 1) {
+            fprintf(stderr, "fwrite failed: %s\n", strerror(errno));
+            free_fragments(fragments, nfragments);
+            fclose(fp);
+            return -1;
+        }
     }
-    free(buf);
+    free_fragments(fragments, nfragments);
     if (fclose(fp) != 0) {
         fprintf(stderr, "fclose failed: %s\n", strerror(errno));
         return -1;
@@ -642,6 +1530,34 @@ ziptool_open(const char *archive, int flags, zip_error_t *error, zip_uint64_t of
     case SOURCE_TYPE_HOLE:
         za = read_hole(archive, flags, error);
         break;
+
+    case SOURCE_TYPE_MMAP:
+        za = read_mmap(archive, flags, error, offset, len);
+        break;
+
+    case SOURCE_TYPE_STREAM:
+        za = write_stream(archive, flags, error);
+        break;
+
+    case SOURCE_TYPE_ASYNC:
+        za = read_async(archive, flags, error, offset, len);
+        break;
+
+    case SOURCE_TYPE_CACHE:
+        za = read_cached(archive, flags, error, offset, len);
+        break;
+
+    case SOURCE_TYPE_DIRECT:
+        za = read_direct(archive, flags, error, offset, len);
+        break;
+
+    case SOURCE_TYPE_NONBLOCKING:
+        za = read_nonblocking(archive, flags, error, offset, len);
+        break;
+
+    case SOURCE_TYPE_MAPPED:
+        za = read_mapped(archive, flags, error, offset, len);
+        break;
     }
 
     return za;
@@ -45,7 +45,12 @@
 #ifdef HAVE_FTS_H
 #include <fts.h>
 #endif
-#include <zlib.h>
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #ifndef HAVE_GETOPT
 #include "getopt.h"
@@ -76,8 +81,11 @@ struct ef {
 
 struct entry {
     char *name;
+    zip_uint64_t index;
     zip_uint64_t size;
     zip_uint32_t crc;
+    int data_differs;
+    zip_uint64_t data_offset;
     zip_uint32_t comp_method;
     struct ef *extra_fields;
     zip_uint16_t n_extra_fields;
@@ -118,6 +126,7 @@ const enum_map_t comp_methods[] = {
     { 97, "WavPack compressed data" },
     { 98, "PPMd version I, Rev 1" },
     { 99, "WinZIP AES Encryption" },
+    { 0x4c34, "LZ4 compressed data (libzip specific)" },
     { UINT32_MAX, NULL }
 };
 
@@ -184,14 +193,16 @@ const char *progname;
 
 #define PROGRAM "zipcmp"
 
-#define USAGE "usage: %s [-hipqtVv] archive1 archive2\n"
+#define USAGE "usage: %s [-chipqtVv] [-j threads] archive1 archive2\n"
 
 char help_head[] = PROGRAM " (" PACKAGE ") by Dieter Baron and Thomas Klausner\n\n";
 
 char help[] = "\n\
   -h       display this help message\n\
   -C       check archive consistencies\n\
+  -c       compare file contents\n\
   -i       compare names ignoring case distinctions\n\
+  -j n     use n threads for reading files\n\
   -p       compare as many details as possible\n\
   -q       be quiet\n\
   -s       print a summary\n\
@@ -205,12 +216,46 @@ char version_string[] = PROGRAM " (" PACKAGE " " VERSION ")\n\
 Copyright (C) 2003-2022 Dieter Baron and Thomas Klausner\n\
 " PACKAGE " comes with ABSOLUTELY NO WARRANTY, to the extent permitted by law.\n";
 
-#define OPTIONS "hVCipqstv"
+#define OPTIONS "hVCcij:pqstv"
 
 
 #define BOTH_ARE_ZIPS(a) (a[0].za && a[1].za)
 
+/* size of buffers used for reading files, per side and thread */
+#define CONTENT_BUFFER_SIZE (1024 * 1024)
+
+typedef struct {
+    const struct archive *archive[2];
+    struct entry *entry[2];
+} content_job_t;
+
+typedef struct {
+    char *path;
+    zip_uint64_t index;
+    struct entry *entry;
+} crc_job_t;
+
+typedef struct {
+    zip_uint8_t *jobs;
+    size_t job_size;
+    zip_uint64_t njobs;
+    zip_uint64_t next;
+    int (*run)(void *job, zip_uint8_t *buffer[2]);
+    int error;
+#ifdef HAVE_THREADS
+    int threaded;
+    pthread_mutex_t mutex;
+#endif
+} job_queue_t;
+
 static int comment_compare(const char *c1, size_t l1, const char *c2, size_t l2);
+static int compare_contents(struct archive a[2]);
+static int compare_entry_contents(void *ud, zip_uint8_t *buffer[2]);
+#ifdef HAVE_FTS_H
+static int compute_crc(void *ud, zip_uint8_t *buffer[2]);
+#endif
+static int run_jobs(void *jobs, size_t job_size, zip_uint64_t njobs, int (*run)(void *job, zip_uint8_t *buffer[2]));
+static void *run_jobs_worker(void *ud);
 static int compare_list(char *const name[2], const void *list[2], const zip_uint64_t list_length[2], int element_size, int (*cmp)(const void *a, const void *b), int (*ignore)(const void *list, int last, const void *other), int (*check)(char *const name[2], const void *a, const void *b), void (*print)(char side, const void *element), void (*start_file)(const void *element));
 static int compare_zip(char *const zn[]);
 static int ef_compare(char *const name[2], const struct entry *e1, const struct entry *e2);
@@ -219,6 +264,7 @@ static void ef_print(char side, const void *p);
 static int ef_read(zip_t *za, zip_uint64_t idx, struct entry *e);
 static int entry_cmp(const void *p1, const void *p2);
 static int entry_ignore(const void *p1, int last, const void *o);
+static int entry_checks(char *const name[2], const void *p1, const void *p2);
 static int entry_paranoia_checks(char *const name[2], const void *p1, const void *p2);
 static void entry_print(char side, const void *p);
 static void entry_start_file(const void *p);
@@ -229,9 +275,10 @@ static int is_directory(const char *name);
 static int list_directory(const char *name, struct archive *a);
 #endif
 static int list_zip(const char *name, struct archive *a);
-static int test_file(zip_t *za, zip_uint64_t idx, const char *zipname, const char *filename, zip_uint64_t size, zip_uint32_t crc);
+static int test_entry(zip_t *za, zip_uint64_t idx, zip_error_t *error, void *ud);
 
-int ignore_case, test_files, paranoid, verbose, have_directory, check_consistency, summary;
+int ignore_case, test_files, paranoid, verbose, have_directory, check_consistency, summary, compare_data;
+unsigned int num_threads;
 int plus_count = 0, minus_count = 0;
 
 diff_output_t output;
@@ -250,15 +297,35 @@ main(int argc, char *const argv[]) {
     have_directory = 0;
     verbose = 1;
     summary = 0;
+    compare_data = 0;
+    num_threads = 1;
+#if defined(HAVE_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n > 1) {
+            num_threads = n > 16 ? 16 : (unsigned int)n;
+        }
+    }
+#endif
 
     while ((c = getopt(argc, argv, OPTIONS)) != -1) {
         switch (c) {
             case 'C':
                 check_consistency = 1;
                 break;
+            case 'c':
+                compare_data = 1;
+                break;
             case 'i':
                 ignore_case = 1;
                 break;
+            case 'j':
+                num_threads = (unsigned int)strtoul(optarg, NULL, 10);
+                if (num_threads == 0) {
+                    fprintf(stderr, "%s: invalid number of threads '%s'\n", progname, optarg);
+                    exit(2);
+                }
+                break;
             case 'p':
                 paranoid = 1;
                 break;
@@ -336,11 +403,15 @@ compare_zip(char *const zn[]) {
 
     diff_output_init(&output, verbose, zn);
 
+    if (compare_data && compare_contents(a) < 0) {
+        exit(2);
+    }
+
     e[0] = a[0].entry;
     e[1] = a[1].entry;
     n[0] = a[0].nentry;
     n[1] = a[1].nentry;
-    res = compare_list(zn, (const void **)e, n, sizeof(e[i][0]), entry_cmp, have_directory ? entry_ignore : NULL, paranoid ? entry_paranoia_checks : NULL, entry_print, entry_start_file);
+    res = compare_list(zn, (const void **)e, n, sizeof(e[i][0]), entry_cmp, have_directory ? entry_ignore : NULL, (paranoid || compare_data) ? entry_checks : NULL, entry_print, entry_start_file);
 
     if (paranoid) {
         if (comment_compare(a[0].comment, a[0].comment_length, a[1].comment, a[1].comment_length) != 0) {
@@ -385,32 +456,33 @@ compare_zip(char *const zn[]) {
 }
 
 #ifdef HAVE_FTS_H
-static zip_int64_t
-compute_crc(const char *fname) {
+/* Compute CRC of file in job, for running from run_jobs(). */
+static int
+compute_crc(void *ud, zip_uint8_t *buffer[2]) {
+    crc_job_t *job = (crc_job_t *)ud;
+    zip_uint32_t crc = 0;
     FILE *f;
-    uLong crc = crc32(0L, Z_NULL, 0);
     size_t n;
-    Bytef buffer[8192];
-
 
-    if ((f = fopen(fname, "rb")) == NULL) {
-        fprintf(stderr, "%s: can't open %s: %s\n", progname, fname, strerror(errno));
+    if ((f = fopen(job->path, "rb")) == NULL) {
+        fprintf(stderr, "%s: can't open %s: %s\n", progname, job->path, strerror(errno));
         return -1;
     }
 
-    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
-        crc = crc32(crc, buffer, (unsigned int)n);
+    while ((n = fread(buffer[0], 1, CONTENT_BUFFER_SIZE, f)) > 0) {
+        crc = zip_crc32(crc, buffer[0], n);
     }
 
     if (ferror(f)) {
-        fprintf(stderr, "%s: read error on %s: %s\n", progname, fname, strerror(errno));
+        fprintf(stderr, "%s: read error on %s: %s\n", progname, job->path, strerror(errno));
         fclose(f);
         return -1;
     }
 
     fclose(f);
 
-    return (zip_int64_t)crc;
+    job->entry->crc = crc;
+    return 0;
 }
 #endif
 
@@ -431,8 +503,10 @@ static int
 list_directory(const char *name, struct archive *a) {
     FTS *fts;
     FTSENT *ent;
-    zip_uint64_t nalloc;
+    zip_uint64_t nalloc, njobs, njobs_alloc, i;
+    crc_job_t *jobs;
     size_t prefix_length;
+    int ret;
 
     char *const names[2] = {(char *)name, NULL};
 
@@ -444,10 +518,11 @@ list_directory(const char *name, struct archive *a) {
     prefix_length = strlen(name) + 1;
 
     nalloc = 0;
+    jobs = NULL;
+    njobs = njobs_alloc = 0;
 
+    /* only list files while walking the tree, their CRCs are computed in parallel afterwards */
     while ((ent = fts_read(fts))) {
-        zip_int64_t crc;
-
         switch (ent->fts_info) {
             case FTS_DOT:
             case FTS_DP:
@@ -463,12 +538,16 @@ list_directory(const char *name, struct archive *a) {
             case FTS_SLNONE:
                 /* TODO: error */
                 fts_close(fts);
+                for (i = 0; i < njobs; i++) {
+                    free(jobs[i].path);
+                }
+                free(jobs);
                 return -1;
 
             case FTS_D:
             case FTS_F:
                 if (a->nentry >= nalloc) {
-                    nalloc += 16;
+                    nalloc = nalloc > 0 ? nalloc * 2 : 16;
                     if (nalloc > SIZE_MAX / sizeof(a->entry[0])) {
                         fprintf(stderr, "%s: malloc failure\n", progname);
                         exit(1);
@@ -497,28 +576,53 @@ list_directory(const char *name, struct archive *a) {
                     a->entry[a->nentry].name = dir_name;
                     a->entry[a->nentry].size = 0;
                     a->entry[a->nentry].crc = 0;
+                    a->entry[a->nentry].data_differs = 0;
                 }
                 else {
+                    if (njobs >= njobs_alloc) {
+                        njobs_alloc = njobs_alloc > 0 ? njobs_alloc * 2 : 16;
+                        if (njobs_alloc > SIZE_MAX / sizeof(jobs[0]) || (jobs = (crc_job_t *)realloc(jobs, sizeof(jobs[0]) * njobs_alloc)) == NULL) {
+                            fprintf(stderr, "%s: malloc failure\n", progname);
+                            exit(1);
+                        }
+                    }
+                    if ((jobs[njobs].path = strdup(ent->fts_accpath)) == NULL) {
+                        fprintf(stderr, "%s: malloc failure\n", progname);
+                        exit(1);
+                    }
+                    jobs[njobs].index = a->nentry;
+                    njobs++;
+
                     a->entry[a->nentry].name = strdup(ent->fts_path + prefix_length);
                     a->entry[a->nentry].size = (zip_uint64_t)ent->fts_statp->st_size;
-                    if ((crc = compute_crc(ent->fts_accpath)) < 0) {
-                        fts_close(fts);
-                        return -1;
-                    }
-                
-                    a->entry[a->nentry].crc = (zip_uint32_t)crc;
+                    a->entry[a->nentry].crc = 0;
+                    a->entry[a->nentry].data_differs = 0;
                 }
                 a->nentry++;
                 break;
         }
     }
 
+    ret = 0;
     if (fts_close(fts)) {
         fprintf(stderr, "%s: error closing directory '%s': %s\n", progname, a->name, strerror(errno));
-        return -1;
+        ret = -1;
     }
 
-    return 0;
+    if (ret == 0) {
+        /* entries have been moved by realloc while walking the tree */
+        for (i = 0; i < njobs; i++) {
+            jobs[i].entry = a->entry + jobs[i].index;
+        }
+        ret = run_jobs(jobs, sizeof(jobs[0]), njobs, compute_crc);
+    }
+
+    for (i = 0; i < njobs; i++) {
+        free(jobs[i].path);
+    }
+    free(jobs);
+
+    return ret;
 }
 #endif
 
@@ -529,8 +633,18 @@ list_zip(const char *name, struct archive *a) {
     int err;
     struct zip_stat st;
     unsigned int i;
+    int flags = check_consistency ? ZIP_CHECKCONS : 0;
 
-    if ((za = zip_open(name, check_consistency ? ZIP_CHECKCONS : 0, &err)) == NULL) {
+    /* read file contents from several threads at once */
+    if (compare_data && num_threads > 1) {
+        if ((za = zip_open(name, flags | ZIP_RDONLY | ZIP_THREADSAFE, &err)) == NULL && err == ZIP_ER_OPNOTSUPP) {
+            num_threads = 1;
+        }
+    }
+    else {
+        za = NULL;
+    }
+    if (za == NULL && (za = zip_open(name, flags, &err)) == NULL) {
         zip_error_t error;
         zip_error_init_with_code(&error, err);
         fprintf(stderr, "%s: cannot open zip archive '%s': %s\n", progname, name, zip_error_strerror(&error));
@@ -552,10 +666,10 @@ list_zip(const char *name, struct archive *a) {
         for (i = 0; i < a->nentry; i++) {
             zip_stat_index(za, i, 0, &st);
             a->entry[i].name = strdup(st.name);
+            a->entry[i].index = i;
             a->entry[i].size = st.size;
             a->entry[i].crc = st.crc;
-            if (test_files)
-                test_file(za, i, name, st.name, st.size, st.crc);
+            a->entry[i].data_differs = 0;
             if (paranoid) {
                 a->entry[i].comp_method = st.comp_method;
                 ef_read(za, i, a->entry + i);
@@ -567,6 +681,11 @@ list_zip(const char *name, struct archive *a) {
             }
         }
 
+        /* checks headers and CRCs of all files, using threads if available */
+        if (test_files) {
+            (void)zip_verify(za, test_entry, (void *)name);
+        }
+
         if (paranoid) {
             int length;
             a->comment = zip_get_archive_comment(za, &length, 0);
@@ -597,6 +716,240 @@ comment_compare(const char *c1, size_t l1, const char *c2, size_t l2) {
 }
 
 
+/* Compare contents of files with the same name, size, and CRC, which are otherwise assumed to be equal.  Differences are recorded in the entries of the first archive. */
+static int
+compare_contents(struct archive a[2]) {
+    content_job_t *jobs;
+    zip_uint64_t i[2], njobs, nalloc;
+    int ret;
+
+    jobs = NULL;
+    njobs = 0;
+    nalloc = 0;
+
+    i[0] = i[1] = 0;
+    while (i[0] < a[0].nentry && i[1] < a[1].nentry) {
+        int c = entry_cmp(a[0].entry + i[0], a[1].entry + i[1]);
+
+        if (c == 0) {
+            const char *name = a[0].entry[i[0]].name;
+            size_t length = strlen(name);
+
+            /* files whose size or CRC differ are different without reading them */
+            if (a[0].entry[i[0]].size > 0 && (length == 0 || name[length - 1] != '/')) {
+                if (njobs >= nalloc) {
+                    nalloc = nalloc > 0 ? nalloc * 2 : 64;
+                    if (nalloc > SIZE_MAX / sizeof(jobs[0]) || (jobs = (content_job_t *)realloc(jobs, sizeof(jobs[0]) * nalloc)) == NULL) {
+                        fprintf(stderr, "%s: malloc failure\n", progname);
+                        exit(1);
+                    }
+                }
+                jobs[njobs].archive[0] = a + 0;
+                jobs[njobs].archive[1] = a + 1;
+                jobs[njobs].entry[0] = a[0].entry + i[0];
+                jobs[njobs].entry[1] = a[1].entry + i[1];
+                njobs++;
+            }
+            i[0]++;
+            i[1]++;
+        }
+        else if (c < 0) {
+            i[0]++;
+        }
+        else {
+            i[1]++;
+        }
+    }
+
+    ret = run_jobs(jobs, sizeof(jobs[0]), njobs, compare_entry_contents);
+
+    free(jobs);
+    return ret;
+}
+
+
+/* Compare data of one pair of files, returns 0 if equal, 1 if different, -1 on error. */
+static int
+compare_entry_contents(void *ud, zip_uint8_t *buffer[2]) {
+    content_job_t *job = (content_job_t *)ud;
+    zip_file_t *zf[2] = {NULL, NULL};
+    FILE *f[2] = {NULL, NULL};
+    zip_uint64_t offset = 0;
+    int j, ret = -1;
+
+    for (j = 0; j < 2; j++) {
+        if (job->archive[j]->za != NULL) {
+            if ((zf[j] = zip_fopen_index(job->archive[j]->za, job->entry[j]->index, 0)) == NULL) {
+                fprintf(stderr, "%s: %s: can't open file %s: %s\n", progname, job->archive[j]->name, job->entry[j]->name, zip_strerror(job->archive[j]->za));
+                goto end;
+            }
+        }
+        else {
+            char *path;
+            size_t length = strlen(job->archive[j]->name) + strlen(job->entry[j]->name) + 2;
+
+            if ((path = (char *)malloc(length)) == NULL) {
+                fprintf(stderr, "%s: malloc failure\n", progname);
+                exit(1);
+            }
+            snprintf(path, length, "%s/%s", job->archive[j]->name, job->entry[j]->name);
+            f[j] = fopen(path, "rb");
+            if (f[j] == NULL) {
+                fprintf(stderr, "%s: can't open %s: %s\n", progname, path, strerror(errno));
+            }
+            free(path);
+            if (f[j] == NULL) {
+                goto end;
+            }
+        }
+    }
+
+    for (;;) {
+        zip_int64_t n[2];
+        zip_int64_t i;
+
+        for (j = 0; j < 2; j++) {
+            if (zf[j] != NULL) {
+                if ((n[j] = zip_fread(zf[j], buffer[j], CONTENT_BUFFER_SIZE)) < 0) {
+                    fprintf(stderr, "%s: %s: can't read file %s: %s\n", progname, job->archive[j]->name, job->entry[j]->name, zip_file_strerror(zf[j]));
+                    goto end;
+                }
+            }
+            else {
+                n[j] = (zip_int64_t)fread(buffer[j], 1, CONTENT_BUFFER_SIZE, f[j]);
+                if (ferror(f[j])) {
+                    fprintf(stderr, "%s: read error on %s/%s: %s\n", progname, job->archive[j]->name, job->entry[j]->name, strerror(errno));
+                    goto end;
+                }
+            }
+        }
+
+        if (n[0] == 0 && n[1] == 0) {
+            ret = 0;
+            break;
+        }
+        if (n[0] != n[1] || memcmp(buffer[0], buffer[1], (size_t)n[0]) != 0) {
+            for (i = 0; i < n[0] && i < n[1] && buffer[0][i] == buffer[1][i]; i++) {
+            }
+            job->entry[0]->data_differs = 1;
+            job->entry[0]->data_offset = offset + (zip_uint64_t)i;
+            ret = 1;
+            break;
+        }
+        offset += (zip_uint64_t)n[0];
+    }
+
+end:
+    for (j = 0; j < 2; j++) {
+        if (zf[j] != NULL) {
+            zip_fclose(zf[j]);
+        }
+        if (f[j] != NULL) {
+            fclose(f[j]);
+        }
+    }
+    return ret;
+}
+
+
+/* Run run on all njobs jobs of job_size bytes each, using up to num_threads threads; returns -1 if any of them failed. */
+static int
+run_jobs(void *jobs, size_t job_size, zip_uint64_t njobs, int (*run)(void *job, zip_uint8_t *buffer[2])) {
+    job_queue_t queue;
+    unsigned int threads;
+
+    queue.jobs = (zip_uint8_t *)jobs;
+    queue.job_size = job_size;
+    queue.njobs = njobs;
+    queue.next = 0;
+    queue.run = run;
+    queue.error = 0;
+
+    threads = num_threads;
+    if (threads > njobs) {
+        threads = njobs > 0 ? (unsigned int)njobs : 1;
+    }
+
+#ifdef HAVE_THREADS
+    queue.threaded = 0;
+    if (threads > 1) {
+        pthread_t *thread;
+        unsigned int t, started;
+
+        if ((thread = (pthread_t *)malloc(sizeof(thread[0]) * threads)) == NULL) {
+            fprintf(stderr, "%s: malloc failure\n", progname);
+            exit(1);
+        }
+        pthread_mutex_init(&queue.mutex, NULL);
+        queue.threaded = 1;
+        for (started = 0; started < threads; started++) {
+            if (pthread_create(thread + started, NULL, run_jobs_worker, &queue) != 0) {
+                break;
+            }
+        }
+        if (started == 0) {
+            /* no threads available, run jobs in this one */
+            (void)run_jobs_worker(&queue);
+        }
+        for (t = 0; t < started; t++) {
+            pthread_join(thread[t], NULL);
+        }
+        pthread_mutex_destroy(&queue.mutex);
+        free(thread);
+    }
+    else
+#endif
+    {
+        (void)run_jobs_worker(&queue);
+    }
+
+    return queue.error ? -1 : 0;
+}
+
+
+/* Run jobs from queue until it is empty or a job failed. */
+static void *
+run_jobs_worker(void *ud) {
+    job_queue_t *queue = (job_queue_t *)ud;
+    void *job;
+    zip_uint8_t *buffer[2];
+
+    buffer[0] = (zip_uint8_t *)malloc(CONTENT_BUFFER_SIZE);
+    buffer[1] = (zip_uint8_t *)malloc(CONTENT_BUFFER_SIZE);
+    if (buffer[0] == NULL || buffer[1] == NULL) {
+        fprintf(stderr, "%s: malloc failure\n", progname);
+        exit(1);
+    }
+
+    job = NULL;
+    for (;;) {
+        int error = job != NULL && queue->run(job, buffer) < 0;
+
+#ifdef HAVE_THREADS
+        if (queue->threaded) {
+            pthread_mutex_lock(&queue->mutex);
+        }
+#endif
+        if (error) {
+            queue->error = 1;
+        }
+        job = queue->next < queue->njobs && !queue->error ? queue->jobs + queue->job_size * queue->next++ : NULL;
+#ifdef HAVE_THREADS
+        if (queue->threaded) {
+            pthread_mutex_unlock(&queue->mutex);
+        }
+#endif
+        if (job == NULL) {
+            break;
+        }
+    }
+
+    free(buffer[0]);
+    free(buffer[1]);
+    return NULL;
+}
+
+
 static int compare_list(char *const name[2], const void *list[2], const zip_uint64_t list_length[2], int element_size, int (*cmp)(const void *a, const void *b), int (*ignore)(const void *list, int last, const void *other), int (*check)(char *const name[2], const void *a, const void *b), void (*print)(char side, const void *element), void (*start_file)(const void *element)) {
     unsigned int i[2];
     int j;
@@ -776,6 +1129,24 @@ entry_ignore(const void *p, int last, const void *o) {
 }
 
 
+static int
+entry_checks(char *const name[2], const void *p1, const void *p2) {
+    const struct entry *e1 = (const struct entry *)p1;
+    int ret = 0;
+
+    if (e1->data_differs) {
+        diff_output(&output, '!', "  data differs at offset %" PRIu64, e1->data_offset);
+        ret = 1;
+    }
+
+    if (paranoid && entry_paranoia_checks(name, p1, p2) != 0) {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+
 static int
 entry_paranoia_checks(char *const name[2], const void *p1, const void *p2) {
     const struct entry *e1, *e2;
@@ -821,43 +1192,12 @@ static void entry_start_file(const void *p) {
 
 
 static int
-test_file(zip_t *za, zip_uint64_t idx, const char *zipname, const char *filename, zip_uint64_t size, zip_uint32_t crc) {
-    zip_file_t *zf;
-    char buf[8192];
-    zip_uint64_t nsize;
-    zip_int64_t n;
-    zip_uint32_t ncrc;
-
-    if ((zf = zip_fopen_index(za, idx, 0)) == NULL) {
-        fprintf(stderr, "%s: %s: cannot open file %s (index %" PRIu64 "): %s\n", progname, zipname, filename, idx, zip_strerror(za));
-        return -1;
-    }
-
-    ncrc = (zip_uint32_t)crc32(0, NULL, 0);
-    nsize = 0;
-
-    while ((n = zip_fread(zf, buf, sizeof(buf))) > 0) {
-        nsize += (zip_uint64_t)n;
-        ncrc = (zip_uint32_t)crc32(ncrc, (const Bytef *)buf, (unsigned int)n);
-    }
-
-    if (n < 0) {
-        fprintf(stderr, "%s: %s: error reading file %s (index %" PRIu64 "): %s\n", progname, zipname, filename, idx, zip_file_strerror(zf));
-        zip_fclose(zf);
-        return -1;
-    }
-
-    zip_fclose(zf);
+test_entry(zip_t *za, zip_uint64_t idx, zip_error_t *error, void *ud) {
+    if (zip_error_code_zip(error) != ZIP_ER_OK) {
+        const char *filename = zip_get_name(za, idx, 0);
 
-    if (nsize != size) {
-        fprintf(stderr, "%s: %s: file %s (index %" PRIu64 "): unexpected length %" PRId64 " (should be %" PRId64 ")\n", progname, zipname, filename, idx, nsize, size);
-        return -2;
+        fprintf(stderr, "%s: %s: file %s (index %" PRIu64 "): %s\n", progname, (const char *)ud, filename ? filename : "(unknown)", idx, zip_error_strerror(error));
     }
-    if (ncrc != crc) {
-        fprintf(stderr, "%s: %s: file %s (index %" PRIu64 "): unexpected length %x (should be %x)\n", progname, zipname, filename, idx, ncrc, crc);
-        return -2;
-    }
-
     return 0;
 }
 
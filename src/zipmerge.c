@@ -40,6 +40,13 @@
 
 #include "config.h"
 
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #ifndef HAVE_GETOPT
 #include "getopt.h"
 #endif
@@ -50,7 +57,7 @@ char *progname;
 
 #define PROGRAM "zipmerge"
 
-#define USAGE "usage: %s [-DhIikSsV] target-zip zip...\n"
+#define USAGE "usage: %s [-DhIikSsV] [-j threads] target-zip zip...\n"
 
 char help_head[] = PROGRAM " (" PACKAGE ") by Dieter Baron and Thomas Klausner\n\n";
 
@@ -60,6 +67,7 @@ char help[] = "\n\
   -D       ignore directory component in file names\n\
   -I       ignore case in file names\n\
   -i       ask before overwriting files\n\
+  -j n     use n threads for reading archives\n\
   -k       don't compress when adding uncompressed files\n\
   -S       don't overwrite identical files\n\
   -s       overwrite identical files without asking\n\
@@ -70,29 +78,52 @@ char version_string[] = PROGRAM " (" PACKAGE " " VERSION ")\n\
 Copyright (C) 2004-2022 Dieter Baron and Thomas Klausner\n\
 " PACKAGE " comes with ABSOLUTELY NO WARRANTY, to the extent permitted by law.\n";
 
-#define OPTIONS "hVDiIksS"
+#define OPTIONS "hVDiIj:ksS"
 
 #define CONFIRM_ALL_YES 0x001
 #define CONFIRM_ALL_NO 0x002
 #define CONFIRM_SAME_YES 0x010
 #define CONFIRM_SAME_NO 0x020
 
+typedef struct {
+    const char *name;
+    zip_t *za;
+    int error;
+} input_t;
+
+/* inputs opened by several threads, each taking the next one */
+typedef struct {
+    input_t *inputs;
+    unsigned int ninputs;
+    unsigned int next;
+#ifdef HAVE_THREADS
+    int threaded;
+    pthread_mutex_t mutex;
+#endif
+} input_queue_t;
+
 int confirm;
 zip_flags_t name_flags;
 int keep_stored;
+unsigned int num_threads;
 
 static int confirm_replace(zip_t *, const char *, zip_uint64_t, zip_t *, const char *, zip_uint64_t);
 static void copy_extra_fields(zip_t *destination_archive, zip_uint64_t destination_index, zip_t *source_archive, zip_uint64_t source_index, zip_flags_t flags);
 static int copy_file(zip_t *destination_archive, zip_int64_t destination_index, zip_t *source_archive, zip_uint64_t source_index, const char* name);
-static zip_t *merge_zip(zip_t *, const char *, const char *);
+static int merge_zip(zip_t *, const char *, zip_t *, const char *);
+static void open_input(input_t *input);
+static void open_inputs(input_t *inputs, unsigned int ninputs);
+static void *open_inputs_worker(void *ud);
 
 
 int
 main(int argc, char *argv[]) {
     zip_t *za;
-    zip_t **zs;
+    input_t *inputs;
     int c, err;
     unsigned int i, n;
+    zip_int64_t nentries;
+    zip_uint64_t total;
     char *tname;
 
     progname = argv[0];
@@ -100,6 +131,15 @@ main(int argc, char *argv[]) {
     confirm = CONFIRM_ALL_YES;
     name_flags = 0;
     keep_stored = 0;
+    num_threads = 1;
+#if defined(HAVE_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    {
+        long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nproc > 1) {
+            num_threads = nproc > 16 ? 16 : (unsigned int)nproc;
+        }
+    }
+#endif
 
     while ((c = getopt(argc, argv, OPTIONS)) != -1) {
         switch (c) {
@@ -112,6 +152,13 @@ main(int argc, char *argv[]) {
         case 'i':
             confirm &= ~CONFIRM_ALL_YES;
             break;
+        case 'j':
+            num_threads = (unsigned int)strtoul(optarg, NULL, 10);
+            if (num_threads == 0) {
+                fprintf(stderr, "%s: invalid number of threads '%s'\n", progname, optarg);
+                exit(2);
+            }
+            break;
         case 'k':
             keep_stored = 1;
             break;
@@ -148,7 +195,7 @@ main(int argc, char *argv[]) {
     argv += optind;
 
     n = (unsigned int)(argc - optind);
-    if ((zs = (zip_t **)malloc(sizeof(zs[0]) * n)) == NULL) {
+    if ((inputs = (input_t *)malloc(sizeof(inputs[0]) * n)) == NULL) {
         fprintf(stderr, "%s: out of memory\n", progname);
         exit(1);
     }
@@ -161,8 +208,38 @@ main(int argc, char *argv[]) {
         exit(1);
     }
 
+    /* open all archives first, several at the same time, so space for all entries can be allocated at once */
+    for (i = 0; i < n; i++) {
+        inputs[i].name = argv[i];
+    }
+    open_inputs(inputs, n);
+    total = 0;
+    for (i = 0; i < n; i++) {
+        if (inputs[i].za == NULL) {
+            zip_error_t error;
+            zip_error_init_with_code(&error, inputs[i].error);
+            fprintf(stderr, "%s: can't open zip archive '%s': %s\n", progname, argv[i], zip_error_strerror(&error));
+            zip_error_fini(&error);
+            exit(1);
+        }
+        if ((nentries = zip_get_num_entries(inputs[i].za, 0)) < 0) {
+            fprintf(stderr, "%s: cannot get number of entries for '%s': %s\n", progname, argv[i], zip_strerror(inputs[i].za));
+            exit(1);
+        }
+        total += (zip_uint64_t)nentries;
+    }
+    if (zip_reserve_entries(za, total) < 0) {
+        fprintf(stderr, "%s: cannot allocate entries for '%s': %s\n", progname, tname, zip_strerror(za));
+        exit(1);
+    }
+
+    /* entries are added in the order of the archives; when writing, data from archives opened for multiple threads is read ahead */
+    if (zip_set_num_threads(za, num_threads) < 0) {
+        fprintf(stderr, "%s: cannot set number of threads for '%s': %s\n", progname, tname, zip_strerror(za));
+        exit(1);
+    }
     for (i = 0; i < n; i++) {
-        if ((zs[i] = merge_zip(za, tname, argv[i])) == NULL)
+        if (merge_zip(za, tname, inputs[i].za, argv[i]) < 0)
             exit(1);
     }
 
@@ -172,7 +249,7 @@ main(int argc, char *argv[]) {
     }
 
     for (i = 0; i < n; i++)
-        zip_close(zs[i]);
+        zip_close(inputs[i].za);
 
     exit(0);
 }
@@ -221,72 +298,159 @@ confirm_replace(zip_t *za, const char *tname, zip_uint64_t it, zip_t *zs, const
 }
 
 
-static zip_t *
-merge_zip(zip_t *za, const char *tname, const char *sname) {
-    zip_t *zs;
+/* Runs in worker thread, must only access input. */
+static void
+open_input(input_t *input) {
+    input->za = NULL;
+
+    /* data is then read ahead from several archives at the same time when writing */
+    if (num_threads > 1) {
+        if ((input->za = zip_open(input->name, ZIP_RDONLY | ZIP_THREADSAFE, &input->error)) != NULL || input->error != ZIP_ER_OPNOTSUPP) {
+            return;
+        }
+    }
+    input->za = zip_open(input->name, 0, &input->error);
+}
+
+
+/* Open all ninputs inputs, using up to num_threads threads. */
+static void
+open_inputs(input_t *inputs, unsigned int ninputs) {
+    input_queue_t queue;
+    unsigned int threads;
+
+    queue.inputs = inputs;
+    queue.ninputs = ninputs;
+    queue.next = 0;
+
+    threads = num_threads > ninputs ? ninputs : num_threads;
+
+#ifdef HAVE_THREADS
+    queue.threaded = 0;
+    if (threads > 1) {
+        pthread_t *thread;
+        unsigned int t, started;
+
+        if ((thread = (pthread_t *)malloc(sizeof(thread[0]) * threads)) == NULL) {
+            fprintf(stderr, "%s: out of memory\n", progname);
+            exit(1);
+        }
+        pthread_mutex_init(&queue.mutex, NULL);
+        queue.threaded = 1;
+        for (started = 0; started < threads; started++) {
+            if (pthread_create(thread + started, NULL, open_inputs_worker, &queue) != 0) {
+                break;
+            }
+        }
+        if (started == 0) {
+            /* no threads available, open inputs in this one */
+            (void)open_inputs_worker(&queue);
+        }
+        for (t = 0; t < started; t++) {
+            pthread_join(thread[t], NULL);
+        }
+        pthread_mutex_destroy(&queue.mutex);
+        free(thread);
+    }
+    else
+#endif
+    {
+        (void)open_inputs_worker(&queue);
+    }
+}
+
+
+/* Open inputs from queue until it is empty. */
+static void *
+open_inputs_worker(void *ud) {
+    input_queue_t *queue = (input_queue_t *)ud;
+    input_t *input;
+
+    for (;;) {
+#ifdef HAVE_THREADS
+        if (queue->threaded) {
+            pthread_mutex_lock(&queue->mutex);
+        }
+#endif
+        input = queue->next < queue->ninputs ? queue->inputs + queue->next++ : NULL;
+#ifdef HAVE_THREADS
+        if (queue->threaded) {
+            pthread_mutex_unlock(&queue->mutex);
+        }
+#endif
+        if (input == NULL) {
+            break;
+        }
+        open_input(input);
+    }
+
+    return NULL;
+}
+
+
+static int
+merge_zip(zip_t *za, const char *tname, zip_t *zs, const char *sname) {
     zip_int64_t ret, idx;
     zip_uint64_t i;
     int err;
     const char *fname;
 
-    if ((zs = zip_open(sname, 0, &err)) == NULL) {
-        zip_error_t error;
-        zip_error_init_with_code(&error, err);
-        fprintf(stderr, "%s: can't open zip archive '%s': %s\n", progname, sname, zip_error_strerror(&error));
-        zip_error_fini(&error);
-        return NULL;
-    }
-
     ret = zip_get_num_entries(zs, 0);
     if (ret < 0) {
-        fprintf(stderr, "%s: cannot get number of entries for '%s': %s\n", progname, sname, zip_strerror(za));
-        return NULL;
+        fprintf(stderr, "%s: cannot get number of entries for '%s': %s\n", progname, sname, zip_strerror(zs));
+        return -1;
     }
     for (i = 0; i < (zip_uint64_t)ret; i++) {
         fname = zip_get_name(zs, i, 0);
 
         if ((idx = zip_name_locate(za, fname, name_flags)) >= 0) {
-            switch (confirm_replace(za, tname, (zip_uint64_t)idx, zs, sname, i)) {
+            switch ((err = confirm_replace(za, tname, (zip_uint64_t)idx, zs, sname, i))) {
             case 0:
                 break;
 
             case 1:
                 if (copy_file(za, idx, zs, i, NULL) < 0) {
                     fprintf(stderr, "%s: cannot replace '%s' in `%s': %s\n", progname, fname, tname, zip_strerror(za));
-                    zip_close(zs);
-                    return NULL;
+                    return -1;
                 }
                 break;
 
             case -1:
-                zip_close(zs);
-                return NULL;
+                return -1;
 
             default:
                 fprintf(stderr,
                         "%s: internal error: "
                         "unexpected return code from confirm (%d)\n",
                         progname, err);
-                zip_close(zs);
-                return NULL;
+                return -1;
             }
         }
         else {
             if (copy_file(za, -1, zs, i, fname) < 0) {
                 fprintf(stderr, "%s: cannot add '%s' to `%s': %s\n", progname, fname, tname, zip_strerror(za));
-                zip_close(zs);
-                return NULL;
+                return -1;
             }
         }
     }
 
-    return zs;
+    return 0;
 }
 
 
 static int copy_file(zip_t *destination_archive, zip_int64_t destination_index, zip_t *source_archive, zip_uint64_t source_index, const char* name) {
-    zip_source_t *source = zip_source_zip_file(destination_archive, source_archive, source_index, ZIP_FL_COMPRESSED, 0, -1, NULL);
+    zip_source_t *source;
+    zip_stat_t st;
+
+    if (destination_index < 0 && zip_stat_index(source_archive, source_index, 0, &st) == 0 && (st.valid & ZIP_STAT_COMP_METHOD) && (keep_stored || st.comp_method != ZIP_CM_STORE)) {
+        /* copy compressed data, extra fields, and comment as they are */
+        if (zip_file_copy(destination_archive, source_archive, source_index, 0) < 0) {
+            return -1;
+        }
+        return 0;
+    }
 
+    source = zip_source_zip_file(destination_archive, source_archive, source_index, ZIP_FL_COMPRESSED, 0, -1, NULL);
     if (source == NULL) {
         return -1;
     }
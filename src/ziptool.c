@@ -38,16 +38,22 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 #ifdef _WIN32
+#include <direct.h>
 /* WIN32 needs <fcntl.h> for _O_BINARY */
 #include <fcntl.h>
+#include <sys/utime.h>
+#define mkdir(path, mode) _mkdir(path)
 #ifndef STDIN_FILENO
 #define STDIN_FILENO _fileno(stdin)
 #endif
+#else
+#include <utime.h>
 #endif
 
 #ifndef HAVE_GETOPT
@@ -67,9 +73,13 @@ typedef struct dispatch_table_s {
 
 static zip_flags_t get_flags(const char *arg);
 static zip_int32_t get_compression_method(const char *arg);
+static zip_uint32_t get_compression_parameter(const char *arg);
 static zip_uint16_t get_encryption_method(const char *arg);
 static void hexdump(const zip_uint8_t *data, zip_uint16_t len);
 static int parse_archive_flag(const char* arg);
+static zip_int64_t parse_indices(const char *arg, zip_uint64_t *indices, zip_uint64_t nindices);
+static int parse_phase(const char *arg);
+static void print_close_stats(zip_t *archive, zip_int64_t index, void *ud);
 int ziptool_post_close(const char *archive);
 static const char* decode_filename(const char* name);
 static const char* encode_filename(const char* name);
@@ -82,8 +92,12 @@ static const char* encode_filename(const char* name);
 zip_t *za, *z_in[16];
 unsigned int z_in_count;
 zip_flags_t stat_flags;
+zip_uint32_t num_threads_set = 1;
 int hex_encoded_filenames = 0; // Can only be set in ziptool_regress.
 
+/* names of ZIP_PHASE_*, in order */
+static const char *const phase_names[] = {"open", "read", "close", "source", "decompress", "crc", "compress", "encrypt", "write", "copy"};
+
 static int
 cat_impl_backend(zip_uint64_t idx, zip_uint64_t start, zip_uint64_t len, FILE *out) {
     zip_error_t error;
@@ -178,6 +192,16 @@ add_dir(char *argv[]) {
     return 0;
 }
 
+static int
+add_dir_tree(char *argv[]) {
+    /* add directory tree */
+    if (zip_dir_add_tree(za, argv[0], decode_filename(argv[1]), 0) < 0) {
+        fprintf(stderr, "can't add directory tree '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 add_file(char *argv[]) {
     zip_source_t *zs;
@@ -241,6 +265,299 @@ add_from_zip(char *argv[]) {
     return 0;
 }
 
+static int
+add_precompressed(char *argv[]) {
+    zip_source_t *zs, *zs_precompressed;
+    zip_int32_t method = get_compression_method(argv[2]);
+    zip_uint64_t size = strtoull(argv[3], NULL, 10);
+    zip_uint32_t crc = (zip_uint32_t)strtoul(argv[4], NULL, 16);
+
+    if ((zs = zip_source_file(za, argv[1], 0, ZIP_LENGTH_TO_END)) == NULL) {
+        fprintf(stderr, "can't create zip_source from file: %s\n", zip_strerror(za));
+        return -1;
+    }
+    if ((zs_precompressed = zip_source_precompressed(za, zs, method, size, crc)) == NULL) {
+        zip_source_free(zs);
+        fprintf(stderr, "can't create precompressed source: %s\n", zip_strerror(za));
+        return -1;
+    }
+
+    if (zip_file_add(za, decode_filename(argv[0]), zs_precompressed, 0) == -1) {
+        zip_source_free(zs_precompressed);
+        fprintf(stderr, "can't add file '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+#define BENCH_BUFFER_SIZE (64 * 1024)
+#define BENCH_RANDOM_READ_LENGTH 4096
+
+static int bench_read(zip_uint8_t *buffer);
+static int bench_read_random(zip_uint8_t *buffer);
+static int bench_rewrite(void);
+static void bench_report(const char *name, zip_uint64_t count, const char *unit, zip_uint64_t bytes, double seconds);
+static void bench_report_stats(const zip_phase_stats_t *stats, zip_uint32_t first, zip_uint32_t last, const zip_phase_stats_t *before);
+static void bench_rewrite_stats(zip_t *archive, zip_int64_t index, void *ud);
+static void bench_stats(zip_t *archive, zip_phase_stats_t *stats);
+static double bench_time(void);
+
+static int
+bench(char *argv[]) {
+    zip_uint8_t *buffer;
+    bool all = strcmp(argv[0], "all") == 0;
+    int ret = 0;
+
+    if (!all && strcmp(argv[0], "read") != 0 && strcmp(argv[0], "random") != 0 && strcmp(argv[0], "rewrite") != 0) {
+        fprintf(stderr, "invalid workload '%s'\n", argv[0]);
+        return -1;
+    }
+    if ((buffer = (zip_uint8_t *)malloc(BENCH_BUFFER_SIZE)) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return -1;
+    }
+
+    if (ret == 0 && (all || strcmp(argv[0], "read") == 0)) {
+        ret = bench_read(buffer);
+    }
+    if (ret == 0 && (all || strcmp(argv[0], "random") == 0)) {
+        ret = bench_read_random(buffer);
+    }
+    if (ret == 0 && (all || strcmp(argv[0], "rewrite") == 0)) {
+        ret = bench_rewrite();
+    }
+
+    free(buffer);
+    return ret;
+}
+
+/* Read all files completely, in archive order. */
+static int
+bench_read(zip_uint8_t *buffer) {
+    zip_phase_stats_t before[ZIP_PHASE_COPY + 1], after[ZIP_PHASE_COPY + 1];
+    zip_uint64_t files = 0, bytes = 0;
+    zip_int64_t i, n;
+    double start;
+
+    bench_stats(za, before);
+
+    start = bench_time();
+    n = zip_get_num_entries(za, 0);
+    for (i = 0; i < n; i++) {
+        zip_file_t *zf;
+        zip_int64_t length;
+
+        if ((zf = zip_fopen_index(za, (zip_uint64_t)i, 0)) == NULL) {
+            if (zip_error_code_zip(zip_get_error(za)) == ZIP_ER_DELETED) {
+                continue;
+            }
+            fprintf(stderr, "can't open file at index '%" PRId64 "': %s\n", i, zip_strerror(za));
+            return -1;
+        }
+        while ((length = zip_fread(zf, buffer, BENCH_BUFFER_SIZE)) > 0) {
+            bytes += (zip_uint64_t)length;
+        }
+        if (length < 0) {
+            fprintf(stderr, "can't read file at index '%" PRId64 "': %s\n", i, zip_file_strerror(zf));
+            zip_fclose(zf);
+            return -1;
+        }
+        zip_fclose(zf);
+        files++;
+    }
+    bench_report("read", files, "files", bytes, bench_time() - start);
+    bench_stats(za, after);
+    bench_report_stats(after, ZIP_PHASE_READ, ZIP_PHASE_READ, before);
+    return 0;
+}
+
+/* Read short pieces of randomly chosen files, from random offsets if they are seekable. */
+static int
+bench_read_random(zip_uint8_t *buffer) {
+    zip_phase_stats_t before[ZIP_PHASE_COPY + 1], after[ZIP_PHASE_COPY + 1];
+    zip_uint64_t i, count, reads = 0, bytes = 0, state = 0x9E3779B97F4A7C15ULL;
+    zip_int64_t n;
+    double start;
+
+    bench_stats(za, before);
+
+    if ((n = zip_get_num_entries(za, 0)) <= 0) {
+        bench_report("random", 0, "reads", 0, 0.0);
+        return 0;
+    }
+    count = (zip_uint64_t)n < 1000 ? 1000 : (zip_uint64_t)n;
+
+    start = bench_time();
+    for (i = 0; i < count; i++) {
+        zip_uint64_t index, random;
+        zip_stat_t st;
+        zip_file_t *zf;
+        zip_int64_t length;
+
+        /* xorshift64*, so runs read the same pieces */
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        random = state * 0x2545F4914F6CDD1DULL;
+
+        index = random % (zip_uint64_t)n;
+        if (zip_stat_index(za, index, 0, &st) < 0 || (zf = zip_fopen_index(za, index, 0)) == NULL) {
+            if (zip_error_code_zip(zip_get_error(za)) == ZIP_ER_DELETED) {
+                continue;
+            }
+            fprintf(stderr, "can't open file at index '%" PRIu64 "': %s\n", index, zip_strerror(za));
+            return -1;
+        }
+        if ((st.valid & ZIP_STAT_SIZE) && st.size > BENCH_RANDOM_READ_LENGTH && zip_file_is_seekable(zf) == 1) {
+            if (zip_fseek(zf, (zip_int64_t)((random >> 32) % (st.size - BENCH_RANDOM_READ_LENGTH)), SEEK_SET) < 0) {
+                fprintf(stderr, "can't seek in file at index '%" PRIu64 "': %s\n", index, zip_file_strerror(zf));
+                zip_fclose(zf);
+                return -1;
+            }
+        }
+        if ((length = zip_fread(zf, buffer, BENCH_RANDOM_READ_LENGTH)) < 0) {
+            fprintf(stderr, "can't read file at index '%" PRIu64 "': %s\n", index, zip_file_strerror(zf));
+            zip_fclose(zf);
+            return -1;
+        }
+        zip_fclose(zf);
+        reads++;
+        bytes += (zip_uint64_t)length;
+    }
+    bench_report("random", reads, "reads", bytes, bench_time() - start);
+    bench_stats(za, after);
+    bench_report_stats(after, ZIP_PHASE_READ, ZIP_PHASE_READ, before);
+    return 0;
+}
+
+/* Write all files to a new archive in memory, which is discarded. */
+static int
+bench_rewrite(void) {
+    zip_source_t *src;
+    zip_error_t error;
+    zip_t *dest;
+    zip_int64_t i, n;
+    zip_phase_stats_t stats[ZIP_PHASE_COPY + 1];
+    zip_uint64_t files = 0, bytes = 0;
+    double start;
+
+    zip_error_init(&error);
+    if ((src = zip_source_buffer_create(NULL, 0, 0, &error)) == NULL || (dest = zip_open_from_source(src, ZIP_TRUNCATE | ZIP_COLLECT_STATS, &error)) == NULL) {
+        fprintf(stderr, "can't create archive in memory: %s\n", zip_error_strerror(&error));
+        zip_source_free(src);
+        zip_error_fini(&error);
+        return -1;
+    }
+    zip_error_fini(&error);
+    memset(stats, 0, sizeof(stats));
+    /* keep the data after closing, so the time spent freeing it is not counted */
+    zip_source_keep(src);
+    zip_set_num_threads(dest, num_threads_set);
+
+    n = zip_get_num_entries(za, 0);
+    for (i = 0; i < n; i++) {
+        zip_source_t *file;
+        zip_stat_t st;
+        const char *name;
+
+        if ((name = zip_get_name(za, (zip_uint64_t)i, 0)) == NULL) {
+            if (zip_error_code_zip(zip_get_error(za)) == ZIP_ER_DELETED) {
+                continue;
+            }
+            fprintf(stderr, "can't get name of file at index '%" PRId64 "': %s\n", i, zip_strerror(za));
+            zip_discard(dest);
+            zip_source_free(src);
+            return -1;
+        }
+        if ((file = zip_source_zip_file(dest, za, (zip_uint64_t)i, 0, 0, -1, NULL)) == NULL || zip_file_add(dest, name, file, 0) < 0) {
+            fprintf(stderr, "can't add file at index '%" PRId64 "': %s\n", i, zip_strerror(dest));
+            zip_source_free(file);
+            zip_discard(dest);
+            zip_source_free(src);
+            return -1;
+        }
+        if (zip_stat_index(za, (zip_uint64_t)i, 0, &st) == 0 && (st.valid & ZIP_STAT_SIZE)) {
+            bytes += st.size;
+        }
+        files++;
+    }
+
+    /* statistics are only available until the archive is freed by zip_close */
+    zip_register_stats_callback(dest, bench_rewrite_stats, stats);
+    start = bench_time();
+    if (zip_close(dest) < 0) {
+        fprintf(stderr, "can't write archive in memory: %s\n", zip_strerror(dest));
+        zip_discard(dest);
+        zip_source_free(src);
+        return -1;
+    }
+    bench_report("rewrite", files, "files", bytes, bench_time() - start);
+    bench_report_stats(stats, ZIP_PHASE_CLOSE, ZIP_PHASE_COPY, NULL);
+    zip_source_free(src);
+    return 0;
+}
+
+static void
+bench_report(const char *name, zip_uint64_t count, const char *unit, zip_uint64_t bytes, double seconds) {
+    printf("%s: %" PRIu64 " %s, %" PRIu64 " bytes in %.3f s", name, count, unit, bytes, seconds);
+    if (seconds > 0) {
+        printf(", %.1f MB/s", (double)bytes / seconds / 1e6);
+    }
+    printf("\n");
+}
+
+/* Print statistics of phases first to last, minus those in before if given. */
+static void
+bench_report_stats(const zip_phase_stats_t *stats, zip_uint32_t first, zip_uint32_t last, const zip_phase_stats_t *before) {
+    zip_uint32_t phase;
+
+    for (phase = first; phase <= last; phase++) {
+        zip_phase_stats_t delta = stats[phase];
+
+        if (before != NULL) {
+            delta.wall_time -= before[phase].wall_time;
+            delta.bytes_in -= before[phase].bytes_in;
+            delta.bytes_out -= before[phase].bytes_out;
+            delta.count -= before[phase].count;
+        }
+        if (delta.count > 0) {
+            printf("  %s: count %" PRIu64 ", in %" PRIu64 ", out %" PRIu64 ", %.3f s\n", phase_names[phase], delta.count, delta.bytes_in, delta.bytes_out, (double)delta.wall_time / 1e9);
+        }
+    }
+}
+
+static void
+bench_rewrite_stats(zip_t *archive, zip_int64_t index, void *ud) {
+    if (index < 0) {
+        bench_stats(archive, (zip_phase_stats_t *)ud);
+    }
+}
+
+/* Get statistics of all phases, all zero if they are not collected. */
+static void
+bench_stats(zip_t *archive, zip_phase_stats_t *stats) {
+    zip_uint32_t phase;
+
+    for (phase = 0; phase <= ZIP_PHASE_COPY; phase++) {
+        if (zip_get_stats(archive, phase, &stats[phase]) < 0) {
+            memset(&stats[phase], 0, sizeof(stats[phase]));
+        }
+    }
+}
+
+/* Wall clock time in seconds, since work may be done in threads. */
+static double
+bench_time(void) {
+#ifdef TIME_UTC
+    struct timespec ts;
+
+    if (timespec_get(&ts, TIME_UTC) != 0) {
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+    }
+#endif
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
 static int
 cat(char *argv[]) {
     /* output file contents to stdout */
@@ -264,6 +581,37 @@ cat_partial(char *argv[]) {
     return cat_impl(idx, start, len);
 }
 
+static int
+commit(char *argv[]) {
+    if (zip_commit(za) < 0) {
+        fprintf(stderr, "can't commit changes: %s\n", zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+copy_file(char *argv[]) {
+    zip_uint64_t idx;
+    int err;
+    /* copy file from another zip file without recompressing */
+    idx = strtoull(argv[1], NULL, 10);
+    if ((z_in[z_in_count] = zip_open(argv[0], ZIP_CHECKCONS, &err)) == NULL) {
+        zip_error_t error;
+        zip_error_init_with_code(&error, err);
+        fprintf(stderr, "can't open zip archive '%s': %s\n", argv[0], zip_error_strerror(&error));
+        zip_error_fini(&error);
+        return -1;
+    }
+    if (zip_file_copy(za, z_in[z_in_count], idx, 0) < 0) {
+        fprintf(stderr, "can't copy file '%" PRIu64 "' from '%s': %s\n", idx, argv[0], zip_strerror(za));
+        zip_close(z_in[z_in_count]);
+        return -1;
+    }
+    z_in_count++;
+    return 0;
+}
+
 static int
 count_extra(char *argv[]) {
     zip_int16_t count;
@@ -341,95 +689,428 @@ delete_extra_by_id(char *argv[]) {
     return 0;
 }
 
-static int
-get_archive_comment(char *argv[]) {
-    const char *comment;
-    int len;
-    /* get archive comment */
-    if ((comment = zip_get_archive_comment(za, &len, 0)) == NULL || len == 0)
-        printf("No archive comment\n");
-    else
-        printf("Archive comment: %.*s\n", len, encode_filename(comment));
-    return 0;
-}
-
-static int
-get_archive_flag(char *argv[]) {
-    int flag = parse_archive_flag(argv[0]);
-    if (flag < 0) {
-        fprintf(stderr, "invalid archive flag '%s'\n", argv[0]);
-        return -1;
-    }
-
-    printf("%d\n", zip_get_archive_flag(za, flag, 0));
-    return 0;
-}
+typedef struct {
+    const char *directory;
+    char *path;
+    FILE *fp;
+    zip_int64_t index;
+    int error;
+} extract_state_t;
 
 static int
-get_extra(char *argv[]) {
-    zip_flags_t geflags;
-    zip_uint16_t id, eidx, eflen;
-    const zip_uint8_t *efdata;
+zdigest(char *argv[]) {
+    /* read file data and show its digest */
     zip_uint64_t idx;
-    /* get extra field data */
+    zip_file_t *zf;
+    zip_uint8_t digest[ZIP_DIGEST_LENGTH];
+    zip_int64_t n;
+    char buf[8192];
+
     idx = strtoull(argv[0], NULL, 10);
-    eidx = (zip_uint16_t)strtoull(argv[1], NULL, 10);
-    geflags = get_flags(argv[2]);
-    if ((efdata = zip_file_extra_field_get(za, idx, eidx, &id, &eflen, geflags)) == NULL) {
-        fprintf(stderr, "can't get extra field data for file at index %" PRIu64 ", extra field %d, flags %u: %s\n", idx, eidx, geflags, zip_strerror(za));
+
+    if ((zf = zip_fopen_index(za, idx, ZIP_FL_DIGEST)) == NULL) {
+        fprintf(stderr, "can't open file at index '%" PRIu64 "': %s\n", idx, zip_strerror(za));
         return -1;
     }
-    printf("Extra field 0x%04x: len %d", id, eflen);
-    if (eflen > 0) {
-        printf(", data ");
-        hexdump(efdata, eflen);
+    while ((n = zip_fread(zf, buf, sizeof(buf))) > 0) {
+    }
+    if (n < 0 || zip_fdigest(zf, digest) < 0) {
+        fprintf(stderr, "can't get digest of file at index '%" PRIu64 "': %s\n", idx, zip_file_strerror(zf));
+        zip_fclose(zf);
+        return -1;
     }
+    zip_fclose(zf);
+
+    printf("Digest of '%s': ", zip_get_name(za, idx, 0));
+    hexdump(digest, ZIP_DIGEST_LENGTH);
     printf("\n");
     return 0;
 }
 
+static int extract_file_callback(zip_t *za, zip_uint64_t idx, const void *data, zip_uint64_t length, void *ud);
+static char *extract_path(const char *directory, const char *name);
+static int make_directories(char *path, bool include_last);
+static void set_file_attributes(zip_uint64_t idx, const char *path);
+
 static int
-get_extra_by_id(char *argv[]) {
-    zip_flags_t geflags;
-    zip_uint16_t eid, eidx, eflen;
-    const zip_uint8_t *efdata;
-    zip_uint64_t idx;
-    idx = strtoull(argv[0], NULL, 10);
-    eid = (zip_uint16_t)strtoull(argv[1], NULL, 10);
-    eidx = (zip_uint16_t)strtoull(argv[2], NULL, 10);
-    geflags = get_flags(argv[3]);
-    if ((efdata = zip_file_extra_field_get_by_id(za, idx, eid, eidx, &eflen, geflags)) == NULL) {
-        fprintf(stderr, "can't get extra field data for file at index %" PRIu64 ", extra field id %d, ef index %d, flags %u: %s\n", idx, eid, eidx, geflags, zip_strerror(za));
-        return -1;
+extract(char *argv[]) {
+    extract_state_t state;
+    zip_int64_t i, n;
+    int ret;
+
+    state.directory = argv[0];
+    state.path = NULL;
+    state.fp = NULL;
+    state.index = -1;
+    state.error = 0;
+
+    ret = 0;
+    if (zip_extract_all(za, 0, extract_file_callback, &state) < 0) {
+        if (!state.error) {
+            fprintf(stderr, "can't extract files: %s\n", zip_strerror(za));
+        }
+        ret = -1;
     }
-    printf("Extra field 0x%04x: len %d", eid, eflen);
-    if (eflen > 0) {
-        printf(", data ");
-        hexdump(efdata, eflen);
+    if (state.fp != NULL) {
+        fclose(state.fp);
     }
-    printf("\n");
-    return 0;
+    free(state.path);
+
+    if (ret == 0) {
+        /* set attributes of directories last, since creating files in them changes their modification time */
+        n = zip_get_num_entries(za, 0);
+        for (i = n - 1; i >= 0; i--) {
+            const char *name = zip_get_name(za, (zip_uint64_t)i, 0);
+            char *path;
+
+            if (name == NULL || name[0] == '\0' || name[strlen(name) - 1] != '/') {
+                continue;
+            }
+            if ((path = extract_path(state.directory, name)) == NULL) {
+                return -1;
+            }
+            set_file_attributes((zip_uint64_t)i, path);
+            free(path);
+        }
+    }
+
+    return ret;
 }
 
 static int
-get_file_comment(char *argv[]) {
-    const char *comment;
-    zip_uint32_t len;
-    zip_uint64_t idx;
-    /* get file comment */
-    idx = strtoull(argv[0], NULL, 10);
-    if ((comment = zip_file_get_comment(za, idx, &len, 0)) == NULL) {
-        fprintf(stderr, "can't get comment for '%s': %s\n", zip_get_name(za, idx, 0), zip_strerror(za));
-        return -1;
+extract_file_callback(zip_t *za, zip_uint64_t idx, const void *data, zip_uint64_t length, void *ud) {
+    extract_state_t *state = (extract_state_t *)ud;
+
+    if (state->index != (zip_int64_t)idx) {
+        const char *name;
+
+        if ((name = zip_get_name(za, idx, 0)) == NULL) {
+            fprintf(stderr, "can't get name of file at index '%" PRIu64 "': %s\n", idx, zip_strerror(za));
+            state->error = 1;
+            return -1;
+        }
+        free(state->path);
+        if ((state->path = extract_path(state->directory, name)) == NULL) {
+            state->error = 1;
+            return -1;
+        }
+        state->index = (zip_int64_t)idx;
+
+        if (name[0] != '\0' && name[strlen(name) - 1] == '/') {
+            if (make_directories(state->path, true) < 0) {
+                state->error = 1;
+                return -1;
+            }
+        }
+        else {
+            if (make_directories(state->path, false) < 0) {
+                state->error = 1;
+                return -1;
+            }
+            if ((state->fp = fopen(state->path, "wb")) == NULL) {
+                fprintf(stderr, "can't create file '%s': %s\n", state->path, strerror(errno));
+                state->error = 1;
+                return -1;
+            }
+        }
+    }
+
+    if (data != NULL) {
+        if (state->fp != NULL && fwrite(data, 1, (size_t)length, state->fp) != length) {
+            fprintf(stderr, "can't write file '%s': %s\n", state->path, strerror(errno));
+            state->error = 1;
+            return -1;
+        }
+        return 0;
+    }
+
+    /* end of file data */
+    if (state->fp != NULL) {
+        int ret = fclose(state->fp);
+
+        state->fp = NULL;
+        if (ret != 0) {
+            fprintf(stderr, "can't write file '%s': %s\n", state->path, strerror(errno));
+            state->error = 1;
+            return -1;
+        }
+        set_file_attributes(idx, state->path);
     }
-    else if (len == 0)
-        printf("No comment for '%s'\n", zip_get_name(za, idx, 0));
-    else
-        printf("File comment for '%s': %.*s\n", zip_get_name(za, idx, 0), (int)len, comment);
     return 0;
 }
 
-static int
+/* Return path of file name in directory, refusing names that would end up outside of it. */
+static char *
+extract_path(const char *directory, const char *name) {
+    const char *component;
+    char *path;
+    size_t length;
+
+    if (name[0] == '/' || name[0] == '\\' || (name[0] != '\0' && name[1] == ':')) {
+        fprintf(stderr, "refusing to extract file with absolute name '%s'\n", name);
+        return NULL;
+    }
+    component = name;
+    while (component != NULL) {
+        if (component[0] == '.' && component[1] == '.' && (component[2] == '\0' || component[2] == '/' || component[2] == '\\')) {
+            fprintf(stderr, "refusing to extract file '%s' outside of directory\n", name);
+            return NULL;
+        }
+        if ((component = strpbrk(component, "/\\")) != NULL) {
+            component++;
+        }
+    }
+
+    length = strlen(directory) + strlen(name) + 2;
+    if ((path = (char *)malloc(length)) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return NULL;
+    }
+    snprintf_s(path, length, "%s/%s", directory, name);
+    return path;
+}
+
+/* Create directories leading up to path, and path itself if include_last is true. */
+static int
+make_directories(char *path, bool include_last) {
+    char *p;
+
+    for (p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        if (mkdir(path, 0777) < 0 && errno != EEXIST) {
+            fprintf(stderr, "can't create directory '%s': %s\n", path, strerror(errno));
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+    if (include_last && mkdir(path, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "can't create directory '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Set modification time and, for files created on Unix, permissions of path from entry idx. */
+static void
+set_file_attributes(zip_uint64_t idx, const char *path) {
+    zip_stat_t st;
+    zip_uint8_t opsys;
+    zip_uint32_t attributes;
+
+#ifndef _WIN32
+    if (zip_file_get_external_attributes(za, idx, 0, &opsys, &attributes) == 0 && opsys == ZIP_OPSYS_UNIX && ((attributes >> 16) & 07777) != 0) {
+        (void)chmod(path, (mode_t)((attributes >> 16) & 07777));
+    }
+#else
+    (void)opsys;
+    (void)attributes;
+#endif
+
+    if (zip_stat_index(za, idx, 0, &st) == 0 && (st.valid & ZIP_STAT_MTIME)) {
+        struct utimbuf times;
+
+        times.actime = st.mtime;
+        times.modtime = st.mtime;
+        (void)utime(path, &times);
+    }
+}
+
+static int
+extract_all_callback(zip_t *za, zip_uint64_t idx, const void *data, zip_uint64_t length, void *ud) {
+    zip_uint64_t *total = (zip_uint64_t *)ud;
+
+    if (data == NULL) {
+        printf("%" PRIu64 ": %" PRIu64 " bytes\n", idx, *total);
+        *total = 0;
+    }
+    else {
+        *total += length;
+    }
+    return 0;
+}
+
+static int
+extract_all(char *argv[]) {
+    zip_flags_t flags;
+    zip_uint64_t total = 0;
+
+    flags = get_flags(argv[0]);
+    if (zip_extract_all(za, flags, extract_all_callback, &total) < 0) {
+        fprintf(stderr, "can't extract files: %s\n", zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+get_access_profile(char *argv[]) {
+    zip_uint64_t indices[64];
+    zip_int64_t i, n;
+
+    if ((n = zip_get_access_profile(za, indices, sizeof(indices) / sizeof(indices[0]))) < 0) {
+        fprintf(stderr, "can't get access profile: %s\n", zip_strerror(za));
+        return -1;
+    }
+    printf("access profile:");
+    for (i = 0; i < n && i < (zip_int64_t)(sizeof(indices) / sizeof(indices[0])); i++) {
+        printf("%s%" PRIu64, i > 0 ? "," : " ", indices[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int
+get_archive_comment(char *argv[]) {
+    const char *comment;
+    int len;
+    /* get archive comment */
+    if ((comment = zip_get_archive_comment(za, &len, 0)) == NULL || len == 0)
+        printf("No archive comment\n");
+    else
+        printf("Archive comment: %.*s\n", len, encode_filename(comment));
+    return 0;
+}
+
+static int
+get_archive_flag(char *argv[]) {
+    int flag = parse_archive_flag(argv[0]);
+    if (flag < 0) {
+        fprintf(stderr, "invalid archive flag '%s'\n", argv[0]);
+        return -1;
+    }
+
+    printf("%d\n", zip_get_archive_flag(za, flag, 0));
+    return 0;
+}
+
+static int
+get_archive_prefix(char *argv[]) {
+    const zip_uint8_t *prefix;
+    zip_uint64_t length;
+
+    if ((prefix = zip_get_archive_prefix(za, &length, 0)) == NULL) {
+        fprintf(stderr, "can't get archive prefix: %s\n", zip_strerror(za));
+        return -1;
+    }
+    if (length == 0)
+        printf("No archive prefix\n");
+    else
+        printf("Archive prefix: %.*s\n", (int)length, (const char *)prefix);
+    return 0;
+}
+
+static int
+get_entry_cache_stats(char *argv[]) {
+    zip_uint64_t hits, misses;
+
+    if (zip_get_entry_cache_stats(za, &hits, &misses) < 0) {
+        fprintf(stderr, "can't get entry cache statistics: %s\n", zip_strerror(za));
+        return -1;
+    }
+    printf("entry cache: %" PRIu64 " hit%s, %" PRIu64 " miss%s\n", hits, hits == 1 ? "" : "s", misses, misses == 1 ? "" : "es");
+    return 0;
+}
+
+static int
+get_stats(char *argv[]) {
+    zip_phase_stats_t stats;
+    int phase;
+
+    if ((phase = parse_phase(argv[0])) < 0) {
+        fprintf(stderr, "invalid phase '%s'\n", argv[0]);
+        return -1;
+    }
+    if (zip_get_stats(za, (zip_uint32_t)phase, &stats) < 0) {
+        fprintf(stderr, "can't get statistics: %s\n", zip_strerror(za));
+        return -1;
+    }
+    /* times vary between runs, so they are not shown */
+    printf("%s: count %" PRIu64 ", in %" PRIu64 ", out %" PRIu64 "\n", argv[0], stats.count, stats.bytes_in, stats.bytes_out);
+    return 0;
+}
+
+static int
+get_extra(char *argv[]) {
+    zip_flags_t geflags;
+    zip_uint16_t id, eidx, eflen;
+    const zip_uint8_t *efdata;
+    zip_uint64_t idx;
+    /* get extra field data */
+    idx = strtoull(argv[0], NULL, 10);
+    eidx = (zip_uint16_t)strtoull(argv[1], NULL, 10);
+    geflags = get_flags(argv[2]);
+    if ((efdata = zip_file_extra_field_get(za, idx, eidx, &id, &eflen, geflags)) == NULL) {
+        fprintf(stderr, "can't get extra field data for file at index %" PRIu64 ", extra field %d, flags %u: %s\n", idx, eidx, geflags, zip_strerror(za));
+        return -1;
+    }
+    printf("Extra field 0x%04x: len %d", id, eflen);
+    if (eflen > 0) {
+        printf(", data ");
+        hexdump(efdata, eflen);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int
+get_extra_by_id(char *argv[]) {
+    zip_flags_t geflags;
+    zip_uint16_t eid, eidx, eflen;
+    const zip_uint8_t *efdata;
+    zip_uint64_t idx;
+    idx = strtoull(argv[0], NULL, 10);
+    eid = (zip_uint16_t)strtoull(argv[1], NULL, 10);
+    eidx = (zip_uint16_t)strtoull(argv[2], NULL, 10);
+    geflags = get_flags(argv[3]);
+    if ((efdata = zip_file_extra_field_get_by_id(za, idx, eid, eidx, &eflen, geflags)) == NULL) {
+        fprintf(stderr, "can't get extra field data for file at index %" PRIu64 ", extra field id %d, ef index %d, flags %u: %s\n", idx, eid, eidx, geflags, zip_strerror(za));
+        return -1;
+    }
+    printf("Extra field 0x%04x: len %d", eid, eflen);
+    if (eflen > 0) {
+        printf(", data ");
+        hexdump(efdata, eflen);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int
+get_file_comment(char *argv[]) {
+    const char *comment;
+    zip_uint32_t len;
+    zip_uint64_t idx;
+    /* get file comment */
+    idx = strtoull(argv[0], NULL, 10);
+    if ((comment = zip_file_get_comment(za, idx, &len, 0)) == NULL) {
+        fprintf(stderr, "can't get comment for '%s': %s\n", zip_get_name(za, idx, 0), zip_strerror(za));
+        return -1;
+    }
+    else if (len == 0)
+        printf("No comment for '%s'\n", zip_get_name(za, idx, 0));
+    else
+        printf("File comment for '%s': %.*s\n", zip_get_name(za, idx, 0), (int)len, comment);
+    return 0;
+}
+
+static int
+get_file_digest(char *argv[]) {
+    zip_uint64_t idx;
+    zip_uint8_t digest[ZIP_DIGEST_LENGTH];
+    /* get digest stored for file data */
+    idx = strtoull(argv[0], NULL, 10);
+    if (zip_file_get_digest(za, idx, digest, 0) < 0) {
+        fprintf(stderr, "can't get digest for '%s': %s\n", zip_get_name(za, idx, 0), zip_strerror(za));
+        return -1;
+    }
+    printf("Stored digest of '%s': ", zip_get_name(za, idx, 0));
+    hexdump(digest, ZIP_DIGEST_LENGTH);
+    printf("\n");
+    return 0;
+}
+
+static int
 get_num_entries(char *argv[]) {
     zip_int64_t count;
     zip_flags_t flags;
@@ -440,90 +1121,520 @@ get_num_entries(char *argv[]) {
     return 0;
 }
 
+static int
+name_list(char *argv[]) {
+    zip_flags_t flags;
+    zip_int64_t i, n;
+    zip_uint64_t *indices;
+
+    flags = get_flags(argv[1]);
+
+    if ((n = zip_name_list(za, argv[0], flags, NULL, 0)) < 0) {
+        fprintf(stderr, "can't list entries with prefix '%s' using flags '%s': %s\n", argv[0], argv[1], zip_strerror(za));
+        return -1;
+    }
+    if (n == 0) {
+        printf("no entries with prefix '%s' using flags '%s'\n", argv[0], argv[1]);
+        return 0;
+    }
+    if ((indices = (zip_uint64_t *)malloc(sizeof(indices[0]) * (size_t)n)) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return -1;
+    }
+    if (zip_name_list(za, argv[0], flags, indices, (zip_uint64_t)n) != n) {
+        fprintf(stderr, "can't list entries with prefix '%s' using flags '%s': %s\n", argv[0], argv[1], zip_strerror(za));
+        free(indices);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        printf("%" PRIu64 ": '%s'\n", indices[i], zip_get_name(za, indices[i], 0));
+    }
+
+    free(indices);
+    return 0;
+}
+
+
 static int
 name_locate(char *argv[]) {
     zip_flags_t flags;
     zip_int64_t idx;
     flags = get_flags(argv[1]);
 
-    if ((idx = zip_name_locate(za, decode_filename(argv[0]), flags)) < 0) {
-        fprintf(stderr, "can't find entry with name '%s' using flags '%s'\n", argv[0], argv[1]);
+    if ((idx = zip_name_locate(za, decode_filename(argv[0]), flags)) < 0) {
+        fprintf(stderr, "can't find entry with name '%s' using flags '%s'\n", argv[0], argv[1]);
+    }
+    else {
+        printf("name '%s' using flags '%s' found at index %" PRId64 "\n", argv[0], argv[1], idx);
+    }
+
+    return 0;
+}
+
+
+static int
+name_locate_len(char *argv[]) {
+    const char *name;
+    zip_uint64_t length;
+    zip_flags_t flags;
+    zip_int64_t idx;
+
+    name = decode_filename(argv[0]);
+    length = strtoull(argv[1], NULL, 10);
+    flags = get_flags(argv[2]);
+
+    if (length > strlen(name)) {
+        fprintf(stderr, "length %" PRIu64 " is longer than name '%s'\n", length, argv[0]);
+        return -1;
+    }
+
+    if ((idx = zip_name_locate_len(za, name, length, flags)) < 0) {
+        fprintf(stderr, "can't find entry with name '%.*s' using flags '%s'\n", (int)length, name, argv[2]);
+    }
+    else {
+        printf("name '%.*s' using flags '%s' found at index %" PRId64 "\n", (int)length, name, argv[2], idx);
+    }
+
+    return 0;
+}
+
+static int
+name_locate_many(char *argv[]) {
+    char *names_buffer, *name;
+    const char **names;
+    zip_uint32_t *hashes;
+    zip_int64_t *indices;
+    zip_uint64_t count, i;
+    zip_flags_t flags;
+    int ret;
+
+    flags = get_flags(argv[1]);
+
+    /* names are separated by commas */
+    if ((names_buffer = strdup(argv[0])) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    count = 1;
+    for (name = names_buffer; *name != '\0'; name++) {
+        if (*name == ',') {
+            count++;
+        }
+    }
+    names = (const char **)malloc(sizeof(names[0]) * count);
+    hashes = (zip_uint32_t *)malloc(sizeof(hashes[0]) * count);
+    indices = (zip_int64_t *)malloc(sizeof(indices[0]) * count);
+    if (names == NULL || hashes == NULL || indices == NULL) {
+        fprintf(stderr, "out of memory\n");
+        free(names);
+        free(hashes);
+        free(indices);
+        free(names_buffer);
+        return -1;
+    }
+    name = names_buffer;
+    for (i = 0; i < count; i++) {
+        char *end = strchr(name, ',');
+
+        names[i] = name;
+        if (end != NULL) {
+            *end = '\0';
+            name = end + 1;
+        }
+        hashes[i] = zip_name_hash(names[i], flags);
+    }
+
+    if ((ret = zip_name_locate_many(za, names, hashes, count, flags, indices)) < 0) {
+        fprintf(stderr, "can't find entries using flags '%s': %s\n", argv[1], zip_strerror(za));
+    }
+    else {
+        for (i = 0; i < count; i++) {
+            if (indices[i] < 0) {
+                printf("name '%s' not found\n", names[i]);
+            }
+            else {
+                printf("name '%s' found at index %" PRId64 "\n", names[i], indices[i]);
+            }
+        }
+    }
+
+    free(names);
+    free(hashes);
+    free(indices);
+    free(names_buffer);
+    return ret;
+}
+
+struct progress_userdata_s {
+    double percentage;
+    double limit;
+};
+
+struct progress_userdata_s progress_userdata;
+
+static void
+progress_callback(zip_t *archive, double percentage, void *ud) {
+    printf("%.1f%% done\n", percentage * 100);
+    progress_userdata.percentage = percentage;
+}
+
+static int
+print_progress(char *argv[]) {
+    zip_register_progress_callback_with_state(za, 0.001, progress_callback, NULL, NULL);
+    return 0;
+}
+
+static void
+progress_bytes_callback(zip_t *archive, zip_uint64_t done, zip_uint64_t total, double throughput, void *ud) {
+    /* throughput varies between runs, so it is not shown */
+    printf("%" PRIu64 " of %" PRIu64 " bytes done\n", done, total);
+}
+
+static int
+print_progress_bytes(char *argv[]) {
+    zip_register_progress_bytes_callback_with_state(za, 0.001, progress_bytes_callback, NULL, NULL);
+    return 0;
+}
+
+/* names of zip_source_cmd_t, in order */
+static const char *const source_command_names[] = {"open", "read", "close", "stat", "error", "free", "seek", "tell", "begin_write", "commit_write", "rollback_write", "write", "seek_write", "tell_write", "supports", "remove", "reserved_1", "begin_write_cloning", "accept_empty", "get_file_attributes", "supports_reopen", "get_data", "read_at", "begin_write_in_place", "copy_data", "writev"};
+
+static void
+source_trace_callback(zip_source_t *src, zip_uint32_t layer, zip_source_cmd_t command, zip_uint64_t length, zip_int64_t result, zip_uint64_t duration, void *ud) {
+    (void)src;
+    (void)duration;
+    (void)ud;
+
+    /* durations vary between runs, so they are not shown */
+    if ((size_t)command < sizeof(source_command_names) / sizeof(source_command_names[0])) {
+        printf("layer %u: %s %" PRIu64 " -> %" PRId64 "\n", layer, source_command_names[command], length, result);
+    }
+    else {
+        printf("layer %u: command %d %" PRIu64 " -> %" PRId64 "\n", layer, (int)command, length, result);
+    }
+}
+
+static int
+print_source_trace(char *argv[]) {
+    zip_set_source_trace_callback(source_trace_callback, NULL);
+    return 0;
+}
+
+static int
+read_entries(char *argv[]) {
+    /* output contents of files with comma separated indices, read at once into buffers of size length, to stdout */
+    zip_read_request_t *requests;
+    zip_uint64_t nrequests, i;
+    zip_uint64_t length;
+    char *p;
+    int ret;
+
+    length = strtoull(argv[1], NULL, 10);
+
+    nrequests = 1;
+    for (p = argv[0]; *p != '\0'; p++) {
+        if (*p == ',') {
+            nrequests++;
+        }
+    }
+    if ((requests = (zip_read_request_t *)calloc((size_t)nrequests, sizeof(requests[0]))) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return -1;
+    }
+    p = argv[0];
+    for (i = 0; i < nrequests; i++) {
+        requests[i].index = strtoull(p, &p, 10);
+        if (*p == ',') {
+            p++;
+        }
+        requests[i].length = length;
+        if ((requests[i].data = malloc(length > 0 ? (size_t)length : 1)) == NULL) {
+            fprintf(stderr, "malloc failure\n");
+            nrequests = i;
+            ret = -1;
+            goto done;
+        }
+    }
+
+    if ((ret = zip_read_entries(za, requests, nrequests)) < 0) {
+        fprintf(stderr, "can't read files '%s': %s\n", argv[0], zip_strerror(za));
+    }
+#ifdef _WIN32
+    /* Need to set stdout to binary mode for Windows */
+    setmode(fileno(stdout), _O_BINARY);
+#endif
+    for (i = 0; i < nrequests; i++) {
+        /* data of files that were read successfully is output even if others failed */
+        if (requests[i].result > 0 && fwrite(requests[i].data, (size_t)requests[i].result, 1, stdout) != 1) {
+            fprintf(stderr, "can't write file contents: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+    }
+
+done:
+    for (i = 0; i < nrequests; i++) {
+        free(requests[i].data);
+    }
+    free(requests);
+    return ret;
+}
+
+
+static int
+read_entry(char *argv[]) {
+    /* output file contents read into buffer of size length to stdout */
+    zip_uint64_t idx;
+    zip_uint64_t length;
+    zip_int64_t n;
+    char *buf;
+
+    idx = strtoull(argv[0], NULL, 10);
+    length = strtoull(argv[1], NULL, 10);
+
+    if ((buf = (char *)malloc(length > 0 ? (size_t)length : 1)) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return -1;
+    }
+    if ((n = zip_read_entry(za, idx, buf, length)) < 0) {
+        fprintf(stderr, "can't read file at index '%" PRIu64 "': %s\n", idx, zip_strerror(za));
+        free(buf);
+        return -1;
+    }
+#ifdef _WIN32
+    /* Need to set stdout to binary mode for Windows */
+    setmode(fileno(stdout), _O_BINARY);
+#endif
+    if (n > 0 && fwrite(buf, (size_t)n, 1, stdout) != 1) {
+        fprintf(stderr, "can't write file contents: %s\n", strerror(errno));
+        free(buf);
+        return -1;
+    }
+    free(buf);
+    return 0;
+}
+
+static int
+zrename(char *argv[]) {
+    zip_uint64_t idx;
+    idx = strtoull(argv[0], NULL, 10);
+    if (zip_file_rename(za, idx, decode_filename(argv[1]), 0) < 0) {
+        fprintf(stderr, "can't rename file at index '%" PRIu64 "' to '%s': %s\n", idx, argv[1], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+reserve_entries(char *argv[]) {
+    zip_uint64_t nentries;
+    nentries = strtoull(argv[0], NULL, 10);
+    if (zip_reserve_entries(za, nentries) < 0) {
+        fprintf(stderr, "can't reserve %" PRIu64 " entries: %s\n", nentries, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+replace_file_contents(char *argv[]) {
+    /* replace file contents with data from command line */
+    const char *content;
+    zip_source_t *s;
+    zip_uint64_t idx;
+    idx = strtoull(argv[0], NULL, 10);
+    content = argv[1];
+    if ((s = zip_source_buffer(za, content, strlen(content), 0)) == NULL || zip_file_replace(za, idx, s, 0) < 0) {
+        zip_source_free(s);
+        fprintf(stderr, "error replacing file data: %s\n", zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_extra(char *argv[]) {
+    zip_flags_t geflags;
+    zip_uint16_t eid, eidx;
+    const zip_uint8_t *efdata;
+    zip_uint64_t idx;
+    idx = strtoull(argv[0], NULL, 10);
+    eid = (zip_uint16_t)strtoull(argv[1], NULL, 10);
+    eidx = (zip_uint16_t)strtoull(argv[2], NULL, 10);
+    geflags = get_flags(argv[3]);
+    efdata = (zip_uint8_t *)argv[4];
+    if ((zip_file_extra_field_set(za, idx, eid, eidx, efdata, (zip_uint16_t)strlen((const char *)efdata), geflags)) < 0) {
+        fprintf(stderr, "can't set extra field data for file at index '%" PRIu64 "', extra field id '%d', index '%d': %s\n", idx, eid, eidx, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_archive_alignment(char *argv[]) {
+    zip_uint32_t alignment = (zip_uint32_t)strtoul(argv[0], NULL, 10);
+
+    if (zip_set_archive_alignment(za, alignment) < 0) {
+        fprintf(stderr, "can't set archive alignment to %" PRIu32 ": %s\n", alignment, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_archive_comment(char *argv[]) {
+    if (zip_set_archive_comment(za, argv[0], (zip_uint16_t)strlen(argv[0])) < 0) {
+        fprintf(stderr, "can't set archive comment to '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_archive_prefix(char *argv[]) {
+    if (zip_set_archive_prefix(za, (const zip_uint8_t *)argv[0], strlen(argv[0])) < 0) {
+        fprintf(stderr, "can't set archive prefix to '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_buffered_entry_size(char *argv[]) {
+    zip_uint64_t size = strtoull(argv[0], NULL, 10);
+
+    if (zip_set_buffered_entry_size(za, size) < 0) {
+        fprintf(stderr, "can't set buffered entry size to %" PRIu64 ": %s\n", size, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_compression_block_size(char *argv[]) {
+    zip_uint64_t block_size = strtoull(argv[0], NULL, 10);
+
+    if (zip_set_compression_block_size(za, block_size) < 0) {
+        fprintf(stderr, "can't set compression block size to %" PRIu64 ": %s\n", block_size, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_compression_dictionary(char *argv[]) {
+    zip_source_t *src;
+    zip_stat_t st;
+    zip_int32_t method;
+    void *data = NULL;
+    int ret = -1;
+
+    method = get_compression_method(argv[0]);
+    if ((src = zip_source_file(za, argv[1], 0, -1)) == NULL) {
+        fprintf(stderr, "can't open dictionary '%s': %s\n", argv[1], zip_strerror(za));
+        return -1;
+    }
+    if (zip_source_open(src) < 0 || zip_source_stat(src, &st) < 0 || (st.valid & ZIP_STAT_SIZE) == 0) {
+        fprintf(stderr, "can't read dictionary '%s': %s\n", argv[1], zip_error_strerror(zip_source_error(src)));
+    }
+    else if ((data = malloc(st.size > 0 ? st.size : 1)) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+    }
+    else if (zip_source_read(src, data, st.size) != (zip_int64_t)st.size) {
+        fprintf(stderr, "can't read dictionary '%s': %s\n", argv[1], zip_error_strerror(zip_source_error(src)));
+    }
+    else if (zip_set_compression_dictionary(za, method, data, st.size) < 0) {
+        fprintf(stderr, "can't set compression dictionary for method '%s': %s\n", argv[0], zip_strerror(za));
     }
     else {
-        printf("name '%s' using flags '%s' found at index %" PRId64 "\n", argv[0], argv[1], idx);
+        ret = 0;
     }
 
-    return 0;
+    free(data);
+    zip_source_close(src);
+    zip_source_free(src);
+    return ret;
 }
 
-struct progress_userdata_s {
-    double percentage;
-    double limit;
-};
-
-struct progress_userdata_s progress_userdata;
+static int
+set_compression_level_policy(char *argv[]) {
+    zip_uint32_t policy;
+
+    if (strcasecmp(argv[0], "default") == 0)
+        policy = ZIP_COMPRESSION_LEVEL_DEFAULT;
+    else if (strcasecmp(argv[0], "speed") == 0)
+        policy = ZIP_COMPRESSION_LEVEL_SPEED;
+    else if (strcasecmp(argv[0], "balanced") == 0)
+        policy = ZIP_COMPRESSION_LEVEL_BALANCED;
+    else if (strcasecmp(argv[0], "max") == 0)
+        policy = ZIP_COMPRESSION_LEVEL_MAX;
+    else {
+        fprintf(stderr, "unknown compression level policy '%s'\n", argv[0]);
+        return -1;
+    }
 
-static void
-progress_callback(zip_t *archive, double percentage, void *ud) {
-    printf("%.1f%% done\n", percentage * 100);
-    progress_userdata.percentage = percentage;
+    if (zip_set_compression_level_policy(za, policy) < 0) {
+        fprintf(stderr, "can't set compression level policy to '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
 }
 
 static int
-print_progress(char *argv[]) {
-    zip_register_progress_callback_with_state(za, 0.001, progress_callback, NULL, NULL);
+set_data_order(char *argv[]) {
+    zip_uint64_t indices[64];
+    zip_int64_t n;
+
+    if ((n = parse_indices(argv[0], indices, sizeof(indices) / sizeof(indices[0]))) < 0) {
+        fprintf(stderr, "invalid data order '%s'\n", argv[0]);
+        return -1;
+    }
+
+    if (zip_set_data_order(za, indices, (zip_uint64_t)n) < 0) {
+        fprintf(stderr, "can't set data order to '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
     return 0;
 }
 
 static int
-zrename(char *argv[]) {
-    zip_uint64_t idx;
-    idx = strtoull(argv[0], NULL, 10);
-    if (zip_file_rename(za, idx, decode_filename(argv[1]), 0) < 0) {
-        fprintf(stderr, "can't rename file at index '%" PRIu64 "' to '%s': %s\n", idx, argv[1], zip_strerror(za));
+set_access_profiling(char *argv[]) {
+    if (zip_set_access_profiling(za, (int)strtol(argv[0], NULL, 10)) < 0) {
+        fprintf(stderr, "can't set access profiling to '%s': %s\n", argv[0], zip_strerror(za));
         return -1;
     }
     return 0;
 }
 
 static int
-replace_file_contents(char *argv[]) {
-    /* replace file contents with data from command line */
-    const char *content;
-    zip_source_t *s;
-    zip_uint64_t idx;
-    idx = strtoull(argv[0], NULL, 10);
-    content = argv[1];
-    if ((s = zip_source_buffer(za, content, strlen(content), 0)) == NULL || zip_file_replace(za, idx, s, 0) < 0) {
-        zip_source_free(s);
-        fprintf(stderr, "error replacing file data: %s\n", zip_strerror(za));
+set_decompression_memory_limit(char *argv[]) {
+    zip_uint64_t limit = strtoull(argv[0], NULL, 10);
+
+    if (zip_set_decompression_memory_limit(za, limit) < 0) {
+        fprintf(stderr, "can't set decompression memory limit to %" PRIu64 ": %s\n", limit, zip_strerror(za));
         return -1;
     }
     return 0;
 }
 
 static int
-set_extra(char *argv[]) {
-    zip_flags_t geflags;
-    zip_uint16_t eid, eidx;
-    const zip_uint8_t *efdata;
-    zip_uint64_t idx;
-    idx = strtoull(argv[0], NULL, 10);
-    eid = (zip_uint16_t)strtoull(argv[1], NULL, 10);
-    eidx = (zip_uint16_t)strtoull(argv[2], NULL, 10);
-    geflags = get_flags(argv[3]);
-    efdata = (zip_uint8_t *)argv[4];
-    if ((zip_file_extra_field_set(za, idx, eid, eidx, efdata, (zip_uint16_t)strlen((const char *)efdata), geflags)) < 0) {
-        fprintf(stderr, "can't set extra field data for file at index '%" PRIu64 "', extra field id '%d', index '%d': %s\n", idx, eid, eidx, zip_strerror(za));
+set_decompression_pool_size(char *argv[]) {
+    zip_uint32_t size = (zip_uint32_t)strtoul(argv[0], NULL, 10);
+
+    if (zip_set_decompression_pool_size(size) < 0) {
+        fprintf(stderr, "can't set decompression pool size to %" PRIu32 "\n", size);
         return -1;
     }
     return 0;
 }
 
 static int
-set_archive_comment(char *argv[]) {
-    if (zip_set_archive_comment(za, argv[0], (zip_uint16_t)strlen(argv[0])) < 0) {
-        fprintf(stderr, "can't set archive comment to '%s': %s\n", argv[0], zip_strerror(za));
+set_entry_cache_size(char *argv[]) {
+    zip_uint64_t size = strtoull(argv[0], NULL, 10);
+
+    if (zip_set_entry_cache_size(za, size) < 0) {
+        fprintf(stderr, "can't set entry cache size to %" PRIu64 ": %s\n", size, zip_strerror(za));
         return -1;
     }
     return 0;
@@ -573,6 +1684,21 @@ set_file_compression(char *argv[]) {
     return 0;
 }
 
+static int
+set_file_compression_parameter(char *argv[]) {
+    zip_uint32_t parameter;
+    zip_int64_t value;
+    zip_uint64_t idx;
+    idx = strtoull(argv[0], NULL, 10);
+    parameter = get_compression_parameter(argv[1]);
+    value = strtoll(argv[2], NULL, 10);
+    if (zip_set_file_compression_parameter(za, idx, parameter, value) < 0) {
+        fprintf(stderr, "can't set file compression parameter '%s' at index '%" PRIu64 "' to '%" PRId64 "': %s\n", argv[1], idx, value, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 set_file_encryption(char *argv[]) {
     zip_uint16_t method;
@@ -651,6 +1777,65 @@ set_password(char *argv[]) {
     return 0;
 }
 
+static int
+set_huge_page_threshold(char *argv[]) {
+    zip_set_huge_page_threshold(strtoull(argv[0], NULL, 10));
+    return 0;
+}
+
+static int
+set_io_buffer_size(char *argv[]) {
+    zip_uint64_t size = strtoull(argv[0], NULL, 10);
+
+    if (zip_set_io_buffer_size(za, size) < 0) {
+        fprintf(stderr, "can't set I/O buffer size to %" PRIu64 ": %s\n", size, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_prefetch_profile(char *argv[]) {
+    zip_uint64_t indices[64];
+    zip_uint64_t window = strtoull(argv[1], NULL, 10);
+    zip_int64_t n;
+
+    if ((n = parse_indices(argv[0], indices, sizeof(indices) / sizeof(indices[0]))) < 0) {
+        fprintf(stderr, "invalid prefetch profile '%s'\n", argv[0]);
+        return -1;
+    }
+
+    if (zip_set_prefetch_profile(za, indices, (zip_uint64_t)n, window) < 0) {
+        fprintf(stderr, "can't set prefetch profile to '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_progress_interval(char *argv[]) {
+    zip_uint64_t bytes = strtoull(argv[0], NULL, 10);
+    zip_uint32_t milliseconds = (zip_uint32_t)strtoul(argv[1], NULL, 10);
+
+    if (zip_set_progress_interval(za, bytes, milliseconds) < 0) {
+        fprintf(stderr, "can't set progress interval to %" PRIu64 " bytes, %" PRIu32 " ms: %s\n", bytes, milliseconds, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_num_threads(char *argv[]) {
+    zip_uint32_t num_threads = (zip_uint32_t)strtoul(argv[0], NULL, 10);
+
+    if (zip_set_num_threads(za, num_threads) < 0) {
+        fprintf(stderr, "can't set number of threads to %" PRIu32 ": %s\n", num_threads, zip_strerror(za));
+        return -1;
+    }
+    num_threads_set = num_threads;
+    return 0;
+}
+
 static int
 zstat(char *argv[]) {
     zip_uint64_t idx;
@@ -696,6 +1881,72 @@ zstat(char *argv[]) {
     return 0;
 }
 
+static int
+stat_entries(char *argv[]) {
+    zip_uint64_t first, count;
+    zip_entry_info_t *infos;
+    zip_int64_t i, n;
+
+    first = strtoull(argv[0], NULL, 10);
+    count = strtoull(argv[1], NULL, 10);
+
+    if ((infos = (zip_entry_info_t *)malloc(sizeof(infos[0]) * (size_t)(count > 0 ? count : 1))) == NULL) {
+        fprintf(stderr, "malloc failure\n");
+        return -1;
+    }
+    if ((n = zip_stat_entries(za, first, count, stat_flags, infos)) < 0) {
+        fprintf(stderr, "zip_stat_entries failed on '%" PRIu64 "': %s\n", first, zip_strerror(za));
+        free(infos);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        const zip_entry_info_t *info = infos + i;
+
+        if (info->name == NULL) {
+            printf("%" PRIu64 ": deleted\n", first + (zip_uint64_t)i);
+            continue;
+        }
+        printf("%" PRIu64 ": '%s'", first + (zip_uint64_t)i, encode_filename(info->name));
+        if (info->valid & ZIP_STAT_SIZE)
+            printf(", size %" PRIu64, info->size);
+        if (info->valid & ZIP_STAT_COMP_SIZE)
+            printf(", compressed size %" PRIu64, info->comp_size);
+        if (info->valid & ZIP_STAT_CRC)
+            printf(", crc %0x", info->crc);
+        if (info->valid & ZIP_STAT_COMP_METHOD)
+            printf(", compression method %d", info->comp_method);
+        if (info->offset != ZIP_UINT64_MAX)
+            printf(", offset %" PRIu64, info->offset);
+        printf("\n");
+    }
+
+    free(infos);
+    return 0;
+}
+
+static int
+verify_entry(zip_t *archive, zip_uint64_t idx, zip_error_t *error, void *ud) {
+    (void)archive;
+    (void)ud;
+
+    if (zip_error_code_zip(error) != ZIP_ER_OK) {
+        printf("file at index '%" PRIu64 "': %s\n", idx, zip_error_strerror(error));
+    }
+    return 0;
+}
+
+static int
+verify(char *argv[]) {
+    (void)argv;
+
+    if (zip_verify(za, verify_entry, NULL) < 0) {
+        fprintf(stderr, "can't verify archive: %s\n", zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
 static int parse_archive_flag(const char* arg) {
     if (strcasecmp(arg, "rdonly") == 0) {
         return ZIP_AFL_RDONLY;
@@ -706,12 +1957,81 @@ static int parse_archive_flag(const char* arg) {
     else if (strcasecmp(arg, "want-torrentzip") == 0) {
         return ZIP_AFL_WANT_TORRENTZIP;
     }
+    else if (strcasecmp(arg, "check-source-crc") == 0) {
+        return ZIP_AFL_CHECK_SOURCE_CRC;
+    }
     else if (strcasecmp(arg, "create-or-keep-file-for-empty-archive") == 0) {
         return ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE;
     }
+    else if (strcasecmp(arg, "deduplicate") == 0) {
+        return ZIP_AFL_DEDUPLICATE;
+    }
+    else if (strcasecmp(arg, "digest") == 0) {
+        return ZIP_AFL_DIGEST;
+    }
+    else if (strcasecmp(arg, "embed-index") == 0) {
+        return ZIP_AFL_EMBED_INDEX;
+    }
+    else if (strcasecmp(arg, "log-structured") == 0) {
+        return ZIP_AFL_LOG_STRUCTURED;
+    }
+    else if (strcasecmp(arg, "resumable") == 0) {
+        return ZIP_AFL_RESUMABLE;
+    }
+    return -1;
+}
+
+/* Parse comma separated list of indices into indices, which has room for nindices. Return number of indices or -1 if arg is invalid. */
+static zip_int64_t
+parse_indices(const char *arg, zip_uint64_t *indices, zip_uint64_t nindices) {
+    zip_uint64_t n;
+    char *end;
+
+    n = 0;
+    while (*arg != '\0') {
+        if (n == nindices) {
+            return -1;
+        }
+        indices[n++] = strtoull(arg, &end, 10);
+        if (end == arg || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        arg = *end == ',' ? end + 1 : end;
+    }
+
+    return (zip_int64_t)n;
+}
+
+static int
+parse_phase(const char *arg) {
+    int i;
+
+    for (i = 0; i < (int)(sizeof(phase_names) / sizeof(phase_names[0])); i++) {
+        if (strcasecmp(arg, phase_names[i]) == 0) {
+            return i;
+        }
+    }
     return -1;
 }
 
+static void
+print_close_stats(zip_t *archive, zip_int64_t index, void *ud) {
+    zip_uint32_t phase;
+    zip_phase_stats_t stats;
+
+    (void)ud;
+
+    if (index >= 0) {
+        return;
+    }
+
+    for (phase = ZIP_PHASE_CLOSE; phase < sizeof(phase_names) / sizeof(phase_names[0]); phase++) {
+        if (zip_get_stats(archive, phase, &stats) == 0 && stats.count > 0) {
+            printf("%s: count %" PRIu64 ", in %" PRIu64 ", out %" PRIu64 "\n", phase_names[phase], stats.count, stats.bytes_in, stats.bytes_out);
+        }
+    }
+}
+
 static zip_flags_t
 get_flags(const char *arg) {
     zip_flags_t flags = 0;
@@ -721,8 +2041,12 @@ get_flags(const char *arg) {
         flags |= ZIP_FL_CENTRAL;
     if (strchr(arg, 'd') != NULL)
         flags |= ZIP_FL_NODIR;
+    if (strchr(arg, 'D') != NULL)
+        flags |= ZIP_FL_CHILDREN;
     if (strchr(arg, 'l') != NULL)
         flags |= ZIP_FL_LOCAL;
+    if (strchr(arg, 'n') != NULL)
+        flags |= ZIP_FL_NORMALIZE;
     if (strchr(arg, 'u') != NULL)
         flags |= ZIP_FL_UNCHANGED;
     if (strchr(arg, '8') != NULL)
@@ -764,12 +2088,29 @@ get_compression_method(const char *arg) {
     else if (strcasecmp(arg, "zstd") == 0)
         return ZIP_CM_ZSTD;
 
+#endif
+#if defined(HAVE_LIBLZ4)
+    else if (strcasecmp(arg, "lz4") == 0)
+        return ZIP_CM_LZ4;
 #endif
     else if (strcasecmp(arg, "unknown") == 0)
         return 100;
     return 0; /* TODO: error handling */
 }
 
+static zip_uint32_t
+get_compression_parameter(const char *arg) {
+    if (strcasecmp(arg, "zstd_window_log") == 0)
+        return ZIP_CP_ZSTD_WINDOW_LOG;
+    else if (strcasecmp(arg, "zstd_strategy") == 0)
+        return ZIP_CP_ZSTD_STRATEGY;
+    else if (strcasecmp(arg, "zstd_long_distance_matching") == 0)
+        return ZIP_CP_ZSTD_LONG_DISTANCE_MATCHING;
+    else if (strcasecmp(arg, "zstd_window_log_max") == 0)
+        return ZIP_CP_ZSTD_WINDOW_LOG_MAX;
+    return 0; /* rejected by zip_set_file_compression_parameter() */
+}
+
 static zip_uint16_t
 get_encryption_method(const char *arg) {
     if (strcasecmp(arg, "none") == 0)
@@ -835,36 +2176,76 @@ read_from_file(const char *archive, int flags, zip_error_t *error, zip_uint64_t
 
 dispatch_table_t dispatch_table[] = {{"add", 2, "name content", "add file called name using content", add},
                                      {"add_dir", 1, "name", "add directory", add_dir},
+                                     {"add_dir_tree", 2, "path prefix", "add files and directories below path, with names starting with prefix", add_dir_tree},
                                      {"add_file", 4, "name file_to_add offset len", "add file to archive, len bytes starting from offset", add_file},
                                      {"add_from_zip", 5, "name archivename index offset len", "add file from another archive, len bytes starting from offset", add_from_zip},
+                                     {"add_precompressed", 5, "name file method size crc", "add file containing data compressed with method, with uncompressed size and CRC (hexadecimal)", add_precompressed},
+                                     {"bench", 1, "workload", "measure throughput of reading and rewriting archive", bench},
                                      {"cat", 1, "index", "output file contents to stdout", cat},
                                      {"cat_partial", 3, "index start length", "output partial file contents to stdout", cat_partial},
+                                     {"commit", 0, "", "write changes to archive and keep it open", commit},
+                                     {"copy_file", 2, "archivename index", "copy file from another archive without recompressing", copy_file},
                                      {"count_extra", 2, "index flags", "show number of extra fields for archive entry", count_extra},
                                      {"count_extra_by_id", 3, "index extra_id flags", "show number of extra fields of type extra_id for archive entry", count_extra_by_id},
                                      {"delete", 1, "index", "remove entry", delete},
                                      {"delete_extra", 3, "index extra_idx flags", "remove extra field", delete_extra},
                                      {"delete_extra_by_id", 4, "index extra_id extra_index flags", "remove extra field of type extra_id", delete_extra_by_id},
+                                     {"digest", 1, "index", "read file data and show its SHA-256 digest", zdigest},
+                                     {"extract", 1, "directory", "extract all files to directory", extract},
+                                     {"extract_all", 1, "flags", "read data of all entries and show their sizes", extract_all},
+                                     {"get_access_profile", 0, "", "show indices of entries in order they were first opened", get_access_profile},
                                      {"get_archive_comment", 0, "", "show archive comment", get_archive_comment},
                                      {"get_archive_flag", 1, "flag", "show archive flag", get_archive_flag},
+                                     {"get_archive_prefix", 0, "", "show data before first entry", get_archive_prefix},
+                                     {"get_entry_cache_stats", 0, "", "show hits and misses of entry cache", get_entry_cache_stats},
                                      {"get_extra", 3, "index extra_index flags", "show extra field", get_extra},
                                      {"get_extra_by_id", 4, "index extra_id extra_index flags", "show extra field of type extra_id", get_extra_by_id},
                                      {"get_file_comment", 1, "index", "get file comment", get_file_comment},
+                                     {"get_file_digest", 1, "index", "show SHA-256 digest of file data stored in archive", get_file_digest},
                                      {"get_num_entries", 1, "flags", "get number of entries in archive", get_num_entries},
+                                     {"get_stats", 1, "phase", "show statistics of phase", get_stats},
+                                     {"name_list", 2, "prefix flags", "list entries with name prefix", name_list},
                                      {"name_locate", 2, "name flags", "find entry in archive", name_locate},
+                                     {"name_locate_len", 3, "name length flags", "find entry in archive by first length bytes of name", name_locate_len},
+                                     {"name_locate_many", 2, "names flags", "find entries in archive, names separated by commas", name_locate_many},
                                      {"print_progress", 0, "", "print progress during zip_close()", print_progress},
+                                     {"print_progress_bytes", 0, "", "print bytes done during zip_close() and zip_extract_all()", print_progress_bytes},
+                                     {"print_source_trace", 0, "", "print source commands called from now on", print_source_trace},
+                                     {"read_entries", 2, "indices length", "output contents of files with comma separated indices read at once into buffers of length bytes", read_entries},
+                                     {"read_entry", 2, "index length", "output file contents read at once into buffer of length bytes", read_entry},
                                      {"rename", 2, "index name", "rename entry", zrename},
                                      {"replace_file_contents", 2, "index data", "replace entry with data", replace_file_contents},
+                                     {"reserve_entries", 1, "nentries", "preallocate space for entries", reserve_entries},
+                                     {"set_access_profiling", 1, "enable", "record order in which entries are opened", set_access_profiling},
+                                     {"set_archive_alignment", 1, "alignment", "align data of stored entries", set_archive_alignment},
                                      {"set_archive_comment", 1, "comment", "set archive comment", set_archive_comment},
                                      {"set_archive_flag", 2, "flag", "set archive flag", set_archive_flag},
+                                     {"set_archive_prefix", 1, "prefix", "set data before first entry", set_archive_prefix},
+                                     {"set_buffered_entry_size", 1, "size", "set size up to which entries are written in one go", set_buffered_entry_size},
+                                     {"set_compression_block_size", 1, "size", "set block size for parallel compression", set_compression_block_size},
+                                     {"set_compression_dictionary", 2, "method file", "set dictionary for compression method", set_compression_dictionary},
+                                     {"set_compression_level_policy", 1, "policy", "set policy for compression level 0 (default, speed, balanced, max)", set_compression_level_policy},
+                                     {"set_data_order", 1, "indices", "write data of entries with comma separated indices first", set_data_order},
+                                     {"set_decompression_memory_limit", 1, "limit", "limit memory used for decompressing xz and zstd data", set_decompression_memory_limit},
+                                     {"set_decompression_pool_size", 1, "size", "keep up to size decompression contexts for reuse by all archives", set_decompression_pool_size},
+                                     {"set_entry_cache_size", 1, "size", "cache up to size bytes of decompressed file data", set_entry_cache_size},
                                      {"set_extra", 5, "index extra_id extra_index flags value", "set extra field", set_extra},
                                      {"set_file_comment", 2, "index comment", "set file comment", set_file_comment},
                                      {"set_file_compression", 3, "index method compression_flags", "set file compression method", set_file_compression},
+                                     {"set_file_compression_parameter", 3, "index parameter value", "set file compression parameter", set_file_compression_parameter},
                                      {"set_file_dostime", 3, "index time date", "set file modification time and date (DOS format)", set_file_dostime},
                                      {"set_file_encryption", 3, "index method password", "set file encryption method", set_file_encryption},
                                      {"set_file_mtime", 2, "index timestamp", "set file modification time", set_file_mtime},
                                      {"set_file_mtime_all", 1, "timestamp", "set file modification time for all files", set_file_mtime_all},
+                                     {"set_huge_page_threshold", 1, "size", "back blocks of archive data of at least size bytes in memory with huge pages", set_huge_page_threshold},
+                                     {"set_io_buffer_size", 1, "size", "set size of buffers for file data", set_io_buffer_size},
+                                     {"set_num_threads", 1, "number", "set number of threads used for compression and extraction", set_num_threads},
                                      {"set_password", 1, "password", "set default password for encryption", set_password},
-                                     {"stat", 1, "index", "print information about entry", zstat}
+                                     {"set_prefetch_profile", 2, "indices window", "read up to window entries following an opened one in comma separated indices into entry cache", set_prefetch_profile},
+                                     {"set_progress_interval", 2, "bytes milliseconds", "check progress and cancel callbacks at most every bytes of data or milliseconds", set_progress_interval},
+                                     {"stat", 1, "index", "print information about entry", zstat},
+                                     {"stat_entries", 2, "first count", "print information about count entries starting at first", stat_entries},
+                                     {"verify", 0, "", "check headers and data of all entries", verify}
 #ifdef DISPATCH_REGRESS
                                      ,
                                      DISPATCH_REGRESS
@@ -894,6 +2275,166 @@ dispatch(int argc, char *argv[]) {
 }
 
 
+#define BATCH_MAX_WORDS 1024
+
+/* lines read with -b are kept until the archive is closed, since sources added by commands refer to their arguments */
+static char **batch_lines;
+static unsigned int batch_lines_count, batch_lines_alloc;
+
+static char *
+read_batch_line(FILE *f) {
+    size_t alloc = 256, length = 0;
+    char *line, *new_line;
+
+    if ((line = (char *)malloc(alloc)) == NULL) {
+        return NULL;
+    }
+
+    while (fgets(line + length, (int)(alloc - length), f) != NULL) {
+        length += strlen(line + length);
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+            if (length > 0 && line[length - 1] == '\r') {
+                line[--length] = '\0';
+            }
+            return line;
+        }
+        if (length + 1 == alloc) {
+            alloc *= 2;
+            if ((new_line = (char *)realloc(line, alloc)) == NULL) {
+                free(line);
+                return NULL;
+            }
+            line = new_line;
+        }
+    }
+
+    if (length == 0 || ferror(f)) {
+        free(line);
+        return NULL;
+    }
+    return line;
+}
+
+
+/* Split line into words in place. Words are separated by blanks; a word in double quotes may contain blanks, and \" and \\ in it stand for " and \. */
+static int
+split_batch_line(char *line, char *words[], int max_words) {
+    char *p = line, *out;
+    int count = 0;
+
+    while (1) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0' || (count == 0 && *p == '#')) {
+            return count;
+        }
+        if (count == max_words) {
+            return -1;
+        }
+        words[count++] = out = p;
+        if (*p == '"') {
+            p++;
+            while (*p != '"') {
+                if (*p == '\0') {
+                    return -1;
+                }
+                if (*p == '\\' && (p[1] == '"' || p[1] == '\\')) {
+                    p++;
+                }
+                *(out++) = *(p++);
+            }
+            p++;
+            if (*p != '\0' && *p != ' ' && *p != '\t') {
+                return -1;
+            }
+        }
+        else {
+            while (*p != '\0' && *p != ' ' && *p != '\t') {
+                *(out++) = *(p++);
+            }
+        }
+        if (*p != '\0') {
+            p++;
+        }
+        *out = '\0';
+    }
+}
+
+
+static int
+run_batch(const char *fname) {
+    FILE *f;
+    char *line, *words[BATCH_MAX_WORDS];
+    unsigned int line_number = 0;
+    int arg, nwords, ret;
+
+    if (strcmp(fname, "-") == 0) {
+        f = stdin;
+    }
+    else if ((f = fopen(fname, "r")) == NULL) {
+        fprintf(stderr, "can't open command file '%s': %s\n", fname, strerror(errno));
+        return -1;
+    }
+
+    ret = 0;
+    while (ret >= 0 && (line = read_batch_line(f)) != NULL) {
+        line_number++;
+        if (batch_lines_count == batch_lines_alloc) {
+            unsigned int new_alloc = batch_lines_alloc == 0 ? 16 : batch_lines_alloc * 2;
+            char **new_lines;
+
+            if ((new_lines = (char **)realloc(batch_lines, new_alloc * sizeof(batch_lines[0]))) == NULL) {
+                free(line);
+                fprintf(stderr, "can't allocate memory\n");
+                ret = -1;
+                break;
+            }
+            batch_lines = new_lines;
+            batch_lines_alloc = new_alloc;
+        }
+        batch_lines[batch_lines_count++] = line;
+
+        if ((nwords = split_batch_line(line, words, BATCH_MAX_WORDS)) < 0) {
+            fprintf(stderr, "invalid command line %u in '%s'\n", line_number, fname);
+            ret = -1;
+            break;
+        }
+        for (arg = 0; arg < nwords; arg += ret) {
+            if ((ret = dispatch(nwords - arg, words + arg)) < 0) {
+                fprintf(stderr, "command line %u in '%s' failed\n", line_number, fname);
+                break;
+            }
+        }
+        fflush(stdout);
+    }
+
+    if (ret >= 0 && ferror(f)) {
+        fprintf(stderr, "can't read command file '%s': %s\n", fname, strerror(errno));
+        ret = -1;
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    return ret < 0 ? -1 : 0;
+}
+
+
+static void
+free_batch_lines(void) {
+    unsigned int i;
+
+    for (i = 0; i < batch_lines_count; i++) {
+        free(batch_lines[i]);
+    }
+    free(batch_lines);
+    batch_lines = NULL;
+    batch_lines_count = batch_lines_alloc = 0;
+}
+
+
 static void
 usage(const char *progname, const char *reason) {
     unsigned int i;
@@ -902,16 +2443,21 @@ usage(const char *progname, const char *reason) {
         out = stdout;
     else
         out = stderr;
-    fprintf(out, "usage: %s [-ceghnrst]" USAGE_REGRESS " [-l len] [-o offset] archive command1 [args] [command2 [args] ...]\n", progname);
+    fprintf(out, "usage: %s [-cDefghILNnPRrstT]" USAGE_REGRESS " [-b file] [-l len] [-o offset] [-p size] archive command1 [args] [command2 [args] ...]\n", progname);
     if (reason != NULL) {
         fprintf(out, "%s\n", reason);
         exit(1);
     }
 
     fprintf(out, "\nSupported options are:\n"
+                 "\t-b file\t\tafter the commands given as arguments, run commands read from file, one line at a time (- for standard input)\n"
                  "\t-c\t\tcheck consistency\n"
+                 "\t-D\t\trebuild central directory from local headers if it can't be read\n"
                  "\t-e\t\terror if archive already exists (only useful with -n)\n"
+                 "\t-f\t\tdon't change archive metadata after opening it, for sharing it with forked processes (only useful with -R)\n"
 #ifdef FOR_REGRESS
+                 "\t-C size\t\tread archive through cache with blocks of size bytes\n"
+                 "\t-d\t\tread and write archive bypassing the page cache\n"
                  "\t-F size\t\tfragment size for in memory archive\n"
 #endif
                  "\t-g\t\tguess file name encoding (for stat)\n"
@@ -919,15 +2465,27 @@ usage(const char *progname, const char *reason) {
                  "\t-H\t\twrite files with holes compactly\n"
 #endif
                  "\t-h\t\tdisplay this usage\n"
+                 "\t-I\t\tbuild index of names only when a name is looked up\n"
+                 "\t-L\t\tread central directory entries only when needed\n"
                  "\t-l len\t\tonly use len bytes of file\n"
 #ifdef FOR_REGRESS
+                 "\t-M\t\tread archive from memory mapped file\n"
                  "\t-m\t\tread archive into memory, and modify there; write out at end\n"
 #endif
+                 "\t-N\t\tdon't check CRC of file data when reading\n"
                  "\t-n\t\tcreate archive if it doesn't exist\n"
                  "\t-o offset\tstart reading file at offset\n"
+                 "\t-P\t\tcollect statistics, print those of writing archive when closing it\n"
+                 "\t-p size\t\tread archive into memory when opening it if it is at most size bytes\n"
+                 "\t-R\t\topen archive read-only\n"
                  "\t-r\t\tprint raw file name encoding without translation (for stat)\n"
                  "\t-s\t\tfollow file name convention strictly (for stat)\n"
-                 "\t-t\t\tdisregard current archive contents, if any\n");
+                 "\t-T\t\tallow reading archive from multiple threads (only useful with -R)\n"
+                 "\t-t\t\tdisregard current archive contents, if any\n"
+#ifdef FOR_REGRESS
+                 "\t-w\t\twrite archive through memory mapping\n"
+#endif
+                 );
     fprintf(out, "\nSupported commands and arguments are:\n");
     for (i = 0; i < sizeof(dispatch_table) / sizeof(dispatch_table_t); i++) {
         fprintf(out, "\t%s %s\n\t    %s\n\n", dispatch_table[i].cmdline_name, dispatch_table[i].arg_names, dispatch_table[i].description);
@@ -940,6 +2498,7 @@ usage(const char *progname, const char *reason) {
                  "\tc\tZIP_FL_CENTRAL\n"
                  "\td\tZIP_FL_NODIR\n"
                  "\tl\tZIP_FL_LOCAL\n"
+                 "\tn\tZIP_FL_NORMALIZE\n"
                  "\tr\tZIP_FL_ENC_RAW\n"
                  "\ts\tZIP_FL_ENC_STRICT\n"
                  "\tu\tZIP_FL_UNCHANGED\n");
@@ -953,8 +2512,11 @@ usage(const char *progname, const char *reason) {
     if (zip_compression_method_supported(ZIP_CM_BZIP2, 1)) {
         fprintf(out, "\tbzip2\n");
     }
-    fprintf(out, "\tdeflate\n"
-                 "\tstore\n");
+    fprintf(out, "\tdeflate\n");
+    if (zip_compression_method_supported(ZIP_CM_LZ4, 1)) {
+        fprintf(out, "\tlz4\n");
+    }
+    fprintf(out, "\tstore\n");
     if (zip_compression_method_supported(ZIP_CM_XZ, 1)) {
         fprintf(out, "\txz\n");
     }
@@ -990,42 +2552,72 @@ main(int argc, char *argv[]) {
     const char *archive;
     unsigned int i;
     int c, arg, err, flags;
-    const char *prg;
+    const char *prg, *batch_file = NULL;
     zip_uint64_t len = 0, offset = 0;
     zip_error_t error;
 
     flags = 0;
     prg = argv[0];
 
-    while ((c = getopt(argc, argv, "ceghl:no:rst" OPTIONS_REGRESS)) != -1) {
+    while ((c = getopt(argc, argv, "b:cDefghILl:Nno:Pp:RrsTt" OPTIONS_REGRESS)) != -1) {
         switch (c) {
+        case 'b':
+            batch_file = optarg;
+            break;
         case 'c':
             flags |= ZIP_CHECKCONS;
             break;
+        case 'D':
+            flags |= ZIP_RECOVER;
+            break;
         case 'e':
             flags |= ZIP_EXCL;
             break;
+        case 'f':
+            flags |= ZIP_FORKSAFE;
+            break;
         case 'g':
             stat_flags = ZIP_FL_ENC_GUESS;
             break;
         case 'h':
             usage(prg, NULL);
             break;
+        case 'I':
+            flags |= ZIP_LAZY_NAMES;
+            break;
+        case 'L':
+            flags |= ZIP_LAZY_CDIR;
+            break;
         case 'l':
             len = strtoull(optarg, NULL, 10);
             break;
+        case 'N':
+            flags |= ZIP_SKIP_CRC_CHECK;
+            break;
         case 'n':
             flags |= ZIP_CREATE;
             break;
         case 'o':
             offset = strtoull(optarg, NULL, 10);
             break;
+        case 'P':
+            flags |= ZIP_COLLECT_STATS;
+            break;
+        case 'p':
+            zip_set_default_preload_size(strtoull(optarg, NULL, 10));
+            break;
+        case 'R':
+            flags |= ZIP_RDONLY;
+            break;
         case 'r':
             stat_flags = ZIP_FL_ENC_RAW;
             break;
         case 's':
             stat_flags = ZIP_FL_ENC_STRICT;
             break;
+        case 'T':
+            flags |= ZIP_THREADSAFE;
+            break;
         case 't':
             flags |= ZIP_TRUNCATE;
             break;
@@ -1041,15 +2633,15 @@ main(int argc, char *argv[]) {
         }
     }
 
-    if (optind >= argc - 1)
+    if (optind >= argc - (batch_file == NULL ? 1 : 0))
         usage(prg, "too few arguments");
 
     arg = optind;
 
     archive = argv[arg++];
 
-    if (flags == 0)
-        flags = ZIP_CREATE;
+    if ((flags & ~ZIP_COLLECT_STATS) == 0)
+        flags |= ZIP_CREATE;
 
     zip_error_init(&error);
     za = ziptool_open(archive, flags, &error, offset, len);
@@ -1060,6 +2652,10 @@ main(int argc, char *argv[]) {
     }
     zip_error_fini(&error);
 
+    if (flags & ZIP_COLLECT_STATS) {
+        zip_register_stats_callback(za, print_close_stats, NULL);
+    }
+
 #ifdef REGRESS_PREPARE_ARGS
     REGRESS_PREPARE_ARGS
 #endif
@@ -1076,6 +2672,9 @@ main(int argc, char *argv[]) {
             break;
         }
     }
+    if (err == 0 && batch_file != NULL && run_batch(batch_file) < 0) {
+        err = 1;
+    }
 
 #ifdef PRECLOSE_REGRESS
     PRECLOSE_REGRESS;
@@ -1085,6 +2684,7 @@ main(int argc, char *argv[]) {
         fprintf(stderr, "can't close zip archive '%s': %s\n", archive, zip_strerror(za));
         return 1;
     }
+    free_batch_lines();
     if (ziptool_post_close(archive) < 0) {
         err = 1;
     }